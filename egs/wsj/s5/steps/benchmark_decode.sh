@@ -0,0 +1,108 @@
+#!/bin/bash
+
+# Apache 2.0
+
+# This script measures the speed of decoding with an nnet3 model on a small,
+# fixed set of utterances, using online2-wav-nnet3-benchmark, which times the
+# feature extraction, the nnet computation, the search, the lattice
+# determinization and (with --rescore-lang) the LM rescoring separately.  The
+# results go in <dir>/benchmark.json, with a description of the machine in
+# <dir>/system.txt; compare the results of different builds or machines with
+# utils/compare_benchmarks.py.
+
+# Begin configuration section.
+online_config=     # config file for the features (and iVectors), as for
+                   # online2-wav-nnet3-latgen-faster; default is
+                   # <model-dir>/conf/online.conf if it exists.
+num_utts=50        # the number of utterances to decode (the first ones, after
+                   # sorting, so that the set is always the same).
+use_gpu=no
+old_lang=          # with --rescore-lang, the lang dir that the graph was built
+                   # from, whose G.fst is subtracted when rescoring.
+rescore_lang=      # if set, rescore with $rescore_lang/G.carpa
+acwt=0.1
+beam=15.0
+lattice_beam=8.0
+max_active=7000
+frames_per_chunk=50
+extra_opts=        # any other options for online2-wav-nnet3-benchmark
+iter=final
+# End configuration section.
+
+echo "$0 $@"  # Print the command line for logging
+
+[ -f ./path.sh ] && . ./path.sh; # source the path.
+. parse_options.sh || exit 1;
+
+if [ $# != 4 ]; then
+   echo "Usage: $0 [options] <model-dir> <graph-dir> <data-dir> <dir>"
+   echo "e.g.: $0 --num-utts 50 exp/nnet3/tdnn exp/tri4b/graph data/test_dev93 exp/nnet3/tdnn/bench"
+   echo ""
+   echo "main options (for others, see top of script file)"
+   echo "  --online-config <config-file>                    # feature (and iVector) configuration"
+   echo "  --num-utts <n>                                   # number of utterances to decode (default: 50)"
+   echo "  --use-gpu <yes|no|optional>                      # use the GPU for the nnet (default: no)"
+   echo "  --rescore-lang <lang-dir>                        # rescore with <lang-dir>/G.carpa ..."
+   echo "  --old-lang <lang-dir>                            # ... removing the LM in <lang-dir>/G.fst"
+   echo "  --iter <iter>                                    # Iteration of model to decode; default is final."
+   exit 1;
+fi
+
+srcdir=$1
+graphdir=$2
+data=$3
+dir=$4
+
+[ -z "$online_config" ] && [ -f $srcdir/conf/online.conf ] && \
+  online_config=$srcdir/conf/online.conf
+
+for f in $srcdir/${iter}.mdl $graphdir/HCLG.fst $data/wav.scp $online_config; do
+  if [ ! -f $f ]; then
+    echo "$0: no such file $f"
+    exit 1;
+  fi
+done
+
+rescore_opts=
+if [ ! -z "$rescore_lang" ]; then
+  [ ! -f $rescore_lang/G.carpa ] && echo "$0: no such file $rescore_lang/G.carpa" && exit 1;
+  rescore_opts="--rescore-const-arpa=$rescore_lang/G.carpa"
+  if [ ! -z "$old_lang" ]; then
+    [ ! -f $old_lang/G.fst ] && echo "$0: no such file $old_lang/G.fst" && exit 1;
+    rescore_opts="$rescore_opts --rescore-old-lm=$old_lang/G.fst"
+  else
+    echo "$0: warning: rescoring without --old-lang, so the old LM costs are not removed."
+  fi
+fi
+
+mkdir -p $dir/log
+
+if [ -f $data/segments ]; then
+  sort $data/segments | head -n $num_utts > $dir/segments
+  utils/filter_scp.pl <(awk '{print $2}' $dir/segments) $data/wav.scp > $dir/wav.scp
+  wav_rspecifier="ark,s,cs:extract-segments scp,p:$dir/wav.scp $dir/segments ark:- |"
+else
+  sort $data/wav.scp | head -n $num_utts > $dir/wav.scp
+  wav_rspecifier="ark,s,cs:wav-copy scp,p:$dir/wav.scp ark:- |"
+fi
+
+config_opts=
+[ ! -z "$online_config" ] && config_opts="--config=$online_config"
+
+# a description of the machine, to go with the results.
+( uname -a
+  grep -m 1 'model name' /proc/cpuinfo 2>/dev/null
+  echo "cpus: $(grep -c ^processor /proc/cpuinfo 2>/dev/null)"
+  which nvidia-smi >/dev/null 2>&1 && nvidia-smi --query-gpu=name,driver_version --format=csv,noheader
+  echo "binary: $(which online2-wav-nnet3-benchmark)"
+) > $dir/system.txt
+
+online2-wav-nnet3-benchmark $config_opts --use-gpu=$use_gpu \
+  --acoustic-scale=$acwt --beam=$beam --lattice-beam=$lattice_beam \
+  --max-active=$max_active --frames-per-chunk=$frames_per_chunk \
+  $rescore_opts $extra_opts $srcdir/${iter}.mdl $graphdir/HCLG.fst \
+  "$wav_rspecifier" $dir/benchmark.json 2> $dir/log/benchmark.log || exit 1;
+
+grep 'real-time factor' $dir/log/benchmark.log
+echo "$0: wrote $dir/benchmark.json"
+exit 0;
@@ -17,6 +17,7 @@ l2_penalty=0
 train_tool="nnet-train-frmshuff"
 train_tool_opts="--minibatch-size=256 --randomizer-size=32768 --randomizer-seed=777"
 feature_transform=
+num_jobs=1 # >1 : train on N parts of the data in parallel (one GPU each), average the models,
 
 # learn rate scheduling,
 max_iters=20
@@ -100,16 +101,42 @@ for iter in $(seq -w $max_iters); do
   
   # training,
   log=$dir/log/iter${iter}.tr.log; hostname>$log
-  $train_tool --cross-validate=false --randomize=true --verbose=$verbose $train_tool_opts \
-    --learn-rate=$learn_rate --momentum=$momentum \
-    --l1-penalty=$l1_penalty --l2-penalty=$l2_penalty \
-    ${feature_transform:+ --feature-transform=$feature_transform} \
-    ${frame_weights:+ "--frame-weights=$frame_weights"} \
-    ${utt_weights:+ "--utt-weights=$utt_weights"} \
-    "$feats_tr" "$labels_tr" $mlp_best $mlp_next \
-    2>> $log || exit 1; 
-
-  tr_loss=$(cat $dir/log/iter${iter}.tr.log | grep "AvgLoss:" | tail -n 1 | awk '{ print $4; }')
+  if [ $num_jobs == 1 ]; then
+    $train_tool --cross-validate=false --randomize=true --verbose=$verbose $train_tool_opts \
+      --learn-rate=$learn_rate --momentum=$momentum \
+      --l1-penalty=$l1_penalty --l2-penalty=$l2_penalty \
+      ${feature_transform:+ --feature-transform=$feature_transform} \
+      ${frame_weights:+ "--frame-weights=$frame_weights"} \
+      ${utt_weights:+ "--utt-weights=$utt_weights"} \
+      "$feats_tr" "$labels_tr" $mlp_best $mlp_next \
+      2>> $log || exit 1; 
+    tr_loss=$(cat $dir/log/iter${iter}.tr.log | grep "AvgLoss:" | tail -n 1 | awk '{ print $4; }')
+  else
+    # model averaging: each job trains on its part of the data (selected by
+    # hashing the utterance keys) on its own GPU, then we average the models,
+    pids=()
+    for job in $(seq 0 $((num_jobs-1))); do
+      log_job=$dir/log/iter${iter}.tr.job${job}.log; hostname>$log_job
+      $train_tool --cross-validate=false --randomize=true --verbose=$verbose $train_tool_opts \
+        --num-jobs=$num_jobs --job-index=$job \
+        --learn-rate=$learn_rate --momentum=$momentum \
+        --l1-penalty=$l1_penalty --l2-penalty=$l2_penalty \
+        ${feature_transform:+ --feature-transform=$feature_transform} \
+        ${frame_weights:+ "--frame-weights=$frame_weights"} \
+        ${utt_weights:+ "--utt-weights=$utt_weights"} \
+        "$feats_tr" "$labels_tr" $mlp_best $mlp_next.job${job} \
+        2>> $log_job &
+      pids+=($!)
+    done
+    for pid in ${pids[@]}; do wait $pid || exit 1; done
+    nnet-average $(for job in $(seq 0 $((num_jobs-1))); do echo $mlp_next.job${job}; done) \
+      $mlp_next 2>> $log || exit 1;
+    rm $mlp_next.job*
+    # the training loss is the average over the jobs,
+    tr_loss=$(for job in $(seq 0 $((num_jobs-1))); do
+      grep "AvgLoss:" $dir/log/iter${iter}.tr.job${job}.log | tail -n 1
+    done | awk '{ sum += $4; n++; } END { print sum/n; }')
+  fi
   echo -n "TRAIN AVG.LOSS $(printf "%.4f" $tr_loss), (lrate$(printf "%.6g" $learn_rate)), "
   
   # cross-validation,
@@ -0,0 +1,78 @@
+#!/usr/bin/env python
+
+# Apache 2.0
+
+# This script prints a table comparing the results of one or more runs of
+# steps/benchmark_decode.sh (the benchmark.json files written by
+# online2-wav-nnet3-benchmark): the overall real-time factor, and the
+# real-time factor, speed and peak memory of each stage of decoding.
+
+from __future__ import print_function
+import json
+import sys
+
+if len(sys.argv) < 2:
+    sys.stderr.write("Usage: compare_benchmarks.py <benchmark.json> [<benchmark.json> ...]\n"
+                     "e.g.: compare_benchmarks.py exp/nnet3/tdnn/bench_{cpu,gpu}/benchmark.json\n")
+    sys.exit(1)
+
+results = []
+for filename in sys.argv[1:]:
+    try:
+        with open(filename) as f:
+            results.append(json.load(f))
+    except (IOError, ValueError) as e:
+        sys.stderr.write("compare_benchmarks.py: error reading {0}: {1}\n".format(filename, e))
+        sys.exit(1)
+
+# the stages in the order they are run, keeping any we don't know about.
+stages = []
+for r in results:
+    for s in r.get('stages', []):
+        if s['name'] not in stages:
+            stages.append(s['name'])
+
+
+def stage(r, name):
+    for s in r.get('stages', []):
+        if s['name'] == name:
+            return s
+    return None
+
+
+def fmt(value, precision):
+    if value is None:
+        return '-'
+    if not isinstance(value, (int, float)):
+        return str(value)
+    return '{0:.{1}f}'.format(value, precision)
+
+
+rows = []  # (label, [value for each file])
+rows.append(('# system', [str(i + 1) for i in range(len(results))]))
+rows.append(('device', [r.get('device') for r in results]))
+rows.append(('blas', [r.get('blas') for r in results]))
+rows.append(('utterances', [fmt(r.get('num_utterances'), 0) for r in results]))
+rows.append(('audio seconds', [fmt(r.get('audio_seconds'), 1) for r in results]))
+rows.append(('likelihood/frame', [fmt(r.get('likelihood_per_frame'), 4) for r in results]))
+rows.append(('total RTF', [fmt(r.get('rtf'), 4) for r in results]))
+rows.append(('peak RSS (MB)', [fmt(r.get('peak_rss_mb'), 0) for r in results]))
+for name in stages:
+    ss = [stage(r, name) for r in results]
+    rows.append((name + ' RTF', [fmt(s and s.get('rtf'), 4) for s in ss]))
+    if any(s is not None and 'tokens_per_second' in s for s in ss):
+        rows.append((name + ' tokens/s', [fmt(s and s.get('tokens_per_second'), 0)
+                                          for s in ss]))
+    rows.append((name + ' peak RSS (MB)', [fmt(s and s.get('peak_rss_mb'), 0) for s in ss]))
+    if any(s is not None and s.get('peak_gpu_memory_mb') for s in ss):
+        rows.append((name + ' peak GPU (MB)', [fmt(s and s.get('peak_gpu_memory_mb'), 0)
+                                               for s in ss]))
+
+label_width = max(len(label) for label, _ in rows)
+value_width = max(10, max(len(v or '-') for _, values in rows for v in values))
+for label, values in rows:
+    print(label.ljust(label_width) + ''.join((v or '-').rjust(value_width + 2)
+                                             for v in values))
+
+for i, filename in enumerate(sys.argv[1:]):
+    print('# {0}: {1}'.format(i + 1, filename))
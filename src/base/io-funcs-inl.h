@@ -178,6 +178,60 @@ template<class T> inline void ReadIntegerVector(std::istream &is,
             << is.tellg();
 }
 
+template<class T> inline void WriteBasicTypeArray(std::ostream &os,
+                                                  const T *data, size_t size) {
+  KALDI_ASSERT(std::numeric_limits<T>::is_specialized);
+  char len_c = (std::numeric_limits<T>::is_signed ? 1 :  -1)
+      * static_cast<char>(sizeof(T));
+  os.put(len_c);
+  if (size != 0)
+    os.write(reinterpret_cast<const char *>(data), sizeof(T) * size);
+  if (os.fail()) {
+    throw std::runtime_error("Write failure in WriteBasicTypeArray.");
+  }
+}
+
+// Helper for ReadBasicTypeArray: reads "size" elements of type S and converts
+// them to type T (used to convert between float and double).
+template<class S, class T> inline void ReadConvertedTypeArray(std::istream &is,
+                                                              size_t size,
+                                                              T *data) {
+  if (size == 0) return;
+  std::vector<S> buf(size);
+  is.read(reinterpret_cast<char *>(&(buf[0])), sizeof(S) * size);
+  for (size_t i = 0; i < size; i++)
+    data[i] = static_cast<T>(buf[i]);
+}
+
+template<class T> inline void ReadBasicTypeArray(std::istream &is,
+                                                 size_t size, T *data) {
+  KALDI_ASSERT(std::numeric_limits<T>::is_specialized);
+  int len_c_in = is.get();
+  if (len_c_in == -1)
+    KALDI_ERR << "ReadBasicTypeArray: encountered end of stream.";
+  char len_c = static_cast<char>(len_c_in), len_c_expected
+      = (std::numeric_limits<T>::is_signed ? 1 :  -1)
+      * static_cast<char>(sizeof(T));
+  if (len_c == len_c_expected) {
+    if (size != 0)
+      is.read(reinterpret_cast<char *>(data), sizeof(T) * size);
+  } else if (!std::numeric_limits<T>::is_integer &&
+             len_c == static_cast<char>(sizeof(float))) {
+    ReadConvertedTypeArray<float>(is, size, data);
+  } else if (!std::numeric_limits<T>::is_integer &&
+             len_c == static_cast<char>(sizeof(double))) {
+    ReadConvertedTypeArray<double>(is, size, data);
+  } else {
+    KALDI_ERR << "ReadBasicTypeArray: did not get expected type, "
+              << static_cast<int>(len_c) << " vs. "
+              << static_cast<int>(len_c_expected);
+  }
+  if (is.fail()) {
+    KALDI_ERR << "Read failure in ReadBasicTypeArray, file position is "
+              << is.tellg();
+  }
+}
+
 // Initialize an opened stream for writing by writing an optional binary
 // header and modifying the floating-point precision.
 inline void InitKaldiOutputStream(std::ostream &os, bool binary) {
@@ -123,7 +123,36 @@ void UnitTestIo(bool binary) {
   }
 }
 
+void UnitTestBasicTypeArray() {
+  std::vector<int32> iv(Rand() % 10);
+  for (size_t i = 0; i < iv.size(); i++)
+    iv[i] = Rand() % 1000 - 500;
+  std::vector<uint16> uv(Rand() % 10);
+  for (size_t i = 0; i < uv.size(); i++)
+    uv[i] = Rand() % 1000;
+  std::vector<double> dv(Rand() % 10);
+  for (size_t i = 0; i < dv.size(); i++)
+    dv[i] = RandGauss();
+  std::ostringstream os;
+  WriteBasicTypeArray(os, (iv.empty() ? NULL : &(iv[0])), iv.size());
+  WriteBasicTypeArray(os, (uv.empty() ? NULL : &(uv[0])), uv.size());
+  WriteBasicTypeArray(os, (dv.empty() ? NULL : &(dv[0])), dv.size());
+  WriteBasicTypeArray(os, (dv.empty() ? NULL : &(dv[0])), dv.size());
 
+  std::istringstream is(os.str());
+  std::vector<int32> iv2(iv.size());
+  std::vector<uint16> uv2(uv.size());
+  std::vector<double> dv2(dv.size());
+  std::vector<float> fv2(dv.size());  // read doubles as floats.
+  ReadBasicTypeArray(is, iv2.size(), (iv2.empty() ? NULL : &(iv2[0])));
+  ReadBasicTypeArray(is, uv2.size(), (uv2.empty() ? NULL : &(uv2[0])));
+  ReadBasicTypeArray(is, dv2.size(), (dv2.empty() ? NULL : &(dv2[0])));
+  ReadBasicTypeArray(is, fv2.size(), (fv2.empty() ? NULL : &(fv2[0])));
+  KALDI_ASSERT(iv2 == iv && uv2 == uv && dv2 == dv);
+  for (size_t i = 0; i < dv.size(); i++)
+    AssertEqual(fv2[i], static_cast<float>(dv[i]));
+  KALDI_ASSERT(is.peek() == -1);
+}
 
 }  // end namespace kaldi.
 
@@ -132,6 +161,7 @@ int main() {
   for (size_t i = 0; i < 10; i++) {
     UnitTestIo(false);
     UnitTestIo(true);
+    UnitTestBasicTypeArray();
   }
   KALDI_ASSERT(1);  // just to check that KALDI_ASSERT does not fail for 1.
   return 0;
@@ -182,6 +182,22 @@ template<class T> inline void WriteIntegerVector(std::ostream &os, bool binary,
 template<class T> inline void ReadIntegerVector(std::istream &is, bool binary,
                                                 std::vector<T> *v);
 
+/// WriteBasicTypeArray writes a contiguous array of integer or floating-point
+/// values in binary mode only, as a single type-size byte (the same as
+/// WriteBasicType would write for each element) followed by the raw data in
+/// one block.  The size is not written; the caller is responsible for that.
+/// This is much faster than calling WriteBasicType for each element, and is
+/// intended for bulk data in Holders and similar code.  Throws on error.
+template<class T> inline void WriteBasicTypeArray(std::ostream &os,
+                                                  const T *data, size_t size);
+
+/// ReadBasicTypeArray reads an array written by WriteBasicTypeArray,
+/// where "size" is the number of elements.  As with ReadBasicType, it will
+/// convert between float and double if the data was written with the other
+/// floating-point type.  Throws on error.
+template<class T> inline void ReadBasicTypeArray(std::istream &is,
+                                                 size_t size, T *data);
+
 /// The WriteToken functions are for writing nonempty sequences of non-space
 /// characters. They are not for general strings.
 void WriteToken(std::ostream &os, bool binary, const char *token);
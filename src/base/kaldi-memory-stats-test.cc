@@ -0,0 +1,118 @@
+// base/kaldi-memory-stats-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//  http://www.apache.org/licenses/LICENSE-2.0
+
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <pthread.h>
+#include <sstream>
+#include <string>
+
+#include "base/kaldi-common.h"
+#include "base/kaldi-memory-stats.h"
+
+namespace kaldi {
+
+static void *AllocateSomething(void *arg) {
+  // The tag is per thread: this thread starts with kMemoryOther.
+  KALDI_ASSERT(CurrentMemoryTag() == kMemoryOther);
+  MemoryTagScope scope(kMemoryFeature);
+  for (int32 i = 0; i < 1000; i++) {
+    MemoryStatsAdd(CurrentMemoryTag(), 10);
+    MemoryStatsAdd(CurrentMemoryTag(), -10);
+  }
+  return NULL;
+}
+
+void UnitTestMemoryStats() {
+  EnableMemoryStats();
+  KALDI_ASSERT(MemoryStatsEnabled());
+  KALDI_ASSERT(CurrentMemoryTag() == kMemoryOther);
+  {
+    MemoryTagScope decoder_scope(kMemoryDecoder);
+    KALDI_ASSERT(CurrentMemoryTag() == kMemoryDecoder);
+    MemoryStatsAdd(CurrentMemoryTag(), 1000);
+    {
+      MemoryTagScope lattice_scope(kMemoryLattice);
+      KALDI_ASSERT(CurrentMemoryTag() == kMemoryLattice);
+      MemoryStatsAdd(CurrentMemoryTag(), 500);
+    }
+    KALDI_ASSERT(CurrentMemoryTag() == kMemoryDecoder);
+    MemoryStatsAdd(CurrentMemoryTag(), -1000);
+  }
+  KALDI_ASSERT(CurrentMemoryTag() == kMemoryOther);
+  KALDI_ASSERT(GetMemoryStats(kMemoryDecoder).current_bytes == 0 &&
+               GetMemoryStats(kMemoryDecoder).peak_bytes == 1000);
+  KALDI_ASSERT(GetMemoryStats(kMemoryLattice).current_bytes == 500 &&
+               GetMemoryStats(kMemoryLattice).peak_bytes == 500);
+  // The peak of the total is the peak of the sum.
+  KALDI_ASSERT(GetTotalMemoryStats().current_bytes == 500 &&
+               GetTotalMemoryStats().peak_bytes == 1500);
+  MemoryStatsAdd(kMemoryLattice, -500);
+
+  {
+    // GPU memory is not part of the total.
+    MemoryStatsEstimate gpu(kMemoryCuAllocator);
+    gpu.Set(1 << 20);
+    KALDI_ASSERT(GetMemoryStats(kMemoryCuAllocator).current_bytes == 1 << 20);
+    KALDI_ASSERT(GetTotalMemoryStats().current_bytes == 0);
+  }
+  KALDI_ASSERT(GetMemoryStats(kMemoryCuAllocator).current_bytes == 0);
+  {
+    // An estimate with no tag takes the tag of the first Set().
+    MemoryStatsEstimate estimate;
+    {
+      MemoryTagScope scope(kMemoryGraph);
+      estimate.Set(300);
+    }
+    estimate.Set(200);
+    KALDI_ASSERT(GetMemoryStats(kMemoryGraph).current_bytes == 200 &&
+                 GetMemoryStats(kMemoryGraph).peak_bytes == 300);
+  }
+  KALDI_ASSERT(GetMemoryStats(kMemoryGraph).current_bytes == 0);
+
+  int32 num_threads = 4;
+  std::vector<pthread_t> threads(num_threads);
+  MemoryTagScope nnet_scope(kMemoryNnet);
+  for (int32 i = 0; i < num_threads; i++)
+    KALDI_ASSERT(pthread_create(&(threads[i]), NULL, AllocateSomething,
+                                NULL) == 0);
+  for (int32 i = 0; i < num_threads; i++)
+    pthread_join(threads[i], NULL);
+  KALDI_ASSERT(CurrentMemoryTag() == kMemoryNnet);
+  KALDI_ASSERT(GetMemoryStats(kMemoryFeature).current_bytes == 0 &&
+               GetMemoryStats(kMemoryFeature).peak_bytes >= 10 &&
+               GetMemoryStats(kMemoryFeature).peak_bytes <= 10 * num_threads);
+  KALDI_ASSERT(GetMemoryStats(kMemoryNnet).peak_bytes == 0);
+
+  std::ostringstream text, json;
+  WriteMemoryStats(text, false);
+  WriteMemoryStats(json, true);
+  KALDI_LOG << text.str() << json.str();
+  KALDI_ASSERT(text.str().find("Memory for lattice: 0 MB in use") !=
+               std::string::npos);
+  KALDI_ASSERT(text.str().find("nnet") == std::string::npos);
+  KALDI_ASSERT(json.str().find("\"decoder\": {\"current_bytes\": 0, "
+                               "\"peak_bytes\": 1000}") != std::string::npos);
+}
+
+}  // namespace kaldi
+
+int main() {
+  // The test depends on nothing else having been counted.
+  if (getenv("KALDI_MEMORY_STATS") != NULL)
+    KALDI_ERR << "Unset KALDI_MEMORY_STATS to run this test.";
+  kaldi::UnitTestMemoryStats();
+  std::cout << "Test OK.\n";
+}
@@ -0,0 +1,226 @@
+// base/kaldi-memory-stats.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <pthread.h>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "base/kaldi-error.h"
+#include "base/kaldi-memory-stats.h"
+
+namespace kaldi {
+
+namespace {
+
+enum MemoryStatsMode {
+  kMemoryStatsOff,
+  kMemoryStatsLog,
+  kMemoryStatsJsonLog,
+  kMemoryStatsJsonFile
+};
+
+pthread_once_t g_memory_stats_once = PTHREAD_ONCE_INIT;
+pthread_key_t g_memory_tag_key;
+MemoryStatsMode g_memory_stats_mode = kMemoryStatsOff;
+bool g_memory_stats_enabled = false;
+std::string *g_memory_stats_json_file = NULL;
+
+// The counters are updated with atomic operations, so that allocation doesn't
+// need a lock.  Element kNumMemoryTags is the total.
+volatile int64 g_current_bytes[kNumMemoryTags + 1];
+volatile int64 g_peak_bytes[kNumMemoryTags + 1];
+
+// Adds "delta" to *value and returns the new value.
+inline int64 AtomicAdd(volatile int64 *value, int64 delta) {
+#ifdef _MSC_VER
+  return InterlockedExchangeAdd64(value, delta) + delta;
+#else
+  return __sync_add_and_fetch(value, delta);
+#endif
+}
+
+// Sets *value to max(*value, new_value).
+inline void AtomicMax(volatile int64 *value, int64 new_value) {
+  int64 old_value = *value;
+  while (new_value > old_value) {
+#ifdef _MSC_VER
+    int64 prev = InterlockedCompareExchange64(value, new_value, old_value);
+#else
+    int64 prev = __sync_val_compare_and_swap(value, old_value, new_value);
+#endif
+    if (prev == old_value)
+      break;
+    old_value = prev;
+  }
+}
+
+void PrintMemoryStatsAtExit() {
+  if (g_memory_stats_mode == kMemoryStatsJsonFile) {
+    std::ofstream os(g_memory_stats_json_file->c_str(), std::ios::app);
+    WriteMemoryStats(os, true);
+    if (!os.good())
+      KALDI_WARN << "Error writing memory stats to "
+                 << *g_memory_stats_json_file;
+    return;
+  }
+  std::ostringstream os;
+  WriteMemoryStats(os, g_memory_stats_mode == kMemoryStatsJsonLog);
+  std::istringstream is(os.str());
+  std::string line;
+  while (std::getline(is, line))
+    KALDI_LOG << line;
+}
+
+void InitMemoryStats() {
+  int ret = pthread_key_create(&g_memory_tag_key, NULL);
+  if (ret != 0)
+    KALDI_ERR << "Error creating thread-local key (errno = " << ret << ")";
+  const char *value = getenv("KALDI_MEMORY_STATS");
+  if (value == NULL || *value == '\0' || !strcmp(value, "0"))
+    return;
+  if (!strcmp(value, "json")) {
+    g_memory_stats_mode = kMemoryStatsJsonLog;
+  } else if (!strncmp(value, "json:", 5) && value[5] != '\0') {
+    g_memory_stats_mode = kMemoryStatsJsonFile;
+    g_memory_stats_json_file = new std::string(value + 5);
+  } else {
+    if (strcmp(value, "1"))
+      KALDI_WARN << "Unknown value of KALDI_MEMORY_STATS: '" << value
+                 << "', treating it as 1.";
+    g_memory_stats_mode = kMemoryStatsLog;
+  }
+  g_memory_stats_enabled = true;
+  atexit(PrintMemoryStatsAtExit);
+}
+
+}  // namespace
+
+const char *MemoryTagName(MemoryTag tag) {
+  switch (tag) {
+    case kMemoryOther: return "other";
+    case kMemoryGraph: return "graph";
+    case kMemoryDecoder: return "decoder";
+    case kMemoryLattice: return "lattice";
+    case kMemoryNnet: return "nnet";
+    case kMemoryFeature: return "feature";
+    case kMemoryTableIo: return "table-io";
+    case kMemoryCuAllocator: return "cuda-allocator";
+    default: KALDI_ERR << "Invalid memory tag " << static_cast<int32>(tag);
+  }
+  return "";  // Suppress compiler warning.
+}
+
+bool MemoryStatsEnabled() {
+  pthread_once(&g_memory_stats_once, InitMemoryStats);
+  return g_memory_stats_enabled;
+}
+
+void EnableMemoryStats() {
+  pthread_once(&g_memory_stats_once, InitMemoryStats);
+  g_memory_stats_enabled = true;
+}
+
+MemoryTagStats GetMemoryStats(MemoryTag tag) {
+  KALDI_ASSERT(tag >= 0 && tag < kNumMemoryTags);
+  MemoryTagStats ans;
+  ans.current_bytes = g_current_bytes[tag];
+  ans.peak_bytes = g_peak_bytes[tag];
+  return ans;
+}
+
+MemoryTagStats GetTotalMemoryStats() {
+  MemoryTagStats ans;
+  ans.current_bytes = g_current_bytes[kNumMemoryTags];
+  ans.peak_bytes = g_peak_bytes[kNumMemoryTags];
+  return ans;
+}
+
+void WriteMemoryStats(std::ostream &os, bool json) {
+  std::string program(g_program_name == NULL ? "" : g_program_name);
+  if (!program.empty() && program[program.size() - 1] == ':')
+    program.resize(program.size() - 1);
+  const double mb = 1048576.0;
+  if (json)
+    os << "{\"program\": \"" << program << "\"";
+  for (int32 t = 0; t <= kNumMemoryTags; t++) {
+    MemoryTagStats stats = (t == kNumMemoryTags ? GetTotalMemoryStats() :
+                            GetMemoryStats(static_cast<MemoryTag>(t)));
+    if (stats.peak_bytes == 0 && t != kNumMemoryTags)
+      continue;
+    const char *name = (t == kNumMemoryTags ? "total" :
+                        MemoryTagName(static_cast<MemoryTag>(t)));
+    if (json)
+      os << ", \"" << name << "\": {\"current_bytes\": "
+         << stats.current_bytes << ", \"peak_bytes\": " << stats.peak_bytes
+         << "}";
+    else
+      os << (t == kNumMemoryTags ? "Total memory counted" :
+             std::string("Memory for ") + name) << ": "
+         << (stats.current_bytes / mb) << " MB in use, peak was "
+         << (stats.peak_bytes / mb) << " MB\n";
+  }
+  if (json)
+    os << "}\n";
+}
+
+MemoryTag CurrentMemoryTag() {
+  pthread_once(&g_memory_stats_once, InitMemoryStats);
+  // We store the tag plus one, so that NULL means kMemoryOther.
+  size_t value = reinterpret_cast<size_t>(
+      pthread_getspecific(g_memory_tag_key));
+  return (value == 0 ? kMemoryOther : static_cast<MemoryTag>(value - 1));
+}
+
+void MemoryStatsAdd(MemoryTag tag, int64 num_bytes) {
+  if (!MemoryStatsEnabled() || num_bytes == 0)
+    return;
+  KALDI_ASSERT(tag >= 0 && tag < kNumMemoryTags);
+  int64 current = AtomicAdd(&(g_current_bytes[tag]), num_bytes);
+  if (num_bytes > 0)
+    AtomicMax(&(g_peak_bytes[tag]), current);
+  if (tag != kMemoryCuAllocator) {
+    current = AtomicAdd(&(g_current_bytes[kNumMemoryTags]), num_bytes);
+    if (num_bytes > 0)
+      AtomicMax(&(g_peak_bytes[kNumMemoryTags]), current);
+  }
+}
+
+MemoryTagScope::MemoryTagScope(MemoryTag tag):
+    previous_tag_(CurrentMemoryTag()) {
+  KALDI_ASSERT(tag >= 0 && tag < kNumMemoryTags);
+  pthread_setspecific(g_memory_tag_key,
+                      reinterpret_cast<void*>(static_cast<size_t>(tag) + 1));
+}
+
+MemoryTagScope::~MemoryTagScope() {
+  pthread_setspecific(g_memory_tag_key, reinterpret_cast<void*>(
+      static_cast<size_t>(previous_tag_) + 1));
+}
+
+void MemoryStatsEstimate::Set(int64 num_bytes) {
+  if (num_bytes == num_bytes_ || !MemoryStatsEnabled())
+    return;
+  if (tag_ < 0)
+    tag_ = CurrentMemoryTag();
+  MemoryStatsAdd(static_cast<MemoryTag>(tag_), num_bytes - num_bytes_);
+  num_bytes_ = num_bytes;
+}
+
+}  // namespace kaldi
@@ -0,0 +1,143 @@
+// base/kaldi-memory-stats.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_BASE_KALDI_MEMORY_STATS_H_
+#define KALDI_BASE_KALDI_MEMORY_STATS_H_
+
+#include <ostream>
+
+#include "base/kaldi-types.h"
+#include "base/kaldi-utils.h"
+
+namespace kaldi {
+
+/*
+  Memory statistics are opt-in counters of the memory in use by each
+  subsystem of a program (the decoding graph, the decoder's tokens, lattice
+  determinization, the neural net, feature extraction, table I/O and the CUDA
+  allocator), with the peak of each, so that when a program runs out of
+  memory you can see what was using it.  They are switched on by the
+  environment variable KALDI_MEMORY_STATS, and are summarized when the program
+  exits, as for KALDI_TABLE_STATS:
+
+    KALDI_MEMORY_STATS=1           one KALDI_LOG line per subsystem.
+    KALDI_MEMORY_STATS=json        one KALDI_LOG line of JSON.
+    KALDI_MEMORY_STATS=json:FILE   append one line of JSON to FILE.
+
+  Servers can call EnableMemoryStats() instead, and read the live values with
+  GetMemoryStats() or WriteMemoryStats().
+
+  What is counted: the data of Matrix and Vector (see
+  matrix/matrix-memory-pool.h), charged to the subsystem of the thread that
+  allocated it (see MemoryTagScope) until it is freed; the blocks of
+  ObjectPool and HashList, as used by the decoders; and estimates kept by
+  particular objects (see MemoryStatsEstimate), e.g. the arrays of
+  CsrDecodingGraph, the memory of the pruned lattice determinizer, and the
+  GPU memory held by CuMemoryAllocator (including its cache; this is reported
+  separately from the total, as it's not host memory).  Other allocations,
+  e.g. of std::vector or OpenFst objects, are not counted, so the total
+  will be less than the size of the process.
+*/
+
+enum MemoryTag {
+  kMemoryOther = 0,  // memory allocated outside any MemoryTagScope.
+  kMemoryGraph,
+  kMemoryDecoder,
+  kMemoryLattice,
+  kMemoryNnet,
+  kMemoryFeature,
+  kMemoryTableIo,
+  kMemoryCuAllocator,  // GPU memory; not included in the total.
+  kNumMemoryTags
+};
+
+/// Returns the name of the tag as used in the summary, e.g. "table-io".
+const char *MemoryTagName(MemoryTag tag);
+
+struct MemoryTagStats {
+  int64 current_bytes;
+  int64 peak_bytes;
+  MemoryTagStats(): current_bytes(0), peak_bytes(0) { }
+};
+
+/// Returns true if memory statistics are being kept, i.e. if
+/// KALDI_MEMORY_STATS was set or EnableMemoryStats() was called.
+bool MemoryStatsEnabled();
+
+/// Starts keeping memory statistics without printing them at exit.  Memory
+/// allocated before this was called is not counted.
+void EnableMemoryStats();
+
+/// Returns the memory in use and its peak for "tag"; this is thread-safe.
+MemoryTagStats GetMemoryStats(MemoryTag tag);
+
+/// Returns the total over the tags except kMemoryCuAllocator; the peak is
+/// the peak of the total, not the sum of the peaks.
+MemoryTagStats GetTotalMemoryStats();
+
+/// Writes the current and peak memory of each tag (that has been used), and
+/// of the total, as text (one line per tag) or as one line of JSON.
+void WriteMemoryStats(std::ostream &os, bool json);
+
+/// Returns the subsystem that memory allocated by the calling thread is
+/// charged to; see MemoryTagScope.
+MemoryTag CurrentMemoryTag();
+
+/// Adds "num_bytes" (which may be negative) to the memory in use of "tag".
+/// Does nothing if memory statistics are not enabled; but note that if they
+/// are enabled between an allocation and its free, the free must not be
+/// counted, which is the caller's responsibility.
+void MemoryStatsAdd(MemoryTag tag, int64 num_bytes);
+
+
+/// While an object of this class exists, memory that the calling thread
+/// allocates is charged to "tag".  These objects may be nested; they must be
+/// destroyed by the thread that created them, in the reverse order of
+/// creation.
+class MemoryTagScope {
+ public:
+  explicit MemoryTagScope(MemoryTag tag);
+  ~MemoryTagScope();
+ private:
+  MemoryTag previous_tag_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MemoryTagScope);
+};
+
+
+/// An object's estimate of the memory it holds, for objects that allocate
+/// memory in ways that are not otherwise counted.  The object calls Set()
+/// when its size changes, and the destructor sets it to zero.  The tag is the
+/// one given to the constructor or, if none was given, the calling thread's
+/// CurrentMemoryTag() at the first call to Set() after memory statistics
+/// were enabled.
+class MemoryStatsEstimate {
+ public:
+  MemoryStatsEstimate(): tag_(-1), num_bytes_(0) { }
+  explicit MemoryStatsEstimate(MemoryTag tag): tag_(tag), num_bytes_(0) { }
+
+  void Set(int64 num_bytes);
+
+  ~MemoryStatsEstimate() { if (num_bytes_ != 0) Set(0); }
+ private:
+  int32 tag_;
+  int64 num_bytes_;  // what we have added to the statistics.
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MemoryStatsEstimate);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_BASE_KALDI_MEMORY_STATS_H_
@@ -0,0 +1,97 @@
+// base/kaldi-trace-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//  http://www.apache.org/licenses/LICENSE-2.0
+
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+// The scopes are tested whether or not tracing is compiled in.
+#ifndef KALDI_ENABLE_TRACING
+#define KALDI_ENABLE_TRACING
+#endif
+
+#include <pthread.h>
+#include <sstream>
+#include <string>
+
+#include "base/kaldi-common.h"
+#include "base/kaldi-trace.h"
+
+namespace kaldi {
+
+static const int32 kNumScopes = 10;
+
+static void *TraceSomething(void *arg) {
+  for (int32 i = 0; i < kNumScopes; i++) {
+    KALDI_TRACE_SCOPE("outer");
+    {
+      KALDI_TRACE_SCOPE("inner \"quoted\"");
+    }
+  }
+  return NULL;
+}
+
+static int32 CountOccurrences(const std::string &str, const std::string &s) {
+  int32 ans = 0;
+  for (size_t pos = str.find(s); pos != std::string::npos;
+       pos = str.find(s, pos + s.size()))
+    ans++;
+  return ans;
+}
+
+void UnitTestTrace() {
+  {
+    // Nothing is recorded before tracing is enabled.
+    KALDI_TRACE_SCOPE("not recorded");
+  }
+  KALDI_ASSERT(!TracingEnabled());
+  EnableTracing();
+  KALDI_ASSERT(TracingEnabled());
+
+  int32 num_threads = 3;
+  std::vector<pthread_t> threads(num_threads);
+  for (int32 i = 0; i < num_threads; i++)
+    KALDI_ASSERT(pthread_create(&(threads[i]), NULL, TraceSomething,
+                                NULL) == 0);
+  for (int32 i = 0; i < num_threads; i++)
+    pthread_join(threads[i], NULL);
+  TraceSomething(NULL);
+
+  std::ostringstream os;
+  WriteTrace(os);
+  std::string trace = os.str();
+  KALDI_LOG << trace.substr(0, 500);
+  KALDI_ASSERT(trace.find("not recorded") == std::string::npos);
+  KALDI_ASSERT(CountOccurrences(trace, "\"ph\": \"X\"") ==
+               2 * kNumScopes * (num_threads + 1));
+  KALDI_ASSERT(CountOccurrences(trace, "\"outer\"") ==
+               kNumScopes * (num_threads + 1));
+  KALDI_ASSERT(CountOccurrences(trace, "\"inner \\\"quoted\\\"\"") ==
+               kNumScopes * (num_threads + 1));
+  KALDI_ASSERT(CountOccurrences(trace, "\"thread_name\"") == num_threads + 1);
+  for (int32 i = 0; i <= num_threads; i++) {
+    std::ostringstream tid;
+    tid << "\"tid\": " << i << "}";
+    KALDI_ASSERT(CountOccurrences(trace, tid.str()) == 2 * kNumScopes);
+  }
+}
+
+}  // namespace kaldi
+
+int main() {
+  // The test depends on KALDI_TRACE not being set.
+  if (getenv("KALDI_TRACE") != NULL)
+    KALDI_ERR << "Unset KALDI_TRACE to run this test.";
+  kaldi::UnitTestTrace();
+  std::cout << "Test OK.\n";
+}
@@ -0,0 +1,196 @@
+// base/kaldi-trace.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <pthread.h>
+#include <sys/time.h>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "base/kaldi-error.h"
+#include "base/kaldi-trace.h"
+
+namespace kaldi {
+
+namespace {
+
+struct TraceEvent {
+  const char *name;
+  int64 start_us;
+  int64 duration_us;
+};
+
+// The events of one thread.  Only that thread adds events, but the mutex is
+// needed because WriteTrace() may be called from another thread.
+struct TraceThreadBuffer {
+  int32 thread_id;  // in order of the first event of each thread.
+  std::vector<TraceEvent> events;
+  int64 num_dropped;
+  pthread_mutex_t mutex;
+};
+
+pthread_once_t g_trace_once = PTHREAD_ONCE_INIT;
+pthread_key_t g_trace_key;
+bool g_trace_enabled = false;
+int64 g_trace_start_us = 0;
+std::string *g_trace_file = NULL;
+
+// The buffers of all threads that have recorded events, protected by
+// g_trace_mutex.  They are never deleted, as threads may exit before the
+// trace is written.
+std::vector<TraceThreadBuffer*> *g_trace_buffers = NULL;
+pthread_mutex_t g_trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+int64 NowMicroseconds() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return static_cast<int64>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+void WriteTraceAtExit() {
+  std::string filename(*g_trace_file);
+  size_t pos = filename.find("%p");
+  if (pos != std::string::npos) {
+    std::ostringstream pid;
+    pid << getpid();
+    filename.replace(pos, 2, pid.str());
+  }
+  std::ofstream os(filename.c_str());
+  WriteTrace(os);
+  if (!os.good())
+    KALDI_WARN << "Error writing trace to " << filename;
+}
+
+void InitTracing() {
+  int ret = pthread_key_create(&g_trace_key, NULL);
+  if (ret != 0)
+    KALDI_ERR << "Error creating thread-local key (errno = " << ret << ")";
+  g_trace_buffers = new std::vector<TraceThreadBuffer*>();
+  g_trace_start_us = NowMicroseconds();
+  const char *value = getenv("KALDI_TRACE");
+  if (value == NULL || *value == '\0')
+    return;
+  g_trace_file = new std::string(value);
+  g_trace_enabled = true;
+  atexit(WriteTraceAtExit);
+}
+
+TraceThreadBuffer *GetThreadBuffer() {
+  TraceThreadBuffer *buffer = static_cast<TraceThreadBuffer*>(
+      pthread_getspecific(g_trace_key));
+  if (buffer == NULL) {
+    buffer = new TraceThreadBuffer();
+    buffer->num_dropped = 0;
+    pthread_mutex_init(&buffer->mutex, NULL);
+    pthread_mutex_lock(&g_trace_mutex);
+    buffer->thread_id = g_trace_buffers->size();
+    g_trace_buffers->push_back(buffer);
+    pthread_mutex_unlock(&g_trace_mutex);
+    pthread_setspecific(g_trace_key, buffer);
+  }
+  return buffer;
+}
+
+void WriteJsonString(std::ostream &os, const char *str) {
+  os << '"';
+  for (; *str != '\0'; str++) {
+    unsigned char c = *str;
+    if (c == '"' || c == '\\') {
+      os << '\\' << c;
+    } else if (c < 0x20) {
+      const char *hex = "0123456789abcdef";
+      os << "\\u00" << hex[c >> 4] << hex[c & 15];
+    } else {
+      os << c;
+    }
+  }
+  os << '"';
+}
+
+}  // namespace
+
+bool TracingEnabled() {
+  pthread_once(&g_trace_once, InitTracing);
+  return g_trace_enabled;
+}
+
+void EnableTracing() {
+  pthread_once(&g_trace_once, InitTracing);
+  g_trace_enabled = true;
+}
+
+void WriteTrace(std::ostream &os) {
+  pthread_once(&g_trace_once, InitTracing);
+  int64 pid = getpid(), num_dropped = 0;
+  std::string program(g_program_name == NULL ? "" : g_program_name);
+  if (!program.empty() && program[program.size() - 1] == ':')
+    program.resize(program.size() - 1);
+  os << "{\"traceEvents\": [\n";
+  os << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << pid
+     << ", \"tid\": 0, \"args\": {\"name\": ";
+  WriteJsonString(os, program.c_str());
+  os << "}}";
+  pthread_mutex_lock(&g_trace_mutex);
+  for (size_t i = 0; i < g_trace_buffers->size(); i++) {
+    TraceThreadBuffer *buffer = (*g_trace_buffers)[i];
+    pthread_mutex_lock(&buffer->mutex);
+    os << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << pid
+       << ", \"tid\": " << buffer->thread_id << ", \"args\": {\"name\": \""
+       << "thread " << buffer->thread_id << "\"}}";
+    for (size_t j = 0; j < buffer->events.size(); j++) {
+      const TraceEvent &event = buffer->events[j];
+      os << ",\n{\"name\": ";
+      WriteJsonString(os, event.name);
+      os << ", \"ph\": \"X\", \"ts\": " << (event.start_us - g_trace_start_us)
+         << ", \"dur\": " << event.duration_us << ", \"pid\": " << pid
+         << ", \"tid\": " << buffer->thread_id << "}";
+    }
+    num_dropped += buffer->num_dropped;
+    pthread_mutex_unlock(&buffer->mutex);
+  }
+  pthread_mutex_unlock(&g_trace_mutex);
+  os << "\n],\n\"displayTimeUnit\": \"ms\"}\n";
+  if (num_dropped > 0)
+    KALDI_WARN << "Dropped " << num_dropped << " trace events (more than "
+               << kMaxTraceEventsPerThread << " in a thread).";
+}
+
+TraceScope::TraceScope(const char *name): name_(NULL), start_us_(0) {
+  if (TracingEnabled()) {
+    name_ = name;
+    start_us_ = NowMicroseconds();
+  }
+}
+
+void TraceScope::End() {
+  TraceEvent event;
+  event.name = name_;
+  event.start_us = start_us_;
+  event.duration_us = NowMicroseconds() - start_us_;
+  TraceThreadBuffer *buffer = GetThreadBuffer();
+  pthread_mutex_lock(&buffer->mutex);
+  if (buffer->events.size() < static_cast<size_t>(kMaxTraceEventsPerThread))
+    buffer->events.push_back(event);
+  else
+    buffer->num_dropped++;
+  pthread_mutex_unlock(&buffer->mutex);
+}
+
+}  // namespace kaldi
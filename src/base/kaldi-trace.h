@@ -0,0 +1,95 @@
+// base/kaldi-trace.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_BASE_KALDI_TRACE_H_
+#define KALDI_BASE_KALDI_TRACE_H_
+
+#include <ostream>
+
+#include "base/kaldi-types.h"
+#include "base/kaldi-utils.h"
+
+namespace kaldi {
+
+/*
+  Tracing records the start and duration of scopes in the hot paths of the
+  code (the decoder's frame loop, the commands of the nnet3 NnetComputer,
+  feature extraction, table reading and writing, and lattice determinization),
+  for each thread, and writes them in the JSON format of the Chrome trace
+  viewer (chrome://tracing, or https://ui.perfetto.dev), where each thread is
+  a row, so you can see where a multi-threaded program stalls and how well
+  its threads overlap.
+
+  It is compiled out unless you add -DKALDI_ENABLE_TRACING to CXXFLAGS in
+  kaldi.mk (and rebuild), and even then it does nothing unless the
+  environment variable KALDI_TRACE is set:
+
+    KALDI_TRACE=FILE     write the trace to FILE when the program exits; any
+                         "%p" in FILE is replaced by the process id, so that
+                         the programs of a pipeline don't overwrite each
+                         other's traces.
+
+  To trace a scope, put KALDI_TRACE_SCOPE("name") at its start; the name must
+  be a string literal (or otherwise outlive the program), as only the pointer
+  is stored.  When tracing is disabled at run time a scope costs a function
+  call and a test; when it is enabled, two reads of the clock and a
+  push_back.  Each thread keeps at most kMaxTraceEventsPerThread events; any
+  more are counted and dropped.
+*/
+
+#ifdef KALDI_ENABLE_TRACING
+#define KALDI_TRACE_CONCAT_(a, b) a##b
+#define KALDI_TRACE_CONCAT(a, b) KALDI_TRACE_CONCAT_(a, b)
+#define KALDI_TRACE_SCOPE(name) \
+  ::kaldi::TraceScope KALDI_TRACE_CONCAT(kaldi_trace_scope_, __LINE__)(name)
+#else
+#define KALDI_TRACE_SCOPE(name)
+#endif
+
+const int32 kMaxTraceEventsPerThread = 1 << 20;
+
+/// Returns true if events are being recorded, i.e. if KALDI_TRACE was set or
+/// EnableTracing() was called.  This does not depend on KALDI_ENABLE_TRACING,
+/// which only controls whether KALDI_TRACE_SCOPE does anything.
+bool TracingEnabled();
+
+/// Starts recording events, as if KALDI_TRACE had been set but without
+/// writing the trace at exit; this is for tests, and for programs that want
+/// to write the trace themselves with WriteTrace().
+void EnableTracing();
+
+/// Writes the events recorded so far, from all threads, as a Chrome trace
+/// JSON object.  It's OK to call this while other threads are recording.
+void WriteTrace(std::ostream &os);
+
+/// Records the time spent in this object's lifetime as an event called
+/// "name" in the current thread.  Normally you would use KALDI_TRACE_SCOPE,
+/// which is compiled out unless KALDI_ENABLE_TRACING is defined.
+class TraceScope {
+ public:
+  explicit TraceScope(const char *name);
+  ~TraceScope() { if (name_ != NULL) End(); }
+ private:
+  void End();
+  const char *name_;  // NULL if tracing is disabled.
+  int64 start_us_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(TraceScope);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_BASE_KALDI_TRACE_H_
@@ -24,6 +24,104 @@
 #include "hmm/transition-model.h"
 #include "hmm/posterior.h"
 #include "transform/lda-estimate.h"
+#include "thread/kaldi-mutex.h"
+#include "thread/kaldi-thread.h"
+
+namespace kaldi {
+
+// The inputs and the totals shared by the threads of AccLdaClass.
+struct AccLdaShared {
+  const TransitionModel *trans_model;
+  BaseFloat rand_prune;
+  SequentialBaseFloatMatrixReader *feature_reader;
+  RandomAccessPosteriorReader *posterior_reader;
+  Mutex mutex;  // guards the readers and everything below.
+  LdaEstimate lda;  // initialized when we see the first utterance.
+  int32 num_done, num_fail;
+};
+
+// Each copy of this class (one per thread, see MultiThreader) takes
+// utterances from the readers and accumulates their stats into its own
+// accumulators, which it adds to the totals in its destructor.
+class AccLdaClass: public MultiThreadable {
+ public:
+  explicit AccLdaClass(AccLdaShared *shared): shared_(shared) { }
+  AccLdaClass(const AccLdaClass &other): shared_(other.shared_) { }
+  void operator () () {
+    std::string utt;
+    Matrix<BaseFloat> feats;
+    Posterior post;
+    while (GetUtterance(&utt, &feats, &post)) {
+      Posterior pdf_post;
+      ConvertPosteriorToPdfs(*(shared_->trans_model), post, &pdf_post);
+      for (size_t i = 0; i < pdf_post.size(); i++)
+        for (size_t j = 0; j < pdf_post[i].size(); j++)
+          pdf_post[i][j].second = RandPrune(pdf_post[i][j].second,
+                                            shared_->rand_prune);
+      if (lda_.Dim() == 0)
+        lda_.Init(shared_->trans_model->NumPdfs(), feats.NumCols());
+      lda_.Accumulate(feats, pdf_post);
+    }
+  }
+  ~AccLdaClass() {
+    if (lda_.Dim() != 0)  // if this is one of the thread's copies and it
+      shared_->lda.Add(lda_);  // processed some data.
+  }
+ private:
+  // Gets the next utterance that has posteriors of the right size, and
+  // returns false if there are no more.
+  bool GetUtterance(std::string *utt, Matrix<BaseFloat> *feats,
+                    Posterior *post) {
+    bool ans = false;
+    shared_->mutex.Lock();
+    try {
+      for (; !shared_->feature_reader->Done();
+           shared_->feature_reader->Next()) {
+        *utt = shared_->feature_reader->Key();
+        if (!shared_->posterior_reader->HasKey(*utt)) {
+          KALDI_WARN << "No posteriors for utterance " << *utt;
+          shared_->num_fail++;
+          continue;
+        }
+        const Posterior &this_post = shared_->posterior_reader->Value(*utt);
+        const Matrix<BaseFloat> &this_feats = shared_->feature_reader->Value();
+        LdaEstimate &lda = shared_->lda;
+        if (lda.Dim() == 0)
+          lda.Init(shared_->trans_model->NumPdfs(), this_feats.NumCols());
+        if (this_feats.NumRows() != static_cast<int32>(this_post.size())) {
+          KALDI_WARN << "Posterior vs. feats size mismatch "
+                     << this_feats.NumRows() << " vs. " << this_post.size();
+          shared_->num_fail++;
+          continue;
+        }
+        if (lda.Dim() != this_feats.NumCols()) {
+          KALDI_WARN << "Feature dimension mismatch " << lda.Dim()
+                     << " vs. " << this_feats.NumCols();
+          shared_->num_fail++;
+          continue;
+        }
+        *feats = this_feats;
+        *post = this_post;
+        shared_->feature_reader->Next();
+        shared_->num_done++;
+        if (shared_->num_done % 100 == 0)
+          KALDI_LOG << "Done " << shared_->num_done << " utterances.";
+        ans = true;
+        break;
+      }
+    } catch (...) {  // e.g. a read error; don't leave the other threads stuck.
+      shared_->mutex.Unlock();
+      throw;
+    }
+    shared_->mutex.Unlock();
+    return ans;
+  }
+
+  AccLdaShared *shared_;
+  LdaEstimate lda_;
+};
+
+}  // namespace kaldi
 
 /** @brief Accumulate LDA statistics based on pdf-ids. Inputs are the
 source models, that serve as the input (and may potentially contain
@@ -41,10 +139,13 @@ int main(int argc, char *argv[]) {
 
     bool binary = true;
     BaseFloat rand_prune = 0.0;
+    int32 num_threads = 1;
     ParseOptions po(usage);
     po.Register("binary", &binary, "Write accumulators in binary mode.");
     po.Register("rand-prune", &rand_prune,
                 "Randomized pruning threshold for posteriors");
+    po.Register("num-threads", &num_threads, "Number of threads to use; each "
+                "has its own accumulators, which are summed at the end.");
     po.Read(argc, argv);
 
     if (po.NumArgs() != 4) {
@@ -65,66 +166,31 @@ int main(int argc, char *argv[]) {
       // discard rest of file.
     }
 
-    LdaEstimate lda;
-
     SequentialBaseFloatMatrixReader feature_reader(features_rspecifier);
     RandomAccessPosteriorReader posterior_reader(posteriors_rspecifier);
 
-    int32 num_done = 0, num_fail = 0;
-    for (;!feature_reader.Done(); feature_reader.Next()) {
-      std::string utt = feature_reader.Key();
-      if (!posterior_reader.HasKey(utt)) {
-        KALDI_WARN << "No posteriors for utterance " << utt;
-        num_fail++;
-        continue;
-      }
-      const Posterior &post (posterior_reader.Value(utt));
-      const Matrix<BaseFloat> &feats(feature_reader.Value());
-
-      if (lda.Dim() == 0)
-        lda.Init(trans_model.NumPdfs(), feats.NumCols());
-
-      if (feats.NumRows() != static_cast<int32>(post.size())) {
-        KALDI_WARN << "Posterior vs. feats size mismatch "
-                   << feats.NumRows() << " vs. " <<post.size();
-        num_fail++;
-        continue;
-      }
-      if (lda.Dim() != 0 && lda.Dim() != feats.NumCols()) {
-        KALDI_WARN << "Feature dimension mismatch " << lda.Dim()
-                   << " vs. " << feats.NumCols();
-        num_fail++;
-        continue;
-      }
-
-      Posterior pdf_post;
-      ConvertPosteriorToPdfs(trans_model, post, &pdf_post);
-      for (int32 i = 0; i < feats.NumRows(); i++) {
-        SubVector<BaseFloat> feat(feats, i);
-        for (size_t j = 0; j < pdf_post[i].size(); j++) {
-          int32 pdf_id = pdf_post[i][j].first;
-          BaseFloat weight = RandPrune(pdf_post[i][j].second, rand_prune);
-          if (weight != 0.0) {
-            lda.Accumulate(feat, pdf_id, weight);
-          }
-        }
-      }
-      num_done++;
-      if (num_done % 100 == 0)
-        KALDI_LOG << "Done " << num_done << " utterances.";
+    AccLdaShared shared;
+    shared.trans_model = &trans_model;
+    shared.rand_prune = rand_prune;
+    shared.feature_reader = &feature_reader;
+    shared.posterior_reader = &posterior_reader;
+    shared.num_done = 0;
+    shared.num_fail = 0;
+    {
+      AccLdaClass c(&shared);
+      // Everything happens in the constructor and destructor.
+      MultiThreader<AccLdaClass> threader(num_threads, c);
     }
 
-    KALDI_LOG << "Done " << num_done << " files, failed for "
-              << num_fail;
+    KALDI_LOG << "Done " << shared.num_done << " files, failed for "
+              << shared.num_fail;
 
     Output ko(acc_wxfilename, binary);
-    lda.Write(ko.Stream(), binary);
+    shared.lda.Write(ko.Stream(), binary);
     KALDI_LOG << "Written statistics.";
-    return (num_done != 0 ? 0 : 1);
+    return (shared.num_done != 0 ? 0 : 1);
   } catch(const std::exception &e) {
     std::cerr << e.what();
     return -1;
   }
 }
-
-
@@ -28,6 +28,7 @@
 
 #include <string>
 #include "lm/kaldi-lm.h"
+#include "thread/kaldi-thread.h"
 #include "util/parse-options.h"
 
 int main(int argc, char *argv[]) {
@@ -39,6 +40,8 @@ int main(int argc, char *argv[]) {
 
     bool natural_base = true;
     po.Register("natural-base", &natural_base, "Use log-base e (not log-base 10)");
+    po.Register("num-threads", &kaldi::g_num_threads, "Number of threads for "
+                "parsing the n-gram lines (the output does not depend on it)");
     po.Read(argc, argv);
 
     if (po.NumArgs() != 1 && po.NumArgs() != 2) {
@@ -24,6 +24,7 @@
 #include "tree/context-dep.h"
 #include "tree/build-tree.h"
 #include "tree/build-tree-utils.h"
+#include "thread/kaldi-thread.h"
 #include "tree/context-dep.h"
 #include "tree/clusterable-classes.h"
 #include "util/text-utils.h"
@@ -86,6 +87,9 @@ int main(int argc, char *argv[]) {
     po.Register("cluster-leaves", &cluster_leaves, "If true, do a post-clustering"
                 " of the leaves of the final decision tree.");
     
+    po.Register("num-threads", &g_num_threads, "Number of threads to use "
+                "for finding the best splits while building the tree.");
+
     po.Read(argc, argv);
 
     if (po.NumArgs() != 6) {
@@ -24,6 +24,7 @@
 #include "tree/context-dep.h"
 #include "tree/build-tree.h"
 #include "tree/build-tree-utils.h"
+#include "thread/kaldi-thread.h"
 #include "tree/clusterable-classes.h"
 #include "util/text-utils.h"
 
@@ -62,6 +63,9 @@ int main(int argc, char *argv[]) {
                 "no clustering; -1 means use as a clustering threshold the "
                 "likelihood change of the final split.");
 
+    po.Register("num-threads", &g_num_threads, "Number of threads to use "
+                "for finding the best splits while building the tree.");
+
     po.Read(argc, argv);
 
     if (po.NumArgs() != 5) {
@@ -20,6 +20,7 @@
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "matrix/kaldi-matrix.h"
+#include "util/mapped-matrix.h"
 #include "transform/transform-common.h"
 
 
@@ -35,9 +36,11 @@ int main(int argc, char *argv[]) {
         "  or: copy-matrix [options] <matrix-in-rxfilename> <matrix-out-wxfilename>\n"
         " e.g.: copy-matrix --binary=false 1.mat -\n"
         "   copy-matrix ark:2.trans ark,t:-\n"
+        "   copy-matrix --aligned=true final.mat final_aligned.mat\n"
+        "   copy-matrix --aligned=true scp:feats.scp ark:feats_aligned.ark\n"
         "See also: copy-feats\n";
     
-    bool binary = true;
+    bool binary = true, aligned = false;
     BaseFloat scale = 1.0;
     ParseOptions po(usage);
 
@@ -45,6 +48,11 @@ int main(int argc, char *argv[]) {
                 "Write in binary mode (only relevant if output is a wxfilename)");
     po.Register("scale", &scale,
                 "This option can be used to scale the matrices being copied.");
+    po.Register("aligned", &aligned,
+                "If true, write the output in the binary format that can be "
+                "memory-mapped by programs that support it (see MappedMatrix "
+                "and SequentialMappedMatrixReader); for archives this only "
+                "works if the archive is an ordinary file.");
     
     po.Read(argc, argv);
 
@@ -73,22 +81,32 @@ int main(int argc, char *argv[]) {
       Matrix<BaseFloat> mat;
       ReadKaldiObject(matrix_in_fn, &mat);
       if (scale != 1.0) mat.Scale(scale);
-      Output ko(matrix_out_fn, binary);
-      mat.Write(ko.Stream(), binary);
+      if (aligned) {
+        WriteAlignedMatrix(mat, matrix_out_fn);
+      } else {
+        Output ko(matrix_out_fn, binary);
+        mat.Write(ko.Stream(), binary);
+      }
       KALDI_LOG << "Copied matrix to " << matrix_out_fn;
       return 0;
     } else {
       int num_done = 0;
-      BaseFloatMatrixWriter writer(matrix_out_fn);
+      BaseFloatMatrixWriter writer(aligned ? "" : matrix_out_fn);
+      TableWriter<AlignedMatrixHolder<BaseFloat> > aligned_writer(
+          aligned ? matrix_out_fn : "");
       SequentialBaseFloatMatrixReader reader(matrix_in_fn);
       for (; !reader.Done(); reader.Next(), num_done++) {
+        Matrix<BaseFloat> scaled_mat;
         if (scale != 1.0) {
-          Matrix<BaseFloat> mat(reader.Value());
-          mat.Scale(scale);
-          writer.Write(reader.Key(), mat);
-        } else {
-          writer.Write(reader.Key(), reader.Value());
+          scaled_mat = reader.Value();
+          scaled_mat.Scale(scale);
         }
+        const Matrix<BaseFloat> &mat = (scale != 1.0 ? scaled_mat :
+                                        reader.Value());
+        if (aligned)
+          aligned_writer.Write(reader.Key(), mat);
+        else
+          writer.Write(reader.Key(), mat);
       }
       KALDI_LOG << "Copied " << num_done << " matrices.";
       return (num_done != 0 ? 0 : 1);
@@ -0,0 +1,166 @@
+// bin/latgen-faster-mapped-batched.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "fstext/fstext-lib.h"
+#include "decoder/decoder-wrappers.h"
+#include "decoder/batched-lattice-decoder.h"
+#include "decoder/decodable-matrix.h"
+#include "base/timer.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    using fst::SymbolTable;
+    using fst::VectorFst;
+    using fst::StdArc;
+
+    const char *usage =
+        "Generate lattices, reading log-likelihoods as matrices, decoding\n"
+        "several utterances at a time in lockstep against a single shared\n"
+        "decoding graph (see BatchedLatticeDecoder).  The output is the same\n"
+        "as that of latgen-faster-mapped, and is written in the input order.\n"
+        " (model is needed only for the integer mappings in its transition-model)\n"
+        "Usage: latgen-faster-mapped-batched [options] trans-model-in fst-in "
+        "loglikes-rspecifier lattice-wspecifier [ words-wspecifier "
+        "[alignments-wspecifier] ]\n";
+    ParseOptions po(usage);
+    Timer timer;
+    bool allow_partial = false;
+    BaseFloat acoustic_scale = 0.1;
+    int32 batch_size = 16;
+    LatticeFasterDecoderConfig config;
+
+    std::string word_syms_filename;
+    config.Register(&po);
+    po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for acoustic likelihoods");
+    po.Register("word-symbol-table", &word_syms_filename, "Symbol table for words [for debug output]");
+    po.Register("allow-partial", &allow_partial, "If true, produce output even if end state was not reached.");
+    po.Register("batch-size", &batch_size, "Number of utterances to decode "
+                "at the same time.");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 4 || po.NumArgs() > 6) {
+      po.PrintUsage();
+      exit(1);
+    }
+    KALDI_ASSERT(batch_size > 0);
+
+    std::string model_in_filename = po.GetArg(1),
+        fst_in_filename = po.GetArg(2),
+        feature_rspecifier = po.GetArg(3),
+        lattice_wspecifier = po.GetArg(4),
+        words_wspecifier = po.GetOptArg(5),
+        alignment_wspecifier = po.GetOptArg(6);
+
+    TransitionModel trans_model;
+    ReadKaldiObject(model_in_filename, &trans_model);
+
+    bool determinize = config.determinize_lattice;
+    CompactLatticeWriter compact_lattice_writer;
+    LatticeWriter lattice_writer;
+    if (! (determinize ? compact_lattice_writer.Open(lattice_wspecifier)
+           : lattice_writer.Open(lattice_wspecifier)))
+      KALDI_ERR << "Could not open table for writing lattices: "
+                 << lattice_wspecifier;
+
+    Int32VectorWriter words_writer(words_wspecifier);
+
+    Int32VectorWriter alignment_writer(alignment_wspecifier);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (word_syms_filename != "")
+      if (!(word_syms = fst::SymbolTable::ReadText(word_syms_filename)))
+        KALDI_ERR << "Could not read symbol table from file "
+                   << word_syms_filename;
+
+    double tot_like = 0.0;
+    kaldi::int64 frame_count = 0;
+    int num_success = 0, num_fail = 0;
+
+    SequentialBaseFloatMatrixReader loglike_reader(feature_rspecifier);
+    VectorFst<StdArc> *decode_fst = fst::ReadFstKaldi(fst_in_filename);
+
+    {
+      BatchedLatticeDecoder decoder(*decode_fst, config, batch_size);
+
+      while (!loglike_reader.Done()) {
+        // Read the next batch of utterances.
+        std::vector<std::string> utts;
+        std::vector<Matrix<BaseFloat>* > loglikes;
+        for (; !loglike_reader.Done() && utts.size() < batch_size;
+             loglike_reader.Next()) {
+          std::string utt = loglike_reader.Key();
+          const Matrix<BaseFloat> &value = loglike_reader.Value();
+          if (value.NumRows() == 0) {
+            KALDI_WARN << "Zero-length utterance: " << utt;
+            num_fail++;
+            continue;
+          }
+          utts.push_back(utt);
+          loglikes.push_back(new Matrix<BaseFloat>(value));
+        }
+        std::vector<DecodableInterface*> decodables(utts.size());
+        for (size_t i = 0; i < utts.size(); i++)
+          decodables[i] = new DecodableMatrixScaledMapped(trans_model,
+                                                          *(loglikes[i]),
+                                                          acoustic_scale);
+        decoder.Decode(decodables);
+
+        for (size_t i = 0; i < utts.size(); i++) {
+          double like;
+          if (OutputDecodedUtteranceLatticeFaster(
+                  decoder.GetDecoder(i), trans_model, word_syms, utts[i],
+                  acoustic_scale, determinize, allow_partial,
+                  &alignment_writer, &words_writer, &compact_lattice_writer,
+                  &lattice_writer, &like)) {
+            tot_like += like;
+            frame_count += loglikes[i]->NumRows();
+            num_success++;
+          } else num_fail++;
+          delete decodables[i];
+          delete loglikes[i];
+        }
+      }
+    }
+    delete decode_fst; // delete this only after decoder goes out of scope.
+
+    double elapsed = timer.Elapsed();
+    KALDI_LOG << "Time taken "<< elapsed
+              << "s: real-time factor assuming 100 frames/sec is "
+              << (elapsed*100.0/frame_count);
+    KALDI_LOG << "Done " << num_success << " utterances, failed for "
+              << num_fail;
+    KALDI_LOG << "Overall log-likelihood per frame is " << (tot_like/frame_count) << " over "
+              << frame_count<<" frames.";
+
+    delete word_syms;
+    if (num_success != 0) return 0;
+    else return 1;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -29,7 +29,7 @@
 #include "decoder/decoder-wrappers.h"
 #include "decoder/decodable-matrix.h"
 #include "base/timer.h"
-#include "thread/kaldi-task-sequence.h"
+#include "thread/kaldi-task-scheduler.h"
 
 int main(int argc, char *argv[]) {
   try {
@@ -49,11 +49,11 @@ int main(int argc, char *argv[]) {
     bool allow_partial = false;
     BaseFloat acoustic_scale = 0.1;
     LatticeFasterDecoderConfig config;
-    TaskSequencerConfig sequencer_config; // has --num-threads option
+    TaskSchedulerConfig scheduler_config; // has --num-threads option
 
     std::string word_syms_filename;
     config.Register(&po);
-    sequencer_config.Register(&po);
+    scheduler_config.Register(&po);
 
     po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for acoustic likelihoods");
 
@@ -101,7 +101,7 @@ int main(int argc, char *argv[]) {
     VectorFst<StdArc> *decode_fst = NULL; // only used if there is a single
                                           // decoding graph.
     
-    TaskSequencer<DecodeUtteranceLatticeFasterClass> sequencer(sequencer_config);
+    TaskScheduler<DecodeUtteranceLatticeFasterClass> scheduler(scheduler_config);
     if (ClassifyRspecifier(fst_in_str, NULL, NULL) == kNoRspecifier) {
       SequentialBaseFloatMatrixReader loglike_reader(feature_rspecifier);
       // Input FST is just one FST, not a table of FSTs.
@@ -131,7 +131,7 @@ int main(int argc, char *argv[]) {
                   &words_writer, &compact_lattice_writer, &lattice_writer,
                   &tot_like, &frame_count, &num_success, &num_fail, NULL);
 
-          sequencer.Run(task); // takes ownership of "task",
+          scheduler.Run(task, loglikes->NumRows()); // takes ownership of "task",
           // and will delete it when done.
         }
       }
@@ -164,19 +164,19 @@ int main(int argc, char *argv[]) {
                 determinize, allow_partial, &alignment_writer, &words_writer,
                 &compact_lattice_writer, &lattice_writer, &tot_like,
                 &frame_count, &num_success, &num_fail, NULL);
-        sequencer.Run(task); // takes ownership of "task",
+        scheduler.Run(task, loglikes->NumRows()); // takes ownership of "task",
         // and will delete it when done.
       }
     }
-    sequencer.Wait();
+    scheduler.Wait();
 
     delete decode_fst;
       
     double elapsed = timer.Elapsed();
-    KALDI_LOG << "Decoded with " << sequencer_config.num_threads << " threads.";
+    KALDI_LOG << "Decoded with " << scheduler_config.num_threads << " threads.";
     KALDI_LOG << "Time taken "<< elapsed
               << "s: real-time factor per thread assuming 100 frames/sec is "
-              << (sequencer_config.num_threads*elapsed*100.0/frame_count);
+              << (scheduler_config.num_threads*elapsed*100.0/frame_count);
     KALDI_LOG << "Done " << num_success << " utterances, failed for "
               << num_fail;
     KALDI_LOG << "Overall log-likelihood per frame is " << (tot_like/frame_count) << " over "
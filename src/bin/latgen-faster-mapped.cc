@@ -26,6 +26,8 @@
 #include "hmm/transition-model.h"
 #include "fstext/fstext-lib.h"
 #include "decoder/decoder-wrappers.h"
+#include "decoder/decoder-search-stats.h"
+#include "decoder/csr-decoding-graph.h"
 #include "decoder/decodable-matrix.h"
 #include "base/timer.h"
 
@@ -45,17 +47,25 @@ int main(int argc, char *argv[]) {
         " lattice-wspecifier [ words-wspecifier [alignments-wspecifier] ]\n";
     ParseOptions po(usage);
     Timer timer;
-    bool allow_partial = false;
+    bool allow_partial = false, csr_graph = false;
     BaseFloat acoustic_scale = 0.1;
     LatticeFasterDecoderConfig config;
     
-    std::string word_syms_filename;
+    std::string word_syms_filename, search_stats_wxfilename;
     config.Register(&po);
     po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for acoustic likelihoods");
 
     po.Register("word-symbol-table", &word_syms_filename, "Symbol table for words [for debug output]");
     po.Register("allow-partial", &allow_partial, "If true, produce output even if end state was not reached.");
+    po.Register("csr-graph", &csr_graph, "If true, fst-in is a graph written "
+                "by make-csr-graph; it is memory-mapped if it is an ordinary "
+                "file, and decoded with the cache-friendly code path.");
     
+    po.Register("search-stats-json", &search_stats_wxfilename, "If set, "
+                "write statistics of the search (active tokens, arcs expanded, "
+                "adaptive beam, etc., per frame and per utterance) to this file "
+                "in JSON format.");
+
     po.Read(argc, argv);
 
     if (po.NumArgs() < 4 || po.NumArgs() > 6) {
@@ -93,15 +103,27 @@ int main(int argc, char *argv[]) {
 
     double tot_like = 0.0;
     kaldi::int64 frame_count = 0;
+    DecoderSearchStats search_stats;
     int num_success = 0, num_fail = 0;
 
     if (ClassifyRspecifier(fst_in_str, NULL, NULL) == kNoRspecifier) {
       SequentialBaseFloatMatrixReader loglike_reader(feature_rspecifier);
       // Input FST is just one FST, not a table of FSTs.
-      VectorFst<StdArc> *decode_fst = fst::ReadFstKaldi(fst_in_str);
+      VectorFst<StdArc> *decode_fst = NULL;
+      CsrDecodingGraph decode_graph;
+      if (csr_graph) {
+        bool use_mmap = true;
+        ReadCsrDecodingGraph(fst_in_str, use_mmap, &decode_graph);
+      } else {
+        decode_fst = fst::ReadFstKaldi(fst_in_str);
+      }
 
       {
-        LatticeFasterDecoder decoder(*decode_fst, config);
+        LatticeFasterDecoder *decoder = (csr_graph ?
+            new LatticeFasterDecoder(decode_graph, config) :
+            new LatticeFasterDecoder(*decode_fst, config));
+        if (!search_stats_wxfilename.empty())
+          decoder->SetSearchStats(&search_stats);
     
         for (; !loglike_reader.Done(); loglike_reader.Next()) {
           std::string utt = loglike_reader.Key();
@@ -117,7 +139,7 @@ int main(int argc, char *argv[]) {
 
           double like;
           if (DecodeUtteranceLatticeFaster(
-                  decoder, decodable, trans_model, word_syms, utt,
+                  *decoder, decodable, trans_model, word_syms, utt,
                   acoustic_scale, determinize, allow_partial, &alignment_writer,
                   &words_writer, &compact_lattice_writer, &lattice_writer,
                   &like)) {
@@ -125,10 +147,15 @@ int main(int argc, char *argv[]) {
             frame_count += loglikes.NumRows();
             num_success++;
           } else num_fail++;
+          if (!search_stats_wxfilename.empty())
+            search_stats.EndUtterance(utt);
         }
+        delete decoder;
       }
-      delete decode_fst; // delete this only after decoder goes out of scope.
+      delete decode_fst; // delete this only after the decoder is deleted.
     } else { // We have different FSTs for different utterances.
+      if (csr_graph)
+        KALDI_ERR << "--csr-graph=true is not supported with a table of FSTs.";
       SequentialTableReader<fst::VectorFstHolder> fst_reader(fst_in_str);
       RandomAccessBaseFloatMatrixReader loglike_reader(feature_rspecifier);          
       for (; !fst_reader.Done(); fst_reader.Next()) {
@@ -146,6 +173,8 @@ int main(int argc, char *argv[]) {
           continue;
         }
         LatticeFasterDecoder decoder(fst_reader.Value(), config);
+        if (!search_stats_wxfilename.empty())
+          decoder.SetSearchStats(&search_stats);
         DecodableMatrixScaledMapped decodable(trans_model, loglikes, acoustic_scale);
         double like;
         if (DecodeUtteranceLatticeFaster(
@@ -156,6 +185,8 @@ int main(int argc, char *argv[]) {
           frame_count += loglikes.NumRows();
           num_success++;
         } else num_fail++;
+        if (!search_stats_wxfilename.empty())
+          search_stats.EndUtterance(utt);
       }
     }
       
@@ -168,6 +199,11 @@ int main(int argc, char *argv[]) {
     KALDI_LOG << "Overall log-likelihood per frame is " << (tot_like/frame_count) << " over "
               << frame_count<<" frames.";
 
+    if (!search_stats_wxfilename.empty()) {
+      Output ko(search_stats_wxfilename, false);
+      search_stats.WriteJson(ko.Stream());
+    }
+
     delete word_syms;
     if (num_success != 0) return 0;
     else return 1;
@@ -0,0 +1,248 @@
+// bin/latgen-grammar-faster-mapped.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "tree/context-dep.h"
+#include "fstext/fstext-lib.h"
+#include "decoder/decoder-wrappers.h"
+#include "decoder/grammar-graph.h"
+#include "decoder/decodable-matrix.h"
+#include "base/timer.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    using fst::SymbolTable;
+    using fst::VectorFst;
+    using fst::StdArc;
+
+    const char *usage =
+        "Generate lattices, reading log-likelihoods as matrices, decoding with\n"
+        "a top-level HCLG containing nonterminals (built with make-hclg\n"
+        "--nonterminal-syms), into which class sub-graphs are inserted on the\n"
+        "fly.  The sub-graphs may be fixed HCLGs (--subgraphs), or be compiled\n"
+        "from per-utterance word lists (--class-words-rspecifier), e.g. for\n"
+        "contact names; compiled sub-graphs are cached by word list.\n"
+        " (model is needed only for the integer mappings in its transition-model)\n"
+        "Usage: latgen-grammar-faster-mapped [options] trans-model-in "
+        "top-hclg-fst-in loglikes-rspecifier lattice-wspecifier "
+        "[ words-wspecifier [alignments-wspecifier] ]\n"
+        "e.g.: latgen-grammar-faster-mapped --nonterminal-ilabels=nt.int \\\n"
+        "  --tree=tree --lexicon-fst=L_disambig.fst --disambig-syms=disambig.int \\\n"
+        "  --class-words-rspecifier=ark:contacts.ark final.mdl HCLG.fst \\\n"
+        "  ark:loglikes.ark ark:lat.ark\n";
+    ParseOptions po(usage);
+    Timer timer;
+    bool allow_partial = false;
+    BaseFloat acoustic_scale = 0.1;
+    LatticeFasterDecoderConfig config;
+    GrammarGraphOptions graph_opts;
+    HclgCompilerOptions hclg_opts;
+
+    std::string word_syms_filename, nonterm_rxfilename, subgraphs_rxfilename,
+        class_words_rspecifier, tree_rxfilename, lex_rxfilename,
+        disambig_rxfilename;
+    config.Register(&po);
+    graph_opts.Register(&po);
+    hclg_opts.Register(&po);
+    po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for acoustic likelihoods");
+    po.Register("word-symbol-table", &word_syms_filename, "Symbol table for words [for debug output]");
+    po.Register("allow-partial", &allow_partial, "If true, produce output even if end state was not reached.");
+    po.Register("nonterminal-ilabels", &nonterm_rxfilename, "The input "
+                "labels of the nonterminals in the top-level HCLG, as written "
+                "by make-hclg --write-nonterminal-ilabels (required)");
+    po.Register("subgraphs", &subgraphs_rxfilename, "File with lines "
+                "<nonterminal-ilabel> <hclg-rxfilename>, giving the "
+                "sub-graphs used when no word list is given for the "
+                "utterance");
+    po.Register("class-words-rspecifier", &class_words_rspecifier, "Table of "
+                "vectors of vectors, indexed by utterance, where each vector "
+                "is <nonterminal-ilabel> <word1> <word2> ...; the sub-graphs "
+                "for those word lists are compiled using --tree, "
+                "--lexicon-fst and --disambig-syms");
+    po.Register("tree", &tree_rxfilename, "The tree, for compiling "
+                "sub-graphs");
+    po.Register("lexicon-fst", &lex_rxfilename, "L_disambig.fst, for "
+                "compiling sub-graphs");
+    po.Register("disambig-syms", &disambig_rxfilename, "Disambiguation "
+                "symbols on the input of --lexicon-fst");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 4 || po.NumArgs() > 6 || nonterm_rxfilename == "") {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string model_in_filename = po.GetArg(1),
+        hclg_in_filename = po.GetArg(2),
+        feature_rspecifier = po.GetArg(3),
+        lattice_wspecifier = po.GetArg(4),
+        words_wspecifier = po.GetOptArg(5),
+        alignment_wspecifier = po.GetOptArg(6);
+
+    g_num_threads = hclg_opts.num_threads;
+
+    TransitionModel trans_model;
+    ReadKaldiObject(model_in_filename, &trans_model);
+
+    bool determinize = config.determinize_lattice;
+    CompactLatticeWriter compact_lattice_writer;
+    LatticeWriter lattice_writer;
+    if (! (determinize ? compact_lattice_writer.Open(lattice_wspecifier)
+           : lattice_writer.Open(lattice_wspecifier)))
+      KALDI_ERR << "Could not open table for writing lattices: "
+                 << lattice_wspecifier;
+
+    Int32VectorWriter words_writer(words_wspecifier);
+
+    Int32VectorWriter alignment_writer(alignment_wspecifier);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (word_syms_filename != "")
+      if (!(word_syms = fst::SymbolTable::ReadText(word_syms_filename)))
+        KALDI_ERR << "Could not read symbol table from file "
+                   << word_syms_filename;
+
+    std::vector<int32> nonterminals;
+    if (!ReadIntegerVectorSimple(nonterm_rxfilename, &nonterminals))
+      KALDI_ERR << "Could not read nonterminal input labels from "
+                << PrintableRxfilename(nonterm_rxfilename);
+
+    // The fixed sub-graphs, indexed like "nonterminals".
+    std::vector<VectorFst<StdArc>*> subgraphs(nonterminals.size(), NULL);
+    if (subgraphs_rxfilename != "") {
+      Input ki(subgraphs_rxfilename);
+      std::string line;
+      while (std::getline(ki.Stream(), line)) {
+        std::vector<std::string> fields;
+        SplitStringToVector(line, " \t\r", true, &fields);
+        if (fields.empty()) continue;
+        int32 ilabel;
+        if (fields.size() != 2 || !ConvertStringToInteger(fields[0], &ilabel))
+          KALDI_ERR << "Bad line in " << subgraphs_rxfilename << ": " << line;
+        std::vector<int32>::iterator iter = std::find(
+            nonterminals.begin(), nonterminals.end(), ilabel);
+        if (iter == nonterminals.end())
+          KALDI_ERR << "Label " << ilabel << " in " << subgraphs_rxfilename
+                    << " is not a nonterminal.";
+        int32 i = iter - nonterminals.begin();
+        delete subgraphs[i];
+        subgraphs[i] = fst::ReadFstKaldi(fields[1]);
+      }
+    }
+
+    ContextDependency ctx_dep;
+    VectorFst<StdArc> *lex_fst = NULL;
+    std::vector<int32> disambig_phones;
+    GrammarSubgraphCompiler *compiler = NULL;
+    RandomAccessInt32VectorVectorReader class_words_reader;
+    if (class_words_rspecifier != "") {
+      if (tree_rxfilename == "" || lex_rxfilename == "")
+        KALDI_ERR << "--class-words-rspecifier requires --tree and "
+                  << "--lexicon-fst";
+      ReadKaldiObject(tree_rxfilename, &ctx_dep);
+      lex_fst = fst::ReadFstKaldi(lex_rxfilename);
+      if (disambig_rxfilename != "")
+        if (!ReadIntegerVectorSimple(disambig_rxfilename, &disambig_phones))
+          KALDI_ERR << "Could not read disambiguation symbols from "
+                    << PrintableRxfilename(disambig_rxfilename);
+      compiler = new GrammarSubgraphCompiler(hclg_opts, ctx_dep, trans_model,
+                                             *lex_fst, disambig_phones);
+      if (!class_words_reader.Open(class_words_rspecifier))
+        KALDI_ERR << "Could not open table " << class_words_rspecifier;
+    }
+
+    double tot_like = 0.0;
+    kaldi::int64 frame_count = 0;
+    int num_success = 0, num_fail = 0;
+
+    VectorFst<StdArc> *hclg_fst = fst::ReadFstKaldi(hclg_in_filename);
+    {
+      GrammarGraph graph(*hclg_fst, nonterminals, graph_opts);
+      LatticeFasterDecoder decoder(graph, config);
+
+      SequentialBaseFloatMatrixReader loglike_reader(feature_rspecifier);
+      for (; !loglike_reader.Done(); loglike_reader.Next()) {
+        std::string utt = loglike_reader.Key();
+        Matrix<BaseFloat> loglikes (loglike_reader.Value());
+        loglike_reader.FreeCurrent();
+        if (loglikes.NumRows() == 0) {
+          KALDI_WARN << "Zero-length utterance: " << utt;
+          num_fail++;
+          continue;
+        }
+
+        for (size_t i = 0; i < nonterminals.size(); i++)
+          graph.SetSubgraph(nonterminals[i], subgraphs[i]);
+        if (compiler != NULL && class_words_reader.HasKey(utt)) {
+          const std::vector<std::vector<int32> > &classes =
+              class_words_reader.Value(utt);
+          for (size_t i = 0; i < classes.size(); i++) {
+            if (classes[i].size() < 2)
+              KALDI_ERR << "Empty word list for utterance " << utt;
+            std::vector<int32> words(classes[i].begin() + 1,
+                                     classes[i].end());
+            graph.SetSubgraph(classes[i][0], compiler->GetSubgraph(words));
+          }
+        }
+
+        DecodableMatrixScaledMapped decodable(trans_model, loglikes, acoustic_scale);
+
+        double like;
+        if (DecodeUtteranceLatticeFaster(
+                decoder, decodable, trans_model, word_syms, utt,
+                acoustic_scale, determinize, allow_partial, &alignment_writer,
+                &words_writer, &compact_lattice_writer, &lattice_writer,
+                &like)) {
+          tot_like += like;
+          frame_count += loglikes.NumRows();
+          num_success++;
+        } else num_fail++;
+        KALDI_VLOG(2) << "Utterance " << utt << " visited "
+                      << graph.NumStatesSeen() << " expanded states.";
+      }
+    }
+    if (compiler != NULL)
+      KALDI_LOG << "Compiled " << compiler->NumCached() << " sub-graphs.";
+    delete compiler;  // delete these only after the graph is deleted.
+    delete lex_fst;
+    DeletePointers(&subgraphs);
+    delete hclg_fst;
+
+    double elapsed = timer.Elapsed();
+    KALDI_LOG << "Time taken "<< elapsed
+              << "s: real-time factor assuming 100 frames/sec is "
+              << (elapsed*100.0/frame_count);
+    KALDI_LOG << "Done " << num_success << " utterances, failed for "
+              << num_fail;
+    KALDI_LOG << "Overall log-likelihood per frame is " << (tot_like/frame_count) << " over "
+              << frame_count<<" frames.";
+
+    delete word_syms;
+    if (num_success != 0) return 0;
+    else return 1;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -0,0 +1,176 @@
+// bin/latgen-lookahead-faster-mapped.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "fstext/fstext-lib.h"
+#include "lm/const-arpa-lm.h"
+#include "decoder/decoder-wrappers.h"
+#include "decoder/lookahead-composed-graph.h"
+#include "decoder/decodable-matrix.h"
+#include "base/timer.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    using fst::SymbolTable;
+    using fst::VectorFst;
+    using fst::StdArc;
+
+    const char *usage =
+        "Generate lattices, reading log-likelihoods as matrices, decoding with\n"
+        "HCL o G composed on the fly (with language-model lookahead), so that\n"
+        "HCLG never has to be built.  G is a ConstArpaLm as written by\n"
+        "arpa-to-const-arpa, or, with --g-is-fst=true, an FST such as G.fst\n"
+        "with the backoff arcs having epsilon on the input side.  HCL must\n"
+        "have no disambiguation symbols on its input side.\n"
+        " (model is needed only for the integer mappings in its transition-model)\n"
+        "Usage: latgen-lookahead-faster-mapped [options] trans-model-in "
+        "hcl-fst-in lm-in loglikes-rspecifier lattice-wspecifier "
+        "[ words-wspecifier [alignments-wspecifier] ]\n";
+    ParseOptions po(usage);
+    Timer timer;
+    bool allow_partial = false, g_is_fst = false;
+    BaseFloat acoustic_scale = 0.1;
+    LatticeFasterDecoderConfig config;
+    LookaheadComposedGraphOptions graph_opts;
+
+    std::string word_syms_filename;
+    config.Register(&po);
+    graph_opts.Register(&po);
+    po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for acoustic likelihoods");
+    po.Register("word-symbol-table", &word_syms_filename, "Symbol table for words [for debug output]");
+    po.Register("allow-partial", &allow_partial, "If true, produce output even if end state was not reached.");
+    po.Register("g-is-fst", &g_is_fst, "If true, lm-in is an FST rather "
+                "than a ConstArpaLm.");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 5 || po.NumArgs() > 7) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string model_in_filename = po.GetArg(1),
+        hcl_in_filename = po.GetArg(2),
+        lm_in_filename = po.GetArg(3),
+        feature_rspecifier = po.GetArg(4),
+        lattice_wspecifier = po.GetArg(5),
+        words_wspecifier = po.GetOptArg(6),
+        alignment_wspecifier = po.GetOptArg(7);
+
+    TransitionModel trans_model;
+    ReadKaldiObject(model_in_filename, &trans_model);
+
+    bool determinize = config.determinize_lattice;
+    CompactLatticeWriter compact_lattice_writer;
+    LatticeWriter lattice_writer;
+    if (! (determinize ? compact_lattice_writer.Open(lattice_wspecifier)
+           : lattice_writer.Open(lattice_wspecifier)))
+      KALDI_ERR << "Could not open table for writing lattices: "
+                 << lattice_wspecifier;
+
+    Int32VectorWriter words_writer(words_wspecifier);
+
+    Int32VectorWriter alignment_writer(alignment_wspecifier);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (word_syms_filename != "")
+      if (!(word_syms = fst::SymbolTable::ReadText(word_syms_filename)))
+        KALDI_ERR << "Could not read symbol table from file "
+                   << word_syms_filename;
+
+    double tot_like = 0.0;
+    kaldi::int64 frame_count = 0;
+    int num_success = 0, num_fail = 0;
+
+    VectorFst<StdArc> *hcl_fst = fst::ReadFstKaldi(hcl_in_filename);
+    ConstArpaLm const_arpa;
+    VectorFst<StdArc> *g_fst = NULL;
+    fst::DeterministicOnDemandFst<StdArc> *g = NULL;
+    if (g_is_fst) {
+      g_fst = fst::ReadFstKaldi(lm_in_filename);
+      g = new fst::BackoffDeterministicOnDemandFst<StdArc>(*g_fst);
+    } else {
+      // This is memory-mapped if it was written by arpa-to-const-arpa
+      // --aligned=true.
+      bool use_mmap = true;
+      ReadConstArpaLm(lm_in_filename, use_mmap, &const_arpa);
+      g = new ConstArpaLmDeterministicFst(const_arpa);
+    }
+
+    {
+      LookaheadComposedGraph graph(*hcl_fst, g, graph_opts);
+      LatticeFasterDecoder decoder(graph, config);
+
+      SequentialBaseFloatMatrixReader loglike_reader(feature_rspecifier);
+      for (; !loglike_reader.Done(); loglike_reader.Next()) {
+        std::string utt = loglike_reader.Key();
+        Matrix<BaseFloat> loglikes (loglike_reader.Value());
+        loglike_reader.FreeCurrent();
+        if (loglikes.NumRows() == 0) {
+          KALDI_WARN << "Zero-length utterance: " << utt;
+          num_fail++;
+          continue;
+        }
+
+        DecodableMatrixScaledMapped decodable(trans_model, loglikes, acoustic_scale);
+
+        double like;
+        if (DecodeUtteranceLatticeFaster(
+                decoder, decodable, trans_model, word_syms, utt,
+                acoustic_scale, determinize, allow_partial, &alignment_writer,
+                &words_writer, &compact_lattice_writer, &lattice_writer,
+                &like)) {
+          tot_like += like;
+          frame_count += loglikes.NumRows();
+          num_success++;
+        } else num_fail++;
+        KALDI_VLOG(2) << "Utterance " << utt << " visited "
+                      << graph.NumStatesSeen() << " composed states.";
+        // The state-ids are only needed for the duration of an utterance.
+        graph.Reset();
+      }
+    }
+    delete g;  // delete these only after the graph is deleted.
+    delete g_fst;
+    delete hcl_fst;
+
+    double elapsed = timer.Elapsed();
+    KALDI_LOG << "Time taken "<< elapsed
+              << "s: real-time factor assuming 100 frames/sec is "
+              << (elapsed*100.0/frame_count);
+    KALDI_LOG << "Done " << num_success << " utterances, failed for "
+              << num_fail;
+    KALDI_LOG << "Overall log-likelihood per frame is " << (tot_like/frame_count) << " over "
+              << frame_count<<" frames.";
+
+    delete word_syms;
+    if (num_success != 0) return 0;
+    else return 1;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
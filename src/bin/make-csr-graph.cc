@@ -0,0 +1,64 @@
+// bin/make-csr-graph.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "fstext/fstext-lib.h"
+#include "decoder/csr-decoding-graph.h"
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Convert a decoding graph (e.g. HCLG.fst) to the cache-friendly,\n"
+        "memory-mappable format of class CsrDecodingGraph, which can be\n"
+        "used by decoders such as latgen-faster-mapped with --csr-graph=true.\n"
+        "The output must be an ordinary file for it to be memory-mapped.\n"
+        "\n"
+        "Usage:  make-csr-graph [options] <fst-in> <csr-graph-out>\n"
+        "e.g.: make-csr-graph exp/tri3/graph/HCLG.fst exp/tri3/graph/HCLG.csr\n";
+
+    ParseOptions po(usage);
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string fst_rxfilename = po.GetArg(1),
+        graph_wxfilename = po.GetArg(2);
+
+    fst::VectorFst<fst::StdArc> *fst = fst::ReadFstKaldi(fst_rxfilename);
+    CsrDecodingGraph graph(*fst);
+    delete fst;
+    graph.Check();
+    WriteCsrDecodingGraph(graph_wxfilename, graph);
+
+    KALDI_LOG << "Wrote graph with " << graph.NumStates() << " states and "
+              << graph.NumArcs() << " arcs to " << graph_wxfilename;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
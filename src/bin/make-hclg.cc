@@ -0,0 +1,156 @@
+// bin/make-hclg.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "fstext/fstext-lib.h"
+#include "thread/kaldi-thread.h"
+#include "decoder/hclg-compiler.h"
+#include "decoder/grammar-weight-map.h"
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    using fst::VectorFst;
+    using fst::StdArc;
+
+    const char *usage =
+        "Build the decoding graph HCLG from the lexicon, grammar, tree and\n"
+        "model, in memory.  This does the same as the FST stages of\n"
+        "utils/mkgraph.sh (fsttablecompose, fstdeterminizestar,\n"
+        "fstminimizeencoded, fstcomposecontext, make-h-transducer,\n"
+        "fstrmsymbols, fstrmepslocal and add-self-loops) without writing the\n"
+        "intermediate FSTs to disk.  The context size is taken from the tree.\n"
+        "With --nonterminal-syms, those disambiguation symbols are kept in\n"
+        "HCLG to mark where class sub-graphs are entered at decode time (see\n"
+        "latgen-grammar-faster-mapped).\n"
+        "With --write-grammar-weight-map, the costs of G are kept track of so\n"
+        "that HCLG can be updated for new G weights (with the same topology)\n"
+        "by update-hclg-grammar-weights.\n"
+        "\n"
+        "Usage:  make-hclg [options] <tree> <model> <L_disambig.fst> <G.fst> "
+        "<HCLG-out>\n"
+        "e.g.: \n"
+        " make-hclg --disambig-syms=data/lang/phones/disambig.int \\\n"
+        "   exp/tri1/tree exp/tri1/final.mdl data/lang/L_disambig.fst \\\n"
+        "   data/lang/G.fst exp/tri1/graph/HCLG.fst\n";
+
+    ParseOptions po(usage);
+    HclgCompilerOptions opts;
+    std::string disambig_rxfilename, ilabels_wxfilename,
+        nonterm_rxfilename, nonterm_wxfilename, weight_map_wxfilename;
+    opts.Register(&po);
+    po.Register("disambig-syms", &disambig_rxfilename, "List of "
+                "disambiguation symbols on the input of L_disambig.fst "
+                "(e.g. phones/disambig.int)");
+    po.Register("write-ilabels", &ilabels_wxfilename, "If supplied, write "
+                "the ilabel info of the context FST to this file (like the "
+                "first argument of fstcomposecontext)");
+    po.Register("nonterminal-syms", &nonterm_rxfilename, "List of "
+                "disambiguation symbols on the input of L_disambig.fst that "
+                "are nonterminals, i.e. are not to be removed from HCLG");
+    po.Register("write-nonterminal-ilabels", &nonterm_wxfilename, "If "
+                "supplied, write the input labels that the nonterminals have "
+                "in HCLG to this file, in the same order as "
+                "--nonterminal-syms");
+    po.Register("write-grammar-weight-map", &weight_map_wxfilename, "If "
+                "supplied, write to this file the map from the arcs of HCLG "
+                "to the arcs of G that update-hclg-grammar-weights uses.");
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 5) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string tree_rxfilename = po.GetArg(1),
+        model_rxfilename = po.GetArg(2),
+        lex_rxfilename = po.GetArg(3),
+        grammar_rxfilename = po.GetArg(4),
+        hclg_wxfilename = po.GetArg(5);
+
+    g_num_threads = opts.num_threads;
+
+    ContextDependency ctx_dep;
+    ReadKaldiObject(tree_rxfilename, &ctx_dep);
+
+    TransitionModel trans_model;
+    ReadKaldiObject(model_rxfilename, &trans_model);
+
+    std::vector<int32> disambig_phones;
+    if (disambig_rxfilename != "")
+      if (!ReadIntegerVectorSimple(disambig_rxfilename, &disambig_phones))
+        KALDI_ERR << "Could not read disambiguation symbols from "
+                  << PrintableRxfilename(disambig_rxfilename);
+
+    std::vector<int32> nonterm_phones, nonterm_ilabels;
+    if (nonterm_rxfilename != "")
+      if (!ReadIntegerVectorSimple(nonterm_rxfilename, &nonterm_phones))
+        KALDI_ERR << "Could not read nonterminal symbols from "
+                  << PrintableRxfilename(nonterm_rxfilename);
+
+    VectorFst<StdArc> lg_fst;
+    std::vector<int32> grammar_words;
+    std::vector<BaseFloat> grammar_costs;
+    {
+      VectorFst<StdArc> *lex_fst = fst::ReadFstKaldi(lex_rxfilename),
+          *grammar_fst = fst::ReadFstKaldi(grammar_rxfilename);
+      if (weight_map_wxfilename != "") {
+        GetGrammarArcs(*grammar_fst, &grammar_words, &grammar_costs);
+        LabelGrammarArcs(grammar_fst);
+      }
+      CompileLG(opts, lex_fst, grammar_fst, &lg_fst);
+      delete lex_fst;
+      delete grammar_fst;
+    }
+    KALDI_LOG << "LG has " << lg_fst.NumStates() << " states.";
+
+    VectorFst<StdArc> clg_fst;
+    std::vector<std::vector<int32> > ilabel_info;
+    CompileCLG(ctx_dep.ContextWidth(), ctx_dep.CentralPosition(),
+               disambig_phones, &lg_fst, &clg_fst, &ilabel_info);
+    KALDI_LOG << "CLG has " << clg_fst.NumStates() << " states.";
+    if (ilabels_wxfilename != "") {
+      bool binary = true;
+      Output ko(ilabels_wxfilename, binary);
+      fst::WriteILabelInfo(ko.Stream(), binary, ilabel_info);
+    }
+
+    VectorFst<StdArc> hclg_fst;
+    CompileHCLG(opts, ctx_dep, trans_model, ilabel_info, &clg_fst, &hclg_fst,
+                (nonterm_rxfilename != "" ? &nonterm_phones : NULL),
+                &nonterm_ilabels);
+    KALDI_LOG << "HCLG has " << hclg_fst.NumStates() << " states.";
+    if (weight_map_wxfilename != "") {
+      GrammarWeightMap weight_map;
+      weight_map.Init(grammar_words, grammar_costs, &hclg_fst);
+      WriteKaldiObject(weight_map, weight_map_wxfilename, true);
+    }
+    if (nonterm_wxfilename != "")
+      if (!WriteIntegerVectorSimple(nonterm_wxfilename, nonterm_ilabels))
+        KALDI_ERR << "Could not write nonterminal input labels to "
+                  << PrintableWxfilename(nonterm_wxfilename);
+
+    fst::WriteFstKaldi(hclg_fst, hclg_wxfilename);
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -0,0 +1,76 @@
+// bin/update-hclg-grammar-weights.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "fstext/fstext-lib.h"
+#include "decoder/grammar-weight-map.h"
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    using fst::VectorFst;
+    using fst::StdArc;
+
+    const char *usage =
+        "Rewrite the weights of a decoding graph HCLG for a new G.fst that has\n"
+        "the same arcs (and words) as the one it was built from, but different\n"
+        "weights, e.g. after changing the interpolation weights of an LM.  The\n"
+        "graph and the map must have been written by make-hclg\n"
+        "--write-grammar-weight-map.  No composition or determinization is\n"
+        "done; the graph can then be converted with make-csr-graph if needed.\n"
+        "\n"
+        "Usage:  update-hclg-grammar-weights [options] <grammar-weight-map> "
+        "<G-new.fst> <HCLG-in> <HCLG-out>\n"
+        "e.g.: \n"
+        " update-hclg-grammar-weights exp/tri1/graph/HCLG.map \\\n"
+        "   data/lang_new/G.fst exp/tri1/graph/HCLG.fst \\\n"
+        "   exp/tri1/graph_new/HCLG.fst\n";
+
+    ParseOptions po(usage);
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 4) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string weight_map_rxfilename = po.GetArg(1),
+        grammar_rxfilename = po.GetArg(2),
+        hclg_rxfilename = po.GetArg(3),
+        hclg_wxfilename = po.GetArg(4);
+
+    GrammarWeightMap weight_map;
+    ReadKaldiObject(weight_map_rxfilename, &weight_map);
+
+    VectorFst<StdArc> *grammar_fst = fst::ReadFstKaldi(grammar_rxfilename),
+        *hclg_fst = fst::ReadFstKaldi(hclg_rxfilename);
+    weight_map.UpdateWeights(*grammar_fst, hclg_fst);
+    KALDI_LOG << "Updated the weights of " << weight_map.NumArcs()
+              << " arcs of HCLG from " << weight_map.NumGrammarArcs()
+              << " grammar arcs.";
+
+    fst::WriteFstKaldi(*hclg_fst, hclg_wxfilename);
+    delete grammar_fst;
+    delete hclg_fst;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -0,0 +1,43 @@
+// cudafeat/cudafeat-kernels-ansi.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_CUDAFEAT_CUDAFEAT_KERNELS_ANSI_H_
+#define KALDI_CUDAFEAT_CUDAFEAT_KERNELS_ANSI_H_
+
+#include "cudamatrix/cu-matrixdim.h"
+
+#if HAVE_CUDA == 1
+
+extern "C" {
+
+/*********************************************************
+ * The kernels of the GPU feature extraction
+ * (see cudafeat/feature-spectral-cuda.h)
+ */
+void cudaF_extract_windows(dim3 Gr, dim3 Bl, const float *wave, int wave_dim, int frame_shift, int frame_length, bool snip_edges, float *frames, MatrixDim d);
+void cudaD_extract_windows(dim3 Gr, dim3 Bl, const double *wave, int wave_dim, int frame_shift, int frame_length, bool snip_edges, double *frames, MatrixDim d);
+void cudaF_power_spectrum(dim3 Gr, dim3 Bl, const float *complex_ffts, int complex_stride, float *power, MatrixDim d);
+void cudaD_power_spectrum(dim3 Gr, dim3 Bl, const double *complex_ffts, int complex_stride, double *power, MatrixDim d);
+
+} // extern "C"
+
+#endif // HAVE_CUDA
+
+#endif
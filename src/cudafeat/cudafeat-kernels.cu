@@ -0,0 +1,103 @@
+// cudafeat/cudafeat-kernels.cu
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+// In this file is the CUDA code of the feature-extraction kernels, plus the
+// ANSI-C wrappers.
+
+#include "cudafeat/cudafeat-kernels-ansi.h"
+
+
+/***********************************************************************
+ * CUDA kernels
+ * In these kernels the x dimension corresponds to rows (frames) and the
+ * y dimension to columns.
+ */
+
+// Extracts frame i of the waveform into row i of "frames", which has
+// d.cols >= frame_length columns; columns from frame_length onward are
+// zeroed (this is the zero-padding for the FFT).  The indexing is the same
+// as in ExtractWindow() in feat/feature-window.cc, including the reflection
+// at the edges of the signal when snip_edges == false.
+template<typename Real>
+__global__
+static void _extract_windows(const Real *wave, int wave_dim, int frame_shift,
+                             int frame_length, bool snip_edges, Real *frames,
+                             MatrixDim d) {
+  int i = blockIdx.x * blockDim.x + threadIdx.x;
+  int j = blockIdx.y * blockDim.y + threadIdx.y;
+  if (i < d.rows && j < d.cols) {
+    Real val = 0.0;
+    if (j < frame_length) {
+      int begin;
+      if (snip_edges)
+        begin = i * frame_shift;
+      else
+        begin = static_cast<int>(frame_shift * (i + 0.5)) - frame_length / 2;
+      int s = begin + j;
+      // Extend the signal by reflection at the edges; the modulus only has an
+      // effect for files shorter than a single frame.
+      if (s < 0)
+        s = (-s) % wave_dim;
+      else if (s >= wave_dim)
+        s = wave_dim - 1 - (s - wave_dim) % wave_dim;
+      val = wave[s];
+    }
+    frames[i * d.stride + j] = val;
+  }
+}
+
+// Computes the power spectrum from the output of an R2C FFT: row i of
+// "complex_ffts" (whose stride is "complex_stride" Reals) contains
+// d.cols complex numbers stored as (re, im) pairs, and element (i, j) of
+// "power" is set to re^2 + im^2 of the j'th of them.
+template<typename Real>
+__global__
+static void _power_spectrum(const Real *complex_ffts, int complex_stride,
+                            Real *power, MatrixDim d) {
+  int i = blockIdx.x * blockDim.x + threadIdx.x;
+  int j = blockIdx.y * blockDim.y + threadIdx.y;
+  if (i < d.rows && j < d.cols) {
+    Real re = complex_ffts[i * complex_stride + 2 * j],
+        im = complex_ffts[i * complex_stride + 2 * j + 1];
+    power[i * d.stride + j] = re * re + im * im;
+  }
+}
+
+
+/***********************************************************************
+ * ANSI-C wrappers of CUDA kernels
+ */
+
+void cudaF_extract_windows(dim3 Gr, dim3 Bl, const float *wave, int wave_dim, int frame_shift, int frame_length, bool snip_edges, float *frames, MatrixDim d) {
+  _extract_windows<<<Gr,Bl>>>(wave, wave_dim, frame_shift, frame_length, snip_edges, frames, d);
+}
+
+void cudaD_extract_windows(dim3 Gr, dim3 Bl, const double *wave, int wave_dim, int frame_shift, int frame_length, bool snip_edges, double *frames, MatrixDim d) {
+  _extract_windows<<<Gr,Bl>>>(wave, wave_dim, frame_shift, frame_length, snip_edges, frames, d);
+}
+
+void cudaF_power_spectrum(dim3 Gr, dim3 Bl, const float *complex_ffts, int complex_stride, float *power, MatrixDim d) {
+  _power_spectrum<<<Gr,Bl>>>(complex_ffts, complex_stride, power, d);
+}
+
+void cudaD_power_spectrum(dim3 Gr, dim3 Bl, const double *complex_ffts, int complex_stride, double *power, MatrixDim d) {
+  _power_spectrum<<<Gr,Bl>>>(complex_ffts, complex_stride, power, d);
+}
@@ -0,0 +1,44 @@
+// cudafeat/cudafeat-kernels.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_CUDAFEAT_CUDAFEAT_KERNELS_H_
+#define KALDI_CUDAFEAT_CUDAFEAT_KERNELS_H_
+
+#if HAVE_CUDA == 1
+
+#include "cudafeat/cudafeat-kernels-ansi.h"
+
+/*
+ * C++ wrappers of the ANSI-C CUDA kernels in cudafeat-kernels.cu, overloaded
+ * on the floating-point type.
+ */
+
+namespace kaldi {
+
+inline void cuda_extract_windows(dim3 Gr, dim3 Bl, const float *wave, int wave_dim, int frame_shift, int frame_length, bool snip_edges, float *frames, MatrixDim d) { cudaF_extract_windows(Gr,Bl,wave,wave_dim,frame_shift,frame_length,snip_edges,frames,d); }
+inline void cuda_extract_windows(dim3 Gr, dim3 Bl, const double *wave, int wave_dim, int frame_shift, int frame_length, bool snip_edges, double *frames, MatrixDim d) { cudaD_extract_windows(Gr,Bl,wave,wave_dim,frame_shift,frame_length,snip_edges,frames,d); }
+inline void cuda_power_spectrum(dim3 Gr, dim3 Bl, const float *complex_ffts, int complex_stride, float *power, MatrixDim d) { cudaF_power_spectrum(Gr,Bl,complex_ffts,complex_stride,power,d); }
+inline void cuda_power_spectrum(dim3 Gr, dim3 Bl, const double *complex_ffts, int complex_stride, double *power, MatrixDim d) { cudaD_power_spectrum(Gr,Bl,complex_ffts,complex_stride,power,d); }
+
+} // namespace kaldi
+
+#endif // HAVE_CUDA
+
+#endif
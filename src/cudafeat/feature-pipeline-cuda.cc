@@ -0,0 +1,164 @@
+// cudafeat/feature-pipeline-cuda.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <vector>
+
+#include "cudafeat/feature-pipeline-cuda.h"
+
+namespace kaldi {
+
+void ApplyCmvnCuda(const MatrixBase<double> &stats,
+                   bool var_norm,
+                   CuMatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(feats != NULL);
+  int32 dim = stats.NumCols() - 1;
+  if (stats.NumRows() > 2 || stats.NumRows() < 1 || feats->NumCols() != dim) {
+    KALDI_ERR << "Dim mismatch: cmvn "
+              << stats.NumRows() << 'x' << stats.NumCols()
+              << ", feats " << feats->NumRows() << 'x' << feats->NumCols();
+  }
+  if (stats.NumRows() == 1 && var_norm)
+    KALDI_ERR << "You requested variance normalization but no variance stats "
+              << "are supplied.";
+
+  double count = stats(0, dim);
+  if (count < 1.0)
+    KALDI_ERR << "Insufficient stats for cepstral mean and variance normalization: "
+              << "count = " << count;
+
+  // The offset and scale are computed on the host as in ApplyCmvn(); they
+  // are tiny compared with the features.
+  Matrix<BaseFloat> norm(2, dim);  // norm(0, d) = mean offset
+  // norm(1, d) = scale, e.g. x(d) <-- x(d)*norm(1, d) + norm(0, d).
+  for (int32 d = 0; d < dim; d++) {
+    double mean, offset, scale;
+    mean = stats(0, d)/count;
+    if (!var_norm) {
+      scale = 1.0;
+      offset = -mean;
+    } else {
+      double var = (stats(1, d)/count) - mean*mean,
+          floor = 1.0e-20;
+      if (var < floor) {
+        KALDI_WARN << "Flooring cepstral variance from " << var << " to "
+                   << floor;
+        var = floor;
+      }
+      scale = 1.0 / sqrt(var);
+      if (scale != scale || 1/scale == 0.0)
+        KALDI_ERR << "NaN or infinity in cepstral mean/variance computation";
+      offset = -(mean*scale);
+    }
+    norm(0, d) = offset;
+    norm(1, d) = scale;
+  }
+  CuMatrix<BaseFloat> cu_norm(norm);
+  if (var_norm)
+    feats->MulColsVec(cu_norm.Row(1));
+  feats->AddVecToRows(1.0, cu_norm.Row(0));
+}
+
+void ApplyUttCmvnCuda(bool var_norm, CuMatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(feats != NULL);
+  int32 num_frames = feats->NumRows(), dim = feats->NumCols();
+  if (num_frames == 0) return;
+  CuVector<BaseFloat> mean(dim);
+  mean.AddRowSumMat(1.0 / num_frames, *feats, 0.0);
+  feats->AddVecToRows(-1.0, mean);
+  if (var_norm) {
+    // We compute the variance from the mean-subtracted features, which is
+    // more accurate in single precision than using the sum of squares.
+    CuVector<BaseFloat> scale(dim);
+    scale.AddDiagMat2(1.0 / num_frames, *feats, kTrans, 0.0);
+    int32 num_floored = scale.ApplyFloor(1.0e-20);
+    if (num_floored > 0)
+      KALDI_WARN << "Flooring cepstral variance in " << num_floored
+                 << " dimensions to " << 1.0e-20;
+    scale.ApplyPow(-0.5);
+    feats->MulColsVec(scale);
+  }
+}
+
+void SpliceFramesCuda(const CuMatrixBase<BaseFloat> &input_features,
+                      int32 left_context,
+                      int32 right_context,
+                      CuMatrix<BaseFloat> *output_features) {
+  int32 T = input_features.NumRows(), D = input_features.NumCols();
+  if (T == 0 || D == 0)
+    KALDI_ERR << "SpliceFramesCuda: empty input";
+  KALDI_ASSERT(left_context >= 0 && right_context >= 0);
+  int32 N = 1 + left_context + right_context;
+  output_features->Resize(T, D*N, kUndefined);
+  std::vector<MatrixIndexT> indexes(T);
+  for (int32 j = 0; j < N; j++) {
+    for (int32 t = 0; t < T; t++) {
+      int32 t2 = t + j - left_context;
+      if (t2 < 0) t2 = 0;
+      if (t2 >= T) t2 = T-1;
+      indexes[t] = t2;
+    }
+    CuArray<MatrixIndexT> cu_indexes(indexes);
+    output_features->ColRange(j*D, D).CopyRows(input_features, cu_indexes);
+  }
+}
+
+
+CudaFeaturePipeline::CudaFeaturePipeline(
+    const MfccOptions &mfcc_opts,
+    const CudaFeaturePipelineOptions &opts):
+    opts_(opts), spectral_features_(mfcc_opts) { }
+
+CudaFeaturePipeline::CudaFeaturePipeline(
+    const FbankOptions &fbank_opts,
+    const CudaFeaturePipelineOptions &opts):
+    opts_(opts), spectral_features_(fbank_opts) { }
+
+int32 CudaFeaturePipeline::Dim() const {
+  return spectral_features_.Dim() *
+      (1 + opts_.left_context + opts_.right_context);
+}
+
+void CudaFeaturePipeline::Compute(const CuVectorBase<BaseFloat> &wave,
+                                  BaseFloat vtln_warp,
+                                  CuMatrix<BaseFloat> *features) {
+  KALDI_ASSERT(features != NULL);
+  CuMatrix<BaseFloat> raw_features;
+  spectral_features_.ComputeFeatures(wave, vtln_warp, &raw_features);
+  if (raw_features.NumRows() == 0) {
+    features->Resize(0, 0);
+    return;
+  }
+  if (opts_.utt_cmvn)
+    ApplyUttCmvnCuda(opts_.norm_vars, &raw_features);
+  if (opts_.left_context == 0 && opts_.right_context == 0)
+    features->Swap(&raw_features);
+  else
+    SpliceFramesCuda(raw_features, opts_.left_context, opts_.right_context,
+                     features);
+}
+
+void CudaFeaturePipeline::Compute(const VectorBase<BaseFloat> &wave,
+                                  BaseFloat vtln_warp,
+                                  CuMatrix<BaseFloat> *features) {
+  CuVector<BaseFloat> cu_wave(wave);
+  Compute(cu_wave, vtln_warp, features);
+}
+
+}  // namespace kaldi
@@ -0,0 +1,118 @@
+// cudafeat/feature-pipeline-cuda.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_CUDAFEAT_FEATURE_PIPELINE_CUDA_H_
+#define KALDI_CUDAFEAT_FEATURE_PIPELINE_CUDA_H_
+
+#include <string>
+
+#include "cudafeat/feature-spectral-cuda.h"
+#include "itf/options-itf.h"
+
+namespace kaldi {
+/// @addtogroup  feat FeatureExtraction
+/// @{
+
+/// This is as ApplyCmvn() in transform/cmvn.h, but for features on the GPU.
+/// "stats" are the cepstral mean and variance stats in the usual format (a
+/// 2 x (dim+1) matrix, or 1 x (dim+1) if var_norm == false).
+void ApplyCmvnCuda(const MatrixBase<double> &stats,
+                   bool var_norm,
+                   CuMatrixBase<BaseFloat> *feats);
+
+/// Does utterance-level cepstral mean (and optionally variance) normalization
+/// of "feats" on the GPU, i.e. the same as accumulating CMVN stats over all
+/// its frames and calling ApplyCmvn(), without copying anything to the host.
+void ApplyUttCmvnCuda(bool var_norm, CuMatrixBase<BaseFloat> *feats);
+
+/// This is as SpliceFrames() in feat/feature-functions.h, but for features on
+/// the GPU: it splices frames together to make a window, duplicating the
+/// first and last frames at the edges.
+void SpliceFramesCuda(const CuMatrixBase<BaseFloat> &input_features,
+                      int32 left_context,
+                      int32 right_context,
+                      CuMatrix<BaseFloat> *output_features);
+
+
+struct CudaFeaturePipelineOptions {
+  bool utt_cmvn;  // if true, apply utterance-level CMN.
+  bool norm_vars;  // if true, also normalize the variance.
+  int32 left_context;  // the frames are spliced with this context.
+  int32 right_context;
+
+  CudaFeaturePipelineOptions(): utt_cmvn(false), norm_vars(false),
+                                left_context(0), right_context(0) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("utt-cmvn", &utt_cmvn, "If true, apply utterance-level "
+                   "cepstral mean normalization to the features.");
+    opts->Register("norm-vars", &norm_vars, "If true, normalize the variance "
+                   "as well (only relevant if --utt-cmvn=true).");
+    opts->Register("left-context", &left_context, "Number of frames of left "
+                   "context to splice the features with.");
+    opts->Register("right-context", &right_context, "Number of frames of "
+                   "right context to splice the features with.");
+  }
+};
+
+
+/**
+   CudaFeaturePipeline computes MFCC or filterbank features on the GPU, then
+   optionally applies utterance-level CMVN and splices the frames, leaving the
+   result in a CuMatrix that can be given directly to the neural net, e.g.
+     pipeline.Compute(wave, 1.0, &features);
+     computer.AcceptInput("input", &features);
+   The only copy between host and device is of the waveform (if it is on the
+   host).
+*/
+class CudaFeaturePipeline {
+ public:
+  CudaFeaturePipeline(const MfccOptions &mfcc_opts,
+                      const CudaFeaturePipelineOptions &opts);
+
+  CudaFeaturePipeline(const FbankOptions &fbank_opts,
+                      const CudaFeaturePipelineOptions &opts);
+
+  /// Returns the dimension of the output features (after splicing).
+  int32 Dim() const;
+
+  /// Computes the features for the waveform "wave" of an entire utterance,
+  /// with VTLN warping factor "vtln_warp" (1.0 for none).  "features" has
+  /// NumFrames(wave.Dim(), frame_opts) rows.
+  void Compute(const CuVectorBase<BaseFloat> &wave,
+               BaseFloat vtln_warp,
+               CuMatrix<BaseFloat> *features);
+
+  /// This version takes the waveform on the host, and copies it to the GPU.
+  void Compute(const VectorBase<BaseFloat> &wave,
+               BaseFloat vtln_warp,
+               CuMatrix<BaseFloat> *features);
+
+ private:
+  CudaFeaturePipelineOptions opts_;
+  CudaSpectralFeatures spectral_features_;
+};
+
+
+/// @} End of "addtogroup feat"
+}  // namespace kaldi
+
+
+#endif  // KALDI_CUDAFEAT_FEATURE_PIPELINE_CUDA_H_
@@ -0,0 +1,214 @@
+// cudafeat/feature-spectral-cuda-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "cudafeat/feature-spectral-cuda.h"
+#include "cudafeat/feature-pipeline-cuda.h"
+#include "cudamatrix/cu-device.h"
+#include "feat/feature-functions.h"
+
+namespace kaldi {
+
+static void RandomFrameOptions(FrameExtractionOptions *opts) {
+  opts->samp_freq = (RandInt(0, 1) == 0 ? 8000 : 16000);
+  opts->frame_length_ms = 25.0 + RandInt(-5, 5);
+  opts->frame_shift_ms = 10.0 + RandInt(-2, 2);
+  opts->dither = 0.0;  // so we can compare with the CPU code.
+  opts->preemph_coeff = (RandInt(0, 3) == 0 ? 0.0 : 0.97);
+  opts->remove_dc_offset = (RandInt(0, 1) == 0);
+  const char *window_types[] = { "hamming", "hanning", "povey", "rectangular" };
+  opts->window_type = window_types[RandInt(0, 3)];
+  opts->round_to_power_of_two = (RandInt(0, 3) != 0);
+  opts->snip_edges = (RandInt(0, 1) == 0);
+}
+
+static void RandomWave(Vector<BaseFloat> *wave) {
+  wave->Resize(RandInt(500, 20000));
+  wave->SetRandn();
+  wave->Scale(1000.0);
+}
+
+static void UnitTestCudaMfcc() {
+  for (int32 i = 0; i < 10; i++) {
+    MfccOptions opts;
+    RandomFrameOptions(&opts.frame_opts);
+    opts.mel_opts.num_bins = RandInt(15, 30);
+    opts.num_ceps = RandInt(5, opts.mel_opts.num_bins);
+    opts.use_energy = (RandInt(0, 1) == 0);
+    opts.raw_energy = (RandInt(0, 1) == 0);
+    opts.energy_floor = (RandInt(0, 1) == 0 ? 0.0 : 1.0);
+    opts.cepstral_lifter = (RandInt(0, 1) == 0 ? 0.0 : 22.0);
+    opts.htk_compat = (RandInt(0, 1) == 0);
+    BaseFloat vtln_warp = (RandInt(0, 1) == 0 ? 1.0 : 0.9);
+
+    Vector<BaseFloat> wave;
+    RandomWave(&wave);
+    Mfcc mfcc(opts);
+    Matrix<BaseFloat> features;
+    mfcc.Compute(wave, vtln_warp, &features, NULL);
+
+    CudaSpectralFeatures cuda_mfcc(opts);
+    CuVector<BaseFloat> cu_wave(wave);
+    CuMatrix<BaseFloat> cu_features;
+    cuda_mfcc.ComputeFeatures(cu_wave, vtln_warp, &cu_features);
+    KALDI_ASSERT(cu_features.NumCols() == cuda_mfcc.Dim());
+    Matrix<BaseFloat> features2(cu_features);
+    AssertEqual(features, features2, 0.001);
+  }
+}
+
+static void UnitTestCudaFbank() {
+  for (int32 i = 0; i < 10; i++) {
+    FbankOptions opts;
+    RandomFrameOptions(&opts.frame_opts);
+    opts.mel_opts.num_bins = RandInt(15, 40);
+    opts.use_energy = (RandInt(0, 1) == 0);
+    opts.raw_energy = (RandInt(0, 1) == 0);
+    opts.htk_compat = (RandInt(0, 1) == 0);
+    opts.use_log_fbank = (RandInt(0, 3) != 0);
+    BaseFloat vtln_warp = (RandInt(0, 1) == 0 ? 1.0 : 1.1);
+
+    Vector<BaseFloat> wave;
+    RandomWave(&wave);
+    Fbank fbank(opts);
+    Matrix<BaseFloat> features;
+    fbank.Compute(wave, vtln_warp, &features, NULL);
+
+    CudaSpectralFeatures cuda_fbank(opts);
+    CuVector<BaseFloat> cu_wave(wave);
+    CuMatrix<BaseFloat> cu_features;
+    cuda_fbank.ComputeFeatures(cu_wave, vtln_warp, &cu_features);
+    KALDI_ASSERT(cu_features.NumCols() == cuda_fbank.Dim());
+    Matrix<BaseFloat> features2(cu_features);
+    AssertEqual(features, features2, 0.001);
+  }
+}
+
+// Test dithering: the features are not the same as from the CPU code, but
+// they should be close for a loud signal.
+static void UnitTestCudaDither() {
+  MfccOptions opts;
+  Vector<BaseFloat> wave;
+  RandomWave(&wave);
+  opts.frame_opts.dither = 0.0;
+  Mfcc mfcc(opts);
+  Matrix<BaseFloat> features;
+  mfcc.Compute(wave, 1.0, &features, NULL);
+
+  opts.frame_opts.dither = 1.0;
+  CudaSpectralFeatures cuda_mfcc(opts);
+  CuMatrix<BaseFloat> cu_features;
+  cuda_mfcc.ComputeFeatures(CuVector<BaseFloat>(wave), 1.0, &cu_features);
+  Matrix<BaseFloat> features2(cu_features);
+  AssertEqual(features, features2, 0.01);
+}
+
+static void UnitTestCudaCmvnAndSplice() {
+  for (int32 i = 0; i < 5; i++) {
+    int32 num_frames = RandInt(1, 200), dim = RandInt(1, 40);
+    Matrix<BaseFloat> feats(num_frames, dim);
+    feats.SetRandn();
+    feats.Add(RandInt(-5, 5));
+    bool var_norm = (RandInt(0, 1) == 0);
+
+    // utterance-level stats, as from AccCmvnStats().
+    Matrix<double> stats(2, dim + 1);
+    for (int32 t = 0; t < num_frames; t++) {
+      for (int32 d = 0; d < dim; d++) {
+        stats(0, d) += feats(t, d);
+        stats(1, d) += feats(t, d) * feats(t, d);
+      }
+    }
+    stats(0, dim) = num_frames;
+
+    CuMatrix<BaseFloat> cu_feats(feats), cu_feats2(feats);
+    ApplyCmvnCuda(stats, var_norm, &cu_feats);
+    ApplyUttCmvnCuda(var_norm, &cu_feats2);
+    for (int32 d = 0; d < dim; d++) {
+      double mean = stats(0, d) / num_frames,
+          var = stats(1, d) / num_frames - mean * mean,
+          scale = (var_norm ? 1.0 / sqrt(std::max(var, 1.0e-20)) : 1.0);
+      for (int32 t = 0; t < num_frames; t++)
+        feats(t, d) = (feats(t, d) - mean) * scale;
+    }
+    if (var_norm && num_frames == 1)  // the variance is floored.
+      continue;
+    AssertEqual(feats, Matrix<BaseFloat>(cu_feats), 0.001);
+    AssertEqual(feats, Matrix<BaseFloat>(cu_feats2), 0.001);
+
+    int32 left_context = RandInt(0, 5), right_context = RandInt(0, 5);
+    Matrix<BaseFloat> spliced;
+    SpliceFrames(feats, left_context, right_context, &spliced);
+    CuMatrix<BaseFloat> cu_spliced;
+    SpliceFramesCuda(cu_feats, left_context, right_context, &cu_spliced);
+    AssertEqual(spliced, Matrix<BaseFloat>(cu_spliced), 0.001);
+  }
+}
+
+static void UnitTestCudaFeaturePipeline() {
+  MfccOptions mfcc_opts;
+  mfcc_opts.frame_opts.dither = 0.0;
+  CudaFeaturePipelineOptions opts;
+  opts.utt_cmvn = true;
+  opts.left_context = 3;
+  opts.right_context = 2;
+  Vector<BaseFloat> wave;
+  RandomWave(&wave);
+
+  Mfcc mfcc(mfcc_opts);
+  Matrix<BaseFloat> features, spliced;
+  mfcc.Compute(wave, 1.0, &features, NULL);
+  Vector<BaseFloat> mean(features.NumCols());
+  mean.AddRowSumMat(1.0 / features.NumRows(), features);
+  features.AddVecToRows(-1.0, mean);
+  SpliceFrames(features, opts.left_context, opts.right_context, &spliced);
+
+  CudaFeaturePipeline pipeline(mfcc_opts, opts);
+  CuMatrix<BaseFloat> cu_spliced;
+  pipeline.Compute(wave, 1.0, &cu_spliced);
+  KALDI_ASSERT(cu_spliced.NumCols() == pipeline.Dim());
+  AssertEqual(spliced, Matrix<BaseFloat>(cu_spliced), 0.001);
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 loop = 0; loop < 2; loop++) {
+#if HAVE_CUDA == 1
+    if (loop == 0)
+      CuDevice::Instantiate().SelectGpuId("no");
+    else
+      CuDevice::Instantiate().SelectGpuId("yes");
+#endif
+    UnitTestCudaMfcc();
+    UnitTestCudaFbank();
+    UnitTestCudaDither();
+    UnitTestCudaCmvnAndSplice();
+    UnitTestCudaFeaturePipeline();
+    if (loop == 0)
+      KALDI_LOG << "Tests without GPU use succeeded.";
+    else
+      KALDI_LOG << "Tests with GPU use (if available) succeeded.";
+  }
+#if HAVE_CUDA == 1
+  CuDevice::Instantiate().PrintProfile();
+#endif
+  return 0;
+}
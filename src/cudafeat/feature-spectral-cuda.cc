@@ -0,0 +1,349 @@
+// cudafeat/feature-spectral-cuda.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <limits>
+
+#if HAVE_CUDA == 1
+#include <cuda_runtime_api.h>
+#endif
+
+#include "cudafeat/feature-spectral-cuda.h"
+#include "cudafeat/cudafeat-kernels.h"
+#include "cudamatrix/cu-common.h"
+#include "cudamatrix/cu-device.h"
+#include "matrix/matrix-functions.h"
+
+namespace kaldi {
+
+CudaSpectralFeatures::CudaSpectralFeatures(const MfccOptions &opts):
+    is_mfcc_(true), frame_opts_(opts.frame_opts), mel_opts_(opts.mel_opts),
+    num_ceps_(opts.num_ceps), use_energy_(opts.use_energy),
+    energy_floor_(opts.energy_floor), raw_energy_(opts.raw_energy),
+    cepstral_lifter_(opts.cepstral_lifter), htk_compat_(opts.htk_compat),
+    use_log_fbank_(true) {
+  Init();
+}
+
+CudaSpectralFeatures::CudaSpectralFeatures(const FbankOptions &opts):
+    is_mfcc_(false), frame_opts_(opts.frame_opts), mel_opts_(opts.mel_opts),
+    num_ceps_(0), use_energy_(opts.use_energy),
+    energy_floor_(opts.energy_floor), raw_energy_(opts.raw_energy),
+    cepstral_lifter_(0.0), htk_compat_(opts.htk_compat),
+    use_log_fbank_(opts.use_log_fbank) {
+  Init();
+}
+
+void CudaSpectralFeatures::Init() {
+  FeatureWindowFunction window_function(frame_opts_);
+  window_ = window_function.window;
+
+  if (is_mfcc_) {
+    // The same DCT and liftering as in class Mfcc.
+    int32 num_bins = mel_opts_.num_bins;
+    Matrix<BaseFloat> dct_matrix(num_bins, num_bins);
+    ComputeDctMatrix(&dct_matrix);
+    dct_matrix_ = dct_matrix.RowRange(0, num_ceps_);
+    if (cepstral_lifter_ != 0.0) {
+      Vector<BaseFloat> lifter_coeffs(num_ceps_);
+      ComputeLifterCoeffs(cepstral_lifter_, &lifter_coeffs);
+      lifter_coeffs_ = lifter_coeffs;
+    }
+  }
+  log_energy_floor_ = (energy_floor_ > 0.0 ? Log(energy_floor_) : 0.0);
+
+  // With --htk-compat, the energy or C0 (which we produce as the first
+  // column) goes last; for filterbanks this only matters with energy.
+  if (htk_compat_ && (is_mfcc_ || use_energy_)) {
+    int32 dim = Dim();
+    std::vector<MatrixIndexT> reorder(dim);
+    for (int32 i = 0; i + 1 < dim; i++)
+      reorder[i] = i + 1;
+    reorder[dim - 1] = 0;
+    htk_reorder_ = reorder;
+  }
+
+  int32 padded_window_size = frame_opts_.PaddedWindowSize();
+  if ((padded_window_size & (padded_window_size-1)) == 0)  // Is a power of two...
+    srfft_ = new SplitRadixRealFft<BaseFloat>(padded_window_size);
+  else
+    srfft_ = NULL;
+#if HAVE_CUDA == 1
+  plan_num_frames_ = 0;
+  plan_in_stride_ = 0;
+  plan_out_stride_ = 0;
+#endif
+  // We'll definitely need the filterbank for VTLN warping factor 1.0.
+  GetMelWeights(1.0);
+}
+
+CudaSpectralFeatures::~CudaSpectralFeatures() {
+  for (std::map<BaseFloat, CuMatrix<BaseFloat>*>::iterator iter =
+           mel_weights_.begin(); iter != mel_weights_.end(); ++iter)
+    delete iter->second;
+  delete srfft_;
+#if HAVE_CUDA == 1
+  if (plan_num_frames_ != 0)
+    cufftDestroy(plan_);
+#endif
+}
+
+int32 CudaSpectralFeatures::Dim() const {
+  if (is_mfcc_) return num_ceps_;
+  else return mel_opts_.num_bins + (use_energy_ ? 1 : 0);
+}
+
+const CuMatrix<BaseFloat> &CudaSpectralFeatures::GetMelWeights(
+    BaseFloat vtln_warp) {
+  std::map<BaseFloat, CuMatrix<BaseFloat>*>::iterator iter =
+      mel_weights_.find(vtln_warp);
+  if (iter != mel_weights_.end())
+    return *(iter->second);
+  MelBanks mel_banks(mel_opts_, frame_opts_, vtln_warp);
+  const std::vector<std::pair<int32, Vector<BaseFloat> > > &bins =
+      mel_banks.GetBins();
+  int32 num_fft_bins = frame_opts_.PaddedWindowSize() / 2 + 1;
+  Matrix<BaseFloat> weights(bins.size(), num_fft_bins);
+  for (size_t i = 0; i < bins.size(); i++)
+    weights.Row(i).Range(bins[i].first, bins[i].second.Dim()).CopyFromVec(
+        bins[i].second);
+  CuMatrix<BaseFloat> *ans = new CuMatrix<BaseFloat>(weights);
+  mel_weights_[vtln_warp] = ans;
+  return *ans;
+}
+
+// Sets "log_energies" to the log of the energy of each row of "frames",
+// floored to avoid log of zero.
+static void ComputeLogEnergies(const CuMatrixBase<BaseFloat> &frames,
+                               CuVector<BaseFloat> *log_energies) {
+  log_energies->Resize(frames.NumRows(), kUndefined);
+  log_energies->AddDiagMat2(1.0, frames, kNoTrans, 0.0);
+  log_energies->ApplyFloor(std::numeric_limits<BaseFloat>::min());
+  log_energies->ApplyLog();
+}
+
+void CudaSpectralFeatures::ExtractWindows(const CuVectorBase<BaseFloat> &wave,
+                                          CuMatrix<BaseFloat> *windows,
+                                          CuVector<BaseFloat> *log_energies) {
+  int32 num_frames = NumFrames(wave.Dim(), frame_opts_),
+      frame_shift = frame_opts_.WindowShift(),
+      frame_length = frame_opts_.WindowSize(),
+      padded_window_size = frame_opts_.PaddedWindowSize();
+  KALDI_ASSERT(num_frames > 0 && frame_length > 1);
+  windows->Resize(num_frames, padded_window_size, kUndefined);
+
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    CuTimer tim;
+    dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
+    dim3 dimGrid(n_blocks(num_frames, CU2DBLOCK),
+                 n_blocks(padded_window_size, CU2DBLOCK));
+    cuda_extract_windows(dimGrid, dimBlock, wave.Data(), wave.Dim(),
+                         frame_shift, frame_length, frame_opts_.snip_edges,
+                         windows->Data(), windows->Dim());
+    CU_SAFE_CALL(cudaGetLastError());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
+  } else
+#endif
+  {
+    // The same indexing as in the CUDA kernel, and as in ExtractWindow().
+    const BaseFloat *wave_data = wave.Data();
+    int32 wave_dim = wave.Dim();
+    MatrixBase<BaseFloat> &windows_mat = windows->Mat();
+    for (int32 r = 0; r < num_frames; r++) {
+      BaseFloat *window = windows_mat.RowData(r);
+      int32 begin = (frame_opts_.snip_edges ? r * frame_shift :
+                     static_cast<int32>(frame_shift * (r + 0.5)) -
+                     frame_length / 2);
+      for (int32 j = 0; j < frame_length; j++) {
+        int32 s = begin + j;
+        if (s < 0)
+          s = (-s) % wave_dim;
+        else if (s >= wave_dim)
+          s = wave_dim - 1 - (s - wave_dim) % wave_dim;
+        window[j] = wave_data[s];
+      }
+      for (int32 j = frame_length; j < padded_window_size; j++)
+        window[j] = 0.0;
+    }
+  }
+
+  // The rest is done for all the frames at once, in the same order as in
+  // ExtractWindow().
+  CuSubMatrix<BaseFloat> frames(windows->ColRange(0, frame_length));
+  if (frame_opts_.dither != 0.0) {
+    CuMatrix<BaseFloat> noise(num_frames, frame_length, kUndefined);
+    rand_.RandGaussian(&noise);
+    frames.AddMat(frame_opts_.dither, noise);
+  }
+
+  if (frame_opts_.remove_dc_offset) {
+    CuVector<BaseFloat> sums(num_frames);
+    sums.AddColSumMat(1.0, frames, 0.0);
+    frames.AddVecToCols(-1.0 / frame_length, sums);
+  }
+
+  if (log_energies != NULL && raw_energy_)
+    ComputeLogEnergies(frames, log_energies);
+
+  BaseFloat preemph_coeff = frame_opts_.preemph_coeff;
+  if (preemph_coeff != 0.0) {
+    KALDI_ASSERT(preemph_coeff >= 0.0 && preemph_coeff <= 1.0);
+    CuMatrix<BaseFloat> unemphasized(frames.ColRange(0, frame_length - 1));
+    frames.ColRange(1, frame_length - 1).AddMat(-preemph_coeff, unemphasized);
+    frames.ColRange(0, 1).Scale(1.0 - preemph_coeff);
+  }
+
+  frames.MulColsVec(window_);
+
+  if (log_energies != NULL && !raw_energy_)
+    ComputeLogEnergies(frames, log_energies);
+}
+
+void CudaSpectralFeatures::ComputePowerSpectra(
+    CuMatrix<BaseFloat> *windows,
+    CuMatrix<BaseFloat> *power_spectra) {
+  int32 num_frames = windows->NumRows(),
+      padded_window_size = windows->NumCols(),
+      num_fft_bins = padded_window_size / 2 + 1;
+  KALDI_ASSERT(padded_window_size == frame_opts_.PaddedWindowSize());
+  power_spectra->Resize(num_frames, num_fft_bins, kUndefined);
+
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    CuTimer tim;
+    // Out-of-place real-to-complex transforms of all the frames in one batch;
+    // row r of "ffts" gets num_fft_bins complex numbers.
+    CuMatrix<BaseFloat> ffts(num_frames, 2 * num_fft_bins, kUndefined);
+    KALDI_ASSERT(ffts.Stride() % 2 == 0);
+    int32 in_stride = windows->Stride(), out_stride = ffts.Stride() / 2;
+    if (plan_num_frames_ != num_frames || plan_in_stride_ != in_stride ||
+        plan_out_stride_ != out_stride) {
+      if (plan_num_frames_ != 0)
+        cufftDestroy(plan_);
+      int n = padded_window_size, inembed = in_stride, onembed = out_stride;
+#if KALDI_DOUBLEPRECISION != 0
+      cufftType type = CUFFT_D2Z;
+#else
+      cufftType type = CUFFT_R2C;
+#endif
+      cufftResult ret = cufftPlanMany(&plan_, 1, &n, &inembed, 1, in_stride,
+                                      &onembed, 1, out_stride, type,
+                                      num_frames);
+      if (ret != CUFFT_SUCCESS)
+        KALDI_ERR << "cufftPlanMany() failed with cufftResult " << ret;
+      plan_num_frames_ = num_frames;
+      plan_in_stride_ = in_stride;
+      plan_out_stride_ = out_stride;
+    }
+#if KALDI_DOUBLEPRECISION != 0
+    cufftResult ret = cufftExecD2Z(
+        plan_, reinterpret_cast<cufftDoubleReal*>(windows->Data()),
+        reinterpret_cast<cufftDoubleComplex*>(ffts.Data()));
+#else
+    cufftResult ret = cufftExecR2C(
+        plan_, reinterpret_cast<cufftReal*>(windows->Data()),
+        reinterpret_cast<cufftComplex*>(ffts.Data()));
+#endif
+    if (ret != CUFFT_SUCCESS)
+      KALDI_ERR << "cuFFT transform failed with cufftResult " << ret;
+
+    dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
+    dim3 dimGrid(n_blocks(num_frames, CU2DBLOCK),
+                 n_blocks(num_fft_bins, CU2DBLOCK));
+    cuda_power_spectrum(dimGrid, dimBlock, ffts.Data(), ffts.Stride(),
+                        power_spectra->Data(), power_spectra->Dim());
+    CU_SAFE_CALL(cudaGetLastError());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
+  } else
+#endif
+  {
+    MatrixBase<BaseFloat> &windows_mat = windows->Mat();
+    if (srfft_ != NULL) {
+      std::vector<BaseFloat> temp_buffer;
+      srfft_->Compute(&windows_mat, true, &temp_buffer);
+    } else {  // An alternative algorithm that works for non-powers-of-two.
+      for (int32 r = 0; r < num_frames; r++) {
+        SubVector<BaseFloat> row(windows_mat, r);
+        RealFft(&row, true);
+      }
+    }
+    ComputePowerSpectrum(&windows_mat);
+    power_spectra->Mat().CopyFromMat(windows_mat.ColRange(0, num_fft_bins));
+  }
+}
+
+void CudaSpectralFeatures::ComputeFeatures(const CuVectorBase<BaseFloat> &wave,
+                                           BaseFloat vtln_warp,
+                                           CuMatrix<BaseFloat> *features) {
+  KALDI_ASSERT(features != NULL);
+  int32 num_frames = NumFrames(wave.Dim(), frame_opts_),
+      num_bins = mel_opts_.num_bins;
+  if (num_frames == 0) {
+    features->Resize(0, 0);
+    return;
+  }
+  CuVector<BaseFloat> log_energies;
+  CuMatrix<BaseFloat> power_spectra;
+  {
+    CuMatrix<BaseFloat> windows;
+    ExtractWindows(wave, &windows, (use_energy_ ? &log_energies : NULL));
+    ComputePowerSpectra(&windows, &power_spectra);
+  }
+  const CuMatrix<BaseFloat> &mel_weights = GetMelWeights(vtln_warp);
+
+  features->Resize(num_frames, Dim(), kUndefined);
+  if (is_mfcc_) {
+    CuMatrix<BaseFloat> mel_energies(num_frames, num_bins, kUndefined);
+    mel_energies.AddMatMat(1.0, power_spectra, kNoTrans,
+                           mel_weights, kTrans, 0.0);
+    // HTK-like flooring- for testing purposes (we prefer dither)
+    if (mel_opts_.htk_mode) mel_energies.ApplyFloor(1.0);
+    // avoid log of zero (which should be prevented anyway by dithering).
+    mel_energies.ApplyFloor(std::numeric_limits<BaseFloat>::min());
+    mel_energies.ApplyLog();
+    features->AddMatMat(1.0, mel_energies, kNoTrans, dct_matrix_, kTrans, 0.0);
+    if (cepstral_lifter_ != 0.0)
+      features->MulColsVec(lifter_coeffs_);
+  } else {
+    CuSubMatrix<BaseFloat> fbank(features->ColRange((use_energy_ ? 1 : 0),
+                                                    num_bins));
+    fbank.AddMatMat(1.0, power_spectra, kNoTrans, mel_weights, kTrans, 0.0);
+    if (mel_opts_.htk_mode) fbank.ApplyFloor(1.0);
+    if (use_log_fbank_) {
+      fbank.ApplyFloor(std::numeric_limits<BaseFloat>::min());
+      fbank.ApplyLog();
+    }
+  }
+
+  if (use_energy_) {
+    if (energy_floor_ > 0.0)
+      log_energies.ApplyFloor(log_energy_floor_);
+    features->CopyColFromVec(log_energies, 0);
+  }
+
+  if (htk_reorder_.Dim() != 0) {
+    CuMatrix<BaseFloat> features_tmp(*features);
+    features->CopyCols(features_tmp, htk_reorder_);
+    if (is_mfcc_ && !use_energy_)
+      features->ColRange(num_ceps_ - 1, 1).Scale(M_SQRT2);  // scale on C0
+  }
+}
+
+}  // namespace kaldi
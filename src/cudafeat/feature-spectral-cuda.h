@@ -0,0 +1,138 @@
+// cudafeat/feature-spectral-cuda.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_CUDAFEAT_FEATURE_SPECTRAL_CUDA_H_
+#define KALDI_CUDAFEAT_FEATURE_SPECTRAL_CUDA_H_
+
+#include <map>
+
+#if HAVE_CUDA == 1
+#include <cufft.h>
+#endif
+
+#include "cudamatrix/cu-array.h"
+#include "cudamatrix/cu-matrix.h"
+#include "cudamatrix/cu-vector.h"
+#include "cudamatrix/cu-rand.h"
+#include "feat/feature-mfcc.h"
+#include "feat/feature-fbank.h"
+#include "matrix/srfft.h"
+
+namespace kaldi {
+/// @addtogroup  feat FeatureExtraction
+/// @{
+
+/**
+   CudaSpectralFeatures computes MFCC or filterbank features for a whole
+   utterance on the GPU: the waveform is given as a CuVector and the features
+   are produced in a CuMatrix, so they can be given to the neural net (e.g. via
+   NnetComputer::AcceptInput()) without going back to the host.  The steps are
+   the same as in class Mfcc and class Fbank (framing, dithering, DC removal,
+   pre-emphasis, windowing, FFT, mel filterbank, log, DCT and liftering), and
+   with --dither=0 the features are the same as theirs up to roundoff.
+
+   Framing and the power spectrum are done by the kernels in
+   cudafeat-kernels.cu and the FFT by cuFFT; everything else is done with
+   CuMatrix operations, with the mel filterbank as a product with a dense
+   matrix of weights.  If we did not compile with CUDA or have no GPU, the
+   same computation is done on the CPU.  The features are not bit-identical
+   to those from class Mfcc or Fbank when dithering, since the random numbers
+   are different.
+*/
+class CudaSpectralFeatures {
+ public:
+  explicit CudaSpectralFeatures(const MfccOptions &opts);
+
+  explicit CudaSpectralFeatures(const FbankOptions &opts);
+
+  ~CudaSpectralFeatures();
+
+  /// Returns the dimension of the features.
+  int32 Dim() const;
+
+  /// Computes the features of the waveform "wave" (an entire utterance),
+  /// with VTLN warping factor "vtln_warp" (use 1.0 for no warping).  At exit,
+  /// "features" has NumFrames(wave.Dim(), frame_opts) rows and Dim() columns.
+  void ComputeFeatures(const CuVectorBase<BaseFloat> &wave,
+                       BaseFloat vtln_warp,
+                       CuMatrix<BaseFloat> *features);
+
+ private:
+  void Init();
+
+  // Cuts the frames out of "wave" and does dithering, DC removal,
+  // pre-emphasis and windowing; at exit each row of "windows" consists of a
+  // windowed frame followed by zeros, up to the padded window size.  The
+  // log-energies are put in "log_energies" if it is not NULL.
+  void ExtractWindows(const CuVectorBase<BaseFloat> &wave,
+                      CuMatrix<BaseFloat> *windows,
+                      CuVector<BaseFloat> *log_energies);
+
+  // Computes the power spectra of the rows of "windows", which must have
+  // PaddedWindowSize() columns; "power_spectra" is resized to have
+  // PaddedWindowSize() / 2 + 1 columns.  "windows" is used as scratch space.
+  void ComputePowerSpectra(CuMatrix<BaseFloat> *windows,
+                           CuMatrix<BaseFloat> *power_spectra);
+
+  // Returns the mel filterbank for this warping factor as a matrix of
+  // dimension num_bins by (PaddedWindowSize() / 2 + 1); it is cached.
+  const CuMatrix<BaseFloat> &GetMelWeights(BaseFloat vtln_warp);
+
+  bool is_mfcc_;
+  FrameExtractionOptions frame_opts_;
+  MelBanksOptions mel_opts_;
+  int32 num_ceps_;  // only used for MFCCs.
+  bool use_energy_;
+  BaseFloat energy_floor_;
+  bool raw_energy_;
+  BaseFloat cepstral_lifter_;  // only used for MFCCs.
+  bool htk_compat_;
+  bool use_log_fbank_;  // only used for filterbanks.
+
+  CuVector<BaseFloat> window_;  // the window function.
+  CuMatrix<BaseFloat> dct_matrix_;  // matrix we left-multiply by to perform DCT.
+  CuVector<BaseFloat> lifter_coeffs_;
+  BaseFloat log_energy_floor_;
+  // The columns of the output in the order they are produced are copied by
+  // this list of indexes when htk_compat_ is true, to put the energy or C0
+  // last.
+  CuArray<MatrixIndexT> htk_reorder_;
+  std::map<BaseFloat, CuMatrix<BaseFloat>*> mel_weights_;  // cached filterbanks.
+  CuRand<BaseFloat> rand_;  // for dithering.
+
+  SplitRadixRealFft<BaseFloat> *srfft_;  // used on the CPU; NULL if the
+                                         // padded window size is not a
+                                         // power of two.
+#if HAVE_CUDA == 1
+  // The cuFFT plan for batches of plan_num_frames_ transforms, with these
+  // input and output strides; it is redone when one of them changes.
+  cufftHandle plan_;
+  int32 plan_num_frames_;
+  int32 plan_in_stride_;
+  int32 plan_out_stride_;
+#endif
+  KALDI_DISALLOW_COPY_AND_ASSIGN(CudaSpectralFeatures);
+};
+
+/// @} End of "addtogroup feat"
+}  // namespace kaldi
+
+
+#endif  // KALDI_CUDAFEAT_FEATURE_SPECTRAL_CUDA_H_
@@ -37,6 +37,23 @@
 
 namespace kaldi {
 
+// Locks a pthread mutex for the lifetime of the object, so it will be unlocked
+// even if KALDI_ERR throws.
+class CuAllocatorLock {
+ public:
+  explicit CuAllocatorLock(pthread_mutex_t *mutex): mutex_(mutex) {
+    if (pthread_mutex_lock(mutex_) != 0)
+      KALDI_ERR << "Error locking mutex";
+  }
+  ~CuAllocatorLock() { pthread_mutex_unlock(mutex_); }
+ private:
+  pthread_mutex_t *mutex_;
+};
+
+// The smallest slot size in the arena is 2^kMinArenaSlotLog2 bytes; this
+// keeps all slots aligned at least as well as cudaMalloc would align them
+// (given that the chunks are obtained from cudaMalloc).
+static const int32 kMinArenaSlotLog2 = 8;
 
 void* CuMemoryAllocator::Malloc(size_t size) {
   // For now just call MallocPitch and throw away the pitch, to avoid
@@ -124,6 +141,11 @@ void* CuMemoryAllocator::MallocPitchInternal(size_t row_bytes,
 }
 
 void CuMemoryAllocator::PrintMemoryUsage() const {
+  CuAllocatorLock lock(&mutex_);
+  PrintMemoryUsageInternal();
+}
+
+void CuMemoryAllocator::PrintMemoryUsageInternal() const {
   KALDI_LOG << "Memory usage: " << cur_bytes_allocated_
             << " bytes currently allocated (max: "
             << max_bytes_allocated_ << "); " << cur_bytes_used_
@@ -135,6 +157,31 @@ void CuMemoryAllocator::PrintMemoryUsage() const {
             << ", in cudaMalloc=" << tot_time_taken_in_cuda_malloc_
             << ", in cudaFree=" << tot_time_taken_in_cuda_free_
             << ", in this->MallocPitch()=" << tot_time_taken_in_malloc_pitch_;
+  double hit_rate = (num_user_allocations_ == 0 ? 0.0 :
+                     1.0 - num_system_allocations_ /
+                     static_cast<double>(num_user_allocations_)),
+      cached_fraction = (cur_bytes_allocated_ == 0 ? 0.0 :
+                         MemoryCached() /
+                         static_cast<double>(cur_bytes_allocated_));
+  KALDI_LOG << "Cache hit rate is " << hit_rate << "; fraction of allocated "
+            << "memory that is cached (not in use) is " << cached_fraction
+            << "; " << cur_bytes_padding_ << " bytes of padding in memory "
+            << "currently in use; " << num_cross_thread_reuses_ << " cached "
+            << "regions were reused by a thread other than the one that "
+            << "freed them.";
+  if (opts_.arena_max_request_bytes > 0 || !arena_chunks_.empty())
+    KALDI_LOG << "Arena (for requests of up to "
+              << opts_.arena_max_request_bytes << " bytes): "
+              << arena_bytes_allocated_ << " bytes allocated in "
+              << arena_chunks_.size() << " chunks; " << arena_bytes_used_
+              << " bytes currently in use (max: " << max_arena_bytes_used_
+              << ").";
+}
+
+void CuMemoryAllocator::SetOptions(const CuAllocatorOptions &opts) {
+  opts.Check();
+  CuAllocatorLock lock(&mutex_);
+  opts_ = opts;
 }
 
 CuMemoryAllocator::CuMemoryAllocator(CuAllocatorOptions opts):
@@ -150,27 +197,110 @@ CuMemoryAllocator::CuMemoryAllocator(CuAllocatorOptions opts):
     tot_time_taken_in_cuda_malloc_(0.0),
     tot_time_taken_in_cuda_malloc_pitch_(0.0),
     tot_time_taken_in_cuda_free_(0.0),
-    tot_time_taken_in_malloc_pitch_(0.0) { }
+    tot_time_taken_in_malloc_pitch_(0.0),
+    cur_bytes_padding_(0),
+    num_cross_thread_reuses_(0),
+    arena_bytes_allocated_(0),
+    arena_bytes_used_(0),
+    max_arena_bytes_used_(0),
+    arena_free_slots_(40),
+    memory_stats_(kMemoryCuAllocator) {
+  opts_.Check();
+  if (pthread_mutex_init(&mutex_, NULL) != 0)
+    KALDI_ERR << "Cannot initialize pthread mutex";
+}
+
+CuMemoryAllocator::~CuMemoryAllocator() {
+  // We don't free any CUDA memory here: this object is destroyed at program
+  // exit, when the CUDA context is released anyway.
+  pthread_mutex_destroy(&mutex_);
+}
+
+void CuMemoryAllocator::HandleReuseByThread(pthread_t thread_id) {
+  if (!pthread_equal(thread_id, pthread_self())) {
+    num_cross_thread_reuses_++;
+#ifdef CUDA_API_PER_THREAD_DEFAULT_STREAM
+    // The other thread's default stream may still have queued work that
+    // reads or writes this memory.
+    CU_SAFE_CALL(cudaDeviceSynchronize());
+#endif
+  }
+}
 
 void* CuMemoryAllocator::MallocPitch(size_t row_bytes,
                                      size_t num_rows,
                                      size_t *pitch) {
+  CuAllocatorLock lock(&mutex_);
   Timer tim;
   t_++;
   num_user_allocations_++;
+  void *ans;
+  if (num_rows == 1 && row_bytes <= opts_.arena_max_request_bytes) {
+    ans = ArenaMalloc(row_bytes);
+    *pitch = row_bytes;
+  } else {
+    ans = CachedMallocPitch(row_bytes, num_rows, pitch);
+  }
+  // Memory is only released to the device inside CachedMallocPitch(), so
+  // this is the only place the statistics need updating.
+  memory_stats_.Set(cur_bytes_allocated_ + arena_bytes_allocated_);
+  tot_time_taken_in_malloc_pitch_ += tim.Elapsed();
+  return ans;
+}
+
+void* CuMemoryAllocator::ArenaMalloc(size_t num_bytes) {
+  int32 slot_log2 = IntegerLog2(num_bytes);
+  if ((static_cast<size_t>(1) << slot_log2) < num_bytes)
+    slot_log2++;
+  if (slot_log2 < kMinArenaSlotLog2)
+    slot_log2 = kMinArenaSlotLog2;
+  KALDI_ASSERT(static_cast<size_t>(slot_log2) < arena_free_slots_.size());
+  size_t slot_bytes = static_cast<size_t>(1) << slot_log2;
+  std::vector<std::pair<void*, pthread_t> > &free_slots =
+      arena_free_slots_[slot_log2];
+  if (free_slots.empty()) {
+    // Carve a new chunk into slots of this size.
+    size_t num_slots = std::max<size_t>(1, opts_.arena_chunk_bytes / slot_bytes),
+        chunk_bytes = num_slots * slot_bytes, chunk_pitch;
+    char *chunk = static_cast<char*>(MallocPitchInternal(chunk_bytes, 1,
+                                                         &chunk_pitch));
+    arena_chunks_.push_back(chunk);
+    arena_bytes_allocated_ += chunk_bytes;
+    pthread_t self = pthread_self();
+    // Add the slots in reverse order so that they are handed out in order of
+    // increasing address.
+    for (size_t i = num_slots; i > 0; i--)
+      free_slots.push_back(std::pair<void*, pthread_t>(
+          chunk + (i - 1) * slot_bytes, self));
+  }
+  void *ans = free_slots.back().first;
+  HandleReuseByThread(free_slots.back().second);
+  free_slots.pop_back();
+  used_map_[ans] = UsedMemoryElement(num_bytes, 1, num_bytes, slot_log2);
+  arena_bytes_used_ += slot_bytes;
+  if (arena_bytes_used_ > max_arena_bytes_used_)
+    max_arena_bytes_used_ = arena_bytes_used_;
+  cur_bytes_padding_ += slot_bytes - num_bytes;
+  return ans;
+}
+
+void* CuMemoryAllocator::CachedMallocPitch(size_t row_bytes,
+                                           size_t num_rows,
+                                           size_t *pitch) {
   size_t requested_bytes = row_bytes * num_rows;
   if (cur_bytes_used_ + requested_bytes > max_bytes_used_)
     max_bytes_used_ = cur_bytes_used_ + requested_bytes;
   MruCache &cache = GetCacheForSize(requested_bytes);
   MemoryRequest request(row_bytes, num_rows);
   CachedMemoryElement output;
-  if (cache.Lookup(request, &output)) {
+  if (cache.Lookup(request, pthread_self(), &output)) {
     // we have cached memory with this value.
+    HandleReuseByThread(output.thread_id);
     void *ans = output.pointer;
     *pitch = output.pitch;
     used_map_[ans] = UsedMemoryElement(row_bytes, num_rows, output.pitch);
     cur_bytes_used_ += requested_bytes;
-    tot_time_taken_in_malloc_pitch_ += tim.Elapsed();
+    cur_bytes_padding_ += (output.pitch - row_bytes) * num_rows;
     return ans;
   } else {
     // note: it's important that we already updated max_bytes_used_.
@@ -194,7 +324,7 @@ void* CuMemoryAllocator::MallocPitch(size_t row_bytes,
       max_bytes_allocated_ = cur_bytes_allocated_;
     used_map_[ans] = UsedMemoryElement(row_bytes, num_rows, *pitch);
     cur_bytes_used_ += requested_bytes;
-    tot_time_taken_in_malloc_pitch_ += tim.Elapsed();
+    cur_bytes_padding_ += (*pitch - row_bytes) * num_rows;
     return ans;
   }
 }
@@ -275,22 +405,35 @@ void CuMemoryAllocator::FreeSomeCachedMemory(size_t bytes_to_free_in) {
 }
 
 void CuMemoryAllocator::Free(void *ptr) {
-  t_++;
-  unordered_map<void*, UsedMemoryElement, PointerHasher>::iterator iter =
-      used_map_.find(ptr);
-  if (iter == used_map_.end()) {
+  if (!TryFree(ptr))
     KALDI_ERR << "Attempt to free CUDA memory pointer that was not allocated: "
               << ptr;
-  }
-  const UsedMemoryElement &elem = iter->second;
-  size_t num_bytes = elem.row_bytes * elem.num_rows;
-
-  cur_bytes_used_ -= num_bytes;
-  MruCache &cache = GetCacheForSize(num_bytes);
+}
 
-  cache.Insert(MemoryRequest(elem.row_bytes, elem.num_rows),
-               CachedMemoryElement(ptr, t_, elem.pitch));
+bool CuMemoryAllocator::TryFree(void *ptr) {
+  CuAllocatorLock lock(&mutex_);
+  unordered_map<void*, UsedMemoryElement, PointerHasher>::iterator iter =
+      used_map_.find(ptr);
+  if (iter == used_map_.end())
+    return false;
+  t_++;
+  const UsedMemoryElement &elem = iter->second;
+  if (elem.arena_slot_log2 >= 0) {
+    size_t slot_bytes = static_cast<size_t>(1) << elem.arena_slot_log2;
+    arena_free_slots_[elem.arena_slot_log2].push_back(
+        std::pair<void*, pthread_t>(ptr, pthread_self()));
+    arena_bytes_used_ -= slot_bytes;
+    cur_bytes_padding_ -= slot_bytes - elem.row_bytes;
+  } else {
+    size_t num_bytes = elem.row_bytes * elem.num_rows;
+    cur_bytes_used_ -= num_bytes;
+    cur_bytes_padding_ -= (elem.pitch - elem.row_bytes) * elem.num_rows;
+    MruCache &cache = GetCacheForSize(num_bytes);
+    cache.Insert(MemoryRequest(elem.row_bytes, elem.num_rows),
+                 CachedMemoryElement(ptr, t_, elem.pitch, pthread_self()));
+  }
   used_map_.erase(iter);
+  return true;
 }
 
 size_t CuMemoryAllocator::MruCache::LeastRecentTime() const {
@@ -308,17 +451,27 @@ size_t CuMemoryAllocator::MruCache::LeastRecentTime() const {
 }
 
 bool CuMemoryAllocator::MruCache::Lookup(const MemoryRequest &request,
+                                         pthread_t thread_id,
                                          CachedMemoryElement *output) {
   MapType::iterator iter = map_.find(request);
   if (iter == map_.end())
     return false;
   MapValueType &q = iter->second;
   KALDI_ASSERT(!q.empty());
-  // use q.back() as we want to return the most recently used one if there
-  // is a choice.  We believe this will give better caching behavior.
-  *output = q.back().first;
-  list_.erase(q.back().second);
-  q.pop_back();
+  // we want to return the most recently used one if there is a choice (we
+  // believe this will give better caching behavior), but among those freed by
+  // the requesting thread, if there are any.
+  MapValueType::iterator elem_iter = q.end() - 1;
+  for (MapValueType::iterator i = q.end(); i != q.begin(); ) {
+    --i;
+    if (pthread_equal(i->first.thread_id, thread_id)) {
+      elem_iter = i;
+      break;
+    }
+  }
+  *output = elem_iter->first;
+  list_.erase(elem_iter->second);
+  q.erase(elem_iter);
   if (q.empty())
     map_.erase(request);
   return true;
@@ -362,6 +515,108 @@ CuMemoryAllocator::MruCache::MruCache(
 }
 
 
+CuPinnedMemoryAllocator::CuPinnedMemoryAllocator(
+    const CuAllocatorOptions &opts):
+    max_bytes_cached_(opts.pinned_max_bytes_cached),
+    cur_bytes_cached_(0),
+    cur_bytes_used_(0),
+    max_bytes_used_(0),
+    num_user_allocations_(0),
+    num_system_allocations_(0),
+    tot_time_taken_in_cuda_malloc_host_(0.0) {
+  if (pthread_mutex_init(&mutex_, NULL) != 0)
+    KALDI_ERR << "Cannot initialize pthread mutex";
+}
+
+CuPinnedMemoryAllocator::~CuPinnedMemoryAllocator() {
+  // As for CuMemoryAllocator, we leave it to CUDA to release the memory at
+  // program exit.
+  pthread_mutex_destroy(&mutex_);
+}
+
+// static
+size_t CuPinnedMemoryAllocator::RoundUpSize(size_t num_bytes) {
+  // We never allocate less than a page.
+  if (num_bytes <= 4096)
+    return 4096;
+  // 'step' is a quarter of the largest power of two <= num_bytes.
+  size_t step = (static_cast<size_t>(1) << IntegerLog2(num_bytes)) / 4;
+  return (num_bytes + step - 1) / step * step;
+}
+
+void CuPinnedMemoryAllocator::SetOptions(const CuAllocatorOptions &opts) {
+  CuAllocatorLock lock(&mutex_);
+  max_bytes_cached_ = opts.pinned_max_bytes_cached;
+}
+
+void* CuPinnedMemoryAllocator::Malloc(size_t num_bytes) {
+  CuAllocatorLock lock(&mutex_);
+  num_user_allocations_++;
+  size_t size = RoundUpSize(num_bytes);
+  void *ans;
+  std::map<size_t, std::vector<void*> >::iterator iter =
+      free_blocks_.find(size);
+  if (iter != free_blocks_.end() && !iter->second.empty()) {
+    ans = iter->second.back();
+    iter->second.pop_back();
+    cur_bytes_cached_ -= size;
+  } else {
+    num_system_allocations_++;
+    Timer tim;
+    cudaError_t e = cudaHostAlloc(&ans, size, cudaHostAllocPortable);
+    if (e != cudaSuccess && cur_bytes_cached_ > 0) {
+      // Release all the cached memory and try again.
+      cudaGetLastError();  // Clear the error state.
+      for (iter = free_blocks_.begin(); iter != free_blocks_.end(); ++iter)
+        for (size_t i = 0; i < iter->second.size(); i++)
+          cudaFreeHost(iter->second[i]);
+      free_blocks_.clear();
+      cur_bytes_cached_ = 0;
+      e = cudaHostAlloc(&ans, size, cudaHostAllocPortable);
+    }
+    if (e != cudaSuccess)
+      KALDI_CUDA_ERR(e, "Cannot allocate " << size << " bytes of pinned "
+                     "host memory (" << cur_bytes_used_ << " bytes already "
+                     "in use)");
+    tot_time_taken_in_cuda_malloc_host_ += tim.Elapsed();
+  }
+  used_blocks_[ans] = size;
+  cur_bytes_used_ += size;
+  if (cur_bytes_used_ > max_bytes_used_)
+    max_bytes_used_ = cur_bytes_used_;
+  return ans;
+}
+
+void CuPinnedMemoryAllocator::Free(void *ptr) {
+  CuAllocatorLock lock(&mutex_);
+  std::map<void*, size_t>::iterator iter = used_blocks_.find(ptr);
+  if (iter == used_blocks_.end())
+    KALDI_ERR << "Attempt to free pinned memory pointer that was not "
+              << "allocated: " << ptr;
+  size_t size = iter->second;
+  used_blocks_.erase(iter);
+  cur_bytes_used_ -= size;
+  if (cur_bytes_cached_ + size <= max_bytes_cached_) {
+    free_blocks_[size].push_back(ptr);
+    cur_bytes_cached_ += size;
+  } else {
+    CU_SAFE_CALL(cudaFreeHost(ptr));
+  }
+}
+
+void CuPinnedMemoryAllocator::PrintMemoryUsage() const {
+  CuAllocatorLock lock(&mutex_);
+  if (num_user_allocations_ == 0)
+    return;
+  KALDI_LOG << "Pinned host memory: " << cur_bytes_used_ << " bytes "
+            << "currently in use (max: " << max_bytes_used_ << "); "
+            << cur_bytes_cached_ << " bytes cached; "
+            << num_system_allocations_ << '/' << num_user_allocations_
+            << " allocations resulted in calls to cudaHostAlloc, taking "
+            << tot_time_taken_in_cuda_malloc_host_ << " seconds.";
+}
+
+
 
 
 }
@@ -29,15 +29,18 @@
 #include <list>
 #include <queue>
 #include <iostream>
+#include <pthread.h>
 #include <cuda.h>
 #include <cuda_runtime_api.h>
 #include "base/kaldi-common.h"
+#include "base/kaldi-memory-stats.h"
 #include "util/stl-utils.h"
 
 namespace kaldi {
 
 
-// For now we don't give the user a way to modify these from the command line.
+// For now we don't give the user a way to modify these from the command line,
+// but programs can change them via CuDevice::SetAllocatorOptions().
 struct CuAllocatorOptions {
   // memory_factor is the total amount of (allocated + cached) memory that we
   // allow to be held, relative to the max amount of memory the program has ever
@@ -53,11 +56,33 @@ struct CuAllocatorOptions {
   // is a constant overhead proportional to the number of buckets.
   BaseFloat delete_factor;
 
+  // If nonzero, single-row requests (from Malloc(), e.g. for vectors) of up to
+  // this many bytes are not given their own cudaMalloc'ed region but are
+  // sub-allocated from larger "arena" chunks of about arena_chunk_bytes, in
+  // power-of-two sized slots of at least 256 bytes.  This reduces the number
+  // of CUDA calls when programs allocate many small, differently sized
+  // vectors, at the cost of up to a factor of 2 of wasted space for those
+  // vectors.  Arena memory is never returned to CUDA, and it is not subject to
+  // memory_factor.  The default (0) disables it.
+  size_t arena_max_request_bytes;
+  // The size of the chunks that arena memory is obtained in (see
+  // arena_max_request_bytes).
+  size_t arena_chunk_bytes;
+
+  // The maximum amount of pinned host memory (see CuPinnedMemoryAllocator)
+  // that we keep cached for reuse when it's not in use, in bytes.
+  size_t pinned_max_bytes_cached;
+
   CuAllocatorOptions(): memory_factor(1.5),
-                        delete_factor(0.001) { }
+                        delete_factor(0.001),
+                        arena_max_request_bytes(0),
+                        arena_chunk_bytes(1 << 20),
+                        pinned_max_bytes_cached(1 << 28) { }
 
-  void Check() {
+  void Check() const {
     KALDI_ASSERT(delete_factor < memory_factor - 1.0 && delete_factor > 0.0);
+    KALDI_ASSERT(arena_max_request_bytes == 0 ||
+                 arena_chunk_bytes >= arena_max_request_bytes);
   }
 };
 
@@ -67,6 +92,19 @@ struct CuAllocatorOptions {
 // Class that caches memory for us (the CUDA
 // malloc and free routines are very slow).
 // This is a member of the CuDevice class.
+//
+// Malloc(), MallocPitch(), Free() and PrintMemoryUsage() may be called from
+// multiple threads at once (they are protected by a mutex); the accessors that
+// return statistics are not locked, so their results are only approximate if
+// other threads are allocating at the same time.
+//
+// Cached memory is tagged with the thread that freed it, and an allocation
+// request prefers memory that was freed by the same thread.  Kaldi normally
+// queues all its work on the legacy default stream, and then it never matters
+// which thread reuses a region; but if compiled with per-thread default
+// streams (nvcc --default-stream per-thread), work that the freeing thread
+// queued may still be using the memory, so when another thread gets the
+// memory we synchronize the device first.
 class CuMemoryAllocator {
  public:
   void* Malloc(size_t size);
@@ -75,6 +113,10 @@ class CuMemoryAllocator {
 
   void Free(void *ptr);
 
+  // Like Free(), but returns false (instead of dying) if "ptr" was not
+  // allocated by this object.
+  bool TryFree(void *ptr);
+
 
   // the maximum amount of memory that was ever allocated in the lifetime of the
   // program, in bytes.
@@ -86,11 +128,36 @@ class CuMemoryAllocator {
   // memory that's cached plus memory that's allocated, in bytes.
   size_t MemoryAllocated() const { return cur_bytes_allocated_; }
 
+  // Prints statistics of memory usage, including the fraction of requests
+  // served from the cache (the hit rate), the fragmentation (memory that's
+  // cached rather than in use, and padding in memory that's in use) and the
+  // peak usage.
   void PrintMemoryUsage() const;
 
+  // Changes the options; this may be done at any time, but is normally done
+  // before the first allocation.
+  void SetOptions(const CuAllocatorOptions &opts);
+
   CuMemoryAllocator(CuAllocatorOptions opts);
+  ~CuMemoryAllocator();
  private:
 
+  // Does the work of PrintMemoryUsage(); the caller must hold mutex_.
+  void PrintMemoryUsageInternal() const;
+
+  // Does the work of MallocPitch() for requests that are not handled by the
+  // arena; the caller must hold mutex_.
+  void* CachedMallocPitch(size_t row_bytes, size_t num_rows, size_t *pitch);
+
+  // Allocates a slot of the arena (see arena_max_request_bytes in
+  // CuAllocatorOptions) for a request of "num_bytes" bytes.  The caller must
+  // hold mutex_.
+  void* ArenaMalloc(size_t num_bytes);
+
+  // To be called when we are about to hand out memory that was freed by
+  // thread "thread_id"; see the comment above the class.
+  void HandleReuseByThread(pthread_t thread_id);
+
   void FreeSomeCachedMemory(size_t bytes_to_free);
 
   // This calls CudaMallocPitch, checks for errors (dies if it has to), and
@@ -102,9 +169,11 @@ class CuMemoryAllocator {
     void *pointer;  // the CUDA memory location that we own
     size_t t;       // time value when we put this in the cache.
     size_t pitch;   // pitch of this memory region (c.f. cudaMallocPitch()).
+    pthread_t thread_id;  // the thread that freed this memory.
     CachedMemoryElement() { }
-    CachedMemoryElement(void *pointer, size_t t, size_t pitch):
-        pointer(pointer), t(t), pitch(pitch) { }
+    CachedMemoryElement(void *pointer, size_t t, size_t pitch,
+                        pthread_t thread_id):
+        pointer(pointer), t(t), pitch(pitch), thread_id(thread_id) { }
   };
 
   // This class caches a map from MemoryRequest to a list of CachedMemoryElements,
@@ -125,9 +194,11 @@ class CuMemoryAllocator {
                                        // this was empty.
 
     // Attempts lookup of the most recently cached element corresponding to
-    // 'request'.  If available, removes it from the cache and puts it to
-    // 'output', and returns true.  Otherwise returns false.
+    // 'request', preferring elements that were freed by thread 'thread_id'.
+    // If available, removes it from the cache and puts it to 'output', and
+    // returns true.  Otherwise returns false.
     bool Lookup(const MemoryRequest &request,
+                pthread_t thread_id,
                 CachedMemoryElement *output);
 
     // Inserts this CachedMemoryElement to the list of CachedMemoryElements for this
@@ -192,6 +263,32 @@ class CuMemoryAllocator {
   double tot_time_taken_in_cuda_malloc_pitch_;  // time in cudaMallocPitch
   double tot_time_taken_in_cuda_free_;  // time in cudaFree
   double tot_time_taken_in_malloc_pitch_;  // time in this->MallocPitch()
+  size_t cur_bytes_padding_;  // bytes of padding (from the pitch, or from
+                              // rounding up to an arena slot size) in memory
+                              // currently owned by callers; not included in
+                              // cur_bytes_used_.
+  size_t num_cross_thread_reuses_;  // number of times we handed out memory
+                                    // that a different thread had freed.
+
+  // Arena statistics.  These are kept separate from the quantities above
+  // (which only refer to memory not in the arena) because arena memory is
+  // never freed.
+  size_t arena_bytes_allocated_;  // total size of the arena chunks.
+  size_t arena_bytes_used_;  // bytes in arena slots currently owned by callers.
+  size_t max_arena_bytes_used_;  // the max over all time of arena_bytes_used_.
+
+  // The chunks of memory that the arena slots are carved out of.
+  std::vector<void*> arena_chunks_;
+  // The free arena slots, indexed by log_2 of the slot size; each is paired
+  // with the thread that freed it (or the thread that created the chunk).
+  std::vector<std::vector<std::pair<void*, pthread_t> > > arena_free_slots_;
+
+  // The GPU memory we hold (cur_bytes_allocated_ + arena_bytes_allocated_),
+  // for the memory statistics.
+  MemoryStatsEstimate memory_stats_;
+
+  // Protects all the members of this class.
+  mutable pthread_mutex_t mutex_;
 
 
   // a memory element is 'used' when it is currently possessed by the caller
@@ -200,9 +297,13 @@ class CuMemoryAllocator {
     size_t row_bytes;
     size_t num_rows;
     size_t pitch;
+    int32 arena_slot_log2;  // log_2 of the slot size if this memory came from
+                            // the arena; -1 otherwise.
     UsedMemoryElement() { }
-    UsedMemoryElement(size_t row_bytes, size_t num_rows, size_t pitch):
-        row_bytes(row_bytes), num_rows(num_rows), pitch(pitch)  { }
+    UsedMemoryElement(size_t row_bytes, size_t num_rows, size_t pitch,
+                      int32 arena_slot_log2 = -1):
+        row_bytes(row_bytes), num_rows(num_rows), pitch(pitch),
+        arena_slot_log2(arena_slot_log2) { }
   };
 
   struct PointerHasher {
@@ -221,6 +322,51 @@ class CuMemoryAllocator {
 };
 
 
+// Class that caches pinned (page-locked) host memory, which the GPU can copy
+// to and from at full speed and asynchronously, but which is very slow to
+// allocate and free with cudaHostAlloc() and cudaFreeHost().  The memory is
+// allocated as "portable", so it can be used with any GPU.  It's used by
+// PinnedMatrix (see cu-stream.h), via CuDevice::MallocPinned() and
+// CuDevice::FreePinned().  Requests are rounded up to one of four sizes per
+// power of two (so at most 25% is wasted), and freed memory is kept for reuse
+// by requests of the same size class, up to
+// CuAllocatorOptions::pinned_max_bytes_cached bytes.  This class is
+// thread-safe.
+class CuPinnedMemoryAllocator {
+ public:
+  void* Malloc(size_t num_bytes);
+
+  void Free(void *ptr);
+
+  void PrintMemoryUsage() const;
+
+  void SetOptions(const CuAllocatorOptions &opts);
+
+  CuPinnedMemoryAllocator(const CuAllocatorOptions &opts);
+  ~CuPinnedMemoryAllocator();
+ private:
+  // Returns the size that a request for num_bytes bytes is rounded up to.
+  static size_t RoundUpSize(size_t num_bytes);
+
+  size_t max_bytes_cached_;
+
+  // Map from (rounded-up) size in bytes to the cached blocks of that size.
+  std::map<size_t, std::vector<void*> > free_blocks_;
+  // Map from each block owned by a caller to its (rounded-up) size.
+  std::map<void*, size_t> used_blocks_;
+
+  size_t cur_bytes_cached_;
+  size_t cur_bytes_used_;
+  size_t max_bytes_used_;
+  size_t num_user_allocations_;  // number of calls to Malloc()
+  size_t num_system_allocations_;  // number of calls to cudaHostAlloc()
+  double tot_time_taken_in_cuda_malloc_host_;
+
+  // Protects all the members of this class.
+  mutable pthread_mutex_t mutex_;
+};
+
+
 }  // namespace
 
 #endif // HAVE_CUDA
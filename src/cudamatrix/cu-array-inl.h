@@ -50,11 +50,11 @@ void CuArray<T>::Resize(MatrixIndexT dim, MatrixResizeType resize_type) {
   
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     this->data_ = static_cast<T*>(CuDevice::Instantiate().Malloc(dim * sizeof(T)));
     this->dim_ = dim;
     if (resize_type == kSetZero) this->SetZero();
-    CuDevice::Instantiate().AccuProfile("CuArray::Resize", tim.Elapsed());    
+    CuDevice::Instantiate().AccuProfile("CuArray::Resize", tim);    
   } else
 #endif
   {
@@ -98,9 +98,9 @@ void CuArray<T>::CopyFromVec(const std::vector<T> &src) {
   if (src.empty()) return;
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     CU_SAFE_CALL(cudaMemcpy(data_, &src.front(), src.size()*sizeof(T), cudaMemcpyHostToDevice));
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim, src.size() * sizeof(T));
   } else
 #endif
   {
@@ -118,9 +118,10 @@ void CuArray<T>::CopyToVec(std::vector<T> *dst) const {
   if (dim_ == 0) return;
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) { 
-    Timer tim;
+    CuTimer tim;
     CU_SAFE_CALL(cudaMemcpy(&dst->front(), Data(), dim_ * sizeof(T), cudaMemcpyDeviceToHost));
-    CuDevice::Instantiate().AccuProfile("CuArray::CopyToVecD2H", tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile("CuArray::CopyToVecD2H", tim,
+                                        dim_ * sizeof(T));
   } else
 #endif
   {
@@ -135,9 +136,10 @@ void CuArray<T>::CopyToHost(T *dst) const {
   KALDI_ASSERT(dst != NULL);
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) { 
-    Timer tim;
+    CuTimer tim;
     CU_SAFE_CALL(cudaMemcpy(dst, Data(), dim_ * sizeof(T), cudaMemcpyDeviceToHost));
-    CuDevice::Instantiate().AccuProfile("CuArray::CopyToVecD2H", tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile("CuArray::CopyToVecD2H", tim,
+                                        dim_ * sizeof(T));
   } else
 #endif
   {
@@ -151,9 +153,9 @@ void CuArray<T>::SetZero() {
   if (dim_ == 0) return;
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) { 
-    Timer tim;
+    CuTimer tim;
     CU_SAFE_CALL(cudaMemset(data_, 0, dim_ * sizeof(T)));
-    CuDevice::Instantiate().AccuProfile("CuArray::SetZero", tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile("CuArray::SetZero", tim);
   } else
 #endif
   {
@@ -190,7 +192,7 @@ inline void CuArray<int32>::Set(const int32 &value) {
   if (dim_ == 0) return;
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) { 
-    Timer tim;
+    CuTimer tim;
 
     dim3 dimBlock(CU2DBLOCK);
     dim3 dimGrid(n_blocks(Dim(), CU2DBLOCK));
@@ -199,7 +201,7 @@ inline void CuArray<int32>::Set(const int32 &value) {
     cudaI32_set_const(dimGrid, dimBlock, data_, value, d);
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -214,10 +216,10 @@ void CuArray<T>::CopyFromArray(const CuArray<T> &src) {
   if (dim_ == 0) return;
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     CU_SAFE_CALL(cudaMemcpy(this->data_, src.data_, dim_ * sizeof(T),
                             cudaMemcpyDeviceToDevice));
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
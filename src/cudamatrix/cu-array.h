@@ -23,6 +23,7 @@
 #ifndef KALDI_CUDAMATRIX_CU_ARRAY_H_
 #define KALDI_CUDAMATRIX_CU_ARRAY_H_
 
+#include <algorithm>
 #include "matrix/kaldi-vector.h"
 
 namespace kaldi {
@@ -102,6 +103,12 @@ class CuArray {
   /// YET except for T == int32 (the current implementation will just crash).
   void Set(const T &value);
 
+  /// Swaps the contents of *this and *other (shallow swap).
+  void Swap(CuArray<T> *other) {
+    std::swap(dim_, other->dim_);
+    std::swap(data_, other->data_);
+  }
+
   CuArray<T> &operator= (const CuArray<T> &in) {
     this->CopyFromArray(in); return *this;
   }
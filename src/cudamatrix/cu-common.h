@@ -31,18 +31,23 @@
 
 #if HAVE_CUDA == 1
 #include <cublas_v2.h>
+#include <cusparse.h>
 #include <cuda_runtime_api.h>
 
 
 
+// CU_SAFE_CALL checks the return status of a CUDA call and dies if it failed.
+// It does not wait for the device to finish (that would prevent computation
+// from overlapping with host code and with asynchronous copies), so an error in
+// a kernel may only be reported by a later call; run with the environment
+// variable CUDA_LAUNCH_BLOCKING=1 to find out where it came from.
 #define CU_SAFE_CALL(fun) \
 { \
   int32 ret; \
   if ((ret = (fun)) != 0) { \
     KALDI_ERR << "cudaError_t " << ret << " : \"" << cudaGetErrorString((cudaError_t)ret) << "\" returned from '" << #fun << "'"; \
   } \
-  cudaDeviceSynchronize(); \
-} 
+}
 
 #define KALDI_CUDA_ERR(ret, msg) \
 { \
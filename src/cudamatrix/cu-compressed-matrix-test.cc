@@ -0,0 +1,131 @@
+// cudamatrix/cu-compressed-matrix-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "cudamatrix/cu-compressed-matrix.h"
+
+namespace kaldi {
+
+template<typename Real>
+static void UnitTestCuCompressedMatrixCopy() {
+  for (int32 i = 0; i < 10; i++) {
+    // Matrices with fewer than 8 rows use the 16-bit format.
+    int32 num_rows = (i % 2 == 0 ? RandInt(1, 7) : RandInt(8, 100)),
+        num_cols = RandInt(1, 50);
+    Matrix<Real> M(num_rows, num_cols);
+    M.SetRandn();
+    CompressedMatrix cmat(M);
+    Matrix<Real> ref(num_rows, num_cols);
+    cmat.CopyToMat(&ref);
+
+    CuCompressedMatrix cu_cmat(cmat);
+    KALDI_ASSERT(cu_cmat.NumRows() == num_rows &&
+                 cu_cmat.NumCols() == num_cols);
+    CuMatrix<Real> cu_mat(num_rows, num_cols);
+    cu_cmat.CopyToMat(&cu_mat);
+    Matrix<Real> mat(cu_mat);
+    KALDI_ASSERT(mat.ApproxEqual(ref, 0.00001));
+
+    CuMatrix<Real> cu_mat_trans(num_cols, num_rows);
+    cu_cmat.CopyToMat(&cu_mat_trans, kTrans);
+    Matrix<Real> mat_trans(cu_mat_trans, kTrans);
+    KALDI_ASSERT(mat_trans.ApproxEqual(ref, 0.00001));
+
+    CuCompressedMatrix cu_cmat2;
+    cu_cmat2.Swap(&cu_cmat);
+    KALDI_ASSERT(cu_cmat.NumRows() == 0 && cu_cmat2.NumRows() == num_rows);
+    cu_mat.SetZero();
+    cu_cmat2.CopyToMat(&cu_mat);
+    Matrix<Real> mat2(cu_mat);
+    KALDI_ASSERT(mat2.ApproxEqual(ref, 0.00001));
+  }
+}
+
+template<typename Real>
+static void UnitTestCuCompressedMatrixConcatenated() {
+  // Blocks in both formats, from CompressedMatrix::ConcatenateRows().
+  int32 num_cols = RandInt(1, 50);
+  std::vector<CompressedMatrix*> parts;
+  for (int32 i = 0; i < 4; i++) {
+    Matrix<Real> M(RandInt(1, 20), num_cols);
+    M.SetRandn();
+    parts.push_back(new CompressedMatrix(M));
+  }
+  CompressedMatrix cmat;
+  cmat.ConcatenateRows(std::vector<const CompressedMatrix*>(parts.begin(),
+                                                            parts.end()));
+  DeletePointers(&parts);
+  int32 num_rows = cmat.NumRows();
+  Matrix<Real> ref(num_rows, num_cols);
+  cmat.CopyToMat(&ref);
+
+  CuCompressedMatrix cu_cmat(cmat);
+  CuMatrix<Real> cu_mat(num_rows, num_cols);
+  cu_cmat.CopyToMat(&cu_mat);
+  Matrix<Real> mat(cu_mat);
+  KALDI_ASSERT(mat.ApproxEqual(ref, 0.00001));
+
+  CuMatrix<Real> cu_mat_trans(num_cols, num_rows);
+  cu_cmat.CopyToMat(&cu_mat_trans, kTrans);
+  Matrix<Real> mat_trans(cu_mat_trans, kTrans);
+  KALDI_ASSERT(mat_trans.ApproxEqual(ref, 0.00001));
+}
+
+static void UnitTestCuCompressedMatrixGeneral() {
+  Matrix<BaseFloat> M(RandInt(10, 50), RandInt(10, 50));
+  M.SetRandn();
+  GeneralMatrix gmat;
+  gmat = CompressedMatrix(M);
+  Matrix<BaseFloat> ref;
+  gmat.GetMatrix(&ref);
+  CuMatrix<BaseFloat> cu_mat(M.NumRows(), M.NumCols());
+  cu_mat.CopyFromGeneralMat(gmat);
+  Matrix<BaseFloat> mat(cu_mat);
+  KALDI_ASSERT(mat.ApproxEqual(ref, 0.00001));
+}
+
+} // end namespace kaldi.
+
+
+int main() {
+  using namespace kaldi;
+  for (int32 loop = 0; loop < 2; loop++) {
+#if HAVE_CUDA == 1
+    if (loop == 0)
+      CuDevice::Instantiate().SelectGpuId("no");
+    else
+      CuDevice::Instantiate().SelectGpuId("yes");
+#endif
+    UnitTestCuCompressedMatrixCopy<float>();
+    UnitTestCuCompressedMatrixCopy<double>();
+    UnitTestCuCompressedMatrixConcatenated<float>();
+    UnitTestCuCompressedMatrixConcatenated<double>();
+    UnitTestCuCompressedMatrixGeneral();
+    if (loop == 0)
+      KALDI_LOG << "Tests without GPU use succeeded.";
+    else
+      KALDI_LOG << "Tests with GPU use (if available) succeeded.";
+  }
+#if HAVE_CUDA == 1
+  CuDevice::Instantiate().PrintProfile();
+#endif
+  return 0;
+}
@@ -0,0 +1,149 @@
+// cudamatrix/cu-compressed-matrix.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#if HAVE_CUDA == 1
+#include <cuda_runtime_api.h>
+#endif
+
+#include "cudamatrix/cu-compressed-matrix.h"
+#include "cudamatrix/cu-common.h"
+#include "cudamatrix/cu-device.h"
+#include "cudamatrix/cu-kernels.h"
+
+namespace kaldi {
+
+void CuCompressedMatrix::Destroy() {
+#if HAVE_CUDA == 1
+  if (data_ != NULL)
+    CuDevice::Instantiate().Free(data_);
+#endif
+  data_ = NULL;
+  cmat_.Clear();
+  blocks_.clear();
+  num_rows_ = 0;
+  num_cols_ = 0;
+}
+
+void CuCompressedMatrix::CopyFromCompressedMat(const CompressedMatrix &cmat) {
+  Destroy();
+  if (cmat.NumRows() == 0)
+    return;
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    typedef CompressedMatrix::GlobalHeader GlobalHeader;
+    const GlobalHeader *h = static_cast<const GlobalHeader*>(cmat.Data());
+    size_t num_bytes = CompressedMatrix::DataSize(*h);
+    bool has_blocks = (h->format == 3);
+    int32 num_blocks = (has_blocks ? cmat.NumBlocks() : 1);
+    for (int32 b = 0; b < num_blocks; b++) {
+      const GlobalHeader *bh = (has_blocks ?
+          static_cast<const GlobalHeader*>(cmat.BlockData(b)) : h);
+      Block block;
+      block.row_offset = (has_blocks ? cmat.BlockRowOffsets()[b] : 0);
+      block.num_rows = bh->num_rows;
+      block.byte_offset = reinterpret_cast<const char*>(bh) -
+          reinterpret_cast<const char*>(h);
+      block.format = bh->format;
+      block.min_value = bh->min_value;
+      block.range = bh->range;
+      blocks_.push_back(block);
+    }
+    CuTimer tim;
+    data_ = CuDevice::Instantiate().Malloc(num_bytes);
+    CU_SAFE_CALL(cudaMemcpy(data_, cmat.Data(), num_bytes,
+                            cudaMemcpyHostToDevice));
+    CuDevice::Instantiate().AccuProfile(__func__, tim, num_bytes);
+  } else
+#endif
+  {
+    cmat_ = cmat;
+  }
+  num_rows_ = cmat.NumRows();
+  num_cols_ = cmat.NumCols();
+}
+
+template<typename Real>
+void CuCompressedMatrix::CopyToMat(CuMatrixBase<Real> *mat,
+                                   MatrixTransposeType trans) const {
+  if (trans == kNoTrans) {
+    KALDI_ASSERT(mat->NumRows() == num_rows_ && mat->NumCols() == num_cols_);
+  } else {
+    KALDI_ASSERT(mat->NumRows() == num_cols_ && mat->NumCols() == num_rows_);
+  }
+  if (num_rows_ == 0)
+    return;
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    CuTimer tim;
+    dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
+    for (size_t i = 0; i < blocks_.size(); i++) {
+      const Block &block = blocks_[i];
+      dim3 dimGrid(n_blocks(num_cols_, CU2DBLOCK),
+                   n_blocks(block.num_rows, CU2DBLOCK));
+      const char *body = static_cast<const char*>(data_) + block.byte_offset +
+          sizeof(CompressedMatrix::GlobalHeader);
+      // The rows of the block are rows of *mat, or columns if trans == kTrans.
+      Real *dest = mat->Data() + (trans == kNoTrans ?
+          static_cast<size_t>(block.row_offset) * mat->Stride() :
+          block.row_offset);
+      if (block.format == 1) {
+        const unsigned short *col_headers =
+            reinterpret_cast<const unsigned short*>(body);
+        const unsigned char *byte_data =
+            reinterpret_cast<const unsigned char*>(
+                body + num_cols_ * sizeof(CompressedMatrix::PerColHeader));
+        cuda_uncompress_col_header(dimGrid, dimBlock, col_headers, byte_data,
+                                   block.min_value, block.range,
+                                   block.num_rows, num_cols_,
+                                   dest, mat->Stride(), trans == kTrans);
+      } else {
+        KALDI_ASSERT(block.format == 2);
+        cuda_uncompress_uint16(dimGrid, dimBlock,
+                               reinterpret_cast<const unsigned short*>(body),
+                               block.min_value, block.range,
+                               block.num_rows, num_cols_,
+                               dest, mat->Stride(), trans == kTrans);
+      }
+    }
+    CU_SAFE_CALL(cudaGetLastError());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
+  } else
+#endif
+  {
+    cmat_.CopyToMat(&(mat->Mat()), trans);
+  }
+}
+
+template
+void CuCompressedMatrix::CopyToMat(CuMatrixBase<float> *mat,
+                                   MatrixTransposeType trans) const;
+template
+void CuCompressedMatrix::CopyToMat(CuMatrixBase<double> *mat,
+                                   MatrixTransposeType trans) const;
+
+void CuCompressedMatrix::Swap(CuCompressedMatrix *other) {
+  std::swap(num_rows_, other->num_rows_);
+  std::swap(num_cols_, other->num_cols_);
+  blocks_.swap(other->blocks_);
+  std::swap(data_, other->data_);
+  cmat_.Swap(&(other->cmat_));
+}
+
+} // end namespace kaldi.
@@ -0,0 +1,96 @@
+// cudamatrix/cu-compressed-matrix.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_CUDAMATRIX_CU_COMPRESSED_MATRIX_H_
+#define KALDI_CUDAMATRIX_CU_COMPRESSED_MATRIX_H_
+
+#include "base/kaldi-common.h"
+#include "matrix/compressed-matrix.h"
+#include "cudamatrix/cu-matrix.h"
+
+namespace kaldi {
+
+/**
+   CuCompressedMatrix holds a CompressedMatrix in GPU memory, in the same
+   byte format (the GlobalHeader, then the PerColHeaders, then the byte data;
+   or, for the "format 2" used for matrices with few rows, 16-bit integers;
+   or, for matrices from CompressedMatrix::ConcatenateRows(), blocks of rows
+   in one of those formats, which are decompressed by a kernel each).
+   Its purpose is to get compressed data such as training examples onto the
+   GPU cheaply: only the compressed bytes (roughly a quarter of the size of the
+   uncompressed matrix) are copied from the host, and the decompression is done
+   by a kernel, instead of by the CPU.
+
+   If we are not using a GPU, it just keeps a copy of the CompressedMatrix and
+   decompresses it on the CPU.
+*/
+class CuCompressedMatrix {
+ public:
+  CuCompressedMatrix(): num_rows_(0), num_cols_(0), data_(NULL) { }
+
+  explicit CuCompressedMatrix(const CompressedMatrix &cmat):
+      num_rows_(0), num_cols_(0), data_(NULL) { CopyFromCompressedMat(cmat); }
+
+  ~CuCompressedMatrix() { Destroy(); }
+
+  MatrixIndexT NumRows() const { return num_rows_; }
+  MatrixIndexT NumCols() const { return num_cols_; }
+
+  /// Copies the compressed data in "cmat" to the GPU (if we are using one).
+  void CopyFromCompressedMat(const CompressedMatrix &cmat);
+
+  /// Decompresses into "mat", which must already have the correct size
+  /// (NumRows() by NumCols(), or the reverse if trans == kTrans).
+  template<typename Real>
+  void CopyToMat(CuMatrixBase<Real> *mat,
+                 MatrixTransposeType trans = kNoTrans) const;
+
+  void Swap(CuCompressedMatrix *other);
+
+ private:
+  void Destroy();
+
+  MatrixIndexT num_rows_;
+  MatrixIndexT num_cols_;
+  // What the kernels need to know about each block of rows of the data: the
+  // format, min_value and range from the block's GlobalHeader, and where it
+  // is.  There is one block unless the CompressedMatrix is in the format from
+  // ConcatenateRows().  Set only if we are using a GPU.
+  struct Block {
+    int32 row_offset;
+    int32 num_rows;
+    size_t byte_offset;  // of the block's GlobalHeader, from data_.
+    int32 format;
+    float min_value;
+    float range;
+  };
+  std::vector<Block> blocks_;
+  // If we are using a GPU, a copy of the data of the CompressedMatrix, in
+  // device memory; else NULL.
+  void *data_;
+  // If we are not using a GPU, the compressed matrix.
+  CompressedMatrix cmat_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(CuCompressedMatrix);
+};
+
+} // end namespace kaldi.
+
+#endif
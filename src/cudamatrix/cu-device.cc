@@ -201,8 +201,8 @@ void CuDevice::FinalizeActiveGpu() {
     }
     // Remember the id of active GPU
     active_gpu_id_ = act_gpu_id; // CuDevice::Enabled() is true from now on
-    // Initialize the CUBLAS
-    CU_SAFE_CALL(cublasCreate(&handle_));
+    // Initialize the CUBLAS handle, etc., and make this thread use them.
+    pthread_setspecific(thread_context_key_, GetContext(act_gpu_id));
 
     // Notify user which GPU is finally used
     char name[128];
@@ -373,16 +373,310 @@ bool CuDevice::SelectGpuIdAuto() {
 }
 
 
+CuDevice::Context::Context(int32 gpu_id, const CuAllocatorOptions &opts):
+    gpu_id(gpu_id), allocator(opts), reference_event(NULL) {
+  CU_SAFE_CALL(cublasCreate(&handle));
+  CU_SAFE_CALL(cusparseCreate(&cusparse_handle));
+  // Create the stream for asynchronous copies.
+  CU_SAFE_CALL(cudaStreamCreateWithFlags(&copy_stream, cudaStreamNonBlocking));
+}
+
+CuDevice::Context::~Context() {
+  cudaSetDevice(gpu_id);
+  cublasDestroy(handle);
+  cusparseDestroy(cusparse_handle);
+  cudaStreamDestroy(copy_stream);
+  for (size_t i = 0; i < free_events.size(); i++)
+    cudaEventDestroy(free_events[i]);
+  if (reference_event != NULL)
+    cudaEventDestroy(reference_event);
+}
+
+CuDevice::Context *CuDevice::GetContext(int32 gpu_id) {
+  pthread_mutex_lock(&contexts_mutex_);
+  if (static_cast<size_t>(gpu_id) >= contexts_.size())
+    contexts_.resize(gpu_id + 1, NULL);
+  Context *context = contexts_[gpu_id];
+  if (context == NULL) {
+    try {
+      context = new Context(gpu_id, allocator_options_);
+    } catch (...) {
+      pthread_mutex_unlock(&contexts_mutex_);
+      throw;
+    }
+    contexts_[gpu_id] = context;
+  }
+  pthread_mutex_unlock(&contexts_mutex_);
+  return context;
+}
+
+CuDevice::Context *CuDevice::InitThreadContext() {
+  KALDI_ASSERT(Enabled());
+  // By default, a new thread's current device would be GPU 0.
+  CU_SAFE_CALL(cudaSetDevice(active_gpu_id_));
+  Context *context = GetContext(active_gpu_id_);
+  pthread_setspecific(thread_context_key_, context);
+  return context;
+}
+
+void CuDevice::SetThreadGpuId(int32 gpu_id) {
+  if (!Enabled())
+    KALDI_ERR << "SetThreadGpuId() may only be called after a GPU has been "
+              << "selected with SelectGpuId().";
+  int32 num_gpus = NumGpus();
+  if (gpu_id < 0 || gpu_id >= num_gpus)
+    KALDI_ERR << "Invalid GPU id " << gpu_id << ": there are " << num_gpus
+              << " GPUs.";
+  cudaError_t e = cudaSetDevice(gpu_id);
+  if (e == cudaSuccess)
+    e = cudaDeviceSynchronize();  // << CUDA context gets created here.
+  if (e != cudaSuccess) {
+    KALDI_CUDA_ERR(e, "Cannot use GPU " << gpu_id);
+  }
+  bool is_new;
+  pthread_mutex_lock(&contexts_mutex_);
+  is_new = (static_cast<size_t>(gpu_id) >= contexts_.size() ||
+            contexts_[gpu_id] == NULL);
+  pthread_mutex_unlock(&contexts_mutex_);
+  pthread_setspecific(thread_context_key_, GetContext(gpu_id));
+  if (is_new) {
+    char name[128];
+    DeviceGetName(name, 128, gpu_id);
+    KALDI_LOG << "Also using GPU [" << gpu_id << "]: " << name << "\t"
+              << GetFreeMemory(NULL, NULL);
+  }
+}
+
+int32 CuDevice::NumGpus() {
+  int32 num_gpus = 0;
+  if (cudaGetDeviceCount(&num_gpus) != cudaSuccess) {
+    cudaGetLastError();  // Clear the error state.
+    return 0;
+  }
+  return num_gpus;
+}
+
+void CuDevice::Free(void *ptr) {
+  // Try the allocator of this thread's GPU first.
+  Context *context = ThreadContext();
+  if (context->allocator.TryFree(ptr))
+    return;
+  std::vector<Context*> contexts;
+  pthread_mutex_lock(&contexts_mutex_);
+  contexts = contexts_;
+  pthread_mutex_unlock(&contexts_mutex_);
+  for (size_t i = 0; i < contexts.size(); i++)
+    if (contexts[i] != NULL && contexts[i] != context &&
+        contexts[i]->allocator.TryFree(ptr))
+      return;
+  KALDI_ERR << "Attempt to free CUDA memory pointer that was not allocated: "
+            << ptr;
+}
+
+void CuDevice::SetAllocatorOptions(const CuAllocatorOptions &opts) {
+  pthread_mutex_lock(&contexts_mutex_);
+  allocator_options_ = opts;
+  for (size_t i = 0; i < contexts_.size(); i++)
+    if (contexts_[i] != NULL)
+      contexts_[i]->allocator.SetOptions(opts);
+  pthread_mutex_unlock(&contexts_mutex_);
+  pinned_allocator_.SetOptions(opts);
+}
+
 void CuDevice::AccuProfile(const std::string &key, double time) {
-  if (profile_map_.find(key) == profile_map_.end()) {
-    profile_map_[key] = 0.0;
+  pthread_mutex_lock(&profile_mutex_);
+  ProfileStats &stats = profile_map_[key];
+  stats.num_calls++;
+  stats.host_time += time;
+  pthread_mutex_unlock(&profile_mutex_);
+}
+
+void CuDevice::AccuProfile(const std::string &key, CuTimer &timer,
+                           int64 num_bytes) {
+  double time = timer.Elapsed();
+  pthread_mutex_lock(&profile_mutex_);
+  ProfileStats &stats = profile_map_[key];
+  stats.num_calls++;
+  stats.host_time += time;
+  stats.num_bytes += num_bytes;
+  if (timer.start_ != NULL) {
+    PendingEvent pending;
+    pending.key = key;
+    pending.context = timer.context_;
+    pending.stream_index = timer.stream_index_;
+    pending.start = timer.start_;
+    pending.stop = GetEvent(timer.context_);
+    pending.num_bytes = num_bytes;
+    CU_SAFE_CALL(cudaEventRecord(pending.stop, timer.stream_));
+    pending_events_.push_back(pending);
+    timer.start_ = NULL;
+    // Don't let the queue get long; this doesn't wait for anything.
+    if (pending_events_.size() >= 1024)
+      ProcessPendingEvents(false);
   }
-  profile_map_[key] += time;
+  pthread_mutex_unlock(&profile_mutex_);
+}
+
+void CuDevice::StartTimer(CuTimer *timer) {
+  if (!Enabled()) return;
+  Context *context = ThreadContext();
+  pthread_mutex_lock(&profile_mutex_);
+  if (context->reference_event == NULL) {
+    CU_SAFE_CALL(cudaEventCreate(&(context->reference_event)));
+    CU_SAFE_CALL(cudaEventRecord(context->reference_event, 0));
+  }
+  timer->context_ = context;
+  timer->stream_index_ = (timer->stream_ == 0 ? 0 :
+                          (timer->stream_ == context->copy_stream ? 1 : 2));
+  timer->start_ = GetEvent(context);
+  CU_SAFE_CALL(cudaEventRecord(timer->start_, timer->stream_));
+  pthread_mutex_unlock(&profile_mutex_);
+}
+
+void CuDevice::ReleaseTimer(CuTimer *timer) {
+  pthread_mutex_lock(&profile_mutex_);
+  timer->context_->free_events.push_back(timer->start_);
+  timer->start_ = NULL;
+  pthread_mutex_unlock(&profile_mutex_);
+}
+
+cudaEvent_t CuDevice::GetEvent(Context *context) {
+  cudaEvent_t event;
+  if (context->free_events.empty()) {
+    CU_SAFE_CALL(cudaEventCreate(&event));
+  } else {
+    event = context->free_events.back();
+    context->free_events.pop_back();
+  }
+  return event;
+}
+
+void CuDevice::ProcessPendingEvents(bool wait) {
+  while (!pending_events_.empty()) {
+    PendingEvent &pending = pending_events_.front();
+    if (wait) {
+      CU_SAFE_CALL(cudaEventSynchronize(pending.stop));
+    } else if (cudaEventQuery(pending.stop) != cudaSuccess) {
+      break;
+    }
+    float elapsed_ms, start_ms;
+    CU_SAFE_CALL(cudaEventElapsedTime(&elapsed_ms, pending.start,
+                                      pending.stop));
+    profile_map_[pending.key].device_time += elapsed_ms / 1000.0;
+    if (trace_events_.size() < static_cast<size_t>(max_trace_events_)) {
+      CU_SAFE_CALL(cudaEventElapsedTime(&start_ms,
+                                        pending.context->reference_event,
+                                        pending.start));
+      TraceEvent trace;
+      trace.key = pending.key;
+      trace.gpu_id = pending.context->gpu_id;
+      trace.stream_index = pending.stream_index;
+      trace.start_time = start_ms * 1000.0;
+      trace.duration = elapsed_ms * 1000.0;
+      trace.num_bytes = pending.num_bytes;
+      trace_events_.push_back(trace);
+    } else {
+      num_dropped_trace_events_++;
+    }
+    pending.context->free_events.push_back(pending.start);
+    pending.context->free_events.push_back(pending.stop);
+    pending_events_.pop_front();
+  }
+}
+
+void CuDevice::SetEventProfiling(bool enable, int32 max_trace_events) {
+  KALDI_ASSERT(max_trace_events >= 0);
+  pthread_mutex_lock(&profile_mutex_);
+  event_profiling_ = enable;
+  max_trace_events_ = max_trace_events;
+  pthread_mutex_unlock(&profile_mutex_);
+}
+
+void CuDevice::ResetProfile() {
+  pthread_mutex_lock(&profile_mutex_);
+  ProcessPendingEvents(true);
+  profile_map_.clear();
+  trace_events_.clear();
+  num_dropped_trace_events_ = 0;
+  pthread_mutex_unlock(&profile_mutex_);
+}
+
+// Writes "str" as a JSON string.
+static void WriteJsonString(const std::string &str, std::ostream &os) {
+  os << '"';
+  for (size_t i = 0; i < str.size(); i++) {
+    char c = str[i];
+    if (c == '"' || c == '\\') os << '\\' << c;
+    else if (static_cast<unsigned char>(c) < 0x20) os << ' ';
+    else os << c;
+  }
+  os << '"';
+}
+
+void CuDevice::WriteProfileJson(std::ostream &os) {
+  pthread_mutex_lock(&profile_mutex_);
+  ProcessPendingEvents(true);
+  // We list the operations from the longest to the shortest total time.
+  std::vector<std::pair<double, std::string> > pairs;
+  unordered_map<std::string, ProfileStats, StringHasher>::iterator it;
+  for (it = profile_map_.begin(); it != profile_map_.end(); ++it)
+    pairs.push_back(std::make_pair(-(event_profiling_ ? it->second.device_time
+                                     : it->second.host_time), it->first));
+  std::sort(pairs.begin(), pairs.end());
+  os << "{\n\"profile\": [";
+  for (size_t i = 0; i < pairs.size(); i++) {
+    const ProfileStats &stats = profile_map_[pairs[i].second];
+    os << (i == 0 ? "\n" : ",\n") << "  {\"name\": ";
+    WriteJsonString(pairs[i].second, os);
+    os << ", \"calls\": " << stats.num_calls
+       << ", \"host_seconds\": " << stats.host_time
+       << ", \"device_seconds\": " << stats.device_time
+       << ", \"bytes\": " << stats.num_bytes << "}";
+  }
+  os << "\n],\n\"droppedTraceEvents\": " << num_dropped_trace_events_
+     << ",\n\"displayTimeUnit\": \"ms\",\n\"traceEvents\": [";
+  // Name the "threads" of each GPU after the streams.
+  const char *stream_names[] = { "default stream", "copy stream",
+                                 "other streams" };
+  bool first = true;
+  for (size_t g = 0; g < contexts_.size(); g++) {
+    if (contexts_[g] == NULL || contexts_[g]->reference_event == NULL)
+      continue;
+    for (int32 s = 0; s < 3; s++) {
+      os << (first ? "\n" : ",\n")
+         << "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << g
+         << ", \"tid\": " << s << ", \"args\": {\"name\": \""
+         << stream_names[s] << "\"}}";
+      first = false;
+    }
+  }
+  for (size_t i = 0; i < trace_events_.size(); i++) {
+    const TraceEvent &trace = trace_events_[i];
+    os << (first ? "\n" : ",\n") << "  {\"name\": ";
+    WriteJsonString(trace.key, os);
+    os << ", \"ph\": \"X\", \"pid\": " << trace.gpu_id
+       << ", \"tid\": " << trace.stream_index
+       << ", \"ts\": " << trace.start_time
+       << ", \"dur\": " << trace.duration
+       << ", \"args\": {\"bytes\": " << trace.num_bytes << "}}";
+    first = false;
+  }
+  os << "\n]\n}\n";
+  pthread_mutex_unlock(&profile_mutex_);
 }
 
 void CuDevice::PrintMemoryUsage() const {
   if (Enabled()) {
-    allocator_.PrintMemoryUsage();
+    int32 num_contexts = 0;
+    for (size_t i = 0; i < contexts_.size(); i++)
+      if (contexts_[i] != NULL) num_contexts++;
+    for (size_t i = 0; i < contexts_.size(); i++) {
+      if (contexts_[i] == NULL) continue;
+      if (num_contexts > 1)
+        KALDI_LOG << "For GPU " << i << ":";
+      contexts_[i]->allocator.PrintMemoryUsage();
+    }
+    pinned_allocator_.PrintMemoryUsage();
     int64 free_memory_now;
     GetFreeMemory(&free_memory_now, NULL);
     KALDI_LOG << "Memory used (according to the device): "
@@ -394,13 +688,16 @@ void CuDevice::PrintProfile() {
   if (verbose_ && Enabled()) {
     std::ostringstream os;
     os << "-----\n[cudevice profile]\n";
-    unordered_map<std::string, double, StringHasher>::iterator it;
+    unordered_map<std::string, ProfileStats, StringHasher>::iterator it;
     std::vector<std::pair<double, std::string> > pairs;
-    double total_time = 0.0;
+    double total_time = 0.0, total_device_time = 0.0;
+    pthread_mutex_lock(&profile_mutex_);
+    ProcessPendingEvents(true);
     for(it = profile_map_.begin(); it != profile_map_.end(); ++it) {
       std::string function_name = it->first;
-      double elapsed_time = it->second;
+      double elapsed_time = it->second.host_time;
       total_time += elapsed_time;
+      total_device_time += it->second.device_time;
       pairs.push_back(std::make_pair(elapsed_time, function_name));
     }
     // display from shortest to longest time, so tail will show the longest
@@ -408,9 +705,17 @@ void CuDevice::PrintProfile() {
     std::sort(pairs.begin(), pairs.end());
     size_t max_print = 15, start_pos = (pairs.size() <= max_print ?
                                         0 : pairs.size() - max_print);
-    for (size_t i = start_pos; i < pairs.size(); i++)
-      os << pairs[i].second << "\t" << pairs[i].first << "s\n";
+    for (size_t i = start_pos; i < pairs.size(); i++) {
+      os << pairs[i].second << "\t" << pairs[i].first << "s";
+      if (event_profiling_)
+        os << "\t(device: " << profile_map_[pairs[i].second].device_time
+           << "s)";
+      os << "\n";
+    }
+    pthread_mutex_unlock(&profile_mutex_);
     os << "Total GPU time:\t" << total_time << "s (may involve some double-counting)\n";
+    if (event_profiling_)
+      os << "Total device time:\t" << total_device_time << "s\n";
     os << "-----";
     KALDI_LOG << os.str();
     PrintMemoryUsage();
@@ -422,7 +727,7 @@ std::string CuDevice::GetFreeMemory(int64* free, int64* total) const {
 // WARNING! the CUDA API is inconsistent accross versions!
 #ifdef _MSC_VER
 	size_t mem_free, mem_total;
-	cuMemGetInfo_v2(handle_, &mem_free, &mem_total);
+	cuMemGetInfo_v2(const_cast<CuDevice*>(this)->GetHandle(), &mem_free, &mem_total);
 #else
 #if (CUDA_VERSION >= 3020)
   // define the function signature type
@@ -435,7 +740,7 @@ std::string CuDevice::GetFreeMemory(int64* free, int64* total) const {
     // pre-fill ``safe'' values that will not cause problems
     mem_free = 1; mem_total = 1;
 #ifdef _MSC_VER
-    cuMemGetInfo_v2(handle_, &mem_free, &mem_total);
+    cuMemGetInfo_v2(const_cast<CuDevice*>(this)->GetHandle(), &mem_free, &mem_total);
 #else
     // open libcuda.so
     void* libcuda = dlopen("libcuda.so",RTLD_LAZY);
@@ -554,14 +859,29 @@ void* CuDevice::Malloc(size_t size) {
 }
 */
 
-CuDevice::CuDevice(): active_gpu_id_(-1), verbose_(true),
-                      allocator_(CuAllocatorOptions()) { }
+CuDevice::CuDevice(): event_profiling_(false), max_trace_events_(0),
+                      num_dropped_trace_events_(0),
+                      active_gpu_id_(-1), verbose_(true),
+                      pinned_allocator_(CuAllocatorOptions()) {
+  if (pthread_mutex_init(&contexts_mutex_, NULL) != 0 ||
+      pthread_mutex_init(&profile_mutex_, NULL) != 0 ||
+      pthread_key_create(&thread_context_key_, NULL) != 0)
+    KALDI_ERR << "Error initializing pthread mutex or key";
+}
 
 
 CuDevice::~CuDevice() {
-  if (Enabled()) {
-    cublasDestroy(handle_);
+  // Give back the events of any operations we never waited for, so the
+  // Contexts destroy them.
+  for (size_t i = 0; i < pending_events_.size(); i++) {
+    pending_events_[i].context->free_events.push_back(pending_events_[i].start);
+    pending_events_[i].context->free_events.push_back(pending_events_[i].stop);
   }
+  for (size_t i = 0; i < contexts_.size(); i++)
+    delete contexts_[i];
+  pthread_key_delete(thread_context_key_);
+  pthread_mutex_destroy(&profile_mutex_);
+  pthread_mutex_destroy(&contexts_mutex_);
 }
 
 // The instance of the static singleton
@@ -26,19 +26,38 @@
 #if HAVE_CUDA == 1
 
 #include <cublas_v2.h>
+#include <cusparse.h>
+#include <deque>
 #include <map>
 #include <string>
+#include <vector>
 #include <iostream>
+#include <pthread.h>
 #include <cuda.h>
 #include <cuda_runtime_api.h>
 #include "base/kaldi-common.h"
+#include "base/timer.h"
 #include "cudamatrix/cu-allocator.h"
 
 namespace kaldi {
 
+class CuTimer;
+
 /**
  * Singleton object which represents the CUDA device
  * responsible for CUBLAS initilalisation, collects profiling info
+ *
+ * A process normally uses the one GPU that SelectGpuId() selects, but
+ * different threads may use different GPUs: after SelectGpuId(), a thread can
+ * call SetThreadGpuId() to do all its subsequent CUDA work (including memory
+ * allocation) on another GPU, which lets a single process spread its
+ * computation (e.g. one NnetComputer per thread) across all the GPUs of a
+ * machine while sharing host-side data such as the model and the decoding
+ * graph.  CUDA memory (e.g. a CuMatrix) must only be used by threads that are
+ * on the GPU it was allocated on, although it may be freed from any thread.
+ * Threads that never call SetThreadGpuId() use the GPU that SelectGpuId()
+ * selected.  The GPUs are assumed to be of the same type (e.g.
+ * DoublePrecisionSupported() only checks the one SelectGpuId() selected).
  */
 class CuDevice {
  // Singleton object (there should only be one instantiated per program)
@@ -46,18 +65,50 @@ class CuDevice {
   ~CuDevice();
   static inline CuDevice& Instantiate() { return global_device_; }
 
-  inline cublasHandle_t GetHandle() { return handle_; }
+  /// Returns the cuBLAS handle for the GPU that the calling thread uses.
+  inline cublasHandle_t GetHandle() { return ThreadContext()->handle; }
+
+  /// Returns the cuSPARSE handle for the GPU that the calling thread uses.
+  inline cusparseHandle_t GetCusparseHandle() {
+    return ThreadContext()->cusparse_handle;
+  }
+
+  /// Returns the stream that asynchronous copies between host and device
+  /// (e.g. CuMatrixBase::CopyFromMatAsync()) are queued on.  It's created with
+  /// cudaStreamNonBlocking when the GPU is selected, so copies on it can run
+  /// at the same time as the computation, which is all done on the default
+  /// stream.  Only valid if Enabled().  Each GPU has its own.
+  inline cudaStream_t GetCopyStream() {
+    return ThreadContext()->copy_stream;
+  }
 
   // We provide functions Malloc, MallocPitch and Free which replace cudaMalloc,
   // cudaMallocPitch and cudaFree.  Their function is to cache the results of
   // previous allocations to avoid the very large overhead that CUDA's
   // allocation seems to give for some setups.
-  inline void* Malloc(size_t size) { return allocator_.Malloc(size); }
+  // These use the allocator of the GPU that the calling thread uses.
+  inline void* Malloc(size_t size) {
+    return ThreadContext()->allocator.Malloc(size);
+  }
 
   inline void* MallocPitch(size_t row_bytes, size_t num_rows, size_t *pitch) {
-    return allocator_.MallocPitch(row_bytes, num_rows, pitch);
+    return ThreadContext()->allocator.MallocPitch(row_bytes, num_rows, pitch);
   }
-  inline void Free(void *ptr) { allocator_.Free(ptr); }
+  // Free() may be called from any thread, not just from threads that use the
+  // GPU the memory was allocated on.
+  void Free(void *ptr);
+
+  /// MallocPinned and FreePinned replace cudaMallocHost and cudaFreeHost,
+  /// caching the memory for reuse; see CuPinnedMemoryAllocator.  Normally
+  /// you would use class PinnedMatrix rather than calling these directly.
+  inline void* MallocPinned(size_t size) {
+    return pinned_allocator_.Malloc(size);
+  }
+  inline void FreePinned(void *ptr) { pinned_allocator_.Free(ptr); }
+
+  /// Changes the options of the memory allocator (see CuAllocatorOptions in
+  /// cu-allocator.h); this is best done before any allocation.
+  void SetAllocatorOptions(const CuAllocatorOptions &opts);
 
   /// Select a GPU for computation, the 'use_gpu' modes are:
   ///  "yes"      -- Select GPU automatically and die if this fails.
@@ -71,29 +122,87 @@ class CuDevice {
     return (active_gpu_id_ > -1);
   }
 
-  /// Get the active GPU id
+  /// Get the active GPU id (the one selected by SelectGpuId()).
   int32 ActiveGpuId() {
     return active_gpu_id_;
   }
 
+  /// Makes the calling thread do all its subsequent CUDA work on GPU number
+  /// "gpu_id" (0 <= gpu_id < NumGpus()), setting up a cuBLAS handle and memory
+  /// allocator for that GPU if no other thread has used it yet.  May only be
+  /// called once SelectGpuId() has selected a GPU (i.e. if Enabled()), and
+  /// should be called before the thread does any CUDA work.  Dies if the GPU
+  /// cannot be used (e.g. because it's in use by another process in
+  /// compute-exclusive mode).
+  void SetThreadGpuId(int32 gpu_id);
+
+  /// Returns the id of the GPU that the calling thread uses.  Only valid if
+  /// Enabled().
+  int32 ThreadGpuId() { return ThreadContext()->gpu_id; }
+
+  /// Returns the number of GPUs in the machine (0 if there are none or CUDA
+  /// can't be initialized).
+  int32 NumGpus();
+
   /// Returns true if either we have no GPU, or we have a GPU
   /// and it supports double precision.
   bool DoublePrecisionSupported();
 
   void SetVerbose(bool verbose) {  verbose_ = verbose; }
 
-  /// Sum the IO time
+  /// Adds "time" (in seconds, host-side) to the profile for operation "key".
   void AccuProfile(const std::string &key, double time);
+
+  /// Adds the time that "timer" has measured to the profile for operation
+  /// "key"; this is called at the end of each Cu* operation, with a CuTimer
+  /// that was created at its start.  "num_bytes" is the amount of memory
+  /// traffic to attribute to the operation (for now, only the copies between
+  /// host and device supply it).  If event-based profiling is on, this
+  /// records the end event, and the device time is added in later, once the
+  /// GPU has got that far.
+  void AccuProfile(const std::string &key, CuTimer &timer,
+                   int64 num_bytes = 0);
+
+  /// Prints the operations that took the most time (if verbose).  If
+  /// event-based profiling is on, it waits for the GPU to finish and prints
+  /// the device time of each operation too.
   void PrintProfile();
 
   void PrintMemoryUsage() const;
 
-  void ResetProfile() {
-    profile_map_.clear();
-  }
+  void ResetProfile();
+
+  /// Turns event-based profiling on or off.  When it's on, each Cu*
+  /// operation records a CUDA event at its start and end (on the stream it
+  /// runs on), so that we get the time it took on the device and not just the
+  /// time it took to launch, without any extra synchronization.  The
+  /// events are resolved in the background of later calls to AccuProfile(),
+  /// and at the latest by PrintProfile() or WriteProfileJson().  The first
+  /// "max_trace_events" operations are also kept individually, for the trace
+  /// that WriteProfileJson() writes.
+  void SetEventProfiling(bool enable, int32 max_trace_events = 100000);
+
+  bool EventProfilingEnabled() const { return event_profiling_; }
+
+  /// Writes the profile as a JSON object.  Its "profile" member is a list of
+  /// the operations with their number of calls, host time, device time (if
+  /// event-based profiling was on) and bytes of memory traffic, and its
+  /// "traceEvents" member is the trace of individual operations (if
+  /// event-based profiling was on) in the Chrome trace-event format, so the
+  /// file can be loaded into chrome://tracing: each GPU is shown as a
+  /// process, and its default and copy streams as threads.
+  void WriteProfileJson(std::ostream &os);
 
   /// Get the actual GPU memory use stats
   std::string GetFreeMemory(int64* free = NULL, int64* total = NULL) const;
+
+  /// Returns the most memory, in bytes, that the memory allocator of the
+  /// calling thread's GPU has held at any time (memory in use plus memory it
+  /// caches).  Unlike GetFreeMemory(), this does not include other processes
+  /// and CUDA's own overhead.  Only call this if Enabled().
+  size_t MaxMemoryAllocated() {
+    return ThreadContext()->allocator.MaxMemoryAllocated();
+  }
   /// Get the name of the GPU
   void DeviceGetName(char* name, int32 len, int32 dev);
 
@@ -113,7 +222,94 @@ class CuDevice {
 
 
   static CuDevice global_device_;
-  cublasHandle_t handle_;
+
+  // The state that we keep for each GPU that some thread uses.  It's created
+  // (and destroyed) with that GPU current.
+  struct Context {
+    int32 gpu_id;
+    cublasHandle_t handle;
+    cusparseHandle_t cusparse_handle;
+    cudaStream_t copy_stream;  // see GetCopyStream().
+    CuMemoryAllocator allocator;
+    // The following are only used for event-based profiling, and are
+    // protected by profile_mutex_.  free_events are events available for
+    // reuse by CuTimer; reference_event is recorded when the first event on
+    // this GPU is needed, and the times in the trace are relative to it.
+    std::vector<cudaEvent_t> free_events;
+    cudaEvent_t reference_event;
+
+    Context(int32 gpu_id, const CuAllocatorOptions &opts);
+    ~Context();
+   private:
+    KALDI_DISALLOW_COPY_AND_ASSIGN(Context);
+  };
+
+  // Returns the Context of the GPU that the calling thread uses.
+  inline Context *ThreadContext() {
+    Context *context =
+        static_cast<Context*>(pthread_getspecific(thread_context_key_));
+    return (context != NULL ? context : InitThreadContext());
+  }
+
+  // Called by ThreadContext() the first time a thread that has not called
+  // SetThreadGpuId() needs its Context: makes it use the GPU selected by
+  // SelectGpuId().
+  Context *InitThreadContext();
+
+  // Returns the Context for GPU "gpu_id", creating it if necessary.  The
+  // calling thread must have made that GPU current.
+  Context *GetContext(int32 gpu_id);
+
+  friend class CuTimer;
+
+  // Called from the constructor of CuTimer if event-based profiling is on:
+  // records its start event.
+  void StartTimer(CuTimer *timer);
+
+  // Called from the destructor of CuTimer if it was never passed to
+  // AccuProfile(): gives back its start event.
+  void ReleaseTimer(CuTimer *timer);
+
+  // Returns an event from the pool of "context", creating one if necessary.
+  // profile_mutex_ must be held.
+  cudaEvent_t GetEvent(Context *context);
+
+  // Works out the device time of entries of pending_events_, which it then
+  // removes.  If "wait" is true it waits for all of them to complete;
+  // otherwise it stops at the first that hasn't.  profile_mutex_ must be held.
+  void ProcessPendingEvents(bool wait);
+
+  // The profile of each operation, as accumulated by AccuProfile().
+  struct ProfileStats {
+    int64 num_calls;
+    double host_time;  // in seconds.
+    double device_time;  // in seconds; only with event-based profiling.
+    int64 num_bytes;
+    ProfileStats(): num_calls(0), host_time(0.0), device_time(0.0),
+                    num_bytes(0) { }
+  };
+
+  // An operation whose events have been recorded, but whose device time we
+  // have not worked out yet.
+  struct PendingEvent {
+    std::string key;
+    Context *context;
+    int32 stream_index;  // 0 for the default stream, 1 for the copy stream,
+                         // 2 for any other.
+    cudaEvent_t start;
+    cudaEvent_t stop;
+    int64 num_bytes;
+  };
+
+  // An operation in the trace that WriteProfileJson() writes.
+  struct TraceEvent {
+    std::string key;
+    int32 gpu_id;
+    int32 stream_index;
+    double start_time;  // in microseconds after the reference event.
+    double duration;  // in microseconds.
+    int64 num_bytes;
+  };
 
   /// Check if the GPU run in compute exclusive mode Returns true if it is
   /// running in compute exclusive mode and we have a GPU.  Returns false
@@ -136,7 +332,14 @@ class CuDevice {
   /// Should only be called if Enabled() == true.
   int32 MinorDeviceVersion();
 
-  unordered_map<std::string, double, StringHasher> profile_map_;
+  // The following members, to do with profiling, are protected by
+  // profile_mutex_ (except event_profiling_, which is only set at startup).
+  unordered_map<std::string, ProfileStats, StringHasher> profile_map_;
+  bool event_profiling_;
+  int32 max_trace_events_;
+  std::deque<PendingEvent> pending_events_;
+  std::vector<TraceEvent> trace_events_;
+  int64 num_dropped_trace_events_;
 
   /// active_gpu_id_ values:
   /// -3 default (default, the SelectGpuId was not called, we did not want to use GPU)
@@ -151,7 +354,24 @@ class CuDevice {
 
   bool verbose_;
 
-  CuMemoryAllocator allocator_;
+  // The options for the memory allocators, including for those of GPUs that
+  // are not in use yet.
+  CuAllocatorOptions allocator_options_;
+
+  // Indexed by GPU id; NULL for GPUs that no thread uses yet.  Protected by
+  // contexts_mutex_.
+  std::vector<Context*> contexts_;
+  pthread_mutex_t contexts_mutex_;
+
+  // Key for the thread-specific pointer to the Context of the GPU that each
+  // thread uses.
+  pthread_key_t thread_context_key_;
+
+  // Protects the profiling state, which all threads may add to.
+  pthread_mutex_t profile_mutex_;
+
+  // Pinned host memory can be used with any GPU, so this is shared.
+  CuPinnedMemoryAllocator pinned_allocator_;
 
 }; // class CuDevice
 
@@ -159,6 +379,44 @@ class CuDevice {
 // in the CUBLAS v2 API, since we so frequently need to access it.
 inline cublasHandle_t GetCublasHandle() { return CuDevice::Instantiate().GetHandle(); }
 
+// The same for the cuSPARSE API.
+inline cusparseHandle_t GetCusparseHandle() {
+  return CuDevice::Instantiate().GetCusparseHandle();
+}
+
+
+/**
+   CuTimer is what the Cu* operations use to time themselves for the profile
+   (see CuDevice::AccuProfile()): create one at the start of the operation
+   and pass it to AccuProfile() at the end.  It measures host-side wall-clock
+   time like Timer does, and if event-based profiling is on (see
+   CuDevice::SetEventProfiling()) it also records a CUDA event on "stream"
+   when it's created, so that the device time can be measured.  Pass the
+   stream that the operation's work is queued on, if it's not the default
+   stream.
+*/
+class CuTimer: public Timer {
+ public:
+  explicit CuTimer(cudaStream_t stream = 0):
+      stream_(stream), start_(NULL), context_(NULL), stream_index_(0) {
+    if (CuDevice::Instantiate().EventProfilingEnabled())
+      CuDevice::Instantiate().StartTimer(this);
+  }
+  ~CuTimer() {
+    if (start_ != NULL)
+      CuDevice::Instantiate().ReleaseTimer(this);
+  }
+ private:
+  friend class CuDevice;
+  cudaStream_t stream_;
+  // The start event, or NULL if we are not doing event-based profiling (or
+  // if the timer has been passed to AccuProfile()).
+  cudaEvent_t start_;
+  CuDevice::Context *context_;
+  int32 stream_index_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(CuTimer);
+};
+
 
 }  // namespace
 
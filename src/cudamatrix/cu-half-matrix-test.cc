@@ -0,0 +1,124 @@
+// cudamatrix/cu-half-matrix-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "cudamatrix/cu-half-matrix.h"
+
+namespace kaldi {
+
+static void UnitTestRoundToHalfPrecision() {
+  KALDI_ASSERT(RoundToHalfPrecision(0.0) == 0.0);
+  KALDI_ASSERT(RoundToHalfPrecision(1.0) == 1.0);
+  KALDI_ASSERT(RoundToHalfPrecision(-2.5) == -2.5);
+  KALDI_ASSERT(RoundToHalfPrecision(65504.0) == 65504.0);
+  KALDI_ASSERT(KALDI_ISINF(RoundToHalfPrecision(70000.0)));
+  // Ties are rounded to even.
+  KALDI_ASSERT(RoundToHalfPrecision(1.0 + std::pow(2.0, -11)) == 1.0);
+  KALDI_ASSERT(RoundToHalfPrecision(1.0 + 3.0 * std::pow(2.0, -11)) ==
+               1.0 + std::pow(2.0, -9));
+  // Subnormals.
+  KALDI_ASSERT(RoundToHalfPrecision(std::pow(2.0, -24)) == std::pow(2.0, -24));
+  KALDI_ASSERT(RoundToHalfPrecision(std::pow(2.0, -26)) == 0.0);
+  KALDI_ASSERT(RoundToHalfPrecision(3.0 * std::pow(2.0, -25)) ==
+               std::pow(2.0, -23));
+  for (int32 i = 0; i < 100; i++) {
+    BaseFloat x = RandGauss() * 100.0, y = RoundToHalfPrecision(x);
+    KALDI_ASSERT(std::abs(x - y) <= std::abs(x) * std::pow(2.0, -11));
+    KALDI_ASSERT(RoundToHalfPrecision(y) == y);
+  }
+}
+
+static void UnitTestCuHalfMatrixCopy() {
+  for (int32 i = 0; i < 10; i++) {
+    int32 num_rows = RandInt(1, 20), num_cols = RandInt(1, 20);
+    CuMatrix<BaseFloat> M(num_rows, num_cols);
+    M.SetRandn();
+    CuHalfMatrix H(M);
+    CuMatrix<BaseFloat> M2(num_rows, num_cols);
+    H.CopyToMat(&M2);
+    KALDI_ASSERT(M.ApproxEqual(M2, 0.001));
+    // Copying the rounded values again should change nothing.
+    CuHalfMatrix H2;
+    H2.CopyFromMat(M2);
+    CuMatrix<BaseFloat> M3(num_rows, num_cols);
+    H2.CopyToMat(&M3);
+    AssertEqual(M2, M3);
+
+    CuHalfMatrix H3;
+    H3.CopyFromHalfMat(H);
+    H3.CopyToMat(&M3);
+    AssertEqual(M2, M3);
+
+    bool binary = (RandInt(0, 1) == 0);
+    std::ostringstream os;
+    H.Write(os, binary);
+    CuHalfMatrix H4;
+    std::istringstream is(os.str());
+    H4.Read(is, binary);
+    H4.CopyToMat(&M3);
+    AssertEqual(M2, M3);
+  }
+}
+
+static void UnitTestAddMatHalfMat() {
+  for (int32 i = 0; i < 10; i++) {
+    int32 n = RandInt(1, 30), m = RandInt(1, 30), k = RandInt(1, 300);
+    MatrixTransposeType transB = (RandInt(0, 1) == 0 ? kNoTrans : kTrans);
+    CuMatrix<BaseFloat> A(n, k), B(transB == kTrans ? m : k,
+                                   transB == kTrans ? k : m),
+        C(n, m);
+    A.SetRandn();
+    B.SetRandn();
+    C.SetRandn();
+    BaseFloat alpha = 0.5, beta = (RandInt(0, 1) == 0 ? 0.0 : 2.0);
+    CuMatrix<BaseFloat> C2(C);
+    C.AddMatMat(alpha, A, kNoTrans, B, transB, beta);
+    CuHalfMatrix B_half(B);
+    AddMatHalfMat(alpha, A, B_half, transB, beta, &C2);
+    // The inputs are rounded to 11 significant bits.
+    KALDI_ASSERT(C.ApproxEqual(C2, 0.01));
+  }
+}
+
+} // end namespace kaldi.
+
+
+int main() {
+  using namespace kaldi;
+  for (int32 loop = 0; loop < 2; loop++) {
+#if HAVE_CUDA == 1
+    if (loop == 0)
+      CuDevice::Instantiate().SelectGpuId("no");
+    else
+      CuDevice::Instantiate().SelectGpuId("yes");
+#endif
+    UnitTestRoundToHalfPrecision();
+    UnitTestCuHalfMatrixCopy();
+    UnitTestAddMatHalfMat();
+    if (loop == 0)
+      KALDI_LOG << "Tests without GPU use succeeded.";
+    else
+      KALDI_LOG << "Tests with GPU use (if available) succeeded.";
+  }
+#if HAVE_CUDA == 1
+  CuDevice::Instantiate().PrintProfile();
+#endif
+  return 0;
+}
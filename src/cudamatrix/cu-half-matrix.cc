@@ -0,0 +1,236 @@
+// cudamatrix/cu-half-matrix.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#if HAVE_CUDA == 1
+#include <cuda_runtime_api.h>
+#include <cublas_v2.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "base/timer.h"
+#include "cudamatrix/cu-half-matrix.h"
+#include "cudamatrix/cu-common.h"
+#include "cudamatrix/cu-device.h"
+#include "cudamatrix/cu-kernels.h"
+
+namespace kaldi {
+
+BaseFloat RoundToHalfPrecision(BaseFloat x) {
+  if (x == 0.0 || KALDI_ISNAN(x) || KALDI_ISINF(x))
+    return x;
+  double abs_x = std::abs(static_cast<double>(x));
+  int exponent;
+  std::frexp(abs_x, &exponent);  // abs_x = m * 2^exponent, 0.5 <= m < 1.
+  // Normal half-precision numbers have 11 significant bits; below 2^-14 they
+  // are subnormal, with a spacing of 2^-24.
+  int quantum_exponent = std::max(exponent - 11, -24);
+  double scaled = std::ldexp(abs_x, -quantum_exponent),
+      rounded = std::floor(scaled + 0.5);
+  if (rounded - scaled == 0.5 && std::fmod(rounded, 2.0) != 0.0)
+    rounded -= 1.0;  // round ties to even.
+  double ans = std::ldexp(rounded, quantum_exponent);
+  const double max_half = 65504.0;
+  if (ans > max_half)
+    ans = std::numeric_limits<double>::infinity();
+  return static_cast<BaseFloat>(x < 0 ? -ans : ans);
+}
+
+void CuHalfMatrix::Destroy() {
+#if HAVE_CUDA == 1
+  if (data_ != NULL)
+    CuDevice::Instantiate().Free(data_);
+#endif
+  data_ = NULL;
+  mat_.Resize(0, 0);
+  num_rows_ = 0;
+  num_cols_ = 0;
+  stride_ = 0;
+}
+
+void CuHalfMatrix::Resize(MatrixIndexT num_rows, MatrixIndexT num_cols) {
+  KALDI_ASSERT(num_rows >= 0 && num_cols >= 0);
+  if (num_rows == num_rows_ && num_cols == num_cols_)
+    return;
+  Destroy();
+  if (num_rows == 0 || num_cols == 0)
+    return;
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    size_t pitch;
+    data_ = static_cast<uint16*>(CuDevice::Instantiate().MallocPitch(
+        num_cols * sizeof(uint16), num_rows, &pitch));
+    stride_ = pitch / sizeof(uint16);
+  } else
+#endif
+  {
+    mat_.Resize(num_rows, num_cols, kUndefined);
+    stride_ = mat_.Stride();
+  }
+  num_rows_ = num_rows;
+  num_cols_ = num_cols;
+}
+
+void CuHalfMatrix::CopyFromMat(const CuMatrixBase<BaseFloat> &M) {
+  Resize(M.NumRows(), M.NumCols());
+  if (num_rows_ == 0 || num_cols_ == 0)
+    return;
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    CuTimer tim;
+    dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
+    dim3 dimGrid(n_blocks(num_cols_, CU2DBLOCK),
+                 n_blocks(num_rows_, CU2DBLOCK));
+    cuda_copy_to_half(dimGrid, dimBlock, M.Data(), M.Dim(),
+                      reinterpret_cast<half*>(data_), stride_);
+    CU_SAFE_CALL(cudaGetLastError());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
+  } else
+#endif
+  {
+    mat_.CopyFromMat(M.Mat());
+    for (MatrixIndexT r = 0; r < num_rows_; r++) {
+      BaseFloat *row_data = mat_.RowData(r);
+      for (MatrixIndexT c = 0; c < num_cols_; c++)
+        row_data[c] = RoundToHalfPrecision(row_data[c]);
+    }
+  }
+}
+
+void CuHalfMatrix::CopyFromHalfMat(const CuHalfMatrix &M) {
+  Resize(M.NumRows(), M.NumCols());
+  if (num_rows_ == 0 || num_cols_ == 0)
+    return;
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    CuTimer tim;
+    CU_SAFE_CALL(cudaMemcpy2D(data_, stride_ * sizeof(uint16),
+                              M.data_, M.stride_ * sizeof(uint16),
+                              num_cols_ * sizeof(uint16), num_rows_,
+                              cudaMemcpyDeviceToDevice));
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
+  } else
+#endif
+  {
+    mat_.CopyFromMat(M.mat_);
+  }
+}
+
+void CuHalfMatrix::CopyToMat(CuMatrixBase<BaseFloat> *M) const {
+  KALDI_ASSERT(M->NumRows() == num_rows_ && M->NumCols() == num_cols_);
+  if (num_rows_ == 0 || num_cols_ == 0)
+    return;
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    CuTimer tim;
+    dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
+    dim3 dimGrid(n_blocks(num_cols_, CU2DBLOCK),
+                 n_blocks(num_rows_, CU2DBLOCK));
+    cuda_copy_from_half(dimGrid, dimBlock,
+                        reinterpret_cast<const half*>(data_), stride_,
+                        M->Data(), M->Dim());
+    CU_SAFE_CALL(cudaGetLastError());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
+  } else
+#endif
+  {
+    M->Mat().CopyFromMat(mat_);
+  }
+}
+
+void CuHalfMatrix::Swap(CuHalfMatrix *other) {
+  std::swap(num_rows_, other->num_rows_);
+  std::swap(num_cols_, other->num_cols_);
+  std::swap(stride_, other->stride_);
+  std::swap(data_, other->data_);
+  mat_.Swap(&(other->mat_));
+}
+
+void CuHalfMatrix::Write(std::ostream &os, bool binary) const {
+  CuMatrix<BaseFloat> temp(num_rows_, num_cols_, kUndefined);
+  CopyToMat(&temp);
+  temp.Write(os, binary);
+}
+
+void CuHalfMatrix::Read(std::istream &is, bool binary) {
+  CuMatrix<BaseFloat> temp;
+  temp.Read(is, binary);
+  CopyFromMat(temp);
+}
+
+void AddMatHalfMat(BaseFloat alpha, const CuMatrixBase<BaseFloat> &A,
+                   const CuHalfMatrix &B, MatrixTransposeType transB,
+                   BaseFloat beta, CuMatrixBase<BaseFloat> *C) {
+  MatrixIndexT m = (transB == kTrans ? B.NumRows() : B.NumCols()),
+      n = A.NumRows(),
+      k = (transB == kTrans ? B.NumCols() : B.NumRows());
+  KALDI_ASSERT(A.NumCols() == k && C->NumRows() == n && C->NumCols() == m);
+  if (m == 0 || n == 0)
+    return;
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    CuTimer tim;
+    CuHalfMatrix A_half(A);
+    // cuBLAS can only output the product to a single-precision matrix, so if
+    // BaseFloat is double we compute it in a temporary.
+    bool use_temp = (sizeof(BaseFloat) != sizeof(float));
+    CuMatrix<float> C_temp;
+    float *C_data;
+    MatrixIndexT C_stride;
+    if (use_temp) {
+      C_temp.Resize(n, m, kUndefined);
+      if (beta != 0.0)
+        C_temp.CopyFromMat(*C);
+      C_data = C_temp.Data();
+      C_stride = C_temp.Stride();
+    } else {
+      C_data = reinterpret_cast<float*>(C->Data());
+      C_stride = C->Stride();
+    }
+    float alpha_f = alpha, beta_f = beta;
+    // CUBLAS is col-major, cudamatrix is row-major; as in
+    // CuMatrixBase::AddMatMat(), we swap the order of the matrices.
+    cublasOperation_t opB = (transB == kTrans ? CUBLAS_OP_T : CUBLAS_OP_N);
+#if CUDA_VERSION >= 9000
+    CU_SAFE_CALL(cublasGemmEx(GetCublasHandle(), opB, CUBLAS_OP_N, m, n, k,
+                              &alpha_f, B.data_, CUDA_R_16F, B.stride_,
+                              A_half.data_, CUDA_R_16F, A_half.stride_,
+                              &beta_f, C_data, CUDA_R_32F, C_stride,
+                              CUDA_R_32F, CUBLAS_GEMM_DEFAULT_TENSOR_OP));
+#elif CUDA_VERSION >= 8000
+    CU_SAFE_CALL(cublasSgemmEx(GetCublasHandle(), opB, CUBLAS_OP_N, m, n, k,
+                               &alpha_f, B.data_, CUDA_R_16F, B.stride_,
+                               A_half.data_, CUDA_R_16F, A_half.stride_,
+                               &beta_f, C_data, CUDA_R_32F, C_stride));
+#else
+    KALDI_ERR << "Half-precision matrix multiplication requires CUDA 8.0 "
+              << "or later.";
+#endif
+    if (use_temp)
+      C->CopyFromMat(C_temp);
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
+  } else
+#endif
+  {
+    C->Mat().AddMatMat(alpha, A.Mat(), kNoTrans, B.mat_, transB, beta);
+  }
+}
+
+} // end namespace kaldi.
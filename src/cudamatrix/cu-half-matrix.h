@@ -0,0 +1,112 @@
+// cudamatrix/cu-half-matrix.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_CUDAMATRIX_CU_HALF_MATRIX_H_
+#define KALDI_CUDAMATRIX_CU_HALF_MATRIX_H_
+
+#include "base/kaldi-common.h"
+#include "matrix/kaldi-matrix.h"
+#include "cudamatrix/cu-matrix.h"
+
+namespace kaldi {
+
+/**
+   CuHalfMatrix stores a matrix in IEEE 16-bit ("half-precision") floating
+   point.  It's intended for inference on GPUs, where it halves the memory and
+   memory bandwidth that the parameters of a layer need, and it only supports
+   what's needed for that: copying from and to a CuMatrix, and AddMatHalfMat()
+   (below), which multiplies a regular matrix by a CuHalfMatrix using
+   half-precision inputs with single-precision accumulation, on the tensor
+   cores if the GPU has them (this requires CUDA 9.0 or later; CUDA 8.0
+   does the same computation without them).
+
+   If we are not using a GPU, the data is stored in BaseFloat, with each
+   element rounded to the nearest half-precision value, so that the results
+   are close to what we'd get on the GPU; there is no speed advantage in that
+   case.
+*/
+class CuHalfMatrix {
+ public:
+  CuHalfMatrix(): num_rows_(0), num_cols_(0), stride_(0), data_(NULL) { }
+
+  explicit CuHalfMatrix(const CuMatrixBase<BaseFloat> &M):
+      num_rows_(0), num_cols_(0), stride_(0), data_(NULL) { CopyFromMat(M); }
+
+  ~CuHalfMatrix() { Destroy(); }
+
+  MatrixIndexT NumRows() const { return num_rows_; }
+  MatrixIndexT NumCols() const { return num_cols_; }
+
+  /// Resizes to the size of M and copies it, rounding each element to half
+  /// precision.
+  void CopyFromMat(const CuMatrixBase<BaseFloat> &M);
+
+  /// Resizes to the size of M and copies it.
+  void CopyFromHalfMat(const CuHalfMatrix &M);
+
+  /// Copies to M, which must already have the correct size.
+  void CopyToMat(CuMatrixBase<BaseFloat> *M) const;
+
+  void Swap(CuHalfMatrix *other);
+
+  /// Writes in the same format as a regular matrix (i.e. in BaseFloat).
+  void Write(std::ostream &os, bool binary) const;
+
+  /// Reads a regular matrix and rounds it to half precision.
+  void Read(std::istream &is, bool binary);
+
+ private:
+  friend void AddMatHalfMat(BaseFloat alpha, const CuMatrixBase<BaseFloat> &A,
+                            const CuHalfMatrix &B, MatrixTransposeType transB,
+                            BaseFloat beta, CuMatrixBase<BaseFloat> *C);
+
+  // Sets the size, without initializing the data.
+  void Resize(MatrixIndexT num_rows, MatrixIndexT num_cols);
+  void Destroy();
+
+  MatrixIndexT num_rows_;
+  MatrixIndexT num_cols_;
+  // The stride of data_, in elements.
+  MatrixIndexT stride_;
+  // If we are using a GPU, the data in device memory, as 16-bit half-precision
+  // values; else NULL.
+  uint16 *data_;
+  // If we are not using a GPU, the data, rounded to half precision.
+  Matrix<BaseFloat> mat_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(CuHalfMatrix);
+};
+
+/// Does *C = alpha * A * B + beta * *C (or alpha * A * B^T + beta * *C if
+/// transB == kTrans).  If we are using a GPU, A is converted to half
+/// precision, the product is computed by cuBLAS with single-precision
+/// accumulation, and *C is in single precision (if BaseFloat is double, via a
+/// temporary).  Otherwise it's an ordinary matrix multiplication with the
+/// rounded values of B.
+void AddMatHalfMat(BaseFloat alpha, const CuMatrixBase<BaseFloat> &A,
+                   const CuHalfMatrix &B, MatrixTransposeType transB,
+                   BaseFloat beta, CuMatrixBase<BaseFloat> *C);
+
+/// Returns the IEEE half-precision value nearest to x (with ties rounded to
+/// even, and out-of-range values to infinity), as a BaseFloat.
+BaseFloat RoundToHalfPrecision(BaseFloat x);
+
+} // end namespace kaldi.
+
+#endif
@@ -30,6 +30,8 @@
 #include "cudamatrix/cu-matrixdim.h"
 
 #if HAVE_CUDA == 1
+#include <cuda_fp16.h>
+
 extern "C" {
 
 /*********************************************************
@@ -55,6 +57,10 @@ void cudaF_copy_from_tp_trans(dim3 Gr, dim3 Bl, float* A, const float* B, Matrix
 void cudaFD_copy_from_tp_trans(dim3 Gr, dim3 Bl, float* A, const double* B, MatrixDim dmat);
 void cudaF_copy_from_tp(dim3 Gr, dim3 Bl, float* A, const float* B, MatrixDim dmat);
 void cudaFD_copy_from_tp(dim3 Gr, dim3 Bl, float* A, const double* B, MatrixDim dmat);
+void cudaF_copy_to_half(dim3 Gr, dim3 Bl, const float* src, MatrixDim d, half* dst, int dst_stride);
+void cudaF_copy_from_half(dim3 Gr, dim3 Bl, const half* src, int src_stride, float* dst, MatrixDim d);
+void cudaF_uncompress_col_header(dim3 Gr, dim3 Bl, const unsigned short* col_headers, const unsigned char* byte_data, float min_value, float range, int num_rows, int num_cols, float* dst, int dst_stride, bool transpose);
+void cudaF_uncompress_uint16(dim3 Gr, dim3 Bl, const unsigned short* data, float min_value, float range, int num_rows, int num_cols, float* dst, int dst_stride, bool transpose);
 void cudaF_copy_col_from_vec(int Gr, int Bl, float* mat, const float* v, int col, MatrixDim d);
 void cudaF_apply_exp(dim3 Gr, dim3 Bl, float* mat, MatrixDim d);
 void cudaF_apply_pow(dim3 Gr, dim3 Bl, float* mat, float power, MatrixDim d);
@@ -139,6 +145,7 @@ void cudaF_block_add_mat_mat(dim3 Gr, dim3 Bl, CuBlockMatrixData *B_cu_data, int
  */
 void cudaF_softmax_reduce(size_t Gr, size_t Bl, float *y, const float *x, MatrixDim d, int src_stride);
 void cudaF_log_softmax_reduce(size_t Gr, size_t Bl, float *y, const float *x, MatrixDim d, int src_stride);
+void cudaF_scaled_log_softmax_reduce(size_t Gr, size_t Bl, float *y, const float *x, const float *log_priors, float scale, MatrixDim d, int src_stride);
 void cudaF_soft_hinge(dim3 Gr, dim3 Bl, float *y, const float *x, MatrixDim d, int src_stride);
 void cudaF_group_pnorm(dim3 Gr, dim3 Bl, float *y, const float *x, MatrixDim d, int src_stride, int group_size, float power);
 void cudaF_group_max(dim3 Gr, dim3 Bl, float *y, const float *x, MatrixDim d, int src_stride, int group_size);
@@ -152,6 +159,8 @@ void cudaF_find_row_max_id(dim3 Gr, dim3 Bl, const float *mat, float *vec_val, i
 void cudaF_diff_xent(dim3 Gr, dim3 Bl, const int32_cuda *vec_tgt, float *mat_net_out, float *vec_log_post, MatrixDim d);
 void cudaF_copy_rows_from_vec(dim3 Gr, dim3 Bl, float *mat_out, MatrixDim d_out, const float *v_in);
 
+void cudaF_lstm_step(dim3 Gr, dim3 Bl, float *y, MatrixDim y_dim, const float *c_prev, int c_prev_stride, const float *pi, const float *pf, const float *po);
+void cudaF_lstm_step_backprop(dim3 Gr, dim3 Bl, const float *y, int y_stride, const float *c_prev, int c_prev_stride, const float *next_y, int next_y_stride, const float *next_d, int next_d_stride, const float *pi, const float *pf, const float *po, float *d, MatrixDim d_dim);
 void cudaF_randomize(dim3 Gr, dim3 Bl, float *y, const float *x, const int32_cuda *copy_from, MatrixDim d_out, MatrixDim d_in);
 void cudaF_splice(dim3 Gr, dim3 Bl, float *y, const float *x, const int32_cuda *off, MatrixDim d_out, MatrixDim d_in);
 void cudaF_one(int Gr, int Bl, float* x, int dim);
@@ -196,6 +205,10 @@ void cudaD_copy_from_tp_trans(dim3 Gr, dim3 Bl, double* A, const double* B, Matr
 void cudaDF_copy_from_tp_trans(dim3 Gr, dim3 Bl, double* A, const float* B, MatrixDim dmat);
 void cudaD_copy_from_tp(dim3 Gr, dim3 Bl, double* A, const double* B, MatrixDim dmat);
 void cudaDF_copy_from_tp(dim3 Gr, dim3 Bl, double* A, const float* B, MatrixDim dmat);
+void cudaD_copy_to_half(dim3 Gr, dim3 Bl, const double* src, MatrixDim d, half* dst, int dst_stride);
+void cudaD_copy_from_half(dim3 Gr, dim3 Bl, const half* src, int src_stride, double* dst, MatrixDim d);
+void cudaD_uncompress_col_header(dim3 Gr, dim3 Bl, const unsigned short* col_headers, const unsigned char* byte_data, float min_value, float range, int num_rows, int num_cols, double* dst, int dst_stride, bool transpose);
+void cudaD_uncompress_uint16(dim3 Gr, dim3 Bl, const unsigned short* data, float min_value, float range, int num_rows, int num_cols, double* dst, int dst_stride, bool transpose);
 void cudaD_copy_col_from_vec(int Gr, int Bl, double* mat, const double* v, int col, MatrixDim d);
 void cudaD_apply_exp(dim3 Gr, dim3 Bl, double* mat, MatrixDim d);
 void cudaD_apply_pow(dim3 Gr, dim3 Bl, double* mat, double power, MatrixDim d);
@@ -283,6 +296,7 @@ void cudaD_block_add_mat_mat(dim3 Gr, dim3 Bl, CuBlockMatrixData *B_cu_data, int
  */
 void cudaD_softmax_reduce(size_t Gr, size_t Bl, double *y, const double *x, MatrixDim d, int src_stride);
 void cudaD_log_softmax_reduce(size_t Gr, size_t Bl, double *y, const double *x, MatrixDim d, int src_stride);
+void cudaD_scaled_log_softmax_reduce(size_t Gr, size_t Bl, double *y, const double *x, const double *log_priors, double scale, MatrixDim d, int src_stride);
 void cudaD_soft_hinge(dim3 Gr, dim3 Bl, double *y, const double *x, MatrixDim d, int src_stride);
 void cudaD_group_pnorm(dim3 Gr, dim3 Bl, double *y, const double *x, MatrixDim d, int src_stride, int group_size, double power);
 void cudaD_group_max(dim3 Gr, dim3 Bl, double *y, const double *x, MatrixDim d, int src_stride, int group_size);
@@ -296,6 +310,8 @@ void cudaD_find_row_max_id(dim3 Gr, dim3 Bl, const double *mat, double *vec_val,
 void cudaD_diff_xent(dim3 Gr, dim3 Bl, const int32_cuda *vec_tgt, double *mat_net_out, double *vec_log_post, MatrixDim d);
 void cudaD_copy_rows_from_vec(dim3 Gr, dim3 Bl, double *mat_out, MatrixDim d_out, const double *v_in);
 
+void cudaD_lstm_step(dim3 Gr, dim3 Bl, double *y, MatrixDim y_dim, const double *c_prev, int c_prev_stride, const double *pi, const double *pf, const double *po);
+void cudaD_lstm_step_backprop(dim3 Gr, dim3 Bl, const double *y, int y_stride, const double *c_prev, int c_prev_stride, const double *next_y, int next_y_stride, const double *next_d, int next_d_stride, const double *pi, const double *pf, const double *po, double *d, MatrixDim d_dim);
 void cudaD_randomize(dim3 Gr, dim3 Bl, double *y, const double *x, const int32_cuda *copy_from, MatrixDim d_out, MatrixDim d_in);
 void cudaD_splice(dim3 Gr, dim3 Bl, double *y, const double *x, const int32_cuda *off, MatrixDim d_out, MatrixDim d_in);
 void cudaD_one(int Gr, int Bl, double* x, int dim);
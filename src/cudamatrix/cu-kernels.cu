@@ -25,6 +25,7 @@
 // In this file is the CUDA code of the CUDA kernels, plus the ANSI-C wrappers
 
 #include <cfloat>
+#include <cuda_fp16.h>
 #include "cudamatrix/cu-kernels-ansi.h"
 
 
@@ -135,6 +136,130 @@ static int32_cuda _max_id_reduce(Real val[], int32_cuda idx[]) {
 }
 
 
+// Merges the softmax statistics (max, sum) of one set of elements with those
+// of another, where "sum" is the sum of exp(x - max) over the set.  A set with
+// sum == 0 is empty (a nonempty set always has sum >= 1), so we don't need to
+// represent -infinity.
+template<typename Real>
+__device__
+static inline void _softmax_stats_merge(Real *max, Real *sum,
+                                        Real other_max, Real other_sum) {
+  if (other_sum == 0) return;
+  if (*sum == 0) {
+    *max = other_max;
+    *sum = other_sum;
+  } else if (other_max > *max) {
+    *sum = *sum * exp(*max - other_max) + other_sum;
+    *max = other_max;
+  } else {
+    *sum += other_sum * exp(other_max - *max);
+  }
+}
+
+#if __CUDA_ARCH__ >= 300
+// Shuffles for float and double (older toolkits have no double overload).
+__device__
+static inline float _shfl_down(float value, int delta) {
+#if CUDART_VERSION >= 9000
+  return __shfl_down_sync(0xffffffff, value, delta);
+#else
+  return __shfl_down(value, delta);
+#endif
+}
+__device__
+static inline double _shfl_down(double value, int delta) {
+  int hi = __double2hiint(value), lo = __double2loint(value);
+#if CUDART_VERSION >= 9000
+  hi = __shfl_down_sync(0xffffffff, hi, delta);
+  lo = __shfl_down_sync(0xffffffff, lo, delta);
+#else
+  hi = __shfl_down(hi, delta);
+  lo = __shfl_down(lo, delta);
+#endif
+  return __hiloint2double(hi, lo);
+}
+
+// Reduces the softmax statistics across the 32 threads of a warp; the result
+// is valid in lane 0.
+template<typename Real>
+__device__
+static inline void _softmax_stats_warp_reduce(Real *max, Real *sum) {
+  for (int delta = 16; delta > 0; delta >>= 1) {
+    Real other_max = _shfl_down(*max, delta),
+        other_sum = _shfl_down(*sum, delta);
+    _softmax_stats_merge(max, sum, other_max, other_sum);
+  }
+}
+#endif
+
+// Computes, for the row x of dimension "dim", the max element and the sum of
+// exp(x - max), in a single pass over the row: each thread keeps a running
+// max and rescales its running sum whenever the max changes.  All threads of
+// the block must call this, and all of them get the result.  On devices with
+// warp shuffles, the per-thread statistics are reduced within each warp
+// without going through shared memory, so blockDim.x must be a multiple of 32
+// (and at most CU1DBLOCK).
+template<typename Real>
+__device__
+static void _softmax_row_stats(const Real *x, int dim,
+                               Real *max_out, Real *sum_out) {
+  Real max = 0, sum = 0;
+  for (int i = threadIdx.x; i < dim; i += blockDim.x) {
+    Real v = x[i];
+    if (sum == 0) {
+      max = v;
+      sum = 1;
+    } else if (v > max) {
+      sum = sum * exp(max - v) + 1;
+      max = v;
+    } else {
+      sum += exp(v - max);
+    }
+  }
+#if __CUDA_ARCH__ >= 300
+  __shared__ Real warp_max[CU1DBLOCK / 32], warp_sum[CU1DBLOCK / 32];
+  int lane = threadIdx.x % 32, warp = threadIdx.x / 32,
+      num_warps = blockDim.x / 32;
+  _softmax_stats_warp_reduce(&max, &sum);
+  if (lane == 0) {
+    warp_max[warp] = max;
+    warp_sum[warp] = sum;
+  }
+  __syncthreads();
+  if (warp == 0) {
+    max = (lane < num_warps ? warp_max[lane] : 0);
+    sum = (lane < num_warps ? warp_sum[lane] : 0);
+    _softmax_stats_warp_reduce(&max, &sum);
+    if (lane == 0) {
+      warp_max[0] = max;
+      warp_sum[0] = sum;
+    }
+  }
+  __syncthreads();
+  *max_out = warp_max[0];
+  *sum_out = warp_sum[0];
+#else
+  __shared__ Real aux_max[CU1DBLOCK], aux_sum[CU1DBLOCK];
+  aux_max[threadIdx.x] = max;
+  aux_sum[threadIdx.x] = sum;
+  int nTotalThreads = blockDim.x;
+  __syncthreads();
+  while (nTotalThreads > 1) {
+    int halfPoint = ((1 + nTotalThreads) >> 1);
+    if (threadIdx.x < halfPoint && threadIdx.x + halfPoint < nTotalThreads) {
+      _softmax_stats_merge(&(aux_max[threadIdx.x]), &(aux_sum[threadIdx.x]),
+                           aux_max[threadIdx.x + halfPoint],
+                           aux_sum[threadIdx.x + halfPoint]);
+    }
+    __syncthreads();
+    nTotalThreads = ((1 + nTotalThreads) >> 1);
+  }
+  *max_out = aux_max[0];
+  *sum_out = aux_sum[0];
+#endif
+}
+
+
 
 
 /***********************************************************************
@@ -226,6 +351,86 @@ static void _copy_from_tp_trans(Real* A, const OtherReal* B, MatrixDim dmat) {
 }
 
 
+// The x-dim is the col-index, the y-dim is the row-index; "dst" has
+// the same dimensions as "src", with stride "dst_stride".
+template<typename Real>
+__global__
+static void _copy_to_half(const Real* src, MatrixDim d, half* dst,
+                          int dst_stride) {
+  int32_cuda i = blockIdx.x * blockDim.x + threadIdx.x;
+  int32_cuda j = blockIdx.y * blockDim.y + threadIdx.y;
+  if (i < d.cols && j < d.rows)
+    dst[j * dst_stride + i] = __float2half(static_cast<float>(src[j * d.stride + i]));
+}
+
+
+template<typename Real>
+__global__
+static void _copy_from_half(const half* src, int src_stride, Real* dst,
+                            MatrixDim d) {
+  int32_cuda i = blockIdx.x * blockDim.x + threadIdx.x;
+  int32_cuda j = blockIdx.y * blockDim.y + threadIdx.y;
+  if (i < d.cols && j < d.rows)
+    dst[j * d.stride + i] = __half2float(src[j * src_stride + i]);
+}
+
+
+// Decompresses a matrix in the CompressedMatrix format where each column has
+// a header with four quantiles, stored as uint16, and each element is a byte
+// that interpolates between them (see CompressedMatrix::CharToFloat()).  The
+// bytes are stored column by column.  The x-dim is the column index, the y-dim
+// the row index (of the compressed matrix; if "transpose" is true, element
+// (r, c) goes to dst[c * dst_stride + r]).
+template<typename Real>
+__global__
+static void _uncompress_col_header(const unsigned short *col_headers,
+                                   const unsigned char *byte_data,
+                                   float min_value, float range,
+                                   int num_rows, int num_cols,
+                                   Real *dst, int dst_stride, bool transpose) {
+  int32_cuda i = blockIdx.x * blockDim.x + threadIdx.x;
+  int32_cuda j = blockIdx.y * blockDim.y + threadIdx.y;
+  if (i >= num_cols || j >= num_rows) return;
+  // the constant 1.52590218966964e-05 is 1/65535.
+  float increment = range * 1.52590218966964e-05F;
+  const unsigned short *h = col_headers + 4 * i;
+  float p0 = min_value + increment * h[0],
+      p25 = min_value + increment * h[1],
+      p75 = min_value + increment * h[2],
+      p100 = min_value + increment * h[3];
+  unsigned char value = byte_data[i * num_rows + j];
+  float f;
+  if (value <= 64)
+    f = p0 + (p25 - p0) * value * (1/64.0f);
+  else if (value <= 192)
+    f = p25 + (p75 - p25) * (value - 64) * (1/128.0f);
+  else
+    f = p75 + (p100 - p75) * (value - 192) * (1/63.0f);
+  if (transpose)
+    dst[i * dst_stride + j] = f;
+  else
+    dst[j * dst_stride + i] = f;
+}
+
+// Decompresses a matrix in the CompressedMatrix format where each element is
+// a uint16, stored row by row.  Indexing is as for _uncompress_col_header.
+template<typename Real>
+__global__
+static void _uncompress_uint16(const unsigned short *data,
+                               float min_value, float range,
+                               int num_rows, int num_cols,
+                               Real *dst, int dst_stride, bool transpose) {
+  int32_cuda i = blockIdx.x * blockDim.x + threadIdx.x;
+  int32_cuda j = blockIdx.y * blockDim.y + threadIdx.y;
+  if (i >= num_cols || j >= num_rows) return;
+  float f = min_value + range * 1.52590218966964e-05F * data[j * num_cols + i];
+  if (transpose)
+    dst[i * dst_stride + j] = f;
+  else
+    dst[j * dst_stride + i] = f;
+}
+
+
 // for this kernel, following the newer pattern, the x-dim is the row-index, the
 // y-dim is the col-index.
 template<typename Real, typename OtherReal>
@@ -1834,145 +2039,54 @@ static void _diff_tanh(Real*eout, const Real*e, const Real*y, MatrixDim d, int e
     eout[dst_index] = (1.0 - y[y_index]*y[y_index]) * e[e_index];
 }
 
+// Softmax of each row; one block per row.  The row is read twice (once for the
+// statistics, once to write the output) and the output written once.
 template<typename Real>
 __global__
 static void _softmax_reduce(Real*y, const Real*x, MatrixDim d, int src_stride) {
   int j = blockIdx.x;
-  int THREADS = blockDim.x;
   if (j >= d.rows) return;
-
-  __shared__ Real aux[CU1DBLOCK];
-  int steps = (d.cols - 1) / THREADS + 1;
-
-  //copy input to aux
-  aux[threadIdx.x] = x[threadIdx.x+j*d.stride];
-  for(int i=1; i<steps; ++i) {
-    if(threadIdx.x+i*THREADS < d.cols && aux[threadIdx.x] < x[threadIdx.x+i*THREADS+j*d.stride])
-	aux[threadIdx.x] = x[threadIdx.x+i*THREADS+j*d.stride];
-  }
-
-  //get the maximum value
-  int nTotalThreads = THREADS;
-  __syncthreads();
-  while(nTotalThreads > 1) {
-    int halfPoint = ((1+nTotalThreads) >> 1);   // divide by two
-    // only the first half of the threads will be active.
-    if (threadIdx.x < halfPoint)  {
-      // Get the shared value stored by another thread
-      if(threadIdx.x+halfPoint < nTotalThreads && aux[threadIdx.x] < aux[threadIdx.x+halfPoint])
-        aux[threadIdx.x] = aux[threadIdx.x + halfPoint];
-    }
-    __syncthreads();
-    nTotalThreads = ((1+nTotalThreads) >> 1);   // divide by two.
-  }
-  Real max = aux[0];
-  __syncthreads();
-
-   // subtract max, apply exp, sum up...
-  y[threadIdx.x+j*d.stride] = exp(x[threadIdx.x+j*d.stride] - max);
-  aux[threadIdx.x] = y[threadIdx.x+j*d.stride];
-  for(int i=1; i<steps; i++) {
-    if(threadIdx.x+i*THREADS < d.cols) {
-      y[threadIdx.x+i*THREADS+j*d.stride] = exp(x[threadIdx.x+i*THREADS+j*d.stride] - max);
-      aux[threadIdx.x] += y[threadIdx.x+i*THREADS+j*d.stride];
-    }
-  }
-  nTotalThreads = THREADS;
-  __syncthreads();
-  while(nTotalThreads > 1) {
-    int halfPoint = ((1+nTotalThreads) >> 1);   // divide by two
-    // only the first half of the threads will be active.
-    if (threadIdx.x < halfPoint)  {
-      // Get the shared value stored by another thread
-      if(threadIdx.x+halfPoint < nTotalThreads)
-        aux[threadIdx.x] += aux[threadIdx.x + halfPoint];
-    }
-    __syncthreads();
-    nTotalThreads = ((1+nTotalThreads) >> 1);   // divide by two.
-  }
-  Real sum = aux[0];
-  __syncthreads();
-
-  //normalize by sum...
-  for(int i=0; i<steps; i++) {
-    if(threadIdx.x+i*THREADS < d.cols) {
-      y[threadIdx.x+i*THREADS+j*d.stride] = y[threadIdx.x+i*THREADS+j*d.stride] / sum;
-    }
-  }
-
+  const Real *x_row = x + j * src_stride;
+  Real *y_row = y + j * d.stride;
+  Real max, sum;
+  _softmax_row_stats(x_row, d.cols, &max, &sum);
+  Real inv_sum = 1.0 / sum;
+  for (int i = threadIdx.x; i < d.cols; i += blockDim.x)
+    y_row[i] = exp(x_row[i] - max) * inv_sum;
 }
 
+// Log-softmax of each row; see _softmax_reduce.
 template<typename Real>
 __global__
 static void _log_softmax_reduce(Real *y, const Real *x,
                                 MatrixDim d, int src_stride) {
   int j = blockIdx.x;
-  int THREADS = blockDim.x;
   if (j >= d.rows) return;
-
-  __shared__ Real aux[CU1DBLOCK];
-  int steps = (d.cols - 1) / THREADS + 1;
-
-  // Maximum step 1: loads input data to <aux>. If <d.cols> is larger than
-  //                 <blockDim.x>, then we do a first pass filtering and only
-  //                 keep a <blockDim.x> size array.
-  aux[threadIdx.x] = x[threadIdx.x + j * d.stride];
-  for (int i = 1; i < steps; ++i) {
-    if (threadIdx.x + i * THREADS < d.cols
-        && aux[threadIdx.x] < x[threadIdx.x + i * THREADS + j * d.stride])
-      aux[threadIdx.x] = x[threadIdx.x + i * THREADS + j * d.stride];
-  }
-
-  // Maximum step 2: the standard max reduce.
-  int nTotalThreads = THREADS;
-  __syncthreads();
-  while (nTotalThreads > 1) {
-    int halfPoint = ((1 + nTotalThreads) >> 1);
-    if (threadIdx.x < halfPoint) {
-      if (threadIdx.x + halfPoint < nTotalThreads
-          && aux[threadIdx.x] < aux[threadIdx.x + halfPoint])
-        aux[threadIdx.x] = aux[threadIdx.x + halfPoint];
-    }
-    __syncthreads();
-    nTotalThreads = ((1 + nTotalThreads) >> 1);
-  }
-  Real max = aux[0];
-  __syncthreads();
-
-  // Log sum step 1: substracts max, and takes exponentials.
-  y[threadIdx.x + j * d.stride] = x[threadIdx.x + j * d.stride] - max;
-  aux[threadIdx.x] = exp(y[threadIdx.x + j * d.stride]);
-  for (int i = 1; i < steps; ++i) {
-    if (threadIdx.x + i * THREADS < d.cols) {
-      y[threadIdx.x + i * THREADS + j * d.stride] =
-        x[threadIdx.x + i * THREADS + j * d.stride] - max;
-      aux[threadIdx.x] += exp(y[threadIdx.x + i * THREADS + j * d.stride]);
-    }
-  }
-
-  // Log sum step 2: comptes summation and then takes logarithm.
-  nTotalThreads = THREADS;
-  __syncthreads();
-  while (nTotalThreads > 1) {
-    int halfPoint = ((1 + nTotalThreads) >> 1);
-    if (threadIdx.x < halfPoint)  {
-      if (threadIdx.x + halfPoint < nTotalThreads)
-        aux[threadIdx.x] += aux[threadIdx.x + halfPoint];
-    }
-    __syncthreads();
-    nTotalThreads = ((1 + nTotalThreads) >> 1);
-  }
-  Real log_sum = log(aux[0]);
-  __syncthreads();
-
-  // Computes log softmax.
-  for (int i = 0; i < steps; ++i) {
-    if (threadIdx.x + i * THREADS < d.cols) {
-      y[threadIdx.x + i * THREADS + j * d.stride] -= log_sum;
-    }
-  }
+  const Real *x_row = x + j * src_stride;
+  Real *y_row = y + j * d.stride;
+  Real max, sum;
+  _softmax_row_stats(x_row, d.cols, &max, &sum);
+  Real log_sum = max + log(sum);
+  for (int i = threadIdx.x; i < d.cols; i += blockDim.x)
+    y_row[i] = x_row[i] - log_sum;
 }
 
+// y = scale * (log-softmax(x) - log_priors), per row.
+template<typename Real>
+__global__
+static void _scaled_log_softmax_reduce(Real *y, const Real *x,
+                                       const Real *log_priors, Real scale,
+                                       MatrixDim d, int src_stride) {
+  int j = blockIdx.x;
+  if (j >= d.rows) return;
+  const Real *x_row = x + j * src_stride;
+  Real *y_row = y + j * d.stride;
+  Real max, sum;
+  _softmax_row_stats(x_row, d.cols, &max, &sum);
+  Real log_sum = max + log(sum);
+  for (int i = threadIdx.x; i < d.cols; i += blockDim.x)
+    y_row[i] = scale * (x_row[i] - log_sum - log_priors[i]);
+}
 
 template<typename Real>
 __global__
@@ -2067,6 +2181,68 @@ static void _copy(Real* y, const Real* x, const int32_cuda* copy_from, MatrixDim
   }
 }
 
+template<typename Real>
+__global__
+static void _lstm_step(Real* y, MatrixDim y_dim, const Real* c_prev,
+                       int c_prev_stride, const Real* pi, const Real* pf,
+                       const Real* po) {
+  int32_cuda j = blockIdx.x * blockDim.x + threadIdx.x;
+  int32_cuda r = blockIdx.y * blockDim.y + threadIdx.y;
+  if (j < y_dim.cols && r < y_dim.rows) {
+    int32_cuda C = y_dim.cols;
+    Real *g = y + r * y_dim.stride + j, *i = g + C, *f = i + C, *o = f + C,
+        *c = o + C, *h = c + C, *m = h + C;
+    Real cp = c_prev[r * c_prev_stride + j];
+    Real i_j = 1.0 / (1.0 + exp(-(*i + pi[j] * cp))),
+        f_j = 1.0 / (1.0 + exp(-(*f + pf[j] * cp))),
+        g_j = tanh(*g);
+    Real c_j = g_j * i_j + cp * f_j;
+    c_j = (c_j < -50.0 ? -50.0 : (c_j > 50.0 ? 50.0 : c_j));
+    Real h_j = tanh(c_j),
+        o_j = 1.0 / (1.0 + exp(-(*o + po[j] * c_j)));
+    *g = g_j;
+    *i = i_j;
+    *f = f_j;
+    *c = c_j;
+    *h = h_j;
+    *o = o_j;
+    *m = h_j * o_j;
+  }
+}
+
+template<typename Real>
+__global__
+static void _lstm_step_backprop(const Real* y, int y_stride,
+                                const Real* c_prev, int c_prev_stride,
+                                const Real* next_y, int next_y_stride,
+                                const Real* next_d, int next_d_stride,
+                                const Real* pi, const Real* pf,
+                                const Real* po, Real* d, MatrixDim d_dim) {
+  int32_cuda j = blockIdx.x * blockDim.x + threadIdx.x;
+  int32_cuda r = blockIdx.y * blockDim.y + threadIdx.y;
+  if (j < d_dim.cols && r < d_dim.rows) {
+    int32_cuda C = d_dim.cols;
+    const Real *y_row = y + r * y_stride + j,
+        *next_d_row = next_d + r * next_d_stride + j;
+    Real y_g = y_row[0], y_i = y_row[C], y_f = y_row[2 * C],
+        y_o = y_row[3 * C], y_h = y_row[5 * C],
+        cp = c_prev[r * c_prev_stride + j],
+        next_y_f = next_y[r * next_y_stride + 2 * C + j];
+    Real *d_row = d + r * d_dim.stride + j;
+    Real d_m = d_row[6 * C],
+        d_h = d_m * y_o * (1.0 - y_h * y_h),
+        d_o = d_m * y_h * y_o * (1.0 - y_o),
+        d_c = d_h + next_d_row[4 * C] * next_y_f + next_d_row[C] * pi[j] +
+        next_d_row[2 * C] * pf[j] + d_o * po[j];
+    d_row[5 * C] = d_h;
+    d_row[4 * C] = d_c;
+    d_row[3 * C] = d_o;
+    d_row[2 * C] = d_c * cp * y_f * (1.0 - y_f);
+    d_row[C] = d_c * y_g * y_i * (1.0 - y_i);
+    d_row[0] = d_c * y_i * (1.0 - y_g * y_g);
+  }
+}
+
 template<typename Real>
 __global__
 static void _one(Real* x, int dim) {
@@ -2209,6 +2385,19 @@ void cudaFD_copy_from_tp(dim3 Gr, dim3 Bl, float* A, const double* B, MatrixDim
   _copy_from_tp<<<Gr,Bl>>>(A,B,dmat);
 }
 
+void cudaF_copy_to_half(dim3 Gr, dim3 Bl, const float* src, MatrixDim d, half* dst, int dst_stride) {
+  _copy_to_half<<<Gr,Bl>>>(src,d,dst,dst_stride);
+}
+void cudaF_copy_from_half(dim3 Gr, dim3 Bl, const half* src, int src_stride, float* dst, MatrixDim d) {
+  _copy_from_half<<<Gr,Bl>>>(src,src_stride,dst,d);
+}
+void cudaF_uncompress_col_header(dim3 Gr, dim3 Bl, const unsigned short* col_headers, const unsigned char* byte_data, float min_value, float range, int num_rows, int num_cols, float* dst, int dst_stride, bool transpose) {
+  _uncompress_col_header<<<Gr,Bl>>>(col_headers,byte_data,min_value,range,num_rows,num_cols,dst,dst_stride,transpose);
+}
+void cudaF_uncompress_uint16(dim3 Gr, dim3 Bl, const unsigned short* data, float min_value, float range, int num_rows, int num_cols, float* dst, int dst_stride, bool transpose) {
+  _uncompress_uint16<<<Gr,Bl>>>(data,min_value,range,num_rows,num_cols,dst,dst_stride,transpose);
+}
+
 
 void cudaF_copy_col_from_vec(int Gr, int Bl, float* mat, const float* v, int col, MatrixDim d) {
   _copy_col_from_vec<<<Gr,Bl>>>(mat,v,col,d);
@@ -2566,6 +2755,10 @@ void cudaF_log_softmax_reduce (size_t Gr, size_t Bl, float* y, const float* x, M
   _log_softmax_reduce<<<Gr,Bl>>>(y, x, d, src_stride);
 }
 
+void cudaF_scaled_log_softmax_reduce(size_t Gr, size_t Bl, float* y, const float* x, const float* log_priors, float scale, MatrixDim d, int src_stride) {
+  _scaled_log_softmax_reduce<<<Gr,Bl>>>(y, x, log_priors, scale, d, src_stride);
+}
+
 void cudaF_splice(dim3 Gr, dim3 Bl, float* y, const float* x, const int32_cuda* off, MatrixDim d_out, MatrixDim d_in) {
   _splice<<<Gr,Bl>>>(y,x,off,d_out,d_in);
 }
@@ -2594,6 +2787,14 @@ void cudaF_copy(dim3 Gr, dim3 Bl, float* y, const float* x, const int32_cuda* co
   _copy<<<Gr,Bl>>>(y,x,copy_from,d_out,d_in);
 }
 
+void cudaF_lstm_step(dim3 Gr, dim3 Bl, float* y, MatrixDim y_dim, const float* c_prev, int c_prev_stride, const float* pi, const float* pf, const float* po) {
+  _lstm_step<<<Gr,Bl>>>(y,y_dim,c_prev,c_prev_stride,pi,pf,po);
+}
+
+void cudaF_lstm_step_backprop(dim3 Gr, dim3 Bl, const float* y, int y_stride, const float* c_prev, int c_prev_stride, const float* next_y, int next_y_stride, const float* next_d, int next_d_stride, const float* pi, const float* pf, const float* po, float* d, MatrixDim d_dim) {
+  _lstm_step_backprop<<<Gr,Bl>>>(y,y_stride,c_prev,c_prev_stride,next_y,next_y_stride,next_d,next_d_stride,pi,pf,po,d,d_dim);
+}
+
 void cudaF_randomize(dim3 Gr, dim3 Bl, float* y, const float* x, const int32_cuda* copy_from, MatrixDim d_out, MatrixDim d_in) {
   _randomize<<<Gr,Bl>>>(y,x,copy_from,d_out,d_in);
 }
@@ -2681,6 +2882,19 @@ void cudaDF_copy_from_tp(dim3 Gr, dim3 Bl, double* A, const float* B, MatrixDim
   _copy_from_tp<<<Gr,Bl>>>(A,B,dmat);
 }
 
+void cudaD_copy_to_half(dim3 Gr, dim3 Bl, const double* src, MatrixDim d, half* dst, int dst_stride) {
+  _copy_to_half<<<Gr,Bl>>>(src,d,dst,dst_stride);
+}
+void cudaD_copy_from_half(dim3 Gr, dim3 Bl, const half* src, int src_stride, double* dst, MatrixDim d) {
+  _copy_from_half<<<Gr,Bl>>>(src,src_stride,dst,d);
+}
+void cudaD_uncompress_col_header(dim3 Gr, dim3 Bl, const unsigned short* col_headers, const unsigned char* byte_data, float min_value, float range, int num_rows, int num_cols, double* dst, int dst_stride, bool transpose) {
+  _uncompress_col_header<<<Gr,Bl>>>(col_headers,byte_data,min_value,range,num_rows,num_cols,dst,dst_stride,transpose);
+}
+void cudaD_uncompress_uint16(dim3 Gr, dim3 Bl, const unsigned short* data, float min_value, float range, int num_rows, int num_cols, double* dst, int dst_stride, bool transpose) {
+  _uncompress_uint16<<<Gr,Bl>>>(data,min_value,range,num_rows,num_cols,dst,dst_stride,transpose);
+}
+
 
 void cudaD_copy_col_from_vec(int Gr, int Bl, double* mat, const double* v, int col, MatrixDim d) {
   _copy_col_from_vec<<<Gr,Bl>>>(mat,v,col,d);
@@ -3038,6 +3252,10 @@ void cudaD_log_softmax_reduce (size_t Gr, size_t Bl, double* y, const double* x,
   _log_softmax_reduce<<<Gr,Bl>>>(y, x, d, src_stride);
 }
 
+void cudaD_scaled_log_softmax_reduce(size_t Gr, size_t Bl, double* y, const double* x, const double* log_priors, double scale, MatrixDim d, int src_stride) {
+  _scaled_log_softmax_reduce<<<Gr,Bl>>>(y, x, log_priors, scale, d, src_stride);
+}
+
 void cudaD_splice(dim3 Gr, dim3 Bl, double* y, const double* x, const int32_cuda* off, MatrixDim d_out, MatrixDim d_in) {
   _splice<<<Gr,Bl>>>(y,x,off,d_out,d_in);
 }
@@ -3066,6 +3284,14 @@ void cudaD_copy(dim3 Gr, dim3 Bl, double* y, const double* x, const int32_cuda*
   _copy<<<Gr,Bl>>>(y,x,copy_from,d_out,d_in);
 }
 
+void cudaD_lstm_step(dim3 Gr, dim3 Bl, double* y, MatrixDim y_dim, const double* c_prev, int c_prev_stride, const double* pi, const double* pf, const double* po) {
+  _lstm_step<<<Gr,Bl>>>(y,y_dim,c_prev,c_prev_stride,pi,pf,po);
+}
+
+void cudaD_lstm_step_backprop(dim3 Gr, dim3 Bl, const double* y, int y_stride, const double* c_prev, int c_prev_stride, const double* next_y, int next_y_stride, const double* next_d, int next_d_stride, const double* pi, const double* pf, const double* po, double* d, MatrixDim d_dim) {
+  _lstm_step_backprop<<<Gr,Bl>>>(y,y_stride,c_prev,c_prev_stride,next_y,next_y_stride,next_d,next_d_stride,pi,pf,po,d,d_dim);
+}
+
 void cudaD_randomize(dim3 Gr, dim3 Bl, double* y, const double* x, const int32_cuda* copy_from, MatrixDim d_out, MatrixDim d_in) {
   _randomize<<<Gr,Bl>>>(y,x,copy_from,d_out,d_in);
 }
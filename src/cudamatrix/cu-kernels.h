@@ -55,6 +55,10 @@ inline void cuda_copy_from_tp_trans(dim3 Gr, dim3 Bl, float* A, const float* B,
 inline void cuda_copy_from_tp_trans(dim3 Gr, dim3 Bl, float* A, const double* B, MatrixDim dmat) { cudaFD_copy_from_tp_trans(Gr,Bl,A,B,dmat); }
 inline void cuda_copy_from_tp(dim3 Gr, dim3 Bl, float* A, const float* B, MatrixDim dmat) { cudaF_copy_from_tp(Gr,Bl,A,B,dmat); }
 inline void cuda_copy_from_tp(dim3 Gr, dim3 Bl, float* A, const double* B, MatrixDim dmat) { cudaFD_copy_from_tp(Gr,Bl,A,B,dmat); }
+inline void cuda_copy_to_half(dim3 Gr, dim3 Bl, const float* src, MatrixDim d, half* dst, int dst_stride) { cudaF_copy_to_half(Gr,Bl,src,d,dst,dst_stride); }
+inline void cuda_copy_from_half(dim3 Gr, dim3 Bl, const half* src, int src_stride, float* dst, MatrixDim d) { cudaF_copy_from_half(Gr,Bl,src,src_stride,dst,d); }
+inline void cuda_uncompress_col_header(dim3 Gr, dim3 Bl, const unsigned short* col_headers, const unsigned char* byte_data, float min_value, float range, int num_rows, int num_cols, float* dst, int dst_stride, bool transpose) { cudaF_uncompress_col_header(Gr,Bl,col_headers,byte_data,min_value,range,num_rows,num_cols,dst,dst_stride,transpose); }
+inline void cuda_uncompress_uint16(dim3 Gr, dim3 Bl, const unsigned short* data, float min_value, float range, int num_rows, int num_cols, float* dst, int dst_stride, bool transpose) { cudaF_uncompress_uint16(Gr,Bl,data,min_value,range,num_rows,num_cols,dst,dst_stride,transpose); }
 
 inline void cuda_copy_from_mat(dim3 Gr, dim3 Bl, float* mat_out, const double* mat_in, MatrixDim d_out, MatrixDim d_in) {
   cuda_copy_from_mat_fd(Gr, Bl, mat_out, mat_in, d_out, d_in);
@@ -261,6 +265,7 @@ Gr: the number of rows
 */
 inline void cuda_softmax_reduce(size_t Gr, size_t Bl, float *y, const float *x, MatrixDim d, int src_stride) { cudaF_softmax_reduce(Gr,Bl,y,x,d,src_stride); }
 inline void cuda_log_softmax_reduce(size_t Gr, size_t Bl, float *y, const float *x, MatrixDim d, int src_stride) { cudaF_log_softmax_reduce(Gr,Bl,y,x,d,src_stride); }
+inline void cuda_scaled_log_softmax_reduce(size_t Gr, size_t Bl, float *y, const float *x, const float *log_priors, float scale, MatrixDim d, int src_stride) { cudaF_scaled_log_softmax_reduce(Gr,Bl,y,x,log_priors,scale,d,src_stride); }
 
 inline void cuda_regularize_l1(dim3 Gr, dim3 Bl, float *wei, float *grad, float l1, float lr, MatrixDim d, int stride_grad) { cudaF_regularize_l1(Gr,Bl,wei,grad,l1,lr,d,stride_grad); }
 inline void cuda_find_row_max_id(dim3 Gr, dim3 Bl, const float *mat, float *vec_val, int32_cuda *vec_id, int32_cuda voff, MatrixDim d) { cudaF_find_row_max_id(Gr,Bl,mat,vec_val,vec_id,voff,d); }
@@ -270,6 +275,8 @@ inline void cuda_copy_rows_from_vec(dim3 Gr, dim3 Bl, float *mat_out, MatrixDim
 }
 
 
+inline void cuda_lstm_step(dim3 Gr, dim3 Bl, float *y, MatrixDim y_dim, const float *c_prev, int c_prev_stride, const float *pi, const float *pf, const float *po) { cudaF_lstm_step(Gr,Bl,y,y_dim,c_prev,c_prev_stride,pi,pf,po); }
+inline void cuda_lstm_step_backprop(dim3 Gr, dim3 Bl, const float *y, int y_stride, const float *c_prev, int c_prev_stride, const float *next_y, int next_y_stride, const float *next_d, int next_d_stride, const float *pi, const float *pf, const float *po, float *d, MatrixDim d_dim) { cudaF_lstm_step_backprop(Gr,Bl,y,y_stride,c_prev,c_prev_stride,next_y,next_y_stride,next_d,next_d_stride,pi,pf,po,d,d_dim); }
 inline void cuda_randomize(dim3 Gr, dim3 Bl, float *y, const float *x, const int32_cuda *copy_from, MatrixDim d_out, MatrixDim d_in) { cudaF_randomize(Gr,Bl,y,x,copy_from,d_out,d_in); }
 
 inline void cuda_splice(dim3 Gr, dim3 Bl, float *y, const float *x, const int32_cuda *off, MatrixDim d_out, MatrixDim d_in) { cudaF_splice(Gr,Bl,y,x,off,d_out,d_in); }
@@ -322,6 +329,10 @@ inline void cuda_copy_from_tp_trans(dim3 Gr, dim3 Bl, double* A, const double* B
 inline void cuda_copy_from_tp_trans(dim3 Gr, dim3 Bl, double* A, const float* B, MatrixDim dmat) { cudaDF_copy_from_tp_trans(Gr,Bl,A,B,dmat); }
 inline void cuda_copy_from_tp(dim3 Gr, dim3 Bl, double* A, const double* B, MatrixDim dmat) { cudaD_copy_from_tp(Gr,Bl,A,B,dmat); }
 inline void cuda_copy_from_tp(dim3 Gr, dim3 Bl, double* A, const float* B, MatrixDim dmat) { cudaDF_copy_from_tp(Gr,Bl,A,B,dmat); }
+inline void cuda_copy_to_half(dim3 Gr, dim3 Bl, const double* src, MatrixDim d, half* dst, int dst_stride) { cudaD_copy_to_half(Gr,Bl,src,d,dst,dst_stride); }
+inline void cuda_copy_from_half(dim3 Gr, dim3 Bl, const half* src, int src_stride, double* dst, MatrixDim d) { cudaD_copy_from_half(Gr,Bl,src,src_stride,dst,d); }
+inline void cuda_uncompress_col_header(dim3 Gr, dim3 Bl, const unsigned short* col_headers, const unsigned char* byte_data, float min_value, float range, int num_rows, int num_cols, double* dst, int dst_stride, bool transpose) { cudaD_uncompress_col_header(Gr,Bl,col_headers,byte_data,min_value,range,num_rows,num_cols,dst,dst_stride,transpose); }
+inline void cuda_uncompress_uint16(dim3 Gr, dim3 Bl, const unsigned short* data, float min_value, float range, int num_rows, int num_cols, double* dst, int dst_stride, bool transpose) { cudaD_uncompress_uint16(Gr,Bl,data,min_value,range,num_rows,num_cols,dst,dst_stride,transpose); }
 inline void cuda_copy_col_from_vec(int Gr, int Bl, double* mat, const double* v, int col, MatrixDim d) { cudaD_copy_col_from_vec(Gr,Bl,mat,v,col,d); }
 inline void cuda_apply_exp(dim3 Gr, dim3 Bl, double* mat, MatrixDim d) { cudaD_apply_exp(Gr,Bl,mat,d); }
 inline void cuda_apply_pow(dim3 Gr, dim3 Bl, double* mat, double power, MatrixDim dim) { cudaD_apply_pow(Gr,Bl,mat,power,dim); }
@@ -441,6 +452,7 @@ inline void cuda_tanh(dim3 Gr, dim3 Bl, double *y, const double *x, MatrixDim d,
 inline void cuda_diff_tanh(dim3 Gr, dim3 Bl, double *eout, const double *e, const double *y, MatrixDim d, int e_stride, int y_stride) { cudaD_diff_tanh(Gr,Bl,eout,e,y,d,e_stride,y_stride); }
 inline void cuda_softmax_reduce(size_t Gr, size_t Bl, double *y, const double *x, MatrixDim d, int src_stride) { cudaD_softmax_reduce(Gr,Bl,y,x,d,src_stride); }
 inline void cuda_log_softmax_reduce(size_t Gr, size_t Bl, double *y, const double *x, MatrixDim d, int src_stride) { cudaD_log_softmax_reduce(Gr,Bl,y,x,d,src_stride); }
+inline void cuda_scaled_log_softmax_reduce(size_t Gr, size_t Bl, double *y, const double *x, const double *log_priors, double scale, MatrixDim d, int src_stride) { cudaD_scaled_log_softmax_reduce(Gr,Bl,y,x,log_priors,scale,d,src_stride); }
 
 inline void cuda_regularize_l1(dim3 Gr, dim3 Bl, double *wei, double *grad, double l1, double lr, MatrixDim d, int stride_grad) { cudaD_regularize_l1(Gr,Bl,wei,grad,l1,lr,d,stride_grad); }
 inline void cuda_find_row_max_id(dim3 Gr, dim3 Bl, const double *mat, double *vec_val, int32_cuda *vec_id, int32_cuda voff, MatrixDim d) { cudaD_find_row_max_id(Gr,Bl,mat,vec_val,vec_id,voff,d); }
@@ -451,6 +463,8 @@ inline void cuda_copy_rows_from_vec(dim3 Gr, dim3 Bl, double *mat_out, MatrixDim
   cudaD_copy_rows_from_vec(Gr, Bl, mat_out, d_out, v_in);
 }
 
+inline void cuda_lstm_step(dim3 Gr, dim3 Bl, double *y, MatrixDim y_dim, const double *c_prev, int c_prev_stride, const double *pi, const double *pf, const double *po) { cudaD_lstm_step(Gr,Bl,y,y_dim,c_prev,c_prev_stride,pi,pf,po); }
+inline void cuda_lstm_step_backprop(dim3 Gr, dim3 Bl, const double *y, int y_stride, const double *c_prev, int c_prev_stride, const double *next_y, int next_y_stride, const double *next_d, int next_d_stride, const double *pi, const double *pf, const double *po, double *d, MatrixDim d_dim) { cudaD_lstm_step_backprop(Gr,Bl,y,y_stride,c_prev,c_prev_stride,next_y,next_y_stride,next_d,next_d_stride,pi,pf,po,d,d_dim); }
 inline void cuda_randomize(dim3 Gr, dim3 Bl, double *y, const double *x, const int32_cuda *copy_from, MatrixDim d_out, MatrixDim d_in) { cudaD_randomize(Gr,Bl,y,x,copy_from,d_out,d_in); }
 inline void cuda_splice(dim3 Gr, dim3 Bl, double *y, const double *x, const int32_cuda *off, MatrixDim d_out, MatrixDim d_in) { cudaD_splice(Gr,Bl,y,x,off,d_out,d_in); }
 inline void cuda_one(int Gr,int Bl,double* x,int dim) { cudaD_one(Gr,Bl,x,dim); }
@@ -139,6 +139,82 @@ static void UnitTestCuMathSplice() {
   }
 }
 
+// Compares cu::ComputeLstmStep() and cu::BackpropLstmStep() with the
+// sequence of matrix operations that nnet1's LstmProjectedStreams used.
+template<typename Real>
+static void UnitTestCuMathLstmStep() {
+  int32 S = 1 + Rand() % 10, C = 1 + Rand() % 50, R = 1 + Rand() % 20,
+      D = 7 * C + R;
+  CuVector<Real> pi(C), pf(C), po(C);
+  pi.SetRandn();
+  pf.SetRandn();
+  po.SetRandn();
+  // rows 0 and 2 are the previous and next time steps, row 1 the current one.
+  CuMatrix<Real> y(3 * S, D), d(3 * S, D);
+  y.SetRandn();
+  y.Scale(2.0);
+  d.SetRandn();
+  CuMatrix<Real> y_ref(y), d_ref(d);
+
+  CuSubMatrix<Real> y_cur(y.RowRange(S, S));
+  cu::ComputeLstmStep(CuSubMatrix<Real>(y.Range(0, S, 4 * C, C)),
+                      pi, pf, po, &y_cur);
+  {
+    CuSubMatrix<Real> y_g(y_ref.Range(S, S, 0, C)),
+        y_i(y_ref.Range(S, S, C, C)), y_f(y_ref.Range(S, S, 2 * C, C)),
+        y_o(y_ref.Range(S, S, 3 * C, C)), y_c(y_ref.Range(S, S, 4 * C, C)),
+        y_h(y_ref.Range(S, S, 5 * C, C)), y_m(y_ref.Range(S, S, 6 * C, C)),
+        c_prev(y_ref.Range(0, S, 4 * C, C));
+    y_i.AddMatDiagVec(1.0, c_prev, kNoTrans, pi, 1.0);
+    y_f.AddMatDiagVec(1.0, c_prev, kNoTrans, pf, 1.0);
+    y_i.Sigmoid(y_i);
+    y_f.Sigmoid(y_f);
+    y_g.Tanh(y_g);
+    y_c.AddMatMatElements(1.0, y_g, y_i, 0.0);
+    y_c.AddMatMatElements(1.0, c_prev, y_f, 1.0);
+    y_c.ApplyFloor(-50);
+    y_c.ApplyCeiling(50);
+    y_h.Tanh(y_c);
+    y_o.AddMatDiagVec(1.0, y_c, kNoTrans, po, 1.0);
+    y_o.Sigmoid(y_o);
+    y_m.AddMatMatElements(1.0, y_h, y_o, 0.0);
+  }
+  AssertEqual(y, y_ref);
+
+  CuSubMatrix<Real> d_cur(d.RowRange(S, S));
+  cu::BackpropLstmStep(CuSubMatrix<Real>(y.RowRange(S, S)),
+                       CuSubMatrix<Real>(y.Range(0, S, 4 * C, C)),
+                       CuSubMatrix<Real>(y.RowRange(2 * S, S)),
+                       CuSubMatrix<Real>(d.RowRange(2 * S, S)),
+                       pi, pf, po, &d_cur);
+  {
+    CuSubMatrix<Real> y_g(y.Range(S, S, 0, C)),
+        y_i(y.Range(S, S, C, C)), y_f(y.Range(S, S, 2 * C, C)),
+        y_o(y.Range(S, S, 3 * C, C)), y_h(y.Range(S, S, 5 * C, C)),
+        d_g(d_ref.Range(S, S, 0, C)), d_i(d_ref.Range(S, S, C, C)),
+        d_f(d_ref.Range(S, S, 2 * C, C)), d_o(d_ref.Range(S, S, 3 * C, C)),
+        d_c(d_ref.Range(S, S, 4 * C, C)), d_h(d_ref.Range(S, S, 5 * C, C)),
+        d_m(d_ref.Range(S, S, 6 * C, C));
+    d_h.AddMatMatElements(1.0, d_m, y_o, 0.0);
+    d_h.DiffTanh(y_h, d_h);
+    d_o.AddMatMatElements(1.0, d_m, y_h, 0.0);
+    d_o.DiffSigmoid(y_o, d_o);
+    d_c.CopyFromMat(d_h);
+    d_c.AddMatMatElements(1.0, d_ref.Range(2 * S, S, 4 * C, C),
+                          y.Range(2 * S, S, 2 * C, C), 1.0);
+    d_c.AddMatDiagVec(1.0, d_ref.Range(2 * S, S, C, C), kNoTrans, pi, 1.0);
+    d_c.AddMatDiagVec(1.0, d_ref.Range(2 * S, S, 2 * C, C), kNoTrans, pf, 1.0);
+    d_c.AddMatDiagVec(1.0, d_o, kNoTrans, po, 1.0);
+    d_f.AddMatMatElements(1.0, d_c, y.Range(0, S, 4 * C, C), 0.0);
+    d_f.DiffSigmoid(y_f, d_f);
+    d_i.AddMatMatElements(1.0, d_c, y_g, 0.0);
+    d_i.DiffSigmoid(y_i, d_i);
+    d_g.AddMatMatElements(1.0, d_c, y_i, 0.0);
+    d_g.DiffTanh(y_g, d_g);
+  }
+  AssertEqual(d, d_ref);
+}
+
 template<typename Real> void CudaMathUnitTest() {
   #if HAVE_CUDA == 1  
     if (CuDevice::Instantiate().DoublePrecisionSupported())
@@ -146,6 +222,8 @@ template<typename Real> void CudaMathUnitTest() {
   UnitTestCuMathRandomize<Real>();
   UnitTestCuMathSplice<Real>();
   UnitTestCuMathCopy<Real>();
+  for (int32 i = 0; i < 5; i++)
+    UnitTestCuMathLstmStep<Real>();
 }
 
 
@@ -21,6 +21,7 @@
 #include "base/timer.h"
 #include "cudamatrix/cu-common.h"
 #include "cudamatrix/cu-matrix.h"
+#include "cudamatrix/cu-vector.h"
 #include "cudamatrix/cu-device.h"
 #include "cudamatrix/cu-kernels.h"
 
@@ -38,7 +39,7 @@ void RegularizeL1(CuMatrixBase<Real> *weight, CuMatrixBase<Real> *grad, Real l1,
   KALDI_ASSERT(SameDim(*weight, *grad));
 #if HAVE_CUDA == 1 
   if (CuDevice::Instantiate().Enabled()) { 
-    Timer tim;
+    CuTimer tim;
 
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(weight->NumCols(), CU2DBLOCK), n_blocks(weight->NumRows(), CU2DBLOCK));
@@ -47,7 +48,7 @@ void RegularizeL1(CuMatrixBase<Real> *weight, CuMatrixBase<Real> *grad, Real l1,
                        weight->Dim(), grad->Stride());
     CU_SAFE_CALL(cudaGetLastError());
     
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
   #endif
   {
@@ -87,7 +88,7 @@ void Randomize(const CuMatrixBase<Real> &src,
 
   #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     
     /*
     Note: default 16x16 block-size limits the --cachesize to matrix size 16*65535 x 16*65535 
@@ -112,7 +113,7 @@ void Randomize(const CuMatrixBase<Real> &src,
                    copy_from_idx.Data(), dimtgt, dimsrc);
     CU_SAFE_CALL(cudaGetLastError());
     
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
   #endif
   {
@@ -137,7 +138,7 @@ void Splice(const CuMatrixBase<Real> &src, const CuArray<int32> &frame_offsets,
 
   #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(tgt->NumCols(), CU2DBLOCK), n_blocks(tgt->NumRows(), CU2DBLOCK));
@@ -146,7 +147,7 @@ void Splice(const CuMatrixBase<Real> &src, const CuArray<int32> &frame_offsets,
                 frame_offsets.Data(), tgt->Dim(), src.Dim());
     CU_SAFE_CALL(cudaGetLastError());
     
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
   #endif
   {
@@ -178,7 +179,7 @@ void Copy(const CuMatrixBase<Real> &src, const CuArray<int32> &copy_from_indices
 
   #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(tgt->NumCols(), CU2DBLOCK), n_blocks(tgt->NumRows(), CU2DBLOCK));
@@ -187,7 +188,7 @@ void Copy(const CuMatrixBase<Real> &src, const CuArray<int32> &copy_from_indices
               copy_from_indices.Data(), tgt->Dim(), src.Dim());
     CU_SAFE_CALL(cudaGetLastError());
     
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
   #endif
   {
@@ -205,6 +206,116 @@ void Copy(const CuMatrixBase<Real> &src, const CuArray<int32> &copy_from_indices
   }
 }
 
+template<typename Real>
+void ComputeLstmStep(const CuMatrixBase<Real> &c_prev,
+                     const CuVectorBase<Real> &peephole_i_c,
+                     const CuVectorBase<Real> &peephole_f_c,
+                     const CuVectorBase<Real> &peephole_o_c,
+                     CuMatrixBase<Real> *y) {
+  int32 num_rows = y->NumRows(), C = peephole_i_c.Dim();
+  KALDI_ASSERT(y->NumCols() >= 7 * C && c_prev.NumRows() == num_rows &&
+               c_prev.NumCols() == C && peephole_f_c.Dim() == C &&
+               peephole_o_c.Dim() == C);
+  if (num_rows == 0 || C == 0) return;
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    CuTimer tim;
+
+    dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
+    dim3 dimGrid(n_blocks(C, CU2DBLOCK), n_blocks(num_rows, CU2DBLOCK));
+    MatrixDim y_dim = { num_rows, C, y->Stride() };
+    cuda_lstm_step(dimGrid, dimBlock, y->Data(), y_dim, c_prev.Data(),
+                   c_prev.Stride(), peephole_i_c.Data(), peephole_f_c.Data(),
+                   peephole_o_c.Data());
+    CU_SAFE_CALL(cudaGetLastError());
+
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
+  } else
+#endif
+  {
+    const Real *pi = peephole_i_c.Data(), *pf = peephole_f_c.Data(),
+        *po = peephole_o_c.Data();
+    for (int32 r = 0; r < num_rows; r++) {
+      Real *g = y->Mat().RowData(r), *i = g + C, *f = i + C, *o = f + C,
+          *c = o + C, *h = c + C, *m = h + C;
+      const Real *cp = c_prev.Mat().RowData(r);
+      for (int32 j = 0; j < C; j++) {
+        i[j] = 1.0 / (1.0 + Exp(-(i[j] + pi[j] * cp[j])));
+        f[j] = 1.0 / (1.0 + Exp(-(f[j] + pf[j] * cp[j])));
+        g[j] = std::tanh(g[j]);
+        Real cj = g[j] * i[j] + cp[j] * f[j];
+        cj = std::min<Real>(std::max<Real>(cj, -50.0), 50.0);
+        c[j] = cj;
+        h[j] = std::tanh(cj);
+        o[j] = 1.0 / (1.0 + Exp(-(o[j] + po[j] * cj)));
+        m[j] = h[j] * o[j];
+      }
+    }
+  }
+}
+
+template<typename Real>
+void BackpropLstmStep(const CuMatrixBase<Real> &y,
+                      const CuMatrixBase<Real> &c_prev,
+                      const CuMatrixBase<Real> &next_y,
+                      const CuMatrixBase<Real> &next_d,
+                      const CuVectorBase<Real> &peephole_i_c,
+                      const CuVectorBase<Real> &peephole_f_c,
+                      const CuVectorBase<Real> &peephole_o_c,
+                      CuMatrixBase<Real> *d) {
+  int32 num_rows = d->NumRows(), C = peephole_i_c.Dim();
+  KALDI_ASSERT(d->NumCols() >= 7 * C && y.NumCols() >= 7 * C &&
+               next_y.NumCols() >= 7 * C && next_d.NumCols() >= 7 * C &&
+               y.NumRows() == num_rows && next_y.NumRows() == num_rows &&
+               next_d.NumRows() == num_rows && c_prev.NumRows() == num_rows &&
+               c_prev.NumCols() == C && peephole_f_c.Dim() == C &&
+               peephole_o_c.Dim() == C);
+  if (num_rows == 0 || C == 0) return;
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    CuTimer tim;
+
+    dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
+    dim3 dimGrid(n_blocks(C, CU2DBLOCK), n_blocks(num_rows, CU2DBLOCK));
+    MatrixDim d_dim = { num_rows, C, d->Stride() };
+    cuda_lstm_step_backprop(dimGrid, dimBlock, y.Data(), y.Stride(),
+                            c_prev.Data(), c_prev.Stride(), next_y.Data(),
+                            next_y.Stride(), next_d.Data(), next_d.Stride(),
+                            peephole_i_c.Data(), peephole_f_c.Data(),
+                            peephole_o_c.Data(), d->Data(), d_dim);
+    CU_SAFE_CALL(cudaGetLastError());
+
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
+  } else
+#endif
+  {
+    const Real *pi = peephole_i_c.Data(), *pf = peephole_f_c.Data(),
+        *po = peephole_o_c.Data();
+    for (int32 r = 0; r < num_rows; r++) {
+      const Real *y_g = y.Mat().RowData(r), *y_i = y_g + C, *y_f = y_i + C,
+          *y_o = y_f + C, *y_h = y_o + 2 * C,
+          *cp = c_prev.Mat().RowData(r),
+          *next_y_f = next_y.Mat().RowData(r) + 2 * C,
+          *next_d_i = next_d.Mat().RowData(r) + C, *next_d_f = next_d_i + C,
+          *next_d_c = next_d_i + 3 * C;
+      Real *d_g = d->Mat().RowData(r), *d_i = d_g + C, *d_f = d_i + C,
+          *d_o = d_f + C, *d_c = d_o + C, *d_h = d_c + C, *d_m = d_h + C;
+      for (int32 j = 0; j < C; j++) {
+        Real h = y_h[j], o = y_o[j], dh = d_m[j] * o * (1.0 - h * h),
+            d_o_j = d_m[j] * h * o * (1.0 - o),
+            dc = dh + next_d_c[j] * next_y_f[j] + next_d_i[j] * pi[j] +
+            next_d_f[j] * pf[j] + d_o_j * po[j];
+        d_h[j] = dh;
+        d_o[j] = d_o_j;
+        d_c[j] = dc;
+        d_f[j] = dc * cp[j] * y_f[j] * (1.0 - y_f[j]);
+        d_i[j] = dc * y_g[j] * y_i[j] * (1.0 - y_i[j]);
+        d_g[j] = dc * y_i[j] * (1.0 - y_g[j] * y_g[j]);
+      }
+    }
+  }
+}
+
 // instantiate the templates.
 template
 void RegularizeL1(CuMatrixBase<float> *weight, CuMatrixBase<float> *grad, float l1, float lr);
@@ -224,6 +335,37 @@ template
 void Copy(const CuMatrixBase<double> &src, const CuArray<int32> &copy_from_indices,
           CuMatrixBase<double> *tgt);
 
+template
+void ComputeLstmStep(const CuMatrixBase<float> &c_prev,
+                     const CuVectorBase<float> &peephole_i_c,
+                     const CuVectorBase<float> &peephole_f_c,
+                     const CuVectorBase<float> &peephole_o_c,
+                     CuMatrixBase<float> *y);
+template
+void ComputeLstmStep(const CuMatrixBase<double> &c_prev,
+                     const CuVectorBase<double> &peephole_i_c,
+                     const CuVectorBase<double> &peephole_f_c,
+                     const CuVectorBase<double> &peephole_o_c,
+                     CuMatrixBase<double> *y);
+template
+void BackpropLstmStep(const CuMatrixBase<float> &y,
+                      const CuMatrixBase<float> &c_prev,
+                      const CuMatrixBase<float> &next_y,
+                      const CuMatrixBase<float> &next_d,
+                      const CuVectorBase<float> &peephole_i_c,
+                      const CuVectorBase<float> &peephole_f_c,
+                      const CuVectorBase<float> &peephole_o_c,
+                      CuMatrixBase<float> *d);
+template
+void BackpropLstmStep(const CuMatrixBase<double> &y,
+                      const CuMatrixBase<double> &c_prev,
+                      const CuMatrixBase<double> &next_y,
+                      const CuMatrixBase<double> &next_d,
+                      const CuVectorBase<double> &peephole_i_c,
+                      const CuVectorBase<double> &peephole_f_c,
+                      const CuVectorBase<double> &peephole_o_c,
+                      CuMatrixBase<double> *d);
+
 template
 void Randomize(const CuMatrixBase<float> &src,
                const CuArray<int32> &copy_from_idx,
@@ -73,6 +73,44 @@ void Copy(const CuMatrixBase<Real> &src,
           const CuArray<int32> &copy_from_indices,
           CuMatrixBase<Real> *tgt);
 
+/// ComputeLstmStep does the nonlinear part of one time step of an LSTM with
+/// peephole connections, as in nnet1's LstmProjectedStreams and
+/// BLstmProjectedStreams, in a single kernel instead of one per operation.
+/// "y" has one row per stream, and (at least) 7*C columns, which are, in
+/// blocks of C = peephole_i_c.Dim(): g, i, f, o, c, h, m, as in the
+/// propagation buffers of those components.  On entry the g, i, f and o
+/// blocks contain the inputs of the gates (from the input, the recurrent
+/// projection and the bias); on exit all seven blocks contain activations:
+///   i = sigmoid(i + peephole_i_c * c_prev), f = sigmoid(f + peephole_f_c * c_prev),
+///   g = tanh(g), c = g * i + c_prev * f (clipped to [-50, 50]), h = tanh(c),
+///   o = sigmoid(o + peephole_o_c * c), m = h * o.
+/// "c_prev" has the same number of rows as y and C columns.
+template<typename Real>
+void ComputeLstmStep(const CuMatrixBase<Real> &c_prev,
+                     const CuVectorBase<Real> &peephole_i_c,
+                     const CuVectorBase<Real> &peephole_f_c,
+                     const CuVectorBase<Real> &peephole_o_c,
+                     CuMatrixBase<Real> *y);
+
+/// BackpropLstmStep is the backward pass of ComputeLstmStep().  "y" and
+/// "c_prev" are as output by (and given to) ComputeLstmStep() for this time
+/// step.  "d" has the same layout as "y"; on entry its m block contains the
+/// derivative w.r.t. m, and on exit the g, i, f, o, c and h blocks contain the
+/// derivatives w.r.t. those quantities (for g, i, f and o, before the
+/// nonlinearity).  "next_y" and "next_d" are the rows of y and d for the next
+/// time step in the order of the recursion (for which d has already been
+/// computed, or is zero): we use its forget gate activation and the c, i and
+/// f derivatives.
+template<typename Real>
+void BackpropLstmStep(const CuMatrixBase<Real> &y,
+                      const CuMatrixBase<Real> &c_prev,
+                      const CuMatrixBase<Real> &next_y,
+                      const CuMatrixBase<Real> &next_d,
+                      const CuVectorBase<Real> &peephole_i_c,
+                      const CuVectorBase<Real> &peephole_f_c,
+                      const CuVectorBase<Real> &peephole_o_c,
+                      CuMatrixBase<Real> *d);
+
 
 } // namespace cu
 } // namespace kaldi
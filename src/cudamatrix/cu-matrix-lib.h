@@ -27,7 +27,9 @@
 #include "cudamatrix/cu-sp-matrix.h"
 #include "cudamatrix/cu-tp-matrix.h"
 #include "cudamatrix/cu-sparse-matrix.h"
+#include "cudamatrix/cu-compressed-matrix.h"
 #include "cudamatrix/cu-block-matrix.h"
 #include "cudamatrix/cu-rand.h"
+#include "cudamatrix/cu-stream.h"
 
 #endif
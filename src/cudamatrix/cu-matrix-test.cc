@@ -1326,6 +1326,47 @@ static void UnitTestCuMatrixAddMatMat() {
 }
 
 
+template<typename Real>
+static void UnitTestCuMatrixAddMatMatBatchedStrided() {
+  for (int32 i = 0; i < 2; i++) {
+    // The products are over column blocks of "A" and "C", as in the
+    // convolutional components, with a single shared matrix "B".
+    int32 num_rows = 10 + Rand() % 20, a_dim = 1 + Rand() % 10,
+        c_dim = 1 + Rand() % 10, batch_count = 1 + Rand() % 8;
+    CuMatrix<Real> A(num_rows, a_dim * batch_count),
+        B(c_dim, a_dim), C(num_rows, c_dim * batch_count);
+    A.SetRandn();
+    B.SetRandn();
+    C.SetRandn();
+    CuMatrix<Real> C2(C);
+    C.ColRange(0, c_dim).AddMatMatBatched(0.5, A.ColRange(0, a_dim), kNoTrans,
+                                          a_dim, B, kTrans, 0, 2.0, c_dim,
+                                          batch_count);
+    for (int32 b = 0; b < batch_count; b++)
+      C2.ColRange(b * c_dim, c_dim).AddMatMat(
+          0.5, A.ColRange(b * a_dim, a_dim), kNoTrans, B, kTrans, 2.0);
+    AssertEqual(C, C2);
+
+    // Now the products are over row blocks of "A" and "C", with "A"
+    // transposed and a separate block of "B" for each product.
+    CuMatrix<Real> D(a_dim * batch_count, num_rows),
+        E(c_dim * batch_count, a_dim * 2), F(num_rows * batch_count, c_dim);
+    D.SetRandn();
+    E.SetRandn();
+    CuMatrix<Real> F2(F);
+    F.RowRange(0, num_rows).AddMatMatBatched(
+        1.0, D.RowRange(0, a_dim), kTrans, a_dim * D.Stride(),
+        E.Range(0, c_dim, 0, a_dim), kTrans, c_dim * E.Stride(), 0.0,
+        num_rows * F.Stride(), batch_count);
+    for (int32 b = 0; b < batch_count; b++)
+      F2.RowRange(b * num_rows, num_rows).AddMatMat(
+          1.0, D.RowRange(b * a_dim, a_dim), kTrans,
+          E.Range(b * c_dim, c_dim, 0, a_dim), kTrans, 0.0);
+    AssertEqual(F, F2);
+  }
+}
+
+
 template<typename Real>
 static void UnitTestCuMatrixAddMatMatBatched() {
   const int32 batchCount = 10;
@@ -1437,6 +1478,35 @@ static void UnitTestCuMatrixCopyFromMat() {
   }
 }
 
+template<typename Real>
+static void UnitTestCuMatrixCopyAsync() {
+  for (int32 i = 1; i < 10; i++) {
+    MatrixIndexT num_rows = 5 * i + Rand() % 10,
+        num_cols = 5 * i + Rand() % 10;
+    // Two upload buffers, used alternately as the asynchronous copies require.
+    PinnedMatrix<Real> A(num_rows, num_cols), B;
+    B.Resize(num_rows, num_cols);
+    A.SetRandn();
+    B.SetRandn();
+    CuMatrix<Real> C(num_rows, num_cols), D(num_rows, num_cols);
+    CuEvent a_done;
+    C.CopyFromMatAsync(A, &a_done);
+    D.CopyFromMatAsync(B);
+    a_done.Wait();
+    KALDI_ASSERT(a_done.Done());
+    // this computation has to wait for the copies.
+    C.AddMat(2.0, D);
+
+    PinnedMatrix<Real> E(num_rows, num_cols);
+    CuEvent e_done;
+    C.CopyToMatAsync(&E, &e_done);
+    e_done.Wait();
+    Matrix<Real> F(A);
+    F.AddMat(2.0, B);
+    AssertEqual<Real>(E, F);
+  }
+}
+
 template<typename Real>
 static void UnitTestCuMatrixCopyFromTp() {
   for (int32 i = 1; i < 10; i++) {
@@ -1945,6 +2015,38 @@ static void UnitTestCuLogSoftmax() {
 }
 
 
+template<typename Real>
+static void UnitTestCuScaledLogSoftmax() {
+  for (int32 i = 0; i < 2; i++) {
+    // include output-layer-sized rows, and a source with a different stride.
+    int row = 10 + Rand() % 40;
+    int col = (i == 0 ? 10 + Rand() % 50 : 5000 + Rand() % 8000);
+    Real scale = 0.1 * (1 + Rand() % 10);
+
+    Matrix<Real> Hi(row, col + 3);
+    Hi.SetRandn();
+    Hi.Scale(5.0);
+    Vector<Real> log_priors(col);
+    log_priors.SetRandn();
+
+    CuMatrix<Real> Di(Hi);
+    CuSubMatrix<Real> Di_part(Di, 0, row, 1, col);
+    CuVector<Real> Dlog_priors(log_priors);
+    CuMatrix<Real> Do(row, col);
+    Do.ApplyScaledLogSoftMaxPerRow(Di_part, Dlog_priors, scale);
+
+    Matrix<Real> Ho(SubMatrix<Real>(Hi, 0, row, 1, col));
+    for (MatrixIndexT r = 0; r < Ho.NumRows(); r++)
+      Ho.Row(r).ApplyLogSoftMax();
+    Ho.AddVecToRows(-1.0, log_priors);
+    Ho.Scale(scale);
+
+    Matrix<Real> Ho2(Do);
+    AssertEqual(Ho, Ho2, 0.00001);
+  }
+}
+
+
 template<typename Real>
 static void UnitTestCuFindRowMaxId() {
   for (int32 i = 0; i < 2; i++) {
@@ -2435,8 +2537,10 @@ template<typename Real> void CudaMatrixUnitTest() {
   UnitTestCuMatrixAddMatMat<Real>();
   UnitTestCuMatrixSymAddMat2<Real>();
   UnitTestCuMatrixAddMatMatBatched<Real>();
+  UnitTestCuMatrixAddMatMatBatchedStrided<Real>();
   UnitTestCuMatrixSymInvertPosDef<Real>();
   UnitTestCuMatrixCopyFromMat<Real>();
+  UnitTestCuMatrixCopyAsync<Real>();
   UnitTestCuMatrixCopyFromTp<Real>();
   UnitTestCuMatrixAddMatTp<Real>();
   UnitTestCuMatrixCopyCols<Real>();
@@ -2485,6 +2589,7 @@ template<typename Real> void CudaMatrixUnitTest() {
   UnitTestCuFindRowMaxId<Real>();
   UnitTestCuSoftmax<Real>();
   UnitTestCuLogSoftmax<Real>();
+  UnitTestCuScaledLogSoftmax<Real>();
   UnitTestCuDiffXent<Real>();
   UnitTestCheck<Real>();
   UnitTestSwapCu2Cu<Real>();
@@ -40,7 +40,11 @@
 #include "cudamatrix/cu-tp-matrix.h"
 #include "cudamatrix/cu-block-matrix.h"
 #include "cudamatrix/cu-sparse-matrix.h"
+#include "cudamatrix/cu-compressed-matrix.h"
+#include "cudamatrix/cu-stream.h"
 #include "cudamatrix/cublas-wrappers.h"
+#include "matrix/cblas-wrappers.h"
+#include "matrix/matrix-memory-pool.h"
 
 namespace kaldi {
 
@@ -60,7 +64,7 @@ void CuMatrix<Real>::Resize(MatrixIndexT rows, MatrixIndexT cols,
   if (rows == 0) return;
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     MatrixIndexT row_bytes = cols * sizeof(Real);
     size_t pitch;
     this->data_ = static_cast<Real*>(CuDevice::Instantiate().MallocPitch(
@@ -69,7 +73,7 @@ void CuMatrix<Real>::Resize(MatrixIndexT rows, MatrixIndexT cols,
     this->num_cols_ = cols;
     this->stride_ = pitch / sizeof(Real);
     if (resize_type == kSetZero) this->SetZero();
-    CuDevice::Instantiate().AccuProfile("CuMatrix::Resize", tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile("CuMatrix::Resize", tim);
   } else
 #endif
   { // Let the initializer of Matrix<Real> handle the allocation,
@@ -85,14 +89,15 @@ void CuMatrix<Real>::Destroy() {
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
     if (this->data_ != NULL) {
-      Timer tim;
+      CuTimer tim;
       CuDevice::Instantiate().Free(this->data_);
-      CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+      CuDevice::Instantiate().AccuProfile(__func__, tim);
     }
   } else
 #endif
   {
-    if (this->data_ != NULL) KALDI_MEMALIGN_FREE(this->data_);
+    // The memory was allocated by Matrix<Real> (see Resize()).
+    MatrixMemoryFree(this->data_);
   }
   this->data_ = NULL;
   this->num_rows_ = 0;
@@ -215,7 +220,7 @@ void CuMatrixBase<Real>::CopyFromMat(const CuMatrixBase<OtherReal> &M,
       KALDI_ASSERT(M.NumCols() == num_rows_ && M.NumRows() == num_cols_);
     }
     if (M.num_rows_ == 0) return; // Nothing to do.
-    Timer tim;
+    CuTimer tim;
     if (sizeof(Real) == sizeof(OtherReal) && trans == kNoTrans ) {
       MatrixIndexT dst_pitch = stride_ * sizeof(Real);
       MatrixIndexT src_pitch = M.Stride() * sizeof(Real);
@@ -233,7 +238,7 @@ void CuMatrixBase<Real>::CopyFromMat(const CuMatrixBase<OtherReal> &M,
         cuda_copy_from_mat_trans(dimGrid, dimBlock, data_, M.data_, Dim(), M.Dim());
       }
     }
-    CuDevice::Instantiate().AccuProfile("CuMatrixBase::CopyFromMat(from other CuMatrixBase)", tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile("CuMatrixBase::CopyFromMat(from other CuMatrixBase)", tim);
   } else
 #endif
   {
@@ -265,7 +270,7 @@ void CuMatrixBase<Real>::CopyFromTp(const CuTpMatrix<OtherReal> &M,
     return;
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(num_rows_, CU2DBLOCK),
                  n_blocks(num_rows_, CU2DBLOCK));
@@ -274,7 +279,7 @@ void CuMatrixBase<Real>::CopyFromTp(const CuTpMatrix<OtherReal> &M,
     } else {
       cuda_copy_from_tp_trans(dimGrid, dimBlock, data_, M.Data(), Dim());
     }
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -298,7 +303,7 @@ void CuMatrixBase<Real>::CopyFromMat(const MatrixBase<Real> &src,
   if (CuDevice::Instantiate().Enabled()) {
     if (trans == kNoTrans) {
       KALDI_ASSERT(src.NumRows() == num_rows_ && src.NumCols() == num_cols_);
-      Timer tim;
+      CuTimer tim;
 
       MatrixIndexT dst_pitch = stride_*sizeof(Real);
       MatrixIndexT src_pitch = src.Stride()*sizeof(Real);
@@ -306,7 +311,8 @@ void CuMatrixBase<Real>::CopyFromMat(const MatrixBase<Real> &src,
       CU_SAFE_CALL(cudaMemcpy2D(data_, dst_pitch, src.Data(), src_pitch,
                                 width, src.NumRows(), cudaMemcpyHostToDevice));
 
-      CuDevice::Instantiate().AccuProfile("CuMatrixBase::CopyFromMat(from CPU)",tim.Elapsed());
+      CuDevice::Instantiate().AccuProfile("CuMatrixBase::CopyFromMat(from CPU)", tim,
+                                          static_cast<int64>(width) * num_rows_);
     } else {
       CuMatrix<Real> trans_mat(src); // Do the transpose on the GPU board.
       this->CopyFromMat(trans_mat, kTrans);
@@ -342,12 +348,12 @@ void CuMatrixBase<Real>::CopyFromSp(const CuSpMatrix<Real> &M) {
     return;
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumRows(), CU2DBLOCK),
                  n_blocks(NumRows(), CU2DBLOCK));
     cuda_copy_from_sp(dimGrid, dimBlock, M.Data(), data_, Dim());
-    CuDevice::Instantiate().AccuProfile("CuMatrix::CopyFromSp",tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile("CuMatrix::CopyFromSp", tim);
   } else
 #endif
   {
@@ -406,7 +412,7 @@ void CuMatrixBase<Real>::CopyToMat(MatrixBase<OtherReal> *dst,
     } else {
       KALDI_ASSERT(dst->NumRows() == NumRows() && dst->NumCols() == NumCols());
       if (num_rows_ == 0) return;
-      Timer tim;
+      CuTimer tim;
 
       MatrixIndexT src_pitch = stride_*sizeof(Real);
       MatrixIndexT dst_pitch = dst->Stride()*sizeof(Real);
@@ -414,7 +420,8 @@ void CuMatrixBase<Real>::CopyToMat(MatrixBase<OtherReal> *dst,
       CU_SAFE_CALL(cudaMemcpy2D(dst->Data(), dst_pitch, this->data_, src_pitch,
                                 width, this->num_rows_, cudaMemcpyDeviceToHost));
 
-      CuDevice::Instantiate().AccuProfile("CuMatrix::CopyToMatD2H",tim.Elapsed());
+      CuDevice::Instantiate().AccuProfile("CuMatrix::CopyToMatD2H", tim,
+                                          static_cast<int64>(width) * num_rows_);
     }
   } else
   #endif
@@ -438,6 +445,67 @@ void CuMatrixBase<double>::CopyToMat(MatrixBase<double> *dst,
                                      MatrixTransposeType trans) const;
 
 
+template<typename Real>
+void CuMatrixBase<Real>::CopyFromMatAsync(const MatrixBase<Real> &src,
+                                          CuEvent *done) {
+  KALDI_ASSERT(src.NumRows() == num_rows_ && src.NumCols() == num_cols_);
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    if (num_rows_ == 0) return;
+    cudaStream_t copy_stream = CuDevice::Instantiate().GetCopyStream();
+    CuTimer tim(copy_stream);
+    MatrixIndexT dst_pitch = stride_ * sizeof(Real),
+        src_pitch = src.Stride() * sizeof(Real),
+        width = num_cols_ * sizeof(Real);
+    CU_SAFE_CALL(cudaMemcpy2DAsync(data_, dst_pitch, src.Data(), src_pitch,
+                                   width, num_rows_, cudaMemcpyHostToDevice,
+                                   copy_stream));
+    // Make the computation (on the default stream) wait for the copy.
+    CuEvent copy_done;
+    CuEvent *event = (done != NULL ? done : &copy_done);
+    event->Record(copy_stream);
+    event->MakeStreamWait(0);
+    CuDevice::Instantiate().AccuProfile("CuMatrixBase::CopyFromMatAsync",
+                                        tim, static_cast<int64>(width) * num_rows_);
+  } else
+#endif
+  {
+    Mat().CopyFromMat(src);
+  }
+}
+
+template<typename Real>
+void CuMatrixBase<Real>::CopyToMatAsync(MatrixBase<Real> *dst,
+                                        CuEvent *done) const {
+  KALDI_ASSERT(dst->NumRows() == num_rows_ && dst->NumCols() == num_cols_ &&
+               done != NULL);
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    if (num_rows_ == 0) return;
+    cudaStream_t copy_stream = CuDevice::Instantiate().GetCopyStream();
+    CuTimer tim(copy_stream);
+    // Make the copy wait for the computation queued so far, which may be
+    // what produces *this.
+    CuEvent compute_done;
+    compute_done.Record(0);
+    compute_done.MakeStreamWait(copy_stream);
+    MatrixIndexT src_pitch = stride_ * sizeof(Real),
+        dst_pitch = dst->Stride() * sizeof(Real),
+        width = num_cols_ * sizeof(Real);
+    CU_SAFE_CALL(cudaMemcpy2DAsync(dst->Data(), dst_pitch, data_, src_pitch,
+                                   width, num_rows_, cudaMemcpyDeviceToHost,
+                                   copy_stream));
+    done->Record(copy_stream);
+    CuDevice::Instantiate().AccuProfile("CuMatrixBase::CopyToMatAsync",
+                                        tim, static_cast<int64>(width) * num_rows_);
+  } else
+#endif
+  {
+    dst->CopyFromMat(Mat());
+  }
+}
+
+
 
 
 
@@ -460,10 +528,10 @@ template<typename Real>
 void CuMatrixBase<Real>::SetZero() {
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     CU_SAFE_CALL(cudaMemset2D(data_, stride_ * sizeof(Real), 0,
                               num_cols_ * sizeof(Real), num_rows_ ));
-    CuDevice::Instantiate().AccuProfile("CuMatrix::SetZero", tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile("CuMatrix::SetZero", tim);
   } else
 #endif
   {
@@ -482,7 +550,7 @@ void CuMatrixBase<Real>::Set(Real value) {
   #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
     if (num_rows_ == 0) return;
-    Timer tim;
+    CuTimer tim;
 
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumCols(), CU2DBLOCK), n_blocks(NumRows(), CU2DBLOCK));
@@ -490,7 +558,7 @@ void CuMatrixBase<Real>::Set(Real value) {
     cuda_set_const(dimGrid, dimBlock, data_, value, Dim());
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
   #endif
   {
@@ -504,7 +572,7 @@ void CuMatrixBase<Real>::SetZeroAboveDiag() {
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
     if (num_rows_ == 0) return;
-    Timer tim;
+    CuTimer tim;
 
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumCols(), CU2DBLOCK), n_blocks(NumRows(), CU2DBLOCK));
@@ -512,7 +580,7 @@ void CuMatrixBase<Real>::SetZeroAboveDiag() {
     cuda_set_zero_above_diag(dimGrid, dimBlock, data_, Dim());
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -531,7 +599,7 @@ void CuMatrixBase<Real>::Add(Real value) {
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
     if (num_rows_ == 0) return;
-    Timer tim;
+    CuTimer tim;
 
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumCols(), CU2DBLOCK), n_blocks(NumRows(), CU2DBLOCK));
@@ -539,7 +607,7 @@ void CuMatrixBase<Real>::Add(Real value) {
     cuda_add(dimGrid, dimBlock, data_, value, Dim());
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
   #endif
   {
@@ -552,7 +620,7 @@ void CuMatrixBase<Real>::AddToDiag(Real value) {
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
     if (num_rows_ == 0) return;
-    Timer tim;
+    CuTimer tim;
     // We'll create a fake matrix with "num_diag" rows, one
     // columnn, and a stride of "this_stride".  The y-value of
     // the grid/blocks corresponds to the row, in this kernel.
@@ -564,7 +632,7 @@ void CuMatrixBase<Real>::AddToDiag(Real value) {
     cuda_add(dimGrid, dimBlock, data_, value, d);
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
   #endif
   {
@@ -592,7 +660,7 @@ void CuMatrixBase<Real>::Scale(Real value) {
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
     if (num_rows_ == 0) return;
-    Timer tim;
+    CuTimer tim;
 
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumCols(), CU2DBLOCK), n_blocks(NumRows(), CU2DBLOCK));
@@ -600,7 +668,7 @@ void CuMatrixBase<Real>::Scale(Real value) {
     cuda_scale(dimGrid, dimBlock, data_, value, Dim());
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -613,7 +681,7 @@ void CuMatrixBase<Real>::ApplyLog() {
   #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
     if (num_rows_ == 0) return;
-    Timer tim;
+    CuTimer tim;
 
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumCols(), CU2DBLOCK), n_blocks(NumRows(), CU2DBLOCK));
@@ -621,7 +689,7 @@ void CuMatrixBase<Real>::ApplyLog() {
     cuda_apply_log(dimGrid, dimBlock, data_, Dim());
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
   #endif
   {
@@ -633,7 +701,7 @@ template<typename Real>
 void CuMatrixBase<Real>::MulElements(const CuMatrixBase<Real>& A) {
   #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
 
     KALDI_ASSERT(num_cols_ == A.NumCols());
     KALDI_ASSERT(num_rows_ == A.NumRows());
@@ -644,7 +712,7 @@ void CuMatrixBase<Real>::MulElements(const CuMatrixBase<Real>& A) {
     cuda_mul_elements(dimGrid, dimBlock, data_, A.data_, Dim(), A.Stride());
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
   #endif
   {
@@ -656,7 +724,7 @@ template<typename Real>
 void CuMatrixBase<Real>::DivElements(const CuMatrixBase<Real>& A) {
   #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
 
     KALDI_ASSERT(num_cols_ == A.NumCols());
     KALDI_ASSERT(num_rows_ == A.NumRows());
@@ -667,7 +735,7 @@ void CuMatrixBase<Real>::DivElements(const CuMatrixBase<Real>& A) {
     cuda_div_elements(dimGrid, dimBlock, data_, A.data_, Dim(), A.Stride());
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
   #endif
   {
@@ -679,7 +747,7 @@ template<typename Real>
 void CuMatrixBase<Real>::Max(const CuMatrixBase<Real>& A) {
   #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
 
     KALDI_ASSERT(num_cols_ == A.NumCols());
     KALDI_ASSERT(num_rows_ == A.NumRows());
@@ -690,7 +758,7 @@ void CuMatrixBase<Real>::Max(const CuMatrixBase<Real>& A) {
     cuda_max(dimGrid, dimBlock, data_, A.data_, Dim(), A.Stride());
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
   #endif
   {
@@ -703,7 +771,7 @@ template<typename Real>
 void CuMatrixBase<Real>::MulColsVec(const CuVectorBase<Real> &scale) {
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
 
     KALDI_ASSERT(scale.Dim() == NumCols());
 
@@ -714,7 +782,7 @@ void CuMatrixBase<Real>::MulColsVec(const CuVectorBase<Real> &scale) {
     CU_SAFE_CALL(cudaGetLastError());
 
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -728,7 +796,7 @@ template<typename Real>
 void CuMatrixBase<Real>::MulRowsVec(const CuVectorBase<Real> &scale) {
   #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
 
     KALDI_ASSERT(scale.Dim() == NumRows());
 
@@ -739,7 +807,7 @@ void CuMatrixBase<Real>::MulRowsVec(const CuVectorBase<Real> &scale) {
     CU_SAFE_CALL(cudaGetLastError());
 
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
   #endif
   {
@@ -752,7 +820,7 @@ void CuMatrixBase<Real>::MulRowsGroupMat(const CuMatrixBase<Real> &src) {
   KALDI_ASSERT(src.NumCols() > 0);
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     int group_size = this->NumCols() / src.NumCols();
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumCols(), CU2DBLOCK),
@@ -762,7 +830,7 @@ void CuMatrixBase<Real>::MulRowsGroupMat(const CuMatrixBase<Real> &src) {
                             this->Dim(), src.Stride(), group_size);
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -778,7 +846,7 @@ void CuMatrixBase<Real>::GroupPnormDeriv(const CuMatrixBase<Real> &src1,
   KALDI_ASSERT(this->NumCols() == src2.NumCols() * group_size);
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
 
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumCols(), CU2DBLOCK), n_blocks(NumRows(), CU2DBLOCK));
@@ -786,7 +854,7 @@ void CuMatrixBase<Real>::GroupPnormDeriv(const CuMatrixBase<Real> &src1,
     cuda_calc_pnorm_deriv(dimGrid, dimBlock, this->data_, src1.Data(), src2.Data(), Dim(), src2.Stride(), group_size, power);
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -802,7 +870,7 @@ void CuMatrixBase<Real>::GroupMaxDeriv(const CuMatrixBase<Real> &src1,
   KALDI_ASSERT(this->NumCols() == src2.NumCols() * group_size);
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
 
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumCols(), CU2DBLOCK), n_blocks(NumRows(), CU2DBLOCK));
@@ -812,7 +880,7 @@ void CuMatrixBase<Real>::GroupMaxDeriv(const CuMatrixBase<Real> &src1,
                               src2.Stride(), group_size);
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -824,7 +892,7 @@ template<typename Real>
 void CuMatrixBase<Real>::DivRowsVec(const CuVectorBase<Real> &div) {
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
 
     KALDI_ASSERT(div.Dim() == NumRows());
 
@@ -834,7 +902,7 @@ void CuMatrixBase<Real>::DivRowsVec(const CuVectorBase<Real> &div) {
     cuda_div_rows_vec(dimGrid, dimBlock, data_, div.data_, Dim());
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -848,7 +916,7 @@ template<typename Real>
 void CuMatrixBase<Real>::InvertElements() {
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
 
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumCols(), CU2DBLOCK), n_blocks(NumRows(), CU2DBLOCK));
@@ -856,7 +924,7 @@ void CuMatrixBase<Real>::InvertElements() {
     cuda_invert_elements(dimGrid, dimBlock, data_, Dim());
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -877,14 +945,14 @@ void CuMatrixBase<Real>::AddMat(Real alpha, const CuMatrixBase<Real>& A,
       KALDI_ASSERT(A.NumCols() == num_rows_ && A.NumRows() == num_cols_);
     }
     if (num_rows_ == 0) return;
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumCols(), CU2DBLOCK), n_blocks(NumRows(), CU2DBLOCK));
     cuda_add_mat(dimGrid, dimBlock, alpha, A.data_, data_, Dim(), A.Stride(),
                  (transA == kTrans ? 1 : 0));
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -908,7 +976,7 @@ void CuMatrixBase<Real>::AddMatBlocks(Real alpha, const CuMatrixBase<Real> &A,
   }
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumCols(), CU2DBLOCK), n_blocks(NumRows(), CU2DBLOCK));
     cuda_add_mat_blocks(dimGrid, dimBlock, alpha, A.data_, num_row_blocks,
@@ -916,7 +984,7 @@ void CuMatrixBase<Real>::AddMatBlocks(Real alpha, const CuMatrixBase<Real> &A,
 		    (transA == kTrans ? 1 : 0));
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -942,7 +1010,7 @@ void CuMatrixBase<Real>::AddMatMatDivMat(const CuMatrixBase<Real> &A,
                     const CuMatrixBase<Real> &B, const CuMatrixBase<Real> &C) {
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
 
     KALDI_ASSERT(num_rows_ == A.num_rows_ && num_cols_ == A.num_cols_);
     KALDI_ASSERT(num_rows_ == B.num_rows_ && num_cols_ == B.num_cols_);
@@ -955,7 +1023,7 @@ void CuMatrixBase<Real>::AddMatMatDivMat(const CuMatrixBase<Real> &A,
     cuda_add_mat_mat_div_mat(dimGrid, dimBlock, A.data_, B.data_, C.data_, data_, Dim(), A.Stride(), B.Stride(), C.Stride());
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -973,7 +1041,7 @@ void CuMatrixBase<Real>::AddVecToCols(Real alpha,
 
   #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
 
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumCols(), CU2DBLOCK), n_blocks(NumRows(), CU2DBLOCK));
@@ -981,7 +1049,7 @@ void CuMatrixBase<Real>::AddVecToCols(Real alpha,
     cuda_add_vec_to_cols(dimGrid, dimBlock, alpha, col.data_, beta, data_, Dim());
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
   #endif
   {
@@ -1001,7 +1069,7 @@ void CuMatrixBase<Real>::AddVecToRows(Real alpha,
   }
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
 
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumCols(), CU2DBLOCK), n_blocks(NumRows(), CU2DBLOCK));
@@ -1009,7 +1077,7 @@ void CuMatrixBase<Real>::AddVecToRows(Real alpha,
     cuda_add_vec_to_rows(dimGrid, dimBlock, alpha, row.data_, beta, data_, Dim());
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -1045,14 +1113,14 @@ void CuMatrixBase<Real>::AddMatMat(
 
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     CU_SAFE_CALL(cublas_gemm(GetCublasHandle(),
 			    (transB==kTrans? CUBLAS_OP_T:CUBLAS_OP_N),
 			    (transA==kTrans? CUBLAS_OP_T:CUBLAS_OP_N),
 			    m, n, k, alpha, B.data_, B.Stride(),
 			    A.data_, A.Stride(), beta, data_, Stride()));
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -1060,6 +1128,84 @@ void CuMatrixBase<Real>::AddMatMat(
   }
 }
 
+template<typename Real>
+void CuMatrixBase<Real>::AddMatMatBatched(
+    Real alpha,
+    const CuMatrixBase<Real> &A, MatrixTransposeType transA,
+    MatrixIndexT a_offset,
+    const CuMatrixBase<Real> &B, MatrixTransposeType transB,
+    MatrixIndexT b_offset,
+    Real beta, MatrixIndexT this_offset,
+    int32 batch_count) {
+  // The mapping from row-major to CUBLAS's column-major is the same as in
+  // AddMatMat().
+  MatrixIndexT m = ((transB==kTrans)? B.NumRows() : B.NumCols());
+  MatrixIndexT n = ((transA==kTrans)? A.NumCols() : A.NumRows());
+  MatrixIndexT k = ((transB==kTrans)? B.NumCols() : B.NumRows());
+  MatrixIndexT k1 = ((transA==kTrans)? A.NumRows() : A.NumCols());
+
+  KALDI_ASSERT(m == NumCols());
+  KALDI_ASSERT(n == NumRows());
+  KALDI_ASSERT(k == k1);
+  KALDI_ASSERT(batch_count >= 0 && a_offset >= 0 && b_offset >= 0 &&
+               (this_offset > 0 || batch_count <= 1));
+
+  if (m == 0 || batch_count == 0) return;
+
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    CuTimer tim;
+#if CUDART_VERSION >= 8000
+    CU_SAFE_CALL(cublas_gemmStridedBatched(GetCublasHandle(),
+        (transB==kTrans? CUBLAS_OP_T:CUBLAS_OP_N),
+        (transA==kTrans? CUBLAS_OP_T:CUBLAS_OP_N),
+        m, n, k, alpha, B.data_, B.Stride(), b_offset,
+        A.data_, A.Stride(), a_offset, beta,
+        data_, Stride(), this_offset, batch_count));
+#else
+    // Older toolkits have no strided version, so set up the arrays of
+    // pointers, as the non-member AddMatMatBatched() does.
+    Real **device_abc_array = static_cast<Real**>(
+        CuDevice::Instantiate().Malloc(3 * batch_count * sizeof(Real*)));
+    std::vector<const Real*> host_abc_array(3 * batch_count);
+    for (int32 i = 0; i < batch_count; i++) {
+      host_abc_array[i] = A.data_ + i * static_cast<size_t>(a_offset);
+      host_abc_array[batch_count + i] =
+          B.data_ + i * static_cast<size_t>(b_offset);
+      host_abc_array[2 * batch_count + i] =
+          data_ + i * static_cast<size_t>(this_offset);
+    }
+    CU_SAFE_CALL(cudaMemcpy(device_abc_array, &(host_abc_array[0]),
+                            3 * batch_count * sizeof(Real*),
+                            cudaMemcpyHostToDevice));
+    const Real **device_a_array = const_cast<const Real**>(device_abc_array),
+        **device_b_array = device_a_array + batch_count;
+    CU_SAFE_CALL(cublas_gemmBatched(GetCublasHandle(),
+        (transB==kTrans? CUBLAS_OP_T:CUBLAS_OP_N),
+        (transA==kTrans? CUBLAS_OP_T:CUBLAS_OP_N),
+        m, n, k, alpha, device_b_array, B.Stride(),
+        device_a_array, A.Stride(), beta,
+        device_abc_array + 2 * batch_count, Stride(), batch_count));
+    CuDevice::Instantiate().Free(device_abc_array);
+#endif
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
+  } else
+#endif
+  {
+    // On the CPU we just do the products one by one; each one goes to the
+    // (possibly multi-threaded) BLAS.
+    for (int32 i = 0; i < batch_count; i++) {
+      SubMatrix<Real> C_i(data_ + i * static_cast<size_t>(this_offset),
+                          num_rows_, num_cols_, stride_),
+          A_i(A.data_ + i * static_cast<size_t>(a_offset),
+              A.num_rows_, A.num_cols_, A.stride_),
+          B_i(B.data_ + i * static_cast<size_t>(b_offset),
+              B.num_rows_, B.num_cols_, B.stride_);
+      C_i.AddMatMat(alpha, A_i, transA, B_i, transB, beta);
+    }
+  }
+}
+
 
 
 template<typename Real>
@@ -1074,14 +1220,14 @@ void CuMatrixBase<Real>::SymAddMat2(
 
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     cublasOperation_t trans = (transA == kTrans ? CUBLAS_OP_N : CUBLAS_OP_T);
     MatrixIndexT A_other_dim = (transA == kNoTrans ? A.num_cols_ : A.num_rows_);
     CU_SAFE_CALL(cublas_syrk(GetCublasHandle(), CUBLAS_FILL_MODE_UPPER, trans,
 			    num_rows_, A_other_dim, alpha, A.Data(),
 			    A.Stride(), beta, this->data_, this->stride_));
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -1104,7 +1250,7 @@ void CuMatrixBase<Real>::AddDiagVecMat(
     }
     KALDI_ASSERT(v.Dim() == this->NumRows());
 
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
 
     dim3 dimGrid(n_blocks(num_cols_, CU2DBLOCK),
@@ -1116,7 +1262,7 @@ void CuMatrixBase<Real>::AddDiagVecMat(
     cuda_add_diag_vec_mat(dimGrid, dimBlock, alpha, data_, Dim(),
                           v.Data(), M.Data(), M_row_stride, M_col_stride, beta);
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -1140,7 +1286,7 @@ void CuMatrixBase<Real>::AddMatDiagVec(
     }
     KALDI_ASSERT(v.Dim() == this->NumCols());
 
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     // Caution, this dimGrid is not the same way around as much of the other
     // code: going forward, I want to use the (rows, cols) order.
@@ -1152,7 +1298,7 @@ void CuMatrixBase<Real>::AddMatDiagVec(
     cuda_add_mat_diag_vec(dimGrid, dimBlock, alpha, data_, Dim(),
                           M.Data(), M_row_stride, M_col_stride, v.Data(),  beta);
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -1165,11 +1311,11 @@ void CuMatrixBase<Real>::AddMatMatElements(Real alpha,
     const CuMatrixBase<Real> &A, const CuMatrixBase<Real> &B, Real beta) {
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumCols(), CU2DBLOCK), n_blocks(NumRows(), CU2DBLOCK));
     cuda_add_mat_mat_elements(dimGrid, dimBlock, this->data_, A.Data(), B.Data(), Dim(), A.Stride(), B.Stride(), alpha, beta);
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -1183,7 +1329,7 @@ void CuMatrixBase<Real>::Sigmoid(const CuMatrixBase<Real> &src) {
   KALDI_ASSERT(SameDim(*this, src));
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
 
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(src.NumCols(), CU2DBLOCK), n_blocks(src.NumRows(), CU2DBLOCK));
@@ -1191,7 +1337,7 @@ void CuMatrixBase<Real>::Sigmoid(const CuMatrixBase<Real> &src) {
     cuda_sigmoid(dimGrid, dimBlock, this->data_, src.data_, this->Dim(), src.Stride());
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
   #endif
   {
@@ -1204,7 +1350,7 @@ void CuMatrixBase<Real>::SoftHinge(const CuMatrixBase<Real> &src) {
   KALDI_ASSERT(SameDim(*this, src));
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
 
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(src.NumCols(), CU2DBLOCK), n_blocks(src.NumRows(), CU2DBLOCK));
@@ -1212,7 +1358,7 @@ void CuMatrixBase<Real>::SoftHinge(const CuMatrixBase<Real> &src) {
     cuda_soft_hinge(dimGrid, dimBlock, this->data_, src.data_, this->Dim(), src.Stride());
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
   #endif
   {
@@ -1227,12 +1373,12 @@ void CuMatrixBase<Real>::GroupPnorm(const CuMatrixBase<Real> &src, Real power) {
                this->NumRows() == src.NumRows());
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(src.NumCols(), CU2DBLOCK), n_blocks(src.NumRows(), CU2DBLOCK));
     cuda_group_pnorm(dimGrid, dimBlock, this->data_, src.data_, this->Dim(), src.Stride(), group_size, power);
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
   #endif
   {
@@ -1247,13 +1393,13 @@ void CuMatrixBase<Real>::GroupMax(const CuMatrixBase<Real> &src) {
                this->NumRows() == src.NumRows());
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(src.NumCols(), CU2DBLOCK), n_blocks(src.NumRows(), CU2DBLOCK));
     cuda_group_max(dimGrid, dimBlock, this->data_, src.data_,
                    this->Dim(), src.Stride(), group_size);
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -1294,7 +1440,7 @@ void CuMatrix<Real>::CompObjfAndDeriv(const std::vector<MatrixElement<Real> >& s
     }
     void *addr = CuDevice::Instantiate().Malloc(sv_labels.size() * sizeof(MatrixElement<Real>));
     CU_SAFE_CALL(cudaMemcpy(addr, sv_labels.data(), sv_labels.size() * sizeof(MatrixElement<Real>), cudaMemcpyHostToDevice));
-    Timer tim;
+    CuTimer tim;
     CuVector<Real> tmp(2, kUndefined);
     int dimBlock(CU1DBLOCK);
     int dimGrid = 1; // only 1 block here. we have loops in each thread.
@@ -1305,7 +1451,7 @@ void CuMatrix<Real>::CompObjfAndDeriv(const std::vector<MatrixElement<Real> >& s
     *tot_objf = tmp_cpu(0);
     *tot_weight = tmp_cpu(1);
     CuDevice::Instantiate().Free(addr);
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -1324,18 +1470,27 @@ void CuMatrix<Real>::CompObjfAndDeriv(const std::vector<MatrixElement<Real> >& s
   }
 }
 
+#if HAVE_CUDA == 1
+// Returns the number of threads per block (one block per row) for the softmax
+// kernels, which need a multiple of the warp size.
+static inline size_t SoftmaxBlockSize(MatrixIndexT num_cols) {
+  if (num_cols >= CU1DBLOCK) return CU1DBLOCK;
+  return ((num_cols + 31) / 32) * 32;
+}
+#endif
+
 template<typename Real> // Y->this, X->src
 void CuMatrixBase<Real>::ApplySoftMaxPerRow(const CuMatrixBase<Real> &src) {
   KALDI_ASSERT(SameDim(*this, src));
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
-    size_t dimBlock = src.num_cols_ > CU1DBLOCK ? CU1DBLOCK : src.num_cols_;
+    CuTimer tim;
+    size_t dimBlock = SoftmaxBlockSize(src.num_cols_);
     size_t dimGrid = src.num_rows_;
     cuda_softmax_reduce(dimGrid, dimBlock, data_, src.data_, Dim(), src.Stride());
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
   #endif
   {
@@ -1352,14 +1507,14 @@ void CuMatrixBase<Real>::ApplyLogSoftMaxPerRow(const CuMatrixBase<Real> &src) {
   KALDI_ASSERT(SameDim(*this, src));
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
-    size_t dimBlock = src.num_cols_ > CU1DBLOCK ? CU1DBLOCK : src.num_cols_;
+    CuTimer tim;
+    size_t dimBlock = SoftmaxBlockSize(src.num_cols_);
     size_t dimGrid = src.num_rows_;
     cuda_log_softmax_reduce(dimGrid, dimBlock,
                             data_, src.data_, Dim(), src.Stride());
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -1371,6 +1526,36 @@ void CuMatrixBase<Real>::ApplyLogSoftMaxPerRow(const CuMatrixBase<Real> &src) {
   }
 }
 
+template<typename Real>
+void CuMatrixBase<Real>::ApplyScaledLogSoftMaxPerRow(
+    const CuMatrixBase<Real> &src, const CuVectorBase<Real> &log_priors,
+    Real scale) {
+  KALDI_ASSERT(SameDim(*this, src) && log_priors.Dim() == num_cols_);
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    CuTimer tim;
+    size_t dimBlock = SoftmaxBlockSize(src.num_cols_);
+    size_t dimGrid = src.num_rows_;
+    cuda_scaled_log_softmax_reduce(dimGrid, dimBlock, data_, src.data_,
+                                   log_priors.Data(), scale, Dim(),
+                                   src.Stride());
+    CU_SAFE_CALL(cudaGetLastError());
+
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
+  } else
+#endif
+  {
+    MatrixBase<Real> &mat(this->Mat());
+    mat.CopyFromMat(src.Mat());
+    for (MatrixIndexT r = 0; r < mat.NumRows(); r++) {
+      SubVector<Real> row(mat, r);
+      row.ApplyLogSoftMax();
+      row.AddVec(-1.0, log_priors.Vec());
+      row.Scale(scale);
+    }
+  }
+}
+
 // DiffSigmoid(Ein, Y, Eout) -> Eout.DiffSigmoid(Y, Ein).
 template<typename Real> // Eout -> *this, Ein -> diff, Y -> value
 void CuMatrixBase<Real>::DiffSigmoid(const CuMatrixBase<Real> &value,
@@ -1378,7 +1563,7 @@ void CuMatrixBase<Real>::DiffSigmoid(const CuMatrixBase<Real> &value,
   KALDI_ASSERT(SameDim(*this, value) && SameDim(*this, diff));
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
 
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(num_cols_, CU2DBLOCK), n_blocks(num_rows_, CU2DBLOCK));
@@ -1386,7 +1571,7 @@ void CuMatrixBase<Real>::DiffSigmoid(const CuMatrixBase<Real> &value,
     cuda_diff_sigmoid(dimGrid, dimBlock, data_, diff.data_, value.data_, Dim(), diff.Stride(), value.Stride());
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -1400,7 +1585,7 @@ void CuMatrixBase<Real>::Tanh(const CuMatrixBase<Real> &src) {
   KALDI_ASSERT(SameDim(*this, src));
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
 
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(src.NumCols(), CU2DBLOCK), n_blocks(src.NumRows(), CU2DBLOCK));
@@ -1408,7 +1593,7 @@ void CuMatrixBase<Real>::Tanh(const CuMatrixBase<Real> &src) {
     cuda_tanh(dimGrid, dimBlock, this->data_, src.data_, this->Dim(), src.Stride());
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -1423,7 +1608,7 @@ void CuMatrixBase<Real>::DiffTanh(const CuMatrixBase<Real> &value,
                                   const CuMatrixBase<Real> &diff) {
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
 
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(num_cols_, CU2DBLOCK), n_blocks(num_rows_, CU2DBLOCK));
@@ -1431,7 +1616,7 @@ void CuMatrixBase<Real>::DiffTanh(const CuMatrixBase<Real> &value,
     cuda_diff_tanh(dimGrid, dimBlock, data_, diff.data_, value.data_, Dim(), diff.Stride(), value.Stride());
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -1443,7 +1628,7 @@ template<typename Real>
 void CuMatrixBase<Real>::FindRowMaxId(CuArray<int32> *id) const {
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
 
     // initialize the vectors
     CuVector<Real> max(num_rows_);
@@ -1475,7 +1660,7 @@ void CuMatrixBase<Real>::FindRowMaxId(CuArray<int32> *id) const {
                            max.data_, id->Data(), offset, d);
     }
     // now we have the indices!
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -1508,14 +1693,14 @@ void CuMatrixBase<Real>::DiffXent(const CuArray<int32> &tgt,
 
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
 
     dim3 dimBlock(1, CU2DBLOCK*8);
     dim3 dimGrid(1, n_blocks(tgt.Dim(), CU2DBLOCK*8));
     cuda_diff_xent(dimGrid, dimBlock, tgt.Data(), data_,
                    log_post_tgt->data_, Dim());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -1659,13 +1844,13 @@ void CuMatrixBase<Real>::SymInvertPosDef() {
   if (num_rows_ == 0) return;
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     CuMatrix<Real> inv_cholesky(num_rows_, num_rows_);
     this->Cholesky(&inv_cholesky);
     // note: SymAddMat2 only updates lower part of *this.
     this->SymAddMat2(1.0, inv_cholesky, kTrans, 0.0);
     this->CopyLowerToUpper();
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -1714,7 +1899,7 @@ Real TraceMatMat(const CuMatrixBase<Real> &A,
                             B, trans, 0.0);
       return sum_vec.Sum();
     } else {
-      Timer tim;
+      CuTimer tim;
       // the sizes of result_vec must match what we
       // call the kernels with, in cu-kernels.cu
       CuVector<Real> result_vec(trans == kTrans ? 4 : 2, kUndefined);
@@ -1726,7 +1911,7 @@ Real TraceMatMat(const CuMatrixBase<Real> &A,
       CU_SAFE_CALL(cudaGetLastError());
       Vector<Real> result_cpu(result_vec); // copying from CUDA faster than summing in CUDA.
       result = result_cpu.Sum();
-      CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+      CuDevice::Instantiate().AccuProfile(__func__, tim);
     }
   } else
 #endif
@@ -1784,7 +1969,7 @@ void AddMatMatBatched(const Real alpha, std::vector<CuSubMatrix<Real>* > &C,
 
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
 
     // place all data (A[batchCount], B[batchCount], C[batchCount]) in memory together
     // in order to make only one call of cudaMemcpy
@@ -1815,7 +2000,7 @@ void AddMatMatBatched(const Real alpha, std::vector<CuSubMatrix<Real>* > &C,
     CuDevice::Instantiate().Free(device_abc_array);
     delete[] host_abc_array;
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -1841,7 +2026,7 @@ template<typename Real>
 void CuMatrixBase<Real>::CopyRowsFromVec(const CuVectorBase<Real> &v) {
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     if (v.Dim() == num_rows_*num_cols_) {
       if (stride_ == num_cols_) {
         const Real* v_data = v.Data();
@@ -1862,7 +2047,7 @@ void CuMatrixBase<Real>::CopyRowsFromVec(const CuVectorBase<Real> &v) {
     } else {
       KALDI_ERR << "Wrong sized arguments";
     }
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -1874,7 +2059,7 @@ template<typename Real>
 void CuMatrixBase<Real>::CopyRowsFromVec(const VectorBase<Real> &v) {
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     if (v.Dim() == num_rows_*num_cols_) {
       if (stride_ == num_cols_) {
         const Real* v_data = v.Data();
@@ -1902,7 +2087,7 @@ void CuMatrixBase<Real>::CopyRowsFromVec(const VectorBase<Real> &v) {
     } else {
       KALDI_ERR << "Wrong sized arguments";
     }
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -1919,12 +2104,12 @@ void CuMatrixBase<Real>::CopyColFromVec(const CuVectorBase<Real> &v,
                static_cast<UnsignedMatrixIndexT>(num_cols_));
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     int dimBlock(CU1DBLOCK);
     int dimGrid(n_blocks(NumRows(), CU1DBLOCK));
     cuda_copy_col_from_vec(dimGrid, dimBlock, data_, v.Data(), col, Dim());
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -1936,14 +2121,14 @@ template<typename Real>
 void CuMatrixBase<Real>::ApplyPow(Real power) {
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumRows(), CU2DBLOCK),
                  n_blocks(NumCols(), CU2DBLOCK));
 
     cuda_apply_pow(dimGrid, dimBlock, data_, power, Dim());
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -1955,14 +2140,14 @@ template<typename Real>
 void CuMatrixBase<Real>::ApplyPowAbs(Real power, bool include_sign) {
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumRows(), CU2DBLOCK),
                  n_blocks(NumCols(), CU2DBLOCK));
 
     cuda_apply_pow_abs(dimGrid, dimBlock, data_, power, include_sign, Dim());
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -1974,14 +2159,14 @@ template<typename Real>
 void CuMatrixBase<Real>::ApplyHeaviside() {
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumRows(), CU2DBLOCK),
                  n_blocks(NumCols(), CU2DBLOCK));
 
     cuda_apply_heaviside(dimGrid, dimBlock, data_, Dim());
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -1994,13 +2179,13 @@ template<typename Real>
 void CuMatrixBase<Real>::ApplyExp() {
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumCols(), CU2DBLOCK), n_blocks(NumRows(), CU2DBLOCK));
 
     cuda_apply_exp(dimGrid, dimBlock, data_, Dim());
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -2013,13 +2198,13 @@ template<typename Real>
 void CuMatrixBase<Real>::ApplyFloor(Real floor_val) {
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumCols(), CU2DBLOCK), n_blocks(NumRows(), CU2DBLOCK));
 
     cuda_apply_floor(dimGrid, dimBlock, data_, floor_val, Dim());
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -2031,13 +2216,13 @@ template<typename Real>
 void CuMatrixBase<Real>::ApplyCeiling(Real ceiling_val) {
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumCols(), CU2DBLOCK), n_blocks(NumRows(), CU2DBLOCK));
 
     cuda_apply_ceiling(dimGrid, dimBlock, data_, ceiling_val, Dim());
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -2051,7 +2236,7 @@ void VectorBase<Real>::CopyRowsFromMat(const CuMatrixBase<Real> &mat) {
   KALDI_ASSERT(dim_ == mat.NumCols() * mat.NumRows());
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     if (mat.Stride() == mat.NumCols()) {
       cudaMemcpy(data_, mat.Data(), sizeof(Real)*dim_, cudaMemcpyDeviceToHost);
     } else {
@@ -2062,7 +2247,7 @@ void VectorBase<Real>::CopyRowsFromMat(const CuMatrixBase<Real> &mat) {
         vec_data += mat.NumCols();
       }
     }
-    CuDevice::Instantiate().AccuProfile("CuVectorBase::CopyRowsFromMat", tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile("CuVectorBase::CopyRowsFromMat", tim);
   } else
 #endif
   {
@@ -2084,13 +2269,13 @@ void CuMatrixBase<Real>::CopyCols(const CuMatrixBase<Real> &src,
   if (CuDevice::Instantiate().Enabled()) {
     KALDI_ASSERT(indices.Dim() == NumCols());
     KALDI_ASSERT(NumRows() == src.NumRows());
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     // This kernel, as it is newer has the (x,y) dims as (rows,cols).
     dim3 dimGrid(n_blocks(NumRows(), CU2DBLOCK), n_blocks(NumCols(), CU2DBLOCK));
     cuda_copy_cols(dimGrid, dimBlock, data_, src.Data(), indices.Data(), Dim(), src.Stride());
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -2107,13 +2292,13 @@ void CuMatrixBase<Real>::CopyRows(const CuMatrixBase<Real> &src,
     KALDI_ASSERT(static_cast<MatrixIndexT>(indices.Dim()) == NumRows());
     KALDI_ASSERT(NumCols() == src.NumCols());
 
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     // This kernel, as it is newer has the (x,y) dims as (rows,cols).
     dim3 dimGrid(n_blocks(NumRows(), CU2DBLOCK), n_blocks(NumCols(), CU2DBLOCK));
     cuda_copy_rows(dimGrid, dimBlock, data_, src.Data(), indices.Data(), Dim(), src.Stride());
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -2128,13 +2313,13 @@ void CuMatrixBase<Real>::AddCols(const CuMatrixBase<Real> &src,
   if (CuDevice::Instantiate().Enabled()) {
     KALDI_ASSERT(indices.Dim() == NumCols());
     KALDI_ASSERT(NumRows() == src.NumRows());
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     // This kernel, as it is newer has the (x,y) dims as (rows,cols).
     dim3 dimGrid(n_blocks(NumRows(), CU2DBLOCK), n_blocks(NumCols(), CU2DBLOCK));
     cuda_add_cols(dimGrid, dimBlock, data_, src.Data(), indices.Data(), Dim(), src.Stride());
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -2149,13 +2334,13 @@ void CuMatrixBase<Real>::CopyRows(const CuArray<const Real*> &src) {
   if (CuDevice::Instantiate().Enabled()) {
     KALDI_ASSERT(static_cast<MatrixIndexT>(src.Dim()) == NumRows());
 
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumRows(), CU2DBLOCK),
                  n_blocks(NumCols(), CU2DBLOCK));
     cuda_copy_rows(dimGrid, dimBlock, data_, src.Data(), Dim());
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -2171,13 +2356,13 @@ void CuMatrixBase<Real>::CopyToRows(const CuArray<Real*> &dst) const {
   if (CuDevice::Instantiate().Enabled()) {
     KALDI_ASSERT(static_cast<MatrixIndexT>(dst.Dim()) == NumRows());
 
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumRows(), CU2DBLOCK),
                  n_blocks(NumCols(), CU2DBLOCK));
     cuda_copy_to_rows(dimGrid, dimBlock, dst.Data(), data_, Dim());
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -2196,14 +2381,14 @@ void CuMatrixBase<Real>::AddRows(Real alpha,
     KALDI_ASSERT(static_cast<MatrixIndexT>(indexes.Dim()) == NumRows());
     KALDI_ASSERT(src.NumCols() == NumCols());
 
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumRows(), CU2DBLOCK),
                  n_blocks(NumCols(), CU2DBLOCK));
     cuda_add_rows(dimGrid, dimBlock, alpha,
                   data_, src.Data(), indexes.Data(), Dim(), src.Stride());
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -2219,13 +2404,13 @@ void CuMatrixBase<Real>::AddRows(Real alpha, const CuArray<const Real*> &src) {
   if (CuDevice::Instantiate().Enabled()) {
     KALDI_ASSERT(static_cast<MatrixIndexT>(src.Dim()) == NumRows());
 
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumRows(), CU2DBLOCK),
                  n_blocks(NumCols(), CU2DBLOCK));
     cuda_add_rows(dimGrid, dimBlock, alpha, data_, src.Data(), Dim());
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -2242,13 +2427,13 @@ void CuMatrixBase<Real>::AddToRows(Real alpha,
   if (CuDevice::Instantiate().Enabled()) {
     KALDI_ASSERT(static_cast<MatrixIndexT>(dst.Dim()) == NumRows());
 
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumRows(), CU2DBLOCK),
                  n_blocks(NumCols(), CU2DBLOCK));
     cuda_add_to_rows(dimGrid, dimBlock, alpha, dst.Data(), data_, Dim());
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -2266,13 +2451,13 @@ void CuMatrixBase<Real>::SumColumnRanges(const CuMatrixBase<Real> &src,
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
 
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     // This kernel, as it is newer has the (x,y) dims as (rows,cols).
     dim3 dimGrid(n_blocks(NumRows(), CU2DBLOCK), n_blocks(NumCols(), CU2DBLOCK));
     cuda_sum_column_ranges(dimGrid, dimBlock, data_, Dim(), src.Data(), src.Dim(), indices.Data());
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -2304,14 +2489,14 @@ void CuMatrixBase<Real>::AddRowRanges(const CuMatrixBase<Real> &src,
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
 
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumRows(), CU2DBLOCK),
                  n_blocks(NumCols(), CU2DBLOCK));
     cuda_add_row_ranges(dimGrid, dimBlock,
                         data_, Dim(), src.Data(), src.Dim(), indexes.Data());
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   { // Implement here for the CPU..
@@ -2340,14 +2525,14 @@ void CuMatrixBase<Real>::CopyLowerToUpper() {
   if (num_rows_ == 0) return;
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     int32 dim = this->num_rows_;
     dim3 dimGrid(n_blocks(dim, CU2DBLOCK),
                  n_blocks(dim, CU2DBLOCK));
     cuda_copy_low_upp(dimGrid, dimBlock, data_, Dim());
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -2361,14 +2546,14 @@ void CuMatrixBase<Real>::CopyUpperToLower() {
   if (num_rows_ == 0) return;
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     int32 dim = this->num_rows_;
     dim3 dimGrid(n_blocks(dim, CU2DBLOCK),
                  n_blocks(dim, CU2DBLOCK));
     cuda_copy_upp_low(dimGrid, dimBlock, data_, Dim());
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -2421,7 +2606,7 @@ template<typename Real>
 Real CuMatrixBase<Real>::Trace(bool check_square) const {
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     if (check_square) KALDI_ASSERT(this->num_rows_ == this->num_cols_);
     MatrixIndexT dim = std::min(this->num_rows_, this->num_cols_);
     CuVector<Real> tmp(1, kUndefined); // for result.
@@ -2429,7 +2614,7 @@ Real CuMatrixBase<Real>::Trace(bool check_square) const {
     int dimGrid = 1;// only 1 block here. we have loops in each thread  //(n_blocks(dim_, CU1DBLOCK));
     cuda_vec_sum(dimGrid, dimBlock, data_, tmp.Data(), dim, Stride() + 1);
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile("CuVectorBase::Sum", tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile("CuVectorBase::Sum", tim);
     return tmp(0);
   } else
 #endif
@@ -2448,9 +2633,16 @@ void CuMatrixBase<Real>::CopyFromGeneralMat(const GeneralMatrix &src,
       return;
     }
     case kCompressedMatrix: {
-      Matrix<BaseFloat> mat;
-      src.GetMatrix(&mat);
-      this->CopyFromMat(mat, trans);
+      const CompressedMatrix &cmat = src.GetCompressedMatrix();
+#if HAVE_CUDA == 1
+      if (CuDevice::Instantiate().Enabled()) {
+        // Copy only the compressed bytes to the GPU, and decompress there.
+        CuCompressedMatrix cu_cmat(cmat);
+        cu_cmat.CopyToMat(this, trans);
+        return;
+      }
+#endif
+      cmat.CopyToMat(&(Mat()), trans);
       return;
     }
     case kSparseMatrix: {
@@ -2538,14 +2730,14 @@ void CuMatrix<Real>::Transpose() {
     return;
 #if HAVE_CUDA == 1
   if (this->num_rows_ == this->num_cols_ && CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     // (x,y) indices will be (row of *this, col of *this)
     dim3 dimGrid(n_blocks(this->num_rows_, CU2DBLOCK),
                  n_blocks(this->num_cols_, CU2DBLOCK));
     cuda_transpose_matrix(dimGrid, dimBlock, this->data_, this->Dim());
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -2582,7 +2774,7 @@ void CuMatrixBase<Real>::AddMatBlock(
   if (num_rows_ == 0) return;
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     MatrixDim this_dim = Dim();
 
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
@@ -2597,7 +2789,7 @@ void CuMatrixBase<Real>::AddMatBlock(
 
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -2626,6 +2818,105 @@ void CuMatrixBase<Real>::AddMatBlock(
   }
 }
 
+template<typename Real>
+void CuMatrixBase<Real>::AddMatSmat(
+    Real alpha, const CuMatrixBase<Real> &A,
+    const CuSparseMatrix<Real> &B, MatrixTransposeType transB,
+    Real beta) {
+  KALDI_ASSERT(NumRows() == A.NumRows());
+  if (transB == kNoTrans) {
+    KALDI_ASSERT(A.NumCols() == B.NumRows() && NumCols() == B.NumCols());
+  } else {
+    KALDI_ASSERT(A.NumCols() == B.NumCols() && NumCols() == B.NumRows());
+  }
+  if (num_rows_ == 0) return;
+  if (B.NumElements() == 0) {
+    if (beta == 0.0) SetZero();
+    else Scale(beta);
+    return;
+  }
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    CuTimer tim;
+    // cuSPARSE is column-major, like CUBLAS, so it sees *this and A as their
+    // transposes, and we compute (*this)^T = op(B)^T A^T; B is the sparse
+    // matrix (on the left) as cuSPARSE requires.
+    cusparseMatDescr_t descr;
+    CU_SAFE_CALL(cusparseCreateMatDescr(&descr));  // general, zero-based.
+    CU_SAFE_CALL(cusparse_csrmm2(GetCusparseHandle(),
+        (transB == kNoTrans ? CUSPARSE_OPERATION_TRANSPOSE :
+                              CUSPARSE_OPERATION_NON_TRANSPOSE),
+        CUSPARSE_OPERATION_NON_TRANSPOSE,
+        B.NumRows(), num_rows_, B.NumCols(), B.NumElements(), alpha, descr,
+        B.csr_val_.Data(), B.csr_row_ptr_.Data(), B.csr_col_idx_.Data(),
+        A.Data(), A.Stride(), beta, data_, stride_));
+    CU_SAFE_CALL(cusparseDestroyMatDescr(descr));
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
+  } else
+#endif
+  {
+    Mat().AddMatSmat(alpha, A.Mat(), B.Mat(), transB, beta);
+  }
+}
+
+template<typename Real>
+void CuMatrixBase<Real>::AddSmatMat(
+    Real alpha, const CuSparseMatrix<Real> &A,
+    MatrixTransposeType transA, const CuMatrixBase<Real> &B,
+    Real beta) {
+  KALDI_ASSERT(NumCols() == B.NumCols());
+  if (transA == kNoTrans) {
+    KALDI_ASSERT(NumRows() == A.NumRows() && A.NumCols() == B.NumRows());
+  } else {
+    KALDI_ASSERT(NumRows() == A.NumCols() && A.NumRows() == B.NumRows());
+  }
+  if (num_rows_ == 0) return;
+  if (A.NumElements() == 0) {
+    if (beta == 0.0) SetZero();
+    else Scale(beta);
+    return;
+  }
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    CuTimer tim;
+    // cuSPARSE needs the sparse matrix on the left and writes a column-major
+    // result, so we compute op(A) B into (the column-major view of) a
+    // row-major temporary of dimension NumCols() by NumRows().  cuSPARSE
+    // doesn't support transposing both operands, so if transA == kTrans we
+    // need B^T in the row-major layout.
+    CuMatrix<Real> this_trans(num_cols_, num_rows_, kUndefined);
+    cusparseMatDescr_t descr;
+    CU_SAFE_CALL(cusparseCreateMatDescr(&descr));  // general, zero-based.
+    if (transA == kNoTrans) {
+      CU_SAFE_CALL(cusparse_csrmm2(GetCusparseHandle(),
+          CUSPARSE_OPERATION_NON_TRANSPOSE, CUSPARSE_OPERATION_TRANSPOSE,
+          A.NumRows(), num_cols_, A.NumCols(), A.NumElements(), alpha, descr,
+          A.csr_val_.Data(), A.csr_row_ptr_.Data(), A.csr_col_idx_.Data(),
+          B.Data(), B.Stride(), 0.0, this_trans.Data(), this_trans.Stride()));
+    } else {
+      CuMatrix<Real> B_trans(B, kTrans);
+      CU_SAFE_CALL(cusparse_csrmm2(GetCusparseHandle(),
+          CUSPARSE_OPERATION_TRANSPOSE, CUSPARSE_OPERATION_NON_TRANSPOSE,
+          A.NumRows(), num_cols_, A.NumCols(), A.NumElements(), alpha, descr,
+          A.csr_val_.Data(), A.csr_row_ptr_.Data(), A.csr_col_idx_.Data(),
+          B_trans.Data(), B_trans.Stride(), 0.0, this_trans.Data(),
+          this_trans.Stride()));
+    }
+    CU_SAFE_CALL(cusparseDestroyMatDescr(descr));
+    if (beta == 0.0) {
+      CopyFromMat(this_trans, kTrans);
+    } else {
+      Scale(beta);
+      AddMat(1.0, this_trans, kTrans);
+    }
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
+  } else
+#endif
+  {
+    Mat().AddSmatMat(alpha, A.Mat(), transA, B.Mat(), beta);
+  }
+}
+
 template<typename Real>
 void CuMatrixBase<Real>::AddElements(Real alpha,
                                      const std::vector<MatrixElement<Real> >& input) {
@@ -2642,7 +2933,7 @@ void CuMatrixBase<Real>::AddElements(Real alpha,
                         input.size() * sizeof(MatrixElement<Real>),
                             cudaMemcpyHostToDevice));
 
-    Timer tim;
+    CuTimer tim;
     int dimBlock(CU1DBLOCK);
     int dimGrid = 1;// only 1 block here. we have loops in each thread  //(n_blocks(dim_, CU1DBLOCK));
 
@@ -2650,7 +2941,7 @@ void CuMatrixBase<Real>::AddElements(Real alpha,
                              alpha, (MatrixElement<Real>*)addr, input.size());
     CU_SAFE_CALL(cudaGetLastError());
     CuDevice::Instantiate().Free(addr);
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -2668,7 +2959,7 @@ void CuMatrixBase<Real>::AddElements(Real alpha, const CuArray<Int32Pair> &index
 
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     CuVector<Real> tmp_vec(indexes.Dim(), kUndefined);
     CU_SAFE_CALL(cudaMemcpy(tmp_vec.Data(), input, indexes.Dim() * sizeof(Real),
                             cudaMemcpyHostToDevice));
@@ -2678,7 +2969,7 @@ void CuMatrixBase<Real>::AddElements(Real alpha, const CuArray<Int32Pair> &index
     cuda_matrix_add_indexed_values(dimGrid, dimBlock, this->Dim(), alpha,
                                    indexes.Data(), tmp_vec.Data(), indexes.Dim(), this->data_);
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -2727,7 +3018,7 @@ void CuMatrixBase<Real>::Lookup(const CuArray<Int32Pair> &indices,
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
     CuArray<Real> cuda_output(num_elements);
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU1DBLOCK, 1);
     dim3 dimGrid(n_blocks(num_elements, CU1DBLOCK), 1);
 
@@ -2736,7 +3027,7 @@ void CuMatrixBase<Real>::Lookup(const CuArray<Int32Pair> &indices,
     CU_SAFE_CALL(cudaGetLastError());
 
     cuda_output.CopyToHost(output);
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -2761,14 +3052,14 @@ void CuMatrixBase<Real>::EqualElementMask(const CuMatrixBase<Real> &mat, CuMatri
 
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU2DBLOCK, CU2DBLOCK);
     dim3 dimGrid(n_blocks(NumCols(), CU2DBLOCK), n_blocks(NumRows(), CU2DBLOCK));
 
     cuda_equal_element_mask(dimGrid, dimBlock, this->data_, mat.Data(), mask->Data(), this->Dim(), mat.Stride(), mask->Stride());
     CU_SAFE_CALL(cudaGetLastError());
 
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
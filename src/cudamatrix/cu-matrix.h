@@ -41,6 +41,8 @@
 
 namespace kaldi {
 
+class CuEvent;
+
 template<typename Real>
 Real TraceMatMat(const CuMatrixBase<Real> &A, const CuMatrixBase<Real> &B,
                  MatrixTransposeType trans = kNoTrans);
@@ -239,6 +241,26 @@ class CuMatrixBase {
   void CopyToMat(MatrixBase<OtherReal> *dst,
                  MatrixTransposeType trans = kNoTrans) const;
 
+  /// Asynchronous version of CopyFromMat(src): queues the copy on the copy
+  /// stream (see CuDevice::GetCopyStream()) and returns without waiting for
+  /// it, so it can run while the GPU does computation that was queued
+  /// earlier; computation queued after this call waits for the copy.  "src"
+  /// must not be changed until the copy is done; if "done" is non-NULL it is
+  /// recorded so you can wait for that.  The copy is only really
+  /// asynchronous if "src" is pinned memory (see PinnedMatrix).  *this must
+  /// not be in use by computation that is still queued (e.g. alternate
+  /// between two buffers that were allocated beforehand).  If we are not
+  /// using a GPU, this is the same as CopyFromMat(src).
+  void CopyFromMatAsync(const MatrixBase<Real> &src, CuEvent *done = NULL);
+
+  /// Asynchronous version of CopyToMat(dst): queues the copy on the copy
+  /// stream, to start once the computation queued so far is done, and
+  /// records "done"; call done->Wait() before using the contents of "dst".
+  /// The copy is only really asynchronous if "dst" is pinned memory (see
+  /// PinnedMatrix).  *this must not be changed or freed until the copy is
+  /// done.  If we are not using a GPU, this is the same as CopyToMat(dst).
+  void CopyToMatAsync(MatrixBase<Real> *dst, CuEvent *done) const;
+
   void CopyRowsFromVec(const CuVectorBase<Real> &v);
 
   void CopyRowsFromVec(const VectorBase<Real> &v);
@@ -346,6 +368,15 @@ class CuMatrixBase {
   /// for each row, the max value is first subtracted for good numerical stability
   void ApplyLogSoftMaxPerRow(const CuMatrixBase<Real> &src);
 
+  /// Y = scale * (LogSoftmax(X) - log_priors), done to each row, in one pass
+  /// (log_priors is added to each row).  This turns the pre-softmax
+  /// activations of an acoustic model into the scaled "pseudo-likelihoods"
+  /// that the decoders use.  Because LogSoftmax(LogSoftmax(X)) ==
+  /// LogSoftmax(X), it is also correct if X is already normalized.
+  void ApplyScaledLogSoftMaxPerRow(const CuMatrixBase<Real> &src,
+                                   const CuVectorBase<Real> &log_priors,
+                                   Real scale);
+
   /// Find the id of the maximal element for each row
   void FindRowMaxId(CuArray<int32> *id) const;
 
@@ -398,6 +429,29 @@ class CuMatrixBase {
   /// C = alpha * A(^T)*B(^T) + beta * C
   void AddMatMat(Real alpha, const CuMatrixBase<Real> &A, MatrixTransposeType transA,
                  const CuMatrixBase<Real> &B, MatrixTransposeType transB, Real beta);
+
+  /// Does "batch_count" matrix multiplications of the same dimensions, whose
+  /// operands are laid out at regular intervals in memory.  For
+  /// 0 <= i < batch_count it does
+  ///   C_i = beta C_i + alpha A_i^{transA} B_i^{transB},
+  /// where C_0 is *this and C_i is the matrix with the same dimensions and
+  /// stride as *this that starts i * this_offset elements after Data(), and
+  /// A_i and B_i are defined in the same way from A, a_offset, B and b_offset.
+  /// An offset of zero means that the same matrix is used in every product.
+  /// For example, if *this, A and B are ColRange(0, dim) of larger matrices,
+  /// an offset of dim refers to the successive blocks of "dim" columns.
+  /// It's the caller's responsibility to make sure that all of the matrices
+  /// lie inside allocated memory, and that the C_i don't overlap.
+  /// This does the same as the non-member AddMatMatBatched(), but on a GPU
+  /// (with CUDA 8.0 or later) it uses cublas<t>gemmStridedBatched, which
+  /// doesn't need arrays of pointers to be set up and copied to the device.
+  void AddMatMatBatched(Real alpha,
+                        const CuMatrixBase<Real> &A, MatrixTransposeType transA,
+                        MatrixIndexT a_offset,
+                        const CuMatrixBase<Real> &B, MatrixTransposeType transB,
+                        MatrixIndexT b_offset,
+                        Real beta, MatrixIndexT this_offset,
+                        int32 batch_count);
   /// *this = a * b / c (by element; when c = 0, *this = a)
   void AddMatMatDivMat(const CuMatrixBase<Real> &A, const CuMatrixBase<Real> &B, const CuMatrixBase<Real> &C);
 
@@ -413,6 +467,20 @@ class CuMatrixBase {
   void AddMatBlock(Real alpha, const CuMatrixBase<Real> &A, MatrixTransposeType transA,
                    const CuBlockMatrix<Real> &B, MatrixTransposeType transB, Real beta);
 
+  /// *this = beta * *this + alpha * A * B [or B^T], where B is sparse.  On a
+  /// GPU this uses cuSPARSE, so no dense copy of B is made.
+  void AddMatSmat(Real alpha, const CuMatrixBase<Real> &A,
+                  const CuSparseMatrix<Real> &B, MatrixTransposeType transB,
+                  Real beta);
+
+  /// *this = beta * *this + alpha * A [or A^T] * B, where A is sparse.  On a
+  /// GPU this uses cuSPARSE, so no dense copy of A is made; but cuSPARSE's
+  /// output has the transposed layout, so a temporary matrix of the same size
+  /// as *this is needed (and, if transA == kTrans, a transposed copy of B).
+  void AddSmatMat(Real alpha, const CuSparseMatrix<Real> &A,
+                  MatrixTransposeType transA, const CuMatrixBase<Real> &B,
+                  Real beta);
+
   /// *this = beta * *this + alpha * diag(v) * M [or M^T].
   /// The same as adding M but scaling each row M_i by v(i).
   void AddDiagVecMat(const Real alpha, const CuVectorBase<Real> &v,
@@ -732,6 +800,14 @@ class CuSubMatrix: public CuMatrixBase<Real> {
                      const MatrixIndexT col_offset,
                      const MatrixIndexT num_cols);
 
+  /// This constructor makes a matrix that points to memory that the calling
+  /// code manages, e.g. part of a larger workspace (it must be GPU memory if we
+  /// are using a GPU).  'stride' must be >= num_cols.
+  inline CuSubMatrix(const Real *data,
+                     const MatrixIndexT num_rows,
+                     const MatrixIndexT num_cols,
+                     const MatrixIndexT stride);
+
   /// This type of constructor is needed for Range() to work [in CuMatrix base
   /// class]. Cannot make it explicit or that breaks.
   inline CuSubMatrix<Real> (const CuSubMatrix &other):
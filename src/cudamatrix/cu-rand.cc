@@ -72,7 +72,7 @@ CuRand<Real>::~CuRand() {
 template<typename Real> void CuRand<Real>::RandUniform(CuMatrixBase<Real> *tgt) {
 #if HAVE_CUDA == 1 
   if (CuDevice::Instantiate().Enabled()) { 
-    Timer tim;
+    CuTimer tim;
 
     int32 tgt_size = tgt->NumRows() * tgt->Stride();
     if (tgt_size != state_size_) SeedGpu(tgt_size);
@@ -83,7 +83,7 @@ template<typename Real> void CuRand<Real>::RandUniform(CuMatrixBase<Real> *tgt)
     cuda_rand(dimGrid, dimBlock, tgt->data_, z1_, z2_, z3_, z4_, tgt->Dim());
     CU_SAFE_CALL(cudaGetLastError());
   
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -96,7 +96,7 @@ template<typename Real> void CuRand<Real>::RandUniform(CuMatrixBase<Real> *tgt)
 template<typename Real> void CuRand<Real>::RandGaussian(CuMatrixBase<Real> *tgt) {
 #if HAVE_CUDA == 1 
   if (CuDevice::Instantiate().Enabled()) { 
-    Timer tim;
+    CuTimer tim;
     int32 tgt_size = tgt->NumRows() * tgt->Stride();
     if (tgt_size == 0)
       return;
@@ -108,7 +108,7 @@ template<typename Real> void CuRand<Real>::RandGaussian(CuMatrixBase<Real> *tgt)
     cuda_gauss_rand(dimGrid, dimBlock, tgt->data_, z1_, z2_, z3_, z4_, tgt->Dim());
     CU_SAFE_CALL(cudaGetLastError());
   
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -120,7 +120,7 @@ template<typename Real> void CuRand<Real>::RandGaussian(CuMatrixBase<Real> *tgt)
 template<typename Real> void CuRand<Real>::RandGaussian(CuVectorBase<Real> *tgt) {
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
 
     int32 tgt_size = tgt->Dim();
     if (tgt_size != state_size_) SeedGpu(tgt_size);
@@ -131,7 +131,7 @@ template<typename Real> void CuRand<Real>::RandGaussian(CuVectorBase<Real> *tgt)
     cuda_vec_gauss_rand(dimGrid, dimBlock, tgt->Data(), z1_, z2_, z3_, z4_, tgt->Dim());
 
     CU_SAFE_CALL(cudaGetLastError());
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
     
   } else
 #endif
@@ -144,7 +144,7 @@ template<typename Real> void CuRand<Real>::RandGaussian(CuVectorBase<Real> *tgt)
 template<typename Real> void CuRand<Real>::BinarizeProbs(const CuMatrix<Real> &probs, CuMatrix<Real> *states) {
 #if HAVE_CUDA == 1 
   if (CuDevice::Instantiate().Enabled()) { 
-    Timer tim;
+    CuTimer tim;
 
     // optionally re-seed the inner state 
     // (this is done in host, for good performance it is better to avoid re-seeding)
@@ -165,7 +165,7 @@ template<typename Real> void CuRand<Real>::BinarizeProbs(const CuMatrix<Real> &p
     cuda_binarize_probs(dimGrid, dimBlock, states->data_, probs.data_, tmp_.data_, states->Dim());
     CU_SAFE_CALL(cudaGetLastError());
   
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -171,6 +171,60 @@ static void UnitTestCuSparseMatrixSwap() {
   }
 }
 
+template <typename Real>
+static void UnitTestCuSparseMatrixAddMatSmat() {
+  for (int32 i = 0; i < 4; i++) {
+    MatrixIndexT row = 10 + Rand() % 40;
+    MatrixIndexT col = 10 + Rand() % 50;
+    MatrixIndexT inner = 10 + Rand() % 30;
+    MatrixTransposeType trans = (i % 2 == 0 ? kNoTrans : kTrans);
+    Real alpha = 0.5, beta = (i < 2 ? 0.0 : 2.0);
+
+    CuMatrix<Real> A(row, inner);
+    A.SetRandn();
+    SparseMatrix<Real> smat(trans == kNoTrans ? inner : col,
+                            trans == kNoTrans ? col : inner);
+    smat.SetRandn(0.8);
+    CuSparseMatrix<Real> cu_smat(smat);
+    CuMatrix<Real> B(smat.NumRows(), smat.NumCols());
+    cu_smat.CopyToMat(&B);
+
+    CuMatrix<Real> C1(row, col), C2(row, col);
+    C1.SetRandn();
+    C2.CopyFromMat(C1);
+    C1.AddMatMat(alpha, A, kNoTrans, B, trans, beta);
+    C2.AddMatSmat(alpha, A, cu_smat, trans, beta);
+    AssertEqual(C1, C2);
+  }
+}
+
+template <typename Real>
+static void UnitTestCuSparseMatrixAddSmatMat() {
+  for (int32 i = 0; i < 4; i++) {
+    MatrixIndexT row = 10 + Rand() % 40;
+    MatrixIndexT col = 10 + Rand() % 50;
+    MatrixIndexT inner = 10 + Rand() % 30;
+    MatrixTransposeType trans = (i % 2 == 0 ? kNoTrans : kTrans);
+    Real alpha = 0.5, beta = (i < 2 ? 0.0 : 2.0);
+
+    SparseMatrix<Real> smat(trans == kNoTrans ? row : inner,
+                            trans == kNoTrans ? inner : row);
+    smat.SetRandn(0.8);
+    CuSparseMatrix<Real> cu_smat(smat);
+    CuMatrix<Real> A(smat.NumRows(), smat.NumCols());
+    cu_smat.CopyToMat(&A);
+    CuMatrix<Real> B(inner, col);
+    B.SetRandn();
+
+    CuMatrix<Real> C1(row, col), C2(row, col);
+    C1.SetRandn();
+    C2.CopyFromMat(C1);
+    C1.AddMatMat(alpha, A, trans, B, kNoTrans, beta);
+    C2.AddSmatMat(alpha, cu_smat, trans, B, beta);
+    AssertEqual(C1, C2);
+  }
+}
+
 template <typename Real>
 void CudaSparseMatrixUnitTest() {
   UnitTestCuSparseMatrixTraceMatSmat<Real>();
@@ -178,6 +232,8 @@ void CudaSparseMatrixUnitTest() {
   UnitTestCuSparseMatrixFrobeniusNorm<Real>();
   UnitTestCuSparseMatrixCopyToSmat<Real>();
   UnitTestCuSparseMatrixSwap<Real>();
+  UnitTestCuSparseMatrixAddMatSmat<Real>();
+  UnitTestCuSparseMatrixAddSmatMat<Real>();
 }
 
 
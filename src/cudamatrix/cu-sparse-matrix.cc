@@ -122,6 +122,9 @@ CuSparseMatrix<Real>& CuSparseMatrix<Real>::operator = (
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
     elements_ = smat.elements_;
+    csr_row_ptr_ = smat.csr_row_ptr_;
+    csr_col_idx_ = smat.csr_col_idx_;
+    csr_val_ = smat.csr_val_;
     num_rows_ = smat.num_rows_;
     num_cols_ = smat.num_cols_;
   } else
@@ -141,22 +144,35 @@ void CuSparseMatrix<Real>::CopyFromSmat(const SparseMatrix<OtherReal> &smat) {
   if (CuDevice::Instantiate().Enabled()) {
     if (num_rows_ == 0 || num_cols_ == 0) {
       elements_.Resize(0);
+      csr_row_ptr_.Resize(0);
+      csr_col_idx_.Resize(0);
+      csr_val_.Resize(0);
       return;
     }
     // We first prepare <elements_> on CPU, we then move it to GPU by calling
     // CopyFromVec. This piece of code should be changed if we change the data
     // structure later.
     std::vector<MatrixElement<Real> > cpu_elements;
+    // We prepare the CSR arrays at the same time.
+    std::vector<int32> cpu_row_ptr(num_rows_ + 1), cpu_col_idx;
+    std::vector<Real> cpu_val;
     for (int32 i = 0; i < smat.NumRows(); ++i) {
+      cpu_row_ptr[i] = cpu_elements.size();
       for (int32 j = 0; j < (smat.Data() + i)->NumElements(); ++j) {
         MatrixElement<Real> cpu_element;
         cpu_element.row = i;
         cpu_element.column = ((smat.Data() + i)->Data() + j)->first;
         cpu_element.weight = ((smat.Data() + i)->Data() + j)->second;
         cpu_elements.push_back(cpu_element);
+        cpu_col_idx.push_back(cpu_element.column);
+        cpu_val.push_back(cpu_element.weight);
       }
     }
+    cpu_row_ptr[num_rows_] = cpu_elements.size();
     elements_.CopyFromVec(cpu_elements);
+    csr_row_ptr_.CopyFromVec(cpu_row_ptr);
+    csr_col_idx_.CopyFromVec(cpu_col_idx);
+    csr_val_.CopyFromVec(cpu_val);
   } else
 #endif
   {
@@ -223,9 +239,10 @@ template <typename Real>
 void CuSparseMatrix<Real>::Swap(CuSparseMatrix<Real> *smat) {
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    CuArray<MatrixElement<Real> > tmp_elements(elements_);
-    elements_ = smat->elements_;
-    smat->elements_ = tmp_elements;
+    elements_.Swap(&(smat->elements_));
+    csr_row_ptr_.Swap(&(smat->csr_row_ptr_));
+    csr_col_idx_.Swap(&(smat->csr_col_idx_));
+    csr_val_.Swap(&(smat->csr_val_));
     MatrixIndexT tmp_dim = num_rows_;
     num_rows_ = smat->num_rows_;
     smat->num_rows_ = tmp_dim;
@@ -294,7 +311,7 @@ Real TraceMatSmat(const CuMatrixBase<Real> &A,
     // The Sum() method in CuVector handles a bunch of logic, we use that to
     // comptue the trace.
     CuVector<Real> sum_vec(B.NumElements());
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU1DBLOCK, 1);
     dim3 dimGrid(n_blocks(B.NumElements(), CU1DBLOCK), 1);
     if (trans == kNoTrans) {
@@ -305,7 +322,7 @@ Real TraceMatSmat(const CuMatrixBase<Real> &A,
                                 A.Dim(), B.NumElements(), sum_vec.Data());
     }
     result = sum_vec.Sum();
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
@@ -375,7 +392,7 @@ void CuSparseMatrix<Real>::CopyToMat(CuMatrixBase<OtherReal> *M,
   }
 #if HAVE_CUDA == 1
   if (CuDevice::Instantiate().Enabled()) {
-    Timer tim;
+    CuTimer tim;
     dim3 dimBlock(CU1DBLOCK, 1);
     dim3 dimGrid(n_blocks(this->NumElements(), CU1DBLOCK), 1);
     if (trans == kNoTrans) {
@@ -385,7 +402,7 @@ void CuSparseMatrix<Real>::CopyToMat(CuMatrixBase<OtherReal> *M,
       cuda_copy_from_smat_trans(dimGrid, dimBlock, M->Data(),
                                 this->Data(), M->Dim(), this->NumElements());
     }
-    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+    CuDevice::Instantiate().AccuProfile(__func__, tim);
   } else
 #endif
   {
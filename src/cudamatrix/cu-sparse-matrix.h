@@ -119,7 +119,8 @@ class CuSparseMatrix {
 
   // Use the CuMatrix::CopyFromSmat() function to copy from this to
   // CuMatrix.
-  // Also see CuMatrix::AddSmat().
+  // Also see CuMatrix::AddSmat(), and CuMatrix::AddMatSmat() and
+  // CuMatrix::AddSmatMat() for products with dense matrices.
 
  protected:
   // The following two functions should only be called if we did not compile
@@ -145,6 +146,16 @@ class CuSparseMatrix {
   // elements, instead of a list for each row.  This is better suited to
   // CUDA code.
   CuArray<MatrixElement<Real> > elements_;
+
+  // The same matrix in compressed sparse row (CSR) format, which is what
+  // cuSPARSE needs; it's used by CuMatrixBase::AddMatSmat() and AddSmatMat().
+  // csr_row_ptr_ has dimension NumRows() + 1 (or zero if the matrix is
+  // empty), and the elements of row r are csr_row_ptr_[r] <= i <
+  // csr_row_ptr_[r+1] of csr_col_idx_ and csr_val_.  Like elements_, these
+  // are only used if we are using a GPU.
+  CuArray<int32> csr_row_ptr_;
+  CuArray<int32> csr_col_idx_;
+  CuArray<Real> csr_val_;
 };
 
 
@@ -0,0 +1,150 @@
+// cudamatrix/cu-stream.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#if HAVE_CUDA == 1
+#include <cuda_runtime_api.h>
+#endif
+
+#include "cudamatrix/cu-stream.h"
+#include "cudamatrix/cu-device.h"
+#include "base/kaldi-utils.h"
+
+namespace kaldi {
+
+CuEvent::~CuEvent() {
+#if HAVE_CUDA == 1
+  // If the event has been recorded but is not done yet, CUDA releases it once
+  // it's done.
+  if (created_)
+    cudaEventDestroy(event_);
+#endif
+}
+
+void CuEvent::Wait() {
+#if HAVE_CUDA == 1
+  if (recorded_)
+    CU_SAFE_CALL(cudaEventSynchronize(event_));
+#endif
+}
+
+bool CuEvent::Done() {
+#if HAVE_CUDA == 1
+  if (recorded_) {
+    cudaError_t e = cudaEventQuery(event_);
+    if (e == cudaErrorNotReady)
+      return false;
+    CU_SAFE_CALL(e);
+  }
+#endif
+  return true;
+}
+
+#if HAVE_CUDA == 1
+void CuEvent::Record(cudaStream_t stream) {
+  if (!created_) {
+    // We don't need the event for timing, and events that don't record
+    // timing information are faster to record and wait for.
+    CU_SAFE_CALL(cudaEventCreateWithFlags(&event_, cudaEventDisableTiming));
+    created_ = true;
+  }
+  CU_SAFE_CALL(cudaEventRecord(event_, stream));
+  recorded_ = true;
+}
+
+void CuEvent::MakeStreamWait(cudaStream_t stream) {
+  if (recorded_)
+    CU_SAFE_CALL(cudaStreamWaitEvent(stream, event_, 0));
+}
+#endif
+
+
+template<typename Real>
+void PinnedMatrix<Real>::Init(MatrixIndexT rows, MatrixIndexT cols,
+                              MatrixResizeType resize_type) {
+  KALDI_ASSERT(rows >= 0 && cols >= 0 &&
+               (resize_type == kSetZero || resize_type == kUndefined));
+  if (rows == 0 || cols == 0) {
+    this->data_ = NULL;
+    this->num_rows_ = 0;
+    this->num_cols_ = 0;
+    this->stride_ = 0;
+    return;
+  }
+  // Use the same stride as Matrix, so each row is 16-byte aligned.
+  MatrixIndexT skip = ((16 / sizeof(Real)) - cols % (16 / sizeof(Real)))
+      % (16 / sizeof(Real)),
+      stride = cols + skip;
+  size_t num_bytes = static_cast<size_t>(rows) * stride * sizeof(Real);
+  void *data = NULL;
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    data = CuDevice::Instantiate().MallocPinned(num_bytes);
+    pinned_ = true;
+  }
+#endif
+  if (data == NULL) {
+    void *temp;
+    if ((data = KALDI_MEMALIGN(16, num_bytes, &temp)) == NULL)
+      throw std::bad_alloc();
+    pinned_ = false;
+  }
+  this->data_ = static_cast<Real*>(data);
+  this->num_rows_ = rows;
+  this->num_cols_ = cols;
+  this->stride_ = stride;
+  if (resize_type == kSetZero)
+    this->SetZero();
+}
+
+template<typename Real>
+void PinnedMatrix<Real>::Destroy() {
+  if (this->data_ != NULL) {
+#if HAVE_CUDA == 1
+    if (pinned_) {
+      CuDevice::Instantiate().FreePinned(this->data_);
+    } else
+#endif
+    {
+      KALDI_MEMALIGN_FREE(this->data_);
+    }
+  }
+  this->data_ = NULL;
+  this->num_rows_ = 0;
+  this->num_cols_ = 0;
+  this->stride_ = 0;
+}
+
+template<typename Real>
+void PinnedMatrix<Real>::Resize(MatrixIndexT rows, MatrixIndexT cols,
+                                MatrixResizeType resize_type) {
+  if (rows == this->num_rows_ && cols == this->num_cols_) {
+    if (resize_type == kSetZero)
+      this->SetZero();
+    return;
+  }
+  Destroy();
+  Init(rows, cols, resize_type);
+}
+
+template class PinnedMatrix<float>;
+template class PinnedMatrix<double>;
+
+
+} // end namespace kaldi.
@@ -0,0 +1,114 @@
+// cudamatrix/cu-stream.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_CUDAMATRIX_CU_STREAM_H_
+#define KALDI_CUDAMATRIX_CU_STREAM_H_
+
+#include "base/kaldi-common.h"
+#include "matrix/kaldi-matrix.h"
+#include "cudamatrix/cu-common.h"
+
+namespace kaldi {
+
+/**
+   CuEvent marks a point in the sequence of work queued on a CUDA stream, so
+   that the host (or another stream) can wait for that work to finish.  It's
+   used with the asynchronous copy functions CuMatrixBase::CopyFromMatAsync()
+   and CuMatrixBase::CopyToMatAsync().  If we are not using a GPU, all
+   operations are done synchronously and the functions of this class do
+   nothing.  The underlying CUDA event is only created when first recorded.
+*/
+class CuEvent {
+ public:
+  CuEvent(): created_(false), recorded_(false) { }
+
+  ~CuEvent();
+
+  /// Blocks until the work that was queued before the most recent Record()
+  /// has finished.  Returns immediately if Record() was never called.
+  void Wait();
+
+  /// Returns true if the work that was queued before the most recent Record()
+  /// has finished (or if Record() was never called).  Does not block.
+  bool Done();
+
+#if HAVE_CUDA == 1
+  /// Records the event on "stream": it will be "done" when all the work
+  /// queued on "stream" so far has finished.
+  void Record(cudaStream_t stream);
+
+  /// Makes all work queued on "stream" after this call wait until the event is
+  /// done.  Does not block the host.  Does nothing if Record() was never
+  /// called.
+  void MakeStreamWait(cudaStream_t stream);
+#endif
+
+ private:
+#if HAVE_CUDA == 1
+  cudaEvent_t event_;
+#endif
+  bool created_;
+  bool recorded_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(CuEvent);
+};
+
+
+/**
+   PinnedMatrix is a MatrixBase whose memory is "pinned" (page-locked) host
+   memory, allocated with cudaHostAlloc() if we are using a GPU.  The GPU can
+   copy to and from pinned memory directly, which is faster than copying from
+   ordinary memory, and it's required for CuMatrixBase::CopyFromMatAsync() and
+   CopyToMatAsync() to be truly asynchronous (with ordinary memory, CUDA does
+   the copies synchronously).  Pinned memory is slow to allocate, so it's
+   cached for reuse (see CuPinnedMemoryAllocator), and these objects can be
+   created and destroyed as freely as a Matrix.  If we are not using a GPU
+   when it's allocated, the memory is ordinary (aligned) memory.
+*/
+template<typename Real>
+class PinnedMatrix: public MatrixBase<Real> {
+ public:
+  PinnedMatrix(): pinned_(false) { Init(0, 0, kUndefined); }
+
+  /// "resize_type" may be kSetZero or kUndefined.
+  PinnedMatrix(MatrixIndexT rows, MatrixIndexT cols,
+               MatrixResizeType resize_type = kSetZero): pinned_(false) {
+    Init(rows, cols, resize_type);
+  }
+
+  /// Changes the size; "resize_type" may be kSetZero or kUndefined.  The
+  /// memory is only reallocated if the dimensions change.
+  void Resize(MatrixIndexT rows, MatrixIndexT cols,
+              MatrixResizeType resize_type = kSetZero);
+
+  ~PinnedMatrix() { Destroy(); }
+
+ private:
+  void Init(MatrixIndexT rows, MatrixIndexT cols,
+            MatrixResizeType resize_type);
+  void Destroy();
+
+  bool pinned_;  // true if the memory is pinned memory.
+  KALDI_DISALLOW_COPY_AND_ASSIGN(PinnedMatrix);
+};
+
+
+} // end namespace kaldi.
+
+#endif
@@ -49,6 +49,26 @@ inline cublasStatus_t cublas_gemmBatched(cublasHandle_t handle, cublasOperation_
 		double *C[], int ldc, int batchCount) {
   return cublasDgemmBatched(handle, transa, transb, m, n, k, &alpha, A, lda, B, ldb, &beta, C, ldc, batchCount); 
 }
+#if CUDART_VERSION >= 8000
+inline cublasStatus_t cublas_gemmStridedBatched(cublasHandle_t handle,
+    cublasOperation_t transa, cublasOperation_t transb, int m, int n, int k,
+    float alpha, const float *A, int lda, long long int strideA,
+    const float *B, int ldb, long long int strideB, float beta,
+    float *C, int ldc, long long int strideC, int batchCount) {
+  return cublasSgemmStridedBatched(handle, transa, transb, m, n, k, &alpha,
+                                   A, lda, strideA, B, ldb, strideB, &beta,
+                                   C, ldc, strideC, batchCount);
+}
+inline cublasStatus_t cublas_gemmStridedBatched(cublasHandle_t handle,
+    cublasOperation_t transa, cublasOperation_t transb, int m, int n, int k,
+    double alpha, const double *A, int lda, long long int strideA,
+    const double *B, int ldb, long long int strideB, double beta,
+    double *C, int ldc, long long int strideC, int batchCount) {
+  return cublasDgemmStridedBatched(handle, transa, transb, m, n, k, &alpha,
+                                   A, lda, strideA, B, ldb, strideB, &beta,
+                                   C, ldc, strideC, batchCount);
+}
+#endif
 inline cublasStatus_t cublas_trsm(cublasHandle_t handle, int m, int n, float alpha,
 	       	const float* A, int lda, float* B, int ldb) {
   return cublasStrsm_v2(handle,CUBLAS_SIDE_LEFT,CUBLAS_FILL_MODE_UPPER,CUBLAS_OP_N,CUBLAS_DIAG_NON_UNIT,m,n,&alpha,A,lda,B,ldb);
@@ -162,6 +182,27 @@ inline cublasStatus_t cublas_spr(cublasHandle_t handle, cublasFillMode_t uplo,
   return cublasDspr_v2(handle, uplo, n, &alpha, x, incx, AP);
 }
 
+// cuSPARSE wrappers.  These take the CSR arrays of a general matrix with
+// zero-based indexes; "descr" should be set up accordingly.
+inline cusparseStatus_t cusparse_csrmm2(cusparseHandle_t handle,
+    cusparseOperation_t transA, cusparseOperation_t transB, int m, int n,
+    int k, int nnz, float alpha, const cusparseMatDescr_t descr,
+    const float *csr_val, const int *csr_row_ptr, const int *csr_col_idx,
+    const float *B, int ldb, float beta, float *C, int ldc) {
+  return cusparseScsrmm2(handle, transA, transB, m, n, k, nnz, &alpha, descr,
+                         csr_val, csr_row_ptr, csr_col_idx, B, ldb, &beta,
+                         C, ldc);
+}
+inline cusparseStatus_t cusparse_csrmm2(cusparseHandle_t handle,
+    cusparseOperation_t transA, cusparseOperation_t transB, int m, int n,
+    int k, int nnz, double alpha, const cusparseMatDescr_t descr,
+    const double *csr_val, const int *csr_row_ptr, const int *csr_col_idx,
+    const double *B, int ldb, double beta, double *C, int ldc) {
+  return cusparseDcsrmm2(handle, transA, transB, m, n, k, nnz, &alpha, descr,
+                         csr_val, csr_row_ptr, csr_col_idx, B, ldb, &beta,
+                         C, ldc);
+}
+
 #endif
 }
 // namespace kaldi
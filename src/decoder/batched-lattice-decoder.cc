@@ -0,0 +1,118 @@
+// decoder/batched-lattice-decoder.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/batched-lattice-decoder.h"
+
+namespace kaldi {
+
+BatchedLatticeDecoder::BatchedLatticeDecoder(
+    const fst::Fst<fst::StdArc> &fst,
+    const LatticeFasterDecoderConfig &config,
+    int32 num_streams):
+    fst_(fst), config_(config) {
+  config.Check();
+  KALDI_ASSERT(num_streams > 0);
+  decoders_.resize(num_streams);
+  for (int32 s = 0; s < num_streams; s++)
+    decoders_[s] = new LatticeFasterDecoder(fst_, config_);
+}
+
+BatchedLatticeDecoder::~BatchedLatticeDecoder() {
+  for (size_t s = 0; s < decoders_.size(); s++)
+    delete decoders_[s];
+}
+
+void BatchedLatticeDecoder::InitDecoding(int32 stream) {
+  KALDI_ASSERT(stream >= 0 && stream < NumStreams());
+  decoders_[stream]->InitDecoding();
+}
+
+int32 BatchedLatticeDecoder::AdvanceDecoding(
+    const std::vector<DecodableInterface*> &decodables,
+    int32 max_num_frames) {
+  KALDI_ASSERT(decodables.size() == decoders_.size());
+  int32 num_steps = 0;
+  while (max_num_frames < 0 || num_steps < max_num_frames) {
+    bool any_advanced = false;
+    for (size_t s = 0; s < decoders_.size(); s++) {
+      DecodableInterface *decodable = decodables[s];
+      if (decodable == NULL) continue;
+      LatticeFasterDecoder *decoder = decoders_[s];
+      if (decodable->NumFramesReady() > decoder->NumFramesDecoded()) {
+        decoder->AdvanceDecoding(decodable, 1);
+        any_advanced = true;
+      }
+    }
+    if (!any_advanced) break;
+    num_steps++;
+  }
+  return num_steps;
+}
+
+void BatchedLatticeDecoder::Decode(
+    const std::vector<DecodableInterface*> &decodables) {
+  KALDI_ASSERT(decodables.size() <= decoders_.size());
+  size_t num_utts = decodables.size();
+  // 'active' is the same as 'decodables' except that streams that have
+  // finished are set to NULL.
+  std::vector<DecodableInterface*> active(decoders_.size(), NULL);
+  int32 num_active = 0;
+  for (size_t s = 0; s < num_utts; s++) {
+    if (decodables[s] != NULL) {
+      decoders_[s]->InitDecoding();
+      active[s] = decodables[s];
+      num_active++;
+    }
+  }
+  while (num_active > 0) {
+    for (size_t s = 0; s < num_utts; s++) {
+      DecodableInterface *decodable = active[s];
+      if (decodable == NULL) continue;
+      LatticeFasterDecoder *decoder = decoders_[s];
+      // We use the same test as LatticeFasterDecoder::Decode() to detect the
+      // end of the utterance.
+      if (decodable->IsLastFrame(decoder->NumFramesDecoded() - 1)) {
+        decoder->FinalizeDecoding();
+        active[s] = NULL;
+        num_active--;
+      } else {
+        decoder->AdvanceDecoding(decodable, 1);
+      }
+    }
+  }
+}
+
+void BatchedLatticeDecoder::FinalizeDecoding(int32 stream) {
+  KALDI_ASSERT(stream >= 0 && stream < NumStreams());
+  decoders_[stream]->FinalizeDecoding();
+}
+
+int32 BatchedLatticeDecoder::NumFramesDecoded(int32 stream) const {
+  KALDI_ASSERT(stream >= 0 && stream < NumStreams());
+  return decoders_[stream]->NumFramesDecoded();
+}
+
+const LatticeFasterDecoder &BatchedLatticeDecoder::GetDecoder(
+    int32 stream) const {
+  KALDI_ASSERT(stream >= 0 && stream < NumStreams());
+  return *(decoders_[stream]);
+}
+
+
+} // end namespace kaldi.
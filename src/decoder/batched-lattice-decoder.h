@@ -0,0 +1,107 @@
+// decoder/batched-lattice-decoder.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_BATCHED_LATTICE_DECODER_H_
+#define KALDI_DECODER_BATCHED_LATTICE_DECODER_H_
+
+#include <vector>
+#include "decoder/lattice-faster-decoder.h"
+
+namespace kaldi {
+
+/**
+   BatchedLatticeDecoder decodes a number of utterances ("streams") at the same
+   time, advancing all of them in lockstep, one frame at a time, against a
+   single shared decoding graph.  Each stream has its own LatticeFasterDecoder
+   (with its own token pools and hash), but the graph is shared and only read,
+   and because the streams visit the graph on the same frame one after the
+   other, the parts of the graph that are in use tend to stay in cache.
+
+   The more important reason for this class is that it allows the acoustic
+   scores for all active streams to be computed together.  Before each call to
+   AdvanceDecoding(), the calling code can compute the acoustic scores for the
+   next block of frames of every active stream in one batch (e.g. as a single
+   neural-net computation), and present them to this class through per-stream
+   DecodableInterface objects such as DecodableMatrixScaledMapped.  This class
+   only ever asks a stream's decodable object for frames that it says are
+   ready.
+
+   Streams are identified by an integer slot index 0 <= s < NumStreams().  A
+   slot is reused for a new utterance by calling InitDecoding(s).
+*/
+class BatchedLatticeDecoder {
+ public:
+  typedef fst::StdArc Arc;
+  typedef Arc::StateId StateId;
+
+  /// The "fst" must outlive this object.  "num_streams" is the maximum number
+  /// of utterances that can be decoded at the same time.
+  BatchedLatticeDecoder(const fst::Fst<fst::StdArc> &fst,
+                        const LatticeFasterDecoderConfig &config,
+                        int32 num_streams);
+
+  ~BatchedLatticeDecoder();
+
+  int32 NumStreams() const { return decoders_.size(); }
+
+  /// Starts decoding a new utterance in slot "stream".  Any previous utterance
+  /// in that slot is discarded.
+  void InitDecoding(int32 stream);
+
+  /// Advances all active streams in lockstep.  "decodables" must have size
+  /// NumStreams(); a NULL entry means that the stream is not to be advanced
+  /// (e.g. it is inactive, or finished).  At each step, every stream whose
+  /// decodable object has another frame ready decodes one frame; this repeats
+  /// until no stream has frames ready, or until "max_num_frames" steps have
+  /// been done (if max_num_frames >= 0).  Returns the number of steps done.
+  int32 AdvanceDecoding(const std::vector<DecodableInterface*> &decodables,
+                        int32 max_num_frames = -1);
+
+  /// Decodes complete utterances: calls InitDecoding() for every stream with a
+  /// non-NULL decodable, decodes them in lockstep until each reaches its last
+  /// frame, and calls FinalizeDecoding() for each.  "decodables" must have
+  /// size no greater than NumStreams().  The results can then be obtained
+  /// through GetDecoder(s).
+  void Decode(const std::vector<DecodableInterface*> &decodables);
+
+  /// Calls FinalizeDecoding() on the decoder of this stream.
+  void FinalizeDecoding(int32 stream);
+
+  /// Returns the number of frames decoded so far for this stream.
+  int32 NumFramesDecoded(int32 stream) const;
+
+  /// Gives access to the decoder of one stream, e.g. to call GetRawLattice(),
+  /// GetBestPath() or ReachedFinal().  Don't call Decode() or InitDecoding()
+  /// on it directly.
+  const LatticeFasterDecoder &GetDecoder(int32 stream) const;
+
+  const LatticeFasterDecoderConfig &GetOptions() const { return config_; }
+
+ private:
+  const fst::Fst<fst::StdArc> &fst_;
+  LatticeFasterDecoderConfig config_;
+  std::vector<LatticeFasterDecoder*> decoders_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(BatchedLatticeDecoder);
+};
+
+
+} // end namespace kaldi.
+
+#endif
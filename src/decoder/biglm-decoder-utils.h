@@ -0,0 +1,112 @@
+// decoder/biglm-decoder-utils.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_BIGLM_DECODER_UTILS_H_
+#define KALDI_DECODER_BIGLM_DECODER_UTILS_H_
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "fst/fstlib.h"
+#include "fstext/deterministic-fst.h"
+
+// This header contains things shared by BiglmFasterDecoder and
+// LatticeBiglmFasterDecoder, which index their tokens by pairs of states in
+// the decoding graph and in the LM-difference FST.
+
+namespace kaldi {
+
+/// Packs a (graph state, LM state) pair into the 64-bit key that the biglm
+/// decoders use in their HashList.  The LM state goes in the top 32 bits, and
+/// the bottom 32 bits are the graph state xor'ed with a multiplicative hash of
+/// the LM state.  HashList takes the key modulo the number of buckets, and
+/// without the xor the top bits would only reach a fraction of the buckets
+/// (a multiple of gcd(2^32, num-buckets)), so tokens that are in the same
+/// graph state with different LM states, which are common, would collide.
+inline uint64 ConstructBiglmPair(int32 fst_state, int32 lm_state) {
+  uint32 lm_hash = static_cast<uint32>(lm_state) * 2654435761u;
+  return (static_cast<uint64>(static_cast<uint32>(lm_state)) << 32) |
+      (static_cast<uint32>(fst_state) ^ lm_hash);
+}
+
+/// Returns the graph state of a key from ConstructBiglmPair().
+inline int32 BiglmPairToState(uint64 state_pair) {
+  uint32 lm_hash = static_cast<uint32>(state_pair >> 32) * 2654435761u;
+  return static_cast<int32>(static_cast<uint32>(state_pair) ^ lm_hash);
+}
+
+/// Returns the LM state of a key from ConstructBiglmPair().
+inline int32 BiglmPairToLmState(uint64 state_pair) {
+  return static_cast<int32>(static_cast<uint32>(state_pair >> 32));
+}
+
+
+/**
+   A small direct-mapped cache of the arcs of the LM-difference FST, which the
+   biglm decoders query every time a token crosses a word.  The tokens that
+   are active on a frame share few LM states and words, so the same arcs are
+   looked up many times, and going through the DeterministicOnDemandFst (often
+   a composition of two backoff LMs, behind virtual calls) each time is
+   expensive.  The cache is small enough to stay in the CPU cache, and unlike
+   fst::CacheDeterministicOnDemandFst it also remembers arcs that don't exist.
+ */
+class BiglmLmArcCache {
+ public:
+  typedef fst::StdArc Arc;
+  typedef Arc::Label Label;
+  typedef Arc::StateId StateId;
+
+  /// We don't take ownership of "fst".  "num_entries" must be a power of two.
+  explicit BiglmLmArcCache(fst::DeterministicOnDemandFst<Arc> *fst,
+                           int32 num_entries = 4096):
+      fst_(fst), mask_(num_entries - 1), entries_(num_entries) {
+    KALDI_ASSERT(num_entries > 0 && (num_entries & mask_) == 0);
+    for (int32 i = 0; i < num_entries; i++)
+      entries_[i].state = fst::kNoStateId;  // Invalidate all the entries.
+  }
+
+  /// As DeterministicOnDemandFst::GetArc().
+  inline bool GetArc(StateId s, Label ilabel, Arc *oarc) {
+    Entry &entry = entries_[(static_cast<uint32>(s) * 2654435761u +
+                             static_cast<uint32>(ilabel)) & mask_];
+    if (entry.state != s || entry.ilabel != ilabel) {
+      entry.state = s;
+      entry.ilabel = ilabel;
+      if (!fst_->GetArc(s, ilabel, &(entry.arc)))
+        entry.arc.nextstate = fst::kNoStateId;
+    }
+    if (entry.arc.nextstate == fst::kNoStateId)
+      return false;
+    *oarc = entry.arc;
+    return true;
+  }
+
+ private:
+  struct Entry {
+    StateId state;
+    Label ilabel;
+    Arc arc;  // arc.nextstate is kNoStateId if there is no arc.
+  };
+  fst::DeterministicOnDemandFst<Arc> *fst_;
+  uint32 mask_;
+  std::vector<Entry> entries_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(BiglmLmArcCache);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_DECODER_BIGLM_DECODER_UTILS_H_
@@ -27,6 +27,7 @@
 #include "lat/kaldi-lattice.h" // for CompactLatticeArc
 #include "decoder/faster-decoder.h" // for options class
 #include "fstext/deterministic-fst.h"
+#include "decoder/biglm-decoder-utils.h"
 
 namespace kaldi {
 
@@ -53,7 +54,7 @@ class BiglmFasterDecoder {
   typedef fst::StdArc Arc;
   typedef Arc::Label Label;
   typedef Arc::StateId StateId;
-  // A PairId will be constructed as: (StateId in fst) + (StateId in lm_diff_fst) << 32;
+  // A PairId is constructed by ConstructBiglmPair() (see biglm-decoder-utils.h).
   typedef uint64 PairId;
   typedef Arc::Weight Weight;
   
@@ -70,7 +71,8 @@ class BiglmFasterDecoder {
   BiglmFasterDecoder(const fst::Fst<fst::StdArc> &fst,
                      const BiglmFasterDecoderOptions &opts,
                      fst::DeterministicOnDemandFst<fst::StdArc> *lm_diff_fst):
-      fst_(fst), lm_diff_fst_(lm_diff_fst), opts_(opts), warned_noarc_(false) {
+      fst_(fst), lm_diff_fst_(lm_diff_fst), lm_arc_cache_(lm_diff_fst),
+      opts_(opts), warned_noarc_(false) {
     KALDI_ASSERT(opts_.hash_ratio >= 1.0);  // less doesn't make much sense.
     KALDI_ASSERT(opts_.max_active > 1);
     KALDI_ASSERT(fst.Start() != fst::kNoStateId &&
@@ -181,14 +183,14 @@ class BiglmFasterDecoder {
 
  private:
   inline PairId ConstructPair(StateId fst_state, StateId lm_state) {
-    return static_cast<PairId>(fst_state) + (static_cast<PairId>(lm_state) << 32);
+    return ConstructBiglmPair(fst_state, lm_state);
   }
   
   static inline StateId PairToState(PairId state_pair) {
-    return static_cast<StateId>(static_cast<uint32>(state_pair));
+    return BiglmPairToState(state_pair);
   }
   static inline StateId PairToLmState(PairId state_pair) {
-    return static_cast<StateId>(static_cast<uint32>(state_pair >> 32));
+    return BiglmPairToLmState(state_pair);
   }
 
   class Token {
@@ -318,7 +320,7 @@ class BiglmFasterDecoder {
       return lm_state; // no change in LM state if no word crossed.
     } else { // Propagate in the LM-diff FST.
       Arc lm_arc;
-      bool ans = lm_diff_fst_->GetArc(lm_state, arc->olabel, &lm_arc);
+      bool ans = lm_arc_cache_.GetArc(lm_state, arc->olabel, &lm_arc);
       if (!ans) { // this case is unexpected for statistical LMs.
         if (!warned_noarc_) {
           warned_noarc_ = true;
@@ -474,6 +476,7 @@ class BiglmFasterDecoder {
   HashList<PairId, Token*> toks_;
   const fst::Fst<fst::StdArc> &fst_;
   fst::DeterministicOnDemandFst<fst::StdArc> *lm_diff_fst_;
+  BiglmLmArcCache lm_arc_cache_;  // caches the arcs of lm_diff_fst_.
   BiglmFasterDecoderOptions opts_;
   bool warned_noarc_;
   std::vector<PairId> queue_;  // temp variable used in ProcessNonemitting,
@@ -0,0 +1,304 @@
+// decoder/csr-decoding-graph.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <sstream>
+#include "decoder/csr-decoding-graph.h"
+#include "util/kaldi-io.h"
+
+namespace kaldi {
+
+void CsrDecodingGraph::Clear() {
+  mapped_file_.Close();
+  start_ = fst::kNoStateId;
+  num_states_ = 0;
+  num_arcs_ = 0;
+  arc_offsets_storage_.assign(1, 0);
+  nonemitting_offsets_storage_.clear();
+  final_costs_storage_.clear();
+  ilabels_storage_.clear();
+  olabels_storage_.clear();
+  weights_storage_.clear();
+  nextstates_storage_.clear();
+  SetPointersToStorage();
+}
+
+void CsrDecodingGraph::SetPointersToStorage() {
+  num_states_ = final_costs_storage_.size();
+  num_arcs_ = ilabels_storage_.size();
+  arc_offsets_ = &(arc_offsets_storage_[0]);
+  nonemitting_offsets_ = (num_states_ == 0 ? NULL :
+                          &(nonemitting_offsets_storage_[0]));
+  final_costs_ = (num_states_ == 0 ? NULL : &(final_costs_storage_[0]));
+  ilabels_ = (num_arcs_ == 0 ? NULL : &(ilabels_storage_[0]));
+  olabels_ = (num_arcs_ == 0 ? NULL : &(olabels_storage_[0]));
+  weights_ = (num_arcs_ == 0 ? NULL : &(weights_storage_[0]));
+  nextstates_ = (num_arcs_ == 0 ? NULL : &(nextstates_storage_[0]));
+  memory_stats_.Set(static_cast<int64>(num_states_) * (3 * sizeof(int32)) +
+                    static_cast<int64>(num_arcs_) * (4 * sizeof(int32)));
+}
+
+void CsrDecodingGraph::Init(const fst::Fst<fst::StdArc> &fst) {
+  typedef fst::StdArc Arc;
+  Clear();
+  int32 num_states = 0;
+  for (fst::StateIterator<fst::Fst<Arc> > siter(fst); !siter.Done();
+       siter.Next())
+    num_states = std::max<int32>(num_states, siter.Value() + 1);
+
+  start_ = fst.Start();
+  arc_offsets_storage_.resize(num_states + 1);
+  nonemitting_offsets_storage_.resize(num_states);
+  final_costs_storage_.resize(num_states);
+
+  for (StateId s = 0; s < num_states; s++) {
+    arc_offsets_storage_[s] = ilabels_storage_.size();
+    final_costs_storage_[s] = fst.Final(s).Value();
+    // We make two passes over the arcs of each state: the first for the
+    // emitting arcs and the second for the non-emitting ones.
+    for (int32 pass = 0; pass < 2; pass++) {
+      if (pass == 1)
+        nonemitting_offsets_storage_[s] = ilabels_storage_.size();
+      for (fst::ArcIterator<fst::Fst<Arc> > aiter(fst, s); !aiter.Done();
+           aiter.Next()) {
+        const Arc &arc = aiter.Value();
+        if ((arc.ilabel != 0) == (pass == 0)) {
+          ilabels_storage_.push_back(arc.ilabel);
+          olabels_storage_.push_back(arc.olabel);
+          weights_storage_.push_back(arc.weight.Value());
+          nextstates_storage_.push_back(arc.nextstate);
+        }
+      }
+    }
+  }
+  arc_offsets_storage_[num_states] = ilabels_storage_.size();
+  SetPointersToStorage();
+  KALDI_VLOG(2) << "Created CSR decoding graph with " << num_states
+                << " states and " << num_arcs_ << " arcs.";
+}
+
+void CsrDecodingGraph::WriteHeader(std::ostream &os) const {
+  bool binary = true;
+  WriteToken(os, binary, "<CsrDecodingGraph>");
+  WriteToken(os, binary, "<NumStates>");
+  WriteBasicType(os, binary, num_states_);
+  WriteToken(os, binary, "<NumArcs>");
+  WriteBasicType(os, binary, num_arcs_);
+  WriteToken(os, binary, "<Start>");
+  WriteBasicType(os, binary, start_);
+}
+
+void CsrDecodingGraph::ReadHeader(std::istream &is) {
+  bool binary = true;
+  ExpectToken(is, binary, "<CsrDecodingGraph>");
+  ExpectToken(is, binary, "<NumStates>");
+  ReadBasicType(is, binary, &num_states_);
+  ExpectToken(is, binary, "<NumArcs>");
+  ReadBasicType(is, binary, &num_arcs_);
+  ExpectToken(is, binary, "<Start>");
+  ReadBasicType(is, binary, &start_);
+  if (num_states_ < 0 || num_arcs_ < 0)
+    KALDI_ERR << "Bad header reading CSR decoding graph: num-states = "
+              << num_states_ << ", num-arcs = " << num_arcs_;
+}
+
+// Outputs the number of elements of each of the 7 arrays of the graph, in
+// the order: arc_offsets, nonemitting_offsets, final_costs, ilabels, olabels,
+// weights, nextstates.  All elements are 4 bytes.
+static void GetArraySizes(int32 num_states, int32 num_arcs, size_t *sizes) {
+  sizes[0] = num_states + 1;
+  sizes[1] = sizes[2] = num_states;
+  sizes[3] = sizes[4] = sizes[5] = sizes[6] = num_arcs;
+}
+
+size_t CsrDecodingGraph::ComputeArrayOffsets(
+    size_t header_size, std::vector<size_t> *offsets) const {
+  size_t sizes[7];
+  GetArraySizes(num_states_, num_arcs_, sizes);
+  offsets->resize(7);
+  size_t pos = header_size;
+  for (int32 i = 0; i < 7; i++) {
+    pos = ((pos + kPageSize - 1) / kPageSize) * kPageSize;
+    (*offsets)[i] = pos;
+    pos += sizes[i] * 4;
+  }
+  return pos;
+}
+
+// Writes "num_bytes" zero bytes to the stream.
+static void WritePadding(std::ostream &os, size_t num_bytes) {
+  std::vector<char> zeros(num_bytes, '\0');
+  if (num_bytes > 0)
+    os.write(&(zeros[0]), num_bytes);
+}
+
+void CsrDecodingGraph::Write(std::ostream &os) const {
+  KALDI_ASSERT(sizeof(float) == 4 && sizeof(int32) == 4);
+  std::ostringstream header;
+  WriteHeader(header);
+  std::string header_str = header.str();
+  std::vector<size_t> offsets;
+  ComputeArrayOffsets(header_str.size(), &offsets);
+  const char *arrays[7] = {
+    reinterpret_cast<const char*>(arc_offsets_),
+    reinterpret_cast<const char*>(nonemitting_offsets_),
+    reinterpret_cast<const char*>(final_costs_),
+    reinterpret_cast<const char*>(ilabels_),
+    reinterpret_cast<const char*>(olabels_),
+    reinterpret_cast<const char*>(weights_),
+    reinterpret_cast<const char*>(nextstates_) };
+  size_t sizes[7];
+  GetArraySizes(num_states_, num_arcs_, sizes);
+  os.write(header_str.data(), header_str.size());
+  size_t pos = header_str.size();
+  for (int32 i = 0; i < 7; i++) {
+    WritePadding(os, offsets[i] - pos);
+    if (sizes[i] != 0)
+      os.write(arrays[i], sizes[i] * 4);
+    pos = offsets[i] + sizes[i] * 4;
+  }
+  if (!os.good())
+    KALDI_ERR << "Error writing CSR decoding graph to stream.";
+}
+
+void CsrDecodingGraph::Read(std::istream &is) {
+  Clear();
+  ReadHeader(is);
+  std::ostringstream header;
+  WriteHeader(header);
+  std::vector<size_t> offsets;
+  ComputeArrayOffsets(header.str().size(), &offsets);
+  // We don't rely on tellg() to find the padding, as it doesn't work for
+  // pipes.
+  size_t pos = header.str().size();
+  arc_offsets_storage_.resize(num_states_ + 1);
+  nonemitting_offsets_storage_.resize(num_states_);
+  final_costs_storage_.resize(num_states_);
+  ilabels_storage_.resize(num_arcs_);
+  olabels_storage_.resize(num_arcs_);
+  weights_storage_.resize(num_arcs_);
+  nextstates_storage_.resize(num_arcs_);
+  char *arrays[7] = {
+    reinterpret_cast<char*>(&(arc_offsets_storage_[0])),
+    reinterpret_cast<char*>(num_states_ == 0 ? NULL :
+                            &(nonemitting_offsets_storage_[0])),
+    reinterpret_cast<char*>(num_states_ == 0 ? NULL :
+                            &(final_costs_storage_[0])),
+    reinterpret_cast<char*>(num_arcs_ == 0 ? NULL : &(ilabels_storage_[0])),
+    reinterpret_cast<char*>(num_arcs_ == 0 ? NULL : &(olabels_storage_[0])),
+    reinterpret_cast<char*>(num_arcs_ == 0 ? NULL : &(weights_storage_[0])),
+    reinterpret_cast<char*>(num_arcs_ == 0 ? NULL :
+                            &(nextstates_storage_[0])) };
+  size_t sizes[7];
+  GetArraySizes(num_states_, num_arcs_, sizes);
+  for (int32 i = 0; i < 7; i++) {
+    is.ignore(offsets[i] - pos);
+    if (sizes[i] != 0)
+      is.read(arrays[i], sizes[i] * 4);
+    pos = offsets[i] + sizes[i] * 4;
+  }
+  if (!is.good())
+    KALDI_ERR << "Error reading CSR decoding graph (file truncated?)";
+  SetPointersToStorage();
+}
+
+bool CsrDecodingGraph::ReadMapped(const std::string &filename) {
+  Clear();
+  if (!mapped_file_.Open(filename))
+    return false;
+  const char *data = mapped_file_.Data();
+  size_t file_size = mapped_file_.Size();
+  // The header is much smaller than a page.
+  std::istringstream is(std::string(data, std::min<size_t>(file_size,
+                                                           kPageSize)));
+  ReadHeader(is);
+  std::ostringstream header;
+  WriteHeader(header);
+  std::vector<size_t> offsets;
+  size_t expected_size = ComputeArrayOffsets(header.str().size(), &offsets);
+  if (file_size < expected_size)
+    KALDI_ERR << "Mapped CSR decoding graph " << filename << " has size "
+              << file_size << ", expected " << expected_size
+              << " (truncated, or not written by WriteCsrDecodingGraph()?)";
+  arc_offsets_ = reinterpret_cast<const int32*>(data + offsets[0]);
+  nonemitting_offsets_ = reinterpret_cast<const int32*>(data + offsets[1]);
+  final_costs_ = reinterpret_cast<const float*>(data + offsets[2]);
+  ilabels_ = reinterpret_cast<const Label*>(data + offsets[3]);
+  olabels_ = reinterpret_cast<const Label*>(data + offsets[4]);
+  weights_ = reinterpret_cast<const float*>(data + offsets[5]);
+  nextstates_ = reinterpret_cast<const StateId*>(data + offsets[6]);
+  KALDI_VLOG(2) << "Mapped CSR decoding graph with " << num_states_
+                << " states and " << num_arcs_ << " arcs from " << filename;
+  return true;
+}
+
+void CsrDecodingGraph::Check() const {
+  int32 num_states = NumStates(), num_arcs = NumArcs();
+  KALDI_ASSERT(num_states == 0 || (start_ >= 0 && start_ < num_states));
+  KALDI_ASSERT(arc_offsets_[0] == 0 && arc_offsets_[num_states] == num_arcs);
+  for (StateId s = 0; s < num_states; s++) {
+    KALDI_ASSERT(arc_offsets_[s] <= nonemitting_offsets_[s] &&
+                 nonemitting_offsets_[s] <= arc_offsets_[s + 1]);
+    for (int32 a = arc_offsets_[s]; a < arc_offsets_[s + 1]; a++) {
+      KALDI_ASSERT(nextstates_[a] >= 0 && nextstates_[a] < num_states);
+      if (a < nonemitting_offsets_[s]) KALDI_ASSERT(ilabels_[a] != 0);
+      else KALDI_ASSERT(ilabels_[a] == 0);
+    }
+  }
+}
+
+
+void WriteCsrDecodingGraph(const std::string &wxfilename,
+                           const CsrDecodingGraph &graph) {
+  bool binary = true, write_header = false;
+  Output ko(wxfilename, binary, write_header);
+  graph.Write(ko.Stream());
+  ko.Close();
+}
+
+void ReadCsrDecodingGraph(const std::string &rxfilename, bool use_mmap,
+                          CsrDecodingGraph *graph) {
+  if (use_mmap && ClassifyRxfilename(rxfilename) == kFileInput) {
+    if (graph->ReadMapped(rxfilename))
+      return;
+    KALDI_WARN << "Could not memory-map " << rxfilename
+               << ", reading it instead.";
+  }
+  Input ki(rxfilename);  // no Kaldi binary header is expected.
+  graph->Read(ki.Stream());
+}
+
+
+void CuCsrDecodingGraph::CopyFromGraph(const CsrDecodingGraph &graph) {
+  start_ = graph.start_;
+  num_states_ = graph.NumStates();
+  int32 num_arcs = graph.NumArcs();
+  const int32 *ao = graph.arc_offsets_, *no = graph.nonemitting_offsets_,
+      *il = graph.ilabels_, *ol = graph.olabels_, *ns = graph.nextstates_;
+  const float *fc = graph.final_costs_, *w = graph.weights_;
+  arc_offsets_.CopyFromVec(std::vector<int32>(ao, ao + num_states_ + 1));
+  nonemitting_offsets_.CopyFromVec(std::vector<int32>(no, no + num_states_));
+  final_costs_.CopyFromVec(std::vector<BaseFloat>(fc, fc + num_states_));
+  ilabels_.CopyFromVec(std::vector<int32>(il, il + num_arcs));
+  olabels_.CopyFromVec(std::vector<int32>(ol, ol + num_arcs));
+  weights_.CopyFromVec(std::vector<BaseFloat>(w, w + num_arcs));
+  nextstates_.CopyFromVec(std::vector<int32>(ns, ns + num_arcs));
+}
+
+
+} // end namespace kaldi.
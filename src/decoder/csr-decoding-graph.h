@@ -0,0 +1,280 @@
+// decoder/csr-decoding-graph.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_CSR_DECODING_GRAPH_H_
+#define KALDI_DECODER_CSR_DECODING_GRAPH_H_
+
+#include <vector>
+#include "base/kaldi-common.h"
+#include "base/kaldi-memory-stats.h"
+#include "fst/fstlib.h"
+#include "cudamatrix/cu-array.h"
+#include "util/mapped-file.h"
+
+namespace kaldi {
+
+/**
+   CsrDecodingGraph is an immutable copy of a decoding graph (e.g. HCLG) in
+   "compressed sparse row" form: the arcs of all states are stored contiguously,
+   sorted by source state, with one array per arc field (struct-of-arrays
+   layout).  For each state, the emitting arcs (ilabel != 0) come first,
+   followed by the non-emitting (epsilon) arcs, so that ProcessEmitting() and
+   ProcessNonemitting()-type loops can each iterate over just the arcs they
+   need, with no test on the ilabel.
+
+   The arcs of state s are:
+     emitting:      EmittingBegin(s) <= a < NonemittingBegin(s)
+     non-emitting:  NonemittingBegin(s) <= a < ArcsEnd(s)
+   and EmittingBegin(s + 1) == ArcsEnd(s).
+
+   Unlike an OpenFst Fst, it requires no virtual function calls or iterator
+   objects to access, and all fields are 32-bit, so it's a suitable format both
+   for cache-friendly CPU decoding and for copying to the GPU (see
+   CuCsrDecodingGraph, below).  Final-costs are stored per state, as
+   infinity for non-final states.
+
+   The on-disk format (see Write()) can be memory-mapped (see ReadMapped()),
+   which makes loading a large graph almost instantaneous and lets several
+   decoding processes on the same machine share one copy of it.  Use the
+   program make-csr-graph to convert an FST to this format.
+*/
+class CsrDecodingGraph {
+ public:
+  typedef int32 StateId;
+  typedef int32 Label;
+
+  CsrDecodingGraph(): memory_stats_(kMemoryGraph) { Clear(); }
+
+  /// Initializes from an Fst.  The Fst must have all its state-ids
+  /// allocated contiguously from zero (true for VectorFst and ConstFst).
+  explicit CsrDecodingGraph(const fst::Fst<fst::StdArc> &fst):
+      memory_stats_(kMemoryGraph) { Init(fst); }
+
+  void Init(const fst::Fst<fst::StdArc> &fst);
+
+  /// Writes the graph in its on-disk format, which is binary-only and is laid
+  /// out (with each array starting at a multiple of kPageSize bytes from the
+  /// start of the object) so that ReadMapped() can use it in place.  For
+  /// ReadMapped() to work, the object has to be at the start of the file, so
+  /// write it with the Kaldi binary header turned off, e.g.
+  /// Output ko(wxfilename, true, false), or use WriteCsrDecodingGraph().
+  void Write(std::ostream &os) const;
+
+  /// Reads the graph into memory from a stream (as written by Write()).
+  void Read(std::istream &is);
+
+  /// Maps the file "filename" (which must be an ordinary file written by
+  /// WriteCsrDecodingGraph()) into memory and uses the arrays in place, so no
+  /// time is spent loading it, and processes that map the same file share a
+  /// single copy of it in the page cache.  Returns false (with a warning) if
+  /// the file could not be mapped, in which case the calling code may want to
+  /// fall back to Read().
+  bool ReadMapped(const std::string &filename);
+
+  /// Returns true if the arrays are memory-mapped from a file.
+  bool IsMapped() const { return mapped_file_.IsOpen(); }
+
+  StateId Start() const { return start_; }
+
+  int32 NumStates() const { return num_states_; }
+
+  int32 NumArcs() const { return num_arcs_; }
+
+  /// Returns the final-cost of state s, which will be infinity if s is not
+  /// final.
+  BaseFloat Final(StateId s) const { return final_costs_[s]; }
+
+  int32 EmittingBegin(StateId s) const { return arc_offsets_[s]; }
+  int32 NonemittingBegin(StateId s) const { return nonemitting_offsets_[s]; }
+  int32 ArcsEnd(StateId s) const { return arc_offsets_[s + 1]; }
+
+  Label ILabel(int32 arc) const { return ilabels_[arc]; }
+  Label OLabel(int32 arc) const { return olabels_[arc]; }
+  BaseFloat Weight(int32 arc) const { return weights_[arc]; }
+  StateId NextState(int32 arc) const { return nextstates_[arc]; }
+
+  /// Checks that the structure is internally consistent; dies with an error
+  /// if not.
+  void Check() const;
+
+  /// The alignment of the arrays in the on-disk format.
+  static const int32 kPageSize = 4096;
+
+ private:
+  friend class CuCsrDecodingGraph;
+
+  // Frees any storage and sets up an empty graph.
+  void Clear();
+  // Sets the array pointers to point to the data in the *_storage_ vectors.
+  void SetPointersToStorage();
+  // Writes the part of the on-disk format that precedes the arrays (not
+  // including the padding).
+  void WriteHeader(std::ostream &os) const;
+  // Reads the header written by WriteHeader(), setting start_, num_states_ and
+  // num_arcs_.
+  void ReadHeader(std::istream &is);
+  // Works out where each array starts, in bytes from the start of the
+  // object, and returns the total size of the object in bytes.
+  size_t ComputeArrayOffsets(size_t header_size,
+                             std::vector<size_t> *offsets) const;
+
+  StateId start_;
+  int32 num_states_;
+  int32 num_arcs_;
+
+  // The array pointers point either into the *_storage_ vectors below, or
+  // into mapped_file_.
+  // arc_offsets_ has dimension NumStates() + 1; the arcs of state s are
+  // arc_offsets_[s] <= a < arc_offsets_[s+1].
+  const int32 *arc_offsets_;
+  // nonemitting_offsets_ has dimension NumStates(); nonemitting_offsets_[s]
+  // is the index of the first non-emitting arc of state s (or
+  // arc_offsets_[s+1] if there are none).
+  const int32 *nonemitting_offsets_;
+  // The costs are stored as float even if BaseFloat is double, so the
+  // on-disk format doesn't depend on the precision.
+  const float *final_costs_;  // dimension NumStates().
+  // The following have dimension NumArcs().
+  const Label *ilabels_;
+  const Label *olabels_;
+  const float *weights_;
+  const StateId *nextstates_;
+
+  std::vector<int32> arc_offsets_storage_;
+  std::vector<int32> nonemitting_offsets_storage_;
+  std::vector<float> final_costs_storage_;
+  std::vector<Label> ilabels_storage_;
+  std::vector<Label> olabels_storage_;
+  std::vector<float> weights_storage_;
+  std::vector<StateId> nextstates_storage_;
+
+  MappedFile mapped_file_;
+
+  // The size of the *_storage_ vectors, for the memory statistics; a mapped
+  // graph is not counted, as its pages are shared and can be evicted.
+  MemoryStatsEstimate memory_stats_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(CsrDecodingGraph);
+};
+
+
+/// Writes the graph to "wxfilename" in the format that
+/// CsrDecodingGraph::ReadMapped() requires (i.e. with no Kaldi binary header).
+void WriteCsrDecodingGraph(const std::string &wxfilename,
+                           const CsrDecodingGraph &graph);
+
+/// Reads a graph written by WriteCsrDecodingGraph().  If "use_mmap" is true
+/// and "rxfilename" is an ordinary file, the graph is memory-mapped (see
+/// CsrDecodingGraph::ReadMapped()); otherwise it is read into memory.
+void ReadCsrDecodingGraph(const std::string &rxfilename, bool use_mmap,
+                          CsrDecodingGraph *graph);
+
+
+/// These classes iterate over, respectively, the emitting and the
+/// non-emitting arcs of a state of a CsrDecodingGraph.  They have the same
+/// interface as the OpenFst ArcIterator (without the Seek functions), so that
+/// a decoder templated on the arc-iterator type can use either; but they are
+/// not virtual, and they don't look at non-matching arcs at all.
+class CsrEmittingArcIterator {
+ public:
+  CsrEmittingArcIterator(const CsrDecodingGraph &graph,
+                         CsrDecodingGraph::StateId s):
+      graph_(graph), pos_(graph.EmittingBegin(s)),
+      end_(graph.NonemittingBegin(s)) { }
+  bool Done() const { return pos_ >= end_; }
+  void Next() { pos_++; }
+  fst::StdArc Value() const {
+    return fst::StdArc(graph_.ILabel(pos_), graph_.OLabel(pos_),
+                       fst::StdArc::Weight(graph_.Weight(pos_)),
+                       graph_.NextState(pos_));
+  }
+ private:
+  const CsrDecodingGraph &graph_;
+  int32 pos_;
+  int32 end_;
+};
+
+class CsrNonemittingArcIterator {
+ public:
+  CsrNonemittingArcIterator(const CsrDecodingGraph &graph,
+                            CsrDecodingGraph::StateId s):
+      graph_(graph), pos_(graph.NonemittingBegin(s)),
+      end_(graph.ArcsEnd(s)) { }
+  bool Done() const { return pos_ >= end_; }
+  void Next() { pos_++; }
+  fst::StdArc Value() const {
+    return fst::StdArc(0, graph_.OLabel(pos_),
+                       fst::StdArc::Weight(graph_.Weight(pos_)),
+                       graph_.NextState(pos_));
+  }
+ private:
+  const CsrDecodingGraph &graph_;
+  int32 pos_;
+  int32 end_;
+};
+
+
+/**
+   CuCsrDecodingGraph is a copy of a CsrDecodingGraph in GPU memory (or in
+   ordinary memory, if we are not using a GPU).  The arrays have the same
+   meaning as in CsrDecodingGraph.  This is the representation that a
+   device-side token-passing search would use: arc expansion for a frame can
+   be parallelized over the emitting arcs of the active states, with no
+   pointer-chasing.
+*/
+class CuCsrDecodingGraph {
+ public:
+  CuCsrDecodingGraph(): start_(fst::kNoStateId), num_states_(0) { }
+
+  explicit CuCsrDecodingGraph(const CsrDecodingGraph &graph) {
+    CopyFromGraph(graph);
+  }
+
+  void CopyFromGraph(const CsrDecodingGraph &graph);
+
+  int32 Start() const { return start_; }
+  int32 NumStates() const { return num_states_; }
+  int32 NumArcs() const { return ilabels_.Dim(); }
+
+  const CuArray<int32> &ArcOffsets() const { return arc_offsets_; }
+  const CuArray<int32> &NonemittingOffsets() const {
+    return nonemitting_offsets_;
+  }
+  const CuArray<BaseFloat> &FinalCosts() const { return final_costs_; }
+  const CuArray<int32> &ILabels() const { return ilabels_; }
+  const CuArray<int32> &OLabels() const { return olabels_; }
+  const CuArray<BaseFloat> &Weights() const { return weights_; }
+  const CuArray<int32> &NextStates() const { return nextstates_; }
+
+ private:
+  int32 start_;
+  int32 num_states_;
+  CuArray<int32> arc_offsets_;
+  CuArray<int32> nonemitting_offsets_;
+  CuArray<BaseFloat> final_costs_;
+  CuArray<int32> ilabels_;
+  CuArray<int32> olabels_;
+  CuArray<BaseFloat> weights_;
+  CuArray<int32> nextstates_;
+};
+
+
+} // end namespace kaldi.
+
+#endif
@@ -37,7 +37,8 @@ class DecodableMatrixScaledMapped: public DecodableInterface {
   DecodableMatrixScaledMapped(const TransitionModel &tm,
                               const Matrix<BaseFloat> &likes,
                               BaseFloat scale): trans_model_(tm), likes_(&likes),
-                                                scale_(scale), delete_likes_(false) {
+                                                scale_(scale), delete_likes_(false),
+                                                scaled_frame_(-1) {
     if (likes.NumCols() != tm.NumPdfs())
       KALDI_ERR << "DecodableMatrixScaledMapped: mismatch, matrix has "
                 << likes.NumCols() << " rows but transition-model has "
@@ -50,7 +51,7 @@ class DecodableMatrixScaledMapped: public DecodableInterface {
                               BaseFloat scale,
                               const Matrix<BaseFloat> *likes):
       trans_model_(tm), likes_(likes),
-      scale_(scale), delete_likes_(true) {
+      scale_(scale), delete_likes_(true), scaled_frame_(-1) {
     if (likes->NumCols() != tm.NumPdfs())
       KALDI_ERR << "DecodableMatrixScaledMapped: mismatch, matrix has "
                 << likes->NumCols() << " rows but transition-model has "
@@ -72,6 +73,21 @@ class DecodableMatrixScaledMapped: public DecodableInterface {
   // Indices are one-based!  This is for compatibility with OpenFst.
   virtual int32 NumIndices() const { return trans_model_.NumTransitionIds(); }
 
+  // Returns the scaled log-likelihoods of this frame, indexed by pdf-id.
+  virtual const BaseFloat *GetFrameScores(int32 frame,
+                                          const int32 **index_to_row) {
+    *index_to_row = &(trans_model_.TransitionIdToPdfArray()[0]);
+    if (scale_ == 1.0)
+      return likes_->RowData(frame);
+    if (frame != scaled_frame_) {
+      scaled_likes_.Resize(likes_->NumCols(), kUndefined);
+      scaled_likes_.CopyFromVec(likes_->Row(frame));
+      scaled_likes_.Scale(scale_);
+      scaled_frame_ = frame;
+    }
+    return scaled_likes_.Data();
+  }
+
   virtual ~DecodableMatrixScaledMapped() {
     if (delete_likes_) delete likes_;
   }
@@ -80,6 +96,10 @@ class DecodableMatrixScaledMapped: public DecodableInterface {
   const Matrix<BaseFloat> *likes_;
   BaseFloat scale_;
   bool delete_likes_;
+  // scaled_likes_ is a cache of the scaled row of likes_ for frame
+  // scaled_frame_, used in GetFrameScores().
+  Vector<BaseFloat> scaled_likes_;
+  int32 scaled_frame_;
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableMatrixScaledMapped);
 };
 
@@ -151,6 +171,14 @@ class DecodableMatrixMappedOffset: public DecodableInterface {
     return loglikes_(index, trans_model_.TransitionIdToPdf(tid));
   }
 
+  virtual const BaseFloat *GetFrameScores(int32 frame,
+                                          const int32 **index_to_row) {
+    int32 index = frame - frame_offset_;
+    KALDI_ASSERT(index >= 0 && index < loglikes_.NumRows());
+    *index_to_row = &(trans_model_.TransitionIdToPdfArray()[0]);
+    return loglikes_.RowData(index);
+  }
+
                  
                  
   virtual int32 NumIndices() const { return trans_model_.NumTransitionIds(); }
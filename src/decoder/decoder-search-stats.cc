@@ -0,0 +1,200 @@
+// decoder/decoder-search-stats.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cmath>
+#include "decoder/decoder-search-stats.h"
+
+namespace kaldi {
+
+// Writes "str" as a JSON string, with quotes and any special characters
+// escaped.
+static void WriteJsonString(const std::string &str, std::ostream &os) {
+  os << '"';
+  for (size_t i = 0; i < str.size(); i++) {
+    char c = str[i];
+    if (c == '"' || c == '\\') {
+      os << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", static_cast<int32>(c));
+      os << buf;
+    } else {
+      os << c;
+    }
+  }
+  os << '"';
+}
+
+void SearchStatsHistogram::Add(double value) {
+  int32 b;
+  if (log_scale_) {
+    // frexp() gives v = m * 2^e with 0.5 <= m < 1, so for v >= 1, e is the
+    // bucket index.
+    double v = value / bucket_width_;
+    int e;
+    std::frexp(v, &e);
+    b = (v < 1.0 ? 0 : e);
+  } else {
+    b = static_cast<int32>(std::floor(value / bucket_width_));
+  }
+  counts_[b]++;
+  if (count_ == 0 || value < min_) min_ = value;
+  if (count_ == 0 || value > max_) max_ = value;
+  count_++;
+  sum_ += value;
+}
+
+void SearchStatsHistogram::Add(const SearchStatsHistogram &other) {
+  KALDI_ASSERT(log_scale_ == other.log_scale_ &&
+               bucket_width_ == other.bucket_width_);
+  if (other.count_ == 0) return;
+  for (std::map<int32, int64>::const_iterator iter = other.counts_.begin();
+       iter != other.counts_.end(); ++iter)
+    counts_[iter->first] += iter->second;
+  if (count_ == 0 || other.min_ < min_) min_ = other.min_;
+  if (count_ == 0 || other.max_ > max_) max_ = other.max_;
+  count_ += other.count_;
+  sum_ += other.sum_;
+}
+
+double SearchStatsHistogram::BucketLower(int32 b) const {
+  if (log_scale_) return (b == 0 ? 0.0 : bucket_width_ * std::pow(2.0, b - 1));
+  else return bucket_width_ * b;
+}
+
+double SearchStatsHistogram::BucketUpper(int32 b) const {
+  if (log_scale_) return bucket_width_ * std::pow(2.0, b);
+  else return bucket_width_ * (b + 1);
+}
+
+void SearchStatsHistogram::WriteJson(std::ostream &os) const {
+  os << "{\"count\": " << count_ << ", \"mean\": "
+     << (count_ > 0 ? sum_ / count_ : 0.0) << ", \"min\": " << min_
+     << ", \"max\": " << max_ << ", \"buckets\": [";
+  for (std::map<int32, int64>::const_iterator iter = counts_.begin();
+       iter != counts_.end(); ++iter) {
+    if (iter != counts_.begin()) os << ", ";
+    os << "{\"lower\": " << BucketLower(iter->first) << ", \"upper\": "
+       << BucketUpper(iter->first) << ", \"count\": " << iter->second << "}";
+  }
+  os << "]}";
+}
+
+DecoderSearchStats::DecoderSearchStats():
+    num_frames_(0), tokens_(true, 1.0), arcs_(true, 1.0), beam_(false, 0.5),
+    links_pruned_(true, 1.0), emitting_time_(true, 1.0),
+    nonemitting_time_(true, 1.0) { }
+
+void DecoderSearchStats::AddFrame(int32 frame,
+                                  const DecoderFrameStats &stats) {
+  KALDI_ASSERT(frame >= 0);
+  if (static_cast<size_t>(frame) >= frames_.size())
+    frames_.resize(frame + 1);
+  // Keep any links-pruned count that was already recorded.
+  int32 num_links_pruned = frames_[frame].num_links_pruned;
+  frames_[frame] = stats;
+  frames_[frame].num_links_pruned += num_links_pruned;
+}
+
+void DecoderSearchStats::AddLinksPruned(int32 frame, int32 num_links) {
+  if (frame < 0) frame = 0;
+  if (static_cast<size_t>(frame) >= frames_.size())
+    frames_.resize(frame + 1);
+  frames_[frame].num_links_pruned += num_links;
+}
+
+void DecoderSearchStats::EndUtterance(const std::string &utterance_id) {
+  if (frames_.empty()) return;
+  UtteranceSummary summary;
+  summary.utterance_id = utterance_id;
+  summary.num_frames = frames_.size();
+  summary.max_tokens = 0;
+  summary.num_arcs = 0;
+  summary.num_links_pruned = 0;
+  summary.time = 0.0;
+  double tot_tokens = 0.0;
+  for (size_t t = 0; t < frames_.size(); t++) {
+    const DecoderFrameStats &f = frames_[t];
+    tot_tokens += f.num_tokens;
+    summary.max_tokens = std::max(summary.max_tokens, f.num_tokens);
+    summary.num_arcs += f.num_arcs;
+    summary.num_links_pruned += f.num_links_pruned;
+    summary.time += f.emitting_time + f.nonemitting_time;
+    tokens_.Add(f.num_tokens);
+    arcs_.Add(f.num_arcs);
+    beam_.Add(f.adaptive_beam);
+    links_pruned_.Add(f.num_links_pruned);
+    emitting_time_.Add(f.emitting_time * 1.0e+06);
+    nonemitting_time_.Add(f.nonemitting_time * 1.0e+06);
+  }
+  summary.mean_tokens = tot_tokens / frames_.size();
+  num_frames_ += frames_.size();
+  utterances_.push_back(summary);
+  frames_.clear();
+}
+
+void DecoderSearchStats::Add(const DecoderSearchStats &other) {
+  KALDI_ASSERT(other.frames_.empty());
+  utterances_.insert(utterances_.end(), other.utterances_.begin(),
+                     other.utterances_.end());
+  num_frames_ += other.num_frames_;
+  tokens_.Add(other.tokens_);
+  arcs_.Add(other.arcs_);
+  beam_.Add(other.beam_);
+  links_pruned_.Add(other.links_pruned_);
+  emitting_time_.Add(other.emitting_time_);
+  nonemitting_time_.Add(other.nonemitting_time_);
+}
+
+void DecoderSearchStats::WriteJson(std::ostream &os) const {
+  if (!frames_.empty())
+    KALDI_WARN << "Writing decoder search stats: EndUtterance() was not "
+               << "called for the last utterance.";
+  os << "{\n  \"num_utterances\": " << utterances_.size()
+     << ",\n  \"num_frames\": " << num_frames_
+     << ",\n  \"per_frame\": {\n    \"active_tokens\": ";
+  tokens_.WriteJson(os);
+  os << ",\n    \"arcs_expanded\": ";
+  arcs_.WriteJson(os);
+  os << ",\n    \"adaptive_beam\": ";
+  beam_.WriteJson(os);
+  os << ",\n    \"links_pruned\": ";
+  links_pruned_.WriteJson(os);
+  os << ",\n    \"emitting_time_us\": ";
+  emitting_time_.WriteJson(os);
+  os << ",\n    \"nonemitting_time_us\": ";
+  nonemitting_time_.WriteJson(os);
+  os << "\n  },\n  \"utterances\": [";
+  for (size_t i = 0; i < utterances_.size(); i++) {
+    const UtteranceSummary &u = utterances_[i];
+    os << (i == 0 ? "\n" : ",\n") << "    {\"id\": ";
+    WriteJsonString(u.utterance_id, os);
+    os << ", \"num_frames\": " << u.num_frames
+       << ", \"mean_tokens\": " << u.mean_tokens
+       << ", \"max_tokens\": " << u.max_tokens
+       << ", \"arcs_expanded\": " << u.num_arcs
+       << ", \"links_pruned\": " << u.num_links_pruned
+       << ", \"time\": " << u.time << "}";
+  }
+  os << "\n  ]\n}\n";
+}
+
+
+} // end namespace kaldi.
@@ -0,0 +1,139 @@
+// decoder/decoder-search-stats.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_DECODER_SEARCH_STATS_H_
+#define KALDI_DECODER_DECODER_SEARCH_STATS_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include "base/kaldi-common.h"
+
+namespace kaldi {
+
+/// Statistics of the search on one frame, as recorded by
+/// LatticeFasterDecoder (see LatticeFasterDecoder::SetSearchStats()).
+struct DecoderFrameStats {
+  int32 num_tokens;  // tokens active at the end of the frame.
+  int64 num_arcs;  // arcs expanded (emitting and non-emitting).
+  BaseFloat adaptive_beam;  // the beam that GetCutoff() used.
+  int32 num_links_pruned;  // links pruned later by PruneForwardLinks().
+  double emitting_time;  // seconds spent in ProcessEmitting().
+  double nonemitting_time;  // seconds spent in ProcessNonemitting().
+  DecoderFrameStats(): num_tokens(0), num_arcs(0), adaptive_beam(0.0),
+                       num_links_pruned(0), emitting_time(0.0),
+                       nonemitting_time(0.0) { }
+};
+
+
+/// A histogram for DecoderSearchStats, with buckets either of a fixed width,
+/// or (if log_scale == true) going up in powers of two: in that case, bucket
+/// zero is [0, 1) and bucket i > 0 is [2^(i-1), 2^i).
+class SearchStatsHistogram {
+ public:
+  SearchStatsHistogram(bool log_scale, double bucket_width):
+      log_scale_(log_scale), bucket_width_(bucket_width), count_(0),
+      sum_(0.0), min_(0.0), max_(0.0) { KALDI_ASSERT(bucket_width > 0.0); }
+
+  void Add(double value);
+
+  /// Adds the counts of another histogram with the same buckets.
+  void Add(const SearchStatsHistogram &other);
+
+  /// Writes the histogram as a JSON object with the count, mean, min and
+  /// max, and a list of the nonempty buckets.
+  void WriteJson(std::ostream &os) const;
+
+ private:
+  double BucketLower(int32 b) const;
+  double BucketUpper(int32 b) const;
+
+  bool log_scale_;
+  double bucket_width_;
+  int64 count_;
+  double sum_;
+  double min_;
+  double max_;
+  std::map<int32, int64> counts_;  // bucket index -> count.
+};
+
+
+/**
+   DecoderSearchStats collects per-frame statistics of the search from
+   LatticeFasterDecoder: active tokens, arcs expanded, the adaptive beam,
+   links pruned and the time spent in ProcessEmitting() and
+   ProcessNonemitting().  Over all utterances it keeps histograms of each of
+   these (per frame), and for each utterance a summary that makes it easy to
+   spot utterances that are unusually expensive to decode.  WriteJson()
+   writes all of this in JSON format.
+
+   Usage: attach it to a decoder with LatticeFasterDecoder::SetSearchStats(),
+   and call EndUtterance() after decoding each utterance.
+*/
+class DecoderSearchStats {
+ public:
+  DecoderSearchStats();
+
+  /// Called by the decoder at the end of each frame; "frame" is the
+  /// zero-based frame index.
+  void AddFrame(int32 frame, const DecoderFrameStats &stats);
+
+  /// Called by the decoder when it prunes the links out of the tokens of a
+  /// frame (frame may be -1 for the tokens before the first frame, which we
+  /// count with frame 0).
+  void AddLinksPruned(int32 frame, int32 num_links);
+
+  /// Adds the frames of the current utterance to the histograms and the
+  /// utterance summaries, and starts a new utterance.
+  void EndUtterance(const std::string &utterance_id);
+
+  /// Adds the statistics of another object (which should have no current
+  /// utterance), e.g. one that was used in another thread.
+  void Add(const DecoderSearchStats &other);
+
+  void WriteJson(std::ostream &os) const;
+
+ private:
+  struct UtteranceSummary {
+    std::string utterance_id;
+    int32 num_frames;
+    double mean_tokens;
+    int32 max_tokens;
+    int64 num_arcs;
+    int64 num_links_pruned;
+    double time;
+  };
+
+  // The frames of the current utterance.
+  std::vector<DecoderFrameStats> frames_;
+
+  std::vector<UtteranceSummary> utterances_;
+  int64 num_frames_;
+  SearchStatsHistogram tokens_;
+  SearchStatsHistogram arcs_;
+  SearchStatsHistogram beam_;
+  SearchStatsHistogram links_pruned_;
+  SearchStatsHistogram emitting_time_;  // in microseconds.
+  SearchStatsHistogram nonemitting_time_;  // in microseconds.
+};
+
+
+} // end namespace kaldi.
+
+#endif
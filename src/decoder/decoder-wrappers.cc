@@ -60,6 +60,17 @@ DecodeUtteranceLatticeFasterClass::DecodeUtteranceLatticeFasterClass(
 
 void DecodeUtteranceLatticeFasterClass::operator () () {
   // Decoding and lattice determinization happens here.
+  RunStage(0);
+  RunStage(1);
+}
+
+void DecodeUtteranceLatticeFasterClass::RunStage(int32 stage) {
+  KALDI_ASSERT(stage == 0 || stage == 1);
+  if (stage == 1) {
+    if (success_)
+      DeterminizeLattice();
+    return;
+  }
   computed_ = true; // Just means this function was called-- a check on the
   // calling code.
   success_ = true;
@@ -82,12 +93,15 @@ void DecodeUtteranceLatticeFasterClass::operator () () {
   }
   if (!success_) return;
 
-  // Get lattice, and do determinization if requested.
+  // Get the raw lattice; it is determinized (if requested) in stage 1.
   lat_ = new Lattice;
   decoder_->GetRawLattice(lat_);
   if (lat_->NumStates() == 0)
     KALDI_ERR << "Unexpected problem getting lattice for utterance " << utt_;
   fst::Connect(lat_);
+}
+
+void DecodeUtteranceLatticeFasterClass::DeterminizeLattice() {
   if (determinize_) {
     clat_ = new CompactLattice;
     if (!DeterminizeLatticePhonePrunedWrapper(
@@ -208,12 +222,30 @@ bool DecodeUtteranceLatticeFaster(
     CompactLatticeWriter *compact_lattice_writer,
     LatticeWriter *lattice_writer,
     double *like_ptr) { // puts utterance's like in like_ptr on success.
-  using fst::VectorFst;
-
   if (!decoder.Decode(&decodable)) {
     KALDI_WARN << "Failed to decode file " << utt;
     return false;
   }
+  return OutputDecodedUtteranceLatticeFaster(
+      decoder, trans_model, word_syms, utt, acoustic_scale, determinize,
+      allow_partial, alignment_writer, words_writer, compact_lattice_writer,
+      lattice_writer, like_ptr);
+}
+
+bool OutputDecodedUtteranceLatticeFaster(
+    const LatticeFasterDecoder &decoder,
+    const TransitionModel &trans_model,
+    const fst::SymbolTable *word_syms,
+    std::string utt,
+    double acoustic_scale,
+    bool determinize,
+    bool allow_partial,
+    Int32VectorWriter *alignment_writer,
+    Int32VectorWriter *words_writer,
+    CompactLatticeWriter *compact_lattice_writer,
+    LatticeWriter *lattice_writer,
+    double *like_ptr) {
+  using fst::VectorFst;
   if (!decoder.ReachedFinal()) {
     if (allow_partial) {
       KALDI_WARN << "Outputting partial output for utterance " << utt
@@ -231,9 +263,12 @@ bool DecodeUtteranceLatticeFaster(
   int32 num_frames;
   { // First do some stuff with word-level traceback...
     VectorFst<LatticeArc> decoded;
-    if (!decoder.GetBestPath(&decoded))
-      // Shouldn't really reach this point as already checked success.
-      KALDI_ERR << "Failed to get traceback for utterance " << utt;
+    if (!decoder.GetBestPath(&decoded)) {
+      // This would only happen if no tokens survived, which
+      // DecodeUtteranceLatticeFaster() checks before calling us.
+      KALDI_WARN << "Failed to get traceback for utterance " << utt;
+      return false;
+    }
 
     std::vector<int32> alignment;
     std::vector<int32> words;
@@ -420,88 +455,202 @@ void ModifyGraphForCarefulAlignment(
 }
 
     
-void AlignUtteranceWrapper(
-    const AlignConfig &config,
-    const std::string &utt,
-    BaseFloat acoustic_scale,  // affects scores written to scores_writer, if
-                               // present
-    fst::VectorFst<fst::StdArc> *fst,  // non-const in case config.careful == 
-                                       // true.
-    DecodableInterface *decodable,  // not const but is really an input.
-    Int32VectorWriter *alignment_writer,
-    BaseFloatWriter *scores_writer,
-    int32 *num_done,
-    int32 *num_error,
-    int32 *num_retried,
-    double *tot_like,
-    int64 *frame_count) {
-
+// Checks that the beams of "config" make sense.
+static void CheckAlignConfig(const AlignConfig &config) {
   if ((config.retry_beam != 0 && config.retry_beam <= config.beam) ||
       config.beam <= 0.0) {
     KALDI_ERR << "Beams do not make sense: beam " << config.beam
               << ", retry-beam " << config.retry_beam;
   }
+}
 
-  if (fst->Start() == fst::kNoStateId) {
-    KALDI_WARN << "Empty decoding graph for " << utt;
-    if (num_error != NULL) (*num_error)++;
-    return;
-  }
-
+static void SetAlignBeam(BaseFloat beam, FasterDecoder *decoder) {
+  FasterDecoderOptions decode_opts;
+  decode_opts.beam = beam;
+  decoder->SetOptions(decode_opts);
+}
 
-  fst::StdArc::Label special_symbol = 0;
-  if (config.careful)
-    ModifyGraphForCarefulAlignment(fst);
+static void SetAlignBeam(BaseFloat beam, LinearGraphAligner *aligner) {
+  aligner->SetBeam(beam);
+}
 
-  FasterDecoderOptions decode_opts;
-  decode_opts.beam = config.beam;
+// Decodes with "decoder" (a FasterDecoder or a LinearGraphAligner, with the
+// beam config.beam), retrying with config.retry_beam if necessary; returns
+// true and outputs the best path if a final state was reached.
+template<class Decoder>
+static bool AlignWithDecoder(const AlignConfig &config,
+                             const std::string &utt,
+                             DecodableInterface *decodable,
+                             Decoder *decoder,
+                             fst::VectorFst<LatticeArc> *decoded,
+                             bool *retried) {
+  decoder->Decode(decodable);
 
-  FasterDecoder decoder(*fst, decode_opts);
-  decoder.Decode(decodable);
+  bool ans = decoder->ReachedFinal();  // consider only final states.
 
-  bool ans = decoder.ReachedFinal();  // consider only final states.
-  
   if (!ans && config.retry_beam != 0.0) {
-    if (num_retried != NULL) (*num_retried)++;
+    *retried = true;
     KALDI_WARN << "Retrying utterance " << utt << " with beam "
                << config.retry_beam;
-    decode_opts.beam = config.retry_beam;
-    decoder.SetOptions(decode_opts);
-    decoder.Decode(decodable);
-    ans = decoder.ReachedFinal();
+    SetAlignBeam(config.retry_beam, decoder);
+    decoder->Decode(decodable);
+    ans = decoder->ReachedFinal();
   }
 
   if (!ans) {  // Still did not reach final state.
     KALDI_WARN << "Did not successfully decode file " << utt << ", len = "
                << decodable->NumFramesReady();
-    if (num_error != NULL) (*num_error)++;
-    return;
+    return false;
   }
-  
-  fst::VectorFst<LatticeArc> decoded;  // linear FST.
-  decoder.GetBestPath(&decoded);
-  if (decoded.NumStates() == 0) {
+
+  decoder->GetBestPath(decoded);
+  if (decoded->NumStates() == 0) {
     KALDI_WARN << "Error getting best path from decoder (likely a bug)";
-    if (num_error != NULL) (*num_error)++;
-    return;
+    return false;
   }
-    
-  std::vector<int32> alignment;
+  return true;
+}
+
+// This does the work of AlignUtteranceWrapper() except for the output and the
+// counting: it returns true on success, in which case it outputs the
+// alignment and the score (the negated cost, including the acoustic scale).
+// It sets *retried to true if it had to retry with config.retry_beam.
+static bool AlignUtteranceInternal(const AlignConfig &config,
+                                   const std::string &utt,
+                                   fst::VectorFst<fst::StdArc> *fst,
+                                   DecodableInterface *decodable,
+                                   std::vector<int32> *alignment,
+                                   BaseFloat *score,
+                                   bool *retried) {
+  *retried = false;
+  if (fst->Start() == fst::kNoStateId) {
+    KALDI_WARN << "Empty decoding graph for " << utt;
+    return false;
+  }
+
+  if (config.careful)
+    ModifyGraphForCarefulAlignment(fst);
+
+  fst::VectorFst<LatticeArc> decoded;  // linear FST.
+  bool ans = false, done = false;
+  if (config.linear_aligner) {
+    LinearGraphAligner aligner(*fst, config.beam);
+    // It isn't supported for graphs with cycles other than self-loops.
+    if (aligner.GraphIsSupported()) {
+      ans = AlignWithDecoder(config, utt, decodable, &aligner, &decoded,
+                             retried);
+      done = true;
+    }
+  }
+  if (!done) {
+    FasterDecoderOptions decode_opts;
+    decode_opts.beam = config.beam;
+    FasterDecoder decoder(*fst, decode_opts);
+    ans = AlignWithDecoder(config, utt, decodable, &decoder, &decoded,
+                           retried);
+  }
+  if (!ans)
+    return false;
+
   std::vector<int32> words;
   LatticeWeight weight;
+  GetLinearSymbolSequence(decoded, alignment, &words, &weight);
+  *score = -(weight.Value1() + weight.Value2());
+  return true;
+}
+
+void AlignUtteranceWrapper(
+    const AlignConfig &config,
+    const std::string &utt,
+    BaseFloat acoustic_scale,  // affects scores written to scores_writer, if
+                               // present
+    fst::VectorFst<fst::StdArc> *fst,  // non-const in case config.careful ==
+                                       // true.
+    DecodableInterface *decodable,  // not const but is really an input.
+    Int32VectorWriter *alignment_writer,
+    BaseFloatWriter *scores_writer,
+    int32 *num_done,
+    int32 *num_error,
+    int32 *num_retried,
+    double *tot_like,
+    int64 *frame_count) {
+  CheckAlignConfig(config);
 
-  GetLinearSymbolSequence(decoded, &alignment, &words, &weight);
-  BaseFloat like = -(weight.Value1()+weight.Value2()) / acoustic_scale;
+  std::vector<int32> alignment;
+  BaseFloat score;
+  bool retried;
+  bool ans = AlignUtteranceInternal(config, utt, fst, decodable,
+                                    &alignment, &score, &retried);
+  if (retried && num_retried != NULL) (*num_retried)++;
+  if (!ans) {
+    if (num_error != NULL) (*num_error)++;
+    return;
+  }
 
   if (num_done != NULL) (*num_done)++;
-  if (tot_like != NULL) (*tot_like) += like;
+  if (tot_like != NULL) (*tot_like) += score / acoustic_scale;
   if (frame_count != NULL) (*frame_count) += decodable->NumFramesReady();
 
   if (alignment_writer != NULL && alignment_writer->IsOpen())
     alignment_writer->Write(utt, alignment);
-  
+
   if (scores_writer != NULL && scores_writer->IsOpen())
-    scores_writer->Write(utt, -(weight.Value1()+weight.Value2()));
+    scores_writer->Write(utt, score);
+}
+
+
+AlignUtteranceClass::AlignUtteranceClass(
+    const AlignConfig &config,
+    const std::string &utt,
+    BaseFloat acoustic_scale,
+    fst::VectorFst<fst::StdArc> *fst,
+    DecodableInterface *decodable,
+    Int32VectorWriter *alignment_writer,
+    BaseFloatWriter *scores_writer,
+    int32 *num_done,
+    int32 *num_error,
+    int32 *num_retried,
+    double *tot_like,
+    int64 *frame_count):
+    config_(config), utt_(utt), acoustic_scale_(acoustic_scale), fst_(fst),
+    decodable_(decodable), alignment_writer_(alignment_writer),
+    scores_writer_(scores_writer), num_done_(num_done),
+    num_error_(num_error), num_retried_(num_retried), tot_like_(tot_like),
+    frame_count_(frame_count), computed_(false), success_(false),
+    retried_(false), score_(0.0), num_frames_(0) {
+  CheckAlignConfig(config);
+}
+
+void AlignUtteranceClass::operator () () {
+  computed_ = true;
+  success_ = AlignUtteranceInternal(config_, utt_, fst_, decodable_,
+                                    &alignment_, &score_, &retried_);
+  num_frames_ = decodable_->NumFramesReady();
+  // Free the graph and the likelihoods now, in the worker thread, rather
+  // than waiting for the output.
+  delete decodable_;
+  decodable_ = NULL;
+  delete fst_;
+  fst_ = NULL;
+}
+
+AlignUtteranceClass::~AlignUtteranceClass() {
+  if (!computed_)
+    KALDI_ERR << "Destructor called without operator (), error in calling code.";
+  if (retried_ && num_retried_ != NULL) (*num_retried_)++;
+  if (!success_) {
+    if (num_error_ != NULL) (*num_error_)++;
+    return;
+  }
+  if (num_done_ != NULL) (*num_done_)++;
+  if (tot_like_ != NULL) (*tot_like_) += score_ / acoustic_scale_;
+  if (frame_count_ != NULL) (*frame_count_) += num_frames_;
+
+  if (alignment_writer_ != NULL && alignment_writer_->IsOpen())
+    alignment_writer_->Write(utt_, alignment_);
+
+  if (scores_writer_ != NULL && scores_writer_->IsOpen())
+    scores_writer_->Write(utt_, score_);
 }
 
 
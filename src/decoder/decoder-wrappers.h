@@ -35,8 +35,10 @@ struct AlignConfig {
   BaseFloat beam;
   BaseFloat retry_beam;
   bool careful;
+  bool linear_aligner;
 
-  AlignConfig(): beam(200.0), retry_beam(0.0), careful(false) { }
+  AlignConfig(): beam(200.0), retry_beam(0.0), careful(false),
+                 linear_aligner(true) { }
 
   void Register(OptionsItf *opts) {
     opts->Register("beam", &beam, "Decoding beam used in alignment");
@@ -45,6 +47,11 @@ struct AlignConfig {
     opts->Register("careful", &careful,
                    "If true, do 'careful' alignment, which is better at detecting "
                    "alignment failure (involves loop to start of decoding graph).");
+    opts->Register("linear-aligner", &linear_aligner,
+                   "If true, align graphs that are acyclic apart from "
+                   "self-loops (e.g. from compile-train-graphs) with "
+                   "LinearGraphAligner, which is faster than the general "
+                   "decoder and gives the same result within the beam.");
   }
 };
 
@@ -72,6 +79,58 @@ void AlignUtteranceWrapper(
     int64 *frame_count);
 
 
+/// This class does the same job as AlignUtteranceWrapper(), but in a way that
+/// allows us to align with multiple threads using TaskSequencer (see
+/// ../thread/kaldi-task-sequence.h): the decoding happens in operator (),
+/// with a decoder belonging to this task, and the output and the counting
+/// happen in the destructor, which TaskSequencer calls in the order of the
+/// input.  Everything that the tasks share (the model, the writers and the
+/// counters) must therefore only be used read-only in operator (); the
+/// decodable object should do its computation lazily, so that it happens in
+/// operator () too.
+class AlignUtteranceClass {
+ public:
+  /// The arguments are as for AlignUtteranceWrapper().  NOTE: we take
+  /// ownership of "fst" and "decodable"; they are deleted at the end of
+  /// operator ().
+  AlignUtteranceClass(const AlignConfig &config,
+                      const std::string &utt,
+                      BaseFloat acoustic_scale,
+                      fst::VectorFst<fst::StdArc> *fst,
+                      DecodableInterface *decodable,
+                      Int32VectorWriter *alignment_writer,
+                      BaseFloatWriter *scores_writer,
+                      int32 *num_done,
+                      int32 *num_error,
+                      int32 *num_retried,
+                      double *tot_like,
+                      int64 *frame_count);
+  void operator () ();  // The alignment happens here.
+  ~AlignUtteranceClass();  // Output happens here.
+ private:
+  // The following variables correspond to inputs:
+  const AlignConfig &config_;
+  std::string utt_;
+  BaseFloat acoustic_scale_;
+  fst::VectorFst<fst::StdArc> *fst_;
+  DecodableInterface *decodable_;
+  Int32VectorWriter *alignment_writer_;
+  BaseFloatWriter *scores_writer_;
+  int32 *num_done_;
+  int32 *num_error_;
+  int32 *num_retried_;
+  double *tot_like_;
+  int64 *frame_count_;
+
+  // The following variables are stored by the computation.
+  bool computed_;  // operator () was called.
+  bool success_;
+  bool retried_;
+  std::vector<int32> alignment_;
+  BaseFloat score_;  // negated cost of the best path, with acoustic scaling.
+  int32 num_frames_;
+};
+
 
 /// This function modifies the decoding graph for what we call "careful
 /// alignment".  The problem we are trying to solve is that if the decoding eats
@@ -109,6 +168,24 @@ bool DecodeUtteranceLatticeFaster(
     LatticeWriter *lattice_writer,
     double *like_ptr);  // puts utterance's likelihood in like_ptr on success.
 
+/// This function does the output part of DecodeUtteranceLatticeFaster(), for a
+/// decoder that has already decoded the utterance and had FinalizeDecoding()
+/// called (for example, one of the streams of a BatchedLatticeDecoder).  The
+/// arguments have the same meaning as for DecodeUtteranceLatticeFaster().
+bool OutputDecodedUtteranceLatticeFaster(
+    const LatticeFasterDecoder &decoder,
+    const TransitionModel &trans_model,
+    const fst::SymbolTable *word_syms,
+    std::string utt,
+    double acoustic_scale,
+    bool determinize,
+    bool allow_partial,
+    Int32VectorWriter *alignments_writer,
+    Int32VectorWriter *words_writer,
+    CompactLatticeWriter *compact_lattice_writer,
+    LatticeWriter *lattice_writer,
+    double *like_ptr);  // puts utterance's likelihood in like_ptr on success.
+
 /// This class basically does the same job as the function
 /// DecodeUtteranceLatticeFaster, but in a way that allows us
 /// to build a multi-threaded command line program more easily,
@@ -139,8 +216,16 @@ class DecodeUtteranceLatticeFasterClass {
       int32 *num_err,  // on failure, increments this.
       int32 *num_partial);  // If partial decode (final-state not reached), increments this.
   void operator () (); // The decoding happens here.
+  /// This is for TaskPipeline (thread/kaldi-task-pipeline.h), and does the
+  /// same as operator () in two stages: stage 0 decodes and gets the raw
+  /// lattice, and stage 1 determinizes it (if requested).
+  void RunStage(int32 stage);
   ~DecodeUtteranceLatticeFasterClass(); // Output happens here.
  private:
+  // Determinizes lat_ into clat_ if determinize_, and removes the acoustic
+  // scaling.
+  void DeterminizeLattice();
+
   // The following variables correspond to inputs:
   LatticeFasterDecoder *decoder_;
   DecodableInterface *decodable_;
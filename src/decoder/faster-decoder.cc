@@ -231,6 +231,12 @@ double FasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
                                    &adaptive_beam, &best_elem);
   KALDI_VLOG(3) << tok_cnt << " tokens active.";
   PossiblyResizeHash(tok_cnt);  // This makes sure the hash is always big enough.
+
+  // If the decodable object can give us the scores of the whole frame at once,
+  // we look them up directly rather than calling LogLikelihood() for each arc.
+  const int32 *index_to_row = NULL;
+  const BaseFloat *frame_scores = decodable->GetFrameScores(frame,
+                                                            &index_to_row);
     
   // This is the cutoff we use after adding in the log-likes (i.e.
   // for the next frame).  This is a bound on the cutoff we will use
@@ -247,7 +253,8 @@ double FasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
          aiter.Next()) {
       const Arc &arc = aiter.Value();
       if (arc.ilabel != 0) {  // we'd propagate..
-        BaseFloat ac_cost = - decodable->LogLikelihood(frame, arc.ilabel);
+        BaseFloat ac_cost = - GetLogLikelihood(decodable, frame, arc.ilabel,
+                                               frame_scores, index_to_row);
         double new_weight = arc.weight.Value() + tok->cost_ + ac_cost;
         if (new_weight + adaptive_beam < next_weight_cutoff)
           next_weight_cutoff = new_weight + adaptive_beam;
@@ -273,7 +280,8 @@ double FasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
            aiter.Next()) {
         Arc arc = aiter.Value();
         if (arc.ilabel != 0) {  // propagate..
-          BaseFloat ac_cost =  - decodable->LogLikelihood(frame, arc.ilabel);
+          BaseFloat ac_cost = - GetLogLikelihood(decodable, frame, arc.ilabel,
+                                                 frame_scores, index_to_row);
           double new_weight = arc.weight.Value() + tok->cost_ + ac_cost;
           if (new_weight < next_weight_cutoff) {  // not pruned..
             Token *new_tok = new Token(arc, ac_cost, tok);
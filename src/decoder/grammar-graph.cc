@@ -0,0 +1,199 @@
+// decoder/grammar-graph.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cmath>
+#include <limits>
+#include "decoder/grammar-graph.h"
+
+namespace kaldi {
+
+GrammarGraph::GrammarGraph(const fst::Fst<Arc> &top,
+                           const std::vector<Label> &nonterminals,
+                           const GrammarGraphOptions &opts):
+    top_(top), subgraphs_(nonterminals.size(), NULL), opts_(opts),
+    num_cached_arcs_(0) {
+  opts.Check();
+  if (top_.Start() == fst::kNoStateId)
+    KALDI_ERR << "Top-level decoding graph has no start state.";
+  for (size_t i = 0; i < nonterminals.size(); i++) {
+    KALDI_ASSERT(nonterminals[i] > 0);
+    if (!nonterminal_index_.insert(
+            std::make_pair(nonterminals[i], static_cast<int32>(i))).second)
+      KALDI_ERR << "Nonterminal " << nonterminals[i] << " appears twice.";
+  }
+  Reset();
+}
+
+void GrammarGraph::SetSubgraph(Label nonterminal,
+                               const fst::Fst<Arc> *subgraph) {
+  unordered_map<Label, int32>::iterator iter =
+      nonterminal_index_.find(nonterminal);
+  if (iter == nonterminal_index_.end())
+    KALDI_ERR << "Label " << nonterminal << " is not a nonterminal.";
+  if (subgraph != NULL && subgraph->Start() == fst::kNoStateId) {
+    KALDI_WARN << "Sub-graph for nonterminal " << nonterminal
+               << " is empty.";
+    subgraph = NULL;
+  }
+  subgraphs_[iter->second] = subgraph;
+  Reset();
+}
+
+void GrammarGraph::Reset() {
+  instance_index_.clear();
+  state_maps_.clear();
+  states_.clear();
+  arc_cache_.clear();
+  num_cached_arcs_ = 0;
+  StateId start = FindOrAddState(0, top_.Start(), -1);
+  KALDI_ASSERT(start == Start());
+}
+
+GrammarGraph::StateId GrammarGraph::FindOrAddState(
+    int32 graph, StateId state, StateId return_state) const {
+  uint64 key = (static_cast<uint64>(static_cast<uint32>(graph)) << 32) |
+      static_cast<uint32>(return_state);
+  std::pair<unordered_map<uint64, int32>::iterator, bool> ret =
+      instance_index_.insert(std::make_pair(key,
+          static_cast<int32>(state_maps_.size())));
+  if (ret.second)
+    state_maps_.resize(state_maps_.size() + 1);
+  unordered_map<StateId, StateId> &state_map = state_maps_[ret.first->second];
+  unordered_map<StateId, StateId>::iterator iter = state_map.find(state);
+  if (iter != state_map.end())
+    return iter->second;
+  StateId s = static_cast<StateId>(states_.size());
+  state_map[state] = s;
+  StateInfo info;
+  info.graph = graph;
+  info.state = state;
+  info.return_state = return_state;
+  states_.push_back(info);
+  return s;
+}
+
+BaseFloat GrammarGraph::Final(StateId s) const {
+  KALDI_ASSERT(static_cast<size_t>(s) < states_.size());
+  const StateInfo &info = states_[s];
+  if (info.graph != 0)
+    return std::numeric_limits<BaseFloat>::infinity();
+  return top_.Final(info.state).Value();
+}
+
+const GrammarGraph::ExpandedState &GrammarGraph::GetArcs(StateId s) const {
+  unordered_map<StateId, ExpandedState>::iterator iter = arc_cache_.find(s);
+  if (iter != arc_cache_.end())
+    return iter->second;
+  if (num_cached_arcs_ > static_cast<size_t>(opts_.max_cached_arcs)) {
+    KALDI_VLOG(2) << "Flushing cache of " << num_cached_arcs_ << " arcs for "
+                  << arc_cache_.size() << " states.";
+    arc_cache_.clear();
+    num_cached_arcs_ = 0;
+  }
+  KALDI_ASSERT(static_cast<size_t>(s) < states_.size());
+  // Copy, as FindOrAddState() may reallocate states_.
+  StateInfo info = states_[s];
+  const fst::Fst<Arc> &fst = (info.graph == 0 ? top_ :
+                              *(subgraphs_[info.graph - 1]));
+
+  ExpandedState &expanded = arc_cache_[s];
+  std::vector<Arc> nonemitting_arcs;
+  for (fst::ArcIterator<fst::Fst<Arc> > aiter(fst, info.state); !aiter.Done();
+       aiter.Next()) {
+    const Arc &arc = aiter.Value();
+    if (info.graph == 0 && arc.ilabel != 0) {
+      unordered_map<Label, int32>::const_iterator nt_iter =
+          nonterminal_index_.find(arc.ilabel);
+      if (nt_iter != nonterminal_index_.end()) {
+        // Nonterminal: enter the sub-graph, returning to arc.nextstate.
+        const fst::Fst<Arc> *subgraph = subgraphs_[nt_iter->second];
+        if (subgraph == NULL)
+          continue;
+        nonemitting_arcs.push_back(
+            Arc(0, arc.olabel, arc.weight,
+                FindOrAddState(nt_iter->second + 1, subgraph->Start(),
+                               arc.nextstate)));
+        continue;
+      }
+    }
+    Arc new_arc(arc.ilabel, arc.olabel, arc.weight,
+                FindOrAddState(info.graph, arc.nextstate, info.return_state));
+    if (arc.ilabel != 0) expanded.arcs.push_back(new_arc);
+    else nonemitting_arcs.push_back(new_arc);
+  }
+  if (info.graph != 0) {
+    // Leave the sub-graph from its final states.
+    Arc::Weight final = fst.Final(info.state);
+    if (final != Arc::Weight::Zero())
+      nonemitting_arcs.push_back(
+          Arc(0, 0, final, FindOrAddState(0, info.return_state, -1)));
+  }
+  expanded.num_emitting = expanded.arcs.size();
+  expanded.arcs.insert(expanded.arcs.end(), nonemitting_arcs.begin(),
+                       nonemitting_arcs.end());
+  num_cached_arcs_ += expanded.arcs.size();
+  return expanded;
+}
+
+
+GrammarSubgraphCompiler::GrammarSubgraphCompiler(
+    const HclgCompilerOptions &opts,
+    const ContextDependency &ctx_dep,
+    const TransitionModel &trans_model,
+    const fst::VectorFst<Arc> &lex_fst,
+    const std::vector<int32> &disambig_phones):
+    opts_(opts), ctx_dep_(ctx_dep), trans_model_(trans_model),
+    lex_fst_(lex_fst), disambig_phones_(disambig_phones) { }
+
+const fst::VectorFst<fst::StdArc> *GrammarSubgraphCompiler::GetSubgraph(
+    const std::vector<int32> &words_in) {
+  std::vector<int32> words(words_in);
+  SortAndUniq(&words);
+  CacheType::iterator iter = cache_.find(words);
+  if (iter != cache_.end())
+    return iter->second;
+  if (words.empty() || words[0] <= 0)
+    KALDI_ERR << "Invalid word list for sub-graph (empty or has epsilon).";
+
+  // The grammar: one arc per word from the start state to the final state.
+  fst::VectorFst<Arc> grammar_fst;
+  grammar_fst.AddState();
+  grammar_fst.AddState();
+  grammar_fst.SetStart(0);
+  grammar_fst.SetFinal(1, Arc::Weight::One());
+  Arc::Weight cost(std::log(static_cast<BaseFloat>(words.size())));
+  for (size_t i = 0; i < words.size(); i++)
+    grammar_fst.AddArc(0, Arc(words[i], words[i], cost, 1));
+
+  fst::VectorFst<Arc> lex_fst(lex_fst_);  // CompileHCLG() frees its inputs;
+                                          // this is a shallow copy.
+  fst::VectorFst<Arc> *hclg_fst = new fst::VectorFst<Arc>();
+  CompileHCLG(opts_, ctx_dep_, trans_model_, disambig_phones_, &lex_fst,
+              &grammar_fst, hclg_fst);
+  cache_[words] = hclg_fst;
+  return hclg_fst;
+}
+
+void GrammarSubgraphCompiler::ClearCache() {
+  for (CacheType::iterator iter = cache_.begin(); iter != cache_.end();
+       ++iter)
+    delete iter->second;
+  cache_.clear();
+}
+
+
+} // end namespace kaldi.
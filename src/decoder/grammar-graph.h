@@ -0,0 +1,239 @@
+// decoder/grammar-graph.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_GRAMMAR_GRAPH_H_
+#define KALDI_DECODER_GRAMMAR_GRAPH_H_
+
+#include <vector>
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "itf/options-itf.h"
+#include "fst/fstlib.h"
+#include "decoder/hclg-compiler.h"
+
+namespace kaldi {
+
+struct GrammarGraphOptions {
+  int32 max_cached_arcs;
+
+  GrammarGraphOptions(): max_cached_arcs(20000000) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("max-cached-arcs", &max_cached_arcs, "Maximum number of "
+                   "arcs of the expanded grammar graph to keep cached; when "
+                   "this is exceeded the cache is flushed.");
+  }
+  void Check() const {
+    KALDI_ASSERT(max_cached_arcs > 0);
+  }
+};
+
+/**
+   GrammarGraph is a decoding graph made of a top-level HCLG that contains
+   nonterminal placeholders, and sub-graphs (e.g. for a list of contact names)
+   that are entered and exited as the decoder visits the states, so that a
+   sub-graph can be changed for each utterance without rebuilding HCLG.
+
+   The top-level graph is built with the nonterminals as disambiguation
+   symbols that are kept in HCLG (see the nonterminal_phones argument of
+   CompileHCLG() in hclg-compiler.h, and make-hclg --nonterminal-syms); so in
+   the lexicon a nonterminal is a word whose pronunciation is its
+   disambiguation symbol, and in G it is a word like any other.  The
+   sub-graphs are ordinary HCLGs, e.g. from GrammarSubgraphCompiler below.
+   An arc of the top-level graph whose input label is a nonterminal is
+   replaced by an epsilon arc (with the same output label and weight) into the
+   start state of its sub-graph, and each final state of the sub-graph gets an
+   epsilon arc, weighted by its final-cost, back to the destination state of
+   the nonterminal arc.  Arcs whose nonterminal has no sub-graph are dropped.
+   Sub-graphs may not themselves contain nonterminals.
+
+   Since the sub-graphs are compiled separately, the phonetic context is not
+   carried across the boundaries: the first and last phones of the sub-graph
+   are built as if at the start and end of an utterance, and similarly the
+   phones next to the nonterminal in the top-level graph.  This is fine when
+   the sub-graph is preceded and followed by optional silence (as the words
+   of an utterance usually are); for the best accuracy with cross-word
+   context, build the whole HCLG.
+
+   The states are triples (graph, state, return-state), which are given
+   integer ids in the order in which they are first seen; the id of the start
+   state is always zero.  As in LookaheadComposedGraph, the arcs of the states
+   the decoder visits are cached, with the cache flushed when it exceeds
+   opts.max_cached_arcs arcs.  This class is not thread-safe, and it is meant
+   to be used by one decoder at a time.  Call Reset() (or SetSubgraph()) only
+   between utterances.
+*/
+class GrammarGraph {
+ public:
+  typedef fst::StdArc Arc;
+  typedef Arc::StateId StateId;
+  typedef Arc::Label Label;
+
+  /// "top" must outlive this object.  "nonterminals" are the input labels of
+  /// "top" that stand for sub-graphs (e.g. as output by CompileHCLG()).
+  GrammarGraph(const fst::Fst<Arc> &top,
+               const std::vector<Label> &nonterminals,
+               const GrammarGraphOptions &opts);
+
+  /// Sets the sub-graph for nonterminal "nonterminal", or, if subgraph ==
+  /// NULL, removes it.  The sub-graph must outlive its use by this object.
+  /// This calls Reset().
+  void SetSubgraph(Label nonterminal, const fst::Fst<Arc> *subgraph);
+
+  StateId Start() const { return 0; }
+
+  /// Returns the final-cost of state s (infinity if not final).  Only states
+  /// of the top-level graph can be final.
+  BaseFloat Final(StateId s) const;
+
+  /// Forgets all states and cached arcs.  Only call this when no decoder is
+  /// using the state-ids, e.g. between utterances.
+  void Reset();
+
+  /// Returns the number of states seen since the last Reset().
+  int32 NumStatesSeen() const { return states_.size(); }
+
+  struct ExpandedState {
+    std::vector<Arc> arcs;  // emitting arcs, then non-emitting arcs.
+    int32 num_emitting;
+  };
+
+  /// Returns the arcs of state s, expanding it if it is not in the cache.
+  /// The reference is valid until the next call to this function.
+  const ExpandedState &GetArcs(StateId s) const;
+
+ private:
+  // A state is a state of graph "graph" (0 for the top-level graph, i + 1 for
+  // subgraphs_[i]); for states of sub-graphs, "return_state" is the state of
+  // the top-level graph that we go to when we leave the sub-graph.
+  struct StateInfo {
+    int32 graph;
+    StateId state;
+    StateId return_state;
+  };
+
+  // Returns the id of the given state, allocating a new one if it has not
+  // been seen.  return_state is -1 for the top-level graph.
+  StateId FindOrAddState(int32 graph, StateId state,
+                         StateId return_state) const;
+
+  const fst::Fst<Arc> &top_;
+  // Maps nonterminal label to index into subgraphs_.
+  unordered_map<Label, int32> nonterminal_index_;
+  std::vector<const fst::Fst<Arc>*> subgraphs_;
+  GrammarGraphOptions opts_;
+
+  // The state and arc caches are mutable because they don't change the
+  // graph that this object represents.
+  // Maps (graph, return_state) to an index into state_maps_, which maps the
+  // states of that graph to state-ids.
+  mutable unordered_map<uint64, int32> instance_index_;
+  mutable std::vector<unordered_map<StateId, StateId> > state_maps_;
+  mutable std::vector<StateInfo> states_;
+  mutable unordered_map<StateId, ExpandedState> arc_cache_;
+  mutable size_t num_cached_arcs_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(GrammarGraph);
+};
+
+
+/// These classes iterate over, respectively, the emitting and the
+/// non-emitting arcs of a state of a GrammarGraph, with the same interface as
+/// CsrEmittingArcIterator and CsrNonemittingArcIterator.  Only one iterator
+/// may be in use at a time.
+class GrammarEmittingArcIterator {
+ public:
+  typedef GrammarGraph::Arc Arc;
+  GrammarEmittingArcIterator(const GrammarGraph &graph,
+                             GrammarGraph::StateId s):
+      state_(graph.GetArcs(s)), pos_(0), end_(state_.num_emitting) { }
+  bool Done() const { return pos_ >= end_; }
+  void Next() { pos_++; }
+  const Arc &Value() const { return state_.arcs[pos_]; }
+ private:
+  const GrammarGraph::ExpandedState &state_;
+  int32 pos_;
+  int32 end_;
+};
+
+class GrammarNonemittingArcIterator {
+ public:
+  typedef GrammarGraph::Arc Arc;
+  GrammarNonemittingArcIterator(const GrammarGraph &graph,
+                                GrammarGraph::StateId s):
+      state_(graph.GetArcs(s)), pos_(state_.num_emitting),
+      end_(state_.arcs.size()) { }
+  bool Done() const { return pos_ >= end_; }
+  void Next() { pos_++; }
+  const Arc &Value() const { return state_.arcs[pos_]; }
+ private:
+  const GrammarGraph::ExpandedState &state_;
+  int32 pos_;
+  int32 end_;
+};
+
+
+/**
+   GrammarSubgraphCompiler compiles the sub-graphs for a GrammarGraph from
+   lists of words (e.g. a user's contact names), using the lexicon, tree and
+   model of the top-level graph, and caches them by word list so that a list
+   that is seen again costs nothing.  The grammar of a sub-graph accepts any
+   one of the words, with equal probabilities.
+*/
+class GrammarSubgraphCompiler {
+ public:
+  typedef fst::StdArc Arc;
+
+  /// "lex_fst" is L_disambig.fst, and "disambig_phones" its disambiguation
+  /// symbols.  The references must outlive this object.
+  GrammarSubgraphCompiler(const HclgCompilerOptions &opts,
+                          const ContextDependency &ctx_dep,
+                          const TransitionModel &trans_model,
+                          const fst::VectorFst<Arc> &lex_fst,
+                          const std::vector<int32> &disambig_phones);
+
+  /// Returns the sub-graph for the words in "words" (the order and any
+  /// duplicates don't matter).  The pointer is owned by this object and is
+  /// valid until ClearCache() is called or this object is destroyed.
+  const fst::VectorFst<Arc> *GetSubgraph(const std::vector<int32> &words);
+
+  /// Returns the number of sub-graphs in the cache.
+  int32 NumCached() const { return cache_.size(); }
+
+  /// Deletes all the cached sub-graphs.
+  void ClearCache();
+
+  ~GrammarSubgraphCompiler() { ClearCache(); }
+
+ private:
+  HclgCompilerOptions opts_;
+  const ContextDependency &ctx_dep_;
+  const TransitionModel &trans_model_;
+  const fst::VectorFst<Arc> &lex_fst_;
+  std::vector<int32> disambig_phones_;
+
+  typedef unordered_map<std::vector<int32>, fst::VectorFst<Arc>*,
+                        VectorHasher<int32> > CacheType;
+  CacheType cache_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(GrammarSubgraphCompiler);
+};
+
+
+} // end namespace kaldi.
+
+#endif
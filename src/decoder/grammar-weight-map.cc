@@ -0,0 +1,171 @@
+// decoder/grammar-weight-map.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/grammar-weight-map.h"
+#include "base/io-funcs.h"
+
+namespace kaldi {
+
+void GetGrammarArcs(const fst::Fst<fst::StdArc> &grammar,
+                    std::vector<int32> *words,
+                    std::vector<BaseFloat> *costs) {
+  using namespace fst;
+  typedef StdArc::Weight Weight;
+  words->clear();
+  costs->clear();
+  for (StateIterator<Fst<StdArc> > siter(grammar); !siter.Done();
+       siter.Next()) {
+    StdArc::StateId s = siter.Value();
+    for (ArcIterator<Fst<StdArc> > aiter(grammar, s); !aiter.Done();
+         aiter.Next()) {
+      const StdArc &arc = aiter.Value();
+      words->push_back(arc.olabel);
+      costs->push_back(arc.weight.Value());
+    }
+    Weight final = grammar.Final(s);
+    if (final != Weight::Zero()) {
+      words->push_back(0);
+      costs->push_back(final.Value());
+    }
+  }
+}
+
+void LabelGrammarArcs(fst::VectorFst<fst::StdArc> *grammar) {
+  using namespace fst;
+  typedef StdArc::Weight Weight;
+  typedef StdArc::StateId StateId;
+  StateId num_states = grammar->NumStates(),
+       final_state = kNoStateId;
+  int32 k = 0;
+  for (StateId s = 0; s < num_states; s++) {
+    for (MutableArcIterator<VectorFst<StdArc> > aiter(grammar, s);
+         !aiter.Done(); aiter.Next()) {
+      StdArc arc = aiter.Value();
+      arc.olabel = ++k;
+      arc.weight = Weight::One();
+      aiter.SetValue(arc);
+    }
+    if (grammar->Final(s) != Weight::Zero()) {
+      if (final_state == kNoStateId) {
+        final_state = grammar->AddState();
+        grammar->SetFinal(final_state, Weight::One());
+      }
+      grammar->SetFinal(s, Weight::Zero());
+      grammar->AddArc(s, StdArc(0, ++k, Weight::One(), final_state));
+    }
+  }
+  grammar->SetOutputSymbols(NULL);
+}
+
+void GrammarWeightMap::Init(const std::vector<int32> &words,
+                            const std::vector<BaseFloat> &costs,
+                            fst::VectorFst<fst::StdArc> *hclg) {
+  using namespace fst;
+  typedef StdArc::StateId StateId;
+  KALDI_ASSERT(words.size() == costs.size());
+  int32 num_grammar_arcs = words.size();
+  words_ = words;
+  grammar_arcs_.clear();
+  std::vector<BaseFloat> other_costs;
+  StateId num_states = hclg->NumStates();
+  for (StateId s = 0; s < num_states; s++) {
+    for (MutableArcIterator<VectorFst<StdArc> > aiter(hclg, s);
+         !aiter.Done(); aiter.Next()) {
+      StdArc arc = aiter.Value();
+      other_costs.push_back(arc.weight.Value());
+      if (arc.olabel == 0) {
+        grammar_arcs_.push_back(-1);
+        continue;
+      }
+      if (arc.olabel < 0 || arc.olabel > num_grammar_arcs)
+        KALDI_ERR << "Output label " << arc.olabel << " of HCLG is not a "
+                  << "grammar arc (was G labeled with LabelGrammarArcs()?)";
+      int32 k = arc.olabel - 1;
+      grammar_arcs_.push_back(k);
+      arc.olabel = words[k];
+      arc.weight = StdArc::Weight(arc.weight.Value() + costs[k]);
+      aiter.SetValue(arc);
+    }
+  }
+  other_costs_.Resize(other_costs.size(), kUndefined);
+  for (size_t a = 0; a < other_costs.size(); a++)
+    other_costs_(a) = other_costs[a];
+}
+
+void GrammarWeightMap::UpdateWeights(const fst::Fst<fst::StdArc> &grammar,
+                                     fst::VectorFst<fst::StdArc> *hclg) const {
+  std::vector<int32> words;
+  std::vector<BaseFloat> costs;
+  GetGrammarArcs(grammar, &words, &costs);
+  if (words != words_)
+    KALDI_ERR << "The grammar has different arcs from the one the map was "
+              << "built for (" << words.size() << " vs. " << words_.size()
+              << " grammar arcs); the graph needs to be rebuilt.";
+  UpdateWeights(costs, hclg);
+}
+
+void GrammarWeightMap::UpdateWeights(const std::vector<BaseFloat> &costs,
+                                     fst::VectorFst<fst::StdArc> *hclg) const {
+  using namespace fst;
+  typedef StdArc::StateId StateId;
+  KALDI_ASSERT(costs.size() == words_.size());
+  StateId num_states = hclg->NumStates();
+  int32 a = 0, num_arcs = NumArcs();
+  for (StateId s = 0; s < num_states; s++) {
+    for (MutableArcIterator<VectorFst<StdArc> > aiter(hclg, s);
+         !aiter.Done(); aiter.Next(), a++) {
+      if (a >= num_arcs)
+        KALDI_ERR << "HCLG has more arcs than the map (" << num_arcs << ")";
+      StdArc arc = aiter.Value();
+      int32 k = grammar_arcs_[a];
+      if (arc.olabel != (k == -1 ? 0 : words_[k]))
+        KALDI_ERR << "HCLG does not match the map (output label mismatch "
+                  << "for arc " << a << ")";
+      BaseFloat cost = other_costs_(a) + (k == -1 ? 0.0 : costs[k]);
+      arc.weight = StdArc::Weight(cost);
+      aiter.SetValue(arc);
+    }
+  }
+  if (a != num_arcs)
+    KALDI_ERR << "HCLG has " << a << " arcs but the map has " << num_arcs;
+}
+
+void GrammarWeightMap::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<GrammarWeightMap>");
+  WriteToken(os, binary, "<Words>");
+  WriteIntegerVector(os, binary, words_);
+  WriteToken(os, binary, "<GrammarArcs>");
+  WriteIntegerVector(os, binary, grammar_arcs_);
+  WriteToken(os, binary, "<OtherCosts>");
+  other_costs_.Write(os, binary);
+  WriteToken(os, binary, "</GrammarWeightMap>");
+}
+
+void GrammarWeightMap::Read(std::istream &is, bool binary) {
+  ExpectToken(is, binary, "<GrammarWeightMap>");
+  ExpectToken(is, binary, "<Words>");
+  ReadIntegerVector(is, binary, &words_);
+  ExpectToken(is, binary, "<GrammarArcs>");
+  ReadIntegerVector(is, binary, &grammar_arcs_);
+  ExpectToken(is, binary, "<OtherCosts>");
+  other_costs_.Read(is, binary);
+  ExpectToken(is, binary, "</GrammarWeightMap>");
+  if (other_costs_.Dim() != NumArcs())
+    KALDI_ERR << "Bad GrammarWeightMap: dimension mismatch.";
+}
+
+}  // namespace kaldi
@@ -0,0 +1,120 @@
+// decoder/grammar-weight-map.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_GRAMMAR_WEIGHT_MAP_H_
+#define KALDI_DECODER_GRAMMAR_WEIGHT_MAP_H_
+
+#include <vector>
+#include "base/kaldi-common.h"
+#include "matrix/kaldi-vector.h"
+#include "fst/fstlib.h"
+
+namespace kaldi {
+
+/*
+   The functions and the class in this file make it possible to change the
+   weights of the grammar G (e.g. after changing the interpolation weights of
+   an interpolated LM) and get the corresponding HCLG without recomposing and
+   redeterminizing it, so long as the topology of G does not change.
+
+   We number the "grammar arcs" of G: these are its arcs, in the order of
+   their states and then in arc order, with an extra entry after the arcs of
+   each final state for its final-prob.  Before building HCLG we replace the
+   output label of grammar arc k by k + 1, and its weight by One, and we
+   replace the final-probs by arcs with that label into a new final state (see
+   LabelGrammarArcs()).  Because G is deterministic on its input labels (the
+   words and the backoff symbol #0), and L_disambig makes the phone sequences
+   of the words distinct, the composition remains functional, and
+   determinization and minimization preserve, for each path, the sequence of
+   output labels and the sum of the weights.  So the output label of an arc
+   of the resulting HCLG says which grammar arc (if any) it carries, and its
+   weight is the non-grammar part of the cost (from the transition model).
+   GrammarWeightMap::Init() stores those, and puts the words and the grammar
+   costs back in; GrammarWeightMap::UpdateWeights() then just rewrites the
+   weights for new grammar costs.
+
+   The graph can be a little larger than the normal HCLG, because the grammar
+   costs are not pushed and states with the same future word sequence but
+   different grammar arcs are not merged; and the final-probs of G appear as
+   epsilon arcs.  See make-hclg --write-grammar-weight-map and
+   update-hclg-grammar-weights.
+*/
+
+
+/// Outputs the word (the output label, 0 for backoff arcs and final-probs)
+/// and the cost of each grammar arc of "grammar", numbered as described
+/// above.
+void GetGrammarArcs(const fst::Fst<fst::StdArc> &grammar,
+                    std::vector<int32> *words,
+                    std::vector<BaseFloat> *costs);
+
+/// Replaces the output label of each grammar arc k by k + 1, and its weight
+/// by One, where the final-probs become arcs with input label zero into a new
+/// final state.  Call GetGrammarArcs() first to get the words and costs.
+void LabelGrammarArcs(fst::VectorFst<fst::StdArc> *grammar);
+
+
+/// GrammarWeightMap stores, for each arc of an HCLG built from a G with
+/// labeled grammar arcs (see above), the grammar arc it carries (or -1) and
+/// the rest of its cost; the arcs are numbered in the order of their states
+/// and then in arc order.
+class GrammarWeightMap {
+ public:
+  GrammarWeightMap() { }
+
+  /// "hclg" is the HCLG built from the output of LabelGrammarArcs(), and
+  /// "words" and "costs" are the output of GetGrammarArcs() for the original
+  /// G.  We work out the map, and replace the output labels of hclg by the
+  /// words and add the grammar costs to its weights, so it's then a normal
+  /// HCLG.
+  void Init(const std::vector<int32> &words,
+            const std::vector<BaseFloat> &costs,
+            fst::VectorFst<fst::StdArc> *hclg);
+
+  /// Sets the weights of "hclg" (which must be the graph output by Init(), or
+  /// a copy of it, possibly with modified weights) for the grammar "grammar",
+  /// which must have the same grammar arcs, with the same words, as the one
+  /// the map was built for; it dies with an error if not.
+  void UpdateWeights(const fst::Fst<fst::StdArc> &grammar,
+                     fst::VectorFst<fst::StdArc> *hclg) const;
+
+  /// As above, but given the grammar costs (as output by GetGrammarArcs()).
+  void UpdateWeights(const std::vector<BaseFloat> &costs,
+                     fst::VectorFst<fst::StdArc> *hclg) const;
+
+  int32 NumArcs() const { return grammar_arcs_.size(); }
+
+  int32 NumGrammarArcs() const { return words_.size(); }
+
+  void Write(std::ostream &os, bool binary) const;
+  void Read(std::istream &is, bool binary);
+
+ private:
+  // The words of the grammar arcs, used to check that a new grammar has the
+  // same topology.
+  std::vector<int32> words_;
+  // For each arc of HCLG, the grammar arc it carries, or -1.
+  std::vector<int32> grammar_arcs_;
+  // For each arc of HCLG, the part of the cost that does not come from the
+  // grammar.
+  Vector<BaseFloat> other_costs_;
+};
+
+
+}  // namespace kaldi
+
+#endif  // KALDI_DECODER_GRAMMAR_WEIGHT_MAP_H_
@@ -0,0 +1,154 @@
+// decoder/hclg-compiler.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include "decoder/hclg-compiler.h"
+#include "fstext/fstext-lib.h"
+
+namespace kaldi {
+
+// Frees the memory of "fst".
+static void FreeFst(fst::VectorFst<fst::StdArc> *fst) {
+  fst::VectorFst<fst::StdArc> empty;
+  *fst = empty;
+}
+
+// Composes with TableCompose(), or, if opts.num_threads > 1, with
+// ParallelTableCompose(), which gives an equivalent result.
+static void ComposeFsts(const HclgCompilerOptions &opts,
+                        const fst::VectorFst<fst::StdArc> &fst1,
+                        const fst::VectorFst<fst::StdArc> &fst2,
+                        fst::VectorFst<fst::StdArc> *ofst) {
+  if (opts.num_threads > 1) {
+    fst::ParallelComposeOptions compose_opts;
+    compose_opts.num_threads = opts.num_threads;
+    fst::ParallelTableCompose(fst1, fst2, ofst, compose_opts);
+  } else {
+    fst::TableCompose(fst1, fst2, ofst);
+  }
+}
+
+void CompileLG(const HclgCompilerOptions &opts,
+               fst::VectorFst<fst::StdArc> *lex_fst,
+               fst::VectorFst<fst::StdArc> *grammar_fst,
+               fst::VectorFst<fst::StdArc> *lg_fst) {
+  using namespace fst;
+  ComposeFsts(opts, *lex_fst, *grammar_fst, lg_fst);
+  FreeFst(lex_fst);
+  FreeFst(grammar_fst);
+  if (lg_fst->Start() == kNoStateId)
+    KALDI_ERR << "Composition of lexicon and grammar is empty.";
+  DeterminizeStarInLog(lg_fst, kDelta, NULL, -1, opts.num_threads);
+  MinimizeEncoded(lg_fst);
+  ArcSort(lg_fst, ILabelCompare<StdArc>());
+}
+
+void CompileCLG(int32 context_width, int32 central_position,
+                const std::vector<int32> &disambig_phones,
+                fst::VectorFst<fst::StdArc> *lg_fst,
+                fst::VectorFst<fst::StdArc> *clg_fst,
+                std::vector<std::vector<int32> > *ilabel_info) {
+  using namespace fst;
+  if (disambig_phones.empty())
+    KALDI_WARN << "Disambiguation symbols list is empty; this likely "
+               << "indicates an error in data preparation.";
+  std::vector<int32> disambig(disambig_phones);  // ComposeContext wants
+                                                 // non-const.
+  ComposeContext(disambig, context_width, central_position,
+                 lg_fst, clg_fst, ilabel_info);
+  FreeFst(lg_fst);
+  ArcSort(clg_fst, ILabelCompare<StdArc>());
+}
+
+void CompileHCLG(const HclgCompilerOptions &opts,
+                 const ContextDependency &ctx_dep,
+                 const TransitionModel &trans_model,
+                 const std::vector<std::vector<int32> > &ilabel_info,
+                 fst::VectorFst<fst::StdArc> *clg_fst,
+                 fst::VectorFst<fst::StdArc> *hclg_fst,
+                 const std::vector<int32> *nonterminal_phones,
+                 std::vector<int32> *nonterminal_ilabels) {
+  using namespace fst;
+  std::vector<int32> disambig_tid;
+  VectorFst<StdArc> *h_fst = GetHTransducer(ilabel_info, ctx_dep, trans_model,
+                                            opts.h_config, &disambig_tid);
+  // kept_tid are the disambiguation symbols we don't remove (the
+  // nonterminals); it's sorted because GetHTransducer() allocates the symbols
+  // in increasing order.
+  std::vector<int32> removed_tid, kept_tid;
+  if (nonterminal_phones == NULL) {
+    removed_tid = disambig_tid;
+  } else {
+    KALDI_ASSERT(nonterminal_ilabels != NULL);
+    nonterminal_ilabels->clear();
+    nonterminal_ilabels->resize(nonterminal_phones->size(), -1);
+    // The k'th disambiguation symbol of H is the one for the k'th
+    // disambiguation symbol in ilabel_info, which is {-phone}.
+    size_t k = 0;
+    for (size_t j = 1; j < ilabel_info.size(); j++) {
+      if (ilabel_info[j].size() == 1 && ilabel_info[j][0] <= 0) {
+        KALDI_ASSERT(k < disambig_tid.size());
+        int32 phone = -ilabel_info[j][0], tid = disambig_tid[k++];
+        std::vector<int32>::const_iterator iter =
+            std::find(nonterminal_phones->begin(), nonterminal_phones->end(),
+                      phone);
+        if (iter == nonterminal_phones->end()) {
+          removed_tid.push_back(tid);
+        } else {
+          (*nonterminal_ilabels)[iter - nonterminal_phones->begin()] = tid;
+          kept_tid.push_back(tid);
+        }
+      }
+    }
+    KALDI_ASSERT(k == disambig_tid.size());
+    for (size_t i = 0; i < nonterminal_phones->size(); i++)
+      if ((*nonterminal_ilabels)[i] == -1)
+        KALDI_ERR << "Nonterminal symbol " << (*nonterminal_phones)[i]
+                  << " is not a disambiguation symbol of CLG.";
+  }
+  ComposeFsts(opts, *h_fst, *clg_fst, hclg_fst);
+  delete h_fst;
+  FreeFst(clg_fst);
+  if (hclg_fst->Start() == kNoStateId)
+    KALDI_ERR << "Composition of H and CLG is empty.";
+  DeterminizeStarInLog(hclg_fst, kDelta, NULL, -1, opts.num_threads);
+  RemoveSomeInputSymbols(removed_tid, hclg_fst);
+  RemoveEpsLocal(hclg_fst);
+  MinimizeEncoded(hclg_fst);
+  AddSelfLoops(trans_model, kept_tid, opts.self_loop_scale, opts.reorder,
+               hclg_fst);
+}
+
+void CompileHCLG(const HclgCompilerOptions &opts,
+                 const ContextDependency &ctx_dep,
+                 const TransitionModel &trans_model,
+                 const std::vector<int32> &disambig_phones,
+                 fst::VectorFst<fst::StdArc> *lex_fst,
+                 fst::VectorFst<fst::StdArc> *grammar_fst,
+                 fst::VectorFst<fst::StdArc> *hclg_fst,
+                 const std::vector<int32> *nonterminal_phones,
+                 std::vector<int32> *nonterminal_ilabels) {
+  fst::VectorFst<fst::StdArc> lg_fst, clg_fst;
+  CompileLG(opts, lex_fst, grammar_fst, &lg_fst);
+  std::vector<std::vector<int32> > ilabel_info;
+  CompileCLG(ctx_dep.ContextWidth(), ctx_dep.CentralPosition(),
+             disambig_phones, &lg_fst, &clg_fst, &ilabel_info);
+  CompileHCLG(opts, ctx_dep, trans_model, ilabel_info, &clg_fst, hclg_fst,
+              nonterminal_phones, nonterminal_ilabels);
+}
+
+}  // namespace kaldi
@@ -0,0 +1,108 @@
+// decoder/hclg-compiler.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_HCLG_COMPILER_H_
+#define KALDI_DECODER_HCLG_COMPILER_H_
+
+#include <vector>
+#include "base/kaldi-common.h"
+#include "hmm/transition-model.h"
+#include "hmm/hmm-utils.h"
+#include "tree/context-dep.h"
+#include "fst/fstlib.h"
+
+namespace kaldi {
+
+/// Options for building the decoding graph HCLG in memory; these correspond to
+/// the options of utils/mkgraph.sh and the programs it calls.
+struct HclgCompilerOptions {
+  HTransducerConfig h_config;  // transition-scale, reverse etc.
+  BaseFloat self_loop_scale;
+  bool reorder;
+  // Number of threads used in composition and DeterminizeStar; note, the
+  // ThreadPool has g_num_threads threads, so that should be set too.
+  int32 num_threads;
+
+  HclgCompilerOptions(): self_loop_scale(0.1), reorder(true),
+                         num_threads(1) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("self-loop-scale", &self_loop_scale, "Scale for self-loop "
+                   "probabilities relative to LM.");
+    opts->Register("reorder", &reorder, "If true, reorder symbols for more "
+                   "decoding efficiency");
+    opts->Register("num-threads", &num_threads, "Number of threads used in "
+                   "composition and determinization");
+    h_config.Register(opts);
+  }
+};
+
+
+/// Composes the lexicon and grammar (L_disambig.fst and G.fst), then
+/// determinizes (in the log semiring) and minimizes the result, and sorts it
+/// on input label; this is LG.fst in utils/mkgraph.sh.  lex_fst and
+/// grammar_fst are freed once they have been used (they are left empty).
+void CompileLG(const HclgCompilerOptions &opts,
+               fst::VectorFst<fst::StdArc> *lex_fst,
+               fst::VectorFst<fst::StdArc> *grammar_fst,
+               fst::VectorFst<fst::StdArc> *lg_fst);
+
+/// Composes LG with the context FST and sorts on input label (CLG.fst).
+/// context_width and central_position are the N and P of the tree, see
+/// ContextDependency.  "disambig_phones" are the disambiguation symbols on the
+/// input of LG; the meaning of the input labels of CLG is output to
+/// "ilabel_info" (see fstext/context-fst.h).  lg_fst is left empty.
+void CompileCLG(int32 context_width, int32 central_position,
+                const std::vector<int32> &disambig_phones,
+                fst::VectorFst<fst::StdArc> *lg_fst,
+                fst::VectorFst<fst::StdArc> *clg_fst,
+                std::vector<std::vector<int32> > *ilabel_info);
+
+/// Creates the H transducer from "ilabel_info" and composes it with CLG, then
+/// determinizes, removes the disambiguation symbols, minimizes and adds the
+/// self-loops.  The output has transition-ids on the input and words on the
+/// output.  clg_fst is left empty.
+///
+/// If "nonterminal_phones" is non-NULL, those disambiguation symbols (which
+/// mark the places where sub-graphs are to be inserted at decode time, see
+/// GrammarGraph in grammar-graph.h) are not removed, and the input labels they
+/// have in HCLG are output to "nonterminal_ilabels", in the same order.
+void CompileHCLG(const HclgCompilerOptions &opts,
+                 const ContextDependency &ctx_dep,
+                 const TransitionModel &trans_model,
+                 const std::vector<std::vector<int32> > &ilabel_info,
+                 fst::VectorFst<fst::StdArc> *clg_fst,
+                 fst::VectorFst<fst::StdArc> *hclg_fst,
+                 const std::vector<int32> *nonterminal_phones = NULL,
+                 std::vector<int32> *nonterminal_ilabels = NULL);
+
+/// Does the whole of the above, i.e. what utils/mkgraph.sh does, but without
+/// writing the intermediate FSTs to disk.  The context width is that of
+/// ctx_dep.  lex_fst and grammar_fst are left empty.
+void CompileHCLG(const HclgCompilerOptions &opts,
+                 const ContextDependency &ctx_dep,
+                 const TransitionModel &trans_model,
+                 const std::vector<int32> &disambig_phones,
+                 fst::VectorFst<fst::StdArc> *lex_fst,
+                 fst::VectorFst<fst::StdArc> *grammar_fst,
+                 fst::VectorFst<fst::StdArc> *hclg_fst,
+                 const std::vector<int32> *nonterminal_phones = NULL,
+                 std::vector<int32> *nonterminal_ilabels = NULL);
+
+}  // namespace kaldi
+
+#endif  // KALDI_DECODER_HCLG_COMPILER_H_
@@ -24,11 +24,13 @@
 
 #include "util/stl-utils.h"
 #include "util/hash-list.h"
+#include "util/object-pool.h"
 #include "fst/fstlib.h"
 #include "itf/decodable-itf.h"
 #include "fstext/fstext-lib.h"
 #include "lat/kaldi-lattice.h"
 #include "decoder/lattice-faster-decoder.h" // for options.
+#include "decoder/biglm-decoder-utils.h"
 
 
 namespace kaldi {
@@ -50,7 +52,7 @@ class LatticeBiglmFasterDecoder {
   typedef fst::StdArc Arc;
   typedef Arc::Label Label;
   typedef Arc::StateId StateId;
-  // A PairId will be constructed as: (StateId in fst) + (StateId in lm_diff_fst) << 32;
+  // A PairId is constructed by ConstructBiglmPair() (see biglm-decoder-utils.h).
   typedef uint64 PairId;
   typedef Arc::Weight Weight;
   // instantiate this class once for each thing you have to decode.
@@ -58,7 +60,8 @@ class LatticeBiglmFasterDecoder {
       const fst::Fst<fst::StdArc> &fst,      
       const LatticeBiglmFasterDecoderConfig &config,
       fst::DeterministicOnDemandFst<fst::StdArc> *lm_diff_fst):
-      fst_(fst), lm_diff_fst_(lm_diff_fst), config_(config),
+      fst_(fst), lm_diff_fst_(lm_diff_fst), lm_arc_cache_(lm_diff_fst),
+      config_(config),
       warned_noarc_(false), num_toks_(0) {
     config.Check();
     KALDI_ASSERT(fst.Start() != fst::kNoStateId &&
@@ -84,7 +87,7 @@ class LatticeBiglmFasterDecoder {
     num_toks_ = 0;
     PairId start_pair = ConstructPair(fst_.Start(), lm_diff_fst_->Start());
     active_toks_.resize(1);
-    Token *start_tok = new Token(0.0, 0.0, NULL, NULL);
+    Token *start_tok = new (token_pool_.Allocate()) Token(0.0, 0.0, NULL, NULL);
     active_toks_[0].toks = start_tok;
     toks_.Insert(start_pair, start_tok);
     num_toks_++;
@@ -134,7 +137,7 @@ class LatticeBiglmFasterDecoder {
                      bool use_final_probs = true) const {
     typedef LatticeArc Arc;
     typedef Arc::StateId StateId;
-    // A PairId will be constructed as: (StateId in fst) + (StateId in lm_diff_fst) << 32;
+    // A PairId is constructed by ConstructBiglmPair() (see biglm-decoder-utils.h).
     typedef uint64 PairId;
     typedef Arc::Weight Weight;
     typedef Arc::Label Label;
@@ -227,14 +230,14 @@ class LatticeBiglmFasterDecoder {
   
  private:
   inline PairId ConstructPair(StateId fst_state, StateId lm_state) {
-    return static_cast<PairId>(fst_state) + (static_cast<PairId>(lm_state) << 32);
+    return ConstructBiglmPair(fst_state, lm_state);
   }
   
   static inline StateId PairToState(PairId state_pair) {
-    return static_cast<StateId>(static_cast<uint32>(state_pair));
+    return BiglmPairToState(state_pair);
   }
   static inline StateId PairToLmState(PairId state_pair) {
-    return static_cast<StateId>(static_cast<uint32>(state_pair >> 32));
+    return BiglmPairToLmState(state_pair);
   }
   
   struct Token;
@@ -276,15 +279,6 @@ class LatticeBiglmFasterDecoder {
     inline Token(BaseFloat tot_cost, BaseFloat extra_cost, ForwardLink *links,
                  Token *next): tot_cost(tot_cost), extra_cost(extra_cost),
                  links(links), next(next) { }
-    inline void DeleteForwardLinks() {
-      ForwardLink *l = links, *m; 
-      while (l != NULL) {
-        m = l->next;
-        delete l;
-        l = m;
-      }
-      links = NULL;
-    }
   };
   
   // head and tail of per-frame list of Tokens (list is in topological order),
@@ -324,7 +318,8 @@ class LatticeBiglmFasterDecoder {
       // tokens on the currently final frame have zero extra_cost
       // as any of them could end up
       // on the winning path.
-      Token *new_tok = new Token (tot_cost, extra_cost, NULL, toks);
+      Token *new_tok = new (token_pool_.Allocate())
+          Token(tot_cost, extra_cost, NULL, toks);
       // NULL: no forward links yet
       toks = new_tok;
       num_toks_++;
@@ -396,7 +391,7 @@ class LatticeBiglmFasterDecoder {
             ForwardLink *next_link = link->next;
             if (prev_link != NULL) prev_link->next = next_link;
             else tok->links = next_link;
-            delete link;
+            link_pool_.Free(link);
             link = next_link; // advance link but leave prev_link the same.
             *links_pruned = true;
           } else { // keep the link and update the tok_extra_cost if needed.
@@ -487,7 +482,7 @@ class LatticeBiglmFasterDecoder {
             ForwardLink *next_link = link->next;
             if (prev_link != NULL) prev_link->next = next_link;
             else tok->links = next_link;
-            delete link;
+            link_pool_.Free(link);
             link = next_link; // advance link but leave prev_link the same.
           } else { // keep the link and update the tok_extra_cost if needed.
             if (link_extra_cost < 0.0) { // this is just a precaution.
@@ -548,7 +543,7 @@ class LatticeBiglmFasterDecoder {
         // excise tok from list and delete tok.
         if (prev_tok != NULL) prev_tok->next = tok->next;
         else toks = tok->next;
-        delete tok;
+        token_pool_.Free(tok);
         num_toks_--;
       } else { // fetch next Token
         prev_tok = tok;
@@ -666,7 +661,7 @@ class LatticeBiglmFasterDecoder {
       return lm_state; // no change in LM state if no word crossed.
     } else { // Propagate in the LM-diff FST.
       Arc lm_arc;
-      bool ans = lm_diff_fst_->GetArc(lm_state, arc->olabel, &lm_arc);
+      bool ans = lm_arc_cache_.GetArc(lm_state, arc->olabel, &lm_arc);
       if (!ans) { // this case is unexpected for statistical LMs.
         if (!warned_noarc_) {
           warned_noarc_ = true;
@@ -748,8 +743,9 @@ class LatticeBiglmFasterDecoder {
             // true: emitting, NULL: no change indicator needed
           
             // Add ForwardLink from tok to next_tok (put on head of list tok->links)
-            tok->links = new ForwardLink(next_tok, arc.ilabel, arc.olabel, 
-                                         graph_cost, ac_cost, tok->links);
+            tok->links = new (link_pool_.Allocate())
+                ForwardLink(next_tok, arc.ilabel, arc.olabel, graph_cost,
+                            ac_cost, tok->links);
           }
         } // for all arcs
       }
@@ -798,7 +794,7 @@ class LatticeBiglmFasterDecoder {
       // because we're about to regenerate them.  This is a kind
       // of non-optimality (remember, this is the simple decoder),
       // but since most states are emitting it's not a huge issue.
-      tok->DeleteForwardLinks(); // necessary when re-visiting
+      DeleteForwardLinks(tok); // necessary when re-visiting
       tok->links = NULL;
       for (fst::ArcIterator<fst::Fst<Arc> > aiter(fst_, state);
           !aiter.Done();
@@ -815,8 +811,8 @@ class LatticeBiglmFasterDecoder {
             Token *new_tok = FindOrAddToken(next_pair, frame, tot_cost,
                                             false, &changed); // false: non-emit
             
-            tok->links = new ForwardLink(new_tok, 0, arc.olabel,
-                                         graph_cost, 0, tok->links);
+            tok->links = new (link_pool_.Allocate())
+                ForwardLink(new_tok, 0, arc.olabel, graph_cost, 0, tok->links);
             
             // "changed" tells us whether the new token has a different
             // cost from before, or is new [if so, add into queue].
@@ -832,6 +828,13 @@ class LatticeBiglmFasterDecoder {
   // more than one list (e.g. for current and previous frames), but only one of
   // them at a time can be indexed by StateId.
   HashList<PairId, Token*> toks_;
+
+  // Tokens and ForwardLinks are allocated from these pools rather than with
+  // new and delete (see ../util/object-pool.h).  The pools persist across
+  // utterances, so once they have grown to the size needed, decoding does no
+  // heap allocation for tokens or links.
+  ObjectPool<Token> token_pool_;
+  ObjectPool<ForwardLink> link_pool_;
   std::vector<TokenList> active_toks_; // Lists of tokens, indexed by
   // frame (members of TokenList are toks, must_prune_forward_links,
   // must_prune_tokens).
@@ -840,6 +843,7 @@ class LatticeBiglmFasterDecoder {
   // make it class member to avoid internal new/delete.
   const fst::Fst<fst::StdArc> &fst_;
   fst::DeterministicOnDemandFst<fst::StdArc> *lm_diff_fst_;  
+  BiglmLmArcCache lm_arc_cache_;  // caches the arcs of lm_diff_fst_.
   LatticeBiglmFasterDecoderConfig config_;
   bool warned_noarc_;  
   int32 num_toks_; // current total #toks allocated...
@@ -863,14 +867,26 @@ class LatticeBiglmFasterDecoder {
     toks_.Clear();
   }
   
+  // Returns all the forward links of "tok" to link_pool_, and sets tok->links
+  // to NULL.
+  inline void DeleteForwardLinks(Token *tok) {
+    ForwardLink *l = tok->links, *m;
+    while (l != NULL) {
+      m = l->next;
+      link_pool_.Free(l);
+      l = m;
+    }
+    tok->links = NULL;
+  }
+
   void ClearActiveTokens() { // a cleanup routine, at utt end/begin
     for (size_t i = 0; i < active_toks_.size(); i++) {
       // Delete all tokens alive on this frame, and any forward
       // links they may have.
       for (Token *tok = active_toks_[i].toks; tok != NULL; ) {
-        tok->DeleteForwardLinks();
+        DeleteForwardLinks(tok);
         Token *next_tok = tok->next;
-        delete tok;
+        token_pool_.Free(tok);
         num_toks_--;
         tok = next_tok;
       }
@@ -25,6 +25,14 @@
 // svn merge ^/sandbox/online/src/decoder/lattice-faster-decoder.cc lattice-faster-online-decoder.cc
 
 #include "decoder/lattice-faster-decoder.h"
+#include "decoder/csr-decoding-graph.h"
+#include "thread/kaldi-thread.h"
+#include "base/kaldi-memory-stats.h"
+#include "base/kaldi-trace.h"
+#include "base/timer.h"
+#include "decoder/lookahead-composed-graph.h"
+#include "decoder/grammar-graph.h"
+#include "decoder/decoder-search-stats.h"
 #include "lat/lattice-functions.h"
 
 namespace kaldi {
@@ -32,39 +40,98 @@ namespace kaldi {
 // instantiate this class once for each thing you have to decode.
 LatticeFasterDecoder::LatticeFasterDecoder(const fst::Fst<fst::StdArc> &fst,
                                            const LatticeFasterDecoderConfig &config):
-    fst_(fst), delete_fst_(false), config_(config), num_toks_(0) {
+    fst_(&fst), csr_graph_(NULL), lookahead_graph_(NULL),
+    grammar_graph_(NULL),
+    delete_fst_(false), config_(config),
+    num_toks_(0), search_stats_(NULL) {
   config.Check();
+  MemoryTagScope memory_tag(kMemoryDecoder);
   toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
 }
 
 
 LatticeFasterDecoder::LatticeFasterDecoder(const LatticeFasterDecoderConfig &config,
                                            fst::Fst<fst::StdArc> *fst):
-    fst_(*fst), delete_fst_(true), config_(config), num_toks_(0) {
+    fst_(fst), csr_graph_(NULL), lookahead_graph_(NULL),
+    grammar_graph_(NULL),
+    delete_fst_(true), config_(config),
+    num_toks_(0), search_stats_(NULL) {
   config.Check();
+  MemoryTagScope memory_tag(kMemoryDecoder);
+  toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
+}
+
+
+LatticeFasterDecoder::LatticeFasterDecoder(
+    const CsrDecodingGraph &graph,
+    const LatticeFasterDecoderConfig &config):
+    fst_(NULL), csr_graph_(&graph), lookahead_graph_(NULL),
+    grammar_graph_(NULL),
+    delete_fst_(false), config_(config), num_toks_(0), search_stats_(NULL) {
+  config.Check();
+  MemoryTagScope memory_tag(kMemoryDecoder);
+  toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
+}
+
+
+LatticeFasterDecoder::LatticeFasterDecoder(
+    const LookaheadComposedGraph &graph,
+    const LatticeFasterDecoderConfig &config):
+    fst_(NULL), csr_graph_(NULL), lookahead_graph_(&graph),
+    grammar_graph_(NULL),
+    delete_fst_(false), config_(config), num_toks_(0), search_stats_(NULL) {
+  config.Check();
+  MemoryTagScope memory_tag(kMemoryDecoder);
+  toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
+}
+
+
+LatticeFasterDecoder::LatticeFasterDecoder(
+    const GrammarGraph &graph,
+    const LatticeFasterDecoderConfig &config):
+    fst_(NULL), csr_graph_(NULL), lookahead_graph_(NULL),
+    grammar_graph_(&graph),
+    delete_fst_(false), config_(config), num_toks_(0), search_stats_(NULL) {
+  config.Check();
+  MemoryTagScope memory_tag(kMemoryDecoder);
   toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
 }
 
 
 LatticeFasterDecoder::~LatticeFasterDecoder() {
-  DeleteElems(toks_.Clear());
+  toks_.Clear();
   ClearActiveTokens();
-  if (delete_fst_) delete &(fst_);
+  if (delete_fst_) delete fst_;
+}
+
+LatticeFasterDecoder::StateId LatticeFasterDecoder::GraphStart() const {
+  if (csr_graph_ != NULL) return csr_graph_->Start();
+  else if (lookahead_graph_ != NULL) return lookahead_graph_->Start();
+  else if (grammar_graph_ != NULL) return grammar_graph_->Start();
+  else return fst_->Start();
+}
+
+BaseFloat LatticeFasterDecoder::GraphFinal(StateId s) const {
+  if (csr_graph_ != NULL) return csr_graph_->Final(s);
+  else if (lookahead_graph_ != NULL) return lookahead_graph_->Final(s);
+  else if (grammar_graph_ != NULL) return grammar_graph_->Final(s);
+  else return fst_->Final(s).Value();
 }
 
 void LatticeFasterDecoder::InitDecoding() {
+  MemoryTagScope memory_tag(kMemoryDecoder);
   // clean up from last time:
-  DeleteElems(toks_.Clear());
+  toks_.Clear();
   cost_offsets_.clear();
   ClearActiveTokens();
   warned_ = false;
   num_toks_ = 0;
   decoding_finalized_ = false;
   final_costs_.clear();
-  StateId start_state = fst_.Start();
+  StateId start_state = GraphStart();
   KALDI_ASSERT(start_state != fst::kNoStateId);
   active_toks_.resize(1);
-  Token *start_tok = new Token(0.0, 0.0, NULL, NULL);
+  Token *start_tok = new (token_pool_.Allocate()) Token(0.0, 0.0, NULL, NULL);
   active_toks_[0].toks = start_tok;
   toks_.Insert(start_state, start_tok);
   num_toks_++;
@@ -75,6 +142,7 @@ void LatticeFasterDecoder::InitDecoding() {
 // a final state).  It should only very rarely return false; this indicates
 // an unusual search error.
 bool LatticeFasterDecoder::Decode(DecodableInterface *decodable) {
+  MemoryTagScope memory_tag(kMemoryDecoder);
   InitDecoding();
 
   // We use 1-based indexing for frames in this decoder (if you view it in
@@ -82,6 +150,7 @@ bool LatticeFasterDecoder::Decode(DecodableInterface *decodable) {
   // numbering, which we have to correct for when we call it.
 
   while (!decodable->IsLastFrame(NumFramesDecoded() - 1)) {
+    KALDI_TRACE_SCOPE("LatticeFasterDecoder frame");
     if (NumFramesDecoded() % config_.prune_interval == 0)
       PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
     BaseFloat cost_cutoff = ProcessEmitting(decodable);
@@ -235,13 +304,14 @@ inline LatticeFasterDecoder::Token *LatticeFasterDecoder::FindOrAddToken(
   // if the token was newly created or the cost changed.
   KALDI_ASSERT(frame_plus_one < active_toks_.size());
   Token *&toks = active_toks_[frame_plus_one].toks;
-  Elem *e_found = toks_.Find(state);
-  if (e_found == NULL) {  // no such token presently.
+  Token **tok_found = toks_.Find(state);
+  if (tok_found == NULL) {  // no such token presently.
     const BaseFloat extra_cost = 0.0;
     // tokens on the currently final frame have zero extra_cost
     // as any of them could end up
     // on the winning path.
-    Token *new_tok = new Token (tot_cost, extra_cost, NULL, toks);
+    Token *new_tok = new (token_pool_.Allocate())
+        Token(tot_cost, extra_cost, NULL, toks);
     // NULL: no forward links yet
     toks = new_tok;
     num_toks_++;
@@ -249,7 +319,7 @@ inline LatticeFasterDecoder::Token *LatticeFasterDecoder::FindOrAddToken(
     if (changed) *changed = true;
     return new_tok;
   } else {
-    Token *tok = e_found->val;  // There is an existing Token for this state.
+    Token *tok = *tok_found;  // There is an existing Token for this state.
     if (tok->tot_cost > tot_cost) {  // replace old token
       tok->tot_cost = tot_cost;
       // we don't allocate a new token, the old stays linked in active_toks_
@@ -267,6 +337,16 @@ inline LatticeFasterDecoder::Token *LatticeFasterDecoder::FindOrAddToken(
   }
 }
 
+inline void LatticeFasterDecoder::DeleteForwardLinks(Token *tok) {
+  ForwardLink *l = tok->links, *m;
+  while (l != NULL) {
+    m = l->next;
+    link_pool_.Free(l);
+    l = m;
+  }
+  tok->links = NULL;
+}
+
 // prunes outgoing links for all tokens in active_toks_[frame]
 // it's called by PruneActiveTokens
 // all links, that have link_extra_cost > lattice_beam are pruned
@@ -281,6 +361,7 @@ void LatticeFasterDecoder::PruneForwardLinks(
 
   *extra_costs_changed = false;
   *links_pruned = false;
+  int32 num_links_pruned = 0;
   KALDI_ASSERT(frame_plus_one >= 0 && frame_plus_one < active_toks_.size());
   if (active_toks_[frame_plus_one].toks == NULL) {  // empty list; should not happen.
     if (!warned_) {
@@ -314,9 +395,10 @@ void LatticeFasterDecoder::PruneForwardLinks(
           ForwardLink *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          delete link;
+          link_pool_.Free(link);
           link = next_link;  // advance link but leave prev_link the same.
           *links_pruned = true;
+          num_links_pruned++;
         } else {   // keep the link and update the tok_extra_cost if needed.
           if (link_extra_cost < 0.0) {  // this is just a precaution.
             if (link_extra_cost < -0.01)
@@ -341,6 +423,8 @@ void LatticeFasterDecoder::PruneForwardLinks(
     // optimizations could cause an infinite loop here for small delta and
     // high-dynamic-range scores.
   } // while changed
+  if (search_stats_ != NULL && num_links_pruned != 0)
+    search_stats_->AddLinksPruned(frame_plus_one - 1, num_links_pruned);
 }
 
 // PruneForwardLinksFinal is a version of PruneForwardLinks that we call
@@ -356,11 +440,11 @@ void LatticeFasterDecoder::PruneForwardLinksFinal() {
   typedef unordered_map<Token*, BaseFloat>::const_iterator IterType;
   ComputeFinalCosts(&final_costs_, &final_relative_cost_, &final_best_cost_);
   decoding_finalized_ = true;
-  // We call DeleteElems() as a nicety, not because it's really necessary;
+  // We call toks_.Clear() as a nicety, not because it's really necessary;
   // otherwise there would be a time, after calling PruneTokensForFrame() on the
   // final frame, when toks_.GetList() or toks_.Clear() would contain pointers
   // to nonexistent tokens.
-  DeleteElems(toks_.Clear());
+  toks_.Clear();
 
   // Now go through tokens on this frame, pruning forward links...  may have to
   // iterate a few times until there is no more change, because the list is not
@@ -401,7 +485,7 @@ void LatticeFasterDecoder::PruneForwardLinksFinal() {
           ForwardLink *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          delete link;
+          link_pool_.Free(link);
           link = next_link; // advance link but leave prev_link the same.
         } else { // keep the link and update the tok_extra_cost if needed.
           if (link_extra_cost < 0.0) { // this is just a precaution.
@@ -460,7 +544,7 @@ void LatticeFasterDecoder::PruneTokensForFrame(int32 frame_plus_one) {
       // excise tok from list and delete tok.
       if (prev_tok != NULL) prev_tok->next = tok->next;
       else toks = tok->next;
-      delete tok;
+      token_pool_.Free(tok);
       num_toks_--;
     } else {  // fetch next Token
       prev_tok = tok;
@@ -474,6 +558,7 @@ void LatticeFasterDecoder::PruneTokensForFrame(int32 frame_plus_one) {
 // where the delta-costs are not changing (and the delta controls when we consider
 // a cost to have "not changed").
 void LatticeFasterDecoder::PruneActiveTokens(BaseFloat delta) {
+  KALDI_TRACE_SCOPE("LatticeFasterDecoder::PruneActiveTokens");
   int32 cur_frame_plus_one = NumFramesDecoded();
   int32 num_toks_begin = num_toks_;
   // The index "f" below represents a "frame plus one", i.e. you'd have to subtract
@@ -509,22 +594,20 @@ void LatticeFasterDecoder::ComputeFinalCosts(
   KALDI_ASSERT(!decoding_finalized_);
   if (final_costs != NULL)
     final_costs->clear();
-  const Elem *final_toks = toks_.GetList();
+  const std::vector<Elem> &final_toks = toks_.GetList();
   BaseFloat infinity = std::numeric_limits<BaseFloat>::infinity();
   BaseFloat best_cost = infinity,
       best_cost_with_final = infinity;
-  while (final_toks != NULL) {
-    StateId state = final_toks->key;
-    Token *tok = final_toks->val;
-    const Elem *next = final_toks->tail;
-    BaseFloat final_cost = fst_.Final(state).Value();
+  for (size_t i = 0; i < final_toks.size(); i++) {
+    StateId state = final_toks[i].key;
+    Token *tok = final_toks[i].val;
+    BaseFloat final_cost = GraphFinal(state);
     BaseFloat cost = tok->tot_cost,
         cost_with_final = cost + final_cost;
     best_cost = std::min(cost, best_cost);
     best_cost_with_final = std::min(cost_with_final, best_cost_with_final);
     if (final_costs != NULL && final_cost != infinity)
       (*final_costs)[tok] = final_cost;
-    final_toks = next;
   }
   if (final_relative_cost != NULL) {
     if (best_cost == infinity && best_cost_with_final == infinity) {
@@ -546,6 +629,7 @@ void LatticeFasterDecoder::ComputeFinalCosts(
 
 void LatticeFasterDecoder::AdvanceDecoding(DecodableInterface *decodable,
                                              int32 max_num_frames) {
+  MemoryTagScope memory_tag(kMemoryDecoder);
   KALDI_ASSERT(!active_toks_.empty() && !decoding_finalized_ &&
                "You must call InitDecoding() before AdvanceDecoding");
   int32 num_frames_ready = decodable->NumFramesReady();
@@ -559,6 +643,7 @@ void LatticeFasterDecoder::AdvanceDecoding(DecodableInterface *decodable,
     target_frames_decoded = std::min(target_frames_decoded,
                                      NumFramesDecoded() + max_num_frames);
   while (NumFramesDecoded() < target_frames_decoded) {
+    KALDI_TRACE_SCOPE("LatticeFasterDecoder frame");
     if (NumFramesDecoded() % config_.prune_interval == 0) {
       PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
     }
@@ -571,6 +656,8 @@ void LatticeFasterDecoder::AdvanceDecoding(DecodableInterface *decodable,
 // (optionally) on the final frame.  Takes into account the final-prob of
 // tokens.  This function used to be called PruneActiveTokensFinal().
 void LatticeFasterDecoder::FinalizeDecoding() {
+  MemoryTagScope memory_tag(kMemoryDecoder);
+  KALDI_TRACE_SCOPE("LatticeFasterDecoder::FinalizeDecoding");
   int32 final_frame_plus_one = NumFramesDecoded();
   int32 num_toks_begin = num_toks_;
   // PruneForwardLinksFinal() prunes final frame (with final-probs), and
@@ -588,18 +675,20 @@ void LatticeFasterDecoder::FinalizeDecoding() {
 }
 
 /// Gets the weight cutoff.  Also counts the active tokens.
-BaseFloat LatticeFasterDecoder::GetCutoff(Elem *list_head, size_t *tok_count,
-                                          BaseFloat *adaptive_beam, Elem **best_elem) {
+BaseFloat LatticeFasterDecoder::GetCutoff(const std::vector<Elem> &toks,
+                                          size_t *tok_count,
+                                          BaseFloat *adaptive_beam,
+                                          const Elem **best_elem) {
   BaseFloat best_weight = std::numeric_limits<BaseFloat>::infinity();
   // positive == high cost == bad.
   size_t count = 0;
   if (config_.max_active == std::numeric_limits<int32>::max() &&
       config_.min_active == 0) {
-    for (Elem *e = list_head; e != NULL; e = e->tail, count++) {
-      BaseFloat w = static_cast<BaseFloat>(e->val->tot_cost);
+    for (; count < toks.size(); count++) {
+      BaseFloat w = static_cast<BaseFloat>(toks[count].val->tot_cost);
       if (w < best_weight) {
         best_weight = w;
-        if (best_elem) *best_elem = e;
+        if (best_elem) *best_elem = &(toks[count]);
       }
     }
     if (tok_count != NULL) *tok_count = count;
@@ -607,12 +696,12 @@ BaseFloat LatticeFasterDecoder::GetCutoff(Elem *list_head, size_t *tok_count,
     return best_weight + config_.beam;
   } else {
     tmp_array_.clear();
-    for (Elem *e = list_head; e != NULL; e = e->tail, count++) {
-      BaseFloat w = e->val->tot_cost;
+    for (; count < toks.size(); count++) {
+      BaseFloat w = toks[count].val->tot_cost;
       tmp_array_.push_back(w);
       if (w < best_weight) {
         best_weight = w;
-        if (best_elem) *best_elem = e;
+        if (best_elem) *best_elem = &(toks[count]);
       }
     }
     if (tok_count != NULL) *tok_count = count;
@@ -658,24 +747,56 @@ BaseFloat LatticeFasterDecoder::GetCutoff(Elem *list_head, size_t *tok_count,
 }
 
 BaseFloat LatticeFasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
+  KALDI_TRACE_SCOPE("LatticeFasterDecoder::ProcessEmitting");
+  double start_time = (search_stats_ != NULL ? search_timer_.Elapsed() : 0.0);
+  BaseFloat next_cutoff;
+  if (csr_graph_ != NULL)
+    next_cutoff = ProcessEmittingTpl<CsrDecodingGraph, CsrEmittingArcIterator>(
+        *csr_graph_, decodable);
+  else if (lookahead_graph_ != NULL)
+    next_cutoff = ProcessEmittingTpl<LookaheadComposedGraph,
+                                     LookaheadComposedEmittingArcIterator>(
+        *lookahead_graph_, decodable);
+  else if (grammar_graph_ != NULL)
+    next_cutoff = ProcessEmittingTpl<GrammarGraph, GrammarEmittingArcIterator>(
+        *grammar_graph_, decodable);
+  else
+    next_cutoff = ProcessEmittingTpl<fst::Fst<Arc>,
+                                     fst::ArcIterator<fst::Fst<Arc> > >(
+        *fst_, decodable);
+  if (search_stats_ != NULL)
+    frame_stats_.emitting_time = search_timer_.Elapsed() - start_time;
+  return next_cutoff;
+}
+
+template <class Graph, class ArcIterator>
+BaseFloat LatticeFasterDecoder::ProcessEmittingTpl(const Graph &graph,
+                                                   DecodableInterface *decodable) {
   KALDI_ASSERT(active_toks_.size() > 0);
   int32 frame = active_toks_.size() - 1; // frame is the frame-index
                                          // (zero-based) used to get likelihoods
                                          // from the decodable object.
   active_toks_.resize(active_toks_.size() + 1);
 
-  Elem *final_toks = toks_.Clear(); // analogous to swapping prev_toks_ / cur_toks_
-                                   // in simple-decoder.h.   Removes the Elems from
-                                   // being indexed in the hash in toks_.
-  Elem *best_elem = NULL;
+  toks_.Clear(&prev_toks_); // analogous to swapping prev_toks_ / cur_toks_
+                            // in simple-decoder.h.
+  const Elem *best_elem = NULL;
   BaseFloat adaptive_beam;
   size_t tok_cnt;
-  BaseFloat cur_cutoff = GetCutoff(final_toks, &tok_cnt, &adaptive_beam, &best_elem);
+  BaseFloat cur_cutoff = GetCutoff(prev_toks_, &tok_cnt, &adaptive_beam,
+                                   &best_elem);
   KALDI_VLOG(6) << "Adaptive beam on frame " << NumFramesDecoded() << " is "
                 << adaptive_beam;
+  frame_stats_.adaptive_beam = adaptive_beam;
   
   PossiblyResizeHash(tok_cnt);  // This makes sure the hash is always big enough.
 
+  // If the decodable object can give us the scores of the whole frame at once,
+  // we look them up directly rather than calling LogLikelihood() for each arc.
+  const int32 *index_to_row = NULL;
+  const BaseFloat *frame_scores = decodable->GetFrameScores(frame,
+                                                            &index_to_row);
+
   BaseFloat next_cutoff = std::numeric_limits<BaseFloat>::infinity();
   // pruning "online" before having seen all tokens
 
@@ -689,14 +810,13 @@ BaseFloat LatticeFasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
     StateId state = best_elem->key;
     Token *tok = best_elem->val;
     cost_offset = - tok->tot_cost;
-    for (fst::ArcIterator<fst::Fst<Arc> > aiter(fst_, state);
-         !aiter.Done();
-         aiter.Next()) {
+    for (ArcIterator aiter(graph, state); !aiter.Done(); aiter.Next()) {
       Arc arc = aiter.Value();
       if (arc.ilabel != 0) {  // propagate..
         arc.weight = Times(arc.weight,
                            Weight(cost_offset -
-                                  decodable->LogLikelihood(frame, arc.ilabel)));
+                                  GetLogLikelihood(decodable, frame, arc.ilabel,
+                                                   frame_scores, index_to_row)));
         BaseFloat new_weight = arc.weight.Value() + tok->tot_cost;
         if (new_weight + adaptive_beam < next_cutoff)
           next_cutoff = new_weight + adaptive_beam;
@@ -710,21 +830,35 @@ BaseFloat LatticeFasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
   cost_offsets_.resize(frame + 1, 0.0);
   cost_offsets_[frame] = cost_offset;
 
-  // the tokens are now owned here, in final_toks, and the hash is empty.
-  // 'owned' is a complex thing here; the point is we need to call DeleteElem
-  // on each elem 'e' to let toks_ know we're done with them.
-  for (Elem *e = final_toks, *e_tail; e != NULL; e = e_tail) {
-    // loop this way because we delete "e" as we go.
-    StateId state = e->key;
-    Token *tok = e->val;
+  if (config_.num_expansion_threads > 1) {
+    ExpandArgs args;
+    args.toks = &prev_toks_;
+    args.frame = frame;
+    args.cutoff = cur_cutoff;
+    args.next_cutoff = next_cutoff;
+    args.adaptive_beam = adaptive_beam;
+    args.cost_offset = cost_offset;
+    args.decodable = decodable;
+    args.frame_scores = frame_scores;
+    args.index_to_row = index_to_row;
+    int32 num_threads = ExpandTpl<Graph, ArcIterator>(graph, args, true);
+    return MergeEmitting(frame, next_cutoff, num_threads);
+  }
+
+  // the tokens of the previous frame are now in prev_toks_, and the hash is
+  // empty.
+  int64 num_arcs = 0;
+  for (size_t i = 0; i < prev_toks_.size(); i++) {
+    StateId state = prev_toks_[i].key;
+    Token *tok = prev_toks_[i].val;
     if (tok->tot_cost <= cur_cutoff) {
-      for (fst::ArcIterator<fst::Fst<Arc> > aiter(fst_, state);
-           !aiter.Done();
-           aiter.Next()) {
+      for (ArcIterator aiter(graph, state); !aiter.Done(); aiter.Next()) {
         const Arc &arc = aiter.Value();
         if (arc.ilabel != 0) {  // propagate..
+          num_arcs++;
           BaseFloat ac_cost = cost_offset -
-              decodable->LogLikelihood(frame, arc.ilabel),
+              GetLogLikelihood(decodable, frame, arc.ilabel, frame_scores,
+                               index_to_row),
               graph_cost = arc.weight.Value(),
               cur_cost = tok->tot_cost,
               tot_cost = cur_cost + ac_cost + graph_cost;
@@ -738,18 +872,47 @@ BaseFloat LatticeFasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
           // NULL: no change indicator needed
 
           // Add ForwardLink from tok to next_tok (put on head of list tok->links)
-          tok->links = new ForwardLink(next_tok, arc.ilabel, arc.olabel,
-                                       graph_cost, ac_cost, tok->links);
+          tok->links = new (link_pool_.Allocate())
+              ForwardLink(next_tok, arc.ilabel, arc.olabel, graph_cost, ac_cost,
+                          tok->links);
         }
       } // for all arcs
     }
-    e_tail = e->tail;
-    toks_.Delete(e); // delete Elem
   }
+  frame_stats_.num_arcs += num_arcs;
   return next_cutoff;
 }
 
 void LatticeFasterDecoder::ProcessNonemitting(BaseFloat cutoff) {
+  KALDI_TRACE_SCOPE("LatticeFasterDecoder::ProcessNonemitting");
+  double start_time = (search_stats_ != NULL ? search_timer_.Elapsed() : 0.0);
+  if (csr_graph_ != NULL)
+    ProcessNonemittingTpl<CsrDecodingGraph, CsrNonemittingArcIterator>(
+        *csr_graph_, cutoff);
+  else if (lookahead_graph_ != NULL)
+    ProcessNonemittingTpl<LookaheadComposedGraph,
+                          LookaheadComposedNonemittingArcIterator>(
+        *lookahead_graph_, cutoff);
+  else if (grammar_graph_ != NULL)
+    ProcessNonemittingTpl<GrammarGraph, GrammarNonemittingArcIterator>(
+        *grammar_graph_, cutoff);
+  else
+    ProcessNonemittingTpl<fst::Fst<Arc>, fst::ArcIterator<fst::Fst<Arc> > >(
+        *fst_, cutoff);
+  if (search_stats_ != NULL) {
+    // This is the end of the frame (or, if NumFramesDecoded() == 0, of the
+    // initial non-emitting step, which we don't record as a frame).
+    frame_stats_.nonemitting_time = search_timer_.Elapsed() - start_time;
+    frame_stats_.num_tokens = toks_.NumElements();
+    if (NumFramesDecoded() > 0)
+      search_stats_->AddFrame(NumFramesDecoded() - 1, frame_stats_);
+  }
+  frame_stats_ = DecoderFrameStats();
+}
+
+template <class Graph, class ArcIterator>
+void LatticeFasterDecoder::ProcessNonemittingTpl(const Graph &graph,
+                                                 BaseFloat cutoff) {
   KALDI_ASSERT(!active_toks_.empty());
   int32 frame = static_cast<int32>(active_toks_.size()) - 2;
   // Note: "frame" is the time-index we just processed, or -1 if
@@ -763,20 +926,29 @@ void LatticeFasterDecoder::ProcessNonemitting(BaseFloat cutoff) {
   // problem did not improve overall speed.
   
   KALDI_ASSERT(queue_.empty());
-  for (const Elem *e = toks_.GetList(); e != NULL;  e = e->tail)
-    queue_.push_back(e->key);
+  const std::vector<Elem> &cur_toks = toks_.GetList();
+  for (size_t i = 0; i < cur_toks.size(); i++)
+    queue_.push_back(cur_toks[i].key);
   if (queue_.empty()) {
     if (!warned_) {
       KALDI_WARN << "Error, no surviving tokens: frame is " << frame;
       warned_ = true;
     }
   }
-  
+
+  if (config_.num_expansion_threads > 1) {
+    queue_.clear();
+    ProcessNonemittingMultiThreadedTpl<Graph, ArcIterator>(graph, frame,
+                                                           cutoff);
+    return;
+  }
+
+  int64 num_arcs = 0;
   while (!queue_.empty()) {
     StateId state = queue_.back();
     queue_.pop_back();
 
-    Token *tok = toks_.Find(state)->val;  // would segfault if state not in toks_ but this can't happen.
+    Token *tok = *(toks_.Find(state));  // would segfault if state not in toks_ but this can't happen.
     BaseFloat cur_cost = tok->tot_cost;
     if (cur_cost > cutoff) // Don't bother processing successors.
       continue;
@@ -784,13 +956,12 @@ void LatticeFasterDecoder::ProcessNonemitting(BaseFloat cutoff) {
     // because we're about to regenerate them.  This is a kind
     // of non-optimality (remember, this is the simple decoder),
     // but since most states are emitting it's not a huge issue.
-    tok->DeleteForwardLinks(); // necessary when re-visiting
+    DeleteForwardLinks(tok); // necessary when re-visiting
     tok->links = NULL;
-    for (fst::ArcIterator<fst::Fst<Arc> > aiter(fst_, state);
-         !aiter.Done();
-         aiter.Next()) {
+    for (ArcIterator aiter(graph, state); !aiter.Done(); aiter.Next()) {
       const Arc &arc = aiter.Value();
       if (arc.ilabel == 0) {  // propagate nonemitting only...
+        num_arcs++;
         BaseFloat graph_cost = arc.weight.Value(),
             tot_cost = cur_cost + graph_cost;
         if (tot_cost < cutoff) {
@@ -799,8 +970,8 @@ void LatticeFasterDecoder::ProcessNonemitting(BaseFloat cutoff) {
           Token *new_tok = FindOrAddToken(arc.nextstate, frame + 1, tot_cost,
                                           &changed);
 
-          tok->links = new ForwardLink(new_tok, 0, arc.olabel,
-                                       graph_cost, 0, tok->links);
+          tok->links = new (link_pool_.Allocate())
+              ForwardLink(new_tok, 0, arc.olabel, graph_cost, 0, tok->links);
 
           // "changed" tells us whether the new token has a different
           // cost from before, or is new [if so, add into queue].
@@ -809,24 +980,212 @@ void LatticeFasterDecoder::ProcessNonemitting(BaseFloat cutoff) {
       }
     } // for all arcs
   } // while queue not empty
+  frame_stats_.num_arcs += num_arcs;
+}
+
+
+// When config_.num_expansion_threads > 1, the expansion of a frame is
+// divided among threads as follows.  First the (emitting or non-emitting)
+// arcs out of the tokens are expanded by several threads, each taking a
+// contiguous range of the tokens and collecting the arcs that survive its own
+// running beam in its own buffer, thread_arcs_[thread]; this phase only reads
+// the state of the decoder.  Then the calling thread merges the buffers, in
+// order, creating or updating the destination tokens (this is where arcs into
+// the same state from different threads are merged) and adding the forward
+// links.  The merge applies the best of the threads' cutoffs, so the pruning
+// is at least as tight as that of the single-threaded code.  Non-emitting
+// arcs are processed in passes: each pass expands the tokens whose cost
+// changed in the previous pass.
+template <class Graph, class ArcIterator>
+class LatticeFasterDecoder::ExpandTask: public MultiThreadable {
+ public:
+  ExpandTask(LatticeFasterDecoder *decoder, const Graph *graph, const ExpandArgs *args,
+             bool emitting):
+      decoder_(decoder), graph_(graph), args_(args), emitting_(emitting) { }
+  void operator() () {
+    size_t num_toks = args_->toks->size(),
+        begin = num_toks * thread_id_ / num_threads_,
+        end = num_toks * (thread_id_ + 1) / num_threads_;
+    if (emitting_)
+      decoder_->ExpandEmittingTpl<Graph, ArcIterator>(*graph_, *args_, begin,
+                                                      end, thread_id_);
+    else
+      decoder_->ExpandNonemittingTpl<Graph, ArcIterator>(*graph_, *args_,
+                                                         begin, end,
+                                                         thread_id_);
+  }
+ private:
+  LatticeFasterDecoder *decoder_;
+  const Graph *graph_;
+  const ExpandArgs *args_;
+  bool emitting_;
+};
+
+template <class Graph, class ArcIterator>
+int32 LatticeFasterDecoder::ExpandTpl(const Graph &graph, const ExpandArgs &args,
+                     bool emitting) {
+  int32 num_toks = args.toks->size(),
+      num_threads = std::min(config_.num_expansion_threads,
+                             num_toks / kMinTokensPerThread);
+  // LogLikelihood() is not generally thread-safe (e.g. decodable objects may
+  // cache things), so for emitting arcs we need the scores of the frame to be
+  // available through GetFrameScores(); and LookaheadComposedGraph and
+  // GrammarGraph expand their states as they are visited, so they are not
+  // thread-safe either.
+  if ((emitting && args.frame_scores == NULL) || lookahead_graph_ != NULL ||
+      grammar_graph_ != NULL)
+    num_threads = 1;
+  if (num_threads < 1) num_threads = 1;
+  if (thread_arcs_.size() < static_cast<size_t>(num_threads))
+    thread_arcs_.resize(num_threads);
+  for (int32 t = 0; t < num_threads; t++)
+    thread_arcs_[t].clear();
+  thread_cutoffs_.assign(num_threads, args.next_cutoff);
+  thread_num_arcs_.assign(num_threads, 0);
+  if (num_threads == 1) {
+    if (emitting) ExpandEmittingTpl<Graph, ArcIterator>(graph, args, 0,
+                                                        num_toks, 0);
+    else ExpandNonemittingTpl<Graph, ArcIterator>(graph, args, 0, num_toks, 0);
+  } else {
+    ExpandTask<Graph, ArcIterator> task(this, &graph, &args, emitting);
+    // The destructor of MultiThreader waits for the threads to finish.
+    MultiThreader<ExpandTask<Graph, ArcIterator> > m(num_threads, task);
+  }
+  for (int32 t = 0; t < num_threads; t++)
+    frame_stats_.num_arcs += thread_num_arcs_[t];
+  return num_threads;
+}
+
+template <class Graph, class ArcIterator>
+void LatticeFasterDecoder::ExpandEmittingTpl(const Graph &graph, const ExpandArgs &args,
+                            size_t begin, size_t end, int32 thread) {
+  std::vector<ExpandedArc> &arcs = thread_arcs_[thread];
+  const std::vector<Elem> &toks = *args.toks;
+  BaseFloat next_cutoff = args.next_cutoff;
+  int64 num_arcs = 0;
+  for (size_t i = begin; i < end; i++) {
+    Token *tok = toks[i].val;
+    if (tok->tot_cost > args.cutoff) continue;
+    for (ArcIterator aiter(graph, toks[i].key); !aiter.Done(); aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      if (arc.ilabel != 0) {
+        num_arcs++;
+        BaseFloat ac_cost = args.cost_offset -
+            GetLogLikelihood(args.decodable, args.frame, arc.ilabel,
+                             args.frame_scores, args.index_to_row),
+            graph_cost = arc.weight.Value(),
+            tot_cost = tok->tot_cost + ac_cost + graph_cost;
+        if (tot_cost > next_cutoff) continue;
+        else if (tot_cost + args.adaptive_beam < next_cutoff)
+          next_cutoff = tot_cost + args.adaptive_beam;
+        arcs.push_back(ExpandedArc(tok, arc.nextstate, arc.ilabel, arc.olabel,
+                                   graph_cost, ac_cost, tot_cost));
+      }
+    }
+  }
+  thread_cutoffs_[thread] = next_cutoff;
+  thread_num_arcs_[thread] = num_arcs;
+}
+
+template <class Graph, class ArcIterator>
+void LatticeFasterDecoder::ExpandNonemittingTpl(const Graph &graph, const ExpandArgs &args,
+                               size_t begin, size_t end, int32 thread) {
+  std::vector<ExpandedArc> &arcs = thread_arcs_[thread];
+  const std::vector<Elem> &toks = *args.toks;
+  int64 num_arcs = 0;
+  for (size_t i = begin; i < end; i++) {
+    Token *tok = toks[i].val;
+    BaseFloat cur_cost = tok->tot_cost;
+    if (cur_cost > args.cutoff) continue;
+    for (ArcIterator aiter(graph, toks[i].key); !aiter.Done(); aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      if (arc.ilabel == 0) {
+        num_arcs++;
+        BaseFloat graph_cost = arc.weight.Value(),
+            tot_cost = cur_cost + graph_cost;
+        if (tot_cost < args.cutoff)
+          arcs.push_back(ExpandedArc(tok, arc.nextstate, 0, arc.olabel,
+                                     graph_cost, 0.0, tot_cost));
+      }
+    }
+  }
+  thread_num_arcs_[thread] = num_arcs;
 }
 
+BaseFloat LatticeFasterDecoder::MergeEmitting(int32 frame, BaseFloat next_cutoff,
+                             int32 num_threads) {
+  for (int32 t = 0; t < num_threads; t++)
+    next_cutoff = std::min(next_cutoff, thread_cutoffs_[t]);
+  for (int32 t = 0; t < num_threads; t++) {
+    const std::vector<ExpandedArc> &arcs = thread_arcs_[t];
+    for (size_t i = 0; i < arcs.size(); i++) {
+      const ExpandedArc &arc = arcs[i];
+      if (arc.tot_cost > next_cutoff) continue;
+      Token *next_tok = FindOrAddToken(arc.nextstate, frame + 1,
+                                       arc.tot_cost, NULL);
+      arc.tok->links = new (link_pool_.Allocate())
+          ForwardLink(next_tok, arc.ilabel, arc.olabel, arc.graph_cost,
+                      arc.acoustic_cost, arc.tok->links);
+    }
+  }
+  return next_cutoff;
+}
 
-void LatticeFasterDecoder::DeleteElems(Elem *list) {
-  for (Elem *e = list, *e_tail; e != NULL; e = e_tail) {
-    e_tail = e->tail;
-    toks_.Delete(e);
+template <class Graph, class ArcIterator>
+void LatticeFasterDecoder::ProcessNonemittingMultiThreadedTpl(const Graph &graph, int32 frame,
+                                             BaseFloat cutoff) {
+  frontier_ = toks_.GetList();
+  ExpandArgs args;
+  args.toks = &frontier_;
+  args.frame = frame;
+  args.cutoff = cutoff;
+  args.next_cutoff = cutoff;
+  args.adaptive_beam = 0.0;
+  args.cost_offset = 0.0;
+  args.decodable = NULL;
+  args.frame_scores = NULL;
+  args.index_to_row = NULL;
+  while (!frontier_.empty()) {
+    int32 num_threads = ExpandTpl<Graph, ArcIterator>(graph, args, false);
+    // The links of the tokens we expanded are about to be regenerated.
+    for (size_t i = 0; i < frontier_.size(); i++)
+      if (frontier_[i].val->tot_cost <= cutoff)
+        DeleteForwardLinks(frontier_[i].val);
+    KALDI_ASSERT(queue_.empty());
+    for (int32 t = 0; t < num_threads; t++) {
+      const std::vector<ExpandedArc> &arcs = thread_arcs_[t];
+      for (size_t i = 0; i < arcs.size(); i++) {
+        const ExpandedArc &arc = arcs[i];
+        bool changed;
+        Token *new_tok = FindOrAddToken(arc.nextstate, frame + 1,
+                                        arc.tot_cost, &changed);
+        arc.tok->links = new (link_pool_.Allocate())
+            ForwardLink(new_tok, 0, arc.olabel, arc.graph_cost, 0,
+                        arc.tok->links);
+        if (changed) queue_.push_back(arc.nextstate);
+      }
+    }
+    // The next pass expands the tokens whose cost changed, once each.
+    std::sort(queue_.begin(), queue_.end());
+    queue_.erase(std::unique(queue_.begin(), queue_.end()), queue_.end());
+    frontier_.resize(queue_.size());
+    for (size_t i = 0; i < queue_.size(); i++) {
+      frontier_[i].key = queue_[i];
+      frontier_[i].val = *(toks_.Find(queue_[i]));
+    }
+    queue_.clear();
   }
 }
 
+
 void LatticeFasterDecoder::ClearActiveTokens() { // a cleanup routine, at utt end/begin
   for (size_t i = 0; i < active_toks_.size(); i++) {
     // Delete all tokens alive on this frame, and any forward
     // links they may have.
     for (Token *tok = active_toks_[i].toks; tok != NULL; ) {
-      tok->DeleteForwardLinks();
+      DeleteForwardLinks(tok);
       Token *next_tok = tok->next;
-      delete tok;
+      token_pool_.Free(tok);
       num_toks_--;
       tok = next_tok;
     }
@@ -28,15 +28,22 @@
 
 
 #include "util/stl-utils.h"
-#include "util/hash-list.h"
+#include "util/active-token-map.h"
+#include "util/object-pool.h"
 #include "fst/fstlib.h"
 #include "itf/decodable-itf.h"
 #include "fstext/fstext-lib.h"
 #include "lat/determinize-lattice-pruned.h"
 #include "lat/kaldi-lattice.h"
+#include "decoder/decoder-search-stats.h"
+#include "base/timer.h"
 
 namespace kaldi {
 
+class CsrDecodingGraph;  // defined in csr-decoding-graph.h
+class LookaheadComposedGraph;  // defined in lookahead-composed-graph.h
+class GrammarGraph;  // defined in grammar-graph.h
+
 struct LatticeFasterDecoderConfig {
   BaseFloat beam;
   int32 max_active;
@@ -47,6 +54,7 @@ struct LatticeFasterDecoderConfig {
                             // command-line program.
   BaseFloat beam_delta; // has nothing to do with beam_ratio
   BaseFloat hash_ratio;
+  int32 num_expansion_threads;
   BaseFloat prune_scale;   // Note: we don't make this configurable on the command line,
                            // it's not a very important parameter.  It affects the
                            // algorithm that prunes the tokens as we go.
@@ -63,6 +71,7 @@ struct LatticeFasterDecoderConfig {
                                 determinize_lattice(true),
                                 beam_delta(0.5),
                                 hash_ratio(2.0),
+                                num_expansion_threads(1),
                                 prune_scale(0.1) { }
   void Register(OptionsItf *opts) {
     det_opts.Register(opts);
@@ -80,10 +89,17 @@ struct LatticeFasterDecoderConfig {
                    "max-active constraint is applied.  Larger is more accurate.");
     opts->Register("hash-ratio", &hash_ratio, "Setting used in decoder to control"
                    " hash behavior");
+    opts->Register("num-expansion-threads", &num_expansion_threads, "Number "
+                   "of threads among which the token expansion of each frame "
+                   "is divided.  This helps only with large beams (e.g. "
+                   "100k or more active tokens), and emitting arcs are only "
+                   "divided if the decodable object supports "
+                   "GetFrameScores().");
   }
   void Check() const {
     KALDI_ASSERT(beam > 0.0 && max_active > 1 && lattice_beam > 0.0
                  && prune_interval > 0 && beam_delta > 0.0 && hash_ratio >= 1.0
+                 && num_expansion_threads >= 1
                  && prune_scale > 0.0 && prune_scale < 1.0);
   }
 };
@@ -109,11 +125,35 @@ class LatticeFasterDecoder {
   LatticeFasterDecoder(const LatticeFasterDecoderConfig &config,
                        fst::Fst<fst::StdArc> *fst);
 
+  // This version decodes with a graph in the cache-friendly format of
+  // CsrDecodingGraph (see csr-decoding-graph.h); the search is the same, but
+  // arc expansion uses non-virtual iterators that visit only the emitting
+  // or only the non-emitting arcs.  The graph must outlive this object.
+  LatticeFasterDecoder(const CsrDecodingGraph &graph,
+                       const LatticeFasterDecoderConfig &config);
+
+  // This version decodes with HCL o G composed on the fly, with lookahead
+  // costs (see lookahead-composed-graph.h).  The graph must outlive this
+  // object, and must not be shared with another decoder.
+  LatticeFasterDecoder(const LookaheadComposedGraph &graph,
+                       const LatticeFasterDecoderConfig &config);
+
+  // This version decodes with a top-level HCLG into which sub-graphs are
+  // inserted on the fly (see grammar-graph.h).  The graph must outlive this
+  // object, and must not be shared with another decoder.
+  LatticeFasterDecoder(const GrammarGraph &graph,
+                       const LatticeFasterDecoderConfig &config);
+
 
   void SetOptions(const LatticeFasterDecoderConfig &config) {
     config_ = config;
   }
 
+  /// If "stats" is non-NULL, the decoder records statistics of the search on
+  /// each frame in it (see decoder-search-stats.h); the caller should call
+  /// stats->EndUtterance() after each utterance.  "stats" is not owned here.
+  void SetSearchStats(DecoderSearchStats *stats) { search_stats_ = stats; }
+
   const LatticeFasterDecoderConfig &GetOptions() const {
     return config_;
   }
@@ -204,6 +244,9 @@ class LatticeFasterDecoder {
   // whenever we call ProcessEmitting().
   inline int32 NumFramesDecoded() const { return active_toks_.size() - 1; }
 
+  // Returns the number of tokens active on the most recent frame decoded.
+  int32 NumActiveTokens() const { return toks_.NumElements(); }
+
  private:
   // ForwardLinks are the links from a token to a token on the next frame.
   // or sometimes on the current frame (for input-epsilon links).
@@ -244,15 +287,6 @@ class LatticeFasterDecoder {
     inline Token(BaseFloat tot_cost, BaseFloat extra_cost, ForwardLink *links,
                  Token *next):
         tot_cost(tot_cost), extra_cost(extra_cost), links(links), next(next) { }
-    inline void DeleteForwardLinks() {
-      ForwardLink *l = links, *m;
-      while (l != NULL) {
-        m = l->next;
-        delete l;
-        l = m;
-      }
-      links = NULL;
-    }
   };
 
   // head of per-frame list of Tokens (list is in topological order),
@@ -265,7 +299,67 @@ class LatticeFasterDecoder {
                  must_prune_tokens(true) { }
   };
 
-  typedef HashList<StateId, Token*>::Elem Elem;
+  typedef ActiveTokenMap<StateId, Token*>::Elem Elem;
+
+  // The following are used when config_.num_expansion_threads > 1; see the
+  // comment above ExpandTask in the .cc file.
+  // ExpandedArc is an arc out of a token that a thread found to be within the
+  // beam, with its costs worked out.
+  struct ExpandedArc {
+    Token *tok;  // the token that the arc leaves.
+    StateId nextstate;
+    Label ilabel;
+    Label olabel;
+    BaseFloat graph_cost;
+    BaseFloat acoustic_cost;
+    BaseFloat tot_cost;  // the cost of the destination token via this arc.
+    ExpandedArc(Token *tok, StateId nextstate, Label ilabel, Label olabel,
+                BaseFloat graph_cost, BaseFloat acoustic_cost,
+                BaseFloat tot_cost):
+        tok(tok), nextstate(nextstate), ilabel(ilabel), olabel(olabel),
+        graph_cost(graph_cost), acoustic_cost(acoustic_cost),
+        tot_cost(tot_cost) { }
+  };
+  // The parameters of one expansion, shared by all threads.
+  struct ExpandArgs {
+    const std::vector<Elem> *toks;  // the tokens to expand.
+    int32 frame;
+    BaseFloat cutoff;  // tokens with greater cost are not expanded.
+    // For emitting arcs: the initial value of the cutoff for destination
+    // tokens, the beam used to tighten it, and the acoustic cost offset.
+    BaseFloat next_cutoff;
+    BaseFloat adaptive_beam;
+    BaseFloat cost_offset;
+    DecodableInterface *decodable;
+    const BaseFloat *frame_scores;
+    const int32 *index_to_row;
+  };
+  template <class Graph, class ArcIterator> class ExpandTask;
+  // Expands the arcs of args.toks (emitting or non-emitting ones) into
+  // thread_arcs_, using up to config_.num_expansion_threads threads, and
+  // returns the number of threads used.
+  template <class Graph, class ArcIterator>
+  int32 ExpandTpl(const Graph &graph, const ExpandArgs &args, bool emitting);
+  // Expands the arcs of (*args.toks)[begin] through (*args.toks)[end - 1]
+  // into thread_arcs_[thread]; this only reads the state of the decoder.
+  template <class Graph, class ArcIterator>
+  void ExpandEmittingTpl(const Graph &graph, const ExpandArgs &args,
+                         size_t begin, size_t end, int32 thread);
+  template <class Graph, class ArcIterator>
+  void ExpandNonemittingTpl(const Graph &graph, const ExpandArgs &args,
+                            size_t begin, size_t end, int32 thread);
+  // Creates the tokens and links for the emitting arcs in the first
+  // "num_threads" elements of thread_arcs_, and returns the cutoff for the
+  // next frame.
+  BaseFloat MergeEmitting(int32 frame, BaseFloat next_cutoff,
+                          int32 num_threads);
+  // The multi-threaded version of the body of ProcessNonemittingTpl().
+  template <class Graph, class ArcIterator>
+  void ProcessNonemittingMultiThreadedTpl(const Graph &graph, int32 frame,
+                                          BaseFloat cutoff);
+  // We don't use more threads than one per this many tokens, since for small
+  // numbers of tokens, starting the threads would cost more than it saves.
+  static const int32 kMinTokensPerThread = 2000;
 
   void PossiblyResizeHash(size_t num_toks);
 
@@ -335,8 +429,8 @@ class LatticeFasterDecoder {
   void PruneActiveTokens(BaseFloat delta);
 
   /// Gets the weight cutoff.  Also counts the active tokens.
-  BaseFloat GetCutoff(Elem *list_head, size_t *tok_count,
-                      BaseFloat *adaptive_beam, Elem **best_elem);
+  BaseFloat GetCutoff(const std::vector<Elem> &toks, size_t *tok_count,
+                      BaseFloat *adaptive_beam, const Elem **best_elem);
 
   /// Processes emitting arcs for one frame.  Propagates from prev_toks_ to cur_toks_.
   /// Returns the cost cutoff for subsequent ProcessNonemitting() to use.
@@ -347,22 +441,64 @@ class LatticeFasterDecoder {
   /// preceding ProcessEmitting().
   void ProcessNonemitting(BaseFloat cost_cutoff);
 
-  // HashList defined in ../util/hash-list.h.  It actually allows us to maintain
-  // more than one list (e.g. for current and previous frames), but only one of
-  // them at a time can be indexed by StateId.  It is indexed by frame-index
-  // plus one, where the frame-index is zero-based, as used in decodable object.
-  // That is, the emitting probs of frame t are accounted for in tokens at
-  // toks_[t+1].  The zeroth frame is for nonemitting transition at the start of
-  // the graph.
-  HashList<StateId, Token*> toks_;
+  /// These are the implementations of ProcessEmitting() and
+  /// ProcessNonemitting(), templated on the graph type and the type of
+  /// iterator over its arcs, so that the search code is shared between
+  /// fst::Fst, CsrDecodingGraph, LookaheadComposedGraph and GrammarGraph.
+  template <class Graph, class ArcIterator>
+  BaseFloat ProcessEmittingTpl(const Graph &graph,
+                               DecodableInterface *decodable);
+  template <class Graph, class ArcIterator>
+  void ProcessNonemittingTpl(const Graph &graph, BaseFloat cost_cutoff);
+
+  /// Returns the start state of whichever graph we are decoding with.
+  StateId GraphStart() const;
+  /// Returns the final-cost of state s (infinity if not final) in whichever
+  /// graph we are decoding with.
+  BaseFloat GraphFinal(StateId s) const;
+
+  // ActiveTokenMap is defined in ../util/active-token-map.h.  It maps the
+  // states that are active on the most recent frame to their tokens; the
+  // tokens of the frame are also stored contiguously, so we can iterate over
+  // them quickly (e.g. in GetCutoff()).  The tokens themselves are stored in
+  // active_toks_, which is indexed by frame-index plus one, where the
+  // frame-index is zero-based, as used in decodable object.  That is, the
+  // emitting probs of frame t are accounted for in tokens at
+  // active_toks_[t+1].  The zeroth frame is for nonemitting transition at the
+  // start of the graph.
+  ActiveTokenMap<StateId, Token*> toks_;
+  // prev_toks_ is used in ProcessEmitting() to hold the tokens of the previous
+  // frame, after toks_.Clear(&prev_toks_).  It's a class member to avoid
+  // allocating memory on each frame.
+  std::vector<Elem> prev_toks_;
+
+  // Tokens and ForwardLinks are allocated from these pools rather than with
+  // new and delete (see ../util/object-pool.h).  The pools persist across
+  // utterances, so once they have grown to the size needed, decoding does no
+  // heap allocation for tokens or links.
+  ObjectPool<Token> token_pool_;
+  ObjectPool<ForwardLink> link_pool_;
 
   std::vector<TokenList> active_toks_; // Lists of tokens, indexed by
   // frame (members of TokenList are toks, must_prune_forward_links,
   // must_prune_tokens).
   std::vector<StateId> queue_;  // temp variable used in ProcessNonemitting,
   std::vector<BaseFloat> tmp_array_;  // used in GetCutoff.
+  // The following are used if config_.num_expansion_threads > 1;
+  // thread_arcs_ and thread_cutoffs_ are indexed by thread, and frontier_
+  // holds the tokens to be expanded in each pass of
+  // ProcessNonemittingMultiThreadedTpl().
+  std::vector<std::vector<ExpandedArc> > thread_arcs_;
+  std::vector<BaseFloat> thread_cutoffs_;
+  std::vector<int64> thread_num_arcs_;
+  std::vector<Elem> frontier_;
   // make it class member to avoid internal new/delete.
-  const fst::Fst<fst::StdArc> &fst_;
+  // Exactly one of fst_, csr_graph_, lookahead_graph_ and grammar_graph_ is
+  // non-NULL.
+  const fst::Fst<fst::StdArc> *fst_;
+  const CsrDecodingGraph *csr_graph_;
+  const LookaheadComposedGraph *lookahead_graph_;
+  const GrammarGraph *grammar_graph_;
   bool delete_fst_;
   std::vector<BaseFloat> cost_offsets_; // This contains, for each
   // frame, an offset that was added to the acoustic likelihoods on that
@@ -371,6 +507,13 @@ class LatticeFasterDecoder {
   int32 num_toks_; // current total #toks allocated...
   bool warned_;
 
+  // If non-NULL, we record the statistics of the search in this (not owned).
+  // frame_stats_ accumulates the statistics of the current frame, and
+  // search_timer_ is used to time ProcessEmitting() and ProcessNonemitting().
+  DecoderSearchStats *search_stats_;
+  DecoderFrameStats frame_stats_;
+  Timer search_timer_;
+
   /// decoding_finalized_ is true if someone called FinalizeDecoding().  [note,
   /// calling this is optional].  If true, it's forbidden to decode more.  Also,
   /// if this is set, then the output of ComputeFinalCosts() is in the next
@@ -385,18 +528,9 @@ class LatticeFasterDecoder {
   BaseFloat final_relative_cost_;
   BaseFloat final_best_cost_;
 
-  // There are various cleanup tasks... the the toks_ structure contains
-  // singly linked lists of Token pointers, where Elem is the list type.
-  // It also indexes them in a hash, indexed by state (this hash is only
-  // maintained for the most recent frame).  toks_.Clear()
-  // deletes them from the hash and returns the list of Elems.  The
-  // function DeleteElems calls toks_.Delete(elem) for each elem in
-  // the list, which returns ownership of the Elem to the toks_ structure
-  // for reuse, but does not delete the Token pointer.  The Token pointers
-  // are reference-counted and are ultimately deleted in PruneTokensForFrame,
-  // but are also linked together on each frame by their own linked-list,
-  // using the "next" pointer.  We delete them manually.
-  void DeleteElems(Elem *list);
+  // Returns all the forward links of "tok" to link_pool_, and sets tok->links
+  // to NULL.
+  inline void DeleteForwardLinks(Token *tok);
 
   // This function takes a singly linked list of tokens for a single frame, and
   // outputs a list of them in topological order (it will crash if no such order
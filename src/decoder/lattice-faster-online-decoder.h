@@ -27,7 +27,8 @@
 #define KALDI_DECODER_LATTICE_FASTER_ONLINE_DECODER_H_
 
 #include "util/stl-utils.h"
-#include "util/hash-list.h"
+#include "util/active-token-map.h"
+#include "util/object-pool.h"
 #include "fst/fstlib.h"
 #include "itf/decodable-itf.h"
 #include "fstext/fstext-lib.h"
@@ -72,6 +73,13 @@ class LatticeFasterOnlineDecoder {
   LatticeFasterOnlineDecoder(const LatticeFasterDecoderConfig &config,
                              fst::Fst<fst::StdArc> *fst);
 
+  // This version decodes with a graph in the cache-friendly format of
+  // CsrDecodingGraph (see csr-decoding-graph.h); the search is the same, but
+  // arc expansion uses non-virtual iterators that visit only the emitting
+  // or only the non-emitting arcs.  The graph must outlive this object.
+  LatticeFasterOnlineDecoder(const CsrDecodingGraph &graph,
+                             const LatticeFasterDecoderConfig &config);
+
 
   void SetOptions(const LatticeFasterDecoderConfig &config) {
     config_ = config;
@@ -143,6 +151,24 @@ class LatticeFasterOnlineDecoder {
   bool GetRawLattice(Lattice *ofst,
                      bool use_final_probs = true) const;
 
+  /// Returns the latest frame f, with min_frame <= f < NumFramesDecoded() and
+  /// f > 0, on which only one token is active, or -1 if there is none.  All
+  /// the paths through the lattice pass through that token, so the part of the
+  /// lattice before it will not change (pruning can only remove tokens).
+  /// Frames are numbered as in GetRawLattice(), where the tokens on frame f
+  /// are those after f frames have been decoded.
+  int32 GetConvergenceFrame(int32 min_frame) const;
+
+  /// Outputs the part of the raw lattice from frame begin_frame to frame
+  /// end_frame (0 <= begin_frame < end_frame <= NumFramesDecoded()).  If
+  /// begin_frame > 0, it must have only one token (e.g. it was returned by
+  /// GetConvergenceFrame()), which becomes the start state; likewise, if
+  /// end_frame < NumFramesDecoded(), its single token is the only final state,
+  /// with weight One(), and "use_final_probs" is ignored.  Concatenating the
+  /// parts for consecutive ranges gives the output of GetRawLattice().
+  bool GetRawLatticeRange(int32 begin_frame, int32 end_frame,
+                          bool use_final_probs, Lattice *ofst) const;
+
   /// Behaves the same like GetRawLattice but only processes tokens whose
   /// extra_cost is smaller than the best-cost plus the specified beam.
   /// It is only worthwhile to call this function if beam is less than
@@ -193,6 +219,9 @@ class LatticeFasterOnlineDecoder {
   // whenever we call ProcessEmitting().
   inline int32 NumFramesDecoded() const { return active_toks_.size() - 1; }
 
+  // Returns the number of tokens active on the most recent frame decoded.
+  int32 NumActiveTokens() const { return toks_.NumElements(); }
+
  private:
   // ForwardLinks are the links from a token to a token on the next frame.
   // or sometimes on the current frame (for input-epsilon links).
@@ -240,15 +269,6 @@ class LatticeFasterOnlineDecoder {
                  Token *next, Token *backpointer):
         tot_cost(tot_cost), extra_cost(extra_cost), links(links), next(next),
         backpointer(backpointer) { }
-    inline void DeleteForwardLinks() {
-      ForwardLink *l = links, *m;
-      while (l != NULL) {
-        m = l->next;
-        delete l;
-        l = m;
-      }
-      links = NULL;
-    }
   };
 
   // head of per-frame list of Tokens (list is in topological order),
@@ -261,7 +281,67 @@ class LatticeFasterOnlineDecoder {
                  must_prune_tokens(true) { }
   };
 
-  typedef HashList<StateId, Token*>::Elem Elem;
+  typedef ActiveTokenMap<StateId, Token*>::Elem Elem;
+
+  // The following are used when config_.num_expansion_threads > 1; see the
+  // comment above ExpandTask in the .cc file.
+  // ExpandedArc is an arc out of a token that a thread found to be within the
+  // beam, with its costs worked out.
+  struct ExpandedArc {
+    Token *tok;  // the token that the arc leaves.
+    StateId nextstate;
+    Label ilabel;
+    Label olabel;
+    BaseFloat graph_cost;
+    BaseFloat acoustic_cost;
+    BaseFloat tot_cost;  // the cost of the destination token via this arc.
+    ExpandedArc(Token *tok, StateId nextstate, Label ilabel, Label olabel,
+                BaseFloat graph_cost, BaseFloat acoustic_cost,
+                BaseFloat tot_cost):
+        tok(tok), nextstate(nextstate), ilabel(ilabel), olabel(olabel),
+        graph_cost(graph_cost), acoustic_cost(acoustic_cost),
+        tot_cost(tot_cost) { }
+  };
+  // The parameters of one expansion, shared by all threads.
+  struct ExpandArgs {
+    const std::vector<Elem> *toks;  // the tokens to expand.
+    int32 frame;
+    BaseFloat cutoff;  // tokens with greater cost are not expanded.
+    // For emitting arcs: the initial value of the cutoff for destination
+    // tokens, the beam used to tighten it, and the acoustic cost offset.
+    BaseFloat next_cutoff;
+    BaseFloat adaptive_beam;
+    BaseFloat cost_offset;
+    DecodableInterface *decodable;
+    const BaseFloat *frame_scores;
+    const int32 *index_to_row;
+  };
+  template <class Graph, class ArcIterator> class ExpandTask;
+  // Expands the arcs of args.toks (emitting or non-emitting ones) into
+  // thread_arcs_, using up to config_.num_expansion_threads threads, and
+  // returns the number of threads used.
+  template <class Graph, class ArcIterator>
+  int32 ExpandTpl(const Graph &graph, const ExpandArgs &args, bool emitting);
+  // Expands the arcs of (*args.toks)[begin] through (*args.toks)[end - 1]
+  // into thread_arcs_[thread]; this only reads the state of the decoder.
+  template <class Graph, class ArcIterator>
+  void ExpandEmittingTpl(const Graph &graph, const ExpandArgs &args,
+                         size_t begin, size_t end, int32 thread);
+  template <class Graph, class ArcIterator>
+  void ExpandNonemittingTpl(const Graph &graph, const ExpandArgs &args,
+                            size_t begin, size_t end, int32 thread);
+  // Creates the tokens and links for the emitting arcs in the first
+  // "num_threads" elements of thread_arcs_, and returns the cutoff for the
+  // next frame.
+  BaseFloat MergeEmitting(int32 frame, BaseFloat next_cutoff,
+                          int32 num_threads);
+  // The multi-threaded version of the body of ProcessNonemittingTpl().
+  template <class Graph, class ArcIterator>
+  void ProcessNonemittingMultiThreadedTpl(const Graph &graph, int32 frame,
+                                          BaseFloat cutoff);
+  // We don't use more threads than one per this many tokens, since for small
+  // numbers of tokens, starting the threads would cost more than it saves.
+  static const int32 kMinTokensPerThread = 2000;
 
   void PossiblyResizeHash(size_t num_toks);
 
@@ -332,8 +412,8 @@ class LatticeFasterOnlineDecoder {
   void PruneActiveTokens(BaseFloat delta);
 
   /// Gets the weight cutoff.  Also counts the active tokens.
-  BaseFloat GetCutoff(Elem *list_head, size_t *tok_count,
-                      BaseFloat *adaptive_beam, Elem **best_elem);
+  BaseFloat GetCutoff(const std::vector<Elem> &toks, size_t *tok_count,
+                      BaseFloat *adaptive_beam, const Elem **best_elem);
   
   /// Processes emitting arcs for one frame.  Propagates from prev_toks_ to cur_toks_.
   /// Returns the cost cutoff for subsequent ProcessNonemitting() to use.
@@ -343,23 +423,61 @@ class LatticeFasterOnlineDecoder {
   /// ProcessEmitting() on each frame.  The cost cutoff is computed by the
   /// preceding ProcessEmitting().
   void ProcessNonemitting(BaseFloat cost_cutoff);
+
+  /// These are the implementations of ProcessEmitting() and
+  /// ProcessNonemitting(), templated on the graph type and the type of
+  /// iterator over its arcs, so that the search code is shared between
+  /// fst::Fst and CsrDecodingGraph.
+  template <class Graph, class ArcIterator>
+  BaseFloat ProcessEmittingTpl(const Graph &graph,
+                               DecodableInterface *decodable);
+  template <class Graph, class ArcIterator>
+  void ProcessNonemittingTpl(const Graph &graph, BaseFloat cost_cutoff);
+
+  /// Returns the start state of whichever graph we are decoding with.
+  StateId GraphStart() const;
+  /// Returns the final-cost of state s (infinity if not final) in whichever
+  /// graph we are decoding with.
+  BaseFloat GraphFinal(StateId s) const;
   
-  // HashList defined in ../util/hash-list.h.  It actually allows us to maintain
-  // more than one list (e.g. for current and previous frames), but only one of
-  // them at a time can be indexed by StateId.  It is indexed by frame-index
-  // plus one, where the frame-index is zero-based, as used in decodable object.
-  // That is, the emitting probs of frame t are accounted for in tokens at
-  // toks_[t+1].  The zeroth frame is for nonemitting transition at the start of
-  // the graph.
-  HashList<StateId, Token*> toks_;
+  // ActiveTokenMap is defined in ../util/active-token-map.h.  It maps the
+  // states that are active on the most recent frame to their tokens; the
+  // tokens of the frame are also stored contiguously, so we can iterate over
+  // them quickly (e.g. in GetCutoff()).  The tokens themselves are stored in
+  // active_toks_, which is indexed by frame-index plus one, where the
+  // frame-index is zero-based, as used in decodable object.  That is, the
+  // emitting probs of frame t are accounted for in tokens at
+  // active_toks_[t+1].  The zeroth frame is for nonemitting transition at the
+  // start of the graph.
+  ActiveTokenMap<StateId, Token*> toks_;
+  // prev_toks_ is used in ProcessEmitting() to hold the tokens of the previous
+  // frame, after toks_.Clear(&prev_toks_).  It's a class member to avoid
+  // allocating memory on each frame.
+  std::vector<Elem> prev_toks_;
+
+  // Tokens and ForwardLinks are allocated from these pools rather than with
+  // new and delete (see ../util/object-pool.h).  The pools persist across
+  // utterances, so once they have grown to the size needed, decoding does no
+  // heap allocation for tokens or links.
+  ObjectPool<Token> token_pool_;
+  ObjectPool<ForwardLink> link_pool_;
 
   std::vector<TokenList> active_toks_; // Lists of tokens, indexed by
   // frame (members of TokenList are toks, must_prune_forward_links,
   // must_prune_tokens).
   std::vector<StateId> queue_;  // temp variable used in ProcessNonemitting,
   std::vector<BaseFloat> tmp_array_;  // used in GetCutoff.
+  // The following are used if config_.num_expansion_threads > 1;
+  // thread_arcs_ and thread_cutoffs_ are indexed by thread, and frontier_
+  // holds the tokens to be expanded in each pass of
+  // ProcessNonemittingMultiThreadedTpl().
+  std::vector<std::vector<ExpandedArc> > thread_arcs_;
+  std::vector<BaseFloat> thread_cutoffs_;
+  std::vector<Elem> frontier_;
   // make it class member to avoid internal new/delete.
-  const fst::Fst<fst::StdArc> &fst_;
+  // Exactly one of fst_ and csr_graph_ is non-NULL.
+  const fst::Fst<fst::StdArc> *fst_;
+  const CsrDecodingGraph *csr_graph_;
   bool delete_fst_;
   std::vector<BaseFloat> cost_offsets_; // This contains, for each
   // frame, an offset that was added to the acoustic likelihoods on that
@@ -382,18 +500,9 @@ class LatticeFasterOnlineDecoder {
   BaseFloat final_relative_cost_;
   BaseFloat final_best_cost_;
 
-  // There are various cleanup tasks... the the toks_ structure contains
-  // singly linked lists of Token pointers, where Elem is the list type.
-  // It also indexes them in a hash, indexed by state (this hash is only
-  // maintained for the most recent frame).  toks_.Clear()
-  // deletes them from the hash and returns the list of Elems.  The
-  // function DeleteElems calls toks_.Delete(elem) for each elem in
-  // the list, which returns ownership of the Elem to the toks_ structure
-  // for reuse, but does not delete the Token pointer.  The Token pointers
-  // are reference-counted and are ultimately deleted in PruneTokensForFrame,
-  // but are also linked together on each frame by their own linked-list,
-  // using the "next" pointer.  We delete them manually.
-  void DeleteElems(Elem *list);
+  // Returns all the forward links of "tok" to link_pool_, and sets tok->links
+  // to NULL.
+  inline void DeleteForwardLinks(Token *tok);
 
   // This function takes a singly linked list of tokens for a single frame, and
   // outputs a list of them in topological order (it will crash if no such order
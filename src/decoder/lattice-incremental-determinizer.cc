@@ -0,0 +1,95 @@
+// decoder/lattice-incremental-determinizer.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "decoder/lattice-incremental-determinizer.h"
+#include "lat/determinize-lattice-pruned.h"
+
+namespace kaldi {
+
+IncrementalLatticeDeterminizer::IncrementalLatticeDeterminizer(
+    const TransitionModel &trans_model,
+    const LatticeFasterDecoderConfig &config):
+    trans_model_(trans_model), config_(config), frozen_frame_(0) { }
+
+void IncrementalLatticeDeterminizer::Init() {
+  frozen_frame_ = 0;
+  frozen_lat_.DeleteStates();
+}
+
+bool IncrementalLatticeDeterminizer::DeterminizeRange(
+    const LatticeFasterOnlineDecoder &decoder,
+    int32 begin_frame, int32 end_frame,
+    bool use_final_probs, CompactLattice *clat) const {
+  Lattice raw_lat;
+  if (!decoder.GetRawLatticeRange(begin_frame, end_frame, use_final_probs,
+                                  &raw_lat))
+    return false;
+  if (!config_.determinize_lattice)
+    KALDI_ERR << "--determinize-lattice=false option is not supported "
+              << "by IncrementalLatticeDeterminizer";
+  DeterminizeLatticePhonePrunedWrapper(trans_model_, &raw_lat,
+                                       config_.lattice_beam, clat,
+                                       config_.det_opts);
+  return (clat->NumStates() != 0);
+}
+
+bool IncrementalLatticeDeterminizer::GetLattice(
+    const LatticeFasterOnlineDecoder &decoder,
+    bool use_final_probs, CompactLattice *clat) {
+  clat->DeleteStates();
+  int32 num_frames = decoder.NumFramesDecoded();
+  KALDI_ASSERT(num_frames >= frozen_frame_ &&
+               "Decoder was re-initialized: call Init().");
+  if (num_frames == 0)
+    return false;
+
+  int32 convergence_frame = decoder.GetConvergenceFrame(frozen_frame_ + 1);
+  if (convergence_frame > frozen_frame_) {
+    // Freeze the lattice up to convergence_frame.  The part from
+    // frozen_frame_ onward is the only part that is determinized.
+    CompactLattice new_part;
+    if (!DeterminizeRange(decoder, frozen_frame_, convergence_frame, false,
+                          &new_part))
+      return false;
+    if (frozen_frame_ == 0)
+      frozen_lat_ = new_part;
+    else
+      fst::Concat(&frozen_lat_, new_part);
+    frozen_frame_ = convergence_frame;
+    KALDI_VLOG(3) << "Froze the lattice up to frame " << frozen_frame_
+                  << " of " << num_frames;
+  }
+
+  // GetConvergenceFrame() never returns the last frame, so there is always a
+  // part after the frozen one.
+  CompactLattice last_part;
+  if (!DeterminizeRange(decoder, frozen_frame_, num_frames, use_final_probs,
+                        &last_part))
+    return false;
+  if (frozen_frame_ == 0) {
+    *clat = last_part;
+  } else {
+    *clat = frozen_lat_;
+    fst::Concat(clat, last_part);
+  }
+  return true;
+}
+
+}  // namespace kaldi
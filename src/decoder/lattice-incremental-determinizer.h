@@ -0,0 +1,96 @@
+// decoder/lattice-incremental-determinizer.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_DECODER_LATTICE_INCREMENTAL_DETERMINIZER_H_
+#define KALDI_DECODER_LATTICE_INCREMENTAL_DETERMINIZER_H_
+
+#include "decoder/lattice-faster-online-decoder.h"
+#include "hmm/transition-model.h"
+#include "lat/kaldi-lattice.h"
+
+namespace kaldi {
+
+/**
+   IncrementalLatticeDeterminizer is for getting partial lattices from a
+   LatticeFasterOnlineDecoder repeatedly during an utterance, e.g. to give
+   partial results to a client, without the cost of each call growing with the
+   length of the utterance.  Getting the raw lattice and determinizing it
+   (which is what GetLattice() in the online decoders does) visits the whole
+   utterance each time, so polling at a fixed interval costs time quadratic in
+   the utterance length.
+
+   This class uses the fact that, after pruning, there are usually frames on
+   which only one token survives (see
+   LatticeFasterOnlineDecoder::GetConvergenceFrame()).  All paths through the
+   lattice pass through such a token, so the part of the lattice before it is
+   frozen: it is determinized once, and the lattice output by GetLattice() is
+   that determinized prefix, concatenated (via an epsilon arc) with the
+   determinized part after it, which is all that is computed each time.  The
+   output is equivalent to determinizing the whole lattice, except that it is
+   joined at those frames and so may be slightly less compact; if there is no
+   such frame, the whole lattice is determinized as usual.
+
+   Call Init() whenever the decoder's InitDecoding() is called.
+*/
+class IncrementalLatticeDeterminizer {
+ public:
+  /// The lattice beam and determinization options are taken from "config".
+  /// Both references must outlive this object.
+  IncrementalLatticeDeterminizer(const TransitionModel &trans_model,
+                                 const LatticeFasterDecoderConfig &config);
+
+  /// Forgets the frozen part of the lattice, for a new utterance.
+  void Init();
+
+  /// Outputs the determinized lattice of everything "decoder" has decoded,
+  /// with final-probs if use_final_probs is true (see
+  /// LatticeFasterOnlineDecoder::GetRawLattice()).  "decoder" must be the same
+  /// one on each call since the last Init().  The lattice has the acoustic
+  /// scaling of the decoder.  Returns false (with an empty lattice) if there is
+  /// nothing to output.
+  bool GetLattice(const LatticeFasterOnlineDecoder &decoder,
+                  bool use_final_probs, CompactLattice *clat);
+
+  /// Returns the frame up to which the lattice has been frozen (0 if none).
+  int32 FrozenFrame() const { return frozen_frame_; }
+
+ private:
+  // Determinizes the raw lattice of these frames of the decoder (see
+  // GetRawLatticeRange()) into "clat"; returns false on failure.
+  bool DeterminizeRange(const LatticeFasterOnlineDecoder &decoder,
+                        int32 begin_frame, int32 end_frame,
+                        bool use_final_probs, CompactLattice *clat) const;
+
+  const TransitionModel &trans_model_;
+  const LatticeFasterDecoderConfig &config_;
+
+  // The decoder frame up to which frozen_lat_ covers the lattice; 0 if
+  // nothing has been frozen yet.
+  int32 frozen_frame_;
+  // The determinized lattice of frames [0, frozen_frame_]; its final state
+  // is the token on frame frozen_frame_.
+  CompactLattice frozen_lat_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(IncrementalLatticeDeterminizer);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_DECODER_LATTICE_INCREMENTAL_DETERMINIZER_H_
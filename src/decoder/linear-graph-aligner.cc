@@ -0,0 +1,294 @@
+// decoder/linear-graph-aligner.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <limits>
+
+#include "decoder/linear-graph-aligner.h"
+
+namespace kaldi {
+
+LinearGraphAligner::LinearGraphAligner(const fst::Fst<fst::StdArc> &fst,
+                                       BaseFloat beam):
+    supported_(false), beam_(beam), start_pos_(-1),
+    cur_begin_(0), cur_end_(0) {
+  KALDI_ASSERT(beam > 0.0);
+  Init(fst);
+}
+
+void LinearGraphAligner::Init(const fst::Fst<fst::StdArc> &fst) {
+  StateId start = fst.Start();
+  if (start == fst::kNoStateId)
+    return;
+  int32 num_states = 0;
+  for (fst::StateIterator<fst::Fst<Arc> > siter(fst); !siter.Done();
+       siter.Next())
+    num_states = std::max<int32>(num_states, siter.Value() + 1);
+
+  // Kahn's algorithm, ignoring self-loops.  Taking the states in FIFO order
+  // keeps the states that are active at the same time close together.
+  std::vector<int32> in_degree(num_states, 0);
+  for (StateId s = 0; s < num_states; s++) {
+    for (fst::ArcIterator<fst::Fst<Arc> > aiter(fst, s); !aiter.Done();
+         aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      if (arc.nextstate != s)
+        in_degree[arc.nextstate]++;
+    }
+  }
+  std::vector<StateId> order;
+  order.reserve(num_states);
+  for (StateId s = 0; s < num_states; s++)
+    if (in_degree[s] == 0)
+      order.push_back(s);
+  for (size_t i = 0; i < order.size(); i++) {
+    StateId s = order[i];
+    for (fst::ArcIterator<fst::Fst<Arc> > aiter(fst, s); !aiter.Done();
+         aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      if (arc.nextstate != s && --in_degree[arc.nextstate] == 0)
+        order.push_back(arc.nextstate);
+    }
+  }
+  if (static_cast<int32>(order.size()) != num_states)
+    return;  // There is a cycle.
+
+  std::vector<int32> position(num_states);
+  for (int32 p = 0; p < num_states; p++)
+    position[order[p]] = p;
+  start_pos_ = position[start];
+
+  arc_begin_.resize(num_states + 1);
+  final_cost_.resize(num_states);
+  arcs_.clear();
+  arc_source_.clear();
+  for (int32 p = 0; p < num_states; p++) {
+    StateId s = order[p];
+    arc_begin_[p] = arcs_.size();
+    for (fst::ArcIterator<fst::Fst<Arc> > aiter(fst, s); !aiter.Done();
+         aiter.Next()) {
+      Arc arc = aiter.Value();
+      if (arc.nextstate == s && arc.ilabel == 0)
+        continue;  // An epsilon self-loop can't be on the best path.
+      arc.nextstate = position[arc.nextstate];
+      arcs_.push_back(arc);
+      arc_source_.push_back(p);
+    }
+    final_cost_[p] = fst.Final(s).Value();
+  }
+  arc_begin_[num_states] = arcs_.size();
+  supported_ = true;
+}
+
+void LinearGraphAligner::Decode(DecodableInterface *decodable) {
+  KALDI_ASSERT(supported_);
+  const double infinity = std::numeric_limits<double>::infinity();
+  int32 num_states = final_cost_.size();
+  cur_cost_.assign(num_states, infinity);
+  cur_arc_.assign(num_states, -1);
+  next_cost_.assign(num_states, infinity);
+  next_arc_.assign(num_states, -1);
+  frame_begin_.clear();
+  frame_offset_.clear();
+  frame_offset_.push_back(0);
+  stored_cost_.clear();
+  stored_arc_.clear();
+
+  cur_cost_[start_pos_] = 0.0;
+  cur_begin_ = start_pos_;
+  cur_end_ = start_pos_ + 1;
+  ProcessNonemitting();
+  PruneAndStore();
+
+  for (int32 frame = 0; !decodable->IsLastFrame(frame - 1); frame++) {
+    // The emitting arcs, from the current frame to the next.  Anything
+    // worse than the best cost so far plus the beam would be pruned anyway.
+    double best_cost = infinity;
+    int32 next_begin = num_states, next_end = 0;
+    for (int32 p = cur_begin_; p < cur_end_; p++) {
+      double cost = cur_cost_[p];
+      if (cost == infinity)
+        continue;
+      for (int32 a = arc_begin_[p]; a < arc_begin_[p + 1]; a++) {
+        const Arc &arc = arcs_[a];
+        if (arc.ilabel == 0)
+          continue;
+        double new_cost = cost + arc.weight.Value() -
+            decodable->LogLikelihood(frame, arc.ilabel);
+        if (new_cost > best_cost + beam_)
+          continue;
+        int32 q = arc.nextstate;
+        if (new_cost < next_cost_[q]) {
+          next_cost_[q] = new_cost;
+          next_arc_[q] = a;
+          if (new_cost < best_cost) best_cost = new_cost;
+          if (q < next_begin) next_begin = q;
+          if (q >= next_end) next_end = q + 1;
+        }
+      }
+      cur_cost_[p] = infinity;
+      cur_arc_[p] = -1;
+    }
+    cur_cost_.swap(next_cost_);
+    cur_arc_.swap(next_arc_);
+    if (next_begin < next_end) {
+      cur_begin_ = next_begin;
+      cur_end_ = next_end;
+    } else {
+      cur_begin_ = cur_end_ = 0;  // Nothing survived.
+    }
+    ProcessNonemitting();
+    PruneAndStore();
+  }
+}
+
+void LinearGraphAligner::ProcessNonemitting() {
+  const double infinity = std::numeric_limits<double>::infinity();
+  // cur_end_ may increase inside the loop; the arcs only go forward.
+  for (int32 p = cur_begin_; p < cur_end_; p++) {
+    double cost = cur_cost_[p];
+    if (cost == infinity)
+      continue;
+    for (int32 a = arc_begin_[p]; a < arc_begin_[p + 1]; a++) {
+      const Arc &arc = arcs_[a];
+      if (arc.ilabel != 0)
+        continue;
+      int32 q = arc.nextstate;
+      double new_cost = cost + arc.weight.Value();
+      if (new_cost < cur_cost_[q]) {
+        cur_cost_[q] = new_cost;
+        cur_arc_[q] = a;
+        if (q >= cur_end_) cur_end_ = q + 1;
+      }
+    }
+  }
+}
+
+void LinearGraphAligner::PruneAndStore() {
+  const double infinity = std::numeric_limits<double>::infinity();
+  frame_begin_.push_back(cur_begin_);
+  double best_cost = infinity;
+  for (int32 p = cur_begin_; p < cur_end_; p++) {
+    stored_cost_.push_back(cur_cost_[p]);
+    stored_arc_.push_back(cur_arc_[p]);
+    if (cur_cost_[p] < best_cost) best_cost = cur_cost_[p];
+  }
+  frame_offset_.push_back(stored_cost_.size());
+
+  double cutoff = best_cost + beam_;
+  int32 new_begin = cur_end_, new_end = cur_begin_;
+  for (int32 p = cur_begin_; p < cur_end_; p++) {
+    if (cur_cost_[p] > cutoff) {
+      cur_cost_[p] = infinity;
+      cur_arc_[p] = -1;
+    } else if (cur_cost_[p] != infinity) {
+      if (p < new_begin) new_begin = p;
+      new_end = p + 1;
+    }
+  }
+  if (new_begin < new_end) {
+    cur_begin_ = new_begin;
+    cur_end_ = new_end;
+  } else {
+    cur_begin_ = cur_end_ = 0;
+  }
+}
+
+int32 LinearGraphAligner::BestFinalPosition(bool *is_final) const {
+  const double infinity = std::numeric_limits<double>::infinity();
+  *is_final = false;
+  if (frame_begin_.empty())
+    return -1;
+  // Only the states that survived pruning on the last frame count, as for
+  // FasterDecoder; these are the band [cur_begin_, cur_end_).
+  int32 best_pos = -1, best_final_pos = -1;
+  double best_cost = infinity, best_final_cost = infinity;
+  for (int32 p = cur_begin_; p < cur_end_; p++) {
+    double cost = cur_cost_[p];
+    if (cost == infinity)
+      continue;
+    if (cost < best_cost) {
+      best_cost = cost;
+      best_pos = p;
+    }
+    double final_cost = cost + final_cost_[p];
+    if (final_cost < best_final_cost) {
+      best_final_cost = final_cost;
+      best_final_pos = p;
+    }
+  }
+  if (best_final_pos != -1) {
+    *is_final = true;
+    return best_final_pos;
+  }
+  return best_pos;
+}
+
+bool LinearGraphAligner::ReachedFinal() const {
+  bool is_final;
+  BestFinalPosition(&is_final);
+  return is_final;
+}
+
+bool LinearGraphAligner::GetBestPath(
+    fst::MutableFst<LatticeArc> *fst_out) const {
+  fst_out->DeleteStates();
+  bool is_final;
+  int32 pos = BestFinalPosition(&is_final);
+  if (pos == -1)
+    return false;
+
+  std::vector<LatticeArc> arcs_reverse;  // arcs in reverse order.
+  int32 t = static_cast<int32>(frame_begin_.size()) - 1, p = pos;
+  while (true) {
+    int32 i = frame_offset_[t] + p - frame_begin_[t];
+    KALDI_ASSERT(i >= frame_offset_[t] && i < frame_offset_[t + 1]);
+    int32 a = stored_arc_[i];
+    if (a == -1) {
+      KALDI_ASSERT(t == 0 && p == start_pos_);
+      break;
+    }
+    const Arc &arc = arcs_[a];
+    int32 prev_t = (arc.ilabel == 0 ? t : t - 1), prev_p = arc_source_[a];
+    int32 prev_i = frame_offset_[prev_t] + prev_p - frame_begin_[prev_t];
+    KALDI_ASSERT(prev_i >= frame_offset_[prev_t] &&
+                 prev_i < frame_offset_[prev_t + 1]);
+    BaseFloat graph_cost = arc.weight.Value(),
+        ac_cost = (arc.ilabel == 0 ? 0.0 :
+                   stored_cost_[i] - stored_cost_[prev_i] - graph_cost);
+    arcs_reverse.push_back(LatticeArc(arc.ilabel, arc.olabel,
+                                      LatticeWeight(graph_cost, ac_cost), 0));
+    t = prev_t;
+    p = prev_p;
+  }
+
+  StateId cur_state = fst_out->AddState();
+  fst_out->SetStart(cur_state);
+  for (ssize_t i = static_cast<ssize_t>(arcs_reverse.size()) - 1; i >= 0; i--) {
+    LatticeArc arc = arcs_reverse[i];
+    arc.nextstate = fst_out->AddState();
+    fst_out->AddArc(cur_state, arc);
+    cur_state = arc.nextstate;
+  }
+  if (is_final)
+    fst_out->SetFinal(cur_state, LatticeWeight(final_cost_[pos], 0.0));
+  else
+    fst_out->SetFinal(cur_state, LatticeWeight::One());
+  fst::RemoveEpsLocal(fst_out);
+  return true;
+}
+
+}  // namespace kaldi
@@ -0,0 +1,132 @@
+// decoder/linear-graph-aligner.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_LINEAR_GRAPH_ALIGNER_H_
+#define KALDI_DECODER_LINEAR_GRAPH_ALIGNER_H_
+
+#include <vector>
+
+#include "fst/fstlib.h"
+#include "itf/decodable-itf.h"
+#include "lat/kaldi-lattice.h"
+
+namespace kaldi {
+
+/**
+   LinearGraphAligner is a Viterbi aligner for graphs that are acyclic apart
+   from self-loops, such as the training graphs from TrainingGraphCompiler (a
+   left-to-right sequence of HMMs, with optional silences), including after
+   ModifyGraphForCarefulAlignment().  It does the same job as FasterDecoder
+   with only a beam (which is how AlignUtteranceWrapper() uses it), but it
+   sorts the states topologically and keeps the costs in dense arrays indexed
+   by the position of the state in that order, so that each frame only visits
+   the band of positions between the first and the last active state, with no
+   hashing and no allocation of tokens.  The back-pointers are stored for
+   each frame's band, which for these graphs is narrow.
+
+   The result is exact, within the beam: each frame keeps the states whose
+   cost is within "beam" of the best one, like FasterDecoder (which, unlike
+   this class, also applies max-active and min-active).
+ */
+class LinearGraphAligner {
+ public:
+  typedef fst::StdArc Arc;
+  typedef Arc::Label Label;
+  typedef Arc::StateId StateId;
+
+  /// We copy what we need from "fst", so it may be deleted or modified
+  /// afterwards.  If it is not acyclic apart from self-loops,
+  /// GraphIsSupported() will return false.
+  LinearGraphAligner(const fst::Fst<fst::StdArc> &fst, BaseFloat beam);
+
+  /// Returns true if the graph given to the constructor is acyclic apart
+  /// from self-loops, and has a start state; Decode() may only be called if
+  /// this is true.
+  bool GraphIsSupported() const { return supported_; }
+
+  void SetBeam(BaseFloat beam) { beam_ = beam; }
+
+  /// Aligns all the frames of "decodable".  This may be called more than
+  /// once, e.g. again with a larger beam if a final state was not reached.
+  void Decode(DecodableInterface *decodable);
+
+  /// Returns true if a final state was active on the last frame.
+  bool ReachedFinal() const;
+
+  /// Outputs the best path (with the graph and acoustic costs in the
+  /// weights, as for FasterDecoder::GetBestPath()).  If a final state was
+  /// reached, this is the best path to a final state, including its final
+  /// cost; otherwise it's the best path to any state.  Returns false if no
+  /// state was active on the last frame (in which case "fst_out" is empty).
+  bool GetBestPath(fst::MutableFst<LatticeArc> *fst_out) const;
+
+ private:
+  // Sorts the states topologically, ignoring self-loops, and copies the arcs
+  // and final-probs; sets supported_ to false if there is a cycle.
+  void Init(const fst::Fst<fst::StdArc> &fst);
+
+  // Processes the epsilon (input label zero) arcs of the band of the
+  // current frame, in topological order, so one pass is enough.
+  void ProcessNonemitting();
+
+  // Stores the costs and back-pointers of the current band, and then prunes
+  // it to the states within the beam.  (We store the band before pruning
+  // because an epsilon arc with a negative cost may lead from a state that
+  // is pruned to one that isn't.)
+  void PruneAndStore();
+
+  // Finds the position in the last frame where the best path ends; returns
+  // -1 if there is none.  Sets *is_final to true if it's a final state.
+  int32 BestFinalPosition(bool *is_final) const;
+
+  bool supported_;
+  BaseFloat beam_;
+
+  // The graph, with states numbered by their topological position.  The
+  // arcs leaving position p are arcs_[arc_begin_[p]] ..
+  // arcs_[arc_begin_[p+1] - 1], with nextstate also a position; self-loops
+  // are included.
+  std::vector<int32> arc_begin_;
+  std::vector<Arc> arcs_;
+  std::vector<int32> arc_source_;  // the position that each arc leaves.
+  std::vector<BaseFloat> final_cost_;  // infinity if not final.
+  int32 start_pos_;
+
+  // The costs of the current and next frame's states, indexed by position;
+  // only the band [cur_begin_, cur_end_) may be finite.
+  std::vector<double> cur_cost_;
+  std::vector<int32> cur_arc_;  // the arc that got the best cost, or -1.
+  int32 cur_begin_, cur_end_;
+  std::vector<double> next_cost_;
+  std::vector<int32> next_arc_;
+
+  // What we store for each frame t = 0 .. num_frames (frame t being the
+  // states after t frames have been consumed): frame_begin_[t] is the
+  // position where its band starts, and its costs and back-pointers are
+  // stored_cost_[i] and stored_arc_[i], for i in
+  // frame_offset_[t] .. frame_offset_[t+1] - 1.
+  std::vector<int32> frame_begin_;
+  std::vector<int32> frame_offset_;
+  std::vector<double> stored_cost_;
+  std::vector<int32> stored_arc_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(LinearGraphAligner);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_DECODER_LINEAR_GRAPH_ALIGNER_H_
@@ -0,0 +1,205 @@
+// decoder/lookahead-composed-graph.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <limits>
+#include "decoder/lookahead-composed-graph.h"
+
+namespace kaldi {
+
+LookaheadComposedGraph::LookaheadComposedGraph(
+    const fst::Fst<Arc> &hcl,
+    fst::DeterministicOnDemandFst<Arc> *g,
+    const LookaheadComposedGraphOptions &opts):
+    hcl_(hcl), g_(g), opts_(opts), num_cached_arcs_(0) {
+  opts.Check();
+  if (hcl_.Start() == fst::kNoStateId)
+    KALDI_ERR << "Decoding graph HCL has no start state.";
+  ComputePotentials();
+  Reset();
+}
+
+void LookaheadComposedGraph::ComputePotentials() {
+  int32 num_states = 0;
+  for (fst::StateIterator<fst::Fst<Arc> > siter(hcl_); !siter.Done();
+       siter.Next()) {
+    StateId s = siter.Value();
+    if (s != num_states)
+      KALDI_ERR << "The state-ids of HCL are not contiguous.";
+    num_states++;
+  }
+  phi_.clear();
+  phi_.resize(num_states, 0.0);
+  if (!opts_.lookahead) return;
+
+  const BaseFloat infinity = std::numeric_limits<BaseFloat>::infinity();
+  phi_.assign(num_states, infinity);
+  // The LM cost of each word in the start state of G.
+  unordered_map<Label, BaseFloat> word_costs;
+  StateId g_start = g_->Start();
+  // For each state t, the source states of the arcs into t that have no word
+  // label ("preds" is in CSR form, indexed by pred_offsets).
+  std::vector<int32> pred_offsets(num_states + 1, 0);
+  std::vector<StateId> preds;
+  for (StateId s = 0; s < num_states; s++) {
+    if (hcl_.Final(s) != Arc::Weight::Zero())
+      phi_[s] = 0.0;
+    for (fst::ArcIterator<fst::Fst<Arc> > aiter(hcl_, s); !aiter.Done();
+         aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      if (arc.olabel == 0) {
+        pred_offsets[arc.nextstate + 1]++;
+        continue;
+      }
+      unordered_map<Label, BaseFloat>::iterator iter =
+          word_costs.find(arc.olabel);
+      BaseFloat cost;
+      if (iter != word_costs.end()) {
+        cost = iter->second;
+      } else {
+        Arc g_arc;
+        cost = (g_->GetArc(g_start, arc.olabel, &g_arc) ?
+                g_arc.weight.Value() : infinity);
+        word_costs[arc.olabel] = cost;
+      }
+      if (cost < phi_[s]) phi_[s] = cost;
+    }
+  }
+  for (StateId t = 0; t < num_states; t++)
+    pred_offsets[t + 1] += pred_offsets[t];
+  preds.resize(pred_offsets[num_states]);
+  std::vector<int32> pos(pred_offsets.begin(), pred_offsets.end() - 1);
+  for (StateId s = 0; s < num_states; s++) {
+    for (fst::ArcIterator<fst::Fst<Arc> > aiter(hcl_, s); !aiter.Done();
+         aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      if (arc.olabel == 0)
+        preds[pos[arc.nextstate]++] = s;
+    }
+  }
+
+  // Propagate the potentials backwards along the arcs with no word label,
+  // phi(s) = min(phi(s), phi(t)) for each such arc s->t, until nothing
+  // changes.
+  std::vector<StateId> queue;
+  for (StateId s = 0; s < num_states; s++)
+    if (phi_[s] != infinity) queue.push_back(s);
+  while (!queue.empty()) {
+    StateId t = queue.back();
+    queue.pop_back();
+    BaseFloat phi_t = phi_[t];
+    for (int32 i = pred_offsets[t]; i < pred_offsets[t + 1]; i++) {
+      StateId s = preds[i];
+      if (phi_t < phi_[s]) {
+        phi_[s] = phi_t;
+        queue.push_back(s);
+      }
+    }
+  }
+  // States from which no word or final state can be reached can't be on a
+  // successful path; give them zero potential so the costs stay finite.
+  int32 num_dead = 0;
+  for (StateId s = 0; s < num_states; s++) {
+    if (phi_[s] == infinity) {
+      phi_[s] = 0.0;
+      num_dead++;
+    }
+  }
+  if (num_dead != 0)
+    KALDI_WARN << num_dead << " states of HCL cannot reach any word of G.";
+  KALDI_VLOG(1) << "Lookahead potential of the start state is "
+                << phi_[hcl_.Start()];
+}
+
+void LookaheadComposedGraph::Reset() {
+  state_map_.clear();
+  state_pairs_.clear();
+  arc_cache_.clear();
+  num_cached_arcs_ = 0;
+  StateId start = FindOrAddState(hcl_.Start(), g_->Start());
+  KALDI_ASSERT(start == Start());
+}
+
+LookaheadComposedGraph::StateId LookaheadComposedGraph::FindOrAddState(
+    StateId hcl_state, StateId g_state) const {
+  uint64 key = (static_cast<uint64>(static_cast<uint32>(hcl_state)) << 32) |
+      static_cast<uint32>(g_state);
+  unordered_map<uint64, StateId>::iterator iter = state_map_.find(key);
+  if (iter != state_map_.end())
+    return iter->second;
+  StateId s = static_cast<StateId>(state_pairs_.size());
+  state_map_[key] = s;
+  state_pairs_.push_back(std::make_pair(hcl_state, g_state));
+  return s;
+}
+
+BaseFloat LookaheadComposedGraph::Final(StateId s) const {
+  KALDI_ASSERT(static_cast<size_t>(s) < state_pairs_.size());
+  StateId hcl_state = state_pairs_[s].first,
+      g_state = state_pairs_[s].second;
+  BaseFloat hcl_final = hcl_.Final(hcl_state).Value();
+  if (hcl_final == std::numeric_limits<BaseFloat>::infinity())
+    return hcl_final;
+  return hcl_final + g_->Final(g_state).Value() - phi_[hcl_state] +
+      phi_[hcl_.Start()];
+}
+
+const LookaheadComposedGraph::ExpandedState &LookaheadComposedGraph::GetArcs(
+    StateId s) const {
+  unordered_map<StateId, ExpandedState>::iterator iter = arc_cache_.find(s);
+  if (iter != arc_cache_.end())
+    return iter->second;
+  if (num_cached_arcs_ > static_cast<size_t>(opts_.max_cached_arcs)) {
+    KALDI_VLOG(2) << "Flushing cache of " << num_cached_arcs_ << " arcs for "
+                  << arc_cache_.size() << " composed states.";
+    arc_cache_.clear();
+    num_cached_arcs_ = 0;
+  }
+  KALDI_ASSERT(static_cast<size_t>(s) < state_pairs_.size());
+  StateId hcl_state = state_pairs_[s].first,
+      g_state = state_pairs_[s].second;
+  BaseFloat phi_s = phi_[hcl_state];
+
+  ExpandedState &expanded = arc_cache_[s];
+  std::vector<Arc> nonemitting_arcs;
+  for (fst::ArcIterator<fst::Fst<Arc> > aiter(hcl_, hcl_state); !aiter.Done();
+       aiter.Next()) {
+    const Arc &arc = aiter.Value();
+    BaseFloat cost = arc.weight.Value() + phi_[arc.nextstate] - phi_s;
+    StateId next_g_state = g_state;
+    if (arc.olabel != 0) {
+      Arc g_arc;
+      if (!g_->GetArc(g_state, arc.olabel, &g_arc))
+        continue;  // The word is not in the LM.
+      cost += g_arc.weight.Value();
+      next_g_state = g_arc.nextstate;
+    }
+    Arc composed_arc(arc.ilabel, arc.olabel, Arc::Weight(cost),
+                     FindOrAddState(arc.nextstate, next_g_state));
+    if (arc.ilabel != 0) expanded.arcs.push_back(composed_arc);
+    else nonemitting_arcs.push_back(composed_arc);
+  }
+  expanded.num_emitting = expanded.arcs.size();
+  expanded.arcs.insert(expanded.arcs.end(), nonemitting_arcs.begin(),
+                       nonemitting_arcs.end());
+  num_cached_arcs_ += expanded.arcs.size();
+  return expanded;
+}
+
+
+} // end namespace kaldi.
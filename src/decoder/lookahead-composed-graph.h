@@ -0,0 +1,184 @@
+// decoder/lookahead-composed-graph.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_LOOKAHEAD_COMPOSED_GRAPH_H_
+#define KALDI_DECODER_LOOKAHEAD_COMPOSED_GRAPH_H_
+
+#include <vector>
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "itf/options-itf.h"
+#include "fst/fstlib.h"
+#include "fstext/deterministic-fst.h"
+
+namespace kaldi {
+
+struct LookaheadComposedGraphOptions {
+  int32 max_cached_arcs;
+  bool lookahead;
+
+  LookaheadComposedGraphOptions(): max_cached_arcs(20000000),
+                                   lookahead(true) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("max-cached-arcs", &max_cached_arcs, "Maximum number of "
+                   "arcs of the composed graph to keep cached; when this is "
+                   "exceeded the cache is flushed.");
+    opts->Register("lookahead", &lookahead, "If true, push label-reachability "
+                   "lookahead costs from the language model onto the arcs of "
+                   "the composed graph, which makes pruning more accurate.");
+  }
+  void Check() const {
+    KALDI_ASSERT(max_cached_arcs > 0);
+  }
+};
+
+/**
+   LookaheadComposedGraph represents the composition HCL o G of a (small)
+   context-dependent lexicon HCL with a (possibly very large) language model
+   G, with the composition done on demand as the decoder visits states, so the
+   full HCLG never has to be built.  G is any fst::DeterministicOnDemandFst,
+   for instance a ConstArpaLmDeterministicFst (for a ConstArpaLm) or a
+   BackoffDeterministicOnDemandFst (for a G.fst); since G is deterministic,
+   each arc of HCL with a word on its output gives at most one arc of the
+   composed graph.  HCL must have the words of G as its output labels, and no
+   disambiguation symbols on its input.
+
+   The composed states are pairs (HCL state, G state), which are given
+   integer ids in the order in which they are first seen; the id of the
+   start state is always zero.  The arcs of each composed state that the
+   decoder visits are cached (emitting arcs first, then non-emitting ones);
+   the cache is flushed when it exceeds "max_cached_arcs" arcs, so memory use
+   is bounded by that and by the number of distinct states visited.
+
+   Lookahead: without it, the LM cost of a word would only be seen at the
+   point in HCL where the word label is output, so that paths into unlikely
+   words would survive pruning for too long.  With "lookahead" set, we compute
+   for each HCL state s a potential phi(s), which is the lowest LM cost of any
+   word that can be output next on a path from s (the LM cost of a word being
+   its cost in G's start state; final states of HCL count as zero), and we
+   add phi(nextstate) - phi(s) to the cost of each arc, and phi(start) -
+   phi(s) to the final-cost of each state.  These terms cancel along any
+   complete path, so the total cost of every successful path (and hence the
+   lattice, after determinization) is the same as in the exact composition;
+   only the distribution of the costs along the path changes.
+
+   This class is not thread-safe, and it is meant to be used by one decoder
+   at a time.  Call Reset() between utterances to free the state-id map.
+*/
+class LookaheadComposedGraph {
+ public:
+  typedef fst::StdArc Arc;
+  typedef Arc::StateId StateId;
+  typedef Arc::Label Label;
+
+  /// "hcl" and "g" must outlive this object.  The state-ids of "hcl" must be
+  /// allocated contiguously from zero (true for VectorFst and ConstFst).
+  LookaheadComposedGraph(const fst::Fst<Arc> &hcl,
+                         fst::DeterministicOnDemandFst<Arc> *g,
+                         const LookaheadComposedGraphOptions &opts);
+
+  StateId Start() const { return 0; }
+
+  /// Returns the final-cost of composed state s (infinity if not final).
+  BaseFloat Final(StateId s) const;
+
+  /// Forgets all composed states and cached arcs.  Only call this when no
+  /// decoder is using the state-ids, e.g. between utterances.
+  void Reset();
+
+  /// Returns the number of composed states seen since the last Reset().
+  int32 NumStatesSeen() const { return state_pairs_.size(); }
+
+  struct ExpandedState {
+    std::vector<Arc> arcs;  // emitting arcs, then non-emitting arcs.
+    int32 num_emitting;
+  };
+
+  /// Returns the arcs of composed state s, expanding it if it is not in the
+  /// cache.  The reference is valid until the next call to this function.
+  const ExpandedState &GetArcs(StateId s) const;
+
+ private:
+  // Computes the lookahead potentials phi_; see the comment above the class.
+  void ComputePotentials();
+
+  // Returns the id of the composed state (hcl_state, g_state), allocating a
+  // new one if it has not been seen.
+  StateId FindOrAddState(StateId hcl_state, StateId g_state) const;
+
+  const fst::Fst<Arc> &hcl_;
+  fst::DeterministicOnDemandFst<Arc> *g_;
+  LookaheadComposedGraphOptions opts_;
+
+  // The lookahead potential of each HCL state (all zero if !opts_.lookahead).
+  std::vector<BaseFloat> phi_;
+
+  // The state and arc caches are mutable because they don't change the
+  // composed graph that this object represents.
+  // Maps (hcl_state << 32 | g_state) to the composed state-id.
+  mutable unordered_map<uint64, StateId> state_map_;
+  // The (hcl_state, g_state) pair of each composed state-id.
+  mutable std::vector<std::pair<StateId, StateId> > state_pairs_;
+  mutable unordered_map<StateId, ExpandedState> arc_cache_;
+  mutable size_t num_cached_arcs_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(LookaheadComposedGraph);
+};
+
+
+/// These classes iterate over, respectively, the emitting and the
+/// non-emitting arcs of a state of a LookaheadComposedGraph, with the same
+/// interface as CsrEmittingArcIterator and CsrNonemittingArcIterator.  Only
+/// one iterator may be in use at a time.
+class LookaheadComposedEmittingArcIterator {
+ public:
+  typedef LookaheadComposedGraph::Arc Arc;
+  LookaheadComposedEmittingArcIterator(const LookaheadComposedGraph &graph,
+                                       LookaheadComposedGraph::StateId s):
+      state_(graph.GetArcs(s)), pos_(0), end_(state_.num_emitting) { }
+  bool Done() const { return pos_ >= end_; }
+  void Next() { pos_++; }
+  const Arc &Value() const { return state_.arcs[pos_]; }
+ private:
+  const LookaheadComposedGraph::ExpandedState &state_;
+  int32 pos_;
+  int32 end_;
+};
+
+class LookaheadComposedNonemittingArcIterator {
+ public:
+  typedef LookaheadComposedGraph::Arc Arc;
+  LookaheadComposedNonemittingArcIterator(const LookaheadComposedGraph &graph,
+                                          LookaheadComposedGraph::StateId s):
+      state_(graph.GetArcs(s)), pos_(state_.num_emitting),
+      end_(state_.arcs.size()) { }
+  bool Done() const { return pos_ >= end_; }
+  void Next() { pos_++; }
+  const Arc &Value() const { return state_.arcs[pos_]; }
+ private:
+  const LookaheadComposedGraph::ExpandedState &state_;
+  int32 pos_;
+  int32 end_;
+};
+
+
+} // end namespace kaldi.
+
+#endif
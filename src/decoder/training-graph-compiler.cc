@@ -17,6 +17,7 @@
 // limitations under the License.
 #include "decoder/training-graph-compiler.h"
 #include "hmm/hmm-utils.h" // for GetHTransducer
+#include "thread/kaldi-thread.h"
 
 namespace kaldi {
 
@@ -27,7 +28,8 @@ TrainingGraphCompiler::TrainingGraphCompiler(const TransitionModel &trans_model,
                                              const std::vector<int32> &disambig_syms,
                                              const TrainingGraphCompilerOptions &opts):
     trans_model_(trans_model), ctx_dep_(ctx_dep), lex_fst_(lex_fst),
-    disambig_syms_(disambig_syms), opts_(opts) {
+    disambig_syms_(disambig_syms), cfst_(NULL), h_fst_(NULL),
+    h_num_ilabels_(0), opts_(opts) {
   using namespace fst;
   const std::vector<int32> &phone_syms = trans_model_.GetPhones();  // needed to create context fst.
 
@@ -57,78 +59,63 @@ TrainingGraphCompiler::TrainingGraphCompiler(const TransitionModel &trans_model,
     fst::OLabelCompare<fst::StdArc> olabel_comp;
     fst::ArcSort(lex_fst_, olabel_comp);
   }
-}
 
-bool TrainingGraphCompiler::CompileGraphFromText(
-    const std::vector<int32> &transcript,
-    fst::VectorFst<fst::StdArc> *out_fst) {
-  using namespace fst;
-  VectorFst<StdArc> word_fst;
-  MakeLinearAcceptor(transcript, &word_fst);
-  return CompileGraph(word_fst, out_fst);
+  // make cfst_ [ it's expanded on the fly, and the same one is used for all
+  // graphs ]
+  cfst_ = new ContextFst<StdArc>(subseq_symbol,
+                                 phone_syms,
+                                 disambig_syms_,
+                                 ctx_dep_.ContextWidth(),
+                                 ctx_dep_.CentralPosition());
+  KALDI_ASSERT(opts_.num_threads >= 1);
 }
 
-bool TrainingGraphCompiler::CompileGraph(const fst::VectorFst<fst::StdArc> &word_fst,
-                                         fst::VectorFst<fst::StdArc> *out_fst) {
-  using namespace fst;
-  KALDI_ASSERT(lex_fst_ !=NULL);
-  KALDI_ASSERT(out_fst != NULL);
-
-  VectorFst<StdArc> phone2word_fst;
-  // TableCompose more efficient than compose.
-  TableCompose(*lex_fst_, word_fst, &phone2word_fst, &lex_cache_);
-
-  KALDI_ASSERT(phone2word_fst.Start() != kNoStateId);
-
-  ContextFst<StdArc> *cfst = NULL;
-  {  // make cfst [ it's expanded on the fly ]
-    const std::vector<int32> &phone_syms = trans_model_.GetPhones();  // needed to create context fst.
-    int32 subseq_symbol = phone_syms.back() + 1;
-    if (!disambig_syms_.empty() && subseq_symbol <= disambig_syms_.back())
-      subseq_symbol = 1 + disambig_syms_.back();
-
-    cfst = new ContextFst<StdArc>(subseq_symbol,
-                                  phone_syms,
-                                  disambig_syms_,
-                                  ctx_dep_.ContextWidth(),
-                                  ctx_dep_.CentralPosition());
-  }
-
-  VectorFst<StdArc> ctx2word_fst;
-  ComposeContextFst(*cfst, phone2word_fst, &ctx2word_fst);
-  // ComposeContextFst is like Compose but faster for this particular Fst type.
-  // [and doesn't expand too many arcs in the ContextFst.]
-
-  KALDI_ASSERT(ctx2word_fst.Start() != kNoStateId);
+TrainingGraphCompiler::~TrainingGraphCompiler() {
+  for (GraphCache::iterator iter = graph_cache_.begin();
+       iter != graph_cache_.end(); ++iter)
+    delete iter->second;
+  delete h_fst_;
+  delete cfst_;
+  delete lex_fst_;
+}
 
+void TrainingGraphCompiler::UpdateH() {
+  size_t num_ilabels = cfst_->ILabelInfo().size();
+  if (h_fst_ != NULL && num_ilabels == h_num_ilabels_)
+    return;
   HTransducerConfig h_cfg;
   h_cfg.transition_scale = opts_.transition_scale;
+  delete h_fst_;
+  disambig_syms_h_.clear();
+  h_fst_ = GetHTransducer(cfst_->ILabelInfo(),
+                          ctx_dep_,
+                          trans_model_,
+                          h_cfg,
+                          &disambig_syms_h_);
+  h_num_ilabels_ = num_ilabels;
+}
+
+void TrainingGraphCompiler::FinishGraph(
+    const fst::VectorFst<fst::StdArc> *h_fst,
+    fst::VectorFst<fst::StdArc> *fst) const {
+  using namespace fst;
+  const VectorFst<StdArc> &H = (h_fst != NULL ? *h_fst : *h_fst_);
+  VectorFst<StdArc> trans2word_fst;  // transition-id to word.
+  TableCompose(H, *fst, &trans2word_fst);
 
-  std::vector<int32> disambig_syms_h; // disambiguation symbols on
-  // input side of H.
-  VectorFst<StdArc> *H = GetHTransducer(cfst->ILabelInfo(),
-                                        ctx_dep_,
-                                        trans_model_,
-                                        h_cfg,
-                                        &disambig_syms_h);
-  
-  VectorFst<StdArc> &trans2word_fst = *out_fst;  // transition-id to word.
-  TableCompose(*H, ctx2word_fst, &trans2word_fst);
-  
   KALDI_ASSERT(trans2word_fst.Start() != kNoStateId);
 
   // Epsilon-removal and determinization combined. This will fail if not determinizable.
   DeterminizeStarInLog(&trans2word_fst);
 
-  if (!disambig_syms_h.empty()) {
-    RemoveSomeInputSymbols(disambig_syms_h, &trans2word_fst);
+  if (!disambig_syms_h_.empty()) {
+    RemoveSomeInputSymbols(disambig_syms_h_, &trans2word_fst);
     // we elect not to remove epsilons after this phase, as it is
     // a little slow.
     if (opts_.rm_eps)
       RemoveEpsLocal(&trans2word_fst);
   }
 
-  
   // Encoded minimization.
   MinimizeEncoded(&trans2word_fst);
 
@@ -139,8 +126,69 @@ bool TrainingGraphCompiler::CompileGraph(const fst::VectorFst<fst::StdArc> &word
                opts_.reorder,
                &trans2word_fst);
 
-  delete H;
-  delete cfst;
+  KALDI_ASSERT(trans2word_fst.Start() != kNoStateId);
+
+  *fst = trans2word_fst;
+}
+
+const fst::VectorFst<fst::StdArc> *TrainingGraphCompiler::LookupCache(
+    const std::vector<int32> &transcript) const {
+  GraphCache::const_iterator iter = graph_cache_.find(transcript);
+  return (iter == graph_cache_.end() ? NULL : iter->second);
+}
+
+void TrainingGraphCompiler::AddToCache(
+    const std::vector<int32> &transcript,
+    const fst::VectorFst<fst::StdArc> &fst) {
+  // We don't evict anything once the cache is full: the transcripts that
+  // repeat most tend to be seen early on.
+  if (static_cast<int32>(graph_cache_.size()) >= opts_.cache_size ||
+      fst.Start() == fst::kNoStateId)
+    return;
+  std::pair<GraphCache::iterator, bool> ans = graph_cache_.insert(
+      std::pair<const std::vector<int32>, fst::VectorFst<fst::StdArc>*>(
+          transcript, NULL));
+  if (ans.second)
+    ans.first->second = new fst::VectorFst<fst::StdArc>(fst);
+}
+
+bool TrainingGraphCompiler::CompileGraphFromText(
+    const std::vector<int32> &transcript,
+    fst::VectorFst<fst::StdArc> *out_fst) {
+  using namespace fst;
+  const VectorFst<StdArc> *cached = LookupCache(transcript);
+  if (cached != NULL) {
+    *out_fst = *cached;
+    return true;
+  }
+  VectorFst<StdArc> word_fst;
+  MakeLinearAcceptor(transcript, &word_fst);
+  bool ans = CompileGraph(word_fst, out_fst);
+  if (ans && opts_.cache_size > 0)
+    AddToCache(transcript, *out_fst);
+  return ans;
+}
+
+bool TrainingGraphCompiler::CompileGraph(const fst::VectorFst<fst::StdArc> &word_fst,
+                                         fst::VectorFst<fst::StdArc> *out_fst) {
+  using namespace fst;
+  KALDI_ASSERT(lex_fst_ !=NULL);
+  KALDI_ASSERT(out_fst != NULL);
+
+  VectorFst<StdArc> phone2word_fst;
+  // TableCompose more efficient than compose.
+  TableCompose(*lex_fst_, word_fst, &phone2word_fst, &lex_cache_);
+
+  KALDI_ASSERT(phone2word_fst.Start() != kNoStateId);
+
+  ComposeContextFst(*cfst_, phone2word_fst, out_fst);
+  // ComposeContextFst is like Compose but faster for this particular Fst type.
+  // [and doesn't expand too many arcs in the ContextFst.]
+
+  KALDI_ASSERT(out_fst->Start() != kNoStateId);
+
+  UpdateH();
+  FinishGraph(NULL, out_fst);
   return true;
 }
 
@@ -149,18 +197,73 @@ bool TrainingGraphCompiler::CompileGraphsFromText(
     const std::vector<std::vector<int32> > &transcripts,
     std::vector<fst::VectorFst<fst::StdArc>*> *out_fsts) {
   using namespace fst;
-  std::vector<const VectorFst<StdArc>* > word_fsts(transcripts.size());
+  KALDI_ASSERT(out_fsts != NULL && out_fsts->empty());
+  out_fsts->resize(transcripts.size(), NULL);
+  // We only compile the transcripts that are not in the cache, and (if we are
+  // caching) each distinct transcript only once; to_compile[j] is the index
+  // of a transcript to compile.
+  std::vector<int32> to_compile;
+  unordered_map<std::vector<int32>, int32, VectorHasher<int32> > first_index;
   for (size_t i = 0; i < transcripts.size(); i++) {
+    if (opts_.cache_size > 0) {
+      const VectorFst<StdArc> *cached = LookupCache(transcripts[i]);
+      if (cached != NULL) {
+        (*out_fsts)[i] = new VectorFst<StdArc>(*cached);
+        continue;
+      }
+      if (!first_index.insert(std::make_pair(transcripts[i],
+                                             static_cast<int32>(i))).second)
+        continue;  // It's a repeat within this batch; we'll copy it below.
+    }
+    to_compile.push_back(i);
+  }
+
+  std::vector<const VectorFst<StdArc>* > word_fsts(to_compile.size());
+  for (size_t j = 0; j < to_compile.size(); j++) {
     VectorFst<StdArc> *word_fst = new VectorFst<StdArc>();
-    MakeLinearAcceptor(transcripts[i], word_fst);
-    word_fsts[i] = word_fst;
-  }    
-  bool ans = CompileGraphs(word_fsts, out_fsts);
-  for (size_t i = 0; i < transcripts.size(); i++)
-    delete word_fsts[i];
+    MakeLinearAcceptor(transcripts[to_compile[j]], word_fst);
+    word_fsts[j] = word_fst;
+  }
+  std::vector<VectorFst<StdArc>* > compiled_fsts;
+  bool ans = CompileGraphs(word_fsts, &compiled_fsts);
+  for (size_t j = 0; j < to_compile.size(); j++) {
+    delete word_fsts[j];
+    (*out_fsts)[to_compile[j]] = compiled_fsts[j];
+    if (ans && opts_.cache_size > 0)
+      AddToCache(transcripts[to_compile[j]], *(compiled_fsts[j]));
+  }
+
+  // Fill in the repeats within this batch.
+  for (size_t i = 0; i < transcripts.size(); i++) {
+    if ((*out_fsts)[i] == NULL) {
+      int32 j = first_index[transcripts[i]];
+      KALDI_ASSERT((*out_fsts)[j] != NULL);
+      (*out_fsts)[i] = new VectorFst<StdArc>(*((*out_fsts)[j]));
+    }
+  }
   return ans;
 }
 
+// This class is used by CompileGraphs() to call FinishGraph() on the graphs
+// from several threads; thread t does graphs t, t + num_threads_, and so on.
+// Each thread uses its own copy of H, since the reference counting of
+// OpenFst's shallow copies is not thread-safe.
+class TrainingGraphCompiler::CompileTask: public MultiThreadable {
+ public:
+  CompileTask(const TrainingGraphCompiler *compiler,
+              const std::vector<fst::VectorFst<fst::StdArc>*> *h_fsts,
+              std::vector<fst::VectorFst<fst::StdArc>*> *fsts):
+      compiler_(compiler), h_fsts_(h_fsts), fsts_(fsts) { }
+  void operator() () {
+    for (size_t i = thread_id_; i < fsts_->size(); i += num_threads_)
+      compiler_->FinishGraph((*h_fsts_)[thread_id_], (*fsts_)[i]);
+  }
+ private:
+  const TrainingGraphCompiler *compiler_;
+  const std::vector<fst::VectorFst<fst::StdArc>*> *h_fsts_;
+  std::vector<fst::VectorFst<fst::StdArc>*> *fsts_;
+};
+
 bool TrainingGraphCompiler::CompileGraphs(
     const std::vector<const fst::VectorFst<fst::StdArc>* > &word_fsts,
     std::vector<fst::VectorFst<fst::StdArc>* > *out_fsts) {
@@ -171,20 +274,8 @@ bool TrainingGraphCompiler::CompileGraphs(
   out_fsts->resize(word_fsts.size(), NULL);
   if (word_fsts.empty()) return true;
 
-  ContextFst<StdArc> *cfst = NULL;
-  {  // make cfst [ it's expanded on the fly ]
-    const std::vector<int32> &phone_syms = trans_model_.GetPhones();  // needed to create context fst.
-    int32 subseq_symbol = phone_syms.back() + 1;
-    if (!disambig_syms_.empty() && subseq_symbol <= disambig_syms_.back())
-      subseq_symbol = 1 + disambig_syms_.back();
-
-    cfst = new ContextFst<StdArc>(subseq_symbol,
-                                  phone_syms,
-                                  disambig_syms_,
-                                  ctx_dep_.ContextWidth(),
-                                  ctx_dep_.CentralPosition());
-  }
-
+  // The composition with L and C is done serially, since lex_cache_ and cfst_
+  // are modified as they are used.
   for (size_t i = 0; i < word_fsts.size(); i++) {
     VectorFst<StdArc> phone2word_fst;
     // TableCompose more efficient than compose.
@@ -192,58 +283,38 @@ bool TrainingGraphCompiler::CompileGraphs(
 
     KALDI_ASSERT(phone2word_fst.Start() != kNoStateId &&
                  "Perhaps you have words missing in your lexicon?");
-    
-    VectorFst<StdArc> ctx2word_fst;
-    ComposeContextFst(*cfst, phone2word_fst, &ctx2word_fst);
+
+    VectorFst<StdArc> *ctx2word_fst = new VectorFst<StdArc>();
+    ComposeContextFst(*cfst_, phone2word_fst, ctx2word_fst);
     // ComposeContextFst is like Compose but faster for this particular Fst type.
     // [and doesn't expand too many arcs in the ContextFst.]
 
-    KALDI_ASSERT(ctx2word_fst.Start() != kNoStateId);
+    KALDI_ASSERT(ctx2word_fst->Start() != kNoStateId);
 
-    (*out_fsts)[i] = ctx2word_fst.Copy();  // For now this contains the FST with symbols
+    (*out_fsts)[i] = ctx2word_fst;  // For now this contains the FST with symbols
     // representing phones-in-context.
   }
 
-  HTransducerConfig h_cfg;
-  h_cfg.transition_scale = opts_.transition_scale;
-
-  std::vector<int32> disambig_syms_h;
-  VectorFst<StdArc> *H = GetHTransducer(cfst->ILabelInfo(),
-                                        ctx_dep_,
-                                        trans_model_,
-                                        h_cfg,
-                                        &disambig_syms_h);
-
-  for (size_t i = 0; i < out_fsts->size(); i++) {
-    VectorFst<StdArc> &ctx2word_fst = *((*out_fsts)[i]);
-    VectorFst<StdArc> trans2word_fst;
-    TableCompose(*H, ctx2word_fst, &trans2word_fst);
-
-    DeterminizeStarInLog(&trans2word_fst);
-
-    if (!disambig_syms_h.empty()) {
-      RemoveSomeInputSymbols(disambig_syms_h, &trans2word_fst);
-      if (opts_.rm_eps)
-        RemoveEpsLocal(&trans2word_fst);
+  UpdateH();
+
+  int32 num_threads = std::min<int32>(opts_.num_threads, out_fsts->size());
+  if (num_threads <= 1) {
+    for (size_t i = 0; i < out_fsts->size(); i++)
+      FinishGraph(NULL, (*out_fsts)[i]);
+  } else {
+    // The copy constructor from Fst (rather than from VectorFst) makes a deep
+    // copy.
+    std::vector<VectorFst<StdArc>*> h_fsts(num_threads);
+    for (int32 t = 0; t < num_threads; t++)
+      h_fsts[t] = new VectorFst<StdArc>(
+          static_cast<const Fst<StdArc>&>(*h_fst_));
+    {
+      CompileTask task(this, &h_fsts, out_fsts);
+      // The destructor of MultiThreader waits for the threads to finish.
+      MultiThreader<CompileTask> m(num_threads, task);
     }
-    
-    // Encoded minimization.
-    MinimizeEncoded(&trans2word_fst);
-
-    std::vector<int32> disambig;
-    AddSelfLoops(trans_model_,
-                 disambig,
-                 opts_.self_loop_scale,
-                 opts_.reorder,
-                 &trans2word_fst);
-
-    KALDI_ASSERT(trans2word_fst.Start() != kNoStateId);
-
-    *((*out_fsts)[i]) = trans2word_fst;
+    DeletePointers(&h_fsts);
   }
-
-  delete H;
-  delete cfst;
   return true;
 }
 
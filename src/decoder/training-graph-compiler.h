@@ -20,6 +20,7 @@
 #define KALDI_DECODER_TRAINING_GRAPH_COMPILER_H_
 
 #include "base/kaldi-common.h"
+#include "util/stl-utils.h"
 #include "hmm/transition-model.h"
 #include "fst/fstlib.h"
 #include "fstext/fstext-lib.h"
@@ -33,6 +34,8 @@ struct TrainingGraphCompilerOptions {
   BaseFloat self_loop_scale;
   bool rm_eps;
   bool reorder;  // (Dan-style graphs)
+  int32 num_threads;  // number of threads used by CompileGraphs().
+  int32 cache_size;  // max number of graphs cached by CompileGraph*FromText().
 
   explicit TrainingGraphCompilerOptions(BaseFloat transition_scale = 1.0,
                                         BaseFloat self_loop_scale = 1.0,
@@ -40,7 +43,9 @@ struct TrainingGraphCompilerOptions {
       transition_scale(transition_scale),
       self_loop_scale(self_loop_scale),
       rm_eps(false),
-      reorder(b) { }
+      reorder(b),
+      num_threads(1),
+      cache_size(0) { }
 
   void Register(OptionsItf *opts) {
     opts->Register("transition-scale", &transition_scale, "Scale of transition "
@@ -50,6 +55,13 @@ struct TrainingGraphCompilerOptions {
     opts->Register("reorder", &reorder, "Reorder transition ids for greater decoding efficiency.");
     opts->Register("rm-eps", &rm_eps,  "Remove [most] epsilons before minimization (only applicable "
                    "if disambig symbols present)");
+    opts->Register("num-threads", &num_threads, "Number of threads used to "
+                   "determinize and minimize the graphs when compiling graphs "
+                   "in batches");
+    opts->Register("graph-cache-size", &cache_size, "If >0, the maximum number "
+                   "of compiled graphs to keep in memory, keyed by the word "
+                   "sequence, so that repeated transcripts are compiled only "
+                   "once.");
   }
 };
 
@@ -74,12 +86,17 @@ class TrainingGraphCompiler {
                     fst::VectorFst<fst::StdArc> *out_fst);
   
   // CompileGraphs allows you to compile a number of graphs at the same
-  // time.  This consumes more memory but is faster.
+  // time.  This consumes more memory but is faster.  If opts.num_threads > 1,
+  // the determinization and minimization of the graphs (which is most of the
+  // work) is shared among that many threads.
   bool CompileGraphs(
       const std::vector<const fst::VectorFst<fst::StdArc> *> &word_fsts,
       std::vector<fst::VectorFst<fst::StdArc> *> *out_fsts);
 
   // This version creates an FST from the text and calls CompileGraph.
+  // If opts.cache_size > 0, the graphs are cached (keyed by the transcript),
+  // and a transcript seen before is not compiled again; this applies to
+  // CompileGraphsFromText() too.
   bool CompileGraphFromText(const std::vector<int32> &transcript,
                             fst::VectorFst<fst::StdArc> *out_fst);
 
@@ -89,8 +106,28 @@ class TrainingGraphCompiler {
       std::vector<fst::VectorFst<fst::StdArc> *> *out_fsts);
   
   
-  ~TrainingGraphCompiler() { delete lex_fst_; }
+  ~TrainingGraphCompiler();
  private:
+  class CompileTask;
+
+  // Makes sure that h_fst_ covers all the input symbols that cfst_ has
+  // created so far (they are created as the ContextFst is expanded).
+  void UpdateH();
+
+  // Turns the output of composing cfst_ with (L o G) into the final graph, in
+  // place: composes with h_fst_ (or with "h_fst", if non-NULL, which must be
+  // a copy of it), determinizes, minimizes and adds self-loops.  This is
+  // const, so it can be called from several threads at once.
+  void FinishGraph(const fst::VectorFst<fst::StdArc> *h_fst,
+                   fst::VectorFst<fst::StdArc> *fst) const;
+
+  // Returns the cached graph for this transcript, or NULL.
+  const fst::VectorFst<fst::StdArc> *LookupCache(
+      const std::vector<int32> &transcript) const;
+  // Adds a copy of "fst" to the cache, if there is space.
+  void AddToCache(const std::vector<int32> &transcript,
+                  const fst::VectorFst<fst::StdArc> &fst);
+
   const TransitionModel &trans_model_;
   const ContextDependency &ctx_dep_;
   fst::VectorFst<fst::StdArc> *lex_fst_; // lexicon FST (an input; we take
@@ -100,6 +137,19 @@ class TrainingGraphCompiler {
   fst::TableComposeCache<fst::Fst<fst::StdArc> > lex_cache_;  // stores matcher..
   // this is one of Dan's extensions.
 
+  // The context FST (expanded on the fly) and the H transducer are created
+  // once and shared by all graphs; h_fst_ is rebuilt by UpdateH() when cfst_
+  // has created new input symbols.  disambig_syms_h_ are the disambiguation
+  // symbols on the input side of h_fst_.
+  fst::ContextFst<fst::StdArc> *cfst_;
+  fst::VectorFst<fst::StdArc> *h_fst_;
+  size_t h_num_ilabels_;  // size of cfst_->ILabelInfo() when h_fst_ was built.
+  std::vector<int32> disambig_syms_h_;
+
+  typedef unordered_map<std::vector<int32>, fst::VectorFst<fst::StdArc>*,
+                        VectorHasher<int32> > GraphCache;
+  GraphCache graph_cache_;
+
   TrainingGraphCompilerOptions opts_;
 };
 
@@ -19,6 +19,8 @@
 
 
 #include "feat/feature-fbank.h"
+#include "base/kaldi-memory-stats.h"
+#include "base/kaldi-trace.h"
 
 
 namespace kaldi {
@@ -105,6 +107,8 @@ void Fbank::ComputeInternal(const VectorBase<BaseFloat> &wave,
                             const MelBanks &mel_banks,
                             Matrix<BaseFloat> *output,
                             Vector<BaseFloat> *wave_remainder) const {
+  KALDI_TRACE_SCOPE("Fbank::Compute");
+  MemoryTagScope memory_tag(kMemoryFeature);
   KALDI_ASSERT(output != NULL);
 
   // Get dimensions of output features
@@ -123,57 +127,49 @@ void Fbank::ComputeInternal(const VectorBase<BaseFloat> &wave,
   if (wave_remainder != NULL)
     ExtractWaveformRemainder(wave, opts_.frame_opts, wave_remainder);
 
-  // Buffers
-  Vector<BaseFloat> window;  // windowed waveform.
-  Vector<BaseFloat> mel_energies;
-  std::vector<BaseFloat> temp_buffer;  // used by srfft.
-  BaseFloat log_energy;
-
-  // Compute all the freames, r is frame index..
-  for (int32 r = 0; r < rows_out; r++) {
-    // Cut the window, apply window function
-    ExtractWindow(wave, r, opts_.frame_opts, feature_window_function_, &window,
-                  (opts_.use_energy && opts_.raw_energy ? &log_energy : NULL));
-
-    // Compute energy after window function (not the raw one)
-    if (opts_.use_energy && !opts_.raw_energy)
-      log_energy = Log(std::max(VecVec(window, window),
-                                std::numeric_limits<BaseFloat>::min()));
-
-    if (srfft_ != NULL)  // Compute FFT using split-radix algorithm.
-      srfft_->Compute(window.Data(), true, &temp_buffer);
-    else  // An alternative algorithm that works for non-powers-of-two.
-      RealFft(&window, true);
-
-    // Convert the FFT into a power spectrum.
-    ComputePowerSpectrum(&window);
-    SubVector<BaseFloat> power_spectrum(window, 0, window.Dim()/2 + 1);
-
-    // Sum with MelFiterbank over power spectrum
-    mel_banks.Compute(power_spectrum, &mel_energies);
+  // FFTs of the windowed frames, done in batches of up to kFeatureBlockFrames
+  // frames so that memory use does not grow with the length of the utterance.
+  Matrix<BaseFloat> ffts;
+  Vector<BaseFloat> log_energies;
+
+  for (int32 start = 0; start < rows_out; start += kFeatureBlockFrames) {
+    int32 num_frames = std::min(kFeatureBlockFrames, rows_out - start);
+    // Cut the windows, apply the window function and compute the FFTs; the
+    // energy is computed after the window function unless opts_.raw_energy.
+    ExtractWindowsFft(wave, opts_.frame_opts, feature_window_function_, srfft_,
+                      opts_.raw_energy, start, num_frames, &ffts,
+                      (opts_.use_energy ? &log_energies : NULL));
+
+    // From here on, each step is done for all the frames of the block at
+    // once.  Convert the FFTs into power spectra.
+    ComputePowerSpectrum(&ffts);
+    SubMatrix<BaseFloat> power_spectra(ffts, 0, num_frames,
+                                       0, ffts.NumCols() / 2 + 1);
+
+    // Sum with MelFiterbank over power spectrum, directly into the output.
+    SubMatrix<BaseFloat> fbank(*output, start, num_frames,
+                               (opts_.use_energy ? 1 : 0),
+                               opts_.mel_opts.num_bins);
+    mel_banks.Compute(power_spectra, &fbank);
     if (opts_.use_log_fbank) {
       // avoid log of zero (which should be prevented anyway by dithering).
-      mel_energies.ApplyFloor(std::numeric_limits<BaseFloat>::min());
-      mel_energies.ApplyLog();  // take the log.
+      fbank.ApplyFloor(std::numeric_limits<BaseFloat>::min());
+      fbank.ApplyLog();  // take the log.
     }
 
-    // Output buffers
-    SubVector<BaseFloat> this_output(output->Row(r));
-    SubVector<BaseFloat> this_fbank(this_output.Range((opts_.use_energy? 1 : 0),
-                                                      opts_.mel_opts.num_bins));
-
-    // Copy to output
-    this_fbank.CopyFromVec(mel_energies);
     // Copy energy as first value
     if (opts_.use_energy) {
-      if (opts_.energy_floor > 0.0 && log_energy < log_energy_floor_) {
-        log_energy = log_energy_floor_;
-      }
-      this_output(0) = log_energy;
+      if (opts_.energy_floor > 0.0)
+        log_energies.ApplyFloor(log_energy_floor_);
+      SubMatrix<BaseFloat> this_output(output->RowRange(start, num_frames));
+      this_output.CopyColFromVec(log_energies, 0);
     }
+  }
 
-    // HTK compat: Shift features, so energy is last value
-    if (opts_.htk_compat && opts_.use_energy) {
+  // HTK compat: Shift features, so energy is last value
+  if (opts_.htk_compat && opts_.use_energy) {
+    for (int32 r = 0; r < rows_out; r++) {
+      SubVector<BaseFloat> this_output(output->Row(r));
       BaseFloat energy = this_output(0);
       for (int32 i = 0; i < opts_.mel_opts.num_bins; i++) {
         this_output(i) = this_output(i+1);
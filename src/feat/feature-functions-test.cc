@@ -19,6 +19,7 @@
 
 
 #include <iostream>
+#include <sstream>
 
 #include "feat/feature-mfcc.h"
 #include "base/kaldi-math.h"
@@ -93,6 +94,98 @@ void UnitTestOnlineCmvn() {
 }
 
 
+void UnitTestWaveStreamReader() {
+  for (int32 i = 0; i < 20; i++) {
+    int32 num_chan = 1 + Rand() % 3, num_samp = 1 + Rand() % 5000;
+    Matrix<BaseFloat> data(num_chan, num_samp);
+    for (int32 c = 0; c < num_chan; c++)
+      for (int32 s = 0; s < num_samp; s++)
+        data(c, s) = RandInt(-32768, 32767);
+    WaveData wave(16000.0, data);
+    std::ostringstream os;
+    wave.Write(os);
+    std::string str = os.str();
+    bool truncate = (Rand() % 3 == 0);
+    int32 num_samp_read = num_samp;
+    if (truncate) {  // cut off some of the samples (and part of one).
+      num_samp_read = Rand() % num_samp;
+      str.resize(44 + 2 * num_chan * num_samp_read + Rand() % 2);
+    }
+
+    // WaveData::Read() reads the whole thing.
+    WaveData wave2;
+    {
+      std::istringstream is(str);
+      if (truncate && num_samp_read == 0) {
+        bool threw = false;
+        try {
+          wave2.Read(is);
+        } catch (const std::exception &e) {
+          threw = true;
+        }
+        KALDI_ASSERT(threw);
+        continue;
+      }
+      wave2.Read(is);
+    }
+    KALDI_ASSERT(wave2.SampFreq() == 16000.0 &&
+                 wave2.Data().NumCols() == num_samp_read);
+    SubMatrix<BaseFloat> expected(data, 0, num_chan, 0, num_samp_read);
+    AssertEqual(wave2.Data(), expected);
+
+    // WaveStreamReader reads it in pieces of random sizes.
+    std::istringstream is(str);
+    WaveStreamReader reader(is);
+    KALDI_ASSERT(reader.NumChannels() == num_chan &&
+                 reader.NumSamplesInHeader() == num_samp);
+    int32 offset = 0;
+    while (!reader.Done()) {
+      Matrix<BaseFloat> block(num_chan, 1 + Rand() % 1000);
+      int32 n = reader.Read(&block);
+      KALDI_ASSERT(n <= block.NumCols() && offset + n <= num_samp_read);
+      AssertEqual(block.ColRange(0, n), expected.ColRange(offset, n));
+      offset += n;
+    }
+    KALDI_ASSERT(offset == num_samp_read);
+  }
+}
+
+void UnitTestExtractWindowsFft() {
+  for (int32 i = 0; i < 10; i++) {
+    FrameExtractionOptions opts;
+    opts.dither = 0.0;
+    opts.snip_edges = (Rand() % 2 == 0);
+    opts.round_to_power_of_two = (Rand() % 2 == 0);
+    Vector<BaseFloat> wave(400 + Rand() % 20000);
+    wave.SetRandn();
+    FeatureWindowFunction window_function(opts);
+    int32 padded_size = opts.PaddedWindowSize();
+    SplitRadixRealFft<BaseFloat> *srfft = NULL;
+    if ((padded_size & (padded_size - 1)) == 0)
+      srfft = new SplitRadixRealFft<BaseFloat>(padded_size);
+    bool raw_energy = (Rand() % 2 == 0);
+    Matrix<BaseFloat> ffts;
+    Vector<BaseFloat> log_energies;
+    ExtractWindowsFft(wave, opts, window_function, srfft, raw_energy,
+                      &ffts, &log_energies);
+    int32 num_frames = NumFrames(wave.Dim(), opts);
+    KALDI_ASSERT(ffts.NumRows() == num_frames);
+    // Doing the frames a block at a time gives the same result.
+    int32 block_size = 1 + Rand() % 50;
+    for (int32 start = 0; start < num_frames; start += block_size) {
+      int32 n = std::min(block_size, num_frames - start);
+      Matrix<BaseFloat> block_ffts;
+      Vector<BaseFloat> block_log_energies;
+      ExtractWindowsFft(wave, opts, window_function, srfft, raw_energy,
+                        start, n, &block_ffts, &block_log_energies);
+      AssertEqual(block_ffts, ffts.RowRange(start, n));
+      SubVector<BaseFloat> log_energies_part(log_energies, start, n);
+      AssertEqual(block_log_energies, log_energies_part);
+    }
+    delete srfft;
+  }
+}
+
 }
 
 
@@ -101,6 +194,8 @@ int main() {
   using namespace kaldi;
   try {
     UnitTestOnlineCmvn();
+    UnitTestWaveStreamReader();
+    UnitTestExtractWindowsFft();
     std::cout << "Tests succeeded.\n";
     return 0;
   } catch (const std::exception &e) {
@@ -166,6 +166,57 @@ void ExtractWindow(const VectorBase<BaseFloat> &wave,
                          frame_length_padded-frame_length).SetZero();
 }
 
+void ExtractWindowsFft(const VectorBase<BaseFloat> &wave,
+                       const FrameExtractionOptions &opts,
+                       const FeatureWindowFunction &window_function,
+                       const SplitRadixRealFft<BaseFloat> *srfft,
+                       bool raw_energy,
+                       Matrix<BaseFloat> *fft,
+                       Vector<BaseFloat> *log_energy) {
+  ExtractWindowsFft(wave, opts, window_function, srfft, raw_energy,
+                    0, NumFrames(wave.Dim(), opts), fft, log_energy);
+}
+
+void ExtractWindowsFft(const VectorBase<BaseFloat> &wave,
+                       const FrameExtractionOptions &opts,
+                       const FeatureWindowFunction &window_function,
+                       const SplitRadixRealFft<BaseFloat> *srfft,
+                       bool raw_energy,
+                       int32 first_frame,
+                       int32 num_frames,
+                       Matrix<BaseFloat> *fft,
+                       Vector<BaseFloat> *log_energy) {
+  KALDI_ASSERT(fft != NULL && first_frame >= 0 && num_frames >= 0 &&
+               first_frame + num_frames <= NumFrames(wave.Dim(), opts));
+  if (log_energy != NULL)
+    log_energy->Resize(num_frames, kUndefined);
+  if (num_frames == 0) {
+    fft->Resize(0, 0);
+    return;
+  }
+  fft->Resize(num_frames, opts.PaddedWindowSize(), kUndefined);
+  Vector<BaseFloat> window;  // windowed waveform.
+  for (int32 r = 0; r < num_frames; r++) {
+    BaseFloat raw_log_energy;
+    ExtractWindow(wave, first_frame + r, opts, window_function, &window,
+                  (log_energy != NULL && raw_energy ? &raw_log_energy : NULL));
+    if (log_energy != NULL)
+      (*log_energy)(r) = (raw_energy ? raw_log_energy :
+                          Log(std::max(VecVec(window, window),
+                                       std::numeric_limits<BaseFloat>::min())));
+    fft->Row(r).CopyFromVec(window);
+  }
+  if (srfft != NULL) {  // Compute the FFTs using the split-radix algorithm.
+    std::vector<BaseFloat> temp_buffer;
+    srfft->Compute(fft, true, &temp_buffer);
+  } else {  // An alternative algorithm that works for non-powers-of-two.
+    for (int32 r = 0; r < num_frames; r++) {
+      SubVector<BaseFloat> row(*fft, r);
+      RealFft(&row, true);
+    }
+  }
+}
+
 void ExtractWaveformRemainder(const VectorBase<BaseFloat> &wave,
                               const FrameExtractionOptions &opts,
                               Vector<BaseFloat> *wave_remainder) {
@@ -206,6 +257,21 @@ void ComputePowerSpectrum(VectorBase<BaseFloat> *waveform) {
   // if the signal has been bandlimited sensibly this should be zero.
 }
 
+void ComputePowerSpectrum(MatrixBase<BaseFloat> *complex_ffts) {
+  int32 num_rows = complex_ffts->NumRows(), half_dim = complex_ffts->NumCols() / 2;
+  for (int32 r = 0; r < num_rows; r++) {
+    BaseFloat *data = complex_ffts->RowData(r);
+    BaseFloat first_energy = data[0] * data[0],
+        last_energy = data[1] * data[1];
+    for (int32 i = 1; i < half_dim; i++) {
+      BaseFloat real = data[i * 2], im = data[i * 2 + 1];
+      data[i] = real * real + im * im;
+    }
+    data[0] = first_energy;
+    data[half_dim] = last_energy;
+  }
+}
+
 
 DeltaFeatures::DeltaFeatures(const DeltaFeaturesOptions &opts): opts_(opts) {
   KALDI_ASSERT(opts.order >= 0 && opts.order < 1000);  // just make sure we don't get binary junk.
@@ -439,8 +505,11 @@ void SlidingWindowCmnInternal(const SlidingWindowCmnOptions &opts,
   opts.Check();
   int32 num_frames = input.NumRows(), dim = input.NumCols();
 
+  // The window moves by at most one frame at each end per frame, so we keep
+  // running sums over it, which makes the cost per frame independent of the
+  // window length.
   int32 last_window_start = -1, last_window_end = -1;
-  Vector<double> cur_sum(dim), cur_sumsq(dim);
+  Vector<double> cur_sum(dim), cur_sumsq(dim), variance(dim);
 
   for (int32 t = 0; t < num_frames; t++) {
     int32 window_start, window_end; // note: window_end will be one
@@ -502,7 +571,7 @@ void SlidingWindowCmnInternal(const SlidingWindowCmnOptions &opts,
       if (window_frames == 1) {
         output_frame.Set(0.0);
       } else {
-        Vector<double> variance(cur_sumsq);
+        variance.CopyFromVec(cur_sumsq);
         variance.Scale(1.0 / window_frames);
         variance.AddVec2(-1.0 / (window_frames * window_frames), cur_sum);
         // now "variance" is the variance of the features in the window,
@@ -153,6 +153,43 @@ void ExtractWindow(const VectorBase<BaseFloat> &wave,
                    Vector<BaseFloat> *window,
                    BaseFloat *log_energy_pre_window = NULL);
 
+// ExtractWindowsFft extracts all NumFrames(wave.Dim(), opts) frames of
+// waveform, as ExtractWindow() does for each one, and puts their FFTs (in the
+// format of RealFft()) in the rows of "fft".  If "srfft" is non-NULL (it
+// must be a SplitRadixRealFft of dimension opts.PaddedWindowSize()), all the
+// frames are transformed in one batched call to it, which is much faster than
+// transforming them one by one; otherwise (e.g. for padded window sizes that
+// are not powers of two), RealFft() is used on each frame.  If log_energy !=
+// NULL, it outputs the log-energy of each frame: of the raw waveform (as
+// ExtractWindow()'s log_energy_pre_window) if raw_energy == true, and of the
+// windowed waveform otherwise.
+void ExtractWindowsFft(const VectorBase<BaseFloat> &wave,
+                       const FrameExtractionOptions &opts,
+                       const FeatureWindowFunction &window_function,
+                       const SplitRadixRealFft<BaseFloat> *srfft,
+                       bool raw_energy,
+                       Matrix<BaseFloat> *fft,
+                       Vector<BaseFloat> *log_energy = NULL);
+
+// This version of ExtractWindowsFft() only does the frames first_frame <= r <
+// first_frame + num_frames, putting frame "r" in row r - first_frame of "fft"
+// (and element r - first_frame of "log_energy").  It lets the feature
+// computations work through long waveforms a block of frames at a time, so
+// that the matrix of FFTs does not have to hold the whole utterance.
+void ExtractWindowsFft(const VectorBase<BaseFloat> &wave,
+                       const FrameExtractionOptions &opts,
+                       const FeatureWindowFunction &window_function,
+                       const SplitRadixRealFft<BaseFloat> *srfft,
+                       bool raw_energy,
+                       int32 first_frame,
+                       int32 num_frames,
+                       Matrix<BaseFloat> *fft,
+                       Vector<BaseFloat> *log_energy);
+
+// The feature computations (Mfcc, Fbank, Plp and Spectrogram) call
+// ExtractWindowsFft() for at most this many frames at a time.
+const int32 kFeatureBlockFrames = 1024;
+
 // ExtractWaveformRemainder is useful if the waveform is coming in segments.
 // It extracts the bit of the waveform at the end of this block that you
 // would have to append the next bit of waveform to, if you wanted to have
@@ -172,6 +209,11 @@ void ExtractWaveformRemainder(const VectorBase<BaseFloat> &wave,
 // remaining (n/2) - 1 elements are undefined at output.
 void ComputePowerSpectrum(VectorBase<BaseFloat> *complex_fft);
 
+// This version of ComputePowerSpectrum() does the same thing for each row of
+// "complex_ffts", e.g. the output of ExtractWindowsFft(); afterwards the first
+// (n/2) + 1 columns contain the power spectra.
+void ComputePowerSpectrum(MatrixBase<BaseFloat> *complex_ffts);
+
 
 
 inline void MaxNormalizeEnergy(Matrix<BaseFloat> *feats) {
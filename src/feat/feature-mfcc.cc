@@ -19,6 +19,8 @@
 
 
 #include "feat/feature-mfcc.h"
+#include "base/kaldi-memory-stats.h"
+#include "base/kaldi-trace.h"
 
 
 namespace kaldi {
@@ -117,6 +119,8 @@ void Mfcc::ComputeInternal(const VectorBase<BaseFloat> &wave,
                            const MelBanks &mel_banks,
                            Matrix<BaseFloat> *output,
                            Vector<BaseFloat> *wave_remainder) const {
+  KALDI_TRACE_SCOPE("Mfcc::Compute");
+  MemoryTagScope memory_tag(kMemoryFeature);
   KALDI_ASSERT(output != NULL);
   int32 rows_out = NumFrames(wave.Dim(), opts_.frame_opts),
       cols_out = opts_.num_ceps;
@@ -129,51 +133,47 @@ void Mfcc::ComputeInternal(const VectorBase<BaseFloat> &wave,
   output->Resize(rows_out, cols_out);
   if (wave_remainder != NULL)
     ExtractWaveformRemainder(wave, opts_.frame_opts, wave_remainder);
-  Vector<BaseFloat> window;  // windowed waveform.
-  Vector<BaseFloat> mel_energies;
-  std::vector<BaseFloat> temp_buffer;  // used by srfft.
-  for (int32 r = 0; r < rows_out; r++) {  // r is frame index..
-    BaseFloat log_energy;
-
-    // If opts_.raw_energy and opts_.use_energy are both true, then
-    // log_energy is computed before windowing and stored in log_energy
-    ExtractWindow(wave, r, opts_.frame_opts, feature_window_function_, &window,
-                  (opts_.use_energy && opts_.raw_energy ? &log_energy : NULL));
-
-    if (opts_.use_energy && !opts_.raw_energy)
-      log_energy = Log(std::max(VecVec(window, window),
-                                std::numeric_limits<BaseFloat>::min()));
-
-    if (srfft_ != NULL)  // Compute FFT using the split-radix algorithm.
-      srfft_->Compute(window.Data(), true, &temp_buffer);
-    else  // An alternative algorithm that works for non-powers-of-two.
-      RealFft(&window, true);
-
-    // Convert the FFT into a power spectrum.
-    ComputePowerSpectrum(&window);
-    SubVector<BaseFloat> power_spectrum(window, 0, window.Dim()/2 + 1);
-
-    mel_banks.Compute(power_spectrum, &mel_energies);
+  // The FFTs of the windowed frames, done in batches of up to
+  // kFeatureBlockFrames frames so that memory use does not grow with the
+  // length of the utterance.  If opts_.raw_energy is true, the log-energies
+  // are computed before windowing.
+  Matrix<BaseFloat> ffts, mel_energies;
+  Vector<BaseFloat> log_energies;
+  for (int32 start = 0; start < rows_out; start += kFeatureBlockFrames) {
+    int32 num_frames = std::min(kFeatureBlockFrames, rows_out - start);
+    ExtractWindowsFft(wave, opts_.frame_opts, feature_window_function_, srfft_,
+                      opts_.raw_energy, start, num_frames, &ffts,
+                      (opts_.use_energy ? &log_energies : NULL));
+    // From here on, each step is done for all the frames of the block at
+    // once.  Convert the FFTs into power spectra.
+    ComputePowerSpectrum(&ffts);
+    SubMatrix<BaseFloat> power_spectra(ffts, 0, num_frames,
+                                       0, ffts.NumCols() / 2 + 1);
+    mel_energies.Resize(num_frames, mel_banks.NumBins(), kUndefined);
+    mel_banks.Compute(power_spectra, &mel_energies);
 
     // avoid log of zero (which should be prevented anyway by dithering).
     mel_energies.ApplyFloor(std::numeric_limits<BaseFloat>::min());
     mel_energies.ApplyLog();  // take the log.
 
-    SubVector<BaseFloat> this_mfcc(output->Row(r));
-
-    // this_mfcc = dct_matrix_ * mel_energies [which now have log]
-    this_mfcc.AddMatVec(1.0, dct_matrix_, kNoTrans, mel_energies, 0.0);
+    // this_output = mel_energies [which now have log] * dct_matrix_^T
+    SubMatrix<BaseFloat> this_output(output->RowRange(start, num_frames));
+    this_output.AddMatMat(1.0, mel_energies, kNoTrans, dct_matrix_, kTrans,
+                          0.0);
 
     if (opts_.cepstral_lifter != 0.0)
-      this_mfcc.MulElements(lifter_coeffs_);
+      this_output.MulColsVec(lifter_coeffs_);
 
     if (opts_.use_energy) {
-      if (opts_.energy_floor > 0.0 && log_energy < log_energy_floor_)
-        log_energy = log_energy_floor_;
-      this_mfcc(0) = log_energy;
+      if (opts_.energy_floor > 0.0)
+        log_energies.ApplyFloor(log_energy_floor_);
+      this_output.CopyColFromVec(log_energies, 0);
     }
+  }
 
-    if (opts_.htk_compat) {
+  if (opts_.htk_compat) {
+    for (int32 r = 0; r < rows_out; r++) {
+      SubVector<BaseFloat> this_mfcc(output->Row(r));
       BaseFloat energy = this_mfcc(0);
       for (int32 i = 0; i < opts_.num_ceps-1; i++)
         this_mfcc(i) = this_mfcc(i+1);
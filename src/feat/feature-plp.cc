@@ -19,6 +19,8 @@
 
 
 #include "feat/feature-plp.h"
+#include "base/kaldi-memory-stats.h"
+#include "base/kaldi-trace.h"
 #include "util/parse-options.h"
 
 
@@ -44,6 +46,7 @@ Plp::Plp(const PlpOptions &opts)
   // [note: this call caches it.]  The reason we call this here is to
   // improve the efficiency of the "const" version of Compute().
   GetMelBanks(1.0);
+  GetEqualLoudness(1.0);  // likewise.
 }
 
 Plp::~Plp() {
@@ -162,6 +165,8 @@ void Plp::ComputeInternal(const VectorBase<BaseFloat> &wave,
                           const Vector<BaseFloat> &equal_loudness,
                           Matrix<BaseFloat> *output,
                           Vector<BaseFloat> *wave_remainder) const {
+  KALDI_TRACE_SCOPE("Plp::Compute");
+  MemoryTagScope memory_tag(kMemoryFeature);
   KALDI_ASSERT(output != NULL);
   int32 rows_out = NumFrames(wave.Dim(), opts_.frame_opts),
       cols_out = opts_.num_ceps;
@@ -174,7 +179,6 @@ void Plp::ComputeInternal(const VectorBase<BaseFloat> &wave,
   output->Resize(rows_out, cols_out);
   if (wave_remainder != NULL)
     ExtractWaveformRemainder(wave, opts_.frame_opts, wave_remainder);
-  Vector<BaseFloat> window;  // windowed waveform.
   int32 num_mel_bins = opts_.mel_opts.num_bins;
   Vector<BaseFloat> mel_energies(num_mel_bins);
   Vector<BaseFloat> mel_energies_duplicated(num_mel_bins+2);
@@ -183,23 +187,21 @@ void Plp::ComputeInternal(const VectorBase<BaseFloat> &wave,
   Vector<BaseFloat> raw_cepstrum(opts_.lpc_order);  // not including C0,
   // and size may differ from final size.
   Vector<BaseFloat> final_cepstrum(opts_.num_ceps);
-  std::vector<BaseFloat> temp_buffer;  // used by srfft.
+  // FFTs of the windowed frames, done in batches of up to kFeatureBlockFrames
+  // frames so that memory use does not grow with the length of the utterance.
+  Matrix<BaseFloat> ffts;
+  Vector<BaseFloat> log_energies;
   
   KALDI_ASSERT(opts_.num_ceps <= opts_.lpc_order+1);  // our num-ceps includes C0.
   for (int32 r = 0; r < rows_out; r++) {  // r is frame index..
-    BaseFloat log_energy;
-    ExtractWindow(wave, r, opts_.frame_opts,
-                  feature_window_function_, &window,
-                  (opts_.use_energy && opts_.raw_energy ? &log_energy : NULL));
-
-    if (opts_.use_energy && !opts_.raw_energy)
-      log_energy = Log(std::max(VecVec(window, window),
-                                std::numeric_limits<BaseFloat>::min()));
-
-    if (srfft_ != NULL)  // Compute FFT using split-radix algorithm.
-      srfft_->Compute(window.Data(), true, &temp_buffer);
-    else  // An alternative algorithm that works for non-powers-of-two.
-      RealFft(&window, true);
+    int32 block_r = r % kFeatureBlockFrames;  // index within the block.
+    if (block_r == 0)
+      ExtractWindowsFft(wave, opts_.frame_opts, feature_window_function_,
+                        srfft_, opts_.raw_energy, r,
+                        std::min(kFeatureBlockFrames, rows_out - r), &ffts,
+                        (opts_.use_energy ? &log_energies : NULL));
+    BaseFloat log_energy = (opts_.use_energy ? log_energies(block_r) : 0.0);
+    SubVector<BaseFloat> window(ffts, block_r);
 
     // Convert the FFT into a power spectrum.
     ComputePowerSpectrum(&window);  // elements 0 ... window.Dim()/2
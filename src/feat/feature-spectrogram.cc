@@ -20,6 +20,8 @@
 
 
 #include "feat/feature-spectrogram.h"
+#include "base/kaldi-memory-stats.h"
+#include "base/kaldi-trace.h"
 
 
 namespace kaldi {
@@ -41,6 +43,8 @@ Spectrogram::~Spectrogram() {
 void Spectrogram::Compute(const VectorBase<BaseFloat> &wave,
                           Matrix<BaseFloat> *output,
                           Vector<BaseFloat> *wave_remainder) {
+  KALDI_TRACE_SCOPE("Spectrogram::Compute");
+  MemoryTagScope memory_tag(kMemoryFeature);
   KALDI_ASSERT(output != NULL);
 
   // Get dimensions of output features
@@ -55,25 +59,22 @@ void Spectrogram::Compute(const VectorBase<BaseFloat> &wave,
   if (wave_remainder != NULL)
     ExtractWaveformRemainder(wave, opts_.frame_opts, wave_remainder);
 
-  // Buffers
-  Vector<BaseFloat> window;  // windowed waveform.
-  BaseFloat log_energy;
+  // Cut the windows, apply the window function and compute the FFTs of the
+  // frames in batches of up to kFeatureBlockFrames; the energy is computed
+  // after the window function unless opts_.raw_energy.
+  Matrix<BaseFloat> ffts;
+  Vector<BaseFloat> log_energies;
 
   // Compute all the freames, r is frame index..
   for (int32 r = 0; r < rows_out; r++) {
-    // Cut the window, apply window function
-    ExtractWindow(wave, r, opts_.frame_opts, feature_window_function_,
-                  &window, (opts_.raw_energy ? &log_energy : NULL));
-
-    // Compute energy after window function (not the raw one)
-    if (!opts_.raw_energy)
-      log_energy = Log(std::max(VecVec(window, window),
-                                std::numeric_limits<BaseFloat>::min()));
-    
-    if (srfft_ != NULL)  // Compute FFT using split-radix algorithm.
-      srfft_->Compute(window.Data(), true);
-    else  // An alternative algorithm that works for non-powers-of-two
-      RealFft(&window, true);
+    int32 block_r = r % kFeatureBlockFrames;  // index within the block.
+    if (block_r == 0)
+      ExtractWindowsFft(wave, opts_.frame_opts, feature_window_function_,
+                        srfft_, opts_.raw_energy, r,
+                        std::min(kFeatureBlockFrames, rows_out - r), &ffts,
+                        &log_energies);
+    BaseFloat log_energy = log_energies(block_r);
+    SubVector<BaseFloat> window(ffts, block_r);
 
     // Convert the FFT into a power spectrum.
     ComputePowerSpectrum(&window);
@@ -245,6 +245,40 @@ void MelBanks::Compute(const VectorBase<BaseFloat> &power_spectrum,
   }
 }
 
+void MelBanks::Compute(const MatrixBase<BaseFloat> &power_spectra,
+                       MatrixBase<BaseFloat> *mel_energies_out) const {
+  int32 num_bins = bins_.size(), num_frames = power_spectra.NumRows();
+  KALDI_ASSERT(mel_energies_out->NumRows() == num_frames &&
+               mel_energies_out->NumCols() == num_bins);
+  if (num_frames == 0) return;
+  // Each bin only covers a few FFT bins, so we don't do this as a product
+  // with a (mostly zero) matrix of weights; going frame by frame also keeps
+  // each frame's power spectrum in the cache while we go through the bins.
+  for (int32 r = 0; r < num_frames; r++) {
+    SubVector<BaseFloat> power_spectrum(power_spectra, r);
+    BaseFloat *mel_energies = mel_energies_out->RowData(r);
+    for (int32 i = 0; i < num_bins; i++) {
+      const Vector<BaseFloat> &v(bins_[i].second);
+      mel_energies[i] = VecVec(v, power_spectrum.Range(bins_[i].first,
+                                                       v.Dim()));
+    }
+  }
+  // HTK-like flooring- for testing purposes (we prefer dither)
+  if (htk_mode_) mel_energies_out->ApplyFloor(1.0);
+
+  // See the comment in the version above.
+  KALDI_ASSERT(!KALDI_ISNAN(mel_energies_out->Sum()));
+
+  if (debug_) {
+    fprintf(stderr, "MEL BANKS:\n");
+    for (int32 r = 0; r < num_frames; r++) {
+      for (int32 i = 0; i < num_bins; i++)
+        fprintf(stderr, " %f", (*mel_energies_out)(r, i));
+      fprintf(stderr, "\n");
+    }
+  }
+}
+
 void ComputeLifterCoeffs(BaseFloat Q, VectorBase<BaseFloat> *coeffs) {
   // Compute liftering coefficients (scaling on cepstral coeffs)
   // coeffs are numbered slightly differently from HTK: the zeroth
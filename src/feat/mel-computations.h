@@ -76,11 +76,24 @@ class MelBanks {
   void Compute(const VectorBase<BaseFloat> &fft_energies,
                Vector<BaseFloat> *mel_energies_out) const;
 
+  /// This version does the same for each row of "fft_energies" (e.g. all the
+  /// frames of an utterance), putting the result in the corresponding row of
+  /// "mel_energies_out", which must have NumBins() columns.
+  void Compute(const MatrixBase<BaseFloat> &fft_energies,
+               MatrixBase<BaseFloat> *mel_energies_out) const;
+
   int32 NumBins() const { return bins_.size(); }
 
   // returns vector of central freq of each bin; needed by plp code.
   const Vector<BaseFloat> &GetCenterFreqs() const { return center_freqs_; }
 
+  // returns the weights of each bin, as pairs of (the first nonzero fft-bin),
+  // (the vector of weights); needed by the GPU feature extraction, which
+  // does the mel computation as a matrix product.
+  const std::vector<std::pair<int32, Vector<BaseFloat> > > &GetBins() const {
+    return bins_;
+  }
+
  private:
   // center frequencies of bins, numbered from 0 ... num_bins-1.
   // Needed by GetCenterFreqs().
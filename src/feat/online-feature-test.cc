@@ -105,6 +105,38 @@ void TestOnlineMatrixCacheFeature() {
   AssertEqual(input_feats, output_feats);
 }
 
+// test OnlineCacheFeature with a limited number of cached frames, and with
+// frames being released.
+void TestOnlineCacheFeatureEviction() {
+  int32 dim = 2 + rand() % 5;  // dimension of features.
+  int32 num_frames = 100 + rand() % 100;
+
+  Matrix<BaseFloat> input_feats(num_frames, dim);
+  input_feats.SetRandn();
+
+  OnlineMatrixFeature matrix_feats(input_feats);
+  OnlineCacheFeature cache(&matrix_feats, rand() % 2 == 0 ? 0 : 1 + rand() % 20);
+  Vector<BaseFloat> feat(dim);
+  for (int32 t = 0; t < num_frames; t++) {
+    // look at this frame and a few recent and earlier ones, in batches and
+    // one by one.
+    std::vector<int32> frames;
+    for (int32 i = 0; i < 5; i++) {
+      int32 t2 = std::max(0, t - rand() % (rand() % 2 == 0 ? 5 : 50));
+      frames.push_back(t2);
+      cache.GetFrame(t2, &feat);
+      KALDI_ASSERT(feat.ApproxEqual(input_feats.Row(t2)));
+    }
+    frames.push_back(t);
+    Matrix<BaseFloat> feats(frames.size(), dim);
+    cache.GetFrames(frames, &feats);
+    for (size_t i = 0; i < frames.size(); i++)
+      KALDI_ASSERT(feats.Row(i).ApproxEqual(input_feats.Row(frames[i])));
+    if (rand() % 10 == 0)
+      cache.ReleaseFramesBefore(t - rand() % 10);
+  }
+}
+
 void TestOnlineDeltaFeature() {
   int32 dim = 2 + rand() % 5;  // dimension of features.
   int32 num_frames = 100 + rand() % 100;
@@ -384,18 +416,140 @@ void TestOnlineAppendFeature() {
   }
 }
 
+void TestOnlineCmvn() {
+  int32 dim = 2 + rand() % 5;  // dimension of features.
+  int32 num_frames = 100 + rand() % 500;
+  Matrix<BaseFloat> input_feats(num_frames, dim);
+  input_feats.SetRandn();
+  input_feats.Add(1.0);
+
+  Matrix<double> global_stats(2, dim + 1);
+  global_stats.Row(0).Range(0, dim).AddRowSumMat(1.0, Matrix<double>(input_feats));
+  global_stats.Row(1).Range(0, dim).AddDiagMat2(1.0, Matrix<double>(input_feats), kTrans);
+  global_stats(0, dim) = num_frames;
+  OnlineCmvnOptions cmvn_opts;
+  cmvn_opts.normalize_variance = (rand() % 2 == 0);
+  cmvn_opts.cmn_window = 1 + rand() % 200;
+  cmvn_opts.global_frames = rand() % 50;
+  OnlineCmvnState cmvn_state(global_stats);
+
+  // Frames requested in order use the running stats; frames requested in
+  // reverse order (after the last one) start from the cached stats.
+  // Both must give the same result.
+  OnlineMatrixFeature matrix_feats(input_feats);
+  OnlineCmvn cmvn1(cmvn_opts, cmvn_state, &matrix_feats),
+      cmvn2(cmvn_opts, cmvn_state, &matrix_feats);
+  Matrix<BaseFloat> output1(num_frames, dim), output2(num_frames, dim);
+  for (int32 t = 0; t < num_frames; t++) {
+    SubVector<BaseFloat> row(output1, t);
+    cmvn1.GetFrame(t, &row);
+  }
+  for (int32 t = num_frames - 1; t >= 0; t--) {
+    SubVector<BaseFloat> row(output2, t);
+    cmvn2.GetFrame(t, &row);
+  }
+  AssertEqual(output1, output2, 1.0e-03);
+
+  // Without smoothing or variance normalization, each output frame should be
+  // the input minus the mean of the input over the last cmn_window frames.
+  cmvn_opts.global_frames = 0;
+  cmvn_opts.normalize_variance = false;
+  OnlineCmvn cmvn3(cmvn_opts, cmvn_state, &matrix_feats);
+  for (int32 t = 0; t < num_frames; t++) {
+    Vector<BaseFloat> output(dim);
+    cmvn3.GetFrame(t, &output);
+    int32 window_start = std::max(0, t + 1 - cmvn_opts.cmn_window);
+    Vector<BaseFloat> expected(input_feats.Row(t));
+    SubMatrix<BaseFloat> window(input_feats, window_start,
+                                t + 1 - window_start, 0, dim);
+    expected.AddRowSumMat(-1.0 / window.NumRows(), window);
+    AssertEqual(output, expected, 1.0e-03);
+  }
+}
+
+
+// Checks that GetFrames() gives the same as GetFrame() for a stack of online
+// feature classes.
+void TestOnlineGetFrames() {
+  int32 dim = 2 + rand() % 5;  // dimension of features.
+  int32 num_frames = 100 + rand() % 100;
+  Matrix<BaseFloat> input_feats(num_frames, dim), input_feats2(num_frames, 2);
+  input_feats.SetRandn();
+  input_feats2.SetRandn();
+
+  Matrix<double> global_stats(2, dim + 1);
+  for (int32 t = 0; t < num_frames; t++) {
+    for (int32 d = 0; d < dim; d++) {
+      global_stats(0, d) += input_feats(t, d);
+      global_stats(1, d) += input_feats(t, d) * input_feats(t, d);
+    }
+  }
+  global_stats(0, dim) = num_frames;
+  OnlineCmvnOptions cmvn_opts;
+  cmvn_opts.normalize_variance = (rand() % 2 == 0);
+  cmvn_opts.cmn_window = 50;
+  cmvn_opts.speaker_frames = 50;
+  cmvn_opts.global_frames = 20;
+  OnlineCmvnState cmvn_state(global_stats);
+  DeltaFeaturesOptions delta_opts;
+  OnlineSpliceOptions splice_opts;
+  splice_opts.left_context = rand() % 4;
+  splice_opts.right_context = rand() % 4;
+  int32 splice_dim = dim * (1 + delta_opts.order) *
+      (1 + splice_opts.left_context + splice_opts.right_context);
+  Matrix<BaseFloat> transform(10, splice_dim + 1);
+  transform.SetRandn();
+
+  // We need two copies of everything, as some of the classes cache things.
+  std::vector<int32> frames;
+  Matrix<BaseFloat> output1, output2;
+  for (int32 copy = 0; copy < 2; copy++) {
+    OnlineMatrixFeature matrix_feats(input_feats), matrix_feats2(input_feats2);
+    OnlineCmvn cmvn(cmvn_opts, cmvn_state, &matrix_feats);
+    OnlineDeltaFeature delta(delta_opts, &cmvn);
+    OnlineSpliceFrames splice(splice_opts, &delta);
+    OnlineTransform lda(transform, &splice);
+    OnlineAppendFeature append(&lda, &matrix_feats2);
+    OnlineCacheFeature cache(&append);
+    int32 num_ready = cache.NumFramesReady();
+    KALDI_ASSERT(num_ready > 0);
+    if (copy == 0) {
+      // a block of consecutive frames followed by some random ones.
+      int32 begin = rand() % num_ready, end = begin + rand() % 40;
+      for (int32 t = begin; t < end && t < num_ready; t++)
+        frames.push_back(t);
+      for (int32 i = 0; i < 10; i++)
+        frames.push_back(rand() % num_ready);
+    }
+    Matrix<BaseFloat> &output = (copy == 0 ? output1 : output2);
+    output.Resize(frames.size(), cache.Dim());
+    if (copy == 0) {
+      for (size_t i = 0; i < frames.size(); i++) {
+        SubVector<BaseFloat> row(output, i);
+        cache.GetFrame(frames[i], &row);
+      }
+    } else {
+      cache.GetFrames(frames, &output);
+    }
+  }
+  AssertEqual(output1, output2);
+}
+
 }  // end namespace kaldi
 
 int main() {
   using namespace kaldi;
   for (int i = 0; i < 10; i++) {
     TestOnlineMatrixCacheFeature();
+    TestOnlineCacheFeatureEviction();
     TestOnlineDeltaFeature();
     TestOnlineSpliceFrames();
     TestOnlineMfcc();
     TestOnlinePlp();
     TestOnlineTransform();
     TestOnlineAppendFeature();
+    TestOnlineGetFrames();
+    TestOnlineCmvn();
   }
   std::cout << "Test OK.\n";
 }
@@ -20,6 +20,7 @@
 // limitations under the License.
 
 #include "feat/online-feature.h"
+#include "base/kaldi-memory-stats.h"
 #include "transform/cmvn.h"
 
 namespace kaldi {
@@ -33,6 +34,17 @@ void OnlineGenericBaseFeature<C>::GetFrame(int32 frame,
   feat->CopyFromVec(features_.Row(frame));
 };
 
+template<class C>
+void OnlineGenericBaseFeature<C>::GetFrames(const std::vector<int32> &frames,
+                                            MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(static_cast<int32>(frames.size()) == feats->NumRows() &&
+               feats->NumCols() == Dim());
+  for (size_t i = 0; i < frames.size(); i++) {
+    KALDI_ASSERT(frames[i] >= 0 && frames[i] < num_frames_);
+    feats->Row(i).CopyFromVec(features_.Row(frames[i]));
+  }
+}
+
 template<class C>
 bool OnlineGenericBaseFeature<C>::IsLastFrame(int32 frame) const {
   return (frame == num_frames_ - 1 && input_finished_);
@@ -50,6 +62,7 @@ void OnlineGenericBaseFeature<C>::AcceptWaveform(BaseFloat sampling_rate,
   if (waveform.Dim() == 0) {
     return;  // Nothing to do.
   }
+  MemoryTagScope memory_tag(kMemoryFeature);
   if (input_finished_) {
     KALDI_ERR << "AcceptWaveform called after InputFinished() was called.";
   }
@@ -134,7 +147,7 @@ void OnlineCmvnState::Read(std::istream &is, bool binary) {
 OnlineCmvn::OnlineCmvn(const OnlineCmvnOptions &opts,
                        const OnlineCmvnState &cmvn_state,
                        OnlineFeatureInterface *src):
-    opts_(opts), src_(src) {
+    opts_(opts), window_stats_frame_(-1), src_(src) {
   SetState(cmvn_state);
   if (!SplitStringToIntegers(opts.skip_dims, ":", false, &skip_dims_))
     KALDI_ERR << "Bad --skip-dims option (should be colon-separated list of "
@@ -142,7 +155,8 @@ OnlineCmvn::OnlineCmvn(const OnlineCmvnOptions &opts,
 }
 
 OnlineCmvn::OnlineCmvn(const OnlineCmvnOptions &opts,
-                       OnlineFeatureInterface *src): opts_(opts), src_(src) {
+                       OnlineFeatureInterface *src):
+    opts_(opts), window_stats_frame_(-1), src_(src) {
   if (!SplitStringToIntegers(opts.skip_dims, ":", false, &skip_dims_))
     KALDI_ERR << "Bad --skip-dims option (should be colon-separated list of "
               <<  "integers)";
@@ -230,6 +244,40 @@ void OnlineCmvn::ComputeStatsForFrame(int32 frame,
   KALDI_ASSERT(frame >= 0 && frame < src_->NumFramesReady());
 
   int32 dim = this->Dim(), cur_frame;
+  if (frame >= window_stats_frame_) {
+    // The normal case, where frames are requested in order: advance the
+    // running stats to "frame".
+    if (window_stats_frame_ == -1) {
+      window_stats_.Resize(2, dim + 1);
+      window_feats_.Resize(opts_.cmn_window, dim, kUndefined);
+    }
+    Vector<BaseFloat> feats(dim);
+    while (window_stats_frame_ < frame) {
+      cur_frame = ++window_stats_frame_;
+      SubVector<double> window_row(window_feats_,
+                                   cur_frame % opts_.cmn_window);
+      if (cur_frame >= opts_.cmn_window) {
+        // frame cur_frame - cmn_window, which is in window_row, is leaving
+        // the window.
+        window_stats_.Row(0).Range(0, dim).AddVec(-1.0, window_row);
+        window_stats_.Row(1).Range(0, dim).AddVec2(-1.0, window_row);
+        window_stats_(0, dim) -= 1.0;
+      }
+      src_->GetFrame(cur_frame, &feats);
+      window_row.CopyFromVec(feats);
+      window_stats_.Row(0).Range(0, dim).AddVec(1.0, window_row);
+      window_stats_.Row(1).Range(0, dim).AddVec2(1.0, window_row);
+      window_stats_(0, dim) += 1.0;
+      // The cached stats are still needed for GetState() and for frames
+      // requested out of order.
+      CacheFrame(cur_frame, window_stats_);
+    }
+    stats_out->CopyFromMat(window_stats_);
+    return;
+  }
+
+  // Otherwise, frame "frame" is before the latest one processed; start from
+  // the nearest cached frame.
   Matrix<double> stats(2, dim + 1);
   GetMostRecentCachedFrame(frame, &cur_frame, &stats);
 
@@ -297,27 +345,32 @@ void OnlineCmvn::SmoothOnlineCmvnStats(const MatrixBase<double> &speaker_stats,
   }
 }
 
-void OnlineCmvn::GetFrame(int32 frame,
-                          VectorBase<BaseFloat> *feat) {
-  src_->GetFrame(frame, feat);
-  KALDI_ASSERT(feat->Dim() == this->Dim());
-  int32 dim = feat->Dim();
-  Matrix<double> stats(2, dim + 1);
+void OnlineCmvn::GetNormalizationStats(int32 frame,
+                                       MatrixBase<double> *stats) {
   if (frozen_state_.NumRows() != 0) {  // the CMVN state has been frozen.
-    stats.CopyFromMat(frozen_state_);
+    stats->CopyFromMat(frozen_state_);
   } else {
     // first get the raw CMVN stats (this involves caching..)
-    this->ComputeStatsForFrame(frame, &stats);
+    this->ComputeStatsForFrame(frame, stats);
     // now smooth them.
     SmoothOnlineCmvnStats(orig_state_.speaker_cmvn_stats,
                           orig_state_.global_cmvn_stats,
                           opts_,
-                          &stats);
+                          stats);
   }
 
   if (!skip_dims_.empty())
-    FakeStatsForSomeDims(skip_dims_, &stats);
-  
+    FakeStatsForSomeDims(skip_dims_, stats);
+}
+
+void OnlineCmvn::GetFrame(int32 frame,
+                          VectorBase<BaseFloat> *feat) {
+  src_->GetFrame(frame, feat);
+  KALDI_ASSERT(feat->Dim() == this->Dim());
+  int32 dim = feat->Dim();
+  Matrix<double> stats(2, dim + 1);
+  GetNormalizationStats(frame, &stats);
+
   // call the function ApplyCmvn declared in ../transform/cmvn.h, which
   // requires a matrix.
   Matrix<BaseFloat> feat_mat(1, dim);
@@ -330,6 +383,29 @@ void OnlineCmvn::GetFrame(int32 frame,
   feat->CopyFromVec(feat_mat.Row(0));
 }
 
+void OnlineCmvn::GetFrames(const std::vector<int32> &frames,
+                           MatrixBase<BaseFloat> *feats) {
+  src_->GetFrames(frames, feats);
+  KALDI_ASSERT(feats->NumCols() == this->Dim());
+  if (!opts_.normalize_mean) {
+    KALDI_ASSERT(!opts_.normalize_variance);
+    return;
+  }
+  int32 dim = feats->NumCols(), num_frames = feats->NumRows();
+  Matrix<double> stats(2, dim + 1);
+  if (frozen_state_.NumRows() != 0) {
+    // All the frames are normalized the same way.
+    GetNormalizationStats(0, &stats);
+    ApplyCmvn(stats, opts_.normalize_variance, feats);
+    return;
+  }
+  for (int32 i = 0; i < num_frames; i++) {
+    GetNormalizationStats(frames[i], &stats);
+    SubMatrix<BaseFloat> feat(*feats, i, 1, 0, dim);
+    ApplyCmvn(stats, opts_.normalize_variance, &feat);
+  }
+}
+
 void OnlineCmvn::Freeze(int32 cur_frame) {
   int32 dim = this->Dim();
   Matrix<double> stats(2, dim + 1);
@@ -397,6 +473,40 @@ void OnlineSpliceFrames::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
   }
 }
 
+void OnlineSpliceFrames::GetFrames(const std::vector<int32> &frames,
+                                   MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(left_context_ >= 0 && right_context_ >= 0);
+  int32 dim_in = src_->Dim(), context = 1 + left_context_ + right_context_,
+      num_frames = frames.size(), T = src_->NumFramesReady();
+  KALDI_ASSERT(feats->NumRows() == num_frames &&
+               feats->NumCols() == dim_in * context);
+  if (num_frames == 0) return;
+  // Work out the distinct input frames we need, and get them all at once;
+  // each of them is typically used in "context" output frames.
+  std::vector<int32> input_frames;
+  input_frames.reserve(num_frames + context - 1);
+  for (int32 i = 0; i < num_frames; i++) {
+    int32 frame = frames[i];
+    KALDI_ASSERT(frame >= 0 && frame < NumFramesReady());
+    for (int32 t2 = frame - left_context_; t2 <= frame + right_context_; t2++)
+      input_frames.push_back(std::max<int32>(0, std::min<int32>(t2, T - 1)));
+  }
+  SortAndUniq(&input_frames);
+  Matrix<BaseFloat> input_feats(input_frames.size(), dim_in, kUndefined);
+  src_->GetFrames(input_frames, &input_feats);
+  for (int32 i = 0; i < num_frames; i++) {
+    SubVector<BaseFloat> feat(*feats, i);
+    int32 frame = frames[i];
+    for (int32 n = 0; n < context; n++) {
+      int32 t2 = std::max<int32>(0, std::min<int32>(frame - left_context_ + n,
+                                                    T - 1)),
+          r = std::lower_bound(input_frames.begin(), input_frames.end(), t2) -
+          input_frames.begin();
+      feat.Range(n * dim_in, dim_in).CopyFromVec(input_feats.Row(r));
+    }
+  }
+}
+
 OnlineTransform::OnlineTransform(const MatrixBase<BaseFloat> &transform,
                                  OnlineFeatureInterface *src):
     src_(src) {
@@ -421,6 +531,18 @@ void OnlineTransform::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
   feat->AddMatVec(1.0, linear_term_, kNoTrans, input_feat, 1.0);
 }
 
+void OnlineTransform::GetFrames(const std::vector<int32> &frames,
+                                MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(static_cast<int32>(frames.size()) == feats->NumRows() &&
+               feats->NumCols() == Dim());
+  Matrix<BaseFloat> input_feats(frames.size(), linear_term_.NumCols(),
+                                kUndefined);
+  src_->GetFrames(frames, &input_feats);
+  // One matrix-matrix product instead of a matrix-vector product per frame.
+  feats->CopyRowsFromVec(offset_);
+  feats->AddMatMat(1.0, input_feats, kNoTrans, linear_term_, kTrans, 1.0);
+}
+
 
 int32 OnlineDeltaFeature::Dim() const {
   int32 src_dim = src_->Dim();
@@ -464,30 +586,142 @@ void OnlineDeltaFeature::GetFrame(int32 frame,
   delta_features_.Process(temp_src, temp_t, feat);
 }
 
+void OnlineDeltaFeature::GetFrames(const std::vector<int32> &frames,
+                                   MatrixBase<BaseFloat> *feats) {
+  int32 num_frames = frames.size();
+  KALDI_ASSERT(feats->NumRows() == num_frames && feats->NumCols() == Dim());
+  if (num_frames == 0) return;
+  int32 min_frame = *std::min_element(frames.begin(), frames.end()),
+      max_frame = *std::max_element(frames.begin(), frames.end());
+  KALDI_ASSERT(min_frame >= 0 && max_frame < NumFramesReady());
+  // We get the input frames for the whole range of "frames" at once, which
+  // is only worthwhile if they are mostly contiguous (the usual case).
+  if (max_frame - min_frame >= 2 * num_frames) {
+    OnlineFeatureInterface::GetFrames(frames, feats);
+    return;
+  }
+  // As in GetFrame(), the input is truncated to the available frames;
+  // Process() will only look at the frames within "context" of the frame it
+  // is computing, so the result is the same.
+  int32 context = opts_.order * opts_.window,
+      left_frame = std::max<int32>(0, min_frame - context),
+      right_frame = std::min<int32>(src_->NumFramesReady() - 1,
+                                    max_frame + context);
+  std::vector<int32> input_frames(right_frame + 1 - left_frame);
+  for (int32 t = left_frame; t <= right_frame; t++)
+    input_frames[t - left_frame] = t;
+  Matrix<BaseFloat> temp_src(input_frames.size(), src_->Dim(), kUndefined);
+  src_->GetFrames(input_frames, &temp_src);
+  for (int32 i = 0; i < num_frames; i++) {
+    SubVector<BaseFloat> feat(*feats, i);
+    delta_features_.Process(temp_src, frames[i] - left_frame, &feat);
+  }
+}
+
 
 OnlineDeltaFeature::OnlineDeltaFeature(const DeltaFeaturesOptions &opts,
                                        OnlineFeatureInterface *src):
     src_(src), opts_(opts), delta_features_(opts) { }
 
+int32 OnlineCacheFeature::RowForFrame(int32 frame) {
+  if (frame < first_frame_)
+    return -1;
+  if (frame > latest_frame_) {
+    latest_frame_ = frame;
+    if (max_cached_frames_ > 0)
+      first_frame_ = std::max(first_frame_, frame - max_cached_frames_ + 1);
+  }
+  int32 num_rows = cache_.NumRows(),
+      num_rows_needed = latest_frame_ + 1 - first_frame_;
+  if (num_rows_needed > num_rows) {
+    // Grow the ring buffer, leaving some extra room so that we don't spend too
+    // much time resizing, and move the cached frames to their new rows.
+    int32 new_num_rows = std::max(num_rows_needed, 2 * num_rows);
+    if (max_cached_frames_ > 0)
+      new_num_rows = std::min(new_num_rows, max_cached_frames_);
+    Matrix<BaseFloat> new_cache(new_num_rows, Dim(), kUndefined);
+    std::vector<int32> new_cached_frames(new_num_rows, -1);
+    for (int32 r = 0; r < num_rows; r++) {
+      int32 t = cached_frames_[r];
+      if (t >= first_frame_) {
+        int32 new_r = t % new_num_rows;
+        new_cache.Row(new_r).CopyFromVec(cache_.Row(r));
+        new_cached_frames[new_r] = t;
+      }
+    }
+    cache_.Swap(&new_cache);
+    cached_frames_.swap(new_cached_frames);
+  }
+  int32 row = frame % cache_.NumRows();
+  cached_frames_[row] = frame;
+  return row;
+}
+
 void OnlineCacheFeature::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
   KALDI_ASSERT(frame >= 0);
-  if (static_cast<size_t>(frame) < cache_.size() && cache_[frame] != NULL) {
-    feat->CopyFromVec(*(cache_[frame]));
-  } else {
-    if (static_cast<size_t>(frame) >= cache_.size())
-      cache_.resize(frame + 1, NULL);
-    int32 dim = this->Dim();
-    cache_[frame] = new Vector<BaseFloat>(dim);
+  int32 row = CachedRow(frame);
+  if (row >= 0) {
+    feat->CopyFromVec(cache_.Row(row));
+    return;
+  }
+  row = RowForFrame(frame);
+  if (row >= 0) {
+    SubVector<BaseFloat> cached_feat(cache_, row);
     // The following call will crash if frame "frame" is not ready.
-    src_->GetFrame(frame, cache_[frame]);
-    feat->CopyFromVec(*(cache_[frame]));
+    src_->GetFrame(frame, &cached_feat);
+    feat->CopyFromVec(cached_feat);
+  } else {
+    src_->GetFrame(frame, feat);
   }
 }
 
+void OnlineCacheFeature::GetFrames(const std::vector<int32> &frames,
+                                   MatrixBase<BaseFloat> *feats) {
+  int32 num_frames = frames.size(), dim = this->Dim();
+  KALDI_ASSERT(feats->NumRows() == num_frames && feats->NumCols() == dim);
+  // Copy out the frames that are cached, and get the others from the source
+  // in one call.  We only cache the new frames at the end, as doing so may
+  // evict some of the frames we were asked for.
+  std::vector<int32> uncached_frames;
+  for (int32 i = 0; i < num_frames; i++) {
+    int32 frame = frames[i];
+    KALDI_ASSERT(frame >= 0);
+    int32 row = CachedRow(frame);
+    if (row >= 0)
+      feats->Row(i).CopyFromVec(cache_.Row(row));
+    else
+      uncached_frames.push_back(frame);
+  }
+  if (uncached_frames.empty())
+    return;
+  SortAndUniq(&uncached_frames);
+  Matrix<BaseFloat> uncached_feats(uncached_frames.size(), dim, kUndefined);
+  // The following call will crash if any of the frames is not ready.
+  src_->GetFrames(uncached_frames, &uncached_feats);
+  for (int32 i = 0; i < num_frames; i++) {
+    if (CachedRow(frames[i]) < 0) {
+      int32 r = std::lower_bound(uncached_frames.begin(), uncached_frames.end(),
+                                 frames[i]) - uncached_frames.begin();
+      feats->Row(i).CopyFromVec(uncached_feats.Row(r));
+    }
+  }
+  for (size_t i = 0; i < uncached_frames.size(); i++) {
+    int32 row = RowForFrame(uncached_frames[i]);
+    if (row >= 0)
+      cache_.Row(row).CopyFromVec(uncached_feats.Row(i));
+  }
+}
+
+void OnlineCacheFeature::ReleaseFramesBefore(int32 frame) {
+  first_frame_ = std::max(first_frame_, frame);
+  src_->ReleaseFramesBefore(frame);
+}
+
 void OnlineCacheFeature::ClearCache() {
-  for (size_t i = 0; i < cache_.size(); i++)
-    delete cache_[i];
-  cache_.resize(0);
+  cache_.Resize(0, 0);
+  cached_frames_.clear();
+  first_frame_ = 0;
+  latest_frame_ = -1;
 }
 
 
@@ -501,5 +735,17 @@ void OnlineAppendFeature::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
   src2_->GetFrame(frame, &feat2);
 };
 
+void OnlineAppendFeature::GetFrames(const std::vector<int32> &frames,
+                                    MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(static_cast<int32>(frames.size()) == feats->NumRows() &&
+               feats->NumCols() == Dim());
+  int32 num_frames = feats->NumRows();
+  SubMatrix<BaseFloat> feats1(*feats, 0, num_frames, 0, src1_->Dim());
+  SubMatrix<BaseFloat> feats2(*feats, 0, num_frames, src1_->Dim(),
+                              src2_->Dim());
+  src1_->GetFrames(frames, &feats1);
+  src2_->GetFrames(frames, &feats2);
+}
+
 
 }  // namespace kaldi
@@ -58,6 +58,9 @@ class OnlineGenericBaseFeature: public OnlineBaseFeature {
   virtual int32 NumFramesReady() const { return num_frames_; }
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
+
   //
   // Next, functions that are not in the interface.
   //
@@ -125,6 +128,13 @@ class OnlineMatrixFeature: public OnlineFeatureInterface {
     feat->CopyFromVec(mat_.Row(frame));
   }
 
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats) {
+    KALDI_ASSERT(static_cast<int32>(frames.size()) == feats->NumRows());
+    for (size_t i = 0; i < frames.size(); i++)
+      feats->Row(i).CopyFromVec(mat_.Row(frames[i]));
+  }
+
   virtual bool IsLastFrame(int32 frame) const {
     return (frame + 1 == mat_.NumRows());
   }
@@ -276,6 +286,12 @@ class OnlineCmvn: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
+
+  // Note: we don't pass ReleaseFramesBefore() on to the source, because
+  // ComputeStatsForFrame() and GetState() may need any earlier frame.
+
 
   //
   // Next, functions that are not in the interface.
@@ -354,6 +370,10 @@ class OnlineCmvn: public OnlineFeatureInterface {
   void ComputeStatsForFrame(int32 frame,
                             MatrixBase<double> *stats);
 
+  /// Gets the smoothed (or frozen) CMVN stats that we normalize frame "frame"
+  /// with; "stats" must be of dimension 2 x (Dim()+1).
+  void GetNormalizationStats(int32 frame, MatrixBase<double> *stats);
+
 
   OnlineCmvnOptions opts_;
   std::vector<int32> skip_dims_; // Skip CMVN for these dimensions.  Derived from opts_.
@@ -372,6 +392,16 @@ class OnlineCmvn: public OnlineFeatureInterface {
   // frame index.
   std::vector<std::pair<int32, Matrix<double> > > cached_stats_ring_;
 
+  // The raw (x, x^2, count) statistics for frame window_stats_frame_, the
+  // latest frame reached by processing the frames in order, and a ring buffer
+  // of the up to opts_.cmn_window input frames they include (frame t is in
+  // row t % opts_.cmn_window).  When the frames are requested in order, this
+  // makes the cost per frame constant however long the window is: the frame
+  // leaving the window is subtracted without requesting it again from src_.
+  Matrix<double> window_stats_;
+  Matrix<double> window_feats_;
+  int32 window_stats_frame_;  // -1 if no frames have been processed.
+
   OnlineFeatureInterface *src_;  // Not owned here
 };
 
@@ -405,6 +435,13 @@ class OnlineSpliceFrames: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
+
+  virtual void ReleaseFramesBefore(int32 frame) {
+    src_->ReleaseFramesBefore(frame - left_context_);
+  }
+
   //
   // Next, functions that are not in the interface.
   //
@@ -435,6 +472,13 @@ class OnlineTransform: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
+
+  virtual void ReleaseFramesBefore(int32 frame) {
+    src_->ReleaseFramesBefore(frame);
+  }
+
   //
   // Next, functions that are not in the interface.
   //
@@ -466,6 +510,13 @@ class OnlineDeltaFeature: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
+
+  virtual void ReleaseFramesBefore(int32 frame) {
+    src_->ReleaseFramesBefore(frame - opts_.order * opts_.window);
+  }
+
   //
   // Next, functions that are not in the interface.
   //
@@ -482,6 +533,13 @@ class OnlineDeltaFeature: public OnlineFeatureInterface {
 
 /// This feature type can be used to cache its input, to avoid
 /// repetition of computation in a multi-pass decoding context.
+/// The frames are stored in a ring buffer (one contiguous matrix), which
+/// holds the frames from the first one not yet released via
+/// ReleaseFramesBefore(), through the most recent one requested, growing as
+/// necessary.  If max_cached_frames > 0, at most that many of the most recent
+/// frames are kept, so the memory is bounded even if nobody calls
+/// ReleaseFramesBefore().  Frames that are no longer cached are still
+/// available: they are just obtained from the source again, without caching.
 class OnlineCacheFeature: public OnlineFeatureInterface {
  public:
   virtual int32 Dim() const { return src_->Dim(); }
@@ -494,18 +552,47 @@ class OnlineCacheFeature: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
-  virtual ~OnlineCacheFeature() { ClearCache(); }
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
+
+  /// Frees the storage for frames before "frame", and passes the call on to
+  /// the source.
+  virtual void ReleaseFramesBefore(int32 frame);
+
+  virtual ~OnlineCacheFeature() { }
 
   // Things that are not in the shared interface:
 
   void ClearCache();  // this should be called if you change the underlying
                       // features in some way.
 
-  explicit OnlineCacheFeature(OnlineFeatureInterface *src): src_(src) { }
+  explicit OnlineCacheFeature(OnlineFeatureInterface *src,
+                              int32 max_cached_frames = 0):
+      src_(src), max_cached_frames_(max_cached_frames), first_frame_(0),
+      latest_frame_(-1) { KALDI_ASSERT(max_cached_frames >= 0); }
  private:
+  // Returns the row of cache_ that holds frame "frame", or -1 if it is not
+  // cached.
+  inline int32 CachedRow(int32 frame) const {
+    if (frame < first_frame_ || cache_.NumRows() == 0) return -1;
+    int32 row = frame % cache_.NumRows();
+    return (cached_frames_[row] == frame ? row : -1);
+  }
+
+  // Returns the row of cache_ in which frame "frame" should be stored
+  // (growing cache_ or moving the window of cached frames on if necessary),
+  // or -1 if it should not be cached because it was released or is too old.
+  int32 RowForFrame(int32 frame);
 
   OnlineFeatureInterface *src_;  // Not owned here
-  std::vector<Vector<BaseFloat>* > cache_;
+  int32 max_cached_frames_;  // If > 0, the maximum number of frames we cache.
+  int32 first_frame_;  // Frames before this are not cached.
+  int32 latest_frame_;  // The most recent frame we cached, or -1.
+  // The ring buffer: frame t is stored in row t % cache_.NumRows(), if
+  // cached_frames_ for that row equals t.  All the cached frames are in the
+  // range first_frame_ ... latest_frame_, which fits in cache_.
+  Matrix<BaseFloat> cache_;
+  std::vector<int32> cached_frames_;
 };
 
 
@@ -527,6 +614,14 @@ class OnlineAppendFeature: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
+
+  virtual void ReleaseFramesBefore(int32 frame) {
+    src1_->ReleaseFramesBefore(frame);
+    src2_->ReleaseFramesBefore(frame);
+  }
+
   virtual ~OnlineAppendFeature() {  }
 
   OnlineAppendFeature(OnlineFeatureInterface *src1,
@@ -131,6 +131,63 @@ static void UnitTestPieces() {
   }
 }
 
+// Make sure that computing the NCCF with FFTs gives the same results as the
+// direct computation, both for the whole waveform and online in pieces, and
+// compare the speed of the two.
+static void UnitTestNccfFft() {
+  KALDI_LOG << "=== UnitTestNccfFft() ===\n";
+  double tot_time_direct = 0.0, tot_time_fft = 0.0;
+  for (int32 n = 0; n < 10; n++) {
+    PitchExtractionOptions op_direct, op_fft;
+    op_direct.nccf_ballast_online = true;
+    op_fft.nccf_ballast_online = true;
+    op_fft.nccf_fft = true;
+
+    int32 size = 10000 + rand() % 50000;
+    Vector<BaseFloat> v(size);
+    double cur_freq = 200.0, normalized_time = 0.0;
+    for (int32 i = 0; i < size; i++) {
+      v(i) = RandGauss() + cos(normalized_time * M_2PI);
+      cur_freq += RandGauss();
+      if (cur_freq < 100.0) cur_freq = 100.0;
+      if (cur_freq > 300.0) cur_freq = 300.0;
+      normalized_time += cur_freq / op_direct.samp_freq;
+    }
+
+    Matrix<BaseFloat> m1, m2, m3;
+    Timer timer;
+    ComputeKaldiPitch(op_direct, v, &m1);
+    tot_time_direct += timer.Elapsed();
+    timer.Reset();
+    ComputeKaldiPitch(op_fft, v, &m2);
+    tot_time_fft += timer.Elapsed();
+
+    { // compute it online with multiple pieces.
+      OnlinePitchFeature pitch_extractor(op_fft);
+      int32 start_samp = 0;
+      while (start_samp < v.Dim()) {
+        int32 num_samp = rand() % (v.Dim() + 1 - start_samp);
+        SubVector<BaseFloat> v_part(v, start_samp, num_samp);
+        pitch_extractor.AcceptWaveform(op_fft.samp_freq, v_part);
+        start_samp += num_samp;
+      }
+      pitch_extractor.InputFinished();
+      int32 num_frames = pitch_extractor.NumFramesReady();
+      m3.Resize(num_frames, 2);
+      for (int32 frame = 0; frame < num_frames; frame++) {
+        SubVector<BaseFloat> row(m3, frame);
+        pitch_extractor.GetFrame(frame, &row);
+      }
+    }
+    // The FFT only changes the round-off.
+    AssertEqual(m1, m2, 0.001);
+    AssertEqual(m1, m3, 0.001);
+  }
+  KALDI_LOG << "Time taken with direct NCCF computation is " << tot_time_direct
+            << ", with FFT-based computation is " << tot_time_fft;
+  KALDI_LOG << "Test passed :)\n";
+}
+
 // Make sure that the delayed output matches the non-delayed
 // version in the online scenario.
 static void UnitTestDelay() {
@@ -513,6 +570,7 @@ void UnitTestProcess() {
 static void UnitTestFeatNoKeele() {
   UnitTestSimple();
   UnitTestPieces();
+  UnitTestNccfFft();
   UnitTestDelay();
   UnitTestSearch();
 }
@@ -121,6 +121,72 @@ void ComputeCorrelation(const VectorBase<BaseFloat> &wave,
   }
 }
 
+/**
+   This function does the same as ComputeCorrelation() for all the frames of a
+   chunk of signal at once, but computes the dot products between the window
+   starting at 0 and the windows starting at each lag using FFTs, which is
+   faster.  Each row of "windows" contains a frame of the signal (of length
+   nccf_window_size + last_lag) in its first columns, then zeros; its number
+   of columns must equal the dimension of srfft and be at least
+   nccf_window_size + last_lag, so the circular correlation computed by the
+   FFT does not wrap around.  "windows" is destroyed.  The inner_prod and norm_prod outputs for
+   each frame go in the corresponding rows of "inner_prods" and "norm_prods".
+ */
+void ComputeCorrelationFft(const SplitRadixRealFft<BaseFloat> &srfft,
+                           int32 first_lag, int32 last_lag,
+                           int32 nccf_window_size,
+                           MatrixBase<BaseFloat> *windows,
+                           MatrixBase<BaseFloat> *inner_prods,
+                           MatrixBase<BaseFloat> *norm_prods) {
+  int32 num_frames = windows->NumRows(), fft_size = windows->NumCols(),
+      full_frame_length = nccf_window_size + last_lag;
+  KALDI_ASSERT(fft_size >= full_frame_length);
+  // first_windows contains the windows starting at 0, padded with zeros.
+  Matrix<BaseFloat> first_windows(num_frames, fft_size);
+  for (int32 frame = 0; frame < num_frames; frame++) {
+    SubVector<BaseFloat> wave(windows->RowData(frame), full_frame_length);
+    // As in ComputeCorrelation().
+    wave.Add(-wave.Range(0, nccf_window_size).Sum() / nccf_window_size);
+    SubVector<BaseFloat> sub_vec1(wave, 0, nccf_window_size);
+    first_windows.Row(frame).Range(0, nccf_window_size).CopyFromVec(sub_vec1);
+    // The energies of the windows are computed with a running sum; we use
+    // double so that round-off doesn't accumulate.
+    double e1 = VecVec(sub_vec1, sub_vec1), e2 = 0.0;
+    const BaseFloat *data = wave.Data();
+    for (int32 i = first_lag; i < first_lag + nccf_window_size; i++)
+      e2 += data[i] * data[i];
+    BaseFloat *norm_prod = norm_prods->RowData(frame);
+    for (int32 lag = first_lag; lag <= last_lag; lag++) {
+      norm_prod[lag - first_lag] = e1 * e2;
+      e2 += data[lag + nccf_window_size] * data[lag + nccf_window_size] -
+          data[lag] * data[lag];
+    }
+  }
+  std::vector<BaseFloat> temp_buffer;
+  srfft.Compute(windows, true, &temp_buffer);
+  srfft.Compute(&first_windows, true, &temp_buffer);
+  // Multiply the FFT of the signal by the conjugate of the FFT of the first
+  // window, which gives the FFT of their cross-correlation.  See
+  // SplitRadixRealFft::Compute() for the format.
+  for (int32 frame = 0; frame < num_frames; frame++) {
+    BaseFloat *x = windows->RowData(frame);
+    const BaseFloat *y = first_windows.RowData(frame);
+    x[0] *= y[0];
+    x[1] *= y[1];
+    for (int32 i = 2; i < fft_size; i += 2) {
+      BaseFloat re = x[i] * y[i] + x[i + 1] * y[i + 1],
+          im = x[i + 1] * y[i] - x[i] * y[i + 1];
+      x[i] = re;
+      x[i + 1] = im;
+    }
+  }
+  srfft.Compute(windows, false, &temp_buffer);
+  // the inverse FFT has no 1/N factor.
+  inner_prods->CopyFromMat(windows->ColRange(first_lag,
+                                             last_lag + 1 - first_lag));
+  inner_prods->Scale(1.0 / fft_size);
+}
+
 /**
    Computes the NCCF as a fraction of the numerator term (a dot product between
    two vectors) and a denominator term which equals sqrt(e1*e2 + nccf_ballast)
@@ -656,6 +722,11 @@ class OnlinePitchFeatureImpl {
   // have to use the initializer from the constructor.
   ArbitraryResample *nccf_resampler_;
 
+  // If opts_.nccf_fft == true, this object is used to compute the
+  // cross-correlations for the NCCF (see ComputeCorrelationFft()); otherwise
+  // it is NULL.
+  SplitRadixRealFft<BaseFloat> *nccf_fft_;
+
   // The following objects may change during the lifetime of this object.
 
   // This object is used to resample the signal.
@@ -756,6 +827,14 @@ OnlinePitchFeatureImpl::OnlinePitchFeatureImpl(
                                           upsample_cutoff, lags_offset,
                                           opts.upsample_filter_width);
 
+  if (opts.nccf_fft) {
+    int32 full_frame_length = opts.NccfWindowSize() + nccf_last_lag_;
+    nccf_fft_ = new SplitRadixRealFft<BaseFloat>(
+        RoundUpToNearestPowerOfTwo(full_frame_length));
+  } else {
+    nccf_fft_ = NULL;
+  }
+
   // add a PitchInfo object for frame -1 (not a real frame).
   frame_info_.push_back(new PitchFrameInfo(lags_.Dim()));
   // zeroes forward_cost_; this is what we want for the fake frame -1.
@@ -1005,6 +1084,7 @@ void OnlinePitchFeatureImpl::RecomputeBacktraces() {
 
 OnlinePitchFeatureImpl::~OnlinePitchFeatureImpl() {
   delete nccf_resampler_;
+  delete nccf_fft_;
   delete signal_resampler_;
   for (size_t i = 0; i < frame_info_.size(); i++)
     delete frame_info_[i];
@@ -1063,6 +1143,17 @@ void OnlinePitchFeatureImpl::AcceptWaveform(
 
   Vector<BaseFloat> cur_forward_cost(num_resampled_lags);
 
+  // If we're using FFTs, the cross-correlations are computed for blocks of
+  // up to fft_block_size frames at a time; this is faster than doing one
+  // frame at a time, while keeping the temporary matrices in cache.
+  int32 fft_block_size = std::min<int32>(32, num_new_frames);
+  Matrix<BaseFloat> windows, inner_prods, norm_prods;
+  if (nccf_fft_ != NULL) {
+    windows.Resize(fft_block_size,
+                   RoundUpToNearestPowerOfTwo(full_frame_length), kUndefined);
+    inner_prods.Resize(fft_block_size, num_measured_lags, kUndefined);
+    norm_prods.Resize(fft_block_size, num_measured_lags, kUndefined);
+  }
 
   // Because the resampling of the NCCF is more efficient when grouped together,
   // we first compute the NCCF for all frames, then resample as a matrix, then
@@ -1071,7 +1162,28 @@ void OnlinePitchFeatureImpl::AcceptWaveform(
   for (int32 frame = start_frame; frame < end_frame; frame++) {
     // start_sample is index into the whole wave, not just this part.
     int64 start_sample = static_cast<int64>(frame) * frame_shift;
-    ExtractFrame(downsampled_wave, start_sample, &window);
+    int32 block_index = (frame - start_frame) % fft_block_size;
+    if (nccf_fft_ == NULL) {
+      ExtractFrame(downsampled_wave, start_sample, &window);
+    } else if (block_index == 0) {
+      int32 this_block_size = std::min(fft_block_size, end_frame - frame);
+      SubMatrix<BaseFloat> windows_part(windows, 0, this_block_size,
+                                        0, windows.NumCols()),
+          inner_prods_part(inner_prods, 0, this_block_size,
+                           0, num_measured_lags),
+          norm_prods_part(norm_prods, 0, this_block_size,
+                          0, num_measured_lags);
+      windows_part.SetZero();
+      for (int32 i = 0; i < this_block_size; i++) {
+        SubVector<BaseFloat> window_part(windows_part.RowData(i),
+                                         full_frame_length);
+        ExtractFrame(downsampled_wave, start_sample + i * frame_shift,
+                     &window_part);
+      }
+      ComputeCorrelationFft(*nccf_fft_, nccf_first_lag_, nccf_last_lag_,
+                            basic_frame_length, &windows_part,
+                            &inner_prods_part, &norm_prods_part);
+    }
     if (opts_.nccf_ballast_online) {
       // use only up to end of current frame to compute root-mean-square value.
       // end_sample will be the sample-index into "downsampled_wave", so
@@ -1095,8 +1207,13 @@ void OnlinePitchFeatureImpl::AcceptWaveform(
     double mean_square = cur_sumsq / cur_num_samp -
         pow(cur_sum / cur_num_samp, 2.0);
 
-    ComputeCorrelation(window, nccf_first_lag_, nccf_last_lag_,
-                       basic_frame_length, &inner_prod, &norm_prod);
+    if (nccf_fft_ == NULL) {
+      ComputeCorrelation(window, nccf_first_lag_, nccf_last_lag_,
+                         basic_frame_length, &inner_prod, &norm_prod);
+    } else {
+      inner_prod.CopyFromVec(inner_prods.Row(block_index));
+      norm_prod.CopyFromVec(norm_prods.Row(block_index));
+    }
     double nccf_ballast_pov = 0.0,
         nccf_ballast_pitch = pow(mean_square * basic_frame_length, 2) *
              opts_.nccf_ballast,
@@ -110,6 +110,11 @@ struct PitchExtractionOptions {
   // chunking, which is useful for testing purposes.
   bool nccf_ballast_online;
   bool snip_edges;
+  // If true, the cross-correlations needed for the NCCF are computed with
+  // FFTs, for all the frames of a chunk of signal at once, rather than as
+  // a dot product for each lag.  This is faster; the NCCF differs from the
+  // direct computation only by round-off.
+  bool nccf_fft;
   PitchExtractionOptions():
       samp_freq(16000),
       frame_shift_ms(10.0),
@@ -130,7 +135,8 @@ struct PitchExtractionOptions {
       simulate_first_pass_online(false),
       recompute_frame(500),
       nccf_ballast_online(false),
-      snip_edges(true) { }
+      snip_edges(true),
+      nccf_fft(false) { }
 
   void Register(OptionsItf *opts) {
     opts->Register("sample-frequency", &samp_freq,
@@ -194,6 +200,9 @@ struct PitchExtractionOptions {
                    "that the number of frames is the file size divided by the "
                    "frame-shift. This makes different types of features give the "
                    "same number of frames.");
+    opts->Register("nccf-fft", &nccf_fft, "If true, compute the "
+                   "cross-correlations for the NCCF using FFTs, which is "
+                   "faster; the results differ only by round-off.");
 
   }
   /// Returns the window-size in samples, after resampling.  This is the
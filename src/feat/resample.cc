@@ -25,6 +25,7 @@
 #include <limits>
 #include "feat/feature-functions.h"
 #include "matrix/matrix-functions.h"
+#include "matrix/vectorized-math.h"
 #include "feat/resample.h"
 
 namespace kaldi {
@@ -149,57 +150,102 @@ void LinearResample::GetIndexes(int64 samp_out,
 }
 
 
+bool LinearResample::InputIsAvailable(int64 samp_out,
+                                      int32 input_dim) const {
+  int64 first_samp_in;
+  int32 samp_out_wrapped;
+  GetIndexes(samp_out, &first_samp_in, &samp_out_wrapped);
+  int64 first_input_index = first_samp_in - input_sample_offset_;
+  return (first_input_index >= 0 &&
+          first_input_index + weights_[samp_out_wrapped].Dim() <= input_dim);
+}
+
+BaseFloat LinearResample::ResampleEdgeSample(
+    const VectorBase<BaseFloat> &input, bool flush, int64 samp_out) const {
+  int64 first_samp_in;
+  int32 samp_out_wrapped;
+  GetIndexes(samp_out, &first_samp_in, &samp_out_wrapped);
+  const Vector<BaseFloat> &weights = weights_[samp_out_wrapped];
+  // first_input_index is the first index into "input" that we have a weight
+  // for.
+  int32 first_input_index = static_cast<int32>(first_samp_in -
+                                               input_sample_offset_),
+      input_dim = input.Dim();
+  BaseFloat this_output = 0.0;
+  for (int32 i = 0; i < weights.Dim(); i++) {
+    BaseFloat weight = weights(i);
+    int32 input_index = first_input_index + i;
+    if (input_index < 0 && input_remainder_.Dim() + input_index >= 0) {
+      this_output += weight *
+          input_remainder_(input_remainder_.Dim() + input_index);
+    } else if (input_index >= 0 && input_index < input_dim) {
+      this_output += weight * input(input_index);
+    } else if (input_index >= input_dim) {
+      // We're past the end of the input and are adding zero; should only
+      // happen if the user specified flush == true, or else we would not
+      // be trying to output this sample.
+      KALDI_ASSERT(flush);
+    }
+  }
+  return this_output;
+}
+
 void LinearResample::Resample(const VectorBase<BaseFloat> &input,
                               bool flush,
                               Vector<BaseFloat> *output) {
   int32 input_dim = input.Dim();
   int64 tot_input_samp = input_sample_offset_ + input_dim,
       tot_output_samp = GetNumOutputSamples(tot_input_samp, flush);
-  
+
   KALDI_ASSERT(tot_output_samp >= output_sample_offset_);
 
   output->Resize(tot_output_samp - output_sample_offset_);
 
   // samp_out is the index into the total output signal, not just the part
-  // of it we are producing here.
-  for (int64 samp_out = output_sample_offset_;
-       samp_out < tot_output_samp;
-       samp_out++) {
-    int64 first_samp_in;
-    int32 samp_out_wrapped;
-    GetIndexes(samp_out, &first_samp_in, &samp_out_wrapped);
-    const Vector<BaseFloat> &weights = weights_[samp_out_wrapped];
-    // first_input_index is the first index into "input" that we have a weight
-    // for.
-    int32 first_input_index = static_cast<int32>(first_samp_in -
-                                                 input_sample_offset_);
-    BaseFloat this_output;
-    if (first_input_index >= 0 &&
-        first_input_index + weights.Dim() <= input_dim) {
-      SubVector<BaseFloat> input_part(input, first_input_index, weights.Dim());
-      this_output = VecVec(input_part, weights);
-    } else {  // Handle edge cases.
-      this_output = 0.0;
-      for (int32 i = 0; i < weights.Dim(); i++) {
-        BaseFloat weight = weights(i);
-        int32 input_index = first_input_index + i;
-        if (input_index < 0 && input_remainder_.Dim() + input_index >= 0) {
-          this_output += weight *
-              input_remainder_(input_remainder_.Dim() + input_index);
-        } else if (input_index >= 0 && input_index < input_dim) {
-          this_output += weight * input(input_index);
-        } else if (input_index >= input_dim) {
-          // We're past the end of the input and are adding zero; should only
-          // happen if the user specified flush == true, or else we would not
-          // be trying to output this sample.
-          KALDI_ASSERT(flush);
-        }
-      }
+  // of it we are producing here.  The output samples whose weights all fall
+  // inside "input" form a contiguous range [samp_out, interior_end), since
+  // the first and last input indexes are nondecreasing in samp_out; the
+  // samples before and after it need input_remainder_ or zero-padding.
+  int64 samp_out = output_sample_offset_;
+  for (; samp_out < tot_output_samp &&
+           !InputIsAvailable(samp_out, input_dim); samp_out++)
+    (*output)(samp_out - output_sample_offset_) =
+        ResampleEdgeSample(input, flush, samp_out);
+  int64 interior_end = tot_output_samp;
+  while (interior_end > samp_out &&
+         !InputIsAvailable(interior_end - 1, input_dim))
+    interior_end--;
+
+  if (interior_end > samp_out) {
+    // The interior is done as polyphase filtering: output sample
+    // samp_out_wrapped of each unit uses the filter weights_[samp_out_wrapped]
+    // and the input samples from first_index_[samp_out_wrapped] onward,
+    // relative to the start of the unit.
+    int64 unit_index = samp_out / output_samples_in_unit_;
+    int64 unit_start_in = unit_index * input_samples_in_unit_ -
+        input_sample_offset_;
+    std::vector<int32> x_offsets(output_samples_in_unit_),
+        num_taps(output_samples_in_unit_);
+    std::vector<const BaseFloat*> w(output_samples_in_unit_);
+    for (int32 i = 0; i < output_samples_in_unit_; i++) {
+      x_offsets[i] = static_cast<int32>(first_index_[i] + unit_start_in);
+      num_taps[i] = weights_[i].Dim();
+      w[i] = weights_[i].Data();
     }
-    int32 output_index = static_cast<int32>(samp_out - output_sample_offset_);
-    (*output)(output_index) = this_output;
+    VectorizedPolyphaseFilter(
+        input.Data(), input_samples_in_unit_, &(x_offsets[0]), &(w[0]),
+        &(num_taps[0]), output_samples_in_unit_,
+        static_cast<MatrixIndexT>(samp_out -
+                                  unit_index * output_samples_in_unit_),
+        static_cast<MatrixIndexT>(interior_end - samp_out),
+        output->Data() + (samp_out - output_sample_offset_));
+    samp_out = interior_end;
   }
 
+  for (; samp_out < tot_output_samp; samp_out++)
+    (*output)(samp_out - output_sample_offset_) =
+        ResampleEdgeSample(input, flush, samp_out);
+
   if (flush) {
     Reset();  // Reset the internal state.
   } else {
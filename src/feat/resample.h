@@ -205,6 +205,16 @@ class LinearResample {
                          int64 *first_samp_in,
                          int32 *samp_out_wrapped) const;
 
+  /// Returns true if all the input samples that output sample "samp_out"
+  /// has weights on are inside the current input (of dimension input_dim),
+  /// i.e. if it needs neither input_remainder_ nor zero-padding.
+  inline bool InputIsAvailable(int64 samp_out, int32 input_dim) const;
+
+  /// Computes output sample "samp_out" when InputIsAvailable() is false,
+  /// using input_remainder_ for the input before "input" and zero after it.
+  BaseFloat ResampleEdgeSample(const VectorBase<BaseFloat> &input,
+                               bool flush, int64 samp_out) const;
+
   void SetRemainder(const VectorBase<BaseFloat> &input);
 
   void SetIndexesAndWeights();
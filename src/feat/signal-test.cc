@@ -52,12 +52,33 @@ void UnitTestConvolution() {
     AssertEqual(signal, signal_test, 0.0001 * signal.Dim());
   }
 }
+
+void UnitTestFftBlockConvolver() {
+  for (int32 i = 0; i < 10; i++) {
+    int32 filter_length = 1 + Rand() % 300;
+    Vector<BaseFloat> filter(filter_length);
+    filter.SetRandn();
+    FftBlockConvolver convolver(filter);
+    // The same convolver is reused for signals of various lengths, including
+    // ones shorter than a block and ones needing more than one batch.
+    for (int32 j = 0; j < 3; j++) {
+      int32 signal_length = 1 + Rand() % (j == 0 ? 500 : 100000);
+      Vector<BaseFloat> signal(signal_length);
+      signal.SetRandn();
+      Vector<BaseFloat> signal_test(signal);
+      ConvolveSignals(filter, &signal_test);
+      convolver.Convolve(&signal);
+      KALDI_ASSERT(signal.ApproxEqual(signal_test, 0.0001));
+    }
+  }
+}
 }
 
 int main() {
   using namespace kaldi;
   UnitTestBlockConvolution();
   UnitTestConvolution();
+  UnitTestFftBlockConvolver();
   KALDI_LOG << "Tests succeeded.";
 
 }
@@ -25,7 +25,11 @@ namespace kaldi {
 
 void ElementwiseProductOfFft(const Vector<BaseFloat> &a, Vector<BaseFloat> *b) {
   int32 num_fft_bins = a.Dim() / 2;
-  for (int32 i = 0; i < num_fft_bins; i++) {
+  // Elements 0 and 1 are the real-valued DC and Nyquist bins, in the format of
+  // SplitRadixRealFft; the rest are (real, imaginary) pairs.
+  (*b)(0) *= a(0);
+  (*b)(1) *= a(1);
+  for (int32 i = 1; i < num_fft_bins; i++) {
     // do complex multiplication
     ComplexMul(a(2*i), a(2*i + 1), &((*b)(2*i)), &((*b)(2*i + 1)));
   }
@@ -71,53 +75,65 @@ void FFTbasedConvolveSignals(const Vector<BaseFloat> &filter, Vector<BaseFloat>
 }
 
 void FFTbasedBlockConvolveSignals(const Vector<BaseFloat> &filter, Vector<BaseFloat> *signal) {
-  int32 signal_length = signal->Dim();
-  int32 filter_length = filter.Dim();
-
-  KALDI_VLOG(1) << "Length of the filter is " << filter_length;
-
-  int32 fft_length = RoundUpToNearestPowerOfTwo(4 * filter_length);
-  KALDI_VLOG(1) << "Best FFT length is " << fft_length;
-
-  int32 block_length = fft_length - filter_length + 1;
-  KALDI_VLOG(1) << "Block size is " << block_length;
-  SplitRadixRealFft<BaseFloat> srfft(fft_length);
+  FftBlockConvolver convolver(filter);
+  convolver.Convolve(signal);
+}
 
-  Vector<float> filter_padded(fft_length);
-  filter_padded.Range(0, filter_length).CopyFromVec(filter);
-  srfft.Compute(filter_padded.Data(), true);
+const int32 FftBlockConvolver::kBlocksPerBatch;
+
+FftBlockConvolver::FftBlockConvolver(const VectorBase<BaseFloat> &filter):
+    filter_length_(filter.Dim()),
+    fft_length_(RoundUpToNearestPowerOfTwo(4 * std::max(filter_length_, 1))),
+    block_length_(fft_length_ - filter_length_ + 1),
+    srfft_(fft_length_),
+    filter_fft_(fft_length_) {
+  KALDI_ASSERT(filter_length_ > 0);
+  KALDI_VLOG(1) << "Length of the filter is " << filter_length_
+                << ", FFT length is " << fft_length_;
+  filter_fft_.Range(0, filter_length_).CopyFromVec(filter);
+  srfft_.Compute(filter_fft_.Data(), true);
+  // Fold the 1 / fft_length_ normalization of the inverse FFT into the
+  // filter, so it doesn't need to be applied to each block.
+  filter_fft_.Scale(1.0 / fft_length_);
+}
 
-  Vector<float> temp_pad(filter_length - 1);
-  temp_pad.SetZero();
-  Vector<float> signal_block_padded(fft_length);
-
-  for (int32 po = 0; po < signal_length; po += block_length) {
-    // get a block of the signal
-    int32 process_length = std::min(block_length, signal_length - po);
-    signal_block_padded.SetZero();
-    signal_block_padded.Range(0, process_length).CopyFromVec(signal->Range(po, process_length));
-
-    srfft.Compute(signal_block_padded.Data(), true);
-
-    ElementwiseProductOfFft(filter_padded, &signal_block_padded);
-
-    srfft.Compute(signal_block_padded.Data(), false);
-    signal_block_padded.Scale(1.0 / fft_length);
-
-    // combine the block
-    if (po + block_length < signal_length) {       // current block is not the last block
-      signal->Range(po, block_length).CopyFromVec(signal_block_padded.Range(0, block_length));
-      signal->Range(po, filter_length - 1).AddVec(1.0, temp_pad);
-      temp_pad.CopyFromVec(signal_block_padded.Range(block_length, filter_length - 1));
-    } else {
-      signal->Range(po, signal_length - po).CopyFromVec(
-                        signal_block_padded.Range(0, signal_length - po));
-      if (filter_length - 1 < signal_length - po)
-        signal->Range(po, filter_length - 1).AddVec(1.0, temp_pad);
-      else
-        signal->Range(po, signal_length - po).AddVec(1.0, temp_pad.Range(0, signal_length - po));
+void FftBlockConvolver::Convolve(VectorBase<BaseFloat> *signal) const {
+  int32 signal_length = signal->Dim(),
+      num_blocks = (signal_length + block_length_ - 1) / block_length_;
+  Vector<BaseFloat> output(signal_length);
+  Matrix<BaseFloat> blocks;
+  std::vector<BaseFloat> temp_buffer;
+  const BaseFloat *filter_fft = filter_fft_.Data();
+  for (int32 b = 0; b < num_blocks; b += kBlocksPerBatch) {
+    int32 this_num_blocks = std::min(kBlocksPerBatch, num_blocks - b);
+    blocks.Resize(this_num_blocks, fft_length_);  // zeroes it.
+    for (int32 i = 0; i < this_num_blocks; i++) {
+      int32 po = (b + i) * block_length_,
+          process_length = std::min(block_length_, signal_length - po);
+      blocks.Row(i).Range(0, process_length).CopyFromVec(
+          signal->Range(po, process_length));
+    }
+    srfft_.Compute(&blocks, true, &temp_buffer);
+    for (int32 i = 0; i < this_num_blocks; i++) {
+      BaseFloat *row = blocks.RowData(i);
+      // Elements 0 and 1 are the real-valued DC and Nyquist bins; the rest
+      // are (real, imaginary) pairs.
+      row[0] *= filter_fft[0];
+      row[1] *= filter_fft[1];
+      for (int32 j = 2; j < fft_length_; j += 2)
+        ComplexMul(filter_fft[j], filter_fft[j + 1], &(row[j]), &(row[j + 1]));
+    }
+    srfft_.Compute(&blocks, false, &temp_buffer);
+    // Overlap-add: each block's output extends filter_length_ - 1 samples
+    // into the following block.
+    for (int32 i = 0; i < this_num_blocks; i++) {
+      int32 po = (b + i) * block_length_,
+          add_length = std::min(fft_length_, signal_length - po);
+      output.Range(po, add_length).AddVec(1.0, blocks.Row(i).Range(0,
+                                                                 add_length));
     }
   }
-}
+  signal->CopyFromVec(output);
 }
 
+}  // namespace kaldi
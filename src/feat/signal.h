@@ -46,6 +46,36 @@ void FFTbasedConvolveSignals(const Vector<BaseFloat> &filter, Vector<BaseFloat>
 */
 void FFTbasedBlockConvolveSignals(const Vector<BaseFloat> &filter, Vector<BaseFloat> *signal);
 
+/*
+   This class does the same FFT-based overlap-add block convolution as
+   FFTbasedBlockConvolveSignals(), for a filter that is fixed in advance (e.g.
+   a room impulse response).  The FFT of the filter is computed only once, in
+   the constructor, so it can be reused for many signals (e.g. all the waves
+   that wav-reverberate processes with a given impulse response), and the
+   blocks of each signal are transformed up to kBlocksPerBatch at a time with
+   the batched SplitRadixRealFft::Compute().
+*/
+class FftBlockConvolver {
+ public:
+  explicit FftBlockConvolver(const VectorBase<BaseFloat> &filter);
+
+  /// Convolves "signal" with the filter, in place; as for the functions above,
+  /// the output is truncated to the length of the input.
+  void Convolve(VectorBase<BaseFloat> *signal) const;
+
+  int32 FilterDim() const { return filter_length_; }
+
+  static const int32 kBlocksPerBatch = 16;
+ private:
+  int32 filter_length_;
+  int32 fft_length_;  // a power of two, at least 4 * filter_length_.
+  int32 block_length_;  // fft_length_ - filter_length_ + 1.
+  SplitRadixRealFft<BaseFloat> srfft_;
+  Vector<BaseFloat> filter_fft_;  // FFT of the zero-padded filter.
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(FftBlockConvolver);
+};
+
 }  // namespace kaldi
 
 #endif  // KALDI_FEAT_SIGNAL_H_
@@ -19,6 +19,7 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <cstdio>
 #include <limits>
 #include <sstream>
@@ -31,7 +32,7 @@
 namespace kaldi {
 
 // static
-void WaveData::Expect4ByteTag(std::istream &is, const char *expected) {
+void WaveStreamReader::Expect4ByteTag(std::istream &is, const char *expected) {
   char tmp[5];
   tmp[4] = '\0';
   is.read(tmp, 4);
@@ -41,7 +42,8 @@ void WaveData::Expect4ByteTag(std::istream &is, const char *expected) {
     KALDI_ERR << "WaveData: expected " << expected << ", got " << tmp;
 }
 
-uint32 WaveData::ReadUint32(std::istream &is, bool swap) {
+// static
+uint32 WaveStreamReader::ReadUint32(std::istream &is, bool swap) {
   union {
     char result[4];
     uint32 ans;
@@ -55,7 +57,8 @@ uint32 WaveData::ReadUint32(std::istream &is, bool swap) {
 }
 
 
-uint16 WaveData::ReadUint16(std::istream &is, bool swap) {
+// static
+uint16 WaveStreamReader::ReadUint16(std::istream &is, bool swap) {
   union {
     char result[2];
     int16 ans;
@@ -69,7 +72,7 @@ uint16 WaveData::ReadUint16(std::istream &is, bool swap) {
 }
 
 // static
-void WaveData::Read4ByteTag(std::istream &is, char *dest) {
+void WaveStreamReader::Read4ByteTag(std::istream &is, char *dest) {
   is.read(dest, 4);
   if (is.fail())
     KALDI_ERR << "WaveData: expected 4-byte chunk-name, got read errror";
@@ -106,9 +109,8 @@ void WaveData::WriteUint16(std::ostream &os, int16 i) {
 
 
 
-void WaveData::Read(std::istream &is) {
-  data_.Resize(0, 0);  // clear the data.
-
+WaveStreamReader::WaveStreamReader(std::istream &is):
+    is_(is), bytes_read_(0), done_(false) {
   char tmp[5];
   tmp[4] = '\0';
   Read4ByteTag(is, &tmp[0]);
@@ -123,6 +125,7 @@ void WaveData::Read(std::istream &is) {
 #else
   bool swap = is_rifx;
 #endif
+  swap_ = swap;
 
   uint32 riff_chunk_size = ReadUint32(is, swap);
   Expect4ByteTag(is, "WAVE");
@@ -176,6 +179,7 @@ void WaveData::Read(std::istream &is) {
   if (num_channels <= 0)
     KALDI_ERR << "WaveData: no channels present";
   samp_freq_ = static_cast<BaseFloat>(sample_rate);
+  num_channels_ = num_channels;
   if (bits_per_sample != 8 && bits_per_sample != 16 && bits_per_sample != 32)
     KALDI_ERR << "WaveData: bits_per_sample is " << bits_per_sample;
   if (byte_rate != sample_rate * bits_per_sample/8 * num_channels)
@@ -185,6 +189,8 @@ void WaveData::Read(std::istream &is) {
   if (block_align != num_channels * bits_per_sample/8)
     KALDI_ERR << "Unexpected block_align: " << block_align << " vs. "
               << num_channels << " * " << (bits_per_sample/8);
+  bits_per_sample_ = bits_per_sample;
+  block_align_ = block_align;
 
   riff_chunk_read += 8 + subchunk1_size;
   // size of what we just read, 4 bytes for "fmt " + 4
@@ -233,76 +239,90 @@ void WaveData::Read(std::istream &is) {
               << "(we do not support reading multiple data chunks).";
   }
 
-  std::vector<char*> data_pointer_vec;
-  std::vector<int> data_size_vec;
-  uint32 num_bytes_read = 0;
-  for (int32 remain_chunk_size = data_chunk_size; remain_chunk_size > 0;
-       remain_chunk_size -= kBlockSize) {
-    int32 this_block_size = remain_chunk_size;
-    if (kBlockSize < remain_chunk_size)
-      this_block_size = kBlockSize;
-    char *block_data_vec = new char[this_block_size];
-    is.read(block_data_vec, this_block_size);
-    num_bytes_read += is.gcount();
-    data_size_vec.push_back(is.gcount());
-    data_pointer_vec.push_back(block_data_vec);
-    if (num_bytes_read < this_block_size)
-      break;
-  }
-
-  std::vector<char> chunk_data_vec(num_bytes_read);
-  uint32 data_address = 0;
-  for (int i = 0; i < data_pointer_vec.size(); i++) {
-    memcpy(&(chunk_data_vec[data_address]), data_pointer_vec[i],
-           data_size_vec[i]);
-    delete[] data_pointer_vec[i];
-    data_address += data_size_vec[i];
-  }
-
-  char *data_ptr = &(chunk_data_vec[0]);
-  if (num_bytes_read == 0 && num_bytes_read != data_chunk_size) {
-    KALDI_ERR << "WaveData: failed to read data chunk (read no bytes)";
-  } else if (num_bytes_read != data_chunk_size) {
-    KALDI_ASSERT(num_bytes_read < data_chunk_size);
-    KALDI_WARN << "Read fewer bytes than specified in the header: "
-               << num_bytes_read << " < " << data_chunk_size;
-  }
-
   if (data_chunk_size == 0)
     KALDI_ERR << "WaveData: empty file (no data)";
+  data_bytes_ = data_chunk_size;
+}
 
-  uint32 num_samp = num_bytes_read / block_align;
-  data_.Resize(num_channels, num_samp);
+int32 WaveStreamReader::Read(MatrixBase<BaseFloat> *data) {
+  KALDI_ASSERT(data->NumRows() == num_channels_);
+  if (done_)
+    return 0;
+  // We only read whole samples; "remaining" is the rest of the data chunk
+  // rounded down to a whole number of samples.
+  uint32 remaining = (data_bytes_ - bytes_read_) / block_align_,
+      num_samp = std::min<uint32>(remaining, data->NumCols());
+  buffer_.resize(std::max<uint32>(num_samp * block_align_, 1));
+  is_.read(&(buffer_[0]), num_samp * block_align_);
+  uint32 num_bytes_read = is_.gcount();
+  bytes_read_ += num_bytes_read;
+  if (num_bytes_read < num_samp * block_align_ || num_samp == remaining) {
+    done_ = true;
+    if (bytes_read_ == 0) {
+      KALDI_ERR << "WaveData: failed to read data chunk (read no bytes)";
+    } else if (bytes_read_ != data_bytes_) {
+      KALDI_ASSERT(bytes_read_ < data_bytes_);
+      KALDI_WARN << "Read fewer bytes than specified in the header: "
+                 << bytes_read_ << " < " << data_bytes_;
+    }
+  }
+  num_samp = num_bytes_read / block_align_;
+
+  const char *data_ptr = &(buffer_[0]);
   for (uint32 i = 0; i < num_samp; i++) {
-    for (uint32 j = 0; j < num_channels; j++) {
-      switch (bits_per_sample) {
+    for (int32 j = 0; j < num_channels_; j++) {
+      switch (bits_per_sample_) {
         case 8:
-          data_(j, i) = *data_ptr;
+          (*data)(j, i) = *data_ptr;
           data_ptr++;
           break;
         case 16:
           {
-            int16 k = *reinterpret_cast<uint16*>(data_ptr);
-            if (swap)
+            int16 k = *reinterpret_cast<const uint16*>(data_ptr);
+            if (swap_)
               KALDI_SWAP2(k);
-            data_(j, i) =  k;
+            (*data)(j, i) =  k;
             data_ptr += 2;
             break;
           }
         case 32:
           {
-            int32 k = *reinterpret_cast<uint32*>(data_ptr);
-            if (swap)
+            int32 k = *reinterpret_cast<const uint32*>(data_ptr);
+            if (swap_)
               KALDI_SWAP4(k);
-            data_(j, i) =  k;
+            (*data)(j, i) =  k;
             data_ptr += 4;
             break;
           }
         default:
-          KALDI_ERR << "bits per sample is " << bits_per_sample;  // already checked this.
+          KALDI_ERR << "bits per sample is " << bits_per_sample_;  // already checked this.
       }
     }
   }
+  return num_samp;
+}
+
+
+void WaveData::Read(std::istream &is) {
+  data_.Resize(0, 0);  // clear the data.
+  WaveStreamReader reader(is);
+  samp_freq_ = reader.SampFreq();
+  int32 num_channels = reader.NumChannels(),
+      num_samp = reader.NumSamplesInHeader(),
+      block_samp = std::max<int32>(kBlockSize / (num_channels * sizeof(int32)),
+                                   1);
+  // Decode the samples block by block (at most kBlockSize bytes at a time)
+  // straight into data_, rather than reading the whole data chunk into a
+  // byte buffer first.
+  data_.Resize(num_channels, num_samp);
+  int32 offset = 0;
+  while (!reader.Done() && offset < num_samp) {
+    SubMatrix<BaseFloat> block(data_, 0, num_channels, offset,
+                               std::min(block_samp, num_samp - offset));
+    offset += reader.Read(&block);
+  }
+  if (offset < num_samp)  // the file was truncated.
+    data_.Resize(num_channels, offset, kCopyData);
 }
 
 
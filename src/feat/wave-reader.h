@@ -44,6 +44,7 @@
 #define KALDI_FEAT_WAVE_READER_H_
 
 #include <cstring>
+#include <vector>
 
 #include "base/kaldi-types.h"
 #include "matrix/kaldi-vector.h"
@@ -57,6 +58,64 @@ namespace kaldi {
 const BaseFloat kWaveSampleMax = 32768.0;
 
 /// This class's purpose is to read in Wave files.
+/// WaveStreamReader parses the header of a WAVE file (PCM, 8, 16 or 32 bits
+/// per sample, RIFF or RIFX) from a stream and then decodes its samples
+/// incrementally, so the whole file never has to be held in memory at once.
+/// This is useful for long recordings that are fed to the online feature
+/// extractors block by block, e.g.:
+/// \code
+///   WaveStreamReader reader(is);
+///   OnlineMfcc mfcc(mfcc_opts);
+///   Matrix<BaseFloat> block(reader.NumChannels(), 8000);
+///   while (!reader.Done()) {
+///     int32 n = reader.Read(&block);
+///     mfcc.AcceptWaveform(reader.SampFreq(), block.Row(0).Range(0, n));
+///   }
+///   mfcc.InputFinished();
+/// \endcode
+class WaveStreamReader {
+ public:
+  /// Reads the header, up to the start of the data chunk; throws on error.
+  /// "is" should be opened in binary mode, and must outlive this object.
+  explicit WaveStreamReader(std::istream &is);
+
+  BaseFloat SampFreq() const { return samp_freq_; }
+
+  int32 NumChannels() const { return num_channels_; }
+
+  /// The number of samples (per channel) that the header says the data chunk
+  /// contains; fewer may actually be read if the file is truncated.
+  int32 NumSamplesInHeader() const { return data_bytes_ / block_align_; }
+
+  /// Decodes up to data->NumCols() samples per channel into the leading
+  /// columns of "data", which must have NumChannels() rows, and returns the
+  /// number of samples decoded.  Returns 0 only once Done() is true.
+  int32 Read(MatrixBase<BaseFloat> *data);
+
+  /// Returns true once the whole data chunk (or, for truncated files, all
+  /// that was present) has been read.
+  bool Done() const { return done_; }
+
+ private:
+  static void Expect4ByteTag(std::istream &is, const char *expected);
+  static uint32 ReadUint32(std::istream &is, bool swap);
+  static uint16 ReadUint16(std::istream &is, bool swap);
+  static void Read4ByteTag(std::istream &is, char *dest);
+
+  std::istream &is_;
+  bool swap_;
+  BaseFloat samp_freq_;
+  int32 num_channels_;
+  int32 bits_per_sample_;
+  int32 block_align_;
+  uint32 data_bytes_;  // size of the data chunk, from the header.
+  uint32 bytes_read_;  // number of bytes of the data chunk read so far.
+  bool done_;
+  std::vector<char> buffer_;  // raw bytes for the current Read() call.
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(WaveStreamReader);
+};
+
 class WaveData {
  public:
   WaveData(BaseFloat samp_freq, const MatrixBase<BaseFloat> &data)
@@ -92,14 +151,17 @@ class WaveData {
     samp_freq_ = 0.0;
   }
 
+  void Swap(WaveData *other) {
+    data_.Swap(&(other->data_));
+    std::swap(samp_freq_, other->samp_freq_);
+  }
+
  private:
+  // Read() decodes the samples in blocks of this many bytes, directly into
+  // data_.
   static const uint32 kBlockSize = 1024 * 1024;  // Use 1M bytes.
   Matrix<BaseFloat> data_;
   BaseFloat samp_freq_;
-  static void Expect4ByteTag(std::istream &is, const char *expected);
-  uint32 ReadUint32(std::istream &is, bool swap);
-  uint16 ReadUint16(std::istream &is, bool swap);
-  static void Read4ByteTag(std::istream &is, char *dest);
 
   static void WriteUint32(std::ostream &os, int32 i);
   static void WriteUint16(std::ostream &os, int16 i);
@@ -133,6 +195,8 @@ class WaveHolder {
 
   const T &Value() { return t_; }
 
+  void Swap(WaveHolder *other) { t_.Swap(&(other->t_)); }
+
   WaveHolder &operator = (const WaveHolder &other) {
     t_.CopyFrom(other.t_);
     return *this;
@@ -0,0 +1,132 @@
+// featbin/cache-feats.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "util/table-cache.h"
+#include "matrix/kaldi-matrix.h"
+
+namespace kaldi {
+
+// Writes the entry for "rspecifier"; returns the number of matrices written,
+// or -1 if the entry exists or another process is writing it.
+int32 CacheFeats(const std::string &rspecifier, bool compress,
+                 int32 num_threads, TableCache *cache) {
+  std::string wspecifier;
+  if (!cache->BeginEntry(rspecifier, &wspecifier))
+    return -1;
+  int32 num_done = 0;
+  try {
+    SequentialBaseFloatMatrixReader reader(rspecifier);
+    if (compress) {
+      CompressedMatrixWriter writer(wspecifier);
+      for (; !reader.Done(); reader.Next(), num_done++)
+        writer.Write(reader.Key(), CompressedMatrix(reader.Value(),
+                                                    num_threads));
+    } else {
+      BaseFloatMatrixWriter writer(wspecifier);
+      for (; !reader.Done(); reader.Next(), num_done++)
+        writer.Write(reader.Key(), reader.Value());
+    }
+    if (!reader.Close())
+      KALDI_ERR << "Error reading " << rspecifier;
+  } catch (...) {
+    cache->AbortEntry(rspecifier);
+    throw;
+  }
+  cache->CommitEntry(rspecifier);
+  return num_done;
+}
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+
+    const char *usage =
+        "Reads tables of features (typically the output of a pipeline of\n"
+        "apply-cmvn, splice-feats, transform-feats and so on) and stores them in\n"
+        "the node-local table cache, from which programs on the same node will\n"
+        "read them if their rspecifier has the 'cache' option and\n"
+        "KALDI_TABLE_CACHE is set to the cache directory (see\n"
+        "util/table-cache.h).  Entries that exist or are being written by\n"
+        "another process are skipped.  The rspecifiers must be given exactly as\n"
+        "the programs that read them will give them (apart from the options),\n"
+        "and from the same directory.\n"
+        "Usage: cache-feats [options] <feature-rspecifier1> [<feature-rspecifier2> ...]\n"
+        "e.g.:\n"
+        " export KALDI_TABLE_CACHE=/dev/shm/kaldi-cache\n"
+        " feats=\"ark,s,cs,cache:apply-cmvn --utt2spk=ark:utt2spk scp:cmvn.scp "
+        "scp:feats.scp ark:- |\"\n"
+        " cache-feats \"$feats\"; gmm-acc-stats-ali 1.mdl \"$feats\" ark:ali 1.acc\n"
+        "See also: copy-feats\n";
+
+    ParseOptions po(usage);
+    std::string cache_dir;
+    bool compress = true, remove = false;
+    int32 num_threads = 1;
+    po.Register("cache-dir", &cache_dir, "Directory of the table cache (by "
+                "default, the value of KALDI_TABLE_CACHE).  It should be on a "
+                "node-local filesystem, e.g. /dev/shm or a local SSD.");
+    po.Register("compress", &compress, "If true, store the features as "
+                "CompressedMatrix.");
+    po.Register("num-threads", &num_threads, "Number of threads used to "
+                "compress each matrix (if --compress=true); only helps for "
+                "large matrices.");
+    po.Register("remove", &remove, "If true, remove the entries for the "
+                "rspecifiers instead of writing them.");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 1) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    TableCache cache(cache_dir);
+    if (!cache.IsEnabled())
+      KALDI_ERR << "Use the --cache-dir option or set KALDI_TABLE_CACHE.";
+
+    int32 num_error = 0;
+    for (int32 i = 1; i <= po.NumArgs(); i++) {
+      std::string rspecifier = po.GetArg(i);
+      if (ClassifyRspecifier(rspecifier, NULL, NULL) == kNoRspecifier)
+        KALDI_ERR << "Invalid rspecifier " << rspecifier;
+      if (remove) {
+        if (cache.RemoveEntry(rspecifier))
+          KALDI_LOG << "Removed the table cache entry for " << rspecifier;
+        else
+          KALDI_WARN << "No table cache entry for " << rspecifier;
+        continue;
+      }
+      int32 num_done = CacheFeats(rspecifier, compress, num_threads, &cache);
+      if (num_done == 0) {
+        KALDI_WARN << "No features were read from " << rspecifier;
+        num_error++;
+      } else if (num_done > 0) {
+        KALDI_LOG << "Cached " << num_done << " feature matrices from "
+                  << rspecifier << " in " << cache.Dir() << " (key "
+                  << TableCache::Key(rspecifier) << ")";
+      }
+    }
+    return (num_error == 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -22,7 +22,84 @@
 #include "util/common-utils.h"
 #include "feat/feature-plp.h"
 #include "feat/wave-reader.h"
+#include "thread/kaldi-task-sequence.h"
+
+
+namespace kaldi {
+
+// This class is used to compute the features of several utterances in
+// parallel, using TaskSequencer.  The features are computed in operator (),
+// and written out in the destructor (TaskSequencer makes sure this happens in
+// the same order as the utterances were read).  The Plp object is shared
+// between the threads; we only call its const Compute() function.
+class PlpComputeTask {
+ public:
+  PlpComputeTask(const Plp &plp, const std::string &utt,
+                 const VectorBase<BaseFloat> &waveform, BaseFloat vtln_warp,
+                 bool subtract_mean, uint16 htk_parameter_kind,
+                 BaseFloatMatrixWriter *kaldi_writer,
+                 TableWriter<HtkMatrixHolder> *htk_writer,
+                 int32 *num_success):
+      plp_(plp), utt_(utt), waveform_(waveform), vtln_warp_(vtln_warp),
+      subtract_mean_(subtract_mean), htk_parameter_kind_(htk_parameter_kind),
+      kaldi_writer_(kaldi_writer), htk_writer_(htk_writer),
+      num_success_(num_success), failed_(false) { }
+
+  void operator () () {
+    try {
+      plp_.Compute(waveform_, vtln_warp_, &features_, NULL);
+    } catch (...) {
+      failed_ = true;
+      return;
+    }
+    if (subtract_mean_) {
+      Vector<BaseFloat> mean(features_.NumCols());
+      mean.AddRowSumMat(1.0, features_);
+      mean.Scale(1.0 / features_.NumRows());
+      for (int32 i = 0; i < features_.NumRows(); i++)
+        features_.Row(i).AddVec(-1.0, mean);
+    }
+  }
 
+  ~PlpComputeTask() {
+    if (failed_) {
+      KALDI_WARN << "Failed to compute features for utterance "
+                 << utt_;
+      return;
+    }
+    if (kaldi_writer_ != NULL) {
+      kaldi_writer_->Write(utt_, features_);
+    } else {
+      std::pair<Matrix<BaseFloat>, HtkHeader> p;
+      p.first.Resize(features_.NumRows(), features_.NumCols());
+      p.first.CopyFromMat(features_);
+      HtkHeader header = {
+        features_.NumRows(),
+        100000,  // 10ms shift
+        static_cast<int16>(sizeof(float)*(features_.NumCols())),
+        htk_parameter_kind_
+      };
+      p.second = header;
+      htk_writer_->Write(utt_, p);
+    }
+    KALDI_VLOG(2) << "Processed features for key " << utt_;
+    (*num_success_)++;
+  }
+ private:
+  const Plp &plp_;
+  std::string utt_;
+  Vector<BaseFloat> waveform_;
+  BaseFloat vtln_warp_;
+  bool subtract_mean_;
+  uint16 htk_parameter_kind_;
+  BaseFloatMatrixWriter *kaldi_writer_;  // exactly one of the writers is
+  TableWriter<HtkMatrixHolder> *htk_writer_;  // non-NULL.
+  int32 *num_success_;
+  Matrix<BaseFloat> features_;
+  bool failed_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -42,6 +119,7 @@ int main(int argc, char *argv[]) {
     BaseFloat min_duration = 0.0;
     // Define defaults for gobal options
     std::string output_format = "kaldi";
+    TaskSequencerConfig sequencer_config;
 
     // Register the options
     po.Register("output-format", &output_format, "Format of the output "
@@ -58,6 +136,7 @@ int main(int argc, char *argv[]) {
                 "0 -> left, 1 -> right)");
     po.Register("min-duration", &min_duration, "Minimum duration of segments "
                 "to process (in seconds).");
+    sequencer_config.Register(&po);
 
     plp_opts.Register(&po);
 
@@ -96,7 +175,15 @@ int main(int argc, char *argv[]) {
       KALDI_ERR << "Invalid output_format string " << output_format;
     }
 
+    uint16 htk_parameter_kind = 013 |  // PLP
+        020000;  // C0 [no option currently to use energy in PLP.
+    // The tasks write their output to whichever of these is non-NULL.
+    BaseFloatMatrixWriter *kaldi_writer_ptr =
+        (output_format == "kaldi" ? &kaldi_writer : NULL);
+    TableWriter<HtkMatrixHolder> *htk_writer_ptr =
+        (output_format == "htk" ? &htk_writer : NULL);
     int32 num_utts = 0, num_success = 0;
+    TaskSequencer<PlpComputeTask> sequencer(sequencer_config);
     for (; !reader.Done(); reader.Next()) {
       num_utts++;
       std::string utt = reader.Key();
@@ -142,42 +229,14 @@ int main(int argc, char *argv[]) {
                   << "option).  Utterance is " << utt;
 
       SubVector<BaseFloat> waveform(wave_data.Data(), this_chan);
-      Matrix<BaseFloat> features;
-      try {
-        plp.Compute(waveform, vtln_warp_local, &features, NULL);
-      } catch (...) {
-        KALDI_WARN << "Failed to compute features for utterance "
-                   << utt;
-        continue;
-      }
-      if (subtract_mean) {
-        Vector<BaseFloat> mean(features.NumCols());
-        mean.AddRowSumMat(1.0, features);
-        mean.Scale(1.0 / features.NumRows());
-        for (size_t i = 0; i < features.NumRows(); i++)
-          features.Row(i).AddVec(-1.0, mean);
-      }
-      if (output_format == "kaldi") {
-        kaldi_writer.Write(utt, features);
-      } else {
-        std::pair<Matrix<BaseFloat>, HtkHeader> p;
-        p.first.Resize(features.NumRows(), features.NumCols());
-        p.first.CopyFromMat(features);
-        HtkHeader header = {
-          features.NumRows(),
-          100000,  // 10ms shift
-          static_cast<int16>(sizeof(float)*features.NumCols()),
-          013 | // PLP
-          020000 // C0 [no option currently to use energy in PLP.
-        };
-        p.second = header;
-        htk_writer.Write(utt, p);
-      }
+      sequencer.Run(new PlpComputeTask(plp, utt, waveform, vtln_warp_local,
+                                       subtract_mean, htk_parameter_kind,
+                                       kaldi_writer_ptr, htk_writer_ptr,
+                                       &num_success));
       if (num_utts % 10 == 0)
         KALDI_LOG << "Processed " << num_utts << " utterances";
-      KALDI_VLOG(2) << "Processed features for key " << utt;
-      num_success++;
     }
+    sequencer.Wait();
     KALDI_LOG << " Done " << num_success << " out of " << num_utts
               << " utterances.";
     return (num_success != 0 ? 0 : 1);
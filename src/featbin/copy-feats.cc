@@ -41,6 +41,7 @@ int main(int argc, char *argv[]) {
     bool htk_in = false;
     bool sphinx_in = false;
     bool compress = false;
+    int32 num_threads = 1;
     po.Register("htk-in", &htk_in, "Read input as HTK features");
     po.Register("sphinx-in", &sphinx_in, "Read input as Sphinx features");
     po.Register("binary", &binary, "Binary-mode output (not relevant if writing "
@@ -48,6 +49,9 @@ int main(int argc, char *argv[]) {
     po.Register("compress", &compress, "If true, write output in compressed form"
                 "(only currently supported for wxfilename, i.e. archive/script,"
                 "output)");
+    po.Register("num-threads", &num_threads, "Number of threads used to "
+                "compress each matrix (if --compress=true); only helps for "
+                "large matrices.");
     
     po.Read(argc, argv);
 
@@ -84,17 +88,20 @@ int main(int argc, char *argv[]) {
           SequentialTableReader<HtkMatrixHolder> htk_reader(rspecifier);
           for (; !htk_reader.Done(); htk_reader.Next(), num_done++)
             kaldi_writer.Write(htk_reader.Key(),
-                               CompressedMatrix(htk_reader.Value().first));
+                               CompressedMatrix(htk_reader.Value().first,
+                                                num_threads));
         } else if (sphinx_in) {
           SequentialTableReader<SphinxMatrixHolder<> > sphinx_reader(rspecifier);
           for (; !sphinx_reader.Done(); sphinx_reader.Next(), num_done++)
             kaldi_writer.Write(sphinx_reader.Key(),
-                               CompressedMatrix(sphinx_reader.Value()));
+                               CompressedMatrix(sphinx_reader.Value(),
+                                                num_threads));
         } else {
           SequentialBaseFloatMatrixReader kaldi_reader(rspecifier);
           for (; !kaldi_reader.Done(); kaldi_reader.Next(), num_done++)
             kaldi_writer.Write(kaldi_reader.Key(),
-                               CompressedMatrix(kaldi_reader.Value()));
+                               CompressedMatrix(kaldi_reader.Value(),
+                                                num_threads));
         }
       }
       KALDI_LOG << "Copied " << num_done << " feature matrices.";
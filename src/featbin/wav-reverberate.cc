@@ -40,16 +40,16 @@ BaseFloat MaxAbsolute(const Vector<BaseFloat> &vector) {
   return std::max(std::abs(vector.Max()), std::abs(vector.Min()));
 }
 
-/* 
-   Early reverberation component of the signal is composed of reflections 
-   within 0.05 seconds of the direct path signal (assumed to be the peak of 
-   the room impulse response). This function returns the energy in 
-   this early reverberation component of the signal. 
-   The input parameters to this function are the room impulse response, the signal
-   and their sampling frequency respectively.
+/*
+   Early reverberation component of the signal is composed of reflections
+   within 0.05 seconds of the direct path signal (assumed to be the peak of
+   the room impulse response). This function returns the part of the
+   room impulse response that gives this early reverberation component.
+   The input parameters to this function are the room impulse response
+   and its sampling frequency respectively.
 */
-BaseFloat ComputeEarlyReverbEnergy(const Vector<BaseFloat> &rir, const Vector<BaseFloat> &signal,
-                                   BaseFloat samp_freq) {
+Vector<BaseFloat> GetEarlyRir(const Vector<BaseFloat> &rir,
+                              BaseFloat samp_freq) {
   int32 peak_index = 0;
   rir.Max(&peak_index);
   KALDI_VLOG(1) << "peak index is " << peak_index;
@@ -62,9 +62,18 @@ BaseFloat ComputeEarlyReverbEnergy(const Vector<BaseFloat> &rir, const Vector<Ba
   if (early_rir_end_index > rir.Dim()) early_rir_end_index = rir.Dim();
 
   int32 duration = early_rir_end_index - early_rir_start_index;
-  Vector<BaseFloat> early_rir(rir.Range(early_rir_start_index, duration));
+  return Vector<BaseFloat>(rir.Range(early_rir_start_index, duration));
+}
+
+/*
+   This function returns the energy in the early reverberation component of
+   the signal (see GetEarlyRir()); "early_rir" is a convolver for the early
+   part of the room impulse response.
+*/
+BaseFloat ComputeEarlyReverbEnergy(const FftBlockConvolver &early_rir,
+                                   const Vector<BaseFloat> &signal) {
   Vector<BaseFloat> early_reverb(signal);
-  FFTbasedBlockConvolveSignals(early_rir, &early_reverb);
+  early_rir.Convolve(&early_reverb);
 
   // compute the energy
   return VecVec(early_reverb, early_reverb) / early_reverb.Dim();
@@ -75,14 +84,16 @@ BaseFloat ComputeEarlyReverbEnergy(const Vector<BaseFloat> &rir, const Vector<Ba
    on the given signal. The noise will be scaled before the addition
    to match the given signal-to-noise ratio (SNR) and it will also concatenate
    itself repeatedly to match the length of the signal.
-   The input parameters to this function are the room impulse response,
-   the sampling frequency, the SNR(dB), the noise and the signal respectively.
+   The input parameters to this function are convolvers for the room impulse
+   response and for its early part, the SNR(dB), the noise and the signal
+   respectively.
 */
-void DoReverberation(const Vector<BaseFloat> &rir, BaseFloat samp_freq,
-                        BaseFloat snr_db, Vector<BaseFloat> *noise,
-                        Vector<BaseFloat> *signal) {
+void DoReverberation(const FftBlockConvolver &rir,
+                     const FftBlockConvolver &early_rir,
+                     BaseFloat snr_db, Vector<BaseFloat> *noise,
+                     Vector<BaseFloat> *signal) {
   if (noise->Dim()) {
-    float input_power = ComputeEarlyReverbEnergy(rir, *signal, samp_freq);
+    float input_power = ComputeEarlyReverbEnergy(early_rir, *signal);
     float noise_power = VecVec(*noise, *noise) / noise->Dim();
     float scale_factor = sqrt(pow(10, -snr_db / 10) * input_power / noise_power);
     noise->Scale(scale_factor);
@@ -90,12 +101,70 @@ void DoReverberation(const Vector<BaseFloat> &rir, BaseFloat samp_freq,
                   << " to generate output with SNR " << snr_db << "db\n";
   }
 
-  FFTbasedBlockConvolveSignals(rir, signal);
+  rir.Convolve(signal);
 
   if (noise->Dim() > 0) {
     AddVectorsOfUnequalLength(*noise, signal);
   }
 }
+
+/*
+   The options of wav-reverberate, and the room impulse responses and noise,
+   which are the same for all the waves processed.  The impulse responses are
+   transformed (for the FFT-based convolution) once, when they are set up,
+   rather than for each wave.
+*/
+struct ReverberationConfig {
+  BaseFloat snr_db;
+  int32 input_channel;
+  bool normalize_output;
+  BaseFloat volume;
+  // The following are indexed by output channel.
+  std::vector<FftBlockConvolver*> rirs;
+  std::vector<FftBlockConvolver*> early_rirs;
+  std::vector<Vector<BaseFloat> > noises;  // empty vectors if no noise.
+
+  ReverberationConfig(): snr_db(20), input_channel(0),
+                         normalize_output(true), volume(0) { }
+  ~ReverberationConfig() {
+    DeletePointers(&rirs);
+    DeletePointers(&early_rirs);
+  }
+};
+
+/*
+   Reverberates one input wave, and adds noise if any, producing the matrix of
+   the output wave, with one row per output channel.
+*/
+void ReverberateWave(const ReverberationConfig &config,
+                     const Matrix<BaseFloat> &input_matrix,
+                     Matrix<BaseFloat> *out_matrix) {
+  int32 num_samp_input = input_matrix.NumCols(),
+      num_output_channels = config.rirs.size();
+  KALDI_ASSERT(config.input_channel < input_matrix.NumRows());
+  out_matrix->Resize(num_output_channels, num_samp_input);
+
+  for (int32 output_channel = 0; output_channel < num_output_channels; output_channel++) {
+    Vector<BaseFloat> input(num_samp_input);
+    input.CopyRowFromMat(input_matrix, config.input_channel);
+    float power_before_reverb = VecVec(input, input) / input.Dim();
+
+    Vector<BaseFloat> noise(config.noises[output_channel]);
+
+    DoReverberation(*(config.rirs[output_channel]),
+                    *(config.early_rirs[output_channel]),
+                    config.snr_db, &noise, &input);
+
+    float power_after_reverb = VecVec(input, input) / input.Dim();
+
+    if (config.volume > 0)
+      input.Scale(config.volume);
+    else if (config.normalize_output)
+      input.Scale(sqrt(power_before_reverb / power_after_reverb));
+
+    out_matrix->CopyRowFromVec(input, output_channel);
+  }
+}
 }
 
 int main(int argc, char *argv[]) {
@@ -105,21 +174,24 @@ int main(int argc, char *argv[]) {
     const char *usage =
         "Corrupts the wave files supplied via input pipe with the specified\n"
         "room-impulse response (rir_matrix) and additive noise distortions\n"
-        "(specified by corresponding files).\n";
+        "(specified by corresponding files).\n"
+        "Usage:  wav-reverberate [options...] <wav-in-rxfilename> "
+        "<rir-rxfilename> <wav-out-wxfilename>\n"
+        " or:  wav-reverberate [options...] <wav-rspecifier> "
+        "<rir-rxfilename> <wav-wspecifier>\n"
+        "The second form processes a table of waves (e.g. scp:wav.scp) with\n"
+        "the same room impulse response, which is only transformed once.\n";
 
     ParseOptions po(usage);
     std::string noise_file;
-    BaseFloat snr_db = 20;
+    ReverberationConfig config;
     bool multi_channel_output = false;
-    int32 input_channel = 0;
     int32 rir_channel = 0;
     int32 noise_channel = 0;
-    bool normalize_output = true;
-    BaseFloat volume = 0;
 
     po.Register("multi-channel-output", &multi_channel_output,
                 "Specifies if the output should be multi-channel or not");
-    po.Register("input-wave-channel", &input_channel,
+    po.Register("input-wave-channel", &config.input_channel,
                 "Specifies the channel to be used from input as only a "
                 "single channel will be used to generate reverberated output");
     po.Register("rir-channel", &rir_channel,
@@ -130,13 +202,13 @@ int main(int argc, char *argv[]) {
                 "it will only be used when multi-channel-output is false");
     po.Register("noise-file", &noise_file,
                 "File with additive noise");
-    po.Register("snr-db", &snr_db,
+    po.Register("snr-db", &config.snr_db,
                 "Desired SNR(dB) of the output");
-    po.Register("normalize-output", &normalize_output,
+    po.Register("normalize-output", &config.normalize_output,
                 "If true, then after reverberating and "
                 "possibly adding noise, scale so that the signal "
                 "energy is the same as the original input signal.");
-    po.Register("volume", &volume,
+    po.Register("volume", &config.volume,
                 "If nonzero, a scaling factor on the signal that is applied "
                 "after reverberating and possibly adding noise. "
                 "If you set this option to a nonzero value, it will be as"
@@ -158,21 +230,6 @@ int main(int argc, char *argv[]) {
     std::string rir_file = po.GetArg(2);
     std::string output_wave_file = po.GetArg(3);
 
-    WaveData input_wave;
-    {
-      Input ki(input_wave_file);
-      input_wave.Read(ki.Stream());
-    }
-
-    const Matrix<BaseFloat> &input_matrix = input_wave.Data();
-    BaseFloat samp_freq_input = input_wave.SampFreq();
-    int32 num_samp_input = input_matrix.NumCols(),  // #samples in the input
-          num_input_channel = input_matrix.NumRows();  // #channels in the input
-    KALDI_VLOG(1) << "sampling frequency of input: " << samp_freq_input
-                  << " #samples: " << num_samp_input
-                  << " #channel: " << num_input_channel;
-    KALDI_ASSERT(input_channel < num_input_channel);
-
     WaveData rir_wave;
     {
       Input ki(rir_file);
@@ -211,17 +268,14 @@ int main(int argc, char *argv[]) {
     }
 
     int32 num_output_channels = (multi_channel_output ? num_rir_channel : 1);
-    Matrix<BaseFloat> out_matrix(num_output_channels, num_samp_input);
-
     for (int32 output_channel = 0; output_channel < num_output_channels; output_channel++) {
-      Vector<BaseFloat> input(num_samp_input);
-      input.CopyRowFromMat(input_matrix, input_channel);
-      float power_before_reverb = VecVec(input, input) / input.Dim();
-
       int32 this_rir_channel = (multi_channel_output ? output_channel : rir_channel);
       Vector<BaseFloat> rir(num_samp_rir);
       rir.CopyRowFromMat(rir_matrix, this_rir_channel);
       rir.Scale(1.0 / (1 << 15));
+      config.rirs.push_back(new FftBlockConvolver(rir));
+      config.early_rirs.push_back(
+          new FftBlockConvolver(GetEarlyRir(rir, samp_freq_rir)));
 
       Vector<BaseFloat> noise(0);
       if (!noise_file.empty()) {
@@ -229,18 +283,40 @@ int main(int argc, char *argv[]) {
         int32 this_noise_channel = (multi_channel_output ? output_channel : noise_channel);
         noise.CopyRowFromMat(noise_matrix, this_noise_channel);
       }
+      config.noises.push_back(noise);
+    }
 
-      DoReverberation(rir, samp_freq_rir, snr_db, &noise, &input);
+    if (ClassifyRspecifier(input_wave_file, NULL, NULL) != kNoRspecifier) {
+      SequentialTableReader<WaveHolder> reader(input_wave_file);
+      TableWriter<WaveHolder> writer(output_wave_file);
+      int32 num_done = 0;
+      for (; !reader.Done(); reader.Next()) {
+        const WaveData &input_wave = reader.Value();
+        Matrix<BaseFloat> out_matrix;
+        ReverberateWave(config, input_wave.Data(), &out_matrix);
+        writer.Write(reader.Key(), WaveData(input_wave.SampFreq(), out_matrix));
+        num_done++;
+      }
+      KALDI_LOG << "Reverberated " << num_done << " waves.";
+      return (num_done != 0 ? 0 : 1);
+    }
 
-      float power_after_reverb = VecVec(input, input) / input.Dim();
+    WaveData input_wave;
+    {
+      Input ki(input_wave_file);
+      input_wave.Read(ki.Stream());
+    }
 
-      if (volume > 0)
-        input.Scale(volume);
-      else if (normalize_output)
-        input.Scale(sqrt(power_before_reverb / power_after_reverb));
+    const Matrix<BaseFloat> &input_matrix = input_wave.Data();
+    BaseFloat samp_freq_input = input_wave.SampFreq();
+    int32 num_samp_input = input_matrix.NumCols(),  // #samples in the input
+          num_input_channel = input_matrix.NumRows();  // #channels in the input
+    KALDI_VLOG(1) << "sampling frequency of input: " << samp_freq_input
+                  << " #samples: " << num_samp_input
+                  << " #channel: " << num_input_channel;
 
-      out_matrix.CopyRowFromVec(input, output_channel);
-    }
+    Matrix<BaseFloat> out_matrix;
+    ReverberateWave(config, input_matrix, &out_matrix);
 
     WaveData out_wave(samp_freq_input, out_matrix);
     Output ko(output_wave_file, false);
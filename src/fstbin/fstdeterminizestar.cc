@@ -24,6 +24,7 @@
 #include "fstext/determinize-star.h"
 #include "fstext/fstext-utils.h"
 #include "fstext/kaldi-fst-io.h"
+#include "thread/kaldi-thread.h"
 #ifndef _MSC_VER
 #include <signal.h> // Comment this line and the call to signal below if
 // it causes compilation problems.  It is only to enable a debugging procedure
@@ -79,6 +80,9 @@ int main(int argc, char *argv[]) {
     po.Register("use-log", &use_log, "Determinize in log semiring.");
     po.Register("delta", &delta, "Delta value used to determine equivalence of weights.");
     po.Register("max-states", &max_states, "Maximum number of states in determinized FST before it will abort.");
+    po.Register("num-threads", &g_num_threads, "Number of threads to use; "
+                "with more than one, the output states are numbered in "
+                "breadth-first order.");
     po.Read(argc, argv);
 
     if (po.NumArgs() > 2) {
@@ -100,10 +104,12 @@ int main(int argc, char *argv[]) {
 
       ArcSort(fst, ILabelCompare<StdArc>());  // improves speed.
       if (use_log) {
-        DeterminizeStarInLog(fst, delta, &debug_location, max_states);
+        DeterminizeStarInLog(fst, delta, &debug_location, max_states,
+                             g_num_threads);
       } else {
         VectorFst<StdArc> det_fst;
-        DeterminizeStar(*fst, &det_fst, delta, &debug_location, max_states);
+        DeterminizeStar(*fst, &det_fst, delta, &debug_location, max_states,
+                        false, g_num_threads);
         *fst = det_fst;  // will do shallow copy and then det_fst goes
         // out of scope anyway.
       }
@@ -119,10 +125,12 @@ int main(int argc, char *argv[]) {
         ArcSort(&fst, ILabelCompare<StdArc>()); // improves speed.
         try {
           if (use_log) {
-            DeterminizeStarInLog(&fst, delta, &debug_location, max_states);
+            DeterminizeStarInLog(&fst, delta, &debug_location, max_states,
+                                 g_num_threads);
           } else {
             VectorFst<StdArc> det_fst;
-            DeterminizeStar(fst, &det_fst, delta, &debug_location, max_states);
+            DeterminizeStar(fst, &det_fst, delta, &debug_location, max_states,
+                            false, g_num_threads);
             fst = det_fst;  // will do shallow copy and then det_fst goes out
             // of scope anyway.
           }
@@ -23,8 +23,10 @@
 #include "util/common-utils.h"
 #include "fst/fstlib.h"
 #include "fstext/table-matcher.h"
+#include "fstext/parallel-compose.h"
 #include "fstext/fstext-utils.h"
 #include "fstext/kaldi-fst-io.h"
+#include "thread/kaldi-thread.h"
 
 
 /*
@@ -58,14 +60,17 @@ int main(int argc, char *argv[]) {
         "Composition algorithm [between two FSTs of standard type, in tropical\n"
         "semiring] that is more efficient for certain cases-- in particular,\n"
         "where one of the FSTs (the left one, if --match-side=left) has large\n"
-        "out-degree\n"
+        "out-degree.  With --num-threads > 1 (only for single FSTs and\n"
+        "--match-side=left --compose-filter=sequence), the composed states are\n"
+        "expanded on several threads; this is for large compositions such as\n"
+        "L o G.\n"
         "\n"
         "Usage:  fsttablecompose (fst1-rxfilename|fst1-rspecifier) "
         "(fst2-rxfilename|fst2-rspecifier) [(out-rxfilename|out-rspecifier)]\n";
 
     ParseOptions po(usage);
 
-    TableComposeOptions opts;
+    ParallelComposeOptions opts;
     std::string match_side = "left";
     std::string compose_filter = "sequence";
 
@@ -74,7 +79,12 @@ int main(int argc, char *argv[]) {
                 "match, one of: \"left\" or \"right\".");
     po.Register("compose-filter", &compose_filter, "Composition filter to use, "
                 "one of: \"alt_sequence\", \"auto\", \"match\", \"sequence\"");
-    
+    po.Register("num-threads", &opts.num_threads, "Number of threads used "
+                "when composing single FSTs");
+    po.Register("max-table-size", &opts.max_table_size, "With --num-threads "
+                "> 1, the maximum total size of the label lookup tables of "
+                "the states of the first FST (bounds their memory)");
+
     po.Read(argc, argv);
 
     if (match_side == "left") {
@@ -134,7 +144,16 @@ int main(int argc, char *argv[]) {
       
       VectorFst<StdArc> composed_fst;
 
-      TableCompose(*fst1, *fst2, &composed_fst, opts);
+      if (opts.num_threads > 1 && opts.table_match_type == MATCH_OUTPUT &&
+          opts.filter_type == SEQUENCE_FILTER) {
+        g_num_threads = opts.num_threads;
+        ParallelTableCompose(*fst1, *fst2, &composed_fst, opts);
+      } else {
+        if (opts.num_threads > 1)
+          KALDI_WARN << "--num-threads > 1 requires --match-side=left and "
+                     << "--compose-filter=sequence; using one thread.";
+        TableCompose(*fst1, *fst2, &composed_fst, opts);
+      }
 
       delete fst1;
       delete fst2;
@@ -38,21 +38,27 @@ typename ContextFstImpl<Arc, LabelT>::StateId
   // Finds state-id corresponding to this vector of phones.  Inserts it if
   // necessary.
   assert(static_cast<int32>(seq.size()) == N_-1);
-  VectorToStateIter iter = state_map_.find(seq);
-  if (iter == state_map_.end()) {  // Not already in map.
-    StateId this_state_id = (StateId)state_seqs_.size();
-    //This check is not needed with OpenFst >= 1.4
-#ifndef HAVE_OPENFST_GE_10400
-    StateId this_state_id_check = CacheImpl<Arc>::AddState();
-    // goes back to VectorFstBaseImpl<Arc>, inherited via CacheFst<Arc>
-    assert(this_state_id == this_state_id_check);
-#endif
-    state_seqs_.push_back(seq);
-    state_map_[seq] = this_state_id;
-    return this_state_id;
+  StateId this_state_id = num_states_;
+  if (pack_bits_ > 0) {
+    std::pair<typename unordered_map<uint64, StateId>::iterator, bool> ret =
+        packed_state_map_.insert(std::make_pair(
+            Pack(seq.empty() ? NULL : &(seq[0]), N_ - 1), this_state_id));
+    if (!ret.second) return ret.first->second;
   } else {
-    return iter->second;
+    VectorToStateIter iter = state_map_.find(seq);
+    if (iter != state_map_.end()) return iter->second;
+    state_map_[seq] = this_state_id;
   }
+  // Not already in map.
+  //This check is not needed with OpenFst >= 1.4
+#ifndef HAVE_OPENFST_GE_10400
+  StateId this_state_id_check = CacheImpl<Arc>::AddState();
+  // goes back to VectorFstBaseImpl<Arc>, inherited via CacheFst<Arc>
+  assert(this_state_id == this_state_id_check);
+#endif
+  state_seqs_.insert(state_seqs_.end(), seq.begin(), seq.end());
+  num_states_++;
+  return this_state_id;
 }
 
 template<class Arc, class LabelT>
@@ -70,6 +76,18 @@ ContextFstImpl<Arc, LabelT>::FindLabel(const vector<LabelT> &label_vec) {
   }
 }
 
+template<class Arc, class LabelT>
+typename ContextFstImpl<Arc, LabelT>::Label
+ContextFstImpl<Arc, LabelT>::FindWindowLabel(const vector<LabelT> &phone_seq) {
+  assert(static_cast<int32>(phone_seq.size()) == N_);
+  if (pack_bits_ == 0) return FindLabel(phone_seq);
+  std::pair<typename unordered_map<uint64, Label>::iterator, bool> ret =
+      packed_ilabel_map_.insert(std::make_pair(Pack(&(phone_seq[0]), N_),
+          static_cast<Label>(ilabel_info_.size())));
+  if (ret.second)  // Not already in map.
+    ilabel_info_.push_back(phone_seq);
+  return ret.first->second;
+}
 
 template<class Arc, class LabelT>
 typename ContextFstImpl<Arc, LabelT>::StateId ContextFstImpl<Arc, LabelT>::Start() {
@@ -99,6 +117,7 @@ ContextFstImpl<Arc, LabelT>::ContextFstImpl(Label subsequential_symbol,  // epsi
                                             const vector<LabelT> &disambig_syms,  // on output
                                             int N,
                                             int P):
+    num_states_(0), pack_bits_(0),
     phone_syms_(phone_syms),  disambig_syms_(disambig_syms), subsequential_symbol_(subsequential_symbol) ,
     N_(N), P_(P) {
 
@@ -115,6 +134,22 @@ ContextFstImpl<Arc, LabelT>::ContextFstImpl(Label subsequential_symbol,  // epsi
     assert(N>0 && P>=0 && P<N);
   }
   SetType("context");
+
+  {  // Work out how many bits we need to pack N phones into 64 bits, if we
+     // can; the phone sequences contain phones, 0 and the subsequential
+     // symbol.
+    Label max_label = std::max<Label>(subsequential_symbol, 1),
+        min_label = subsequential_symbol;
+    for (size_t i = 0; i < phone_syms.size(); i++) {
+      max_label = std::max<Label>(max_label, phone_syms[i]);
+      min_label = std::min<Label>(min_label, phone_syms[i]);
+    }
+    int bits = 1;
+    while (bits < 63 && (static_cast<uint64>(1) << bits) <= static_cast<uint64>(max_label))
+      bits++;
+    if (min_label > 0 && bits * N <= 64)
+      pack_bits_ = bits;
+  }
   assert(subsequential_symbol_ != 0);  // it's OK to be kNoLabel though, if it never appears in ifst.
 
   assert(disambig_syms_.count(subsequential_symbol_) == 0 && phone_syms_.count(subsequential_symbol_) == 0);
@@ -146,12 +181,11 @@ ContextFstImpl<Arc, LabelT>::ContextFstImpl(Label subsequential_symbol,  // epsi
 
 template<class Arc, class LabelT>
 typename ContextFstImpl<Arc, LabelT>::Weight ContextFstImpl<Arc, LabelT>::Final(StateId s) {
-  assert(static_cast<size_t>(s) < state_seqs_.size());  // make sure state exists already.
+  assert(s >= 0 && s < num_states_);  // make sure state exists already.
   if (!this->HasFinal(s)) {  // Work out final-state weight.
-    const vector<LabelT> &seq = state_seqs_[s];
-    
+    const LabelT *seq = StateSeq(s);
+
     bool final_ok;
-    assert(static_cast<int32>(seq.size()) == N_-1);
 
     if (P_ < N_ - 1) {
       /* Note that P_ (in zero based indexing) is the "central position", and for arcs out of
@@ -181,10 +215,9 @@ size_t ContextFstImpl<Arc, LabelT>::NumArcs(StateId s) {
   if (this->HasArcs(s)) {
     return CacheImpl<Arc>::NumArcs(s);
   }
-  KALDI_ASSERT(s >= 0 && s < state_seqs_.size());
-  const vector<LabelT> &seq = state_seqs_[s];
-  KALDI_ASSERT(seq.size() == N_ - 1);
-  if (!seq.empty() && seq.back() == subsequential_symbol_) {
+  KALDI_ASSERT(s >= 0 && s < num_states_);
+  const LabelT *seq = StateSeq(s);
+  if (N_ > 1 && seq[N_ - 2] == subsequential_symbol_) {
     // State is not a "normal" state because it just saw the subsequential symbol,
     // hence it cannot accept phones.
 
@@ -255,7 +288,7 @@ bool ContextFstImpl<Arc, LabelT>::CreatePhoneOrEpsArc(StateId src,
     return true;
   } else {
     // have a phone in central position.
-    Label ilabel = FindLabel(phone_seq);
+    Label ilabel = FindWindowLabel(phone_seq);
     *oarc = Arc(ilabel, olabel, Weight::One(), dst);
     return true;
   }
@@ -276,7 +309,7 @@ bool ContextFstImpl<Arc, LabelT>::CreateArc(StateId s,
 
   if (olabel == 0) return false;  // No epsilon-output arcs in this FST.
 
-  const vector<LabelT> &seq = state_seqs_[s];
+  const LabelT *seq = StateSeq(s);
 
   if (IsDisambigSymbol(olabel)) {  // Disambiguation-symbol arcs.. create self-loop.
     CreateDisambigArc(s, olabel, oarc);
@@ -284,8 +317,8 @@ bool ContextFstImpl<Arc, LabelT>::CreateArc(StateId s,
   } else if (IsPhoneSymbol(olabel) || olabel == subsequential_symbol_) {
     // If all is OK, we shift the old sequence left by 1 and push on the new phone.
 
-    if (olabel != subsequential_symbol_ && !seq.empty() &&
-        seq.back() == subsequential_symbol_) {
+    if (olabel != subsequential_symbol_ && N_ > 1 &&
+        seq[N_ - 2] == subsequential_symbol_) {
       return false;  // Phone not allowed to follow subsequential symbol.
     }
 
@@ -296,12 +329,14 @@ bool ContextFstImpl<Arc, LabelT>::CreateArc(StateId s,
       return false;
     }
 
-    vector<LabelT> newseq(N_-1);  // seq shifted left by 1.
+    vector<LabelT> &newseq = tmp_seq_;  // seq shifted left by 1.
+    newseq.resize(N_-1);
     for (int i = 0;i < N_-2;i++) newseq[i] = seq[i+1];
     if (N_ > 1) newseq[N_-2] = olabel;
 
-    vector<LabelT> phoneseq(seq);  // copy it before FindState which
+    vector<LabelT> &phoneseq = tmp_window_;  // copy it before FindState which
     // possibly changes the address.
+    phoneseq.assign(seq, seq + (N_ - 1));
     StateId nextstate = FindState(newseq);
 
     phoneseq.push_back(olabel);  // Now it's the full context window of size N_.
@@ -320,7 +355,7 @@ bool ContextFstImpl<Arc, LabelT>::CreateArc(StateId s,
 // ContextMatcher<Arc>, which is the normal case.
 template<class Arc, class LabelT>
 void ContextFstImpl<Arc, LabelT>::Expand(StateId s) {  // expands arcs only [not final state weight].
-  assert(static_cast<size_t>(s) < state_seqs_.size());  // make sure state exists already.
+  assert(s >= 0 && s < num_states_);  // make sure state exists already.
 
   // We just try adding all possible symbols on the output side.
   Arc arc;
@@ -512,6 +547,63 @@ SymbolTable *CreateILabelInfoSymbolTable(const vector<vector<I> > &info,
   return ans;
 }
 
+template<class Arc, class LabelT>
+void ComposeContextFst(const ContextFst<Arc, LabelT> &ifst1, const Fst<Arc> &ifst2,
+                       MutableFst<Arc> *ofst,
+                       const ComposeOptions &opts) {
+  typedef typename Arc::StateId StateId;
+  typedef typename Arc::Weight Weight;
+  ofst->DeleteStates();
+  ofst->SetInputSymbols(ifst1.InputSymbols());
+  ofst->SetOutputSymbols(ifst2.OutputSymbols());
+  StateId start1 = ifst1.Start(), start2 = ifst2.Start();
+  if (start1 == kNoStateId || start2 == kNoStateId)
+    return;
+
+  // Maps the pair (state of ifst1, state of ifst2), packed into an integer,
+  // to the output state; "pairs" is indexed by output state.
+  unordered_map<uint64, StateId> pair_map;
+  vector<std::pair<StateId, StateId> > pairs;
+  pairs.push_back(std::make_pair(start1, start2));
+  pair_map[(static_cast<uint64>(start1) << 32) |
+           static_cast<uint32>(start2)] = ofst->AddState();
+  ofst->SetStart(0);
+
+  for (StateId s = 0; s < static_cast<StateId>(pairs.size()); s++) {
+    StateId s1 = pairs[s].first, s2 = pairs[s].second;
+    Weight final = Times(ifst1.Final(s1), ifst2.Final(s2));
+    if (final != Weight::Zero())
+      ofst->SetFinal(s, final);
+    for (ArcIterator<Fst<Arc> > aiter(ifst2, s2); !aiter.Done(); aiter.Next()) {
+      const Arc &arc2 = aiter.Value();
+      Arc arc;
+      if (arc2.ilabel == 0) {  // ifst2 moves on its own.
+        arc = Arc(0, arc2.olabel, arc2.weight, s1);
+      } else {
+        Arc arc1;
+        if (!ifst1.CreateArc(s1, arc2.ilabel, &arc1)) continue;
+        arc = Arc(arc1.ilabel, arc2.olabel, Times(arc1.weight, arc2.weight),
+                  arc1.nextstate);
+      }
+      // arc.nextstate is the state of ifst1; we replace it with the output
+      // state.
+      std::pair<typename unordered_map<uint64, StateId>::iterator, bool> ret =
+          pair_map.insert(std::make_pair(
+              (static_cast<uint64>(arc.nextstate) << 32) |
+              static_cast<uint32>(arc2.nextstate),
+              static_cast<StateId>(pairs.size())));
+      if (ret.second) {
+        pairs.push_back(std::make_pair(arc.nextstate, arc2.nextstate));
+        ofst->AddState();
+      }
+      arc.nextstate = ret.first->second;
+      ofst->AddArc(s, arc);
+    }
+  }
+  if (opts.connect)
+    Connect(ofst);
+}
+
 inline void ComposeContext(vector<int32> &disambig_syms_in,
                            int N, int P,
                            VectorFst<StdArc> *ifst,
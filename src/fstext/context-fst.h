@@ -151,10 +151,28 @@ class ContextFstImpl : public CacheImpl<Arc> {
   //! Finds state-id corresponding to this vector of phones.  Inserts it if necessary.
   StateId FindState(const vector<LabelT> &seq);
 
-  //! Finds the label index corresponding to this context-window of phones.
+  //! Finds the label index corresponding to this ilabel_info entry.
   //! Inserts it if necessary.
   Label FindLabel(const vector<LabelT> &label_info);
 
+  //! Finds the label index corresponding to this context-window of N_ phones
+  //! (as FindLabel(), but uses the packed map where possible).
+  Label FindWindowLabel(const vector<LabelT> &phone_seq);
+
+  // Returns the phone sequence of state s (N_-1 labels).
+  const LabelT *StateSeq(StateId s) const {
+    return (N_ == 1 ? NULL : &(state_seqs_[s * (N_ - 1)]));
+  }
+
+  // Packs n labels into an integer, with pack_bits_ bits per label.  Only
+  // called if pack_bits_ > 0.
+  uint64 Pack(const LabelT *seq, int n) const {
+    uint64 ans = 0;
+    for (int i = 0; i < n; i++)
+      ans = (ans << pack_bits_) | static_cast<uint64>(seq[i]);
+    return ans;
+  }
+
   // Ask whether symbol on output side is disambiguation symbol.
   bool IsDisambigSymbol(Label lab) {  return (disambig_syms_.count(lab) != 0); }
 
@@ -166,13 +184,28 @@ class ContextFstImpl : public CacheImpl<Arc> {
   inline bool CreatePhoneOrEpsArc(StateId src, StateId dst, Label olabel,
                                   const vector<LabelT> &phone_seq, Arc *oarc);
 
-  // maps from vector<LabelT> to StateId.
+  // The phone sequences of the states, N_-1 labels per state, one after the
+  // other (so we don't need a vector per state).
+  vector<LabelT> state_seqs_;
+  StateId num_states_;
+  // The number of bits per label that we use to pack phone sequences into a
+  // uint64 for the maps below; it is 0 (and we use the vector-keyed maps) if
+  // N_ phones don't fit in 64 bits.
+  int pack_bits_;
+  // maps from packed phone sequence to StateId, if pack_bits_ > 0.
+  unordered_map<uint64, StateId> packed_state_map_;
+  // maps from vector<LabelT> to StateId, if pack_bits_ == 0.
   VectorToStateType state_map_;
-  vector<vector<LabelT> > state_seqs_;
 
-  // maps from vector<LabelT> to Label
+  // maps from packed context window to Label, if pack_bits_ > 0.
+  unordered_map<uint64, Label> packed_ilabel_map_;
+  // maps from vector<LabelT> to Label, for ilabels that are not context
+  // windows (epsilon and disambiguation symbols) or if pack_bits_ == 0.
   VectorToLabelType ilabel_map_;
   vector<vector<LabelT> > ilabel_info_;
+  // Temporary vectors used in CreateArc().
+  vector<LabelT> tmp_seq_;
+  vector<LabelT> tmp_window_;
 
   // Stuff we were provided at input (but changed to more convenient form):
   kaldi::ConstIntegerSet<Label> phone_syms_;
@@ -482,21 +515,19 @@ class ContextMatcher : public MatcherBase<Arc> {  // CAREFUL: templated on arc,
 /* This is a specialization of Compose, where the left argument is of
    type ContextFst.
    For clarity we distinguish it with a different name.
-   It uses the special matcher which should be more efficient than
-   a normal matcher.
+   It does not use ComposeFst: it visits the composed states breadth-first,
+   creating the arcs of ifst1 on demand with CreateArc() as ContextMatcher
+   does, and writes them straight to ofst, so nothing is cached apart from the
+   map from pairs of states to output states.  Because a ContextFst has no
+   epsilons on its output side, no composition filter is needed (the
+   filter_type in "opts" is ignored).
    The fst ifst2 must have the subsequential loop (if not a left-context-only
    system)
 */
 template<class Arc, class LabelT>
 void ComposeContextFst(const ContextFst<Arc, LabelT> &ifst1, const Fst<Arc> &ifst2,
                        MutableFst<Arc> *ofst,
-                       const ComposeOptions &opts = ComposeOptions()) {
-  ComposeFstOptions<Arc, ContextMatcher<Arc, LabelT> > nopts;
-  nopts.gc_limit = 0;  // Cache only the most recent state for fastest copy.
-  *ofst = ComposeFst<Arc>(ifst1, ifst2, nopts);
-  if (opts.connect)
-    Connect(ofst);
-}
+                       const ComposeOptions &opts = ComposeOptions());
 
 /**
    Used in the command-line tool fstcomposecontext.  It creates a context FST and
@@ -217,6 +217,21 @@ inline size_t CacheDeterministicOnDemandFst<Arc>::GetIndex(
       static_cast<size_t>(num_cached_arcs_);
 }
 
+template<class Arc>
+typename Arc::Weight ScaleDeterministicOnDemandFst<Arc>::Final(StateId s) {
+  Weight w = fst_->Final(s);
+  if (w == Weight::Zero()) return w;  // non-final states stay non-final.
+  return Weight(w.Value() * scale_);
+}
+
+template<class Arc>
+bool ScaleDeterministicOnDemandFst<Arc>::GetArc(StateId s, Label ilabel,
+                                                Arc *oarc) {
+  if (!fst_->GetArc(s, ilabel, oarc)) return false;
+  oarc->weight = Weight(oarc->weight.Value() * scale_);
+  return true;
+}
+
 template<class Arc>
 CacheDeterministicOnDemandFst<Arc>::CacheDeterministicOnDemandFst(
     DeterministicOnDemandFst<Arc> *fst,
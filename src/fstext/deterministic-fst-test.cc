@@ -218,6 +218,34 @@ void TestCompose() {
   }
 }
 
+void TestScale() {
+  cout << "Test scaling of a backoff FST" << endl;
+  StdVectorFst *nfst = CreateBackoffFst();
+  StdVectorFst *rfst = CreateResultFst();
+  ArcSort(nfst, StdILabelCompare());
+
+  VectorFst<StdArc> path_fst;
+  ShortestPath(*rfst, &path_fst);
+
+  BackoffDeterministicOnDemandFst<StdArc> dfst1(*nfst), dfst2(*nfst),
+      dfst3a(*nfst), dfst3b(*nfst);
+  ScaleDeterministicOnDemandFst<StdArc> dfst2_scaled(2.0, &dfst2),
+      dfst3b_scaled(-1.0, &dfst3b);
+  // Composing with the FST scaled by -1 cancels out its costs.
+  ComposeDeterministicOnDemandFst<StdArc> dfst3(&dfst3a, &dfst3b_scaled);
+
+  // Each walk gives the cost of the path plus the cost in the FST that we
+  // walk it through, which is c, 2c and 0 for the three of them.
+  float w1 = WalkSinglePath(&path_fst, &dfst1).Value(),
+      w2 = WalkSinglePath(&path_fst, &dfst2_scaled).Value(),
+      w3 = WalkSinglePath(&path_fst, &dfst3).Value();
+  KALDI_ASSERT(kaldi::ApproxEqual(w2 - w1, w1 - w3));
+  KALDI_ASSERT(dfst2_scaled.Start() == dfst2.Start());
+
+  delete rfst;
+  delete nfst;
+}
+
 }
 
 
@@ -225,5 +253,6 @@ int main() {
   using namespace fst;
   TestBackoffAndCache();
   TestCompose();
+  TestScale();
 }
   
@@ -184,6 +184,33 @@ class ComposeDeterministicOnDemandFst: public DeterministicOnDemandFst<Arc> {
   StateId start_state_;
 };
     
+/// This class scales the weights of another DeterministicOnDemandFst by
+/// "scale" (in the tropical semiring, it multiplies the costs); e.g. with
+/// scale = -1 and a language model, it can be composed with a lattice (see
+/// ComposeDeterministicOnDemandFst) to remove that language model's costs.
+template<class Arc>
+class ScaleDeterministicOnDemandFst: public DeterministicOnDemandFst<Arc> {
+ public:
+  typedef typename Arc::StateId StateId;
+  typedef typename Arc::Weight Weight;
+  typedef typename Arc::Label Label;
+
+  /// We don't take ownership of this pointer.  The argument is "really" const.
+  ScaleDeterministicOnDemandFst(float scale,
+                                DeterministicOnDemandFst<Arc> *fst):
+      scale_(scale), fst_(fst) { }
+
+  virtual StateId Start() { return fst_->Start(); }
+
+  virtual Weight Final(StateId s);
+
+  virtual bool GetArc(StateId s, Label ilabel, Arc *oarc);
+
+ private:
+  float scale_;
+  DeterministicOnDemandFst<Arc> *fst_;
+};
+
 template<class Arc>
 class CacheDeterministicOnDemandFst: public DeterministicOnDemandFst<Arc> {
  public:
@@ -24,6 +24,8 @@
 
 #include <vector>
 #include <climits>
+#include "base/kaldi-memory-stats.h"
+#include "base/kaldi-trace.h"
 
 namespace fst {
 
@@ -470,6 +472,7 @@ template<class Weight, class IntType> class LatticeDeterminizer {
         arcs_size = num_arcs_ * sizeof(TempArc),
         elems_size = num_elems_ * sizeof(Element),
         total_size = repo_size + arcs_size + elems_size;
+    memory_stats_.Set(total_size);
     if (opts_.max_mem > 0 && total_size > opts_.max_mem) { // We passed the memory threshold.
       // This is usually due to the repository getting large, so we
       // clean this out.
@@ -1228,6 +1231,9 @@ template<class Weight, class IntType> class LatticeDeterminizer {
 
   int num_arcs_; // keep track of memory usage: number of arcs in output_arcs_
   int num_elems_; // keep track of memory usage: number of elems in output_states_
+  // The memory usage as of the last CheckMemoryUsage(), for the memory
+  // statistics.
+  kaldi::MemoryStatsEstimate memory_stats_;
   
   const Fst<Arc> *ifst_;
   DeterminizeLatticeOptions opts_;
@@ -1272,6 +1278,8 @@ bool DeterminizeLattice(const Fst<ArcTpl<Weight> > &ifst,
                         MutableFst<ArcTpl<Weight> > *ofst,
                         DeterminizeLatticeOptions opts,
                         bool *debug_ptr) {
+  KALDI_TRACE_SCOPE("DeterminizeLattice");
+  kaldi::MemoryTagScope memory_tag(kaldi::kMemoryLattice);
   ofst->SetInputSymbols(ifst.InputSymbols());
   ofst->SetOutputSymbols(ifst.OutputSymbols());
   LatticeDeterminizer<Weight, IntType> det(ifst, opts);
@@ -1289,6 +1297,8 @@ bool DeterminizeLattice(const Fst<ArcTpl<Weight> >&ifst,
                         MutableFst<ArcTpl<CompactLatticeWeightTpl<Weight, IntType> > >*ofst,
                         DeterminizeLatticeOptions opts,
                         bool *debug_ptr) {
+  KALDI_TRACE_SCOPE("DeterminizeLattice");
+  kaldi::MemoryTagScope memory_tag(kaldi::kMemoryLattice);
   ofst->SetInputSymbols(ifst.InputSymbols());
   ofst->SetOutputSymbols(ifst.OutputSymbols());
   LatticeDeterminizer<Weight, IntType> det(ifst, opts);
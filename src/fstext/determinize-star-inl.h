@@ -23,6 +23,8 @@
 // Do not include this file directly.  It is included by determinize-star.h
 
 #include "base/kaldi-error.h"
+#include "thread/kaldi-mutex.h"
+#include "thread/kaldi-thread-pool.h"
 
 #ifdef _MSC_VER
 #include <unordered_map>
@@ -96,8 +98,10 @@ template<class Label, class StringId> class StringRepository {
     else if (id>=single_symbol_start) {
       v->resize(1); (*v)[0] = id - single_symbol_start;
     } else {
+      if (thread_safe_) mutex_.Lock();
       assert(id >= string_start && id < static_cast<StringId>(vec_.size()));
       *v = *(vec_[id]);
+      if (thread_safe_) mutex_.Unlock();
     }
   }
   StringId RemovePrefix(StringId id, size_t prefix_len) {
@@ -113,7 +117,12 @@ template<class Label, class StringId> class StringRepository {
     }
   }
 
-  StringRepository() {
+  // If thread_safe == true, access to the sequences of length > 1 is
+  // protected by a mutex, so that several threads can use this object at once.
+  // Sequences of length zero and one never need the lock.
+  void SetThreadSafe(bool thread_safe) { thread_safe_ = thread_safe; }
+
+  StringRepository(): thread_safe_(false) {
     // The following are really just constants but don't want to complicate compilation so make them
     // class variables.  Due to the brokenness of <limits>, they can't be accessed as constants.
     string_end = (numeric_limits<StringId>::max() / 2) - 1;  // all hash values must be <= this.
@@ -137,21 +146,27 @@ template<class Label, class StringId> class StringRepository {
   DISALLOW_COPY_AND_ASSIGN(StringRepository);
 
   StringId IdOfSeqInternal(const vector<Label> &v) {
+    if (thread_safe_) mutex_.Lock();
+    StringId ans;
     typename MapType::iterator iter = map_.find(&v);
     if (iter != map_.end()) {
-      return iter->second;
+      ans = iter->second;
     } else {  // must add it to map.
       StringId this_id = (StringId) vec_.size();
       vector<Label> *v_new = new vector<Label> (v);
       vec_.push_back(v_new);
       map_[v_new] = this_id;
       assert(this_id < string_end);  // or we used up the labels.
-      return this_id;
+      ans = this_id;
     }
+    if (thread_safe_) mutex_.Unlock();
+    return ans;
   }
 
   vector<vector<Label>* > vec_;
   MapType map_;
+  bool thread_safe_;
+  kaldi::Mutex mutex_;
 
   static const StringId string_start = (StringId) 0;  // This must not change.  It's assumed.
   StringId string_end;  // = (numeric_limits<StringId>::max() / 2) - 1; // all hash values must be <= this.
@@ -178,16 +193,28 @@ template<class F> class DeterminizerStar {
 
   // Initializer.  After initializing the object you will typically call
   // Determinize() and then one of the Output functions.
+  // If num_threads > 1, Determinize() processes the queue of subsets in
+  // batches, doing the epsilon closure and the work of finding the transitions
+  // out of each subset on num_threads threads (see DeterminizeParallel()).
+  // This requires the input to be an ExpandedFst (e.g. a VectorFst or
+  // ConstFst), since iterating over the arcs of on-demand FSTs is not
+  // thread-safe; otherwise we use one thread.
   DeterminizerStar(const Fst<Arc> &ifst, float delta = kDelta,
-                   int max_states = -1, bool allow_partial = false):
+                   int max_states = -1, bool allow_partial = false,
+                   int num_threads = 1):
       ifst_(ifst.Copy()), delta_(delta), max_states_(max_states),
-      determinized_(false), allow_partial_(allow_partial),
-      is_partial_(false), equal_(delta),
+      num_threads_(num_threads), determinized_(false),
+      allow_partial_(allow_partial), is_partial_(false), equal_(delta),
       hash_(ifst.Properties(kExpanded, false) ?
               down_cast<const ExpandedFst<Arc>*,
               const Fst<Arc> >(&ifst)->NumStates()/2 + 3 : 20,
             hasher_, equal_),
-      epsilon_closure_(ifst_, max_states, &repository_, delta) { }
+      epsilon_closure_(ifst_, max_states, &repository_, delta) {
+    if (num_threads_ > 1 && !ifst.Properties(kExpanded, false)) {
+      KALDI_WARN << "Input FST is not expanded; determinizing with one thread.";
+      num_threads_ = 1;
+    }
+  }
 
   void Determinize(bool *debug_ptr) {
     assert(!determinized_);
@@ -205,23 +232,17 @@ template<class F> class DeterminizerStar {
       OutputStateId cur_id = SubsetToStateId(vec);
       assert(cur_id == 0 && "Do not call Determinize twice.");
     }
+    if (num_threads_ > 1) {
+      DeterminizeParallel(debug_ptr);
+      determinized_ = true;
+      return;
+    }
     while (!Q_.empty()) {
       pair<vector<Element>*, OutputStateId> cur_pair = Q_.front();
       Q_.pop_front();
       ProcessSubset(cur_pair);
       if (debug_ptr && *debug_ptr) Debug();  // will exit.
-      if (max_states_ > 0 && output_arcs_.size() > max_states_) {
-        if (allow_partial_ == false) {
-          std::cerr << "Determinization aborted since passed " << max_states_
-                    << " states.\n";
-          throw std::runtime_error("max-states reached in determinization");
-        } else {
-          KALDI_WARN << "Determinization terminated since passed " << max_states_
-                     << " states, partial results will be generated.";
-          is_partial_ = true;
-          break;
-        }
-      }
+      if (ReachedMaxStates()) break;
     }
     determinized_ = true;
   }
@@ -435,10 +456,12 @@ template<class F> class DeterminizerStar {
 
 
   // This function works out the final-weight of the determinized state.
-  // called by ProcessSubset.
-  // Has no side effects except on the variable repository_, and output_arcs_.
+  // called by ProcessSubset.  If the state is final, it appends the
+  // final-weight to "arcs" in the form of a TempArc with nextstate ==
+  // kNoStateId.  Has no side effects except on the variable repository_.
 
-  void ProcessFinal(const vector<Element> &closed_subset, OutputStateId state) {
+  void ProcessFinal(const vector<Element> &closed_subset,
+                    vector<TempArc> *arcs) {
     // processes final-weights for this subset.
     bool is_final = false;
     StringId final_string = 0;  // = 0 to keep compiler happy.
@@ -472,14 +495,25 @@ template<class F> class DeterminizerStar {
       temp_arc.nextstate = kNoStateId;  // special marker meaning "final weight".
       temp_arc.ostring = final_string;
       temp_arc.weight = final_weight;
-      output_arcs_[state].push_back(temp_arc);
+      arcs->push_back(temp_arc);
     }
   }
 
+  // A transition out of a determinized state whose destination subset has
+  // not yet been looked up in hash_ (see ProcessTransitions and AddArcs).
+  struct PendingArc {
+    Label ilabel;
+    StringId ostring;
+    Weight weight;
+    vector<Element> subset;  // the normalized subset of the destination.
+  };
+
   // ProcessTransition is called from "ProcessTransitions".  Broken out for
-  // clarity.  Has side effects on output_arcs_, and (via SubsetToStateId), Q_
-  // and hash_.
-  void ProcessTransition(OutputStateId state, Label ilabel, vector<Element> *subset);
+  // clarity.  It normalizes "subset" and works out the output string and weight
+  // of the transition, which it puts in "arc".  Has no side effects except on
+  // repository_.
+  void ProcessTransition(Label ilabel, vector<Element> *subset,
+                         PendingArc *arc);
 
   // "less than" operator for pair<Label, Element>.   Used in ProcessTransitions.
   // Lexicographical order, with comparing the state only for "Element".
@@ -499,13 +533,14 @@ template<class F> class DeterminizerStar {
   // ProcessTransitions handles transitions out of this subset of states.
   // Ignores epsilon transitions (epsilon closure already handled that).
   // Does not consider final states.  Breaks the transitions up by ilabel,
-  // and creates a new transition in determinized FST, for each ilabel.
+  // and appends to "arcs" a transition in determinized FST, for each ilabel.
   // Does this by creating a big vector of pairs <Label, Element> and then sorting them
   // using a lexicographical ordering, and calling ProcessTransition for each range
   // with the same ilabel.
-  // Side effects on repository, and (via ProcessTransition) on Q_, hash_,
-  // and output_arcs_.
-  void ProcessTransitions(const vector<Element> &closed_subset, OutputStateId state) {
+  // Has no side effects except on repository_, so it may be called from
+  // several threads at once if repository_ is thread-safe.
+  void ProcessTransitions(const vector<Element> &closed_subset,
+                          vector<PendingArc> *arcs) {
     vector<pair<Label, Element> > all_elems;
     {  // Push back into "all_elems", elements corresponding to all non-epsilon-input transitions
       // out of all states in "closed_subset".
@@ -541,17 +576,41 @@ template<class F> class DeterminizerStar {
     // now sorted first on input label, then on state.
     typedef typename vector<pair<Label, Element> >::const_iterator PairIter;
     PairIter cur = all_elems.begin(), end = all_elems.end();
-    vector<Element> this_subset;
+    {  // Reserve space for all the arcs, so we don't copy the subsets in
+      // resize().
+      size_t num_ilabels = 0;
+      for (PairIter iter = cur; iter != end; ++iter)
+        if (iter == cur || iter->first != (iter - 1)->first) num_ilabels++;
+      arcs->reserve(arcs->size() + num_ilabels);
+    }
     while (cur != end) {
       // Process ranges that share the same input symbol.
       Label ilabel = cur->first;
-      this_subset.clear();
+      arcs->resize(arcs->size() + 1);
+      PendingArc &arc = arcs->back();
       while (cur != end && cur->first == ilabel) {
-        this_subset.push_back(cur->second);
+        arc.subset.push_back(cur->second);
         cur++;
       }
       // We now have a subset for this ilabel.
-      ProcessTransition(state, ilabel, &this_subset);
+      ProcessTransition(ilabel, &arc.subset, &arc);
+    }
+  }
+
+  // AddArcs adds the transitions in "arcs" to output_arcs_[state], looking up
+  // (and maybe creating) their destination states.  Side effects on
+  // output_arcs_, and (via SubsetToStateId) on Q_ and hash_.
+  void AddArcs(OutputStateId state, const vector<PendingArc> &arcs) {
+    typename vector<PendingArc>::const_iterator iter = arcs.begin(),
+        end = arcs.end();
+    for (; iter != end; ++iter) {
+      TempArc temp_arc;
+      temp_arc.ilabel = iter->ilabel;
+      // may or may not really add the subset.
+      temp_arc.nextstate = SubsetToStateId(iter->subset);
+      temp_arc.ostring = iter->ostring;
+      temp_arc.weight = iter->weight;
+      output_arcs_[state].push_back(temp_arc);  // record the arc.
     }
   }
 
@@ -570,13 +629,15 @@ template<class F> class DeterminizerStar {
                                                        new_state_id)).second;
       assert(ans);
       output_arcs_.push_back(vector<TempArc>());
-      if (allow_partial_ == false) {
+      if (allow_partial_ == false && num_threads_ == 1) {
         // If --allow-partial is not requested, we do the old way.
         Q_.push_front(pair<vector<Element>*, OutputStateId>(new_subset,  new_state_id));
       } else {
         // If --allow-partial is requested, we do breadth first search. This
         // ensures that when we return partial results, we return the states
         // that are reachable by the fewest steps from the start state.
+        // DeterminizeParallel() also needs this, as it takes batches of
+        // subsets from the front of the queue.
         Q_.push_back(pair<vector<Element>*, OutputStateId>(new_subset,  new_state_id));
       }
       return new_state_id;
@@ -600,10 +661,84 @@ template<class F> class DeterminizerStar {
     epsilon_closure_.GetEpsilonClosure(*subset, &closed_subset);
 
     // Now follow non-epsilon arcs [and also process final states]
-    ProcessFinal(closed_subset, state);
+    ProcessFinal(closed_subset, &(output_arcs_[state]));
 
     // Now handle transitions out of these states.
-    ProcessTransitions(closed_subset, state);
+    vector<PendingArc> arcs;
+    ProcessTransitions(closed_subset, &arcs);
+    AddArcs(state, arcs);
+  }
+
+  // The part of ProcessSubset that DeterminizeParallel() does in parallel:
+  // everything except the lookups in hash_.
+  struct SubsetInfo {
+    vector<TempArc> final_arcs;  // the final-weight, if any.
+    vector<PendingArc> arcs;
+  };
+
+  // ThreadPool task used in DeterminizeParallel(): each task has its own
+  // EpsilonClosure object (they have scratch space), and they take chunks of
+  // the batch of subsets in turn.
+  class ProcessSubsetsTask: public kaldi::ThreadPoolTask {
+   public:
+    ProcessSubsetsTask(DeterminizerStar<F> *det, EpsilonClosure *closure,
+                       const vector<pair<vector<Element>*, OutputStateId> > &batch,
+                       vector<SubsetInfo> *info, size_t *next,
+                       kaldi::Mutex *mutex):
+        det_(det), closure_(closure), batch_(batch), info_(info),
+        next_(next), mutex_(mutex) { }
+    virtual void Run() {
+      const size_t chunk = 8;
+      vector<Element> closed_subset;
+      while (true) {
+        mutex_->Lock();
+        size_t begin = *next_;
+        *next_ += chunk;
+        mutex_->Unlock();
+        if (begin >= batch_.size()) break;
+        size_t end = std::min(begin + chunk, batch_.size());
+        for (size_t i = begin; i < end; i++) {
+          closure_->GetEpsilonClosure(*(batch_[i].first), &closed_subset);
+          det_->ProcessFinal(closed_subset, &((*info_)[i].final_arcs));
+          det_->ProcessTransitions(closed_subset, &((*info_)[i].arcs));
+        }
+      }
+    }
+   private:
+    DeterminizerStar<F> *det_;
+    EpsilonClosure *closure_;
+    const vector<pair<vector<Element>*, OutputStateId> > &batch_;
+    vector<SubsetInfo> *info_;
+    size_t *next_;
+    kaldi::Mutex *mutex_;
+  };
+
+  // This does the work of Determinize() when num_threads_ > 1.  We take
+  // batches of subsets from the front of Q_ and do the epsilon closure,
+  // final-weights and transitions of the subsets on num_threads_ threads; the
+  // only shared state they modify is repository_, which is made thread-safe.
+  // Then, on this thread, we look up the destination subsets in hash_ (which
+  // may add new subsets to the back of Q_) in the order of the batch.  This
+  // gives the same state numbering as a serial breadth-first search, whatever
+  // the number of threads.
+  void DeterminizeParallel(bool *debug_ptr);
+
+  // Returns true if the determinization should stop because of max_states_;
+  // throws if allow_partial_ == false.
+  bool ReachedMaxStates() {
+    if (max_states_ > 0 && output_arcs_.size() > max_states_) {
+      if (allow_partial_ == false) {
+        std::cerr << "Determinization aborted since passed " << max_states_
+                  << " states.\n";
+        throw std::runtime_error("max-states reached in determinization");
+      } else {
+        KALDI_WARN << "Determinization terminated since passed " << max_states_
+                   << " states, partial results will be generated.";
+        is_partial_ = true;
+        return true;
+      }
+    }
+    return false;
   }
 
   void Debug();
@@ -616,6 +751,7 @@ template<class F> class DeterminizerStar {
   const Fst<Arc> *ifst_;
   float delta_;
   int max_states_;
+  int num_threads_;
   bool determinized_; // used to check usage.
   bool allow_partial_;  // output paritial results or not
   bool is_partial_;     // if we get partial results or not
@@ -631,11 +767,11 @@ template<class F> class DeterminizerStar {
 template<class F>
 bool DeterminizeStar(F &ifst, MutableFst<typename F::Arc> *ofst,
                      float delta, bool *debug_ptr, int max_states,
-                     bool allow_partial) {
+                     bool allow_partial, int num_threads) {
   typedef typename F::Arc Arc;
   ofst->SetOutputSymbols(ifst.OutputSymbols());
   ofst->SetInputSymbols(ifst.InputSymbols());
-  DeterminizerStar<F> det(ifst, delta, max_states, allow_partial);
+  DeterminizerStar<F> det(ifst, delta, max_states, allow_partial, num_threads);
   det.Determinize(debug_ptr);
   det.Output(ofst);
   return det.IsPartial();
@@ -646,11 +782,11 @@ template<class F>
 bool DeterminizeStar(F &ifst,
                      MutableFst<GallicArc<typename F::Arc> > *ofst, float delta,
                      bool *debug_ptr, int max_states,
-                     bool allow_partial) {
+                     bool allow_partial, int num_threads) {
   typedef typename F::Arc Arc;
   ofst->SetOutputSymbols(ifst.InputSymbols());
   ofst->SetInputSymbols(ifst.InputSymbols());
-  DeterminizerStar<F> det(ifst, delta, max_states, allow_partial);
+  DeterminizerStar<F> det(ifst, delta, max_states, allow_partial, num_threads);
   det.Determinize(debug_ptr);
   det.Output(ofst);
   return det.IsPartial();
@@ -997,11 +1133,10 @@ void DeterminizerStar<F>::Output(MutableFst<Arc> *ofst, bool destroy) {
 }
 
 template<class F> void DeterminizerStar<F>::
-ProcessTransition(OutputStateId state, Label ilabel, vector<Element> *subset) {
+ProcessTransition(Label ilabel, vector<Element> *subset, PendingArc *arc) {
   // At input, "subset" may contain duplicates for a given dest state (but in sorted
-  // order).  This function removes duplicates from "subset", normalizes it, and adds
-  // a transition to the dest. state (possibly affecting Q_ and hash_, if state did not
-  // exist).
+  // order).  This function removes duplicates from "subset", normalizes it, and works
+  // out the label, output string and weight of the transition to the dest. state.
 
   typedef typename vector<Element>::iterator IterType;
   {  // This block makes the subset have one unique Element per state, adding the weights.
@@ -1066,14 +1201,74 @@ ProcessTransition(OutputStateId state, Label ilabel, vector<Element> *subset) {
     }
   }
 
-  // Now add an arc to the state that the subset represents.
-  // We may create a new state id for this (in SubsetToStateId).
-  TempArc temp_arc;
-  temp_arc.ilabel = ilabel;
-  temp_arc.nextstate = SubsetToStateId(*subset);  // may or may not really add the subset.
-  temp_arc.ostring = common_str;
-  temp_arc.weight = tot_weight;
-  output_arcs_[state].push_back(temp_arc);  // record the arc.
+  // The destination state is looked up later, in AddArcs.
+  arc->ilabel = ilabel;
+  arc->ostring = common_str;
+  arc->weight = tot_weight;
+}
+
+template<class F>
+void DeterminizerStar<F>::DeterminizeParallel(bool *debug_ptr) {
+  // Below this many subsets in the queue it's not worth starting the threads;
+  // the serial code gives the same result.
+  const size_t min_batch_size = 64,
+      max_batch_size = 1024 * static_cast<size_t>(num_threads_);
+  repository_.SetThreadSafe(true);
+  // The EpsilonClosure objects are kept for the whole determinization since
+  // their scratch space is of the size of the input FST.
+  vector<EpsilonClosure*> closures(num_threads_);
+  for (int i = 0; i < num_threads_; i++)
+    closures[i] = new EpsilonClosure(ifst_, max_states_, &repository_, delta_);
+  try {
+    vector<pair<vector<Element>*, OutputStateId> > batch;
+    vector<SubsetInfo> info;
+    bool done = false;
+    while (!Q_.empty() && !done) {
+      if (Q_.size() < min_batch_size) {
+        pair<vector<Element>*, OutputStateId> cur_pair = Q_.front();
+        Q_.pop_front();
+        ProcessSubset(cur_pair);
+        if (debug_ptr && *debug_ptr) Debug();  // will exit.
+        done = ReachedMaxStates();
+      } else {
+        size_t batch_size = std::min(Q_.size(), max_batch_size);
+        batch.assign(Q_.begin(), Q_.begin() + batch_size);
+        Q_.erase(Q_.begin(), Q_.begin() + batch_size);
+        info.clear();
+        info.resize(batch_size);
+        size_t next = 0;
+        kaldi::Mutex mutex;
+        vector<ProcessSubsetsTask*> tasks(num_threads_);
+        for (int i = 0; i < num_threads_; i++)
+          tasks[i] = new ProcessSubsetsTask(this, closures[i], batch, &info,
+                                            &next, &mutex);
+        try {
+          kaldi::ThreadPool::Instance()->Run(
+              vector<kaldi::ThreadPoolTask*>(tasks.begin(), tasks.end()));
+        } catch (...) {
+          for (int i = 0; i < num_threads_; i++) delete tasks[i];
+          throw;
+        }
+        for (int i = 0; i < num_threads_; i++) delete tasks[i];
+        // As in the serial code, we check max_states_ after each state, so
+        // the partial output is the same.
+        for (size_t i = 0; i < batch_size && !done; i++) {
+          OutputStateId state = batch[i].second;
+          output_arcs_[state].swap(info[i].final_arcs);
+          AddArcs(state, info[i].arcs);
+          vector<PendingArc>().swap(info[i].arcs);  // free memory as we go.
+          if (debug_ptr && *debug_ptr) Debug();  // will exit.
+          done = ReachedMaxStates();
+        }
+      }
+    }
+  } catch (...) {
+    for (int i = 0; i < num_threads_; i++) delete closures[i];
+    repository_.SetThreadSafe(false);
+    throw;
+  }
+  for (int i = 0; i < num_threads_; i++) delete closures[i];
+  repository_.SetThreadSafe(false);
 }
 
 template<class F>
@@ -23,6 +23,7 @@
 #include "fstext/determinize-star.h"
 #include "fstext/trivial-factor-weight.h"
 #include "fstext/fst-test-utils.h"
+#include "thread/kaldi-thread.h"
 
 
 namespace fst
@@ -545,6 +546,49 @@ template<class Arc>  void TestMinimize() {
 }
 
 
+// Test the multi-threaded DeterminizeStar on a union of many random paths
+// (which is functional, so it's determinizable), big enough that the subsets
+// get processed in parallel batches.
+template<class Arc> void TestDeterminizeThreaded() {
+  typedef typename Arc::Label Label;
+  typedef typename Arc::StateId StateId;
+  typedef typename Arc::Weight Weight;
+  VectorFst<Arc> fst;
+  StateId start = fst.AddState();
+  fst.SetStart(start);
+  int num_paths = 200 + kaldi::Rand() % 300;
+  for (int i = 0; i < num_paths; i++) {
+    int len = 1 + kaldi::Rand() % 8;
+    StateId cur = start;
+    size_t input_hash = 0;
+    for (int j = 0; j < len; j++) {
+      Label ilabel = kaldi::Rand() % 6;  // 0 is epsilon.
+      if (ilabel != 0) input_hash = input_hash * 7 + ilabel;
+      // The output is a function of the input sequence, so the FST is
+      // functional.
+      Label olabel = (j + 1 == len ? 1 + input_hash % 10 : 0);
+      StateId next = fst.AddState();
+      fst.AddArc(cur, Arc(ilabel, olabel,
+                          Weight(kaldi::RandInt(0, 3) * 0.5), next));
+      cur = next;
+    }
+    fst.SetFinal(cur, Weight(kaldi::RandInt(0, 3) * 0.5));
+  }
+  ArcSort(&fst, ILabelCompare<Arc>());
+
+  VectorFst<Arc> ofst1, ofst2, ofst4;
+  DeterminizeStar(fst, &ofst1);
+  DeterminizeStar(fst, &ofst2, kDelta, NULL, -1, false, 2);
+  DeterminizeStar(fst, &ofst4, kDelta, NULL, -1, false, 4);
+  assert(ofst2.Properties(kIDeterministic, true) == kIDeterministic);
+  // The output for num_threads > 1 doesn't depend on the number of threads.
+  assert(Equal(ofst2, ofst4));
+  assert(ofst1.NumStates() == ofst2.NumStates());
+  assert(RandEquivalent(ofst1, ofst2, 5/*paths*/, 0.01/*delta*/, kaldi::Rand()/*seed*/, 100/*path length-- max?*/));
+  assert(RandEquivalent(fst, ofst2, 5/*paths*/, 0.01/*delta*/, kaldi::Rand()/*seed*/, 100/*path length-- max?*/));
+}
+
+
 template<class Arc, class inttype> void TestStringRepository() {
   typedef typename Arc::Label Label;
 
@@ -593,6 +637,7 @@ template<class Arc, class inttype> void TestStringRepository() {
 
 
 int main() {
+  kaldi::g_num_threads = 4;  // for TestDeterminizeThreaded().
   for (int i = 0;i < 3;i++) {  // We would need more iterations to check
     // this properly.
     fst::TestStringRepository<fst::StdArc, int>();
@@ -605,5 +650,6 @@ int main() {
     // fst::TestDeterminize2<fst::StdArc>();
     fst::TestPush<fst::StdArc>();
     fst::TestMinimize<fst::StdArc>();
+    fst::TestDeterminizeThreaded<fst::StdArc>();
   }
 }
@@ -82,13 +82,20 @@ namespace fst {
     out an error.
     The function will return false if partial FST is generated, and true if the
     complete determinized FST is generated.
+    If num_threads > 1 and the input is an ExpandedFst, the subsets of states
+    are processed in parallel batches on the ThreadPool (which has
+    g_num_threads threads, so set that too).  The output is then the same for
+    any number of threads, but its state numbering is different from the
+    single-threaded version, which does a depth-first rather than a
+    breadth-first search.
 */
 template<class F>
 bool DeterminizeStar(F &ifst, MutableFst<typename F::Arc> *ofst,
                      float delta = kDelta,
                      bool *debug_ptr = NULL,
                      int max_states = -1,
-                     bool allow_partial = false);
+                     bool allow_partial = false,
+                     int num_threads = 1);
 
 
 
@@ -102,12 +109,14 @@ bool DeterminizeStar(F &ifst, MutableFst<typename F::Arc> *ofst,
     out an error.
     The function will return false if partial FST is generated, and true if the
     complete determinized FST is generated.
+    See above for num_threads.
 */
 template<class F>
 bool DeterminizeStar(F &ifst, MutableFst<GallicArc<typename F::Arc> > *ofst,
                      float delta = kDelta, bool *debug_ptr = NULL,
                      int max_states = -1,
-                     bool allow_partial = false);
+                     bool allow_partial = false,
+                     int num_threads = 1);
 
 
 /// @} end "addtogroup fst_extensions"
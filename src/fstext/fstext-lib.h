@@ -27,6 +27,7 @@
 #include "fstext/fstext-utils.h"
 #include "fstext/pre-determinize.h"
 #include "fstext/table-matcher.h"
+#include "fstext/parallel-compose.h"
 #include "fstext/trivial-factor-weight.h"
 #include "fstext/lattice-weight.h"
 #include "fstext/lattice-utils.h"
@@ -81,9 +81,11 @@ void GetSymbols(const SymbolTable &symtab,
 
 
 
+/// Determinizes "fst" in the log semiring using DeterminizeStar.  See
+/// DeterminizeStar() in determinize-star.h for the meaning of the arguments.
 inline
 void DeterminizeStarInLog(VectorFst<StdArc> *fst, float delta = kDelta, bool *debug_ptr = NULL,
-                          int max_states = -1);
+                          int max_states = -1, int num_threads = 1);
 
 
 // e.g. of using this function: PushInLog<REWEIGHT_TO_INITIAL>(fst, kPushWeights|kPushLabels);
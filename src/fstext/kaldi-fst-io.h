@@ -93,6 +93,10 @@ class VectorFstTplHolder {
     return *t_;
   }
 
+  void Swap(VectorFstTplHolder<Arc> *other) {
+    std::swap(t_, other->t_);
+  }
+
   void Clear() {
     if (t_) {
       delete t_;
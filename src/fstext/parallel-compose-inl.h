@@ -0,0 +1,426 @@
+// fstext/parallel-compose-inl.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_FSTEXT_PARALLEL_COMPOSE_INL_H_
+#define KALDI_FSTEXT_PARALLEL_COMPOSE_INL_H_
+// Do not include this file directly.  It is included by parallel-compose.h
+
+#include "base/kaldi-error.h"
+#include "thread/kaldi-mutex.h"
+#include "thread/kaldi-thread-pool.h"
+
+#ifdef _MSC_VER
+#include <unordered_map>
+using std::unordered_map;
+#elif __cplusplus > 199711L || defined(__GXX_EXPERIMENTAL_CXX0X__)
+#include <unordered_map>
+using std::unordered_map;
+#else
+#include <tr1/unordered_map>
+using std::tr1::unordered_map;
+#endif
+
+#include <algorithm>
+#include <vector>
+
+namespace fst {
+
+template<class Arc>
+class ParallelComposer {
+ public:
+  typedef typename Arc::Label Label;
+  typedef typename Arc::StateId StateId;
+  typedef typename Arc::Weight Weight;
+
+  ParallelComposer(const ExpandedFst<Arc> &fst1, const ExpandedFst<Arc> &fst2,
+                   const ParallelComposeOptions &opts,
+                   MutableFst<Arc> *ofst):
+      fst1_(fst1), fst2_(fst2), opts_(opts), ofst_(ofst),
+      num_threads_(std::max(opts.num_threads, 1)) {
+    if (opts.table_match_type != MATCH_OUTPUT ||
+        opts.filter_type != SEQUENCE_FILTER)
+      KALDI_ERR << "ParallelTableCompose() only supports matching on the "
+                << "left FST with the sequence filter.";
+  }
+
+  ~ParallelComposer() {
+    for (size_t i = 0; i < states1_.size(); i++)
+      delete states1_[i].table;
+  }
+
+  void Compose();
+
+ private:
+  // A composed state: a state of each FST, and the state of the sequence
+  // filter, which is 0 if fst1 may move on its own on an arc with epsilon
+  // output, and 1 if it may not (because fst2 has just moved on its own).
+  struct Tuple {
+    StateId s1;
+    StateId s2;
+    int filter_state;
+    Tuple() { }
+    Tuple(StateId s1, StateId s2, int filter_state):
+        s1(s1), s2(s2), filter_state(filter_state) { }
+    bool operator == (const Tuple &other) const {
+      return s1 == other.s1 && s2 == other.s2 &&
+          filter_state == other.filter_state;
+    }
+  };
+  struct TupleHasher {
+    size_t operator () (const Tuple &t) const {
+      return t.s1 * 7853 + t.s2 * 7867 + t.filter_state;
+    }
+  };
+  typedef unordered_map<Tuple, StateId, TupleHasher> TupleMap;
+
+  // An arc whose destination has not been given a state-id yet; "nextstate"
+  // points to its entry in tuple_maps_ once we have looked it up.
+  struct PendingArc {
+    Label ilabel;
+    Label olabel;
+    Weight weight;
+    Tuple dest;
+    StateId *nextstate;
+    PendingArc(Label ilabel, Label olabel, Weight weight, const Tuple &dest):
+        ilabel(ilabel), olabel(olabel), weight(weight), dest(dest),
+        nextstate(NULL) { }
+  };
+
+  struct StateInfo {
+    Weight final;
+    std::vector<PendingArc> arcs;
+  };
+
+  // The arcs of state s of fst1 are arcs1_[begin, end), sorted on output
+  // label, and those in [begin, nonepsilon) have epsilon output.  If "table"
+  // is non-NULL, (*table)[l - min_label] is the index (relative to
+  // "nonepsilon") of the first arc with output label l, or -1.
+  struct State1 {
+    size_t begin;
+    size_t nonepsilon;
+    size_t end;
+    std::vector<int> *table;
+    Label min_label;
+  };
+
+  // Copies the arcs of fst1 into arcs1_ and states1_, and creates the
+  // tables, up to opts_.max_table_size entries in total.
+  void InitFst1();
+
+  // Outputs the range of arcs of state s1 of fst1 with output label "label"
+  // (which is not epsilon).
+  void FindArcs1(StateId s1, Label label, size_t *begin, size_t *end) const;
+
+  // Outputs the final-weight and the arcs of the composed state "tuple".
+  // This only reads from this object, so it can be called from several
+  // threads.
+  void Expand(const Tuple &tuple, StateInfo *info) const;
+
+  // Which part of tuple_maps_ a tuple is in.
+  size_t Shard(const Tuple &tuple) const {
+    return (static_cast<size_t>(tuple.s2) * 2654435761u) % tuple_maps_.size();
+  }
+
+  // Looks up the destinations of the arcs in tuple_maps_, adding them (with
+  // state-id kNoStateId) if they are new, and sets their "nextstate".  If
+  // "shard" is >= 0 this only looks at the destinations in that part.
+  void LookUpArcs(StateInfo *info, int shard);
+
+  // Adds the final-weight and arcs of "info" to state s of the output,
+  // giving state-ids to the new destination states.
+  void CommitState(StateId s, StateInfo *info);
+
+  class ExpandTask: public kaldi::ThreadPoolTask {
+   public:
+    ExpandTask(const ParallelComposer<Arc> *composer, size_t begin,
+               std::vector<StateInfo> *info, size_t *next,
+               kaldi::Mutex *mutex):
+        composer_(composer), begin_(begin), info_(info), next_(next),
+        mutex_(mutex) { }
+    virtual void Run() {
+      const size_t chunk = 16;
+      while (true) {
+        mutex_->Lock();
+        size_t begin = *next_;
+        *next_ += chunk;
+        mutex_->Unlock();
+        if (begin >= info_->size()) break;
+        size_t end = std::min(begin + chunk, info_->size());
+        for (size_t i = begin; i < end; i++)
+          composer_->Expand(composer_->tuples_[begin_ + i], &((*info_)[i]));
+      }
+    }
+   private:
+    const ParallelComposer<Arc> *composer_;
+    size_t begin_;  // The state-id of (*info_)[0].
+    std::vector<StateInfo> *info_;
+    size_t *next_;
+    kaldi::Mutex *mutex_;
+  };
+
+  class LookUpTask: public kaldi::ThreadPoolTask {
+   public:
+    LookUpTask(ParallelComposer<Arc> *composer, std::vector<StateInfo> *info,
+               int shard):
+        composer_(composer), info_(info), shard_(shard) { }
+    virtual void Run() {
+      for (size_t i = 0; i < info_->size(); i++)
+        composer_->LookUpArcs(&((*info_)[i]), shard_);
+    }
+   private:
+    ParallelComposer<Arc> *composer_;
+    std::vector<StateInfo> *info_;
+    int shard_;
+  };
+
+  // Runs the tasks, and deletes them.
+  static void RunTasks(const std::vector<kaldi::ThreadPoolTask*> &tasks);
+
+  const ExpandedFst<Arc> &fst1_;
+  const ExpandedFst<Arc> &fst2_;
+  ParallelComposeOptions opts_;
+  MutableFst<Arc> *ofst_;
+  int num_threads_;
+
+  std::vector<Arc> arcs1_;
+  std::vector<State1> states1_;
+
+  // The composed states, indexed by output state-id.
+  std::vector<Tuple> tuples_;
+  // Maps composed states to output state-ids; Shard() says which map a state
+  // is in.
+  std::vector<TupleMap> tuple_maps_;
+};
+
+
+template<class Arc>
+void ParallelComposer<Arc>::InitFst1() {
+  StateId num_states = fst1_.NumStates();
+  states1_.resize(num_states);
+  size_t table_size = 0;
+  for (StateId s = 0; s < num_states; s++) {
+    State1 &state = states1_[s];
+    state.begin = arcs1_.size();
+    for (ArcIterator<Fst<Arc> > aiter(fst1_, s); !aiter.Done(); aiter.Next())
+      arcs1_.push_back(aiter.Value());
+    state.end = arcs1_.size();
+    std::stable_sort(arcs1_.begin() + state.begin, arcs1_.end(),
+                     OLabelCompare<Arc>());
+    state.nonepsilon = state.begin;
+    while (state.nonepsilon < state.end &&
+           arcs1_[state.nonepsilon].olabel == 0)
+      state.nonepsilon++;
+    state.table = NULL;
+    state.min_label = 0;
+    size_t num_arcs = state.end - state.nonepsilon;
+    if (num_arcs == 0 || num_arcs < static_cast<size_t>(opts_.min_table_size))
+      continue;
+    Label min_label = arcs1_[state.nonepsilon].olabel,
+        max_label = arcs1_[state.end - 1].olabel;
+    size_t range = static_cast<size_t>(max_label - min_label) + 1,
+        num_labels = 0;
+    for (size_t i = state.nonepsilon; i < state.end; i++)
+      if (i == state.nonepsilon || arcs1_[i].olabel != arcs1_[i-1].olabel)
+        num_labels++;
+    if (num_labels < opts_.table_ratio * range ||
+        table_size + range > static_cast<size_t>(opts_.max_table_size))
+      continue;
+    table_size += range;
+    state.min_label = min_label;
+    state.table = new std::vector<int>(range, -1);
+    for (size_t i = state.end; i > state.nonepsilon; i--)  // first arc wins.
+      (*state.table)[arcs1_[i-1].olabel - min_label] = i - 1 - state.nonepsilon;
+  }
+}
+
+template<class Arc>
+void ParallelComposer<Arc>::FindArcs1(StateId s1, Label label,
+                                      size_t *begin, size_t *end) const {
+  const State1 &state = states1_[s1];
+  if (state.table != NULL) {
+    *begin = *end = state.end;
+    if (label < state.min_label ||
+        static_cast<size_t>(label - state.min_label) >= state.table->size())
+      return;
+    int offset = (*state.table)[label - state.min_label];
+    if (offset < 0) return;
+    *begin = state.nonepsilon + offset;
+  } else {
+    Arc arc(0, label, Weight::One(), kNoStateId);
+    *begin = std::lower_bound(arcs1_.begin() + state.nonepsilon,
+                              arcs1_.begin() + state.end, arc,
+                              OLabelCompare<Arc>()) - arcs1_.begin();
+  }
+  *end = *begin;
+  while (*end < state.end && arcs1_[*end].olabel == label)
+    (*end)++;
+}
+
+template<class Arc>
+void ParallelComposer<Arc>::Expand(const Tuple &tuple, StateInfo *info) const {
+  const State1 &state = states1_[tuple.s1];
+  Weight final1 = fst1_.Final(tuple.s1);
+  info->final = Times(final1, fst2_.Final(tuple.s2));
+  info->arcs.clear();
+  // fst1 moves on its own, on an arc with epsilon output.
+  if (tuple.filter_state == 0) {
+    for (size_t i = state.begin; i < state.nonepsilon; i++) {
+      const Arc &arc1 = arcs1_[i];
+      info->arcs.push_back(PendingArc(arc1.ilabel, 0, arc1.weight,
+                                      Tuple(arc1.nextstate, tuple.s2, 0)));
+    }
+  }
+  // As in SequenceComposeFilter, fst2 may move on its own (on an arc with
+  // epsilon input) unless fst1 can only move on epsilons; after that, fst1
+  // may not move on its own unless it had no epsilons to move on anyway.
+  bool all_epsilon1 = (state.nonepsilon == state.end &&
+                       final1 == Weight::Zero());
+  int filter_state2 = (state.nonepsilon == state.begin ? 0 : 1);
+  for (ArcIterator<Fst<Arc> > aiter(fst2_, tuple.s2); !aiter.Done();
+       aiter.Next()) {
+    const Arc &arc2 = aiter.Value();
+    if (arc2.ilabel == 0) {
+      if (!all_epsilon1)
+        info->arcs.push_back(PendingArc(0, arc2.olabel, arc2.weight,
+            Tuple(tuple.s1, arc2.nextstate, filter_state2)));
+    } else {
+      size_t begin, end;
+      FindArcs1(tuple.s1, arc2.ilabel, &begin, &end);
+      for (size_t i = begin; i < end; i++) {
+        const Arc &arc1 = arcs1_[i];
+        info->arcs.push_back(PendingArc(arc1.ilabel, arc2.olabel,
+                                        Times(arc1.weight, arc2.weight),
+                                        Tuple(arc1.nextstate, arc2.nextstate,
+                                              0)));
+      }
+    }
+  }
+}
+
+template<class Arc>
+void ParallelComposer<Arc>::LookUpArcs(StateInfo *info, int shard) {
+  typename std::vector<PendingArc>::iterator iter = info->arcs.begin(),
+      end = info->arcs.end();
+  for (; iter != end; ++iter) {
+    size_t this_shard = Shard(iter->dest);
+    if (shard >= 0 && this_shard != static_cast<size_t>(shard)) continue;
+    // References to the elements of an unordered_map stay valid when it is
+    // rehashed.
+    iter->nextstate = &(tuple_maps_[this_shard].insert(
+        std::make_pair(iter->dest, static_cast<StateId>(kNoStateId))).first->second);
+  }
+}
+
+template<class Arc>
+void ParallelComposer<Arc>::CommitState(StateId s, StateInfo *info) {
+  if (info->final != Weight::Zero())
+    ofst_->SetFinal(s, info->final);
+  typename std::vector<PendingArc>::iterator iter = info->arcs.begin(),
+      end = info->arcs.end();
+  for (; iter != end; ++iter) {
+    StateId &nextstate = *(iter->nextstate);
+    if (nextstate == kNoStateId) {
+      nextstate = ofst_->AddState();
+      tuples_.push_back(iter->dest);
+    }
+    ofst_->AddArc(s, Arc(iter->ilabel, iter->olabel, iter->weight,
+                         nextstate));
+  }
+  std::vector<PendingArc>().swap(info->arcs);  // free memory as we go.
+}
+
+template<class Arc>
+void ParallelComposer<Arc>::RunTasks(
+    const std::vector<kaldi::ThreadPoolTask*> &tasks) {
+  try {
+    kaldi::ThreadPool::Instance()->Run(tasks);
+  } catch (...) {
+    for (size_t i = 0; i < tasks.size(); i++) delete tasks[i];
+    throw;
+  }
+  for (size_t i = 0; i < tasks.size(); i++) delete tasks[i];
+}
+
+template<class Arc>
+void ParallelComposer<Arc>::Compose() {
+  ofst_->DeleteStates();
+  ofst_->SetInputSymbols(fst1_.InputSymbols());
+  ofst_->SetOutputSymbols(fst2_.OutputSymbols());
+  if (fst1_.Start() == kNoStateId || fst2_.Start() == kNoStateId)
+    return;
+  InitFst1();
+  tuple_maps_.resize(num_threads_);
+  Tuple start(fst1_.Start(), fst2_.Start(), 0);
+  tuple_maps_[Shard(start)][start] = ofst_->AddState();
+  tuples_.push_back(start);
+  ofst_->SetStart(0);
+
+  // Below min_batch states we don't use threads; the batches grow with the
+  // breadth-first frontier, up to max_batch.
+  const size_t min_batch = 64, max_batch = 1024 * num_threads_;
+  std::vector<StateInfo> info;
+  size_t next_state = 0;
+  while (next_state < tuples_.size()) {
+    size_t batch_size = std::min(tuples_.size() - next_state, max_batch);
+    if (num_threads_ == 1 || batch_size < min_batch) {
+      StateInfo this_info;
+      Expand(tuples_[next_state], &this_info);
+      LookUpArcs(&this_info, -1);
+      CommitState(next_state, &this_info);
+      next_state++;
+      continue;
+    }
+    info.resize(batch_size);
+    {
+      size_t next = 0;
+      kaldi::Mutex mutex;
+      std::vector<kaldi::ThreadPoolTask*> tasks(num_threads_);
+      for (int i = 0; i < num_threads_; i++)
+        tasks[i] = new ExpandTask(this, next_state, &info, &next, &mutex);
+      RunTasks(tasks);
+    }
+    {
+      // Each thread looks up the destination states in its part of
+      // tuple_maps_, so they need no locking.
+      std::vector<kaldi::ThreadPoolTask*> tasks(num_threads_);
+      for (int i = 0; i < num_threads_; i++)
+        tasks[i] = new LookUpTask(this, &info, i);
+      RunTasks(tasks);
+    }
+    // We give the new states their ids in the order of the batch, as the
+    // serial code does.
+    for (size_t i = 0; i < batch_size; i++)
+      CommitState(next_state + i, &(info[i]));
+    next_state += batch_size;
+  }
+  KALDI_VLOG(2) << "Composed FST has " << tuples_.size() << " states.";
+  if (opts_.connect) Connect(ofst_);
+}
+
+
+template<class Arc>
+void ParallelTableCompose(const ExpandedFst<Arc> &ifst1,
+                          const ExpandedFst<Arc> &ifst2,
+                          MutableFst<Arc> *ofst,
+                          const ParallelComposeOptions &opts) {
+  ParallelComposer<Arc> composer(ifst1, ifst2, opts, ofst);
+  composer.Compose();
+}
+
+} // end namespace fst
+
+#endif
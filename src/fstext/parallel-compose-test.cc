@@ -0,0 +1,131 @@
+// fstext/parallel-compose-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "fstext/parallel-compose.h"
+#include "fstext/fst-test-utils.h"
+#include "base/kaldi-math.h"
+#include "thread/kaldi-thread.h"
+
+namespace fst {
+
+
+// Don't instantiate with log semiring, as RandEquivalent may fail.
+template<class Arc> void TestParallelTableCompose(bool connect) {
+  VectorFst<Arc> *fst1 = RandFst<Arc>();
+  VectorFst<Arc> *fst2 = RandFst<Arc>();
+
+  ParallelComposeOptions opts;
+  opts.min_table_size = 1 + kaldi::Rand() % 5;
+  opts.table_ratio = 0.25 * (kaldi::Rand() % 5);
+  opts.connect = connect;
+  if (kaldi::Rand() % 2 == 0)
+    opts.max_table_size = kaldi::Rand() % 10;  // so some states use binary
+                                               // search.
+
+  // ParallelTableCompose() doesn't need sorted inputs, but Compose() does.
+  ArcSort(fst1, OLabelCompare<Arc>());
+  ArcSort(fst2, ILabelCompare<Arc>());
+
+  VectorFst<Arc> composed;
+  ParallelTableCompose(*fst1, *fst2, &composed, opts);
+  if (!connect) Connect(&composed);
+
+  VectorFst<Arc> composed_baseline;
+  Compose(*fst1, *fst2, &composed_baseline);
+
+  std::cout << "Connect = " << (connect ? "True\n" : "False\n");
+  assert(RandEquivalent(composed, composed_baseline, 3/*paths*/, 0.01/*delta*/,
+                        kaldi::Rand()/*seed*/, 20/*path length-- max?*/));
+
+  // The output doesn't depend on the number of threads.
+  opts.num_threads = 1 + kaldi::Rand() % 4;
+  VectorFst<Arc> composed_threaded;
+  ParallelTableCompose(*fst1, *fst2, &composed_threaded, opts);
+  if (!connect) Connect(&composed_threaded);
+  assert(Equal(composed, composed_threaded));
+
+  delete fst1;
+  delete fst2;
+}
+
+
+// Tests with something more like L o G, large enough that the batches of
+// states are expanded on threads.
+template<class Arc> void TestParallelTableComposeLarge() {
+  typedef typename Arc::StateId StateId;
+  typedef typename Arc::Weight Weight;
+  VectorFst<Arc> fst1, fst2;
+  // fst1 is like a lexicon: a loop state with one path per word, with the
+  // word on the first arc.
+  int num_words = 20 + kaldi::Rand() % 50;
+  StateId loop = fst1.AddState();
+  fst1.SetStart(loop);
+  fst1.SetFinal(loop, Weight::One());
+  for (int w = 1; w <= num_words; w++) {
+    StateId cur = loop;
+    int len = 1 + kaldi::Rand() % 4;
+    for (int j = 0; j < len; j++) {
+      StateId next = (j + 1 == len ? loop : fst1.AddState());
+      fst1.AddArc(cur, Arc(1 + kaldi::Rand() % 10, (j == 0 ? w : 0),
+                           Weight::One(), next));
+      cur = next;
+    }
+  }
+  // fst2 is like a grammar, with backoff arcs.
+  int num_states = 500 + kaldi::Rand() % 2000;
+  for (int s = 0; s < num_states; s++)
+    fst2.AddState();
+  fst2.SetStart(0);
+  for (int s = 0; s < num_states; s++) {
+    int num_arcs = 1 + kaldi::Rand() % 5;
+    for (int j = 0; j < num_arcs; j++) {
+      int w = 1 + kaldi::Rand() % num_words;
+      fst2.AddArc(s, Arc(w, w, Weight(0.5 * (kaldi::Rand() % 4)),
+                         kaldi::Rand() % num_states));
+    }
+    if (s != 0)
+      fst2.AddArc(s, Arc(0, 0, Weight(1.0), 0));
+    if (kaldi::Rand() % 5 == 0)
+      fst2.SetFinal(s, Weight(0.5));
+  }
+  ArcSort(&fst2, ILabelCompare<Arc>());
+
+  VectorFst<Arc> composed, composed_threaded, composed_baseline;
+  ParallelComposeOptions opts;
+  ParallelTableCompose(fst1, fst2, &composed, opts);
+  opts.num_threads = 4;
+  ParallelTableCompose(fst1, fst2, &composed_threaded, opts);
+  assert(Equal(composed, composed_threaded));
+
+  TableCompose(fst1, fst2, &composed_baseline);
+  assert(RandEquivalent(composed, composed_baseline, 5/*paths*/, 0.01/*delta*/,
+                        kaldi::Rand()/*seed*/, 50/*path length-- max?*/));
+}
+
+} // end namespace fst
+
+int main() {
+  using namespace fst;
+  kaldi::g_num_threads = 4;
+  for (int i = 0; i < 10; i++) {
+    TestParallelTableCompose<fst::StdArc>(true);
+    TestParallelTableCompose<fst::StdArc>(false);
+  }
+  for (int i = 0; i < 3; i++)
+    TestParallelTableComposeLarge<fst::StdArc>();
+  std::cout << "Test OK.\n";
+}
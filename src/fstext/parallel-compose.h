@@ -0,0 +1,73 @@
+// fstext/parallel-compose.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_FSTEXT_PARALLEL_COMPOSE_H_
+#define KALDI_FSTEXT_PARALLEL_COMPOSE_H_
+#include <fst/fstlib.h>
+#include "fstext/table-matcher.h"
+
+
+namespace fst {
+
+struct ParallelComposeOptions: public TableComposeOptions {
+  // The number of threads; the ThreadPool (thread/kaldi-thread-pool.h) has
+  // kaldi::g_num_threads threads, so that should be set too.
+  int num_threads;
+  // The maximum total number of entries in the lookup tables of the states
+  // of the left FST (see table_ratio and min_table_size); states beyond this
+  // use binary search instead.  This bounds the memory used for the tables,
+  // which are built for all the states of the left FST before we start.
+  int max_table_size;
+
+  ParallelComposeOptions(): num_threads(1), max_table_size(50000000) { }
+  explicit ParallelComposeOptions(const TableComposeOptions &opts,
+                                  int num_threads = 1):
+      TableComposeOptions(opts), num_threads(num_threads),
+      max_table_size(50000000) { }
+};
+
+
+/// ParallelTableCompose() computes the same thing as TableCompose() with
+/// table_match_type == MATCH_OUTPUT and filter_type == SEQUENCE_FILTER (the
+/// defaults), but it is not based on ComposeFst: the composed states are
+/// expanded in batches, in breadth-first order, on opts.num_threads threads.
+/// It is meant for large compositions such as L o G, where the left FST is
+/// small and the right one is large.
+///
+/// For each state of the left FST we copy its arcs, sorted on output label,
+/// and (if it has enough arcs with distinct labels, as for TableMatcher) a
+/// table from output label to arcs; so ifst1 need not be sorted.  The arcs of
+/// ifst2 are visited once for each composed state, so ifst2 need not be
+/// sorted either.  The new composed states are looked up in a hash that is
+/// partitioned on the state of ifst2, with one part per thread, and the
+/// states are numbered in the order in which they are first reached, so the
+/// output doesn't depend on the number of threads.
+///
+/// The input FSTs must be safe to read from several threads at once (any
+/// expanded FST such as VectorFst or ConstFst is).
+template<class Arc>
+void ParallelTableCompose(const ExpandedFst<Arc> &ifst1,
+                          const ExpandedFst<Arc> &ifst2,
+                          MutableFst<Arc> *ofst,
+                          const ParallelComposeOptions &opts =
+                          ParallelComposeOptions());
+
+} // end namespace fst
+
+#include "fstext/parallel-compose-inl.h"
+
+#endif
@@ -0,0 +1,95 @@
+// gmm/am-diag-gmm-gselect-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gmm/am-diag-gmm-gselect.h"
+#include "gmm/model-test-common.h"
+
+namespace kaldi {
+
+// Returns the log-likelihood of "data" for "pdf" evaluating only the
+// Gaussians that "gselect" picks.
+BaseFloat GselectLogLikelihood(const AmDiagGmmGselect &gselect, int32 pdf,
+                               const VectorBase<BaseFloat> &data) {
+  std::vector<int32> ubm_gselect, gauss;
+  gselect.SelectUbm(data, &ubm_gselect);
+  gselect.GetGaussians(pdf, ubm_gselect, &gauss);
+  Vector<BaseFloat> loglikes;
+  gselect.Am().GetPdf(pdf).LogLikelihoodsPreselect(data, gauss, &loglikes);
+  return loglikes.LogSumExp();
+}
+
+void UnitTestAmDiagGmmGselect() {
+  int32 dim = 1 + Rand() % 10, num_pdfs = 1 + Rand() % 20,
+      num_ubm_gauss = 1 + Rand() % 20;
+  AmDiagGmm am_gmm;
+  for (int32 pdf = 0; pdf < num_pdfs; pdf++) {
+    DiagGmm gmm;
+    unittest::InitRandDiagGmm(dim, 1 + Rand() % 10, &gmm);
+    am_gmm.AddPdf(gmm);
+  }
+  DiagGmm ubm;
+  unittest::InitRandDiagGmm(dim, num_ubm_gauss, &ubm);
+
+  Vector<BaseFloat> data(dim);
+  data.SetRandn();
+
+  {  // With everything selected, it is exact.
+    AmDiagGmmGselectOptions opts;
+    opts.num_ubm_gselect = num_ubm_gauss;
+    opts.num_assign = num_ubm_gauss + Rand() % 3;
+    AmDiagGmmGselect gselect(am_gmm, ubm, opts);
+    for (int32 pdf = 0; pdf < num_pdfs; pdf++) {
+      BaseFloat ref = am_gmm.LogLikelihood(pdf, data),
+          loglike = GselectLogLikelihood(gselect, pdf, data);
+      KALDI_ASSERT(ApproxEqual(ref, loglike, 1.0e-04));
+    }
+  }
+  {  // Otherwise it evaluates a subset of the Gaussians, or all of them.
+    AmDiagGmmGselectOptions opts;
+    opts.num_ubm_gselect = 1 + Rand() % 3;
+    opts.num_assign = 1 + Rand() % 2;
+    AmDiagGmmGselect gselect(am_gmm, ubm, opts);
+    std::vector<int32> ubm_gselect;
+    gselect.SelectUbm(data, &ubm_gselect);
+    KALDI_ASSERT(static_cast<int32>(ubm_gselect.size()) ==
+                 std::min(opts.num_ubm_gselect, num_ubm_gauss));
+    for (int32 pdf = 0; pdf < num_pdfs; pdf++) {
+      std::vector<int32> gauss;
+      gselect.GetGaussians(pdf, ubm_gselect, &gauss);
+      int32 num_gauss = am_gmm.GetPdf(pdf).NumGauss();
+      KALDI_ASSERT(!gauss.empty() &&
+                   static_cast<int32>(gauss.size()) <= num_gauss);
+      for (size_t i = 0; i < gauss.size(); i++)
+        KALDI_ASSERT(gauss[i] >= 0 && gauss[i] < num_gauss &&
+                     (i == 0 || gauss[i] > gauss[i - 1]));
+      BaseFloat ref = am_gmm.LogLikelihood(pdf, data),
+          loglike = GselectLogLikelihood(gselect, pdf, data);
+      KALDI_ASSERT(loglike <= ref + 1.0e-03);
+    }
+  }
+}
+
+}  // namespace kaldi
+
+int main() {
+  for (kaldi::int32 i = 0; i < 20; i++)
+    kaldi::UnitTestAmDiagGmmGselect();
+  std::cout << "Test OK.\n";
+  return 0;
+}
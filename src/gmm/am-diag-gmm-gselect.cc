@@ -0,0 +1,105 @@
+// gmm/am-diag-gmm-gselect.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <utility>
+
+#include "gmm/am-diag-gmm-gselect.h"
+
+namespace kaldi {
+
+AmDiagGmmGselect::AmDiagGmmGselect(const AmDiagGmm &am, const DiagGmm &ubm,
+                                   const AmDiagGmmGselectOptions &opts):
+    am_(am), ubm_(ubm), opts_(opts) {
+  KALDI_ASSERT(opts.num_ubm_gselect > 0 && opts.num_assign > 0);
+  if (am.Dim() != ubm.Dim())
+    KALDI_ERR << "Dimension mismatch between model (" << am.Dim()
+              << ") and UBM (" << ubm.Dim() << ")";
+  if (!ubm.valid_gconsts())
+    KALDI_ERR << "Must call ComputeGconsts() on the UBM.";
+  int32 num_pdfs = am.NumPdfs(), num_ubm = ubm.NumGauss(),
+      num_assign = std::min(opts.num_assign, num_ubm);
+  offsets_.resize(num_pdfs);
+  assigned_.resize(num_pdfs);
+  for (int32 pdf = 0; pdf < num_pdfs; pdf++) {
+    const DiagGmm &gmm = am.GetPdf(pdf);
+    int32 num_gauss = gmm.NumGauss();
+    Matrix<BaseFloat> means(num_gauss, gmm.Dim()), vars(num_gauss, gmm.Dim());
+    gmm.GetMeans(&means);
+    gmm.GetVars(&vars);
+    // E[x^2] = mean^2 + var.
+    Matrix<BaseFloat> second_moment(vars);
+    second_moment.AddMatMatElements(1.0, means, means, 1.0);
+    // expected_loglikes(i, u) is the expected log-likelihood under UBM
+    // Gaussian u (including its weight) of samples from Gaussian i.
+    Matrix<BaseFloat> expected_loglikes(num_gauss, num_ubm);
+    expected_loglikes.CopyRowsFromVec(ubm.gconsts());
+    expected_loglikes.AddMatMat(1.0, means, kNoTrans, ubm.means_invvars(),
+                                kTrans, 1.0);
+    expected_loglikes.AddMatMat(-0.5, second_moment, kNoTrans, ubm.inv_vars(),
+                                kTrans, 1.0);
+
+    // pairs (u, i) of UBM Gaussian and Gaussian of this pdf.
+    std::vector<std::pair<int32, int32> > pairs;
+    pairs.reserve(num_gauss * num_assign);
+    std::vector<std::pair<BaseFloat, int32> > scores(num_ubm);
+    for (int32 i = 0; i < num_gauss; i++) {
+      for (int32 u = 0; u < num_ubm; u++)
+        scores[u] = std::make_pair(-expected_loglikes(i, u), u);
+      std::nth_element(scores.begin(), scores.begin() + num_assign - 1,
+                       scores.end());
+      for (int32 j = 0; j < num_assign; j++)
+        pairs.push_back(std::make_pair(scores[j].second, i));
+    }
+    std::sort(pairs.begin(), pairs.end());
+    std::vector<int32> &offsets = offsets_[pdf], &assigned = assigned_[pdf];
+    offsets.resize(num_ubm + 1);
+    assigned.resize(pairs.size());
+    size_t k = 0;
+    for (int32 u = 0; u <= num_ubm; u++) {
+      offsets[u] = k;
+      for (; k < pairs.size() && pairs[k].first == u; k++)
+        assigned[k] = pairs[k].second;
+    }
+  }
+}
+
+void AmDiagGmmGselect::GetGaussians(int32 pdf,
+                                    const std::vector<int32> &ubm_gselect,
+                                    std::vector<int32> *gauss) const {
+  KALDI_ASSERT(static_cast<size_t>(pdf) < offsets_.size());
+  const std::vector<int32> &offsets = offsets_[pdf], &assigned = assigned_[pdf];
+  gauss->clear();
+  for (size_t j = 0; j < ubm_gselect.size(); j++) {
+    int32 u = ubm_gselect[j];
+    gauss->insert(gauss->end(), assigned.begin() + offsets[u],
+                  assigned.begin() + offsets[u + 1]);
+  }
+  if (gauss->empty()) {
+    int32 num_gauss = am_.GetPdf(pdf).NumGauss();
+    gauss->resize(num_gauss);
+    for (int32 i = 0; i < num_gauss; i++)
+      (*gauss)[i] = i;
+  } else {
+    std::sort(gauss->begin(), gauss->end());
+    gauss->erase(std::unique(gauss->begin(), gauss->end()), gauss->end());
+  }
+}
+
+}  // namespace kaldi
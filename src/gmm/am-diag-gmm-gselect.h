@@ -0,0 +1,91 @@
+// gmm/am-diag-gmm-gselect.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_GMM_AM_DIAG_GMM_GSELECT_H_
+#define KALDI_GMM_AM_DIAG_GMM_GSELECT_H_
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "gmm/am-diag-gmm.h"
+#include "itf/options-itf.h"
+
+namespace kaldi {
+
+struct AmDiagGmmGselectOptions {
+  int32 num_ubm_gselect;
+  int32 num_assign;
+
+  AmDiagGmmGselectOptions(): num_ubm_gselect(20), num_assign(2) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("gselect-num-ubm", &num_ubm_gselect, "Number of UBM "
+                   "Gaussians selected on each frame; the Gaussians of each "
+                   "pdf that are evaluated are those assigned to these.");
+    opts->Register("gselect-num-assign", &num_assign, "Number of UBM "
+                   "Gaussians that each Gaussian of the model is assigned to. "
+                   "Larger values of this and --gselect-num-ubm are slower but "
+                   "more exact.");
+  }
+};
+
+/**
+   AmDiagGmmGselect supports Gaussian selection for an AmDiagGmm, in the style
+   of the gselect of SGMMs: on each frame we select the best few Gaussians of a
+   small UBM (e.g. as created by init-ubm), and for each pdf we only evaluate
+   the Gaussians that are "assigned" to those.  Each Gaussian of the model is
+   assigned to the num_assign UBM Gaussians under which it has the highest
+   expected log-likelihood, i.e. E[log N(x; ubm)] for x drawn from that
+   Gaussian.  If none of the Gaussians of a pdf are assigned to the selected
+   ones, you should evaluate all of them (this is what GetGaussians() does).
+*/
+class AmDiagGmmGselect {
+ public:
+  /// The models must have valid gconsts.  Keeps references to "am" and "ubm".
+  AmDiagGmmGselect(const AmDiagGmm &am, const DiagGmm &ubm,
+                   const AmDiagGmmGselectOptions &opts);
+
+  /// Outputs the best UBM Gaussians for this frame.
+  void SelectUbm(const VectorBase<BaseFloat> &data,
+                 std::vector<int32> *ubm_gselect) const {
+    ubm_.GaussianSelection(data, opts_.num_ubm_gselect, ubm_gselect);
+  }
+
+  /// Outputs, sorted, the Gaussians of "pdf" that are assigned to the UBM
+  /// Gaussians in "ubm_gselect", or all of its Gaussians if there are none.
+  void GetGaussians(int32 pdf, const std::vector<int32> &ubm_gselect,
+                    std::vector<int32> *gauss) const;
+
+  const AmDiagGmm &Am() const { return am_; }
+  const DiagGmm &Ubm() const { return ubm_; }
+
+ private:
+  const AmDiagGmm &am_;
+  const DiagGmm &ubm_;
+  AmDiagGmmGselectOptions opts_;
+  // For each pdf, assigned_[pdf][offsets_[pdf][u] ... offsets_[pdf][u+1] - 1]
+  // are the Gaussians of "pdf" assigned to UBM Gaussian u.
+  std::vector<std::vector<int32> > offsets_;
+  std::vector<std::vector<int32> > assigned_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(AmDiagGmmGselect);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_GMM_AM_DIAG_GMM_GSELECT_H_
@@ -0,0 +1,74 @@
+// gmm/cu-am-diag-gmm-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gmm/cu-am-diag-gmm.h"
+#include "gmm/model-test-common.h"
+#include "cudamatrix/cu-device.h"
+
+namespace kaldi {
+
+void UnitTestCuAmDiagGmm() {
+  int32 dim = 1 + Rand() % 20, num_pdfs = 1 + Rand() % 30,
+      num_frames = Rand() % 50;
+  AmDiagGmm am_gmm;
+  for (int32 pdf = 0; pdf < num_pdfs; pdf++) {
+    DiagGmm gmm;
+    unittest::InitRandDiagGmm(dim, 1 + Rand() % 10, &gmm);
+    am_gmm.AddPdf(gmm);
+  }
+  Matrix<BaseFloat> feats(num_frames, dim);
+  feats.SetRandn();
+
+  CuAmDiagGmm cu_am_gmm(am_gmm);
+  KALDI_ASSERT(cu_am_gmm.NumPdfs() == num_pdfs && cu_am_gmm.Dim() == dim);
+  Matrix<BaseFloat> loglikes;
+  cu_am_gmm.LogLikelihoods(feats, &loglikes);
+  KALDI_ASSERT(loglikes.NumRows() == num_frames &&
+               loglikes.NumCols() == num_pdfs);
+  for (int32 t = 0; t < num_frames; t++) {
+    for (int32 pdf = 0; pdf < num_pdfs; pdf++) {
+      BaseFloat ref = am_gmm.LogLikelihood(pdf, feats.Row(t));
+      KALDI_ASSERT(ApproxEqual(ref, loglikes(t, pdf), 1.0e-04));
+    }
+  }
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 loop = 0; loop < 2; loop++) {
+#if HAVE_CUDA == 1
+    if (loop == 0)
+      CuDevice::Instantiate().SelectGpuId("no");
+    else
+      CuDevice::Instantiate().SelectGpuId("yes");
+#endif
+    for (int32 i = 0; i < 10; i++)
+      UnitTestCuAmDiagGmm();
+    if (loop == 0)
+      KALDI_LOG << "Tests without GPU use succeeded.";
+    else
+      KALDI_LOG << "Tests with GPU use (if available) succeeded.";
+  }
+#if HAVE_CUDA == 1
+  CuDevice::Instantiate().PrintProfile();
+#endif
+  return 0;
+}
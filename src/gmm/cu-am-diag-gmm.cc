@@ -0,0 +1,101 @@
+// gmm/cu-am-diag-gmm.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+
+#include "gmm/cu-am-diag-gmm.h"
+
+namespace kaldi {
+
+CuAmDiagGmm::CuAmDiagGmm(const AmDiagGmm &am):
+    num_pdfs_(am.NumPdfs()), dim_(am.Dim()), max_gauss_(0) {
+  KALDI_ASSERT(num_pdfs_ > 0);
+  for (int32 pdf = 0; pdf < num_pdfs_; pdf++) {
+    const DiagGmm &gmm = am.GetPdf(pdf);
+    if (!gmm.valid_gconsts())
+      KALDI_ERR << "Pdf " << pdf << ": must call ComputeGconsts() before "
+                << "computing likelihoods.";
+    max_gauss_ = std::max(max_gauss_, gmm.NumGauss());
+  }
+  Matrix<BaseFloat> params(num_pdfs_ * max_gauss_, 2 * dim_);
+  Vector<BaseFloat> gconsts(num_pdfs_ * max_gauss_);
+  gconsts.Set(-1.0e+30);
+  for (int32 pdf = 0; pdf < num_pdfs_; pdf++) {
+    const DiagGmm &gmm = am.GetPdf(pdf);
+    int32 num_gauss = gmm.NumGauss(), offset = pdf * max_gauss_;
+    SubMatrix<BaseFloat> this_params(params, offset, num_gauss, 0, 2 * dim_);
+    this_params.ColRange(0, dim_).CopyFromMat(gmm.means_invvars());
+    this_params.ColRange(dim_, dim_).AddMat(-0.5, gmm.inv_vars());
+    gconsts.Range(offset, num_gauss).CopyFromVec(gmm.gconsts());
+  }
+  params_.Swap(&params);
+  gconsts_.Swap(&gconsts);
+}
+
+void CuAmDiagGmm::LogLikelihoods(const MatrixBase<BaseFloat> &feats,
+                                 Matrix<BaseFloat> *loglikes) const {
+  if (feats.NumCols() != dim_)
+    KALDI_ERR << "Dim mismatch: data dim = " << feats.NumCols()
+              << " vs. model dim = " << dim_;
+  int32 num_frames = feats.NumRows(),
+      num_cols = num_pdfs_ * max_gauss_;
+  loglikes->Resize(num_frames, num_pdfs_, kUndefined);
+  if (num_frames == 0) return;
+  // We do blocks of frames so that the likelihoods of the individual
+  // Gaussians take at most about 64MB.
+  int32 max_block_size = std::max<int32>(1, (1 << 24) / num_cols),
+      block_size = std::min(num_frames, max_block_size);
+  CuMatrix<BaseFloat> data(block_size, 2 * dim_, kUndefined),
+      block_loglikes(block_size, num_pdfs_, kUndefined);
+  CuVector<BaseFloat> work(block_size * num_cols, kUndefined),
+      log_sums(block_size * num_pdfs_, kUndefined),
+      first_col(block_size * num_pdfs_, kUndefined);
+  for (int32 start = 0; start < num_frames; start += block_size) {
+    int32 n = std::min(block_size, num_frames - start);
+    // [ x, x^2 ] for each frame.
+    CuSubMatrix<BaseFloat> this_data(data, 0, n, 0, 2 * dim_);
+    this_data.ColRange(0, dim_).CopyFromMat(feats.RowRange(start, n));
+    this_data.ColRange(dim_, dim_).CopyFromMat(this_data.ColRange(0, dim_));
+    this_data.ColRange(dim_, dim_).ApplyPow(2.0);
+
+    // The same memory, seen as (frame, gaussian) and as (frame * pdf, i).
+    CuSubMatrix<BaseFloat> by_frame(work.Data(), n, num_cols, num_cols),
+        by_pdf(work.Data(), n * num_pdfs_, max_gauss_, max_gauss_);
+    by_frame.AddMatMat(1.0, this_data, kNoTrans, params_, kTrans, 0.0);
+    by_frame.AddVecToRows(1.0, gconsts_);
+
+    // log-sum-exp(x) = x_0 - log-softmax(x)_0.
+    CuSubVector<BaseFloat> this_log_sums(log_sums, 0, n * num_pdfs_),
+        this_first_col(first_col, 0, n * num_pdfs_);
+    this_log_sums.CopyColFromMat(by_pdf, 0);
+    by_pdf.ApplyLogSoftMaxPerRow(by_pdf);
+    this_first_col.CopyColFromMat(by_pdf, 0);
+    this_log_sums.AddVec(-1.0, this_first_col);
+
+    CuSubMatrix<BaseFloat> this_loglikes(block_loglikes, 0, n, 0, num_pdfs_);
+    this_loglikes.CopyRowsFromVec(this_log_sums);
+    BaseFloat sum = this_loglikes.Sum();
+    if (KALDI_ISNAN(sum) || KALDI_ISINF(sum))
+      KALDI_ERR << "Invalid answer (overflow or invalid variances/features?)";
+    SubMatrix<BaseFloat> out(*loglikes, start, n, 0, num_pdfs_);
+    this_loglikes.CopyToMat(&out);
+  }
+}
+
+}  // namespace kaldi
@@ -0,0 +1,70 @@
+// gmm/cu-am-diag-gmm.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_GMM_CU_AM_DIAG_GMM_H_
+#define KALDI_GMM_CU_AM_DIAG_GMM_H_
+
+#include "base/kaldi-common.h"
+#include "gmm/am-diag-gmm.h"
+#include "cudamatrix/cu-matrix.h"
+#include "cudamatrix/cu-vector.h"
+
+namespace kaldi {
+
+/// CuAmDiagGmm holds a copy of the parameters of an AmDiagGmm as CuMatrix
+/// objects, i.e. on the GPU if one was selected, and computes the
+/// log-likelihoods of all the pdfs for a whole utterance at a time.  For each
+/// block of frames this is one matrix multiplication for all the Gaussians,
+/// followed by a log-sum-exp over the Gaussians of each pdf (we pad all the
+/// pdfs to the same number of Gaussians so that it can be done as a
+/// log-softmax per row).  The output is suitable for DecodableMatrixScaledMapped
+/// (see decoder/decodable-matrix.h).
+///
+/// The answers are exact, i.e. unlike DecodableAmDiagGmm there is no
+/// log-sum-exp pruning.  The model is copied at construction, so if you change
+/// the AmDiagGmm you must create a new CuAmDiagGmm.
+class CuAmDiagGmm {
+ public:
+  /// The model must have valid gconsts (see DiagGmm::ComputeGconsts()).
+  explicit CuAmDiagGmm(const AmDiagGmm &am);
+
+  int32 NumPdfs() const { return num_pdfs_; }
+  int32 Dim() const { return dim_; }
+
+  /// Sets "loglikes" to the log-likelihoods of the features, of dimension
+  /// (num-frames, num-pdfs).
+  void LogLikelihoods(const MatrixBase<BaseFloat> &feats,
+                      Matrix<BaseFloat> *loglikes) const;
+
+ private:
+  int32 num_pdfs_;
+  int32 dim_;
+  int32 max_gauss_;  // The largest number of Gaussians of any pdf.
+  // Row (pdf * max_gauss_ + i) is [ means_invvars, -0.5 * inv_vars ] of
+  // Gaussian i of "pdf", or zero for the padding.
+  CuMatrix<BaseFloat> params_;
+  // The gconsts, in the same order as the rows of params_; the padding has a
+  // very negative value, so it doesn't contribute to the sum.
+  CuVector<BaseFloat> gconsts_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(CuAmDiagGmm);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_GMM_CU_AM_DIAG_GMM_H_
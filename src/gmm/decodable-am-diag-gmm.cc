@@ -18,6 +18,7 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <vector>
 using std::vector;
 
@@ -32,6 +33,9 @@ BaseFloat DecodableAmDiagGmmUnmapped::LogLikelihoodZeroBased(
   KALDI_ASSERT(static_cast<size_t>(state) < static_cast<size_t>(NumIndices()) &&
                "Likely graph/model mismatch, e.g. using wrong HCLG.fst");
 
+  if (frame_batch_size_ > 1)
+    return LogLikelihoodBatched(frame, state);
+
   if (log_like_cache_[state].hit_time == frame) {
     return log_like_cache_[state].log_like;  // return cached value, if found
   }
@@ -55,11 +59,17 @@ BaseFloat DecodableAmDiagGmmUnmapped::LogLikelihoodZeroBased(
         "before computing likelihood.";
   }
 
-  Vector<BaseFloat> loglikes(pdf.gconsts());  // need to recreate for each pdf
-  // loglikes +=  means * inv(vars) * data.
-  loglikes.AddMatVec(1.0, pdf.means_invvars(), kNoTrans, data, 1.0);
-  // loglikes += -0.5 * inv(vars) * data_sq.
-  loglikes.AddMatVec(-0.5, pdf.inv_vars(), kNoTrans, data_squared_, 1.0);
+  Vector<BaseFloat> loglikes;
+  if (pdf.UsesLikelihoodKernel()) {
+    // The code specialized on the dimension is faster.
+    pdf.LogLikelihoods(data, &loglikes);
+  } else {
+    loglikes = pdf.gconsts();
+    // loglikes +=  means * inv(vars) * data.
+    loglikes.AddMatVec(1.0, pdf.means_invvars(), kNoTrans, data, 1.0);
+    // loglikes += -0.5 * inv(vars) * data_sq.
+    loglikes.AddMatVec(-0.5, pdf.inv_vars(), kNoTrans, data_squared_, 1.0);
+  }
 
   BaseFloat log_sum = loglikes.LogSumExp(log_sum_exp_prune_);
   if (KALDI_ISNAN(log_sum) || KALDI_ISINF(log_sum))
@@ -71,6 +81,112 @@ BaseFloat DecodableAmDiagGmmUnmapped::LogLikelihoodZeroBased(
   return log_sum;
 }
 
+BaseFloat DecodableAmDiagGmmUnmapped::LogLikelihoodBatched(
+    int32 frame, int32 state) {
+  int32 start = batch_start_[state];
+  if (start >= 0 && frame >= start && frame < start + frame_batch_size_)
+    return batch_log_likes_(state, frame - start);
+
+  const DiagGmm &pdf = acoustic_model_.GetPdf(state);
+  if (pdf.Dim() != feature_matrix_.NumCols()) {
+    KALDI_ERR << "Dim mismatch: data dim = "  << feature_matrix_.NumCols()
+        << " vs. model dim = " << pdf.Dim();
+  }
+  if (!pdf.valid_gconsts()) {
+    KALDI_ERR << "State "  << (state)  << ": Must call ComputeGconsts() "
+        "before computing likelihood.";
+  }
+  if (feats_squared_.NumRows() != feature_matrix_.NumRows()) {
+    feats_squared_ = feature_matrix_;
+    feats_squared_.ApplyPow(2.0);
+  }
+
+  int32 num_frames = std::min(frame_batch_size_, NumFramesReady() - frame);
+  SubMatrix<BaseFloat> data(feature_matrix_, frame, num_frames,
+                            0, feature_matrix_.NumCols()),
+      data_sq(feats_squared_, frame, num_frames, 0, feats_squared_.NumCols());
+  // loglikes(t, i) is the log-likelihood of frame "frame + t" for Gaussian i.
+  Matrix<BaseFloat> loglikes(num_frames, pdf.NumGauss(), kUndefined);
+  loglikes.CopyRowsFromVec(pdf.gconsts());
+  // loglikes +=  data * inv(vars) * means.
+  loglikes.AddMatMat(1.0, data, kNoTrans, pdf.means_invvars(), kTrans, 1.0);
+  // loglikes += -0.5 * data_sq * inv(vars).
+  loglikes.AddMatMat(-0.5, data_sq, kNoTrans, pdf.inv_vars(), kTrans, 1.0);
+
+  for (int32 t = 0; t < num_frames; t++) {
+    BaseFloat log_sum = loglikes.Row(t).LogSumExp(log_sum_exp_prune_);
+    if (KALDI_ISNAN(log_sum) || KALDI_ISINF(log_sum))
+      KALDI_ERR << "Invalid answer (overflow or invalid variances/features?)";
+    batch_log_likes_(state, t) = log_sum;
+  }
+  batch_start_[state] = frame;
+  return batch_log_likes_(state, 0);
+}
+
+void DecodableAmDiagGmmUnmapped::SetFrameBatchSize(int32 batch_size) {
+  KALDI_ASSERT(batch_size > 0);
+  frame_batch_size_ = batch_size;
+  if (batch_size > 1) {
+    batch_start_.assign(acoustic_model_.NumPdfs(), -1);
+    batch_log_likes_.Resize(acoustic_model_.NumPdfs(), batch_size, kUndefined);
+  } else {
+    batch_start_.clear();
+    batch_log_likes_.Resize(0, 0);
+  }
+}
+
+const BaseFloat *DecodableAmDiagGmmUnmapped::ComputeFrameScores(
+    int32 frame, BaseFloat scale) {
+  int32 num_pdfs = acoustic_model_.NumPdfs();
+  frame_scores_.Resize(num_pdfs, kUndefined);
+  for (int32 pdf = 0; pdf < num_pdfs; pdf++)
+    frame_scores_(pdf) = scale * LogLikelihoodZeroBased(frame, pdf);
+  return frame_scores_.Data();
+}
+
+BaseFloat DecodableAmDiagGmmGselectScaled::LogLikelihoodZeroBased(
+    int32 frame, int32 state) {
+  KALDI_ASSERT(static_cast<size_t>(frame) <
+               static_cast<size_t>(NumFramesReady()));
+  KALDI_ASSERT(static_cast<size_t>(state) <
+               static_cast<size_t>(acoustic_model_.NumPdfs()) &&
+               "Likely graph/model mismatch, e.g. using wrong HCLG.fst");
+
+  if (log_like_cache_[state].hit_time == frame) {
+    return log_like_cache_[state].log_like;  // return cached value, if found
+  }
+
+  const VectorBase<BaseFloat> &data = feature_matrix_.Row(frame);
+  if (frame != gselect_frame_) {
+    gselect_.SelectUbm(data, &ubm_gselect_);
+    gselect_frame_ = frame;
+  }
+  const DiagGmm &pdf = acoustic_model_.GetPdf(state);
+  if (!pdf.valid_gconsts()) {
+    KALDI_ERR << "State "  << (state)  << ": Must call ComputeGconsts() "
+        "before computing likelihood.";
+  }
+  gselect_.GetGaussians(state, ubm_gselect_, &gauss_);
+  pdf.LogLikelihoodsPreselect(data, gauss_, &loglikes_);
+  num_evaluated_ += gauss_.size();
+  num_total_ += pdf.NumGauss();
+
+  BaseFloat log_sum = loglikes_.LogSumExp(log_sum_exp_prune_);
+  if (KALDI_ISNAN(log_sum) || KALDI_ISINF(log_sum))
+    KALDI_ERR << "Invalid answer (overflow or invalid variances/features?)";
+
+  log_like_cache_[state].log_like = log_sum;
+  log_like_cache_[state].hit_time = frame;
+  return log_sum;
+}
+
+DecodableAmDiagGmmGselectScaled::~DecodableAmDiagGmmGselectScaled() {
+  if (num_total_ > 0)
+    KALDI_VLOG(2) << "Gaussian selection: evaluated " << num_evaluated_
+                  << " out of " << num_total_ << " Gaussians ("
+                  << (100.0 * num_evaluated_ / num_total_) << "%)";
+}
+
 void DecodableAmDiagGmmUnmapped::ResetLogLikeCache() {
   if (static_cast<int32>(log_like_cache_.size()) != acoustic_model_.NumPdfs()) {
     log_like_cache_.resize(acoustic_model_.NumPdfs());
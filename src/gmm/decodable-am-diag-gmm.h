@@ -26,6 +26,7 @@
 
 #include "base/kaldi-common.h"
 #include "gmm/am-diag-gmm.h"
+#include "gmm/am-diag-gmm-gselect.h"
 #include "hmm/transition-model.h"
 #include "itf/decodable-itf.h"
 #include "transform/regression-tree.h"
@@ -53,10 +54,18 @@ class DecodableAmDiagGmmUnmapped : public DecodableInterface {
                              BaseFloat log_sum_exp_prune = -1.0):
     acoustic_model_(am), feature_matrix_(feats),
     previous_frame_(-1), log_sum_exp_prune_(log_sum_exp_prune), 
-    data_squared_(feats.NumCols()) {
+    data_squared_(feats.NumCols()), frame_batch_size_(1) {
     ResetLogLikeCache();
   }
 
+  /// If batch_size > 1, the first time the likelihood of a pdf is needed on a
+  /// frame, we compute it for the next batch_size - 1 frames as well, as
+  /// matrix-matrix products against that pdf's parameters.  This is faster
+  /// than one frame at a time (the parameters are read from memory once per
+  /// batch), but wastes work on the frames where the pdf isn't needed any
+  /// more; something like 4 to 16 is reasonable for typical beams.
+  void SetFrameBatchSize(int32 batch_size);
+
   // Note, frames are numbered from zero.  But state_index is numbered
   // from one (this routine is called by FSTs).
   virtual BaseFloat LogLikelihood(int32 frame, int32 state_index) {
@@ -75,6 +84,15 @@ class DecodableAmDiagGmmUnmapped : public DecodableInterface {
  protected:
   void ResetLogLikeCache();
   virtual BaseFloat LogLikelihoodZeroBased(int32 frame, int32 state_index);
+  /// Called from LogLikelihoodZeroBased() if frame_batch_size_ > 1.
+  BaseFloat LogLikelihoodBatched(int32 frame, int32 state_index);
+  /// Computes the log-likelihoods of all pdfs for this frame, times "scale",
+  /// into frame_scores_, and returns frame_scores_.Data().  This is used in
+  /// the GetFrameScores() functions of the child classes.  Note: this
+  /// computes every pdf, whereas LogLikelihood() computes only the pdfs that
+  /// the decoder asks for; it's faster when most pdfs are active on each
+  /// frame, as with typical beams.
+  const BaseFloat *ComputeFrameScores(int32 frame, BaseFloat scale);
 
   const AmDiagGmm &acoustic_model_;
   const Matrix<BaseFloat> &feature_matrix_;
@@ -87,9 +105,17 @@ class DecodableAmDiagGmmUnmapped : public DecodableInterface {
     int32 hit_time;     ///< Frame for which this value is relevant
   };
   std::vector<LikelihoodCacheRecord> log_like_cache_;
+  Vector<BaseFloat> frame_scores_;  ///< Used in ComputeFrameScores().
  private:
   Vector<BaseFloat> data_squared_;  ///< Cache for fast likelihood calculation
 
+  int32 frame_batch_size_;  ///< See SetFrameBatchSize().
+  /// Used if frame_batch_size_ > 1: batch_start_[pdf] is the first frame
+  /// whose log-likelihood for "pdf" is in row "pdf" of batch_log_likes_
+  /// (-1 if none), which holds frame_batch_size_ consecutive frames.
+  std::vector<int32> batch_start_;
+  Matrix<BaseFloat> batch_log_likes_;
+  Matrix<BaseFloat> feats_squared_;  ///< The squared features, if batching.
 
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableAmDiagGmmUnmapped);
 };
@@ -112,6 +138,12 @@ class DecodableAmDiagGmm: public DecodableAmDiagGmmUnmapped {
   // Indices are one-based!  This is for compatibility with OpenFst.
   virtual int32 NumIndices() const { return trans_model_.NumTransitionIds(); }
 
+  virtual const BaseFloat *GetFrameScores(int32 frame,
+                                          const int32 **index_to_row) {
+    *index_to_row = &(trans_model_.TransitionIdToPdfArray()[0]);
+    return ComputeFrameScores(frame, 1.0);
+  }
+
   const TransitionModel *TransModel() { return &trans_model_; }
  private: // want to access public to have pdf id information
   const TransitionModel &trans_model_;  // for tid to pdf mapping
@@ -146,6 +178,12 @@ class DecodableAmDiagGmmScaled: public DecodableAmDiagGmmUnmapped {
   // Indices are one-based!  This is for compatibility with OpenFst.
   virtual int32 NumIndices() const { return trans_model_.NumTransitionIds(); }
 
+  virtual const BaseFloat *GetFrameScores(int32 frame,
+                                          const int32 **index_to_row) {
+    *index_to_row = &(trans_model_.TransitionIdToPdfArray()[0]);
+    return ComputeFrameScores(frame, scale_);
+  }
+
   const TransitionModel *TransModel() { return &trans_model_; }
 
   virtual ~DecodableAmDiagGmmScaled() {
@@ -159,6 +197,37 @@ class DecodableAmDiagGmmScaled: public DecodableAmDiagGmmUnmapped {
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableAmDiagGmmScaled);
 };
 
+/// DecodableAmDiagGmmGselectScaled is as DecodableAmDiagGmmScaled, but only
+/// evaluates the Gaussians of each pdf that Gaussian selection with a UBM
+/// picks on each frame (see AmDiagGmmGselect), which is faster and
+/// approximate.  SetFrameBatchSize() has no effect on it.
+class DecodableAmDiagGmmGselectScaled: public DecodableAmDiagGmmScaled {
+ public:
+  DecodableAmDiagGmmGselectScaled(const AmDiagGmmGselect &gselect,
+                                  const TransitionModel &tm,
+                                  const Matrix<BaseFloat> &feats,
+                                  BaseFloat scale,
+                                  BaseFloat log_sum_exp_prune = -1.0):
+      DecodableAmDiagGmmScaled(gselect.Am(), tm, feats, scale,
+                               log_sum_exp_prune),
+      gselect_(gselect), gselect_frame_(-1), num_evaluated_(0), num_total_(0) {}
+
+  virtual ~DecodableAmDiagGmmGselectScaled();
+
+ protected:
+  virtual BaseFloat LogLikelihoodZeroBased(int32 frame, int32 state_index);
+
+ private:
+  const AmDiagGmmGselect &gselect_;
+  int32 gselect_frame_;  ///< The frame that ubm_gselect_ is for.
+  std::vector<int32> ubm_gselect_;
+  std::vector<int32> gauss_;  ///< Temporary.
+  Vector<BaseFloat> loglikes_;  ///< Temporary.
+  int64 num_evaluated_;  ///< Number of Gaussians we evaluated...
+  int64 num_total_;  ///< ... out of this many.
+  KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableAmDiagGmmGselectScaled);
+};
+
 }  // namespace kaldi
 
 #endif  // KALDI_GMM_DECODABLE_AM_DIAG_GMM_H_
@@ -0,0 +1,177 @@
+// gmm/diag-gmm-kernel.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+
+#include "gmm/diag-gmm-kernel.h"
+
+namespace kaldi {
+
+namespace {
+
+const int32 kBlockSize = DiagGmmLikelihoodKernel::kBlockSize;
+
+template<int32 Dim>
+void LogLikelihoodsKernel(const BaseFloat *params, const BaseFloat *data,
+                          int32 begin_block, int32 end_block,
+                          BaseFloat *loglikes) {
+  BaseFloat x[Dim], x_sq[Dim];
+  for (int32 d = 0; d < Dim; d++) {
+    x[d] = data[d];
+    x_sq[d] = data[d] * data[d];
+  }
+  const int32 block_stride = kBlockSize * (2 * Dim + 1);
+  for (int32 b = begin_block; b < end_block; b++, loglikes += kBlockSize) {
+    const BaseFloat *p = params + b * block_stride;
+    BaseFloat sum[kBlockSize];
+    for (int32 i = 0; i < kBlockSize; i++)
+      sum[i] = p[i];
+    p += kBlockSize;
+    for (int32 d = 0; d < Dim; d++, p += 2 * kBlockSize) {
+      for (int32 i = 0; i < kBlockSize; i++)
+        sum[i] += p[i] * x[d] + p[kBlockSize + i] * x_sq[d];
+    }
+    for (int32 i = 0; i < kBlockSize; i++)
+      loglikes[i] = sum[i];
+  }
+}
+
+template<int32 Dim>
+BaseFloat ComponentLogLikelihoodKernel(const BaseFloat *params,
+                                       const BaseFloat *data, int32 gauss) {
+  const BaseFloat *p = params + (gauss / kBlockSize) *
+      kBlockSize * (2 * Dim + 1) + gauss % kBlockSize;
+  BaseFloat sum = p[0];
+  p += kBlockSize;
+  for (int32 d = 0; d < Dim; d++, p += 2 * kBlockSize)
+    sum += p[0] * data[d] + p[kBlockSize] * (data[d] * data[d]);
+  return sum;
+}
+
+template<int32 Dim>
+const DiagGmmLikelihoodKernel::Impl *GetImpl() {
+  static const DiagGmmLikelihoodKernel::Impl impl = {
+    &LogLikelihoodsKernel<Dim>, &ComponentLogLikelihoodKernel<Dim> };
+  return &impl;
+}
+
+// The dimensions we specialize for: raw MFCCs, MFCC + deltas + deltas-deltas,
+// LDA+MLLT features and the features of typical iVector-extractor UBMs.
+const DiagGmmLikelihoodKernel::Impl *GetImplForDim(int32 dim) {
+  switch (dim) {
+    case 13: return GetImpl<13>();
+    case 39: return GetImpl<39>();
+    case 40: return GetImpl<40>();
+    case 60: return GetImpl<60>();
+    default: return NULL;
+  }
+}
+
+}  // namespace
+
+bool DiagGmmLikelihoodKernel::IsSpecializedDim(int32 dim) {
+  return GetImplForDim(dim) != NULL;
+}
+
+void DiagGmmLikelihoodKernel::Init(const VectorBase<BaseFloat> &gconsts,
+                                   const MatrixBase<BaseFloat> &means_invvars,
+                                   const MatrixBase<BaseFloat> &inv_vars) {
+  int32 num_gauss = gconsts.Dim(), dim = means_invvars.NumCols();
+  KALDI_ASSERT(means_invvars.NumRows() == num_gauss &&
+               inv_vars.NumRows() == num_gauss && inv_vars.NumCols() == dim);
+  impl_ = GetImplForDim(dim);
+  if (impl_ == NULL) {
+    Clear();
+    return;
+  }
+  dim_ = dim;
+  num_gauss_ = num_gauss;
+  int32 num_blocks = (num_gauss + kBlockSize - 1) / kBlockSize,
+      block_stride = kBlockSize * (2 * dim + 1);
+  params_.Resize(num_blocks * block_stride);  // zeroes the padding.
+  BaseFloat *data = params_.Data();
+  for (int32 g = 0; g < num_gauss; g++) {
+    BaseFloat *p = data + (g / kBlockSize) * block_stride + g % kBlockSize;
+    p[0] = gconsts(g);
+    p += kBlockSize;
+    const BaseFloat *mean_invvar = means_invvars.RowData(g),
+        *inv_var = inv_vars.RowData(g);
+    for (int32 d = 0; d < dim; d++, p += 2 * kBlockSize) {
+      p[0] = mean_invvar[d];
+      p[kBlockSize] = -0.5 * inv_var[d];
+    }
+  }
+}
+
+void DiagGmmLikelihoodKernel::Clear() {
+  dim_ = 0;
+  num_gauss_ = 0;
+  impl_ = NULL;
+  params_.Resize(0);
+}
+
+void DiagGmmLikelihoodKernel::LogLikelihoods(const BaseFloat *data,
+                                             BaseFloat *loglikes) const {
+  KALDI_ASSERT(IsEnabled());
+  int32 num_full_blocks = num_gauss_ / kBlockSize,
+      remainder = num_gauss_ % kBlockSize;
+  impl_->log_likelihoods(params_.Data(), data, 0, num_full_blocks, loglikes);
+  if (remainder != 0) {
+    BaseFloat last_block[kBlockSize];
+    impl_->log_likelihoods(params_.Data(), data, num_full_blocks,
+                           num_full_blocks + 1, last_block);
+    std::copy(last_block, last_block + remainder,
+              loglikes + num_full_blocks * kBlockSize);
+  }
+}
+
+void DiagGmmLikelihoodKernel::LogLikelihoodsPreselect(
+    const BaseFloat *data, const std::vector<int32> &indices,
+    BaseFloat *loglikes) const {
+  KALDI_ASSERT(IsEnabled());
+  int32 num_indices = indices.size();
+  if (num_indices == 0)
+    return;
+  if (indices.back() + 1 - indices.front() == num_indices &&
+      num_indices >= kBlockSize) {
+    // A contiguous range (a common case): we compute the blocks that cover
+    // it, which wastes less than two blocks.
+    int32 begin_block = indices.front() / kBlockSize,
+        end_block = indices.back() / kBlockSize + 1;
+    std::vector<BaseFloat> block_loglikes((end_block - begin_block) *
+                                          kBlockSize);
+    impl_->log_likelihoods(params_.Data(), data, begin_block, end_block,
+                           &(block_loglikes[0]));
+    int32 offset = indices.front() - begin_block * kBlockSize;
+    std::copy(block_loglikes.begin() + offset,
+              block_loglikes.begin() + offset + num_indices, loglikes);
+  } else {
+    for (int32 i = 0; i < num_indices; i++) {
+      KALDI_PARANOID_ASSERT(indices[i] >= 0 && indices[i] < num_gauss_);
+      loglikes[i] = impl_->component_log_likelihood(params_.Data(), data,
+                                                    indices[i]);
+    }
+  }
+}
+
+BaseFloat DiagGmmLikelihoodKernel::ComponentLogLikelihood(
+    const BaseFloat *data, int32 gauss) const {
+  KALDI_ASSERT(IsEnabled() && gauss >= 0 && gauss < num_gauss_);
+  return impl_->component_log_likelihood(params_.Data(), data, gauss);
+}
+
+}  // namespace kaldi
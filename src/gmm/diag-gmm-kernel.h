@@ -0,0 +1,117 @@
+// gmm/diag-gmm-kernel.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_GMM_DIAG_GMM_KERNEL_H_
+#define KALDI_GMM_DIAG_GMM_KERNEL_H_
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "matrix/matrix-lib.h"
+
+namespace kaldi {
+
+/**
+   DiagGmmLikelihoodKernel computes the per-Gaussian log-likelihoods of a
+   diagonal GMM for one frame, with code specialized at compile time on the
+   feature dimension.  DiagGmm sets it up in ComputeGconsts() (so, in
+   particular, when a model is read) if there is a specialization for its
+   dimension (see IsSpecializedDim()), and otherwise uses the generic
+   matrix-vector code.
+
+   The parameters are stored in blocks of kBlockSize Gaussians, and within a
+   block, dimension by dimension ("structure of arrays"), so the inner loop is
+   over the Gaussians of a block, which the compiler vectorizes; with the
+   dimension known, the loop over dimensions is unrolled, the terms for the
+   means and the variances are computed in the same pass, and the partial
+   sums stay in registers.  This is faster than two matrix-vector products for
+   one frame at a time, but for many frames at once a matrix-matrix product
+   is faster, so the multi-frame LogLikelihoods() of DiagGmm doesn't use this
+   for more than a few frames.
+
+   Because the sums are done in a different order, the results may differ
+   from those of the generic code in the last few bits.
+*/
+class DiagGmmLikelihoodKernel {
+ public:
+  /// The number of Gaussians in a block (the kernels are written for this).
+  static const int32 kBlockSize = 8;
+
+  DiagGmmLikelihoodKernel(): dim_(0), num_gauss_(0), impl_(NULL) { }
+
+  /// Returns true if there is a specialized kernel for dimension "dim".
+  static bool IsSpecializedDim(int32 dim);
+
+  /// Sets up the kernel from the parameters of a DiagGmm, as in DiagGmm
+  /// (gconsts including the constant term, means times inverse variances,
+  /// inverse variances).  If IsSpecializedDim(means_invvars.NumCols()) is
+  /// false, this is the same as Clear().
+  void Init(const VectorBase<BaseFloat> &gconsts,
+            const MatrixBase<BaseFloat> &means_invvars,
+            const MatrixBase<BaseFloat> &inv_vars);
+
+  /// Frees the parameters; after this, IsEnabled() returns false.
+  void Clear();
+
+  /// Returns true if Init() was called with a specialized dimension.
+  bool IsEnabled() const { return impl_ != NULL; }
+
+  int32 Dim() const { return dim_; }
+  int32 NumGauss() const { return num_gauss_; }
+
+  /// Outputs the log-likelihoods of all the Gaussians for one frame ("data"
+  /// has dimension Dim(), "loglikes" NumGauss()).  Requires IsEnabled().
+  void LogLikelihoods(const BaseFloat *data, BaseFloat *loglikes) const;
+
+  /// Outputs the log-likelihoods of Gaussians "indices" (which need not be
+  /// sorted) for one frame.  Requires IsEnabled().
+  void LogLikelihoodsPreselect(const BaseFloat *data,
+                               const std::vector<int32> &indices,
+                               BaseFloat *loglikes) const;
+
+  /// Returns the log-likelihood of Gaussian "gauss" for one frame.  Requires
+  /// IsEnabled().
+  BaseFloat ComponentLogLikelihood(const BaseFloat *data, int32 gauss) const;
+
+  // The kernels for a particular dimension; this is an implementation detail.
+  struct Impl {
+    // Outputs the log-likelihoods of blocks [begin_block, end_block), i.e.
+    // kBlockSize * (end_block - begin_block) values.
+    void (*log_likelihoods)(const BaseFloat *params, const BaseFloat *data,
+                            int32 begin_block, int32 end_block,
+                            BaseFloat *loglikes);
+    BaseFloat (*component_log_likelihood)(const BaseFloat *params,
+                                          const BaseFloat *data,
+                                          int32 gauss);
+  };
+
+ private:
+  int32 dim_;
+  int32 num_gauss_;
+  const Impl *impl_;  // NULL if not enabled.
+  // The parameters of block b start at b * kBlockSize * (2 * dim_ + 1): the
+  // gconsts of its Gaussians, then for each dimension d, the means times
+  // inverse variances for d, then -0.5 times the inverse variances for d.
+  // The Gaussians that pad the last block have zero parameters.
+  Vector<BaseFloat> params_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(DiagGmmLikelihoodKernel);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_GMM_DIAG_GMM_KERNEL_H_
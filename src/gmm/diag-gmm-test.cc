@@ -296,6 +296,83 @@ void UnitTestDiagGmm() {
   unlink("tmpfb");
 }
 
+// Checks the dimension-specialized likelihood code against a direct
+// computation.
+void UnitTestDiagGmmLikelihoodKernel() {
+  int32 dims[] = { 13, 39, 40, 60 };
+  for (int32 i = 0; i < 4; i++) {
+    int32 dim = dims[i], num_gauss = RandInt(1, 40);
+    DiagGmm gmm(num_gauss, dim);
+    Matrix<BaseFloat> inv_vars(num_gauss, dim), means(num_gauss, dim);
+    Vector<BaseFloat> weights(num_gauss);
+    for (int32 g = 0; g < num_gauss; g++) {
+      for (int32 d = 0; d < dim; d++) {
+        inv_vars(g, d) = Exp(0.5 * RandGauss());
+        means(g, d) = RandGauss();
+      }
+      weights(g) = Exp(RandGauss());
+    }
+    weights.Scale(1.0 / weights.Sum());
+    gmm.SetWeights(weights);
+    gmm.SetInvVarsAndMeans(inv_vars, means);
+    gmm.ComputeGconsts();
+    KALDI_ASSERT(gmm.UsesLikelihoodKernel());
+
+    int32 num_frames = RandInt(1, 10);
+    Matrix<BaseFloat> data(num_frames, dim), data_sq(num_frames, dim);
+    data.SetRandn();
+    data_sq.CopyFromMat(data);
+    data_sq.ApplyPow(2.0);
+    Matrix<BaseFloat> ref_loglikes(num_frames, num_gauss);
+    ref_loglikes.CopyRowsFromVec(gmm.gconsts());
+    ref_loglikes.AddMatMat(1.0, data, kNoTrans, gmm.means_invvars(), kTrans,
+                           1.0);
+    ref_loglikes.AddMatMat(-0.5, data_sq, kNoTrans, gmm.inv_vars(), kTrans,
+                           1.0);
+
+    Matrix<BaseFloat> loglikes;
+    gmm.LogLikelihoods(data, &loglikes);
+    KALDI_ASSERT(loglikes.ApproxEqual(ref_loglikes, 1.0e-04));
+    DiagGmm gmm_copy(gmm);
+    KALDI_ASSERT(gmm_copy.UsesLikelihoodKernel());
+    for (int32 t = 0; t < num_frames; t++) {
+      Vector<BaseFloat> frame_loglikes;
+      gmm_copy.LogLikelihoods(data.Row(t), &frame_loglikes);
+      KALDI_ASSERT(frame_loglikes.ApproxEqual(ref_loglikes.Row(t), 1.0e-04));
+      int32 g = RandInt(0, num_gauss - 1);
+      AssertEqual(gmm.ComponentLogLikelihood(data.Row(t), g),
+                  ref_loglikes(t, g), 1.0e-04);
+      // A contiguous range, and a random subset.
+      std::vector<int32> range, subset;
+      int32 begin = RandInt(0, num_gauss - 1), end = RandInt(begin + 1,
+                                                             num_gauss);
+      for (int32 j = begin; j < end; j++)
+        range.push_back(j);
+      for (int32 j = 0; j < num_gauss; j++)
+        if (RandInt(0, 1) == 0) subset.push_back(j);
+      if (subset.empty()) subset.push_back(g);
+      Vector<BaseFloat> range_loglikes, subset_loglikes;
+      gmm.LogLikelihoodsPreselect(data.Row(t), range, &range_loglikes);
+      gmm.LogLikelihoodsPreselect(data.Row(t), subset, &subset_loglikes);
+      for (size_t j = 0; j < range.size(); j++)
+        AssertEqual(range_loglikes(j), ref_loglikes(t, range[j]), 1.0e-04);
+      for (size_t j = 0; j < subset.size(); j++)
+        AssertEqual(subset_loglikes(j), ref_loglikes(t, subset[j]), 1.0e-04);
+    }
+    if (num_gauss > 1) {
+      // Removing a Gaussian (without renormalizing, so the gconsts stay
+      // valid) must update the kernel.
+      int32 g = RandInt(0, num_gauss - 1);
+      gmm_copy.RemoveComponent(g, false);
+      Vector<BaseFloat> frame_loglikes;
+      gmm_copy.LogLikelihoods(data.Row(0), &frame_loglikes);
+      for (int32 j = 0; j < num_gauss - 1; j++)
+        AssertEqual(frame_loglikes(j), ref_loglikes(0, j < g ? j : j + 1),
+                    1.0e-04);
+    }
+  }
+}
+
 }  // end namespace kaldi
 
 int main() {
@@ -303,6 +380,7 @@ int main() {
   for (int i = 0; i < 2; i++) {
     kaldi::UnitTestDiagGmm();
     kaldi::UnitTestDiagGmmGenerate();
+    kaldi::UnitTestDiagGmmLikelihoodKernel();
   }
   std::cout << "Test OK.\n";
 }
@@ -87,6 +87,10 @@ void DiagGmm::CopyFromDiagGmm(const DiagGmm &diaggmm) {
   inv_vars_.CopyFromMat(diaggmm.inv_vars_);
   means_invvars_.CopyFromMat(diaggmm.means_invvars_);
   valid_gconsts_ = diaggmm.valid_gconsts_;
+  if (valid_gconsts_)
+    kernel_.Init(gconsts_, means_invvars_, inv_vars_);
+  else
+    kernel_.Clear();
 }
 
 void DiagGmm::CopyFromFullGmm(const FullGmm &fullgmm) {
@@ -148,6 +152,7 @@ int32 DiagGmm::ComputeGconsts() {
   }
 
   valid_gconsts_ = true;
+  kernel_.Init(gconsts_, means_invvars_, inv_vars_);
   return num_bad;
 }
 
@@ -502,6 +507,8 @@ BaseFloat DiagGmm::ComponentLogLikelihood(const VectorBase<BaseFloat> &data,
     KALDI_ERR << "DiagGmm::ComponentLogLikelihood, dimension "
         << "mismatch " << (data.Dim()) << " vs. "<< (Dim());
   }
+  if (kernel_.IsEnabled())
+    return kernel_.ComponentLogLikelihood(data.Data(), comp_id);
   BaseFloat loglike;
   Vector<BaseFloat> data_sq(data);
   data_sq.ApplyPow(2.0);
@@ -528,11 +535,15 @@ BaseFloat DiagGmm::LogLikelihood(const VectorBase<BaseFloat> &data) const {
 void DiagGmm::LogLikelihoods(const VectorBase<BaseFloat> &data,
                              Vector<BaseFloat> *loglikes) const {
   loglikes->Resize(gconsts_.Dim(), kUndefined);
-  loglikes->CopyFromVec(gconsts_);
   if (data.Dim() != Dim()) {
     KALDI_ERR << "DiagGmm::ComponentLogLikelihood, dimension "
               << "mismatch " << data.Dim() << " vs. "<< Dim();
   }
+  if (UsesLikelihoodKernel()) {
+    kernel_.LogLikelihoods(data.Data(), loglikes->Data());
+    return;
+  }
+  loglikes->CopyFromVec(gconsts_);
   Vector<BaseFloat> data_sq(data);
   data_sq.ApplyPow(2.0);
 
@@ -543,15 +554,25 @@ void DiagGmm::LogLikelihoods(const VectorBase<BaseFloat> &data,
 }
 
 
+// Up to this many frames, DiagGmm::LogLikelihoods() for a matrix uses the
+// kernel frame by frame rather than matrix multiplications.
+static const int32 kMaxKernelFrames = 2;
+
 void DiagGmm::LogLikelihoods(const MatrixBase<BaseFloat> &data,
                              Matrix<BaseFloat> *loglikes) const {
   KALDI_ASSERT(data.NumRows() != 0);
   loglikes->Resize(data.NumRows(), gconsts_.Dim(), kUndefined);
-  loglikes->CopyRowsFromVec(gconsts_);
   if (data.NumCols() != Dim()) {
     KALDI_ERR << "DiagGmm::ComponentLogLikelihood, dimension "
               << "mismatch " << data.NumCols() << " vs. "<< Dim();
   }
+  // For a few frames, the kernel is faster than the matrix multiplications.
+  if (UsesLikelihoodKernel() && data.NumRows() <= kMaxKernelFrames) {
+    for (int32 t = 0; t < data.NumRows(); t++)
+      kernel_.LogLikelihoods(data.RowData(t), loglikes->RowData(t));
+    return;
+  }
+  loglikes->CopyRowsFromVec(gconsts_);
   Matrix<BaseFloat> data_sq(data);
   data_sq.ApplyPow(2.0);
 
@@ -567,11 +588,15 @@ void DiagGmm::LogLikelihoodsPreselect(const VectorBase<BaseFloat> &data,
                                       const std::vector<int32> &indices,
                                       Vector<BaseFloat> *loglikes) const {
   KALDI_ASSERT(data.Dim() == Dim());
+  int32 num_indices = static_cast<int32>(indices.size());
+  loglikes->Resize(num_indices, kUndefined);
+  if (UsesLikelihoodKernel()) {
+    kernel_.LogLikelihoodsPreselect(data.Data(), indices, loglikes->Data());
+    return;
+  }
   Vector<BaseFloat> data_sq(data);
   data_sq.ApplyPow(2.0);
 
-  int32 num_indices = static_cast<int32>(indices.size());
-  loglikes->Resize(num_indices, kUndefined);
   if (indices.back() + 1 - indices.front() == num_indices) {
     // A special (but common) case when the indices form a contiguous range.
     int32 start_idx = indices.front();
@@ -627,6 +652,8 @@ void DiagGmm::RemoveComponent(int32 gauss, bool renorm_weights) {
     weights_.Scale(1.0/sum_weights);
     valid_gconsts_ = false;
   }
+  if (valid_gconsts_)
+    kernel_.Init(gconsts_, means_invvars_, inv_vars_);
 }
 
 void DiagGmm::RemoveComponents(const std::vector<int32> &gauss_in,
@@ -28,6 +28,7 @@
 #include <vector>
 
 #include "base/kaldi-common.h"
+#include "gmm/diag-gmm-kernel.h"
 #include "gmm/model-common.h"
 #include "matrix/matrix-lib.h"
 #include "tree/cluster-utils.h"
@@ -180,6 +181,12 @@ class DiagGmm {
   const Matrix<BaseFloat> &means_invvars() const { return means_invvars_; }
   const Matrix<BaseFloat> &inv_vars() const { return inv_vars_; }
   bool valid_gconsts() const { return valid_gconsts_; }
+  /// Returns true if the log-likelihoods for single frames are computed by
+  /// code specialized on the dimension (see DiagGmmLikelihoodKernel); it is
+  /// set up by ComputeGconsts().
+  bool UsesLikelihoodKernel() const {
+    return valid_gconsts_ && kernel_.IsEnabled();
+  }
 
   /// Removes single component from model
   void RemoveComponent(int32 gauss, bool renorm_weights);
@@ -235,6 +242,9 @@ class DiagGmm {
   Vector<BaseFloat> weights_;        ///< weights (not log).
   Matrix<BaseFloat> inv_vars_;       ///< Inverted (diagonal) variances
   Matrix<BaseFloat> means_invvars_;  ///< Means times inverted variance
+  /// The parameters rearranged for the dimension-specialized code; only set
+  /// up if there is a kernel for Dim(), and only used if valid_gconsts_.
+  DiagGmmLikelihoodKernel kernel_;
 
   // merged_components_logdet computes logdet for merged components
   // f1, f2 are first-order stats (normalized by zero-order stats)
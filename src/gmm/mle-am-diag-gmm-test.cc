@@ -91,6 +91,36 @@ void TestAmDiagGmmAccsIO(const AmDiagGmm &am_gmm,
   unlink("tmpfb");
 }
 
+// Tests that AccumulateForGmms() gives the same stats as AccumulateForGmm()
+// for each frame.
+void TestAmDiagGmmAccsBatched(const AmDiagGmm &am_gmm,
+                              const Matrix<BaseFloat> &feats) {
+  kaldi::GmmFlagsType flags = kaldi::kGmmAll;
+  AccumAmDiagGmm accs, accs_batched;
+  accs.Init(am_gmm, flags);
+  accs_batched.Init(am_gmm, flags);
+  std::vector<std::vector<std::pair<int32, BaseFloat> > > pdf_post(
+      feats.NumRows());
+  double loglike = 0.0;
+  for (int32 i = 0; i < feats.NumRows(); i++) {
+    int32 num_pdfs = RandInt(0, 2);
+    for (int32 j = 0; j < num_pdfs; j++) {
+      int32 pdf = RandInt(0, am_gmm.NumPdfs() - 1);
+      BaseFloat weight = RandUniform();
+      pdf_post[i].push_back(std::make_pair(pdf, weight));
+      loglike += weight * accs.AccumulateForGmm(am_gmm, feats.Row(i), pdf,
+                                                weight);
+    }
+  }
+  BaseFloat loglike_batched =
+      accs_batched.AccumulateForGmms(am_gmm, feats, pdf_post);
+  AssertEqual(loglike, loglike_batched, 1e-4);
+  AssertEqual(accs.TotLogLike(), accs_batched.TotLogLike(), 1e-4);
+  AssertEqual(accs.TotCount(), accs_batched.TotCount(), 1e-4);
+  for (int32 pdf = 0; pdf < am_gmm.NumPdfs(); pdf++)
+    accs.GetAcc(pdf).AssertEqual(accs_batched.GetAcc(pdf));
+}
+
 void UnitTestMleAmDiagGmm() {
   int32 dim = 1 + kaldi::RandInt(0, 9),  // random dimension of the gmm
       num_pdfs = 5 + kaldi::RandInt(0, 9);  // random number of states
@@ -126,6 +156,7 @@ void UnitTestMleAmDiagGmm() {
     }
   }
   TestAmDiagGmmAccsIO(am_gmm, feats);
+  TestAmDiagGmmAccsBatched(am_gmm, feats);
 }
 
 
@@ -18,6 +18,8 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+
 #include "gmm/am-diag-gmm.h"
 #include "gmm/mle-am-diag-gmm.h"
 #include "util/stl-utils.h"
@@ -78,6 +80,47 @@ BaseFloat AccumAmDiagGmm::AccumulateForGmm(
   return log_like;
 }
 
+BaseFloat AccumAmDiagGmm::AccumulateForGmms(
+    const AmDiagGmm &model, const MatrixBase<BaseFloat> &data,
+    const std::vector<std::vector<std::pair<int32, BaseFloat> > > &pdf_post) {
+  KALDI_ASSERT(static_cast<size_t>(data.NumRows()) == pdf_post.size());
+  // (gmm-index, frame) pairs, with their weights.
+  std::vector<std::pair<std::pair<int32, int32>, BaseFloat> > frames;
+  for (size_t t = 0; t < pdf_post.size(); t++) {
+    for (size_t i = 0; i < pdf_post[t].size(); i++) {
+      int32 gmm_index = pdf_post[t][i].first;
+      KALDI_ASSERT(static_cast<size_t>(gmm_index) < gmm_accumulators_.size());
+      frames.push_back(std::make_pair(std::make_pair(gmm_index,
+                                                     static_cast<int32>(t)),
+                                      pdf_post[t][i].second));
+    }
+  }
+  std::sort(frames.begin(), frames.end());
+  double tot_like = 0.0;
+  std::vector<MatrixIndexT> rows;
+  for (size_t begin = 0; begin < frames.size(); ) {
+    int32 gmm_index = frames[begin].first.first;
+    size_t end = begin;
+    for (; end < frames.size() && frames[end].first.first == gmm_index; end++);
+    int32 num_frames = end - begin;
+    rows.resize(num_frames);
+    Vector<BaseFloat> weights(num_frames);
+    for (int32 i = 0; i < num_frames; i++) {
+      rows[i] = frames[begin + i].first.second;
+      weights(i) = frames[begin + i].second;
+    }
+    Matrix<BaseFloat> this_data(num_frames, data.NumCols(), kUndefined);
+    this_data.CopyRows(data, &(rows[0]));
+    double this_like = gmm_accumulators_[gmm_index]->AccumulateFromDiag(
+        model.GetPdf(gmm_index), this_data, weights);
+    tot_like += this_like;
+    total_log_like_ += this_like;
+    total_frames_ += weights.Sum();
+    begin = end;
+  }
+  return tot_like;
+}
+
 BaseFloat AccumAmDiagGmm::AccumulateForGmmTwofeats(
     const AmDiagGmm &model,
     const VectorBase<BaseFloat> &data1,
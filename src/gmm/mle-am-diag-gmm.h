@@ -52,6 +52,16 @@ class AccumAmDiagGmm {
                              const VectorBase<BaseFloat> &data,
                              int32 gmm_index, BaseFloat weight);
 
+  /// Accumulates stats for many frames at once: pdf_post[t] is a list of
+  /// (gmm-index, weight) pairs for row t of "data", e.g. a Posterior (see
+  /// hmm/posterior.h) converted to pdf-ids.  The frames are grouped by GMM so
+  /// that we can use matrix multiplications, which is much faster than
+  /// calling AccumulateForGmm() for each frame.  Returns the sum of
+  /// log-likelihood times weight.
+  BaseFloat AccumulateForGmms(
+      const AmDiagGmm &model, const MatrixBase<BaseFloat> &data,
+      const std::vector<std::vector<std::pair<int32, BaseFloat> > > &pdf_post);
+
   /// Accumulate stats for a single GMM in the model; uses data1 for
   /// getting posteriors and data2 for stats. Returns log likelihood.
   BaseFloat AccumulateForGmmTwofeats(const AmDiagGmm &model,
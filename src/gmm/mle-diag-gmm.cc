@@ -188,6 +188,53 @@ void AccumDiagGmm::AccumulateFromPosteriors(
   }
 }
 
+void AccumDiagGmm::AccumulateFromPosteriors(
+    const MatrixBase<BaseFloat> &data,
+    const MatrixBase<BaseFloat> &posteriors) {
+  if (flags_ & kGmmMeans)
+    KALDI_ASSERT(static_cast<int32>(data.NumCols()) == Dim());
+  KALDI_ASSERT(static_cast<int32>(posteriors.NumCols()) == NumGauss() &&
+               posteriors.NumRows() == data.NumRows());
+  Matrix<double> post_d(posteriors);  // Copy with type-conversion
+
+  // accumulate
+  occupancy_.AddRowSumMat(1.0, post_d);
+  if (flags_ & kGmmMeans) {
+    Matrix<double> data_d(data);  // Copy with type-conversion
+    mean_accumulator_.AddMatMat(1.0, post_d, kTrans, data_d, kNoTrans, 1.0);
+    if (flags_ & kGmmVariances) {
+      data_d.ApplyPow(2.0);
+      variance_accumulator_.AddMatMat(1.0, post_d, kTrans, data_d, kNoTrans,
+                                      1.0);
+    }
+  }
+}
+
+BaseFloat AccumDiagGmm::AccumulateFromDiag(
+    const DiagGmm &gmm,
+    const MatrixBase<BaseFloat> &data,
+    const VectorBase<BaseFloat> &frame_weights) {
+  KALDI_ASSERT(gmm.NumGauss() == NumGauss());
+  KALDI_ASSERT(gmm.Dim() == Dim());
+  KALDI_ASSERT(data.NumCols() == Dim() &&
+               data.NumRows() == frame_weights.Dim());
+  if (data.NumRows() == 0) return 0.0;
+
+  Matrix<BaseFloat> posteriors;
+  gmm.LogLikelihoods(data, &posteriors);
+  double tot_like = 0.0;
+  for (int32 t = 0; t < posteriors.NumRows(); t++) {
+    SubVector<BaseFloat> post(posteriors, t);
+    BaseFloat log_like = post.ApplySoftMax();
+    if (KALDI_ISNAN(log_like) || KALDI_ISINF(log_like))
+      KALDI_ERR << "Invalid answer (overflow or invalid variances/features?)";
+    tot_like += log_like * frame_weights(t);
+  }
+  posteriors.MulRowsVec(frame_weights);
+  AccumulateFromPosteriors(data, posteriors);
+  return tot_like;
+}
+
 BaseFloat AccumDiagGmm::AccumulateFromDiag(const DiagGmm &gmm,
                                            const VectorBase<BaseFloat> &data,
                                            BaseFloat frame_posterior) {
@@ -136,12 +136,24 @@ class AccumDiagGmm {
   void AccumulateFromPosteriors(const VectorBase<BaseFloat> &data,
                                 const VectorBase<BaseFloat> &gauss_posteriors);
 
+  /// Accumulate for all components, given the posteriors, for many frames at
+  /// once: row t of gauss_posteriors is for row t of data.
+  void AccumulateFromPosteriors(const MatrixBase<BaseFloat> &data,
+                                const MatrixBase<BaseFloat> &gauss_posteriors);
+
   /// Accumulate for all components given a diagonal-covariance GMM.
   /// Computes posteriors and returns log-likelihood
   BaseFloat AccumulateFromDiag(const DiagGmm &gmm,
                                const VectorBase<BaseFloat> &data,
                                BaseFloat frame_posterior);
 
+  /// This does the same job as AccumulateFromDiag, but for many frames at
+  /// once, using matrix multiplications; frame t has weight frame_weights(t).
+  /// Returns sum of (log-likelihood times frame weight) over all frames.
+  BaseFloat AccumulateFromDiag(const DiagGmm &gmm,
+                               const MatrixBase<BaseFloat> &data,
+                               const VectorBase<BaseFloat> &frame_weights);
+
   /// This does the same job as AccumulateFromDiag, but using
   /// multiple threads.  Returns sum of (log-likelihood times
   /// frame weight) over all frames.
@@ -25,6 +25,127 @@
 #include "hmm/transition-model.h"
 #include "transform/mllt.h"
 #include "hmm/posterior.h"
+#include "thread/kaldi-mutex.h"
+#include "thread/kaldi-thread.h"
+
+namespace kaldi {
+
+// The inputs and the totals shared by the threads of AccMlltClass.
+struct AccMlltShared {
+  const AmDiagGmm *am_gmm;
+  const TransitionModel *trans_model;
+  BaseFloat rand_prune;
+  SequentialBaseFloatMatrixReader *feature_reader;
+  RandomAccessPosteriorReader *posteriors_reader;
+  Mutex mutex;  // guards the readers and everything below.
+  MlltAccs mllt_accs;
+  double tot_like, tot_t;
+  int32 num_done, num_no_posterior, num_other_error;
+};
+
+// Each copy of this class (one per thread, see MultiThreader) takes
+// utterances from the readers and accumulates their stats into its own
+// accumulators, which it adds to the totals in its destructor.
+class AccMlltClass: public MultiThreadable {
+ public:
+  explicit AccMlltClass(AccMlltShared *shared): shared_(shared) { }
+  AccMlltClass(const AccMlltClass &other): shared_(other.shared_),
+      mllt_accs_(shared_->am_gmm->Dim(), shared_->rand_prune) { }
+  void operator () () {
+    std::string key;
+    Matrix<BaseFloat> mat;
+    Posterior posterior;
+    while (GetUtterance(&key, &mat, &posterior)) {
+      Posterior pdf_posterior;
+      ConvertPosteriorToPdfs(*(shared_->trans_model), posterior,
+                             &pdf_posterior);
+      // Group the frames by pdf, so we can accumulate each pdf's frames as a
+      // block.
+      std::map<int32, std::vector<std::pair<int32, BaseFloat> > > pdf_frames;
+      for (size_t i = 0; i < pdf_posterior.size(); i++)
+        for (size_t j = 0; j < pdf_posterior[i].size(); j++)
+          pdf_frames[pdf_posterior[i][j].first].push_back(
+              std::make_pair(static_cast<int32>(i),
+                             pdf_posterior[i][j].second));
+      double tot_like_this_file = 0.0, tot_weight = 0.0;
+      std::map<int32, std::vector<std::pair<int32, BaseFloat> > >::const_iterator
+          iter = pdf_frames.begin(), end = pdf_frames.end();
+      for (; iter != end; ++iter) {
+        const std::vector<std::pair<int32, BaseFloat> > &frames = iter->second;
+        int32 num_frames = frames.size();
+        std::vector<int32> rows(num_frames);
+        Vector<BaseFloat> weights(num_frames);
+        for (int32 i = 0; i < num_frames; i++) {
+          rows[i] = frames[i].first;
+          weights(i) = frames[i].second;
+        }
+        Matrix<BaseFloat> feats(num_frames, mat.NumCols(), kUndefined);
+        feats.CopyRows(mat, &(rows[0]));
+        tot_like_this_file += mllt_accs_.AccumulateFromGmm(
+            shared_->am_gmm->GetPdf(iter->first), feats, weights);
+        tot_weight += weights.Sum();
+      }
+      shared_->mutex.Lock();
+      KALDI_LOG << "Average like for this file is "
+                << (tot_like_this_file/tot_weight) << " over "
+                << tot_weight << " frames.";
+      shared_->tot_like += tot_like_this_file;
+      shared_->tot_t += tot_weight;
+      shared_->num_done++;
+      if (shared_->num_done % 10 == 0)
+        KALDI_LOG << "Avg like per frame so far is "
+                  << (shared_->tot_like/shared_->tot_t);
+      shared_->mutex.Unlock();
+    }
+  }
+  ~AccMlltClass() {
+    if (mllt_accs_.Dim() != 0)  // if this is one of the thread's copies.
+      shared_->mllt_accs.Add(mllt_accs_);
+  }
+ private:
+  // Gets the next utterance that has posteriors of the right size, and
+  // returns false if there are no more.
+  bool GetUtterance(std::string *key, Matrix<BaseFloat> *mat,
+                    Posterior *posterior) {
+    bool ans = false;
+    shared_->mutex.Lock();
+    try {
+      for (; !shared_->feature_reader->Done();
+           shared_->feature_reader->Next()) {
+        *key = shared_->feature_reader->Key();
+        if (!shared_->posteriors_reader->HasKey(*key)) {
+          shared_->num_no_posterior++;
+          continue;
+        }
+        const Matrix<BaseFloat> &this_mat = shared_->feature_reader->Value();
+        const Posterior &this_posterior =
+            shared_->posteriors_reader->Value(*key);
+        if (static_cast<int32>(this_posterior.size()) != this_mat.NumRows()) {
+          KALDI_WARN << "Posterior vector has wrong size "
+                     << (this_posterior.size()) << " vs. "
+                     << (this_mat.NumRows());
+          shared_->num_other_error++;
+          continue;
+        }
+        *mat = this_mat;
+        *posterior = this_posterior;
+        shared_->feature_reader->Next();
+        ans = true;
+        break;
+      }
+    } catch (...) {  // e.g. a read error; don't leave the other threads stuck.
+      shared_->mutex.Unlock();
+      throw;
+    }
+    shared_->mutex.Unlock();
+    return ans;
+  }
+
+  AccMlltShared *shared_;
+  MlltAccs mllt_accs_;
+};
+
+}  // namespace kaldi
 
 
 int main(int argc, char *argv[]) {
@@ -39,9 +160,12 @@ int main(int argc, char *argv[]) {
     ParseOptions po(usage);
     bool binary = true;
     BaseFloat rand_prune = 0.25;
+    int32 num_threads = 1;
     po.Register("binary", &binary, "Write output in binary mode");
     po.Register("rand-prune", &rand_prune, "Randomized pruning parameter to speed up "
                 "accumulation (larger -> more pruning.  May exceed one).");
+    po.Register("num-threads", &num_threads, "Number of threads to use; each "
+                "has its own accumulators, which are summed at the end.");
     po.Read(argc, argv);
 
     if (po.NumArgs() != 4) {
@@ -54,9 +178,6 @@ int main(int argc, char *argv[]) {
         posteriors_rspecifier = po.GetArg(3),
         accs_wxfilename = po.GetArg(4);
 
-    using namespace kaldi;
-    typedef kaldi::int32 int32;
-
     AmDiagGmm am_gmm;
     TransitionModel trans_model;
     {
@@ -66,70 +187,40 @@ int main(int argc, char *argv[]) {
       am_gmm.Read(ki.Stream(), binary);
     }
 
-    MlltAccs mllt_accs(am_gmm.Dim(), rand_prune);
-
-    double tot_like = 0.0;
-    double tot_t = 0.0;
-
     SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
     RandomAccessPosteriorReader posteriors_reader(posteriors_rspecifier);
 
-    int32 num_done = 0, num_no_posterior = 0, num_other_error = 0;
-    for (; !feature_reader.Done(); feature_reader.Next()) {
-      std::string key = feature_reader.Key();
-      if (!posteriors_reader.HasKey(key)) {
-        num_no_posterior++;
-      } else {
-        const Matrix<BaseFloat> &mat = feature_reader.Value();
-        const Posterior &posterior = posteriors_reader.Value(key);
-
-        if (static_cast<int32>(posterior.size()) != mat.NumRows()) {
-          KALDI_WARN << "Posterior vector has wrong size "<< (posterior.size()) << " vs. "<< (mat.NumRows());
-          num_other_error++;
-          continue;
-        }
-
-        num_done++;
-        BaseFloat tot_like_this_file = 0.0, tot_weight = 0.0;
-
-        Posterior pdf_posterior;
-        ConvertPosteriorToPdfs(trans_model, posterior, &pdf_posterior);
-        for (size_t i = 0; i < posterior.size(); i++) {
-          for (size_t j = 0; j < pdf_posterior[i].size(); j++) {
-            int32 pdf_id = pdf_posterior[i][j].first;
-            BaseFloat weight = pdf_posterior[i][j].second;
-
-            tot_like_this_file += mllt_accs.AccumulateFromGmm(am_gmm.GetPdf(pdf_id),
-                                                              mat.Row(i),
-                                                              weight) * weight;
-            tot_weight += weight;
-          }
-        }
-        KALDI_LOG << "Average like for this file is "
-                  << (tot_like_this_file/tot_weight) << " over "
-                  << tot_weight << " frames.";
-        tot_like += tot_like_this_file;
-        tot_t += tot_weight;
-        if (num_done % 10 == 0)
-          KALDI_LOG << "Avg like per frame so far is "
-                    << (tot_like/tot_t);
-      }
+    AccMlltShared shared;
+    shared.am_gmm = &am_gmm;
+    shared.trans_model = &trans_model;
+    shared.rand_prune = rand_prune;
+    shared.feature_reader = &feature_reader;
+    shared.posteriors_reader = &posteriors_reader;
+    shared.mllt_accs.Init(am_gmm.Dim(), rand_prune);
+    shared.tot_like = 0.0;
+    shared.tot_t = 0.0;
+    shared.num_done = 0;
+    shared.num_no_posterior = 0;
+    shared.num_other_error = 0;
+    {
+      AccMlltClass c(&shared);
+      // Everything happens in the constructor and destructor.
+      MultiThreader<AccMlltClass> threader(num_threads, c);
     }
 
-    KALDI_LOG << "Done " << num_done << " files, " << num_no_posterior
-              << " with no posteriors, " << num_other_error
-              << " with other errors.";
+    KALDI_LOG << "Done " << shared.num_done << " files, "
+              << shared.num_no_posterior << " with no posteriors, "
+              << shared.num_other_error << " with other errors.";
 
     KALDI_LOG << "Overall avg like per frame (Gaussian only) = "
-              << (tot_like/tot_t) << " over " << tot_t << " frames.";
+              << (shared.tot_like/shared.tot_t) << " over " << shared.tot_t
+              << " frames.";
 
-    WriteKaldiObject(mllt_accs, accs_wxfilename, binary);
+    WriteKaldiObject(shared.mllt_accs, accs_wxfilename, binary);
     KALDI_LOG << "Written accs.";
-    return (num_done != 0 ? 0 : 1);
+    return (shared.num_done != 0 ? 0 : 1);
   } catch(const std::exception &e) {
     std::cerr << e.what();
     return -1;
   }
 }
-
-
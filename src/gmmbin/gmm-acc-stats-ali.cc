@@ -23,9 +23,114 @@
 #include "gmm/am-diag-gmm.h"
 #include "hmm/transition-model.h"
 #include "gmm/mle-am-diag-gmm.h"
+#include "thread/kaldi-mutex.h"
+#include "thread/kaldi-thread.h"
+
+namespace kaldi {
+
+// The inputs and the totals shared by the threads of AccStatsAliClass.
+struct AccStatsAliShared {
+  const AmDiagGmm *am_gmm;
+  const TransitionModel *trans_model;
+  SequentialBaseFloatMatrixReader *feature_reader;
+  RandomAccessInt32VectorReader *alignments_reader;
+  Mutex mutex;  // guards the readers and everything below.
+  Vector<double> transition_accs;
+  AccumAmDiagGmm gmm_accs;
+  double tot_like;
+  kaldi::int64 tot_t;
+  int32 num_done, num_err;
+};
+
+// Each copy of this class (one per thread, see MultiThreader) takes
+// utterances from the readers and accumulates their stats into its own
+// accumulators, which it adds to the totals in its destructor.
+class AccStatsAliClass: public MultiThreadable {
+ public:
+  explicit AccStatsAliClass(AccStatsAliShared *shared): shared_(shared) { }
+  AccStatsAliClass(const AccStatsAliClass &other): shared_(other.shared_) {
+    shared_->trans_model->InitStats(&transition_accs_);
+    gmm_accs_.Init(*(shared_->am_gmm), kGmmAll);
+  }
+  void operator () () {
+    std::string key;
+    Matrix<BaseFloat> mat;
+    std::vector<int32> alignment;
+    while (GetUtterance(&key, &mat, &alignment)) {
+      if (static_cast<int32>(alignment.size()) != mat.NumRows()) {
+        KALDI_WARN << "Alignments has wrong size " << (alignment.size())
+                   << " vs. " << (mat.NumRows());
+        shared_->mutex.Lock();
+        shared_->num_err++;
+        shared_->mutex.Unlock();
+        continue;
+      }
+      std::vector<std::vector<std::pair<int32, BaseFloat> > > pdf_post(
+          alignment.size());
+      for (size_t i = 0; i < alignment.size(); i++) {
+        int32 tid = alignment[i],  // transition identifier.
+            pdf_id = shared_->trans_model->TransitionIdToPdf(tid);
+        shared_->trans_model->Accumulate(1.0, tid, &transition_accs_);
+        pdf_post[i].push_back(std::make_pair(pdf_id, 1.0));
+      }
+      BaseFloat tot_like_this_file = gmm_accs_.AccumulateForGmms(
+          *(shared_->am_gmm), mat, pdf_post);
+
+      shared_->mutex.Lock();
+      shared_->num_done++;
+      shared_->tot_like += tot_like_this_file;
+      shared_->tot_t += alignment.size();
+      if (shared_->num_done % 50 == 0) {
+        KALDI_LOG << "Processed " << shared_->num_done
+                  << " utterances; for utterance " << key << " avg. like is "
+                  << (tot_like_this_file/alignment.size())
+                  << " over " << alignment.size() <<" frames.";
+      }
+      shared_->mutex.Unlock();
+    }
+  }
+  ~AccStatsAliClass() {
+    if (gmm_accs_.NumAccs() != 0) {  // if this is one of the thread's copies.
+      shared_->transition_accs.AddVec(1.0, transition_accs_);
+      shared_->gmm_accs.Add(1.0, gmm_accs_);
+    }
+  }
+ private:
+  // Gets the next utterance that has an alignment, and returns false if there
+  // are no more.
+  bool GetUtterance(std::string *key, Matrix<BaseFloat> *mat,
+                    std::vector<int32> *alignment) {
+    bool ans = false;
+    shared_->mutex.Lock();
+    try {
+      for (; !shared_->feature_reader->Done();
+           shared_->feature_reader->Next()) {
+        *key = shared_->feature_reader->Key();
+        if (!shared_->alignments_reader->HasKey(*key)) {
+          KALDI_WARN << "No alignment for utterance " << *key;
+          shared_->num_err++;
+        } else {
+          *mat = shared_->feature_reader->Value();
+          *alignment = shared_->alignments_reader->Value(*key);
+          shared_->feature_reader->Next();
+          ans = true;
+          break;
+        }
+      }
+    } catch (...) {  // e.g. a read error; don't leave the other threads stuck.
+      shared_->mutex.Unlock();
+      throw;
+    }
+    shared_->mutex.Unlock();
+    return ans;
+  }
 
+  AccStatsAliShared *shared_;
+  Vector<double> transition_accs_;
+  AccumAmDiagGmm gmm_accs_;
+};
 
-
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   using namespace kaldi;
@@ -39,7 +144,10 @@ int main(int argc, char *argv[]) {
 
     ParseOptions po(usage);
     bool binary = true;
+    int32 num_threads = 1;
     po.Register("binary", &binary, "Write output in binary mode");
+    po.Register("num-threads", &num_threads, "Number of threads to use; each "
+                "has its own accumulators, which are summed at the end.");
     po.Read(argc, argv);
 
     if (po.NumArgs() != 4) {
@@ -61,67 +169,40 @@ int main(int argc, char *argv[]) {
       am_gmm.Read(ki.Stream(), binary);
     }
 
-    Vector<double> transition_accs;
-    trans_model.InitStats(&transition_accs);
-    AccumAmDiagGmm gmm_accs;
-    gmm_accs.Init(am_gmm, kGmmAll);
-
-    double tot_like = 0.0;
-    kaldi::int64 tot_t = 0;
-
     SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
     RandomAccessInt32VectorReader alignments_reader(alignments_rspecifier);
 
-    int32 num_done = 0, num_err = 0;
-    for (; !feature_reader.Done(); feature_reader.Next()) {
-      std::string key = feature_reader.Key();
-      if (!alignments_reader.HasKey(key)) {
-        KALDI_WARN << "No alignment for utterance " << key;
-        num_err++;
-      } else {
-        const Matrix<BaseFloat> &mat = feature_reader.Value();
-        const std::vector<int32> &alignment = alignments_reader.Value(key);
-
-        if (alignment.size() != mat.NumRows()) {
-          KALDI_WARN << "Alignments has wrong size " << (alignment.size())
-                     << " vs. " << (mat.NumRows());
-          num_err++;
-          continue;
-        }
-
-        num_done++;
-        BaseFloat tot_like_this_file = 0.0;
-
-        for (size_t i = 0; i < alignment.size(); i++) {
-          int32 tid = alignment[i],  // transition identifier.
-              pdf_id = trans_model.TransitionIdToPdf(tid);
-          trans_model.Accumulate(1.0, tid, &transition_accs);
-          tot_like_this_file += gmm_accs.AccumulateForGmm(am_gmm, mat.Row(i),
-                                                          pdf_id, 1.0);
-        }
-        tot_like += tot_like_this_file;
-        tot_t += alignment.size();
-        if (num_done % 50 == 0) {
-          KALDI_LOG << "Processed " << num_done << " utterances; for utterance "
-                    << key << " avg. like is "
-                    << (tot_like_this_file/alignment.size())
-                    << " over " << alignment.size() <<" frames.";
-        }
-      }
+    AccStatsAliShared shared;
+    shared.am_gmm = &am_gmm;
+    shared.trans_model = &trans_model;
+    shared.feature_reader = &feature_reader;
+    shared.alignments_reader = &alignments_reader;
+    trans_model.InitStats(&shared.transition_accs);
+    shared.gmm_accs.Init(am_gmm, kGmmAll);
+    shared.tot_like = 0.0;
+    shared.tot_t = 0;
+    shared.num_done = 0;
+    shared.num_err = 0;
+    {
+      AccStatsAliClass c(&shared);
+      // Everything happens in the constructor and destructor.
+      MultiThreader<AccStatsAliClass> threader(num_threads, c);
     }
-    KALDI_LOG << "Done " << num_done << " files, " << num_err
+
+    KALDI_LOG << "Done " << shared.num_done << " files, " << shared.num_err
               << " with errors.";
 
     KALDI_LOG << "Overall avg like per frame (Gaussian only) = "
-              << (tot_like/tot_t) << " over " << tot_t << " frames.";
+              << (shared.tot_like/shared.tot_t) << " over " << shared.tot_t
+              << " frames.";
 
     {
       Output ko(accs_wxfilename, binary);
-      transition_accs.Write(ko.Stream(), binary);
-      gmm_accs.Write(ko.Stream(), binary);
+      shared.transition_accs.Write(ko.Stream(), binary);
+      shared.gmm_accs.Write(ko.Stream(), binary);
     }
     KALDI_LOG << "Written accs.";
-    if (num_done != 0)
+    if (shared.num_done != 0)
       return 0;
     else
       return 1;
@@ -25,7 +25,119 @@
 #include "hmm/transition-model.h"
 #include "gmm/mle-am-diag-gmm.h"
 #include "hmm/posterior.h"
+#include "thread/kaldi-mutex.h"
+#include "thread/kaldi-thread.h"
+
+namespace kaldi {
+
+// The inputs and the totals shared by the threads of AccStatsClass.
+struct AccStatsShared {
+  const AmDiagGmm *am_gmm;
+  const TransitionModel *trans_model;
+  GmmFlagsType flags;
+  SequentialBaseFloatMatrixReader *feature_reader;
+  RandomAccessPosteriorReader *posteriors_reader;
+  Mutex mutex;  // guards the readers and everything below.
+  Vector<double> transition_accs;
+  AccumAmDiagGmm gmm_accs;
+  double tot_like, tot_t;
+  int32 num_done, num_err;
+};
+
+// Each copy of this class (one per thread, see MultiThreader) takes
+// utterances from the readers and accumulates their stats into its own
+// accumulators, which it adds to the totals in its destructor.
+class AccStatsClass: public MultiThreadable {
+ public:
+  explicit AccStatsClass(AccStatsShared *shared): shared_(shared) { }
+  AccStatsClass(const AccStatsClass &other): shared_(other.shared_) {
+    shared_->trans_model->InitStats(&transition_accs_);
+    gmm_accs_.Init(*(shared_->am_gmm), shared_->flags);
+  }
+  void operator () () {
+    std::string key;
+    Matrix<BaseFloat> mat;
+    Posterior posterior;
+    while (GetUtterance(&key, &mat, &posterior)) {
+      if (static_cast<int32>(posterior.size()) != mat.NumRows()) {
+        KALDI_WARN << "Posterior vector has wrong size "
+                   << (posterior.size()) << " vs. "
+                   << (mat.NumRows());
+        shared_->mutex.Lock();
+        shared_->num_err++;
+        shared_->mutex.Unlock();
+        continue;
+      }
+      Posterior pdf_posterior;
+      ConvertPosteriorToPdfs(*(shared_->trans_model), posterior,
+                             &pdf_posterior);
+      // Accumulates for GMMs.
+      double tot_like_this_file = gmm_accs_.AccumulateForGmms(
+          *(shared_->am_gmm), mat, pdf_posterior),
+          tot_weight = TotalPosterior(pdf_posterior);
+      // Accumulates for transitions.
+      for (size_t i = 0; i < posterior.size(); i++) {
+        for (size_t j = 0; j < posterior[i].size(); j++) {
+          int32 tid = posterior[i][j].first;
+          BaseFloat weight = posterior[i][j].second;
+          shared_->trans_model->Accumulate(weight, tid, &transition_accs_);
+        }
+      }
+      shared_->mutex.Lock();
+      shared_->num_done++;
+      if (shared_->num_done % 50 == 0) {
+        KALDI_LOG << "Processed " << shared_->num_done
+                  << " utterances; for utterance " << key << " avg. like is "
+                  << (tot_like_this_file/tot_weight)
+                  << " over " << tot_weight <<" frames.";
+      }
+      shared_->tot_like += tot_like_this_file;
+      shared_->tot_t += tot_weight;
+      shared_->mutex.Unlock();
+    }
+  }
+  ~AccStatsClass() {
+    if (gmm_accs_.NumAccs() != 0) {  // if this is one of the thread's copies.
+      shared_->transition_accs.AddVec(1.0, transition_accs_);
+      shared_->gmm_accs.Add(1.0, gmm_accs_);
+    }
+  }
+ private:
+  // Gets the next utterance that has posteriors, and returns false if there
+  // are no more.
+  bool GetUtterance(std::string *key, Matrix<BaseFloat> *mat,
+                    Posterior *posterior) {
+    bool ans = false;
+    shared_->mutex.Lock();
+    try {
+      for (; !shared_->feature_reader->Done();
+           shared_->feature_reader->Next()) {
+        *key = shared_->feature_reader->Key();
+        if (!shared_->posteriors_reader->HasKey(*key)) {
+          KALDI_WARN << "Could not find posteriors for utterance " << *key;
+          shared_->num_err++;
+        } else {
+          *mat = shared_->feature_reader->Value();
+          *posterior = shared_->posteriors_reader->Value(*key);
+          shared_->feature_reader->Next();
+          ans = true;
+          break;
+        }
+      }
+    } catch (...) {  // e.g. a read error; don't leave the other threads stuck.
+      shared_->mutex.Unlock();
+      throw;
+    }
+    shared_->mutex.Unlock();
+    return ans;
+  }
+
+  AccStatsShared *shared_;
+  Vector<double> transition_accs_;
+  AccumAmDiagGmm gmm_accs_;
+};
 
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   using namespace kaldi;
@@ -40,11 +152,14 @@ int main(int argc, char *argv[]) {
 
     ParseOptions po(usage);
     bool binary = true;
+    int32 num_threads = 1;
     std::string update_flags_str = "mvwt"; // note: t is ignored, we acc
     // transition stats regardless.
     po.Register("binary", &binary, "Write output in binary mode");
     po.Register("update-flags", &update_flags_str, "Which GMM parameters will be "
                 "updated: subset of mvwt.");
+    po.Register("num-threads", &num_threads, "Number of threads to use; each "
+                "has its own accumulators, which are summed at the end.");
     po.Read(argc, argv);
 
     if (po.NumArgs() != 4) {
@@ -67,80 +182,41 @@ int main(int argc, char *argv[]) {
       am_gmm.Read(ki.Stream(), binary);
     }
 
-    Vector<double> transition_accs;
-    trans_model.InitStats(&transition_accs);
-    AccumAmDiagGmm gmm_accs;
-    gmm_accs.Init(am_gmm, StringToGmmFlags(update_flags_str));
-
-    double tot_like = 0.0;
-    double tot_t = 0.0;
-
     SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
     RandomAccessPosteriorReader posteriors_reader(posteriors_rspecifier);
 
-    int32 num_done = 0, num_err = 0;
-    for (; !feature_reader.Done(); feature_reader.Next()) {
-      std::string key = feature_reader.Key();
-      if (!posteriors_reader.HasKey(key)) {
-        KALDI_WARN << "Could not find posteriors for utterance " << key;
-        num_err++;
-      } else {
-        const Matrix<BaseFloat> &mat = feature_reader.Value();
-        const Posterior &posterior = posteriors_reader.Value(key);
-
-        if (static_cast<int32>(posterior.size()) != mat.NumRows()) {
-          KALDI_WARN << "Posterior vector has wrong size " 
-                     << (posterior.size()) << " vs. "
-                     << (mat.NumRows());
-          num_err++;
-          continue;
-        }
-
-        num_done++;
-        BaseFloat tot_like_this_file = 0.0, tot_weight = 0.0;
-
-        Posterior pdf_posterior;
-        ConvertPosteriorToPdfs(trans_model, posterior, &pdf_posterior);
-        for (size_t i = 0; i < posterior.size(); i++) {
-          // Accumulates for GMM.
-          for (size_t j = 0; j < pdf_posterior[i].size(); j++) {
-            int32 pdf_id = pdf_posterior[i][j].first;
-            BaseFloat weight = pdf_posterior[i][j].second;
-            tot_like_this_file += gmm_accs.AccumulateForGmm(am_gmm, mat.Row(i), pdf_id, weight)
-                * weight;
-            tot_weight += weight;
-          }
-
-          // Accumulates for transitions.
-          for (size_t j = 0; j < posterior[i].size(); j++) {
-            int32 tid = posterior[i][j].first;
-            BaseFloat weight = posterior[i][j].second;
-            trans_model.Accumulate(weight, tid, &transition_accs);
-          }
-        }
-        if (num_done % 50 == 0) {
-          KALDI_LOG << "Processed " << num_done << " utterances; for utterance "
-                    << key << " avg. like is " << (tot_like_this_file/tot_weight)
-                    << " over " << tot_weight <<" frames.";
-        }
-        tot_like += tot_like_this_file;
-        tot_t += tot_weight;
-      }
+    AccStatsShared shared;
+    shared.am_gmm = &am_gmm;
+    shared.trans_model = &trans_model;
+    shared.feature_reader = &feature_reader;
+    shared.posteriors_reader = &posteriors_reader;
+    trans_model.InitStats(&shared.transition_accs);
+    shared.flags = StringToGmmFlags(update_flags_str);
+    shared.gmm_accs.Init(am_gmm, shared.flags);
+    shared.tot_like = 0.0;
+    shared.tot_t = 0.0;
+    shared.num_done = 0;
+    shared.num_err = 0;
+    {
+      AccStatsClass c(&shared);
+      // Everything happens in the constructor and destructor.
+      MultiThreader<AccStatsClass> threader(num_threads, c);
     }
 
-    KALDI_LOG << "Done " << num_done << " files, " << num_err
+    KALDI_LOG << "Done " << shared.num_done << " files, " << shared.num_err
               << " with errors.";
     
     KALDI_LOG << "Overall avg like per frame (Gaussian only) = "
-              << (tot_like/tot_t) << " over " << tot_t << " frames.";
+              << (shared.tot_like/shared.tot_t) << " over " << shared.tot_t
+              << " frames.";
 
     {
       Output ko(accs_wxfilename, binary);
-      transition_accs.Write(ko.Stream(), binary);
-      gmm_accs.Write(ko.Stream(), binary);
+      shared.transition_accs.Write(ko.Stream(), binary);
+      shared.gmm_accs.Write(ko.Stream(), binary);
     }
     KALDI_LOG << "Written accs.";
-    return (num_done != 0 ? 0 : 1);
+    return (shared.num_done != 0 ? 0 : 1);
   } catch(const std::exception &e) {
     std::cerr << e.what();
     return -1;
@@ -27,7 +27,36 @@
 #include "fstext/fstext-lib.h"
 #include "decoder/decoder-wrappers.h"
 #include "gmm/decodable-am-diag-gmm.h"
+#include "gmm/cu-am-diag-gmm.h"
+#include "decoder/decodable-matrix.h"
+#include "cudamatrix/cu-device.h"
 #include "lat/kaldi-lattice.h" // for {Compact}LatticeArc
+#include "thread/kaldi-task-sequence.h"
+
+namespace kaldi {
+// Returns a new decodable object for "features", and takes ownership of
+// "features".  If cu_am_gmm is not NULL we compute the log-likelihoods of the
+// whole utterance with it now (on the GPU, if one is in use); otherwise they
+// are computed on demand by DecodableAmDiagGmmScaled, i.e. in the alignment
+// task's thread.
+DecodableInterface *NewGmmDecodable(const AmDiagGmm &am_gmm,
+                                    const CuAmDiagGmm *cu_am_gmm,
+                                    const TransitionModel &trans_model,
+                                    Matrix<BaseFloat> *features,
+                                    BaseFloat acoustic_scale) {
+  if (cu_am_gmm != NULL) {
+    Matrix<BaseFloat> *loglikes = new Matrix<BaseFloat>();
+    cu_am_gmm->LogLikelihoods(*features, loglikes);
+    delete features;
+    // takes ownership of "loglikes".
+    return new DecodableMatrixScaledMapped(trans_model, acoustic_scale,
+                                           loglikes);
+  }
+  BaseFloat log_sum_exp_prune = -1.0;  // the default.
+  return new DecodableAmDiagGmmScaled(am_gmm, trans_model, acoustic_scale,
+                                      log_sum_exp_prune, features);
+}
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -45,21 +74,30 @@ int main(int argc, char *argv[]) {
         " gmm-align-compiled 1.mdl ark:graphs.fsts scp:train.scp ark:1.ali\n"
         "or:\n"
         " compile-train-graphs tree 1.mdl lex.fst ark:train.tra b, ark:- | \\\n"
-        "   gmm-align-compiled 1.mdl ark:- scp:train.scp t, ark:1.ali\n";
+        "   gmm-align-compiled 1.mdl ark:- scp:train.scp t, ark:1.ali\n"
+        "With --num-threads > 1, utterances are aligned in parallel (sharing\n"
+        "the model); the output is in the same order as the input.\n";
 
     ParseOptions po(usage);
     AlignConfig align_config;
     BaseFloat acoustic_scale = 1.0;
     BaseFloat transition_scale = 1.0;
     BaseFloat self_loop_scale = 1.0;
+    std::string use_gpu = "no";
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
 
     align_config.Register(&po);
+    sequencer_config.Register(&po);
     po.Register("transition-scale", &transition_scale,
                 "Transition-probability scale [relative to acoustics]");
     po.Register("acoustic-scale", &acoustic_scale,
                 "Scaling factor for acoustic likelihoods");
     po.Register("self-loop-scale", &self_loop_scale,
                 "Scale of self-loop versus non-self-loop log probs [relative to acoustics]");
+    po.Register("use-gpu", &use_gpu,
+                "yes|no|optional|wait, only has effect if compiled with CUDA. "
+                "If not \"no\", the likelihoods are computed for whole "
+                "utterances using CuAmDiagGmm.");
     po.Read(argc, argv);
 
     if (po.NumArgs() < 4 || po.NumArgs() > 5) {
@@ -73,6 +111,10 @@ int main(int argc, char *argv[]) {
         alignment_wspecifier = po.GetArg(4),
         scores_wspecifier = po.GetOptArg(5);
 
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().SelectGpuId(use_gpu);
+#endif
+
     TransitionModel trans_model;
     AmDiagGmm am_gmm;
     {
@@ -81,56 +123,68 @@ int main(int argc, char *argv[]) {
       trans_model.Read(ki.Stream(), binary);
       am_gmm.Read(ki.Stream(), binary);
     }
+    CuAmDiagGmm *cu_am_gmm = (use_gpu != "no" ? new CuAmDiagGmm(am_gmm) : NULL);
 
     SequentialTableReader<fst::VectorFstHolder> fst_reader(fst_rspecifier);
     RandomAccessBaseFloatMatrixReader feature_reader(feature_rspecifier);
     Int32VectorWriter alignment_writer(alignment_wspecifier);
     BaseFloatWriter scores_writer(scores_wspecifier);
 
-    int num_done = 0, num_err = 0, num_retry = 0;
+    // num_fail counts utterances that we didn't get as far as aligning;
+    // num_done, num_err and num_retry are updated by the alignment tasks.
+    int num_done = 0, num_err = 0, num_retry = 0, num_fail = 0;
     double tot_like = 0.0;
     kaldi::int64 frame_count = 0;
 
-    for (; !fst_reader.Done(); fst_reader.Next()) {
-      std::string utt = fst_reader.Key();
-      if (!feature_reader.HasKey(utt)) {
-        num_err++;
-        KALDI_WARN << "No features for utterance " << utt;
-      } else {
+    {
+      TaskSequencer<AlignUtteranceClass> sequencer(sequencer_config);
+      for (; !fst_reader.Done(); fst_reader.Next()) {
+        std::string utt = fst_reader.Key();
+        if (!feature_reader.HasKey(utt)) {
+          num_fail++;
+          KALDI_WARN << "No features for utterance " << utt;
+          continue;
+        }
         const Matrix<BaseFloat> &features = feature_reader.Value(utt);
-        VectorFst<StdArc> decode_fst(fst_reader.Value());
-        fst_reader.FreeCurrent();  // this stops copy-on-write of the fst
-        // by deleting the fst inside the reader, since we're about to mutate
-        // the fst by adding transition probs.
-
         if (features.NumRows() == 0) {
           KALDI_WARN << "Zero-length utterance: " << utt;
-          num_err++;
+          num_fail++;
           continue;
         }
+        VectorFst<StdArc> *decode_fst = new VectorFst<StdArc>(
+            fst_reader.Value());
+        fst_reader.FreeCurrent();  // this stops copy-on-write of the fst
+        // by deleting the fst inside the reader, since we're about to mutate
+        // the fst by adding transition probs.
 
         {  // Add transition-probs to the FST.
           std::vector<int32> disambig_syms;  // empty.
           AddTransitionProbs(trans_model, disambig_syms,
                              transition_scale, self_loop_scale,
-                             &decode_fst);
+                             decode_fst);
         }
 
-        DecodableAmDiagGmmScaled gmm_decodable(am_gmm, trans_model, features,
-                                               acoustic_scale);
-         
-        AlignUtteranceWrapper(align_config, utt,
-                              acoustic_scale, &decode_fst, &gmm_decodable,
-                              &alignment_writer, &scores_writer,
-                              &num_done, &num_err, &num_retry,
-                              &tot_like, &frame_count);
+        DecodableInterface *gmm_decodable = NewGmmDecodable(
+            am_gmm, cu_am_gmm, trans_model, new Matrix<BaseFloat>(features),
+            acoustic_scale);
+
+        // takes ownership of decode_fst and gmm_decodable.
+        sequencer.Run(new AlignUtteranceClass(
+            align_config, utt, acoustic_scale, decode_fst, gmm_decodable,
+            &alignment_writer, &scores_writer, &num_done, &num_err,
+            &num_retry, &tot_like, &frame_count));
       }
+      sequencer.Wait();
     }
     KALDI_LOG << "Overall log-likelihood per frame is " << (tot_like/frame_count)
               << " over " << frame_count<< " frames.";
     KALDI_LOG << "Retried " << num_retry << " out of "
-              << (num_done + num_err) << " utterances.";
-    KALDI_LOG << "Done " << num_done << ", errors on " << num_err;
+              << (num_done + num_err + num_fail) << " utterances.";
+    KALDI_LOG << "Done " << num_done << ", errors on " << (num_err + num_fail);
+    delete cu_am_gmm;
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().PrintProfile();
+#endif
     return (num_done != 0 ? 0 : 1);
   } catch(const std::exception &e) {
     std::cerr << e.what();
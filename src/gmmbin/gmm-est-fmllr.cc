@@ -30,6 +30,7 @@ using std::vector;
 #include "hmm/transition-model.h"
 #include "transform/fmllr-diag-gmm.h"
 #include "hmm/posterior.h"
+#include "thread/kaldi-task-sequence.h"
 
 namespace kaldi {
 void AccumulateForUtterance(const Matrix<BaseFloat> &feats,
@@ -39,16 +40,70 @@ void AccumulateForUtterance(const Matrix<BaseFloat> &feats,
                             FmllrDiagGmmAccs *spk_stats) {
   Posterior pdf_post;
   ConvertPosteriorToPdfs(trans_model, post, &pdf_post);
-  for (size_t i = 0; i < post.size(); i++) {
-    for (size_t j = 0; j < pdf_post[i].size(); j++) {
-      int32 pdf_id = pdf_post[i][j].first;
-      spk_stats->AccumulateForGmm(am_gmm.GetPdf(pdf_id),
-                                  feats.Row(i),
-                                  pdf_post[i][j].second);
-    }
-  }
+  spk_stats->AccumulateForGmms(am_gmm, feats, pdf_post);
 }
 
+// Estimates the fMLLR transform for one speaker (or utterance) in
+// operator (), and writes it out in the destructor, so that with
+// TaskSequencer the speakers are processed in parallel but the output is
+// written in the same order as the input.
+class FmllrEstimateTask {
+ public:
+  // Takes ownership of the contents of "feats" and "posts" (by swapping).
+  FmllrEstimateTask(const TransitionModel &trans_model,
+                    const AmDiagGmm &am_gmm,
+                    const FmllrOptions &fmllr_opts,
+                    const std::string &key,
+                    bool per_speaker,
+                    std::vector<Matrix<BaseFloat> > *feats,
+                    std::vector<Posterior> *posts,
+                    BaseFloatMatrixWriter *transform_writer,
+                    double *tot_impr,
+                    double *tot_t):
+      trans_model_(trans_model), am_gmm_(am_gmm), fmllr_opts_(fmllr_opts),
+      key_(key), per_speaker_(per_speaker), transform_writer_(transform_writer), tot_impr_(tot_impr),
+      tot_t_(tot_t), impr_(0.0), count_(0.0) {
+    feats_.swap(*feats);
+    posts_.swap(*posts);
+  }
+
+  void operator () () {
+    FmllrDiagGmmAccs spk_stats(am_gmm_.Dim(), fmllr_opts_);
+    for (size_t i = 0; i < feats_.size(); i++)
+      AccumulateForUtterance(feats_[i], posts_[i], trans_model_, am_gmm_,
+                             &spk_stats);
+    // Free the memory as soon as we're done with it.
+    std::vector<Matrix<BaseFloat> >().swap(feats_);
+    std::vector<Posterior>().swap(posts_);
+    transform_.Resize(am_gmm_.Dim(), am_gmm_.Dim() + 1);
+    transform_.SetUnit();
+    spk_stats.Update(fmllr_opts_, &transform_, &impr_, &count_);
+  }
+
+  ~FmllrEstimateTask() {
+    transform_writer_->Write(key_, transform_);
+    KALDI_LOG << "For " << (per_speaker_ ? "speaker " : "utterance ") << key_
+              << ", auxf-impr from fMLLR is "
+              << (impr_ / count_) << ", over " << count_ << " frames.";
+    *tot_impr_ += impr_;
+    *tot_t_ += count_;
+  }
+
+ private:
+  const TransitionModel &trans_model_;
+  const AmDiagGmm &am_gmm_;
+  const FmllrOptions &fmllr_opts_;
+  std::string key_;
+  bool per_speaker_;
+  std::vector<Matrix<BaseFloat> > feats_;
+  std::vector<Posterior> posts_;
+  BaseFloatMatrixWriter *transform_writer_;
+  double *tot_impr_;
+  double *tot_t_;
+  Matrix<BaseFloat> transform_;
+  BaseFloat impr_;
+  BaseFloat count_;
+};
 
 }
 
@@ -59,16 +114,19 @@ int main(int argc, char *argv[]) {
     const char *usage =
         "Estimate global fMLLR transforms, either per utterance or for the supplied\n"
         "set of speakers (spk2utt option).  Reads posteriors (on transition-ids).  Writes\n"
-        "to a table of matrices.\n"
+        "to a table of matrices.  With --num-threads > 1, the transforms for\n"
+        "different speakers are estimated in parallel.\n"
         "Usage: gmm-est-fmllr [options] <model-in> "
         "<feature-rspecifier> <post-rspecifier> <transform-wspecifier>\n";
 
     ParseOptions po(usage);
     FmllrOptions fmllr_opts;
+    TaskSequencerConfig sequencer_config;
     string spk2utt_rspecifier;
     po.Register("spk2utt", &spk2utt_rspecifier, "rspecifier for speaker to "
                 "utterance-list map");
     fmllr_opts.Register(&po);
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -99,89 +157,76 @@ int main(int argc, char *argv[]) {
     BaseFloatMatrixWriter transform_writer(trans_wspecifier);
 
     int32 num_done = 0, num_no_post = 0, num_other_error = 0;
-    if (spk2utt_rspecifier != "") {  // per-speaker adaptation
-      SequentialTokenVectorReader spk2utt_reader(spk2utt_rspecifier);
-      RandomAccessBaseFloatMatrixReader feature_reader(feature_rspecifier);
-
-      for (; !spk2utt_reader.Done(); spk2utt_reader.Next()) {
-        FmllrDiagGmmAccs spk_stats(am_gmm.Dim(), fmllr_opts);
-        string spk = spk2utt_reader.Key();
-        const vector<string> &uttlist = spk2utt_reader.Value();
-        for (size_t i = 0; i < uttlist.size(); i++) {
-          std::string utt = uttlist[i];
-          if (!feature_reader.HasKey(utt)) {
-            KALDI_WARN << "Did not find features for utterance " << utt;
-            num_other_error++;
-            continue;
-          }
+    {
+      // The tasks' destructors write to transform_writer and update the
+      // totals; the sequencer's destructor waits for all of them.
+      TaskSequencer<FmllrEstimateTask> sequencer(sequencer_config);
+      if (spk2utt_rspecifier != "") {  // per-speaker adaptation
+        SequentialTokenVectorReader spk2utt_reader(spk2utt_rspecifier);
+        RandomAccessBaseFloatMatrixReader feature_reader(feature_rspecifier);
+
+        for (; !spk2utt_reader.Done(); spk2utt_reader.Next()) {
+          string spk = spk2utt_reader.Key();
+          const vector<string> &uttlist = spk2utt_reader.Value();
+          std::vector<Matrix<BaseFloat> > feats;
+          std::vector<Posterior> posts;
+          for (size_t i = 0; i < uttlist.size(); i++) {
+            std::string utt = uttlist[i];
+            if (!feature_reader.HasKey(utt)) {
+              KALDI_WARN << "Did not find features for utterance " << utt;
+              num_other_error++;
+              continue;
+            }
+            if (!post_reader.HasKey(utt)) {
+              KALDI_WARN << "Did not find posteriors for utterance " << utt;
+              num_no_post++;
+              continue;
+            }
+            const Matrix<BaseFloat> &utt_feats = feature_reader.Value(utt);
+            const Posterior &post = post_reader.Value(utt);
+            if (static_cast<int32>(post.size()) != utt_feats.NumRows()) {
+              KALDI_WARN << "Posterior vector has wrong size " << (post.size())
+                         << " vs. " << (utt_feats.NumRows());
+              num_other_error++;
+              continue;
+            }
+            feats.push_back(utt_feats);
+            posts.push_back(post);
+            num_done++;
+          }  // end looping over all utterances of the current speaker
+          sequencer.Run(new FmllrEstimateTask(trans_model, am_gmm, fmllr_opts,
+                                              spk, true, &feats, &posts,
+                                              &transform_writer,
+                                              &tot_impr, &tot_t));
+        }  // end looping over speakers
+      } else {  // per-utterance adaptation
+        SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
+        for (; !feature_reader.Done(); feature_reader.Next()) {
+          string utt = feature_reader.Key();
           if (!post_reader.HasKey(utt)) {
-            KALDI_WARN << "Did not find posteriors for utterance " << utt;
+            KALDI_WARN << "Did not find posts for utterance "
+                       << utt;
             num_no_post++;
             continue;
           }
-          const Matrix<BaseFloat> &feats = feature_reader.Value(utt);
+          const Matrix<BaseFloat> &utt_feats = feature_reader.Value();
           const Posterior &post = post_reader.Value(utt);
-          if (static_cast<int32>(post.size()) != feats.NumRows()) {
-            KALDI_WARN << "Posterior vector has wrong size " << (post.size())
-                       << " vs. " << (feats.NumRows());
+
+          if (static_cast<int32>(post.size()) != utt_feats.NumRows()) {
+            KALDI_WARN << "Posterior has wrong size " << (post.size())
+                << " vs. " << (utt_feats.NumRows());
             num_other_error++;
             continue;
           }
-
-          AccumulateForUtterance(feats, post, trans_model, am_gmm, &spk_stats);
-
           num_done++;
-        }  // end looping over all utterances of the current speaker
-
-        BaseFloat impr, spk_tot_t;
-        {  // Compute the transform and write it out.
-          Matrix<BaseFloat> transform(am_gmm.Dim(), am_gmm.Dim()+1);
-          transform.SetUnit();
-          spk_stats.Update(fmllr_opts, &transform, &impr, &spk_tot_t);
-          transform_writer.Write(spk, transform);
-        }
-        KALDI_LOG << "For speaker " << spk << ", auxf-impr from fMLLR is "
-                  << (impr/spk_tot_t) << ", over " << spk_tot_t << " frames.";
-        tot_impr += impr;
-        tot_t += spk_tot_t;
-      }  // end looping over speakers
-    } else {  // per-utterance adaptation
-      SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
-      for (; !feature_reader.Done(); feature_reader.Next()) {
-        string utt = feature_reader.Key();
-        if (!post_reader.HasKey(utt)) {
-          KALDI_WARN << "Did not find posts for utterance "
-                     << utt;
-          num_no_post++;
-          continue;
-        }
-        const Matrix<BaseFloat> &feats = feature_reader.Value();
-        const Posterior &post = post_reader.Value(utt);
-
-        if (static_cast<int32>(post.size()) != feats.NumRows()) {
-          KALDI_WARN << "Posterior has wrong size " << (post.size())
-              << " vs. " << (feats.NumRows());
-          num_other_error++;
-          continue;
-        }
-        num_done++;
-
-        FmllrDiagGmmAccs spk_stats(am_gmm.Dim(), fmllr_opts);
 
-        AccumulateForUtterance(feats, post, trans_model, am_gmm,
-                               &spk_stats);
-
-        BaseFloat impr, utt_tot_t;
-        {  // Compute the transform and write it out.
-          Matrix<BaseFloat> transform(am_gmm.Dim(), am_gmm.Dim()+1);
-          transform.SetUnit();
-          spk_stats.Update(fmllr_opts, &transform, &impr, &utt_tot_t);
-          transform_writer.Write(utt, transform);
+          std::vector<Matrix<BaseFloat> > feats(1, utt_feats);
+          std::vector<Posterior> posts(1, post);
+          sequencer.Run(new FmllrEstimateTask(trans_model, am_gmm, fmllr_opts,
+                                              utt, false, &feats, &posts,
+                                              &transform_writer,
+                                              &tot_impr, &tot_t));
         }
-        KALDI_LOG << "For utterance " << utt << ", auxf-impr from fMLLR is "
-                  << (impr/utt_tot_t) << ", over " << utt_tot_t << " frames.";
-        tot_impr += impr;
-        tot_t += utt_tot_t;
       }
     }
 
@@ -195,4 +240,3 @@ int main(int argc, char *argv[]) {
     return -1;
   }
 }
-
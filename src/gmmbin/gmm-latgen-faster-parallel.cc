@@ -30,8 +30,24 @@
 #include "gmm/decodable-am-diag-gmm.h"
 #include "base/timer.h"
 #include "feat/feature-functions.h"  // feature reversal
-#include "thread/kaldi-task-sequence.h"
+#include "thread/kaldi-task-pipeline.h"
+#include "thread/kaldi-task-scheduler.h"
+#include "thread/kaldi-numa.h"
 
+namespace kaldi {
+// For NumaReplicated: VectorFst's copy constructor shares the data, so we
+// copy via the Fst interface, which makes a deep copy.
+fst::VectorFst<fst::StdArc> *CopyDecodeFst(
+    const fst::VectorFst<fst::StdArc> &fst) {
+  return new fst::VectorFst<fst::StdArc>(
+      static_cast<const fst::Fst<fst::StdArc>&>(fst));
+}
+AmDiagGmm *CopyAmDiagGmm(const AmDiagGmm &am_gmm) {
+  AmDiagGmm *ans = new AmDiagGmm();
+  ans->CopyFromAmDiagGmm(am_gmm);
+  return ans;
+}
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -51,23 +67,42 @@ int main(int argc, char *argv[]) {
     bool allow_partial = false;
     BaseFloat acoustic_scale = 0.1;
     BaseFloat log_sum_exp_prune = 0.0;
+    int32 frame_batch_size = 1;
     LatticeFasterDecoderConfig latgen_config;
-    TaskSequencerConfig sequencer_config; // has --num-threads option
+    TaskSchedulerConfig scheduler_config; // has --num-threads option
+    int32 determinize_threads = 0;
+    std::string numa_policy = "none";
     
     std::string word_syms_filename;
     latgen_config.Register(&po);
-    sequencer_config.Register(&po);
+    scheduler_config.Register(&po);
     po.Register("acoustic-scale", &acoustic_scale,
                 "Scaling factor for acoustic likelihoods");
     po.Register("log-sum-exp-prune", &log_sum_exp_prune,
                 "If >0, pruning parameter to minimize exp()'s.  Suggest 3 to 5; "
                 "larger is more exact.");
+    po.Register("frame-batch-size", &frame_batch_size, "If > 1, compute the "
+                "likelihood of each Gaussian mixture for this many frames at a "
+                "time, the first time it is needed (faster, as it uses "
+                "matrix-matrix products, but does some unnecessary work).");
     po.Register("word-symbol-table", &word_syms_filename,
                 "Symbol table for words [for debug output]");
     po.Register("allow-partial", &allow_partial,
                 "If true, produce output even if end state was not reached.");
+    po.Register("determinize-threads", &determinize_threads,
+                "If > 0, lattice determinization is done by this many "
+                "separate threads, overlapping with the decoding done by the "
+                "--num-threads threads, instead of in the decoding threads. "
+                "(The --sort-window and --reorder-buffer options are then "
+                "ignored: the output is in order.)");
+    po.Register("numa-policy", &numa_policy,
+                "Placement of threads and memory on NUMA machines: \"none\", "
+                "\"pin\" (pin the threads to the nodes) or \"replicate\" "
+                "(also copy the model and, if there is a single graph, the "
+                "graph to each node; ignored with --determinize-threads).");
     
     po.Read(argc, argv);
+    SetNumaPolicy(numa_policy);
 
     if (po.NumArgs() < 4 || po.NumArgs() > 6) {
       po.PrintUsage();
@@ -114,13 +149,40 @@ int main(int argc, char *argv[]) {
     VectorFst<StdArc> *decode_fst = NULL; // only used if there is a single
                                           // decoding graph.
     
-    TaskSequencer<DecodeUtteranceLatticeFasterClass> sequencer(sequencer_config);
+    // If --determinize-threads > 0, "pipeline" runs the decoding (stage 0)
+    // and the determinization (stage 1) in separate threads; otherwise
+    // "scheduler" runs both in the same thread.
+    TaskPipeline<DecodeUtteranceLatticeFasterClass> *pipeline = NULL;
+    TaskScheduler<DecodeUtteranceLatticeFasterClass> *scheduler = NULL;
+    if (determinize_threads > 0) {
+      std::vector<int32> stage_threads(2);
+      stage_threads[0] = scheduler_config.num_threads;
+      stage_threads[1] = determinize_threads;
+      pipeline = new TaskPipeline<DecodeUtteranceLatticeFasterClass>(
+          stage_threads, 2 * (scheduler_config.num_threads +
+                              determinize_threads));
+    } else {
+      scheduler = new TaskScheduler<DecodeUtteranceLatticeFasterClass>(
+          scheduler_config);
+    }
       
     if (ClassifyRspecifier(fst_in_str, NULL, NULL) == kNoRspecifier) {
       SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
       // Input FST is just one FST, not a table of FSTs.
 
       decode_fst = fst::ReadFstKaldi(fst_in_str);
+      // If --numa-policy=replicate, each task uses the copies of the graph and
+      // the model on the node we ask the scheduler to run it on.
+      bool replicate = (GetNumaPolicy() == kNumaReplicate && scheduler != NULL);
+      NumaReplicated<VectorFst<StdArc> > *fst_replicas = NULL;
+      NumaReplicated<AmDiagGmm> *am_gmm_replicas = NULL;
+      if (replicate) {
+        fst_replicas = new NumaReplicated<VectorFst<StdArc> >(*decode_fst,
+                                                              &CopyDecodeFst);
+        am_gmm_replicas = new NumaReplicated<AmDiagGmm>(am_gmm,
+                                                        &CopyAmDiagGmm);
+      }
+      int32 num_read = 0;
       
       {    
         for (; !feature_reader.Done(); feature_reader.Next()) {
@@ -135,14 +197,16 @@ int main(int argc, char *argv[]) {
             continue;
           }
           
-          LatticeFasterDecoder *decoder = new LatticeFasterDecoder(*decode_fst,
-                                                                   latgen_config);
+          int32 node = (replicate ? num_read++ % NumaNumNodes() : -1);
+          LatticeFasterDecoder *decoder = new LatticeFasterDecoder(
+              replicate ? fst_replicas->Get(node) : *decode_fst,
+              latgen_config);
           // takes ownership of "features"
           DecodableAmDiagGmmScaled *gmm_decodable =
-              new DecodableAmDiagGmmScaled(am_gmm, trans_model, 
-                                           acoustic_scale,
-                                           log_sum_exp_prune,
-                                           features);
+              new DecodableAmDiagGmmScaled(
+                  replicate ? am_gmm_replicas->Get(node) : am_gmm, trans_model,
+                  acoustic_scale, log_sum_exp_prune, features);
+          gmm_decodable->SetFrameBatchSize(frame_batch_size);
 
           DecodeUtteranceLatticeFasterClass *task =
               new DecodeUtteranceLatticeFasterClass(
@@ -152,10 +216,19 @@ int main(int argc, char *argv[]) {
                   &compact_lattice_writer, &lattice_writer,
                   &tot_like, &frame_count, &num_done, &num_err, NULL);
             
-          sequencer.Run(task); // takes ownership of "task",
-          // and will delete it when done.
+          // takes ownership of "task", and will delete it when done.
+          if (pipeline != NULL)
+            pipeline->Run(task);
+          else
+            scheduler->Run(task, features->NumRows(), node);
         }
       }
+      if (replicate) {
+        delete scheduler;  // waits for the tasks, which use the replicas.
+        scheduler = NULL;
+        delete fst_replicas;
+        delete am_gmm_replicas;
+      }
     } else { // We have different FSTs for different utterances.
       SequentialTableReader<fst::VectorFstHolder> fst_reader(fst_in_str);
       RandomAccessBaseFloatMatrixReader feature_reader(feature_rspecifier);          
@@ -185,6 +258,7 @@ int main(int argc, char *argv[]) {
         DecodableAmDiagGmmScaled *gmm_decodable =
             new DecodableAmDiagGmmScaled(am_gmm, trans_model, acoustic_scale,
                                          log_sum_exp_prune, features);
+        gmm_decodable->SetFrameBatchSize(frame_batch_size);
 
         DecodeUtteranceLatticeFasterClass *task =
             new DecodeUtteranceLatticeFasterClass(
@@ -193,19 +267,23 @@ int main(int argc, char *argv[]) {
                 allow_partial, &alignment_writer, &words_writer,
                 &compact_lattice_writer, &lattice_writer,
                 &tot_like, &frame_count, &num_done, &num_err, NULL);
-        sequencer.Run(task); // takes ownership of "task",
-        // and will delete it when done.
+        // takes ownership of "task", and will delete it when done.
+        if (pipeline != NULL)
+          pipeline->Run(task);
+        else
+          scheduler->Run(task, features->NumRows());
       }
     }
-    sequencer.Wait();
+    delete pipeline;  // waits for the tasks.
+    delete scheduler;
 
     delete decode_fst;
     
     double elapsed = timer.Elapsed();
-    KALDI_LOG << "Decoded with " << sequencer_config.num_threads << " threads.";
+    KALDI_LOG << "Decoded with " << scheduler_config.num_threads << " threads.";
     KALDI_LOG << "Time taken "<< elapsed
               << "s: real-time factor per thread assuming 100 frames/sec is "
-              << (sequencer_config.num_threads * elapsed * 100.0 / frame_count);
+              << (scheduler_config.num_threads * elapsed * 100.0 / frame_count);
     KALDI_LOG << "Done " << num_done << " utterances, failed for "
               << num_err;
     KALDI_LOG << "Overall log-likelihood per frame is "
@@ -27,9 +27,44 @@
 #include "hmm/transition-model.h"
 #include "fstext/fstext-lib.h"
 #include "decoder/decoder-wrappers.h"
+#include "decoder/decoder-search-stats.h"
 #include "gmm/decodable-am-diag-gmm.h"
+#include "gmm/cu-am-diag-gmm.h"
+#include "decoder/decodable-matrix.h"
+#include "cudamatrix/cu-device.h"
 #include "base/timer.h"
 #include "feat/feature-functions.h"  // feature reversal
+#include "matrix/matrix-memory-pool.h"
+
+namespace kaldi {
+// Returns a new decodable object for "features", which must outlive it.  If
+// cu_am_gmm is not NULL we compute the log-likelihoods of the whole
+// utterance with it (on the GPU, if one is in use); otherwise they are
+// computed on demand by DecodableAmDiagGmmScaled, or if gselect is not NULL,
+// by DecodableAmDiagGmmGselectScaled.
+DecodableInterface *NewGmmDecodable(const AmDiagGmm &am_gmm,
+                                    const CuAmDiagGmm *cu_am_gmm,
+                                    const AmDiagGmmGselect *gselect,
+                                    const TransitionModel &trans_model,
+                                    const Matrix<BaseFloat> &features,
+                                    BaseFloat acoustic_scale,
+                                    int32 frame_batch_size) {
+  if (cu_am_gmm != NULL) {
+    Matrix<BaseFloat> *loglikes = new Matrix<BaseFloat>();
+    cu_am_gmm->LogLikelihoods(features, loglikes);
+    // takes ownership of "loglikes".
+    return new DecodableMatrixScaledMapped(trans_model, acoustic_scale,
+                                           loglikes);
+  }
+  if (gselect != NULL)
+    return new DecodableAmDiagGmmGselectScaled(*gselect, trans_model, features,
+                                               acoustic_scale);
+  DecodableAmDiagGmmScaled *ans = new DecodableAmDiagGmmScaled(
+      am_gmm, trans_model, features, acoustic_scale);
+  ans->SetFrameBatchSize(frame_batch_size);
+  return ans;
+}
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -45,12 +80,17 @@ int main(int argc, char *argv[]) {
         " lattice-wspecifier [ words-wspecifier [alignments-wspecifier] ]\n";
     ParseOptions po(usage);
     Timer timer;
-    bool allow_partial = false;
+    bool allow_partial = false, use_memory_pool = true;
     BaseFloat acoustic_scale = 0.1;
+    int32 frame_batch_size = 1;
+    std::string use_gpu = "no";
     LatticeFasterDecoderConfig config;
+    AmDiagGmmGselectOptions gselect_opts;
     
-    std::string word_syms_filename;
+    std::string word_syms_filename, search_stats_wxfilename,
+        gselect_ubm_rxfilename;
     config.Register(&po);
+    gselect_opts.Register(&po);
     po.Register("acoustic-scale", &acoustic_scale,
                 "Scaling factor for acoustic likelihoods");
     po.Register("word-symbol-table", &word_syms_filename,
@@ -58,8 +98,32 @@ int main(int argc, char *argv[]) {
     po.Register("allow-partial", &allow_partial,
                 "If true, produce output even if end state was not reached.");
     
+    po.Register("search-stats-json", &search_stats_wxfilename, "If set, "
+                "write statistics of the search (active tokens, arcs expanded, "
+                "adaptive beam, etc., per frame and per utterance) to this file "
+                "in JSON format.");
+    po.Register("use-memory-pool", &use_memory_pool, "If true, cache the "
+                "memory of matrix and vector temporaries for reuse instead of "
+                "freeing it (see matrix/matrix-memory-pool.h); with "
+                "--verbose=1, prints statistics of the allocations.");
+    po.Register("frame-batch-size", &frame_batch_size, "If > 1, compute the "
+                "likelihood of each Gaussian mixture for this many frames at a "
+                "time, the first time it is needed (faster, as it uses "
+                "matrix-matrix products, but does some unnecessary work).");
+    po.Register("use-gpu", &use_gpu,
+                "yes|no|optional|wait, only has effect if compiled with CUDA. "
+                "If not \"no\", the likelihoods are computed for whole "
+                "utterances using CuAmDiagGmm.");
+    po.Register("gselect-ubm", &gselect_ubm_rxfilename, "If set, a diagonal "
+                "UBM (e.g. from init-ubm) used for Gaussian selection: on each "
+                "frame, only the Gaussians of the model assigned to the best "
+                "--gselect-num-ubm Gaussians of the UBM are evaluated.");
+
     po.Read(argc, argv);
 
+    MatrixMemoryPool memory_pool;
+    ScopedMatrixMemoryPool scoped_pool(use_memory_pool ? &memory_pool : NULL);
+
     if (po.NumArgs() < 4 || po.NumArgs() > 6) {
       po.PrintUsage();
       exit(1);
@@ -71,7 +135,11 @@ int main(int argc, char *argv[]) {
         lattice_wspecifier = po.GetArg(4),
         words_wspecifier = po.GetOptArg(5),
         alignment_wspecifier = po.GetOptArg(6);
-    
+
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().SelectGpuId(use_gpu);
+#endif
+
     TransitionModel trans_model;
     AmDiagGmm am_gmm;
     {
@@ -80,6 +148,15 @@ int main(int argc, char *argv[]) {
       trans_model.Read(ki.Stream(), binary);
       am_gmm.Read(ki.Stream(), binary);
     }
+    CuAmDiagGmm *cu_am_gmm = (use_gpu != "no" ? new CuAmDiagGmm(am_gmm) : NULL);
+    DiagGmm gselect_ubm;
+    AmDiagGmmGselect *gselect = NULL;
+    if (!gselect_ubm_rxfilename.empty()) {
+      if (cu_am_gmm != NULL)
+        KALDI_ERR << "--gselect-ubm can't be used together with --use-gpu.";
+      ReadKaldiObject(gselect_ubm_rxfilename, &gselect_ubm);
+      gselect = new AmDiagGmmGselect(am_gmm, gselect_ubm, gselect_opts);
+    }
 
     bool determinize = config.determinize_lattice;
     CompactLatticeWriter compact_lattice_writer;
@@ -101,6 +178,7 @@ int main(int argc, char *argv[]) {
 
     double tot_like = 0.0;
     kaldi::int64 frame_count = 0;
+    DecoderSearchStats search_stats;
     int num_done = 0, num_err = 0;
 
     if (ClassifyRspecifier(fst_in_str, NULL, NULL) == kNoRspecifier) {
@@ -110,6 +188,8 @@ int main(int argc, char *argv[]) {
       
       {
         LatticeFasterDecoder decoder(*decode_fst, config);
+        if (!search_stats_wxfilename.empty())
+          decoder.SetSearchStats(&search_stats);
     
         for (; !feature_reader.Done(); feature_reader.Next()) {
           std::string utt = feature_reader.Key();
@@ -121,12 +201,13 @@ int main(int argc, char *argv[]) {
             continue;
           }
           
-          DecodableAmDiagGmmScaled gmm_decodable(am_gmm, trans_model, features,
-                                                 acoustic_scale);
+          DecodableInterface *gmm_decodable = NewGmmDecodable(
+              am_gmm, cu_am_gmm, gselect, trans_model, features,
+              acoustic_scale, frame_batch_size);
 
           double like;
           if (DecodeUtteranceLatticeFaster(
-                  decoder, gmm_decodable, trans_model, word_syms, utt,
+                  decoder, *gmm_decodable, trans_model, word_syms, utt,
                   acoustic_scale, determinize, allow_partial, &alignment_writer,
                   &words_writer, &compact_lattice_writer, &lattice_writer,
                   &like)) {
@@ -134,6 +215,9 @@ int main(int argc, char *argv[]) {
             frame_count += features.NumRows();
             num_done++;
           } else num_err++;
+          delete gmm_decodable;
+          if (!search_stats_wxfilename.empty())
+            search_stats.EndUtterance(utt);
         }
       }
       delete decode_fst; // delete this only after decoder goes out of scope.
@@ -156,11 +240,14 @@ int main(int argc, char *argv[]) {
         }
 
         LatticeFasterDecoder decoder(fst_reader.Value(), config);
-        DecodableAmDiagGmmScaled gmm_decodable(am_gmm, trans_model, features,
-                                               acoustic_scale);
+        if (!search_stats_wxfilename.empty())
+          decoder.SetSearchStats(&search_stats);
+        DecodableInterface *gmm_decodable = NewGmmDecodable(
+            am_gmm, cu_am_gmm, gselect, trans_model, features, acoustic_scale,
+            frame_batch_size);
         double like;
         if (DecodeUtteranceLatticeFaster(
-                decoder, gmm_decodable, trans_model, word_syms, utt,
+                decoder, *gmm_decodable, trans_model, word_syms, utt,
                 acoustic_scale, determinize, allow_partial, &alignment_writer,
                 &words_writer, &compact_lattice_writer, &lattice_writer,
                 &like)) {
@@ -168,6 +255,9 @@ int main(int argc, char *argv[]) {
           frame_count += features.NumRows();
           num_done++;
         } else num_err++;
+        delete gmm_decodable;
+        if (!search_stats_wxfilename.empty())
+          search_stats.EndUtterance(utt);
       }
     }
       
@@ -179,8 +269,20 @@ int main(int argc, char *argv[]) {
               << num_err;
     KALDI_LOG << "Overall log-likelihood per frame is " << (tot_like/frame_count) << " over "
               << frame_count << " frames.";
+    if (use_memory_pool && GetVerboseLevel() >= 1)
+      memory_pool.PrintStats();
+
+    if (!search_stats_wxfilename.empty()) {
+      Output ko(search_stats_wxfilename, false);
+      search_stats.WriteJson(ko.Stream());
+    }
 
     delete word_syms;
+    delete cu_am_gmm;
+    delete gselect;
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().PrintProfile();
+#endif
     if (num_done != 0) return 0;
     else return 1;
   } catch(const std::exception &e) {
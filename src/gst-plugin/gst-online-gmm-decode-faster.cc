@@ -49,6 +49,7 @@
 
 #include "gst-plugin/kaldimarshal.h"
 #include "gst-plugin/gst-online-gmm-decode-faster.h"
+#include "gst-plugin/gst-online-nnet2-decode-faster.h"
 
 #include "feat/feature-mfcc.h"
 #include "online/online-audio-source.h"
@@ -860,7 +861,8 @@ onlinegmmdecodefaster_init(GstPlugin * onlinegmmdecodefaster) {
                            0, "Automatic Speech Recognition");
 
   return gst_element_register(onlinegmmdecodefaster, "onlinegmmdecodefaster", GST_RANK_NONE,
-                               GST_TYPE_ONLINEGMMDECODEFASTER);
+                               GST_TYPE_ONLINEGMMDECODEFASTER) &&
+      gst_online_nnet2_decode_faster_register(onlinegmmdecodefaster);
 }
 
 /* PACKAGE: this is usually set by autotools depending on some _INIT macro
@@ -0,0 +1,831 @@
+// gst-plugin/gst-online-nnet2-decode-faster.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * GStreamer element for automatic speech recognition, based on Kaldi's
+ * SingleUtteranceNnet2DecoderThreaded decoder (online nnet2 decoding with
+ * iVector adaptation and endpointing).
+ *
+ * The recognized words of each utterance are pushed out of the source pad as
+ * for onlinegmmdecodefaster, followed by "<#s>"; applications can also connect
+ * to the "partial-result" and "final-result" signals, which give the whole
+ * hypothesis so far, or of the utterance, as a string.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0  filesrc location=test.wav \
+ *     ! decodebin ! audioconvert ! audioresample ! audio/x-raw,rate=16000 \
+ *     ! onlinennet2decodefaster model=$dir/final.mdl fst=$dir/HCLG.fst \
+ *                               word-syms=$dir/words.txt \
+ *                               mfcc-config=$dir/conf/mfcc.conf \
+ *                               ivector-extraction-config=$dir/conf/ivector_extractor.conf \
+ *                               do-endpointing=true endpoint-silence-phones="1:2:3:4:5" \
+ *     ! filesink location=$resultfile
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#else
+#  define VERSION "1.0"
+#endif
+
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gst-plugin/kaldimarshal.h"
+#include "gst-plugin/gst-online-nnet2-decode-faster.h"
+
+#include "fstext/fstext-lib.h"
+#include "lat/lattice-functions.h"
+#include "online2/onlinebin-util.h"
+
+namespace kaldi {
+
+GST_DEBUG_CATEGORY_STATIC(gst_online_nnet2_decode_faster_debug);
+#define GST_CAT_DEFAULT gst_online_nnet2_decode_faster_debug
+
+enum {
+  PARTIAL_RESULT_SIGNAL,
+  FINAL_RESULT_SIGNAL,
+  LAST_SIGNAL
+};
+
+enum {
+  PROP_0,
+  PROP_SILENT,
+  PROP_MODEL,
+  PROP_FST,
+  PROP_WORD_SYMS,
+  PROP_DO_ENDPOINTING,
+  PROP_LAST
+};
+
+#define DEFAULT_MODEL           "final.mdl"
+#define DEFAULT_FST             "HCLG.fst"
+#define DEFAULT_WORD_SYMS       "words.txt"
+
+// How often (in seconds) the decoding task checks the decoder for new partial
+// results and endpoints.
+static const BaseFloat kPollPeriod = 0.05;
+
+/* The sample rate isn't fixed because it has to match the feature
+ * configuration of the model; the decoder checks this.
+ */
+static GstStaticPadTemplate sink_factory =
+    GST_STATIC_PAD_TEMPLATE("sink",
+                            GST_PAD_SINK,
+                            GST_PAD_ALWAYS,
+                            GST_STATIC_CAPS(
+                                "audio/x-raw, "
+                                "format = (string) S16LE, "
+                                "channels = (int) 1, "
+                                "rate = (int) [ 1, MAX ] "));
+
+
+static GstStaticPadTemplate src_factory =
+    GST_STATIC_PAD_TEMPLATE("src",
+                            GST_PAD_SRC,
+                            GST_PAD_ALWAYS,
+                            GST_STATIC_CAPS("text/x-raw, format= { utf8 }"));
+
+static guint gst_online_nnet2_decode_faster_signals[LAST_SIGNAL];
+
+#define gst_online_nnet2_decode_faster_parent_class parent_class
+G_DEFINE_TYPE(GstOnlineNnet2DecodeFaster, gst_online_nnet2_decode_faster, GST_TYPE_ELEMENT);
+
+
+static void
+gst_online_nnet2_decode_faster_set_property(GObject * object, guint prop_id,
+                                            const GValue * value,
+                                            GParamSpec * pspec);
+static void
+gst_online_nnet2_decode_faster_get_property(GObject * object, guint prop_id,
+                                            GValue * value, GParamSpec * pspec);
+static GstStateChangeReturn
+gst_online_nnet2_decode_faster_change_state(GstElement *element,
+                                            GstStateChange transition);
+static void
+gst_online_nnet2_decode_faster_finalize(GObject * object);
+
+static gboolean
+gst_online_nnet2_decode_faster_sink_event(GstPad * pad, GstObject * parent,
+                                          GstEvent * event);
+
+static GstFlowReturn gst_online_nnet2_decode_faster_chain(GstPad * pad,
+                                                          GstObject * parent,
+                                                          GstBuffer * buf);
+
+static void
+gst_online_nnet2_decode_faster_loop(GstOnlineNnet2DecodeFaster * filter);
+
+
+// Registers the options of the Kaldi config classes with "opts".
+static void
+gst_online_nnet2_decode_faster_register_options(
+    OnlineNnet2FeaturePipelineConfig *feature_config,
+    OnlineNnet2DecodingThreadedConfig *decoding_config,
+    OnlineEndpointConfig *endpoint_config,
+    SimpleOptions *opts) {
+  feature_config->Register(opts);
+  decoding_config->Register(opts);
+  endpoint_config->Register(opts);
+}
+
+// GObject property names may not contain '.', which Kaldi uses for prefixed
+// options such as "endpoint.rule1.min-trailing-silence"; we use '-' instead.
+static std::string
+gst_online_nnet2_decode_faster_property_name(const std::string &option_name) {
+  std::string name(option_name);
+  for (size_t i = 0; i < name.size(); i++)
+    if (name[i] == '.') name[i] = '-';
+  return name;
+}
+
+// Finds the Kaldi option for a property name; returns false if none.
+static bool
+gst_online_nnet2_decode_faster_option_name(GstOnlineNnet2DecodeFaster *filter,
+                                           const std::string &property_name,
+                                           std::string *option_name) {
+  std::vector<std::pair<std::string, SimpleOptions::OptionInfo> > option_info_list =
+      filter->simple_options_->GetOptionInfoList();
+  for (size_t i = 0; i < option_info_list.size(); i++) {
+    if (gst_online_nnet2_decode_faster_property_name(
+            option_info_list[i].first) == property_name) {
+      *option_name = option_info_list[i].first;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+/* GObject vmethod implementations */
+
+/* initialize the onlinennet2decodefaster's class */
+static void gst_online_nnet2_decode_faster_class_init(GstOnlineNnet2DecodeFasterClass * klass) {
+  GObjectClass *gobject_class;
+  GstElementClass *gstelement_class;
+
+  gobject_class = (GObjectClass *) klass;
+  gstelement_class = (GstElementClass *) klass;
+
+  gobject_class->set_property = gst_online_nnet2_decode_faster_set_property;
+  gobject_class->get_property = gst_online_nnet2_decode_faster_get_property;
+  gobject_class->finalize = gst_online_nnet2_decode_faster_finalize;
+
+  gstelement_class->change_state = gst_online_nnet2_decode_faster_change_state;
+
+  g_object_class_install_property(G_OBJECT_CLASS(klass),
+                                  PROP_SILENT,
+                                  g_param_spec_boolean("silent",
+                                                       "Silence the decoder",
+                                                       "Determines whether incoming audio is sent to the decoder or not",
+                                                       false,
+                                                       (GParamFlags) G_PARAM_READWRITE));
+  g_object_class_install_property(G_OBJECT_CLASS(klass),
+                                  PROP_MODEL,
+                                  g_param_spec_string("model",
+                                                      "Acoustic model",
+                                                      "Filename of the nnet2 acoustic model (as for online2-wav-nnet2-latgen-threaded)",
+                                                      DEFAULT_MODEL,
+                                                      (GParamFlags) G_PARAM_READWRITE));
+  g_object_class_install_property(G_OBJECT_CLASS(klass),
+                                  PROP_FST,
+                                  g_param_spec_string("fst",
+                                                      "Decoding FST",
+                                                      "Filename of the HCLG FST",
+                                                      DEFAULT_FST,
+                                                      (GParamFlags) G_PARAM_READWRITE));
+  g_object_class_install_property(G_OBJECT_CLASS(klass),
+                                  PROP_WORD_SYMS,
+                                  g_param_spec_string("word-syms",
+                                                      "Word symbols",
+                                                      "Name of word symbols file (typically words.txt)",
+                                                      DEFAULT_WORD_SYMS,
+                                                      (GParamFlags) G_PARAM_READWRITE));
+  g_object_class_install_property(G_OBJECT_CLASS(klass),
+                                  PROP_DO_ENDPOINTING,
+                                  g_param_spec_boolean("do-endpointing",
+                                                       "Endpointing",
+                                                       "If true, split the audio into utterances at endpoints (see the endpoint-* properties)",
+                                                       false,
+                                                       (GParamFlags) G_PARAM_READWRITE));
+
+  // Install a property for each option of the Kaldi config classes, with the
+  // defaults taken from freshly constructed configs.
+  OnlineNnet2FeaturePipelineConfig feature_config;
+  OnlineNnet2DecodingThreadedConfig decoding_config;
+  OnlineEndpointConfig endpoint_config;
+  SimpleOptions simple_options;
+  gst_online_nnet2_decode_faster_register_options(&feature_config,
+                                                  &decoding_config,
+                                                  &endpoint_config,
+                                                  &simple_options);
+  std::vector<std::pair<std::string, SimpleOptions::OptionInfo> > option_info_list =
+      simple_options.GetOptionInfoList();
+  for (size_t i = 0; i < option_info_list.size(); i++) {
+    const std::string &option_name = option_info_list[i].first;
+    const SimpleOptions::OptionInfo &option_info = option_info_list[i].second;
+    std::string name = gst_online_nnet2_decode_faster_property_name(option_name);
+    const gchar *doc = option_info.doc.c_str();
+    GParamSpec *pspec = NULL;
+    bool tmp_bool;
+    int32 tmp_int;
+    uint32 tmp_uint;
+    float tmp_float;
+    double tmp_double;
+    std::string tmp_string;
+    switch (option_info.type) {
+      case SimpleOptions::kBool:
+        simple_options.GetOption(option_name, &tmp_bool);
+        pspec = g_param_spec_boolean(name.c_str(), doc, doc, tmp_bool,
+                                     (GParamFlags) G_PARAM_READWRITE);
+        break;
+      case SimpleOptions::kInt32:
+        simple_options.GetOption(option_name, &tmp_int);
+        pspec = g_param_spec_int(name.c_str(), doc, doc, G_MININT, G_MAXINT,
+                                 tmp_int, (GParamFlags) G_PARAM_READWRITE);
+        break;
+      case SimpleOptions::kUint32:
+        simple_options.GetOption(option_name, &tmp_uint);
+        pspec = g_param_spec_uint(name.c_str(), doc, doc, 0, G_MAXUINT,
+                                  tmp_uint, (GParamFlags) G_PARAM_READWRITE);
+        break;
+      case SimpleOptions::kFloat:
+        simple_options.GetOption(option_name, &tmp_float);
+        pspec = g_param_spec_float(name.c_str(), doc, doc, -G_MAXFLOAT,
+                                   G_MAXFLOAT, tmp_float,
+                                   (GParamFlags) G_PARAM_READWRITE);
+        break;
+      case SimpleOptions::kDouble:
+        simple_options.GetOption(option_name, &tmp_double);
+        pspec = g_param_spec_double(name.c_str(), doc, doc, -G_MAXDOUBLE,
+                                    G_MAXDOUBLE, tmp_double,
+                                    (GParamFlags) G_PARAM_READWRITE);
+        break;
+      case SimpleOptions::kString:
+        simple_options.GetOption(option_name, &tmp_string);
+        pspec = g_param_spec_string(name.c_str(), doc, doc, tmp_string.c_str(),
+                                    (GParamFlags) G_PARAM_READWRITE);
+        break;
+    }
+    if (pspec != NULL)
+      g_object_class_install_property(G_OBJECT_CLASS(klass), PROP_LAST + i,
+                                      pspec);
+  }
+
+  gst_element_class_set_details_simple(gstelement_class,
+                                       "OnlineNnet2DecodeFaster",
+                                       "Speech/Audio",
+                                       "Convert speech to text",
+                                       "Kaldi <kaldi-developers@lists.sourceforge.net>");
+
+  gst_element_class_add_pad_template(gstelement_class,
+                                     gst_static_pad_template_get(&src_factory));
+  gst_element_class_add_pad_template(gstelement_class,
+                                     gst_static_pad_template_get(&sink_factory));
+
+  gst_online_nnet2_decode_faster_signals[PARTIAL_RESULT_SIGNAL]
+      = g_signal_new("partial-result", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST,
+                     G_STRUCT_OFFSET(GstOnlineNnet2DecodeFasterClass, partial_result),
+                     NULL, NULL, kaldi_marshal_VOID__STRING, G_TYPE_NONE, 1,
+                     G_TYPE_STRING);
+  gst_online_nnet2_decode_faster_signals[FINAL_RESULT_SIGNAL]
+      = g_signal_new("final-result", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST,
+                     G_STRUCT_OFFSET(GstOnlineNnet2DecodeFasterClass, final_result),
+                     NULL, NULL, kaldi_marshal_VOID__STRING, G_TYPE_NONE, 1,
+                     G_TYPE_STRING);
+}
+
+
+/* initialize the new element
+ * instantiate pads and add them to element
+ * set pad calback functions
+ * initialize instance structure
+ */
+static void
+gst_online_nnet2_decode_faster_init(GstOnlineNnet2DecodeFaster * filter) {
+  filter->silent_ = false;
+  filter->do_endpointing_ = false;
+  filter->samp_freq_ = 16000;
+  filter->model_rspecifier_ = g_strdup(DEFAULT_MODEL);
+  filter->fst_rspecifier_ = g_strdup(DEFAULT_FST);
+  filter->word_syms_filename_ = g_strdup(DEFAULT_WORD_SYMS);
+
+  filter->trans_model_ = NULL;
+  filter->am_nnet_ = NULL;
+  filter->decode_fst_ = NULL;
+  filter->word_syms_ = NULL;
+  filter->feature_info_ = NULL;
+  filter->adaptation_state_ = NULL;
+  filter->decoder_ = NULL;
+  filter->input_finished_ = false;
+  filter->decoder_mutex_ = new Mutex();
+
+  filter->feature_config_ = new OnlineNnet2FeaturePipelineConfig();
+  filter->decoding_config_ = new OnlineNnet2DecodingThreadedConfig();
+  filter->endpoint_config_ = new OnlineEndpointConfig();
+  filter->simple_options_ = new SimpleOptions();
+  gst_online_nnet2_decode_faster_register_options(filter->feature_config_,
+                                                  filter->decoding_config_,
+                                                  filter->endpoint_config_,
+                                                  filter->simple_options_);
+
+  filter->sinkpad_ = gst_pad_new_from_static_template(&sink_factory, "sink");
+  gst_pad_set_event_function(filter->sinkpad_,
+                              GST_DEBUG_FUNCPTR(gst_online_nnet2_decode_faster_sink_event));
+  gst_pad_set_chain_function(filter->sinkpad_,
+                              GST_DEBUG_FUNCPTR(gst_online_nnet2_decode_faster_chain));
+
+  gst_pad_use_fixed_caps(filter->sinkpad_);
+  gst_element_add_pad(GST_ELEMENT(filter), filter->sinkpad_);
+
+  filter->srcpad_ = gst_pad_new_from_static_template(&src_factory, "src");
+  gst_pad_use_fixed_caps(filter->srcpad_);
+  gst_element_add_pad(GST_ELEMENT(filter), filter->srcpad_);
+}
+
+static bool
+gst_online_nnet2_decode_faster_allocate(GstOnlineNnet2DecodeFaster * filter) {
+  if (!filter->trans_model_) {
+    GST_INFO_OBJECT(filter,  "Loading Kaldi decoder");
+    try {
+      filter->feature_info_ =
+          new OnlineNnet2FeaturePipelineInfo(*(filter->feature_config_));
+      filter->adaptation_state_ = new OnlineIvectorExtractorAdaptationState(
+          filter->feature_info_->ivector_extractor_info);
+
+      filter->trans_model_ = new TransitionModel();
+      filter->am_nnet_ = new nnet2::AmNnet();
+      {
+        bool binary;
+        Input ki(filter->model_rspecifier_, &binary);
+        filter->trans_model_->Read(ki.Stream(), binary);
+        filter->am_nnet_->Read(ki.Stream(), binary);
+      }
+      filter->decode_fst_ = ReadDecodeGraph(filter->fst_rspecifier_);
+    } catch (const std::exception &e) {
+      GST_ERROR_OBJECT(filter, "Error loading the models: %s", e.what());
+      return false;
+    }
+    if (!(filter->word_syms_ = fst::SymbolTable::ReadText(filter->word_syms_filename_))) {
+      GST_ERROR_OBJECT(filter, "Could not read symbol table from file %s", filter->word_syms_filename_);
+      return false;
+    }
+    GST_INFO_OBJECT(filter,  "Finished loading Kaldi decoder");
+  }
+  return true;
+}
+
+static void
+gst_online_nnet2_decode_faster_finalize(GObject * object) {
+  GstOnlineNnet2DecodeFaster *filter = GST_ONLINENNET2DECODEFASTER(object);
+
+  g_free(filter->model_rspecifier_);
+  g_free(filter->fst_rspecifier_);
+  g_free(filter->word_syms_filename_);
+  delete filter->decoder_;  // deletes its threads.
+  filter->decoder_ = NULL;
+  delete filter->decoder_mutex_;
+  delete filter->adaptation_state_;
+  delete filter->feature_info_;
+  delete filter->trans_model_;
+  delete filter->am_nnet_;
+  delete filter->decode_fst_;
+  delete filter->word_syms_;
+  delete filter->simple_options_;
+  delete filter->feature_config_;
+  delete filter->decoding_config_;
+  delete filter->endpoint_config_;
+
+  G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+
+static bool
+gst_online_nnet2_decode_faster_deallocate(GstOnlineNnet2DecodeFaster * filter) {
+  /* We won't deallocate the decoder once it's already allocated, since model loading could take a lot of time */
+  GST_INFO_OBJECT(filter, "Refusing to unload decoder");
+  return true;
+}
+
+static void
+gst_online_nnet2_decode_faster_set_property(GObject * object, guint prop_id,
+                                            const GValue * value, GParamSpec * pspec) {
+  GstOnlineNnet2DecodeFaster *filter = GST_ONLINENNET2DECODEFASTER(object);
+
+  if (prop_id == PROP_SILENT) {
+    filter->silent_ = g_value_get_boolean(value);
+    return;
+  }
+  // All other props cannot be changed after initialization
+  if (filter->trans_model_) {
+    GST_WARNING_OBJECT(filter,  "Decoder already initialized, cannot change it's properties");
+    return;
+  }
+  switch (prop_id) {
+    case PROP_MODEL:
+      g_free(filter->model_rspecifier_);
+      filter->model_rspecifier_ = g_value_dup_string(value);
+      break;
+    case PROP_FST:
+      g_free(filter->fst_rspecifier_);
+      filter->fst_rspecifier_ = g_value_dup_string(value);
+      break;
+    case PROP_WORD_SYMS:
+      g_free(filter->word_syms_filename_);
+      filter->word_syms_filename_ = g_value_dup_string(value);
+      break;
+    case PROP_DO_ENDPOINTING:
+      filter->do_endpointing_ = g_value_get_boolean(value);
+      break;
+    default:
+      if (prop_id >= PROP_LAST) {
+        std::string name;
+        SimpleOptions::OptionType option_type;
+        if (gst_online_nnet2_decode_faster_option_name(
+                filter, g_param_spec_get_name(pspec), &name) &&
+            filter->simple_options_->GetOptionType(name, &option_type)) {
+          switch (option_type) {
+            case SimpleOptions::kBool:
+              filter->simple_options_->SetOption(name, static_cast<bool>(g_value_get_boolean(value)));
+              break;
+            case SimpleOptions::kInt32:
+              filter->simple_options_->SetOption(name, static_cast<int32>(g_value_get_int(value)));
+              break;
+            case SimpleOptions::kUint32:
+              filter->simple_options_->SetOption(name, static_cast<uint32>(g_value_get_uint(value)));
+              break;
+            case SimpleOptions::kFloat:
+              filter->simple_options_->SetOption(name, g_value_get_float(value));
+              break;
+            case SimpleOptions::kDouble:
+              filter->simple_options_->SetOption(name, g_value_get_double(value));
+              break;
+            case SimpleOptions::kString:
+              filter->simple_options_->SetOption(name, g_value_get_string(value));
+              break;
+          }
+          break;
+        }
+      }
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_online_nnet2_decode_faster_get_property(GObject * object, guint prop_id,
+                                            GValue * value, GParamSpec * pspec) {
+  bool tmp_bool;
+  int32 tmp_int;
+  uint32 tmp_uint;
+  float tmp_float;
+  double tmp_double;
+  std::string tmp_string;
+
+  GstOnlineNnet2DecodeFaster *filter = GST_ONLINENNET2DECODEFASTER(object);
+
+  switch (prop_id) {
+    case PROP_SILENT:
+      g_value_set_boolean(value, filter->silent_);
+      break;
+    case PROP_MODEL:
+      g_value_set_string(value, filter->model_rspecifier_);
+      break;
+    case PROP_FST:
+      g_value_set_string(value, filter->fst_rspecifier_);
+      break;
+    case PROP_WORD_SYMS:
+      g_value_set_string(value, filter->word_syms_filename_);
+      break;
+    case PROP_DO_ENDPOINTING:
+      g_value_set_boolean(value, filter->do_endpointing_);
+      break;
+    default:
+      if (prop_id >= PROP_LAST) {
+        std::string name;
+        SimpleOptions::OptionType option_type;
+        if (gst_online_nnet2_decode_faster_option_name(
+                filter, g_param_spec_get_name(pspec), &name) &&
+            filter->simple_options_->GetOptionType(name, &option_type)) {
+          switch (option_type) {
+            case SimpleOptions::kBool:
+              filter->simple_options_->GetOption(name, &tmp_bool);
+              g_value_set_boolean(value, tmp_bool);
+              break;
+            case SimpleOptions::kInt32:
+              filter->simple_options_->GetOption(name, &tmp_int);
+              g_value_set_int(value, tmp_int);
+              break;
+            case SimpleOptions::kUint32:
+              filter->simple_options_->GetOption(name, &tmp_uint);
+              g_value_set_uint(value, tmp_uint);
+              break;
+            case SimpleOptions::kFloat:
+              filter->simple_options_->GetOption(name, &tmp_float);
+              g_value_set_float(value, tmp_float);
+              break;
+            case SimpleOptions::kDouble:
+              filter->simple_options_->GetOption(name, &tmp_double);
+              g_value_set_double(value, tmp_double);
+              break;
+            case SimpleOptions::kString:
+              filter->simple_options_->GetOption(name, &tmp_string);
+              g_value_set_string(value, tmp_string.c_str());
+              break;
+          }
+          break;
+        }
+      }
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+}
+
+
+static GstStateChangeReturn
+gst_online_nnet2_decode_faster_change_state(GstElement *element, GstStateChange transition) {
+  GstStateChangeReturn ret = GST_STATE_CHANGE_SUCCESS;
+  GstOnlineNnet2DecodeFaster *filter = GST_ONLINENNET2DECODEFASTER(element);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_NULL_TO_READY:
+      if (!gst_online_nnet2_decode_faster_allocate(filter))
+        return GST_STATE_CHANGE_FAILURE;
+      break;
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+  if (ret == GST_STATE_CHANGE_FAILURE)
+    return ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_NULL:
+      gst_online_nnet2_decode_faster_deallocate(filter);
+      break;
+    default:
+      break;
+  }
+
+  return ret;
+}
+
+// Converts the best path of the decoder to a string of words.
+static std::string
+gst_online_nnet2_decode_faster_best_path(GstOnlineNnet2DecodeFaster * filter,
+                                         bool end_of_utterance,
+                                         std::vector<int32> *words) {
+  Lattice best_path;
+  filter->decoder_->GetBestPath(end_of_utterance, &best_path, NULL);
+  fst::GetLinearSymbolSequence(best_path,
+                               static_cast<std::vector<int32> *>(0),
+                               words,
+                               static_cast<LatticeArc::Weight*>(0));
+  std::ostringstream ss;
+  for (size_t i = 0; i < words->size(); i++) {
+    std::string word = filter->word_syms_->Find((*words)[i]);
+    if (word == "") {
+      GST_ERROR_OBJECT(filter, "Word-id %d  not in symbol table!",  (*words)[i]);
+    }
+    if (i > 0) ss << ' ';
+    ss << word;
+  }
+  return ss.str();
+}
+
+/*
+ * Push the words of a finished utterance through the source pad, in the same
+ * format as onlinegmmdecodefaster: each word followed by a space, then "<#s>".
+ */
+static void
+gst_online_nnet2_decode_faster_push_result(GstOnlineNnet2DecodeFaster * filter,
+                                           const std::vector<int32> &words) {
+  std::ostringstream ss;
+  for (size_t i = 0; i < words.size(); i++)
+    ss << filter->word_syms_->Find(words[i]) << ' ';
+  ss << "<#s> ";
+  std::string result = ss.str();
+  GstBuffer *buffer = gst_buffer_new_and_alloc(result.size());
+  gst_buffer_fill(buffer, 0, result.data(), result.size());
+  gst_pad_push(filter->srcpad_, buffer);
+}
+
+// Creates the decoder for a new utterance, starting from the current
+// adaptation state.  Requires decoder_mutex_ to be locked.
+static void
+gst_online_nnet2_decode_faster_new_decoder(GstOnlineNnet2DecodeFaster * filter) {
+  KALDI_ASSERT(filter->decoder_ == NULL);
+  filter->decoder_ = new SingleUtteranceNnet2DecoderThreaded(
+      *(filter->decoding_config_), *(filter->trans_model_),
+      *(filter->am_nnet_), *(filter->decode_fst_), *(filter->feature_info_),
+      *(filter->adaptation_state_));
+}
+
+static void
+gst_online_nnet2_decode_faster_loop(GstOnlineNnet2DecodeFaster * filter) {
+  GST_DEBUG_OBJECT(filter,  "starting decoding loop");
+  std::string partial_result;
+  while (true) {
+    filter->decoder_mutex_->Lock();
+    SingleUtteranceNnet2DecoderThreaded *decoder = filter->decoder_;
+    bool input_finished = filter->input_finished_,
+        endpoint = !input_finished && filter->do_endpointing_ &&
+        decoder->EndpointDetected(*(filter->endpoint_config_));
+    if (!input_finished && !endpoint) {
+      if (decoder->NumFramesDecoded() > 0) {
+        std::vector<int32> words;
+        std::string result = gst_online_nnet2_decode_faster_best_path(
+            filter, false, &words);
+        if (result != partial_result) {
+          partial_result = result;
+          GST_DEBUG_OBJECT(filter, "PARTIAL: %s", result.c_str());
+          g_signal_emit(filter,
+                        gst_online_nnet2_decode_faster_signals[PARTIAL_RESULT_SIGNAL],
+                        0, result.c_str());
+        }
+      }
+      filter->decoder_mutex_->Unlock();
+      Sleep(kPollPeriod);
+      continue;
+    }
+    // The utterance has ended, at an endpoint or at the end of the stream.
+    if (endpoint)
+      decoder->TerminateDecoding();
+    decoder->Wait();
+    decoder->FinalizeDecoding();
+    std::vector<int32> words;
+    std::string result = gst_online_nnet2_decode_faster_best_path(
+        filter, true, &words);
+    decoder->GetAdaptationState(filter->adaptation_state_);
+    Vector<BaseFloat> remaining_waveform;
+    if (endpoint)
+      decoder->GetRemainingWaveform(&remaining_waveform);
+    delete decoder;
+    filter->decoder_ = NULL;
+    if (endpoint) {
+      // Start the next utterance on the audio the old decoder didn't use.
+      gst_online_nnet2_decode_faster_new_decoder(filter);
+      filter->decoder_->AcceptWaveform(filter->samp_freq_, &remaining_waveform);
+    } else {
+      // The next stream may be a different speaker.
+      *(filter->adaptation_state_) = OnlineIvectorExtractorAdaptationState(
+          filter->feature_info_->ivector_extractor_info);
+    }
+    filter->decoder_mutex_->Unlock();
+
+    GST_DEBUG_OBJECT(filter, "RESULT: %s", result.c_str());
+    if (!words.empty())
+      gst_online_nnet2_decode_faster_push_result(filter, words);
+    g_signal_emit(filter, gst_online_nnet2_decode_faster_signals[FINAL_RESULT_SIGNAL],
+                  0, result.c_str());
+    partial_result = "";
+    if (!endpoint)
+      break;
+  }
+  GST_DEBUG_OBJECT(filter, "Finished decoding loop");
+  GST_DEBUG_OBJECT(filter, "Pushing EOS event");
+  gst_pad_push_event(filter->srcpad_, gst_event_new_eos());
+
+  GST_DEBUG_OBJECT(filter, "Pausing decoding task");
+  gst_pad_pause_task(filter->srcpad_);
+}
+
+/* GstElement vmethod implementations */
+/* this function handles sink events */
+static gboolean
+gst_online_nnet2_decode_faster_sink_event(GstPad * pad, GstObject * parent, GstEvent * event) {
+  gboolean ret;
+  GstOnlineNnet2DecodeFaster *filter;
+
+  filter = GST_ONLINENNET2DECODEFASTER(parent);
+  GST_DEBUG_OBJECT(filter, "Handling %s event", GST_EVENT_TYPE_NAME(event));
+
+  switch (GST_EVENT_TYPE(event)) {
+    case GST_EVENT_SEGMENT:
+    {
+      bool start_task = false;
+      filter->decoder_mutex_->Lock();
+      if (filter->decoder_ == NULL) {
+        filter->input_finished_ = false;
+        gst_online_nnet2_decode_faster_new_decoder(filter);
+        start_task = true;
+      }
+      filter->decoder_mutex_->Unlock();
+      if (start_task) {
+        GST_DEBUG_OBJECT(filter,  "Starting decoding task");
+        gst_pad_start_task(filter->srcpad_,
+                           (GstTaskFunction) gst_online_nnet2_decode_faster_loop, filter, NULL);
+        GST_DEBUG_OBJECT(filter,  "Started decoding task");
+      }
+      gst_event_unref(event);
+      ret = TRUE;
+      break;
+    }
+    case GST_EVENT_CAPS:
+    {
+      GstCaps *caps;
+      gint rate;
+      gst_event_parse_caps(event, &caps);
+      if (gst_structure_get_int(gst_caps_get_structure(caps, 0), "rate", &rate))
+        filter->samp_freq_ = rate;
+      gst_event_unref(event);
+      ret = TRUE;
+      break;
+    }
+    case GST_EVENT_EOS:
+    {
+      /* end-of-stream: the decoding task pushes EOS once it has finished */
+      GST_DEBUG_OBJECT(filter, "EOS received");
+      filter->decoder_mutex_->Lock();
+      filter->input_finished_ = true;
+      if (filter->decoder_ != NULL)
+        filter->decoder_->InputFinished();
+      filter->decoder_mutex_->Unlock();
+      gst_event_unref(event);
+      ret = TRUE;
+      break;
+    }
+    default:
+      ret = gst_pad_event_default(pad, parent, event);
+      break;
+  }
+  return ret;
+}
+
+/* chain function
+ * this function does the actual processing
+ */
+static GstFlowReturn gst_online_nnet2_decode_faster_chain(GstPad * pad,
+                                                          GstObject * parent,
+                                                          GstBuffer * buf) {
+  GstOnlineNnet2DecodeFaster *filter;
+  GstMapInfo map;
+
+  filter = GST_ONLINENNET2DECODEFASTER(parent);
+
+  if (G_UNLIKELY(!filter->trans_model_))
+    goto not_negotiated;
+  if (!filter->silent_ && gst_buffer_map(buf, &map, GST_MAP_READ)) {
+    // The samples are converted straight from the mapped buffer into the vector
+    // that the decoder takes over, so this is the only copy of the audio.
+    const int16 *samples = reinterpret_cast<const int16*>(map.data);
+    int32 num_samples = map.size / sizeof(int16);
+    Vector<BaseFloat> wave_part(num_samples, kUndefined);
+    BaseFloat *wave_data = wave_part.Data();
+    for (int32 i = 0; i < num_samples; i++)
+      wave_data[i] = samples[i];
+    gst_buffer_unmap(buf, &map);
+
+    filter->decoder_mutex_->Lock();
+    if (filter->decoder_ != NULL && !filter->input_finished_)
+      filter->decoder_->AcceptWaveform(filter->samp_freq_, &wave_part);
+    filter->decoder_mutex_->Unlock();
+  }
+  gst_buffer_unref(buf);
+  return GST_FLOW_OK;
+
+  /* special cases */
+  not_negotiated: {
+    GST_ELEMENT_ERROR(filter, CORE, NEGOTIATION, (NULL),
+                      ("decoder wasn't allocated before chain function"));
+
+    gst_buffer_unref(buf);
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+}
+
+
+gboolean
+gst_online_nnet2_decode_faster_register(GstPlugin * plugin) {
+  GST_DEBUG_CATEGORY_INIT(gst_online_nnet2_decode_faster_debug, "onlinennet2decodefaster",
+                           0, "Automatic Speech Recognition");
+
+  return gst_element_register(plugin, "onlinennet2decodefaster", GST_RANK_NONE,
+                               GST_TYPE_ONLINENNET2DECODEFASTER);
+}
+
+}  // namespace kaldi
@@ -0,0 +1,105 @@
+// gst-plugin/gst-online-nnet2-decode-faster.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_GST_PLUGIN_GST_ONLINE_NNET2_DECODE_FASTER_H_
+#define KALDI_GST_PLUGIN_GST_ONLINE_NNET2_DECODE_FASTER_H_
+
+#include <gst/gst.h>
+
+#include "online2/online-nnet2-decoding-threaded.h"
+#include "online2/online-nnet2-feature-pipeline.h"
+#include "online2/online-endpoint.h"
+#include "thread/kaldi-mutex.h"
+#include "util/simple-options.h"
+
+namespace kaldi {
+
+G_BEGIN_DECLS
+
+/* #defines don't like whitespacey bits */
+#define GST_TYPE_ONLINENNET2DECODEFASTER \
+    (gst_online_nnet2_decode_faster_get_type())
+#define GST_ONLINENNET2DECODEFASTER(obj) \
+    (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_ONLINENNET2DECODEFASTER,GstOnlineNnet2DecodeFaster))
+#define GST_ONLINENNET2DECODEFASTER_CLASS(klass) \
+    (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_ONLINENNET2DECODEFASTER,GstOnlineNnet2DecodeFasterClass))
+#define GST_IS_ONLINENNET2DECODEFASTER(obj) \
+    (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_ONLINENNET2DECODEFASTER))
+#define GST_IS_ONLINENNET2DECODEFASTER_CLASS(klass) \
+    (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_ONLINENNET2DECODEFASTER))
+
+typedef struct _GstOnlineNnet2DecodeFaster      GstOnlineNnet2DecodeFaster;
+typedef struct _GstOnlineNnet2DecodeFasterClass GstOnlineNnet2DecodeFasterClass;
+
+// The element is a thin wrapper around SingleUtteranceNnet2DecoderThreaded.
+// Audio is handed to the decoder from the chain function; a task on the source
+// pad polls the decoder, emits partial and final results, and at each endpoint
+// starts the decoder for the next utterance, carrying over the adaptation
+// state.  (GObject allocates this struct without running constructors, so
+// anything with one is held by pointer.)
+struct _GstOnlineNnet2DecodeFaster {
+  GstElement element;
+
+  GstPad *sinkpad_, *srcpad_;
+
+  bool silent_;
+  bool do_endpointing_;
+  BaseFloat samp_freq_;  // from the caps of the sink pad.
+
+  gchar* model_rspecifier_;
+  gchar* fst_rspecifier_;
+  gchar* word_syms_filename_;
+
+  TransitionModel *trans_model_;
+  nnet2::AmNnet *am_nnet_;
+  fst::Fst<fst::StdArc> *decode_fst_;
+  fst::SymbolTable *word_syms_;
+
+  OnlineNnet2FeaturePipelineConfig *feature_config_;
+  OnlineNnet2DecodingThreadedConfig *decoding_config_;
+  OnlineEndpointConfig *endpoint_config_;
+  OnlineNnet2FeaturePipelineInfo *feature_info_;  // set up when models load.
+  OnlineIvectorExtractorAdaptationState *adaptation_state_;
+
+  // The decoder for the current utterance, or NULL if no stream is active.
+  // Guarded by decoder_mutex_, since the chain function and the decoding task
+  // run in different threads.
+  SingleUtteranceNnet2DecoderThreaded *decoder_;
+  bool input_finished_;  // set at EOS; guarded by decoder_mutex_.
+  Mutex *decoder_mutex_;
+
+  SimpleOptions *simple_options_;
+};
+
+struct _GstOnlineNnet2DecodeFasterClass {
+  GstElementClass parent_class;
+  void (*partial_result)(GstElement *element, const gchar *hyp_str);
+  void (*final_result)(GstElement *element, const gchar *hyp_str);
+};
+
+GType gst_online_nnet2_decode_faster_get_type(void);
+
+// Registers the "onlinennet2decodefaster" element with the plugin; called
+// from the plugin's init function.
+gboolean gst_online_nnet2_decode_faster_register(GstPlugin *plugin);
+
+G_END_DECLS
+}
+#endif  // KALDI_GST_PLUGIN_GST_ONLINE_NNET2_DECODE_FASTER_H_
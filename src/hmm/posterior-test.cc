@@ -18,6 +18,7 @@
 // limitations under the License.
 
 #include "hmm/posterior.h"
+#include "hmm/hmm-test-utils.h"
 #include "base/kaldi-math.h"
 
 namespace kaldi {
@@ -82,13 +83,117 @@ void TestPosteriorIo() {
     }
   }
 }
+
+// Check that we can still read the older binary format, which wrote each
+// element with WriteBasicType().
+void TestPosteriorReadOldFormat() {
+  Posterior post(3);
+  post[0].push_back(std::pair<int32, BaseFloat>(5, 0.25));
+  post[0].push_back(std::pair<int32, BaseFloat>(7, 0.75));
+  post[2].push_back(std::pair<int32, BaseFloat>(-1, 1.0));
+  std::ostringstream os;
+  WriteBasicType(os, true, static_cast<int32>(post.size()));
+  for (size_t i = 0; i < post.size(); i++) {
+    WriteBasicType(os, true, static_cast<int32>(post[i].size()));
+    for (size_t j = 0; j < post[i].size(); j++) {
+      WriteBasicType(os, true, post[i][j].first);
+      WriteBasicType(os, true, post[i][j].second);
+    }
+  }
+  std::istringstream is(os.str());
+  Posterior post2;
+  ReadPosterior(is, true, &post2);
+  KALDI_ASSERT(post == post2);
+}
+
+// Checks conversion between Posterior and CompactPosterior, and that their
+// I/O is interchangeable.
+void TestCompactPosterior() {
+  int32 post_size = RandInt(0, 20);
+  Posterior post(post_size);
+  for (int32 i = 0; i < post.size(); i++) {
+    int32 s = RandInt(0, 3);
+    for (int32 j = 0; j < s; j++)
+      post[i].push_back(std::pair<int32,BaseFloat>(
+          RandInt(-10, 100), RandUniform()));
+  }
+  CompactPosterior cpost(post);
+  KALDI_ASSERT(cpost.NumFrames() == post_size);
+  Posterior post2;
+  cpost.CopyToPosterior(&post2);
+  KALDI_ASSERT(post == post2);
+  for (int32 i = 0; i < post_size; i++) {
+    KALDI_ASSERT(cpost.FrameEnd(i) - cpost.FrameBegin(i) == post[i].size());
+    for (int32 j = 0; j < post[i].size(); j++) {
+      KALDI_ASSERT(cpost.Ids()[cpost.FrameBegin(i) + j] == post[i][j].first &&
+                   cpost.Weights()[cpost.FrameBegin(i) + j] ==
+                   post[i][j].second);
+    }
+  }
+  {  // Binary I/O is the same as for Posterior.
+    std::ostringstream os1, os2;
+    WritePosterior(os1, true, post);
+    cpost.Write(os2, true);
+    KALDI_ASSERT(os1.str() == os2.str());
+    CompactPosterior cpost2;
+    std::istringstream is(os1.str());
+    cpost2.Read(is, true);
+    cpost2.CopyToPosterior(&post2);
+    KALDI_ASSERT(post == post2);
+  }
+  {  // .. and so is text I/O.
+    std::ostringstream os1, os2;
+    WritePosterior(os1, false, post);
+    cpost.Write(os2, false);
+    KALDI_ASSERT(os1.str() == os2.str());
+  }
+  std::vector<int32> ali(post_size);
+  for (int32 i = 0; i < post_size; i++)
+    ali[i] = RandInt(1, 100);
+  AlignmentToPosterior(ali, &post);
+  AlignmentToPosterior(ali, &cpost);
+  cpost.CopyToPosterior(&post2);
+  KALDI_ASSERT(post == post2);
+}
+
+void TestConvertCompactPosteriorToPdfs() {
+  TransitionModel *trans_model = GenRandTransitionModel(NULL);
+  int32 num_frames = RandInt(0, 20);
+  Posterior post(num_frames);
+  for (int32 i = 0; i < num_frames; i++) {
+    int32 s = RandInt(0, 5);
+    for (int32 j = 0; j < s; j++)
+      post[i].push_back(std::pair<int32,BaseFloat>(
+          RandInt(1, trans_model->NumTransitionIds()), RandUniform()));
+  }
+  Posterior pdf_post, pdf_post2;
+  ConvertPosteriorToPdfs(*trans_model, post, &pdf_post);
+  CompactPosterior cpost(post), pdf_cpost;
+  ConvertPosteriorToPdfs(*trans_model, cpost, &pdf_cpost);
+  pdf_cpost.CopyToPosterior(&pdf_post2);
+  KALDI_ASSERT(pdf_post.size() == pdf_post2.size());
+  for (int32 i = 0; i < num_frames; i++) {
+    // the order within frames may differ.
+    std::sort(pdf_post[i].begin(), pdf_post[i].end());
+    std::sort(pdf_post2[i].begin(), pdf_post2[i].end());
+    KALDI_ASSERT(pdf_post[i].size() == pdf_post2[i].size());
+    for (size_t j = 0; j < pdf_post[i].size(); j++)
+      KALDI_ASSERT(pdf_post[i][j].first == pdf_post2[i][j].first &&
+                   ApproxEqual(pdf_post[i][j].second,
+                               pdf_post2[i][j].second));
+  }
+  delete trans_model;
+}
 }
 
 int main() {
+  kaldi::TestPosteriorReadOldFormat();
   // repeat the test ten times
   for (int i = 0; i < 10; i++) {
     kaldi::TestVectorToPosteriorEntry();
     kaldi::TestPosteriorIo();
+    kaldi::TestCompactPosterior();
+    kaldi::TestConvertCompactPosteriorToPdfs();
   }
   std::cout << "Test OK.\n";
 }
@@ -30,17 +30,35 @@ namespace kaldi {
 
 void WritePosterior(std::ostream &os, bool binary, const Posterior &post) {
   if (binary) {
+    // The "PO" token marks the bulk format: the number of frames, then the
+    // number of entries on each frame, the ids and the weights, each as a
+    // single block.  ReadPosterior() also accepts the older format, which
+    // wrote each element separately with WriteBasicType().
+    WriteToken(os, binary, "PO");
     int32 sz = post.size();
     WriteBasicType(os, binary, sz);
+    std::vector<int32> counts(sz);
+    size_t total = 0;
+    for (int32 i = 0; i < sz; i++) {
+      counts[i] = post[i].size();
+      total += post[i].size();
+    }
+    std::vector<int32> ids;
+    std::vector<BaseFloat> weights;
+    ids.reserve(total);
+    weights.reserve(total);
     for (Posterior::const_iterator iter = post.begin(); iter != post.end(); ++iter) {
-      int32 sz2 = iter->size();
-      WriteBasicType(os, binary, sz2);
       for (std::vector<std::pair<int32, BaseFloat> >::const_iterator
                iter2 = iter->begin(); iter2 != iter->end(); ++iter2) {
-        WriteBasicType(os, binary, iter2->first);
-        WriteBasicType(os, binary, iter2->second);
+        ids.push_back(iter2->first);
+        weights.push_back(iter2->second);
       }
     }
+    WriteBasicTypeArray(os, (counts.empty() ? NULL : &(counts[0])),
+                        counts.size());
+    WriteBasicTypeArray(os, (ids.empty() ? NULL : &(ids[0])), ids.size());
+    WriteBasicTypeArray(os, (weights.empty() ? NULL : &(weights[0])),
+                        weights.size());
   } else {  // In text-mode, choose a human-friendly, script-friendly format.
     // format is [ 1235 0.6 12 0.4 ] [ 34 1.0 ] ...
     // We could have used the same code as in the binary case above,
@@ -62,7 +80,39 @@ void WritePosterior(std::ostream &os, bool binary, const Posterior &post) {
 
 void ReadPosterior(std::istream &is, bool binary, Posterior *post) {
   post->clear();
-  if (binary) {
+  if (binary && is.peek() == 'P') {
+    // The bulk format; see WritePosterior().  The older format starts with
+    // the type-size byte of an int32, so it can't start with 'P'.
+    ExpectToken(is, true, "PO");
+    int32 sz;
+    ReadBasicType(is, true, &sz);
+    if (sz < 0 || sz > 10000000)
+      KALDI_ERR << "Reading posterior: got negative or improbably large size"
+                << sz;
+    std::vector<int32> counts(sz);
+    ReadBasicTypeArray(is, counts.size(),
+                       (counts.empty() ? NULL : &(counts[0])));
+    size_t total = 0;
+    for (int32 i = 0; i < sz; i++) {
+      if (counts[i] < 0)
+        KALDI_ERR << "Reading posteriors: got negative size";
+      total += counts[i];
+    }
+    std::vector<int32> ids(total);
+    std::vector<BaseFloat> weights(total);
+    ReadBasicTypeArray(is, total, (ids.empty() ? NULL : &(ids[0])));
+    ReadBasicTypeArray(is, total, (weights.empty() ? NULL : &(weights[0])));
+    post->resize(sz);
+    size_t k = 0;
+    for (int32 i = 0; i < sz; i++) {
+      std::vector<std::pair<int32, BaseFloat> > &this_vec = (*post)[i];
+      this_vec.resize(counts[i]);
+      for (int32 j = 0; j < counts[i]; j++, k++) {
+        this_vec[j].first = ids[k];
+        this_vec[j].second = weights[k];
+      }
+    }
+  } else if (binary) {
     int32 sz;
     ReadBasicType(is, true, &sz);
     if (sz < 0 || sz > 10000000)
@@ -217,6 +267,148 @@ bool GaussPostHolder::Read(std::istream &is) {
   }
 }
 
+void CompactPosterior::CopyFromPosterior(const Posterior &post) {
+  size_t num_entries = 0;
+  for (size_t t = 0; t < post.size(); t++)
+    num_entries += post[t].size();
+  offsets_.resize(post.size() + 1);
+  ids_.resize(num_entries);
+  weights_.resize(num_entries);
+  size_t k = 0;
+  offsets_[0] = 0;
+  for (size_t t = 0; t < post.size(); t++) {
+    for (size_t j = 0; j < post[t].size(); j++, k++) {
+      ids_[k] = post[t][j].first;
+      weights_[k] = post[t][j].second;
+    }
+    offsets_[t + 1] = k;
+  }
+}
+
+void CompactPosterior::CopyToPosterior(Posterior *post) const {
+  int32 num_frames = NumFrames();
+  post->resize(num_frames);
+  for (int32 t = 0; t < num_frames; t++) {
+    std::vector<std::pair<int32, BaseFloat> > &this_vec = (*post)[t];
+    this_vec.resize(offsets_[t + 1] - offsets_[t]);
+    for (int32 k = offsets_[t], j = 0; k < offsets_[t + 1]; k++, j++) {
+      this_vec[j].first = ids_[k];
+      this_vec[j].second = weights_[k];
+    }
+  }
+}
+
+void CompactPosterior::Clear() {
+  offsets_.resize(1);
+  offsets_[0] = 0;
+  ids_.clear();
+  weights_.clear();
+}
+
+void CompactPosterior::Reserve(int32 num_frames, int32 num_entries) {
+  offsets_.reserve(num_frames + 1);
+  ids_.reserve(num_entries);
+  weights_.reserve(num_entries);
+}
+
+void CompactPosterior::Swap(CompactPosterior *other) {
+  offsets_.swap(other->offsets_);
+  ids_.swap(other->ids_);
+  weights_.swap(other->weights_);
+}
+
+void CompactPosterior::Write(std::ostream &os, bool binary) const {
+  int32 num_frames = NumFrames();
+  if (binary) {
+    // The same format as WritePosterior().
+    WriteToken(os, binary, "PO");
+    WriteBasicType(os, binary, num_frames);
+    std::vector<int32> counts(num_frames);
+    for (int32 t = 0; t < num_frames; t++)
+      counts[t] = offsets_[t + 1] - offsets_[t];
+    WriteBasicTypeArray(os, (counts.empty() ? NULL : &(counts[0])),
+                        counts.size());
+    WriteBasicTypeArray(os, Ids(), ids_.size());
+    WriteBasicTypeArray(os, Weights(), weights_.size());
+  } else {
+    for (int32 t = 0; t < num_frames; t++) {
+      os << "[ ";
+      for (int32 k = offsets_[t]; k < offsets_[t + 1]; k++)
+        os << ids_[k] << ' ' << weights_[k] << ' ';
+      os << "] ";
+    }
+    os << '\n';  // newline terminates the Posterior.
+  }
+  if (!os.good())
+    KALDI_ERR << "Output stream error writing Posterior.";
+}
+
+void CompactPosterior::Read(std::istream &is, bool binary) {
+  if (binary && is.peek() == 'P') {
+    // The bulk format, which we can read directly.
+    ExpectToken(is, true, "PO");
+    int32 num_frames;
+    ReadBasicType(is, true, &num_frames);
+    if (num_frames < 0 || num_frames > 10000000)
+      KALDI_ERR << "Reading posterior: got negative or improbably large size"
+                << num_frames;
+    std::vector<int32> counts(num_frames);
+    ReadBasicTypeArray(is, counts.size(),
+                       (counts.empty() ? NULL : &(counts[0])));
+    offsets_.resize(num_frames + 1);
+    offsets_[0] = 0;
+    for (int32 t = 0; t < num_frames; t++) {
+      if (counts[t] < 0)
+        KALDI_ERR << "Reading posteriors: got negative size";
+      offsets_[t + 1] = offsets_[t] + counts[t];
+    }
+    ids_.resize(offsets_.back());
+    weights_.resize(offsets_.back());
+    ReadBasicTypeArray(is, ids_.size(), (ids_.empty() ? NULL : &(ids_[0])));
+    ReadBasicTypeArray(is, weights_.size(),
+                       (weights_.empty() ? NULL : &(weights_[0])));
+  } else {
+    // The older binary format, or text; these are not used for large amounts
+    // of data so we don't mind the conversion.
+    Posterior post;
+    ReadPosterior(is, binary, &post);
+    CopyFromPosterior(post);
+  }
+}
+
+// static
+bool CompactPosteriorHolder::Write(std::ostream &os, bool binary,
+                                   const T &t) {
+  InitKaldiOutputStream(os, binary);  // Puts binary header if binary mode.
+  try {
+    t.Write(os, binary);
+    return true;
+  } catch(const std::exception &e) {
+    KALDI_WARN << "Exception caught writing table of posteriors";
+    if (!IsKaldiError(e.what())) { std::cerr << e.what(); }
+    return false;  // Write failure.
+  }
+}
+
+bool CompactPosteriorHolder::Read(std::istream &is) {
+  t_.Clear();
+
+  bool is_binary;
+  if (!InitKaldiInputStream(is, &is_binary)) {
+    KALDI_WARN << "Reading Table object, failed reading binary header";
+    return false;
+  }
+  try {
+    t_.Read(is, is_binary);
+    return true;
+  } catch (std::exception &e) {
+    KALDI_WARN << "Exception caught reading table of posteriors";
+    if (!IsKaldiError(e.what())) { std::cerr << e.what(); }
+    t_.Clear();
+    return false;
+  }
+}
+
 
 void ScalePosterior(BaseFloat scale, Posterior *post) {
   if (scale == 1.0) return;
@@ -301,6 +493,16 @@ void AlignmentToPosterior(const std::vector<int32> &ali,
   }
 }
 
+void AlignmentToPosterior(const std::vector<int32> &ali,
+                          CompactPosterior *post) {
+  post->Clear();
+  post->Reserve(ali.size(), ali.size());
+  for (size_t i = 0; i < ali.size(); i++) {
+    post->AddFrame();
+    post->AddEntry(ali[i], 1.0);
+  }
+}
+
 struct ComparePosteriorByPdfs {
   const TransitionModel *tmodel_;
   ComparePosteriorByPdfs(const TransitionModel &tmodel): tmodel_(&tmodel) {}
@@ -348,6 +550,46 @@ void ConvertPosteriorToPdfs(const TransitionModel &tmodel,
   }
 }
 
+void ConvertPosteriorToPdfs(const TransitionModel &tmodel,
+                            const CompactPosterior &post_in,
+                            CompactPosterior *post_out) {
+  KALDI_ASSERT(post_out != &post_in);
+  int32 num_frames = post_in.NumFrames();
+  const int32 *ids = post_in.Ids();
+  const BaseFloat *weights = post_in.Weights();
+  const std::vector<int32> &id2pdf = tmodel.TransitionIdToPdfArray();
+  // pdf_to_entry[pdf] is the index in this_ids and this_weights of the entry
+  // for that pdf on the current frame, or -1; we reset it after each frame.
+  std::vector<int32> pdf_to_entry(tmodel.NumPdfs(), -1);
+  std::vector<int32> this_ids;
+  std::vector<BaseFloat> this_weights;
+  post_out->Clear();
+  post_out->Reserve(num_frames, post_in.NumEntries());
+  for (int32 t = 0; t < num_frames; t++) {
+    this_ids.clear();
+    this_weights.clear();
+    for (int32 k = post_in.FrameBegin(t); k < post_in.FrameEnd(t); k++) {
+      int32 tid = ids[k];
+      KALDI_ASSERT(static_cast<size_t>(tid) < id2pdf.size() && tid != 0 &&
+                   "Posterior does not match model");
+      int32 pdf_id = id2pdf[tid];
+      if (pdf_to_entry[pdf_id] < 0) {
+        pdf_to_entry[pdf_id] = this_ids.size();
+        this_ids.push_back(pdf_id);
+        this_weights.push_back(weights[k]);
+      } else {
+        this_weights[pdf_to_entry[pdf_id]] += weights[k];
+      }
+    }
+    post_out->AddFrame();
+    for (size_t j = 0; j < this_ids.size(); j++) {
+      pdf_to_entry[this_ids[j]] = -1;
+      if (this_weights[j] != 0.0)
+        post_out->AddEntry(this_ids[j], this_weights[j]);
+    }
+  }
+}
+
 void ConvertPosteriorToPhones(const TransitionModel &tmodel,
                               const Posterior &post_in,
                               Posterior *post_out) {
@@ -65,6 +65,8 @@ class PosteriorHolder {
   
   void Clear() { Posterior tmp; std::swap(tmp, t_); }
 
+  void Swap(PosteriorHolder *other) { t_.swap(other->t_); }
+
   // Reads into the holder.
   bool Read(std::istream &is);
   
@@ -101,6 +103,8 @@ class GaussPostHolder {
 
   void Clear() {  GaussPost tmp;  std::swap(tmp, t_); }
 
+  void Swap(GaussPostHolder *other) { t_.swap(other->t_); }
+
   // Reads into the holder.
   bool Read(std::istream &is);
   
@@ -116,6 +120,96 @@ class GaussPostHolder {
 };
 
 
+/// CompactPosterior stores the same information as Posterior, but in three
+/// flat arrays (compressed sparse row format): the entries for frame t are
+/// Ids()[i] and Weights()[i] for FrameBegin(t) <= i < FrameEnd(t).  This
+/// avoids one allocation per frame and the padding of std::pair, which
+/// matters for posterior-heavy programs.  Its binary form on disk is the same
+/// as that of Posterior, so the two can be read and written interchangeably.
+class CompactPosterior {
+ public:
+  CompactPosterior(): offsets_(1, 0) { }
+
+  explicit CompactPosterior(const Posterior &post) { CopyFromPosterior(post); }
+
+  void CopyFromPosterior(const Posterior &post);
+
+  void CopyToPosterior(Posterior *post) const;
+
+  int32 NumFrames() const { return offsets_.size() - 1; }
+
+  /// Total number of entries, over all frames.
+  int32 NumEntries() const { return ids_.size(); }
+
+  /// Index of the first entry of frame t.
+  int32 FrameBegin(int32 t) const { return offsets_[t]; }
+  /// One past the index of the last entry of frame t.
+  int32 FrameEnd(int32 t) const { return offsets_[t + 1]; }
+
+  const int32 *Ids() const { return (ids_.empty() ? NULL : &(ids_[0])); }
+  const BaseFloat *Weights() const {
+    return (weights_.empty() ? NULL : &(weights_[0]));
+  }
+
+  /// Removes all frames.
+  void Clear();
+
+  /// Appends an entry to the last frame; there must be at least one frame.
+  void AddEntry(int32 id, BaseFloat weight) {
+    KALDI_ASSERT(NumFrames() > 0);
+    ids_.push_back(id);
+    weights_.push_back(weight);
+    offsets_.back()++;
+  }
+
+  /// Starts a new, empty frame.
+  void AddFrame() { offsets_.push_back(offsets_.back()); }
+
+  /// Reserves space for the given number of frames and entries.
+  void Reserve(int32 num_frames, int32 num_entries);
+
+  void Swap(CompactPosterior *other);
+
+  void Write(std::ostream &os, bool binary) const;
+
+  /// Reads either format written by WritePosterior(), or text format.
+  void Read(std::istream &is, bool binary);
+
+ private:
+  std::vector<int32> offsets_;  // dimension NumFrames() + 1; offsets_[0] = 0.
+  std::vector<int32> ids_;
+  std::vector<BaseFloat> weights_;
+};
+
+// CompactPosteriorHolder is a holder for CompactPosterior; it reads and
+// writes tables that are compatible with those of PosteriorHolder.
+class CompactPosteriorHolder {
+ public:
+  typedef CompactPosterior T;
+
+  CompactPosteriorHolder() { }
+
+  static bool Write(std::ostream &os, bool binary, const T &t);
+
+  void Clear() { CompactPosterior tmp; t_.Swap(&tmp); }
+
+  void Swap(CompactPosteriorHolder *other) { t_.Swap(&(other->t_)); }
+
+  // Reads into the holder.
+  bool Read(std::istream &is);
+
+  // Kaldi objects always have the stream open in binary mode for
+  // reading.
+  static bool IsReadInBinary() { return true; }
+
+  const T &Value() const { return t_; }
+
+ private:
+  KALDI_DISALLOW_COPY_AND_ASSIGN(CompactPosteriorHolder);
+  T t_;
+};
+
+
 // Posterior is a typedef: vector<vector<pair<int32, BaseFloat> > >,
 // representing posteriors over (typically) transition-ids for an
 // utterance.
@@ -129,6 +223,12 @@ typedef TableWriter<GaussPostHolder> GaussPostWriter;
 typedef SequentialTableReader<GaussPostHolder> SequentialGaussPostReader;
 typedef RandomAccessTableReader<GaussPostHolder> RandomAccessGaussPostReader;
 
+typedef TableWriter<CompactPosteriorHolder> CompactPosteriorWriter;
+typedef SequentialTableReader<CompactPosteriorHolder>
+    SequentialCompactPosteriorReader;
+typedef RandomAccessTableReader<CompactPosteriorHolder>
+    RandomAccessCompactPosteriorReader;
+
 
 /// Scales the BaseFloat (weight) element in the posterior entries.
 void ScalePosterior(BaseFloat scale, Posterior *post);
@@ -174,6 +274,10 @@ BaseFloat VectorToPosteriorEntry(
 void AlignmentToPosterior(const std::vector<int32> &ali,
                           Posterior *post);
 
+/// As AlignmentToPosterior(), but outputs a CompactPosterior.
+void AlignmentToPosterior(const std::vector<int32> &ali,
+                          CompactPosterior *post);
+
 /// Sorts posterior entries so that transition-ids with same pdf-id are next to
 /// each other.
 void SortPosteriorByPdfs(const TransitionModel &tmodel,
@@ -186,6 +290,12 @@ void ConvertPosteriorToPdfs(const TransitionModel &tmodel,
                             const Posterior &post_in,
                             Posterior *post_out);
 
+/// As ConvertPosteriorToPdfs() above, but for CompactPosterior.  Within each
+/// frame the pdf-ids are output in order of first appearance.
+void ConvertPosteriorToPdfs(const TransitionModel &tmodel,
+                            const CompactPosterior &post_in,
+                            CompactPosterior *post_out);
+
 /// Converts a posterior over transition-ids to be a posterior
 /// over phones.
 void ConvertPosteriorToPhones(const TransitionModel &tmodel,
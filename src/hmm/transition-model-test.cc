@@ -46,11 +46,40 @@ void TestTransitionModel() {
   delete trans_model;
 }
 
+// Checks the precomputed per-transition-id information against the topology.
+void TestTransitionIdInfo() {
+  TransitionModel *trans_model = GenRandTransitionModel(NULL);
+  const HmmTopology &topo = trans_model->GetTopo();
+  for (int32 trans_id = 1; trans_id <= trans_model->NumTransitionIds();
+       trans_id++) {
+    int32 trans_state = trans_model->TransitionIdToTransitionState(trans_id),
+        trans_index = trans_model->TransitionIdToTransitionIndex(trans_id),
+        phone = trans_model->TransitionStateToPhone(trans_state),
+        hmm_state = trans_model->TransitionStateToHmmState(trans_state);
+    const HmmTopology::TopologyEntry &entry = topo.TopologyForPhone(phone);
+    int32 dest_state = entry[hmm_state].transitions[trans_index].first;
+    const TransitionIdInfo &info = trans_model->GetTransitionIdInfo(trans_id);
+    KALDI_ASSERT(info.pdf == trans_model->TransitionStateToPdf(trans_state) &&
+                 info.pdf == trans_model->TransitionIdToPdf(trans_id));
+    KALDI_ASSERT(info.phone == phone &&
+                 trans_model->TransitionIdToPhone(trans_id) == phone);
+    KALDI_ASSERT(trans_model->TransitionIdToHmmState(trans_id) == hmm_state);
+    KALDI_ASSERT(trans_model->TransitionIdToPdfClass(trans_id) ==
+                 entry[hmm_state].pdf_class);
+    KALDI_ASSERT(trans_model->IsSelfLoop(trans_id) ==
+                 (dest_state == hmm_state));
+    KALDI_ASSERT(trans_model->IsFinal(trans_id) ==
+                 (dest_state + 1 == static_cast<int32>(entry.size())));
+  }
+  delete trans_model;
+}
+
 }
 
 int main() {
   for (int i = 0; i < 2; i++)
     kaldi::TestTransitionModel();
+    kaldi::TestTransitionIdInfo();
   KALDI_LOG << "Test OK.\n";
 }
 
@@ -91,10 +91,42 @@ void TransitionModel::ComputeDerived() {
   }
 
   id2state_.resize(cur_transition_id);   // cur_transition_id is #transition-ids+1.
+  id2pdf_id_.resize(cur_transition_id);
+  id2pdf_id_[0] = -1;  // transition-id zero is not valid.
   for (int32 tstate = 1; tstate <= static_cast<int32>(triples_.size()); tstate++)
-    for (int32 tid = state2id_[tstate]; tid < state2id_[tstate+1]; tid++)
+    for (int32 tid = state2id_[tstate]; tid < state2id_[tstate+1]; tid++) {
       id2state_[tid] = tstate;
+      id2pdf_id_[tid] = triples_[tstate-1].pdf;
+    }
 
+  id2info_.resize(cur_transition_id);
+  id2info_[0].pdf = -1;
+  id2info_[0].phone = 0;
+  id2info_[0].hmm_state = -1;
+  id2info_[0].pdf_class = -1;
+  id2info_[0].flags = 0;
+  for (int32 tstate = 1; tstate <= static_cast<int32>(triples_.size()); tstate++) {
+    const Triple &triple = triples_[tstate-1];
+    const HmmTopology::TopologyEntry &entry = topo_.TopologyForPhone(triple.phone);
+    KALDI_ASSERT(static_cast<size_t>(triple.hmm_state) < entry.size());
+    const HmmTopology::HmmState &state = entry[triple.hmm_state];
+    // hmm-states and pdf-classes are stored as int16.
+    KALDI_ASSERT(triple.hmm_state <= 32767 && state.pdf_class <= 32767);
+    for (int32 tid = state2id_[tstate]; tid < state2id_[tstate+1]; tid++) {
+      int32 trans_index = tid - state2id_[tstate],
+          dest_state = state.transitions[trans_index].first;
+      TransitionIdInfo &info = id2info_[tid];
+      info.pdf = triple.pdf;
+      info.phone = triple.phone;
+      info.hmm_state = triple.hmm_state;
+      info.pdf_class = state.pdf_class;
+      info.flags = 0;
+      if (dest_state == triple.hmm_state)
+        info.flags |= TransitionIdInfo::kIsSelfLoop;
+      if (dest_state + 1 == static_cast<int32>(entry.size()))
+        info.flags |= TransitionIdInfo::kIsFinal;
+    }
+  }
 }
 void TransitionModel::InitializeProbs() {
   log_probs_.Resize(NumTransitionIds()+1);  // one-based array, zeroth element empty.
@@ -208,35 +240,6 @@ int32 TransitionModel::NumPhones() const {
 }
 
 
-bool TransitionModel::IsFinal(int32 trans_id) const {
-  KALDI_ASSERT(static_cast<size_t>(trans_id) < id2state_.size());
-  int32 trans_state = id2state_[trans_id];
-  int32 trans_index = trans_id - state2id_[trans_state];
-  const Triple &triple = triples_[trans_state-1];
-  const HmmTopology::TopologyEntry &entry = topo_.TopologyForPhone(triple.phone);
-  KALDI_ASSERT(static_cast<size_t>(triple.hmm_state) < entry.size());
-  KALDI_ASSERT(static_cast<size_t>(triple.hmm_state) < entry.size());
-  KALDI_ASSERT(static_cast<size_t>(trans_index) <
-               entry[triple.hmm_state].transitions.size());
-  // return true if the transition goes to the final state of the
-  // topology entry.
-  return (entry[triple.hmm_state].transitions[trans_index].first + 1 == 
-          static_cast<int32>(entry.size()));
-}
-
-
-bool TransitionModel::IsSelfLoop(int32 trans_id) const {
-  KALDI_ASSERT(static_cast<size_t>(trans_id) < id2state_.size());
-  int32 trans_state = id2state_[trans_id];
-  int32 trans_index = trans_id - state2id_[trans_state];
-  const Triple &triple = triples_[trans_state-1];
-  int32 phone = triple.phone, hmm_state = triple.hmm_state;
-  const HmmTopology::TopologyEntry &entry = topo_.TopologyForPhone(phone);
-  KALDI_ASSERT(static_cast<size_t>(hmm_state) < entry.size());
-  return (static_cast<size_t>(trans_index) < entry[hmm_state].transitions.size()
-          && entry[hmm_state].transitions[trans_index].first == hmm_state);
-}
-
 int32 TransitionModel::SelfLoopOf(int32 trans_state) const {  // returns the self-loop transition-id,
   KALDI_ASSERT(static_cast<size_t>(trans_state-1) < triples_.size());
   const Triple &triple = triples_[trans_state-1];
@@ -639,30 +642,6 @@ void TransitionModel::MapUpdateShared(const Vector<double> &stats,
 }
 
 
-int32 TransitionModel::TransitionIdToPhone(int32 trans_id) const {
-  KALDI_ASSERT(trans_id != 0 && static_cast<size_t>(trans_id) < id2state_.size());
-  int32 trans_state = id2state_[trans_id];
-  return triples_[trans_state-1].phone;
-}
-
-int32 TransitionModel::TransitionIdToPdfClass(int32 trans_id) const {
-  KALDI_ASSERT(trans_id != 0 && static_cast<size_t>(trans_id) < id2state_.size());
-  int32 trans_state = id2state_[trans_id];
-
-  const Triple &t = triples_[trans_state-1];
-  const HmmTopology::TopologyEntry &entry = topo_.TopologyForPhone(t.phone);
-  KALDI_ASSERT(static_cast<size_t>(t.hmm_state) < entry.size());
-  return entry[t.hmm_state].pdf_class;
-}
-
-
-int32 TransitionModel::TransitionIdToHmmState(int32 trans_id) const {
-  KALDI_ASSERT(trans_id != 0 && static_cast<size_t>(trans_id) < id2state_.size());
-  int32 trans_state = id2state_[trans_id];
-  const Triple &t = triples_[trans_state-1];
-  return t.hmm_state;
-}
-
 void TransitionModel::Print(std::ostream &os,
                             const std::vector<std::string> &phone_names,
                             const Vector<double> *occs) {
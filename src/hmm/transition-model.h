@@ -118,6 +118,21 @@ struct MapTransitionUpdateConfig {
   }
 };
 
+/// Per-transition-id information that TransitionModel precomputes, so that
+/// decoders and other code that looks up many transition-ids can get at it
+/// with one memory access (see TransitionModel::TransitionIdInfoArray()).
+struct TransitionIdInfo {
+  enum {
+    kIsSelfLoop = 1,  // the transition is a self-loop.
+    kIsFinal = 2  // the transition goes to the final state of the topology.
+  };
+  int32 pdf;
+  int32 phone;
+  int16 hmm_state;
+  int16 pdf_class;
+  int32 flags;  // bitwise OR of kIsSelfLoop and kIsFinal.
+};
+
 class TransitionModel {
 
  public:
@@ -152,15 +167,33 @@ class TransitionModel {
   // this state doesn't have a self-loop.
 
   inline int32 TransitionIdToPdf(int32 trans_id) const;
-  int32 TransitionIdToPhone(int32 trans_id) const;
-  int32 TransitionIdToPdfClass(int32 trans_id) const;
-  int32 TransitionIdToHmmState(int32 trans_id) const;
+  /// Returns the table that TransitionIdToPdf() uses: element i is the pdf-id
+  /// of transition-id i (element zero is -1).  This is for code, such as the
+  /// decodable objects, that looks up the pdf-ids of very many transition-ids
+  /// and wants to avoid the function call and the asserts.
+  const std::vector<int32> &TransitionIdToPdfArray() const {
+    return id2pdf_id_;
+  }
+  inline int32 TransitionIdToPhone(int32 trans_id) const;
+  inline int32 TransitionIdToPdfClass(int32 trans_id) const;
+  inline int32 TransitionIdToHmmState(int32 trans_id) const;
+
+  /// Returns the precomputed information for transition-id "trans_id".
+  inline const TransitionIdInfo &GetTransitionIdInfo(int32 trans_id) const;
+  /// Returns the table that the functions above use, indexed by transition-id
+  /// (element zero is not valid).  Like TransitionIdToPdfArray(), this is for
+  /// code in inner loops that wants to avoid the asserts, or to prefetch.
+  const std::vector<TransitionIdInfo> &TransitionIdInfoArray() const {
+    return id2info_;
+  }
 
   /// @}
 
-  bool IsFinal(int32 trans_id) const;  // returns true if this trans_id goes to the final state
-  // (which is bound to be nonemitting).
-  bool IsSelfLoop(int32 trans_id) const;  // return true if this trans_id corresponds to a self-loop.
+  // returns true if this trans_id goes to the final state (which is bound to
+  // be nonemitting).
+  inline bool IsFinal(int32 trans_id) const;
+  // return true if this trans_id corresponds to a self-loop.
+  inline bool IsSelfLoop(int32 trans_id) const;
 
   /// Returns the total number of transition-ids (note, these are one-based).
   inline int32 NumTransitionIds() const { return id2state_.size()-1; }
@@ -292,6 +325,15 @@ class TransitionModel {
   /// state (indexed by transition-id).
   std::vector<int32> id2state_;
 
+  /// For each transition-id, the corresponding pdf-id (indexed by
+  /// transition-id; the zeroth element is -1).
+  std::vector<int32> id2pdf_id_;
+
+  /// For each transition-id, the pdf-id, phone, hmm-state, pdf-class and
+  /// whether it's a self-loop or final (indexed by transition-id; the zeroth
+  /// element is not valid).
+  std::vector<TransitionIdInfo> id2info_;
+
   /// For each transition-id, the corresponding log-prob.  Indexed by transition-id.
   Vector<BaseFloat> log_probs_;
 
@@ -310,12 +352,38 @@ class TransitionModel {
 };
 
 inline int32 TransitionModel::TransitionIdToPdf(int32 trans_id) const {
-  // If a lot of time is spent here we may create an extra array
-  // to handle this.
-  KALDI_ASSERT(static_cast<size_t>(trans_id) < id2state_.size() &&
+  KALDI_ASSERT(static_cast<size_t>(trans_id) < id2pdf_id_.size() &&
                "Likely graph/model mismatch (graph built from wrong model?)");
-  int32 trans_state = id2state_[trans_id];
-  return triples_[trans_state-1].pdf;
+  return id2pdf_id_[trans_id];
+}
+
+inline const TransitionIdInfo &TransitionModel::GetTransitionIdInfo(
+    int32 trans_id) const {
+  KALDI_ASSERT(trans_id != 0 &&
+               static_cast<size_t>(trans_id) < id2info_.size());
+  return id2info_[trans_id];
+}
+
+inline int32 TransitionModel::TransitionIdToPhone(int32 trans_id) const {
+  return GetTransitionIdInfo(trans_id).phone;
+}
+
+inline int32 TransitionModel::TransitionIdToPdfClass(int32 trans_id) const {
+  return GetTransitionIdInfo(trans_id).pdf_class;
+}
+
+inline int32 TransitionModel::TransitionIdToHmmState(int32 trans_id) const {
+  return GetTransitionIdInfo(trans_id).hmm_state;
+}
+
+inline bool TransitionModel::IsFinal(int32 trans_id) const {
+  return (GetTransitionIdInfo(trans_id).flags &
+          TransitionIdInfo::kIsFinal) != 0;
+}
+
+inline bool TransitionModel::IsSelfLoop(int32 trans_id) const {
+  return (GetTransitionIdInfo(trans_id).flags &
+          TransitionIdInfo::kIsSelfLoop) != 0;
 }
 
 /// Works out which pdfs might correspond to the given phones.  Will return true
@@ -0,0 +1,80 @@
+// itf/batched-rnnlm-itf.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_ITF_BATCHED_RNNLM_ITF_H_
+#define KALDI_ITF_BATCHED_RNNLM_ITF_H_ 1
+#include <vector>
+#include "base/kaldi-common.h"
+#include "matrix/matrix-lib.h"
+#include "cudamatrix/cu-matrix.h"
+
+namespace kaldi {
+/// @ingroup Interfaces
+/// @{
+
+/// BatchedRnnlmInterface is the interface that RnnlmBatchDeterministicFst
+/// (in ../lm/kaldi-rnnlm-batch.h) needs from a recurrent language model: it
+/// computes the hidden states of many histories at once, one word at a time,
+/// and the log-probs of many (history, word) pairs.  A history is represented
+/// by its hidden state, which is a row of a matrix; words are identified by
+/// their labels (the integers in the word symbol table), and by an
+/// LM-specific index for the input word.
+class BatchedRnnlmInterface {
+ public:
+  /// The dimension of the hidden state (the context of the next word).
+  virtual int32 HiddenDim() const = 0;
+
+  /// The word label of the end-of-sentence symbol.
+  virtual int32 Eos() const = 0;
+
+  /// The LM's own index of word label "label", as given to ComputeHidden();
+  /// -1 if it has none.
+  virtual int32 WordIndex(int32 label) const = 0;
+
+  /// Outputs the context of the start of the sentence, i.e. the "previous
+  /// hidden state" of the empty history, and returns the index of the word
+  /// that is taken to precede it (the sentence boundary).
+  virtual int32 GetInitialContext(VectorBase<BaseFloat> *context) const = 0;
+
+  /// For each i, computes in row i of "hidden" the hidden state obtained from
+  /// the previous hidden state in row i of "context" and the word
+  /// "prev_words[i]", which is an index as returned by WordIndex() or
+  /// GetInitialContext() (-1 for no word).  "hidden" is resized.
+  virtual void ComputeHidden(const CuMatrixBase<BaseFloat> &context,
+                             const std::vector<int32> &prev_words,
+                             CuMatrix<BaseFloat> *hidden) const = 0;
+
+  /// For each i, computes in (*logprobs)[i] the log-probability of the word
+  /// labels[i] given the hidden state in row rows[i] of "hidden", and the word
+  /// history "*(histories[rows[i]])" (a sequence of word labels, which most
+  /// models ignore).
+  virtual void ComputeLogProbs(
+      const CuMatrixBase<BaseFloat> &hidden,
+      const std::vector<const std::vector<int32>* > &histories,
+      const std::vector<int32> &rows,
+      const std::vector<int32> &labels,
+      std::vector<BaseFloat> *logprobs) const = 0;
+
+  virtual ~BatchedRnnlmInterface() { }
+};
+
+/// @}
+}  // namespace kaldi
+
+#endif  // KALDI_ITF_BATCHED_RNNLM_ITF_H_
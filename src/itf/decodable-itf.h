@@ -114,9 +114,37 @@ class DecodableInterface {
   /// (they will be indexed one-based, i.e. from 1 to NumIndices();
   /// this is for compatibility with OpenFst.
   virtual int32 NumIndices() const = 0;
-  
+
+  /// This is an optional, faster alternative to LogLikelihood() for decoders
+  /// that need the scores of many indices on the same frame.  If the
+  /// decodable object supports it, it returns a pointer to a row of scores
+  /// for this frame and sets *index_to_row to a table such that
+  /// LogLikelihood(frame, i) == scores[(*index_to_row)[i]] for
+  /// 1 <= i <= NumIndices().  For objects whose indices are transition-ids,
+  /// the row is the scaled log-likelihoods of the pdfs and the table is
+  /// TransitionModel::TransitionIdToPdfArray().  This saves a virtual function
+  /// call and the transition-id to pdf-id lookup for each arc.  The pointers
+  /// are valid until the next call to a non-const function of this object.
+  /// The default implementation returns NULL, meaning the decoder has to call
+  /// LogLikelihood().
+  virtual const BaseFloat *GetFrameScores(int32 frame,
+                                          const int32 **index_to_row) {
+    return NULL;
+  }
+
   virtual ~DecodableInterface() {}
 };
+
+/// This is a convenience function for decoders that use
+/// DecodableInterface::GetFrameScores(): it returns the log-likelihood of
+/// "index" on the frame for which "frame_scores" and "index_to_row" were
+/// obtained, or calls decodable->LogLikelihood() if frame_scores is NULL.
+inline BaseFloat GetLogLikelihood(DecodableInterface *decodable, int32 frame,
+                                  int32 index, const BaseFloat *frame_scores,
+                                  const int32 *index_to_row) {
+  if (frame_scores != NULL) return frame_scores[index_to_row[index]];
+  else return decodable->LogLikelihood(frame, index);
+}
 /// @}
 }  // namespace Kaldi
 
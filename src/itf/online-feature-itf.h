@@ -19,6 +19,7 @@
 
 #ifndef KALDI_ITF_ONLINE_FEATURE_ITF_H_
 #define KALDI_ITF_ONLINE_FEATURE_ITF_H_ 1
+#include <vector>
 #include "base/kaldi-common.h"
 #include "matrix/matrix-lib.h"
 
@@ -74,6 +75,33 @@ class OnlineFeatureInterface {
   /// the class.
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat) = 0;
 
+  /// This is like GetFrame() but for a collection of frames: it puts the
+  /// feature vector for frame frames[i] in row i of "feats", which must have
+  /// frames.size() rows and Dim() columns.  The frames need not be distinct
+  /// or in order, but each must be less than NumFramesReady().  This default
+  /// implementation just calls GetFrame() for each frame; classes override it
+  /// where doing the frames together saves work, e.g. where a frame of the
+  /// input would otherwise be fetched repeatedly (splicing, deltas), or where
+  /// a matrix-matrix product can replace matrix-vector products
+  /// (transforms).  Code that needs a block of frames, e.g. for a chunk of
+  /// neural-net computation, should call this rather than GetFrame().
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats) {
+    KALDI_ASSERT(static_cast<int32>(frames.size()) == feats->NumRows());
+    for (size_t i = 0; i < frames.size(); i++) {
+      SubVector<BaseFloat> feat(*feats, i);
+      GetFrame(frames[i], &feat);
+    }
+  }
+
+  /// This tells the object that the caller will not ask for frames before
+  /// "frame" any more, e.g. because an online decoder has moved past them, so
+  /// any storage for them can be freed.  Classes that compute their output
+  /// from other OnlineFeatureInterface objects pass it on (adjusted for their
+  /// context) where that is safe.  It is only a hint: asking for an earlier
+  /// frame afterwards still works, but may require recomputation.
+  virtual void ReleaseFramesBefore(int32 frame) { }
+
   /// Virtual destructor.  Note: constructors that take another member of
   /// type OnlineFeatureInterface are not expected to take ownership of
   /// that pointer; the caller needs to keep track of that manually.
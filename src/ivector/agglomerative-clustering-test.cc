@@ -0,0 +1,101 @@
+// ivector/agglomerative-clustering-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+
+#include "ivector/agglomerative-clustering.h"
+
+namespace kaldi {
+
+// A simple O(N^3) version of AgglomerativeCluster(), which recomputes the
+// average-linkage cost of every pair of clusters before each merge.
+void AgglomerativeClusterSimple(const MatrixBase<BaseFloat> &costs,
+                                BaseFloat threshold,
+                                int32 min_clusters,
+                                std::vector<int32> *assignments_out) {
+  int32 num_points = costs.NumRows();
+  std::vector<std::vector<int32> > clusters(num_points);
+  for (int32 i = 0; i < num_points; i++)
+    clusters[i].push_back(i);
+  while (static_cast<int32>(clusters.size()) > min_clusters) {
+    double best_cost = 0.0;
+    int32 best_i = -1, best_j = -1;
+    for (size_t i = 0; i < clusters.size(); i++) {
+      for (size_t j = 0; j < i; j++) {
+        double cost = 0.0;
+        for (size_t m = 0; m < clusters[i].size(); m++)
+          for (size_t n = 0; n < clusters[j].size(); n++)
+            cost += 0.5 * (costs(clusters[i][m], clusters[j][n]) +
+                           costs(clusters[j][n], clusters[i][m]));
+        cost /= clusters[i].size() * clusters[j].size();
+        if (best_i < 0 || cost < best_cost) {
+          best_cost = cost;
+          best_i = i;
+          best_j = j;
+        }
+      }
+    }
+    if (best_cost > threshold)
+      break;
+    clusters[best_j].insert(clusters[best_j].end(), clusters[best_i].begin(),
+                            clusters[best_i].end());
+    clusters.erase(clusters.begin() + best_i);
+  }
+  assignments_out->resize(num_points);
+  for (size_t c = 0; c < clusters.size(); c++)
+    for (size_t n = 0; n < clusters[c].size(); n++)
+      (*assignments_out)[clusters[c][n]] = c;
+}
+
+void UnitTestAgglomerativeCluster() {
+  int32 num_points = 1 + Rand() % 30, dim = 1 + Rand() % 3;
+  // The costs are distances between random points, plus some noise so that
+  // they're not symmetric.
+  Matrix<BaseFloat> points(num_points, dim), costs(num_points, num_points);
+  points.SetRandn();
+  for (int32 i = 0; i < num_points; i++) {
+    for (int32 j = 0; j < num_points; j++) {
+      Vector<BaseFloat> diff(points.Row(i));
+      diff.AddVec(-1.0, points.Row(j));
+      costs(i, j) = diff.Norm(2.0) + 0.1 * RandUniform();
+    }
+  }
+  int32 min_clusters = 1 + Rand() % 5;
+  BaseFloat threshold = (Rand() % 2 == 0 ? 1.0e+10 : RandUniform() * 2.0);
+  std::vector<int32> assignments, assignments_simple;
+  AgglomerativeCluster(costs, threshold, min_clusters, &assignments);
+  AgglomerativeClusterSimple(costs, threshold, min_clusters,
+                             &assignments_simple);
+  KALDI_ASSERT(assignments == assignments_simple);
+  int32 num_clusters = 1 + *std::max_element(assignments.begin(),
+                                             assignments.end());
+  KALDI_ASSERT(num_clusters >= std::min(min_clusters, num_points));
+  if (threshold > 1.0e+09)
+    KALDI_ASSERT(num_clusters == std::min(min_clusters, num_points));
+}
+
+}  // end namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 100; i++)
+    UnitTestAgglomerativeCluster();
+  std::cout << "Test OK.\n";
+  return 0;
+}
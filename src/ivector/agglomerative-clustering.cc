@@ -0,0 +1,108 @@
+// ivector/agglomerative-clustering.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <functional>
+#include <queue>
+#include <utility>
+
+#include "ivector/agglomerative-clustering.h"
+
+namespace kaldi {
+
+void AgglomerativeCluster(const MatrixBase<BaseFloat> &costs,
+                          BaseFloat threshold,
+                          int32 min_clusters,
+                          std::vector<int32> *assignments_out) {
+  int32 num_points = costs.NumRows();
+  KALDI_ASSERT(costs.NumCols() == num_points && min_clusters > 0);
+  // cluster_costs(i, j) is the average cost between the points of clusters i
+  // and j, where a cluster is numbered by one of its points; we only use
+  // elements with i > j.
+  Matrix<double> cluster_costs(costs);
+  {
+    Matrix<double> costs_trans(costs, kTrans);
+    cluster_costs.AddMat(1.0, costs_trans);
+    cluster_costs.Scale(0.5);
+  }
+  // cluster_points[i] is the list of points in cluster i, which is empty if
+  // cluster i has been merged into another cluster.
+  std::vector<std::vector<int32> > cluster_points(num_points);
+  for (int32 i = 0; i < num_points; i++)
+    cluster_points[i].push_back(i);
+
+  // The queue contains (cost, (i, j)) with i > j, lowest cost first.  An
+  // element is stale if either cluster has been merged, or if the cost has
+  // been updated since.
+  typedef std::pair<double, std::pair<int32, int32> > QueueElement;
+  std::priority_queue<QueueElement, std::vector<QueueElement>,
+                      std::greater<QueueElement> > queue;
+  for (int32 i = 0; i < num_points; i++)
+    for (int32 j = 0; j < i; j++)
+      queue.push(std::make_pair(cluster_costs(i, j), std::make_pair(i, j)));
+
+  int32 num_clusters = num_points;
+  while (num_clusters > min_clusters && !queue.empty()) {
+    QueueElement elem = queue.top();
+    queue.pop();
+    double cost = elem.first;
+    int32 i = elem.second.first, j = elem.second.second;
+    if (cluster_points[i].empty() || cluster_points[j].empty() ||
+        cluster_costs(i, j) != cost)
+      continue;  // stale element.
+    if (cost > threshold)
+      break;
+    // Merge cluster i into cluster j, and update the costs between j and the
+    // other clusters.
+    double size_i = cluster_points[i].size(),
+        size_j = cluster_points[j].size(),
+        scale_i = size_i / (size_i + size_j),
+        scale_j = size_j / (size_i + size_j);
+    for (int32 k = 0; k < num_points; k++) {
+      if (k == i || k == j || cluster_points[k].empty())
+        continue;
+      double cost_ik = (i > k ? cluster_costs(i, k) : cluster_costs(k, i)),
+          &cost_jk = (j > k ? cluster_costs(j, k) : cluster_costs(k, j));
+      cost_jk = scale_i * cost_ik + scale_j * cost_jk;
+      if (j > k)
+        queue.push(std::make_pair(cost_jk, std::make_pair(j, k)));
+      else
+        queue.push(std::make_pair(cost_jk, std::make_pair(k, j)));
+    }
+    cluster_points[j].insert(cluster_points[j].end(),
+                             cluster_points[i].begin(),
+                             cluster_points[i].end());
+    std::vector<int32>().swap(cluster_points[i]);
+    num_clusters--;
+  }
+
+  // Since cluster j absorbs cluster i > j, each cluster is numbered by its
+  // lowest-numbered point, so this numbers the clusters in that order.
+  assignments_out->resize(num_points);
+  int32 cluster_index = 0;
+  for (int32 j = 0; j < num_points; j++) {
+    const std::vector<int32> &points = cluster_points[j];
+    if (points.empty())
+      continue;
+    for (size_t n = 0; n < points.size(); n++)
+      (*assignments_out)[points[n]] = cluster_index;
+    cluster_index++;
+  }
+}
+
+}  // end namespace kaldi
@@ -0,0 +1,52 @@
+// ivector/agglomerative-clustering.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_IVECTOR_AGGLOMERATIVE_CLUSTERING_H_
+#define KALDI_IVECTOR_AGGLOMERATIVE_CLUSTERING_H_
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "matrix/matrix-lib.h"
+
+namespace kaldi {
+
+/// Does bottom-up (agglomerative) clustering of points with average linkage,
+/// given the matrix "costs" of pairwise costs (lower means more similar; e.g.
+/// negated PLDA scores).  "costs" must be square; it is symmetrized as
+/// 0.5 * (costs + costs^T) and the diagonal is ignored.  We repeatedly merge
+/// the pair of clusters with the lowest cost, where the cost between two
+/// clusters is the average of the pairwise costs between their points, until
+/// there are min_clusters clusters or the lowest cost exceeds "threshold".
+///
+/// The cluster costs are kept in a matrix and updated when clusters are merged
+/// (this is exact for average linkage), and the candidate merges are in a
+/// priority queue whose stale elements are discarded lazily, so this takes
+/// O(N^2 log N) time for N points rather than O(N^3) for the naive algorithm.
+///
+/// On exit, (*assignments_out)[n] is the cluster of point n; clusters are
+/// numbered 0, 1, ... in order of their lowest-numbered points.
+void AgglomerativeCluster(const MatrixBase<BaseFloat> &costs,
+                          BaseFloat threshold,
+                          int32 min_clusters,
+                          std::vector<int32> *assignments_out);
+
+}  // end namespace kaldi
+
+#endif  // KALDI_IVECTOR_AGGLOMERATIVE_CLUSTERING_H_
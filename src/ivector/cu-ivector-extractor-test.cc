@@ -0,0 +1,231 @@
+// ivector/cu-ivector-extractor-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gmm/model-test-common.h"
+#include "gmm/full-gmm-normal.h"
+#include "ivector/cu-ivector-extractor.h"
+#include "cudamatrix/cu-device.h"
+
+namespace kaldi {
+
+// Checks CuIvectorExtractor::GetIvectors() against
+// IvectorExtractor::GetIvectorDistribution().
+void UnitTestCuIvectorExtractor() {
+  FullGmm fgmm;
+  int32 dim = 5 + Rand() % 5, num_comp = 1 + Rand() % 5;
+  unittest::InitRandFullGmm(dim, num_comp, &fgmm);
+  FullGmmNormal fgmm_normal(fgmm);
+
+  IvectorExtractorOptions ivector_opts;
+  ivector_opts.ivector_dim = dim + 5;
+  ivector_opts.use_weights = (Rand() % 2 == 0);
+  IvectorExtractor extractor(ivector_opts, fgmm);
+  // The projections M_i are initialized randomly, so there's no need to
+  // train the model for this test.
+  int32 num_utts = 1 + Rand() % 10;
+  std::vector<Matrix<BaseFloat> > all_feats(num_utts);
+  for (int32 utt = 0; utt < num_utts; utt++) {
+    all_feats[utt].Resize(10 + Rand() % 200, dim);
+    fgmm_normal.Rand(&all_feats[utt]);
+  }
+
+  std::vector<IvectorExtractorUtteranceStats*> utt_stats(num_utts);
+  std::vector<const IvectorExtractorUtteranceStats*> utt_stats_const(num_utts);
+  for (int32 utt = 0; utt < num_utts; utt++) {
+    const Matrix<BaseFloat> &feats = all_feats[utt];
+    Posterior post(feats.NumRows());
+    for (int32 t = 0; t < feats.NumRows(); t++) {
+      Vector<BaseFloat> posterior(fgmm.NumGauss(), kUndefined);
+      fgmm.ComponentPosteriors(feats.Row(t), &posterior);
+      for (int32 i = 0; i < posterior.Dim(); i++)
+        post[t].push_back(std::make_pair(i, posterior(i)));
+    }
+    utt_stats[utt] = new IvectorExtractorUtteranceStats(
+        extractor.NumGauss(), extractor.FeatDim(), false);
+    utt_stats[utt]->AccStats(feats, post);
+    utt_stats_const[utt] = utt_stats[utt];
+  }
+
+  CuIvectorExtractor cu_extractor(extractor);
+  Matrix<double> ivectors(num_utts, extractor.IvectorDim());
+  cu_extractor.GetIvectors(utt_stats_const, &ivectors);
+  for (int32 utt = 0; utt < num_utts; utt++) {
+    Vector<double> ivector(extractor.IvectorDim());
+    extractor.GetIvectorDistribution(*(utt_stats[utt]), &ivector, NULL);
+    KALDI_ASSERT(ivector.ApproxEqual(ivectors.Row(utt), 1.0e-05));
+    delete utt_stats[utt];
+  }
+}
+
+// Reads the stats written by IvectorExtractorStats::Write() from "is" (in text
+// mode) and checks that they're the same as the ones in "is_ref", within a
+// tolerance.  We go through the written form because the members are not
+// accessible, and this also checks that the format is the same.
+void CompareIvectorExtractorStats(std::istream &is, std::istream &is_ref) {
+  bool binary = false;
+  double tol = 1.0e-04;
+  ExpectToken(is, binary, "<IvectorExtractorStats>");
+  ExpectToken(is_ref, binary, "<IvectorExtractorStats>");
+  ExpectToken(is, binary, "<TotAuxf>");
+  ExpectToken(is_ref, binary, "<TotAuxf>");
+  double tot_auxf, tot_auxf_ref;
+  ReadBasicType(is, binary, &tot_auxf);
+  ReadBasicType(is_ref, binary, &tot_auxf_ref);
+  KALDI_ASSERT(ApproxEqual(tot_auxf, tot_auxf_ref, tol));
+  ExpectToken(is, binary, "<gamma>");
+  ExpectToken(is_ref, binary, "<gamma>");
+  Vector<double> gamma, gamma_ref;
+  gamma.Read(is, binary);
+  gamma_ref.Read(is_ref, binary);
+  KALDI_ASSERT(gamma.ApproxEqual(gamma_ref, tol));
+  ExpectToken(is, binary, "<Y>");
+  ExpectToken(is_ref, binary, "<Y>");
+  int32 size, size_ref;
+  ReadBasicType(is, binary, &size);
+  ReadBasicType(is_ref, binary, &size_ref);
+  KALDI_ASSERT(size == size_ref);
+  for (int32 i = 0; i < size; i++) {
+    Matrix<double> Y, Y_ref;
+    Y.Read(is, binary);
+    Y_ref.Read(is_ref, binary);
+    KALDI_ASSERT(Y.ApproxEqual(Y_ref, tol));
+  }
+  const char *mat_tokens[] = { "<R>", "<Q>", "<G>" };
+  for (int32 j = 0; j < 3; j++) {
+    ExpectToken(is, binary, mat_tokens[j]);
+    ExpectToken(is_ref, binary, mat_tokens[j]);
+    Matrix<double> mat, mat_ref;
+    mat.Read(is, binary);
+    mat_ref.Read(is_ref, binary);
+    KALDI_ASSERT(mat.ApproxEqual(mat_ref, tol));
+  }
+  ExpectToken(is, binary, "<S>");
+  ExpectToken(is_ref, binary, "<S>");
+  ReadBasicType(is, binary, &size);
+  ReadBasicType(is_ref, binary, &size_ref);
+  KALDI_ASSERT(size == size_ref);
+  for (int32 i = 0; i < size; i++) {
+    SpMatrix<double> S, S_ref;
+    S.Read(is, binary);
+    S_ref.Read(is_ref, binary);
+    KALDI_ASSERT(S.ApproxEqual(S_ref, tol));
+  }
+  ExpectToken(is, binary, "<NumIvectors>");
+  ExpectToken(is_ref, binary, "<NumIvectors>");
+  double num_ivectors, num_ivectors_ref;
+  ReadBasicType(is, binary, &num_ivectors);
+  ReadBasicType(is_ref, binary, &num_ivectors_ref);
+  KALDI_ASSERT(num_ivectors == num_ivectors_ref);
+  ExpectToken(is, binary, "<IvectorSum>");
+  ExpectToken(is_ref, binary, "<IvectorSum>");
+  Vector<double> ivector_sum, ivector_sum_ref;
+  ivector_sum.Read(is, binary);
+  ivector_sum_ref.Read(is_ref, binary);
+  KALDI_ASSERT(ivector_sum.ApproxEqual(ivector_sum_ref, tol));
+  ExpectToken(is, binary, "<IvectorScatter>");
+  ExpectToken(is_ref, binary, "<IvectorScatter>");
+  SpMatrix<double> ivector_scatter, ivector_scatter_ref;
+  ivector_scatter.Read(is, binary);
+  ivector_scatter_ref.Read(is_ref, binary);
+  KALDI_ASSERT(ivector_scatter.ApproxEqual(ivector_scatter_ref, tol));
+}
+
+// Checks CuIvectorExtractorStats against
+// IvectorExtractorStats::AccStatsForUtterance().
+void UnitTestCuIvectorExtractorStats() {
+  FullGmm fgmm;
+  int32 dim = 5 + Rand() % 5, num_comp = 1 + Rand() % 5;
+  unittest::InitRandFullGmm(dim, num_comp, &fgmm);
+  FullGmmNormal fgmm_normal(fgmm);
+
+  IvectorExtractorOptions ivector_opts;
+  ivector_opts.ivector_dim = dim + 5;
+  ivector_opts.use_weights = false;
+  IvectorExtractor extractor(ivector_opts, fgmm);
+  CuIvectorExtractor cu_extractor(extractor);
+
+  IvectorExtractorStatsOptions stats_opts;
+  stats_opts.update_variances = (Rand() % 2 == 0);
+  IvectorExtractorStats stats(extractor, stats_opts),
+      stats_ref(extractor, stats_opts);
+  {
+    CuIvectorExtractorStats cu_stats(cu_extractor, &stats);
+    int32 num_batches = 1 + Rand() % 3;
+    for (int32 b = 0; b < num_batches; b++) {
+      int32 num_utts = 1 + Rand() % 5;
+      std::vector<IvectorExtractorUtteranceStats*> utt_stats(num_utts);
+      std::vector<const IvectorExtractorUtteranceStats*> utt_stats_const(
+          num_utts);
+      for (int32 utt = 0; utt < num_utts; utt++) {
+        Matrix<BaseFloat> feats(10 + Rand() % 200, dim);
+        fgmm_normal.Rand(&feats);
+        Posterior post(feats.NumRows());
+        for (int32 t = 0; t < feats.NumRows(); t++) {
+          Vector<BaseFloat> posterior(fgmm.NumGauss(), kUndefined);
+          fgmm.ComponentPosteriors(feats.Row(t), &posterior);
+          for (int32 i = 0; i < posterior.Dim(); i++)
+            post[t].push_back(std::make_pair(i, posterior(i)));
+        }
+        stats_ref.AccStatsForUtterance(extractor, feats, post);
+        utt_stats[utt] = new IvectorExtractorUtteranceStats(
+            extractor.NumGauss(), extractor.FeatDim(),
+            stats_opts.update_variances);
+        utt_stats[utt]->AccStats(feats, post);
+        utt_stats_const[utt] = utt_stats[utt];
+      }
+      cu_stats.AccStatsForUtterances(utt_stats_const);
+      if (Rand() % 2 == 0)
+        cu_stats.Flush();
+      for (int32 utt = 0; utt < num_utts; utt++)
+        delete utt_stats[utt];
+    }
+    // The destructor of cu_stats flushes the remaining stats.
+  }
+  std::ostringstream os, os_ref;
+  stats.Write(os, false);
+  stats_ref.Write(os_ref, false);
+  std::istringstream is(os.str()), is_ref(os_ref.str());
+  CompareIvectorExtractorStats(is, is_ref);
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 loop = 0; loop < 2; loop++) {
+#if HAVE_CUDA == 1
+    if (loop == 0)
+      CuDevice::Instantiate().SelectGpuId("no");
+    else
+      CuDevice::Instantiate().SelectGpuId("yes");
+#endif
+    for (int32 i = 0; i < 5; i++) {
+      UnitTestCuIvectorExtractor();
+      UnitTestCuIvectorExtractorStats();
+    }
+    if (loop == 0)
+      KALDI_LOG << "Tests without GPU use succeeded.";
+    else
+      KALDI_LOG << "Tests with GPU use (if available) succeeded.";
+  }
+#if HAVE_CUDA == 1
+  CuDevice::Instantiate().PrintProfile();
+#endif
+  return 0;
+}
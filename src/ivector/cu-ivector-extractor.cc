@@ -0,0 +1,233 @@
+// ivector/cu-ivector-extractor.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <vector>
+
+#include "ivector/cu-ivector-extractor.h"
+
+namespace kaldi {
+
+CuIvectorExtractor::CuIvectorExtractor(const IvectorExtractor &extractor):
+    extractor_(extractor) {
+  if (extractor.IvectorDependentWeights())
+    return;  // GetIvectors() won't need the stacked parameters.
+  int32 num_gauss = extractor.NumGauss(), feat_dim = extractor.FeatDim(),
+      ivector_dim = extractor.IvectorDim();
+  Matrix<double> sigma_inv_m(num_gauss * feat_dim, ivector_dim, kUndefined);
+  for (int32 i = 0; i < num_gauss; i++)
+    sigma_inv_m.RowRange(i * feat_dim, feat_dim).CopyFromMat(
+        extractor.Sigma_inv_M_[i]);
+  sigma_inv_m_.Swap(&sigma_inv_m);
+  Matrix<double> u(extractor.U_);
+  u_.Swap(&u);
+}
+
+int32 CuIvectorExtractor::BlockSize() const {
+  // We do blocks of utterances so that the stacked first-order stats take at
+  // most about 64MB.
+  return std::max<int32>(1, (1 << 23) /
+                         (extractor_.NumGauss() * extractor_.FeatDim()));
+}
+
+void CuIvectorExtractor::GetDistMeanTerms(
+    const std::vector<const IvectorExtractorUtteranceStats*> &utt_stats,
+    int32 start, int32 n,
+    CuMatrix<double> *gamma, CuMatrix<double> *X,
+    Matrix<double> *linear, Matrix<double> *quadratic) const {
+  int32 num_gauss = extractor_.NumGauss(), feat_dim = extractor_.FeatDim(),
+      ivector_dim = extractor_.IvectorDim();
+  KALDI_ASSERT(start >= 0 && n > 0 &&
+               start + n <= static_cast<int32>(utt_stats.size()));
+  Matrix<double> gamma_cpu(n, num_gauss, kUndefined),
+      X_cpu(n, num_gauss * feat_dim, kUndefined);
+  for (int32 k = 0; k < n; k++) {
+    const IvectorExtractorUtteranceStats &stats = *(utt_stats[start + k]);
+    KALDI_ASSERT(stats.gamma_.Dim() == num_gauss &&
+                 stats.X_.NumCols() == feat_dim);
+    gamma_cpu.Row(k).CopyFromVec(stats.gamma_);
+    X_cpu.Row(k).CopyRowsFromMat(stats.X_);
+  }
+  gamma->Swap(&gamma_cpu);
+  X->Swap(&X_cpu);
+  CuMatrix<double> cu_linear(n, ivector_dim, kUndefined),
+      cu_quadratic(n, ivector_dim * (ivector_dim + 1) / 2, kUndefined);
+  // As in IvectorExtractor::GetIvectorDistMean(), for all utterances at once.
+  cu_linear.AddMatMat(1.0, *X, kNoTrans, sigma_inv_m_, kNoTrans, 0.0);
+  cu_quadratic.AddMatMat(1.0, *gamma, kNoTrans, u_, kNoTrans, 0.0);
+  linear->Resize(0, 0);
+  cu_linear.Swap(linear);
+  quadratic->Resize(0, 0);
+  cu_quadratic.Swap(quadratic);
+}
+
+void CuIvectorExtractor::GetIvectors(
+    const std::vector<const IvectorExtractorUtteranceStats*> &utt_stats,
+    MatrixBase<double> *ivectors) const {
+  int32 num_utts = utt_stats.size(), ivector_dim = extractor_.IvectorDim();
+  KALDI_ASSERT(ivectors->NumRows() == num_utts &&
+               ivectors->NumCols() == ivector_dim);
+  if (extractor_.IvectorDependentWeights()) {
+    for (int32 n = 0; n < num_utts; n++) {
+      SubVector<double> ivector(*ivectors, n);
+      extractor_.GetIvectorDistribution(*(utt_stats[n]), &ivector, NULL);
+    }
+    return;
+  }
+  int32 packed_dim = ivector_dim * (ivector_dim + 1) / 2,
+      block_size = BlockSize();
+  for (int32 start = 0; start < num_utts; start += block_size) {
+    int32 n = std::min(block_size, num_utts - start);
+    CuMatrix<double> gamma, X;
+    Matrix<double> linear, quadratic;
+    GetDistMeanTerms(utt_stats, start, n, &gamma, &X, &linear, &quadratic);
+
+    SpMatrix<double> this_quadratic(ivector_dim, kUndefined);
+    TpMatrix<double> cholesky(ivector_dim, kUndefined);
+    SubVector<double> this_quadratic_vec(this_quadratic.Data(), packed_dim);
+    for (int32 k = 0; k < n; k++) {
+      this_quadratic_vec.CopyFromVec(quadratic.Row(k));
+      SubVector<double> ivector(*ivectors, start + k);
+      ivector.CopyFromVec(linear.Row(k));
+      // The prior, as in IvectorExtractor::GetIvectorDistPrior().
+      ivector(0) += extractor_.PriorOffset();
+      this_quadratic.AddToDiag(1.0);
+      // quadratic = C C^T, so ivector = C^{-T} C^{-1} linear.
+      cholesky.Cholesky(this_quadratic);
+      ivector.Solve(cholesky, kNoTrans);
+      ivector.Solve(cholesky, kTrans);
+    }
+  }
+}
+
+CuIvectorExtractorStats::CuIvectorExtractorStats(
+    const CuIvectorExtractor &cu_extractor,
+    IvectorExtractorStats *stats):
+    cu_extractor_(cu_extractor), extractor_(cu_extractor.extractor_),
+    stats_(stats) {
+  stats->CheckDims(extractor_);
+  if (extractor_.IvectorDependentWeights())
+    return;  // we'll use stats->CommitStatsForUtterance().
+  int32 num_gauss = extractor_.NumGauss(), feat_dim = extractor_.FeatDim(),
+      ivector_dim = extractor_.IvectorDim();
+  gamma_.Resize(num_gauss);
+  Y_.Resize(num_gauss * feat_dim, ivector_dim);
+  R_.Resize(num_gauss, ivector_dim * (ivector_dim + 1) / 2);
+}
+
+void CuIvectorExtractorStats::AccStatsForUtterances(
+    const std::vector<const IvectorExtractorUtteranceStats*> &utt_stats) {
+  int32 num_utts = utt_stats.size();
+  bool update_variances = !stats_->S_.empty();
+  for (int32 n = 0; n < num_utts; n++)
+    KALDI_ASSERT(utt_stats[n]->S_.empty() != update_variances);
+  if (extractor_.IvectorDependentWeights()) {
+    for (int32 n = 0; n < num_utts; n++)
+      stats_->CommitStatsForUtterance(extractor_, *(utt_stats[n]));
+    return;
+  }
+  int32 ivector_dim = extractor_.IvectorDim(),
+      num_gauss = extractor_.NumGauss(), feat_dim = extractor_.FeatDim(),
+      packed_dim = ivector_dim * (ivector_dim + 1) / 2,
+      block_size = cu_extractor_.BlockSize();
+  for (int32 start = 0; start < num_utts; start += block_size) {
+    int32 n = std::min(block_size, num_utts - start);
+    CuMatrix<double> gamma, X;
+    Matrix<double> linear, quadratic;
+    cu_extractor_.GetDistMeanTerms(utt_stats, start, n, &gamma, &X,
+                                   &linear, &quadratic);
+    // ivec_means and ivec_scatters are the means and the (packed) second-order
+    // moments of the iVector distributions.
+    Matrix<double> ivec_means(n, ivector_dim, kUndefined),
+        ivec_scatters(n, packed_dim, kUndefined);
+    SpMatrix<double> ivec_var(ivector_dim, kUndefined);
+    SubVector<double> ivec_var_vec(ivec_var.Data(), packed_dim);
+    Vector<double> this_linear(ivector_dim, kUndefined);
+    for (int32 k = 0; k < n; k++) {
+      const IvectorExtractorUtteranceStats &this_stats = *(utt_stats[start + k]);
+      // The rest is as in IvectorExtractor::GetIvectorDistribution() and
+      // IvectorExtractorStats::CommitStatsForUtterance().
+      ivec_var_vec.CopyFromVec(quadratic.Row(k));
+      ivec_var.AddToDiag(1.0);
+      ivec_var.Invert();
+      this_linear.CopyFromVec(linear.Row(k));
+      this_linear(0) += extractor_.PriorOffset();
+      SubVector<double> ivec_mean(ivec_means, k);
+      ivec_mean.AddSpVec(1.0, ivec_var, this_linear, 0.0);
+
+      if (stats_->config_.compute_auxf) {
+        // This is IvectorExtractor::GetAuxf(), except that we already have the
+        // terms of GetAcousticAuxfMean() that involve the projections.
+        double K = 0.0;
+        Vector<double> x(feat_dim), temp(feat_dim);
+        for (int32 i = 0; i < num_gauss; i++) {
+          double gamma_i = this_stats.gamma_(i);
+          if (gamma_i != 0.0) {
+            x.CopyFromVec(this_stats.X_.Row(i));
+            temp.AddSpVec(1.0 / gamma_i, extractor_.Sigma_inv_[i], x, 0.0);
+            K += -0.5 * VecVec(x, temp);
+          }
+        }
+        SpMatrix<double> B(ivector_dim, kUndefined);
+        SubVector<double> B_vec(B.Data(), packed_dim);
+        B_vec.CopyFromVec(quadratic.Row(k));
+        double mean_auxf = K + VecVec(ivec_mean, linear.Row(k)) -
+            0.5 * VecSpVec(ivec_mean, B, ivec_mean) -
+            0.5 * TraceSpSp(ivec_var, B);
+        stats_->tot_auxf_ +=
+            extractor_.GetAcousticAuxfWeight(this_stats, ivec_mean, &ivec_var) +
+            extractor_.GetAcousticAuxfGconst(this_stats) + mean_auxf +
+            extractor_.GetAcousticAuxfVariance(this_stats) +
+            extractor_.GetPriorAuxf(ivec_mean, &ivec_var);
+      }
+      stats_->CommitStatsForPrior(ivec_mean, ivec_var);
+      if (update_variances)
+        stats_->CommitStatsForSigma(extractor_, this_stats);
+      ivec_var.AddVec2(1.0, ivec_mean);
+      ivec_scatters.Row(k).CopyFromVec(ivec_var_vec);
+    }
+    // As in IvectorExtractorStats::CommitStatsForM(), for all utterances at
+    // once.
+    CuMatrix<double> cu_ivec_means(ivec_means), cu_ivec_scatters(ivec_scatters);
+    gamma_.AddRowSumMat(1.0, gamma, 1.0);
+    Y_.AddMatMat(1.0, X, kTrans, cu_ivec_means, kNoTrans, 1.0);
+    R_.AddMatMat(1.0, gamma, kTrans, cu_ivec_scatters, kNoTrans, 1.0);
+  }
+}
+
+void CuIvectorExtractorStats::Flush() {
+  if (gamma_.Dim() == 0 || gamma_.Sum() == 0.0)
+    return;
+  int32 num_gauss = extractor_.NumGauss(), feat_dim = extractor_.FeatDim();
+  Vector<double> gamma(gamma_);
+  Matrix<double> Y(Y_), R(R_);
+  stats_->gamma_Y_lock_.Lock();
+  stats_->gamma_.AddVec(1.0, gamma);
+  for (int32 i = 0; i < num_gauss; i++)
+    stats_->Y_[i].AddMat(1.0, Y.RowRange(i * feat_dim, feat_dim));
+  stats_->gamma_Y_lock_.Unlock();
+  stats_->R_lock_.Lock();
+  stats_->R_.AddMat(1.0, R);
+  stats_->R_lock_.Unlock();
+  gamma_.SetZero();
+  Y_.SetZero();
+  R_.SetZero();
+}
+
+}  // namespace kaldi
@@ -0,0 +1,141 @@
+// ivector/cu-ivector-extractor.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_IVECTOR_CU_IVECTOR_EXTRACTOR_H_
+#define KALDI_IVECTOR_CU_IVECTOR_EXTRACTOR_H_
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "ivector/ivector-extractor.h"
+#include "cudamatrix/cu-matrix.h"
+#include "cudamatrix/cu-vector.h"
+
+namespace kaldi {
+
+/// CuIvectorExtractor holds a copy of the quantities M_i^T \Sigma_i^{-1} and
+/// U_i of an IvectorExtractor as CuMatrix objects, i.e. on the GPU if one was
+/// selected, and computes the iVectors of a batch of utterances at a time.  The
+/// linear and quadratic terms of the iVector distributions of all the
+/// utterances in the batch are each one matrix multiplication (against the
+/// stacked first-order stats and the zeroth-order stats respectively), and the
+/// iVectors are then obtained with a Cholesky solve per utterance (on the CPU;
+/// this is a small part of the work).
+///
+/// This gives the same answer as IvectorExtractor::GetIvectorDistribution()
+/// (the mean only).  If the extractor has iVector-dependent weights the
+/// estimation is iterative and nonlinear, and we just call
+/// GetIvectorDistribution() for each utterance.  The extractor is referenced,
+/// not copied, so it must not be changed or destroyed while this object
+/// exists.
+class CuIvectorExtractor {
+ public:
+  explicit CuIvectorExtractor(const IvectorExtractor &extractor);
+
+  /// Sets row n of "ivectors" (which must have utt_stats.size() rows and
+  /// IvectorDim() columns) to the iVector of utt_stats[n], including the prior
+  /// offset, as for the "mean" output of GetIvectorDistribution().
+  void GetIvectors(
+      const std::vector<const IvectorExtractorUtteranceStats*> &utt_stats,
+      MatrixBase<double> *ivectors) const;
+
+  int32 IvectorDim() const { return extractor_.IvectorDim(); }
+
+ private:
+  friend class CuIvectorExtractorStats;
+
+  /// Returns the number of utterances we process at a time.
+  int32 BlockSize() const;
+
+  /// Stacks the zeroth- and first-order stats of utterances
+  /// utt_stats[start] ... utt_stats[start + n - 1] as the rows of "gamma" and
+  /// "X", and sets the rows of "linear" and "quadratic" (packed) to the terms in
+  /// their iVector distributions that arise from the means, as in
+  /// IvectorExtractor::GetIvectorDistMean().  The outputs are resized.
+  void GetDistMeanTerms(
+      const std::vector<const IvectorExtractorUtteranceStats*> &utt_stats,
+      int32 start, int32 n,
+      CuMatrix<double> *gamma, CuMatrix<double> *X,
+      Matrix<double> *linear, Matrix<double> *quadratic) const;
+
+  const IvectorExtractor &extractor_;
+  /// Row (i * FeatDim() + d) is row d of \Sigma_i^{-1} M_i; dimension is
+  /// [I * D][S].  Empty if using iVector-dependent weights.
+  CuMatrix<double> sigma_inv_m_;
+  /// U_i in packed format, as IvectorExtractor::U_; dimension is
+  /// [I][S * (S + 1) / 2].
+  CuMatrix<double> u_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(CuIvectorExtractor);
+};
+
+
+/// CuIvectorExtractorStats accumulates the stats for training an
+/// IvectorExtractor (i.e. for IvectorExtractorStats) for batches of utterances
+/// at a time.  The stats whose accumulation dominates the time, i.e. gamma_,
+/// the linear term Y_ of the projections and the quadratic term R_, are kept
+/// in CuMatrix objects (on the GPU, if one was selected) and accumulated with
+/// one matrix multiplication per batch; they are added to the
+/// IvectorExtractorStats object by Flush(), which the destructor calls.  The
+/// other stats (prior, variances and auxf) are cheap and are committed directly
+/// to the IvectorExtractorStats object.  The posterior covariances of the
+/// iVectors are obtained by inverting an [S][S] matrix per utterance on the
+/// CPU.
+///
+/// The result is the same as calling
+/// IvectorExtractorStats::AccStatsForUtterance() for each utterance.  If the
+/// extractor has iVector-dependent weights we do just that (the estimation of
+/// the iVectors is iterative, and there are extra stats that have to be
+/// accumulated per sample).
+///
+/// This class is not thread-safe, but accumulating to the
+/// IvectorExtractorStats object from other threads at the same time is OK.
+class CuIvectorExtractorStats {
+ public:
+  /// The stats will be added to "stats", which must have been initialized
+  /// with the same extractor that "cu_extractor" was constructed from.
+  CuIvectorExtractorStats(const CuIvectorExtractor &cu_extractor,
+                          IvectorExtractorStats *stats);
+
+  /// Accumulates the stats for a batch of utterances.  If the variances are
+  /// being updated (i.e. the IvectorExtractorStats object was initialized with
+  /// --update-variances=true), utt_stats must have the second-order stats.
+  void AccStatsForUtterances(
+      const std::vector<const IvectorExtractorUtteranceStats*> &utt_stats);
+
+  /// Adds the stats accumulated so far into the IvectorExtractorStats object.
+  void Flush();
+
+  ~CuIvectorExtractorStats() { Flush(); }
+
+ private:
+  const CuIvectorExtractor &cu_extractor_;
+  const IvectorExtractor &extractor_;
+  IvectorExtractorStats *stats_;
+  /// Accumulators for IvectorExtractorStats::gamma_, Y_ and R_: gamma_ has
+  /// dimension [I]; Y_ is stacked, with row (i * D + d) being row d of Y_i, so
+  /// the dimension is [I * D][S]; R_ has dimension [I][S * (S + 1) / 2].
+  CuVector<double> gamma_;
+  CuMatrix<double> Y_;
+  CuMatrix<double> R_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(CuIvectorExtractorStats);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_IVECTOR_CU_IVECTOR_EXTRACTOR_H_
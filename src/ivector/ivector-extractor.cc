@@ -780,6 +780,37 @@ void IvectorExtractorUtteranceStats::AccStats(
   }
 }
 
+void IvectorExtractorUtteranceStats::AccStats(
+    const MatrixBase<BaseFloat> &feats,
+    const CompactPosterior &post) {
+  int32 num_frames = feats.NumRows(),
+      num_gauss = X_.NumRows(),
+      feat_dim = feats.NumCols();
+  KALDI_ASSERT(X_.NumCols() == feat_dim);
+  KALDI_ASSERT(feats.NumRows() == post.NumFrames());
+  bool update_variance = (!S_.empty());
+  SpMatrix<double> outer_prod(feat_dim);
+  const int32 *ids = post.Ids();
+  const BaseFloat *weights = post.Weights();
+  for (int32 t = 0; t < num_frames; t++) {
+    SubVector<BaseFloat> frame(feats, t);
+    if (update_variance) {
+      outer_prod.SetZero();
+      outer_prod.AddVec2(1.0, frame);
+    }
+    for (int32 k = post.FrameBegin(t); k < post.FrameEnd(t); k++) {
+      int32 i = ids[k]; // Gaussian index.
+      KALDI_ASSERT(i >= 0 && i < num_gauss &&
+                   "Out-of-range Gaussian (mismatched posteriors?)");
+      double weight = weights[k];
+      gamma_(i) += weight;
+      X_.Row(i).AddVec(weight, frame);
+      if (update_variance)
+        S_[i].AddSp(weight, outer_prod);
+    }
+  }
+}
+
 void IvectorExtractorUtteranceStats::Scale(double scale) {
   gamma_.Scale(scale);
   X_.Scale(scale);
@@ -91,6 +91,10 @@ class IvectorExtractorUtteranceStats {
   void AccStats(const MatrixBase<BaseFloat> &feats,
                 const Posterior &post);
 
+  /// As above, but for posteriors stored as CompactPosterior.
+  void AccStats(const MatrixBase<BaseFloat> &feats,
+                const CompactPosterior &post);
+
   void Scale(double scale); // Used to apply acoustic scale.
 
   double NumFrames() { return gamma_.Sum(); }
@@ -98,6 +102,8 @@ class IvectorExtractorUtteranceStats {
  protected:
   friend class IvectorExtractor;
   friend class IvectorExtractorStats;
+  friend class CuIvectorExtractor;
+  friend class CuIvectorExtractorStats;
   Vector<double> gamma_; // zeroth-order stats (summed posteriors), dimension [I]
   Matrix<double> X_; // first-order stats, dimension [I][D]
   std::vector<SpMatrix<double> > S_; // 2nd-order stats, dimension [I][D][D], if
@@ -137,6 +143,8 @@ class IvectorExtractor {
  public:
   friend class IvectorExtractorStats;
   friend class OnlineIvectorEstimationStats;
+  friend class CuIvectorExtractor;
+  friend class CuIvectorExtractorStats;
 
   IvectorExtractor(): prior_offset_(0.0) { }
 
@@ -474,6 +482,7 @@ class IvectorExtractorUpdateWeightClass;
 class IvectorExtractorStats {
  public:
   friend class IvectorExtractor;
+  friend class CuIvectorExtractorStats;
 
   IvectorExtractorStats(): tot_auxf_(0.0), R_num_cached_(0), num_ivectors_(0) { }
 
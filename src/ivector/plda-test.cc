@@ -89,6 +89,61 @@ void UnitTestPldaEstimation(int32 dim) {
   
 }
 
+// Checks that Plda::LogLikelihoodRatios() gives the same answer as
+// Plda::LogLikelihoodRatio().
+void UnitTestPldaLogLikelihoodRatios(int32 dim) {
+  PldaStats stats;
+  Matrix<double> between_proj(dim, dim);
+  between_proj.SetRandn();
+  for (int32 n = 0; n < 100; n++) {
+    Vector<double> class_mean(dim);
+    class_mean.SetRandn();
+    Vector<double> temp(class_mean);
+    class_mean.AddMatVec(1.0, between_proj, kNoTrans, temp, 0.0);
+    Matrix<double> egs(1 + Rand() % 10, dim);
+    egs.SetRandn();
+    egs.AddVecToRows(1.0, class_mean);
+    stats.AddSamples(1.0, egs);
+  }
+  stats.Sort();
+  PldaEstimator estimator(stats);
+  Plda plda;
+  PldaEstimationConfig estimation_config;
+  estimation_config.num_em_iters = 2;
+  estimator.Estimate(estimation_config, &plda);
+
+  PldaConfig config;
+  config.normalize_length = (Rand() % 2 == 0);
+  int32 num_train = 1 + Rand() % 5, num_test = 1 + Rand() % 5;
+  Matrix<double> train_ivectors(num_train, dim), test_ivectors(num_test, dim);
+  std::vector<int32> num_train_utts(num_train);
+  for (int32 j = 0; j < num_train; j++) {
+    Vector<double> ivector(dim);
+    ivector.SetRandn();
+    SubVector<double> transformed_ivector(train_ivectors, j);
+    plda.TransformIvector(config, ivector, &transformed_ivector);
+    num_train_utts[j] = 1 + Rand() % 10;
+  }
+  for (int32 k = 0; k < num_test; k++) {
+    Vector<double> ivector(dim);
+    ivector.SetRandn();
+    SubVector<double> transformed_ivector(test_ivectors, k);
+    plda.TransformIvector(config, ivector, &transformed_ivector);
+  }
+  Matrix<double> scores(num_train, num_test);
+  plda.LogLikelihoodRatios(train_ivectors, num_train_utts, test_ivectors,
+                           &scores);
+  for (int32 j = 0; j < num_train; j++) {
+    for (int32 k = 0; k < num_test; k++) {
+      double score = plda.LogLikelihoodRatio(train_ivectors.Row(j),
+                                             num_train_utts[j],
+                                             test_ivectors.Row(k));
+      KALDI_ASSERT(ApproxEqual(score, scores(j, k), 1.0e-06) ||
+                   fabs(score - scores(j, k)) < 1.0e-06);
+    }
+  }
+}
+
 }
 
 
@@ -110,6 +165,8 @@ int main() {
 
   // UnitTestPldaEstimation(400);
   UnitTestPldaEstimation(80);
+  for (int i = 0; i < 10; i++)
+    UnitTestPldaLogLikelihoodRatios(i + 1);
   std::cout << "Test OK.\n";
   return 0;
 }
@@ -150,6 +150,83 @@ double Plda::LogLikelihoodRatio(
 }
 
 
+/*
+   This comment explains GetTrainScoringVectors() and GetTestScoringVectors().
+   As all the covariances are diagonal, the log-likelihood ratio that
+   LogLikelihoodRatio() computes is a sum over dimensions i.  Write u for the
+   transformed test iVector, g for the transformed training iVector, n for the
+   number of training utterances, and
+     a_i = n \psi_i / (n \psi_i + 1),  v_i = 1 + \psi_i / (n \psi_i + 1),
+     w_i = 1 + \psi_i.
+   The log-likelihood ratio is
+    \sum_i -0.5 [ (u_i - a_i g_i)^2 / v_i + log v_i ] + 0.5 [ u_i^2 / w_i + log w_i ]
+    = \sum_i  u_i (a_i g_i / v_i)   +  u_i^2 (-0.5 (1/v_i - 1/w_i))
+              + 0.5 (log w_i - log v_i - a_i^2 g_i^2 / v_i)
+   which is the dot product of the test-side vector [ u, u^2, 1 ] with the
+   train-side vector [ a g / v, -0.5 (1/v - 1/w), c ], where c is the sum of
+   the last term over i.
+*/
+void Plda::GetTrainScoringVectors(
+    const MatrixBase<double> &transformed_train_ivectors,
+    const std::vector<int32> &num_train_utts,
+    MatrixBase<double> *train_vectors) const {
+  int32 dim = Dim(), num_train = transformed_train_ivectors.NumRows();
+  KALDI_ASSERT(transformed_train_ivectors.NumCols() == dim &&
+               static_cast<int32>(num_train_utts.size()) == num_train &&
+               train_vectors->NumRows() == num_train &&
+               train_vectors->NumCols() == 2 * dim + 1);
+  for (int32 j = 0; j < num_train; j++) {
+    int32 n = num_train_utts[j];
+    KALDI_ASSERT(n > 0);
+    SubVector<double> train_ivector(transformed_train_ivectors, j),
+        train_vector(*train_vectors, j);
+    double c = 0.0;
+    for (int32 i = 0; i < dim; i++) {
+      double a = n * psi_(i) / (n * psi_(i) + 1.0),
+          v = 1.0 + psi_(i) / (n * psi_(i) + 1.0),
+          w = 1.0 + psi_(i),
+          ag = a * train_ivector(i);
+      train_vector(i) = ag / v;
+      train_vector(dim + i) = -0.5 * (1.0 / v - 1.0 / w);
+      c += 0.5 * (log(w) - log(v) - ag * ag / v);
+    }
+    train_vector(2 * dim) = c;
+  }
+}
+
+void Plda::GetTestScoringVectors(
+    const MatrixBase<double> &transformed_test_ivectors,
+    MatrixBase<double> *test_vectors) const {
+  int32 dim = Dim(), num_test = transformed_test_ivectors.NumRows();
+  KALDI_ASSERT(transformed_test_ivectors.NumCols() == dim &&
+               test_vectors->NumRows() == num_test &&
+               test_vectors->NumCols() == 2 * dim + 1);
+  SubMatrix<double> linear(*test_vectors, 0, num_test, 0, dim),
+      quadratic(*test_vectors, 0, num_test, dim, dim);
+  linear.CopyFromMat(transformed_test_ivectors);
+  quadratic.CopyFromMat(transformed_test_ivectors);
+  quadratic.ApplyPow(2.0);
+  test_vectors->ColRange(2 * dim, 1).Set(1.0);
+}
+
+void Plda::LogLikelihoodRatios(
+    const MatrixBase<double> &transformed_train_ivectors,
+    const std::vector<int32> &num_train_utts,
+    const MatrixBase<double> &transformed_test_ivectors,
+    MatrixBase<double> *scores) const {
+  int32 dim = Dim(), num_train = transformed_train_ivectors.NumRows(),
+      num_test = transformed_test_ivectors.NumRows();
+  KALDI_ASSERT(scores->NumRows() == num_train &&
+               scores->NumCols() == num_test);
+  Matrix<double> train_vectors(num_train, 2 * dim + 1, kUndefined),
+      test_vectors(num_test, 2 * dim + 1, kUndefined);
+  GetTrainScoringVectors(transformed_train_ivectors, num_train_utts,
+                         &train_vectors);
+  GetTestScoringVectors(transformed_test_ivectors, &test_vectors);
+  scores->AddMatMat(1.0, train_vectors, kNoTrans, test_vectors, kTrans, 0.0);
+}
+
+
 void Plda::SmoothWithinClassCovariance(double smoothing_factor) {
   KALDI_ASSERT(smoothing_factor >= 0.0 && smoothing_factor <= 1.0);
   // smoothing_factor > 1.0 is possible but wouldn't really make sense.
@@ -100,6 +100,37 @@ class Plda {
                             int32 num_train_utts,
                             const VectorBase<double> &transformed_test_ivector);
 
+  /// This is a batched version of LogLikelihoodRatio(): it sets (*scores)(j, k)
+  /// to the log-likelihood ratio for row j of transformed_train_ivectors (an
+  /// average over num_train_utts[j] utterances) and row k of
+  /// transformed_test_ivectors.  "scores" must be of dimension
+  /// transformed_train_ivectors.NumRows() by
+  /// transformed_test_ivectors.NumRows().  It is computed as one matrix
+  /// product of the outputs of GetTrainScoringVectors() and
+  /// GetTestScoringVectors().
+  void LogLikelihoodRatios(const MatrixBase<double> &transformed_train_ivectors,
+                           const std::vector<int32> &num_train_utts,
+                           const MatrixBase<double> &transformed_test_ivectors,
+                           MatrixBase<double> *scores) const;
+
+  /// The log-likelihood ratio that LogLikelihoodRatio() computes can be written
+  /// as the dot product of a vector that depends only on the training iVector
+  /// (and the number of utterances), and a vector that depends only on the test
+  /// iVector; both are of dimension 2 * Dim() + 1.  This function sets the rows
+  /// of "train_vectors" to the former (see the comment in plda.cc for the
+  /// details).  This is for batch scoring, e.g. in blocks or on a GPU.
+  void GetTrainScoringVectors(
+      const MatrixBase<double> &transformed_train_ivectors,
+      const std::vector<int32> &num_train_utts,
+      MatrixBase<double> *train_vectors) const;
+
+  /// Sets the rows of "test_vectors" to the test-side vectors for scoring,
+  /// see GetTrainScoringVectors().  If u is a transformed test iVector the
+  /// vector is [ u, u^2, 1 ] (with the square taken elementwise).
+  void GetTestScoringVectors(
+      const MatrixBase<double> &transformed_test_ivectors,
+      MatrixBase<double> *test_vectors) const;
+
   
   /// This function smooths the within-class covariance by adding to it,
   /// smoothing_factor (e.g. 0.1) times the between-class covariance (it's
@@ -22,7 +22,9 @@
 #include "util/common-utils.h"
 #include "gmm/am-diag-gmm.h"
 #include "ivector/ivector-extractor.h"
+#include "ivector/cu-ivector-extractor.h"
 #include "thread/kaldi-task-sequence.h"
+#include "cudamatrix/cu-device.h"
 
 namespace kaldi {
 
@@ -89,6 +91,91 @@ class IvectorExtractTask {
   double auxf_change_;
 };
 
+// This is like IvectorExtractTask but it processes a batch of utterances,
+// whose iVectors are computed together by CuIvectorExtractor (this is used if
+// --batch-size > 1).
+class IvectorExtractBatchTask {
+ public:
+  IvectorExtractBatchTask(const IvectorExtractor &extractor,
+                          const CuIvectorExtractor &cu_extractor,
+                          BaseFloatVectorWriter *writer,
+                          double *tot_auxf_change):
+      extractor_(extractor), cu_extractor_(cu_extractor), writer_(writer),
+      tot_auxf_change_(tot_auxf_change) { }
+
+  void AddUtterance(const std::string &utt, const Matrix<BaseFloat> &feats,
+                    const Posterior &posterior) {
+    utts_.push_back(utt);
+    feats_.resize(feats_.size() + 1);
+    feats_.back() = feats;
+    posteriors_.push_back(posterior);
+  }
+
+  int32 NumUtterances() const { return utts_.size(); }
+
+  void operator () () {
+    int32 num_utts = utts_.size();
+    bool need_2nd_order_stats = false;
+    std::vector<IvectorExtractorUtteranceStats*> utt_stats(num_utts);
+    std::vector<const IvectorExtractorUtteranceStats*> utt_stats_const(
+        num_utts);
+    for (int32 n = 0; n < num_utts; n++) {
+      utt_stats[n] = new IvectorExtractorUtteranceStats(extractor_.NumGauss(),
+                                                        extractor_.FeatDim(),
+                                                        need_2nd_order_stats);
+      utt_stats[n]->AccStats(feats_[n], posteriors_[n]);
+      utt_stats_const[n] = utt_stats[n];
+    }
+    // Free the features now; we only need the posteriors for logging.
+    std::vector<Matrix<BaseFloat> >().swap(feats_);
+
+    ivectors_.Resize(num_utts, extractor_.IvectorDim());
+    cu_extractor_.GetIvectors(utt_stats_const, &ivectors_);
+
+    if (tot_auxf_change_ != NULL) {
+      auxf_changes_.resize(num_utts);
+      Vector<double> ivector_zero(extractor_.IvectorDim());
+      ivector_zero(0) = extractor_.PriorOffset();
+      for (int32 n = 0; n < num_utts; n++) {
+        Vector<double> ivector(ivectors_.Row(n));
+        auxf_changes_[n] = extractor_.GetAuxf(*(utt_stats[n]), ivector) -
+            extractor_.GetAuxf(*(utt_stats[n]), ivector_zero);
+      }
+    }
+    for (int32 n = 0; n < num_utts; n++)
+      delete utt_stats[n];
+  }
+
+  ~IvectorExtractBatchTask() {
+    for (size_t n = 0; n < utts_.size(); n++) {
+      if (tot_auxf_change_ != NULL) {
+        double T = TotalPosterior(posteriors_[n]);
+        *tot_auxf_change_ += auxf_changes_[n];
+        KALDI_VLOG(2) << "Auxf change for utterance " << utts_[n] << " was "
+                      << (auxf_changes_[n] / T) << " per frame over " << T
+                      << " frames (weighted)";
+      }
+      // We write out the offset from the mean of the prior, as in
+      // IvectorExtractTask.
+      Vector<double> ivector(ivectors_.Row(n));
+      ivector(0) -= extractor_.PriorOffset();
+      KALDI_VLOG(2) << "Ivector norm for utterance " << utts_[n]
+                    << " was " << ivector.Norm(2.0);
+      writer_->Write(utts_[n], Vector<BaseFloat>(ivector));
+    }
+  }
+ private:
+  const IvectorExtractor &extractor_;
+  const CuIvectorExtractor &cu_extractor_;
+  std::vector<std::string> utts_;
+  std::vector<Matrix<BaseFloat> > feats_;
+  std::vector<Posterior> posteriors_;
+  BaseFloatVectorWriter *writer_;
+  double *tot_auxf_change_; // if non-NULL we need the auxf change.
+  Matrix<double> ivectors_;
+  std::vector<double> auxf_changes_;
+};
+
 int32 RunPerSpeaker(const std::string &ivector_extractor_rxfilename,
                    const IvectorEstimationOptions &opts,
                    bool compute_objf_change,
@@ -226,6 +313,8 @@ int main(int argc, char *argv[]) {
     IvectorEstimationOptions opts;
     std::string spk2utt_rspecifier;
     TaskSequencerConfig sequencer_config;
+    int32 batch_size = 1;
+    std::string use_gpu = "no";
     po.Register("compute-objf-change", &compute_objf_change,
                 "If true, compute the change in objective function from using "
                 "nonzero iVector (a potentially useful diagnostic).  Combine "
@@ -236,7 +325,15 @@ int main(int argc, char *argv[]) {
                 "is not the normal way iVectors are obtained for speaker-id. "
                 "This option will cause the program to ignore the --num-threads "
                 "option.");
-    
+    po.Register("batch-size", &batch_size, "If > 1, compute the iVectors "
+                "of this many utterances at a time, using matrix-matrix "
+                "products (faster for large extractors, and needed for "
+                "--use-gpu).  Each batch is one task for --num-threads.");
+    po.Register("use-gpu", &use_gpu,
+                "yes|no|optional|wait, only has effect if compiled with CUDA. "
+                "If not \"no\", the batched computation (--batch-size) is "
+                "done on the GPU.");
+
     opts.Register(&po);
     sequencer_config.Register(&po);
     
@@ -252,6 +349,13 @@ int main(int argc, char *argv[]) {
         posterior_rspecifier = po.GetArg(3),
         ivectors_wspecifier = po.GetArg(4);
 
+    if (batch_size < 1)
+      KALDI_ERR << "Invalid --batch-size " << batch_size;
+    if (use_gpu != "no" && batch_size == 1)
+      KALDI_ERR << "--use-gpu requires --batch-size > 1.";
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().SelectGpuId(use_gpu);
+#endif
 
     if (spk2utt_rspecifier.empty()) {
       // g_num_threads affects how ComputeDerivedVars is called when we read the
@@ -267,7 +371,55 @@ int main(int argc, char *argv[]) {
       RandomAccessPosteriorReader posterior_reader(posterior_rspecifier);
       BaseFloatVectorWriter ivector_writer(ivectors_wspecifier);
     
-      {
+      if (batch_size > 1) {
+        CuIvectorExtractor cu_extractor(extractor);
+        TaskSequencer<IvectorExtractBatchTask> sequencer(sequencer_config);
+        double *auxf_ptr = (compute_objf_change ? &tot_auxf_change : NULL );
+        IvectorExtractBatchTask *task = NULL;
+        for (; !feature_reader.Done(); feature_reader.Next()) {
+          std::string utt = feature_reader.Key();
+          if (!posterior_reader.HasKey(utt)) {
+            KALDI_WARN << "No posteriors for utterance " << utt;
+            num_err++;
+            continue;
+          }
+          const Matrix<BaseFloat> &mat = feature_reader.Value();
+          Posterior posterior = posterior_reader.Value(utt);
+
+          if (static_cast<int32>(posterior.size()) != mat.NumRows()) {
+            KALDI_WARN << "Size mismatch between posterior " << posterior.size()
+                       << " and features " << mat.NumRows() << " for utterance "
+                       << utt;
+            num_err++;
+            continue;
+          }
+          double this_t = opts.acoustic_weight * TotalPosterior(posterior),
+              max_count_scale = 1.0;
+          if (opts.max_count > 0 && this_t > opts.max_count) {
+            max_count_scale = opts.max_count / this_t;
+            KALDI_LOG << "Scaling stats for utterance " << utt << " by scale "
+                      << max_count_scale << " due to --max-count="
+                      << opts.max_count;
+            this_t = opts.max_count;
+          }
+          ScalePosterior(opts.acoustic_weight * max_count_scale,
+                         &posterior);
+          if (task == NULL)
+            task = new IvectorExtractBatchTask(extractor, cu_extractor,
+                                               &ivector_writer, auxf_ptr);
+          task->AddUtterance(utt, mat, posterior);
+          if (task->NumUtterances() == batch_size) {
+            sequencer.Run(task);
+            task = NULL;
+          }
+          tot_t += this_t;
+          num_done++;
+        }
+        if (task != NULL)
+          sequencer.Run(task);
+        // Destructor of "sequencer" will wait for any remaining tasks (before
+        // cu_extractor is destroyed).
+      } else {
         TaskSequencer<IvectorExtractTask> sequencer(sequencer_config);
         for (; !feature_reader.Done(); feature_reader.Next()) {
           std::string utt = feature_reader.Key();
@@ -317,7 +469,9 @@ int main(int argc, char *argv[]) {
         KALDI_LOG << "Overall average objective-function change from estimating "
                   << "ivector was " << (tot_auxf_change / tot_t) << " per frame "
                   << " over " << tot_t << " (weighted) frames.";
-
+#if HAVE_CUDA==1
+      CuDevice::Instantiate().PrintProfile();
+#endif
       return (num_done != 0 ? 0 : 1);
     } else {
       KALDI_ASSERT(sequencer_config.num_threads == 1 &&
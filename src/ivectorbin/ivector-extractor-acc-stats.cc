@@ -22,7 +22,9 @@
 #include "util/common-utils.h"
 #include "gmm/am-diag-gmm.h"
 #include "ivector/ivector-extractor.h"
+#include "ivector/cu-ivector-extractor.h"
 #include "thread/kaldi-task-sequence.h"
+#include "cudamatrix/cu-device.h"
 
 
 namespace kaldi {
@@ -53,6 +55,51 @@ class IvectorTask {
   IvectorExtractorStats *stats_;
 };
 
+// This class is used if --batch-size > 1.  It accumulates the per-utterance
+// stats of a batch of utterances in parallel, in operator (); the destructor,
+// which is called in the main thread, then accumulates the stats for the
+// extractor for the whole batch at once.
+class IvectorBatchTask {
+ public:
+  IvectorBatchTask(const IvectorExtractor &extractor,
+                   bool need_2nd_order_stats,
+                   CuIvectorExtractorStats *cu_stats):
+      extractor_(extractor), need_2nd_order_stats_(need_2nd_order_stats),
+      cu_stats_(cu_stats) { }
+
+  void AddUtterance(const Matrix<BaseFloat> &features,
+                    const Posterior &posterior) {
+    features_.resize(features_.size() + 1);
+    features_.back() = features;
+    posteriors_.push_back(posterior);
+  }
+
+  int32 NumUtterances() const { return features_.size(); }
+
+  void operator () () {
+    utt_stats_.resize(features_.size());
+    for (size_t n = 0; n < features_.size(); n++) {
+      utt_stats_[n] = new IvectorExtractorUtteranceStats(
+          extractor_.NumGauss(), extractor_.FeatDim(), need_2nd_order_stats_);
+      utt_stats_[n]->AccStats(features_[n], posteriors_[n]);
+    }
+  }
+  ~IvectorBatchTask() {
+    std::vector<const IvectorExtractorUtteranceStats*> utt_stats(
+        utt_stats_.begin(), utt_stats_.end());
+    cu_stats_->AccStatsForUtterances(utt_stats);
+    for (size_t n = 0; n < utt_stats_.size(); n++)
+      delete utt_stats_[n];
+  }
+ private:
+  const IvectorExtractor &extractor_;
+  bool need_2nd_order_stats_;
+  std::vector<Matrix<BaseFloat> > features_;
+  std::vector<Posterior> posteriors_;
+  std::vector<IvectorExtractorUtteranceStats*> utt_stats_;
+  CuIvectorExtractorStats *cu_stats_;
+};
+
 
 
 }
@@ -79,7 +126,16 @@ int main(int argc, char *argv[]) {
     bool binary = true;
     IvectorExtractorStatsOptions stats_opts;
     TaskSequencerConfig sequencer_opts;
+    int32 batch_size = 1;
+    std::string use_gpu = "no";
     po.Register("binary", &binary, "Write output in binary mode");
+    po.Register("batch-size", &batch_size, "If > 1, accumulate the stats for "
+                "this many utterances at a time, using matrix-matrix products "
+                "(faster for large extractors, and needed for --use-gpu).");
+    po.Register("use-gpu", &use_gpu,
+                "yes|no|optional|wait, only has effect if compiled with CUDA. "
+                "If not \"no\", the batched accumulation (--batch-size) is "
+                "done on the GPU.");
     stats_opts.Register(&po);
     sequencer_opts.Register(&po);
 
@@ -95,6 +151,11 @@ int main(int argc, char *argv[]) {
         posteriors_rspecifier = po.GetArg(3),
         accs_wxfilename = po.GetArg(4);
 
+    if (batch_size < 1)
+      KALDI_ERR << "Invalid --batch-size " << batch_size;
+    if (use_gpu != "no" && batch_size == 1)
+      KALDI_ERR << "--use-gpu requires --batch-size > 1.";
+
 
     // Initialize these Reader objects before reading the IvectorExtractor,
     // because it uses up a lot of memory and any fork() after that will
@@ -113,12 +174,53 @@ int main(int argc, char *argv[]) {
     ReadKaldiObject(ivector_extractor_rxfilename, &extractor);
     
     IvectorExtractorStats stats(extractor, stats_opts);
+
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().SelectGpuId(use_gpu);
+#endif
     
     
     int64 tot_t = 0;
     int32 num_done = 0, num_err = 0;
     
-    {
+    if (batch_size > 1) {
+      CuIvectorExtractor cu_extractor(extractor);
+      CuIvectorExtractorStats cu_stats(cu_extractor, &stats);
+      TaskSequencer<IvectorBatchTask> sequencer(sequencer_opts);
+      IvectorBatchTask *task = NULL;
+      for (; !feature_reader.Done(); feature_reader.Next()) {
+        std::string key = feature_reader.Key();
+        if (!posteriors_reader.HasKey(key)) {
+          KALDI_WARN << "No posteriors for utterance " << key;
+          num_err++;
+          continue;
+        }
+        const Matrix<BaseFloat> &mat = feature_reader.Value();
+        const Posterior &posterior = posteriors_reader.Value(key);
+
+        if (static_cast<int32>(posterior.size()) != mat.NumRows()) {
+          KALDI_WARN << "Size mismatch between posterior " << (posterior.size())
+                     << " and features " << (mat.NumRows()) << " for utterance "
+                     << key;
+          num_err++;
+          continue;
+        }
+        if (task == NULL)
+          task = new IvectorBatchTask(extractor, stats_opts.update_variances,
+                                      &cu_stats);
+        task->AddUtterance(mat, posterior);
+        if (task->NumUtterances() == batch_size) {
+          sequencer.Run(task);
+          task = NULL;
+        }
+        tot_t += posterior.size();
+        num_done++;
+      }
+      if (task != NULL)
+        sequencer.Run(task);
+      // destructor of "sequencer" will wait for any remaining tasks, and then
+      // the destructor of "cu_stats" adds its stats to "stats".
+    } else {
       TaskSequencer<IvectorTask> sequencer(sequencer_opts);
       
       for (; !feature_reader.Done(); feature_reader.Next()) {
@@ -157,6 +259,9 @@ int main(int argc, char *argv[]) {
     }
     
     KALDI_LOG << "Wrote stats to " << accs_wxfilename;
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().PrintProfile();
+#endif
 
     return (num_done != 0 ? 0 : 1);
   } catch(const std::exception &e) {
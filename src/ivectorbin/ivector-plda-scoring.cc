@@ -21,6 +21,96 @@
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "ivector/plda.h"
+#include "thread/kaldi-task-sequence.h"
+#include "cudamatrix/cu-matrix.h"
+#include "cudamatrix/cu-vector.h"
+#include "cudamatrix/cu-device.h"
+
+namespace kaldi {
+
+// This class is used if --batch-size > 1.  It scores a block of trials in
+// operator () and writes out the scores in its destructor.  The rows of
+// train_vectors and test_vectors are the outputs of
+// Plda::GetTrainScoringVectors() and Plda::GetTestScoringVectors(), so each
+// score is a dot product.  If the trials in the block involve few distinct
+// train and test keys (e.g. the trials are the cross product of some speakers
+// and utterances), we compute the scores of all pairs with one matrix
+// multiplication; otherwise we compute just the dot products we need.
+class PldaScoringTask {
+ public:
+  PldaScoringTask(const CuMatrix<double> &train_vectors,
+                  const CuMatrix<double> &test_vectors,
+                  std::ostream *os, double *sum, double *sumsq):
+      train_vectors_(train_vectors), test_vectors_(test_vectors), os_(os),
+      sum_(sum), sumsq_(sumsq) { }
+
+  void AddTrial(const std::string &key1, int32 train_index,
+                const std::string &key2, int32 test_index) {
+    keys_.push_back(std::make_pair(key1, key2));
+    train_indexes_.push_back(train_index);
+    test_indexes_.push_back(test_index);
+  }
+
+  int32 NumTrials() const { return keys_.size(); }
+
+  void operator () () {
+    int32 num_trials = keys_.size();
+    scores_.Resize(num_trials, kUndefined);
+    // Work out the distinct train and test indexes.
+    std::vector<int32> unique_train(train_indexes_), unique_test(test_indexes_);
+    SortAndUniq(&unique_train);
+    SortAndUniq(&unique_test);
+    if (static_cast<double>(unique_train.size()) * unique_test.size() <=
+        4.0 * num_trials) {
+      CuMatrix<double> train(unique_train.size(), train_vectors_.NumCols(),
+                             kUndefined),
+          test(unique_test.size(), test_vectors_.NumCols(), kUndefined),
+          scores(unique_train.size(), unique_test.size(), kUndefined);
+      train.CopyRows(train_vectors_, CuArray<MatrixIndexT>(unique_train));
+      test.CopyRows(test_vectors_, CuArray<MatrixIndexT>(unique_test));
+      scores.AddMatMat(1.0, train, kNoTrans, test, kTrans, 0.0);
+      Matrix<double> scores_cpu(scores);
+      for (int32 n = 0; n < num_trials; n++) {
+        int32 j = std::lower_bound(unique_train.begin(), unique_train.end(),
+                                   train_indexes_[n]) - unique_train.begin(),
+            k = std::lower_bound(unique_test.begin(), unique_test.end(),
+                                 test_indexes_[n]) - unique_test.begin();
+        scores_(n) = scores_cpu(j, k);
+      }
+    } else {
+      CuMatrix<double> train(num_trials, train_vectors_.NumCols(), kUndefined),
+          test(num_trials, test_vectors_.NumCols(), kUndefined);
+      train.CopyRows(train_vectors_, CuArray<MatrixIndexT>(train_indexes_));
+      test.CopyRows(test_vectors_, CuArray<MatrixIndexT>(test_indexes_));
+      train.MulElements(test);
+      CuVector<double> scores(num_trials, kUndefined);
+      scores.AddColSumMat(1.0, train, 0.0);
+      scores_.CopyFromVec(scores);
+    }
+  }
+
+  ~PldaScoringTask() {
+    for (size_t n = 0; n < keys_.size(); n++) {
+      BaseFloat score = scores_(n);
+      *sum_ += score;
+      *sumsq_ += score * score;
+      *os_ << keys_[n].first << ' ' << keys_[n].second << ' ' << score
+           << std::endl;
+    }
+  }
+ private:
+  const CuMatrix<double> &train_vectors_;
+  const CuMatrix<double> &test_vectors_;
+  std::ostream *os_;
+  double *sum_;
+  double *sumsq_;
+  std::vector<std::pair<std::string, std::string> > keys_;
+  std::vector<int32> train_indexes_;
+  std::vector<int32> test_indexes_;
+  Vector<double> scores_;
+};
+
+}  // namespace kaldi
 
 
 int main(int argc, char *argv[]) {
@@ -51,11 +141,22 @@ int main(int argc, char *argv[]) {
     ParseOptions po(usage);
 
     std::string num_utts_rspecifier;
+    int32 batch_size = 1;
+    std::string use_gpu = "no";
     
     PldaConfig plda_config;
+    TaskSequencerConfig sequencer_config;
     plda_config.Register(&po);
+    sequencer_config.Register(&po);
     po.Register("num-utts", &num_utts_rspecifier, "Table to read the number of "
                 "utterances per speaker, e.g. ark:num_utts.ark\n");
+    po.Register("batch-size", &batch_size, "If > 1, score this many trials at "
+                "a time using matrix operations (much faster for large trial "
+                "lists; needed for --num-threads and --use-gpu).");
+    po.Register("use-gpu", &use_gpu,
+                "yes|no|optional|wait, only has effect if compiled with CUDA. "
+                "If not \"no\", the batched scoring (--batch-size) is done on "
+                "the GPU.");
     
     po.Read(argc, argv);
     
@@ -69,6 +170,15 @@ int main(int argc, char *argv[]) {
         test_ivector_rspecifier = po.GetArg(3),
         trials_rxfilename = po.GetArg(4),
         scores_wxfilename = po.GetArg(5);
+
+    if (batch_size < 1)
+      KALDI_ERR << "Invalid --batch-size " << batch_size;
+    if (batch_size == 1 && (use_gpu != "no" ||
+                            sequencer_config.num_threads != 1))
+      KALDI_ERR << "--use-gpu and --num-threads require --batch-size > 1.";
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().SelectGpuId(use_gpu);
+#endif
     
     //  diagnostics:
     double tot_test_renorm_scale = 0.0, tot_train_renorm_scale = 0.0;
@@ -142,46 +252,113 @@ int main(int argc, char *argv[]) {
     double sum = 0.0, sumsq = 0.0;
     std::string line;
 
-    while (std::getline(ki.Stream(), line)) {
-      std::vector<std::string> fields;
-      SplitStringToVector(line, " \t\n\r", true, &fields);
-      if (fields.size() != 2) {
-        KALDI_ERR << "Bad line " << (num_trials_done + num_trials_err)
-                  << "in input (expected two fields: key1 key2): " << line;
+    if (batch_size > 1) {
+      // Work out the vectors whose dot products are the scores, see
+      // Plda::GetTrainScoringVectors().
+      unordered_map<string, int32, StringHasher> train_index, test_index;
+      Matrix<double> train_mat(train_ivectors.size(), dim, kUndefined),
+          test_mat(test_ivectors.size(), dim, kUndefined);
+      std::vector<int32> num_train_utts(train_ivectors.size(), 1);
+      int32 j = 0;
+      for (HashType::iterator iter = train_ivectors.begin();
+           iter != train_ivectors.end(); ++iter, ++j) {
+        train_index[iter->first] = j;
+        train_mat.Row(j).CopyFromVec(*(iter->second));
+        if (!num_utts_rspecifier.empty()) {
+          if (!num_utts_reader.HasKey(iter->first))
+            KALDI_ERR << "Number of utterances not given for speaker "
+                      << iter->first;
+          num_train_utts[j] = num_utts_reader.Value(iter->first);
+        }
       }
-      std::string key1 = fields[0], key2 = fields[1];
-      if (train_ivectors.count(key1) == 0) {
-        KALDI_WARN << "Key " << key1 << " not present in training iVectors.";
-        num_trials_err++;
-        continue;
+      int32 k = 0;
+      for (HashType::iterator iter = test_ivectors.begin();
+           iter != test_ivectors.end(); ++iter, ++k) {
+        test_index[iter->first] = k;
+        test_mat.Row(k).CopyFromVec(*(iter->second));
       }
-      if (test_ivectors.count(key2) == 0) {
-        KALDI_WARN << "Key " << key2 << " not present in test iVectors.";
-        num_trials_err++;
-        continue;
+      Matrix<double> train_vectors(train_mat.NumRows(), 2 * dim + 1, kUndefined),
+          test_vectors(test_mat.NumRows(), 2 * dim + 1, kUndefined);
+      plda.GetTrainScoringVectors(train_mat, num_train_utts, &train_vectors);
+      plda.GetTestScoringVectors(test_mat, &test_vectors);
+      CuMatrix<double> cu_train_vectors(train_vectors),
+          cu_test_vectors(test_vectors);
+
+      TaskSequencer<PldaScoringTask> sequencer(sequencer_config);
+      PldaScoringTask *task = NULL;
+      while (std::getline(ki.Stream(), line)) {
+        std::vector<std::string> fields;
+        SplitStringToVector(line, " \t\n\r", true, &fields);
+        if (fields.size() != 2) {
+          KALDI_ERR << "Bad line " << (num_trials_done + num_trials_err)
+                    << "in input (expected two fields: key1 key2): " << line;
+        }
+        std::string key1 = fields[0], key2 = fields[1];
+        if (train_ivectors.count(key1) == 0) {
+          KALDI_WARN << "Key " << key1 << " not present in training iVectors.";
+          num_trials_err++;
+          continue;
+        }
+        if (test_ivectors.count(key2) == 0) {
+          KALDI_WARN << "Key " << key2 << " not present in test iVectors.";
+          num_trials_err++;
+          continue;
+        }
+        if (task == NULL)
+          task = new PldaScoringTask(cu_train_vectors, cu_test_vectors,
+                                     &(ko.Stream()), &sum, &sumsq);
+        task->AddTrial(key1, train_index[key1], key2, test_index[key2]);
+        if (task->NumTrials() == batch_size) {
+          sequencer.Run(task);
+          task = NULL;
+        }
+        num_trials_done++;
       }
-      const Vector<BaseFloat> *train_ivector = train_ivectors[key1],
-          *test_ivector = test_ivectors[key2];
+      if (task != NULL)
+        sequencer.Run(task);
+      // The destructor of "sequencer" will wait for any remaining tasks.
+    } else {
+      while (std::getline(ki.Stream(), line)) {
+        std::vector<std::string> fields;
+        SplitStringToVector(line, " \t\n\r", true, &fields);
+        if (fields.size() != 2) {
+          KALDI_ERR << "Bad line " << (num_trials_done + num_trials_err)
+                    << "in input (expected two fields: key1 key2): " << line;
+        }
+        std::string key1 = fields[0], key2 = fields[1];
+        if (train_ivectors.count(key1) == 0) {
+          KALDI_WARN << "Key " << key1 << " not present in training iVectors.";
+          num_trials_err++;
+          continue;
+        }
+        if (test_ivectors.count(key2) == 0) {
+          KALDI_WARN << "Key " << key2 << " not present in test iVectors.";
+          num_trials_err++;
+          continue;
+        }
+        const Vector<BaseFloat> *train_ivector = train_ivectors[key1],
+            *test_ivector = test_ivectors[key2];
           
-      Vector<double> train_ivector_dbl(*train_ivector),
-          test_ivector_dbl(*test_ivector);
-
-      int32 num_train_examples;
-      if (!num_utts_rspecifier.empty()) {
-        // we already checked that it has this key.
-        num_train_examples = num_utts_reader.Value(key1);
-      } else {
-        num_train_examples = 1;
-      }
+        Vector<double> train_ivector_dbl(*train_ivector),
+            test_ivector_dbl(*test_ivector);
+
+        int32 num_train_examples;
+        if (!num_utts_rspecifier.empty()) {
+          // we already checked that it has this key.
+          num_train_examples = num_utts_reader.Value(key1);
+        } else {
+          num_train_examples = 1;
+        }
       
       
-      BaseFloat score = plda.LogLikelihoodRatio(train_ivector_dbl,
-                                                num_train_examples,
-                                                test_ivector_dbl);
-      sum += score;
-      sumsq += score * score;
-      num_trials_done++;
-      ko.Stream() << key1 << ' ' << key2 << ' ' << score << std::endl;
+        BaseFloat score = plda.LogLikelihoodRatio(train_ivector_dbl,
+                                                  num_train_examples,
+                                                  test_ivector_dbl);
+        sum += score;
+        sumsq += score * score;
+        num_trials_done++;
+        ko.Stream() << key1 << ' ' << key2 << ' ' << score << std::endl;
+      }
     }
 
     for (HashType::iterator iter = train_ivectors.begin();
@@ -200,6 +377,9 @@ int main(int argc, char *argv[]) {
     }
     KALDI_LOG << "Processed " << num_trials_done << " trials, " << num_trials_err
               << " had errors.";
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().PrintProfile();
+#endif
     return (num_trials_done != 0 ? 0 : 1);
   } catch(const std::exception &e) {
     std::cerr << e.what();
@@ -23,6 +23,7 @@
 #include "tree/clusterable-classes.h"
 #include "ivector/logistic-regression.h"
 #include "ivector/plda.h"
+#include "ivector/agglomerative-clustering.h"
 
 using namespace kaldi;
 
@@ -30,7 +31,9 @@ int main(int argc, char *argv[]) {
   using namespace kaldi;
   typedef kaldi::int32 int32;
   try {
-    const char *usage = "Does speaker diarzation using k-means clustering of PLDA transformed i-vectors.\n"
+    const char *usage = "Does speaker diarzation using k-means clustering of PLDA transformed i-vectors\n"
+                        "(or, with --cluster-method=agglomerative, bottom-up clustering using the\n"
+                        "PLDA log-likelihood ratios between the segments).\n"
                         "Usage: speaker-diarization <plda> <spk2utt-rspecifier> <per-utt-ivector-rspecifier> <diar-wspecifier>\n"
                         " e.g.: speaker-diarization plda ark,t:data/dev/spk2utt scp:exp/ivectors_dev/ivector.scp ark,t:exp/diarization_dev/diarization.txt\n"
                         "\n";
@@ -39,7 +42,15 @@ int main(int argc, char *argv[]) {
     int32 num_speakers = 2;
     ParseOptions po(usage);
 
-    po.Register("num-speakers", &num_speakers, "Number of speakers to use in the k-means clustering algorithm");
+    std::string cluster_method = "kmeans";
+    BaseFloat threshold = -std::numeric_limits<BaseFloat>::max();
+    po.Register("num-speakers", &num_speakers, "Number of speakers to use in the k-means clustering algorithm "
+                "(for agglomerative clustering, the minimum number of speakers)");
+    po.Register("cluster-method", &cluster_method, "Clustering method, kmeans|agglomerative.  Agglomerative "
+                "clustering uses average linkage of the PLDA log-likelihood ratios (or, without <plda>, of the "
+                "cosine similarities) of the segments.");
+    po.Register("threshold", &threshold, "For agglomerative clustering: stop merging clusters when the "
+                "average score between the closest two clusters is below this value.");
 
     ClusterKMeansOptions cfg;
 
@@ -49,6 +60,8 @@ int main(int argc, char *argv[]) {
       po.PrintUsage();
       exit(1);
     }
+    if (cluster_method != "kmeans" && cluster_method != "agglomerative")
+      KALDI_ERR << "Invalid --cluster-method " << cluster_method;
     int32 num_utt_err = 0;
     int32 num_utt_done = 0;
 
@@ -83,6 +96,8 @@ int main(int argc, char *argv[]) {
       const std::vector<std::string> &uttlist = spk2utt_reader.Value();
       std::vector<Clusterable *> ivector_clusters;
       ivector_clusters.reserve(uttlist.size());
+      // Only used for agglomerative clustering: the (transformed) iVectors.
+      std::vector<Vector<BaseFloat> > ivectors;
 
       for (size_t i = 0; i < uttlist.size(); i++) {
         std::string utt = uttlist[i];
@@ -104,6 +119,8 @@ int main(int argc, char *argv[]) {
 
           Clusterable *cluster = new VectorClusterable(*transformed_ivector, 1.0);
           ivector_clusters.back() = cluster;
+          if (cluster_method == "agglomerative")
+            ivectors.push_back(*transformed_ivector);
           num_utt_done++;
           
           if (plda_rxfilename != "") {
@@ -114,7 +131,31 @@ int main(int argc, char *argv[]) {
       std::vector<Clusterable *> ivector_clusters_out;
       std::vector<int32> assignments_out;
       //BaseFloat imprv = ClusterKMeansOnce(ivector_clusters, 2, &ivector_clusters_out, &assignments_out, cfg);
-      BaseFloat imprv = ClusterKMeans(ivector_clusters, num_speakers, &ivector_clusters_out, &assignments_out, cfg);
+      BaseFloat imprv = 0.0;
+      if (cluster_method == "kmeans") {
+        imprv = ClusterKMeans(ivector_clusters, num_speakers, &ivector_clusters_out, &assignments_out, cfg);
+      } else if (!ivectors.empty()) {
+        // Score all pairs of segments at once.
+        int32 num_segments = ivectors.size(), ivector_dim = ivectors[0].Dim();
+        Matrix<double> ivector_mat(num_segments, ivector_dim);
+        for (int32 i = 0; i < num_segments; i++)
+          ivector_mat.Row(i).CopyFromVec(ivectors[i]);
+        Matrix<double> scores(num_segments, num_segments);
+        if (plda_rxfilename != "") {
+          std::vector<int32> num_utts(num_segments, 1);
+          plda.LogLikelihoodRatios(ivector_mat, num_utts, ivector_mat, &scores);
+        } else {
+          for (int32 i = 0; i < num_segments; i++) {
+            BaseFloat norm = ivector_mat.Row(i).Norm(2.0);
+            if (norm != 0.0)
+              ivector_mat.Row(i).Scale(1.0 / norm);
+          }
+          scores.AddMatMat(1.0, ivector_mat, kNoTrans, ivector_mat, kTrans, 0.0);
+        }
+        Matrix<BaseFloat> costs(scores);
+        costs.Scale(-1.0);
+        AgglomerativeCluster(costs, -threshold, num_speakers, &assignments_out);
+      }
       for (int32 i = 0; i < ivector_clusters.size(); i++) {
         delete ivector_clusters[i];
       }
@@ -0,0 +1,169 @@
+// kws/kws-batch-search.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <deque>
+#include "kws/kws-batch-search.h"
+
+namespace kaldi {
+
+bool KwsKeywordTrie::AddKeyword(int32 keyword_index,
+                                const fst::StdVectorFst &keyword) {
+  KALDI_ASSERT(keyword_index >= 0);
+  if (keyword.Start() == fst::kNoStateId)
+    return true;
+  if (keyword.Properties(fst::kAcyclic, true) == 0)
+    return false;
+  AddPaths(keyword_index, keyword, keyword.Start(), 0, 0.0);
+  num_keywords_ = std::max(num_keywords_, keyword_index + 1);
+  return true;
+}
+
+void KwsKeywordTrie::AddPaths(int32 keyword_index,
+                              const fst::StdVectorFst &keyword,
+                              fst::StdArc::StateId state, int32 node,
+                              double weight) {
+  fst::TropicalWeight final_weight = keyword.Final(state);
+  if (final_weight != fst::TropicalWeight::Zero() && node != 0) {
+    std::vector<std::pair<int32, BaseFloat> > &keywords = nodes_[node].keywords;
+    BaseFloat this_weight = weight + final_weight.Value();
+    if (!keywords.empty() && keywords.back().first == keyword_index)
+      keywords.back().second = std::min(keywords.back().second, this_weight);
+    else
+      keywords.push_back(std::make_pair(keyword_index, this_weight));
+  }
+  for (fst::ArcIterator<fst::StdVectorFst> aiter(keyword, state);
+       !aiter.Done(); aiter.Next()) {
+    const fst::StdArc &arc = aiter.Value();
+    if (arc.weight == fst::TropicalWeight::Zero()) continue;
+    int32 next_node = node;
+    if (arc.ilabel != 0) {
+      std::map<int32, int32>::iterator iter =
+          nodes_[node].children.find(arc.ilabel);
+      if (iter != nodes_[node].children.end()) {
+        next_node = iter->second;
+      } else {
+        next_node = nodes_.size();
+        // Note: this may reallocate nodes_, so we don't keep references.
+        nodes_.push_back(Node());
+        nodes_[node].children[arc.ilabel] = next_node;
+      }
+    }
+    AddPaths(keyword_index, keyword, arc.nextstate, next_node,
+             weight + arc.weight.Value());
+  }
+}
+
+void SearchKwsIndexBatch(
+    const KwsLexicographicFst &index, const KwsKeywordTrie &trie,
+    std::vector<unordered_map<std::pair<int32, int32>, KwsSearchResult,
+                              PairHasher<int32> > > *results) {
+  typedef KwsLexicographicArc Arc;
+  typedef Arc::StateId StateId;
+  typedef KwsLexicographicWeight Weight;
+  typedef std::pair<int32, StateId> ProductState;  // (trie node, index state)
+  typedef unordered_map<ProductState, Weight, PairHasher<int32> > ProductMap;
+  typedef unordered_map<std::pair<int32, int32>, KwsSearchResult,
+                        PairHasher<int32> > ResultMap;
+
+  results->clear();
+  results->resize(trie.NumKeywords());
+  if (index.Start() == fst::kNoStateId) return;
+
+  // We go through the product of the trie and the index one trie depth at a
+  // time.  "cur" holds the best weights of the product states at the current
+  // depth, and "queue" the ones still to be processed; a state may be
+  // processed again if an epsilon arc in the index gives it a better weight.
+  ProductMap cur, next;
+  std::deque<ProductState> queue;
+  ProductState start(0, index.Start());
+  cur[start] = Weight::One();
+  queue.push_back(start);
+  while (!queue.empty()) {
+    while (!queue.empty()) {
+      ProductState p = queue.front();
+      queue.pop_front();
+      const Weight weight = cur[p];
+      const KwsKeywordTrie::Node &node = trie.nodes_[p.first];
+      std::map<int32, int32>::const_iterator child = node.children.begin(),
+          child_end = node.children.end();
+      // The index arcs are sorted by ilabel, so we can match them against
+      // the children of the node in one pass.
+      for (fst::ArcIterator<KwsLexicographicFst> aiter(index, p.second);
+           !aiter.Done(); aiter.Next()) {
+        const Arc &arc = aiter.Value();
+        Weight final_weight = index.Final(arc.nextstate);
+        if (final_weight != Weight::Zero()) {
+          // A hit, i.e. an arc to a final state whose ilabel is the
+          // disambiguation symbol and olabel the utterance-id.
+          if (node.keywords.empty()) continue;
+          Weight hit_weight = fst::Times(fst::Times(weight, arc.weight),
+                                         final_weight);
+          for (size_t k = 0; k < node.keywords.size(); k++) {
+            KwsSearchResult result(
+                arc.olabel, arc.ilabel,
+                hit_weight.Value1().Value() + node.keywords[k].second,
+                hit_weight.Value2().Value1().Value(),
+                hit_weight.Value2().Value2().Value());
+            ResultMap &keyword_results = (*results)[node.keywords[k].first];
+            std::pair<ResultMap::iterator, bool> ret = keyword_results.insert(
+                std::make_pair(std::make_pair(arc.ilabel, arc.olabel),
+                               result));
+            if (!ret.second && result < ret.first->second)
+              ret.first->second = result;
+          }
+          continue;
+        }
+        ProductMap *dest_map;
+        ProductState dest;
+        if (arc.ilabel == 0) {  // An epsilon arc; the depth stays the same.
+          dest_map = &cur;
+          dest = ProductState(p.first, arc.nextstate);
+        } else {
+          while (child != child_end && child->first < arc.ilabel)
+            ++child;
+          if (child == child_end) {
+            if (node.keywords.empty()) break;  // No more hits we want.
+            continue;
+          }
+          if (child->first != arc.ilabel) continue;
+          dest_map = &next;
+          dest = ProductState(child->second, arc.nextstate);
+        }
+        Weight dest_weight = fst::Times(weight, arc.weight);
+        std::pair<ProductMap::iterator, bool> ret =
+            dest_map->insert(std::make_pair(dest, dest_weight));
+        if (ret.second) {
+          if (dest_map == &cur) queue.push_back(dest);
+        } else if (fst::Plus(ret.first->second, dest_weight) !=
+                   ret.first->second) {
+          ret.first->second = dest_weight;
+          if (dest_map == &cur) queue.push_back(dest);
+        }
+      }
+    }
+    cur.swap(next);
+    next.clear();
+    for (ProductMap::const_iterator iter = cur.begin(); iter != cur.end();
+         ++iter)
+      queue.push_back(iter->first);
+  }
+}
+
+}  // namespace kaldi
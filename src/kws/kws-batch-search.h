@@ -0,0 +1,88 @@
+// kws/kws-batch-search.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_KWS_KWS_BATCH_SEARCH_H_
+#define KALDI_KWS_KWS_BATCH_SEARCH_H_
+
+#include <map>
+#include <vector>
+#include "base/kaldi-common.h"
+#include "util/stl-utils.h"
+#include "kws/kaldi-kws.h"
+#include "kws/kws-sharded-index.h"
+
+namespace kaldi {
+
+/**
+   KwsKeywordTrie stores the word sequences of many keywords (e.g. the
+   keywords and proxy keywords of a whole keyword list) as a prefix tree, so
+   that they can all be searched for in one traversal of the index, with the
+   work for shared prefixes done only once (see SearchKwsIndexBatch()).
+*/
+class KwsKeywordTrie {
+ public:
+  KwsKeywordTrie(): nodes_(1), num_keywords_(0) { }
+
+  /// Adds the word sequences accepted by "keyword", with their weights, as
+  /// keyword number "keyword_index".  Epsilons are ignored.  Returns false
+  /// (and adds nothing) if the keyword is cyclic.  The empty word sequence is
+  /// not searched for.
+  bool AddKeyword(int32 keyword_index, const fst::StdVectorFst &keyword);
+
+  int32 NumNodes() const { return nodes_.size(); }
+
+  /// Returns the largest keyword index added, plus one.
+  int32 NumKeywords() const { return num_keywords_; }
+
+ private:
+  friend void SearchKwsIndexBatch(
+      const KwsLexicographicFst &index, const KwsKeywordTrie &trie,
+      std::vector<unordered_map<std::pair<int32, int32>, KwsSearchResult,
+                                PairHasher<int32> > > *results);
+
+  struct Node {
+    // Maps from word to the child node.
+    std::map<int32, int32> children;
+    // The keywords whose word sequences end here, with the weights; the
+    // weight is the best one if the keyword has the sequence more than once.
+    std::vector<std::pair<int32, BaseFloat> > keywords;
+  };
+
+  void AddPaths(int32 keyword_index, const fst::StdVectorFst &keyword,
+                fst::StdArc::StateId state, int32 node, double weight);
+
+  std::vector<Node> nodes_;
+  int32 num_keywords_;
+};
+
+/// Searches for all the keywords in "trie" in one traversal of "index", an
+/// index from lattice-to-kws-index or kws-index-union (not relabeled as in
+/// kws-search), which must be sorted on input labels.  "results" is resized to
+/// trie.NumKeywords(), and for each
+/// keyword maps from (disambiguation symbol, utterance-id) to the best result
+/// for that hit, as kws-search would find it.
+void SearchKwsIndexBatch(
+    const KwsLexicographicFst &index, const KwsKeywordTrie &trie,
+    std::vector<unordered_map<std::pair<int32, int32>, KwsSearchResult,
+                              PairHasher<int32> > > *results);
+
+}  // namespace kaldi
+
+#endif  // KALDI_KWS_KWS_BATCH_SEARCH_H_
@@ -490,4 +490,160 @@ void OptimizeFactorTransducer(KwsLexicographicFst *index_transducer,
 
 
 
+namespace {
+
+// An element of a state of the output of MergeKwsIndices(): a state of one of
+// the input indices, and the residual weight with which it is reached.
+struct KwsMergeElement {
+  int32 index;
+  KwsLexicographicArc::StateId state;
+  KwsLexicographicWeight residual;
+  KwsMergeElement(int32 index, KwsLexicographicArc::StateId state,
+                  const KwsLexicographicWeight &residual):
+      index(index), state(state), residual(residual) { }
+  bool operator < (const KwsMergeElement &other) const {
+    if (index != other.index) return index < other.index;
+    return state < other.state;
+  }
+};
+
+// An arc of an element, with the residual weight included, for
+// MergeKwsIndices().
+struct KwsMergeArc {
+  KwsLexicographicArc::Label ilabel;
+  KwsLexicographicArc::Label olabel;
+  KwsMergeElement dest;
+  KwsMergeArc(const KwsLexicographicArc &arc, int32 index,
+              const KwsLexicographicWeight &residual):
+      ilabel(arc.ilabel), olabel(arc.olabel),
+      dest(index, arc.nextstate, fst::Times(residual, arc.weight)) { }
+  bool operator < (const KwsMergeArc &other) const {
+    if (ilabel != other.ilabel) return ilabel < other.ilabel;
+    if (olabel != other.olabel) return olabel < other.olabel;
+    return dest < other.dest;
+  }
+};
+
+// Appends to "key" a representation of "weight" quantized to fst::kDelta, so
+// that states whose residuals are approximately equal are treated as the
+// same, as in DeterminizeStar().
+void AppendQuantizedKwsWeight(const KwsLexicographicWeight &weight,
+                              std::vector<int64> *key) {
+  double delta = fst::kDelta;
+  key->push_back(static_cast<int64>(std::floor(
+      weight.Value1().Value() / delta + 0.5)));
+  key->push_back(static_cast<int64>(std::floor(
+      weight.Value2().Value1().Value() / delta + 0.5)));
+  key->push_back(static_cast<int64>(std::floor(
+      weight.Value2().Value2().Value() / delta + 0.5)));
+}
+
+}  // namespace
+
+bool MergeKwsIndices(const std::vector<const KwsLexicographicFst*> &indices,
+                     int32 max_states,
+                     KwsLexicographicFst *ofst) {
+  typedef KwsLexicographicArc Arc;
+  typedef Arc::StateId StateId;
+  typedef KwsLexicographicWeight Weight;
+  typedef unordered_map<std::vector<int64>, StateId,
+                        VectorHasher<int64> > SubsetMap;
+
+  ofst->DeleteStates();
+  for (size_t i = 0; i < indices.size(); i++) {
+    const KwsLexicographicFst &index = *(indices[i]);
+    for (StateId s = 0; s < index.NumStates(); s++) {
+      for (fst::ArcIterator<KwsLexicographicFst> aiter(index, s);
+           !aiter.Done(); aiter.Next()) {
+        if (aiter.Value().ilabel == 0 && aiter.Value().olabel == 0)
+          return false;
+      }
+    }
+  }
+
+  // subsets[s] is the set of input states corresponding to output state s,
+  // sorted and without duplicates.
+  std::vector<std::vector<KwsMergeElement> > subsets(1);
+  for (size_t i = 0; i < indices.size(); i++)
+    if (indices[i]->Start() != fst::kNoStateId)
+      subsets[0].push_back(KwsMergeElement(i, indices[i]->Start(),
+                                           Weight::One()));
+  if (subsets[0].empty())
+    return true;
+  SubsetMap subset_map;
+  std::vector<int64> key;
+  for (size_t e = 0; e < subsets[0].size(); e++) {
+    key.push_back(subsets[0][e].index);
+    key.push_back(subsets[0][e].state);
+    AppendQuantizedKwsWeight(subsets[0][e].residual, &key);
+  }
+  subset_map[key] = 0;
+  ofst->SetStart(ofst->AddState());
+
+  std::vector<KwsMergeArc> arcs;
+  std::vector<KwsMergeElement> dest_subset;
+  for (StateId s = 0; s < static_cast<StateId>(subsets.size()); s++) {
+    // Note: we copy this, because "subsets" may be resized below.
+    std::vector<KwsMergeElement> subset(subsets[s]);
+    Weight final_weight = Weight::Zero();
+    arcs.clear();
+    for (size_t e = 0; e < subset.size(); e++) {
+      const KwsMergeElement &elem = subset[e];
+      const KwsLexicographicFst &index = *(indices[elem.index]);
+      final_weight = fst::Plus(final_weight,
+                               fst::Times(elem.residual,
+                                          index.Final(elem.state)));
+      for (fst::ArcIterator<KwsLexicographicFst> aiter(index, elem.state);
+           !aiter.Done(); aiter.Next()) {
+        if (aiter.Value().weight != Weight::Zero())
+          arcs.push_back(KwsMergeArc(aiter.Value(), elem.index,
+                                     elem.residual));
+      }
+    }
+    if (final_weight != Weight::Zero())
+      ofst->SetFinal(s, final_weight);
+
+    // Merge the arcs with the same labels.
+    std::sort(arcs.begin(), arcs.end());
+    for (size_t begin = 0, end; begin < arcs.size(); begin = end) {
+      Weight weight = Weight::Zero();
+      for (end = begin; end < arcs.size() &&
+               arcs[end].ilabel == arcs[begin].ilabel &&
+               arcs[end].olabel == arcs[begin].olabel; end++)
+        weight = fst::Plus(weight, arcs[end].dest.residual);
+      dest_subset.clear();
+      key.clear();
+      for (size_t a = begin; a < end; a++) {
+        Weight residual = fst::Divide(arcs[a].dest.residual, weight);
+        if (!dest_subset.empty() &&
+            !(dest_subset.back() < arcs[a].dest)) {  // A duplicate state.
+          dest_subset.back().residual = fst::Plus(dest_subset.back().residual,
+                                                  residual);
+          continue;
+        }
+        dest_subset.push_back(KwsMergeElement(arcs[a].dest.index,
+                                              arcs[a].dest.state, residual));
+      }
+      for (size_t e = 0; e < dest_subset.size(); e++) {
+        key.push_back(dest_subset[e].index);
+        key.push_back(dest_subset[e].state);
+        AppendQuantizedKwsWeight(dest_subset[e].residual, &key);
+      }
+      std::pair<SubsetMap::iterator, bool> ret =
+          subset_map.insert(std::make_pair(key, subsets.size()));
+      if (ret.second) {
+        if (max_states > 0 && static_cast<int32>(subsets.size()) >= max_states)
+          return false;
+        subsets.push_back(dest_subset);
+        ofst->AddState();
+      }
+      ofst->AddArc(s, Arc(arcs[begin].ilabel, arcs[begin].olabel, weight,
+                          ret.first->second));
+    }
+    std::vector<KwsMergeElement>().swap(subsets[s]);
+  }
+  return true;
+}
+
+
 } // end namespace kaldi
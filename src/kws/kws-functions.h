@@ -98,6 +98,19 @@ void OptimizeFactorTransducer(KwsLexicographicFst *index_transducer,
                               int32 max_states,
                               bool allow_partial);
 
+// Computes the determinized union of the index transducers "indices" (with
+// their input and output labels treated as one label, as in
+// kws-index-union), which is what Union() followed by encoded DeterminizeStar()
+// would give, but much faster, since the indices are already deterministic
+// and epsilon-free: each state of the output corresponds to a set of states
+// of the input indices (with residual weights), and its arcs are found by
+// merging the arcs of those states by label.  Returns false if an input has
+// epsilon arcs, or if max_states > 0 and the output would have more than
+// max_states states; "ofst" is not meaningful in that case.
+bool MergeKwsIndices(const std::vector<const KwsLexicographicFst*> &indices,
+                     int32 max_states,
+                     KwsLexicographicFst *ofst);
+
 // the following two functions will, if GetVerboseLevel() >= 2, check that the
 // cost of the second-best path in the transducers is not negative, and print
 // out some associated debugging info if GetVerboseLevel() >= 3.  The best path
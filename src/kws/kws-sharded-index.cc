@@ -0,0 +1,400 @@
+// kws/kws-sharded-index.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <iterator>
+#include <limits>
+#include "kws/kws-sharded-index.h"
+#include "util/kaldi-io.h"
+
+namespace kaldi {
+
+// The file starts with this header, followed by the arrays word_offsets and
+// hit_offsets (num_states + 1 elements each), first_arcs, word_arcs and
+// hit_arcs.  Everything is in the machine's native byte order.
+struct KwsShardHeader {
+  char magic[8];
+  int32 num_first_arcs;
+  int32 num_states;
+  int64 num_word_arcs;
+  int64 num_hit_arcs;
+};
+
+static const char *kKwsShardMagic = "KWSSHRD1";
+
+void KwsIndexShard::Clear() {
+  mapped_file_.Close();
+  std::vector<int64>().swap(storage_);
+  num_first_arcs_ = 0;
+  num_states_ = 0;
+  word_offsets_ = NULL;
+  hit_offsets_ = NULL;
+  first_arcs_ = NULL;
+  word_arcs_ = NULL;
+  hit_arcs_ = NULL;
+}
+
+void KwsIndexShard::SetPointers(const char *data, size_t size,
+                                const std::string &name) {
+  KwsShardHeader header;
+  if (size < sizeof(header) ||
+      std::memcmp(data, kKwsShardMagic, sizeof(header.magic)) != 0)
+    KALDI_ERR << "File " << name << " is not a KWS index shard.";
+  std::memcpy(&header, data, sizeof(header));
+  size_t offsets_size = sizeof(int64) * (header.num_states + 1),
+      expected_size = sizeof(header) + 2 * offsets_size +
+      sizeof(KwsShardArc) * (header.num_first_arcs + header.num_word_arcs +
+                             header.num_hit_arcs);
+  if (header.num_states < 0 || header.num_first_arcs < 0 ||
+      size != expected_size)
+    KALDI_ERR << "KWS index shard " << name << " has size " << size
+              << ", expected " << expected_size << " (truncated?)";
+  num_first_arcs_ = header.num_first_arcs;
+  num_states_ = header.num_states;
+  const char *ptr = data + sizeof(header);
+  word_offsets_ = reinterpret_cast<const int64*>(ptr);
+  ptr += offsets_size;
+  hit_offsets_ = reinterpret_cast<const int64*>(ptr);
+  ptr += offsets_size;
+  first_arcs_ = reinterpret_cast<const KwsShardArc*>(ptr);
+  word_arcs_ = first_arcs_ + header.num_first_arcs;
+  hit_arcs_ = word_arcs_ + header.num_word_arcs;
+  if (word_offsets_[num_states_] != header.num_word_arcs ||
+      hit_offsets_[num_states_] != header.num_hit_arcs)
+    KALDI_ERR << "KWS index shard " << name << " is corrupted.";
+}
+
+bool KwsIndexShard::Open(const std::string &filename) {
+  Clear();
+  if (!mapped_file_.Open(filename))
+    return false;
+  SetPointers(mapped_file_.Data(), mapped_file_.Size(), filename);
+  KALDI_VLOG(2) << "Mapped KWS index shard " << filename << " with "
+                << num_states_ << " states.";
+  return true;
+}
+
+void KwsIndexShard::Read(const std::string &rxfilename, bool use_mmap) {
+  if (use_mmap && ClassifyRxfilename(rxfilename) == kFileInput) {
+    if (Open(rxfilename))
+      return;
+    KALDI_WARN << "Reading " << rxfilename << " instead.";
+  }
+  Clear();
+  Input ki(rxfilename);
+  std::string contents((std::istreambuf_iterator<char>(ki.Stream())),
+                       std::istreambuf_iterator<char>());
+  // We store it as int64 so the arrays in it are aligned.
+  storage_.resize((contents.size() + sizeof(int64) - 1) / sizeof(int64));
+  if (!contents.empty())
+    std::memcpy(&(storage_[0]), contents.data(), contents.size());
+  SetPointers(reinterpret_cast<const char*>(storage_.empty() ? NULL :
+                                            &(storage_[0])),
+              contents.size(), PrintableRxfilename(rxfilename));
+}
+
+namespace {
+
+// Compares arcs by label only, for std::equal_range().
+struct KwsShardArcLabelLess {
+  bool operator() (const KwsShardArc &a, int32 label) const {
+    return a.label < label;
+  }
+  bool operator() (int32 label, const KwsShardArc &a) const {
+    return label < a.label;
+  }
+  bool operator() (const KwsShardArc &a, const KwsShardArc &b) const {
+    return a.label < b.label;
+  }
+};
+
+// A weight in the T*T*T semiring.
+struct KwsCost {
+  double score;
+  double tbeg;
+  double tend;
+  KwsCost(double score, double tbeg, double tend):
+      score(score), tbeg(tbeg), tend(tend) { }
+  KwsCost Times(const KwsShardArc &arc) const {
+    return KwsCost(score + arc.score, tbeg + arc.tbeg, tend + arc.tend);
+  }
+  bool operator < (const KwsCost &other) const {
+    if (score != other.score) return score < other.score;
+    if (tbeg != other.tbeg) return tbeg < other.tbeg;
+    return tend < other.tend;
+  }
+};
+
+// The best cost found so far for a state of the product of the keyword and
+// the index in KwsIndexShard::Search().
+struct KwsSearchEntry {
+  KwsCost cost;
+  bool queued;
+  KwsSearchEntry(): cost(0, 0, 0), queued(false) { }
+};
+
+}  // namespace
+
+void KwsIndexShard::Search(
+    const fst::StdVectorFst &keyword,
+    unordered_map<std::pair<int32, int32>, KwsSearchResult,
+                  PairHasher<int32> > *results) const {
+  typedef fst::StdArc::StateId StateId;
+  typedef std::pair<int32, int32> ProductState;
+  typedef unordered_map<std::pair<int32, int32>, KwsSearchResult,
+                        PairHasher<int32> > ResultMap;
+  if (keyword.Start() == fst::kNoStateId || num_states_ == 0) return;
+
+  // We search the product of the keyword and the index, whose states are
+  // (keyword state, shard state); shard state -1 means the start state of the
+  // index, whose arcs are first_arcs_.  Both are acyclic, so relaxing the
+  // costs in FIFO order reaches the best cost for each product state.
+  typedef unordered_map<ProductState, KwsSearchEntry,
+                        PairHasher<int32> > ProductMap;
+  ProductMap product;
+  std::deque<ProductState> queue;
+
+  ProductState start(keyword.Start(), -1);
+  product[start].queued = true;
+  queue.push_back(start);
+
+  while (!queue.empty()) {
+    ProductState p = queue.front();
+    queue.pop_front();
+    KwsSearchEntry &entry = product[p];
+    entry.queued = false;
+    KwsCost cost = entry.cost;
+    StateId k = p.first;
+    int32 s = p.second;
+
+    // The successors of p, with their costs.
+    std::vector<std::pair<ProductState, KwsCost> > next;
+    for (fst::ArcIterator<fst::StdVectorFst> aiter(keyword, k);
+         !aiter.Done(); aiter.Next()) {
+      const fst::StdArc &arc = aiter.Value();
+      if (arc.weight == fst::TropicalWeight::Zero()) continue;
+      KwsCost kw_cost(cost.score + arc.weight.Value(), cost.tbeg, cost.tend);
+      if (arc.ilabel == 0) {
+        next.push_back(std::make_pair(ProductState(arc.nextstate, s), kw_cost));
+        continue;
+      }
+      const KwsShardArc *begin, *end;
+      if (s == -1) {
+        begin = first_arcs_;
+        end = first_arcs_ + num_first_arcs_;
+      } else {
+        begin = word_arcs_ + word_offsets_[s];
+        end = word_arcs_ + word_offsets_[s + 1];
+      }
+      std::pair<const KwsShardArc*, const KwsShardArc*> range =
+          std::equal_range(begin, end, arc.ilabel, KwsShardArcLabelLess());
+      for (const KwsShardArc *a = range.first; a != range.second; ++a)
+        next.push_back(std::make_pair(ProductState(arc.nextstate,
+                                                   a->nextstate),
+                                      kw_cost.Times(*a)));
+    }
+    if (s == -1) {
+      // The empty keyword is not searched for.
+    } else {
+      // Epsilon arcs in the index.
+      const KwsShardArc *begin = word_arcs_ + word_offsets_[s],
+          *end = word_arcs_ + word_offsets_[s + 1];
+      for (const KwsShardArc *a = begin; a != end && a->label == 0; ++a)
+        next.push_back(std::make_pair(ProductState(k, a->nextstate),
+                                      cost.Times(*a)));
+      fst::TropicalWeight final_weight = keyword.Final(k);
+      if (final_weight != fst::TropicalWeight::Zero()) {
+        KwsCost final_cost(cost.score + final_weight.Value(), cost.tbeg,
+                           cost.tend);
+        for (int64 h = hit_offsets_[s]; h < hit_offsets_[s + 1]; h++) {
+          const KwsShardArc &hit = hit_arcs_[h];
+          KwsCost hit_cost = final_cost.Times(hit);
+          KwsSearchResult result(hit.nextstate, hit.label, hit_cost.score,
+                                 hit_cost.tbeg, hit_cost.tend);
+          std::pair<ResultMap::iterator, bool> ret = results->insert(
+              std::make_pair(std::make_pair(hit.label, hit.nextstate),
+                             result));
+          if (!ret.second && result < ret.first->second)
+            ret.first->second = result;
+        }
+      }
+    }
+
+    for (size_t i = 0; i < next.size(); i++) {
+      std::pair<ProductMap::iterator, bool> ret =
+          product.insert(std::make_pair(next[i].first, KwsSearchEntry()));
+      KwsSearchEntry &next_entry = ret.first->second;
+      if (ret.second || next[i].second < next_entry.cost) {
+        next_entry.cost = next[i].second;
+        if (!next_entry.queued) {
+          next_entry.queued = true;
+          queue.push_back(next[i].first);
+        }
+      }
+    }
+  }
+}
+
+
+KwsIndexShardWriter::KwsIndexShardWriter(int32 num_shards):
+    shards_(num_shards) {
+  KALDI_ASSERT(num_shards > 0);
+}
+
+static KwsShardArc MakeKwsShardArc(int32 label, int32 nextstate,
+                                   const KwsLexicographicWeight &weight) {
+  KwsShardArc arc;
+  arc.label = label;
+  arc.nextstate = nextstate;
+  arc.score = weight.Value1().Value();
+  arc.tbeg = weight.Value2().Value1().Value();
+  arc.tend = weight.Value2().Value2().Value();
+  return arc;
+}
+
+// Appends to "first_arcs" the word arcs leaving state s of "index", following
+// any epsilon arcs (whose weights are included), with "weight" being the
+// weight of the path to s.  The nextstates refer to states of "index".
+static void GetKwsFirstArcs(const KwsLexicographicFst &index,
+                            KwsLexicographicArc::StateId s,
+                            const KwsLexicographicWeight &weight,
+                            std::vector<KwsLexicographicArc> *first_arcs) {
+  for (fst::ArcIterator<KwsLexicographicFst> aiter(index, s);
+       !aiter.Done(); aiter.Next()) {
+    const KwsLexicographicArc &arc = aiter.Value();
+    if (index.Final(arc.nextstate) != KwsLexicographicWeight::Zero())
+      continue;  // A hit for the empty word sequence.
+    KwsLexicographicWeight new_weight = fst::Times(weight, arc.weight);
+    if (arc.ilabel == 0)
+      GetKwsFirstArcs(index, arc.nextstate, new_weight, first_arcs);
+    else
+      first_arcs->push_back(KwsLexicographicArc(arc.ilabel, arc.olabel,
+                                                new_weight, arc.nextstate));
+  }
+}
+
+void KwsIndexShardWriter::AddIndex(const KwsLexicographicFst &index) {
+  typedef KwsLexicographicArc Arc;
+  typedef Arc::StateId StateId;
+  if (index.Start() == fst::kNoStateId) return;
+  std::vector<Arc> first_arcs;
+  GetKwsFirstArcs(index, index.Start(), KwsLexicographicWeight::One(),
+                  &first_arcs);
+
+  int32 num_shards = shards_.size();
+  // state_map[s] is the id in the current shard of state s of the index, or
+  // -1; "touched" lists the states to reset for the next shard.
+  std::vector<int32> state_map(index.NumStates(), -1);
+  std::vector<StateId> touched, queue;
+  std::vector<KwsShardArc> arcs;
+  for (int32 n = 0; n < num_shards; n++) {
+    Shard &shard = shards_[n];
+    int32 num_states = shard.word_offsets.size() - 1;
+    // The states of the index are numbered in the order they're reached, so
+    // they are added to the shard in the order they're processed.
+    queue.clear();
+    for (size_t i = 0; i < first_arcs.size(); i++) {
+      const Arc &arc = first_arcs[i];
+      if (arc.ilabel % num_shards != n) continue;
+      if (state_map[arc.nextstate] == -1) {
+        state_map[arc.nextstate] = num_states + queue.size();
+        touched.push_back(arc.nextstate);
+        queue.push_back(arc.nextstate);
+      }
+      shard.first_arcs.push_back(MakeKwsShardArc(
+          arc.ilabel, state_map[arc.nextstate], arc.weight));
+    }
+    for (size_t q = 0; q < queue.size(); q++) {
+      StateId s = queue[q];
+      arcs.clear();
+      for (fst::ArcIterator<KwsLexicographicFst> aiter(index, s);
+           !aiter.Done(); aiter.Next()) {
+        const Arc &arc = aiter.Value();
+        KwsLexicographicWeight final_weight = index.Final(arc.nextstate);
+        if (final_weight != KwsLexicographicWeight::Zero()) {
+          // A hit; there are no arcs leaving the final state.
+          shard.hit_arcs.push_back(MakeKwsShardArc(
+              arc.ilabel, arc.olabel, fst::Times(arc.weight, final_weight)));
+          continue;
+        }
+        if (state_map[arc.nextstate] == -1) {
+          state_map[arc.nextstate] = num_states + queue.size();
+          touched.push_back(arc.nextstate);
+          queue.push_back(arc.nextstate);
+        }
+        arcs.push_back(MakeKwsShardArc(arc.ilabel, state_map[arc.nextstate],
+                                       arc.weight));
+      }
+      std::stable_sort(arcs.begin(), arcs.end(), KwsShardArcLabelLess());
+      shard.word_arcs.insert(shard.word_arcs.end(), arcs.begin(), arcs.end());
+      shard.word_offsets.push_back(shard.word_arcs.size());
+      shard.hit_offsets.push_back(shard.hit_arcs.size());
+    }
+    for (size_t i = 0; i < touched.size(); i++)
+      state_map[touched[i]] = -1;
+    touched.clear();
+    if (shard.word_offsets.size() > std::numeric_limits<int32>::max())
+      KALDI_ERR << "Too many states in KWS index shard; use more shards.";
+  }
+}
+
+void KwsIndexShardWriter::WriteShard(int32 n,
+                                     const std::string &wxfilename) const {
+  KALDI_ASSERT(n >= 0 && n < NumShards());
+  const Shard &shard = shards_[n];
+  std::vector<KwsShardArc> first_arcs(shard.first_arcs);
+  std::stable_sort(first_arcs.begin(), first_arcs.end(),
+                   KwsShardArcLabelLess());
+  KwsShardHeader header;
+  std::memcpy(header.magic, kKwsShardMagic, sizeof(header.magic));
+  header.num_first_arcs = first_arcs.size();
+  header.num_states = shard.word_offsets.size() - 1;
+  header.num_word_arcs = shard.word_arcs.size();
+  header.num_hit_arcs = shard.hit_arcs.size();
+
+  Output ko(wxfilename, true, false);
+  std::ostream &os = ko.Stream();
+  os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  os.write(reinterpret_cast<const char*>(&(shard.word_offsets[0])),
+           sizeof(int64) * shard.word_offsets.size());
+  os.write(reinterpret_cast<const char*>(&(shard.hit_offsets[0])),
+           sizeof(int64) * shard.hit_offsets.size());
+  if (!first_arcs.empty())
+    os.write(reinterpret_cast<const char*>(&(first_arcs[0])),
+             sizeof(KwsShardArc) * first_arcs.size());
+  if (!shard.word_arcs.empty())
+    os.write(reinterpret_cast<const char*>(&(shard.word_arcs[0])),
+             sizeof(KwsShardArc) * shard.word_arcs.size());
+  if (!shard.hit_arcs.empty())
+    os.write(reinterpret_cast<const char*>(&(shard.hit_arcs[0])),
+             sizeof(KwsShardArc) * shard.hit_arcs.size());
+  if (!os.good())
+    KALDI_ERR << "Error writing KWS index shard to "
+              << PrintableWxfilename(wxfilename);
+  ko.Close();
+  KALDI_LOG << "Wrote KWS index shard with " << header.num_first_arcs
+            << " first-word arcs, " << header.num_states << " states, "
+            << header.num_word_arcs << " arcs and " << header.num_hit_arcs
+            << " hits to " << PrintableWxfilename(wxfilename);
+}
+
+}  // namespace kaldi
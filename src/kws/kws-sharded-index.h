@@ -0,0 +1,170 @@
+// kws/kws-sharded-index.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_KWS_KWS_SHARDED_INDEX_H_
+#define KALDI_KWS_KWS_SHARDED_INDEX_H_
+
+#include <string>
+#include <vector>
+#include "base/kaldi-common.h"
+#include "util/mapped-file.h"
+#include "util/stl-utils.h"
+#include "kws/kaldi-kws.h"
+
+namespace kaldi {
+
+/**
+   The sharded KWS index is an alternative, for search, to the single index
+   FST produced by lattice-to-kws-index and kws-index-union.  The index paths
+   are split into shards by the first word on the path, so a keyword only has
+   to be searched for in the shard(s) of its first word(s).  Each shard stores
+   the part of the index reachable from its first words in flat arrays, in a
+   file that can be memory-mapped (see class MappedFile), so "loading" a shard
+   costs nothing and only the parts of it that are searched are ever read from
+   disk.
+
+   The index FST has, on each path, a sequence of word arcs (word on the
+   input, epsilon on the output) followed by one arc into a final state, whose
+   input label is a disambiguation symbol and output label the utterance-id:
+   this last arc is the "hit".  A search result is the best weight (in the
+   T*T*T semiring: score, then begin time, then end time) over the paths that
+   match the keyword, for each distinct hit; this is what kws-search finds.
+   The shards can be built either from the union index or directly from the
+   per-job indexes, since the union is not needed for the search.
+*/
+
+/// An arc in a KwsIndexShard.  For hits, "label" is the disambiguation symbol
+/// and "nextstate" the utterance-id.
+struct KwsShardArc {
+  int32 label;
+  int32 nextstate;
+  float score;  // the negated log-probability.
+  float tbeg;
+  float tend;
+};
+
+/// A search result, as output by kws-search.
+struct KwsSearchResult {
+  int32 utt_id;
+  int32 disambig;
+  double score;
+  double tbeg;
+  double tend;
+  KwsSearchResult(int32 utt_id, int32 disambig, double score, double tbeg,
+                  double tend):
+      utt_id(utt_id), disambig(disambig), score(score), tbeg(tbeg),
+      tend(tend) { }
+  /// Orders by weight in the T*T*T semiring, i.e. best first.
+  bool operator < (const KwsSearchResult &other) const {
+    if (score != other.score) return score < other.score;
+    if (tbeg != other.tbeg) return tbeg < other.tbeg;
+    return tend < other.tend;
+  }
+};
+
+
+/// A read-only shard of the index, as written by KwsIndexShardWriter.
+class KwsIndexShard {
+ public:
+  KwsIndexShard() { Clear(); }
+
+  /// Reads the shard from "rxfilename".  If "use_mmap" is true and it is an
+  /// ordinary file, the shard is memory-mapped (see Open()); otherwise it is
+  /// read into memory.
+  void Read(const std::string &rxfilename, bool use_mmap = true);
+
+  /// Maps the ordinary file "filename".  Returns false (with a warning) if it
+  /// could not be mapped.
+  bool Open(const std::string &filename);
+
+  bool IsMapped() const { return mapped_file_.IsOpen(); }
+
+  /// Searches for "keyword", an acceptor of word sequences whose weights are
+  /// added to the scores, and updates "results" with the hits found:
+  /// "results" maps from (disambiguation symbol, utterance-id) to the best
+  /// result for that hit, and may already contain results from other shards.
+  /// Epsilons in the keyword are allowed; the empty word sequence is ignored.
+  void Search(const fst::StdVectorFst &keyword,
+              unordered_map<std::pair<int32, int32>, KwsSearchResult,
+                            PairHasher<int32> > *results) const;
+
+  int32 NumStates() const { return num_states_; }
+
+ private:
+  void Clear();
+
+  // Sets up the pointers into "data", of size "size" bytes; "name" is used in
+  // error messages.
+  void SetPointers(const char *data, size_t size, const std::string &name);
+
+  int32 num_first_arcs_;
+  int32 num_states_;
+  // For state s, the arcs are word_arcs_[word_offsets_[s]] ...
+  // word_arcs_[word_offsets_[s+1] - 1], sorted by word, and similarly for the
+  // hits.
+  const int64 *word_offsets_;
+  const int64 *hit_offsets_;
+  // The arcs from the start state of the index, sorted by word.
+  const KwsShardArc *first_arcs_;
+  const KwsShardArc *word_arcs_;
+  const KwsShardArc *hit_arcs_;
+
+  // The data is stored in one of these.
+  std::vector<int64> storage_;
+  MappedFile mapped_file_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(KwsIndexShard);
+};
+
+
+/// Splits KWS indexes into shards by the first word on each path, and writes
+/// them in the format read by KwsIndexShard.  Word w goes to shard
+/// w % num-shards.  Several indexes (e.g. one per job) may be added; the
+/// utterance-ids in them must be distinct.
+class KwsIndexShardWriter {
+ public:
+  explicit KwsIndexShardWriter(int32 num_shards);
+
+  /// Adds the paths of "index" to the shards.  The index must be acyclic, as
+  /// produced by lattice-to-kws-index.
+  void AddIndex(const KwsLexicographicFst &index);
+
+  /// Writes shard "shard" (0 <= shard < num-shards) to "wxfilename".
+  void WriteShard(int32 shard, const std::string &wxfilename) const;
+
+  int32 NumShards() const { return shards_.size(); }
+
+ private:
+  struct Shard {
+    std::vector<KwsShardArc> first_arcs;
+    std::vector<int64> word_offsets;
+    std::vector<int64> hit_offsets;
+    std::vector<KwsShardArc> word_arcs;
+    std::vector<KwsShardArc> hit_arcs;
+    Shard(): word_offsets(1, 0), hit_offsets(1, 0) { }
+  };
+
+  std::vector<Shard> shards_;
+};
+
+
+}  // namespace kaldi
+
+#endif  // KALDI_KWS_KWS_SHARDED_INDEX_H_
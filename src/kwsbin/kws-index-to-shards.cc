@@ -0,0 +1,74 @@
+// kwsbin/kws-index-to-shards.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "fstext/kaldi-fst-io.h"
+#include "kws/kws-sharded-index.h"
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Splits KWS indexes into shards by the first word of each index path,\n"
+        "in a format that kws-search-shards can memory-map.  All the indexes\n"
+        "in the archive are added (e.g. the per-job outputs of\n"
+        "lattice-to-kws-index, which need not be combined by kws-index-union\n"
+        "first); the number of shards is the number of output filenames.\n"
+        "\n"
+        "Usage: kws-index-to-shards [options] <index-rspecifier> "
+        "<shard-wxfilename-1> [<shard-wxfilename-2> ...]\n"
+        " e.g.: kws-index-to-shards 'ark:cat index.*|' shard.1 shard.2 "
+        "shard.3\n";
+
+    ParseOptions po(usage);
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string index_rspecifier = po.GetArg(1);
+    int32 num_shards = po.NumArgs() - 1;
+
+    KwsIndexShardWriter writer(num_shards);
+    SequentialTableReader<VectorFstTplHolder<KwsLexicographicArc> >
+        index_reader(index_rspecifier);
+    int32 n_done = 0;
+    for (; !index_reader.Done(); index_reader.Next()) {
+      writer.AddIndex(index_reader.Value());
+      index_reader.FreeCurrent();
+      n_done++;
+    }
+
+    for (int32 n = 0; n < num_shards; n++)
+      writer.WriteShard(n, po.GetArg(n + 2));
+
+    KALDI_LOG << "Split " << n_done << " indexes into " << num_shards
+              << " shards.";
+    return (n_done != 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -62,27 +62,47 @@ int main(int argc, char *argv[]) {
     TableWriter< VectorFstTplHolder<KwsLexicographicArc> > index_writer(index_wspecifier);
 
     int32 n_done = 0;
-    KwsLexicographicFst global_index;
+    std::vector<KwsLexicographicFst*> indices;
     for (; !index_reader.Done(); index_reader.Next()) {
-      std::string key = index_reader.Key();
-      KwsLexicographicFst index = index_reader.Value();
+      indices.push_back(new KwsLexicographicFst(index_reader.Value()));
       index_reader.FreeCurrent();
-
-      Union(&global_index, index);
-
       n_done++;
     }
 
+    KwsLexicographicFst global_index;
+    bool merged = false;
+    if (skip_opt == false) {
+      // The indices from lattice-to-kws-index are deterministic (with encoded
+      // labels), so rather than Union() followed by DeterminizeStar(), we
+      // merge them directly.
+      std::vector<const KwsLexicographicFst*> const_indices(indices.begin(),
+                                                            indices.end());
+      merged = MergeKwsIndices(const_indices, max_states, &global_index);
+      if (!merged)
+        KALDI_LOG << "Could not merge the indices directly; using "
+                  << "determinization instead.";
+    }
+    if (!merged) {
+      global_index.DeleteStates();
+      for (size_t i = 0; i < indices.size(); i++)
+        Union(&global_index, *(indices[i]));
+    }
+    DeletePointers(&indices);
+
     if (skip_opt == false) {
       // Do the encoded epsilon removal, determinization and minimization
       KwsLexicographicFst ifst = global_index;
       EncodeMapper<KwsLexicographicArc> encoder(kEncodeLabels, ENCODE);
       Encode(&ifst, &encoder);
-      try {
-        DeterminizeStar(ifst, &global_index, kDelta, NULL, max_states);
-      } catch(const std::exception &e) {
-        KALDI_WARN << e.what()
-                   << " (should affect speed of search but not results)";
+      if (!merged) {
+        try {
+          DeterminizeStar(ifst, &global_index, kDelta, NULL, max_states);
+        } catch(const std::exception &e) {
+          KALDI_WARN << e.what()
+                     << " (should affect speed of search but not results)";
+          global_index = ifst;
+        }
+      } else {
         global_index = ifst;
       }
       Minimize(&global_index);
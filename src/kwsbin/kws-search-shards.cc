@@ -0,0 +1,198 @@
+// kwsbin/kws-search-shards.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "fstext/kaldi-fst-io.h"
+#include "kws/kws-sharded-index.h"
+#include "thread/kaldi-task-sequence.h"
+
+namespace kaldi {
+
+/// Searches for one keyword in all the shards; the results are written, in
+/// the order of the keywords, by the destructor.
+class KwsSearchShardsTask {
+ public:
+  KwsSearchShardsTask(const std::vector<KwsIndexShard*> &shards,
+                      const std::string &key,
+                      const fst::StdVectorFst &keyword,
+                      int32 n_best, int32 keyword_nbest, double keyword_beam,
+                      double negative_tolerance,
+                      TableWriter<BasicVectorHolder<double> > *result_writer,
+                      int32 *n_done):
+      shards_(shards), key_(key), keyword_(keyword), n_best_(n_best),
+      keyword_nbest_(keyword_nbest), keyword_beam_(keyword_beam),
+      negative_tolerance_(negative_tolerance), result_writer_(result_writer),
+      n_done_(n_done) { }
+
+  void operator () () {
+    // Process the case where we have confusion for keywords
+    if (keyword_beam_ != -1)
+      fst::Prune(&keyword_, keyword_beam_);
+    if (keyword_nbest_ != -1) {
+      fst::StdVectorFst tmp;
+      fst::ShortestPath(keyword_, &tmp, keyword_nbest_, true, true);
+      keyword_ = tmp;
+    }
+    unordered_map<std::pair<int32, int32>, KwsSearchResult,
+                  PairHasher<int32> > results;
+    for (size_t i = 0; i < shards_.size(); i++)
+      shards_[i]->Search(keyword_, &results);
+    for (unordered_map<std::pair<int32, int32>, KwsSearchResult,
+                       PairHasher<int32> >::const_iterator iter =
+             results.begin(); iter != results.end(); ++iter)
+      results_.push_back(iter->second);
+    std::sort(results_.begin(), results_.end());
+    if (n_best_ != -1 && results_.size() > static_cast<size_t>(n_best_))
+      results_.resize(n_best_);
+  }
+
+  ~KwsSearchShardsTask() {
+    // No result found
+    if (results_.empty())
+      return;
+    for (size_t i = 0; i < results_.size(); i++) {
+      double score = results_[i].score;
+      if (score < 0) {
+        if (score < negative_tolerance_) {
+          KALDI_WARN << "Score out of expected range: " << score;
+        }
+        score = 0.0;
+      }
+      std::vector<double> result;
+      result.push_back(results_[i].utt_id);
+      result.push_back(results_[i].tbeg);
+      result.push_back(results_[i].tend);
+      result.push_back(score);
+      result_writer_->Write(key_, result);
+    }
+    (*n_done_)++;
+  }
+
+ private:
+  const std::vector<KwsIndexShard*> &shards_;
+  std::string key_;
+  fst::StdVectorFst keyword_;
+  int32 n_best_;
+  int32 keyword_nbest_;
+  double keyword_beam_;
+  double negative_tolerance_;
+  TableWriter<BasicVectorHolder<double> > *result_writer_;
+  int32 *n_done_;
+  std::vector<KwsSearchResult> results_;
+};
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Search the keywords over a sharded index, as written by\n"
+        "kws-index-to-shards; the results are the same as those of\n"
+        "kws-search on the corresponding index.  The shards are\n"
+        "memory-mapped, so only the parts of them that are searched are read\n"
+        "from disk, and keywords are searched for in parallel if\n"
+        "--num-threads > 1.  The output is in the same format as kws-search:\n"
+        "kw utterance_id beg_frame end_frame negated_log_probs\n"
+        " e.g.: KW1 1 23 67 0.6074219\n"
+        "\n"
+        "Usage: kws-search-shards [options] <keywords-rspecifier> "
+        "<results-wspecifier> <shard-rxfilename-1> "
+        "[<shard-rxfilename-2> ...]\n"
+        " e.g.: kws-search-shards ark:keywords.fsts ark:results shard.*\n";
+
+    ParseOptions po(usage);
+
+    int32 n_best = -1;
+    int32 keyword_nbest = -1;
+    bool strict = true;
+    double negative_tolerance = -0.1;
+    double keyword_beam = -1;
+    bool use_mmap = true;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+
+    po.Register("nbest", &n_best, "Return the best n hypotheses.");
+    po.Register("keyword-nbest", &keyword_nbest,
+                "Pick the best n keywords if the FST contains multiple "
+                "keywords.");
+    po.Register("strict", &strict, "Affects the return status of the "
+                "program.");
+    po.Register("negative-tolerance", &negative_tolerance,
+                "The program will print a warning if we get negative score "
+                "smaller than this tolerance.");
+    po.Register("keyword-beam", &keyword_beam,
+                "Prune the FST with the given beam if the FST contains "
+                "multiple keywords.");
+    po.Register("use-mmap", &use_mmap, "If true, memory-map the shards if "
+                "they are ordinary files; otherwise read them into memory.");
+    sequencer_config.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (n_best < 0 && n_best != -1)
+      KALDI_ERR << "Bad number for nbest";
+    if (keyword_nbest < 0 && keyword_nbest != -1)
+      KALDI_ERR << "Bad number for keyword-nbest";
+    if (keyword_beam < 0 && keyword_beam != -1)
+      KALDI_ERR << "Bad number for keyword-beam";
+
+    if (po.NumArgs() < 3) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string keyword_rspecifier = po.GetArg(1),
+        result_wspecifier = po.GetArg(2);
+
+    std::vector<KwsIndexShard*> shards;
+    for (int32 i = 3; i <= po.NumArgs(); i++) {
+      shards.push_back(new KwsIndexShard());
+      shards.back()->Read(po.GetArg(i), use_mmap);
+    }
+
+    SequentialTableReader<VectorFstHolder> keyword_reader(keyword_rspecifier);
+    TableWriter<BasicVectorHolder<double> > result_writer(result_wspecifier);
+
+    int32 n_done = 0;
+    {
+      TaskSequencer<KwsSearchShardsTask> sequencer(sequencer_config);
+      for (; !keyword_reader.Done(); keyword_reader.Next()) {
+        sequencer.Run(new KwsSearchShardsTask(
+            shards, keyword_reader.Key(), keyword_reader.Value(), n_best,
+            keyword_nbest, keyword_beam, negative_tolerance, &result_writer,
+            &n_done));
+      }
+      sequencer.Wait();
+    }
+    DeletePointers(&shards);
+
+    KALDI_LOG << "Done " << n_done << " keywords";
+    if (strict == true)
+      return (n_done != 0 ? 0 : 1);
+    else
+      return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -22,6 +22,7 @@
 #include "util/common-utils.h"
 #include "fstext/kaldi-fst-io.h"
 #include "kws/kaldi-kws.h"
+#include "kws/kws-batch-search.h"
 
 namespace kaldi {
 
@@ -99,7 +100,8 @@ int main(int argc, char *argv[]) {
     bool strict = true;
     double negative_tolerance = -0.1;
     double keyword_beam = -1;
-    
+    bool batch = false;
+
     po.Register("nbest", &n_best, "Return the best n hypotheses.");
     po.Register("keyword-nbest", &keyword_nbest,
                 "Pick the best n keywords if the FST contains multiple keywords.");
@@ -109,6 +111,10 @@ int main(int argc, char *argv[]) {
                 "than this tolerance.");
     po.Register("keyword-beam", &keyword_beam,
                 "Prune the FST with the given beam if the FST contains multiple keywords.");
+    po.Register("batch", &batch, "If true, read all the keywords first and "
+                "search for them together in one traversal of the index, "
+                "sharing the work for common prefixes.  The results are the "
+                "same; this is much faster for large keyword lists.");
 
     if (n_best < 0 && n_best != -1) {
       KALDI_ERR << "Bad number for nbest";
@@ -140,6 +146,73 @@ int main(int argc, char *argv[]) {
 
     // Index has key "global"
     KwsLexicographicFst index = index_reader.Value("global");
+
+    if (batch) {
+      std::vector<std::string> keys;
+      KwsKeywordTrie trie;
+      int32 n_cyclic = 0;
+      for (; !keyword_reader.Done(); keyword_reader.Next()) {
+        VectorFst<StdArc> keyword = keyword_reader.Value();
+        keyword_reader.FreeCurrent();
+        if (keyword_beam != -1) {
+          Prune(&keyword, keyword_beam);
+        }
+        if (keyword_nbest != -1) {
+          VectorFst<StdArc> tmp;
+          ShortestPath(keyword, &tmp, keyword_nbest, true, true);
+          keyword = tmp;
+        }
+        if (!trie.AddKeyword(keys.size(), keyword)) {
+          KALDI_WARN << "Keyword " << keyword_reader.Key() << " is cyclic, "
+                     << "which --batch=true does not support; skipping it.";
+          n_cyclic++;
+        }
+        keys.push_back(keyword_reader.Key());
+      }
+      KALDI_LOG << "Searching for " << keys.size() << " keywords, with "
+                << trie.NumNodes() << " prefixes";
+      ArcSort(&index, fst::ILabelCompare<KwsLexicographicArc>());
+      std::vector<unordered_map<std::pair<int32, int32>, KwsSearchResult,
+                                PairHasher<int32> > > batch_results;
+      SearchKwsIndexBatch(index, trie, &batch_results);
+
+      int32 n_done = 0;
+      for (size_t i = 0; i < batch_results.size(); i++) {
+        if (batch_results[i].empty()) continue;
+        std::vector<KwsSearchResult> results;
+        for (unordered_map<std::pair<int32, int32>, KwsSearchResult,
+                           PairHasher<int32> >::const_iterator iter =
+                 batch_results[i].begin(); iter != batch_results[i].end();
+             ++iter)
+          results.push_back(iter->second);
+        std::sort(results.begin(), results.end());
+        if (n_best != -1 && results.size() > static_cast<size_t>(n_best))
+          results.resize(n_best);
+        for (size_t j = 0; j < results.size(); j++) {
+          double score = results[j].score;
+          if (score < 0) {
+            if (score < negative_tolerance) {
+              KALDI_WARN << "Score out of expected range: " << score;
+            }
+            score = 0.0;
+          }
+          vector<double> result;
+          result.push_back(results[j].utt_id);
+          result.push_back(results[j].tbeg);
+          result.push_back(results[j].tend);
+          result.push_back(score);
+          result_writer.Write(keys[i], result);
+        }
+        n_done++;
+      }
+      KALDI_LOG << "Done " << n_done << " keywords";
+      if (n_cyclic != 0)
+        KALDI_WARN << n_cyclic << " cyclic keywords were skipped.";
+      if (strict == true)
+        return (n_done != 0 ? 0 : 1);
+      else
+        return 0;
+    }
     
     // First we have to remove the disambiguation symbols. But rather than
     // removing them totally, we actually move them from input side to output
@@ -27,6 +27,148 @@
 #include "kws/kaldi-kws.h"
 #include "kws/kws-functions.h"
 #include "fstext/epsilon-property.h"
+#include "thread/kaldi-task-sequence.h"
+
+namespace kaldi {
+
+/// Builds the index of one lattice; the index is written, in order, by the
+/// destructor.
+class LatticeToKwsIndexTask {
+ public:
+  LatticeToKwsIndexTask(const std::string &key,
+                        const CompactLattice &clat,
+                        int32 utterance_id,
+                        int32 max_silence_frames,
+                        int32 max_states,
+                        bool allow_partial,
+                        TableWriter<fst::VectorFstTplHolder<
+                          KwsLexicographicArc> > *index_writer,
+                        int32 *n_done, int32 *n_fail):
+      key_(key), clat_(clat), utterance_id_(utterance_id),
+      max_silence_frames_(max_silence_frames), max_states_(max_states),
+      allow_partial_(allow_partial), index_writer_(index_writer),
+      success_(false), n_done_(n_done), n_fail_(n_fail) { }
+
+  void operator () () {
+    KALDI_LOG << "Processing lattice " << key_;
+
+    // Topologically sort the lattice, if not already sorted.
+    uint64 props = clat_.Properties(fst::kFstProperties, false);
+    if (!(props & fst::kTopSorted)) {
+      if (fst::TopSort(&clat_) == false) {
+        KALDI_WARN << "Cycles detected in lattice " << key_;
+        return;
+      }
+    }
+
+    // Get the alignments
+    vector<int32> state_times;
+    CompactLatticeStateTimes(clat_, &state_times);
+
+    // Cluster the arcs in the CompactLattice, write the cluster_id on the
+    // output label side.
+    // ClusterLattice() corresponds to the second part of the preprocessing in
+    // Dogan and Murat's paper -- clustering. Note that we do the first part
+    // of preprocessing (the weight pushing step) later when generating the
+    // factor transducer.
+    KALDI_VLOG(1) << "Arc clustering...";
+    bool success = false;
+    success = ClusterLattice(&clat_, state_times);
+    if (!success) {
+      KALDI_WARN << "State id's and alignments do not match for lattice "
+                 << key_;
+      return;
+    }
+
+    // The next part is something new, not in the Dogan and Can paper.  It is
+    // necessary because we have epsilon arcs, due to silences, in our
+    // lattices.  We modify the factor transducer, while maintaining
+    // equivalence, to ensure that states don't have both epsilon *and*
+    // non-epsilon arcs entering them.  (and the same, with "entering"
+    // replaced with "leaving").  Later we will find out which states have
+    // non-epsilon arcs leaving/entering them and use it to be more selective
+    // in adding arcs to connect them with the initial/final states.  The goal
+    // here is to disallow silences at the beginning or ending of a keyword
+    // occurrence.
+    if (true) {
+      EnsureEpsilonProperty(&clat_);
+      fst::TopSort(&clat_);
+      // We have to recompute the state times because they will have changed.
+      CompactLatticeStateTimes(clat_, &state_times);    
+    }
+
+    // Generate factor transducer
+    // CreateFactorTransducer() corresponds to the "Factor Generation" part of
+    // Dogan and Murat's paper. But we also move the weight pushing step to
+    // this function as we have to compute the alphas and betas anyway.
+    KALDI_VLOG(1) << "Generating factor transducer...";
+    KwsProductFst factor_transducer;
+    success = CreateFactorTransducer(clat_, state_times, utterance_id_,
+                                     &factor_transducer);
+    if (!success) {
+      KALDI_WARN << "Cannot generate factor transducer for lattice " << key_;
+      return;
+    }
+
+    MaybeDoSanityCheck(factor_transducer);
+
+    // Remove long silence arc
+    // We add the filtering step in our implementation. This is because gap
+    // between two successive words in a query term should be less than 0.5s
+    KALDI_VLOG(1) << "Removing long silence...";
+    RemoveLongSilences(max_silence_frames_, state_times, &factor_transducer);
+
+    MaybeDoSanityCheck(factor_transducer);
+
+    // Do factor merging, and return a transducer in T*T*T semiring. This step
+    // corresponds to the "Factor Merging" part in Dogan and Murat's paper.
+    KALDI_VLOG(1) << "Merging factors...";
+    DoFactorMerging(&factor_transducer, &index_transducer_);
+
+    MaybeDoSanityCheck(index_transducer_);
+
+    // Do factor disambiguation. It corresponds to the "Factor Disambiguation"
+    // step in Dogan and Murat's paper.
+    KALDI_VLOG(1) << "Doing factor disambiguation...";
+    DoFactorDisambiguation(&index_transducer_);
+
+    MaybeDoSanityCheck(index_transducer_);
+
+    // Optimize the above factor transducer. It corresponds to the
+    // "Optimization" step in the paper.
+    KALDI_VLOG(1) << "Optimizing factor transducer...";
+    OptimizeFactorTransducer(&index_transducer_, max_states_, allow_partial_);
+
+    MaybeDoSanityCheck(index_transducer_);
+
+    success_ = true;
+  }
+
+  ~LatticeToKwsIndexTask() {
+    if (success_) {
+      // Write result
+      index_writer_->Write(key_, index_transducer_);
+      (*n_done_)++;
+    } else {
+      (*n_fail_)++;
+    }
+  }
+
+ private:
+  std::string key_;
+  CompactLattice clat_;
+  int32 utterance_id_;
+  int32 max_silence_frames_;
+  int32 max_states_;
+  bool allow_partial_;
+  TableWriter<fst::VectorFstTplHolder<KwsLexicographicArc> > *index_writer_;
+  KwsLexicographicFst index_transducer_;
+  bool success_;
+  int32 *n_done_;
+  int32 *n_fail_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -40,6 +182,8 @@ int main(int argc, char *argv[]) {
         "semiring. For details for the semiring, please refer to Dogan Can and Muran Saraclar's"
         "lattice indexing paper."
         "\n"
+        "Lattices are processed in parallel if --num-threads > 1.\n"
+        "\n"
         "Usage: lattice-to-kws-index [options]  utter-symtab-rspecifier lattice-rspecifier index-wspecifier\n"
         " e.g.: lattice-to-kws-index ark:utter.symtab ark:1.lats ark:global.idx\n";
 
@@ -59,6 +203,8 @@ int main(int argc, char *argv[]) {
                 "limit on the number of states.");
     po.Register("allow-partial", &allow_partial, "Allow partial output if fails"
                 " to determinize, otherwise skip determinization if it fails.");
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -81,123 +227,36 @@ int main(int argc, char *argv[]) {
 
     int32 n_done = 0;
     int32 n_fail = 0;
+    // n_fail is also updated by the tasks, so we count these separately.
+    int32 n_no_id = 0;
 
     int32 max_states = -1;
 
-    for (; !clat_reader.Done(); clat_reader.Next()) {
-      std::string key = clat_reader.Key();
-      CompactLattice clat = clat_reader.Value();
-      clat_reader.FreeCurrent();
-      KALDI_LOG << "Processing lattice " << key;
-
-      if (max_states_scale > 0) {
-        max_states = static_cast<int32>(
-            max_states_scale * static_cast<BaseFloat>(clat.NumStates()));
-      }
+    {
+      TaskSequencer<LatticeToKwsIndexTask> sequencer(sequencer_config);
+      for (; !clat_reader.Done(); clat_reader.Next()) {
+        std::string key = clat_reader.Key();
+        const CompactLattice &clat = clat_reader.Value();
 
-      // Check if we have the corresponding utterance id.
-      if (!usymtab_reader.HasKey(key)) {
-        KALDI_WARN << "Cannot find utterance id for " << key;
-        n_fail++;
-        continue;
-      }
+        if (max_states_scale > 0) {
+          max_states = static_cast<int32>(
+              max_states_scale * static_cast<BaseFloat>(clat.NumStates()));
+        }
 
-      // Topologically sort the lattice, if not already sorted.
-      uint64 props = clat.Properties(fst::kFstProperties, false);
-      if (!(props & fst::kTopSorted)) {
-        if (fst::TopSort(&clat) == false) {
-          KALDI_WARN << "Cycles detected in lattice " << key;
-          n_fail++;
+        // Check if we have the corresponding utterance id.
+        if (!usymtab_reader.HasKey(key)) {
+          KALDI_WARN << "Cannot find utterance id for " << key;
+          n_no_id++;
           continue;
         }
-      } 
-
-      // Get the alignments
-      vector<int32> state_times;
-      CompactLatticeStateTimes(clat, &state_times);
-
-      // Cluster the arcs in the CompactLattice, write the cluster_id on the
-      // output label side.
-      // ClusterLattice() corresponds to the second part of the preprocessing in
-      // Dogan and Murat's paper -- clustering. Note that we do the first part
-      // of preprocessing (the weight pushing step) later when generating the
-      // factor transducer.
-      KALDI_VLOG(1) << "Arc clustering...";
-      bool success = false;
-      success = ClusterLattice(&clat, state_times);
-      if (!success) {
-        KALDI_WARN << "State id's and alignments do not match for lattice " << key;
-        n_fail++;
-        continue;
-      }
 
-      // The next part is something new, not in the Dogan and Can paper.  It is
-      // necessary because we have epsilon arcs, due to silences, in our
-      // lattices.  We modify the factor transducer, while maintaining
-      // equivalence, to ensure that states don't have both epsilon *and*
-      // non-epsilon arcs entering them.  (and the same, with "entering"
-      // replaced with "leaving").  Later we will find out which states have
-      // non-epsilon arcs leaving/entering them and use it to be more selective
-      // in adding arcs to connect them with the initial/final states.  The goal
-      // here is to disallow silences at the beginning or ending of a keyword
-      // occurrence.
-      if (true) {
-        EnsureEpsilonProperty(&clat);
-        fst::TopSort(&clat);
-        // We have to recompute the state times because they will have changed.
-        CompactLatticeStateTimes(clat, &state_times);        
-      }
-      
-      // Generate factor transducer
-      // CreateFactorTransducer() corresponds to the "Factor Generation" part of
-      // Dogan and Murat's paper. But we also move the weight pushing step to
-      // this function as we have to compute the alphas and betas anyway.
-      KALDI_VLOG(1) << "Generating factor transducer...";
-      KwsProductFst factor_transducer;
-      int32 utterance_id = usymtab_reader.Value(key);
-      success = CreateFactorTransducer(clat, state_times, utterance_id, &factor_transducer);
-      if (!success) {
-        KALDI_WARN << "Cannot generate factor transducer for lattice " << key;
-        n_fail++; 
+        sequencer.Run(new LatticeToKwsIndexTask(
+            key, clat, usymtab_reader.Value(key), max_silence_frames,
+            max_states, allow_partial, &index_writer, &n_done, &n_fail));
       }
-
-      MaybeDoSanityCheck(factor_transducer);
-
-      // Remove long silence arc
-      // We add the filtering step in our implementation. This is because gap
-      // between two successive words in a query term should be less than 0.5s
-      KALDI_VLOG(1) << "Removing long silence...";
-      RemoveLongSilences(max_silence_frames, state_times, &factor_transducer);
-
-      MaybeDoSanityCheck(factor_transducer);
-
-      // Do factor merging, and return a transducer in T*T*T semiring. This step
-      // corresponds to the "Factor Merging" part in Dogan and Murat's paper.
-      KALDI_VLOG(1) << "Merging factors...";
-      KwsLexicographicFst index_transducer;
-      DoFactorMerging(&factor_transducer, &index_transducer);
-
-      MaybeDoSanityCheck(index_transducer);
-      
-      // Do factor disambiguation. It corresponds to the "Factor Disambiguation"
-      // step in Dogan and Murat's paper.
-      KALDI_VLOG(1) << "Doing factor disambiguation...";
-      DoFactorDisambiguation(&index_transducer);
-
-      MaybeDoSanityCheck(index_transducer);
-
-      // Optimize the above factor transducer. It corresponds to the
-      // "Optimization" step in the paper.
-      KALDI_VLOG(1) << "Optimizing factor transducer...";
-      OptimizeFactorTransducer(&index_transducer, max_states, allow_partial);
-
-      MaybeDoSanityCheck(index_transducer);      
-      
-      // Write result
-      index_writer.Write(key, index_transducer);  
-
-      n_done++;
+      sequencer.Wait();
     }
+    n_fail += n_no_id;
 
     KALDI_LOG << "Done " << n_done << " lattices, failed for " << n_fail;
     if (strict == true)
@@ -160,6 +160,47 @@ template<class Arc> void TestDeterminizeLatticePruned2() {
   }
 }
 
+// test that determinizing a lattice in pieces, with
+// DeterminizeLatticePhonePrunedChunked(), gives the same result as
+// determinizing the whole of it.
+void TestDeterminizeLatticePhonePrunedChunked() {
+  using kaldi::Lattice;
+  using kaldi::CompactLattice;
+  kaldi::TransitionModel trans_model;  // not used without phone_determinize.
+  RandFstOptions opts;
+  opts.acyclic = true;
+  opts.allow_empty = false;
+  opts.weight_multiplier = 0.5;
+  for (int i = 0; i < 50; i++) {
+    // Concatenating random lattices gives states that all paths go through.
+    Lattice lat;
+    int num_parts = 1 + kaldi::Rand() % 5;
+    for (int j = 0; j < num_parts; j++) {
+      Lattice *part = RandPairFst<kaldi::LatticeArc>(opts);
+      if (j == 0)
+        lat = *part;
+      else
+        Concat(&lat, *part);
+      delete part;
+    }
+    Connect(&lat);
+    if (lat.NumStates() == 0 || !TopSort(&lat))
+      continue;
+    DeterminizeLatticePhonePrunedOptions det_opts;
+    det_opts.phone_determinize = false;
+    Lattice lat_copy(lat);
+    CompactLattice clat1, clat2;
+    bool ans1 = DeterminizeLatticePhonePrunedWrapper(trans_model, &lat_copy,
+                                                     1000.0, &clat1, det_opts);
+    det_opts.chunk_frames = kaldi::Rand() % 3;
+    det_opts.num_threads = 1 + kaldi::Rand() % 3;
+    bool ans2 = DeterminizeLatticePhonePrunedChunked(trans_model, &lat,
+                                                     1000.0, &clat2, det_opts);
+    if (ans1 && ans2)
+      KALDI_ASSERT(RandEquivalent(clat1, clat2, 5/*paths*/, 0.01/*delta*/,
+                                  kaldi::Rand()/*seed*/, 100/*path length*/));
+  }
+}
 
 } // end namespace fst
 
@@ -167,5 +208,6 @@ int main() {
   using namespace fst;
   TestDeterminizeLatticePruned<kaldi::LatticeArc>();
   TestDeterminizeLatticePruned2<kaldi::LatticeArc>();
+  TestDeterminizeLatticePhonePrunedChunked();
   std::cout << "Tests succeeded\n";
 }
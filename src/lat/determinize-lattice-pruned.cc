@@ -38,6 +38,9 @@ using std::tr1::unordered_map;
 #include "lat/minimize-lattice.h"   // for minimization
 #include "lat/push-lattice.h"       // for minimization
 #include "lat/determinize-lattice-pruned.h"
+#include "thread/kaldi-thread.h"
+#include "base/kaldi-memory-stats.h"
+#include "base/kaldi-trace.h"
 
 namespace fst {
 
@@ -200,7 +203,8 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
                             DeterminizeLatticePrunedOptions opts):
       num_arcs_(0), num_elems_(0), ifst_(ifst.Copy()), beam_(beam), opts_(opts),
       equal_(opts_.delta), determinized_(false),
-      minimal_hash_(3, hasher_, equal_), initial_hash_(3, hasher_, equal_) {
+      minimal_hash_(3, hasher_, equal_), initial_hash_(3, hasher_, equal_),
+      subset_pool_used_(0), subset_pool_block_size_(0) {
     KALDI_ASSERT(Weight::Properties() & kIdempotent); // this algorithm won't
     // work correctly otherwise.
   }
@@ -226,10 +230,12 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
       empty_subset.swap(output_states_[i]->minimal_subset);
     }
     
-    for (typename InitialSubsetHash::iterator iter = initial_hash_.begin();
-         iter != initial_hash_.end(); ++iter)
-      delete iter->first;
     { InitialSubsetHash tmp; tmp.swap(initial_hash_); }
+    for (size_t i = 0; i < subset_pool_.size(); i++)
+      delete [] subset_pool_[i];
+    { vector<Element*> tmp; tmp.swap(subset_pool_); }
+    subset_pool_used_ = 0;
+    subset_pool_block_size_ = 0;
     for (size_t i = 0; i < output_states_.size(); i++) {
       vector<Element> tmp;
       tmp.swap(output_states_[i]->minimal_subset);
@@ -282,9 +288,8 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     for (typename InitialSubsetHash::const_iterator
              iter = initial_hash_.begin();
          iter != initial_hash_.end(); ++iter) {
-      const vector<Element> &vec = *(iter->first);
       Element elem = iter->second;
-      AddStrings(vec, &needed_strings);
+      AddStrings(iter->first, &needed_strings);
       needed_strings.push_back(elem.string);
     }
     std::sort(needed_strings.begin(), needed_strings.end());
@@ -297,21 +302,31 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   }
   
   bool CheckMemoryUsage() {
-    int32 repo_size = repository_.MemSize(),
-        arcs_size = num_arcs_ * sizeof(TempArc),
-        elems_size = num_elems_ * sizeof(Element),
+    // The Elements of the subsets are counted in num_elems_; on top of that,
+    // each subset has a key in a hash (the Elements of the keys of
+    // initial_hash_ are in subset_pool_; those of minimal_hash_ are in the
+    // OutputStates).  We use int64 because for big lattices the sizes can
+    // exceed 2GB.
+    int64 repo_size = repository_.MemSize(),
+        arcs_size = static_cast<int64>(num_arcs_) * sizeof(TempArc),
+        elems_size = static_cast<int64>(num_elems_) * sizeof(Element) +
+        static_cast<int64>(minimal_hash_.size()) *
+        (sizeof(SubsetRef) + sizeof(OutputStateId)) +
+        static_cast<int64>(initial_hash_.size()) *
+        (sizeof(SubsetRef) + sizeof(Element)),
         total_size = repo_size + arcs_size + elems_size;
+    memory_stats_.Set(total_size);
     if (opts_.max_mem > 0 && total_size > opts_.max_mem) { // We passed the memory threshold.
       // This is usually due to the repository getting large, so we
       // clean this out.
       RebuildRepository();
-      int32 new_repo_size = repository_.MemSize(),
+      int64 new_repo_size = repository_.MemSize(),
           new_total_size = new_repo_size + arcs_size + elems_size;
 
       KALDI_VLOG(2) << "Rebuilt repository in determinize-lattice: repository shrank from "
                     << repo_size << " to " << new_repo_size << " bytes (approximately)";
       
-      if (new_total_size > static_cast<int32>(opts_.max_mem * 0.8)) {
+      if (new_total_size > static_cast<int64>(opts_.max_mem * 0.8)) {
         // Rebuilding didn't help enough-- we need a margin to stop
         // having to rebuild too often.  We'll just return to the user at
         // this point, with a partial lattice that's pruned tighter than
@@ -423,8 +438,24 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     Weight weight;
   };
 
+  // A subset of Elements, stored elsewhere: in the minimal_subset of an
+  // OutputState (for the keys of minimal_hash_), or in subset_pool_ (for the
+  // keys of initial_hash_).  Using this as the key of the hashes, rather than
+  // a pointer to a vector<Element> allocated for each key, saves an allocation
+  // (and the vector's own overhead) for each subset.
+  struct SubsetRef {
+    const Element *elems;
+    size_t size;
+  };
+
+  static SubsetRef MakeRef(const vector<Element> &subset) {
+    SubsetRef ans;
+    ans.elems = (subset.empty() ? NULL : &(subset[0]));
+    ans.size = subset.size();
+    return ans;
+  }
+
   // Hashing function used in hash of subsets.
-  // A subset is a pointer to vector<Element>.
   // The Elements are in sorted order on state id, and without repeated states.
   // Because the order of Elements is fixed, we can use a hashing function that is
   // order-dependent.  However the weights are not included in the hashing function--
@@ -438,9 +469,10 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
 
   class SubsetKey {
    public:
-    size_t operator ()(const vector<Element> * subset) const {  // hashes only the state and string.
+    size_t operator ()(const SubsetRef &subset) const {  // hashes only the state and string.
       size_t hash = 0, factor = 1;
-      for (typename vector<Element>::const_iterator iter= subset->begin(); iter != subset->end(); ++iter) {
+      for (const Element *iter = subset.elems, *end = subset.elems + subset.size;
+           iter != end; ++iter) {
         hash *= factor;
         hash += iter->state + reinterpret_cast<size_t>(iter->string);
         factor *= 23531;  // these numbers are primes.
@@ -453,12 +485,11 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   // and string, and approximate match on weights.
   class SubsetEqual {
    public:
-    bool operator ()(const vector<Element> * s1, const vector<Element> * s2) const {
-      size_t sz = s1->size();
-      KALDI_ASSERT(sz>=0);
-      if (sz != s2->size()) return false;
-      typename vector<Element>::const_iterator iter1 = s1->begin(),
-          iter1_end = s1->end(), iter2=s2->begin();
+    bool operator ()(const SubsetRef &s1, const SubsetRef &s2) const {
+      size_t sz = s1.size;
+      if (sz != s2.size) return false;
+      const Element *iter1 = s1.elems, *iter1_end = s1.elems + sz,
+          *iter2 = s2.elems;
       for (; iter1 < iter1_end; ++iter1, ++iter2) {
         if (iter1->state != iter2->state ||
            iter1->string != iter2->string ||
@@ -475,12 +506,11 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   // Used only for debug.
   class SubsetEqualStates {
    public:
-    bool operator ()(const vector<Element> * s1, const vector<Element> * s2) const {
-      size_t sz = s1->size();
-      KALDI_ASSERT(sz>=0);
-      if (sz != s2->size()) return false;
-      typename vector<Element>::const_iterator iter1 = s1->begin(),
-          iter1_end = s1->end(), iter2=s2->begin();
+    bool operator ()(const SubsetRef &s1, const SubsetRef &s2) const {
+      size_t sz = s1.size;
+      if (sz != s2.size) return false;
+      const Element *iter1 = s1.elems, *iter1_end = s1.elems + sz,
+          *iter2 = s2.elems;
       for (; iter1 < iter1_end; ++iter1, ++iter2) {
         if (iter1->state != iter2->state) return false;
       }
@@ -490,7 +520,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
 
   // Define the hash type we use to map subsets (in minimal
   // representation) to OutputStateId.
-  typedef unordered_map<const vector<Element>*, OutputStateId,
+  typedef unordered_map<SubsetRef, OutputStateId,
                         SubsetKey, SubsetEqual> MinimalSubsetHash;
 
   // Define the hash type we use to map subsets (in initial
@@ -498,7 +528,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   // extra weight. [note: we interpret the Element.state in here
   // as an OutputStateId even though it's declared as InputStateId;
   // these types are the same anyway].
-  typedef unordered_map<const vector<Element>*, Element,
+  typedef unordered_map<SubsetRef, Element,
                         SubsetKey, SubsetEqual> InitialSubsetHash;
   
 
@@ -527,7 +557,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   OutputStateId MinimalToStateId(const vector<Element> &subset,
                                  const double forward_cost) {
     typename MinimalSubsetHash::const_iterator iter
-        = minimal_hash_.find(&subset);
+        = minimal_hash_.find(MakeRef(subset));
     if (iter != minimal_hash_.end()) { // Found a matching subset.
       OutputStateId state_id = iter->second;
       const OutputState &state = *(output_states_[state_id]);
@@ -538,10 +568,13 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
                    << forward_cost << ", "
                    << state.forward_cost;
       }
+      return state_id;
     }
     OutputStateId state_id = static_cast<OutputStateId>(output_states_.size());
     OutputState *new_state = new OutputState(subset, forward_cost);
-    minimal_hash_[&(new_state->minimal_subset)] = state_id;
+    // The key refers to new_state->minimal_subset, which is not changed until
+    // FreeMostMemory() (after minimal_hash_ has been cleared).
+    minimal_hash_[MakeRef(new_state->minimal_subset)] = state_id;
     output_states_.push_back(new_state);
     num_elems_ += subset.size();
     // Note: in the previous algorithm, we pushed the new state-id onto the queue
@@ -560,7 +593,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
                                  Weight *remaining_weight,
                                  StringId *common_prefix) {
     typename InitialSubsetHash::const_iterator iter
-        = initial_hash_.find(&subset_in);
+        = initial_hash_.find(MakeRef(subset_in));
     if (iter != initial_hash_.end()) { // Found a matching subset.
       const Element &elem = iter->second;
       *remaining_weight = elem.weight;
@@ -594,10 +627,9 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     // Before returning "ans", add the initial subset to the hash,
     // so that we can bypass the epsilon-closure etc., next time
     // we process the same initial subset.
-    vector<Element> *initial_subset_ptr = new vector<Element>(subset_in);
     elem.state = ans;
-    initial_hash_[initial_subset_ptr] = elem;
-    num_elems_ += initial_subset_ptr->size(); // keep track of memory usage.
+    initial_hash_[CopyToPool(subset_in)] = elem;
+    num_elems_ += subset_in.size(); // keep track of memory usage.
     return ans;
   }
 
@@ -1099,7 +1131,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
       output_states_.push_back(initial_state);
       num_elems_ += subset.size();
       OutputStateId initial_state_id = 0;
-      minimal_hash_[&(initial_state->minimal_subset)] = initial_state_id;
+      minimal_hash_[MakeRef(initial_state->minimal_subset)] = initial_state_id;
       ProcessFinal(initial_state_id);
       ProcessTransitions(initial_state_id); // this will add tasks to
       // the queue, which we'll start processing in Determinize().
@@ -1129,6 +1161,9 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   int num_arcs_; // keep track of memory usage: number of arcs in output_states_[ ]->arcs
   int num_elems_; // keep track of memory usage: number of elems in output_states_ and
   // the keys of initial_hash_
+  // The memory usage as of the last CheckMemoryUsage(), for the memory
+  // statistics.
+  kaldi::MemoryStatsEstimate memory_stats_;
   
   const ExpandedFst<Arc> *ifst_;
   std::vector<double> backward_costs_; // This vector stores, for every state in ifst_,
@@ -1147,8 +1182,8 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   // sure this object is used correctly.
   MinimalSubsetHash minimal_hash_;  // hash from Subset to OutputStateId.  Subset is "minimal
                                     // representation" (only include final and states and states with
-                                    // nonzero ilabel on arc out of them.  Owns the pointers
-                                    // in its keys.
+                                    // nonzero ilabel on arc out of them.  Its keys point
+                                    // to the minimal_subset of the OutputStates.
   InitialSubsetHash initial_hash_;   // hash from Subset to Element, which
                                      // represents the OutputStateId together
                                      // with an extra weight and string.  Subset
@@ -1156,8 +1191,13 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
                                      // weight and string is needed because after
                                      // we convert to minimal representation and
                                      // normalize, there may be an extra weight
-                                     // and string.  Owns the pointers
-                                     // in its keys.
+                                     // and string.  Its keys point into
+                                     // subset_pool_.
+
+  vector<Element*> subset_pool_;  // blocks of memory holding the keys of
+                                  // initial_hash_ (see CopyToPool()).
+  size_t subset_pool_used_;  // number of Elements used in the last block.
+  size_t subset_pool_block_size_;  // size of the last block.
   
   struct Task {
     OutputStateId state; // State from which we're processing the transition.
@@ -1199,6 +1239,35 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
          iter != vec.end(); ++iter)
       needed_strings->push_back(iter->string);
   }
+
+  void AddStrings(const SubsetRef &subset,
+                  vector<StringId> *needed_strings) {
+    for (size_t i = 0; i < subset.size; i++)
+      needed_strings->push_back(subset.elems[i].string);
+  }
+
+  // Copies "subset" to subset_pool_, and returns a reference to the copy.  The
+  // pool is allocated in blocks of several thousand Elements, and never
+  // shrinks until FreeMostMemory(), since the keys of initial_hash_ are never
+  // removed.
+  SubsetRef CopyToPool(const vector<Element> &subset) {
+    size_t size = subset.size();
+    if (subset_pool_.empty() ||
+        subset_pool_used_ + size > subset_pool_block_size_) {
+      size_t block_size = 4096;
+      if (size > block_size) block_size = size;
+      subset_pool_.push_back(new Element[block_size]);
+      subset_pool_used_ = 0;
+      subset_pool_block_size_ = block_size;
+    }
+    Element *dest = subset_pool_.back() + subset_pool_used_;
+    std::copy(subset.begin(), subset.end(), dest);
+    subset_pool_used_ += size;
+    SubsetRef ans;
+    ans.elems = dest;
+    ans.size = size;
+    return ans;
+  }
 };
 
 
@@ -1212,6 +1281,8 @@ bool DeterminizeLatticePruned(
     double beam,
     MutableFst<ArcTpl<CompactLatticeWeightTpl<Weight, IntType> > >*ofst,
     DeterminizeLatticePrunedOptions opts) {
+  KALDI_TRACE_SCOPE("DeterminizeLatticePruned");
+  kaldi::MemoryTagScope memory_tag(kaldi::kMemoryLattice);
   ofst->SetInputSymbols(ifst.InputSymbols());
   ofst->SetOutputSymbols(ifst.OutputSymbols());
   if (ifst.NumStates() == 0) {
@@ -1263,6 +1334,8 @@ bool DeterminizeLatticePruned(const ExpandedFst<ArcTpl<Weight> > &ifst,
                               double beam,
                               MutableFst<ArcTpl<Weight> > *ofst,
                               DeterminizeLatticePrunedOptions opts) {
+  KALDI_TRACE_SCOPE("DeterminizeLatticePruned");
+  kaldi::MemoryTagScope memory_tag(kaldi::kMemoryLattice);
   typedef int32 IntType;
   ofst->SetInputSymbols(ifst.InputSymbols());
   ofst->SetOutputSymbols(ifst.OutputSymbols());
@@ -1500,6 +1573,11 @@ bool DeterminizeLatticePhonePrunedWrapper(
     double beam,
     MutableFst<kaldi::CompactLatticeArc> *ofst,
     DeterminizeLatticePhonePrunedOptions opts) {
+  KALDI_TRACE_SCOPE("DeterminizeLatticePhonePrunedWrapper");
+  kaldi::MemoryTagScope memory_tag(kaldi::kMemoryLattice);
+  if (opts.chunk_frames > 0)
+    return DeterminizeLatticePhonePrunedChunked(trans_model, ifst, beam, ofst,
+                                                opts);
   bool ans = true;
   Invert(ifst);
   if (ifst->Properties(fst::kTopSorted, true) == 0) {
@@ -1518,6 +1596,171 @@ bool DeterminizeLatticePhonePrunedWrapper(
   return ans;
 }
 
+// This class determinizes the pieces of a lattice in parallel, for
+// DeterminizeLatticePhonePrunedChunked().  Thread i does pieces i, i +
+// num_threads_, and so on.
+class DeterminizeLatticePiecesClass: public kaldi::MultiThreadable {
+ public:
+  DeterminizeLatticePiecesClass(
+      const kaldi::TransitionModel &trans_model, double beam,
+      const DeterminizeLatticePhonePrunedOptions &opts,
+      std::vector<kaldi::Lattice> *pieces,
+      std::vector<kaldi::CompactLattice> *clats,
+      std::vector<char> *success):
+      trans_model_(&trans_model), beam_(beam), opts_(opts), pieces_(pieces),
+      clats_(clats), success_(success) { }
+
+  void operator () () {
+    for (size_t i = thread_id_; i < pieces_->size(); i += num_threads_) {
+      (*success_)[i] = DeterminizeLatticePhonePrunedWrapper(
+          *trans_model_, &((*pieces_)[i]), beam_, &((*clats_)[i]), opts_);
+      (*pieces_)[i].DeleteStates();  // free the memory.
+    }
+  }
+
+ private:
+  const kaldi::TransitionModel *trans_model_;
+  double beam_;
+  DeterminizeLatticePhonePrunedOptions opts_;
+  std::vector<kaldi::Lattice> *pieces_;
+  std::vector<kaldi::CompactLattice> *clats_;
+  std::vector<char> *success_;
+};
+
+bool DeterminizeLatticePhonePrunedChunked(
+    const kaldi::TransitionModel &trans_model,
+    MutableFst<kaldi::LatticeArc> *ifst,
+    double beam,
+    MutableFst<kaldi::CompactLatticeArc> *ofst,
+    DeterminizeLatticePhonePrunedOptions opts) {
+  typedef kaldi::LatticeArc::StateId StateId;
+  typedef kaldi::LatticeArc::Weight Weight;
+  typedef kaldi::CompactLatticeArc::Weight CompactWeight;
+  KALDI_ASSERT(opts.num_threads > 0);
+  DeterminizeLatticePhonePrunedOptions piece_opts(opts);
+  piece_opts.chunk_frames = 0;
+
+  kaldi::Lattice lat(*ifst);
+  ifst->DeleteStates();
+  // PruneLattice() topologically sorts the lattice; after this and Connect(),
+  // the start state is state 0 and all states are on successful paths.
+  if (!kaldi::PruneLattice(beam, &lat))
+    return DeterminizeLatticePhonePrunedWrapper(trans_model, &lat, beam,
+                                                ofst, piece_opts);
+  Connect(&lat);
+  if (lat.Start() != 0 && !TopSort(&lat))
+    KALDI_ERR << "Topological sorting of state-level lattice failed.";
+  std::vector<int32> state_times;
+  kaldi::LatticeStateTimes(lat, &state_times);
+
+  // In topological order, all paths go through state s if no arc from a
+  // state before s goes past it and no state before it is final.  We split at
+  // such states (which are not final themselves, so that their final-prob
+  // does not need to go in two pieces), at least chunk_frames apart.
+  StateId num_states = lat.NumStates(), max_nextstate = 0;
+  std::vector<StateId> split_states;
+  int32 last_split_time = 0;
+  bool seen_final = false;
+  for (StateId s = 0; s < num_states; s++) {
+    bool is_final = (lat.Final(s) != Weight::Zero());
+    if (s > 0 && max_nextstate <= s && !seen_final && !is_final &&
+        state_times[s] >= last_split_time + opts.chunk_frames) {
+      split_states.push_back(s);
+      last_split_time = state_times[s];
+    }
+    seen_final = seen_final || is_final;
+    for (ArcIterator<kaldi::Lattice> aiter(lat, s); !aiter.Done(); aiter.Next())
+      max_nextstate = std::max(max_nextstate, aiter.Value().nextstate);
+  }
+  if (split_states.empty())
+    return DeterminizeLatticePhonePrunedWrapper(trans_model, &lat, beam,
+                                                ofst, piece_opts);
+
+  // Piece k has the states from split_states[k-1] (its start state) to
+  // split_states[k] (its only final state), or the original start and final
+  // states for the first and last pieces.
+  int32 num_pieces = split_states.size() + 1;
+  std::vector<kaldi::Lattice> pieces(num_pieces);
+  for (int32 k = 0; k < num_pieces; k++) {
+    StateId begin = (k == 0 ? 0 : split_states[k - 1]),
+        end = (k + 1 < num_pieces ? split_states[k] : num_states - 1);
+    kaldi::Lattice &piece = pieces[k];
+    for (StateId s = begin; s <= end; s++)
+      piece.AddState();
+    piece.SetStart(0);
+    for (StateId s = begin; s <= end; s++) {
+      if (k + 1 < num_pieces && s == end) {
+        piece.SetFinal(s - begin, Weight::One());
+        break;  // its arcs are in the next piece.
+      }
+      piece.SetFinal(s - begin, lat.Final(s));
+      for (ArcIterator<kaldi::Lattice> aiter(lat, s); !aiter.Done();
+           aiter.Next()) {
+        kaldi::LatticeArc arc = aiter.Value();
+        arc.nextstate -= begin;
+        piece.AddArc(s - begin, arc);
+      }
+    }
+  }
+  lat.DeleteStates();
+
+  std::vector<kaldi::CompactLattice> clats(num_pieces);
+  std::vector<char> success(num_pieces, 1);
+  {
+    DeterminizeLatticePiecesClass c(trans_model, beam, piece_opts,
+                                    &pieces, &clats, &success);
+    // The destructor waits for the threads to finish.
+    kaldi::MultiThreader<DeterminizeLatticePiecesClass> m(
+        std::min(opts.num_threads, num_pieces), c);
+  }
+
+  // Join the determinized pieces: each final state of a piece gets an epsilon
+  // arc, with its final weight, to the start state of the next piece.
+  ofst->DeleteStates();
+  bool ans = true;
+  std::vector<std::pair<StateId, CompactWeight> > prev_finals;
+  for (int32 k = 0; k < num_pieces; k++) {
+    const kaldi::CompactLattice &clat = clats[k];
+    ans = ans && success[k];
+    if (clat.Start() == kNoStateId) {
+      KALDI_WARN << "Determinization of piece " << k << " of " << num_pieces
+                 << " of the lattice gave an empty result.";
+      ofst->DeleteStates();
+      return false;
+    }
+    StateId offset = ofst->NumStates();
+    std::vector<std::pair<StateId, CompactWeight> > finals;
+    for (StateId s = 0; s < clat.NumStates(); s++) {
+      ofst->AddState();
+      CompactWeight final_weight = clat.Final(s);
+      if (final_weight != CompactWeight::Zero()) {
+        if (k + 1 < num_pieces)
+          finals.push_back(std::make_pair(s + offset, final_weight));
+        else
+          ofst->SetFinal(s + offset, final_weight);
+      }
+    }
+    for (StateId s = 0; s < clat.NumStates(); s++) {
+      for (ArcIterator<kaldi::CompactLattice> aiter(clat, s); !aiter.Done();
+           aiter.Next()) {
+        kaldi::CompactLatticeArc arc = aiter.Value();
+        arc.nextstate += offset;
+        ofst->AddArc(s + offset, arc);
+      }
+    }
+    if (k == 0)
+      ofst->SetStart(clat.Start() + offset);
+    for (size_t i = 0; i < prev_finals.size(); i++)
+      ofst->AddArc(prev_finals[i].first,
+                   kaldi::CompactLatticeArc(0, 0, prev_finals[i].second,
+                                            clat.Start() + offset));
+    prev_finals.swap(finals);
+    clats[k].DeleteStates();
+  }
+  KALDI_VLOG(2) << "Determinized lattice in " << num_pieces << " pieces.";
+  return ans;
+}
+
 // Instantiate the templates for the types we might need.
 // Note: there are actually four templates, each of which
 // we instantiate for a single type.
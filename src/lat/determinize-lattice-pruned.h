@@ -155,11 +155,19 @@ struct DeterminizeLatticePhonePrunedOptions {
   bool word_determinize;
   // minimize: if true, push and minimize after determinization.
   bool minimize;
+  // chunk_frames: if > 0, DeterminizeLatticePhonePrunedWrapper() splits the
+  // lattice into pieces of about this many frames and determinizes them
+  // separately (see DeterminizeLatticePhonePrunedChunked()).
+  int chunk_frames;
+  // num_threads: the number of threads that determinize the pieces.
+  int num_threads;
   DeterminizeLatticePhonePrunedOptions(): delta(kDelta),
                                           max_mem(50000000),
                                           phone_determinize(true),
                                           word_determinize(true),
-                                          minimize(false) {}
+                                          minimize(false),
+                                          chunk_frames(0),
+                                          num_threads(1) {}
   void Register (kaldi::OptionsItf *opts) {
     opts->Register("delta", &delta, "Tolerance used in determinization");
     opts->Register("max-mem", &max_mem, "Maximum approximate memory usage in "
@@ -172,6 +180,14 @@ struct DeterminizeLatticePhonePrunedOptions {
                    "--phone-determinize)");
     opts->Register("minimize", &minimize, "If true, push and minimize after "
                    "determinization.");
+    opts->Register("determinize-chunk-frames", &chunk_frames, "If > 0, split "
+                   "long lattices at frames where all paths meet (after "
+                   "pruning) into pieces of at least this many frames, and "
+                   "determinize the pieces separately; this saves memory for "
+                   "very long lattices.");
+    opts->Register("determinize-threads", &num_threads, "Number of threads "
+                   "that determinize the pieces, with "
+                   "--determinize-chunk-frames > 0.");
   }
 };
 
@@ -287,6 +303,26 @@ bool DeterminizeLatticePhonePrunedWrapper(
     DeterminizeLatticePhonePrunedOptions opts
       = DeterminizeLatticePhonePrunedOptions());
 
+/** This is like DeterminizeLatticePhonePrunedWrapper() (which calls it if
+    opts.chunk_frames > 0), but for very long lattices, whose determinization
+    would need a lot of memory (and may fail because of max_mem).  The lattice
+    is pruned with the beam, and then split at states that all paths go
+    through (after pruning, there are usually many of these, where tokens
+    have coalesced), at least opts.chunk_frames frames apart.  The pieces are
+    determinized separately, in opts.num_threads threads, and joined with
+    epsilon arcs.  Since every path goes through those states, the result is
+    equivalent to determinizing the whole lattice, within the beam, although
+    it may be a little less compact.  If there is no such state, the whole
+    lattice is determinized as usual.
+*/
+bool DeterminizeLatticePhonePrunedChunked(
+    const kaldi::TransitionModel &trans_model,
+    MutableFst<kaldi::LatticeArc> *ifst,
+    double prune,
+    MutableFst<kaldi::CompactLatticeArc> *ofst,
+    DeterminizeLatticePhonePrunedOptions opts
+      = DeterminizeLatticePhonePrunedOptions());
+
 /// @} end "addtogroup fst_extensions"
 
 } // end namespace fst
@@ -155,6 +155,47 @@ void TestLatticeTableCross(bool binary) {
 }
 
 
+// Write in the compressed format, read as CompactLattice and as Lattice.
+void TestCompressedCompactLatticeTable(bool quantize_weights) {
+  LatticeCompressionOptions opts;
+  opts.compress = true;
+  opts.quantize_weights = quantize_weights;
+  SetCompactLatticeCompression(opts);
+  CompactLatticeWriter writer("ark:tmpf");
+  int N = 10;
+  std::vector<CompactLattice*> lat_vec(N);
+  for (int i = 0; i < N; i++) {
+    char buf[2];
+    buf[0] = '0' + i;
+    buf[1] = '\0';
+    std::string key = "key" + std::string(buf);
+    CompactLattice *fst = RandCompactLattice();
+    lat_vec[i] = fst;
+    writer.Write(key, *fst);
+  }
+  writer.Close();
+  SetCompactLatticeCompression(LatticeCompressionOptions());
+
+  // The quantization error is 1/65535 of the range of the costs.
+  float delta = (quantize_weights ? 0.01 : fst::kDelta);
+  RandomAccessCompactLatticeReader reader("ark:tmpf");
+  RandomAccessLatticeReader lat_reader("ark:tmpf");
+  for (int i = 0; i < N; i++) {
+    char buf[2];
+    buf[0] = '0' + i;
+    buf[1] = '\0';
+    std::string key = "key" + std::string(buf);
+    const CompactLattice &fst = reader.Value(key);
+    if (quantize_weights)
+      KALDI_ASSERT(fst::Equal(fst, *(lat_vec[i]), delta));
+    else
+      KALDI_ASSERT(fst::Equal(fst, *(lat_vec[i])));
+    CompactLattice fst2;
+    ConvertLattice(lat_reader.Value(key), &fst2);
+    KALDI_ASSERT(fst::Equal(fst2, *(lat_vec[i]), delta));
+    delete lat_vec[i];
+  }
+}
 
 } // end namespace kaldi
 
@@ -166,6 +207,7 @@ int main() {
     TestCompactLatticeTableCross(binary);
     TestLatticeTable(binary);
     TestLatticeTableCross(binary);
+    TestCompressedCompactLatticeTable(binary);
   }
   std::cout << "Test OK\n";
   
@@ -19,6 +19,8 @@
 // limitations under the License.
 
 
+#include <cstring>
+
 #include "lat/kaldi-lattice.h"
 #include "fst/script/print-impl.h"
 
@@ -59,9 +61,346 @@ Lattice* ConvertToLattice(Lattice *ifst) {
 }
 
 
+// The compressed lattice format starts with these 4 bytes; the first one
+// distinguishes it from the OpenFst format (whose magic number starts with
+// 214) and from text (which starts with space).  They are followed by the size
+// in bytes of the rest, as a varint, and then by the rest.
+static const char kCompressedLatticeMagic[] = "KCL1";
+static const int32 kCompressedLatticeMagicSize = 4;
+
+// Flag bits of the compressed format.
+static const int32 kCompressedLatticeQuantized = 1;
+
+static LatticeCompressionOptions g_lattice_compression_opts;
+
+void SetCompactLatticeCompression(const LatticeCompressionOptions &opts) {
+  g_lattice_compression_opts = opts;
+}
+
+// Appends "value" as a variable-length integer: 7 bits per byte, least
+// significant first, with the top bit set on all bytes but the last.
+static inline void WriteVarint(uint64 value, std::string *buf) {
+  while (value >= 128) {
+    buf->push_back(static_cast<char>((value & 127) | 128));
+    value >>= 7;
+  }
+  buf->push_back(static_cast<char>(value));
+}
+
+// Maps signed to unsigned integers so that small magnitudes give small
+// varints.
+static inline uint64 ZigZagEncode(int64 value) {
+  return (static_cast<uint64>(value) << 1) ^ static_cast<uint64>(value >> 63);
+}
+
+static inline int64 ZigZagDecode(uint64 value) {
+  return static_cast<int64>(value >> 1) ^ -static_cast<int64>(value & 1);
+}
+
+static inline void WriteRawFloat(float value, std::string *buf) {
+  buf->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Helper class for decoding the compressed format from memory.  After any
+// error, ok() returns false and the values read are zero.
+class CompressedLatticeDecoder {
+ public:
+  CompressedLatticeDecoder(const char *data, size_t size):
+      cur_(data), end_(data + size), ok_(true) { }
+
+  uint64 Varint() {
+    uint64 ans = 0;
+    for (int32 shift = 0; shift < 64; shift += 7) {
+      if (cur_ == end_) { ok_ = false; return 0; }
+      unsigned char c = static_cast<unsigned char>(*(cur_++));
+      ans |= static_cast<uint64>(c & 127) << shift;
+      if (c < 128) return ans;
+    }
+    ok_ = false;
+    return 0;
+  }
+
+  int64 SignedVarint() { return ZigZagDecode(Varint()); }
+
+  float RawFloat() {
+    float ans = 0.0;
+    if (end_ - cur_ < static_cast<ptrdiff_t>(sizeof(ans))) {
+      ok_ = false;
+      return 0.0;
+    }
+    memcpy(&ans, cur_, sizeof(ans));
+    cur_ += sizeof(ans);
+    return ans;
+  }
+
+  bool ok() const { return ok_; }
+
+  void SetError() { ok_ = false; }
+
+  bool Done() const { return cur_ == end_; }
+
+ private:
+  const char *cur_;
+  const char *end_;
+  bool ok_;
+};
+
+// Quantizes the costs of the lattice weights to 16 bits, linearly between
+// their minimum and maximum values.
+struct CompressedLatticeQuantizer {
+  float min_value[2];
+  float range[2];
+
+  // Returns false if some costs are not finite, in which case we cannot
+  // quantize.
+  bool Init(const CompactLattice &clat) {
+    float max_value[2];
+    bool first = true;
+    for (fst::StateIterator<CompactLattice> siter(clat); !siter.Done();
+         siter.Next()) {
+      CompactLattice::StateId s = siter.Value();
+      if (clat.Final(s) != CompactLatticeWeight::Zero() &&
+          !Accumulate(clat.Final(s).Weight(), &first, max_value))
+        return false;
+      for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+           aiter.Next())
+        if (!Accumulate(aiter.Value().weight.Weight(), &first, max_value))
+          return false;
+    }
+    for (int32 i = 0; i < 2; i++) {
+      if (first) min_value[i] = max_value[i] = 0.0;
+      range[i] = max_value[i] - min_value[i];
+    }
+    return true;
+  }
+
+  void Write(const LatticeWeight &w, std::string *buf) const {
+    float values[2] = { w.Value1(), w.Value2() };
+    for (int32 i = 0; i < 2; i++) {
+      int32 q = (range[i] == 0.0 ? 0 :
+                 static_cast<int32>((values[i] - min_value[i]) / range[i] *
+                                    65535.0 + 0.5));
+      if (q < 0) q = 0;
+      if (q > 65535) q = 65535;
+      WriteVarint(q, buf);
+    }
+  }
+
+  LatticeWeight Read(CompressedLatticeDecoder *decoder) const {
+    float values[2];
+    for (int32 i = 0; i < 2; i++) {
+      uint64 q = decoder->Varint();
+      values[i] = min_value[i] + q * (range[i] / 65535.0);
+    }
+    return LatticeWeight(values[0], values[1]);
+  }
+
+ private:
+  bool Accumulate(const LatticeWeight &w, bool *first, float *max_value) {
+    float values[2] = { w.Value1(), w.Value2() };
+    for (int32 i = 0; i < 2; i++) {
+      if (!KALDI_ISFINITE(values[i])) return false;
+      if (*first || values[i] < min_value[i]) min_value[i] = values[i];
+      if (*first || values[i] > max_value[i]) max_value[i] = values[i];
+    }
+    *first = false;
+    return true;
+  }
+};
+
+// Writes the weight and run-length-coded string of "w".
+static void WriteCompressedWeight(const CompactLatticeWeight &w,
+                                  const CompressedLatticeQuantizer *quantizer,
+                                  std::string *buf) {
+  if (quantizer != NULL) {
+    quantizer->Write(w.Weight(), buf);
+  } else {
+    WriteRawFloat(w.Weight().Value1(), buf);
+    WriteRawFloat(w.Weight().Value2(), buf);
+  }
+  const std::vector<int32> &str = w.String();
+  int32 num_runs = 0;
+  for (size_t i = 0; i < str.size(); i++)
+    if (i == 0 || str[i] != str[i - 1]) num_runs++;
+  WriteVarint(num_runs, buf);
+  int32 prev = 0;
+  for (size_t i = 0; i < str.size(); ) {
+    size_t j = i + 1;
+    while (j < str.size() && str[j] == str[i]) j++;
+    WriteVarint(ZigZagEncode(static_cast<int64>(str[i]) - prev), buf);
+    WriteVarint(j - i - 1, buf);
+    prev = str[i];
+    i = j;
+  }
+}
+
+static CompactLatticeWeight ReadCompressedWeight(
+    const CompressedLatticeQuantizer *quantizer,
+    CompressedLatticeDecoder *decoder) {
+  LatticeWeight weight;
+  if (quantizer != NULL) {
+    weight = quantizer->Read(decoder);
+  } else {
+    float value1 = decoder->RawFloat();
+    weight = LatticeWeight(value1, decoder->RawFloat());
+  }
+  std::vector<int32> str;
+  uint64 num_runs = decoder->Varint();
+  int32 prev = 0;
+  for (uint64 r = 0; r < num_runs && decoder->ok(); r++) {
+    int32 value = prev + decoder->SignedVarint();
+    uint64 count = decoder->Varint() + 1;
+    if (count > (1 << 24)) {  // corrupted input.
+      decoder->SetError();
+      break;
+    }
+    str.insert(str.end(), count, value);
+    prev = value;
+  }
+  return CompactLatticeWeight(weight, str);
+}
+
+bool WriteCompressedCompactLattice(std::ostream &os,
+                                   const CompactLattice &clat,
+                                   bool quantize_weights) {
+  typedef CompactLattice::StateId StateId;
+  CompressedLatticeQuantizer quantizer;
+  if (quantize_weights && !quantizer.Init(clat))
+    quantize_weights = false;  // some costs are infinite or NaN.
+  const CompressedLatticeQuantizer *quantizer_ptr =
+      (quantize_weights ? &quantizer : NULL);
+
+  std::string buf;
+  WriteVarint(quantize_weights ? kCompressedLatticeQuantized : 0, &buf);
+  if (quantize_weights) {
+    for (int32 i = 0; i < 2; i++) {
+      WriteRawFloat(quantizer.min_value[i], &buf);
+      WriteRawFloat(quantizer.range[i], &buf);
+    }
+  }
+  StateId num_states = clat.NumStates();
+  WriteVarint(num_states, &buf);
+  WriteVarint(clat.Start() + 1, &buf);  // kNoStateId becomes 0.
+  for (StateId s = 0; s < num_states; s++) {
+    bool is_final = (clat.Final(s) != CompactLatticeWeight::Zero());
+    WriteVarint((static_cast<uint64>(clat.NumArcs(s)) << 1) |
+                (is_final ? 1 : 0), &buf);
+    if (is_final)
+      WriteCompressedWeight(clat.Final(s), quantizer_ptr, &buf);
+    int64 prev_ilabel = 0;
+    for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+         aiter.Next()) {
+      const CompactLatticeArc &arc = aiter.Value();
+      bool same_labels = (arc.olabel == arc.ilabel);
+      WriteVarint((ZigZagEncode(arc.ilabel - prev_ilabel) << 1) |
+                  (same_labels ? 0 : 1), &buf);
+      if (!same_labels)
+        WriteVarint(ZigZagEncode(static_cast<int64>(arc.olabel) -
+                                 arc.ilabel), &buf);
+      WriteVarint(ZigZagEncode(static_cast<int64>(arc.nextstate) - s), &buf);
+      WriteCompressedWeight(arc.weight, quantizer_ptr, &buf);
+      prev_ilabel = arc.ilabel;
+    }
+  }
+  os.write(kCompressedLatticeMagic, kCompressedLatticeMagicSize);
+  std::string size_buf;
+  WriteVarint(buf.size(), &size_buf);
+  os.write(size_buf.data(), size_buf.size());
+  os.write(buf.data(), buf.size());
+  return os.good();
+}
+
+bool ReadCompressedCompactLattice(std::istream &is,
+                                  CompactLattice **clat) {
+  typedef CompactLattice::StateId StateId;
+  KALDI_ASSERT(*clat == NULL);
+  char magic[kCompressedLatticeMagicSize];
+  is.read(magic, kCompressedLatticeMagicSize);
+  if (!is.good() ||
+      memcmp(magic, kCompressedLatticeMagic, kCompressedLatticeMagicSize)) {
+    KALDI_WARN << "Reading compressed lattice: bad header.";
+    return false;
+  }
+  uint64 size = 0;
+  for (int32 shift = 0; ; shift += 7) {
+    int c = is.get();
+    if (c == EOF || shift >= 64) {
+      KALDI_WARN << "Reading compressed lattice: bad header.";
+      return false;
+    }
+    size |= static_cast<uint64>(c & 127) << shift;
+    if (c < 128) break;
+  }
+  std::string buf(size, '\0');
+  if (size > 0) is.read(&(buf[0]), size);
+  if (!is.good()) {
+    KALDI_WARN << "Reading compressed lattice: unexpected end of stream.";
+    return false;
+  }
+
+  CompressedLatticeDecoder decoder(buf.data(), buf.size());
+  uint64 flags = decoder.Varint();
+  CompressedLatticeQuantizer quantizer;
+  const CompressedLatticeQuantizer *quantizer_ptr = NULL;
+  if (flags & kCompressedLatticeQuantized) {
+    for (int32 i = 0; i < 2; i++) {
+      quantizer.min_value[i] = decoder.RawFloat();
+      quantizer.range[i] = decoder.RawFloat();
+    }
+    quantizer_ptr = &quantizer;
+  }
+  uint64 num_states = decoder.Varint();
+  StateId start = static_cast<StateId>(decoder.Varint()) - 1;
+  // Each state takes at least one byte, which guards against corrupted input.
+  if (!decoder.ok() || num_states > buf.size() ||
+      start >= static_cast<StateId>(num_states)) {
+    KALDI_WARN << "Reading compressed lattice: bad header.";
+    return false;
+  }
+  CompactLattice *ans = new CompactLattice();
+  for (uint64 s = 0; s < num_states; s++)
+    ans->AddState();
+  if (start != fst::kNoStateId)
+    ans->SetStart(start);
+  for (StateId s = 0; s < static_cast<StateId>(num_states) && decoder.ok();
+       s++) {
+    uint64 header = decoder.Varint();
+    uint64 num_arcs = header >> 1;
+    if (header & 1)
+      ans->SetFinal(s, ReadCompressedWeight(quantizer_ptr, &decoder));
+    int64 ilabel = 0;
+    for (uint64 a = 0; a < num_arcs && decoder.ok(); a++) {
+      uint64 label_code = decoder.Varint();
+      ilabel += ZigZagDecode(label_code >> 1);
+      int64 olabel = ilabel;
+      if (label_code & 1)
+        olabel += decoder.SignedVarint();
+      int64 nextstate = s + decoder.SignedVarint();
+      CompactLatticeWeight weight = ReadCompressedWeight(quantizer_ptr,
+                                                         &decoder);
+      if (nextstate < 0 || nextstate >= static_cast<int64>(num_states)) {
+        KALDI_WARN << "Reading compressed lattice: invalid state id.";
+        delete ans;
+        return false;
+      }
+      ans->AddArc(s, CompactLatticeArc(ilabel, olabel, weight, nextstate));
+    }
+  }
+  if (!decoder.ok() || !decoder.Done()) {
+    KALDI_WARN << "Reading compressed lattice: corrupted data.";
+    delete ans;
+    return false;
+  }
+  *clat = ans;
+  return true;
+}
+
 bool WriteCompactLattice(std::ostream &os, bool binary,
                          const CompactLattice &t) {
   if (binary) {
+    if (g_lattice_compression_opts.compress)
+      return WriteCompressedCompactLattice(
+          os, t, g_lattice_compression_opts.quantize_weights);
     fst::FstWriteOptions opts;
     // Leave all the options default.  Normally these lattices wouldn't have any
     // osymbols/isymbols so no point directing it not to write them (who knows what
@@ -311,6 +650,8 @@ bool ReadCompactLattice(std::istream &is, bool binary,
                         CompactLattice **clat) {
   KALDI_ASSERT(*clat == NULL);
   if (binary) {
+    if (is.peek() == kCompressedLatticeMagic[0])
+      return ReadCompressedCompactLattice(is, clat);
     fst::FstHeader hdr;
     if (!hdr.Read(is, "<unknown>")) {
       KALDI_WARN << "Reading compact lattice: error reading FST header.";
@@ -380,8 +721,9 @@ bool CompactLatticeHolder::Read(std::istream &is) {
     // cannot begin with space because it starts with the FST Type() which is not
     // space).
     return ReadCompactLattice(is, false, &t_);
-  } else if (c != 214) { // 214 is first char of FST magic number,
-    // on little-endian machines which is all we support (\326 octal)
+  } else if (c != 214 && c != kCompressedLatticeMagic[0]) {
+    // 214 is first char of FST magic number, on little-endian machines which
+    // is all we support (\326 octal); the other is our compressed format.
     KALDI_WARN << "Reading compact lattice: does not appear to be an FST "
                << " [non-space but no magic number detected], file pos is "
                << is.tellg();
@@ -430,6 +772,12 @@ bool ReadLattice(std::istream &is, bool binary,
                  Lattice **lat) {
   KALDI_ASSERT(*lat == NULL);
   if (binary) {
+    if (is.peek() == kCompressedLatticeMagic[0]) {
+      CompactLattice *clat = NULL;
+      if (!ReadCompressedCompactLattice(is, &clat)) return false;
+      *lat = ConvertToLattice(clat);
+      return true;
+    }
     fst::FstHeader hdr;
     if (!hdr.Read(is, "<unknown>")) {
       KALDI_WARN << "Reading lattice: error reading FST header.";
@@ -502,8 +850,9 @@ bool LatticeHolder::Read(std::istream &is) {
     // cannot begin with space because it starts with the FST Type() which is not
     // space).
     return ReadLattice(is, false, &t_);
-  } else if (c != 214) { // 214 is first char of FST magic number,
-    // on little-endian machines which is all we support (\326 octal)
+  } else if (c != 214 && c != kCompressedLatticeMagic[0]) {
+    // 214 is first char of FST magic number, on little-endian machines which
+    // is all we support (\326 octal); the other is our compressed format.
     KALDI_WARN << "Reading compact lattice: does not appear to be an FST "
                << " [non-space but no magic number detected], file pos is "
                << is.tellg();
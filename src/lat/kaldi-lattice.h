@@ -65,6 +65,46 @@ bool ReadCompactLattice(std::istream &is, bool binary,
 bool ReadLattice(std::istream &is, bool binary,
                  Lattice **lat);
 
+// The following functions write and read CompactLattice in a compressed
+// binary format, which is much smaller than the OpenFst format: state ids and
+// labels are delta-coded as variable-length integers, the transition-id
+// strings are run-length coded, and if "quantize_weights" is true the two
+// costs are stored as 16-bit integers (linearly quantized between their
+// minimum and maximum in the lattice).  ReadCompactLattice() and
+// ReadLattice() in binary mode, and the lattice holders, recognize this
+// format by its first bytes and read it transparently; OpenFst cannot, so
+// it is only suitable for archives.  These return false on error (having
+// printed a warning).
+bool WriteCompressedCompactLattice(std::ostream &os,
+                                   const CompactLattice &clat,
+                                   bool quantize_weights);
+// the following function requires that *clat be
+// NULL when called.
+bool ReadCompressedCompactLattice(std::istream &is,
+                                  CompactLattice **clat);
+
+struct LatticeCompressionOptions {
+  bool compress;
+  bool quantize_weights;
+
+  LatticeCompressionOptions(): compress(false), quantize_weights(false) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("compress-lattices", &compress, "If true, write binary "
+                   "lattices in Kaldi's compressed format (readable by Kaldi "
+                   "programs but not by OpenFst).");
+    opts->Register("quantize-lattice-weights", &quantize_weights, "If true "
+                   "(and --compress-lattices=true), store the lattice costs "
+                   "as 16-bit integers, which is lossy.");
+  }
+};
+
+// Sets the format used from now on by WriteCompactLattice() in binary mode
+// (and hence by CompactLatticeWriter): if opts.compress is true, it will use
+// WriteCompressedCompactLattice().  This is a program-wide setting; programs
+// that register LatticeCompressionOptions call it after reading the options.
+void SetCompactLatticeCompression(const LatticeCompressionOptions &opts);
+
 
 class CompactLatticeHolder {
  public:
@@ -90,6 +130,8 @@ class CompactLatticeHolder {
 
   void Clear() { delete t_; t_ = NULL; }
 
+  void Swap(CompactLatticeHolder *other) { std::swap(t_, other->t_); }
+
   ~CompactLatticeHolder() { Clear(); }
 
  private:
@@ -120,6 +162,8 @@ class LatticeHolder {
 
   void Clear() {  delete t_; t_ = NULL; }
 
+  void Swap(LatticeHolder *other) { std::swap(t_, other->t_); }
+
   ~LatticeHolder() { Clear(); }
 
  private:
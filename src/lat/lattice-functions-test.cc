@@ -0,0 +1,174 @@
+// lat/lattice-functions-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lat/kaldi-lattice.h"
+#include "lat/lattice-functions.h"
+#include "base/timer.h"
+
+namespace kaldi {
+
+// Makes a random lattice with "num_frames" frames and up to "max_states"
+// states per frame, where all arcs go from one frame to the next; states are
+// numbered in order of time so the lattice is topologically sorted.
+Lattice *RandTimedLattice(int32 num_frames, int32 max_states) {
+  Lattice *lat = new Lattice;
+  std::vector<std::vector<int32> > frame_states(num_frames + 1);
+  frame_states[0].push_back(lat->AddState());
+  lat->SetStart(0);
+  for (int32 t = 1; t <= num_frames; t++) {
+    int32 n = 1 + Rand() % max_states;
+    for (int32 i = 0; i < n; i++)
+      frame_states[t].push_back(lat->AddState());
+    // make sure every state on frame t has an arc entering it, and every
+    // state on frame t-1 has an arc leaving it.
+    const std::vector<int32> &prev = frame_states[t-1], &cur = frame_states[t];
+    int32 num_arcs = std::max(prev.size(), cur.size()) + Rand() % 3;
+    for (int32 i = 0; i < num_arcs; i++) {
+      int32 s = prev[i < prev.size() ? i : Rand() % prev.size()],
+          d = cur[i < cur.size() ? i : Rand() % cur.size()];
+      LatticeWeight w(RandUniform() * 5.0, RandUniform() * 20.0);
+      lat->AddArc(s, LatticeArc(1 + Rand() % 100, Rand() % 10, w, d));
+    }
+  }
+  for (size_t i = 0; i < frame_states[num_frames].size(); i++)
+    lat->SetFinal(frame_states[num_frames][i],
+                  LatticeWeight(RandUniform(), RandUniform()));
+  return lat;
+}
+
+// The forward-backward as it was done before FlatLattice, with a LogAdd()
+// per arc; used to check the results and as a baseline for the timing.
+double ReferenceForwardBackward(const Lattice &lat, Posterior *post,
+                                std::vector<double> *alpha,
+                                std::vector<double> *beta) {
+  int32 num_states = lat.NumStates();
+  std::vector<int32> state_times;
+  int32 max_time = LatticeStateTimes(lat, &state_times);
+  alpha->assign(num_states, kLogZeroDouble);
+  beta->assign(num_states, kLogZeroDouble);
+  double tot_prob = kLogZeroDouble;
+  (*alpha)[0] = 0.0;
+  for (int32 s = 0; s < num_states; s++) {
+    for (fst::ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
+      const LatticeArc &arc = aiter.Value();
+      (*alpha)[arc.nextstate] = LogAdd((*alpha)[arc.nextstate],
+                                       (*alpha)[s] - ConvertToCost(arc.weight));
+    }
+    if (lat.Final(s) != LatticeWeight::Zero())
+      tot_prob = LogAdd(tot_prob, (*alpha)[s] - ConvertToCost(lat.Final(s)));
+  }
+  post->clear();
+  post->resize(max_time);
+  for (int32 s = num_states - 1; s >= 0; s--) {
+    double this_beta = -ConvertToCost(lat.Final(s));
+    for (fst::ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
+      const LatticeArc &arc = aiter.Value();
+      double arc_beta = (*beta)[arc.nextstate] - ConvertToCost(arc.weight);
+      this_beta = LogAdd(this_beta, arc_beta);
+      (*post)[state_times[s]].push_back(
+          std::make_pair(arc.ilabel, static_cast<BaseFloat>(
+              Exp((*alpha)[s] + arc_beta - tot_prob))));
+    }
+    (*beta)[s] = this_beta;
+  }
+  for (int32 t = 0; t < max_time; t++)
+    MergePairVectorSumming(&((*post)[t]));
+  return tot_prob;
+}
+
+void AssertPosteriorsEqual(const Posterior &a, const Posterior &b) {
+  KALDI_ASSERT(a.size() == b.size());
+  for (size_t t = 0; t < a.size(); t++) {
+    KALDI_ASSERT(a[t].size() == b[t].size());
+    for (size_t i = 0; i < a[t].size(); i++) {
+      KALDI_ASSERT(a[t][i].first == b[t][i].first);
+      KALDI_ASSERT(ApproxEqual(a[t][i].second, b[t][i].second, 1.0e-04) ||
+                   std::abs(a[t][i].second - b[t][i].second) < 1.0e-06);
+    }
+  }
+}
+
+void TestLatticeForwardBackward() {
+  Lattice *lat = RandTimedLattice(1 + Rand() % 20, 1 + Rand() % 5);
+  Posterior post, ref_post;
+  std::vector<double> ref_alpha, ref_beta, alpha, beta;
+  double acoustic_like_sum;
+  BaseFloat tot_prob = LatticeForwardBackward(*lat, &post, &acoustic_like_sum);
+  double ref_tot_prob = ReferenceForwardBackward(*lat, &ref_post,
+                                                 &ref_alpha, &ref_beta);
+  KALDI_ASSERT(ApproxEqual(tot_prob, ref_tot_prob));
+  AssertPosteriorsEqual(post, ref_post);
+
+  FlatLattice flat;
+  FlattenLattice(*lat, &flat);
+  KALDI_ASSERT(flat.NumStates() == lat->NumStates());
+  ComputeFlatLatticeAlphas(flat, &alpha);
+  ComputeFlatLatticeBetas(flat, &beta);
+  for (size_t s = 0; s < alpha.size(); s++) {
+    KALDI_ASSERT(ApproxEqual(alpha[s], ref_alpha[s]));
+    KALDI_ASSERT(ApproxEqual(beta[s], ref_beta[s]));
+  }
+
+  CompactLattice clat;
+  ConvertLattice(*lat, &clat);
+  TopSortCompactLatticeIfNeeded(&clat);
+  std::vector<double> clat_alpha, clat_beta;
+  KALDI_ASSERT(ComputeCompactLatticeAlphas(clat, &clat_alpha) &&
+               ComputeCompactLatticeBetas(clat, &clat_beta));
+  double clat_tot_prob = kLogZeroDouble;
+  for (size_t s = 0; s < clat_alpha.size(); s++)
+    if (clat.Final(s) != CompactLatticeWeight::Zero())
+      clat_tot_prob = LogAdd(clat_tot_prob,
+                             clat_alpha[s] - ConvertToCost(clat.Final(s)));
+  KALDI_ASSERT(ApproxEqual(clat_tot_prob, ref_tot_prob));
+  KALDI_ASSERT(ApproxEqual(clat_beta[0], ref_tot_prob));
+  delete lat;
+}
+
+// Compares the speed of LatticeForwardBackward() with that of the per-arc
+// LogAdd() version, on large lattices.
+void TestLatticeForwardBackwardSpeed() {
+  Lattice *lat = RandTimedLattice(2000, 40);
+  int32 num_iters = 10;
+  Posterior post;
+  std::vector<double> alpha, beta;
+  Timer timer;
+  for (int32 i = 0; i < num_iters; i++)
+    ReferenceForwardBackward(*lat, &post, &alpha, &beta);
+  double ref_time = timer.Elapsed();
+  timer.Reset();
+  for (int32 i = 0; i < num_iters; i++)
+    LatticeForwardBackward(*lat, &post);
+  double time = timer.Elapsed();
+  KALDI_LOG << "For lattice with " << lat->NumStates() << " states and "
+            << fst::NumArcs(*lat) << " arcs, forward-backward took "
+            << (time / num_iters) << " seconds, versus "
+            << (ref_time / num_iters) << " with per-arc LogAdd().";
+  delete lat;
+}
+
+} // end namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 100; i++)
+    TestLatticeForwardBackward();
+  TestLatticeForwardBackwardSpeed();
+  KALDI_LOG << "Success.";
+}
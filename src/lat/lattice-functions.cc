@@ -105,15 +105,155 @@ int32 CompactLatticeStateTimes(const CompactLattice &lat, vector<int32> *times)
   return utt_len;
 }
 
-bool ComputeCompactLatticeAlphas(const CompactLattice &clat,
-                                 vector<double> *alpha) {
-  using namespace fst;
+static inline double AcousticCost(const LatticeWeight &w) {
+  return w.Value2();
+}
 
-  // typedef the arc, weight types
-  typedef CompactLattice::Arc Arc;
-  typedef Arc::Weight Weight;
-  typedef Arc::StateId StateId;
+static inline double AcousticCost(const CompactLatticeWeight &w) {
+  return w.Weight().Value2();
+}
+
+template<class LatType>
+static void FlattenLatticeTpl(const LatType &lat, FlatLattice *flat) {
+  typedef typename LatType::Arc Arc;
+  typedef typename Arc::Weight Weight;
+  int32 num_states = lat.NumStates();
+  flat->arc_begin.resize(num_states + 1);
+  flat->arc_source.clear();
+  flat->arc_dest.clear();
+  flat->arc_ilabel.clear();
+  flat->arc_like.clear();
+  flat->arc_acoustic_cost.clear();
+  flat->final_like.resize(num_states);
+  flat->final_acoustic_cost.resize(num_states);
+  flat->arc_begin[0] = 0;
+  if (num_states == 0) {
+    flat->in_begin.assign(1, 0);
+    flat->in_arcs.clear();
+    return;
+  }
+  if (lat.Properties(fst::kTopSorted, true) == 0)
+    KALDI_ERR << "Input lattice must be topologically sorted.";
+  KALDI_ASSERT(lat.Start() == 0);
 
+  for (int32 s = 0; s < num_states; s++) {
+    for (fst::ArcIterator<LatType> aiter(lat, s); !aiter.Done();
+         aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      flat->arc_source.push_back(s);
+      flat->arc_dest.push_back(arc.nextstate);
+      flat->arc_ilabel.push_back(arc.ilabel);
+      flat->arc_like.push_back(-ConvertToCost(arc.weight));
+      flat->arc_acoustic_cost.push_back(AcousticCost(arc.weight));
+    }
+    flat->arc_begin[s + 1] = flat->arc_source.size();
+    Weight f = lat.Final(s);
+    if (f != Weight::Zero()) {
+      flat->final_like[s] = -ConvertToCost(f);
+      flat->final_acoustic_cost[s] = AcousticCost(f);
+    } else {
+      flat->final_like[s] = kLogZeroDouble;
+      flat->final_acoustic_cost[s] = 0.0;
+    }
+  }
+  // Set up in_begin and in_arcs, as a counting sort of the arcs on their
+  // destination state.
+  int32 num_arcs = flat->arc_dest.size();
+  flat->in_begin.assign(num_states + 1, 0);
+  for (int32 a = 0; a < num_arcs; a++)
+    flat->in_begin[flat->arc_dest[a] + 1]++;
+  for (int32 s = 0; s < num_states; s++)
+    flat->in_begin[s + 1] += flat->in_begin[s];
+  flat->in_arcs.resize(num_arcs);
+  std::vector<int32> next_pos(flat->in_begin.begin(),
+                              flat->in_begin.end() - 1);
+  for (int32 a = 0; a < num_arcs; a++)
+    flat->in_arcs[next_pos[flat->arc_dest[a]]++] = a;
+}
+
+void FlattenLattice(const Lattice &lat, FlatLattice *flat) {
+  FlattenLatticeTpl(lat, flat);
+}
+
+void FlattenLattice(const CompactLattice &clat, FlatLattice *flat) {
+  FlattenLatticeTpl(clat, flat);
+}
+
+// Returns log(sum_i exp(x[i])) for 0 <= i < dim, or kLogZeroDouble if dim is
+// zero or all the x[i] are kLogZeroDouble.  There are no dependencies between
+// iterations of the loops except for the reductions, so the compiler can
+// vectorize them.
+static inline double LogAddArray(const double *x, int32 dim) {
+  if (dim == 1) return x[0];
+  double max_x = kLogZeroDouble;
+  for (int32 i = 0; i < dim; i++)
+    max_x = (x[i] > max_x ? x[i] : max_x);
+  if (max_x == kLogZeroDouble) return kLogZeroDouble;
+  double sum = 0.0;
+  for (int32 i = 0; i < dim; i++)
+    sum += Exp(x[i] - max_x);
+  return max_x + Log(sum);
+}
+
+void ComputeFlatLatticeAlphas(const FlatLattice &flat,
+                              std::vector<double> *alpha) {
+  int32 num_states = flat.NumStates(), num_arcs = flat.NumArcs();
+  alpha->resize(num_states);
+  if (num_states == 0) return;
+  std::vector<double> terms(num_arcs + 1);
+  double *alpha_data = &((*alpha)[0]), *terms_data = &(terms[0]);
+  // Note that we don't account the weight of the final state to alpha --
+  // we account it to beta.
+  alpha_data[0] = 0.0;
+  for (int32 s = 1; s < num_states; s++) {
+    int32 begin = flat.in_begin[s], end = flat.in_begin[s + 1];
+    for (int32 i = begin; i < end; i++) {
+      int32 a = flat.in_arcs[i];
+      terms_data[i - begin] = alpha_data[flat.arc_source[a]] + flat.arc_like[a];
+    }
+    alpha_data[s] = LogAddArray(terms_data, end - begin);
+  }
+}
+
+void ComputeFlatLatticeBetas(const FlatLattice &flat,
+                             std::vector<double> *beta) {
+  int32 num_states = flat.NumStates(), num_arcs = flat.NumArcs();
+  beta->resize(num_states);
+  if (num_states == 0) return;
+  std::vector<double> terms(num_arcs + 1);
+  double *beta_data = &((*beta)[0]), *terms_data = &(terms[0]);
+  // Note that beta includes the weight of the final state.
+  for (int32 s = num_states - 1; s >= 0; s--) {
+    int32 begin = flat.arc_begin[s], end = flat.arc_begin[s + 1];
+    terms_data[0] = flat.final_like[s];
+    for (int32 a = begin; a < end; a++)
+      terms_data[a - begin + 1] = beta_data[flat.arc_dest[a]] +
+          flat.arc_like[a];
+    beta_data[s] = LogAddArray(terms_data, end - begin + 1);
+  }
+}
+
+// Returns the total forward log-probability of the lattice given the alphas,
+// checking that the final-probs are all on frame "max_time" if
+// state_times != NULL.
+static double FlatLatticeTotalProb(const FlatLattice &flat,
+                                   const std::vector<double> &alpha,
+                                   const std::vector<int32> *state_times,
+                                   int32 max_time) {
+  std::vector<double> terms;
+  for (int32 s = 0; s < flat.NumStates(); s++) {
+    if (flat.final_like[s] != kLogZeroDouble) {
+      terms.push_back(alpha[s] + flat.final_like[s]);
+      KALDI_ASSERT((state_times == NULL || (*state_times)[s] == max_time) &&
+                   "Lattice is inconsistent (final-prob not at max_time)");
+    }
+  }
+  return (terms.empty() ? kLogZeroDouble :
+          LogAddArray(&(terms[0]), terms.size()));
+}
+
+bool ComputeCompactLatticeAlphas(const CompactLattice &clat,
+                                 vector<double> *alpha) {
   //Make sure the lattice is topologically sorted.
   if (clat.Properties(fst::kTopSorted, true) == 0) {
     KALDI_WARN << "Input lattice must be topologically sorted.";
@@ -123,35 +263,14 @@ bool ComputeCompactLatticeAlphas(const CompactLattice &clat,
     KALDI_WARN << "Input lattice must start from state 0.";
     return false;
   }
-
-  int32 num_states = clat.NumStates();
-  (*alpha).resize(0);
-  (*alpha).resize(num_states, kLogZeroDouble);
-
-  // Now propagate alphas forward. Note that we don't acount the weight of the
-  // final state to alpha[final_state] -- we acount it to beta[final_state];
-  (*alpha)[0] = 0.0;
-  for (StateId s = 0; s < num_states; s++) {
-    double this_alpha = (*alpha)[s];
-    for (ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -(arc.weight.Weight().Value1() + arc.weight.Weight().Value2());
-      (*alpha)[arc.nextstate] = LogAdd((*alpha)[arc.nextstate], this_alpha + arc_like);
-    }
-  }
-
+  FlatLattice flat;
+  FlattenLattice(clat, &flat);
+  ComputeFlatLatticeAlphas(flat, alpha);
   return true;
 }
 
 bool ComputeCompactLatticeBetas(const CompactLattice &clat,
                                 vector<double> *beta) {
-  using namespace fst;
-
-  // typedef the arc, weight types
-  typedef CompactLattice::Arc Arc;
-  typedef Arc::Weight Weight;
-  typedef Arc::StateId StateId;
-
   // Make sure the lattice is topologically sorted.
   if (clat.Properties(fst::kTopSorted, true) == 0) {
     KALDI_WARN << "Input lattice must be topologically sorted.";
@@ -161,25 +280,9 @@ bool ComputeCompactLatticeBetas(const CompactLattice &clat,
     KALDI_WARN << "Input lattice must start from state 0.";
     return false;
   }
-
-  int32 num_states = clat.NumStates();
-  (*beta).resize(0);
-  (*beta).resize(num_states, kLogZeroDouble);
-
-  // Now propagate betas backward. Note that beta[final_state] contains the
-  // weight of the final state in the lattice -- compare that with alpha.
-  for (StateId s = num_states-1; s >= 0; s--) {
-    Weight f = clat.Final(s);
-    double this_beta = -(f.Weight().Value1()+f.Weight().Value2());
-    for (ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -(arc.weight.Weight().Value1()+arc.weight.Weight().Value2());
-      double arc_beta = (*beta)[arc.nextstate] + arc_like;
-      this_beta = LogAdd(this_beta, arc_beta);
-    }
-    (*beta)[s] = this_beta;
-  }
-
+  FlatLattice flat;
+  FlattenLattice(clat, &flat);
+  ComputeFlatLatticeBetas(flat, beta);
   return true;
 }
 
@@ -274,11 +377,6 @@ BaseFloat LatticeForwardBackward(const Lattice &lat, Posterior *post,
   // Note, Posterior is defined as follows:  Indexed [frame], then a list
   // of (transition-id, posterior-probability) pairs.
   // typedef std::vector<std::vector<std::pair<int32, BaseFloat> > > Posterior;
-  using namespace fst;
-  typedef Lattice::Arc Arc;
-  typedef Arc::Weight Weight;
-  typedef Arc::StateId StateId;
-
   if (acoustic_like_sum) *acoustic_like_sum = 0.0;
 
   // Make sure the lattice is topologically sorted.
@@ -289,58 +387,38 @@ BaseFloat LatticeForwardBackward(const Lattice &lat, Posterior *post,
   int32 num_states = lat.NumStates();
   vector<int32> state_times;
   int32 max_time = LatticeStateTimes(lat, &state_times);
-  std::vector<double> alpha(num_states, kLogZeroDouble);
-  std::vector<double> &beta(alpha); // we re-use the same memory for
-  // this, but it's semantically distinct so we name it differently.
-  double tot_forward_prob = kLogZeroDouble;
+  FlatLattice flat;
+  FlattenLattice(lat, &flat);
+  int32 num_arcs = flat.NumArcs();
+  std::vector<double> alpha, beta;
+  ComputeFlatLatticeAlphas(flat, &alpha);
+  ComputeFlatLatticeBetas(flat, &beta);
+  double tot_forward_prob = FlatLatticeTotalProb(flat, alpha, &state_times,
+                                                 max_time);
 
   post->clear();
   post->resize(max_time);
 
-  alpha[0] = 0.0;
-  // Propagate alphas forward.
-  for (StateId s = 0; s < num_states; s++) {
-    double this_alpha = alpha[s];
-    for (ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight);
-      alpha[arc.nextstate] = LogAdd(alpha[arc.nextstate], this_alpha + arc_like);
-    }
-    Weight f = lat.Final(s);
-    if (f != Weight::Zero()) {
-      double final_like = this_alpha - (f.Value1() + f.Value2());
-      tot_forward_prob = LogAdd(tot_forward_prob, final_like);
-      KALDI_ASSERT(state_times[s] == max_time &&
-                   "Lattice is inconsistent (final-prob not at max_time)");
-    }
-  }
-  for (StateId s = num_states-1; s >= 0; s--) {
-    Weight f = lat.Final(s);
-    double this_beta = -(f.Value1() + f.Value2());
-    for (ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight),
-          arc_beta = beta[arc.nextstate] + arc_like;
-      this_beta = LogAdd(this_beta, arc_beta);
-      int32 transition_id = arc.ilabel;
-
-      // The following "if" is an optimization to avoid un-needed exp().
-      if (transition_id != 0 || acoustic_like_sum != NULL) {
-        double posterior = Exp(alpha[s] + arc_beta - tot_forward_prob);
-
-        if (transition_id != 0) // Arc has a transition-id on it [not epsilon]
-          (*post)[state_times[s]].push_back(std::make_pair(transition_id,
-                                                           static_cast<kaldi::BaseFloat>(posterior)));
-        if (acoustic_like_sum != NULL)
-          *acoustic_like_sum -= posterior * arc.weight.Value2();
-      }
+  // Work out the posteriors of all the arcs in one pass.
+  std::vector<double> arc_post(num_arcs);
+  for (int32 a = 0; a < num_arcs; a++)
+    arc_post[a] = Exp(alpha[flat.arc_source[a]] +
+                      (beta[flat.arc_dest[a]] + flat.arc_like[a]) -
+                      tot_forward_prob);
+
+  for (int32 s = num_states - 1; s >= 0; s--) {
+    for (int32 a = flat.arc_begin[s]; a < flat.arc_begin[s + 1]; a++) {
+      int32 transition_id = flat.arc_ilabel[a];
+      if (transition_id != 0) // Arc has a transition-id on it [not epsilon]
+        (*post)[state_times[s]].push_back(std::make_pair(transition_id,
+                                                         static_cast<kaldi::BaseFloat>(arc_post[a])));
+      if (acoustic_like_sum != NULL)
+        *acoustic_like_sum -= arc_post[a] * flat.arc_acoustic_cost[a];
     }
-    if (acoustic_like_sum != NULL && f != Weight::Zero()) {
-      double final_logprob = - ConvertToCost(f),
-          posterior = Exp(alpha[s] + final_logprob - tot_forward_prob);
-      *acoustic_like_sum -= posterior * f.Value2();
+    if (acoustic_like_sum != NULL && flat.final_like[s] != kLogZeroDouble) {
+      double posterior = Exp(alpha[s] + flat.final_like[s] - tot_forward_prob);
+      *acoustic_like_sum -= posterior * flat.final_acoustic_cost[s];
     }
-    beta[s] = this_beta;
   }
   double tot_backward_prob = beta[0];
   if (!ApproxEqual(tot_forward_prob, tot_backward_prob, 1e-8)) {
@@ -745,11 +823,6 @@ BaseFloat LatticeForwardBackwardMpeVariants(
     std::string criterion,
     bool one_silence_class,
     Posterior *post) {
-  using namespace fst;
-  typedef Lattice::Arc Arc;
-  typedef Arc::Weight Weight;
-  typedef Arc::StateId StateId;
-
   KALDI_ASSERT(criterion == "mpfe" || criterion == "smbr");
   bool is_mpfe = (criterion == "mpfe");
 
@@ -761,46 +834,23 @@ BaseFloat LatticeForwardBackwardMpeVariants(
   vector<int32> state_times;
   int32 max_time = LatticeStateTimes(lat, &state_times);
   KALDI_ASSERT(max_time == static_cast<int32>(num_ali.size()));
-  std::vector<double> alpha(num_states, kLogZeroDouble),
+  FlatLattice flat;
+  FlattenLattice(lat, &flat);
+  int32 num_arcs = flat.NumArcs();
+  std::vector<double> alpha, beta,
       alpha_smbr(num_states, 0), //forward variable for sMBR
-      beta(num_states, kLogZeroDouble),
       beta_smbr(num_states, 0); //backward variable for sMBR
 
-  double tot_forward_prob = kLogZeroDouble;
   double tot_forward_score = 0;
 
   post->clear();
   post->resize(max_time);
 
-  alpha[0] = 0.0;
-  // First Pass Forward,
-  for (StateId s = 0; s < num_states; s++) {
-    double this_alpha = alpha[s];
-    for (ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight);
-      alpha[arc.nextstate] = LogAdd(alpha[arc.nextstate], this_alpha + arc_like);
-    }
-    Weight f = lat.Final(s);
-    if (f != Weight::Zero()) {
-      double final_like = this_alpha - (f.Value1() + f.Value2());
-      tot_forward_prob = LogAdd(tot_forward_prob, final_like);
-      KALDI_ASSERT(state_times[s] == max_time &&
-                   "Lattice is inconsistent (final-prob not at max_time)");
-    }
-  }
-  // First Pass Backward,
-  for (StateId s = num_states-1; s >= 0; s--) {
-    Weight f = lat.Final(s);
-    double this_beta = -(f.Value1() + f.Value2());
-    for (ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight),
-          arc_beta = beta[arc.nextstate] + arc_like;
-      this_beta = LogAdd(this_beta, arc_beta);
-    }
-    beta[s] = this_beta;
-  }
+  // First Pass Forward and Backward,
+  ComputeFlatLatticeAlphas(flat, &alpha);
+  ComputeFlatLatticeBetas(flat, &beta);
+  double tot_forward_prob = FlatLatticeTotalProb(flat, alpha, &state_times,
+                                                 max_time);
   // First Pass Forward-Backward Check
   double tot_backward_prob = beta[0];
   // may loose the condition somehow here 1e-6 (was 1e-8)
@@ -809,93 +859,78 @@ BaseFloat LatticeForwardBackwardMpeVariants(
               << ", while total backward probability = " << tot_backward_prob;
   }
 
-  alpha_smbr[0] = 0.0;
-  // Second Pass Forward, calculate forward for MPFE/SMBR
-  for (StateId s = 0; s < num_states; s++) {
-    double this_alpha = alpha[s];
-    for (ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight);
-      double frame_acc = 0.0;
-      if (arc.ilabel != 0) {
-        int32 cur_time = state_times[s];
-        int32 phone = trans.TransitionIdToPhone(arc.ilabel),
-            ref_phone = trans.TransitionIdToPhone(num_ali[cur_time]);
-        bool phone_is_sil = std::binary_search(silence_phones.begin(),
-                                               silence_phones.end(),
-                                               phone),
-            ref_phone_is_sil = std::binary_search(silence_phones.begin(),
-                                                  silence_phones.end(),
-                                                  ref_phone),
-            both_sil = phone_is_sil && ref_phone_is_sil;
-        if (!is_mpfe) { // smbr.
-          int32 pdf = trans.TransitionIdToPdf(arc.ilabel),
-              ref_pdf = trans.TransitionIdToPdf(num_ali[cur_time]);
-          if (!one_silence_class)  // old behavior
-            frame_acc = (pdf == ref_pdf && !phone_is_sil) ? 1.0 : 0.0;
-          else
-            frame_acc = (pdf == ref_pdf || both_sil) ? 1.0 : 0.0;
-        } else {
-          if (!one_silence_class)  // old behavior
-            frame_acc = (phone == ref_phone && !phone_is_sil) ? 1.0 : 0.0;
-          else
-            frame_acc = (phone == ref_phone || both_sil) ? 1.0 : 0.0;
-        }
+  // Work out the frame accuracy of each arc, and the forward and backward
+  // scales of each arc for the second pass, once only.
+  std::vector<double> frame_acc(num_arcs, 0.0), fwd_scale(num_arcs),
+      bwd_scale(num_arcs);
+  for (int32 a = 0; a < num_arcs; a++) {
+    int32 transition_id = flat.arc_ilabel[a];
+    if (transition_id != 0) {
+      int32 cur_time = state_times[flat.arc_source[a]];
+      int32 phone = trans.TransitionIdToPhone(transition_id),
+          ref_phone = trans.TransitionIdToPhone(num_ali[cur_time]);
+      bool phone_is_sil = std::binary_search(silence_phones.begin(),
+                                             silence_phones.end(),
+                                             phone),
+          ref_phone_is_sil = std::binary_search(silence_phones.begin(),
+                                                silence_phones.end(),
+                                                ref_phone),
+          both_sil = phone_is_sil && ref_phone_is_sil;
+      if (!is_mpfe) { // smbr.
+        int32 pdf = trans.TransitionIdToPdf(transition_id),
+            ref_pdf = trans.TransitionIdToPdf(num_ali[cur_time]);
+        if (!one_silence_class)  // old behavior
+          frame_acc[a] = (pdf == ref_pdf && !phone_is_sil) ? 1.0 : 0.0;
+        else
+          frame_acc[a] = (pdf == ref_pdf || both_sil) ? 1.0 : 0.0;
+      } else {
+        if (!one_silence_class)  // old behavior
+          frame_acc[a] = (phone == ref_phone && !phone_is_sil) ? 1.0 : 0.0;
+        else
+          frame_acc[a] = (phone == ref_phone || both_sil) ? 1.0 : 0.0;
       }
-      double arc_scale = Exp(alpha[s] + arc_like - alpha[arc.nextstate]);
-      alpha_smbr[arc.nextstate] += arc_scale * (alpha_smbr[s] + frame_acc);
     }
-    Weight f = lat.Final(s);
-    if (f != Weight::Zero()) {
-      double final_like = this_alpha - (f.Value1() + f.Value2());
+  }
+  for (int32 a = 0; a < num_arcs; a++) {
+    int32 s = flat.arc_source[a], d = flat.arc_dest[a];
+    fwd_scale[a] = Exp(alpha[s] + flat.arc_like[a] - alpha[d]);
+    bwd_scale[a] = Exp(beta[d] + flat.arc_like[a] - beta[s]);
+  }
+
+  // Second Pass Forward, calculate forward for MPFE/SMBR
+  alpha_smbr[0] = 0.0;
+  for (int32 s = 1; s < num_states; s++) {
+    double this_alpha_smbr = 0.0;
+    for (int32 i = flat.in_begin[s]; i < flat.in_begin[s + 1]; i++) {
+      int32 a = flat.in_arcs[i];
+      this_alpha_smbr += fwd_scale[a] *
+          (alpha_smbr[flat.arc_source[a]] + frame_acc[a]);
+    }
+    alpha_smbr[s] = this_alpha_smbr;
+  }
+  for (int32 s = 0; s < num_states; s++) {
+    if (flat.final_like[s] != kLogZeroDouble) {
+      double final_like = alpha[s] + flat.final_like[s];
       double arc_scale = Exp(final_like - tot_forward_prob);
       tot_forward_score += arc_scale * alpha_smbr[s];
-      KALDI_ASSERT(state_times[s] == max_time &&
-                   "Lattice is inconsistent (final-prob not at max_time)");
     }
   }
   // Second Pass Backward, collect Mpe style posteriors
-  for (StateId s = num_states-1; s >= 0; s--) {
-    for (ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight),
-          arc_beta = beta[arc.nextstate] + arc_like;
-      double frame_acc = 0.0;
-      int32 transition_id = arc.ilabel;
-      if (arc.ilabel != 0) {
-        int32 cur_time = state_times[s];
-        int32 phone = trans.TransitionIdToPhone(arc.ilabel),
-            ref_phone = trans.TransitionIdToPhone(num_ali[cur_time]);
-        bool phone_is_sil = std::binary_search(silence_phones.begin(),
-                                               silence_phones.end(), phone),
-            ref_phone_is_sil = std::binary_search(silence_phones.begin(),
-                                                  silence_phones.end(),
-                                                  ref_phone),
-            both_sil = phone_is_sil && ref_phone_is_sil;
-        if (!is_mpfe) { // smbr.
-          int32 pdf = trans.TransitionIdToPdf(arc.ilabel),
-              ref_pdf = trans.TransitionIdToPdf(num_ali[cur_time]);
-          if (!one_silence_class)  // old behavior
-            frame_acc = (pdf == ref_pdf && !phone_is_sil) ? 1.0 : 0.0;
-          else
-            frame_acc = (pdf == ref_pdf || both_sil) ? 1.0 : 0.0;
-        } else {
-          if (!one_silence_class)  // old behavior
-            frame_acc = (phone == ref_phone && !phone_is_sil) ? 1.0 : 0.0;
-          else
-            frame_acc = (phone == ref_phone || both_sil) ? 1.0 : 0.0;
-        }
-      }
-      double arc_scale = Exp(beta[arc.nextstate] + arc_like - beta[s]);
+  for (int32 s = num_states - 1; s >= 0; s--) {
+    for (int32 a = flat.arc_begin[s]; a < flat.arc_begin[s + 1]; a++) {
+      int32 d = flat.arc_dest[a];
+      double arc_scale = bwd_scale[a];
       // check arc_scale NAN,
       // this is to prevent partial paths in Lattices
       // i.e., paths don't survive to the final state
       if (KALDI_ISNAN(arc_scale)) arc_scale = 0;
-      beta_smbr[s] += arc_scale * (beta_smbr[arc.nextstate] + frame_acc);
+      beta_smbr[s] += arc_scale * (beta_smbr[d] + frame_acc[a]);
 
+      int32 transition_id = flat.arc_ilabel[a];
       if (transition_id != 0) { // Arc has a transition-id on it [not epsilon]
-        double posterior = Exp(alpha[s] + arc_beta - tot_forward_prob);
-        double acc_diff = alpha_smbr[s] + frame_acc + beta_smbr[arc.nextstate]
+        double posterior = Exp(alpha[s] + (beta[d] + flat.arc_like[a]) -
+                               tot_forward_prob);
+        double acc_diff = alpha_smbr[s] + frame_acc[a] + beta_smbr[d]
                                - tot_forward_score;
         double posterior_smbr = posterior * acc_diff;
         (*post)[state_times[s]].push_back(std::make_pair(transition_id,
@@ -1584,4 +1619,224 @@ void ComposeCompactLatticeDeterministic(
   fst::Connect(composed_clat);
 }
 
+// A hypothesis of CompactLatticeOracleEditDistance(): the best path found so
+// far from the start of the lattice to some state, that has consumed the first
+// "ref_pos" words of the reference.
+struct LatticeOracleToken {
+  int32 cost;  // The number of errors on the path.
+  int32 ref_pos;
+  int32 word;  // The lattice word on the last step of the path (0 if none).
+  int32 prev;  // The index of the previous token on the path; -1 at the start.
+  LatticeOracleToken(int32 cost, int32 ref_pos, int32 word, int32 prev):
+      cost(cost), ref_pos(ref_pos), word(word), prev(prev) { }
+};
+
+// Returns a lower bound on the number of errors still to come, for a path that
+// has "num_ref_left" reference words left and is at a lattice state from which
+// between "min_len" and "max_len" more words are output.
+static inline int32 LatticeOracleLowerBound(int32 min_len, int32 max_len,
+                                            int32 num_ref_left) {
+  return std::max(0, std::max(num_ref_left - max_len,
+                              min_len - num_ref_left));
+}
+
+// This does the work of CompactLatticeOracleEditDistance(); it returns the
+// index in "tokens" of the best final token, or -1 if there was none.
+static int32 CompactLatticeOracleInternal(
+    const CompactLattice &clat,
+    const std::vector<int32> &reference,
+    BaseFloat beam,
+    std::vector<LatticeOracleToken> *tokens) {
+  typedef CompactLatticeArc Arc;
+  typedef Arc::StateId StateId;
+  int32 num_states = clat.NumStates(), ref_len = reference.size();
+  const int32 kInf = std::numeric_limits<int32>::max() / 4;
+
+  // min_len[s] and max_len[s] are the minimum and maximum number of words on
+  // the paths from s to a final state (kInf and -1 if there are none).  They
+  // give a lower bound on the number of errors to come, which we add to the
+  // cost of a token for pruning.
+  std::vector<int32> min_len(num_states, kInf), max_len(num_states, -1);
+  for (StateId s = num_states - 1; s >= 0; s--) {
+    if (clat.Final(s) != CompactLatticeWeight::Zero())
+      min_len[s] = max_len[s] = 0;
+    for (fst::ArcIterator<CompactLattice> aiter(clat, s);
+         !aiter.Done(); aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      KALDI_ASSERT(arc.nextstate > s && "Lattice is not topologically sorted.");
+      if (min_len[arc.nextstate] == kInf) continue;
+      int32 n = (arc.olabel != 0 ? 1 : 0);
+      min_len[s] = std::min(min_len[s], min_len[arc.nextstate] + n);
+      max_len[s] = std::max(max_len[s], max_len[arc.nextstate] + n);
+    }
+  }
+
+  // The tokens of the states that have not been processed yet, indexed by
+  // (state, ref_pos); pending_pos[s] lists the ref_pos values for state s.
+  // A pending token may be overwritten by a better one, since no other token
+  // points to it yet.
+  typedef unordered_map<std::pair<StateId, int32>, int32,
+                        PairHasher<int32> > PendingMap;
+  PendingMap pending;
+  std::vector<std::vector<int32> > pending_pos(num_states);
+  tokens->clear();
+  tokens->push_back(LatticeOracleToken(0, 0, 0, -1));
+  pending[std::make_pair(clat.Start(), 0)] = 0;
+  pending_pos[clat.Start()].push_back(0);
+
+  int32 best_final = -1;
+  std::vector<std::pair<int32, int32> > entries, active;  // (ref_pos, token)
+  for (StateId s = 0; s < num_states; s++) {
+    std::vector<int32> &positions = pending_pos[s];
+    if (positions.empty()) continue;
+    std::sort(positions.begin(), positions.end());
+    entries.clear();
+    for (size_t i = 0; i < positions.size(); i++) {
+      PendingMap::iterator iter = pending.find(std::make_pair(s, positions[i]));
+      entries.push_back(std::make_pair(positions[i], iter->second));
+      pending.erase(iter);
+    }
+    std::vector<int32>().swap(positions);
+    if (min_len[s] == kInf) continue;  // No final state can be reached.
+
+    // Tokens whose cost plus the lower bound on the errors to come exceeds the
+    // best such score at this state by more than "beam" are pruned.  The
+    // score can only increase along a sequence of deletions, so the best
+    // score is that of one of the entries.
+    double threshold = std::numeric_limits<double>::infinity();
+    if (beam > 0) {
+      int32 best_score = kInf;
+      for (size_t i = 0; i < entries.size(); i++) {
+        int32 score = (*tokens)[entries[i].second].cost +
+            LatticeOracleLowerBound(min_len[s], max_len[s],
+                                    ref_len - entries[i].first);
+        best_score = std::min(best_score, score);
+      }
+      threshold = best_score + beam;
+    }
+
+    // Extends the entries with deletions of reference words, giving "active",
+    // the tokens of this state in order of ref_pos.
+    active.clear();
+    size_t k = 0;
+    int32 j = entries[0].first, carry = -1;  // carry is the token at j - 1.
+    while (j <= ref_len) {
+      int32 tok = -1;
+      if (k < entries.size() && entries[k].first == j) {
+        tok = entries[k].second;
+        k++;
+      }
+      if (carry != -1 &&
+          (tok == -1 || (*tokens)[carry].cost + 1 < (*tokens)[tok].cost)) {
+        tokens->push_back(LatticeOracleToken((*tokens)[carry].cost + 1, j, 0,
+                                             carry));
+        tok = tokens->size() - 1;
+      }
+      if (tok != -1 && (*tokens)[tok].cost +
+          LatticeOracleLowerBound(min_len[s], max_len[s], ref_len - j) <=
+          threshold) {
+        active.push_back(std::make_pair(j, tok));
+        carry = tok;
+        j++;
+      } else {
+        carry = -1;
+        if (k == entries.size()) break;
+        j = entries[k].first;
+      }
+    }
+
+    if (clat.Final(s) != CompactLatticeWeight::Zero() && !active.empty() &&
+        active.back().first == ref_len) {
+      int32 tok = active.back().second;
+      if (best_final == -1 || (*tokens)[tok].cost < (*tokens)[best_final].cost)
+        best_final = tok;
+    }
+
+    for (fst::ArcIterator<CompactLattice> aiter(clat, s);
+         !aiter.Done(); aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      StateId t = arc.nextstate;
+      if (min_len[t] == kInf) continue;
+      int32 word = arc.olabel;
+      for (size_t i = 0; i < active.size(); i++) {
+        int32 pos = active[i].first, tok = active[i].second,
+            cost = (*tokens)[tok].cost;
+        // Up to two successors: the epsilon or insertion, which keeps the
+        // ref_pos, and the match or substitution, which advances it.
+        for (int32 n = 0; n < 2; n++) {
+          int32 next_pos = pos, next_cost = cost;
+          if (n == 0) {
+            if (word != 0) next_cost++;
+          } else {
+            if (word == 0 || pos == ref_len) break;
+            next_pos++;
+            if (word != reference[pos]) next_cost++;
+          }
+          std::pair<PendingMap::iterator, bool> ret = pending.insert(
+              std::make_pair(std::make_pair(t, next_pos),
+                             static_cast<int32>(tokens->size())));
+          if (ret.second) {
+            tokens->push_back(LatticeOracleToken(next_cost, next_pos, word,
+                                                 tok));
+            pending_pos[t].push_back(next_pos);
+          } else {
+            LatticeOracleToken &other = (*tokens)[ret.first->second];
+            if (next_cost < other.cost)
+              other = LatticeOracleToken(next_cost, next_pos, word, tok);
+          }
+        }
+      }
+    }
+  }
+  return best_final;
+}
+
+bool CompactLatticeOracleEditDistance(const CompactLattice &clat,
+                                      const std::vector<int32> &reference,
+                                      BaseFloat beam,
+                                      std::vector<int32> *oracle_words,
+                                      int32 *correct,
+                                      int32 *substitutions,
+                                      int32 *insertions,
+                                      int32 *deletions) {
+  oracle_words->clear();
+  *correct = *substitutions = *insertions = *deletions = 0;
+  if (clat.Start() == fst::kNoStateId) return false;
+  KALDI_ASSERT(clat.Properties(fst::kTopSorted, true) != 0 &&
+               "Lattice is not topologically sorted.");
+  for (size_t i = 0; i < reference.size(); i++)
+    KALDI_ASSERT(reference[i] != 0);
+
+  std::vector<LatticeOracleToken> tokens;
+  int32 best_final = CompactLatticeOracleInternal(clat, reference, beam,
+                                                  &tokens);
+  if (best_final == -1 && beam > 0) {
+    KALDI_WARN << "No path through the lattice survived the oracle beam "
+               << beam << "; retrying without pruning.";
+    best_final = CompactLatticeOracleInternal(clat, reference, 0.0, &tokens);
+  }
+  if (best_final == -1) return false;
+
+  std::vector<int32> path;
+  for (int32 tok = best_final; tok != -1; tok = tokens[tok].prev)
+    path.push_back(tok);
+  std::reverse(path.begin(), path.end());
+  for (size_t i = 1; i < path.size(); i++) {
+    const LatticeOracleToken &prev = tokens[path[i - 1]],
+        &cur = tokens[path[i]];
+    bool advances = (cur.ref_pos != prev.ref_pos);
+    if (cur.word != 0) {
+      oracle_words->push_back(cur.word);
+      if (!advances) (*insertions)++;
+      else if (cur.word == reference[prev.ref_pos]) (*correct)++;
+      else (*substitutions)++;
+    } else if (advances) {
+      (*deletions)++;
+    }
+  }
+  KALDI_ASSERT(*substitutions + *insertions + *deletions ==
+               tokens[best_final].cost);
+  return true;
+}
+
 }  // namespace kaldi
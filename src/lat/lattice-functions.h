@@ -74,6 +74,52 @@ bool ComputeCompactLatticeAlphas(const CompactLattice &lat,
 bool ComputeCompactLatticeBetas(const CompactLattice &lat,
                                 vector<double> *beta);
 
+/// A flattened copy of the arcs of a topologically sorted lattice with start
+/// state 0, as used internally by the forward-backward functions above and by
+/// LatticeForwardBackwardMpeVariants().  Keeping the arcs in contiguous arrays
+/// avoids the ArcIterator overhead in the inner loops, and lets the log-add
+/// over all the arcs entering (or leaving) a state be done in one pass with a
+/// single max, an exp per arc and a log per state, rather than a LogAdd()
+/// (exp and log1p) per arc.
+struct FlatLattice {
+  /// The arcs leaving state s are indexes arc_begin[s] <= a < arc_begin[s+1],
+  /// in the order the ArcIterator gives them.  Size is num-states + 1.
+  std::vector<int32> arc_begin;
+  std::vector<int32> arc_source;  // source state of each arc.
+  std::vector<int32> arc_dest;  // destination state of each arc.
+  std::vector<int32> arc_ilabel;  // ilabel of each arc.
+  std::vector<double> arc_like;  // negated total cost of each arc.
+  std::vector<double> arc_acoustic_cost;  // acoustic cost (Value2()) of each arc.
+  /// The arcs entering state s are in_arcs[i] for in_begin[s] <= i <
+  /// in_begin[s+1], in increasing order.  Size is num-states + 1.
+  std::vector<int32> in_begin;
+  std::vector<int32> in_arcs;
+  /// negated final-cost of each state (kLogZeroDouble if not final).
+  std::vector<double> final_like;
+  std::vector<double> final_acoustic_cost;  // acoustic part of final-cost.
+
+  int32 NumStates() const { return static_cast<int32>(final_like.size()); }
+  int32 NumArcs() const { return static_cast<int32>(arc_dest.size()); }
+};
+
+/// Sets up "flat" from a lattice, which must be topologically sorted with start
+/// state 0 (this is checked).
+void FlattenLattice(const Lattice &lat, FlatLattice *flat);
+
+/// As the Lattice version; the "ilabel" is the word label, and the costs are
+/// those of the LatticeWeight part of the weights.
+void FlattenLattice(const CompactLattice &clat, FlatLattice *flat);
+
+/// Computes the forward (alpha) log-probabilities of the states of a
+/// FlatLattice; alpha[0] is 0.0, and the final-probs are not included.
+void ComputeFlatLatticeAlphas(const FlatLattice &flat,
+                              std::vector<double> *alpha);
+
+/// Computes the backward (beta) log-probabilities of the states of a
+/// FlatLattice, including the final-probs.
+void ComputeFlatLatticeBetas(const FlatLattice &flat,
+                             std::vector<double> *beta);
+
 /// Topologically sort the compact lattice if not already topologically sorted.
 /// Will crash if the lattice cannot be topologically sorted.
 void TopSortCompactLatticeIfNeeded(CompactLattice *clat);
@@ -306,6 +352,28 @@ void ComposeCompactLatticeDeterministic(
     fst::DeterministicOnDemandFst<fst::StdArc>* det_fst,
     CompactLattice* composed_clat);
 
+/// This function finds the path through a CompactLattice whose word
+/// sequence has the smallest edit distance (Levenshtein distance) to
+/// "reference", i.e. the oracle path, by dynamic programming over the lattice
+/// states and the reference positions.  This is much cheaper than composing
+/// the lattice with an edit-distance transducer.  The lattice must be
+/// topologically sorted; its weights are ignored and output labels of zero
+/// are treated as epsilon.  "reference" must not contain zeros.
+/// If beam > 0, hypotheses whose number of errors (plus a lower bound on the
+/// errors still to come) is more than "beam" worse than the best one at the
+/// same state are pruned, which makes it faster but possibly inexact; if
+/// beam <= 0 the result is exact.  Outputs the oracle word sequence and the
+/// counts of correct words, substitutions, insertions and deletions.  Returns
+/// false if the lattice has no successful path.
+bool CompactLatticeOracleEditDistance(const CompactLattice &clat,
+                                      const std::vector<int32> &reference,
+                                      BaseFloat beam,
+                                      std::vector<int32> *oracle_words,
+                                      int32 *correct,
+                                      int32 *substitutions,
+                                      int32 *insertions,
+                                      int32 *deletions);
+
 }  // namespace kaldi
 
 #endif  // KALDI_LAT_LATTICE_FUNCTIONS_H_
@@ -20,6 +20,7 @@
 
 #include "lat/sausages.h"
 #include "lat/lattice-functions.h"
+#include "thread/kaldi-thread.h"
 
 namespace kaldi {
 
@@ -90,6 +91,42 @@ void MinimumBayesRisk::NormalizeEps(std::vector<int32> *vec) {
   (*vec)[0] = 0;
 }
 
+void MinimumBayesRisk::ArcEditDistance(const double *alpha_dash_s, int32 w_a,
+                                       int32 Q, double *alpha_dash_arc,
+                                       char *b_arc) const {
+  double l_w0 = l(w_a, 0), d = delta();
+  alpha_dash_arc[0] = alpha_dash_s[0] + l_w0 + d;  // line 15.
+  const int32 *r = (Q > 0 ? &(R_[0]) : NULL);  // r[q-1] is r_q.
+  if (b_arc == NULL) {
+    // The terms a1 and a2 of the min expression of line 17 do not depend on
+    // alpha_dash_arc, so we compute min(a1, a2) in a loop that the compiler
+    // can vectorize, and then do the recursion through a3.
+    for (int32 q = 1; q <= Q; q++) {
+      double a1 = alpha_dash_s[q-1] + l(w_a, r[q-1]),
+          a2 = alpha_dash_s[q] + l_w0 + d;
+      alpha_dash_arc[q] = std::min(a1, a2);
+    }
+    for (int32 q = 1; q <= Q; q++) {
+      double a3 = alpha_dash_arc[q-1] + l(0, r[q-1]);
+      if (a3 < alpha_dash_arc[q]) alpha_dash_arc[q] = a3;
+    }
+  } else {
+    for (int32 q = 1; q <= Q; q++) {  // lines 15-18 of Figure 5.
+      int32 r_q = r[q-1];
+      double a1 = alpha_dash_s[q-1] + l(w_a, r_q),
+          a2 = alpha_dash_s[q] + l_w0 + d,
+          a3 = alpha_dash_arc[q-1] + l(0, r_q);
+      if (a1 <= a2) {
+        if (a1 <= a3) { b_arc[q] = 1; alpha_dash_arc[q] = a1; }
+        else { b_arc[q] = 3; alpha_dash_arc[q] = a3; }
+      } else {
+        if (a2 <= a3) { b_arc[q] = 2; alpha_dash_arc[q] = a2; }
+        else { b_arc[q] = 3; alpha_dash_arc[q] = a3; }
+      }
+    }
+  }
+}
+
 double MinimumBayesRisk::EditDistance(int32 N, int32 Q,
                                       Vector<double> &alpha,
                                       Matrix<double> &alpha_dash,
@@ -106,24 +143,19 @@ double MinimumBayesRisk::EditDistance(int32 N, int32 Q,
     }
     alpha(n) = alpha_n; // Line 10.
     // Line 11 omitted: matrix was initialized to zero.
+    double *alpha_dash_n = alpha_dash.RowData(n);
+    const double *arc_data = alpha_dash_arc.Data();
     for (size_t i = 0; i < pre_[n].size(); i++) {
       const Arc &arc = arcs_[pre_[n][i]];
       int32 s_a = arc.start_node, w_a = arc.word;
       BaseFloat p_a = arc.loglike;
-      for (int32 q = 0; q <= Q; q++) {
-        if (q == 0) {
-          alpha_dash_arc(q) = // line 15.
-              alpha_dash(s_a, q) + l(w_a, 0) + delta();
-        } else {  // a1,a2,a3 are the 3 parts of min expression of line 17.
-          int32 r_q = r(q);
-          double a1 = alpha_dash(s_a, q-1) + l(w_a, r_q),
-              a2 = alpha_dash(s_a, q) + l(w_a, 0) + delta(),
-              a3 = alpha_dash_arc(q-1) + l(0, r_q);
-          alpha_dash_arc(q) = std::min(a1, std::min(a2, a3));
-        }
-        // line 19:
-        alpha_dash(n, q) += Exp(alpha(s_a) + p_a - alpha(n)) * alpha_dash_arc(q);
-      }
+      // lines 13 to 18:
+      ArcEditDistance(alpha_dash.RowData(s_a), w_a, Q,
+                      alpha_dash_arc.Data(), NULL);
+      // line 19:
+      double scale = Exp(alpha(s_a) + p_a - alpha(n));
+      for (int32 q = 0; q <= Q; q++)
+        alpha_dash_n[q] += scale * arc_data[q];
     }
   }
   return alpha_dash(N, Q); // line 23.
@@ -165,24 +197,14 @@ void MinimumBayesRisk::AccStats() {
       const Arc &arc = arcs_[pre_[n][i]];
       int32 s_a = arc.start_node, w_a = arc.word;
       BaseFloat p_a = arc.loglike;
-      alpha_dash_arc(0) = alpha_dash(s_a, 0) + l(w_a, 0) + delta(); // line 14.
-      for (int32 q = 1; q <= Q; q++) { // this loop == lines 15-18.
-        int32 r_q = r(q);
-        double a1 = alpha_dash(s_a, q-1) + l(w_a, r_q),
-            a2 = alpha_dash(s_a, q) + l(w_a, 0) + delta(),
-            a3 = alpha_dash_arc(q-1) + l(0, r_q);
-        if (a1 <= a2) {
-          if (a1 <= a3) { b_arc[q] = 1; alpha_dash_arc(q) = a1; }
-          else { b_arc[q] = 3; alpha_dash_arc(q) = a3; }
-        } else {
-          if (a2 <= a3) { b_arc[q] = 2; alpha_dash_arc(q) = a2; }
-          else { b_arc[q] = 3; alpha_dash_arc(q) = a3; }
-        }
-      }
+      // lines 14-18:
+      ArcEditDistance(alpha_dash.RowData(s_a), w_a, Q,
+                      alpha_dash_arc.Data(), &(b_arc[0]));
+      double scale = Exp(alpha(s_a) + p_a - alpha(n));
       beta_dash_arc.SetZero(); // line 19.
       for (int32 q = Q; q >= 1; q--) {
         // line 21:
-        beta_dash_arc(q) += Exp(alpha(s_a) + p_a - alpha(n)) * beta_dash(n, q);
+        beta_dash_arc(q) += scale * beta_dash(n, q);
         switch (static_cast<int>(b_arc[q])) { // lines 22 and 23:
           case 1:
             beta_dash(s_a, q-1) += beta_dash_arc(q);
@@ -210,7 +232,7 @@ void MinimumBayesRisk::AccStats() {
             KALDI_ERR << "Invalid b_arc value"; // error in code.
         }
       }
-      beta_dash_arc(0) += Exp(alpha(s_a) + p_a - alpha(n)) * beta_dash(n, 0);
+      beta_dash_arc(0) += scale * beta_dash(n, 0);
       beta_dash(s_a, 0) += beta_dash_arc(0); // line 26.
     }
   }
@@ -314,8 +336,7 @@ void MinimumBayesRisk::PrepareLatticeAndInitStats(CompactLattice *clat) {
   }
 }
 
-MinimumBayesRisk::MinimumBayesRisk(const CompactLattice &clat_in, bool do_mbr):
-    do_mbr_(do_mbr) {
+void MinimumBayesRisk::Compute(const CompactLattice &clat_in) {
   CompactLattice clat(clat_in); // copy.
 
   PrepareLatticeAndInitStats(&clat);
@@ -345,7 +366,158 @@ MinimumBayesRisk::MinimumBayesRisk(const CompactLattice &clat_in, bool do_mbr):
   }
   
   MbrDecode();
-  
+}
+
+MinimumBayesRisk::MinimumBayesRisk(const CompactLattice &clat_in, bool do_mbr):
+    do_mbr_(do_mbr) {
+  Compute(clat_in);
+}
+
+void MinimumBayesRisk::SplitLattice(const CompactLattice &clat_in,
+                                    int32 segment_frames,
+                                    std::vector<CompactLattice> *segments,
+                                    std::vector<int32> *segment_times) {
+  segments->clear();
+  segment_times->clear();
+  CompactLattice clat(clat_in);
+  fst::Connect(&clat);
+  if (clat.Start() == fst::kNoStateId) {  // empty lattice: nothing to split.
+    segments->push_back(clat_in);
+    segment_times->push_back(0);
+    return;
+  }
+  CreateSuperFinal(&clat);
+  if (!(clat.Properties(fst::kTopSorted, true) & fst::kTopSorted)) {
+    if (fst::TopSort(&clat) == false)
+      KALDI_ERR << "Cycles detected in lattice.";
+  }
+  std::vector<int32> state_times;
+  CompactLatticeStateTimes(clat, &state_times);
+  int32 N = clat.NumStates();
+
+  // num_spanning[n] is the number of arcs from a state before n to a state
+  // after n; n is a bottleneck state (every path goes through it) if this is
+  // zero, since the lattice is topologically sorted and connected.
+  std::vector<int32> num_spanning(N + 1, 0);
+  for (int32 s = 0; s < N; s++) {
+    for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+         aiter.Next()) {
+      int32 e = aiter.Value().nextstate;
+      if (e > s + 1) {
+        num_spanning[s + 1]++;
+        num_spanning[e]--;
+      }
+    }
+  }
+  std::vector<int32> split_states(1, 0);
+  int32 total_time = state_times[N - 1], count = 0;
+  for (int32 n = 1; n + 1 < N; n++) {
+    count += num_spanning[n];
+    if (count == 0 &&
+        state_times[n] - state_times[split_states.back()] >= segment_frames &&
+        total_time - state_times[n] >= segment_frames)
+      split_states.push_back(n);
+  }
+  if (split_states.size() == 1) {  // no split point; keep the lattice as it
+    // was, so the output is exactly as if we had not tried to split it.
+    segments->push_back(clat_in);
+    segment_times->push_back(0);
+    return;
+  }
+  split_states.push_back(N - 1);
+
+  segments->resize(split_states.size() - 1);
+  for (size_t i = 0; i + 1 < split_states.size(); i++) {
+    int32 a = split_states[i], b = split_states[i + 1];
+    CompactLattice &segment = (*segments)[i];
+    for (int32 s = a; s <= b; s++)
+      segment.AddState();
+    segment.SetStart(0);
+    for (int32 s = a; s < b; s++) {
+      for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+           aiter.Next()) {
+        CompactLatticeArc arc = aiter.Value();
+        KALDI_ASSERT(arc.nextstate <= b);
+        arc.nextstate -= a;
+        segment.AddArc(s - a, arc);
+      }
+    }
+    segment.SetFinal(b - a, CompactLatticeWeight::One());
+    segment_times->push_back(state_times[a]);
+  }
+}
+
+void MinimumBayesRisk::CombineSegments(
+    const std::vector<MinimumBayesRisk*> &segments,
+    const std::vector<int32> &segment_times) {
+  KALDI_ASSERT(segments.size() == segment_times.size());
+  R_.clear();
+  gamma_.clear();
+  times_.clear();
+  one_best_times_.clear();
+  one_best_confidences_.clear();
+  L_ = 0.0;
+  for (size_t i = 0; i < segments.size(); i++) {
+    const MinimumBayesRisk &seg = *(segments[i]);
+    BaseFloat offset = segment_times[i];
+    R_.insert(R_.end(), seg.R_.begin(), seg.R_.end());
+    gamma_.insert(gamma_.end(), seg.gamma_.begin(), seg.gamma_.end());
+    for (size_t j = 0; j < seg.times_.size(); j++)
+      times_.push_back(std::make_pair(seg.times_[j].first + offset,
+                                      seg.times_[j].second + offset));
+    for (size_t j = 0; j < seg.one_best_times_.size(); j++)
+      one_best_times_.push_back(
+          std::make_pair(seg.one_best_times_[j].first + offset,
+                         seg.one_best_times_[j].second + offset));
+    one_best_confidences_.insert(one_best_confidences_.end(),
+                                 seg.one_best_confidences_.begin(),
+                                 seg.one_best_confidences_.end());
+    L_ += seg.L_;
+  }
+}
+
+// This class does the MBR computation for segments num_threads apart,
+// starting from thread_id_.
+class MbrSegmentClass: public MultiThreadable {
+ public:
+  MbrSegmentClass(const std::vector<CompactLattice> &segments, bool do_mbr,
+                  std::vector<MinimumBayesRisk*> *results):
+      segments_(&segments), do_mbr_(do_mbr), results_(results) { }
+  void operator() () {
+    for (size_t i = thread_id_; i < segments_->size(); i += num_threads_)
+      (*results_)[i] = new MinimumBayesRisk((*segments_)[i], do_mbr_);
+  }
+ private:
+  const std::vector<CompactLattice> *segments_;
+  bool do_mbr_;
+  std::vector<MinimumBayesRisk*> *results_;
+};
+
+MinimumBayesRisk::MinimumBayesRisk(const CompactLattice &clat_in,
+                                   const MinimumBayesRiskOptions &opts):
+    do_mbr_(opts.decode_mbr) {
+  if (opts.segment_frames <= 0) {
+    Compute(clat_in);
+    return;
+  }
+  std::vector<CompactLattice> segments;
+  std::vector<int32> segment_times;
+  SplitLattice(clat_in, opts.segment_frames, &segments, &segment_times);
+  if (segments.size() == 1) {
+    Compute(segments[0]);
+    return;
+  }
+  KALDI_VLOG(2) << "Split lattice into " << segments.size() << " segments.";
+  std::vector<MinimumBayesRisk*> results(segments.size(), NULL);
+  {
+    MbrSegmentClass c(segments, do_mbr_, &results);
+    int32 num_threads = std::max<int32>(1, std::min<int32>(opts.num_threads,
+                                                           segments.size()));
+    // The MultiThreader destructor waits for all the threads to finish.
+    MultiThreader<MbrSegmentClass> m(num_threads, c);
+  }
+  CombineSegments(results, segment_times);
+  DeletePointers(&results);
 }
 
 MinimumBayesRisk::MinimumBayesRisk(const CompactLattice &clat_in,
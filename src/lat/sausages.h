@@ -53,6 +53,35 @@ namespace kaldi {
 /// is where we put possible insertions. 
 
 
+struct MinimumBayesRiskOptions {
+  /// If true, do Minimum Bayes Risk decoding; if false, the output is the MAP
+  /// recognition output, but we still get the MBR stats.
+  bool decode_mbr;
+  /// If > 0, lattices are split at states that every path goes through
+  /// ("bottleneck" states, typically in silence), into segments of at least
+  /// this many frames, and each segment is processed separately (which is an
+  /// approximation, since the edit-distance alignment can no longer cross the
+  /// split points).  Lattices too short to be split give the same output as
+  /// with segment_frames == 0.
+  int32 segment_frames;
+  /// Number of threads used to process the segments.
+  int32 num_threads;
+
+  MinimumBayesRiskOptions(): decode_mbr(true), segment_frames(0),
+                             num_threads(1) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("decode-mbr", &decode_mbr, "If true, do Minimum Bayes Risk "
+                   "decoding (else, Maximum a Posteriori)");
+    opts->Register("mbr-segment-frames", &segment_frames, "If > 0, split long "
+                   "lattices at states all paths go through, into segments of "
+                   "at least this many frames, and do MBR on each (faster, but "
+                   "approximate).");
+    opts->Register("mbr-num-threads", &num_threads, "Number of threads used "
+                   "to process the segments if --mbr-segment-frames > 0.");
+  }
+};
+
 /// This class does the word-level Minimum Bayes Risk computation, and gives you
 /// either the 1-best MBR output together with the expected Bayes Risk,
 /// or a sausage-like structure.
@@ -70,6 +99,13 @@ class MinimumBayesRisk {
   MinimumBayesRisk(const CompactLattice &clat,
                    const std::vector<int32> &words, bool do_mbr = false);
 
+  /// This version supports splitting long lattices into segments (see
+  /// MinimumBayesRiskOptions); the output is the concatenation of that of the
+  /// segments, so the sausage stats have two adjacent epsilon bins at each
+  /// split point.
+  MinimumBayesRisk(const CompactLattice &clat,
+                   const MinimumBayesRiskOptions &opts);
+
   const std::vector<int32> &GetOneBest() const { // gets one-best (with no epsilons)
     return R_;
   }
@@ -103,16 +139,38 @@ class MinimumBayesRisk {
  private:
   void PrepareLatticeAndInitStats(CompactLattice *clat);
 
+  /// Sets R_ to the best path of the lattice and does the computation; called
+  /// from the constructors.
+  void Compute(const CompactLattice &clat);
+
+  /// Splits the lattice at bottleneck states into segments of at least
+  /// "segment_frames" frames; outputs the segments and the time of their
+  /// first state.  Outputs just one segment if it can't split it.
+  static void SplitLattice(const CompactLattice &clat, int32 segment_frames,
+                           std::vector<CompactLattice> *segments,
+                           std::vector<int32> *segment_times);
+
+  /// Sets up the output of *this by concatenating that of the segments.
+  void CombineSegments(const std::vector<MinimumBayesRisk*> &segments,
+                       const std::vector<int32> &segment_times);
+
   /// Minimum-Bayes-Risk Decode. Top-level algorithm.  Figure 6 of the paper.
   void MbrDecode(); 
 
   /// The basic edit-distance function l(a,b), as in the paper.
-  inline double l(int32 a, int32 b) { return (a == b ? 0.0 : 1.0); }
+  inline double l(int32 a, int32 b) const { return (a == b ? 0.0 : 1.0); }
   
   /// returns r_q, in one-based indexing, as in the paper.
   inline int32 r(int32 q) { return R_[q-1]; }
   
   
+  /// Computes alpha'_{a,q} for q = 0...Q for an arc with word w_a leaving a
+  /// state whose alpha' values are "alpha_dash_s" (lines 15-17 of Figure 4,
+  /// or 14-18 of Figure 5).  If b_arc != NULL, also outputs b_arc[q] (for q
+  /// = 1...Q) as in Figure 5.
+  void ArcEditDistance(const double *alpha_dash_s, int32 w_a, int32 Q,
+                       double *alpha_dash_arc, char *b_arc) const;
+
   /// Figure 4 of the paper; called from AccStats (Fig. 5)
   double EditDistance(int32 N, int32 Q,
                       Vector<double> &alpha,
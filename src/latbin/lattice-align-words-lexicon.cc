@@ -23,6 +23,89 @@
 #include "lat/kaldi-lattice.h"
 #include "lat/word-align-lattice-lexicon.h"
 #include "lat/lattice-functions.h"
+#include "thread/kaldi-task-sequence.h"
+
+namespace kaldi {
+
+class WordAlignLatticeLexiconTask {
+ public:
+  // Initializer takes ownership of "clat".
+  WordAlignLatticeLexiconTask(const TransitionModel &tmodel,
+                              const WordAlignLatticeLexiconInfo &lexicon_info,
+                              const WordAlignLatticeLexiconOpts &opts,
+                              bool output_if_error,
+                              bool output_if_empty,
+                              const std::string &key,
+                              CompactLattice *clat,
+                              CompactLatticeWriter *clat_writer,
+                              int32 *num_done,
+                              int32 *num_err):
+      tmodel_(tmodel), lexicon_info_(lexicon_info), opts_(opts),
+      output_if_error_(output_if_error), output_if_empty_(output_if_empty),
+      key_(key), clat_(clat), clat_writer_(clat_writer), num_done_(num_done),
+      num_err_(num_err), ok_(false) { }
+
+  void operator () () {
+    ok_ = WordAlignLatticeLexicon(*clat_, tmodel_, lexicon_info_, opts_,
+                                  &aligned_clat_);
+    if (ok_ || !output_if_empty_) {
+      // The input lattice is only needed if we may pass it through.
+      delete clat_;
+      clat_ = NULL;
+    }
+    if (ok_ && aligned_clat_.Start() != fst::kNoStateId)
+      TopSortCompactLatticeIfNeeded(&aligned_clat_);
+  }
+
+  // The output is written, and the counts updated, in the destructor, which
+  // the TaskSequencer calls in the original order.
+  ~WordAlignLatticeLexiconTask() {
+    if (!ok_) {
+      (*num_err_)++;
+      if (output_if_empty_ && aligned_clat_.NumStates() == 0 &&
+          clat_->NumStates() != 0) {
+        KALDI_WARN << "Algorithm produced no output (due to --max-expand?), "
+                   << "so passing input through as output, for key " << key_;
+        clat_writer_->Write(key_, *clat_);
+      } else if (!output_if_error_) {
+        KALDI_WARN << "Lattice for " << key_ << " did not align correctly";
+      } else {
+        if (aligned_clat_.Start() != fst::kNoStateId) {
+          KALDI_WARN << "Outputting partial lattice for " << key_;
+          clat_writer_->Write(key_, aligned_clat_);
+        } else {
+          KALDI_WARN << "Empty aligned lattice for " << key_
+                     << ", producing no output.";
+        }
+      }
+    } else {
+      if (aligned_clat_.Start() == fst::kNoStateId) {
+        (*num_err_)++;
+        KALDI_WARN << "Lattice was empty for key " << key_;
+      } else {
+        (*num_done_)++;
+        KALDI_VLOG(2) << "Aligned lattice for " << key_;
+        clat_writer_->Write(key_, aligned_clat_);
+      }
+    }
+    delete clat_;
+  }
+ private:
+  const TransitionModel &tmodel_;
+  const WordAlignLatticeLexiconInfo &lexicon_info_;
+  const WordAlignLatticeLexiconOpts &opts_;
+  bool output_if_error_;
+  bool output_if_empty_;
+  std::string key_;
+  CompactLattice *clat_;  // The input lattice; owned locally.
+  CompactLattice aligned_clat_;  // The output of our process.
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int32 *num_err_;
+  bool ok_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -42,7 +125,9 @@ int main(int argc, char *argv[]) {
         " e.g.: lattice-align-words-lexicon  --partial-word-label=4324 --max-expand 10.0 --test true \\\n"
         "   data/lang/phones/align_lexicon.int final.mdl ark:1.lats ark:aligned.lats\n"
         "See also: lattice-align-words, which is only applicable if your phones have word-position\n"
-        "markers, i.e. each phone comes in 5 versions like AA_B, AA_I, AA_W, AA_S, AA.\n";
+        "markers, i.e. each phone comes in 5 versions like AA_B, AA_I, AA_W, AA_S, AA.\n"
+        "With --num-threads > 1, lattices are aligned in parallel, sharing the\n"
+        "tables built from the lexicon; the output order is unchanged.\n";
     
     ParseOptions po(usage);
     bool output_if_error = true;
@@ -53,8 +138,11 @@ int main(int argc, char *argv[]) {
     po.Register("output-if-empty", &output_if_empty, "If true: if algorithm gives "
                 "error and produces empty output, pass the input through.");
     
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+
     WordAlignLatticeLexiconOpts opts;
     opts.Register(&po);
+    sequencer_config.Register(&po);
     
     po.Read(argc, argv);
 
@@ -91,48 +179,18 @@ int main(int argc, char *argv[]) {
     // No longer needed.
     
     int32 num_done = 0, num_err = 0;
-    
-    for (; !clat_reader.Done(); clat_reader.Next()) {
-      std::string key = clat_reader.Key();
-      const CompactLattice &clat = clat_reader.Value();
-      
-      CompactLattice aligned_clat;
-      
-      bool ok = WordAlignLatticeLexicon(clat, tmodel, lexicon_info, opts,
-                                        &aligned_clat);
-      
-      if (!ok) {
-        num_err++;
-        if (output_if_empty && aligned_clat.NumStates() == 0 &&
-            clat.NumStates() != 0) {
-          KALDI_WARN << "Algorithm produced no output (due to --max-expand?), "
-                     << "so passing input through as output, for key " << key;
-          TopSortCompactLatticeIfNeeded(&aligned_clat);
-          clat_writer.Write(key, clat);
-          continue;
-        }
-        if (!output_if_error)
-          KALDI_WARN << "Lattice for " << key << " did not align correctly";
-        else {
-          if (aligned_clat.Start() != fst::kNoStateId) {
-            KALDI_WARN << "Outputting partial lattice for " << key;
-            clat_writer.Write(key, aligned_clat);
-          } else {
-            KALDI_WARN << "Empty aligned lattice for " << key
-                       << ", producing no output.";
-          }
-        }
-      } else {
-        if (aligned_clat.Start() == fst::kNoStateId) {
-          num_err++;
-          KALDI_WARN << "Lattice was empty for key " << key;
-        } else {
-          num_done++;
-          KALDI_VLOG(2) << "Aligned lattice for " << key;
-          TopSortCompactLatticeIfNeeded(&aligned_clat);
-          clat_writer.Write(key, aligned_clat);
-        }
+
+    {
+      TaskSequencer<WordAlignLatticeLexiconTask> sequencer(sequencer_config);
+      for (; !clat_reader.Done(); clat_reader.Next()) {
+        std::string key = clat_reader.Key();
+        CompactLattice *clat = new CompactLattice(clat_reader.Value());
+        clat_reader.FreeCurrent();
+        sequencer.Run(new WordAlignLatticeLexiconTask(
+            tmodel, lexicon_info, opts, output_if_error, output_if_empty, key,
+            clat, &clat_writer, &num_done, &num_err));
       }
+      sequencer.Wait();
     }
     KALDI_LOG << "Successfully aligned " << num_done << " lattices; "
               << num_err << " had errors.";
@@ -23,6 +23,88 @@
 #include "lat/kaldi-lattice.h"
 #include "lat/word-align-lattice.h"
 #include "lat/lattice-functions.h"
+#include "thread/kaldi-task-sequence.h"
+
+namespace kaldi {
+
+class WordAlignLatticeTask {
+ public:
+  // Initializer takes ownership of "clat".
+  WordAlignLatticeTask(const TransitionModel &tmodel,
+                       const WordBoundaryInfo &info,
+                       BaseFloat max_expand,
+                       bool do_test,
+                       bool output_if_error,
+                       const std::string &key,
+                       CompactLattice *clat,
+                       CompactLatticeWriter *clat_writer,
+                       int32 *num_done,
+                       int32 *num_err):
+      tmodel_(tmodel), info_(info), max_expand_(max_expand),
+      do_test_(do_test), output_if_error_(output_if_error), key_(key),
+      clat_(clat), clat_writer_(clat_writer), num_done_(num_done),
+      num_err_(num_err), ok_(false) { }
+
+  void operator () () {
+    int32 max_states;
+    if (max_expand_ > 0) max_states = 1000 + max_expand_ * clat_->NumStates();
+    else max_states = 0;
+
+    ok_ = WordAlignLattice(*clat_, tmodel_, info_, max_states, &aligned_clat_);
+
+    if (do_test_ && ok_)
+      TestWordAlignedLattice(*clat_, tmodel_, info_, aligned_clat_);
+    delete clat_;  // This is no longer needed so we can delete it now.
+    clat_ = NULL;
+    if (aligned_clat_.Start() != fst::kNoStateId)
+      TopSortCompactLatticeIfNeeded(&aligned_clat_);
+  }
+
+  // The output is written, and the counts updated, in the destructor, which
+  // the TaskSequencer calls in the original order.
+  ~WordAlignLatticeTask() {
+    delete clat_;
+    if (!ok_) {
+      (*num_err_)++;
+      if (!output_if_error_)
+        KALDI_WARN << "Lattice for " << key_
+                   << " did not align correctly, producing no output.";
+      else {
+        if (aligned_clat_.Start() != fst::kNoStateId) {
+          KALDI_WARN << "Outputting partial lattice for " << key_;
+          clat_writer_->Write(key_, aligned_clat_);
+        } else {
+          KALDI_WARN << "Empty aligned lattice for " << key_
+                     << ", producing no output.";
+        }
+      }
+    } else {
+      if (aligned_clat_.Start() == fst::kNoStateId) {
+        (*num_err_)++;
+        KALDI_WARN << "Lattice was empty for key " << key_;
+      } else {
+        (*num_done_)++;
+        KALDI_VLOG(2) << "Aligned lattice for " << key_;
+        clat_writer_->Write(key_, aligned_clat_);
+      }
+    }
+  }
+ private:
+  const TransitionModel &tmodel_;
+  const WordBoundaryInfo &info_;
+  BaseFloat max_expand_;
+  bool do_test_;
+  bool output_if_error_;
+  std::string key_;
+  CompactLattice *clat_;  // The input lattice; owned locally.
+  CompactLattice aligned_clat_;  // The output of our process.
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int32 *num_err_;
+  bool ok_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -39,6 +121,8 @@ int main(int argc, char *argv[]) {
         "   data/lang/phones/word_boundary.int final.mdl ark:1.lats ark:aligned.lats\n"
         "Note: word-boundary file has format (on each line):\n"
         "<integer-phone-id> [begin|end|singleton|internal|nonword]\n"
+        "With --num-threads > 1, lattices are aligned in parallel; the output\n"
+        "order is unchanged.\n"
         "See also: lattice-align-words-lexicon, for use in cases where phones\n"
         "don't have word-position information.\n";
     
@@ -55,8 +139,11 @@ int main(int argc, char *argv[]) {
                 "This can be used to prevent this program consuming excessive memory "
                 "if there is a mismatch on the command-line or a 'problem' lattice.");
     
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+
     WordBoundaryInfoNewOpts opts;
     opts.Register(&po);
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -80,47 +167,18 @@ int main(int argc, char *argv[]) {
     WordBoundaryInfo info(opts, word_boundary_rxfilename);
     
     int32 num_done = 0, num_err = 0;
-    
-    for (; !clat_reader.Done(); clat_reader.Next()) {
-      std::string key = clat_reader.Key();
-      const CompactLattice &clat = clat_reader.Value();
-
-      CompactLattice aligned_clat;
-      int32 max_states;
-      if (max_expand > 0) max_states = 1000 + max_expand * clat.NumStates();
-      else max_states = 0;
-      
-      bool ok = WordAlignLattice(clat, tmodel, info, max_states, &aligned_clat);
-      
-      if (do_test && ok)
-        TestWordAlignedLattice(clat, tmodel, info, aligned_clat);
-
-      if (!ok) {
-        num_err++;
-        if (!output_if_error)
-          KALDI_WARN << "Lattice for " << key
-                     << " did not align correctly, producing no output.";
-        else {
-          if (aligned_clat.Start() != fst::kNoStateId) {
-            KALDI_WARN << "Outputting partial lattice for " << key;
-            TopSortCompactLatticeIfNeeded(&aligned_clat);
-            clat_writer.Write(key, aligned_clat);
-          } else {
-            KALDI_WARN << "Empty aligned lattice for " << key
-                       << ", producing no output.";
-          }
-        }
-      } else {
-        if (aligned_clat.Start() == fst::kNoStateId) {
-          num_err++;
-          KALDI_WARN << "Lattice was empty for key " << key;
-        } else {
-          num_done++;
-          KALDI_VLOG(2) << "Aligned lattice for " << key;
-          TopSortCompactLatticeIfNeeded(&aligned_clat);
-          clat_writer.Write(key, aligned_clat);
-        }
+
+    {
+      TaskSequencer<WordAlignLatticeTask> sequencer(sequencer_config);
+      for (; !clat_reader.Done(); clat_reader.Next()) {
+        std::string key = clat_reader.Key();
+        CompactLattice *clat = new CompactLattice(clat_reader.Value());
+        clat_reader.FreeCurrent();
+        sequencer.Run(new WordAlignLatticeTask(
+            tmodel, info, max_expand, do_test, output_if_error, key, clat,
+            &clat_writer, &num_done, &num_err));
       }
+      sequencer.Wait();
     }
     KALDI_LOG << "Successfully aligned " << num_done << " lattices; "
               << num_err << " had errors.";
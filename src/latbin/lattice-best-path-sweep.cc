@@ -0,0 +1,297 @@
+// latbin/lattice-best-path-sweep.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "lat/kaldi-lattice.h"
+#include "thread/kaldi-thread.h"
+
+namespace kaldi {
+
+/// A lattice stored in a compact, OpenFst-free form for fast repeated
+/// best-path computations: the states are topologically sorted, the arcs of
+/// state s are arcs[arc_offsets[s]] ... arcs[arc_offsets[s+1] - 1], and the
+/// transition-id strings are discarded.
+struct SweepLattice {
+  struct Arc {
+    int32 nextstate;
+    int32 word;
+    BaseFloat graph_cost;
+    BaseFloat acoustic_cost;
+  };
+  std::vector<int32> arc_offsets;  // Of size num-states + 1.
+  std::vector<Arc> arcs;
+  // The final costs; graph cost is +infinity for non-final states.
+  std::vector<BaseFloat> final_graph_cost;
+  std::vector<BaseFloat> final_acoustic_cost;
+
+  /// Initializes from "clat", which will be topologically sorted if needed.
+  /// Returns false if it could not be sorted (i.e. it has cycles).
+  bool Init(CompactLattice *clat) {
+    if (clat->Properties(fst::kTopSorted, true) == 0 && !fst::TopSort(clat))
+      return false;
+    int32 num_states = clat->NumStates();
+    arc_offsets.resize(num_states + 1);
+    arcs.clear();
+    final_graph_cost.resize(num_states);
+    final_acoustic_cost.resize(num_states);
+    for (int32 s = 0; s < num_states; s++) {
+      arc_offsets[s] = arcs.size();
+      for (fst::ArcIterator<CompactLattice> aiter(*clat, s); !aiter.Done();
+           aiter.Next()) {
+        const CompactLatticeArc &arc = aiter.Value();
+        Arc a;
+        a.nextstate = arc.nextstate;
+        a.word = arc.olabel;
+        a.graph_cost = arc.weight.Weight().Value1();
+        a.acoustic_cost = arc.weight.Weight().Value2();
+        arcs.push_back(a);
+      }
+      const LatticeWeight &final_weight = clat->Final(s).Weight();
+      final_graph_cost[s] = final_weight.Value1();
+      final_acoustic_cost[s] = final_weight.Value2();
+    }
+    arc_offsets[num_states] = arcs.size();
+    return true;
+  }
+
+  int32 NumStates() const { return final_graph_cost.size(); }
+
+  /// Computes the best path with costs
+  /// graph-cost + word_ins_penalty * num-words + acoustic-cost / lm_weight,
+  /// which is the same as lattice-scale --inv-acoustic-scale=lm_weight,
+  /// followed by lattice-add-penalty and lattice-best-path.  Outputs the
+  /// words on the best path and returns its cost (+infinity if there is no
+  /// path, in which case "words" is empty).
+  double BestPath(BaseFloat lm_weight, BaseFloat word_ins_penalty,
+                  std::vector<int32> *words) const {
+    words->clear();
+    int32 num_states = NumStates();
+    if (num_states == 0) return std::numeric_limits<double>::infinity();
+    double inv_scale = 1.0 / lm_weight;
+    // For each state, the best cost to reach it and the arc we reached it by.
+    std::vector<std::pair<double, int32> > best(
+        num_states, std::make_pair(std::numeric_limits<double>::infinity(),
+                                   -1));
+    best[0].first = 0.0;
+    double best_final_cost = std::numeric_limits<double>::infinity();
+    int32 best_final_state = -1;
+    for (int32 s = 0; s < num_states; s++) {
+      double cost = best[s].first;
+      if (cost == std::numeric_limits<double>::infinity()) continue;
+      for (int32 a = arc_offsets[s]; a < arc_offsets[s + 1]; a++) {
+        const Arc &arc = arcs[a];
+        double next_cost = cost + arc.graph_cost +
+            arc.acoustic_cost * inv_scale +
+            (arc.word != 0 ? word_ins_penalty : 0.0);
+        if (next_cost < best[arc.nextstate].first)
+          best[arc.nextstate] = std::make_pair(next_cost, a);
+      }
+      double final_cost = cost + final_graph_cost[s] +
+          final_acoustic_cost[s] * inv_scale;
+      if (final_cost < best_final_cost) {
+        best_final_cost = final_cost;
+        best_final_state = s;
+      }
+    }
+    if (best_final_state == -1) return best_final_cost;
+    // Trace back.  Since the states are topologically sorted, the state an
+    // arc leaves from is the largest s with arc_offsets[s] <= a.
+    for (int32 s = best_final_state; best[s].second != -1; ) {
+      int32 a = best[s].second;
+      if (arcs[a].word != 0) words->push_back(arcs[a].word);
+      s = std::upper_bound(arc_offsets.begin(), arc_offsets.end(), a) -
+          arc_offsets.begin() - 1;
+    }
+    std::reverse(words->begin(), words->end());
+    return best_final_cost;
+  }
+};
+
+/// Computes the best paths for all the (lm-weight, word-insertion-penalty)
+/// settings; each thread takes every num_threads_'th setting.
+class BestPathSweeper: public MultiThreadable {
+ public:
+  BestPathSweeper(const std::vector<SweepLattice> &lats,
+                  const std::vector<std::pair<BaseFloat, BaseFloat> > &settings,
+                  std::vector<std::vector<std::vector<int32> > > *words,
+                  std::vector<double> *tot_cost):
+      lats_(lats), settings_(settings), words_(words), tot_cost_(tot_cost) { }
+
+  void operator() () {
+    for (size_t i = thread_id_; i < settings_.size(); i += num_threads_) {
+      std::vector<std::vector<int32> > &words = (*words_)[i];
+      words.resize(lats_.size());
+      double tot_cost = 0.0;
+      for (size_t j = 0; j < lats_.size(); j++) {
+        double cost = lats_[j].BestPath(settings_[i].first,
+                                        settings_[i].second, &(words[j]));
+        tot_cost += cost;
+      }
+      (*tot_cost_)[i] = tot_cost;
+    }
+  }
+
+ private:
+  const std::vector<SweepLattice> &lats_;
+  const std::vector<std::pair<BaseFloat, BaseFloat> > &settings_;
+  std::vector<std::vector<std::vector<int32> > > *words_;
+  std::vector<double> *tot_cost_;
+};
+
+// Replaces all occurrences of "from" in "str" with "to".
+void ReplaceAll(const std::string &from, const std::string &to,
+                std::string *str) {
+  size_t pos = 0;
+  while ((pos = str->find(from, pos)) != std::string::npos) {
+    str->replace(pos, from.size(), to);
+    pos += to.size();
+  }
+}
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Reads lattices once into memory and computes the best paths for a\n"
+        "grid of LM weights and word insertion penalties, writing one set of\n"
+        "transcriptions per setting.  For each setting the result is the same\n"
+        "as lattice-scale --inv-acoustic-scale=LMWT | lattice-add-penalty\n"
+        "--word-ins-penalty=WIP | lattice-best-path.  In the\n"
+        "transcriptions-wspecifier-pattern, the strings LMWT and WIP are\n"
+        "replaced by the LM weight and word insertion penalty.\n"
+        "\n"
+        "Usage: lattice-best-path-sweep [options] <lattice-rspecifier> \\\n"
+        "                               <transcriptions-wspecifier-pattern>\n"
+        " e.g.: lattice-best-path-sweep --lm-weights=7:8:9:10:11:12 \\\n"
+        "         --word-ins-penalties=0.0:0.5:1.0 --num-threads=8 \\\n"
+        "         'ark:gunzip -c lat.*.gz|' ark,t:scoring/LMWT_WIP.tra\n";
+
+    ParseOptions po(usage);
+    std::string lm_weights_str = "10",
+        word_ins_penalties_str = "0.0";
+
+    po.Register("lm-weights", &lm_weights_str, "Colon-separated list of LM "
+                "weights (inverse acoustic scales) to evaluate.");
+    po.Register("word-ins-penalties", &word_ins_penalties_str,
+                "Colon-separated list of word insertion penalties to "
+                "evaluate.");
+    po.Register("num-threads", &g_num_threads, "Number of threads to use; "
+                "the settings are divided among the threads.");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string lats_rspecifier = po.GetArg(1),
+        transcriptions_pattern = po.GetArg(2);
+
+    std::vector<std::string> lm_weights, word_ins_penalties;
+    SplitStringToVector(lm_weights_str, ":", true, &lm_weights);
+    SplitStringToVector(word_ins_penalties_str, ":", true,
+                        &word_ins_penalties);
+    if (lm_weights.empty() || word_ins_penalties.empty())
+      KALDI_ERR << "Empty --lm-weights or --word-ins-penalties option.";
+    if ((lm_weights.size() > 1 &&
+         transcriptions_pattern.find("LMWT") == std::string::npos) ||
+        (word_ins_penalties.size() > 1 &&
+         transcriptions_pattern.find("WIP") == std::string::npos))
+      KALDI_ERR << "The transcriptions-wspecifier-pattern must contain LMWT "
+                << "(WIP) if there is more than one LM weight (word insertion "
+                << "penalty): " << transcriptions_pattern;
+
+    // The settings as (lm-weight, word-insertion-penalty) and the
+    // corresponding wspecifiers.
+    std::vector<std::pair<BaseFloat, BaseFloat> > settings;
+    std::vector<std::string> wspecifiers;
+    for (size_t i = 0; i < lm_weights.size(); i++) {
+      for (size_t j = 0; j < word_ins_penalties.size(); j++) {
+        BaseFloat lm_weight, word_ins_penalty;
+        if (!ConvertStringToReal(lm_weights[i], &lm_weight) || lm_weight <= 0)
+          KALDI_ERR << "Bad LM weight " << lm_weights[i];
+        if (!ConvertStringToReal(word_ins_penalties[j], &word_ins_penalty))
+          KALDI_ERR << "Bad word insertion penalty " << word_ins_penalties[j];
+        settings.push_back(std::make_pair(lm_weight, word_ins_penalty));
+        std::string wspecifier = transcriptions_pattern;
+        ReplaceAll("LMWT", lm_weights[i], &wspecifier);
+        ReplaceAll("WIP", word_ins_penalties[j], &wspecifier);
+        wspecifiers.push_back(wspecifier);
+      }
+    }
+
+    std::vector<std::string> keys;
+    std::vector<SweepLattice> lats;
+    int32 n_fail = 0;
+    SequentialCompactLatticeReader clat_reader(lats_rspecifier);
+    for (; !clat_reader.Done(); clat_reader.Next()) {
+      std::string key = clat_reader.Key();
+      CompactLattice clat(clat_reader.Value());
+      clat_reader.FreeCurrent();
+      lats.resize(lats.size() + 1);
+      if (!lats.back().Init(&clat)) {
+        KALDI_WARN << "Could not topologically sort lattice for utterance "
+                   << key << " (cycles found?)";
+        lats.pop_back();
+        n_fail++;
+        continue;
+      }
+      std::vector<int32> words;
+      if (lats.back().BestPath(1.0, 0.0, &words) ==
+          std::numeric_limits<double>::infinity()) {
+        KALDI_WARN << "Lattice for utterance " << key << " has no successful "
+                   << "path.";
+        lats.pop_back();
+        n_fail++;
+        continue;
+      }
+      keys.push_back(key);
+    }
+    KALDI_LOG << "Read " << lats.size() << " lattices; evaluating "
+              << settings.size() << " settings.";
+
+    std::vector<std::vector<std::vector<int32> > > words(settings.size());
+    std::vector<double> tot_cost(settings.size(), 0.0);
+    BestPathSweeper sweeper(lats, settings, &words, &tot_cost);
+    RunMultiThreaded(sweeper);
+
+    for (size_t i = 0; i < settings.size(); i++) {
+      Int32VectorWriter transcriptions_writer(wspecifiers[i]);
+      for (size_t j = 0; j < keys.size(); j++)
+        transcriptions_writer.Write(keys[j], words[i][j]);
+      std::vector<std::vector<int32> >().swap(words[i]);
+      KALDI_LOG << "For LM weight " << settings[i].first
+                << " and word insertion penalty " << settings[i].second
+                << ", average cost per utterance is "
+                << (tot_cost[i] / std::max<size_t>(keys.size(), 1));
+    }
+    KALDI_LOG << "Done " << keys.size() << " lattices, failed for " << n_fail;
+    return (keys.size() != 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -38,13 +38,17 @@ int main(int argc, char *argv[]) {
         "format to standard from compact lattice.)\n"
         "Usage: lattice-copy [options] lattice-rspecifier lattice-wspecifier\n"
         " e.g.: lattice-copy --write-compact=false ark:1.lats ark,t:text.lats\n"
+        " or: lattice-copy --compress-lattices=true ark:1.lats ark:1.clats\n"
         "See also: lattice-to-fst, and the script egs/wsj/s5/utils/convert_slf.pl\n";
     
     ParseOptions po(usage);
     bool write_compact = true;
     po.Register("write-compact", &write_compact, "If true, write in normal (compact) form.");
+    LatticeCompressionOptions compression_opts;
+    compression_opts.Register(&po);
     
     po.Read(argc, argv);
+    SetCompactLatticeCompression(compression_opts);
 
     if (po.NumArgs() != 2) {
       po.PrintUsage();
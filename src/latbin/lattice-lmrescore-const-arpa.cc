@@ -23,8 +23,83 @@
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
 #include "lm/const-arpa-lm.h"
+#include "thread/kaldi-task-sequence.h"
 #include "util/common-utils.h"
 
+namespace kaldi {
+
+struct LmRescoreConstArpaStats {
+  int32 num_done;
+  int32 num_fail;
+  LmRescoreConstArpaStats(): num_done(0), num_fail(0) { }
+};
+
+// This class rescores the lattice of one utterance in operator (), and writes
+// it in the destructor (TaskSequencer makes sure this happens in the same
+// order as the lattices were read).
+class LmRescoreConstArpaTask {
+ public:
+  LmRescoreConstArpaTask(const ConstArpaLm &const_arpa,
+                         ConstArpaLmHistoryCache *cache,
+                         BaseFloat lm_scale, const std::string &key,
+                         const CompactLattice &clat,
+                         CompactLatticeWriter *compact_lattice_writer,
+                         LmRescoreConstArpaStats *stats):
+      const_arpa_(const_arpa), cache_(cache), lm_scale_(lm_scale), key_(key),
+      clat_(clat), compact_lattice_writer_(compact_lattice_writer),
+      stats_(stats) { }
+
+  void operator () () {
+    if (lm_scale_ == 0.0) return;  // Zero scale so nothing to do.
+    // Before composing with the LM FST, we scale the lattice weights
+    // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
+    // We do it this way so we can determinize and it will give the
+    // right effect (taking the "best path" through the LM) regardless
+    // of the sign of lm_scale.
+    fst::ScaleLattice(fst::GraphLatticeScale(1.0/lm_scale_), &clat_);
+    ArcSort(&clat_, fst::OLabelCompare<CompactLatticeArc>());
+
+    // Wraps the ConstArpaLm format language model into FST. We re-create it
+    // for each lattice to prevent memory usage increasing with time; what is
+    // worth keeping between lattices is in <cache_>.
+    ConstArpaLmDeterministicFst const_arpa_fst(const_arpa_, cache_);
+
+    // Composes lattice with language model.
+    CompactLattice composed_clat;
+    ComposeCompactLatticeDeterministic(clat_,
+                                       &const_arpa_fst, &composed_clat);
+
+    // Determinizes the composed lattice.
+    Lattice composed_lat;
+    ConvertLattice(composed_clat, &composed_lat);
+    Invert(&composed_lat);
+    DeterminizeLattice(composed_lat, &clat_);
+    fst::ScaleLattice(fst::GraphLatticeScale(lm_scale_), &clat_);
+  }
+
+  ~LmRescoreConstArpaTask() {
+    if (lm_scale_ != 0.0 && clat_.Start() == fst::kNoStateId) {
+      KALDI_WARN << "Empty lattice for utterance " << key_
+                 << " (incompatible LM?)";
+      stats_->num_fail++;
+    } else {
+      compact_lattice_writer_->Write(key_, clat_);
+      stats_->num_done++;
+    }
+  }
+
+ private:
+  const ConstArpaLm &const_arpa_;
+  ConstArpaLmHistoryCache *cache_;
+  BaseFloat lm_scale_;
+  std::string key_;
+  CompactLattice clat_;
+  CompactLatticeWriter *compact_lattice_writer_;
+  LmRescoreConstArpaStats *stats_;
+};
+
+}  // namespace kaldi
+
 int main(int argc, char *argv[]) {
   try {
     using namespace kaldi;
@@ -36,19 +111,29 @@ int main(int argc, char *argv[]) {
         "will be wrapped into the DeterministicOnDemandFst interface and the\n"
         "rescoring is done by composing with the wrapped LM using a special\n"
         "type of composition algorithm. Determinization will be applied on\n"
-        "the composed lattice.\n"
+        "the composed lattice.  The n-gram lookups are cached across\n"
+        "lattices (see --cache-size), and with --num-threads > 1 several\n"
+        "lattices are rescored at a time, sharing the cache; the output\n"
+        "order is unchanged.\n"
         "\n"
         "Usage: lattice-lmrescore-const-arpa [options] lattice-rspecifier \\\n"
         "                                   const-arpa-in lattice-wspecifier\n"
         " e.g.: lattice-lmrescore-const-arpa --lm-scale=-1.0 ark:in.lats \\\n"
         "                                   const_arpa ark:out.lats\n";
-      
+
     ParseOptions po(usage);
     BaseFloat lm_scale = 1.0;
-    
+    int64 cache_size = 1000000;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+
     po.Register("lm-scale", &lm_scale, "Scaling factor for language model "
                 "costs; frequently 1.0 or -1.0");
-    
+    po.Register("cache-size", &cache_size, "Maximum number of (history, word) "
+                "lookups of the LM to cache, shared by all the lattices and "
+                "threads; the least recently used are discarded.  0 means no "
+                "cache.  Each entry takes of the order of 100 bytes.");
+    sequencer_config.Register(&po);
+
     po.Read(argc, argv);
 
     if (po.NumArgs() != 3) {
@@ -62,60 +147,42 @@ int main(int argc, char *argv[]) {
 
     // Reads the language model in ConstArpaLm format.
     ConstArpaLm const_arpa;
-    ReadKaldiObject(lm_rxfilename, &const_arpa);
+    // This is memory-mapped if it was written by arpa-to-const-arpa
+    // --aligned=true.
+    bool use_mmap = true;
+    ReadConstArpaLm(lm_rxfilename, use_mmap, &const_arpa);
+    ConstArpaLmHistoryCache *cache = (cache_size > 0 ?
+                                      new ConstArpaLmHistoryCache(cache_size) :
+                                      NULL);
 
     // Reads and writes as compact lattice.
     SequentialCompactLatticeReader compact_lattice_reader(lats_rspecifier);
-    CompactLatticeWriter compact_lattice_writer(lats_wspecifier); 
-
-    int32 n_done = 0, n_fail = 0;
-    for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
-      std::string key = compact_lattice_reader.Key();
-      CompactLattice clat = compact_lattice_reader.Value();
-      compact_lattice_reader.FreeCurrent();
-
-      if (lm_scale != 0.0) {
-        // Before composing with the LM FST, we scale the lattice weights
-        // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
-        // We do it this way so we can determinize and it will give the
-        // right effect (taking the "best path" through the LM) regardless
-        // of the sign of lm_scale.
-        fst::ScaleLattice(fst::GraphLatticeScale(1.0/lm_scale), &clat);
-        ArcSort(&clat, fst::OLabelCompare<CompactLatticeArc>());
-
-        // Wraps the ConstArpaLm format language model into FST. We re-create it
-        // for each lattice to prevent memory usage increasing with time.
-        ConstArpaLmDeterministicFst const_arpa_fst(const_arpa);
-
-        // Composes lattice with language model.        
-        CompactLattice composed_clat;
-        ComposeCompactLatticeDeterministic(clat,
-                                           &const_arpa_fst, &composed_clat);
-
-        // Determinizes the composed lattice.
-        Lattice composed_lat;
-        ConvertLattice(composed_clat, &composed_lat);
-        Invert(&composed_lat);
-        CompactLattice determinized_clat;
-        DeterminizeLattice(composed_lat, &determinized_clat);
-        fst::ScaleLattice(fst::GraphLatticeScale(lm_scale), &determinized_clat);
-        if (determinized_clat.Start() == fst::kNoStateId) {
-          KALDI_WARN << "Empty lattice for utterance " << key
-              << " (incompatible LM?)";
-          n_fail++;
-        } else {
-          compact_lattice_writer.Write(key, determinized_clat);
-          n_done++;
-        }
-      } else {
-        // Zero scale so nothing to do.
-        n_done++;
-        compact_lattice_writer.Write(key, clat);
+    CompactLatticeWriter compact_lattice_writer(lats_wspecifier);
+
+    LmRescoreConstArpaStats stats;
+    {
+      TaskSequencer<LmRescoreConstArpaTask> sequencer(sequencer_config);
+      for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
+        sequencer.Run(new LmRescoreConstArpaTask(
+            const_arpa, cache, lm_scale, compact_lattice_reader.Key(),
+            compact_lattice_reader.Value(), &compact_lattice_writer, &stats));
+        compact_lattice_reader.FreeCurrent();
       }
+      sequencer.Wait();
+    }
+    if (cache != NULL) {
+      int64 num_hits, num_misses;
+      cache->GetStats(&num_hits, &num_misses);
+      int64 num_lookups = num_hits + num_misses;
+      KALDI_LOG << "LM cache hit rate was "
+                << (num_hits * 100.0 / std::max<int64>(1, num_lookups))
+                << "% over " << num_lookups << " lookups.";
+      delete cache;
     }
 
-    KALDI_LOG << "Done " << n_done << " lattices, failed for " << n_fail;
-    return (n_done != 0 ? 0 : 1);
+    KALDI_LOG << "Done " << stats.num_done << " lattices, failed for "
+              << stats.num_fail;
+    return (stats.num_done != 0 ? 0 : 1);
   } catch(const std::exception &e) {
     std::cerr << e.what();
     return -1;
@@ -0,0 +1,187 @@
+// latbin/lattice-lmrescore-nnet-rnnlm.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "cudamatrix/cu-device.h"
+#include "fstext/fstext-lib.h"
+#include "lat/kaldi-lattice.h"
+#include "lat/lattice-functions.h"
+#include "lm/kaldi-rnnlm-batch.h"
+#include "nnet3/nnet-rnnlm.h"
+#include "util/common-utils.h"
+
+namespace kaldi {
+
+// Rescores the lattices in "clats" (already scaled by 1.0 / lm_scale and
+// arc-sorted) together, and writes them out; clears "keys" and "clats".
+void RescoreLatticeBatch(const RnnlmBatchOptions &batch_opts,
+                         int32 max_ngram_order,
+                         BaseFloat lm_scale,
+                         const BatchedRnnlmInterface &rnnlm,
+                         std::vector<std::string> *keys,
+                         std::vector<CompactLattice> *clats,
+                         CompactLatticeWriter *compact_lattice_writer,
+                         int32 *n_done, int32 *n_fail) {
+  // We re-create the LM FST for each batch to prevent memory usage
+  // increasing with time.
+  RnnlmBatchDeterministicFst rnnlm_fst(batch_opts, max_ngram_order, &rnnlm);
+  for (size_t i = 0; i < clats->size(); i++)
+    rnnlm_fst.AddLattice((*clats)[i]);
+  rnnlm_fst.Compute();
+
+  for (size_t i = 0; i < clats->size(); i++) {
+    // Composes lattice with language model.
+    CompactLattice composed_clat;
+    ComposeCompactLatticeDeterministic((*clats)[i], &rnnlm_fst,
+                                       &composed_clat);
+    // Determinizes the composed lattice.
+    Lattice composed_lat;
+    ConvertLattice(composed_clat, &composed_lat);
+    Invert(&composed_lat);
+    CompactLattice determinized_clat;
+    DeterminizeLattice(composed_lat, &determinized_clat);
+    fst::ScaleLattice(fst::GraphLatticeScale(lm_scale), &determinized_clat);
+    if (determinized_clat.Start() == fst::kNoStateId) {
+      KALDI_WARN << "Empty lattice for utterance " << (*keys)[i]
+                 << " (incompatible LM?)";
+      (*n_fail)++;
+    } else {
+      compact_lattice_writer->Write((*keys)[i], determinized_clat);
+      (*n_done)++;
+    }
+  }
+  KALDI_VLOG(1) << "Rescored " << clats->size() << " lattices using "
+                << rnnlm_fst.NumStates() << " RNNLM histories.";
+  keys->clear();
+  clats->clear();
+}
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    typedef kaldi::int64 int64;
+
+    const char *usage =
+        "Rescores lattice with an nnet3 RNNLM (see nnet3/nnet-rnnlm.h), whose\n"
+        "vocabulary is the integer word labels of the lattices.  As in\n"
+        "lattice-lmrescore-rnnlm-batched, the histories needed by a group of\n"
+        "lattices are found first and evaluated together (on the GPU, if one\n"
+        "is used).\n"
+        "\n"
+        "Usage: lattice-lmrescore-nnet-rnnlm [options] <rnnlm-rxfilename> \\\n"
+        "             <lattice-rspecifier> <lattice-wspecifier>\n"
+        " e.g.: lattice-lmrescore-nnet-rnnlm --lm-scale=-1.0 \\\n"
+        "          --eos-symbol=2 final.rnnlm ark:in.lats ark:out.lats\n";
+
+    ParseOptions po(usage);
+    int32 max_ngram_order = 3;
+    int32 lattice_batch_size = 16;
+    BaseFloat lm_scale = 1.0;
+    std::string use_gpu = "optional";
+
+    po.Register("lm-scale", &lm_scale, "Scaling factor for language model "
+                "costs; frequently 1.0 or -1.0");
+    po.Register("max-ngram-order", &max_ngram_order, "If positive, limit the "
+                "rnnlm context to the given number, -1 means we are not going "
+                "to limit it.");
+    po.Register("lattice-batch-size", &lattice_batch_size, "Number of lattices "
+                "whose rnnlm histories are evaluated together.  With "
+                "--max-ngram-order > 0 and a value > 1, a truncated history "
+                "may take its hidden state from another lattice of the batch, "
+                "so results can depend on the batch size.");
+    po.Register("use-gpu", &use_gpu,
+                "yes|no|optional|wait, only has effect if compiled with CUDA");
+
+    nnet3::NnetRnnlmComputeOptions opts;
+    opts.Register(&po);
+    RnnlmBatchOptions batch_opts;
+    batch_opts.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 3) {
+      po.PrintUsage();
+      exit(1);
+    }
+    KALDI_ASSERT(lattice_batch_size > 0);
+
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().SelectGpuId(use_gpu);
+#endif
+
+    std::string rnnlm_rxfilename = po.GetArg(1),
+        lats_rspecifier = po.GetArg(2),
+        lats_wspecifier = po.GetArg(3);
+
+    // Reads the language model (which goes to the GPU, if we're using one).
+    nnet3::NnetRnnlm rnnlm;
+    ReadKaldiObject(rnnlm_rxfilename, &rnnlm);
+    nnet3::NnetRnnlmComputer rnnlm_computer(opts, rnnlm);
+
+    // Reads and writes as compact lattice.
+    SequentialCompactLatticeReader compact_lattice_reader(lats_rspecifier);
+    CompactLatticeWriter compact_lattice_writer(lats_wspecifier);
+
+    int32 n_done = 0, n_fail = 0;
+    std::vector<std::string> keys;
+    std::vector<CompactLattice> clats;
+    for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
+      std::string key = compact_lattice_reader.Key();
+      if (lm_scale == 0.0) {
+        // Zero scale so nothing to do.
+        n_done++;
+        compact_lattice_writer.Write(key, compact_lattice_reader.Value());
+        continue;
+      }
+      keys.push_back(key);
+      clats.push_back(compact_lattice_reader.Value());
+      compact_lattice_reader.FreeCurrent();
+      CompactLattice &clat = clats.back();
+
+      // Before composing with the LM FST, we scale the lattice weights
+      // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
+      // We do it this way so we can determinize and it will give the
+      // right effect (taking the "best path" through the LM) regardless
+      // of the sign of lm_scale.
+      fst::ScaleLattice(fst::GraphLatticeScale(1.0 / lm_scale), &clat);
+      ArcSort(&clat, fst::OLabelCompare<CompactLatticeArc>());
+
+      if (clats.size() == static_cast<size_t>(lattice_batch_size))
+        RescoreLatticeBatch(batch_opts, max_ngram_order, lm_scale,
+                            rnnlm_computer, &keys, &clats,
+                            &compact_lattice_writer, &n_done, &n_fail);
+    }
+    if (!clats.empty())
+      RescoreLatticeBatch(batch_opts, max_ngram_order, lm_scale,
+                          rnnlm_computer, &keys, &clats,
+                          &compact_lattice_writer, &n_done, &n_fail);
+
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().PrintProfile();
+#endif
+    KALDI_LOG << "Done " << n_done << " lattices, failed for " << n_fail;
+    return (n_done != 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -50,6 +50,7 @@ int main(int argc, char *argv[]) {
     BaseFloat acoustic_scale = 1.0;
     BaseFloat lm_scale = 1.0;
     bool one_best_times = false;
+    MinimumBayesRiskOptions mbr_opts;
 
     std::string word_syms_filename;
     po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for "
@@ -60,6 +61,7 @@ int main(int argc, char *argv[]) {
                 "words [for debug output]");
     po.Register("one-best-times", &one_best_times, "If true, output times "
                 "corresponding to one-best, not whole sausage.");
+    mbr_opts.Register(&po);
     
     po.Read(argc, argv);
 
@@ -100,7 +102,7 @@ int main(int argc, char *argv[]) {
       clat_reader.FreeCurrent();
       fst::ScaleLattice(fst::LatticeScale(lm_scale, acoustic_scale), &clat);
 
-      MinimumBayesRisk mbr(clat);
+      MinimumBayesRisk mbr(clat, mbr_opts);
 
       if (trans_wspecifier != "")
         trans_writer.Write(key, mbr.GetOneBest());
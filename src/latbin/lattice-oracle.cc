@@ -23,6 +23,7 @@
 #include "util/common-utils.h"
 #include "fstext/fstext-lib.h"
 #include "lat/kaldi-lattice.h"
+#include "lat/lattice-functions.h"
 
 namespace kaldi {
 
@@ -56,14 +57,15 @@ void ReadSymbolList(const std::string &rxfilename,
   }
 }
 
-void MapWildCards(const LabelSet &wildcards, fst::StdVectorFst *ofst) {
+template<class FST>
+void MapWildCards(const LabelSet &wildcards, FST *ofst) {
+  typedef typename FST::Arc Arc;
   // map all wildcards symbols to epsilons
-  for (fst::StateIterator<fst::StdVectorFst> siter(*ofst);
-       !siter.Done(); siter.Next()) {
-    fst::StdArc::StateId s = siter.Value();
-    for (fst::MutableArcIterator<fst::StdVectorFst> aiter(ofst, s);
+  for (fst::StateIterator<FST> siter(*ofst); !siter.Done(); siter.Next()) {
+    typename Arc::StateId s = siter.Value();
+    for (fst::MutableArcIterator<FST> aiter(ofst, s);
          !aiter.Done();  aiter.Next()) {
-      fst::StdArc arc(aiter.Value());
+      Arc arc(aiter.Value());
       LabelSet::const_iterator it = wildcards.find(arc.ilabel);
       if (it != wildcards.end()) {
         KALDI_VLOG(4) << "MapWildCards: mapping symbol " << arc.ilabel
@@ -182,6 +184,66 @@ bool CheckFst(const fst::StdVectorFst &fst, string name, string key) {
   return true;
 #endif
 }
+
+// Finds the oracle path by composing the lattice with an edit-distance
+// transducer and the reference, and taking the shortest path.  This is the
+// slow way; it's only used for lattices that are not acyclic.  Returns false
+// if there was no path.
+bool GetOracleByComposition(const Lattice &lat,
+                            const LabelSet &wildcards,
+                            const std::vector<int32> &reference,
+                            const std::string &key,
+                            std::vector<int32> *oracle_words,
+                            int32 *correct,
+                            int32 *substitutions,
+                            int32 *insertions,
+                            int32 *deletions) {
+  using fst::VectorFst;
+  using fst::StdArc;
+  // remove all weights while creating a standard FST
+  VectorFst<StdArc> lattice_fst;
+  ConvertLatticeToUnweightedAcceptor(lat, wildcards, &lattice_fst);
+  CheckFst(lattice_fst, "lattice_fst_", key);
+
+  VectorFst<StdArc> reference_fst;
+  MakeLinearAcceptor(reference, &reference_fst);
+  MapWildCards(wildcards, &reference_fst);  // Remove any wildcards in
+                                            // reference.
+  CheckFst(reference_fst, "reference_fst_", key);
+
+  // recreate edit distance fst if necessary
+  fst::StdVectorFst edit_distance_fst;
+  CreateEditDistance(lattice_fst, reference_fst, &edit_distance_fst);
+
+  // compose with edit distance transducer
+  VectorFst<StdArc> edit_ref_fst;
+  fst::Compose(edit_distance_fst, reference_fst, &edit_ref_fst);
+  CheckFst(edit_ref_fst, "composed_", key);
+
+  // make sure composed FST is input sorted
+  fst::ArcSort(&edit_ref_fst, fst::StdILabelCompare());
+
+  // compose with previous result
+  VectorFst<StdArc> result_fst;
+  fst::Compose(lattice_fst, edit_ref_fst, &result_fst);
+  CheckFst(result_fst, "result_", key);
+
+  // find out best path
+  VectorFst<StdArc> best_path;
+  fst::ShortestPath(result_fst, &best_path);
+  CheckFst(best_path, "best_path_", key);
+
+  if (best_path.Start() == fst::kNoStateId)
+    return false;
+  int32 num_words;
+  CountErrors(best_path, correct, substitutions,
+              insertions, deletions, &num_words);
+  std::vector<int32> reference_words;
+  StdArc::Weight weight;
+  GetLinearSymbolSequence(best_path, oracle_words,
+                          &reference_words, &weight);
+  return true;
+}
 }
 
 int main(int argc, char *argv[]) {
@@ -217,6 +279,7 @@ int main(int argc, char *argv[]) {
     std::string wild_syms_rxfilename;
     std::string wildcard_symbols;
     std::string lats_wspecifier;
+    BaseFloat beam = 0.0;
 
     po.Register("word-symbol-table", &word_syms_filename,
                 "Symbol table for words [for debug output]");
@@ -232,6 +295,9 @@ int main(int argc, char *argv[]) {
     po.Register("write-lattices", &lats_wspecifier, "If supplied, write the "
                 "lattice that contains only the oracle path to the given "
                 "wspecifier.");
+    po.Register("beam", &beam, "If >0, prune hypotheses whose number of "
+                "errors is more than this much worse than the best one at the "
+                "same lattice state.  Faster, but the oracle may not be exact.");
 
     po.Read(argc, argv);
 
@@ -286,11 +352,6 @@ int main(int argc, char *argv[]) {
       const Lattice &lat = lattice_reader.Value();
       cerr << "Lattice " << key << " read." << endl;
 
-      // remove all weights while creating a standard FST
-      VectorFst<StdArc> lattice_fst;
-      ConvertLatticeToUnweightedAcceptor(lat, wildcards, &lattice_fst);
-      CheckFst(lattice_fst, "lattice_fst_", key);
-
       // TODO: map certain symbols (using an FST created with CreateMapFst())
       if (!reference_reader.HasKey(key)) {
         KALDI_WARN << "No reference present for utterance " << key;
@@ -298,43 +359,38 @@ int main(int argc, char *argv[]) {
         continue;
       }
       const std::vector<int32> &reference = reference_reader.Value(key);
-      VectorFst<StdArc> reference_fst;
-      MakeLinearAcceptor(reference, &reference_fst);
-      MapWildCards(wildcards, &reference_fst);  // Remove any wildcards in
-                                                // reference.
-
-      CheckFst(reference_fst, "reference_fst_", key);
-
-      // recreate edit distance fst if necessary
-      fst::StdVectorFst edit_distance_fst;
-      CreateEditDistance(lattice_fst, reference_fst, &edit_distance_fst);
-
-      // compose with edit distance transducer
-      VectorFst<StdArc> edit_ref_fst;
-      fst::Compose(edit_distance_fst, reference_fst, &edit_ref_fst);
-      CheckFst(edit_ref_fst, "composed_", key);
-
-      // make sure composed FST is input sorted
-      fst::ArcSort(&edit_ref_fst, fst::StdILabelCompare());
-
-      // compose with previous result
-      VectorFst<StdArc> result_fst;
-      fst::Compose(lattice_fst, edit_ref_fst, &result_fst);
-      CheckFst(result_fst, "result_", key);
-
-      // find out best path
-      VectorFst<StdArc> best_path;
-      fst::ShortestPath(result_fst, &best_path);
-      CheckFst(best_path, "best_path_", key);
+      std::vector<int32> reference_words;  // Reference without wildcards.
+      for (size_t i = 0; i < reference.size(); i++)
+        if (reference[i] != 0 && wildcards.count(reference[i]) == 0)
+          reference_words.push_back(reference[i]);
+
+      CompactLattice clat;
+      ConvertLattice(lat, &clat);
+      CompactLattice mapped_clat(clat);
+      MapWildCards(wildcards, &mapped_clat);
+
+      std::vector<int32> oracle_words;
+      int32 correct, substitutions, insertions, deletions;
+      bool ans;
+      if (fst::TopSort(&mapped_clat)) {
+        // The lattice is acyclic, so we can do the edit-distance dynamic
+        // programming directly on it, which is much faster than composition.
+        ans = CompactLatticeOracleEditDistance(mapped_clat, reference_words,
+                                               beam, &oracle_words, &correct,
+                                               &substitutions, &insertions,
+                                               &deletions);
+      } else {
+        ans = GetOracleByComposition(lat, wildcards, reference, key,
+                                     &oracle_words, &correct, &substitutions,
+                                     &insertions, &deletions);
+      }
 
-      if (best_path.Start() == fst::kNoStateId) {
+      if (!ans) {
         KALDI_WARN << "Best-path failed for key " << key;
         n_fail++;
       } else {
         // count errors
-        int32 correct, substitutions, insertions, deletions, num_words;
-        CountErrors(best_path, &correct, &substitutions,
-                    &insertions, &deletions, &num_words);
+        int32 num_words = correct + substitutions + deletions;
         int32 tot_errs = substitutions + insertions + deletions;
         if (edit_distance_wspecifier != "")
           edit_distance_writer.Write(key, tot_errs);
@@ -347,12 +403,7 @@ int main(int argc, char *argv[]) {
         tot_deletions += deletions;
         tot_words += num_words;
 
-        std::vector<int32> oracle_words;
-        std::vector<int32> reference_words;
-        Weight weight;
-        GetLinearSymbolSequence(best_path, &oracle_words,
-                                &reference_words, &weight);
-        KALDI_LOG << "For utterance " << key << ", best cost " << weight;
+        KALDI_LOG << "For utterance " << key << ", best cost " << tot_errs;
         if (transcriptions_wspecifier != "")
           transcriptions_writer.Write(key, oracle_words);
         if (word_syms != NULL) {
@@ -380,9 +431,7 @@ int main(int argc, char *argv[]) {
           CompactLattice oracle_clat_mask;
           MakeLinearAcceptor(oracle_words, &oracle_clat_mask);
 
-          CompactLattice clat;
           CompactLattice oracle_clat;
-          ConvertLattice(lat, &clat);
           fst::Compose(oracle_clat_mask, clat, &oracle_clat);
 
           if (oracle_clat.Start() == fst::kNoStateId) {
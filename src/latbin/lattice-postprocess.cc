@@ -0,0 +1,332 @@
+// latbin/lattice-postprocess.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <numeric>
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "lat/kaldi-lattice.h"
+#include "lat/lattice-functions.h"
+#include "lat/word-align-lattice.h"
+#include "lat/sausages.h"
+#include "thread/kaldi-task-sequence.h"
+
+namespace kaldi {
+
+// The configuration shared (read-only) by all the tasks.
+struct LatticePostprocessInfo {
+  std::vector<std::string> operations;
+  BaseFloat acoustic_scale;
+  BaseFloat lm_scale;
+  BaseFloat word_ins_penalty;
+  BaseFloat beam;
+  BaseFloat max_expand;
+  const TransitionModel *trans_model;  // NULL if not doing align-words.
+  const WordBoundaryInfo *word_boundary_info;  // as trans_model.
+  MinimumBayesRiskOptions mbr_opts;
+  BaseFloat frame_shift;
+};
+
+struct LatticePostprocessStats {
+  int32 num_done;
+  int32 num_err;
+  int64 num_words;
+  double tot_bayes_risk;
+  double tot_like;
+  double tot_frames;
+  LatticePostprocessStats(): num_done(0), num_err(0), num_words(0),
+                             tot_bayes_risk(0.0), tot_like(0.0),
+                             tot_frames(0.0) { }
+};
+
+// This class applies the operations to the lattice of one utterance, and works
+// out the CTM and posteriors if requested, in operator (), and writes the
+// outputs in the destructor (TaskSequencer makes sure this happens in the
+// same order as the lattices were read).
+class LatticePostprocessTask {
+ public:
+  LatticePostprocessTask(const LatticePostprocessInfo &info,
+                         const std::string &key,
+                         const CompactLattice &clat,
+                         CompactLatticeWriter *lattice_writer,
+                         std::ostream *ctm_stream,
+                         PosteriorWriter *posterior_writer,
+                         LatticePostprocessStats *stats):
+      info_(info), key_(key), clat_(clat), lattice_writer_(lattice_writer),
+      ctm_stream_(ctm_stream), posterior_writer_(posterior_writer),
+      stats_(stats), ok_(true), bayes_risk_(0.0), num_words_(0), like_(0.0) { }
+
+  void operator () () {
+    for (size_t i = 0; i < info_.operations.size() && ok_; i++) {
+      const std::string &op = info_.operations[i];
+      if (op == "scale") {
+        if (info_.acoustic_scale != 1.0 || info_.lm_scale != 1.0)
+          fst::ScaleLattice(fst::LatticeScale(info_.lm_scale,
+                                              info_.acoustic_scale), &clat_);
+      } else if (op == "add-penalty") {
+        AddWordInsPenToCompactLattice(info_.word_ins_penalty, &clat_);
+      } else if (op == "prune") {
+        if (!PruneLattice(info_.beam, &clat_)) {
+          KALDI_WARN << "Error pruning lattice for utterance " << key_;
+          ok_ = false;
+        }
+      } else {
+        KALDI_ASSERT(op == "align-words");
+        CompactLattice aligned_clat;
+        int32 max_states = (info_.max_expand > 0 ?
+                            1000 + info_.max_expand * clat_.NumStates() : 0);
+        if (!WordAlignLattice(clat_, *info_.trans_model,
+                              *info_.word_boundary_info, max_states,
+                              &aligned_clat) ||
+            aligned_clat.Start() == fst::kNoStateId) {
+          KALDI_WARN << "Lattice for " << key_
+                     << " did not align correctly, producing no output.";
+          ok_ = false;
+        } else {
+          TopSortCompactLatticeIfNeeded(&aligned_clat);
+          clat_ = aligned_clat;
+        }
+      }
+    }
+    if (!ok_) return;
+    if (ctm_stream_ != NULL) {
+      MinimumBayesRisk mbr(clat_, info_.mbr_opts);
+      const std::vector<BaseFloat> &conf = mbr.GetOneBestConfidences();
+      const std::vector<int32> &words = mbr.GetOneBest();
+      const std::vector<std::pair<BaseFloat, BaseFloat> > &times =
+          mbr.GetOneBestTimes();
+      KALDI_ASSERT(conf.size() == words.size() &&
+                   words.size() == times.size());
+      ctm_.copyfmt(*ctm_stream_);
+      for (size_t i = 0; i < words.size(); i++) {
+        KALDI_ASSERT(words[i] != 0); // Should not have epsilons.
+        ctm_ << key_ << " 1 " << (info_.frame_shift * times[i].first) << ' '
+             << (info_.frame_shift * (times[i].second - times[i].first))
+             << ' ' << words[i] << ' ' << conf[i] << '\n';
+      }
+      bayes_risk_ = mbr.GetBayesRisk();
+      num_words_ = words.size();
+    }
+    if (posterior_writer_ != NULL) {
+      Lattice lat;
+      ConvertLattice(clat_, &lat);
+      TopSortLatticeIfNeeded(&lat);
+      like_ = LatticeForwardBackward(lat, &post_);
+    }
+  }
+
+  ~LatticePostprocessTask() {
+    if (!ok_) {
+      stats_->num_err++;
+      return;
+    }
+    if (lattice_writer_ != NULL)
+      lattice_writer_->Write(key_, clat_);
+    if (ctm_stream_ != NULL) {
+      *ctm_stream_ << ctm_.str();
+      stats_->tot_bayes_risk += bayes_risk_;
+      stats_->num_words += num_words_;
+    }
+    if (posterior_writer_ != NULL) {
+      posterior_writer_->Write(key_, post_);
+      stats_->tot_like += like_;
+      stats_->tot_frames += post_.size();
+    }
+    KALDI_VLOG(2) << "Processed lattice for utterance " << key_;
+    stats_->num_done++;
+  }
+ private:
+  const LatticePostprocessInfo &info_;
+  std::string key_;
+  CompactLattice clat_;
+  CompactLatticeWriter *lattice_writer_;  // The outputs; NULL if not
+  std::ostream *ctm_stream_;              // wanted.
+  PosteriorWriter *posterior_writer_;
+  LatticePostprocessStats *stats_;
+  bool ok_;
+  std::ostringstream ctm_;
+  BaseFloat bayes_risk_;
+  int32 num_words_;
+  double like_;
+  Posterior post_;
+};
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Apply a sequence of operations to lattices and write out any of the\n"
+        "resulting lattices, a CTM with confidences (as lattice-to-ctm-conf)\n"
+        "and posteriors (as lattice-to-post), all in one process, with the\n"
+        "utterances processed in parallel if --num-threads > 1.  This replaces\n"
+        "pipelines of lattice-scale, lattice-add-penalty, lattice-prune,\n"
+        "lattice-align-words, lattice-to-ctm-conf and lattice-to-post.\n"
+        "The operations (the --operations option, applied in the order given)\n"
+        "are: scale (uses --acoustic-scale, --inv-acoustic-scale and\n"
+        "--lm-scale), add-penalty (--word-ins-penalty), prune (--beam) and\n"
+        "align-words (--word-boundary and --model); the CTM and posteriors are\n"
+        "computed from the lattice after the last operation.  Use the empty\n"
+        "string for unwanted outputs.\n"
+        "\n"
+        "Usage: lattice-postprocess [options] <lattice-rspecifier> "
+        "<lattice-wspecifier> [<ctm-wxfilename> [<posteriors-wspecifier>]]\n"
+        " e.g.: lattice-postprocess --operations=scale,add-penalty,align-words \\\n"
+        "   --inv-acoustic-scale=10 --word-ins-penalty=0.5 \\\n"
+        "   --word-boundary=data/lang/phones/word_boundary.int --model=final.mdl \\\n"
+        "   --num-threads=4 ark:1.lats '' 1.ctm ark:1.post\n";
+
+    ParseOptions po(usage);
+    LatticePostprocessInfo info;
+    std::string operations = "scale,add-penalty",
+        word_boundary_rxfilename, model_rxfilename;
+    BaseFloat inv_acoustic_scale = 1.0;
+    info.acoustic_scale = 1.0;
+    info.lm_scale = 1.0;
+    info.word_ins_penalty = 0.0;
+    info.beam = 10.0;
+    info.max_expand = 0.0;
+    info.frame_shift = 0.01;
+    info.trans_model = NULL;
+    info.word_boundary_info = NULL;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+    WordBoundaryInfoNewOpts word_boundary_opts;
+
+    po.Register("operations", &operations, "Comma-separated list of "
+                "operations to apply to each lattice, in order; from: scale, "
+                "add-penalty, prune, align-words.");
+    po.Register("acoustic-scale", &info.acoustic_scale, "Scaling factor for "
+                "acoustic likelihoods (operation 'scale').");
+    po.Register("inv-acoustic-scale", &inv_acoustic_scale, "An alternative way "
+                "of setting the acoustic scale: you can set its inverse.");
+    po.Register("lm-scale", &info.lm_scale, "Scaling factor for graph/lm costs "
+                "(operation 'scale').");
+    po.Register("word-ins-penalty", &info.word_ins_penalty, "Word insertion "
+                "penalty (operation 'add-penalty').");
+    po.Register("beam", &info.beam, "Pruning beam, applied after acoustic "
+                "scaling if 'scale' precedes it (operation 'prune').");
+    po.Register("word-boundary", &word_boundary_rxfilename, "Word-boundary "
+                "file, as for lattice-align-words (operation 'align-words').");
+    po.Register("model", &model_rxfilename, "Transition model (operation "
+                "'align-words').");
+    po.Register("max-expand", &info.max_expand, "If >0, the maximum amount by "
+                "which word alignment may expand lattices, as for "
+                "lattice-align-words.");
+    po.Register("frame-shift", &info.frame_shift, "Time in seconds between "
+                "frames, for the CTM output.");
+    word_boundary_opts.Register(&po);
+    info.mbr_opts.Register(&po);
+    sequencer_config.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 2 || po.NumArgs() > 4) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    KALDI_ASSERT(info.acoustic_scale == 1.0 || inv_acoustic_scale == 1.0);
+    if (inv_acoustic_scale != 1.0)
+      info.acoustic_scale = 1.0 / inv_acoustic_scale;
+
+    std::string lats_rspecifier = po.GetArg(1),
+        lats_wspecifier = po.GetArg(2),
+        ctm_wxfilename = po.GetOptArg(3),
+        posteriors_wspecifier = po.GetOptArg(4);
+
+    SplitStringToVector(operations, ",", true, &info.operations);
+    bool align_words = false;
+    for (size_t i = 0; i < info.operations.size(); i++) {
+      const std::string &op = info.operations[i];
+      if (op == "align-words")
+        align_words = true;
+      else if (op != "scale" && op != "add-penalty" && op != "prune")
+        KALDI_ERR << "Invalid operation '" << op << "' in --operations="
+                  << operations;
+    }
+
+    TransitionModel trans_model;
+    WordBoundaryInfo *word_boundary_info = NULL;
+    if (align_words) {
+      if (word_boundary_rxfilename.empty() || model_rxfilename.empty())
+        KALDI_ERR << "Operation 'align-words' requires the --word-boundary "
+                  << "and --model options.";
+      ReadKaldiObject(model_rxfilename, &trans_model);
+      word_boundary_info = new WordBoundaryInfo(word_boundary_opts,
+                                                word_boundary_rxfilename);
+      info.trans_model = &trans_model;
+      info.word_boundary_info = word_boundary_info;
+    }
+
+    if (ctm_wxfilename != "" &&
+        ClassifyWspecifier(ctm_wxfilename, NULL, NULL, NULL) != kNoWspecifier)
+      KALDI_ERR << "The output ctm file should not be a wspecifier. "
+                << "Please use things like 1.ctm instead of ark:-";
+
+    SequentialCompactLatticeReader clat_reader(lats_rspecifier);
+    CompactLatticeWriter lattice_writer;
+    PosteriorWriter posterior_writer;
+    Output ko;
+    if (lats_wspecifier != "" && !lattice_writer.Open(lats_wspecifier))
+      KALDI_ERR << "Could not open lattice output " << lats_wspecifier;
+    if (posteriors_wspecifier != "" &&
+        !posterior_writer.Open(posteriors_wspecifier))
+      KALDI_ERR << "Could not open posterior output " << posteriors_wspecifier;
+    if (ctm_wxfilename != "") {
+      if (!ko.Open(ctm_wxfilename, false, false))  // non-binary, no header.
+        KALDI_ERR << "Could not open CTM output " << ctm_wxfilename;
+      ko.Stream() << std::fixed;  // Set to "fixed" floating point model, where
+      // precision() specifies the #digits after the decimal point.
+      ko.Stream().precision(2);
+    }
+
+    LatticePostprocessStats stats;
+    {
+      TaskSequencer<LatticePostprocessTask> sequencer(sequencer_config);
+      for (; !clat_reader.Done(); clat_reader.Next()) {
+        sequencer.Run(new LatticePostprocessTask(
+            info, clat_reader.Key(), clat_reader.Value(),
+            lattice_writer.IsOpen() ? &lattice_writer : NULL,
+            ctm_wxfilename != "" ? &(ko.Stream()) : NULL,
+            posterior_writer.IsOpen() ? &posterior_writer : NULL,
+            &stats));
+      }
+      sequencer.Wait();
+    }
+    delete word_boundary_info;
+
+    if (ctm_wxfilename != "" && stats.num_done > 0)
+      KALDI_LOG << "Overall average Bayes Risk per sentence is "
+                << (stats.tot_bayes_risk / stats.num_done) << " and per word, "
+                << (stats.tot_bayes_risk / stats.num_words);
+    if (posteriors_wspecifier != "" && stats.tot_frames > 0)
+      KALDI_LOG << "Overall average log-like/frame is "
+                << (stats.tot_like / stats.tot_frames) << " over "
+                << stats.tot_frames << " frames.";
+    KALDI_LOG << "Done " << stats.num_done << " lattices, errors on "
+              << stats.num_err;
+    return (stats.num_done != 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -56,7 +56,7 @@ int main(int argc, char *argv[]) {
 
     ParseOptions po(usage);
     BaseFloat acoustic_scale = 1.0, inv_acoustic_scale = 1.0, lm_scale = 1.0;
-    bool decode_mbr = true;
+    MinimumBayesRiskOptions mbr_opts;
     BaseFloat frame_shift = 0.01;
 
     std::string word_syms_filename;
@@ -66,8 +66,7 @@ int main(int argc, char *argv[]) {
                 "of setting the acoustic scale: you can set its inverse.");
     po.Register("lm-scale", &lm_scale, "Scaling factor for language model "
                 "probabilities");
-    po.Register("decode-mbr", &decode_mbr, "If true, do Minimum Bayes Risk "
-                "decoding (else, Maximum a Posteriori)");
+    mbr_opts.Register(&po);
     po.Register("frame-shift", &frame_shift, "Time in seconds between frames.");
     
     po.Read(argc, argv);
@@ -124,14 +123,14 @@ int main(int argc, char *argv[]) {
       MinimumBayesRisk *mbr = NULL;
 
       if (one_best_rspecifier == "") {
-        mbr = new MinimumBayesRisk(clat, decode_mbr);
+        mbr = new MinimumBayesRisk(clat, mbr_opts);
       } else {
         if (!one_best_reader.HasKey(key)) {
           KALDI_WARN << "No 1-best present for utterance " << key;
           continue;
         }
         const std::vector<int32> &one_best = one_best_reader.Value(key);
-        mbr = new MinimumBayesRisk(clat, one_best, decode_mbr);
+        mbr = new MinimumBayesRisk(clat, one_best, mbr_opts.decode_mbr);
       }
       
       const std::vector<BaseFloat> &conf = mbr->GetOneBestConfidences();
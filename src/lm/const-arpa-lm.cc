@@ -23,6 +23,7 @@
 #include <utility>
 
 #include "lm/const-arpa-lm.h"
+#include "thread/kaldi-thread.h"
 #include "util/stl-utils.h"
 #include "util/text-utils.h"
 #include "base/kaldi-math.h"
@@ -130,17 +131,46 @@ class LmState {
     return (backoff_logprob_ == 0.0 && children_.empty());
   }
 
+  // Checks if the child with index <index> will have no entry of its own in
+  // <lm_states> (children are never unigrams).
+  bool ChildIsLeaf(const int32 index) const {
+    return is_child_final_order_ || children_[index].second.state->IsLeaf();
+  }
+
+  // Returns the log probability of the child with index <index>.
+  float ChildLogprob(const int32 index) const {
+    return is_child_final_order_ ? children_[index].second.prob :
+        children_[index].second.state->Logprob();
+  }
+
+  int32 NumLeafChildren() const {
+    if (is_child_final_order_) return children_.size();
+    int32 num_leaf_children = 0;
+    for (size_t i = 0; i < children_.size(); ++i)
+      if (children_[i].second.state->IsLeaf()) num_leaf_children++;
+    return num_leaf_children;
+  }
+
   // Computes the size of the memory that the current LmState would take in
-  // <lm_states> array. It's the number of 4-byte chunks.
-  int32 MemSize() const {
+  // <lm_states> array. It's the number of 4-byte chunks.  <quantize_bits> is
+  // as ConstArpaLm::QuantizeBits().
+  int32 MemSize(const int32 quantize_bits = 0) const {
     if (IsLeaf() && !is_unigram_) {
       // We don't create an entry in this case; the logprob will be stored in
       // the same int32 that we would normally store the pointer in.
       return 0;
-    } else {
+    } else if (quantize_bits == 0) {
       // We store the following information:
       // logprob, backoff_logprob, children.size() and children data.
       return (3 + 2 * children_.size());
+    } else {
+      // We store the codes, the numbers of leaf and non-leaf children, the
+      // non-leaf children data, the leaf words and the packed leaf codes.
+      int32 num_leaf_children = NumLeafChildren(),
+          codes_per_int32 = 32 / quantize_bits;
+      return (3 + 2 * (children_.size() - num_leaf_children) +
+              num_leaf_children +
+              (num_leaf_children + codes_per_int32 - 1) / codes_per_int32);
     }
   }
 
@@ -170,15 +200,99 @@ class LmState {
   std::vector<std::pair<int32, union ChildType> > children_;
 };
 
+// Auxiliary struct for an n-gram line of the Arpa format language model, as
+// parsed by ArpaNgramParser.
+struct ArpaNgram {
+  std::vector<int32> words;  // Sequence of words.
+  float logprob;             // Logprob of the word sequence.
+  float backoff_logprob;     // Backoff_logprob, 0 if not present.
+  std::string error;         // If not empty, the line was bad, and this says
+                             // why.
+};
+
+// Parses a block of n-gram lines of order <order>; with MultiThreader, each
+// thread does a contiguous range of the lines.  We parse in parallel but
+// create the LmStates serially, because that changes <seq_to_state_>.
+class ArpaNgramParser: public MultiThreadable {
+ public:
+  ArpaNgramParser(int32 order, bool is_final_order, bool natural_base,
+                  const std::vector<std::string> &lines,
+                  std::vector<ArpaNgram> *ngrams):
+      order_(order), is_final_order_(is_final_order),
+      natural_base_(natural_base), lines_(&lines), ngrams_(ngrams) {
+    KALDI_ASSERT(ngrams_->size() == lines_->size());
+  }
+
+  void operator() () {
+    size_t begin = (lines_->size() * thread_id_) / num_threads_,
+        end = (lines_->size() * (thread_id_ + 1)) / num_threads_;
+    for (size_t i = begin; i < end; i++)
+      Parse((*lines_)[i], &((*ngrams_)[i]));
+  }
+
+ private:
+  void Parse(const std::string &line, ArpaNgram *ngram) const {
+    std::vector<std::string> col;
+    SplitStringToVector(line, " \t", true, &col);
+    ngram->error.clear();
+    // backoff_logprob can be missing, which means it is 0.
+    if (col.size() < 1 + order_ || col.size() > 2 + order_) {
+      std::ostringstream error;
+      error << "Bad " << order_ << "-gram line \"" << line << "\".";
+      ngram->error = error.str();
+      return;
+    }
+    if (is_final_order_ && col.size() == 2 + order_) {
+      ngram->error = "Backoff probability detected for final-order entry \"" +
+          line + "\".";
+      return;
+    }
+    ngram->backoff_logprob = 0.0;
+    if (!ConvertStringToReal(col[0], &(ngram->logprob)) ||
+        (col.size() == 2 + order_ &&
+         !ConvertStringToReal(col[1 + order_], &(ngram->backoff_logprob)))) {
+      ngram->error = "bad line: " + line + "; fail to convert log-probability.";
+      return;
+    }
+    if (natural_base_) {
+      ngram->logprob *= Log(10.0f);
+      ngram->backoff_logprob *= Log(10.0f);
+    }
+    ngram->words.resize(order_);
+    for (int32 index = 0; index < order_; ++index) {
+      if (!ConvertStringToInteger(col[1 + index], &(ngram->words[index]))) {
+        ngram->error = "bad line: " + line + "; fail to convert " +
+            col[1 + index] + " to integer.";
+        return;
+      }
+    }
+  }
+
+  int32 order_;
+  bool is_final_order_;
+  bool natural_base_;
+  const std::vector<std::string> *lines_;
+  std::vector<ArpaNgram> *ngrams_;
+};
+
 // Class to build ConstArpaLm from Arpa format language model. It relies on the
 // auxiliary class LmState above.
 class ConstArpaLmBuilder {
  public:
+  // <quantize_bits> is as ConstArpaLm::QuantizeBits().  If <num_threads> is
+  // more than one, the parsing in Read() and the filling of the LmStates in
+  // Build() use that many threads (Read() also keeps the calling thread busy
+  // creating the LmStates); the result is the same.
   ConstArpaLmBuilder(
       const bool natural_base, const int32 bos_symbol,
-      const int32 eos_symbol, const int32 unk_symbol) :
+      const int32 eos_symbol, const int32 unk_symbol,
+      const int32 quantize_bits = 0, const int32 num_threads = 1) :
       natural_base_(natural_base), bos_symbol_(bos_symbol),
-      eos_symbol_(eos_symbol), unk_symbol_(unk_symbol) {
+      eos_symbol_(eos_symbol), unk_symbol_(unk_symbol),
+      quantize_bits_(quantize_bits), num_threads_(num_threads) {
+    if (!(quantize_bits_ == 0 || quantize_bits_ == 8 || quantize_bits_ == 16))
+      KALDI_ERR << "Invalid quantize-bits " << quantize_bits_
+                << ", expected 0, 8 or 16.";
     ngram_order_ = 0;
     num_words_ = 0;
     overflow_buffer_size_ = 0;
@@ -209,6 +323,9 @@ class ConstArpaLmBuilder {
   // Writes ConstArpaLm.
   void Write(std::ostream &os, bool binary) const;
 
+  // Writes ConstArpaLm in the format written by ConstArpaLm::WriteAligned().
+  void WriteAligned(std::ostream &os) const;
+
   // Builds ConstArpaLm.
   void Build();
 
@@ -227,6 +344,45 @@ class ConstArpaLmBuilder {
     }
   };
 
+  // The number of n-gram lines Read() parses at a time.
+  static const size_t kNgramBlockSize = 100000;
+
+  // Parses the n-gram lines of order <order> in <lines> with <num_threads_>
+  // threads, while it adds the n-grams in <ngrams> (the previous block) to
+  // the LmStates; it then puts the parsed n-grams in <ngrams> and clears
+  // <lines>.
+  void ProcessNgramBlock(int32 order, std::vector<std::string> *lines,
+                         std::vector<ArpaNgram> *ngrams, int32 *max_word_id);
+
+  // Adds an n-gram of order <order> to the LmStates, updating
+  // <max_word_id> for unigrams.
+  void AddNgram(int32 order, const ArpaNgram &ngram, int32 *max_word_id);
+
+  // Fills in the part of <lm_states_> for the LmStates sorted_vec[begin] to
+  // sorted_vec[end - 1], and sets their entries in <unigram_states_>.  For
+  // each child whose relative address does not fit in 30 bits, it outputs to
+  // <overflows> the position of its child_info in <lm_states_> and its
+  // address, to be put into <overflow_buffer_> by the caller.
+  void FillLmStates(
+      const std::vector<std::pair<std::vector<int32>*, LmState*> > &sorted_vec,
+      size_t begin, size_t end,
+      std::vector<std::pair<int32, int32*> > *overflows);
+
+  friend class LmStateFillClass;
+
+  // Computes <logprob_codebook_> and <backoff_codebook_> from the LmStates in
+  // <sorted_vec>, and logs the quantization error.
+  void ComputeCodebooks(
+      const std::vector<std::pair<std::vector<int32>*, LmState*> > &sorted_vec);
+
+  // Returns the child_info of the non-leaf child with index <index> of
+  // <state>, whose entry is at <parent_address>.  If the relative address
+  // cannot be represented by 30 bits, it returns 0 (which is not a valid
+  // child_info for a non-leaf) and outputs the address of the child to
+  // <overflow_address>.
+  int32 NonLeafChildInfo(LmState *state, int32 index, int32 *parent_address,
+                         int32 **overflow_address) const;
+
  private:
   // If true, use natural base e for log-prob, otherwise use base 10. The
   // default base in Arpa format language model is base 10.
@@ -249,6 +405,17 @@ class ConstArpaLmBuilder {
   // provided.
   int32 unk_symbol_;
 
+  // Number of bits of the logprob and backoff codes, or 0 for no
+  // quantization.
+  int32 quantize_bits_;
+
+  // The codebooks, if <quantize_bits_> is nonzero.
+  std::vector<float> logprob_codebook_;
+  std::vector<float> backoff_codebook_;
+
+  // Number of threads for Read() and Build().
+  int32 num_threads_;
+
   // N-gram order of language model. This can be figured out from "/data/"
   // section in Arpa format language model.
   int32 ngram_order_;
@@ -279,6 +446,114 @@ class ConstArpaLmBuilder {
                 LmState*, VectorHasher<int32> > seq_to_state_;
 };
 
+// Sorts the children of a range of sorted_vec, or fills in their part of
+// <lm_states_>; with MultiThreader, each thread does a contiguous range.
+class LmStateFillClass: public MultiThreadable {
+ public:
+  LmStateFillClass(
+      ConstArpaLmBuilder *builder,
+      const std::vector<std::pair<std::vector<int32>*, LmState*> > &sorted_vec,
+      bool sort_only,
+      std::vector<std::vector<std::pair<int32, int32*> > > *overflows):
+      builder_(builder), sorted_vec_(&sorted_vec), sort_only_(sort_only),
+      overflows_(overflows) { }
+
+  void operator() () {
+    size_t begin = (sorted_vec_->size() * thread_id_) / num_threads_,
+        end = (sorted_vec_->size() * (thread_id_ + 1)) / num_threads_;
+    if (sort_only_) {
+      for (size_t i = begin; i < end; ++i)
+        (*sorted_vec_)[i].second->SortChildren();
+    } else {
+      builder_->FillLmStates(*sorted_vec_, begin, end,
+                             &((*overflows_)[thread_id_]));
+    }
+  }
+
+ private:
+  ConstArpaLmBuilder *builder_;
+  const std::vector<std::pair<std::vector<int32>*, LmState*> > *sorted_vec_;
+  bool sort_only_;
+  std::vector<std::vector<std::pair<int32, int32*> > > *overflows_;
+};
+
+void ConstArpaLmBuilder::ProcessNgramBlock(int32 order,
+                                           std::vector<std::string> *lines,
+                                           std::vector<ArpaNgram> *ngrams,
+                                           int32 *max_word_id) {
+  std::vector<ArpaNgram> parsed(lines->size());
+  {
+    ArpaNgramParser parser(order, order == ngram_order_, natural_base_,
+                           *lines, &parsed);
+    // With zero threads, MultiThreader does the parsing in this thread, in
+    // its constructor.  Its destructor waits for the threads to finish.
+    MultiThreader<ArpaNgramParser> m(num_threads_ > 1 ? num_threads_ : 0,
+                                     parser);
+    for (size_t i = 0; i < ngrams->size(); ++i)
+      AddNgram(order, (*ngrams)[i], max_word_id);
+  }
+  ngrams->swap(parsed);
+  lines->clear();
+}
+
+void ConstArpaLmBuilder::AddNgram(int32 order, const ArpaNgram &ngram,
+                                  int32 *max_word_id) {
+  if (!ngram.error.empty())
+    KALDI_ERR << ngram.error;
+  const std::vector<int32> &seq = ngram.words;
+  KALDI_ASSERT(seq.size() == order);
+
+  // Creates LmState for the current word sequence.  If <ngram_order_> is
+  // larger than 1, then we do not create LmState for the final order entry.
+  // We only keep the log probability for it.
+  bool is_unigram = (order == 1) ? true : false;
+  LmState *lm_state = NULL;
+  if (order != ngram_order_ || ngram_order_ == 1) {
+    lm_state = new LmState(is_unigram,
+                           (order == ngram_order_ - 1),
+                           ngram.logprob, ngram.backoff_logprob);
+  }
+
+  // If <ngram_order_> is larger than 1, then we do not insert LmState to
+  // <seq_to_state_>.
+  if (order != ngram_order_ || ngram_order_ == 1) {
+    KALDI_ASSERT(lm_state != NULL);
+    KALDI_ASSERT(seq_to_state_.find(seq) == seq_to_state_.end());
+    seq_to_state_[seq] = lm_state;
+  }
+
+  // If n-gram order is larger than 1, we have to add possible child to
+  // existing LmStates. We have the following two assumptions:
+  // 1. N-grams are processed from small order to larger ones, i.e., from
+  //    1, 2, ... to the highest order.
+  // 2. If a n-gram exists in the Arpa format language model, then the
+  //    "history" n-gram also exists. For example, if "A B C" is a valid
+  //    n-gram, then "A B" is also a valid n-gram.
+  if (order > 1) {
+    std::vector<int32> hist(seq.begin(), seq.begin() + order - 1);
+    int32 word = seq[seq.size() - 1];
+    unordered_map<std::vector<int32>,
+                  LmState*, VectorHasher<int32> >::iterator hist_iter;
+    hist_iter = seq_to_state_.find(hist);
+    KALDI_ASSERT(hist_iter != seq_to_state_.end());
+    if (order != ngram_order_ || ngram_order_ == 1) {
+      KALDI_ASSERT(lm_state != NULL);
+      KALDI_ASSERT(!hist_iter->second->IsChildFinalOrder());
+      hist_iter->second->AddChild(word, lm_state);
+    } else {
+      KALDI_ASSERT(lm_state == NULL);
+      KALDI_ASSERT(hist_iter->second->IsChildFinalOrder());
+      hist_iter->second->AddChild(word, ngram.logprob);
+    }
+  } else {
+    // Figures out <max_word_id>.
+    KALDI_ASSERT(seq.size() == 1);
+    if (seq[0] > *max_word_id) {
+      *max_word_id = seq[0];
+    }
+  }
+}
+
 // Reads in the Arpa format language model, parses it and puts the word sequence
 // into the corresponding LmState in <seq_to_state_>.
 void ConstArpaLmBuilder::Read(std::istream &is, bool binary) {
@@ -347,8 +622,12 @@ void ConstArpaLmBuilder::Read(std::istream &is, bool binary) {
     KALDI_ERR << "Fail to read \"\\data\\\" section.";
   ngram_order_ = num_ngrams.size() - 1;
 
-  // Processes "\N-grams:" section.
+  // Processes "\N-grams:" section.  We collect the lines in blocks of
+  // kNgramBlockSize; each block is parsed by <num_threads_> threads while this
+  // thread adds the n-grams of the previous block (see ProcessNgramBlock()).
   int32 max_word_id = 0;
+  std::vector<std::string> lines;
+  std::vector<ArpaNgram> ngrams;
   for (int32 cur_order = 1; cur_order < num_ngrams.size(); ++cur_order) {
     // Skips n-grams with zero count.
     if (num_ngrams[cur_order] == 0) continue;
@@ -366,104 +645,29 @@ void ConstArpaLmBuilder::Read(std::istream &is, bool binary) {
         if (line.find("\\end\\") != std::string::npos) break;
       }
 
-      std::vector<std::string> col;
-      SplitStringToVector(line, " \t", true, &col);
-
       // Looks for keyword "\N-gram:" if the keyword has not been located.
-      if (!keyword_found && col.size() == 1 && col[0] == keyword.str()) {
-        KALDI_LOG << "Reading \"" << keyword.str() << "\" section.";
-        ngram_count = 0;
-        keyword_found = true;
+      if (!keyword_found) {
+        std::vector<std::string> col;
+        SplitStringToVector(line, " \t", true, &col);
+        if (col.size() == 1 && col[0] == keyword.str()) {
+          KALDI_LOG << "Reading \"" << keyword.str() << "\" section.";
+          ngram_count = 0;
+          keyword_found = true;
+        }
         continue;
       }
 
       // Enters "\N-grams:" section if the keyword has been located.
-      if (keyword_found && col.size() > 0) {
-        KALDI_ASSERT(col.size() >= 1 + cur_order);
-        KALDI_ASSERT(col.size() <= 2 + cur_order);  // backoff_logprob can be 0.
-        if (cur_order == ngram_order_ && col.size() == 2 + cur_order) {
-          KALDI_ERR << "Backoff probability detected for final-order entry \""
-              << line << "\".";
-        }
+      if (line.find_first_not_of(" \t") != std::string::npos) {
         ngram_count++;
-
-        // If backoff_logprob is 0, it will not appear in Arpa format language
-        // model. We put it back so the processing afterwards will be easier.
-        if (col.size() == 1 + cur_order) {
-          col.push_back("0");
-        }
-
-        // Creates LmState for the current word sequence.
-        bool is_unigram = (cur_order == 1) ? true : false;
-        float logprob;
-        float backoff_logprob;
-        KALDI_ASSERT(ConvertStringToReal(col[0], &logprob));
-        KALDI_ASSERT(ConvertStringToReal(col[1 + cur_order], &backoff_logprob));
-        if (natural_base_) {
-          logprob *= Log(10.0f);
-          backoff_logprob *= Log(10.0f);
-        }
-
-        // If <ngram_order_> is larger than 1, then we do not create LmState for
-        // the final order entry. We only keep the log probability for it.
-        LmState *lm_state = NULL;
-        if (cur_order != ngram_order_ || ngram_order_ == 1) {
-          lm_state = new LmState(is_unigram,
-                                 (cur_order == ngram_order_ - 1),
-                                 logprob, backoff_logprob);
-        }
-
-        // Figures out the sequence of words.
-        std::vector<int32> seq(cur_order, 0);
-        for (int32 index = 0; index < cur_order; ++index) {
-          int32 word;
-          if (!ConvertStringToInteger(col[1 + index], &word)) {
-            KALDI_ERR << "bad line: " << line << "; fail to convert "
-                << col[1 + index] << " to integer.";
-          }
-          seq[index] = word;
-        }
-
-        // If <ngram_order_> is larger than 1, then we do not insert LmState to
-        // <seq_to_state_>.
-        if (cur_order != ngram_order_ || ngram_order_ == 1) {
-          KALDI_ASSERT(lm_state != NULL);
-          KALDI_ASSERT(seq_to_state_.find(seq) == seq_to_state_.end());
-          seq_to_state_[seq] = lm_state;
-        }
-
-        // If n-gram order is larger than 1, we have to add possible child to
-        // existing LmStates. We have the following two assumptions:
-        // 1. N-grams are processed from small order to larger ones, i.e., from
-        //    1, 2, ... to the highest order.
-        // 2. If a n-gram exists in the Arpa format language model, then the
-        //    "history" n-gram also exists. For example, if "A B C" is a valid
-        //    n-gram, then "A B" is also a valid n-gram.
-        if (cur_order > 1) {
-          std::vector<int32> hist(seq.begin(), seq.begin() + cur_order - 1);
-          int32 word = seq[seq.size() - 1];
-          unordered_map<std::vector<int32>,
-                        LmState*, VectorHasher<int32> >::iterator hist_iter;
-          hist_iter = seq_to_state_.find(hist);
-          KALDI_ASSERT(hist_iter != seq_to_state_.end());
-          if (cur_order != ngram_order_ || ngram_order_ == 1) {
-            KALDI_ASSERT(lm_state != NULL);
-            KALDI_ASSERT(!hist_iter->second->IsChildFinalOrder());
-            hist_iter->second->AddChild(word, lm_state);
-          } else {
-            KALDI_ASSERT(lm_state == NULL);
-            KALDI_ASSERT(hist_iter->second->IsChildFinalOrder());
-            hist_iter->second->AddChild(word, logprob);
-          }
-        } else {
-          // Figures out <max_word_id>.
-          KALDI_ASSERT(seq.size() == 1);
-          if (seq[0] > max_word_id) {
-            max_word_id = seq[0];
-          }
-        }
+        lines.push_back(line);
+        if (lines.size() == kNgramBlockSize)
+          ProcessNgramBlock(cur_order, &lines, &ngrams, &max_word_id);
       }
     } while (getline(is, line) && !is.eof());
+    // Adds the n-grams of the last two blocks.
+    ProcessNgramBlock(cur_order, &lines, &ngrams, &max_word_id);
+    ProcessNgramBlock(cur_order, &lines, &ngrams, &max_word_id);
     if (ngram_count > num_ngrams[cur_order] ||
         (ngram_count == 0 && num_ngrams[cur_order] != 0)) {
       KALDI_ERR << "Header said there would be " << num_ngrams[cur_order]
@@ -476,6 +680,239 @@ void ConstArpaLmBuilder::Read(std::istream &is, bool binary) {
   num_words_ = max_word_id + 1;
 }
 
+// Computes a codebook of at most <num_codes> values for <values> (which it
+// sorts) such that about the same number of the values map to each code, each
+// code being the mean of its values.  If there are no more than <num_codes>
+// distinct values, the codebook is those values, so quantization is exact.
+// If <keep_zero> is true, zero is always exactly representable; we use this
+// for the backoff weights, as zero means there is no backoff.  The codebook is
+// sorted.
+static void ComputeCodebook(std::vector<float> *values, int32 num_codes,
+                            bool keep_zero, std::vector<float> *codebook) {
+  std::sort(values->begin(), values->end());
+  codebook->clear();
+  std::vector<float> distinct(*values);
+  distinct.erase(std::unique(distinct.begin(), distinct.end()),
+                 distinct.end());
+  if (keep_zero && !std::binary_search(distinct.begin(), distinct.end(), 0.0f))
+    distinct.insert(std::lower_bound(distinct.begin(), distinct.end(), 0.0f),
+                    0.0f);
+  if (distinct.size() <= static_cast<size_t>(num_codes)) {
+    codebook->swap(distinct);
+    return;
+  }
+  // Equal-population binning of the values, leaving out the zeros if we add
+  // zero separately.
+  std::vector<float>::const_iterator begin = values->begin(),
+      end = values->end();
+  std::vector<float> nonzero;
+  if (keep_zero) {
+    for (; begin != end; ++begin)
+      if (*begin != 0.0f) nonzero.push_back(*begin);
+    begin = nonzero.begin();
+    end = nonzero.end();
+    num_codes--;
+  }
+  size_t num_values = end - begin;
+  for (int32 c = 0; c < num_codes; c++) {
+    size_t bin_begin = (num_values * c) / num_codes,
+        bin_end = (num_values * (c + 1)) / num_codes;
+    if (bin_end == bin_begin) continue;
+    double sum = 0.0;
+    for (size_t i = bin_begin; i < bin_end; i++)
+      sum += begin[i];
+    codebook->push_back(sum / (bin_end - bin_begin));
+  }
+  if (keep_zero) codebook->push_back(0.0f);
+  std::sort(codebook->begin(), codebook->end());
+  codebook->erase(std::unique(codebook->begin(), codebook->end()),
+                  codebook->end());
+}
+
+// Returns the index of the value in the sorted <codebook> that is closest to
+// <value>.
+static int32 QuantizeValue(const std::vector<float> &codebook, float value) {
+  KALDI_ASSERT(!codebook.empty());
+  std::vector<float>::const_iterator iter =
+      std::lower_bound(codebook.begin(), codebook.end(), value);
+  if (iter == codebook.end()) return codebook.size() - 1;
+  if (iter != codebook.begin() && value - *(iter - 1) < *iter - value)
+    --iter;
+  return iter - codebook.begin();
+}
+
+void ConstArpaLmBuilder::ComputeCodebooks(
+    const std::vector<std::pair<std::vector<int32>*, LmState*> > &sorted_vec) {
+  KALDI_ASSERT(quantize_bits_ == 8 || quantize_bits_ == 16);
+  std::vector<float> logprobs, backoffs;
+  for (size_t i = 0; i < sorted_vec.size(); ++i) {
+    LmState *state = sorted_vec[i].second;
+    logprobs.push_back(state->Logprob());
+    backoffs.push_back(state->BackoffLogprob());
+    for (int32 j = 0; j < state->NumChildren(); ++j)
+      if (state->ChildIsLeaf(j))
+        logprobs.push_back(state->ChildLogprob(j));
+  }
+  int32 num_codes = 1 << quantize_bits_;
+  ComputeCodebook(&logprobs, num_codes, false, &logprob_codebook_);
+  ComputeCodebook(&backoffs, num_codes, true, &backoff_codebook_);
+
+  // Reports the quantization error, which is what determines how much the
+  // quantization can change the rescoring output.  <logprobs> and <backoffs>
+  // are now sorted, so we can quantize them in one pass.
+  const std::vector<float> *values[2] = { &logprobs, &backoffs },
+      *codebooks[2] = { &logprob_codebook_, &backoff_codebook_ };
+  const char *names[2] = { "log-probabilities", "backoff weights" };
+  for (int32 k = 0; k < 2; k++) {
+    double total_error = 0.0, max_error = 0.0;
+    size_t code = 0;
+    const std::vector<float> &v = *(values[k]), &codebook = *(codebooks[k]);
+    for (size_t i = 0; i < v.size(); i++) {
+      while (code + 1 < codebook.size() &&
+             codebook[code + 1] - v[i] <= v[i] - codebook[code])
+        code++;
+      double error = std::abs(v[i] - codebook[code]);
+      total_error += error;
+      max_error = std::max(max_error, error);
+    }
+    KALDI_LOG << "Quantized " << v.size() << " " << names[k] << " to "
+              << codebook.size() << " codes of " << quantize_bits_
+              << " bits; average absolute error is "
+              << (v.empty() ? 0.0 : total_error / v.size())
+              << ", maximum is " << max_error;
+  }
+}
+
+int32 ConstArpaLmBuilder::NonLeafChildInfo(
+    LmState *state, int32 index, int32 *parent_address,
+    int32 **overflow_address) const {
+  int64 offset = state->GetChild(index).second.state->MyAddress()
+      - state->MyAddress();
+  KALDI_ASSERT(offset > 0);
+  if (offset <= max_address_offset_) {
+    // Relative address can be represented by 30 bits.
+    int32 child_info = offset * 2;
+    child_info |= 1;
+    return child_info;
+  } else {
+    // Relative address cannot be represented by 30 bits, we have to put
+    // the child address into <overflow_buffer_>.
+    *overflow_address = parent_address + offset;
+    return 0;
+  }
+}
+
+void ConstArpaLmBuilder::FillLmStates(
+    const std::vector<std::pair<std::vector<int32>*, LmState*> > &sorted_vec,
+    size_t begin, size_t end,
+    std::vector<std::pair<int32, int32*> > *overflows) {
+  for (size_t i = begin; i < end; ++i) {
+    LmState *state = sorted_vec[i].second;
+    int32 lm_states_index = state->MyAddress();
+    // Current address.
+    int32* parent_address = lm_states_ + lm_states_index;
+    int32* overflow_address = NULL;
+
+    if (quantize_bits_ == 0) {
+      // Adds logprob.
+      Int32AndFloat logprob_f(state->Logprob());
+      lm_states_[lm_states_index++] = logprob_f.i;
+
+      // Adds backoff_logprob.
+      Int32AndFloat backoff_logprob_f(state->BackoffLogprob());
+      lm_states_[lm_states_index++] = backoff_logprob_f.i;
+
+      // Adds num_children.
+      lm_states_[lm_states_index++] = state->NumChildren();
+
+      // Adds children, there are 3 cases:
+      // 1. Child is a leaf and not unigram
+      // 2. Child is not a leaf or is unigram
+      //    2.1 Relative address can be represented by 30 bits
+      //    2.2 Relative address cannot be represented by 30 bits
+      for (int32 j = 0; j < state->NumChildren(); ++j) {
+        int32 child_info;
+        if (state->ChildIsLeaf(j)) {
+          // Child is a leaf and not unigram. In this case we will not create an
+          // entry in <lm_states_>; instead, we put the logprob in the place
+          // where we normally store the poitner.
+          Int32AndFloat child_logprob_f(state->ChildLogprob(j));
+          child_info = child_logprob_f.i;
+          child_info &= ~1;   // Sets the last bit to 0 so <child_info> is even.
+        } else {
+          // Child is not a leaf or is unigram.
+          child_info = NonLeafChildInfo(state, j, parent_address,
+                                        &overflow_address);
+          if (child_info == 0)
+            overflows->push_back(std::make_pair(lm_states_index + 1,
+                                                overflow_address));
+        }
+        // Child word.
+        lm_states_[lm_states_index++] = state->GetChild(j).first;
+        // Child info.
+        lm_states_[lm_states_index++] = child_info;
+      }
+    } else {
+      // Adds the codes of logprob and backoff_logprob.
+      int32 logprob_code = QuantizeValue(logprob_codebook_, state->Logprob()),
+          backoff_code = QuantizeValue(backoff_codebook_,
+                                       state->BackoffLogprob());
+      lm_states_[lm_states_index++] = static_cast<int32>(
+          static_cast<uint32>(logprob_code) |
+          (static_cast<uint32>(backoff_code) << 16));
+
+      // Adds the numbers of leaf and non-leaf children.
+      int32 num_leaf_children = state->NumLeafChildren();
+      lm_states_[lm_states_index++] = num_leaf_children;
+      lm_states_[lm_states_index++] = state->NumChildren() - num_leaf_children;
+
+      // Adds the non-leaf children, then the leaf words, then the leaf codes.
+      for (int32 j = 0; j < state->NumChildren(); ++j) {
+        if (!state->ChildIsLeaf(j)) {
+          int32 child_info = NonLeafChildInfo(state, j, parent_address,
+                                              &overflow_address);
+          if (child_info == 0)
+            overflows->push_back(std::make_pair(lm_states_index + 1,
+                                                overflow_address));
+          lm_states_[lm_states_index++] = state->GetChild(j).first;
+          lm_states_[lm_states_index++] = child_info;
+        }
+      }
+      for (int32 j = 0; j < state->NumChildren(); ++j) {
+        if (state->ChildIsLeaf(j))
+          lm_states_[lm_states_index++] = state->GetChild(j).first;
+      }
+      int32 codes_per_int32 = 32 / quantize_bits_,
+          num_code_int32s = (num_leaf_children + codes_per_int32 - 1) /
+          codes_per_int32;
+      uint32 *codes = reinterpret_cast<uint32*>(lm_states_ + lm_states_index);
+      for (int32 k = 0; k < num_code_int32s; ++k)
+        codes[k] = 0;
+      int32 k = 0;
+      for (int32 j = 0; j < state->NumChildren(); ++j) {
+        if (state->ChildIsLeaf(j)) {
+          uint32 code = QuantizeValue(logprob_codebook_,
+                                      state->ChildLogprob(j));
+          codes[k / codes_per_int32] |=
+              code << ((k % codes_per_int32) * quantize_bits_);
+          k++;
+        }
+      }
+      lm_states_index += num_code_int32s;
+    }
+    KALDI_ASSERT(lm_states_index ==
+                 state->MyAddress() + state->MemSize(quantize_bits_));
+
+    // If the current state corresponds to an unigram, then create a separate
+    // loop up table to improve efficiency, since those will be looked up pretty
+    // frequently.
+    if (state->IsUnigram()) {
+      KALDI_ASSERT(sorted_vec[i].first->size() == 1);
+      unigram_states_[(*sorted_vec[i].first)[0]] = parent_address;
+    }
+  }
+}
+
 // ConstArpaLm can be built in the following steps, assuming we have already
 // created LmStates <seq_to_state_>:
 // 1. Sort LmStates lexicographically.
@@ -498,6 +935,8 @@ void ConstArpaLmBuilder::Read(std::istream &is, bool binary) {
 //      int32 num_children;
 //      std::pair<int32, int32> [] children;
 //    }
+//    or, if we are quantizing, the structure described above
+//    ConstArpaLm::lm_states_.
 //
 //    At the same time, we will also create two special buffers:
 //    <unigram_states_>
@@ -521,103 +960,65 @@ void ConstArpaLmBuilder::Build() {
 
   // STEP 2: updating <my_address> in LmState.
   for (int32 i = 0; i < sorted_vec.size(); ++i) {
-    lm_states_size_ += sorted_vec[i].second->MemSize();
+    lm_states_size_ += sorted_vec[i].second->MemSize(quantize_bits_);
     if (i == 0) {
       sorted_vec[i].second->SetMyAddress(0);
     } else {
       sorted_vec[i].second->SetMyAddress(sorted_vec[i - 1].second->MyAddress()
-          + sorted_vec[i - 1].second->MemSize());
+          + sorted_vec[i - 1].second->MemSize(quantize_bits_));
     }
   }
+  if (quantize_bits_ != 0)
+    ComputeCodebooks(sorted_vec);
 
   // STEP 3: creating memory block to store LmStates.
   // Reserves a memory block for LmStates.
-  int32 lm_states_index = 0;
   try {
     lm_states_ = new int32[lm_states_size_];
   } catch(const std::exception &e) {
     KALDI_ERR << e.what();
   }
 
-  // Puts data into memory block.
+  // Puts data into memory block.  Each LmState goes at its own address, so we
+  // can do ranges of <sorted_vec> in parallel; but we first sort all the
+  // children, as FillLmStates() looks at the children of the children.
   unigram_states_ = new int32*[num_words_];
-  std::vector<int32*> overflow_buffer_vec;
   for (int32 i = 0; i < num_words_; ++i) {
     unigram_states_[i] = NULL;
   }
-  for (int32 i = 0; i < sorted_vec.size(); ++i) {
-    // Current address.
-    int32* parent_address = lm_states_ + lm_states_index;
-
-    // Adds logprob.
-    Int32AndFloat logprob_f(sorted_vec[i].second->Logprob());
-    lm_states_[lm_states_index++] = logprob_f.i;
-
-    // Adds backoff_logprob.
-    Int32AndFloat backoff_logprob_f(sorted_vec[i].second->BackoffLogprob());
-    lm_states_[lm_states_index++] = backoff_logprob_f.i;
-
-    // Adds num_children.
-    lm_states_[lm_states_index++] = sorted_vec[i].second->NumChildren();
-
-    // Adds children, there are 3 cases:
-    // 1. Child is a leaf and not unigram
-    // 2. Child is not a leaf or is unigram
-    //    2.1 Relative address can be represented by 30 bits
-    //    2.2 Relative address cannot be represented by 30 bits
-    sorted_vec[i].second->SortChildren();
-    for (int32 j = 0; j < sorted_vec[i].second->NumChildren(); ++j) {
-      int32 child_info;
-      if (sorted_vec[i].second->IsChildFinalOrder() ||
-          sorted_vec[i].second->GetChild(j).second.state->MemSize() == 0) {
-        // Child is a leaf and not unigram. In this case we will not create an
-        // entry in <lm_states_>; instead, we put the logprob in the place where
-        // we normally store the poitner.
-        Int32AndFloat child_logprob_f;
-        if (sorted_vec[i].second->IsChildFinalOrder()) {
-          child_logprob_f.f = sorted_vec[i].second->GetChild(j).second.prob;
-        } else {
-          child_logprob_f.f =
-              sorted_vec[i].second->GetChild(j).second.state->Logprob();
-        }
-        child_info = child_logprob_f.i;
-        child_info &= ~1;   // Sets the last bit to 0 so <child_info> is even.
-      } else {
-        // Child is not a leaf or is unigram.
-        int64 offset =
-            sorted_vec[i].second->GetChild(j).second.state->MyAddress()
-            - sorted_vec[i].second->MyAddress();
-        KALDI_ASSERT(offset > 0);
-        if (offset <= max_address_offset_) {
-          // Relative address can be represented by 30 bits.
-          child_info = offset * 2;
-          child_info |= 1;
-        } else {
-          // Relative address cannot be represented by 30 bits, we have to put
-          // the child address into <overflow_buffer_>.
-          int32* abs_address = parent_address + offset;
-          overflow_buffer_vec.push_back(abs_address);
-          int32 overflow_buffer_index = overflow_buffer_vec.size() - 1;
-          child_info = overflow_buffer_index * 2;
-          child_info |= 1;
-          child_info *= -1;
-        }
-      }
-      // Child word.
-      lm_states_[lm_states_index++] = sorted_vec[i].second->GetChild(j).first;
-      // Child info.
-      lm_states_[lm_states_index++] = child_info;
-    }
+  int32 num_threads = num_threads_ > 1 ? num_threads_ : 0;
+  std::vector<std::vector<std::pair<int32, int32*> > > overflows(
+      std::max<int32>(1, num_threads));
+  {
+    LmStateFillClass c(this, sorted_vec, true, &overflows);
+    MultiThreader<LmStateFillClass> m(num_threads, c);
+  }
+  {
+    LmStateFillClass c(this, sorted_vec, false, &overflows);
+    MultiThreader<LmStateFillClass> m(num_threads, c);
+  }
 
-    // If the current state corresponds to an unigram, then create a separate
-    // loop up table to improve efficiency, since those will be looked up pretty
-    // frequently.
-    if (sorted_vec[i].second->IsUnigram()) {
-      KALDI_ASSERT(sorted_vec[i].first->size() == 1);
-      unigram_states_[(*sorted_vec[i].first)[0]] = parent_address;
+  // Puts the addresses that did not fit in 30 bits into <overflow_buffer_vec>
+  // in the order of the LmStates, and their indexes into the child_infos.
+  std::vector<int32*> overflow_buffer_vec;
+  for (size_t t = 0; t < overflows.size(); ++t) {
+    for (size_t i = 0; i < overflows[t].size(); ++i) {
+      overflow_buffer_vec.push_back(overflows[t][i].second);
+      int32 overflow_buffer_index = overflow_buffer_vec.size() - 1;
+      int32 child_info = overflow_buffer_index * 2;
+      child_info |= 1;
+      child_info *= -1;
+      lm_states_[overflows[t][i].first] = child_info;
     }
   }
-  KALDI_ASSERT(lm_states_size_ == lm_states_index);
+  if (quantize_bits_ != 0) {
+    int64 unquantized_size = 0;
+    for (size_t i = 0; i < sorted_vec.size(); ++i)
+      unquantized_size += sorted_vec[i].second->MemSize();
+    KALDI_LOG << "Quantized LmStates take " << lm_states_size_ * 4
+              << " bytes, versus " << unquantized_size * 4
+              << " without quantization.";
+  }
 
   // Move <overflow_buffer_> from vector holder to array.
   overflow_buffer_size_ = overflow_buffer_vec.size();
@@ -638,15 +1039,32 @@ void ConstArpaLmBuilder::Write(std::ostream &os, bool binary) const {
   // Creates ConstArpaLm.
   ConstArpaLm const_arpa_lm(bos_symbol_, eos_symbol_, unk_symbol_, ngram_order_,
                             num_words_, overflow_buffer_size_, lm_states_size_,
-                            unigram_states_, overflow_buffer_, lm_states_);
+                            unigram_states_, overflow_buffer_, lm_states_,
+                            quantize_bits_, logprob_codebook_,
+                            backoff_codebook_);
   const_arpa_lm.Write(os, binary);
 }
 
+void ConstArpaLmBuilder::WriteAligned(std::ostream &os) const {
+  KALDI_ASSERT(is_built_);
+  ConstArpaLm const_arpa_lm(bos_symbol_, eos_symbol_, unk_symbol_, ngram_order_,
+                            num_words_, overflow_buffer_size_, lm_states_size_,
+                            unigram_states_, overflow_buffer_, lm_states_,
+                            quantize_bits_, logprob_codebook_,
+                            backoff_codebook_);
+  const_arpa_lm.WriteAligned(os);
+}
+
 void ConstArpaLm::Write(std::ostream &os, bool binary) const {
   KALDI_ASSERT(initialized_);
   if (!binary) {
     KALDI_ERR << "text-mode writing is not implemented for ConstArpaLm.";
   }
+  if (quantize_bits_ != 0) {
+    // The format below has no room for the codebooks.
+    WriteAligned(os);
+    return;
+  }
 
   // Misc info.
   WriteBasicType(os, binary, bos_symbol_);
@@ -696,6 +1114,13 @@ void ConstArpaLm::Read(std::istream &is, bool binary) {
   if (!binary) {
     KALDI_ERR << "text-mode reading is not implemented for ConstArpaLm.";
   }
+  // The format written by Write() starts with an integer (whose first byte is
+  // its size), the one written by WriteAligned() with a token.
+  if (Peek(is, binary) == '<') {
+    ExpectToken(is, binary, "<ConstArpaLmAligned>");
+    ReadAligned(is);
+    return;
+  }
 
   // Misc info.
   ReadBasicType(is, binary, &bos_symbol_);
@@ -743,6 +1168,292 @@ void ConstArpaLm::Read(std::istream &is, bool binary) {
   initialized_ = true;
 }
 
+void ConstArpaLm::WriteAlignedHeader(std::ostream &os, int32 version,
+                                     int64 begin,
+                                     const std::vector<int64> &offsets) const {
+  bool binary = true;
+  int32 num_sections = (version == 1 ? 3 : 4);
+  KALDI_ASSERT(offsets.size() == num_sections);
+  WriteToken(os, binary, "<ConstArpaLmAligned>");
+  WriteToken(os, binary, "<Version>");
+  WriteBasicType(os, binary, version);
+  WriteBasicType(os, binary, bos_symbol_);
+  WriteBasicType(os, binary, eos_symbol_);
+  WriteBasicType(os, binary, unk_symbol_);
+  WriteBasicType(os, binary, ngram_order_);
+  WriteBasicType(os, binary, lm_states_size_);
+  WriteBasicType(os, binary, num_words_);
+  WriteBasicType(os, binary, overflow_buffer_size_);
+  if (version >= 2) {
+    WriteToken(os, binary, "<QuantizeBits>");
+    WriteBasicType(os, binary, quantize_bits_);
+    int32 logprob_codebook_size = logprob_codebook_.size(),
+        backoff_codebook_size = backoff_codebook_.size();
+    WriteBasicType(os, binary, logprob_codebook_size);
+    WriteBasicType(os, binary, backoff_codebook_size);
+  }
+  WriteToken(os, binary, "<Begin>");
+  WriteBasicType(os, binary, begin);
+  WriteToken(os, binary, "<Offsets>");
+  for (int32 i = 0; i < num_sections; i++)
+    WriteBasicType(os, binary, offsets[i]);
+}
+
+void ConstArpaLm::ReadAlignedHeader(std::istream &is, int32 *version,
+                                    int64 *begin,
+                                    std::vector<int64> *offsets) {
+  // The token <ConstArpaLmAligned> has already been read.
+  bool binary = true;
+  ExpectToken(is, binary, "<Version>");
+  ReadBasicType(is, binary, version);
+  if (*version < 1 || *version > kAlignedFormatVersion)
+    KALDI_ERR << "Reading ConstArpaLm: format version " << *version
+              << " is not supported by this version of the code (max "
+              << kAlignedFormatVersion << ").";
+  ReadBasicType(is, binary, &bos_symbol_);
+  ReadBasicType(is, binary, &eos_symbol_);
+  ReadBasicType(is, binary, &unk_symbol_);
+  ReadBasicType(is, binary, &ngram_order_);
+  ReadBasicType(is, binary, &lm_states_size_);
+  ReadBasicType(is, binary, &num_words_);
+  ReadBasicType(is, binary, &overflow_buffer_size_);
+  quantize_bits_ = 0;
+  logprob_codebook_.clear();
+  backoff_codebook_.clear();
+  if (*version >= 2) {
+    ExpectToken(is, binary, "<QuantizeBits>");
+    ReadBasicType(is, binary, &quantize_bits_);
+    int32 logprob_codebook_size, backoff_codebook_size;
+    ReadBasicType(is, binary, &logprob_codebook_size);
+    ReadBasicType(is, binary, &backoff_codebook_size);
+    int32 max_codes = (quantize_bits_ == 0 ? 0 : 1 << quantize_bits_);
+    if (!(quantize_bits_ == 0 || quantize_bits_ == 8 || quantize_bits_ == 16) ||
+        logprob_codebook_size < 0 || backoff_codebook_size < 0 ||
+        logprob_codebook_size > max_codes || backoff_codebook_size > max_codes)
+      KALDI_ERR << "Bad quantization info reading ConstArpaLm.";
+    logprob_codebook_.resize(logprob_codebook_size);
+    backoff_codebook_.resize(backoff_codebook_size);
+  }
+  ExpectToken(is, binary, "<Begin>");
+  ReadBasicType(is, binary, begin);
+  ExpectToken(is, binary, "<Offsets>");
+  int32 num_sections = (*version == 1 ? 3 : 4);
+  offsets->resize(num_sections);
+  for (int32 i = 0; i < num_sections; i++)
+    ReadBasicType(is, binary, &((*offsets)[i]));
+  if (lm_states_size_ < 0 || num_words_ < 0 || overflow_buffer_size_ < 0 ||
+      *begin < 0)
+    KALDI_ERR << "Bad header reading ConstArpaLm.";
+  // Check that the offsets are the ones we would have written.
+  std::ostringstream header;
+  WriteAlignedHeader(header, *version, *begin, *offsets);
+  std::vector<int64> expected_offsets;
+  ComputeAlignedOffsets(*version, *begin, header.str().size(),
+                        &expected_offsets);
+  if (expected_offsets != *offsets)
+    KALDI_ERR << "Bad section offsets reading ConstArpaLm.";
+}
+
+void ConstArpaLm::GetAlignedSectionSizes(int64 *sizes) const {
+  sizes[0] = static_cast<int64>(lm_states_size_) * 4;  // int32
+  sizes[1] = static_cast<int64>(num_words_) * 8;  // int64
+  sizes[2] = static_cast<int64>(overflow_buffer_size_) * 8;  // int64
+  sizes[3] = static_cast<int64>(logprob_codebook_.size() +
+                                backoff_codebook_.size()) * 4;  // float
+}
+
+int64 ConstArpaLm::ComputeAlignedOffsets(int32 version, int64 begin,
+                                         int64 header_size,
+                                         std::vector<int64> *offsets) const {
+  int64 sizes[4];
+  GetAlignedSectionSizes(sizes);
+  int32 num_sections = (version == 1 ? 3 : 4);
+  offsets->resize(num_sections);
+  int64 pos = begin + header_size;
+  for (int32 i = 0; i < num_sections; i++) {
+    pos = ((pos + kPageSize - 1) / kPageSize) * kPageSize;
+    (*offsets)[i] = pos;
+    pos += sizes[i];
+  }
+  return pos;
+}
+
+void ConstArpaLm::WriteAligned(std::ostream &os) const {
+  KALDI_ASSERT(initialized_);
+  KALDI_ASSERT(sizeof(int32) == 4 && sizeof(int64) == 8 && sizeof(float) == 4);
+  int32 version = kAlignedFormatVersion;
+  // If the stream position is not known (e.g. for a pipe), we assume that we
+  // are writing just after the Kaldi binary header at the start of a file.
+  int64 begin = os.tellp();
+  if (begin < 0) begin = 2;
+  std::vector<int64> offsets(4, 0);
+  std::ostringstream header;
+  WriteAlignedHeader(header, version, begin, offsets);
+  int64 header_size = header.str().size();
+  ComputeAlignedOffsets(version, begin, header_size, &offsets);
+  WriteAlignedHeader(os, version, begin, offsets);
+
+  // The addresses are relative, as in Write().
+  std::vector<int64> unigram_addresses(num_words_),
+      overflow_addresses(overflow_buffer_size_);
+  for (int32 i = 0; i < num_words_; ++i)
+    unigram_addresses[i] = (unigram_states_[i] == NULL) ? 0 :
+        unigram_states_[i] - lm_states_ + 1;
+  for (int32 i = 0; i < overflow_buffer_size_; ++i)
+    overflow_addresses[i] = (overflow_buffer_[i] == NULL) ? 0 :
+        overflow_buffer_[i] - lm_states_ + 1;
+  std::vector<float> codebooks(logprob_codebook_);
+  codebooks.insert(codebooks.end(), backoff_codebook_.begin(),
+                   backoff_codebook_.end());
+  const char *data[4] = {
+    reinterpret_cast<const char*>(lm_states_),
+    reinterpret_cast<const char*>(num_words_ == 0 ? NULL :
+                                  &(unigram_addresses[0])),
+    reinterpret_cast<const char*>(overflow_buffer_size_ == 0 ? NULL :
+                                  &(overflow_addresses[0])),
+    reinterpret_cast<const char*>(codebooks.empty() ? NULL :
+                                  &(codebooks[0])) };
+  int64 sizes[4];
+  GetAlignedSectionSizes(sizes);
+  int64 pos = begin + header_size;
+  for (int32 i = 0; i < 4; i++) {
+    std::vector<char> zeros(offsets[i] - pos, '\0');
+    if (!zeros.empty())
+      os.write(&(zeros[0]), zeros.size());
+    if (sizes[i] != 0)
+      os.write(data[i], sizes[i]);
+    pos = offsets[i] + sizes[i];
+  }
+  if (!os.good())
+    KALDI_ERR << "Error writing ConstArpaLm to stream.";
+}
+
+void ConstArpaLm::ReadAligned(std::istream &is) {
+  int32 version;
+  int64 begin;
+  std::vector<int64> offsets;
+  ReadAlignedHeader(is, &version, &begin, &offsets);
+  std::ostringstream header;
+  WriteAlignedHeader(header, version, begin, offsets);
+  // We don't rely on tellg() to find the padding, as it doesn't work for
+  // pipes.
+  int64 pos = begin + header.str().size();
+  lm_states_ = new int32[lm_states_size_];
+  std::vector<int64> unigram_addresses(num_words_),
+      overflow_addresses(overflow_buffer_size_);
+  std::vector<float> codebooks(logprob_codebook_.size() +
+                               backoff_codebook_.size());
+  char *data[4] = {
+    reinterpret_cast<char*>(lm_states_),
+    reinterpret_cast<char*>(num_words_ == 0 ? NULL : &(unigram_addresses[0])),
+    reinterpret_cast<char*>(overflow_buffer_size_ == 0 ? NULL :
+                            &(overflow_addresses[0])),
+    reinterpret_cast<char*>(codebooks.empty() ? NULL : &(codebooks[0])) };
+  int64 sizes[4];
+  GetAlignedSectionSizes(sizes);
+  for (size_t i = 0; i < offsets.size(); i++) {
+    is.ignore(offsets[i] - pos);
+    if (sizes[i] != 0)
+      is.read(data[i], sizes[i]);
+    pos = offsets[i] + sizes[i];
+  }
+  if (!is.good())
+    KALDI_ERR << "Error reading ConstArpaLm (file truncated?)";
+  memory_assigned_ = true;
+  SetCodebooks(codebooks.empty() ? NULL : &(codebooks[0]));
+  SetPointersFromAddresses(num_words_ == 0 ? NULL : &(unigram_addresses[0]),
+                           overflow_buffer_size_ == 0 ? NULL :
+                           &(overflow_addresses[0]));
+}
+
+void ConstArpaLm::SetCodebooks(const float *codebooks) {
+  size_t num_logprob_codes = logprob_codebook_.size();
+  for (size_t i = 0; i < num_logprob_codes; i++)
+    logprob_codebook_[i] = codebooks[i];
+  for (size_t i = 0; i < backoff_codebook_.size(); i++)
+    backoff_codebook_[i] = codebooks[num_logprob_codes + i];
+}
+
+void ConstArpaLm::SetPointersFromAddresses(const int64 *unigram_addresses,
+                                           const int64 *overflow_addresses) {
+  // Check out how we compute the relative address in ConstArpaLm::Write().
+  unigram_states_ = new int32*[num_words_];
+  for (int32 i = 0; i < num_words_; ++i) {
+    int64 tmp_address = unigram_addresses[i];
+    if (tmp_address < 0 || tmp_address > lm_states_size_)
+      KALDI_ERR << "Bad unigram address reading ConstArpaLm.";
+    unigram_states_[i] =
+        (tmp_address == 0) ? NULL : lm_states_ + tmp_address - 1;
+  }
+  overflow_buffer_ = new int32*[overflow_buffer_size_];
+  for (int32 i = 0; i < overflow_buffer_size_; ++i) {
+    int64 tmp_address = overflow_addresses[i];
+    if (tmp_address < 0 || tmp_address > lm_states_size_)
+      KALDI_ERR << "Bad overflow address reading ConstArpaLm.";
+    overflow_buffer_[i] =
+        (tmp_address == 0) ? NULL : lm_states_ + tmp_address - 1;
+  }
+  KALDI_ASSERT(ngram_order_ > 0);
+  KALDI_ASSERT(bos_symbol_ < num_words_ && bos_symbol_ > 0);
+  KALDI_ASSERT(eos_symbol_ < num_words_ && eos_symbol_ > 0);
+  KALDI_ASSERT(unk_symbol_ < num_words_ &&
+               (unk_symbol_ > 0 || unk_symbol_ == -1));
+  lm_states_end_ = lm_states_ + lm_states_size_ - 1;
+  initialized_ = true;
+}
+
+bool ConstArpaLm::ReadMapped(const std::string &filename) {
+  KALDI_ASSERT(!initialized_);
+  if (!mapped_file_.Open(filename))
+    return false;
+  const char *data = mapped_file_.Data();
+  size_t file_size = mapped_file_.Size();
+  // The file should start with the Kaldi binary header "\0B" and then the
+  // token and its trailing space.
+  std::string token = "<ConstArpaLmAligned>";
+  if (file_size < token.size() + 3 || data[0] != '\0' || data[1] != 'B' ||
+      std::string(data + 2, token.size()) != token) {
+    KALDI_VLOG(1) << filename << " is not in the aligned ConstArpaLm format "
+                  << "(see WriteConstArpaLmAligned()); not mapping it.";
+    mapped_file_.Close();
+    return false;
+  }
+  // The header is much smaller than a page.
+  std::istringstream is(std::string(data + 2,
+                                    std::min<size_t>(file_size - 2,
+                                                     kPageSize)));
+  ExpectToken(is, true, token);
+  int32 version;
+  int64 begin;
+  std::vector<int64> offsets;
+  ReadAlignedHeader(is, &version, &begin, &offsets);
+  if (begin != 2) {
+    KALDI_WARN << "ConstArpaLm in " << filename << " was not written at the "
+               << "start of the file; cannot map it.";
+    mapped_file_.Close();
+    return false;
+  }
+  std::ostringstream header;
+  WriteAlignedHeader(header, version, begin, offsets);
+  int64 expected_size = ComputeAlignedOffsets(version, begin,
+                                              header.str().size(), &offsets);
+  if (static_cast<int64>(file_size) < expected_size)
+    KALDI_ERR << "Mapped ConstArpaLm " << filename << " has size "
+              << file_size << ", expected " << expected_size
+              << " (truncated?)";
+  lm_states_ = const_cast<int32*>(
+      reinterpret_cast<const int32*>(data + offsets[0]));
+  memory_assigned_ = true;
+  if (version >= 2)
+    SetCodebooks(reinterpret_cast<const float*>(data + offsets[3]));
+  SetPointersFromAddresses(reinterpret_cast<const int64*>(data + offsets[1]),
+                           reinterpret_cast<const int64*>(data + offsets[2]));
+  KALDI_VLOG(1) << "Mapped ConstArpaLm with " << lm_states_size_
+                << " LmState entries and " << num_words_ << " words from "
+                << filename;
+  return true;
+}
+
 bool ConstArpaLm::HistoryStateExists(const std::vector<int32>& hist) const {
   // We do not create LmState for empty word sequence, but technically it is the
   // history state of all unigrams.
@@ -760,8 +1471,9 @@ bool ConstArpaLm::HistoryStateExists(const std::vector<int32>& hist) const {
     // not NULL, we still have to check if it has child.
     KALDI_ASSERT(lm_state >= lm_states_);
     KALDI_ASSERT(lm_state + 2 <= lm_states_end_);
-    // <lm_state + 2> points to <num_children>.
-    if (*(lm_state + 2) > 0) {
+    // <lm_state + 2> points to <num_children>, and in the quantized case
+    // <lm_state + 1> to <num_leaf_children>.
+    if (*(lm_state + 2) > 0 || (quantize_bits_ != 0 && *(lm_state + 1) > 0)) {
       return true;
     } else {
       return false;
@@ -818,8 +1530,7 @@ float ConstArpaLm::GetNgramLogprobRecurse(
       // defined.
       return std::numeric_limits<float>::min();
     } else {
-      Int32AndFloat logprob_i(*unigram_states_[word]);
-      return logprob_i.f;
+      return StateLogprob(unigram_states_[word]);
     }
   }
 
@@ -834,8 +1545,7 @@ float ConstArpaLm::GetNgramLogprobRecurse(
       DecodeChildInfo(child_info, state, &child_lm_state, &logprob);
       return logprob;
     } else {
-      Int32AndFloat backoff_logprob_i(*(state + 1));
-      backoff_logprob = backoff_logprob_i.f;
+      backoff_logprob = StateBackoffLogprob(state);
     }
   }
   std::vector<int32> new_hist(hist);
@@ -883,8 +1593,6 @@ bool ConstArpaLm::GetChildInfo(const int32 word,
   int32 num_children = *(parent + 2);
   KALDI_ASSERT(parent + 2 + 2 * num_children <= lm_states_end_);
 
-  if (num_children == 0) return false;
-
   // A binary search into the children memory block.
   int32 start_index = 1;
   int32 end_index = num_children;
@@ -900,8 +1608,32 @@ bool ConstArpaLm::GetChildInfo(const int32 word,
       end_index = mid_index - 1;
     }
   }
+  if (quantize_bits_ == 0) return false;
+
+  // In the quantized case, a binary search into the leaf words.
+  int32 num_leaf_children = *(parent + 1);
+  const int32 *leaf_words = parent + 3 + 2 * num_children;
+  const int32 *leaf_words_end = leaf_words + num_leaf_children;
+  const int32 *iter = std::lower_bound(leaf_words, leaf_words_end, word);
+  if (iter == leaf_words_end || *iter != word) return false;
+  *child_info = GetLeafChildInfo(parent, iter - leaf_words);
+  return true;
+}
 
-  return false;
+int32 ConstArpaLm::GetLeafChildInfo(const int32* parent,
+                                    const int32 index) const {
+  KALDI_ASSERT(quantize_bits_ != 0);
+  int32 num_leaf_children = *(parent + 1), num_children = *(parent + 2);
+  KALDI_ASSERT(index >= 0 && index < num_leaf_children);
+  int32 codes_per_int32 = 32 / quantize_bits_;
+  const uint32 *codes = reinterpret_cast<const uint32*>(
+      parent + 3 + 2 * num_children + num_leaf_children);
+  KALDI_ASSERT(reinterpret_cast<const int32*>(codes) +
+               index / codes_per_int32 <= lm_states_end_);
+  uint32 code = (codes[index / codes_per_int32] >>
+                 ((index % codes_per_int32) * quantize_bits_)) &
+      ((1u << quantize_bits_) - 1);
+  return code * 2;
 }
 
 void ConstArpaLm::DecodeChildInfo(const int32 child_info,
@@ -914,22 +1646,24 @@ void ConstArpaLm::DecodeChildInfo(const int32 child_info,
   if (child_info % 2 == 0) {
     // Child is a leaf, only returns the log probability.
     *child_lm_state = NULL;
-    Int32AndFloat logprob_i(child_info);
-    *logprob = logprob_i.f;
+    if (quantize_bits_ == 0) {
+      Int32AndFloat logprob_i(child_info);
+      *logprob = logprob_i.f;
+    } else {
+      KALDI_ASSERT(child_info / 2 < logprob_codebook_.size());
+      *logprob = logprob_codebook_[child_info / 2];
+    }
   } else {
     int32 child_offset = child_info / 2;
     if (child_offset > 0) {
       *child_lm_state = parent + child_offset;
-      Int32AndFloat logprob_i(**child_lm_state);
-      *logprob = logprob_i.f;
     } else {
       KALDI_ASSERT(-child_offset < overflow_buffer_size_);
       *child_lm_state = overflow_buffer_[-child_offset];
-      Int32AndFloat logprob_i(**child_lm_state);
-      *logprob = logprob_i.f;
     }
     KALDI_ASSERT(*child_lm_state >= lm_states_);
     KALDI_ASSERT(*child_lm_state <= lm_states_end_);
+    *logprob = StateLogprob(*child_lm_state);
   }
 }
 
@@ -944,19 +1678,26 @@ void ConstArpaLm::WriteArpaRecurse(int32* lm_state,
   // Inserts the current LmState to <output>.
   ArpaLine arpa_line;
   arpa_line.words = seq;
-  Int32AndFloat logprob_i(*lm_state);
-  arpa_line.logprob = logprob_i.f;
-  Int32AndFloat backoff_logprob_i(*(lm_state + 1));
-  arpa_line.backoff_logprob = backoff_logprob_i.f;
+  arpa_line.logprob = StateLogprob(lm_state);
+  arpa_line.backoff_logprob = StateBackoffLogprob(lm_state);
   output->push_back(arpa_line);
 
-  // Scans for possible children, and recursively adds child to <output>.
-  int32 num_children = *(lm_state + 2);
-  KALDI_ASSERT(lm_state + 2 + 2 * num_children <= lm_states_end_);
-  for (int32 i = 0; i < num_children; ++i) {
+  // Scans for possible children, and recursively adds child to <output>. In
+  // the quantized case the leaf children come after the others.
+  int32 num_children = *(lm_state + 2),
+      num_leaf_children = (quantize_bits_ == 0 ? 0 : *(lm_state + 1));
+  KALDI_ASSERT(lm_state + 2 + 2 * num_children + num_leaf_children <=
+               lm_states_end_);
+  for (int32 i = 0; i < num_children + num_leaf_children; ++i) {
     std::vector<int32> new_seq(seq);
-    new_seq.push_back(*(lm_state + 3 + 2 * i));
-    int32 child_info = *(lm_state + 4 + 2 * i);
+    int32 child_info;
+    if (i < num_children) {
+      new_seq.push_back(*(lm_state + 3 + 2 * i));
+      child_info = *(lm_state + 4 + 2 * i);
+    } else {
+      new_seq.push_back(*(lm_state + 3 + num_children + i));
+      child_info = GetLeafChildInfo(lm_state, i - num_children);
+    }
     float logprob;
     int32* child_lm_state = NULL;
     DecodeChildInfo(child_info, lm_state, &child_lm_state, &logprob);
@@ -1035,8 +1776,86 @@ void ConstArpaLm::WriteArpa(std::ostream &os) const {
   os << std::endl << "\\end\\" << std::endl;
 }
 
+ConstArpaLmHistoryCache::ConstArpaLmHistoryCache(int64 max_entries,
+                                                 int32 num_shards) {
+  KALDI_ASSERT(max_entries > 0 && num_shards > 0);
+  shards_.resize(num_shards);
+  for (int32 i = 0; i < num_shards; ++i)
+    shards_[i] = new Shard();
+  max_entries_per_shard_ = std::max<int64>(1, max_entries / num_shards);
+}
+
+ConstArpaLmHistoryCache::~ConstArpaLmHistoryCache() {
+  DeletePointers(&shards_);
+}
+
+ConstArpaLmHistoryCache::Shard* ConstArpaLmHistoryCache::GetShard(
+    const std::vector<int32> &key) const {
+  // The low bits of the hash choose the bucket within the shard's map, so we
+  // use the high bits.
+  size_t hash = hasher_(key);
+  return shards_[(hash >> 16) % shards_.size()];
+}
+
+bool ConstArpaLmHistoryCache::Lookup(const std::vector<int32> &hist,
+                                     int32 word, float *logprob,
+                                     std::vector<int32> *next_hist) {
+  std::vector<int32> key(hist);
+  key.push_back(word);
+  Shard *shard = GetShard(key);
+  shard->mutex.Lock();
+  EntryMap::iterator iter = shard->entry_map.find(key);
+  bool found = (iter != shard->entry_map.end());
+  if (found) {
+    // Moves the entry to the front, as the most recently used.
+    shard->entries.splice(shard->entries.begin(), shard->entries,
+                          iter->second);
+    *logprob = iter->second->logprob;
+    *next_hist = iter->second->next_hist;
+    shard->num_hits++;
+  } else {
+    shard->num_misses++;
+  }
+  shard->mutex.Unlock();
+  return found;
+}
+
+void ConstArpaLmHistoryCache::Insert(const std::vector<int32> &hist,
+                                     int32 word, float logprob,
+                                     const std::vector<int32> &next_hist) {
+  Entry entry;
+  entry.key = hist;
+  entry.key.push_back(word);
+  entry.logprob = logprob;
+  entry.next_hist = next_hist;
+  Shard *shard = GetShard(entry.key);
+  shard->mutex.Lock();
+  // Another thread may have added it since we looked it up.
+  if (shard->entry_map.find(entry.key) == shard->entry_map.end()) {
+    shard->entries.push_front(entry);
+    shard->entry_map[entry.key] = shard->entries.begin();
+    if (shard->entries.size() > max_entries_per_shard_) {
+      shard->entry_map.erase(shard->entries.back().key);
+      shard->entries.pop_back();
+    }
+  }
+  shard->mutex.Unlock();
+}
+
+void ConstArpaLmHistoryCache::GetStats(int64 *num_hits, int64 *num_misses) {
+  *num_hits = 0;
+  *num_misses = 0;
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    shards_[i]->mutex.Lock();
+    *num_hits += shards_[i]->num_hits;
+    *num_misses += shards_[i]->num_misses;
+    shards_[i]->mutex.Unlock();
+  }
+}
+
 ConstArpaLmDeterministicFst::ConstArpaLmDeterministicFst(
-    const ConstArpaLm& lm) : lm_(lm) {
+    const ConstArpaLm& lm, ConstArpaLmHistoryCache *cache):
+    lm_(lm), cache_(cache) {
   // Creates a history state for <s>.
   std::vector<Label> bos_state(1, lm_.BosSymbol());
   state_to_wseq_.push_back(bos_state);
@@ -1048,7 +1867,13 @@ fst::StdArc::Weight ConstArpaLmDeterministicFst::Final(StateId s) {
   // At this point, we should have created the state.
   KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
   const std::vector<Label>& wseq = state_to_wseq_[s];
-  float logprob = lm_.GetNgramLogprob(lm_.EosSymbol(), wseq);
+  float logprob;
+  std::vector<Label> next_wseq;
+  if (cache_ == NULL || !cache_->Lookup(wseq, -1, &logprob, &next_wseq)) {
+    logprob = lm_.GetNgramLogprob(lm_.EosSymbol(), wseq);
+    if (cache_ != NULL)
+      cache_->Insert(wseq, -1, logprob, next_wseq);
+  }
   return Weight(-logprob);
 }
 
@@ -1056,25 +1881,35 @@ bool ConstArpaLmDeterministicFst::GetArc(StateId s,
                                          Label ilabel, fst::StdArc *oarc) {
   // At this point, we should have created the state.
   KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
-  std::vector<Label> wseq = state_to_wseq_[s];
-
-  float logprob = lm_.GetNgramLogprob(ilabel, wseq);
+  KALDI_ASSERT(ilabel >= 0);
+  std::vector<Label> wseq;
+  float logprob;
+  if (cache_ == NULL ||
+      !cache_->Lookup(state_to_wseq_[s], ilabel, &logprob, &wseq)) {
+    wseq = state_to_wseq_[s];
+    logprob = lm_.GetNgramLogprob(ilabel, wseq);
+    if (logprob != std::numeric_limits<float>::min()) {
+      // Locates the next state in ConstArpaLm. Note that OOV and backoff have
+      // been taken care of in ConstArpaLm.
+      wseq.push_back(ilabel);
+      while (wseq.size() >= lm_.NgramOrder()) {
+        // History state has at most lm_.NgramOrder() -1 words in the state.
+        wseq.erase(wseq.begin(), wseq.begin() + 1);
+      }
+      while (!lm_.HistoryStateExists(wseq)) {
+        KALDI_ASSERT(wseq.size() > 0);
+        wseq.erase(wseq.begin(), wseq.begin() + 1);
+      }
+    } else {
+      wseq.clear();
+    }
+    if (cache_ != NULL)
+      cache_->Insert(state_to_wseq_[s], ilabel, logprob, wseq);
+  }
   if (logprob == std::numeric_limits<float>::min()) {
     return false;
   }
 
-  // Locates the next state in ConstArpaLm. Note that OOV and backoff have been
-  // taken care of in ConstArpaLm.
-  wseq.push_back(ilabel);
-  while (wseq.size() >= lm_.NgramOrder()) {
-    // History state has at most lm_.NgramOrder() -1 words in the state.
-    wseq.erase(wseq.begin(), wseq.begin() + 1);
-  }
-  while (!lm_.HistoryStateExists(wseq)) {
-    KALDI_ASSERT(wseq.size() > 0);
-    wseq.erase(wseq.begin(), wseq.begin() + 1);
-  }
-
   std::pair<const std::vector<Label>, StateId> wseq_state_pair(
       wseq, static_cast<Label>(state_to_wseq_.size()));
 
@@ -1099,13 +1934,36 @@ bool ConstArpaLmDeterministicFst::GetArc(StateId s,
 bool BuildConstArpaLm(const bool natural_base, const int32 bos_symbol,
                       const int32 eos_symbol, const int32 unk_symbol,
                       const std::string& arpa_rxfilename,
-                      const std::string& const_arpa_wxfilename) {
+                      const std::string& const_arpa_wxfilename,
+                      bool aligned, int32 quantize_bits, int32 num_threads) {
   ConstArpaLmBuilder lm_builder(natural_base, bos_symbol,
-                                eos_symbol, unk_symbol);
+                                eos_symbol, unk_symbol, quantize_bits,
+                                num_threads);
   ReadKaldiObject(arpa_rxfilename, &lm_builder);
   lm_builder.Build();
-  WriteKaldiObject(lm_builder, const_arpa_wxfilename, true);
+  if (aligned || quantize_bits != 0) {
+    Output ko(const_arpa_wxfilename, true);
+    lm_builder.WriteAligned(ko.Stream());
+    ko.Close();
+  } else {
+    WriteKaldiObject(lm_builder, const_arpa_wxfilename, true);
+  }
   return true;
 }
 
+void WriteConstArpaLmAligned(const std::string &wxfilename,
+                             const ConstArpaLm &lm) {
+  Output ko(wxfilename, true);  // binary, with the Kaldi binary header.
+  lm.WriteAligned(ko.Stream());
+  ko.Close();
+}
+
+void ReadConstArpaLm(const std::string &rxfilename, bool use_mmap,
+                     ConstArpaLm *lm) {
+  if (use_mmap && ClassifyRxfilename(rxfilename) == kFileInput &&
+      lm->ReadMapped(rxfilename))
+    return;
+  ReadKaldiObject(rxfilename, lm);
+}
+
 }  // namespace kaldi
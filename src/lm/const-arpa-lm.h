@@ -20,12 +20,15 @@
 #ifndef KALDI_LM_CONST_ARPA_LM_H_
 #define KALDI_LM_CONST_ARPA_LM_H_
 
+#include <list>
 #include <string>
 #include <vector>
 
 #include "base/kaldi-common.h"
 #include "fstext/deterministic-fst.h"
+#include "thread/kaldi-mutex.h"
 #include "util/common-utils.h"
+#include "util/mapped-file.h"
 
 namespace kaldi {
 
@@ -52,20 +55,33 @@ class ConstArpaLm {
     overflow_buffer_ = NULL;
     memory_assigned_ = false;
     initialized_ = false;
+    quantize_bits_ = 0;
   }
 
   // Special constructor, will be used when you initialize ConstArpaLm from
-  // scratch through this constructor.
+  // scratch through this constructor.  If <quantize_bits> is nonzero (8 or
+  // 16), <lm_states> is in the quantized layout described above <lm_states_>
+  // and the codebooks give the values of the codes.
   ConstArpaLm(const int32 bos_symbol, const int32 eos_symbol,
               const int32 unk_symbol, const int32 ngram_order,
               const int32 num_words, const int32 overflow_buffer_size,
               const int32 lm_states_size, int32** unigram_states,
-              int32** overflow_buffer, int32* lm_states) :
+              int32** overflow_buffer, int32* lm_states,
+              const int32 quantize_bits = 0,
+              const std::vector<float> &logprob_codebook =
+              std::vector<float>(),
+              const std::vector<float> &backoff_codebook =
+              std::vector<float>()) :
       bos_symbol_(bos_symbol), eos_symbol_(eos_symbol),
       unk_symbol_(unk_symbol), ngram_order_(ngram_order),
       num_words_(num_words), overflow_buffer_size_(overflow_buffer_size),
       lm_states_size_(lm_states_size), unigram_states_(unigram_states),
-      overflow_buffer_(overflow_buffer), lm_states_(lm_states) {
+      overflow_buffer_(overflow_buffer), lm_states_(lm_states),
+      quantize_bits_(quantize_bits), logprob_codebook_(logprob_codebook),
+      backoff_codebook_(backoff_codebook) {
+    KALDI_ASSERT(quantize_bits_ == 0 || quantize_bits_ == 8 ||
+                 quantize_bits_ == 16);
+    KALDI_ASSERT(quantize_bits_ == 0 || !logprob_codebook_.empty());
     KALDI_ASSERT(unigram_states_ != NULL);
     KALDI_ASSERT(overflow_buffer_ != NULL);
     KALDI_ASSERT(lm_states_ != NULL);
@@ -81,18 +97,42 @@ class ConstArpaLm {
 
   ~ConstArpaLm() {
     if (memory_assigned_) {
-      delete[] lm_states_;
+      if (!mapped_file_.IsOpen())
+        delete[] lm_states_;
       delete[] unigram_states_;
       delete[] overflow_buffer_;
     }
   }
 
-  // Reads the ConstArpaLm format language model.
+  // Reads the ConstArpaLm format language model.  Accepts both the format
+  // written by Write() and that written by WriteAligned().
   void Read(std::istream &is, bool binary);
 
-  // Writes the language model in ConstArpaLm format.
+  // Writes the language model in ConstArpaLm format.  A quantized model (see
+  // QuantizeBits()) can only be written by WriteAligned(), so in that case
+  // this calls WriteAligned().
   void Write(std::ostream &os, bool binary) const;
 
+  // Writes the language model (binary only) in a versioned format in which the
+  // LmStates, unigram and overflow sections start at multiples of kPageSize
+  // bytes into the file, so that ReadMapped() can use the LmStates in place.
+  // For this to work the object must be the only thing in the file, written
+  // in binary mode with the Kaldi binary header, e.g. by
+  // WriteConstArpaLmAligned().  Read() also accepts this format.
+  void WriteAligned(std::ostream &os) const;
+
+  // Maps the ordinary file "filename", written by WriteConstArpaLmAligned(),
+  // into memory and uses the LmStates in place (only the unigram and overflow
+  // tables, which are small, are set up in memory), so loading takes almost
+  // no time and processes that map the same file share one copy of it.
+  // Returns false if the file is not in that format (e.g. it was written by
+  // Write()) or could not be mapped, in which case the calling code may want
+  // to fall back to Read().
+  bool ReadMapped(const std::string &filename);
+
+  // Returns true if the LmStates are memory-mapped from a file.
+  bool IsMapped() const { return mapped_file_.IsOpen(); }
+
   // Creates Arpa format language model from ConstArpaLm format, and writes it
   // to output stream. This will be useful in testing.
   void WriteArpa(std::ostream &os) const;
@@ -110,6 +150,10 @@ class ConstArpaLm {
   int32 UnkSymbol() const { return unk_symbol_; }
   int32 NgramOrder() const { return ngram_order_; }
 
+  // Returns the number of bits used for the codes of the log-probabilities and
+  // backoff weights (8 or 16), or 0 if the model is not quantized.
+  int32 QuantizeBits() const { return quantize_bits_; }
+
  private:
   // Loops up n-gram probability for given word sequence. Backoff is handled by
   // recursively calling this function.
@@ -125,25 +169,83 @@ class ConstArpaLm {
   int32* GetLmState(const std::vector<int32>& seq) const;
 
   // Given a pointer to the parent, find the child_info that corresponds to
-  // given word. The parent has the following structure:
-  // struct LmState {
-  //   float logprob;
-  //   float backoff_logprob;
-  //   int32 num_children;
-  //   std::pair<int32, int32> [] children;
-  // }
+  // given word. The parent has the structure described above <lm_states_>.
   // It returns false if the child is not found.
   bool GetChildInfo(const int32 word, int32* parent, int32* child_info) const;
 
+  // Returns the child_info of the leaf child with index <index> of a state in
+  // the quantized layout, which is twice its logprob code.
+  int32 GetLeafChildInfo(const int32* parent, const int32 index) const;
+
   // Decodes <child_info> to get log probability and child LmState. In the leaf
   // case, only <logprob> will be returned, and <child_address> will be NULL.
   void DecodeChildInfo(const int32 child_info, int32* parent,
                        int32** child_lm_state, float* logprob) const;
 
+  // Returns the log probability and backoff log probability stored in the
+  // LmState <lm_state>, in either layout.
+  inline float StateLogprob(const int32* lm_state) const {
+    if (quantize_bits_ == 0) {
+      Int32AndFloat logprob_i(lm_state[0]);
+      return logprob_i.f;
+    }
+    return logprob_codebook_[lm_state[0] & 0xFFFF];
+  }
+  inline float StateBackoffLogprob(const int32* lm_state) const {
+    if (quantize_bits_ == 0) {
+      Int32AndFloat backoff_logprob_i(lm_state[1]);
+      return backoff_logprob_i.f;
+    }
+    return backoff_codebook_[static_cast<uint32>(lm_state[0]) >> 16];
+  }
+
   void WriteArpaRecurse(int32* lm_state,
                         const std::vector<int32>& seq,
                         std::vector<ArpaLine> *output) const;
 
+  // The alignment of the sections in the format written by WriteAligned().
+  static const int32 kPageSize = 4096;
+
+  // The version of the format written by WriteAligned().  Version 1 had no
+  // quantization info and no codebook section; we can still read it.
+  static const int32 kAlignedFormatVersion = 2;
+
+  // Writes the header of version <version> of the format written by
+  // WriteAligned(), where "begin" is the position of the header in the file
+  // and "offsets" the positions in the file of the sections (three for
+  // version 1, four after that).
+  void WriteAlignedHeader(std::ostream &os, int32 version, int64 begin,
+                          const std::vector<int64> &offsets) const;
+
+  // Reads the header written by WriteAlignedHeader(), after its first token,
+  // setting up the sizes, the symbols and the quantization info (but not the
+  // codebook contents), and outputs "version", "begin" and "offsets".
+  void ReadAlignedHeader(std::istream &is, int32 *version, int64 *begin,
+                         std::vector<int64> *offsets);
+
+  // Outputs the sizes in bytes of the four sections written by
+  // WriteAligned().
+  void GetAlignedSectionSizes(int64 *sizes) const;
+
+  // Works out the positions of the sections written by WriteAligned() given
+  // the format version, the position of the header in the file and its size.
+  // Returns the size of the file.
+  int64 ComputeAlignedOffsets(int32 version, int64 begin, int64 header_size,
+                              std::vector<int64> *offsets) const;
+
+  // Reads the rest of the format written by WriteAligned(), after the first
+  // token, into memory.
+  void ReadAligned(std::istream &is);
+
+  // Copies the codebook section (the logprob codebook, then the backoff one)
+  // into the codebooks, which have already been sized by ReadAlignedHeader().
+  void SetCodebooks(const float *codebooks);
+
+  // Sets up unigram_states_ and overflow_buffer_ from the relative addresses
+  // stored on disk, and checks the symbols.  Called after reading lm_states_.
+  void SetPointersFromAddresses(const int64 *unigram_addresses,
+                                const int64 *overflow_addresses);
+
   // We assign memory in Read(). If it is called, we have to release memory in
   // the destructor.
   bool memory_assigned_;
@@ -204,7 +306,96 @@ class ConstArpaLm {
   // bytes, therefore one LmState will occupy the following number of bytes:
   //
   // x = 1 + 1 + 1 + 2 * children.size() = 3 + 2 * children.size()
+  //
+  // If the model is quantized (<quantize_bits_> is 8 or 16), the log
+  // probabilities are replaced by codes into <logprob_codebook_> and
+  // <backoff_codebook_>, and the children that are leaves (which have no
+  // LmState of their own) are stored without a child_info:
+  //
+  // struct LmState {
+  //   int32 codes;  // logprob code in the low 16 bits, backoff code above.
+  //   int32 num_leaf_children;
+  //   int32 num_children;  // the non-leaf ones, as above.
+  //   std::pair<int32, int32> [] children;
+  //   int32 [] leaf_children;  // sorted words.
+  //   int32 [] leaf_codes;  // logprob codes, 32 / quantize_bits_ per int32.
+  // }
+  //
+  // so a leaf n-gram takes 4 + quantize_bits_ / 8 bytes instead of 8.
+  //
+  // If the model was loaded by ReadMapped(), this points into mapped_file_
+  // (and the memory must not be modified).
   int32* lm_states_;
+
+  // Number of bits of the codes in a quantized model (8 or 16), or 0.
+  int32 quantize_bits_;
+
+  // The values of the logprob and backoff codes of a quantized model; empty
+  // if it is not quantized.
+  std::vector<float> logprob_codebook_;
+  std::vector<float> backoff_codebook_;
+
+  MappedFile mapped_file_;
+};
+
+/**
+ This class caches, for a ConstArpaLm, the result of looking up a word in a
+ history (the word sequence of a state of ConstArpaLmDeterministicFst): the
+ log probability and the history of the next state.  The same histories come
+ up again and again in the lattices of a batch, and this saves the n-gram
+ lookups with their backoff, which go through the ConstArpaLm trie.
+
+ It is meant to be shared by the ConstArpaLmDeterministicFst objects of all the
+ lattices and all the threads.  It holds at most about <max_entries> entries,
+ discarding the least recently used ones; it is divided into <num_shards>
+ parts, chosen by the hash of the history and word, each with its own lock so
+ that threads rarely wait for each other.
+ */
+class ConstArpaLmHistoryCache {
+ public:
+  explicit ConstArpaLmHistoryCache(int64 max_entries = 1000000,
+                                   int32 num_shards = 64);
+
+  ~ConstArpaLmHistoryCache();
+
+  // Looks up word <word> in history <hist>; <word> == -1 means the final
+  // probability (</s>), which has no next history.  Returns false if it is
+  // not in the cache.
+  bool Lookup(const std::vector<int32> &hist, int32 word, float *logprob,
+              std::vector<int32> *next_hist);
+
+  // Adds the result of looking up <word> in <hist>; see Lookup().
+  void Insert(const std::vector<int32> &hist, int32 word, float logprob,
+              const std::vector<int32> &next_hist);
+
+  // Outputs the number of Lookup() calls that succeeded and failed so far.
+  void GetStats(int64 *num_hits, int64 *num_misses);
+
+ private:
+  struct Entry {
+    std::vector<int32> key;  // the history followed by the word.
+    float logprob;
+    std::vector<int32> next_hist;
+  };
+  typedef std::list<Entry> EntryList;
+  typedef unordered_map<std::vector<int32>, EntryList::iterator,
+                        VectorHasher<int32> > EntryMap;
+  // A part of the cache; the front of <entries> is the most recently used.
+  struct Shard {
+    Mutex mutex;
+    EntryList entries;
+    EntryMap entry_map;
+    int64 num_hits;
+    int64 num_misses;
+    Shard(): num_hits(0), num_misses(0) { }
+  };
+
+  Shard *GetShard(const std::vector<int32> &key) const;
+
+  VectorHasher<int32> hasher_;
+  std::vector<Shard*> shards_;
+  size_t max_entries_per_shard_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(ConstArpaLmHistoryCache);
 };
 
 /**
@@ -218,7 +409,11 @@ class ConstArpaLmDeterministicFst
   typedef fst::StdArc::StateId StateId;
   typedef fst::StdArc::Label Label;
 
-  explicit ConstArpaLmDeterministicFst(const ConstArpaLm& lm);
+  // If <cache> is not NULL, the n-gram lookups go through it (see
+  // ConstArpaLmHistoryCache); it is not owned here and may be shared with
+  // other objects, including ones in other threads.
+  explicit ConstArpaLmDeterministicFst(const ConstArpaLm& lm,
+                                       ConstArpaLmHistoryCache *cache = NULL);
 
   // We cannot use "const" because the pure virtual function in the interface is
   // not const.
@@ -237,15 +432,39 @@ class ConstArpaLmDeterministicFst
   MapType wseq_to_state_;
   std::vector<std::vector<Label> > state_to_wseq_;
   const ConstArpaLm& lm_;
+  ConstArpaLmHistoryCache *cache_;
 };
 
 // Reads in an Arpa format language model and converts it into ConstArpaLm
 // format. We assume that the words in the input Arpa format language model have
 // been converted into integers.
+//
+// If <aligned> is true, it writes the format that can be memory-mapped (see
+// ConstArpaLm::WriteAligned()).  If <quantize_bits> is 8 or 16, the log
+// probabilities and backoff weights are quantized to codes of that many bits
+// (see ConstArpaLm::QuantizeBits()), which implies the aligned format, and
+// the quantization error is logged.  With <num_threads> more than one, the
+// n-gram lines are parsed, and the ConstArpaLm is filled in, in parallel; the
+// output does not depend on <num_threads>.
 bool BuildConstArpaLm(const bool natural_base, const int32 bos_symbol,
                       const int32 eos_symbol, const int32 unk_symbol,
                       const std::string& arpa_rxfilename,
-                      const std::string& const_arpa_wxfilename);
+                      const std::string& const_arpa_wxfilename,
+                      bool aligned = false, int32 quantize_bits = 0,
+                      int32 num_threads = 1);
+
+// Writes <lm> to <wxfilename> in the format written by
+// ConstArpaLm::WriteAligned(), with the Kaldi binary header.
+void WriteConstArpaLmAligned(const std::string &wxfilename,
+                             const ConstArpaLm &lm);
+
+// Reads a ConstArpaLm format language model from <rxfilename>.  If <use_mmap>
+// is true and <rxfilename> is an ordinary file written by
+// WriteConstArpaLmAligned(), it is memory-mapped (see
+// ConstArpaLm::ReadMapped()); otherwise it is read into memory, as by
+// ReadKaldiObject().
+void ReadConstArpaLm(const std::string &rxfilename, bool use_mmap,
+                     ConstArpaLm *lm);
 
 }  // namespace kaldi
 
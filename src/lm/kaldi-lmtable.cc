@@ -25,6 +25,7 @@
 
 #include "lm/kaldi-lmtable.h"
 #include "base/kaldi-common.h"
+#include "thread/kaldi-thread.h"
 #include <sstream>
 
 namespace kaldi {
@@ -165,6 +166,178 @@ void LmFstConverter::AddArcsForNgramProb(
 
 #ifndef HAVE_IRSTLM
 
+// An n-gram line of an ARPA file, as parsed by ArpaNgramParser.
+struct ArpaFstNgram {
+  std::vector<string> ngramString;  // words, in reverse order from index 1
+  float prob, bow;
+  bool skip;  // if true, ignore this line ("message" says why, if not empty)
+  string error;  // if not empty, the line was bad and this says why
+  string message;
+};
+
+// The number of n-gram lines we parse at a time.
+static const size_t kArpaNgramBlockSize = 100000;
+
+// Parses a block of ARPA n-gram lines; with MultiThreader, each thread does a
+// contiguous range of them.
+class ArpaNgramParser: public MultiThreadable {
+ public:
+  ArpaNgramParser(int ngram_order, int max_ngram_order,
+                  const std::vector<string> &lines,
+                  std::vector<ArpaFstNgram> *ngrams):
+      ngram_order_(ngram_order), max_ngram_order_(max_ngram_order),
+      lines_(&lines), ngrams_(ngrams) { }
+
+  void operator() () {
+    size_t begin = (lines_->size() * thread_id_) / num_threads_,
+        end = (lines_->size() * (thread_id_ + 1)) / num_threads_;
+    for (size_t i = begin; i < end; i++)
+      Parse((*lines_)[i], &((*ngrams_)[i]));
+  }
+
+ private:
+  // parse ngram line: first field = prob, other fields = words,
+  // last field = backoff (optional)
+  void Parse(const string &inpline, ArpaFstNgram *ngram) const {
+    int ngram_order = ngram_order_;
+    std::vector<string> &ngramString = ngram->ngramString;
+    ngram->skip = false;
+    ngram->error.clear();
+    ngram->message.clear();
+    std::ostringstream error;
+
+    // eat up space.
+    const char *cur_cstr = inpline.c_str();
+    while (*cur_cstr && isspace(*cur_cstr))
+      cur_cstr++;
+
+    if (*cur_cstr == '\0') { // Ignore empty lines.
+      ngram->skip = true;
+      return;
+    }
+    char *next_cstr;
+    // found, parse probability from first field
+    ngram->prob = KALDI_STRTOF(cur_cstr, &next_cstr);
+    if (ngram->prob != ngram->prob || ngram->prob - ngram->prob != 0) {
+      error << "nan or inf detected in LM file [parsing " << (ngram_order)
+            << "-grams]: " << inpline;
+      ngram->error = error.str();
+      return;
+    }
+    if (next_cstr == cur_cstr) {
+      error << "Bad line in LM file [parsing "<<(ngram_order)<<"-grams]: "
+            << inpline;
+      ngram->error = error.str();
+      return;
+    }
+    cur_cstr = next_cstr;
+    while (*cur_cstr && isspace(*cur_cstr))
+      cur_cstr++;
+
+    // Parse the words; they go into ngramString in reverse order, from
+    // index 1.
+    ngramString.resize(ngram_order + 1);
+
+    for (int i = 0; i < ngram_order; i++) {
+      if (*cur_cstr == '\0') {
+        error << "Bad line in LM file [parsing "<<(ngram_order)<<"-grams]: "
+              << inpline;
+        ngram->error = error.str();
+        return;
+      }
+
+      const char *end_cstr = strpbrk(cur_cstr, " \t\r");
+      std::string this_word;
+      if (end_cstr == NULL) {
+        this_word = std::string(cur_cstr);
+        cur_cstr += strlen(cur_cstr);
+      } else {
+        this_word = std::string(cur_cstr, end_cstr-cur_cstr);
+        cur_cstr = end_cstr;
+        while (*cur_cstr && isspace(*cur_cstr))
+          cur_cstr++;
+      }
+
+      // We don't allow <s> to be in the middle of the n-gram, or </s> to be
+      // in the middle of the n-gram.
+      if ((ngram_order > 1 && i != 0 && this_word == "<s>") ||
+          (ngram_order > 1 && i != ngram_order - 1 && this_word == "</s>")) {
+        ngram->skip = true;
+        ngram->message = "<s> is not at the beginning of the n-gram, or </s> "
+            "is not at the end of the n-gram, skipping it: " + inpline;
+        return;
+      }
+
+      ngramString[ngram_order - i].swap(this_word);
+    }
+
+    ngram->bow = 0;
+    if (ngram_order < max_ngram_order_) {
+      // try converting anything left in the line to a backoff weight
+      if (*cur_cstr != '\0') {
+        char *end_cstr;
+        ngram->bow = KALDI_STRTOF(cur_cstr, &end_cstr);
+        if (ngram->bow != ngram->bow || ngram->bow - ngram->bow != 0) {
+          error << "nan or inf detected in LM file [parsing " << (ngram_order)
+                << "-grams]: " << inpline;
+        } else if (end_cstr != cur_cstr) {  // got something.
+          while (*end_cstr != '\0' && isspace(*end_cstr))
+            end_cstr++;
+          if (*end_cstr != '\0')
+            error << "Junk " << (end_cstr) << " at end of line [parsing "
+                  << (ngram_order) << "-grams]" << inpline;
+        } else {
+          error << "Junk " << (cur_cstr) << " at end of line [parsing "
+                << (ngram_order) << "-grams]" << inpline;
+        }
+        ngram->error = error.str();
+      }
+    }
+  }
+
+  int ngram_order_;
+  int max_ngram_order_;
+  const std::vector<string> *lines_;
+  std::vector<ArpaFstNgram> *ngrams_;
+};
+
+// Parses the n-gram lines in "lines" with g_num_threads threads, while this
+// thread adds to the FST the arcs for the n-grams in "ngrams" (the previous
+// block, or empty); it then puts the parsed n-grams into "ngrams" and clears
+// "lines".  Adding the arcs has to be done serially and in order, but this
+// way it overlaps with the parsing, which is the slow part.
+static void ProcessArpaNgramBlock(int ngram_order, int max_ngram_order,
+                                  const string &startSent,
+                                  const string &endSent,
+                                  LmFstConverter *conv,
+                                  fst::StdVectorFst *fst,
+                                  std::vector<string> *lines,
+                                  std::vector<ArpaFstNgram> *ngrams) {
+  std::vector<ArpaFstNgram> parsed(lines->size());
+  {
+    ArpaNgramParser parser(ngram_order, max_ngram_order, *lines, &parsed);
+    // With zero threads MultiThreader parses in this thread, in the
+    // constructor; the destructor waits for the threads to finish.
+    MultiThreader<ArpaNgramParser> m(g_num_threads > 1 ? g_num_threads : 0,
+                                     parser);
+    for (size_t i = 0; i < ngrams->size(); i++) {
+      ArpaFstNgram &ngram = (*ngrams)[i];
+      if (!ngram.error.empty())
+        KALDI_ERR << ngram.error;
+      if (ngram.skip) {
+        if (!ngram.message.empty())
+          KALDI_WARN << ngram.message;
+        continue;
+      }
+      conv->AddArcsForNgramProb(ngram_order, max_ngram_order, ngram.prob,
+                                ngram.bow, ngram.ngramString, fst,
+                                startSent, endSent);
+    }
+  }
+  ngrams->swap(parsed);
+  lines->clear();
+}
+
 bool LmTable::ReadFstFromLmFile(std::istream &istrm,
                                 fst::StdVectorFst *fst,
                                 bool useNaturalOpt,
@@ -230,102 +403,26 @@ bool LmTable::ReadFstFromLmFile(std::istream &istrm,
     ngram_order = atoi(inpline.substr(pos1+1, pos2-(pos1+1)).c_str());
     cerr << "Processing " << ngram_order << "-grams" << endl;
 
-    // process individual n-grams
+    // process individual n-grams, in blocks of kArpaNgramBlockSize lines;
+    // see ProcessArpaNgramBlock()
+    std::vector<string> lines;
+    std::vector<ArpaFstNgram> ngrams;
     while (getline(istrm, inpline) && !istrm.eof()) {
       // break out of inner loop if another section is found
       if (!inpline.empty() && inpline[0] == '\\') {
         if (inpline.find("-grams:") != string::npos) break;
         if (inpline.find("\\end\\") != string::npos) break;
       }
-      // parse ngram line: first field = prob, other fields = words,
-      // last field = backoff (optional)
-      std::vector<string> ngramString;
-      float prob, bow;
-
-      // eat up space.
-      const char *cur_cstr = inpline.c_str();
-      while (*cur_cstr && isspace(*cur_cstr))
-        cur_cstr++;
-
-      if (*cur_cstr == '\0') // Ignore empty lines.
-        continue;
-      char *next_cstr;
-      // found, parse probability from first field
-      prob = KALDI_STRTOF(cur_cstr, &next_cstr);
-      if (prob != prob || prob - prob != 0) {
-        KALDI_ERR << "nan or inf detected in LM file [parsing " << (ngram_order)
-            << "-grams]: " << inpline;
-      }
-      if (next_cstr == cur_cstr)
-        KALDI_ERR << "Bad line in LM file [parsing "<<(ngram_order)<<"-grams]: "<<inpline;
-      cur_cstr = next_cstr;
-      while (*cur_cstr && isspace(*cur_cstr))
-        cur_cstr++;
-
-      // element 0 will be empty, element 1 will be the current word,
-      // element 2 will be the immediately preceding word, and so on.
-      // Apparently an IRSTLM convention.
-      ngramString.resize(ngram_order + 1);
-      
-      bool illegal_bos_or_eos = false;
-      for (int i = 0; i < ngram_order; i++) {
-        if (*cur_cstr == '\0')
-          KALDI_ERR << "Bad line in LM file [parsing "<<(ngram_order)<<"-grams]: "<<inpline;
-
-        const char *end_cstr = strpbrk(cur_cstr, " \t\r");
-        std::string this_word;
-        if (end_cstr == NULL) {
-          this_word = std::string(cur_cstr);
-          cur_cstr += strlen(cur_cstr);
-        } else {
-          this_word = std::string(cur_cstr, end_cstr-cur_cstr);
-          cur_cstr = end_cstr;
-          while (*cur_cstr && isspace(*cur_cstr))
-            cur_cstr++;
-        }
-
-        // Checks if <s> only appears at the beginning of the ngram, and if </s>
-        // only appears at the end of the ngram.
-        if ((ngram_order > 1 && i != 0 && this_word == "<s>") ||
-            (ngram_order > 1 && i != ngram_order - 1 && this_word == "</s>")) {
-          illegal_bos_or_eos = true;
-          break;
-        }
-
-        ngramString[ngram_order - i].swap(this_word);
-      }
-      if (illegal_bos_or_eos) {
-        KALDI_WARN << "<s> is not at the beginning of the n-gram, or </s> is "
-            << "not at the end of the n-gram, skipping it: " << inpline;
-        continue;
-      }
-
-      bow = 0;
-      if (ngram_order < max_ngram_order) {
-        // try converting anything left in the line to a backoff weight
-        if (*cur_cstr != '\0') {
-          char *end_cstr;
-          bow = KALDI_STRTOF(cur_cstr, &end_cstr);
-          if (bow != bow || bow - bow != 0) {
-            KALDI_ERR << "nan or inf detected in LM file [parsing " << (ngram_order)
-                << "-grams]: " << inpline;
-          }
-          if (end_cstr != cur_cstr) {  // got something.
-            while (*end_cstr != '\0' && isspace(*end_cstr))
-              end_cstr++;
-            if (*end_cstr != '\0')
-              KALDI_ERR << "Junk " << (end_cstr) << " at end of line [parsing "
-                        << (ngram_order) << "-grams]" << inpline;
-          } else {
-            KALDI_ERR << "Junk " << (cur_cstr) << " at end of line [parsing "
-                      << (ngram_order) << "-grams]" << inpline;
-          }
-        }
-      }
-      conv_->AddArcsForNgramProb(ngram_order, max_ngram_order, prob, bow,
-                                 ngramString, fst,
-                                 startSent, endSent);
+      lines.push_back(inpline);
+      if (lines.size() == kArpaNgramBlockSize)
+        ProcessArpaNgramBlock(ngram_order, max_ngram_order, startSent, endSent,
+                              conv_, fst, &lines, &ngrams);
     }  // end of loop on individual n-gram lines
+    // add the arcs for the last two blocks
+    ProcessArpaNgramBlock(ngram_order, max_ngram_order, startSent, endSent,
+                          conv_, fst, &lines, &ngrams);
+    ProcessArpaNgramBlock(ngram_order, max_ngram_order, startSent, endSent,
+                          conv_, fst, &lines, &ngrams);
   }
 
   conv_->ConnectUnusedStates(fst);
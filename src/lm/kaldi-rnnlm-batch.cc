@@ -0,0 +1,520 @@
+// lm/kaldi-rnnlm-batch.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+
+#include "lm/kaldi-rnnlm-batch.h"
+#include "cudamatrix/cu-array.h"
+#include "cudamatrix/cu-vector.h"
+
+namespace kaldi {
+
+// The log-prob CRnnLM gives to words for which it has no index.
+static const BaseFloat kRnnlmOovLogProb = -16.118;
+
+CuRnnlm::CuRnnlm(KaldiRnnlmWrapper *wrapper) {
+  KALDI_ASSERT(wrapper != NULL);
+  rnnlm::CRnnLM &rnnlm = wrapper->rnnlm_;
+  int32 vocab_size = rnnlm.vocab_size,
+      num_classes = rnnlm.class_size,
+      layer0_size = rnnlm.layer0_size,
+      hidden_dim = rnnlm.layer1_size,
+      compression_dim = rnnlm.layerc_size,
+      output_input_dim = (compression_dim > 0 ? compression_dim : hidden_dim);
+  KALDI_ASSERT(layer0_size == vocab_size + hidden_dim &&
+               rnnlm.layer2_size == vocab_size + num_classes);
+
+  // The weights are stored as in CRnnLM::matrixXvector(): element (b, a) of
+  // the matrix from layer x to layer y is at [a + b * size of x].
+  Matrix<BaseFloat> word_input(vocab_size, hidden_dim),
+      recurrent(hidden_dim, hidden_dim);
+  for (int32 b = 0; b < hidden_dim; b++) {
+    const rnnlm::synapse *row = rnnlm.syn0 + b * layer0_size;
+    for (int32 w = 0; w < vocab_size; w++)
+      word_input(w, b) = row[w].weight;
+    for (int32 a = 0; a < hidden_dim; a++)
+      recurrent(b, a) = row[vocab_size + a].weight;
+  }
+  word_input_weights_.Swap(&word_input);
+  recurrent_weights_.Swap(&recurrent);
+
+  const rnnlm::synapse *output = rnnlm.syn1;
+  if (compression_dim > 0) {
+    Matrix<BaseFloat> compression(compression_dim, hidden_dim);
+    for (int32 c = 0; c < compression_dim; c++)
+      for (int32 a = 0; a < hidden_dim; a++)
+        compression(c, a) = rnnlm.syn1[a + c * hidden_dim].weight;
+    compression_weights_.Swap(&compression);
+    output = rnnlm.sync;
+  }
+  Matrix<BaseFloat> word_weights(vocab_size, output_input_dim),
+      class_weights(num_classes, output_input_dim);
+  for (int32 w = 0; w < vocab_size; w++)
+    for (int32 a = 0; a < output_input_dim; a++)
+      word_weights(w, a) = output[a + w * output_input_dim].weight;
+  for (int32 c = 0; c < num_classes; c++)
+    for (int32 a = 0; a < output_input_dim; a++)
+      class_weights(c, a) =
+          output[a + (vocab_size + c) * output_input_dim].weight;
+  word_weights_.Swap(&word_weights);
+  class_weights_.Swap(&class_weights);
+
+  word_class_.resize(vocab_size);
+  for (int32 w = 0; w < vocab_size; w++)
+    word_class_[w] = rnnlm.vocab[w].class_index;
+  class_begin_.resize(num_classes);
+  class_size_.resize(num_classes);
+  for (int32 c = 0; c < num_classes; c++) {
+    class_size_[c] = rnnlm.class_cn[c];
+    class_begin_[c] = (class_size_[c] > 0 ? rnnlm.class_words[c][0] : 0);
+    // CRnnLM::computeNet() also relies on this.
+    for (int32 i = 0; i < class_size_[c]; i++)
+      KALDI_ASSERT(rnnlm.class_words[c][i] == class_begin_[c] + i);
+  }
+
+  // Maps the words as CRnnLM::computeConditionalLogprob() does.
+  const std::vector<std::string> &label_to_word = wrapper->label_to_word_;
+  int32 unk_index = rnnlm.searchVocab(rnnlm.unk_sym.c_str());
+  label_to_index_.resize(label_to_word.size());
+  label_to_penalty_.resize(label_to_word.size(), 0.0);
+  for (size_t i = 0; i < label_to_word.size(); i++) {
+    const std::string &word = label_to_word[i];
+    int32 index = rnnlm.searchVocab(word.c_str());
+    if (index == -1 || word == rnnlm.unk_sym) {
+      index = unk_index;
+      label_to_penalty_[i] = rnnlm.getUnkPenalty(word);
+    }
+    label_to_index_[i] = index;
+  }
+  eos_ = wrapper->GetEos();
+
+  direct_size_ = rnnlm.direct_size;
+  direct_order_ = rnnlm.direct_order;
+  direct_weights_ = (direct_size_ > 0 ? rnnlm.syn_d : NULL);
+  KALDI_ASSERT(direct_order_ <= rnnlm::MAX_NGRAM_ORDER);
+}
+
+int32 CuRnnlm::WordIndex(int32 label) const {
+  KALDI_ASSERT(label >= 0 &&
+               static_cast<size_t>(label) < label_to_index_.size());
+  return label_to_index_[label];
+}
+
+int32 CuRnnlm::GetInitialContext(VectorBase<BaseFloat> *context) const {
+  KALDI_ASSERT(context->Dim() == HiddenDim());
+  context->Set(1.0);
+  return 0;
+}
+
+void CuRnnlm::ClampAndSigmoid(CuMatrixBase<BaseFloat> *mat) {
+  mat->ApplyFloor(-50.0);
+  mat->ApplyCeiling(50.0);
+  mat->Sigmoid(*mat);
+}
+
+void CuRnnlm::ClampAndLogSoftmax(VectorBase<BaseFloat> *vec) {
+  vec->ApplyFloor(-50.0);
+  vec->ApplyCeiling(50.0);
+  vec->ApplyLogSoftMax();
+}
+
+void CuRnnlm::ComputeHidden(const CuMatrixBase<BaseFloat> &context,
+                            const std::vector<int32> &prev_words,
+                            CuMatrix<BaseFloat> *hidden) const {
+  KALDI_ASSERT(context.NumCols() == HiddenDim() &&
+               static_cast<size_t>(context.NumRows()) == prev_words.size());
+  hidden->Resize(context.NumRows(), HiddenDim(), kUndefined);
+  if (context.NumRows() == 0) return;
+  // CopyRows() sets the rows with index -1 to zero.
+  CuArray<MatrixIndexT> indexes(prev_words);
+  hidden->CopyRows(word_input_weights_, indexes);
+  hidden->AddMatMat(1.0, context, kNoTrans, recurrent_weights_, kTrans, 1.0);
+  ClampAndSigmoid(hidden);
+}
+
+void CuRnnlm::GetHistoryIndexes(const std::vector<int32> &history,
+                                std::vector<int32> *indexes) const {
+  indexes->clear();
+  indexes->resize(rnnlm::MAX_NGRAM_ORDER, 0);
+  for (size_t i = 0; i < history.size() && i < indexes->size(); i++)
+    (*indexes)[i] = WordIndex(history[history.size() - 1 - i]);
+}
+
+void CuRnnlm::AddDirectClassFeatures(const std::vector<int32> &history,
+                                     VectorBase<BaseFloat> *class_act) const {
+  if (direct_weights_ == NULL) return;
+  // This follows CRnnLM::computeNet().
+  unsigned long long hash[rnnlm::MAX_NGRAM_ORDER];
+  for (int32 a = 0; a < direct_order_; a++) hash[a] = 0;
+  for (int32 a = 0; a < direct_order_; a++) {
+    if (a > 0 && history[a - 1] == -1) break;
+    hash[a] = rnnlm::PRIMES[0] * rnnlm::PRIMES[1];
+    for (int32 b = 1; b <= a; b++)
+      hash[a] += rnnlm::PRIMES[(a * rnnlm::PRIMES[b] + b) % rnnlm::PRIMES_SIZE]
+          * (unsigned long long)(history[b - 1] + 1);
+    hash[a] = hash[a] % (direct_size_ / 2);
+  }
+  for (int32 c = 0; c < class_act->Dim(); c++) {
+    double sum = 0.0;
+    for (int32 b = 0; b < direct_order_ && hash[b] != 0; b++) {
+      sum += direct_weights_[hash[b]];
+      hash[b]++;
+    }
+    (*class_act)(c) += sum;
+  }
+}
+
+void CuRnnlm::AddDirectWordFeatures(const std::vector<int32> &history,
+                                    int32 c,
+                                    VectorBase<BaseFloat> *word_act) const {
+  if (direct_weights_ == NULL) return;
+  unsigned long long hash[rnnlm::MAX_NGRAM_ORDER];
+  for (int32 a = 0; a < direct_order_; a++) hash[a] = 0;
+  for (int32 a = 0; a < direct_order_; a++) {
+    if (a > 0 && history[a - 1] == -1) break;
+    hash[a] = rnnlm::PRIMES[0] * rnnlm::PRIMES[1] *
+        (unsigned long long)(c + 1);
+    for (int32 b = 1; b <= a; b++)
+      hash[a] += rnnlm::PRIMES[(a * rnnlm::PRIMES[b] + b) % rnnlm::PRIMES_SIZE]
+          * (unsigned long long)(history[b - 1] + 1);
+    hash[a] = (hash[a] % (direct_size_ / 2)) + direct_size_ / 2;
+  }
+  for (int32 w = 0; w < word_act->Dim(); w++) {
+    double sum = 0.0;
+    for (int32 b = 0; b < direct_order_ && hash[b] != 0; b++) {
+      sum += direct_weights_[hash[b]];
+      hash[b] = (hash[b] + 1) % direct_size_;
+    }
+    (*word_act)(w) += sum;
+  }
+}
+
+void CuRnnlm::ComputeLogProbs(
+    const CuMatrixBase<BaseFloat> &hidden,
+    const std::vector<const std::vector<int32>* > &histories,
+    const std::vector<int32> &rows,
+    const std::vector<int32> &labels,
+    std::vector<BaseFloat> *logprobs) const {
+  int32 num_rows = hidden.NumRows(), num_queries = rows.size();
+  KALDI_ASSERT(hidden.NumCols() == HiddenDim() &&
+               histories.size() == static_cast<size_t>(num_rows) &&
+               labels.size() == rows.size());
+  logprobs->resize(num_queries);
+  if (num_queries == 0) return;
+
+  CuMatrix<BaseFloat> compressed;
+  const CuMatrixBase<BaseFloat> *output_input = &hidden;
+  if (compression_weights_.NumRows() != 0) {
+    compressed.Resize(num_rows, compression_weights_.NumRows(), kUndefined);
+    compressed.AddMatMat(1.0, hidden, kNoTrans,
+                         compression_weights_, kTrans, 0.0);
+    ClampAndSigmoid(&compressed);
+    output_input = &compressed;
+  }
+
+  // The class log-probs are needed for every row.
+  CuMatrix<BaseFloat> class_act(num_rows, class_weights_.NumRows(),
+                                kUndefined);
+  class_act.AddMatMat(1.0, *output_input, kNoTrans,
+                      class_weights_, kTrans, 0.0);
+  Matrix<BaseFloat> class_logprobs(class_act);
+  std::vector<std::vector<int32> > history_indexes(num_rows);
+  for (int32 r = 0; r < num_rows; r++) {
+    GetHistoryIndexes(*(histories[r]), &(history_indexes[r]));
+    SubVector<BaseFloat> row(class_logprobs, r);
+    AddDirectClassFeatures(history_indexes[r], &row);
+    ClampAndLogSoftmax(&row);
+  }
+
+  // The words are normalized within their class, so we only need the
+  // activations of the words in the classes of the queries, for each row.
+  // "groups" are the distinct (row, class) pairs; the log-probs of the words
+  // of group g start at group_offsets[g] in "word_logprobs".
+  typedef unordered_map<std::pair<int32, int32>, int32,
+                        PairHasher<int32> > GroupMap;
+  GroupMap group_map;
+  std::vector<std::pair<int32, int32> > groups;
+  std::vector<int32> group_offsets;
+  std::vector<int32> query_groups(num_queries, -1);
+  int32 total_words = 0;
+  for (int32 q = 0; q < num_queries; q++) {
+    int32 index = WordIndex(labels[q]);
+    if (index == -1) continue;
+    std::pair<int32, int32> group(rows[q], word_class_[index]);
+    GroupMap::iterator iter = group_map.find(group);
+    if (iter == group_map.end()) {
+      iter = group_map.insert(std::make_pair(group,
+                                             int32(groups.size()))).first;
+      groups.push_back(group);
+      group_offsets.push_back(total_words);
+      total_words += class_size_[group.second];
+    }
+    query_groups[q] = iter->second;
+  }
+
+  // We process the groups in pieces of about "max_words" words, to limit the
+  // size of the temporary matrices.
+  const int32 max_words = 1 << 16;
+  Vector<BaseFloat> word_logprobs(total_words, kUndefined);
+  size_t g_begin = 0;
+  while (g_begin < groups.size()) {
+    size_t g_end = g_begin;
+    int32 begin_offset = group_offsets[g_begin], num_words = 0;
+    while (g_end < groups.size() &&
+           (num_words == 0 ||
+            num_words + class_size_[groups[g_end].second] <= max_words)) {
+      num_words += class_size_[groups[g_end].second];
+      g_end++;
+    }
+    std::vector<MatrixIndexT> row_indexes, word_indexes;
+    row_indexes.reserve(num_words);
+    word_indexes.reserve(num_words);
+    for (size_t g = g_begin; g < g_end; g++) {
+      int32 r = groups[g].first, c = groups[g].second;
+      for (int32 i = 0; i < class_size_[c]; i++) {
+        row_indexes.push_back(r);
+        word_indexes.push_back(class_begin_[c] + i);
+      }
+    }
+    CuArray<MatrixIndexT> cu_row_indexes(row_indexes),
+        cu_word_indexes(word_indexes);
+    CuMatrix<BaseFloat> input(num_words, output_input->NumCols(), kUndefined),
+        weights(num_words, output_input->NumCols(), kUndefined);
+    input.CopyRows(*output_input, cu_row_indexes);
+    weights.CopyRows(word_weights_, cu_word_indexes);
+    CuVector<BaseFloat> word_act(num_words);
+    word_act.AddDiagMatMat(1.0, input, kNoTrans, weights, kTrans, 0.0);
+    SubVector<BaseFloat> this_logprobs(word_logprobs, begin_offset, num_words);
+    word_act.CopyToVec(&this_logprobs);
+    for (size_t g = g_begin; g < g_end; g++) {
+      int32 r = groups[g].first, c = groups[g].second;
+      SubVector<BaseFloat> class_words(word_logprobs, group_offsets[g],
+                                       class_size_[c]);
+      AddDirectWordFeatures(history_indexes[r], c, &class_words);
+      ClampAndLogSoftmax(&class_words);
+    }
+    g_begin = g_end;
+  }
+
+  for (int32 q = 0; q < num_queries; q++) {
+    int32 label = labels[q], index = WordIndex(label);
+    BaseFloat logprob = label_to_penalty_[label];
+    if (index == -1) {
+      logprob += kRnnlmOovLogProb;
+    } else {
+      int32 c = word_class_[index], g = query_groups[q];
+      logprob += class_logprobs(rows[q], c) +
+          word_logprobs(group_offsets[g] + index - class_begin_[c]);
+    }
+    (*logprobs)[q] = logprob;
+  }
+}
+
+
+RnnlmBatchDeterministicFst::RnnlmBatchDeterministicFst(
+    const RnnlmBatchOptions &opts, int32 max_ngram_order,
+    const BatchedRnnlmInterface *rnnlm):
+    opts_(opts), max_ngram_order_(max_ngram_order), rnnlm_(rnnlm),
+    num_hidden_(0) {
+  KALDI_ASSERT(rnnlm != NULL && opts.batch_size > 0);
+  // Uses empty history for <s>, as RnnlmDeterministicFst does.
+  LmState start;
+  start.parent = -1;
+  start.depth = 0;
+  start.final_cost = 0.0;
+  states_.push_back(start);
+  wseq_to_state_[start.wseq] = 0;
+  pending_finals_.push_back(0);
+}
+
+RnnlmBatchDeterministicFst::StateId RnnlmBatchDeterministicFst::Transition(
+    StateId s, Label ilabel) {
+  KALDI_ASSERT(static_cast<size_t>(s) < states_.size());
+  std::pair<StateId, Label> key(s, ilabel);
+  ArcMapType::iterator iter = arcs_.find(key);
+  if (iter != arcs_.end())
+    return iter->second.first;
+
+  std::vector<Label> wseq = states_[s].wseq;
+  wseq.push_back(ilabel);
+  if (max_ngram_order_ > 0) {
+    while (wseq.size() >= max_ngram_order_) {
+      // History state has at most <max_ngram_order_> - 1 words in the state.
+      wseq.erase(wseq.begin(), wseq.begin() + 1);
+    }
+  }
+  std::pair<MapType::iterator, bool> result = wseq_to_state_.insert(
+      std::make_pair(wseq, static_cast<StateId>(states_.size())));
+  if (result.second) {
+    LmState state;
+    state.wseq = wseq;
+    state.parent = s;
+    state.depth = states_[s].depth + 1;
+    state.final_cost = 0.0;
+    states_.push_back(state);
+    pending_finals_.push_back(result.first->second);
+  }
+  StateId next_state = result.first->second;
+  arcs_[key] = std::make_pair(next_state, BaseFloat(0.0));
+  pending_arcs_.push_back(key);
+  return next_state;
+}
+
+// Used to sort the new states by depth.
+struct RnnlmStateDepthCompare {
+  explicit RnnlmStateDepthCompare(const std::vector<int32> &depths):
+      depths_(depths) { }
+  bool operator () (int32 a, int32 b) const {
+    return depths_[a] < depths_[b] || (depths_[a] == depths_[b] && a < b);
+  }
+  const std::vector<int32> &depths_;
+};
+
+void RnnlmBatchDeterministicFst::ComputeHidden() {
+  int32 num_states = states_.size(), dim = rnnlm_->HiddenDim();
+  if (num_hidden_ == num_states) return;
+  if (hidden_.NumRows() < num_states)
+    hidden_.Resize(std::max(num_states, 2 * hidden_.NumRows()), dim,
+                   kCopyData);
+
+  // A state's context is the hidden state of its parent, which is either
+  // computed already or has a smaller depth, so we process the new states in
+  // order of depth, in batches of states with the same depth.
+  std::vector<int32> depths(num_states - num_hidden_), order;
+  for (int32 s = num_hidden_; s < num_states; s++) {
+    depths[s - num_hidden_] = states_[s].depth;
+    order.push_back(s - num_hidden_);
+  }
+  std::sort(order.begin(), order.end(), RnnlmStateDepthCompare(depths));
+
+  size_t begin = 0;
+  while (begin < order.size()) {
+    size_t end = begin + 1;
+    while (end < order.size() && end - begin < opts_.batch_size &&
+           depths[order[end]] == depths[order[begin]])
+      end++;
+    int32 num_rows = end - begin;
+    Matrix<BaseFloat> context(num_rows, dim, kUndefined);
+    std::vector<int32> prev_words(num_rows);
+    for (int32 i = 0; i < num_rows; i++) {
+      const LmState &state = states_[num_hidden_ + order[begin + i]];
+      SubVector<BaseFloat> this_context(context, i);
+      if (state.parent == -1) {
+        // The start state; the sentence boundary precedes its empty history.
+        prev_words[i] = rnnlm_->GetInitialContext(&this_context);
+      } else {
+        this_context.CopyFromVec(hidden_.Row(state.parent));
+        prev_words[i] = rnnlm_->WordIndex(state.wseq.back());
+      }
+    }
+    CuMatrix<BaseFloat> cu_context(context), cu_hidden;
+    rnnlm_->ComputeHidden(cu_context, prev_words, &cu_hidden);
+    Matrix<BaseFloat> hidden(cu_hidden);
+    for (int32 i = 0; i < num_rows; i++)
+      hidden_.Row(num_hidden_ + order[begin + i]).CopyFromVec(hidden.Row(i));
+    begin = end;
+  }
+  num_hidden_ = num_states;
+}
+
+void RnnlmBatchDeterministicFst::ComputeCosts() {
+  // Each query is (state, word, index into pending_arcs_), with -1 for
+  // final-probs; we group them by state.
+  typedef std::pair<StateId, std::pair<Label, int32> > Query;
+  std::vector<Query> queries;
+  queries.reserve(pending_arcs_.size() + pending_finals_.size());
+  for (size_t i = 0; i < pending_arcs_.size(); i++)
+    queries.push_back(Query(pending_arcs_[i].first,
+                            std::make_pair(pending_arcs_[i].second,
+                                           int32(i))));
+  for (size_t i = 0; i < pending_finals_.size(); i++)
+    queries.push_back(Query(pending_finals_[i],
+                            std::make_pair(rnnlm_->Eos(), -1)));
+  std::sort(queries.begin(), queries.end());
+
+  int32 dim = rnnlm_->HiddenDim();
+  size_t begin = 0;
+  while (begin < queries.size()) {
+    // Takes the queries for up to opts_.batch_size states.
+    std::vector<StateId> batch_states;
+    size_t end = begin;
+    for (; end < queries.size(); end++) {
+      StateId s = queries[end].first;
+      if (batch_states.empty() || batch_states.back() != s) {
+        if (batch_states.size() == static_cast<size_t>(opts_.batch_size))
+          break;
+        batch_states.push_back(s);
+      }
+    }
+    int32 num_rows = batch_states.size();
+    Matrix<BaseFloat> hidden(num_rows, dim, kUndefined);
+    std::vector<const std::vector<int32>* > histories(num_rows);
+    for (int32 i = 0; i < num_rows; i++) {
+      hidden.Row(i).CopyFromVec(hidden_.Row(batch_states[i]));
+      histories[i] = &(states_[batch_states[i]].wseq);
+    }
+    std::vector<int32> rows, labels;
+    for (size_t q = begin, i = 0; q < end; q++) {
+      while (batch_states[i] != queries[q].first) i++;
+      rows.push_back(i);
+      labels.push_back(queries[q].second.first);
+    }
+    CuMatrix<BaseFloat> cu_hidden(hidden);
+    std::vector<BaseFloat> logprobs;
+    rnnlm_->ComputeLogProbs(cu_hidden, histories, rows, labels, &logprobs);
+    for (size_t q = begin; q < end; q++) {
+      BaseFloat cost = -logprobs[q - begin];
+      int32 arc_index = queries[q].second.second;
+      if (arc_index == -1)
+        states_[queries[q].first].final_cost = cost;
+      else
+        arcs_[pending_arcs_[arc_index]].second = cost;
+    }
+    begin = end;
+  }
+  pending_arcs_.clear();
+  pending_finals_.clear();
+}
+
+void RnnlmBatchDeterministicFst::Compute() {
+  ComputeHidden();
+  ComputeCosts();
+}
+
+fst::StdArc::Weight RnnlmBatchDeterministicFst::Final(StateId s) {
+  KALDI_ASSERT(static_cast<size_t>(s) < states_.size() &&
+               pending_finals_.empty() && "Compute() was not called.");
+  return Weight(states_[s].final_cost);
+}
+
+bool RnnlmBatchDeterministicFst::GetArc(StateId s, Label ilabel,
+                                        fst::StdArc *oarc) {
+  ArcMapType::const_iterator iter = arcs_.find(std::make_pair(s, ilabel));
+  if (iter == arcs_.end() || !pending_arcs_.empty())
+    KALDI_ERR << "Arc from state " << s << " with word " << ilabel
+              << " was not computed: call AddLattice() and Compute() for "
+              << "each lattice before composing.";
+  oarc->ilabel = ilabel;
+  oarc->olabel = ilabel;
+  oarc->nextstate = iter->second.first;
+  oarc->weight = Weight(iter->second.second);
+  return true;
+}
+
+}  // namespace kaldi
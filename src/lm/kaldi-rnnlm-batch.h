@@ -0,0 +1,256 @@
+// lm/kaldi-rnnlm-batch.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_LM_KALDI_RNNLM_BATCH_H_
+#define KALDI_LM_KALDI_RNNLM_BATCH_H_
+
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "cudamatrix/cu-matrix.h"
+#include "fstext/deterministic-fst.h"
+#include "itf/batched-rnnlm-itf.h"
+#include "lm/kaldi-rnnlm.h"
+#include "util/common-utils.h"
+
+namespace kaldi {
+
+/// This class holds a copy of the weights of an RNNLM in Mikolov's format (as
+/// read by KaldiRnnlmWrapper), in CuMatrix form, so that the network can be
+/// evaluated for many histories at once, on the GPU if one was selected.  It
+/// computes the same quantities as CRnnLM::computeConditionalLogprob(), up to
+/// roundoff (CRnnLM uses double precision and an approximate exp()).
+class CuRnnlm: public BatchedRnnlmInterface {
+ public:
+  /// Does not take ownership of "rnnlm".  The direct (maximum-entropy)
+  /// weights, if the model has them, are not copied but read from "rnnlm",
+  /// so it must outlive this object.
+  explicit CuRnnlm(KaldiRnnlmWrapper *rnnlm);
+
+  virtual int32 HiddenDim() const { return recurrent_weights_.NumRows(); }
+
+  virtual int32 Eos() const { return eos_; }
+
+  /// The rnnlm's own index of word label "label", after mapping
+  /// out-of-vocabulary words to the unknown-word symbol; -1 if it has none.
+  virtual int32 WordIndex(int32 label) const;
+
+  /// CRnnLM starts from a hidden state of all ones, and the sentence
+  /// boundary is rnnlm index 0.
+  virtual int32 GetInitialContext(VectorBase<BaseFloat> *context) const;
+
+  virtual void ComputeHidden(const CuMatrixBase<BaseFloat> &context,
+                             const std::vector<int32> &prev_words,
+                             CuMatrix<BaseFloat> *hidden) const;
+
+  /// The histories are used only by the direct connections.  Queries that
+  /// share a history are cheaper because the normalizers are shared.
+  virtual void ComputeLogProbs(
+      const CuMatrixBase<BaseFloat> &hidden,
+      const std::vector<const std::vector<int32>* > &histories,
+      const std::vector<int32> &rows,
+      const std::vector<int32> &labels,
+      std::vector<BaseFloat> *logprobs) const;
+
+ private:
+  // Clamps to [-50, 50] and applies the sigmoid, as CRnnLM does.
+  static void ClampAndSigmoid(CuMatrixBase<BaseFloat> *mat);
+
+  // Clamps to [-50, 50] and replaces with the log-softmax, as CRnnLM does.
+  static void ClampAndLogSoftmax(VectorBase<BaseFloat> *vec);
+
+  // Outputs the rnnlm indexes of the words of "history", most recent first,
+  // padded with zeros to rnnlm::MAX_NGRAM_ORDER words, as CRnnLM does.
+  void GetHistoryIndexes(const std::vector<int32> &history,
+                         std::vector<int32> *indexes) const;
+
+  // Adds the direct connections to the class activations "class_act".
+  void AddDirectClassFeatures(const std::vector<int32> &history_indexes,
+                              VectorBase<BaseFloat> *class_act) const;
+
+  // Adds the direct connections to the activations "word_act" of the words
+  // of class "c".
+  void AddDirectWordFeatures(const std::vector<int32> &history_indexes,
+                             int32 c, VectorBase<BaseFloat> *word_act) const;
+
+  // Row w is the input weight of word w (rnnlm index).
+  CuMatrix<BaseFloat> word_input_weights_;
+  // Maps the previous hidden state to the hidden state (row = output).
+  CuMatrix<BaseFloat> recurrent_weights_;
+  // Maps the hidden state to the compression layer; empty if there is none.
+  CuMatrix<BaseFloat> compression_weights_;
+  // Row c is the output weight of class c.
+  CuMatrix<BaseFloat> class_weights_;
+  // Row w is the output weight of word w (rnnlm index).
+  CuMatrix<BaseFloat> word_weights_;
+
+  std::vector<int32> word_class_;  // class of each rnnlm word index.
+  std::vector<int32> class_begin_;  // first word index of each class.
+  std::vector<int32> class_size_;  // number of words in each class.
+
+  // For each word label, its rnnlm index (-1 if none), and the log-prob
+  // penalty added if it is mapped to the unknown-word symbol.
+  std::vector<int32> label_to_index_;
+  std::vector<BaseFloat> label_to_penalty_;
+  int32 eos_;
+
+  const double *direct_weights_;  // owned by the CRnnLM; NULL if none.
+  long long direct_size_;
+  int32 direct_order_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(CuRnnlm);
+};
+
+
+struct RnnlmBatchOptions {
+  int32 batch_size;
+
+  RnnlmBatchOptions(): batch_size(1024) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("rnnlm-batch-size", &batch_size, "Maximum number of RNNLM "
+                   "histories that are evaluated together, e.g. in one GPU "
+                   "matrix multiplication.");
+  }
+};
+
+
+/// This class is a replacement for RnnlmDeterministicFst which evaluates the
+/// RNNLM (any BatchedRnnlmInterface) in batches.  Instead of computing each
+/// arc when it is requested, it is first given the lattices it is to be
+/// composed with (AddLattice()); it follows them to find all the histories
+/// and arcs the composition will need, and Compute() then works out the
+/// hidden states level by level (all histories of length n together) and the
+/// arc log-probs in batches.  After that it can be used in
+/// ComposeCompactLatticeDeterministic() for each of the lattices.
+///
+/// Histories are cached by word sequence, as in RnnlmDeterministicFst, and
+/// the cache is shared between all the lattices given to one object.  If
+/// max_ngram_order > 0, a truncated history takes the hidden state of the
+/// first full history that reached it; with a single lattice this gives the
+/// same states as RnnlmDeterministicFst.
+class RnnlmBatchDeterministicFst
+    : public fst::DeterministicOnDemandFst<fst::StdArc> {
+ public:
+  typedef fst::StdArc::Weight Weight;
+  typedef fst::StdArc::StateId StateId;
+  typedef fst::StdArc::Label Label;
+
+  /// Does not take ownership of "rnnlm".
+  RnnlmBatchDeterministicFst(const RnnlmBatchOptions &opts,
+                             int32 max_ngram_order,
+                             const BatchedRnnlmInterface *rnnlm);
+
+  /// Adds the histories and arcs needed to compose "lat" (whose output labels
+  /// are words) with this FST.  Can be called for several lattices, before
+  /// and after Compute().
+  template <class Arc>
+  void AddLattice(const fst::Fst<Arc> &lat);
+
+  /// Computes the weights of all the arcs and final-probs that are needed by
+  /// the lattices added so far.
+  void Compute();
+
+  virtual StateId Start() { return 0; }
+
+  /// Final() and GetArc() require that Compute() was called after the last
+  /// AddLattice(), and GetArc() only knows the arcs needed by those lattices.
+  virtual Weight Final(StateId s);
+
+  virtual bool GetArc(StateId s, Label ilabel, fst::StdArc *oarc);
+
+  int32 NumStates() const { return states_.size(); }
+
+ private:
+  struct LmState {
+    std::vector<Label> wseq;  // the (truncated) word history.
+    StateId parent;  // state whose hidden state is our context; -1 for start.
+    int32 depth;  // number of words since the start (not truncated).
+    BaseFloat final_cost;
+  };
+
+  // Returns the destination of the arc with word "ilabel" from state "s",
+  // creating the arc (and the state) if needed.
+  StateId Transition(StateId s, Label ilabel);
+
+  // Computes the hidden states of the states that do not have them yet.
+  void ComputeHidden();
+
+  // Computes the costs of the pending arcs and final-probs.
+  void ComputeCosts();
+
+  typedef unordered_map<std::vector<Label>,
+                        StateId, VectorHasher<Label> > MapType;
+  typedef unordered_map<std::pair<StateId, Label>,
+                        std::pair<StateId, BaseFloat>,
+                        PairHasher<int32> > ArcMapType;
+
+  RnnlmBatchOptions opts_;
+  int32 max_ngram_order_;
+  const BatchedRnnlmInterface *rnnlm_;
+
+  std::vector<LmState> states_;
+  MapType wseq_to_state_;
+  ArcMapType arcs_;  // (state, word) -> (next state, cost)
+
+  // Row s is the hidden state of LM state s (the context of its successors),
+  // for s < num_hidden_; the number of rows may be larger.
+  Matrix<BaseFloat> hidden_;
+  int32 num_hidden_;
+
+  // Arcs and final-probs whose costs have not been computed.
+  std::vector<std::pair<StateId, Label> > pending_arcs_;
+  std::vector<StateId> pending_finals_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(RnnlmBatchDeterministicFst);
+};
+
+
+template <class Arc>
+void RnnlmBatchDeterministicFst::AddLattice(const fst::Fst<Arc> &lat) {
+  typedef typename Arc::StateId LatStateId;
+  typedef std::pair<LatStateId, StateId> StatePair;
+  if (lat.Start() == fst::kNoStateId) return;
+  // We visit the pairs (lattice state, LM state) in the same order as
+  // ComposeCompactLatticeDeterministic() does.
+  unordered_map<StatePair, bool, PairHasher<int32> > visited;
+  std::queue<StatePair> queue;
+  StatePair start_pair(lat.Start(), Start());
+  visited[start_pair] = true;
+  queue.push(start_pair);
+  while (!queue.empty()) {
+    StatePair pair = queue.front();
+    queue.pop();
+    for (fst::ArcIterator<fst::Fst<Arc> > aiter(lat, pair.first);
+         !aiter.Done(); aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      StateId next_lm_state = (arc.olabel == 0 ? pair.second :
+                               Transition(pair.second, arc.olabel));
+      StatePair next_pair(arc.nextstate, next_lm_state);
+      if (visited.insert(std::make_pair(next_pair, true)).second)
+        queue.push(next_pair);
+    }
+  }
+}
+
+}  // namespace kaldi
+
+#endif  // KALDI_LM_KALDI_RNNLM_BATCH_H_
@@ -64,6 +64,8 @@ class KaldiRnnlmWrapper {
   std::vector<std::string> label_to_word_;
   int32 eos_;
 
+  friend class CuRnnlm;  // see kaldi-rnnlm-batch.h
+
   KALDI_DISALLOW_COPY_AND_ASSIGN(KaldiRnnlmWrapper);
 };
 
@@ -56,6 +56,10 @@
 #include <vector>
 #include "util/stl-utils.h"
 
+namespace kaldi {
+class CuRnnlm;
+}
+
 namespace rnnlm {
 
 #define MAX_STRING 100
@@ -232,6 +236,10 @@ class CRnnLM {
   void setUnkPenalty(const std::string &filename);
   float getUnkPenalty(const std::string &word);
   bool isUnk(const std::string &word);
+
+  // CuRnnlm (lm/kaldi-rnnlm-batch.h) copies the weights to evaluate the
+  // network in batches.
+  friend class kaldi::CuRnnlm;
 };
 
 }  // namespace rnnlm
@@ -48,6 +48,9 @@ int main(int argc, char *argv[]) {
     int32 unk_symbol = -1;
     int32 bos_symbol = -1;
     int32 eos_symbol = -1;
+    bool aligned = false;
+    int32 quantize_bits = 0;
+    int32 num_threads = 1;
     po.Register("natural-base", &natural_base,
                 "If true, use log-base e instead of log-base 10.");
     po.Register("unk-symbol", &unk_symbol,
@@ -60,6 +63,24 @@ int main(int argc, char *argv[]) {
                 "Integer corresponds to </s>. You must set this to your actual "
                 "EOS integer.");
 
+    po.Register("aligned", &aligned,
+                "If true, write a format that programs reading the model can "
+                "memory-map, so that loading it is almost instantaneous and "
+                "processes on the same machine share one copy.  Such files "
+                "can also be read in the normal way.");
+    po.Register("quantize-bits", &quantize_bits,
+                "If 8 or 16, store the log-probabilities and backoff weights "
+                "as codes of this many bits into codebooks, and pack the "
+                "leaf n-grams more compactly, to reduce the size of the model "
+                "in memory; 0 means no quantization.  Implies --aligned.  The "
+                "quantization error is logged; compare rescoring results with "
+                "the unquantized model to see the effect on WER.");
+    po.Register("num-threads", &num_threads,
+                "Number of threads for parsing the n-grams and building the "
+                "model; the output is the same for any value.  Parsing "
+                "proceeds in blocks of n-gram lines, so memory use does not "
+                "grow with the number of threads.");
+
     po.Read(argc, argv);
 
     if (po.NumArgs() != 2) {
@@ -77,7 +98,8 @@ int main(int argc, char *argv[]) {
 
     bool ans = BuildConstArpaLm(natural_base, bos_symbol,
                                 eos_symbol, unk_symbol,
-                                arpa_rxfilename, const_arpa_wxfilename);
+                                arpa_rxfilename, const_arpa_wxfilename,
+                                aligned, quantize_bits, num_threads);
 
     if (ans)
       return 0;
@@ -430,7 +430,52 @@ inline void clapack_Xgesvd(char *v, char *u, KaldiBlasInt *num_cols,
   dgesvd_(v, u,
           num_cols, num_rows, Mdata, stride,
           sv, Vdata, vstride, Udata, ustride,
-          p_work, l_work, result); 
+          p_work, l_work, result);
+}
+//
+inline void clapack_Xsyevr(char *jobz, char *range, char *uplo,
+                           KaldiBlasInt *num_rows, float *Mdata,
+                           KaldiBlasInt *stride, float *vl, float *vu,
+                           KaldiBlasInt *il, KaldiBlasInt *iu, float *abstol,
+                           KaldiBlasInt *num_found, float *eigs, float *Zdata,
+                           KaldiBlasInt *zstride, KaldiBlasInt *isuppz,
+                           float *p_work, KaldiBlasInt *l_work,
+                           KaldiBlasInt *p_iwork, KaldiBlasInt *l_iwork,
+                           KaldiBlasInt *result) {
+  ssyevr_(jobz, range, uplo, num_rows, Mdata, stride, vl, vu, il, iu, abstol,
+          num_found, eigs, Zdata, zstride, isuppz, p_work, l_work,
+          p_iwork, l_iwork, result);
+}
+inline void clapack_Xsyevr(char *jobz, char *range, char *uplo,
+                           KaldiBlasInt *num_rows, double *Mdata,
+                           KaldiBlasInt *stride, double *vl, double *vu,
+                           KaldiBlasInt *il, KaldiBlasInt *iu, double *abstol,
+                           KaldiBlasInt *num_found, double *eigs, double *Zdata,
+                           KaldiBlasInt *zstride, KaldiBlasInt *isuppz,
+                           double *p_work, KaldiBlasInt *l_work,
+                           KaldiBlasInt *p_iwork, KaldiBlasInt *l_iwork,
+                           KaldiBlasInt *result) {
+  dsyevr_(jobz, range, uplo, num_rows, Mdata, stride, vl, vu, il, iu, abstol,
+          num_found, eigs, Zdata, zstride, isuppz, p_work, l_work,
+          p_iwork, l_iwork, result);
+}
+//
+inline void clapack_Xpotrf(KaldiBlasInt *num_rows, float *Mdata,
+                           KaldiBlasInt *stride, KaldiBlasInt *result) {
+  spotrf_(const_cast<char *>("U"), num_rows, Mdata, stride, result);
+}
+inline void clapack_Xpotrf(KaldiBlasInt *num_rows, double *Mdata,
+                           KaldiBlasInt *stride, KaldiBlasInt *result) {
+  dpotrf_(const_cast<char *>("U"), num_rows, Mdata, stride, result);
+}
+//
+inline void clapack_Xpotri(KaldiBlasInt *num_rows, float *Mdata,
+                           KaldiBlasInt *stride, KaldiBlasInt *result) {
+  spotri_(const_cast<char *>("U"), num_rows, Mdata, stride, result);
+}
+inline void clapack_Xpotri(KaldiBlasInt *num_rows, double *Mdata,
+                           KaldiBlasInt *stride, KaldiBlasInt *result) {
+  dpotri_(const_cast<char *>("U"), num_rows, Mdata, stride, result);
 }
 //
 void inline clapack_Xsptri(KaldiBlasInt *num_rows, float *Mdata, 
@@ -20,27 +20,188 @@
 // limitations under the License.
 
 #include "matrix/compressed-matrix.h"
+#include "matrix/matrix-parallel.h"
+#include "matrix/vectorized-math.h"
 #include <algorithm>
+#include <limits>
 
 namespace kaldi {
 
+// One part of the work of CompressedMatrix::CopyFromMat() (if src_mat !=
+// NULL) or CopyToMat() (otherwise), which may be run in a thread of its own.
+template<typename Real>
+struct CompressedMatrixPart {
+  const MatrixBase<Real> *src_mat;
+  CompressedMatrix *dest_cmat;
+  const CompressedMatrix *src_cmat;
+  MatrixBase<Real> *dest_mat;
+  int32 begin;
+  int32 end;
+
+  static void *Run(void *arg) {
+    CompressedMatrixPart<Real> *part =
+        static_cast<CompressedMatrixPart<Real>*>(arg);
+    if (part->src_mat != NULL)
+      part->dest_cmat->CompressPart(*(part->src_mat), part->begin, part->end);
+    else
+      part->src_cmat->DecompressPart(part->dest_mat, part->begin, part->end);
+    return NULL;
+  }
+};
+
+// Runs "part" for the range [0, num_items) of columns or rows.  We use at
+// most "num_threads" threads (including this one), and no more than one per
+// CompressedMatrix::kMinElementsPerThread of the "num_elements" elements of
+// the matrix, since for small matrices the threads would cost more than
+// they save.
+template<typename Real>
+static void RunCompressedMatrixParts(const CompressedMatrixPart<Real> &part,
+                                     int32 num_items, int64 num_elements,
+                                     int32 num_threads) {
+  int64 max_threads = num_elements / CompressedMatrix::kMinElementsPerThread;
+  if (num_threads > max_threads) num_threads = max_threads;
+  RunMatrixParts(part, num_items, num_threads);
+}
+
 //static 
 MatrixIndexT CompressedMatrix::DataSize(const GlobalHeader &header) {
   // Returns size in bytes of the data.
   if (header.format == 1) {
     return sizeof(GlobalHeader) +
         header.num_cols * (sizeof(PerColHeader) + header.num_rows);
-  } else {
-    KALDI_ASSERT(header.format == 2) ;
+  } else if (header.format == 2) {
     return sizeof(GlobalHeader) +
         2 * header.num_rows * header.num_cols;
+  } else {
+    KALDI_ASSERT(header.format == 3);
+    return reinterpret_cast<const BlockHeader*>(&header + 1)->num_bytes;
+  }
+}
+
+class CompressedMatrix::BlockView {
+ public:
+  BlockView(const CompressedMatrix &mat, int32 b) {
+    view_.data_ = const_cast<void*>(mat.BlockData(b));
+  }
+  const CompressedMatrix &Get() const { return view_; }
+  ~BlockView() { view_.data_ = NULL; }  // we don't own the data.
+ private:
+  CompressedMatrix view_;
+};
+
+int32 CompressedMatrix::NumBlocks() const {
+  return reinterpret_cast<const BlockHeader*>(
+      reinterpret_cast<const GlobalHeader*>(data_) + 1)->num_blocks;
+}
+
+const int32 *CompressedMatrix::BlockRowOffsets() const {
+  return reinterpret_cast<const int32*>(
+      reinterpret_cast<const BlockHeader*>(
+          reinterpret_cast<const GlobalHeader*>(data_) + 1) + 1);
+}
+
+const void *CompressedMatrix::BlockData(int32 b) const {
+  const int32 *byte_offsets = BlockRowOffsets() + NumBlocks() + 1;
+  return static_cast<const char*>(data_) + byte_offsets[b];
+}
+
+int32 CompressedMatrix::BlockForRow(int32 row) const {
+  const int32 *row_offsets = BlockRowOffsets();
+  return std::upper_bound(row_offsets, row_offsets + NumBlocks() + 1, row) -
+      row_offsets - 1;
+}
+
+void CompressedMatrix::CheckBlocks() const {
+  const GlobalHeader &h = *reinterpret_cast<const GlobalHeader*>(data_);
+  int32 num_blocks = NumBlocks(), num_bytes = DataSize(h);
+  int64 header_bytes = sizeof(GlobalHeader) + sizeof(BlockHeader) +
+      sizeof(int32) * (2 * static_cast<int64>(num_blocks) + 1);
+  if (num_blocks < 1 || num_blocks > h.num_rows || num_bytes < header_bytes)
+    KALDI_ERR << "Invalid compressed matrix data (bad block header).";
+  const int32 *row_offsets = BlockRowOffsets(),
+      *byte_offsets = row_offsets + num_blocks + 1;
+  if (row_offsets[0] != 0 || row_offsets[num_blocks] != h.num_rows)
+    KALDI_ERR << "Invalid compressed matrix data (bad row offsets).";
+  for (int32 b = 0; b < num_blocks; b++) {
+    int32 offset = byte_offsets[b];
+    if (row_offsets[b + 1] <= row_offsets[b] || offset < header_bytes ||
+        offset % 4 != 0 ||
+        offset > num_bytes - static_cast<int32>(sizeof(GlobalHeader)))
+      KALDI_ERR << "Invalid compressed matrix data (bad block " << b << ").";
+    const GlobalHeader &bh = *static_cast<const GlobalHeader*>(BlockData(b));
+    if ((bh.format != 1 && bh.format != 2) || bh.num_cols != h.num_cols ||
+        bh.num_rows != row_offsets[b + 1] - row_offsets[b] ||
+        DataSize(bh) > num_bytes - offset)
+      KALDI_ERR << "Invalid compressed matrix data (bad block " << b << ").";
   }
 }
 
+void CompressedMatrix::ConcatenateRows(
+    const std::vector<const CompressedMatrix*> &src) {
+  // The blocks, in format 1 or 2, of all the inputs.
+  std::vector<const GlobalHeader*> blocks;
+  for (size_t i = 0; i < src.size(); i++) {
+    const CompressedMatrix &cmat = *(src[i]);
+    if (cmat.data_ == NULL)
+      continue;
+    const GlobalHeader *h = static_cast<const GlobalHeader*>(cmat.data_);
+    if (h->format == 3) {
+      for (int32 b = 0; b < cmat.NumBlocks(); b++)
+        blocks.push_back(static_cast<const GlobalHeader*>(cmat.BlockData(b)));
+    } else {
+      blocks.push_back(h);
+    }
+    if (h->num_cols != blocks[0]->num_cols)
+      KALDI_ERR << "Concatenating compressed matrices with different "
+                << "numbers of columns: " << blocks[0]->num_cols << " vs. "
+                << h->num_cols;
+  }
+  int32 num_blocks = blocks.size();
+  void *new_data = NULL;
+  if (num_blocks == 1) {
+    MatrixIndexT size = DataSize(*blocks[0]);
+    new_data = AllocateData(size);
+    memcpy(new_data, blocks[0], size);
+  } else if (num_blocks > 1) {
+    int32 header_bytes = sizeof(GlobalHeader) + sizeof(BlockHeader) +
+        sizeof(int32) * (2 * num_blocks + 1);
+    // Each block starts at a multiple of 4 bytes, for alignment.
+    int64 num_bytes = (header_bytes + 3) / 4 * 4;
+    for (int32 b = 0; b < num_blocks; b++)
+      num_bytes += (DataSize(*blocks[b]) + 3) / 4 * 4;
+    KALDI_ASSERT(num_bytes < std::numeric_limits<int32>::max());
+    new_data = AllocateData(num_bytes);
+    GlobalHeader *h = static_cast<GlobalHeader*>(new_data);
+    h->format = 3;
+    h->min_value = 0.0;
+    h->range = 0.0;
+    h->num_rows = 0;
+    h->num_cols = blocks[0]->num_cols;
+    BlockHeader *block_header = reinterpret_cast<BlockHeader*>(h + 1);
+    block_header->num_blocks = num_blocks;
+    block_header->num_bytes = num_bytes;
+    int32 *row_offsets = reinterpret_cast<int32*>(block_header + 1),
+        *byte_offsets = row_offsets + num_blocks + 1;
+    int32 offset = (header_bytes + 3) / 4 * 4;
+    for (int32 b = 0; b < num_blocks; b++) {
+      row_offsets[b] = h->num_rows;
+      byte_offsets[b] = offset;
+      MatrixIndexT size = DataSize(*blocks[b]);
+      memcpy(static_cast<char*>(new_data) + offset, blocks[b], size);
+      offset += (size + 3) / 4 * 4;
+      h->num_rows += blocks[b]->num_rows;
+    }
+    row_offsets[num_blocks] = h->num_rows;
+  }
+  // We only free the old data now, as "this" may be one of the inputs.
+  Clear();
+  data_ = new_data;
+}
+
 
 template<typename Real>
 void CompressedMatrix::CopyFromMat(
-    const MatrixBase<Real> &mat) {
+    const MatrixBase<Real> &mat, int32 num_threads) {
   if (data_ != NULL) {
     delete [] static_cast<float*>(data_);  // call delete [] because was allocated with new float[]
     data_ = NULL;
@@ -92,31 +253,59 @@ void CompressedMatrix::CopyFromMat(
   
   *(reinterpret_cast<GlobalHeader*>(data_)) = global_header;
 
+  CompressedMatrixPart<Real> part = { &mat, this, NULL, NULL, 0, 0 };
+  RunCompressedMatrixParts(part, (global_header.format == 1 ?
+                                  global_header.num_cols :
+                                  global_header.num_rows),
+                           static_cast<int64>(mat.NumRows()) * mat.NumCols(),
+                           num_threads);
+}
+
+template<typename Real>
+void CompressedMatrix::CompressPart(const MatrixBase<Real> &mat,
+                                    int32 begin, int32 end) {
+  const GlobalHeader &global_header =
+      *(reinterpret_cast<GlobalHeader*>(data_));
   if (global_header.format == 1) {
     PerColHeader *header_data =
         reinterpret_cast<PerColHeader*>(static_cast<char*>(data_) +
                                         sizeof(GlobalHeader));
     unsigned char *byte_data =
         reinterpret_cast<unsigned char*>(header_data + global_header.num_cols);
-
-    const Real *matrix_data = mat.Data();
-
-    for (int32 col = 0; col < global_header.num_cols; col++) {
-      CompressColumn(global_header,
-                     matrix_data + col, mat.Stride(),
-                     global_header.num_rows,
-                     header_data, byte_data);
-      header_data++;
-      byte_data += global_header.num_rows;
+    int32 num_rows = global_header.num_rows;
+    header_data += begin;
+    byte_data += static_cast<size_t>(begin) * num_rows;
+
+    // We copy blocks of columns to the rows of a temporary matrix, so that
+    // CompressColumn() gets contiguous data; doing several columns at a time
+    // uses each cache line of "mat" fully.
+    const int32 kBlockSize = 16;
+    Matrix<Real> cols(std::min(kBlockSize, end - begin), num_rows,
+                      kUndefined);
+    for (int32 block_begin = begin; block_begin < end;
+         block_begin += kBlockSize) {
+      int32 block_size = std::min(kBlockSize, end - block_begin);
+      for (int32 r = 0; r < num_rows; r++) {
+        const Real *row_data = mat.RowData(r) + block_begin;
+        for (int32 c = 0; c < block_size; c++)
+          cols(c, r) = row_data[c];
+      }
+      for (int32 c = 0; c < block_size; c++) {
+        CompressColumn(global_header, cols.RowData(c), num_rows,
+                       header_data, byte_data);
+        header_data++;
+        byte_data += num_rows;
+      }
     }
   } else {
     uint16 *data = reinterpret_cast<uint16*>(static_cast<char*>(data_) +
                                              sizeof(GlobalHeader));
-    int32 num_rows = mat.NumRows(), num_cols = mat.NumCols();
-    for (int32 r = 0; r < num_rows; r++) {
-      const Real *row_data = mat.RowData(r);
-      for (int32 c = 0; c < num_cols; c++)
-        data[c] = FloatToUint16(global_header, row_data[c]);
+    int32 num_cols = mat.NumCols();
+    data += static_cast<size_t>(begin) * num_cols;
+    for (int32 r = begin; r < end; r++) {
+      VectorizedCompressUint16(mat.RowData(r), num_cols,
+                               global_header.min_value, global_header.range,
+                               data);
       data += num_cols;
     }
   }
@@ -124,10 +313,12 @@ void CompressedMatrix::CopyFromMat(
 
 // Instantiate the template for float and double.
 template
-void CompressedMatrix::CopyFromMat(const MatrixBase<float> &mat);
+void CompressedMatrix::CopyFromMat(const MatrixBase<float> &mat,
+                                   int32 num_threads);
 
 template
-void CompressedMatrix::CopyFromMat(const MatrixBase<double> &mat);
+void CompressedMatrix::CopyFromMat(const MatrixBase<double> &mat,
+                                   int32 num_threads);
 
 
 CompressedMatrix::CompressedMatrix(
@@ -152,6 +343,25 @@ CompressedMatrix::CompressedMatrix(
   
   GlobalHeader *old_global_header = reinterpret_cast<GlobalHeader*>(cmat.Data());
 
+  if (old_global_header->format == 3) {
+    // Take the part of each block that we need, and concatenate them.
+    const int32 *row_offsets = cmat.BlockRowOffsets();
+    std::vector<CompressedMatrix*> parts;
+    for (int32 b = cmat.BlockForRow(row_offset);
+         b < cmat.NumBlocks() && row_offsets[b] < row_offset + num_rows; b++) {
+      int32 begin = std::max(row_offset, row_offsets[b]),
+          end = std::min(row_offset + num_rows, row_offsets[b + 1]);
+      BlockView block(cmat, b);
+      parts.push_back(new CompressedMatrix(block.Get(), begin - row_offsets[b],
+                                           end - begin, col_offset, num_cols));
+    }
+    ConcatenateRows(std::vector<const CompressedMatrix*>(parts.begin(),
+                                                         parts.end()));
+    for (size_t i = 0; i < parts.size(); i++)
+      delete parts[i];
+    return;
+  }
+
   new_global_header = *old_global_header;
   new_global_header.num_cols = num_cols;
   new_global_header.num_rows = num_rows;
@@ -234,11 +444,13 @@ CompressedMatrix& CompressedMatrix::operator =(const MatrixBase<double> &mat);
 inline uint16 CompressedMatrix::FloatToUint16(
     const GlobalHeader &global_header,
     float value) {
+  // This is computed in float, in the same way as in
+  // VectorizedCompressUint16(), so that the results are the same.
   float f = (value - global_header.min_value) /
       global_header.range;
-  if (f > 1.0) f = 1.0;  // Note: this should not happen.
-  if (f < 0.0) f = 0.0;  // Note: this should not happen.
-  return static_cast<int>(f * 65535 + 0.499);  // + 0.499 is to
+  if (f > 1.0f) f = 1.0f;  // Note: this should not happen.
+  if (f < 0.0f) f = 0.0f;  // Note: this should not happen.
+  return static_cast<int>(f * 65535.0f + 0.499f);  // + 0.499 is to
   // round to closest int; avoids bias.
 }
 
@@ -250,6 +462,14 @@ inline float CompressedMatrix::Uint16ToFloat(
       + global_header.range * 1.52590218966964e-05F * value;
 }
 
+// static
+inline float CompressedMatrix::Uint16Increment(
+    const GlobalHeader &global_header) {
+  // Uint16ToFloat(global_header, value) equals
+  // global_header.min_value + Uint16Increment(global_header) * value.
+  return global_header.range * 1.52590218966964e-05F;
+}
+
 template<typename Real>  // static
 void CompressedMatrix::ComputeColHeader(
     const GlobalHeader &global_header,
@@ -268,7 +488,10 @@ void CompressedMatrix::ComputeColHeader(
     std::nth_element(sdata.begin(), sdata.begin() + quarter_nr, sdata.end());
     // Now, sdata.begin() + quarter_nr contains the element that would appear
     // in sorted order, in that position.
-    std::nth_element(sdata.begin(), sdata.begin(), sdata.begin() + quarter_nr);
+    // (For the smallest and largest elements, a linear search is faster
+    // than nth_element).
+    std::iter_swap(sdata.begin(),
+                   std::min_element(sdata.begin(), sdata.begin() + quarter_nr));
     // Now, sdata.begin() and sdata.begin() + quarter_nr contain the elements
     // that would appear at those positions in sorted order.
     std::nth_element(sdata.begin() + quarter_nr + 1,
@@ -276,8 +499,9 @@ void CompressedMatrix::ComputeColHeader(
     // Now, sdata.begin(), sdata.begin() + quarter_nr, and sdata.begin() +
     // 3*quarter_nr, contain the elements that would appear at those positions
     // in sorted order.
-    std::nth_element(sdata.begin() + (3*quarter_nr) + 1, sdata.end() - 1,
-                     sdata.end());
+    std::iter_swap(sdata.end() - 1,
+                   std::max_element(sdata.begin() + (3*quarter_nr) + 1,
+                                    sdata.end()));
     // Now, sdata.begin(), sdata.begin() + quarter_nr, and sdata.begin() +
     // 3*quarter_nr, and sdata.end() - 1, contain the elements that would appear
     // at those positions in sorted order.
@@ -327,49 +551,19 @@ void CompressedMatrix::ComputeColHeader(
   }
 }
 
-// static
-inline unsigned char CompressedMatrix::FloatToChar(
-    float p0, float p25, float p75, float p100,
-    float value) {
-  int ans;
-  if (value < p25) {  // range [ p0, p25 ) covered by
-    // characters 0 .. 64.  We round to the closest int.
-    float f = (value - p0) / (p25 - p0);
-    ans = static_cast<int>(f * 64 + 0.5);
-    // Note: the checks on the next two lines
-    // are necessary in pathological cases when all the elements in a row
-    // are the same and the percentile_* values are separated by one.
-    if (ans < 0) ans = 0;
-    if (ans > 64) ans = 64;
-  } else if (value < p75) {  // range [ p25, p75 )covered
-    // by characters 64 .. 192.  We round to the closest int.
-    float f = (value - p25) / (p75 - p25);
-    ans = 64 + static_cast<int>(f * 128 + 0.5);
-    if (ans < 64) ans = 64;
-    if (ans > 192) ans = 192;
-  } else {  // range [ p75, p100 ] covered by
-    // characters 192 .. 255.  Note: this last range
-    // has fewer characters than the left range, because
-    // we go up to 255, not 256.
-    float f = (value - p75) / (p100 - p75);
-    ans = 192 + static_cast<int>(f * 63 + 0.5);
-    if (ans < 192) ans = 192;
-    if (ans > 255) ans = 255;
-  }
-  return static_cast<unsigned char>(ans);
-}
-
-
 // static
 inline float CompressedMatrix::CharToFloat(
     float p0, float p25, float p75, float p100,
     unsigned char value) {
+  // This is computed in the same way (in float, with the slopes computed
+  // first) as in VectorizedDecompressUint8(), so that the results are the
+  // same.
   if (value <= 64) {
-    return p0 + (p25 - p0) * value * (1/64.0);
+    return p0 + (p25 - p0) * (1 / 64.0f) * value;
   } else if (value <= 192) {
-    return p25 + (p75 - p25) * (value - 64) * (1/128.0);
+    return p25 + (p75 - p25) * (1 / 128.0f) * (value - 64);
   } else {
-    return p75 + (p100 - p75) * (value - 192) * (1/63.0);
+    return p75 + (p100 - p75) * (1 / 63.0f) * (value - 192);
   }
 }
 
@@ -377,10 +571,10 @@ inline float CompressedMatrix::CharToFloat(
 template<typename Real>  // static
 void CompressedMatrix::CompressColumn(
     const GlobalHeader &global_header,
-    const Real *data, MatrixIndexT stride,
-    int32 num_rows, CompressedMatrix::PerColHeader *header,
+    const Real *data, int32 num_rows,
+    CompressedMatrix::PerColHeader *header,
     unsigned char *byte_data) {
-  ComputeColHeader(global_header, data, stride,
+  ComputeColHeader(global_header, data, 1,
                    num_rows, header);
   
   float p0 = Uint16ToFloat(global_header, header->percentile_0),
@@ -388,10 +582,7 @@ void CompressedMatrix::CompressColumn(
       p75 = Uint16ToFloat(global_header, header->percentile_75),
       p100 = Uint16ToFloat(global_header, header->percentile_100);
 
-  for (int32 i = 0; i < num_rows; i++) {
-    Real this_data = data[i * stride];
-    byte_data[i] = FloatToChar(p0, p25, p75, p100, this_data);
-  }
+  VectorizedCompressUint8(data, num_rows, p0, p25, p75, p100, byte_data);
 }
 
 // static
@@ -402,15 +593,45 @@ void* CompressedMatrix::AllocateData(int32 num_bytes) {
   return reinterpret_cast<void*>(new float[(num_bytes/3) + 4]);
 }
 
+void CompressedMatrix::CopyFromData(const void *data, MatrixIndexT num_bytes) {
+  Clear();
+  if (num_bytes == 0)
+    return;
+  GlobalHeader h;
+  if (num_bytes < static_cast<MatrixIndexT>(sizeof(h)))
+    KALDI_ERR << "Compressed matrix data is too short.";
+  memcpy(&h, data, sizeof(h));
+  if (h.format == 3) {
+    // The size is in the BlockHeader, which follows the GlobalHeader.
+    BlockHeader bh;
+    if (num_bytes < static_cast<MatrixIndexT>(sizeof(h) + sizeof(bh)))
+      KALDI_ERR << "Compressed matrix data is too short.";
+    memcpy(&bh, static_cast<const char*>(data) + sizeof(h), sizeof(bh));
+    if (h.num_rows <= 0 || h.num_cols <= 0 || bh.num_bytes != num_bytes)
+      KALDI_ERR << "Invalid compressed matrix data.";
+    data_ = AllocateData(num_bytes);
+    memcpy(data_, data, num_bytes);
+    CheckBlocks();
+    return;
+  }
+  if ((h.format != 1 && h.format != 2) || h.num_rows < 0 || h.num_cols < 0 ||
+      DataSize(h) != num_bytes)
+    KALDI_ERR << "Invalid compressed matrix data.";
+  data_ = AllocateData(num_bytes);
+  memcpy(data_, data, num_bytes);
+}
+
 void CompressedMatrix::Write(std::ostream &os, bool binary) const {
   if (binary) {  // Binary-mode write:
     if (data_ != NULL) {
       GlobalHeader &h = *reinterpret_cast<GlobalHeader*>(data_);
       if (h.format == 1) {
         WriteToken(os, binary, "CM");
-      } else {
-        KALDI_ASSERT(h.format == 2);
+      } else if (h.format == 2) {
         WriteToken(os, binary, "CM2");
+      } else {
+        KALDI_ASSERT(h.format == 3);
+        WriteToken(os, binary, "CMB");
       }
       MatrixIndexT size = DataSize(h);  // total size of data in data_
       // We don't write out the "int32 format", hence the + 4, - 4.
@@ -419,9 +640,11 @@ void CompressedMatrix::Write(std::ostream &os, bool binary) const {
       // matrix.
       WriteToken(os, binary, "CM");
       GlobalHeader h;
+      h.format = 1;
       h.range = h.min_value = 0.0;
       h.num_rows = h.num_cols = 0;
-      os.write(reinterpret_cast<const char*>(&h), sizeof(h));
+      // As above, we don't write the "format"; Read() doesn't expect it.
+      os.write(reinterpret_cast<const char*>(&h) + 4, sizeof(h) - 4);
     }
   } else {
     // In text mode, just use the same format as a regular matrix.
@@ -443,18 +666,38 @@ void CompressedMatrix::Read(std::istream &is, bool binary) {
   if (binary) {
     int peekval = Peek(is, binary);
     if (peekval == 'C') {
-      std::string tok; // Should be CM (format 1) or CM2 (format 2)
+      // Should be CM (format 1), CM2 (format 2) or CMB (format 3).
+      std::string tok;
       ReadToken(is, binary, &tok);
       GlobalHeader h;
       if (tok == "CM") { h.format = 1; }
       else if (tok == "CM2") { h.format = 2; }
+      else if (tok == "CMB") { h.format = 3; }
       else {
-        KALDI_ERR << "Unexpected token " << tok << ", expecting CM or CM2.";
+        KALDI_ERR << "Unexpected token " << tok
+                  << ", expecting CM, CM2 or CMB.";
       }
       // don't read the "format" -> hence + 4, - 4.
       is.read(reinterpret_cast<char*>(&h) + 4, sizeof(h) - 4);
       if (is.fail())
         KALDI_ERR << "Failed to read header";
+      if (h.format == 3) {
+        BlockHeader bh;
+        is.read(reinterpret_cast<char*>(&bh), sizeof(bh));
+        if (is.fail() || h.num_rows <= 0 || h.num_cols <= 0 ||
+            bh.num_bytes < static_cast<int32>(sizeof(h) + sizeof(bh)))
+          KALDI_ERR << "Failed to read header";
+        data_ = AllocateData(bh.num_bytes);
+        *(reinterpret_cast<GlobalHeader*>(data_)) = h;
+        *(reinterpret_cast<BlockHeader*>(
+            reinterpret_cast<GlobalHeader*>(data_) + 1)) = bh;
+        is.read(reinterpret_cast<char*>(data_) + sizeof(h) + sizeof(bh),
+                bh.num_bytes - sizeof(h) - sizeof(bh));
+        if (is.fail())
+          KALDI_ERR << "Failed to read data.";
+        CheckBlocks();
+        return;
+      }
       if (h.num_cols == 0) // empty matrix.
         return;
       int32 size = DataSize(h), remaining_size = size - sizeof(GlobalHeader);
@@ -484,10 +727,11 @@ void CompressedMatrix::Read(std::istream &is, bool binary) {
 
 template<typename Real>
 void CompressedMatrix::CopyToMat(MatrixBase<Real> *mat,
-                                 MatrixTransposeType trans) const {
+                                 MatrixTransposeType trans,
+                                 int32 num_threads) const {
   if (trans == kTrans) {
-    Matrix<Real> temp(this->NumCols(), this->NumRows());
-    CopyToMat(&temp, kNoTrans);
+    Matrix<Real> temp(this->NumRows(), this->NumCols());
+    CopyToMat(&temp, kNoTrans, num_threads);
     mat->CopyFromMat(temp, kTrans);
     return;
   }
@@ -501,28 +745,66 @@ void CompressedMatrix::CopyToMat(MatrixBase<Real> *mat,
   int32 num_cols = h->num_cols, num_rows = h->num_rows;
   KALDI_ASSERT(mat->NumRows() == num_rows);
   KALDI_ASSERT(mat->NumCols() == num_cols);
-  
+
+  if (h->format == 3) {
+    const int32 *row_offsets = BlockRowOffsets();
+    for (int32 b = 0; b < NumBlocks(); b++) {
+      SubMatrix<Real> block_mat(*mat, row_offsets[b],
+                                row_offsets[b + 1] - row_offsets[b],
+                                0, num_cols);
+      BlockView(*this, b).Get().CopyToMat(&block_mat, kNoTrans, num_threads);
+    }
+    return;
+  }
+
+  CompressedMatrixPart<Real> part = { NULL, NULL, this, mat, 0, 0 };
+  RunCompressedMatrixParts(part, (h->format == 1 ? num_cols : num_rows),
+                           static_cast<int64>(num_rows) * num_cols,
+                           num_threads);
+}
+
+template<typename Real>
+void CompressedMatrix::DecompressPart(MatrixBase<Real> *mat,
+                                      int32 begin, int32 end) const {
+  GlobalHeader *h = reinterpret_cast<GlobalHeader*>(data_);
+  int32 num_cols = h->num_cols, num_rows = h->num_rows;
   if (h->format == 1) {
     PerColHeader *per_col_header = reinterpret_cast<PerColHeader*>(h+1);
     unsigned char *byte_data = reinterpret_cast<unsigned char*>(per_col_header +
                                                                 h->num_cols);
-    for (int32 i = 0; i < num_cols; i++, per_col_header++) {
-      float p0 = Uint16ToFloat(*h, per_col_header->percentile_0),
-          p25 = Uint16ToFloat(*h, per_col_header->percentile_25),
-          p75 = Uint16ToFloat(*h, per_col_header->percentile_75),
-          p100 = Uint16ToFloat(*h, per_col_header->percentile_100);
-      for (int32 j = 0; j < num_rows; j++, byte_data++) {
-        float f = CharToFloat(p0, p25, p75, p100, *byte_data);
-        (*mat)(j, i) = f;
+    per_col_header += begin;
+    byte_data += static_cast<size_t>(begin) * num_rows;
+    // Blocks of columns are decompressed into the rows of a temporary
+    // matrix, which (unlike the columns of *mat) are contiguous, and then
+    // copied to *mat a row at a time, as in CompressPart().
+    const int32 kBlockSize = 16;
+    Matrix<Real> cols(std::min(kBlockSize, end - begin), num_rows,
+                      kUndefined);
+    for (int32 block_begin = begin; block_begin < end;
+         block_begin += kBlockSize) {
+      int32 block_size = std::min(kBlockSize, end - block_begin);
+      for (int32 c = 0; c < block_size;
+           c++, per_col_header++, byte_data += num_rows) {
+        float p0 = Uint16ToFloat(*h, per_col_header->percentile_0),
+            p25 = Uint16ToFloat(*h, per_col_header->percentile_25),
+            p75 = Uint16ToFloat(*h, per_col_header->percentile_75),
+            p100 = Uint16ToFloat(*h, per_col_header->percentile_100);
+        VectorizedDecompressUint8(byte_data, num_rows, p0, p25, p75, p100,
+                                  cols.RowData(c));
+      }
+      for (int32 r = 0; r < num_rows; r++) {
+        Real *row_data = mat->RowData(r) + block_begin;
+        for (int32 c = 0; c < block_size; c++)
+          row_data[c] = cols(c, r);
       }
     }
   } else {
     KALDI_ASSERT(h->format == 2);
     const uint16 *data = reinterpret_cast<const uint16*>(h + 1);
-    for (int32 i = 0; i < num_rows; i++) {
-      Real *row_data = mat->RowData(i);
-      for (int32 j = 0; j < num_cols; j++)
-        row_data[j] = Uint16ToFloat(*h, data[j]);
+    data += static_cast<size_t>(begin) * num_cols;
+    for (int32 i = begin; i < end; i++) {
+      VectorizedDecompressUint16(data, num_cols, h->min_value,
+                                 Uint16Increment(*h), mat->RowData(i));
       data += num_cols;
     }
   }
@@ -531,10 +813,12 @@ void CompressedMatrix::CopyToMat(MatrixBase<Real> *mat,
 // Instantiate the template for float and double.
 template
 void CompressedMatrix::CopyToMat(MatrixBase<float> *mat,
-                                 MatrixTransposeType trans) const;
+                                 MatrixTransposeType trans,
+                                 int32 num_threads) const;
 template
 void CompressedMatrix::CopyToMat(MatrixBase<double> *mat,
-                                 MatrixTransposeType trans) const;
+                                 MatrixTransposeType trans,
+                                 int32 num_threads) const;
 
 template<typename Real>
 void CompressedMatrix::CopyRowToVec(MatrixIndexT row,
@@ -545,7 +829,10 @@ void CompressedMatrix::CopyRowToVec(MatrixIndexT row,
 
   GlobalHeader *h = reinterpret_cast<GlobalHeader*>(data_);
 
-  if (h->format == 1) {  // format with per-col header.
+  if (h->format == 3) {
+    int32 b = BlockForRow(row);
+    BlockView(*this, b).Get().CopyRowToVec(row - BlockRowOffsets()[b], v);
+  } else if (h->format == 1) {  // format with per-col header.
     PerColHeader *per_col_header = reinterpret_cast<PerColHeader*>(h+1);
     unsigned char *byte_data = reinterpret_cast<unsigned char*>(per_col_header +
                                                                 h->num_cols);
@@ -563,9 +850,8 @@ void CompressedMatrix::CopyRowToVec(MatrixIndexT row,
     KALDI_ASSERT(h->format == 2);  // uint16 format
     int32 num_cols = h->num_cols;
     const uint16 *row_data = reinterpret_cast<uint16*>(h + 1) + (num_cols * row);
-    Real *v_data = v->Data();
-    for (int32 c = 0; c < num_cols; c++)
-      v_data[c] = Uint16ToFloat(*h, row_data[c]);
+    VectorizedDecompressUint16(row_data, num_cols, h->min_value,
+                               Uint16Increment(*h), v->Data());
   }
 }
 template<typename Real>
@@ -577,7 +863,14 @@ void CompressedMatrix::CopyColToVec(MatrixIndexT col,
 
   GlobalHeader *h = reinterpret_cast<GlobalHeader*>(data_);
 
-  if (h->format == 1) {  // format with per-col header.
+  if (h->format == 3) {
+    const int32 *row_offsets = BlockRowOffsets();
+    for (int32 b = 0; b < NumBlocks(); b++) {
+      SubVector<Real> block_v(*v, row_offsets[b],
+                              row_offsets[b + 1] - row_offsets[b]);
+      BlockView(*this, b).Get().CopyColToVec(col, &block_v);
+    }
+  } else if (h->format == 1) {  // format with per-col header.
     PerColHeader *per_col_header = reinterpret_cast<PerColHeader*>(h+1);
     unsigned char *byte_data = reinterpret_cast<unsigned char*>(per_col_header +
                                                                 h->num_cols);
@@ -587,10 +880,8 @@ void CompressedMatrix::CopyColToVec(MatrixIndexT col,
         p25 = Uint16ToFloat(*h, per_col_header->percentile_25),
         p75 = Uint16ToFloat(*h, per_col_header->percentile_75),
         p100 = Uint16ToFloat(*h, per_col_header->percentile_100);
-    for (int32 i = 0; i < h->num_rows; i++, byte_data++) {
-      float f = CharToFloat(p0, p25, p75, p100, *byte_data);
-      (*v)(i) = f;
-    }
+    VectorizedDecompressUint8(byte_data, h->num_rows, p0, p25, p75, p100,
+                              v->Data());
   } else {
     KALDI_ASSERT(h->format == 2);  // uint16 format
     int32 num_rows = h->num_rows, num_cols = h->num_cols;
@@ -619,14 +910,25 @@ void CompressedMatrix::CopyToMat(int32 row_offset,
   KALDI_PARANOID_ASSERT(col_offset < this->NumCols());
   KALDI_PARANOID_ASSERT(row_offset >= 0);
   KALDI_PARANOID_ASSERT(col_offset >= 0);
-  KALDI_ASSERT(row_offset+dest->NumRows() < this->NumRows());
-  KALDI_ASSERT(col_offset+dest->NumCols() < this->NumCols());
+  KALDI_ASSERT(row_offset+dest->NumRows() <= this->NumRows());
+  KALDI_ASSERT(col_offset+dest->NumCols() <= this->NumCols());
   // everything is OK
   GlobalHeader *h = reinterpret_cast<GlobalHeader*>(data_);
   int32 num_rows = h->num_rows, num_cols = h->num_cols,
       tgt_cols = dest->NumCols(), tgt_rows = dest->NumRows();
   
-  if (h->format == 1) {
+  if (h->format == 3) {
+    const int32 *row_offsets = BlockRowOffsets();
+    for (int32 b = BlockForRow(row_offset);
+         b < NumBlocks() && row_offsets[b] < row_offset + tgt_rows; b++) {
+      int32 begin = std::max(row_offset, row_offsets[b]),
+          end = std::min(row_offset + tgt_rows, row_offsets[b + 1]);
+      SubMatrix<Real> block_dest(*dest, begin - row_offset, end - begin,
+                                 0, tgt_cols);
+      BlockView(*this, b).Get().CopyToMat(begin - row_offsets[b], col_offset,
+                                          &block_dest);
+    }
+  } else if (h->format == 1) {
     // format where we have a per-column header and use one byte per
     // element.
     PerColHeader *per_col_header = reinterpret_cast<PerColHeader*>(h+1);
@@ -639,18 +941,17 @@ void CompressedMatrix::CopyToMat(int32 row_offset,
 
     per_col_header += col_offset;  // skip the appropriate number of headers
 
+    Vector<Real> col(tgt_rows, kUndefined);
     for (int32 i = 0;
          i < tgt_cols;
          i++, per_col_header++, start_of_subcol+=num_rows) {
-      byte_data = start_of_subcol;
       float p0 = Uint16ToFloat(*h, per_col_header->percentile_0),
           p25 = Uint16ToFloat(*h, per_col_header->percentile_25),
           p75 = Uint16ToFloat(*h, per_col_header->percentile_75),
           p100 = Uint16ToFloat(*h, per_col_header->percentile_100);
-      for (int32 j = 0; j < tgt_rows; j++, byte_data++) {
-        float f = CharToFloat(p0, p25, p75, p100, *byte_data);
-        (*dest)(j, i) = f;
-      }
+      VectorizedDecompressUint8(start_of_subcol, tgt_rows, p0, p25, p75, p100,
+                                col.Data());
+      dest->CopyColFromVec(col, i);
     }
   } else {
     KALDI_ASSERT(h->format == 2);
@@ -658,9 +959,8 @@ void CompressedMatrix::CopyToMat(int32 row_offset,
         (num_cols * row_offset);
 
     for (int32 row = 0; row < tgt_rows; row++) {
-      Real *dest_row = dest->RowData(row);
-      for (int32 col = 0; col < tgt_cols; col++)
-        dest_row[col] = Uint16ToFloat(*h, data[col]);
+      VectorizedDecompressUint16(data, tgt_cols, h->min_value,
+                                 Uint16Increment(*h), dest->RowData(row));
       data += num_cols;
     }
   }
@@ -41,6 +41,8 @@ namespace kaldi {
 /// linear encodings (0-25th, 25-50th, 50th-100th).
 /// If the matrix has 8 rows or fewer, we simply store all values as
 /// uint16.
+/// A matrix made by ConcatenateRows() keeps the compressed data of each of
+/// its sources as a block of rows, each with its own headers.
 
 class CompressedMatrix {
  public:
@@ -48,8 +50,10 @@ class CompressedMatrix {
 
   ~CompressedMatrix() { Clear(); }
   
+  /// See CopyFromMat() for the meaning of "num_threads".
   template<typename Real>
-  CompressedMatrix(const MatrixBase<Real> &mat): data_(NULL) { CopyFromMat(mat); }
+  CompressedMatrix(const MatrixBase<Real> &mat, int32 num_threads = 1):
+      data_(NULL) { CopyFromMat(mat, num_threads); }
 
   /// Initializer that can be used to select part of an existing
   /// CompressedMatrix without un-compressing and re-compressing (note: unlike
@@ -63,9 +67,24 @@ class CompressedMatrix {
 
   void *Data() const { return this->data_; }
 
-  /// This will resize *this and copy the contents of mat to *this.
+  /// Returns the size in bytes of the data at Data(), or zero for an empty
+  /// matrix.
+  MatrixIndexT DataSizeInBytes() const {
+    return (data_ == NULL) ? 0 :
+        DataSize(*reinterpret_cast<const GlobalHeader*>(data_));
+  }
+
+  /// Sets *this to a copy of "num_bytes" bytes of compressed data in the
+  /// format of Data() (with the size given by DataSizeInBytes()), e.g. as
+  /// stored by code that keeps compressed matrices in its own file format.
+  void CopyFromData(const void *data, MatrixIndexT num_bytes);
+
+  /// This will resize *this and copy the contents of mat to *this.  If
+  /// num_threads > 1 and the matrix is large (at least
+  /// kMinElementsPerThread elements per thread), the work is shared between
+  /// that many threads; the result is the same either way.
   template<typename Real>
-  void CopyFromMat(const MatrixBase<Real> &mat);
+  void CopyFromMat(const MatrixBase<Real> &mat, int32 num_threads = 1);
 
   CompressedMatrix(const CompressedMatrix &mat);
 
@@ -75,10 +94,11 @@ class CompressedMatrix {
   CompressedMatrix &operator = (const MatrixBase<Real> &mat); // assignment operator.
   
   /// Copies contents to matrix.  Note: mat must have the correct size.
-  /// kNoTrans case uses a temporary.
+  /// kTrans case uses a temporary.  "num_threads" is as for CopyFromMat().
   template<typename Real>
   void CopyToMat(MatrixBase<Real> *mat,
-                 MatrixTransposeType trans = kNoTrans) const;
+                 MatrixTransposeType trans = kNoTrans,
+                 int32 num_threads = 1) const;
 
   void Write(std::ostream &os, bool binary) const;
   
@@ -110,13 +130,27 @@ class CompressedMatrix {
                  int32 column_offset,
                  MatrixBase<Real> *dest) const;
 
+  /// Sets *this to the rows of the matrices in "src", one after the other,
+  /// without decompressing them.  The non-empty ones must all have the same
+  /// number of columns.  Unless only one is non-empty, the result keeps the
+  /// headers of each of them for its block of rows, so no precision is lost
+  /// (but it can't be read by versions of the code from before this format
+  /// was added).  It's OK for "this" to be in "src".
+  void ConcatenateRows(const std::vector<const CompressedMatrix*> &src);
+
   void Swap(CompressedMatrix *other) { std::swap(data_, other->data_); }
 
   void Clear();
   
   friend class Matrix<float>;
   friend class Matrix<double>;
+  friend class CuCompressedMatrix;
+
+  /// The minimum number of elements of the matrix per thread for which
+  /// CopyFromMat() and CopyToMat() will use more than one thread.
+  static const int32 kMinElementsPerThread = 1 << 16;
  private:
+  template<typename Real> friend struct CompressedMatrixPart;
 
   // allocates data using new [], ensures byte alignment
   // sufficient for float.
@@ -124,7 +158,12 @@ class CompressedMatrix {
 
   // the "format" will be 1 for the original format where each column has a
   // PerColHeader, and 2 for the format now used for matrices with 8 or fewer
-  // rows, where everything is represented as 16-bit integers.
+  // rows, where everything is represented as 16-bit integers.  Format 3 is
+  // for matrices from ConcatenateRows(): the GlobalHeader (whose min_value
+  // and range are not used) is followed by a BlockHeader, then
+  // int32 row_offsets[num_blocks + 1] and int32 byte_offsets[num_blocks],
+  // then the blocks, each of which is the data of a matrix in format 1 or 2
+  // starting at byte_offsets[b] (a multiple of 4) from the start.
   struct GlobalHeader {
     int32 format;
     float min_value;
@@ -133,8 +172,31 @@ class CompressedMatrix {
     int32 num_cols;
   };
 
+  struct BlockHeader {
+    int32 num_blocks;
+    int32 num_bytes;  // the size of all the data, from the GlobalHeader on.
+  };
+
+  // Returns the size in bytes of the data whose header is "header".  For
+  // format 3 the size is in the BlockHeader, so "header" must be followed by
+  // the rest of the data.
   static MatrixIndexT DataSize(const GlobalHeader &header);
 
+  // The following are for format 3.  BlockRowOffsets() returns the
+  // row_offsets array; BlockData(b) returns the data of block b.
+  int32 NumBlocks() const;
+  const int32 *BlockRowOffsets() const;
+  const void *BlockData(int32 b) const;
+  // Returns the block that "row" is in.
+  int32 BlockForRow(int32 row) const;
+  // Dies if the structure of the format 3 data is not consistent, e.g.
+  // after reading it.
+  void CheckBlocks() const;
+  // A CompressedMatrix that refers to a block of a format 3 matrix, without
+  // owning it.
+  class BlockView;
+  friend class BlockView;
+
   struct PerColHeader {
     uint16 percentile_0;
     uint16 percentile_25;
@@ -142,10 +204,22 @@ class CompressedMatrix {
     uint16 percentile_100;
   };
 
+  // Compresses the columns (format 1) or rows (format 2) begin <= i < end of
+  // "mat" into data_, whose GlobalHeader has already been set up.
+  template<typename Real>
+  void CompressPart(const MatrixBase<Real> &mat, int32 begin, int32 end);
+
+  // Decompresses the columns (format 1) or rows (format 2) begin <= i < end
+  // into the same columns or rows of "mat".
+  template<typename Real>
+  void DecompressPart(MatrixBase<Real> *mat, int32 begin, int32 end) const;
+
+  // Compresses one column, whose "num_rows" elements are contiguous in
+  // "data", setting up its PerColHeader.
   template<typename Real>
   static void CompressColumn(const GlobalHeader &global_header,
-                             const Real *data, MatrixIndexT stride,
-                             int32 num_rows, PerColHeader *header,
+                             const Real *data, int32 num_rows,
+                             PerColHeader *header,
                              unsigned char *byte_data);
   template<typename Real>
   static void ComputeColHeader(const GlobalHeader &global_header,
@@ -157,9 +231,9 @@ class CompressedMatrix {
 
   static inline float Uint16ToFloat(const GlobalHeader &global_header,
                                     uint16 value);
-  static inline unsigned char FloatToChar(float p0, float p25,
-                                          float p75, float p100,
-                                          float value);
+  // Returns the amount by which Uint16ToFloat() increases per unit of
+  // "value".
+  static inline float Uint16Increment(const GlobalHeader &global_header);
   static inline float CharToFloat(float p0, float p25,
                                   float p75, float p100,
                                   unsigned char value);
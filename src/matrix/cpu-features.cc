@@ -0,0 +1,166 @@
+// matrix/cpu-features.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <cstdlib>
+#include <cstring>
+#include "base/kaldi-common.h"
+#include "matrix/cpu-features.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || \
+  defined(_M_IX86)
+#define KALDI_CPU_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace kaldi {
+
+#ifdef KALDI_CPU_X86
+// Puts eax, ebx, ecx, edx (in that order) from instruction "cpuid" with the
+// given leaf and subleaf in regs.
+static void Cpuid(uint32 leaf, uint32 subleaf, uint32 regs[4]) {
+#ifdef _MSC_VER
+  int r[4];
+  __cpuidex(r, leaf, subleaf);
+  for (int32 i = 0; i < 4; i++)
+    regs[i] = r[i];
+#else
+  __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Returns the low 32 bits of extended control register 0, which say which
+// register states the operating system saves on context switches.
+static uint32 Xgetbv0() {
+#ifdef _MSC_VER
+  return static_cast<uint32>(_xgetbv(0));
+#else
+  uint32 eax, edx;
+  // This is the "xgetbv" instruction; older assemblers don't know it.
+  __asm__ __volatile__(".byte 0x0f, 0x01, 0xd0"
+                       : "=a" (eax), "=d" (edx) : "c" (0));
+  return eax;
+#endif
+}
+#endif
+
+// Returns the best instruction set the CPU supports.
+static SimdInstructionSet DetectInstructionSet() {
+#if defined(KALDI_CPU_X86)
+  uint32 regs[4];
+  Cpuid(0, 0, regs);
+  uint32 max_leaf = regs[0];
+  if (max_leaf < 1)
+    return kSimdNone;
+  Cpuid(1, 0, regs);
+  bool sse2 = (regs[3] & (1 << 26)) != 0,
+      fma = (regs[2] & (1 << 12)) != 0,
+      osxsave = (regs[2] & (1 << 27)) != 0,
+      avx = (regs[2] & (1 << 28)) != 0;
+  // AVX can only be used if the OS saves the xmm and ymm registers.
+  if (avx && osxsave && (Xgetbv0() & 6) == 6 && fma && max_leaf >= 7) {
+    Cpuid(7, 0, regs);
+    if ((regs[1] & (1 << 5)) != 0)
+      return kSimdAvx2;
+  }
+  return (sse2 ? kSimdSse2 : kSimdNone);
+#elif defined(__aarch64__)
+  // Advanced SIMD is a mandatory part of ARMv8-A.
+  return kSimdNeon;
+#else
+  return kSimdNone;
+#endif
+}
+
+static SimdInstructionSet BestInstructionSet() {
+  // The detection is cheap and always gives the same answer, so it doesn't
+  // matter if two threads do it at the same time.
+  static int32 best = -1;
+  if (best < 0)
+    best = DetectInstructionSet();
+  return static_cast<SimdInstructionSet>(best);
+}
+
+bool CpuSupports(SimdInstructionSet iset) {
+  SimdInstructionSet best = BestInstructionSet();
+  switch (iset) {
+    case kSimdNone:
+      return true;
+    case kSimdSse2: case kSimdAvx2:
+      return best != kSimdNeon && iset <= best;
+    case kSimdNeon:
+      return best == kSimdNeon;
+    default:
+      return false;
+  }
+}
+
+const char *SimdInstructionSetName(SimdInstructionSet iset) {
+  switch (iset) {
+    case kSimdNone: return "none";
+    case kSimdSse2: return "sse2";
+    case kSimdAvx2: return "avx2";
+    case kSimdNeon: return "neon";
+    default: KALDI_ERR << "Invalid instruction set " << iset;
+  }
+  return NULL;  // suppress compiler warning.
+}
+
+// -1 until GetSimdInstructionSet() is first called.
+static int32 g_simd_instruction_set = -1;
+
+SimdInstructionSet GetSimdInstructionSet() {
+  if (g_simd_instruction_set < 0) {
+    SimdInstructionSet iset = BestInstructionSet();
+    const char *env = getenv("KALDI_SIMD");
+    if (env != NULL) {
+      bool found = false;
+      for (int32 i = kSimdNone; i <= kSimdNeon; i++) {
+        SimdInstructionSet this_iset = static_cast<SimdInstructionSet>(i);
+        if (strcmp(env, SimdInstructionSetName(this_iset)) == 0) {
+          found = true;
+          if (CpuSupports(this_iset))
+            iset = this_iset;
+          else
+            KALDI_WARN << "KALDI_SIMD=" << env << ": not supported by this "
+                       << "CPU, using " << SimdInstructionSetName(iset);
+        }
+      }
+      if (!found)
+        KALDI_WARN << "Ignoring invalid value KALDI_SIMD=" << env;
+    }
+    KALDI_VLOG(2) << "Using SIMD instruction set "
+                  << SimdInstructionSetName(iset);
+    g_simd_instruction_set = iset;
+  }
+  return static_cast<SimdInstructionSet>(g_simd_instruction_set);
+}
+
+void SetSimdInstructionSet(SimdInstructionSet iset) {
+  if (!CpuSupports(iset))
+    KALDI_ERR << "This CPU does not support the instruction set "
+              << SimdInstructionSetName(iset);
+  g_simd_instruction_set = iset;
+}
+
+} // end namespace kaldi.
@@ -0,0 +1,63 @@
+// matrix/cpu-features.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_MATRIX_CPU_FEATURES_H_
+#define KALDI_MATRIX_CPU_FEATURES_H_
+
+namespace kaldi {
+
+/// \file cpu-features.h
+/// Detection, at run time, of the SIMD instruction sets that the CPU
+/// supports.  The hand-written kernels in vectorized-math.h are compiled for
+/// each instruction set that the compiler can target, and the version to use
+/// is chosen at run time, so a single binary runs at full speed on a mix of
+/// machines (e.g. with and without AVX2).
+
+enum SimdInstructionSet {
+  kSimdNone = 0,  // plain C++ code.
+  kSimdSse2 = 1,  // x86 SSE2.
+  kSimdAvx2 = 2,  // x86 AVX2, together with FMA.
+  kSimdNeon = 3   // 64-bit ARM NEON (Advanced SIMD).
+};
+
+/// Returns true if the CPU (and, for AVX2, the operating system) supports
+/// this instruction set.  kSimdNone is always supported.
+bool CpuSupports(SimdInstructionSet iset);
+
+/// Returns the instruction set that the kernels in vectorized-math.h should
+/// use.  The first time it is called, this is the best instruction set that
+/// the CPU supports, unless the environment variable KALDI_SIMD is set to the
+/// name of an instruction set (one of "none", "sse2", "avx2" or "neon"; see
+/// SimdInstructionSetName()) that the CPU supports, in which case that one is
+/// used; this is useful for comparing speed or results.
+SimdInstructionSet GetSimdInstructionSet();
+
+/// Changes the instruction set that the kernels in vectorized-math.h use;
+/// this is mainly intended for testing.  It is an error if the CPU does not
+/// support "iset".  Should not be called while other threads are using the
+/// kernels.
+void SetSimdInstructionSet(SimdInstructionSet iset);
+
+/// Returns the name of the instruction set, e.g. "avx2".
+const char *SimdInstructionSetName(SimdInstructionSet iset);
+
+} // end namespace kaldi.
+
+#endif
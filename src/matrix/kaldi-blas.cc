@@ -0,0 +1,49 @@
+// matrix/kaldi-blas.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "matrix/kaldi-blas.h"
+
+namespace kaldi {
+
+int32 SetBlasNumThreads(int32 num_threads) {
+  KALDI_ASSERT(num_threads >= 1);
+  int32 prev_num_threads = GetBlasNumThreads();
+  if (num_threads != prev_num_threads) {
+#if defined(HAVE_MKL)
+    // this affects only the calling thread.
+    mkl_set_num_threads_local(num_threads);
+#elif defined(HAVE_OPENBLAS)
+    openblas_set_num_threads(num_threads);
+#endif
+  }
+  return prev_num_threads;
+}
+
+int32 GetBlasNumThreads() {
+#if defined(HAVE_MKL)
+  return mkl_get_max_threads();
+#elif defined(HAVE_OPENBLAS)
+  return openblas_get_num_threads();
+#else
+  return 1;
+#endif
+}
+
+} // end namespace kaldi.
@@ -128,5 +128,41 @@ typedef MKL_INT KaldiBlasInt;
 // for Svd code which is not included in ATLAS (we re-implement it).
 #endif
 
+#include "base/kaldi-types.h"
+#include "base/kaldi-utils.h"
+
+namespace kaldi {
+
+// The following functions control how many threads the BLAS library uses
+// internally.  Multi-threaded BLAS and Kaldi's own threading (MultiThreader,
+// TaskSequencer and so on) do not mix well: each worker thread would start
+// its own set of BLAS threads and the machine would be oversubscribed.  The
+// thread pools in ../thread/ therefore call these functions so that BLAS is
+// single-threaded while they are running.  With MKL the setting applies only
+// to the calling thread; with OpenBLAS it applies to the whole process.  With
+// ATLAS and CLAPACK, which are not multi-threaded in the way Kaldi links them,
+// these functions do nothing.
+
+/// Sets the number of threads the BLAS library may use (see above for the
+/// scope of this), and returns the previous value.  num_threads must be >= 1.
+int32 SetBlasNumThreads(int32 num_threads);
+
+/// Returns the number of threads the BLAS library may use; this is 1 if it
+/// is not multi-threaded or if we don't know how to control it.
+int32 GetBlasNumThreads();
+
+/// This sets the number of BLAS threads for as long as the object exists,
+/// and restores the previous value in the destructor.
+class BlasThreadScope {
+ public:
+  explicit BlasThreadScope(int32 num_threads):
+      prev_num_threads_(SetBlasNumThreads(num_threads)) { }
+  ~BlasThreadScope() { SetBlasNumThreads(prev_num_threads_); }
+ private:
+  int32 prev_num_threads_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(BlasThreadScope);
+};
+
+}  // namespace kaldi
 
 #endif  // KALDI_MATRIX_KALDI_BLAS_H_
@@ -25,7 +25,9 @@
 #include "matrix/jama-svd.h"
 #include "matrix/jama-eig.h"
 #include "matrix/compressed-matrix.h"
+#include "matrix/matrix-memory-pool.h"
 #include "matrix/sparse-matrix.h"
+#include "matrix/vectorized-math.h"
 
 namespace kaldi {
 
@@ -642,8 +644,6 @@ inline void Matrix<Real>::Init(const MatrixIndexT rows,
   MatrixIndexT skip;
   MatrixIndexT real_cols;
   size_t size;
-  void *data;  // aligned memory block
-  void *temp;  // memory block to be really freed
 
   // compute the size of skip and real cols
   skip = ((16 / sizeof(Real)) - cols % (16 / sizeof(Real)))
@@ -652,15 +652,12 @@ inline void Matrix<Real>::Init(const MatrixIndexT rows,
   size = static_cast<size_t>(rows) * static_cast<size_t>(real_cols)
       * sizeof(Real);
   
-  // allocate the memory and set the right dimensions and parameters
-  if (NULL != (data = KALDI_MEMALIGN(16, size, &temp))) {
-    MatrixBase<Real>::data_        = static_cast<Real *> (data);
-    MatrixBase<Real>::num_rows_      = rows;
-    MatrixBase<Real>::num_cols_      = cols;
-    MatrixBase<Real>::stride_  = real_cols;
-  } else {
-    throw std::bad_alloc();
-  }
+  // allocate the memory (aligned to 16 bytes; see matrix-memory-pool.h) and
+  // set the right dimensions and parameters
+  MatrixBase<Real>::data_ = static_cast<Real *>(MatrixMemoryAllocate(size));
+  MatrixBase<Real>::num_rows_      = rows;
+  MatrixBase<Real>::num_cols_      = cols;
+  MatrixBase<Real>::stride_  = real_cols;
 }
 
 template<typename Real>
@@ -973,8 +970,7 @@ void Matrix<Real>::RemoveRow(MatrixIndexT i) {
 template<typename Real>
 void Matrix<Real>::Destroy() {
   // we need to free the data block if it was defined
-  if (NULL != MatrixBase<Real>::data_)
-    KALDI_MEMALIGN_FREE( MatrixBase<Real>::data_);
+  MatrixMemoryFree(MatrixBase<Real>::data_);
   MatrixBase<Real>::data_ = NULL;
   MatrixBase<Real>::num_rows_ = MatrixBase<Real>::num_cols_
       = MatrixBase<Real>::stride_ = 0;
@@ -1240,6 +1236,39 @@ void MatrixBase<Real>::Write(std::ostream &os, bool binary) const {
   }
 }
 
+template<typename Real>
+void MatrixBase<Real>::WriteAligned(std::ostream &os) const {
+  if (!os.good()) {
+    KALDI_ERR << "Failed to write matrix to stream: stream not good";
+  }
+  bool binary = true;
+  std::string my_token = (sizeof(Real) == 4 ? "FMA" : "DMA");
+  // The position of the data is rounded up to a multiple of
+  // kAlignedMatrixAlignment by the padding that follows the dimensions.  The
+  // header is the token plus its trailing space, then three integers each
+  // of which has a size byte.
+  std::streamoff pos = os.tellp();
+  int32 header_size = my_token.size() + 1 + 3 * (1 + sizeof(int32)),
+      padding = 0;
+  if (pos >= 0)
+    padding = (kAlignedMatrixAlignment -
+               (pos + header_size) % kAlignedMatrixAlignment) %
+        kAlignedMatrixAlignment;
+  WriteToken(os, binary, my_token);
+  int32 rows = this->num_rows_, cols = this->num_cols_;
+  WriteBasicType(os, binary, rows);
+  WriteBasicType(os, binary, cols);
+  WriteBasicType(os, binary, padding);
+  std::vector<char> zeros(padding, '\0');
+  if (padding > 0)
+    os.write(&(zeros[0]), padding);
+  for (MatrixIndexT i = 0; i < num_rows_; i++)
+    os.write(reinterpret_cast<const char*>(RowData(i)), sizeof(Real) * num_cols_);
+  if (!os.good()) {
+    KALDI_ERR << "Failed to write matrix to stream";
+  }
+}
+
 
 template<typename Real>
 void MatrixBase<Real>::Read(std::istream & is, bool binary, bool add) {
@@ -1310,15 +1339,25 @@ void Matrix<Real>::Read(std::istream & is, bool binary, bool add) {
       this->CopyFromMat(other);
       return;
     }
+    const char *my_aligned_token = (sizeof(Real) == 4 ? "FMA" : "DMA");
     std::string token;
     ReadToken(is, binary, &token);
-    if (token != my_token) {
+    if (token != my_token && token != my_aligned_token) {
       specific_error << ": Expected token " << my_token << ", got " << token;
       goto bad;
     }
     int32 rows, cols;
     ReadBasicType(is, binary, &rows);  // throws on error.
     ReadBasicType(is, binary, &cols);  // throws on error.
+    if (token == my_aligned_token) {  // format written by WriteAligned().
+      int32 padding;
+      ReadBasicType(is, binary, &padding);
+      if (padding < 0 || padding >= MatrixBase<Real>::kAlignedMatrixAlignment) {
+        specific_error << ": Invalid padding " << padding;
+        goto bad;
+      }
+      is.ignore(padding);
+    }
     if ((MatrixIndexT)rows != this->num_rows_ || (MatrixIndexT)cols != this->num_cols_) {
       this->Resize(rows, cols);
     }
@@ -2472,13 +2511,9 @@ Real MatrixBase<Real>::LogSumExp(Real prune) const {
 
   double sum_relto_max_elem = 0.0;
 
-  for (MatrixIndexT i = 0; i < num_rows_; i++) {
-    for (MatrixIndexT j = 0; j < num_cols_; j++) {
-      BaseFloat f = (*this)(i, j);
-      if (f >= cutoff)
-        sum_relto_max_elem += Exp(f - max_elem);
-    }
-  }
+  for (MatrixIndexT i = 0; i < num_rows_; i++)
+    sum_relto_max_elem += VectorizedSumExp(RowData(i), num_cols_,
+                                           max_elem, cutoff);
   return max_elem + Log(sum_relto_max_elem);
 }
 
@@ -2486,9 +2521,12 @@ template<typename Real>
 Real MatrixBase<Real>::ApplySoftMax() {
   Real max = this->Max(), sum = 0.0;
   // the 'max' helps to get in good numeric range.
-  for (MatrixIndexT i = 0; i < num_rows_; i++)
-    for (MatrixIndexT j = 0; j < num_cols_; j++)
-      sum += ((*this)(i, j) = Exp((*this)(i, j) - max));
+  for (MatrixIndexT i = 0; i < num_rows_; i++) {
+    SubVector<Real> row(*this, i);
+    row.Add(-max);
+    row.ApplyExp();
+    sum += row.Sum();
+  }
   this->Scale(1.0 / sum);
   return max + Log(sum);
 }
@@ -590,6 +590,20 @@ class MatrixBase {
                   const MatrixBase<Real>& B, MatrixTransposeType transB,
                   const Real beta);
 
+  /// *this = beta * *this + alpha * A * B [or B^T], where B is a SparseMatrix.
+  /// If num_threads > 1 and there is enough work, it is shared between that
+  /// many threads.  Implemented in sparse-matrix.cc.
+  void AddMatSmat(Real alpha, const MatrixBase<Real> &A,
+                  const SparseMatrix<Real> &B, MatrixTransposeType transB,
+                  Real beta, int32 num_threads = 1);
+
+  /// *this = beta * *this + alpha * A [or A^T] * B, where A is a SparseMatrix.
+  /// "num_threads" is as for the other version of AddMatSmat(), above.
+  /// Implemented in sparse-matrix.cc.
+  void AddSmatMat(Real alpha, const SparseMatrix<Real> &A,
+                  MatrixTransposeType transA, const MatrixBase<Real> &B,
+                  Real beta, int32 num_threads = 1);
+
   /// this <-- beta*this + alpha*A*B*C.
   void AddMatMatMat(const Real alpha,
                     const MatrixBase<Real>& A, MatrixTransposeType transA,
@@ -675,6 +689,15 @@ class MatrixBase {
   /// write to stream.
   void Write(std::ostream & out, bool binary) const;
 
+  /// Writes the matrix in a binary format in which the data begins at a
+  /// multiple of kAlignedMatrixAlignment bytes from the start of the stream
+  /// (if the stream position is known) and the rows are contiguous, so that
+  /// if it's the only object in a file, MappedMatrix (util/mapped-matrix.h)
+  /// can use the data in place.  Read() accepts this format.
+  void WriteAligned(std::ostream &out) const;
+  /// The alignment of the data in the format written by WriteAligned().
+  static const int32 kAlignedMatrixAlignment = 64;
+
   // Below is internal methods for Svd, user does not have to know about this.
 #if !defined(HAVE_ATLAS) && !defined(USE_KALDI_SVD)
   // protected:
@@ -27,8 +27,10 @@
 #include "matrix/cblas-wrappers.h"
 #include "matrix/kaldi-vector.h"
 #include "matrix/kaldi-matrix.h"
+#include "matrix/matrix-memory-pool.h"
 #include "matrix/sp-matrix.h"
 #include "matrix/sparse-matrix.h"
+#include "matrix/vectorized-math.h"
 
 namespace kaldi {
 
@@ -170,18 +172,9 @@ inline void Vector<Real>::Init(const MatrixIndexT dim) {
     this->data_ = NULL;
     return;
   }
-  MatrixIndexT size;
-  void *data;
-  void *free_data;
-
-  size = dim * sizeof(Real);
-
-  if ((data = KALDI_MEMALIGN(16, size, &free_data)) != NULL) {
-    this->data_ = static_cast<Real*> (data);
-    this->dim_ = dim;
-  } else {
-    throw std::bad_alloc();
-  }
+  size_t size = static_cast<size_t>(dim) * sizeof(Real);
+  this->data_ = static_cast<Real*>(MatrixMemoryAllocate(size));
+  this->dim_ = dim;
 }
 
 
@@ -289,8 +282,7 @@ void Vector<Real>::RemoveElement(MatrixIndexT i) {
 template<typename Real>
 void Vector<Real>::Destroy() {
   /// we need to free the data block if it was defined
-  if (this->data_ != NULL)
-    KALDI_MEMALIGN_FREE(this->data_);
+  MatrixMemoryFree(this->data_);
   this->data_ = NULL;
   this->dim_ = 0;
 }
@@ -764,13 +756,7 @@ Real VectorBase<Real>::LogSumExp(Real prune) const {
   if (prune > 0.0 && max_elem - prune > cutoff) // explicit pruning...
     cutoff = max_elem - prune;
 
-  double sum_relto_max_elem = 0.0;
-
-  for (MatrixIndexT i = 0; i < dim_; i++) {
-    BaseFloat f = data_[i];
-    if (f >= cutoff)
-      sum_relto_max_elem += Exp(f - max_elem);
-  }
+  double sum_relto_max_elem = VectorizedSumExp(data_, dim_, max_elem, cutoff);
   return max_elem + Log(sum_relto_max_elem);
 }
 
@@ -786,23 +772,19 @@ void VectorBase<Real>::ApplyLog() {
   for (MatrixIndexT i = 0; i < dim_; i++) {
     if (data_[i] < 0.0)
       KALDI_ERR << "Trying to take log of a negative number.";
-    data_[i] = Log(data_[i]);
   }
+  VectorizedLog(data_, dim_, data_);
 }
 
 template<typename Real>
 void VectorBase<Real>::ApplyLogAndCopy(const VectorBase<Real> &v) {
   KALDI_ASSERT(dim_ == v.Dim());
-  for (MatrixIndexT i = 0; i < dim_; i++) {
-    data_[i] = Log(v(i));
-  }
+  VectorizedLog(v.Data(), dim_, data_);
 }
 
 template<typename Real>
 void VectorBase<Real>::ApplyExp() {
-  for (MatrixIndexT i = 0; i < dim_; i++) {
-    data_[i] = Exp(data_[i]);
-  }
+  VectorizedExp(data_, dim_, data_);
 }
 
 template<typename Real>
@@ -850,21 +832,20 @@ MatrixIndexT VectorBase<Real>::ApplyFloor(const VectorBase<Real> &floor_vec) {
 
 template<typename Real>
 Real VectorBase<Real>::ApplySoftMax() {
-  Real max = this->Max(), sum = 0.0;
-  for (MatrixIndexT i = 0; i < dim_; i++) {
-    sum += (data_[i] = Exp(data_[i] - max));
-  }
+  Real max = this->Max();
+  this->Add(-max);
+  VectorizedExp(data_, dim_, data_);
+  Real sum = this->Sum();
   this->Scale(1.0 / sum);
   return max + Log(sum);
 }
 
 template<typename Real>
 Real VectorBase<Real>::ApplyLogSoftMax() {
-  Real max = this->Max(), sum = 0.0;
-  for (MatrixIndexT i = 0; i < dim_; i++) {
-    sum += Exp((data_[i] -= max));
-  }
-  sum = Log(sum);
+  Real max = this->Max();
+  this->Add(-max);
+  Real sum = Log(VectorizedSumExp(data_, dim_, Real(0.0),
+                                  -std::numeric_limits<Real>::infinity()));
   this->Add(-1.0 * sum);
   return max + sum;
 }
@@ -884,17 +865,7 @@ void VectorBase<double>::Tanh(const VectorBase<double> &src) {
 template<typename Real>
 void VectorBase<Real>::Tanh(const VectorBase<Real> &src) {
   KALDI_ASSERT(dim_ == src.dim_);
-  for (MatrixIndexT i = 0; i < dim_; i++) {
-    Real x = src.data_[i];
-    if (x > 0.0) {
-      Real inv_expx = Exp(-x);
-      x = -1.0 + 2.0 / (1.0 + inv_expx * inv_expx);
-    } else {
-      Real inv_expx = Exp(x);
-      x = 1.0 - 2.0 / (1.0 + inv_expx * inv_expx);
-    }
-    data_[i] = x;
-  }
+  VectorizedTanh(src.data_, dim_, data_);
 }
 #endif
 
@@ -922,17 +893,7 @@ void VectorBase<double>::Sigmoid(const VectorBase<double> &src) {
 template<typename Real>
 void VectorBase<Real>::Sigmoid(const VectorBase<Real> &src) {
   KALDI_ASSERT(dim_ == src.dim_);
-  for (MatrixIndexT i = 0; i < dim_; i++) {
-    Real x = src.data_[i];
-    // We aim to avoid floating-point overflow here.
-    if (x > 0.0) {
-      x = 1.0 / (1.0 + Exp(-x));
-    } else {
-      Real ex = Exp(x);
-      x = ex / (ex + 1.0);
-    }
-    data_[i] = x;
-  }
+  VectorizedSigmoid(src.data_, dim_, data_);
 }
 #endif
 
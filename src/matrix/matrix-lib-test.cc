@@ -1623,6 +1623,96 @@ template<typename Real> static void UnitTestEigSp() {
   }    
 }
 
+// Tests SpMatrix::Eig() for larger dimensions, where it uses LAPACK (if
+// available), including the case with no eigenvectors.
+static void UnitTestBlasNumThreads() {
+  int32 num_threads = GetBlasNumThreads();
+  KALDI_ASSERT(num_threads >= 1);
+  {
+    BlasThreadScope scope(1);
+    KALDI_ASSERT(GetBlasNumThreads() == 1);
+  }
+  KALDI_ASSERT(GetBlasNumThreads() == num_threads);
+}
+
+// Tests the full-storage code paths of AddMat2Sp(), Invert() and Cholesky(),
+// which are used from dimension SpMatrix<Real>::kFullStorageMinDim.
+template<typename Real> static void UnitTestSpFullStorage() {
+  for (MatrixIndexT iter = 0; iter < 10; iter++) {
+    MatrixIndexT dim = 5 + Rand() % 60, other_dim = 1 + Rand() % 40;
+    MatrixTransposeType trans = (iter % 2 == 0 ? kNoTrans : kTrans);
+    Matrix<Real> M(trans == kNoTrans ? dim : other_dim,
+                   trans == kNoTrans ? other_dim : dim);
+    M.SetRandn();
+    SpMatrix<Real> A(other_dim), S(dim), S2(dim);
+    A.SetRandn();
+    S.SetRandn();
+    S2.CopyFromSp(S);
+    S.AddMat2Sp(0.5, M, trans, A, 2.0);
+    Matrix<Real> A_full(A), MA(dim, other_dim), S2_full(S2);
+    MA.AddMatMat(1.0, M, trans, A_full, kNoTrans, 0.0);
+    S2_full.AddMatMat(0.5, MA, kNoTrans, M,
+                      (trans == kNoTrans ? kTrans : kNoTrans), 2.0);
+    S2.CopyFromMat(S2_full, kTakeLower);
+    AssertEqual(S, S2);
+
+    // A positive definite matrix, and (for odd iter) an indefinite one.
+    SpMatrix<Real> P(dim);
+    Matrix<Real> N(dim, dim + 5);
+    N.SetRandn();
+    P.AddMat2(1.0, N, kNoTrans, 0.0);
+    if (iter % 2 == 1) P.AddToDiag(-P.Trace() / dim);
+    Matrix<Real> P_full(P);
+    Real logdet, det_sign, logdet2, det_sign2;
+    P_full.Invert(&logdet2, &det_sign2);
+    SpMatrix<Real> Pinv(P);
+    Pinv.Invert(&logdet, &det_sign);
+    SpMatrix<Real> Pinv2(dim);
+    Pinv2.CopyFromMat(P_full, kTakeLower);
+    AssertEqual(Pinv, Pinv2);
+    AssertEqual(logdet, logdet2, 0.01);
+    KALDI_ASSERT(det_sign == det_sign2);
+
+    if (iter % 2 == 0) {
+      TpMatrix<Real> L(dim);
+      L.Cholesky(P);
+      SpMatrix<Real> P2(dim);
+      P2.AddTp2(1.0, L, kNoTrans, 0.0);
+      AssertEqual(P, P2);
+    }
+  }
+}
+
+template<typename Real> static void UnitTestEigSpLarge() {
+  for (MatrixIndexT iter = 0; iter < 4; iter++) {
+    MatrixIndexT dim = 40 + Rand() % 100;
+    SpMatrix<Real> S(dim);
+    S.SetRandn();
+    if (iter % 2 == 1) {
+      // Give it a repeated eigenvalue and a zero eigenspace.
+      Vector<Real> s(dim); Matrix<Real> P(dim, dim);
+      S.Eig(&s, &P);
+      for (MatrixIndexT i = 0; i < dim / 4; i++) {
+        s(i) = 0.0;
+        s(dim - 1 - i) = 2.0;
+      }
+      S.AddMat2Vec(1.0, P, kNoTrans, s, 0.0);
+    }
+    Vector<Real> s(dim), s2(dim); Matrix<Real> P(dim, dim);
+    S.Eig(&s, &P);
+    SpMatrix<Real> I(dim), S2(dim);
+    I.AddMat2(1.0, P, kTrans, 0.0);
+    KALDI_ASSERT(I.IsUnit(1.0e-03));
+    S2.AddMat2Vec(1.0, P, kNoTrans, s, 0.0);
+    KALDI_ASSERT(S.ApproxEqual(S2, 1.0e-03));
+    // The eigenvalues should be the same without the eigenvectors.
+    S.Eig(&s2);
+    std::sort(s.Data(), s.Data() + dim);
+    std::sort(s2.Data(), s2.Data() + dim);
+    AssertEqual(s, s2);
+  }
+}
+
 // TEMP!
 template<typename Real>
 static Real NonOrthogonality(const MatrixBase<Real> &M, MatrixTransposeType transM) {
@@ -2394,6 +2484,29 @@ template<typename Real> static void  UnitTestMat2Vec() {
     B3.AddMat2Vec(1.0, PT, kTrans, s, 0.0);
     AssertEqual(B, B3);
   }
+  // Compare with rank-one updates, with weights of both signs and
+  // non-square matrices.
+  for (MatrixIndexT i = 0; i < 5; i++) {
+    MatrixIndexT dim = 5 + Rand() % 30, num_terms = 5 + Rand() % 50;
+    Matrix<Real> M(num_terms, dim);
+    M.SetRandn();
+    Vector<Real> v(num_terms);
+    v.SetRandn();
+    if (i % 2 == 0) v.ApplyAbs();
+    if (num_terms > 1) v(0) = 0.0;
+    SpMatrix<Real> A(dim), B(dim), C(dim);
+    A.SetUnit();
+    B.SetUnit();
+    C.SetUnit();
+    for (MatrixIndexT j = 0; j < num_terms; j++)
+      A.AddVec2(0.5 * v(j), M.Row(j));
+    A.AddToDiag(1.0);  // beta = 2.0, below.
+    B.AddMat2Vec(0.5, M, kTrans, v, 2.0);
+    Matrix<Real> MT(M, kTrans);
+    C.AddMat2Vec(0.5, MT, kNoTrans, v, 2.0);
+    AssertEqual(A, B);
+    AssertEqual(A, C);
+  }
 }
 
 template<typename Real> static void  UnitTestLimitCond() {
@@ -3702,6 +3815,27 @@ template<typename Real> static void UnitTestSplitRadixRealFft() {
 }
 
 
+// Checks the version of SplitRadixRealFft::Compute() that transforms each
+// row of a matrix against the version that does one vector.
+template<typename Real> static void UnitTestSplitRadixRealFftRows() {
+  for (MatrixIndexT p = 0; p < 10; p++) {
+    MatrixIndexT logn = 2 + Rand() % 9, N = 1 << logn,
+        num_rows = 1 + Rand() % 20;
+    SplitRadixRealFft<Real> srfft(N);
+    std::vector<Real> temp_buffer;
+    Matrix<Real> M(num_rows, N), M2(num_rows, N);
+    M.SetRandn();
+    M2.CopyFromMat(M);
+    bool forward = (Rand() % 2 == 0);
+    if (Rand() % 2 == 0)
+      srfft.Compute(&M, forward);
+    else
+      srfft.Compute(&M, forward, &temp_buffer);
+    for (MatrixIndexT r = 0; r < num_rows; r++)
+      srfft.Compute(M2.RowData(r), forward, &temp_buffer);
+    AssertEqual(M, M2, 0.001);
+  }
+}
 
 template<typename Real> static void UnitTestRealFftSpeed() {
 
@@ -4120,6 +4254,134 @@ static void UnitTestSvdSpeed() {
   }
 }
 
+// Checks that compressing and decompressing with several threads gives the
+// same result as with one.
+template<typename Real> static void UnitTestCompressedMatrixThreaded() {
+  for (MatrixIndexT n = 0; n < 4; n++) {
+    // Format 2 (all uint16) is used for 8 rows or fewer.
+    MatrixIndexT num_rows = (n % 2 == 0 ? 100 + Rand() % 2000 :
+                             1 + Rand() % 8),
+        num_cols = (n % 2 == 0 ? 100 + Rand() % 200 :
+                    30000 + Rand() % 30000);
+    int32 num_threads = 2 + Rand() % 4;
+    Matrix<Real> M(num_rows, num_cols);
+    M.SetRandn();
+    CompressedMatrix cmat(M), cmat_threaded(M, num_threads);
+    Matrix<Real> M2(num_rows, num_cols), M3(num_rows, num_cols),
+        M4(num_rows, num_cols);
+    cmat.CopyToMat(&M2);
+    cmat_threaded.CopyToMat(&M3);
+    cmat.CopyToMat(&M4, kNoTrans, num_threads);
+    AssertEqual(M2, M3, 0.0);
+    AssertEqual(M2, M4, 0.0);
+  }
+}
+
+template<typename Real> static void UnitTestCompressedMatrixConcatenate() {
+  for (MatrixIndexT n = 0; n < 50; n++) {
+    // The parts have formats 1 and 2 (8 rows or fewer), and some are empty
+    // or already concatenated.
+    MatrixIndexT num_cols = 1 + Rand() % 20, num_parts = 1 + Rand() % 5;
+    std::vector<CompressedMatrix*> parts;
+    std::vector<Matrix<Real> > part_mats;
+    for (MatrixIndexT i = 0; i < num_parts; i++) {
+      MatrixIndexT num_rows = (Rand() % 5 == 0 ? 0 : 1 + Rand() % 20);
+      Matrix<Real> M(num_rows, (num_rows == 0 ? 0 : num_cols));
+      M.SetRandn();
+      parts.push_back(new CompressedMatrix(M));
+      if (Rand() % 4 == 0 && num_rows != 0) {
+        std::vector<const CompressedMatrix*> two(2, parts.back());
+        parts.back()->ConcatenateRows(two);
+      }
+      Matrix<Real> M2(parts.back()->NumRows(), parts.back()->NumCols());
+      parts.back()->CopyToMat(&M2);
+      part_mats.push_back(M2);
+    }
+    CompressedMatrix cmat;
+    cmat.ConcatenateRows(std::vector<const CompressedMatrix*>(parts.begin(),
+                                                              parts.end()));
+    MatrixIndexT num_rows = 0;
+    for (MatrixIndexT i = 0; i < num_parts; i++)
+      num_rows += part_mats[i].NumRows();
+    KALDI_ASSERT(cmat.NumRows() == num_rows);
+    if (num_rows == 0) {
+      DeletePointers(&parts);
+      continue;
+    }
+    KALDI_ASSERT(cmat.NumCols() == num_cols);
+    // The values must be exactly those of the parts.
+    Matrix<Real> ref(num_rows, num_cols);
+    for (MatrixIndexT i = 0, row = 0; i < num_parts; i++) {
+      if (part_mats[i].NumRows() == 0) continue;
+      ref.Range(row, part_mats[i].NumRows(), 0, num_cols).CopyFromMat(
+          part_mats[i]);
+      row += part_mats[i].NumRows();
+    }
+    DeletePointers(&parts);
+
+    Matrix<Real> M(num_rows, num_cols), M_trans(num_cols, num_rows);
+    cmat.CopyToMat(&M);
+    AssertEqual(M, ref, 0.0);
+    cmat.CopyToMat(&M_trans, kTrans);
+    M_trans.Transpose();
+    AssertEqual(M_trans, ref, 0.0);
+
+    Vector<Real> row(num_cols), col(num_rows);
+    MatrixIndexT r = Rand() % num_rows, c = Rand() % num_cols;
+    cmat.CopyRowToVec(r, &row);
+    Vector<Real> ref_row(ref.Row(r));
+    AssertEqual(row, ref_row, 0.0);
+    cmat.CopyColToVec(c, &col);
+    Vector<Real> ref_col(num_rows);
+    ref_col.CopyColFromMat(ref, c);
+    AssertEqual(col, ref_col, 0.0);
+
+    MatrixIndexT row_offset = Rand() % num_rows,
+        sub_rows = 1 + Rand() % (num_rows - row_offset),
+        col_offset = Rand() % num_cols,
+        sub_cols = 1 + Rand() % (num_cols - col_offset);
+    SubMatrix<Real> ref_sub(ref, row_offset, sub_rows, col_offset, sub_cols);
+    Matrix<Real> sub(sub_rows, sub_cols);
+    cmat.CopyToMat(row_offset, col_offset, &sub);
+    AssertEqual(sub, ref_sub, 0.0);
+    CompressedMatrix sub_cmat(cmat, row_offset, sub_rows, col_offset,
+                              sub_cols);
+    Matrix<Real> sub2(sub_rows, sub_cols);
+    sub_cmat.CopyToMat(&sub2);
+    // Parts of fewer than 8 rows taken from a block in the per-column
+    // format are recompressed, so these are only approximately equal.
+    KALDI_ASSERT(sub2.ApproxEqual(ref_sub, 0.01));
+
+    CompressedMatrix cmat2;
+    cmat2.CopyFromData(cmat.Data(), cmat.DataSizeInBytes());
+    Matrix<Real> M2(num_rows, num_cols);
+    cmat2.CopyToMat(&M2);
+    AssertEqual(M2, ref, 0.0);
+
+    {
+      std::ostringstream os;
+      cmat.Write(os, true);
+      CompressedMatrix cmat3;
+      std::istringstream is(os.str());
+      cmat3.Read(is, true);
+      KALDI_ASSERT(cmat3.DataSizeInBytes() == cmat.DataSizeInBytes());
+      Matrix<Real> M3(num_rows, num_cols);
+      cmat3.CopyToMat(&M3);
+      AssertEqual(M3, ref, 0.0);
+      // A concatenated compressed matrix can also be read as a Matrix.
+      std::istringstream is2(os.str());
+      Matrix<Real> M4;
+      M4.Read(is2, true);
+      AssertEqual(M4, ref, 0.0);
+    }
+    // "this" may be one of the inputs.
+    std::vector<const CompressedMatrix*> self(1, &cmat);
+    self.push_back(&cmat2);
+    cmat.ConcatenateRows(self);
+    KALDI_ASSERT(cmat.NumRows() == 2 * num_rows);
+  }
+}
+
 template<typename Real> static void UnitTestCompressedMatrix() {
   // This is the basic test.
 
@@ -4547,6 +4809,8 @@ template<typename Real> static void MatrixUnitTest(bool full_test) {
   UnitTestLbfgs<Real>();
   // UnitTestSvdBad<Real>(); // test bug in Jama SVD code.
   UnitTestCompressedMatrix<Real>();
+  UnitTestCompressedMatrixConcatenate<Real>();
+  UnitTestCompressedMatrixThreaded<Real>();
   UnitTestExtractCompressedMatrix<Real>();
   UnitTestResize<Real>();
   UnitTestMatrixExponentialBackprop();
@@ -4557,6 +4821,9 @@ template<typename Real> static void MatrixUnitTest(bool full_test) {
   UnitTestComplexPower<Real>();
   UnitTestEig<Real>();
   UnitTestEigSp<Real>();
+  UnitTestEigSpLarge<Real>();
+  UnitTestSpFullStorage<Real>();
+  UnitTestBlasNumThreads();
   // commenting these out for now-- they test the speed, but take a while.
   // UnitTestSplitRadixRealFftSpeed<Real>();
   // UnitTestRealFftSpeed<Real>();   // won't exit!/
@@ -4570,6 +4837,7 @@ template<typename Real> static void MatrixUnitTest(bool full_test) {
   UnitTestRealFft<Real>();
   KALDI_LOG << " Point C";
   UnitTestSplitRadixRealFft<Real>();
+  UnitTestSplitRadixRealFftRows<Real>();
   UnitTestSvd<Real>();
   UnitTestSvdNodestroy<Real>();
   UnitTestSvdJustvec<Real>();
@@ -0,0 +1,220 @@
+// matrix/matrix-memory-pool-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <pthread.h>
+#include "base/kaldi-memory-stats.h"
+#include "matrix/matrix-lib.h"
+#include "matrix/matrix-memory-pool.h"
+
+namespace kaldi {
+
+static void UnitTestMatrixMemoryAllocate() {
+  // Without a pool.
+  for (int32 i = 0; i < 100; i++) {
+    size_t num_bytes = RandInt(1, 100000);
+    char *data = static_cast<char*>(MatrixMemoryAllocate(num_bytes));
+    KALDI_ASSERT(reinterpret_cast<size_t>(data) % 16 == 0);
+    memset(data, 0, num_bytes);
+    MatrixMemoryFree(data);
+  }
+  MatrixMemoryFree(NULL);
+
+  MatrixMemoryPool pool;
+  {
+    ScopedMatrixMemoryPool scoped_pool(&pool);
+    std::vector<char*> blocks;
+    std::vector<size_t> sizes;
+    for (int32 i = 0; i < 1000; i++) {
+      if (blocks.empty() || RandInt(0, 2) != 0) {
+        size_t num_bytes = RandInt(1, 10000);
+        char *data = static_cast<char*>(MatrixMemoryAllocate(num_bytes));
+        KALDI_ASSERT(reinterpret_cast<size_t>(data) % 16 == 0);
+        memset(data, i % 256, num_bytes);
+        blocks.push_back(data);
+        sizes.push_back(num_bytes);
+      } else {
+        size_t j = RandInt(0, blocks.size() - 1);
+        char *data = blocks[j];
+        // Check that no other allocation overwrote the block.
+        for (size_t k = 0; k < sizes[j]; k++)
+          KALDI_ASSERT(data[k] == data[0]);
+        MatrixMemoryFree(data);
+        blocks[j] = blocks.back();
+        sizes[j] = sizes.back();
+        blocks.pop_back();
+        sizes.pop_back();
+      }
+    }
+    for (size_t j = 0; j < blocks.size(); j++)
+      MatrixMemoryFree(blocks[j]);
+  }
+  KALDI_ASSERT(pool.NumAllocations() > 0 && pool.NumCacheHits() > 0);
+  pool.PrintStats();
+}
+
+template<typename Real>
+static void UnitTestMatrixMemoryPoolTemporaries() {
+  MatrixMemoryPool pool;
+  Matrix<Real> outlives_pool;
+  {
+    ScopedMatrixMemoryPool scoped_pool(&pool);
+    Matrix<Real> m(10, 20);
+    m.SetRandn();
+    for (int32 i = 0; i < 100; i++) {
+      // The same-sized temporaries should come from the cache after the
+      // first time.
+      Matrix<Real> temp(m);
+      Vector<Real> row_sums(m.NumRows());
+      row_sums.AddColSumMat(1.0, temp);
+      AssertEqual(row_sums.Sum(), m.Sum());
+    }
+    KALDI_ASSERT(pool.NumCacheHits() >= 2 * 99);
+
+    outlives_pool.Resize(5, 5);
+    outlives_pool.SetRandn();
+  }
+  // This memory is freed after the pool has been destroyed; that's allowed.
+  Matrix<Real> copy(outlives_pool);
+  AssertEqual(copy, outlives_pool);
+
+  // Memory allocated without a pool may be freed while one is in use.
+  Vector<Real> *v = new Vector<Real>(100);
+  {
+    ScopedMatrixMemoryPool scoped_pool(&pool);
+    delete v;
+  }
+}
+
+static void UnitTestMatrixMemoryPoolLimits() {
+  MatrixMemoryPoolOptions opts;
+  opts.max_block_bytes = 1000;
+  opts.max_bytes_cached = 5000;
+  MatrixMemoryPool pool(opts), inner_pool;
+  ScopedMatrixMemoryPool scoped_pool(&pool);
+  {
+    // Nested pools: the inner one is used until it goes out of scope.
+    ScopedMatrixMemoryPool inner_scoped_pool(&inner_pool);
+    Vector<BaseFloat> v(10);
+  }
+  KALDI_ASSERT(pool.NumAllocations() == 0 &&
+               inner_pool.NumAllocations() == 1);
+  {
+    Vector<BaseFloat> big(10000);  // too big to be cached.
+  }
+  KALDI_ASSERT(pool.BytesCached() == 0);
+  {
+    std::vector<Vector<BaseFloat>*> vecs;
+    for (int32 i = 0; i < 20; i++)
+      vecs.push_back(new Vector<BaseFloat>(200));
+    for (int32 i = 0; i < 20; i++)
+      delete vecs[i];
+  }
+  KALDI_ASSERT(pool.BytesCached() > 0 && pool.BytesCached() <= 5000);
+  pool.ReleaseCachedMemory();
+  KALDI_ASSERT(pool.BytesCached() == 0);
+}
+
+// Each thread uses its own pool, and frees matrices allocated by the other
+// threads.
+static std::vector<Matrix<BaseFloat>*> g_matrices;
+
+static void *TestThread(void *arg) {
+  int32 thread_index = *static_cast<int32*>(arg);
+  MatrixMemoryPool pool;
+  ScopedMatrixMemoryPool scoped_pool(&pool);
+  for (int32 i = 0; i < 100; i++) {
+    Matrix<BaseFloat> temp(RandInt(1, 20), RandInt(1, 20));
+    temp.Set(thread_index);
+    KALDI_ASSERT(temp.Sum() == thread_index * temp.NumRows() * temp.NumCols());
+  }
+  delete g_matrices[thread_index];
+  return NULL;
+}
+
+static void UnitTestMatrixMemoryPoolThreads() {
+  const int32 num_threads = 4;
+  MatrixMemoryPool pool;
+  std::vector<int32> thread_indexes(num_threads);
+  {
+    ScopedMatrixMemoryPool scoped_pool(&pool);
+    for (int32 i = 0; i < num_threads; i++) {
+      g_matrices.push_back(new Matrix<BaseFloat>(10, 10));
+      thread_indexes[i] = i;
+    }
+  }
+  std::vector<pthread_t> threads(num_threads);
+  for (int32 i = 0; i < num_threads; i++)
+    KALDI_ASSERT(pthread_create(&(threads[i]), NULL, TestThread,
+                                &(thread_indexes[i])) == 0);
+  for (int32 i = 0; i < num_threads; i++)
+    pthread_join(threads[i], NULL);
+  g_matrices.clear();
+}
+
+static void UnitTestMatrixMemoryStats() {
+  // Memory allocated before the statistics were enabled is not counted, even
+  // when it's freed.
+  Vector<BaseFloat> *before = new Vector<BaseFloat>(1000);
+  EnableMemoryStats();
+  int64 nnet_bytes = GetMemoryStats(kMemoryNnet).current_bytes,
+      feature_bytes = GetMemoryStats(kMemoryFeature).current_bytes;
+  delete before;
+  MatrixMemoryPool pool;
+  Matrix<BaseFloat> *m;
+  {
+    MemoryTagScope nnet_scope(kMemoryNnet);
+    Matrix<BaseFloat> temp(100, 100);
+    KALDI_ASSERT(GetMemoryStats(kMemoryNnet).current_bytes >=
+                 nnet_bytes + static_cast<int64>(sizeof(BaseFloat)) * 10000);
+    {
+      MemoryTagScope feature_scope(kMemoryFeature);
+      ScopedMatrixMemoryPool scoped_pool(&pool);
+      m = new Matrix<BaseFloat>(10, 10);
+    }
+    KALDI_ASSERT(CurrentMemoryTag() == kMemoryNnet);
+  }
+  KALDI_ASSERT(CurrentMemoryTag() == kMemoryOther);
+  KALDI_ASSERT(GetMemoryStats(kMemoryNnet).current_bytes == nnet_bytes &&
+               GetMemoryStats(kMemoryNnet).peak_bytes >= nnet_bytes + 40000);
+  KALDI_ASSERT(GetMemoryStats(kMemoryFeature).current_bytes > feature_bytes);
+  {
+    // It's charged to the tag it was allocated under, wherever it's freed,
+    // and also if it goes back to a pool.
+    ScopedMatrixMemoryPool scoped_pool(&pool);
+    MemoryTagScope nnet_scope(kMemoryNnet);
+    delete m;
+  }
+  KALDI_ASSERT(GetMemoryStats(kMemoryFeature).current_bytes == feature_bytes);
+  KALDI_ASSERT(pool.BytesCached() > 0);
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  UnitTestMatrixMemoryAllocate();
+  UnitTestMatrixMemoryPoolTemporaries<float>();
+  UnitTestMatrixMemoryPoolTemporaries<double>();
+  UnitTestMatrixMemoryPoolLimits();
+  UnitTestMatrixMemoryPoolThreads();
+  UnitTestMatrixMemoryStats();
+  KALDI_LOG << "Tests succeeded.";
+  return 0;
+}
@@ -0,0 +1,219 @@
+// matrix/matrix-memory-pool.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <pthread.h>
+#include "base/kaldi-memory-stats.h"
+#include "matrix/matrix-memory-pool.h"
+
+namespace kaldi {
+
+// Each block of memory starts with this header, which says how the block was
+// allocated; the caller's data starts after it.  Its size keeps the data
+// aligned to 16 bytes.
+struct MatrixMemoryHeader {
+  int32 size_class;  // -1 if the block was allocated with no size class,
+                     // else its size class (see SizeClassBytes()).
+  int32 memory_tag;  // the MemoryTag it's counted under, or -1 if it's not
+                     // counted in the memory statistics.
+  int64 num_bytes;   // the size of the block, if it's counted.
+};
+
+// The size in bytes, including the header, of blocks of size class c.  There
+// are four classes per power of two, starting at 64 bytes: 64, 80, 96, 112,
+// 128, 160, ...
+static inline size_t SizeClassBytes(int32 c) {
+  return static_cast<size_t>(4 + c % 4) * 16 << (c / 4);
+}
+
+// Returns the smallest size class whose blocks have at least "num_bytes"
+// bytes (including the header).
+static inline int32 SizeClassForBytes(size_t num_bytes) {
+  if (num_bytes <= 64)
+    return 0;
+  int32 octave = 0;
+  while ((static_cast<size_t>(64) << (octave + 1)) < num_bytes)
+    octave++;
+  // Now 64 << octave < num_bytes <= 64 << (octave + 1).
+  size_t step = static_cast<size_t>(16) << octave;
+  int32 sub = static_cast<int32>(
+      (num_bytes - (static_cast<size_t>(64) << octave) + step - 1) / step);
+  return 4 * octave + sub;
+}
+
+// Allocates a block of "num_bytes" bytes (including the header) from the
+// system, and sets up its header.  Returns the start of the caller's data.
+static void *SystemAllocate(size_t num_bytes, int32 size_class) {
+  void *data, *free_data;
+  if ((data = KALDI_MEMALIGN(16, num_bytes, &free_data)) == NULL)
+    throw std::bad_alloc();
+  MatrixMemoryHeader *header = static_cast<MatrixMemoryHeader*>(data);
+  header->size_class = size_class;
+  header->num_bytes = num_bytes;
+  return header + 1;
+}
+
+// Counts the block in the memory statistics, if they are enabled, and returns
+// the start of the caller's data.
+static inline void *CountBlock(MatrixMemoryHeader *header) {
+  if (MemoryStatsEnabled()) {
+    MemoryTag tag = CurrentMemoryTag();
+    header->memory_tag = tag;
+    MemoryStatsAdd(tag, header->num_bytes);
+  } else {
+    header->memory_tag = -1;
+  }
+  return header + 1;
+}
+
+// The key for the per-thread pointer to the pool that the thread is using (if
+// any).
+static pthread_key_t g_pool_key;
+static pthread_once_t g_pool_key_once = PTHREAD_ONCE_INIT;
+
+static void CreatePoolKey() {
+  if (pthread_key_create(&g_pool_key, NULL) != 0)
+    KALDI_ERR << "pthread_key_create failed";
+}
+
+static inline MatrixMemoryPool *ThreadPool() {
+  pthread_once(&g_pool_key_once, CreatePoolKey);
+  return static_cast<MatrixMemoryPool*>(pthread_getspecific(g_pool_key));
+}
+
+static inline void SetThreadPool(MatrixMemoryPool *pool) {
+  pthread_once(&g_pool_key_once, CreatePoolKey);
+  if (pthread_setspecific(g_pool_key, pool) != 0)
+    KALDI_ERR << "pthread_setspecific failed";
+}
+
+void *MatrixMemoryAllocate(size_t num_bytes) {
+  KALDI_ASSERT(num_bytes > 0);
+  size_t total_bytes = num_bytes + sizeof(MatrixMemoryHeader);
+  MatrixMemoryPool *pool = ThreadPool();
+  void *data;
+  if (pool == NULL) {
+    data = SystemAllocate(total_bytes, -1);
+  } else {
+    pool->num_allocations_++;
+    if (total_bytes > pool->opts_.max_block_bytes) {
+      data = SystemAllocate(total_bytes, -1);
+    } else {
+      int32 size_class = SizeClassForBytes(total_bytes);
+      void *block = pool->Allocate(size_class);
+      if (block != NULL)
+        data = static_cast<MatrixMemoryHeader*>(block) + 1;
+      else
+        data = SystemAllocate(SizeClassBytes(size_class), size_class);
+    }
+  }
+  return CountBlock(static_cast<MatrixMemoryHeader*>(data) - 1);
+}
+
+void MatrixMemoryFree(void *data) {
+  if (data == NULL)
+    return;
+  MatrixMemoryHeader *header = static_cast<MatrixMemoryHeader*>(data) - 1;
+  if (header->memory_tag >= 0)
+    MemoryStatsAdd(static_cast<MemoryTag>(header->memory_tag),
+                   -header->num_bytes);
+  int32 size_class = header->size_class;
+  MatrixMemoryPool *pool = ThreadPool();
+  if (pool != NULL) {
+    pool->num_frees_++;
+    if (size_class >= 0 && pool->Free(size_class, header))
+      return;
+  }
+  KALDI_MEMALIGN_FREE(header);
+}
+
+
+MatrixMemoryPool::MatrixMemoryPool(const MatrixMemoryPoolOptions &opts):
+    opts_(opts), bytes_cached_(0), max_bytes_cached_(0),
+    num_allocations_(0), num_cache_hits_(0), num_frees_(0),
+    num_frees_cached_(0) {
+  KALDI_ASSERT(opts.max_block_bytes > 0);
+  free_blocks_.resize(SizeClassForBytes(opts.max_block_bytes) + 1);
+}
+
+MatrixMemoryPool::~MatrixMemoryPool() {
+  ReleaseCachedMemory();
+}
+
+void MatrixMemoryPool::ReleaseCachedMemory() {
+  for (size_t c = 0; c < free_blocks_.size(); c++) {
+    std::vector<void*> &blocks = free_blocks_[c];
+    for (size_t i = 0; i < blocks.size(); i++)
+      KALDI_MEMALIGN_FREE(blocks[i]);
+    blocks.clear();
+  }
+  bytes_cached_ = 0;
+}
+
+void *MatrixMemoryPool::Allocate(int32 size_class) {
+  if (size_class >= static_cast<int32>(free_blocks_.size()))
+    return NULL;
+  std::vector<void*> &blocks = free_blocks_[size_class];
+  if (blocks.empty())
+    return NULL;
+  void *block = blocks.back();
+  blocks.pop_back();
+  bytes_cached_ -= SizeClassBytes(size_class);
+  num_cache_hits_++;
+  return block;
+}
+
+bool MatrixMemoryPool::Free(int32 size_class, void *block) {
+  size_t num_bytes = SizeClassBytes(size_class);
+  // Blocks allocated by a pool with a larger max_block_bytes may be freed
+  // here; those we don't cache.
+  if (size_class >= static_cast<int32>(free_blocks_.size()) ||
+      bytes_cached_ + num_bytes > opts_.max_bytes_cached)
+    return false;
+  free_blocks_[size_class].push_back(block);
+  bytes_cached_ += num_bytes;
+  if (bytes_cached_ > max_bytes_cached_)
+    max_bytes_cached_ = bytes_cached_;
+  num_frees_cached_++;
+  return true;
+}
+
+void MatrixMemoryPool::PrintStats() const {
+  KALDI_LOG << "Matrix memory pool: " << num_allocations_ << " allocations, "
+            << "of which " << num_cache_hits_ << " ("
+            << (num_allocations_ == 0 ? 0.0 :
+                100.0 * num_cache_hits_ / num_allocations_)
+            << "%) came from the cache; " << num_frees_ << " frees, of which "
+            << num_frees_cached_ << " were cached.  Currently "
+            << bytes_cached_ << " bytes cached, maximum was "
+            << max_bytes_cached_ << " bytes.";
+}
+
+
+ScopedMatrixMemoryPool::ScopedMatrixMemoryPool(MatrixMemoryPool *pool):
+    previous_pool_(ThreadPool()) {
+  SetThreadPool(pool);
+}
+
+ScopedMatrixMemoryPool::~ScopedMatrixMemoryPool() {
+  SetThreadPool(previous_pool_);
+}
+
+
+} // end namespace kaldi.
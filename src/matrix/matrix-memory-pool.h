@@ -0,0 +1,146 @@
+// matrix/matrix-memory-pool.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_MATRIX_MATRIX_MEMORY_POOL_H_
+#define KALDI_MATRIX_MATRIX_MEMORY_POOL_H_
+
+#include <vector>
+#include "base/kaldi-common.h"
+
+namespace kaldi {
+
+/// \file matrix-memory-pool.h
+/// Memory allocation for the data of Matrix and Vector.  Normally each
+/// allocation goes to malloc() (via posix_memalign()), but code that creates
+/// and destroys many temporaries of the same few sizes (e.g. per frame) can
+/// make the calling thread allocate from a MatrixMemoryPool instead, by
+/// creating a ScopedMatrixMemoryPool:
+/// \code
+///   MatrixMemoryPool pool;
+///   {
+///     ScopedMatrixMemoryPool scoped_pool(&pool);
+///     ... decode ...
+///   }
+///   pool.PrintStats();
+/// \endcode
+/// Memory allocated in one place may safely be freed in any other: memory
+/// that was allocated from a pool may outlive the pool or be freed by another
+/// thread, and it goes back to the pool of whichever thread frees it (or to
+/// the system, if that thread has no pool).
+
+/// Allocates "num_bytes" bytes, aligned to 16 bytes, from the calling thread's
+/// MatrixMemoryPool if it has one, else from the system.  Throws
+/// std::bad_alloc on failure.  "num_bytes" must be > 0.
+void *MatrixMemoryAllocate(size_t num_bytes);
+
+/// Frees memory allocated by MatrixMemoryAllocate(), returning it to the
+/// calling thread's MatrixMemoryPool if it has one and the memory is of a
+/// size that the pool caches, else to the system.  "data" may be NULL.
+void MatrixMemoryFree(void *data);
+
+
+struct MatrixMemoryPoolOptions {
+  // Allocations larger than this many bytes are not cached, but go straight
+  // to the system.
+  size_t max_block_bytes;
+  // The most memory, in bytes, that the pool will hold for reuse; memory that
+  // is freed when the pool is full goes back to the system.
+  size_t max_bytes_cached;
+
+  MatrixMemoryPoolOptions(): max_block_bytes(1 << 24),
+                             max_bytes_cached(1 << 28) { }
+};
+
+/**
+   MatrixMemoryPool caches memory freed by Matrix and Vector (see
+   MatrixMemoryFree()) and hands it out again for later allocations of a
+   similar size, which is much faster than malloc() and free().  Requests are
+   rounded up to one of a set of size classes, four per power of two (so at
+   most about 19% of each block is wasted), and each class has a list of free
+   blocks.
+
+   The pool is used by a thread while a ScopedMatrixMemoryPool for it exists.
+   It is not thread-safe: only one thread at a time may use a given pool, so
+   multi-threaded programs would have one pool per thread.
+*/
+class MatrixMemoryPool {
+ public:
+  explicit MatrixMemoryPool(
+      const MatrixMemoryPoolOptions &opts = MatrixMemoryPoolOptions());
+
+  /// Frees the cached memory.  Memory that is still in use is not affected.
+  ~MatrixMemoryPool();
+
+  /// Returns the cached memory to the system.
+  void ReleaseCachedMemory();
+
+  /// The number of allocations requested while this pool was in use.
+  int64 NumAllocations() const { return num_allocations_; }
+  /// The number of those that were served from the cache.
+  int64 NumCacheHits() const { return num_cache_hits_; }
+  /// The memory currently cached, in bytes.
+  size_t BytesCached() const { return bytes_cached_; }
+
+  /// Prints (with KALDI_LOG) the number of allocations and frees and the
+  /// fraction served from the cache, and the peak amount of memory cached.
+  void PrintStats() const;
+
+ private:
+  friend void *MatrixMemoryAllocate(size_t num_bytes);
+  friend void MatrixMemoryFree(void *data);
+
+  // Returns a block of the size class "size_class" from the cache, or NULL.
+  void *Allocate(int32 size_class);
+  // Returns true if the block (of size class "size_class") was cached, false
+  // if it has to be returned to the system.
+  bool Free(int32 size_class, void *block);
+
+  MatrixMemoryPoolOptions opts_;
+  // free_blocks_[c] is the list of cached blocks of size class c.
+  std::vector<std::vector<void*> > free_blocks_;
+  size_t bytes_cached_;
+  size_t max_bytes_cached_;  // the maximum that bytes_cached_ has reached.
+  int64 num_allocations_;
+  int64 num_cache_hits_;
+  int64 num_frees_;
+  int64 num_frees_cached_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MatrixMemoryPool);
+};
+
+
+/// While an object of this class exists, the Matrix and Vector allocations
+/// (and frees) of the thread that created it use "pool"; if "pool" is NULL,
+/// they go to the system.  These objects may be nested; the destructor
+/// restores the previous pool of the thread.  They must be destroyed by the
+/// thread that created them, in the reverse order of creation.
+class ScopedMatrixMemoryPool {
+ public:
+  explicit ScopedMatrixMemoryPool(MatrixMemoryPool *pool);
+  ~ScopedMatrixMemoryPool();
+ private:
+  MatrixMemoryPool *previous_pool_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(ScopedMatrixMemoryPool);
+};
+
+
+} // end namespace kaldi.
+
+#endif
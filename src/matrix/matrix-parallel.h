@@ -0,0 +1,67 @@
+// matrix/matrix-parallel.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_MATRIX_MATRIX_PARALLEL_H_
+#define KALDI_MATRIX_MATRIX_PARALLEL_H_
+
+#include <pthread.h>
+#include <cstring>
+#include <vector>
+#include "base/kaldi-common.h"
+#include "matrix/kaldi-blas.h"
+
+namespace kaldi {
+
+/// This is a helper for the matrix operations that can optionally use more
+/// than one thread, like CompressedMatrix::CopyFromMat().  (The matrix library
+/// can't use the thread library, which comes after it in the link order, so
+/// it uses pthreads directly).  Class C describes the work to be done on a
+/// range begin <= i < end of rows, columns or whatever; it must be copyable
+/// and have members "int32 begin, end" and "static void *Run(void *part)",
+/// where "part" is a C*.  This function divides [0, num_items) into at most
+/// "num_threads" roughly equal parts, and runs each one in its own thread
+/// (the first one in the calling thread), returning when they are all done.
+/// While it runs, BLAS is limited to one thread (see SetBlasNumThreads()).
+template<class C>
+void RunMatrixParts(const C &part, int32 num_items, int32 num_threads) {
+  if (num_threads > num_items) num_threads = num_items;
+  std::vector<C> parts(std::max(num_threads, 1), part);
+  int32 num_parts = parts.size();
+  for (int32 i = 0; i < num_parts; i++) {
+    parts[i].begin = (static_cast<int64>(num_items) * i) / num_parts;
+    parts[i].end = (static_cast<int64>(num_items) * (i + 1)) / num_parts;
+  }
+  BlasThreadScope blas_threads(num_parts > 1 ? 1 : GetBlasNumThreads());
+  std::vector<pthread_t> threads(num_parts);
+  for (int32 i = 1; i < num_parts; i++) {
+    int32 ret = pthread_create(&(threads[i]), NULL, &C::Run, &(parts[i]));
+    if (ret != 0)
+      KALDI_ERR << "Error creating thread, errno was: " << strerror(ret);
+  }
+  C::Run(&(parts[0]));
+  for (int32 i = 1; i < num_parts; i++)
+    if (pthread_join(threads[i], NULL) != 0)
+      KALDI_ERR << "Error rejoining thread.";
+}
+
+
+} // end namespace kaldi.
+
+#endif  // KALDI_MATRIX_MATRIX_PARALLEL_H_
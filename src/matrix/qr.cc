@@ -429,12 +429,66 @@ void SpMatrix<Real>::Qr(MatrixBase<Real> *Q) {
   }
 }
 
+#if !defined(HAVE_ATLAS)
+template<typename Real>
+bool SpMatrix<Real>::LapackEig(VectorBase<Real> *s, MatrixBase<Real> *P) const {
+  // Because the matrix is symmetric, it doesn't matter that LAPACK sees its
+  // transpose; and the output "Z", being in column-major order, has the
+  // eigenvectors as its rows from our point of view, so we transpose it at
+  // the end.
+  Matrix<Real> A(*this);
+  KaldiBlasInt n = this->NumRows(), stride = A.Stride(),
+      z_stride = (P != NULL ? P->Stride() : 1), il = 0, iu = 0,
+      num_found = 0, result;
+  Real vl = 0.0, vu = 0.0, abstol = 0.0;  // abstol <= 0 means: use the default.
+  char *jobz = const_cast<char*>(P != NULL ? "V" : "N"),
+      *range = const_cast<char*>("A"), *uplo = const_cast<char*>("U");
+  std::vector<KaldiBlasInt> isuppz(2 * n);
+  Real *z_data = (P != NULL ? P->Data() : NULL);
+
+  // query for work space
+  Real work_query;
+  KaldiBlasInt l_work = -1, iwork_query, l_iwork = -1;
+  clapack_Xsyevr(jobz, range, uplo, &n, A.Data(), &stride, &vl, &vu, &il, &iu,
+                 &abstol, &num_found, s->Data(), z_data, &z_stride,
+                 &(isuppz[0]), &work_query, &l_work, &iwork_query, &l_iwork,
+                 &result);
+  KALDI_ASSERT(result >= 0 && "Call to CLAPACK syevr_ called with wrong arguments");
+
+  l_work = static_cast<KaldiBlasInt>(work_query);
+  l_iwork = iwork_query;
+  Vector<Real> work(l_work, kUndefined);
+  std::vector<KaldiBlasInt> iwork(l_iwork);
+  clapack_Xsyevr(jobz, range, uplo, &n, A.Data(), &stride, &vl, &vu, &il, &iu,
+                 &abstol, &num_found, s->Data(), z_data, &z_stride,
+                 &(isuppz[0]), work.Data(), &l_work, &(iwork[0]), &l_iwork,
+                 &result);
+  KALDI_ASSERT(result >= 0 && "Call to CLAPACK syevr_ called with wrong arguments");
+
+  if (result != 0 || num_found != n) {
+    KALDI_WARN << "CLAPACK syevr_ failed to converge (result = " << result
+               << "); falling back to QR.";
+    return false;
+  }
+  if (P != NULL) P->Transpose();
+  return true;
+}
+#endif
+
 template<typename Real>
 void SpMatrix<Real>::Eig(VectorBase<Real> *s, MatrixBase<Real> *P) const {
   MatrixIndexT dim = this->NumRows();
   KALDI_ASSERT(s->Dim() == dim);
   KALDI_ASSERT(P == NULL || (P->NumRows() == dim && P->NumCols() == dim));
 
+#if !defined(HAVE_ATLAS)
+  // LAPACK's MRRR solver is faster than the code below except for small
+  // matrices (below about 48, for the reference LAPACK); we only fall back to
+  // our own code for those, or if it fails.
+  if (dim >= 48 && LapackEig(s, P))
+    return;
+#endif
+
   SpMatrix<Real> A(*this); // Copy *this, since the tridiagonalization
   // and QR decomposition are destructive.
   // Note: for efficiency of memory access, the tridiagonalization
@@ -452,13 +506,13 @@ void SpMatrix<Real>::Eig(VectorBase<Real> *s, MatrixBase<Real> *P) const {
 
 template<typename Real>
 void SpMatrix<Real>::TopEigs(VectorBase<Real> *s, MatrixBase<Real> *P,
-                             MatrixIndexT lanczos_dim) const {
-  const SpMatrix<Real> &S(*this); // call this "S" for easy notation.
+                             MatrixIndexT subspace_dim,
+                             int32 num_iters) const {
   MatrixIndexT eig_dim = s->Dim(); // Space of dim we want to retain.
-  if (lanczos_dim <= 0)
-    lanczos_dim = std::max(eig_dim + 50, eig_dim + eig_dim/2);
+  if (subspace_dim <= 0)
+    subspace_dim = std::max(eig_dim + 50, eig_dim + eig_dim/2);
   MatrixIndexT dim = this->NumRows();
-  if (lanczos_dim >= dim) {
+  if (subspace_dim >= dim) {
     // There would be no speed advantage in using this method, so just
     // use the regular approach.
     Vector<Real> s_tmp(dim);
@@ -469,89 +523,45 @@ void SpMatrix<Real>::TopEigs(VectorBase<Real> *s, MatrixBase<Real> *P,
     P->CopyFromMat(P_tmp.Range(0, dim, 0, eig_dim));
     return;
   }
-  KALDI_ASSERT(eig_dim <= dim && eig_dim > 0);
+  KALDI_ASSERT(eig_dim <= dim && eig_dim > 0 && num_iters >= 0);
   KALDI_ASSERT(P->NumRows() == dim && P->NumCols() == eig_dim); // each column
   // is one eigenvector.
 
-  Matrix<Real> Q(lanczos_dim, dim); // The rows of Q will be the
-  // orthogonal vectors of the Krylov subspace.
-
-  SpMatrix<Real> T(lanczos_dim); // This will be equal to Q S Q^T,
-  // i.e. *this projected into the Krylov subspace.  Note: only the
-  // diagonal and off-diagonal fo T are nonzero, i.e. it's tridiagonal,
-  // but we don't have access to the low-level algorithms that work
-  // on that type of matrix (since we want to use ATLAS).  So we just
-  // do normal SVD, on a full matrix; it won't typically dominate.
-
-  Q.Row(0).SetRandn();
-  Q.Row(0).Scale(1.0 / Q.Row(0).Norm(2));
-  for (MatrixIndexT d = 0; d < lanczos_dim; d++) {
-    Vector<Real> r(dim);
-    r.AddSpVec(1.0, S, Q.Row(d), 0.0);
-    // r = S * q_d
-    MatrixIndexT counter = 0;
-    Real end_prod;
-    while (1) { // Normally we'll do this loop only once:
-      // we repeat to handle cases where r gets very much smaller
-      // and we want to orthogonalize again.
-      // We do "full orthogonalization" to preserve stability,
-      // even though this is usually a waste of time.
-      Real start_prod = VecVec(r, r);
-      for (SignedMatrixIndexT e = d; e >= 0; e--) { // e must be signed!
-        SubVector<Real> q_e(Q, e);
-        Real prod = VecVec(r, q_e);
-        if (counter == 0 && static_cast<MatrixIndexT>(e) + 1 >= d) // Keep T tridiagonal, which
-          T(d, e) = prod; // mathematically speaking, it is.
-        r.AddVec(-prod, q_e); // Subtract component in q_e.
-      }
-      if (d+1 == lanczos_dim) break;
-      end_prod = VecVec(r, r);
-      if (end_prod <= 0.1 * start_prod) {
-        // also handles case where both are 0.
-        // We're not confident any more that it's completely
-        // orthogonal to the rest so we want to re-do.
-        if (end_prod == 0.0)
-          r.SetRandn(); // "Restarting".
-        counter++;
-        if (counter > 100)
-          KALDI_ERR << "Loop detected in Lanczos iteration.";
-      } else {
-        break;
-      }
-    }
-    if (d+1 != lanczos_dim) {
-      // OK, at this point we're satisfied that r is orthogonal
-      // to all previous rows.
-      KALDI_ASSERT(end_prod != 0.0); // should have looped.
-      r.Scale(1.0 / std::sqrt(end_prod)); // make it unit.
-      Q.Row(d+1).CopyFromVec(r);
-    }
+  // We work with the full matrix so that the multiplications are done by
+  // GEMM, which is the point of this method versus Lanczos: all the work is
+  // in matrix-matrix products.
+  Matrix<Real> S(*this);
+
+  // The rows of Q are an orthonormal basis of the subspace; we start from a
+  // random one and repeatedly multiply by S and re-orthogonalize, which
+  // converges to the subspace of the top (absolute) eigenvalues.
+  Matrix<Real> Q(subspace_dim, dim), SQ(subspace_dim, dim);
+  Q.SetRandn();
+  Q.OrthogonalizeRows();
+  for (int32 iter = 0; iter < num_iters; iter++) {
+    // The rows of SQ are S times the rows of Q (using the symmetry of S).
+    SQ.AddMatMat(1.0, Q, kNoTrans, S, kNoTrans, 0.0);
+    SQ.OrthogonalizeRows();
+    Q.Swap(&SQ);
   }
-
-  Matrix<Real> R(lanczos_dim, lanczos_dim);  
-  R.SetUnit();
-  T.Qr(&R); // Diagonalizes T.
-  Vector<Real> s_tmp(lanczos_dim);
-  s_tmp.CopyDiagFromSp(T);  
-
-  // Now T = R * diag(s_tmp) * R^T.
-  // The next call sorts the elements of s from greatest to least absolute value,
-  // and moves around the rows of R in the corresponding way.  This picks out
-  // the largest (absolute) eigenvalues.
-  SortSvd(&s_tmp, static_cast<Matrix<Real>*>(NULL), &R);
-  // Keep only the initial rows of R, those corresponding to greatest (absolute)
-  // eigenvalues.
-  SubMatrix<Real> Rsub(R, 0, eig_dim, 0, lanczos_dim);
-  SubVector<Real> s_sub(s_tmp, 0, eig_dim);
-  s->CopyFromVec(s_sub);
-      
-  // For working out what to do now, just assume the other eigenvalues were
-  // zero.  This is just for purposes of knowing how to get the result, and
-  // not getting things wrongly transposed.
-  // We have T = Rsub^T * diag(s_sub) * Rsub.
-  // Now, T = Q S Q^T, with Q orthogonal,  so S = Q^T T Q = Q^T Rsub^T * diag(s) * Rsub * Q.
-  // The output is P and we want S = P * diag(s) * P^T, so we need P = Q^T Rsub^T.
-  P->AddMatMat(1.0, Q, kTrans, Rsub, kTrans, 0.0);
+  SQ.AddMatMat(1.0, Q, kNoTrans, S, kNoTrans, 0.0);
+
+  // T = Q S Q^T, i.e. S projected into the subspace.
+  Matrix<Real> T_full(subspace_dim, subspace_dim);
+  T_full.AddMatMat(1.0, SQ, kNoTrans, Q, kTrans, 0.0);
+  SpMatrix<Real> T(T_full, kTakeMean);
+  Matrix<Real> R(subspace_dim, subspace_dim);
+  Vector<Real> s_tmp(subspace_dim);
+  T.Eig(&s_tmp, &R);
+  // Now T = R * diag(s_tmp) * R^T.  The next call sorts the elements of s_tmp
+  // from greatest to least absolute value, and moves around the columns of R
+  // in the corresponding way.
+  SortSvd(&s_tmp, &R);
+  s->CopyFromVec(s_tmp.Range(0, eig_dim));
+  // S is approximately Q^T T Q = Q^T R diag(s_tmp) R^T Q, and we want
+  // S = P diag(s) P^T, so P = Q^T R, keeping the first eig_dim columns of R.
+  SubMatrix<Real> R_sub(R, 0, subspace_dim, 0, eig_dim);
+  P->AddMatMat(1.0, Q, kTrans, R_sub, kNoTrans, 0.0);
 }
 
 
@@ -562,9 +572,11 @@ template
 void SpMatrix<double>::Eig(VectorBase<double>*, MatrixBase<double>*) const;
 
 template
-void SpMatrix<float>::TopEigs(VectorBase<float>*, MatrixBase<float>*, MatrixIndexT) const;
+void SpMatrix<float>::TopEigs(VectorBase<float>*, MatrixBase<float>*,
+                              MatrixIndexT, int32) const;
 template
-void SpMatrix<double>::TopEigs(VectorBase<double>*, MatrixBase<double>*, MatrixIndexT) const;
+void SpMatrix<double>::TopEigs(VectorBase<double>*, MatrixBase<double>*,
+                               MatrixIndexT, int32) const;
 
 // Someone had a problem with the Intel compiler with -O3, with Qr not being
 // defined for some strange reason (should automatically happen when
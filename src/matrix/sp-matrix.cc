@@ -241,8 +241,44 @@ template<>
 void SpMatrix<double>::AddVec2(const double alpha, const VectorBase<double> &v);
 
 #ifndef HAVE_ATLAS
+template<typename Real>
+bool SpMatrix<Real>::InvertPosDef(Real *logdet, Real *det_sign,
+                                  bool need_inverse) {
+  MatrixIndexT dim = this->num_rows_;
+  Matrix<Real> full(dim, dim, kUndefined);
+  full.CopyFromSp(*this);
+  KaldiBlasInt result, rows = dim, stride = full.Stride();
+  // As for sptrf below, LAPACK's "U" in column-major storage is our lower
+  // triangle; the factor L (with L L^T = *this) is put there.
+  clapack_Xpotrf(&rows, full.Data(), &stride, &result);
+  KALDI_ASSERT(result >= 0 && "Call to CLAPACK potrf_ called with wrong arguments");
+  if (result > 0) return false;  // not positive definite.
+  if (logdet != NULL) {
+    Real log_prod = 0.0;
+    for (MatrixIndexT i = 0; i < dim; i++)
+      log_prod += kaldi::Log(full(i, i));
+    *logdet = 2.0 * log_prod;
+  }
+  if (det_sign != NULL) *det_sign = 1.0;
+  if (need_inverse) {
+    clapack_Xpotri(&rows, full.Data(), &stride, &result);
+    KALDI_ASSERT(result >= 0 && "Call to CLAPACK potri_ called with wrong arguments");
+    if (result != 0)
+      KALDI_ERR << "CLAPACK potri_ : Matrix is singular";
+    this->CopyFromMat(full, kTakeLower);
+  }
+  return true;
+}
+
 template<typename Real>
 void SpMatrix<Real>::Invert(Real *logdet, Real *det_sign, bool need_inverse) {
+  // Most matrices we invert are positive definite (e.g. covariances), and for
+  // those the blocked routines in full storage are faster; if the matrix turns
+  // out not to be positive definite we use the packed routines below, which
+  // work for any symmetric matrix.
+  if (this->num_rows_ >= kFullStorageMinDim &&
+      InvertPosDef(logdet, det_sign, need_inverse))
+    return;
   // these are CLAPACK types
   KaldiBlasInt   result;
   KaldiBlasInt   rows = static_cast<int>(this->num_rows_);
@@ -1022,6 +1058,20 @@ void SpMatrix<Real>::AddMat2Sp(
   KALDI_ASSERT(M_same_dim == dim);
   
   const Real *M_data = M.Data();
+
+  if (dim >= kFullStorageMinDim) {
+    // Do it as two matrix multiplications in full storage; this computes the
+    // whole of M A M^T rather than just the lower triangle, but level-3 BLAS
+    // more than makes up for that.
+    Matrix<Real> A_full(A), MA(dim, A.NumRows(), kUndefined),
+        this_full(dim, dim, kUndefined);
+    MA.AddMatMat(1.0, M, transM, A_full, kNoTrans, 0.0);
+    if (beta != 0.0) this_full.CopyFromSp(*this);
+    this_full.AddMatMat(alpha, MA, kNoTrans, M,
+                        (transM == kNoTrans ? kTrans : kNoTrans), beta);
+    this->CopyFromMat(this_full, kTakeLower);
+    return;
+  }
   
   if (this->Data() <= A.Data() + A.SizeInBytes() &&
       this->Data() + this->SizeInBytes() >= A.Data()) {
@@ -1113,18 +1163,43 @@ void SpMatrix<Real>::AddMat2Vec(const Real alpha,
                (transM == kTrans && this->NumRows() == M.NumCols() &&
                 M.NumRows() == v.Dim()));
 
+  MatrixIndexT dim = this->NumRows(), num_terms = v.Dim();
+  if (dim >= kFullStorageMinDim && num_terms >= kFullStorageMinDim) {
+    // Do it as at most two rank-k updates (syrk), one for the positive and
+    // one for the negative elements of v, on copies of the rows (or columns)
+    // of M scaled by sqrt(|v_i|); this is much faster than num_terms rank-one
+    // updates.
+    const Real *vdata = v.Data();
+    for (int32 sign = 1; sign >= -1; sign -= 2) {
+      MatrixIndexT num_this_sign = 0;
+      for (MatrixIndexT i = 0; i < num_terms; i++)
+        if (vdata[i] * sign > 0.0) num_this_sign++;
+      if (num_this_sign == 0) continue;
+      // rows of "scaled" are the rows (kTrans) or columns (kNoTrans) of M.
+      Matrix<Real> scaled(num_this_sign, dim, kUndefined);
+      for (MatrixIndexT i = 0, j = 0; i < num_terms; i++) {
+        if (vdata[i] * sign > 0.0) {
+          SubVector<Real> scaled_row(scaled, j++);
+          if (transM == kTrans) scaled_row.CopyFromVec(M.Row(i));
+          else scaled_row.CopyColFromMat(M, i);
+          scaled_row.Scale(std::sqrt(vdata[i] * sign));
+        }
+      }
+      AddMat2(alpha * sign, scaled, kTrans, 1.0);
+    }
+    return;
+  }
+
   if (transM == kNoTrans) {
     const Real *Mdata = M.Data(), *vdata = v.Data();
     Real *data = this->data_;
-    MatrixIndexT dim = this->NumRows(), mcols = M.NumCols(),
-        mstride = M.Stride();
+    MatrixIndexT mcols = M.NumCols(), mstride = M.Stride();
     for (MatrixIndexT col = 0; col < mcols; col++, vdata++, Mdata += 1)
       cblas_Xspr(dim, *vdata*alpha, Mdata, mstride, data);
   } else {
     const Real *Mdata = M.Data(), *vdata = v.Data();
     Real *data = this->data_;
-    MatrixIndexT dim = this->NumRows(), mrows = M.NumRows(),
-        mstride = M.Stride();
+    MatrixIndexT mrows = M.NumRows(), mstride = M.Stride();
     for (MatrixIndexT row = 0; row < mrows; row++, vdata++, Mdata += mstride)
       cblas_Xspr(dim, *vdata*alpha, Mdata, 1, data);
   }
@@ -161,8 +161,9 @@ class SpMatrix : public PackedMatrix<Real> {
                         Real tolerance = 0.001) const;
 
   /// Solves the symmetric eigenvalue problem: at end we should have (*this) = P
-  /// * diag(s) * P^T.  We solve the problem using the symmetric QR method.
-  /// P may be NULL.
+  /// * diag(s) * P^T.  If we are compiled against a full LAPACK (i.e. not
+  /// ATLAS), we use its syevr routine, falling back to the symmetric QR method
+  /// if that fails; otherwise we use the symmetric QR method.  P may be NULL.
   /// Implemented in qr.cc.
   /// If you need the eigenvalues sorted, the function SortSvd declared in
   /// kaldi-matrix is suitable.
@@ -170,10 +171,11 @@ class SpMatrix : public PackedMatrix<Real> {
   
   /// This function gives you, approximately, the largest eigenvalues of the
   /// symmetric matrix and the corresponding eigenvectors.  (largest meaning,
-  /// further from zero).  It does this by doing a SVD within the Krylov
-  /// subspace generated by this matrix and a random vector.  This is
-  /// a form of the Lanczos method with complete reorthogonalization, followed
-  /// by SVD within a smaller dimension ("lanczos_dim").
+  /// further from zero).  It does this by randomized subspace iteration: a
+  /// random subspace of dimension "subspace_dim" is repeatedly multiplied by
+  /// this matrix and re-orthogonalized ("num_iters" times), and we then do
+  /// the eigenvalue decomposition of the matrix projected into that subspace.
+  /// All the work in the large dimension is done by matrix-matrix products.
   ///
   /// If *this is m by m, s should be of dimension n and P should be of
   /// dimension m by n, with n <= m.  The *columns* of P are the approximate
@@ -181,19 +183,16 @@ class SpMatrix : public PackedMatrix<Real> {
   /// *this.  The columns of P will be orthogonal, and the elements of s will be
   /// the eigenvalues of *this projected into that subspace, but beyond that
   /// there are no exact guarantees.  (This is because the convergence of this
-  /// method is statistical).  Note: it only makes sense to use this
-  /// method if you are in very high dimension and n is substantially smaller
-  /// than m: for example, if you want the 100 top eigenvalues of a 10k by 10k
-  /// matrix.  This function calls Rand() to initialize the lanczos
-  /// iterations and also for restarting.
-  /// If lanczos_dim is zero, it will default to the greater of:
-  /// s->Dim() + 50 or s->Dim() + s->Dim()/2, but not more than this->Dim().
-  /// If lanczos_dim == this->Dim(), you might as well just call the function
-  /// Eig() since the result will be the same, and Eig() would be faster; the
-  /// whole point of this function is to reduce the dimension of the SVD
-  /// computation.
+  /// method is statistical; more iterations, or a larger subspace, make the
+  /// approximation better).  Note: it only makes sense to use this method if
+  /// you are in very high dimension and n is substantially smaller than m: for
+  /// example, if you want the 100 top eigenvalues of a 10k by 10k matrix.
+  /// This function calls Rand() to initialize the subspace.
+  /// If subspace_dim is zero, it will default to the greater of:
+  /// s->Dim() + 50 or s->Dim() + s->Dim()/2.  If subspace_dim >= this->Dim(),
+  /// we just call Eig(), since the result would be the same.
   void TopEigs(VectorBase<Real> *s, MatrixBase<Real> *P,
-               MatrixIndexT lanczos_dim = 0) const;
+               MatrixIndexT subspace_dim = 0, int32 num_iters = 2) const;
 
 
   
@@ -259,6 +258,8 @@ class SpMatrix : public PackedMatrix<Real> {
   /// this <-- beta*this  +  alpha * M * A * M^T.
   /// (*this) and A are allowed to be the same.
   /// If transM == kTrans, then we do it as M^T * A * M.
+  /// For dimensions of at least kFullStorageMinDim this is done with matrix
+  /// multiplications in full (unpacked) storage.
   void AddMat2Sp(const Real alpha, const MatrixBase<Real> &M,
                  MatrixTransposeType transM, const SpMatrix<Real> &A,
                  const Real beta = 0.0);
@@ -292,6 +293,8 @@ class SpMatrix : public PackedMatrix<Real> {
   /// this <-- beta*this + alpha * M * diag(v) * M^T.
   /// if transM == kTrans, then
   /// this <-- beta*this + alpha * M^T * diag(v) * M.
+  /// For dimensions of at least kFullStorageMinDim this is done with syrk,
+  /// so it's an efficient way to accumulate weighted scatter over many frames.
   void AddMat2Vec(const Real alpha, const MatrixBase<Real> &M,
                   MatrixTransposeType transM, const VectorBase<Real> &v,
                   const Real beta = 0.0);
@@ -364,8 +367,23 @@ class SpMatrix : public PackedMatrix<Real> {
   /// At entry Q should probably be either NULL or orthogonal, but we don't check
   /// this.
   void Qr(MatrixBase<Real> *Q);
+
+  /// The dimension from which AddMat2Sp(), Invert() (for positive definite
+  /// matrices) and TpMatrix::Cholesky() copy to full storage and use level-3
+  /// BLAS or blocked LAPACK routines, rather than working on the packed
+  /// format, which only allows level-2 operations.
+  static const MatrixIndexT kFullStorageMinDim = 16;
   
  private:
+#if !defined(HAVE_ATLAS)
+  // Does the work of Invert() using LAPACK's potrf and potri in full storage.
+  // Returns false, leaving *this unchanged, if the matrix is not positive
+  // definite.
+  bool InvertPosDef(Real *logdet, Real *det_sign, bool need_inverse);
+  // Does the work of Eig() using LAPACK's syevr (the MRRR algorithm).  Returns
+  // false if LAPACK reported a failure, in which case *s and *P are undefined.
+  bool LapackEig(VectorBase<Real> *s, MatrixBase<Real> *P) const;
+#endif
  void EigInternal(VectorBase<Real> *s, MatrixBase<Real> *P,
                    Real tolerance, int recurse) const;
 };
@@ -202,6 +202,52 @@ void UnitTestSparseMatrixTraceMatSmat() {
   }
 }
 
+// Tests the versions of AddMatSmat() and AddSmatMat() that take a
+// SparseMatrix, including the multi-threaded case.
+template <typename Real>
+void UnitTestSparseMatrixProducts() {
+  for (int32 i = 0; i < 20; i++) {
+    // Make it big enough, sometimes, that several threads get used.
+    MatrixIndexT m = 10 + Rand() % (i % 2 == 0 ? 40 : 400),
+        n = 10 + Rand() % 50, k = 10 + Rand() % 300;
+    MatrixTransposeType trans = (i % 4 < 2 ? kNoTrans : kTrans);
+    int32 num_threads = 1 + Rand() % 4;
+    Real alpha = 0.5, beta = (i % 3 == 0 ? 0.0 : 2.0);
+
+    // A * B [or B^T] with B sparse.
+    Matrix<Real> A(m, k), M(m, n), M2(m, n);
+    SparseMatrix<Real> B(trans == kNoTrans ? k : n, trans == kNoTrans ? n : k);
+    A.SetRandn();
+    B.SetRandn(0.8);
+    M.SetRandn();
+    M2.CopyFromMat(M);
+    Matrix<Real> B_full(B.NumRows(), B.NumCols());
+    B.CopyToMat(&B_full);
+    M.AddMatMat(alpha, A, kNoTrans, B_full, trans, beta);
+    M2.AddMatSmat(alpha, A, B, trans, beta, num_threads);
+    AssertEqual(M, M2);
+
+    // C [or C^T] * D with C sparse.
+    Matrix<Real> D(k, n), N(m, n), N2(m, n);
+    SparseMatrix<Real> C(trans == kNoTrans ? m : k, trans == kNoTrans ? k : m);
+    D.SetRandn();
+    C.SetRandn(0.8);
+    N.SetRandn();
+    N2.CopyFromMat(N);
+    Matrix<Real> C_full(C.NumRows(), C.NumCols());
+    C.CopyToMat(&C_full);
+    N.AddMatMat(alpha, C_full, trans, D, kNoTrans, beta);
+    N2.AddSmatMat(alpha, C, trans, D, beta, num_threads);
+    AssertEqual(N, N2);
+
+    // Check that the threaded and unthreaded versions agree.
+    Matrix<Real> N3(N2);
+    N2.AddSmatMat(alpha, C, trans, D, beta, 1);
+    N3.AddSmatMat(alpha, C, trans, D, beta, 4);
+    AssertEqual(N2, N3);
+  }
+}
+
 template <typename Real>
 void SparseMatrixUnitTest() {
   // SparseVector
@@ -215,6 +261,7 @@ void SparseMatrixUnitTest() {
   UnitTestSparseMatrixFrobeniusNorm<Real>();
   UnitTestSparseMatrixAddToMat<Real>();
   UnitTestSparseMatrixTraceMatSmat<Real>();
+  UnitTestSparseMatrixProducts<Real>();
 }
 
 }  // namespace kaldi
@@ -24,6 +24,8 @@
 
 #include "matrix/sparse-matrix.h"
 #include "matrix/kaldi-matrix.h"
+#include "matrix/matrix-parallel.h"
+#include "matrix/cblas-wrappers.h"
 
 namespace kaldi {
 
@@ -641,6 +643,178 @@ double TraceMatSmat(const MatrixBase<double> &A,
                    const SparseMatrix<double> &B,
                    MatrixTransposeType trans);
 
+// The minimum number of multiply-adds per thread for which AddMatSmat() and
+// AddSmatMat() will use more than one thread.
+static const int64 kSparseProductMinWorkPerThread = 1 << 18;
+
+// Does *M = beta * *M + alpha * A * B [or B^T], where B is sparse, in one
+// thread.  We go row by row through *M and A, so that the accesses to them
+// (which are in random order, within the row) stay within the current row,
+// which will normally be in cache; B, being sparse, is normally small enough
+// to stay in cache too.
+template<typename Real>
+static void AddMatSmatPart(Real alpha, const MatrixBase<Real> &A,
+                           const SparseMatrix<Real> &B,
+                           MatrixTransposeType transB, Real beta,
+                           MatrixBase<Real> *M) {
+  if (beta == 0.0) M->SetZero();
+  else if (beta != 1.0) M->Scale(beta);
+  MatrixIndexT num_rows = M->NumRows(), B_rows = B.NumRows();
+  for (MatrixIndexT r = 0; r < num_rows; r++) {
+    const Real *A_row = A.RowData(r);
+    Real *M_row = M->RowData(r);
+    for (MatrixIndexT k = 0; k < B_rows; k++) {
+      const SparseVector<Real> &B_row = B.Row(k);
+      const std::pair<MatrixIndexT, Real> *B_data = B_row.Data();
+      MatrixIndexT num_elems = B_row.NumElements();
+      if (transB == kNoTrans) {
+        // B(k, c) multiplies A(r, k) into M(r, c).
+        Real a = alpha * A_row[k];
+        if (a == 0.0) continue;
+        for (MatrixIndexT e = 0; e < num_elems; e++)
+          M_row[B_data[e].first] += a * B_data[e].second;
+      } else {
+        // M(r, k) gets the dot product of row r of A with row k of B.
+        Real sum = 0.0;
+        for (MatrixIndexT e = 0; e < num_elems; e++)
+          sum += A_row[B_data[e].first] * B_data[e].second;
+        M_row[k] += alpha * sum;
+      }
+    }
+  }
+}
+
+// Does *M = beta * *M + alpha * A [or A^T] * B, where A is sparse, in one
+// thread.  Each element of A leads to adding a row of B to a row of *M.
+template<typename Real>
+static void AddSmatMatPart(Real alpha, const SparseMatrix<Real> &A,
+                           MatrixTransposeType transA,
+                           const MatrixBase<Real> &B, Real beta,
+                           MatrixBase<Real> *M) {
+  if (beta == 0.0) M->SetZero();
+  else if (beta != 1.0) M->Scale(beta);
+  MatrixIndexT A_rows = A.NumRows(), num_cols = M->NumCols();
+  for (MatrixIndexT k = 0; k < A_rows; k++) {
+    const SparseVector<Real> &A_row = A.Row(k);
+    const std::pair<MatrixIndexT, Real> *A_data = A_row.Data();
+    MatrixIndexT num_elems = A_row.NumElements();
+    for (MatrixIndexT e = 0; e < num_elems; e++) {
+      MatrixIndexT c = A_data[e].first;
+      Real value = alpha * A_data[e].second;
+      // A(k, c) multiplies row c of B into row k of *M, or, if transA ==
+      // kTrans, row k of B into row c of *M.
+      if (transA == kNoTrans)
+        cblas_Xaxpy(num_cols, value, B.RowData(c), 1, M->RowData(k), 1);
+      else
+        cblas_Xaxpy(num_cols, value, B.RowData(k), 1, M->RowData(c), 1);
+    }
+  }
+}
+
+// The part of AddMatSmat() or AddSmatMat() that one thread does, for
+// RunMatrixParts().  For AddMatSmat() (sparse_on_left == false), each part
+// is a range of rows of *M and of the dense matrix; for AddSmatMat(), a range
+// of columns of *M and of the dense matrix.
+template<typename Real>
+struct SparseProductPart {
+  bool sparse_on_left;
+  Real alpha;
+  const MatrixBase<Real> *dense;
+  const SparseMatrix<Real> *sparse;
+  MatrixTransposeType trans;
+  Real beta;
+  MatrixBase<Real> *M;
+  int32 begin;
+  int32 end;
+
+  static void *Run(void *arg) {
+    SparseProductPart<Real> *part = static_cast<SparseProductPart<Real>*>(arg);
+    int32 n = part->end - part->begin;
+    if (n == 0) return NULL;
+    if (!part->sparse_on_left) {
+      SubMatrix<Real> dense(part->dense->RowRange(part->begin, n)),
+          M(part->M->RowRange(part->begin, n));
+      AddMatSmatPart(part->alpha, dense, *(part->sparse), part->trans,
+                     part->beta, &M);
+    } else {
+      SubMatrix<Real> dense(part->dense->ColRange(part->begin, n)),
+          M(part->M->ColRange(part->begin, n));
+      AddSmatMatPart(part->alpha, *(part->sparse), part->trans, dense,
+                     part->beta, &M);
+    }
+    return NULL;
+  }
+};
+
+// Works out how many threads a sparse-dense product should use.
+static int32 SparseProductNumThreads(int64 num_elements, int64 dense_dim,
+                                     int32 num_threads) {
+  int64 max_threads = (num_elements * dense_dim) /
+      kSparseProductMinWorkPerThread;
+  return static_cast<int32>(std::min<int64>(num_threads,
+                                            std::max<int64>(max_threads, 1)));
+}
+
+template<typename Real>
+void MatrixBase<Real>::AddMatSmat(Real alpha, const MatrixBase<Real> &A,
+                                  const SparseMatrix<Real> &B,
+                                  MatrixTransposeType transB, Real beta,
+                                  int32 num_threads) {
+  KALDI_ASSERT(NumRows() == A.NumRows());
+  if (transB == kNoTrans) {
+    KALDI_ASSERT(A.NumCols() == B.NumRows() && NumCols() == B.NumCols());
+  } else {
+    KALDI_ASSERT(A.NumCols() == B.NumCols() && NumCols() == B.NumRows());
+  }
+  KALDI_ASSERT(&A != this);
+  SparseProductPart<Real> part = { false, alpha, &A, &B, transB, beta, this,
+                                   0, 0 };
+  RunMatrixParts(part, num_rows_,
+                 SparseProductNumThreads(B.NumElements(), num_rows_,
+                                         num_threads));
+}
+
+template<typename Real>
+void MatrixBase<Real>::AddSmatMat(Real alpha, const SparseMatrix<Real> &A,
+                                  MatrixTransposeType transA,
+                                  const MatrixBase<Real> &B, Real beta,
+                                  int32 num_threads) {
+  KALDI_ASSERT(NumCols() == B.NumCols());
+  if (transA == kNoTrans) {
+    KALDI_ASSERT(NumRows() == A.NumRows() && A.NumCols() == B.NumRows());
+  } else {
+    KALDI_ASSERT(NumRows() == A.NumCols() && A.NumRows() == B.NumRows());
+  }
+  KALDI_ASSERT(&B != this);
+  SparseProductPart<Real> part = { true, alpha, &B, &A, transA, beta, this,
+                                   0, 0 };
+  RunMatrixParts(part, num_cols_,
+                 SparseProductNumThreads(A.NumElements(), num_cols_,
+                                         num_threads));
+}
+
+template
+void MatrixBase<float>::AddMatSmat(float alpha, const MatrixBase<float> &A,
+                                   const SparseMatrix<float> &B,
+                                   MatrixTransposeType transB, float beta,
+                                   int32 num_threads);
+template
+void MatrixBase<double>::AddMatSmat(double alpha, const MatrixBase<double> &A,
+                                    const SparseMatrix<double> &B,
+                                    MatrixTransposeType transB, double beta,
+                                    int32 num_threads);
+template
+void MatrixBase<float>::AddSmatMat(float alpha, const SparseMatrix<float> &A,
+                                   MatrixTransposeType transA,
+                                   const MatrixBase<float> &B, float beta,
+                                   int32 num_threads);
+template
+void MatrixBase<double>::AddSmatMat(double alpha,
+                                    const SparseMatrix<double> &A,
+                                    MatrixTransposeType transA,
+                                    const MatrixBase<double> &B, double beta,
+                                    int32 num_threads);
+
 void GeneralMatrix::Clear() {
   mat_.Resize(0, 0);
   cmat_.Clear();
@@ -775,6 +949,12 @@ void GeneralMatrix::SwapFullMatrix(Matrix<BaseFloat> *mat) {
   mat->Swap(&mat_);
 }
 
+void GeneralMatrix::SwapCompressedMatrix(CompressedMatrix *cmat) {
+  if (mat_.NumRows() != 0 || smat_.NumRows() != 0)
+    KALDI_ERR << "SwapCompressedMatrix called on GeneralMatrix of wrong type.";
+  cmat->Swap(&cmat_);
+}
+
 void GeneralMatrix::Write(std::ostream &os, bool binary) const {
   if (smat_.NumRows() != 0) {
     smat_.Write(os, binary);
@@ -254,6 +254,10 @@ class GeneralMatrix {
   /// crash.
   const CompressedMatrix &GetCompressedMatrix() const;
 
+  /// Swaps the with the given CompressedMatrix.  This will only work if
+  /// Type() returns kCompressedMatrix, or NumRows() == 0.
+  void SwapCompressedMatrix(CompressedMatrix *cmat);
+
   /// Returns the contents as a Matrix<BaseFloat>.  This will only work if
   /// Type() returns kFullMatrix, or NumRows() == 0; otherwise it will crash.
   const Matrix<BaseFloat>& GetFullMatrix() const;
@@ -325,7 +329,8 @@ class GeneralMatrix {
 /// Appends all the matrix rows of a list of GeneralMatrixes, to get a single
 /// GeneralMatrix.  Preserves sparsity if all inputs were sparse (or empty).
 /// Does not preserve compression, if inputs were compressed; you have to
-/// re-compress manually, if that's what you need.
+/// re-compress manually, if that's what you need (or, if all the inputs are
+/// compressed, use CompressedMatrix::ConcatenateRows()).
 void AppendGeneralMatrixRows(const std::vector<const GeneralMatrix *> &src,
                              GeneralMatrix *mat);
 
@@ -27,6 +27,7 @@
 
 #include "matrix/srfft.h"
 #include "matrix/matrix-functions.h"
+#include "matrix/vectorized-math.h"
 
 namespace kaldi {
 
@@ -155,6 +156,63 @@ void SplitRadixComplexFft<Real>::Compute(Real *x, bool forward) {
   this->Compute(x, forward, &temp_buffer_);
 }
 
+template<typename Real>
+void SplitRadixComplexFft<Real>::Compute(MatrixBase<Real> *x, bool forward,
+                                         std::vector<Real> *temp_buffer) const {
+  KALDI_ASSERT(x->NumCols() == N_ * 2);
+  for (MatrixIndexT r = 0; r < x->NumRows(); r++)
+    Compute(x->RowData(r), forward, temp_buffer);
+}
+
+// For float, we transform num_lanes rows at a time, interleaving their
+// elements so that VectorizedSrfftInterleaved() can work on all of them at
+// once with SIMD instructions.  The bit-reversal permutation is done while
+// copying the results back to the rows.
+template<>
+void SplitRadixComplexFft<float>::Compute(MatrixBase<float> *x, bool forward,
+                                          std::vector<float> *temp_buffer) const {
+  KALDI_ASSERT(x->NumCols() == N_ * 2 && temp_buffer != NULL);
+  MatrixIndexT num_rows = x->NumRows(), num_lanes = VectorizedSrfftNumLanes(),
+      r = 0;
+  if (num_lanes > 1 && num_rows >= num_lanes) {
+    std::vector<MatrixIndexT> reversed(N_);
+    for (MatrixIndexT n = 0; n < N_; n++) {
+      MatrixIndexT rev = 0;
+      for (MatrixIndexT b = 0; b < logn_; b++)
+        if (n & (1 << b)) rev |= 1 << (logn_ - 1 - b);
+      reversed[n] = rev;
+    }
+    if (temp_buffer->size() != N_ * num_lanes * 2)
+      temp_buffer->resize(N_ * num_lanes * 2);
+    float *xr = &((*temp_buffer)[0]), *xi = xr + N_ * num_lanes;
+    for (; r + num_lanes <= num_rows; r += num_lanes) {
+      for (MatrixIndexT l = 0; l < num_lanes; l++) {
+        const float *row = x->RowData(r + l);
+        for (MatrixIndexT n = 0; n < N_; n++) {
+          xr[n * num_lanes + l] = row[n * 2];
+          xi[n * num_lanes + l] = row[n * 2 + 1];
+        }
+      }
+      // For the inverse FFT, swap the real and imaginary parts, as
+      // Compute(xr, xi, forward) does.
+      if (forward)
+        VectorizedSrfftInterleaved(xr, xi, logn_, tab_);
+      else
+        VectorizedSrfftInterleaved(xi, xr, logn_, tab_);
+      for (MatrixIndexT l = 0; l < num_lanes; l++) {
+        float *row = x->RowData(r + l);
+        for (MatrixIndexT n = 0; n < N_; n++) {
+          MatrixIndexT i = reversed[n] * num_lanes + l;
+          row[n * 2] = xr[i];
+          row[n * 2 + 1] = xi[i];
+        }
+      }
+    }
+  }
+  for (; r < num_rows; r++)  // The remaining rows, one by one.
+    Compute(x->RowData(r), forward, temp_buffer);
+}
+
 template<typename Real>
 void SplitRadixComplexFft<Real>::BitReversePermute(Real *x, MatrixIndexT logn) const {
   MatrixIndexT      i, j, lg2, n;
@@ -184,11 +242,9 @@ void SplitRadixComplexFft<Real>::BitReversePermute(Real *x, MatrixIndexT logn) c
 template<typename Real>
 void SplitRadixComplexFft<Real>::ComputeRecursive(Real *xr, Real *xi, MatrixIndexT logn) const {
 
-  MatrixIndexT    m, m2, m4, m8, nel, n;
+  MatrixIndexT    m, m2, m4;
   Real    *xr1, *xr2, *xi1, *xi2;
-  Real    *cn, *spcn, *smcn, *c3n, *spc3n, *smc3n;
   Real    tmp1, tmp2;
-  Real   sqhalf = M_SQRT1_2;
 
   /* Check range of logn */
   if (logn < 0)
@@ -249,68 +305,11 @@ void SplitRadixComplexFft<Real>::ComputeRecursive(Real *xr, Real *xi, MatrixInde
     else if (logn == 0) return;   /* length m = 1 */
   }
 
-  /* Compute a few constants */
-  m = 1 << logn; m2 = m / 2; m4 = m2 / 2; m8 = m4 /2;
-
-
-  /* Step 1 */
-  xr1 = xr; xr2 = xr1 + m2;
-  xi1 = xi; xi2 = xi1 + m2;
-  for (n = 0; n < m2; n++) {
-    tmp1 = *xr1 + *xr2;
-    *xr2 = *xr1 - *xr2;
-    xr2++;
-    *xr1++ = tmp1;
-    tmp2 = *xi1 + *xi2;
-    *xi2 = *xi1 - *xi2;
-    xi2++;
-    *xi1++ = tmp2;
-  }
-
-  /* Step 2 */
-  xr1 = xr + m2; xr2 = xr1 + m4;
-  xi1 = xi + m2; xi2 = xi1 + m4;
-  for (n = 0; n < m4; n++) {
-    tmp1 = *xr1 + *xi2;
-    tmp2 = *xi1 + *xr2;
-    *xi1 = *xi1 - *xr2;
-    xi1++;
-    *xr2++ = *xr1 - *xi2;
-    *xr1++ = tmp1;
-    *xi2++ = tmp2;
-    // xr1++; xr2++; xi1++; xi2++;
-  }
+  /* Steps 1 to 4: the butterflies of this level (in vectorized-math.cc),
+     with the table of twiddle factors for length m = 1 << logn. */
+  VectorizedSrfftButterflies(xr, xi, logn, (logn >= 4 ? tab_[logn-4] : NULL));
 
-  /* Steps 3 & 4 */
-  xr1 = xr + m2; xr2 = xr1 + m4;
-  xi1 = xi + m2; xi2 = xi1 + m4;
-  if (logn >= 4) {
-    nel = m4 - 2;
-    cn  = tab_[logn-4]; spcn  = cn + nel;  smcn  = spcn + nel;
-    c3n = smcn + nel;  spc3n = c3n + nel; smc3n = spc3n + nel;
-  }
-  xr1++; xr2++; xi1++; xi2++;
-  // xr1++; xi1++;
-  for (n = 1; n < m4; n++) {
-    if (n == m8) {
-      tmp1 =  sqhalf * (*xr1 + *xi1);
-      *xi1 =  sqhalf * (*xi1 - *xr1);
-      *xr1 =  tmp1;
-      tmp2 =  sqhalf * (*xi2 - *xr2);
-      *xi2 = -sqhalf * (*xr2 + *xi2);
-      *xr2 =  tmp2;
-    } else {
-      tmp2 = *cn++ * (*xr1 + *xi1);
-      tmp1 = *spcn++ * *xr1 + tmp2;
-      *xr1 = *smcn++ * *xi1 + tmp2;
-      *xi1 = tmp1;
-      tmp2 = *c3n++ * (*xr2 + *xi2);
-      tmp1 = *spc3n++ * *xr2 + tmp2;
-      *xr2 = *smc3n++ * *xi2 + tmp2;
-      *xi2 = tmp1;
-    }
-    xr1++; xr2++; xi1++; xi2++;
-  }
+  m = 1 << logn; m2 = m / 2;
 
   /* Call ssrec again with half DFT length */
   ComputeRecursive(xr, xi, logn-1);
@@ -331,16 +330,52 @@ void SplitRadixRealFft<Real>::Compute(Real *data, bool forward) {
 }
 
 
-// This code is mostly the same as the RealFft function.  It would be
-// possible to replace it with more efficient code from Rico's book.
+template<typename Real>
+void SplitRadixRealFft<Real>::Compute(MatrixBase<Real> *frames, bool forward) {
+  Compute(frames, forward, &this->temp_buffer_);
+}
+
+
 template<typename Real>
 void SplitRadixRealFft<Real>::Compute(Real *data, bool forward,
                                       std::vector<Real> *temp_buffer) const {
-  MatrixIndexT N = N_, N2 = N/2;
-  KALDI_ASSERT(N%2 == 0);
-  if (forward) // call to base class
+  if (forward) { // call to base class
     SplitRadixComplexFft<Real>::Compute(data, true, temp_buffer);
+    Recombine(data, true);
+  } else {
+    Recombine(data, false);
+    SplitRadixComplexFft<Real>::Compute(data, false, temp_buffer);
+    for (MatrixIndexT i = 0; i < N_; i++)
+      data[i] *= 2.0;
+    // This is so we get a factor of N increase, rather than N/2 which we would
+    // otherwise get from [ComplexFft, forward] + [ComplexFft, backward] in dimension N/2.
+    // It's for consistency with our normal FFT convensions.
+  }
+}
+
+template<typename Real>
+void SplitRadixRealFft<Real>::Compute(MatrixBase<Real> *frames, bool forward,
+                                      std::vector<Real> *temp_buffer) const {
+  KALDI_ASSERT(frames->NumCols() == N_);
+  MatrixIndexT num_rows = frames->NumRows();
+  if (forward) {
+    SplitRadixComplexFft<Real>::Compute(frames, true, temp_buffer);
+    for (MatrixIndexT r = 0; r < num_rows; r++)
+      Recombine(frames->RowData(r), true);
+  } else {
+    for (MatrixIndexT r = 0; r < num_rows; r++)
+      Recombine(frames->RowData(r), false);
+    SplitRadixComplexFft<Real>::Compute(frames, false, temp_buffer);
+    frames->Scale(2.0);  // See the comment in the other Compute().
+  }
+}
 
+// This code is mostly the same as the RealFft function.  It would be
+// possible to replace it with more efficient code from Rico's book.
+template<typename Real>
+void SplitRadixRealFft<Real>::Recombine(Real *data, bool forward) const {
+  MatrixIndexT N = N_, N2 = N/2;
+  KALDI_ASSERT(N%2 == 0);
   Real rootN_re, rootN_im;  // exp(-2pi/N), forward; exp(2pi/N), backward
   int forward_sign = forward ? -1 : 1;
   ComplexImExp(static_cast<Real>(M_2PI/N *forward_sign), &rootN_re, &rootN_im);
@@ -394,14 +429,6 @@ void SplitRadixRealFft<Real>::Compute(Real *data, bool forward,
       data[1] /= 2;
     }
   }
-  if (!forward) {  // call to base class
-    SplitRadixComplexFft<Real>::Compute(data, false, temp_buffer);
-    for (MatrixIndexT i = 0; i < N; i++)
-      data[i] *= 2.0;
-    // This is so we get a factor of N increase, rather than N/2 which we would
-    // otherwise get from [ComplexFft, forward] + [ComplexFft, backward] in dimension N/2.
-    // It's for consistency with our normal FFT convensions.
-  }
 }
 
 template class SplitRadixComplexFft<float>;
@@ -74,6 +74,16 @@ class SplitRadixComplexFft {
   // needed.
   void Compute(Real *x, bool forward, std::vector<Real> *temp_buffer) const;
 
+  // This version of Compute does the FFT of each row of "x", which must have
+  // N*2 columns in the format [ r0 im0 r1 im1 ... ]; the result is the same
+  // as calling the version above on each row.  For float, if the CPU has
+  // SIMD instructions, it transforms several rows at a time with the data of
+  // the rows interleaved (see VectorizedSrfftInterleaved()), which is much
+  // faster than doing them one by one for typical feature-extraction sizes.
+  // It uses "temp_buffer" as temporary storage.
+  void Compute(MatrixBase<Real> *x, bool forward,
+               std::vector<Real> *temp_buffer) const;
+
   ~SplitRadixComplexFft();
 
  protected:
@@ -117,7 +127,25 @@ class SplitRadixRealFft: private SplitRadixComplexFft<Real> {
   /// uses a user-supplied buffer.
   void Compute(Real *x, bool forward, std::vector<Real> *temp_buffer) const;
 
+  /// This version transforms each row of "frames", which must have N
+  /// columns, in place; the result is the same as calling Compute() on each
+  /// row, but it is faster because the complex FFTs of several rows are done
+  /// at once (see SplitRadixComplexFft::Compute(MatrixBase<Real>*, ...)).
+  /// It is intended for feature extraction, where all the frames of an
+  /// utterance can be transformed in one call.
+  void Compute(MatrixBase<Real> *frames, bool forward,
+               std::vector<Real> *temp_buffer) const;
+
+  /// As the version above, but using a class-member temporary buffer.
+  void Compute(MatrixBase<Real> *frames, bool forward);
+
  private:
+  // Converts, in place, between the complex FFT of dimension N/2 of the data
+  // (viewed as complex) and the real FFT of dimension N: this is the part of
+  // Compute() that comes after the complex FFT if forward == true, or before
+  // it if forward == false.
+  void Recombine(Real *data, bool forward) const;
+
   KALDI_DISALLOW_COPY_AND_ASSIGN(SplitRadixRealFft);  
   int N_;
 };
@@ -88,6 +88,24 @@ template<typename Real>
 void TpMatrix<Real>::Cholesky(const SpMatrix<Real> &orig) {
   KALDI_ASSERT(orig.NumRows() == this->NumRows());
   MatrixIndexT n = this->NumRows();
+#ifndef HAVE_ATLAS
+  if (n >= SpMatrix<Real>::kFullStorageMinDim) {
+    // Use LAPACK's blocked potrf in full storage; its "U" in column-major
+    // storage is our lower triangle.
+    Matrix<Real> full(n, n, kUndefined);
+    full.CopyFromSp(orig);
+    KaldiBlasInt result, rows = n, stride = full.Stride();
+    clapack_Xpotrf(&rows, full.Data(), &stride, &result);
+    KALDI_ASSERT(result >= 0 && "Call to CLAPACK potrf_ called with wrong arguments");
+    if (result > 0) {
+      KALDI_WARN << "Cholesky decomposition failed. Maybe matrix "
+          "is not positive definite. Throwing error";
+      throw std::runtime_error("Cholesky decomposition failed.");
+    }
+    this->CopyFromMat(full);
+    return;
+  }
+#endif
   this->SetZero();
   Real *data = this->data_, *jdata = data;  // start of j'th row of matrix.
   const Real *orig_jdata = orig.Data(); // start of j'th row of matrix.
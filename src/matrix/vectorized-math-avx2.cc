@@ -0,0 +1,132 @@
+// matrix/vectorized-math-avx2.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+// The AVX2 versions of the float kernels, 8 elements at a time.  They use
+// FMA too, which every CPU with AVX2 so far also has (the CPU detection in
+// cpu-features.cc requires both).
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include "matrix/vectorized-math-kernels.h"
+
+#if defined(KALDI_SIMD_X86) && KALDI_SIMD_CAN_TARGET_AVX2
+#include <immintrin.h>
+#if defined(__GNUC__) && !defined(__clang__)
+// Stop gcc from fusing separate Mul() and Add() into FMA instructions, which
+// would make the results of DecompressUint16() etc. differ from those of the
+// scalar code.  (Where we want FMA, we use MulAdd().)
+#pragma GCC optimize("fp-contract=off")
+#endif
+#define KALDI_SIMD_FUNC KALDI_SIMD_TARGET("avx2,fma") static
+#endif
+
+namespace kaldi {
+
+#if defined(KALDI_SIMD_X86) && KALDI_SIMD_CAN_TARGET_AVX2
+
+namespace avx2 {
+
+// The comparisons return masks in the same type as the data (all bits set
+// where the condition is true), and Select(mask, a, b) takes a where the mask
+// is set and b elsewhere.
+typedef __m256 Simd;
+const int32 kSimdWidth = 8;
+
+KALDI_SIMD_FUNC inline Simd Set(float f) { return _mm256_set1_ps(f); }
+KALDI_SIMD_FUNC inline Simd Load(const float *p) { return _mm256_loadu_ps(p); }
+KALDI_SIMD_FUNC inline void Store(float *p, Simd a) { _mm256_storeu_ps(p, a); }
+KALDI_SIMD_FUNC inline Simd Add(Simd a, Simd b) { return _mm256_add_ps(a, b); }
+KALDI_SIMD_FUNC inline Simd Sub(Simd a, Simd b) { return _mm256_sub_ps(a, b); }
+KALDI_SIMD_FUNC inline Simd Mul(Simd a, Simd b) { return _mm256_mul_ps(a, b); }
+KALDI_SIMD_FUNC inline Simd Div(Simd a, Simd b) { return _mm256_div_ps(a, b); }
+KALDI_SIMD_FUNC inline Simd MulAdd(Simd a, Simd b, Simd c) {  // a * b + c
+  return _mm256_fmadd_ps(a, b, c);
+}
+KALDI_SIMD_FUNC inline Simd Min(Simd a, Simd b) { return _mm256_min_ps(a, b); }
+KALDI_SIMD_FUNC inline Simd Max(Simd a, Simd b) { return _mm256_max_ps(a, b); }
+KALDI_SIMD_FUNC inline Simd Less(Simd a, Simd b) {
+  return _mm256_cmp_ps(a, b, _CMP_LT_OQ);
+}
+KALDI_SIMD_FUNC inline Simd Equal(Simd a, Simd b) {
+  return _mm256_cmp_ps(a, b, _CMP_EQ_OQ);
+}
+KALDI_SIMD_FUNC inline Simd IsNan(Simd a) {
+  return _mm256_cmp_ps(a, a, _CMP_UNORD_Q);
+}
+KALDI_SIMD_FUNC inline Simd Select(Simd mask, Simd a, Simd b) {
+  return _mm256_blendv_ps(b, a, mask);
+}
+KALDI_SIMD_FUNC inline Simd Floor(Simd a) { return _mm256_floor_ps(a); }
+// Returns 2^n, for integer-valued n with -126 <= n <= 127.
+KALDI_SIMD_FUNC inline Simd Pow2(Simd n) {
+  __m256i i = _mm256_add_epi32(_mm256_cvttps_epi32(n), _mm256_set1_epi32(127));
+  return _mm256_castsi256_ps(_mm256_slli_epi32(i, 23));
+}
+// For positive normal a, returns m in [0.5, 1) and sets *e so that
+// a = m * 2^e.
+KALDI_SIMD_FUNC inline Simd Frexp(Simd a, Simd *e) {
+  __m256i bits = _mm256_castps_si256(a);
+  *e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23),
+                                           _mm256_set1_epi32(126)));
+  bits = _mm256_or_si256(_mm256_and_si256(bits,
+                                          _mm256_set1_epi32(0x007fffff)),
+                         _mm256_set1_epi32(0x3f000000));
+  return _mm256_castsi256_ps(bits);
+}
+// Loads kSimdWidth unsigned integers and converts them to float.
+KALDI_SIMD_FUNC inline Simd LoadUint16(const uint16 *p) {
+  __m128i i = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(i));
+}
+KALDI_SIMD_FUNC inline Simd LoadUint8(const unsigned char *p) {
+  __m128i i = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+  return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(i));
+}
+// Stores kSimdWidth floats, which must be integers in the range of the
+// output type, as unsigned integers.
+KALDI_SIMD_FUNC inline __m128i PackUint16(Simd a) {
+  __m256i i = _mm256_cvttps_epi32(a);
+  return _mm_packus_epi32(_mm256_castsi256_si128(i),
+                          _mm256_extracti128_si256(i, 1));
+}
+KALDI_SIMD_FUNC inline void StoreUint16(uint16 *p, Simd a) {
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(p), PackUint16(a));
+}
+KALDI_SIMD_FUNC inline void StoreUint8(unsigned char *p, Simd a) {
+  __m128i i = PackUint16(a);
+  _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packus_epi16(i, i));
+}
+
+#include "matrix/vectorized-math-simd.h"
+
+} // namespace avx2
+
+const VectorizedMathKernels *GetAvx2Kernels() {
+  return &avx2::kKernels;
+}
+
+#else
+
+const VectorizedMathKernels *GetAvx2Kernels() { return NULL; }
+
+#endif
+
+} // end namespace kaldi.
@@ -0,0 +1,99 @@
+// matrix/vectorized-math-kernels.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_MATRIX_VECTORIZED_MATH_KERNELS_H_
+#define KALDI_MATRIX_VECTORIZED_MATH_KERNELS_H_
+
+#include "matrix/matrix-common.h"
+
+// This header is internal to the implementation of vectorized-math.h; other
+// code should not need it.
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || \
+  defined(_M_IX86)
+#define KALDI_SIMD_X86
+#endif
+
+// KALDI_SIMD_TARGET(isa) is placed on the declaration of each function that
+// uses the intrinsics of an instruction set which the compiler does not
+// enable by default, so that e.g. the AVX2 kernels can be compiled with the
+// default build flags and then used only if the CPU supports them.
+#if defined(_MSC_VER)
+// MSVC allows the intrinsics of any instruction set to be used anywhere.
+#define KALDI_SIMD_TARGET(isa)
+#define KALDI_SIMD_CAN_TARGET_AVX2 1
+#elif defined(__clang__) || (defined(__GNUC__) && \
+      (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define KALDI_SIMD_TARGET(isa) __attribute__((target(isa)))
+#define KALDI_SIMD_CAN_TARGET_AVX2 1
+#else
+// Older compilers can only use the instruction sets that are enabled by the
+// build flags (e.g. -mavx2 -mfma).
+#define KALDI_SIMD_TARGET(isa)
+#if defined(__AVX2__) && defined(__FMA__)
+#define KALDI_SIMD_CAN_TARGET_AVX2 1
+#else
+#define KALDI_SIMD_CAN_TARGET_AVX2 0
+#endif
+#endif
+
+namespace kaldi {
+
+/// The float kernels for one instruction set.  See the functions with the
+/// same names in vectorized-math.h for what they do.
+struct VectorizedMathKernels {
+  void (*exp)(const float *x, MatrixIndexT n, float *y);
+  void (*log)(const float *x, MatrixIndexT n, float *y);
+  void (*tanh)(const float *x, MatrixIndexT n, float *y);
+  void (*sigmoid)(const float *x, MatrixIndexT n, float *y);
+  void (*decompress_uint16)(const uint16 *x, MatrixIndexT n,
+                            float min_value, float increment, float *y);
+  void (*decompress_uint8)(const unsigned char *x, MatrixIndexT n,
+                           float p0, float p25, float p75, float p100,
+                           float *y);
+  void (*compress_uint16)(const float *x, MatrixIndexT n,
+                          float min_value, float range, uint16 *y);
+  void (*compress_uint8)(const float *x, MatrixIndexT n,
+                         float p0, float p25, float p75, float p100,
+                         unsigned char *y);
+  void (*srfft_butterflies)(float *xr, float *xi, MatrixIndexT logn,
+                            const float *tab);
+  // The number of signals that srfft_interleaved transforms at once; it is 1
+  // (and srfft_interleaved is NULL) for the scalar kernels.
+  int32 srfft_num_lanes;
+  void (*srfft_interleaved)(float *xr, float *xi, MatrixIndexT logn,
+                            const float *const *tab);
+  void (*polyphase_filter)(const float *x, MatrixIndexT x_step,
+                           const int32 *x_offsets, const float *const *w,
+                           const int32 *num_taps, MatrixIndexT num_phases,
+                           MatrixIndexT first_phase, MatrixIndexT num_out,
+                           float *y);
+};
+
+/// These return the kernels for each instruction set (defined in
+/// vectorized-math-sse2.cc etc.), or NULL if they could not be compiled for
+/// this architecture or with this compiler.
+const VectorizedMathKernels *GetSse2Kernels();
+const VectorizedMathKernels *GetAvx2Kernels();
+const VectorizedMathKernels *GetNeonKernels();
+
+} // end namespace kaldi.
+
+#endif
@@ -0,0 +1,119 @@
+// matrix/vectorized-math-neon.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+// The 64-bit ARM NEON versions of the float kernels, 4 elements at a time.
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include "matrix/vectorized-math-kernels.h"
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+// NEON is always enabled on 64-bit ARM.
+#define KALDI_SIMD_FUNC static
+#endif
+
+namespace kaldi {
+
+#if defined(__aarch64__)
+
+namespace neon {
+
+// The comparisons return masks in the same type as the data (all bits set
+// where the condition is true), and Select(mask, a, b) takes a where the mask
+// is set and b elsewhere.
+typedef float32x4_t Simd;
+const int32 kSimdWidth = 4;
+
+KALDI_SIMD_FUNC inline Simd Set(float f) { return vdupq_n_f32(f); }
+KALDI_SIMD_FUNC inline Simd Load(const float *p) { return vld1q_f32(p); }
+KALDI_SIMD_FUNC inline void Store(float *p, Simd a) { vst1q_f32(p, a); }
+KALDI_SIMD_FUNC inline Simd Add(Simd a, Simd b) { return vaddq_f32(a, b); }
+KALDI_SIMD_FUNC inline Simd Sub(Simd a, Simd b) { return vsubq_f32(a, b); }
+KALDI_SIMD_FUNC inline Simd Mul(Simd a, Simd b) { return vmulq_f32(a, b); }
+KALDI_SIMD_FUNC inline Simd Div(Simd a, Simd b) { return vdivq_f32(a, b); }
+KALDI_SIMD_FUNC inline Simd MulAdd(Simd a, Simd b, Simd c) {
+  return vfmaq_f32(c, a, b);
+}
+// vminq/vmaxq propagate NaNs, which is what we want.
+KALDI_SIMD_FUNC inline Simd Min(Simd a, Simd b) { return vminq_f32(a, b); }
+KALDI_SIMD_FUNC inline Simd Max(Simd a, Simd b) { return vmaxq_f32(a, b); }
+KALDI_SIMD_FUNC inline Simd Less(Simd a, Simd b) {
+  return vreinterpretq_f32_u32(vcltq_f32(a, b));
+}
+KALDI_SIMD_FUNC inline Simd Equal(Simd a, Simd b) {
+  return vreinterpretq_f32_u32(vceqq_f32(a, b));
+}
+KALDI_SIMD_FUNC inline Simd IsNan(Simd a) {
+  return vreinterpretq_f32_u32(vmvnq_u32(vceqq_f32(a, a)));
+}
+KALDI_SIMD_FUNC inline Simd Select(Simd mask, Simd a, Simd b) {
+  return vbslq_f32(vreinterpretq_u32_f32(mask), a, b);
+}
+KALDI_SIMD_FUNC inline Simd Floor(Simd a) { return vrndmq_f32(a); }
+KALDI_SIMD_FUNC inline Simd Pow2(Simd n) {
+  int32x4_t i = vaddq_s32(vcvtq_s32_f32(n), vdupq_n_s32(127));
+  return vreinterpretq_f32_s32(vshlq_n_s32(i, 23));
+}
+KALDI_SIMD_FUNC inline Simd Frexp(Simd a, Simd *e) {
+  int32x4_t bits = vreinterpretq_s32_f32(a);
+  *e = vcvtq_f32_s32(vsubq_s32(vshrq_n_s32(bits, 23), vdupq_n_s32(126)));
+  bits = vorrq_s32(vandq_s32(bits, vdupq_n_s32(0x007fffff)),
+                   vdupq_n_s32(0x3f000000));
+  return vreinterpretq_f32_s32(bits);
+}
+// Loads kSimdWidth unsigned integers and converts them to float.
+KALDI_SIMD_FUNC inline Simd LoadUint16(const uint16 *p) {
+  return vcvtq_f32_u32(vmovl_u16(vld1_u16(p)));
+}
+KALDI_SIMD_FUNC inline Simd LoadUint8(const unsigned char *p) {
+  uint32 bytes;
+  memcpy(&bytes, p, sizeof(bytes));
+  uint16x8_t i = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(bytes)));
+  return vcvtq_f32_u32(vmovl_u16(vget_low_u16(i)));
+}
+// Stores kSimdWidth floats, which must be integers in the range of the
+// output type, as unsigned integers.
+KALDI_SIMD_FUNC inline void StoreUint16(uint16 *p, Simd a) {
+  vst1_u16(p, vmovn_u32(vcvtq_u32_f32(a)));
+}
+KALDI_SIMD_FUNC inline void StoreUint8(unsigned char *p, Simd a) {
+  uint16x4_t i = vmovn_u32(vcvtq_u32_f32(a));
+  uint32 bytes = vget_lane_u32(
+      vreinterpret_u32_u8(vmovn_u16(vcombine_u16(i, i))), 0);
+  memcpy(p, &bytes, sizeof(bytes));
+}
+
+#include "matrix/vectorized-math-simd.h"
+
+} // namespace neon
+
+const VectorizedMathKernels *GetNeonKernels() {
+  return &neon::kKernels;
+}
+
+#else
+
+const VectorizedMathKernels *GetNeonKernels() { return NULL; }
+
+#endif
+
+} // end namespace kaldi.
@@ -0,0 +1,483 @@
+// matrix/vectorized-math-simd.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+// This file is included, inside a namespace of its own, by each of the
+// files vectorized-math-sse2.cc, vectorized-math-avx2.cc and
+// vectorized-math-neon.cc, and contains the parts of the kernels that are
+// the same for all instruction sets.  It has no include guard, and should
+// not be included anywhere else.  The including file must first define:
+//   - the type Simd, which holds kSimdWidth floats;
+//   - the macro KALDI_SIMD_FUNC, which declares a function as static and
+//     (with KALDI_SIMD_TARGET) enables the instruction set for it;
+//   - the primitives Set(), Load(), Store(), Add(), Sub(), Mul(), Div(),
+//     MulAdd(), Min(), Max(), Less(), Equal(), IsNan(), Select(), Floor(),
+//     Pow2(), Frexp(), LoadUint16(), LoadUint8(), StoreUint16() and
+//     StoreUint8().
+// It defines kKernels, the VectorizedMathKernels for the instruction set.
+
+// exp(x) = 2^n * exp(r), with n = round(x / log(2)) and |r| <= log(2) / 2;
+// exp(r) is a degree-6 polynomial (from Cephes' expf).  2^n is applied as two
+// factors, so that results in the denormal range and overflow to infinity
+// come out right without special cases.
+KALDI_SIMD_FUNC inline Simd ExpSimd(Simd x) {
+  Simd nan_mask = IsNan(x);
+  Simd a = Max(Min(x, Set(150.0f)), Set(-150.0f));
+  Simd n = Floor(MulAdd(a, Set(1.44269504088896341f), Set(0.5f)));
+  Simd r = Sub(a, Mul(n, Set(0.693359375f)));
+  r = Sub(r, Mul(n, Set(-2.12194440e-4f)));
+  Simd p = Set(1.9875691500e-4f);
+  p = MulAdd(p, r, Set(1.3981999507e-3f));
+  p = MulAdd(p, r, Set(8.3334519073e-3f));
+  p = MulAdd(p, r, Set(4.1665795894e-2f));
+  p = MulAdd(p, r, Set(1.6666665459e-1f));
+  p = MulAdd(p, r, Set(5.0000001201e-1f));
+  p = MulAdd(p, Mul(r, r), Add(r, Set(1.0f)));
+  Simd n1 = Floor(Mul(n, Set(0.5f))), n2 = Sub(n, n1);
+  Simd ans = Mul(Mul(p, Pow2(n1)), Pow2(n2));
+  return Select(nan_mask, x, ans);
+}
+
+// log(x) = e * log(2) + log(m), with x = m * 2^e and sqrt(0.5) <= m <
+// sqrt(2); log(m) uses the polynomial from Cephes' logf.
+KALDI_SIMD_FUNC inline Simd LogSimd(Simd x) {
+  Simd zero = Set(0.0f), one = Set(1.0f);
+  Simd nan_mask = Select(IsNan(x), IsNan(x), Less(x, zero)),
+      zero_mask = Equal(x, zero),
+      inf_mask = Equal(x, Set(std::numeric_limits<float>::infinity())),
+      denorm_mask = Less(x, Set(std::numeric_limits<float>::min()));
+  // Scale up denormals so that Frexp() works.
+  Simd a = Select(denorm_mask, Mul(x, Set(8388608.0f)), x), e;
+  Simd m = Frexp(a, &e);
+  e = Sub(e, Select(denorm_mask, Set(23.0f), zero));
+  Simd small_mask = Less(m, Set(0.707106781186547524f));
+  e = Sub(e, Select(small_mask, one, zero));
+  m = Sub(Add(m, Select(small_mask, m, zero)), one);
+  Simd z = Mul(m, m);
+  Simd y = Set(7.0376836292e-2f);
+  y = MulAdd(y, m, Set(-1.1514610310e-1f));
+  y = MulAdd(y, m, Set(1.1676998740e-1f));
+  y = MulAdd(y, m, Set(-1.2420140846e-1f));
+  y = MulAdd(y, m, Set(1.4249322787e-1f));
+  y = MulAdd(y, m, Set(-1.6668057665e-1f));
+  y = MulAdd(y, m, Set(2.0000714765e-1f));
+  y = MulAdd(y, m, Set(-2.4999993993e-1f));
+  y = MulAdd(y, m, Set(3.3333331174e-1f));
+  y = Mul(Mul(y, m), z);
+  y = MulAdd(e, Set(-2.12194440e-4f), y);
+  y = MulAdd(z, Set(-0.5f), y);
+  Simd ans = MulAdd(e, Set(0.693359375f), Add(m, y));
+  ans = Select(zero_mask, Set(-std::numeric_limits<float>::infinity()), ans);
+  ans = Select(inf_mask, x, ans);
+  return Select(nan_mask, Set(std::numeric_limits<float>::quiet_NaN()), ans);
+}
+
+// For |x| < 0.625 a polynomial (from Cephes' tanhf); otherwise
+// (1 - exp(-2|x|)) / (1 + exp(-2|x|)), with the sign of x.
+KALDI_SIMD_FUNC inline Simd TanhSimd(Simd x) {
+  Simd zero = Set(0.0f), one = Set(1.0f);
+  Simd negative_mask = Less(x, zero),
+      abs_x = Select(negative_mask, Sub(zero, x), x);
+  Simd t = ExpSimd(Mul(abs_x, Set(-2.0f)));
+  Simd large = Div(Sub(one, t), Add(one, t));
+  large = Select(negative_mask, Sub(zero, large), large);
+  Simd z = Mul(x, x);
+  Simd small = Set(-5.70498872745e-3f);
+  small = MulAdd(small, z, Set(2.06390887954e-2f));
+  small = MulAdd(small, z, Set(-5.37397155531e-2f));
+  small = MulAdd(small, z, Set(1.33314422036e-1f));
+  small = MulAdd(small, z, Set(-3.33332819422e-1f));
+  small = MulAdd(Mul(small, z), x, x);
+  return Select(Less(abs_x, Set(0.625f)), small, large);
+}
+
+KALDI_SIMD_FUNC inline Simd SigmoidSimd(Simd x) {
+  Simd one = Set(1.0f);
+  return Div(one, Add(one, ExpSimd(Sub(Set(0.0f), x))));
+}
+
+struct ExpOp {
+  KALDI_SIMD_FUNC Simd Apply(Simd x) { return ExpSimd(x); }
+};
+struct LogOp {
+  KALDI_SIMD_FUNC Simd Apply(Simd x) { return LogSimd(x); }
+};
+struct TanhOp {
+  KALDI_SIMD_FUNC Simd Apply(Simd x) { return TanhSimd(x); }
+};
+struct SigmoidOp {
+  KALDI_SIMD_FUNC Simd Apply(Simd x) { return SigmoidSimd(x); }
+};
+
+// Applies Op::Apply() to the elements of x, writing to y.  The last partial
+// group of elements goes through a temporary, so that all elements get
+// exactly the same computation.
+template<class Op>
+KALDI_SIMD_FUNC void ApplySimd(const float *x, MatrixIndexT n, float *y) {
+  MatrixIndexT i = 0;
+  for (; i + kSimdWidth <= n; i += kSimdWidth)
+    Store(y + i, Op::Apply(Load(x + i)));
+  if (i < n) {
+    float temp[kSimdWidth];
+    std::fill(temp, temp + kSimdWidth, 0.0f);
+    std::copy(x + i, x + n, temp);
+    Store(temp, Op::Apply(Load(temp)));
+    std::copy(temp, temp + (n - i), y + i);
+  }
+}
+
+
+KALDI_SIMD_FUNC void Exp(const float *x, MatrixIndexT n, float *y) {
+  ApplySimd<ExpOp>(x, n, y);
+}
+
+KALDI_SIMD_FUNC void Log(const float *x, MatrixIndexT n, float *y) {
+  ApplySimd<LogOp>(x, n, y);
+}
+
+KALDI_SIMD_FUNC void Tanh(const float *x, MatrixIndexT n, float *y) {
+  ApplySimd<TanhOp>(x, n, y);
+}
+
+KALDI_SIMD_FUNC void Sigmoid(const float *x, MatrixIndexT n, float *y) {
+  ApplySimd<SigmoidOp>(x, n, y);
+}
+
+// The multiplication and the addition are done separately (not with
+// MulAdd()) so that the result is exactly the same as that of
+// CompressedMatrix::Uint16ToFloat().
+KALDI_SIMD_FUNC void DecompressUint16(const uint16 *x, MatrixIndexT n,
+                                      float min_value, float increment,
+                                      float *y) {
+  Simd min_simd = Set(min_value), increment_simd = Set(increment);
+  MatrixIndexT i = 0;
+  for (; i + kSimdWidth <= n; i += kSimdWidth)
+    Store(y + i, Add(min_simd, Mul(increment_simd, LoadUint16(x + i))));
+  for (; i < n; i++)
+    y[i] = min_value + increment * x[i];
+}
+
+KALDI_SIMD_FUNC inline Simd Uint8ToFloat(Simd v, Simd p0, Simd s0,
+                                         Simd p25, Simd s25,
+                                         Simd p75, Simd s75) {
+  // As in DecompressUint16(), we don't use MulAdd().
+  Simd lower = Add(p0, Mul(s0, v)),
+      middle = Add(p25, Mul(s25, Sub(v, Set(64.0f)))),
+      upper = Add(p75, Mul(s75, Sub(v, Set(192.0f))));
+  return Select(Less(v, Set(64.5f)), lower,
+                Select(Less(v, Set(192.5f)), middle, upper));
+}
+
+KALDI_SIMD_FUNC void DecompressUint8(const unsigned char *x, MatrixIndexT n,
+                                     float p0, float p25, float p75,
+                                     float p100, float *y) {
+  // The same computation as CompressedMatrix::CharToFloat().
+  Simd p0_simd = Set(p0), p25_simd = Set(p25), p75_simd = Set(p75),
+      s0 = Set((p25 - p0) * (1.0f / 64.0f)),
+      s25 = Set((p75 - p25) * (1.0f / 128.0f)),
+      s75 = Set((p100 - p75) * (1.0f / 63.0f));
+  MatrixIndexT i = 0;
+  for (; i + kSimdWidth <= n; i += kSimdWidth)
+    Store(y + i, Uint8ToFloat(LoadUint8(x + i), p0_simd, s0, p25_simd, s25,
+                              p75_simd, s75));
+  if (i < n) {
+    unsigned char temp_in[kSimdWidth];
+    float temp_out[kSimdWidth];
+    std::fill(temp_in, temp_in + kSimdWidth, 0);
+    std::copy(x + i, x + n, temp_in);
+    Store(temp_out, Uint8ToFloat(LoadUint8(temp_in), p0_simd, s0, p25_simd,
+                                 s25, p75_simd, s75));
+    std::copy(temp_out, temp_out + (n - i), y + i);
+  }
+}
+
+// The same computation as CompressedMatrix::FloatToUint16().
+KALDI_SIMD_FUNC inline Simd FloatToUint16(Simd x, Simd min_value, Simd range) {
+  Simd f = Div(Sub(x, min_value), range);
+  f = Min(Max(f, Set(0.0f)), Set(1.0f));
+  return Floor(Add(Mul(f, Set(65535.0f)), Set(0.499f)));
+}
+
+KALDI_SIMD_FUNC void CompressUint16(const float *x, MatrixIndexT n,
+                                    float min_value, float range, uint16 *y) {
+  Simd min_simd = Set(min_value), range_simd = Set(range);
+  MatrixIndexT i = 0;
+  for (; i + kSimdWidth <= n; i += kSimdWidth)
+    StoreUint16(y + i, FloatToUint16(Load(x + i), min_simd, range_simd));
+  if (i < n) {
+    float temp_in[kSimdWidth];
+    uint16 temp_out[kSimdWidth];
+    std::fill(temp_in, temp_in + kSimdWidth, min_value);
+    std::copy(x + i, x + n, temp_in);
+    StoreUint16(temp_out, FloatToUint16(Load(temp_in), min_simd, range_simd));
+    std::copy(temp_out, temp_out + (n - i), y + i);
+  }
+}
+
+// The same computation as CompressUint8Scalar() in vectorized-math.cc: the
+// value is encoded in each of the three ranges, and the right one is
+// selected.
+KALDI_SIMD_FUNC inline Simd FloatToUint8(Simd x, Simd p0, Simd d0, Simd p25,
+                                         Simd d25, Simd p75, Simd d75) {
+  Simd zero = Set(0.0f), half = Set(0.5f);
+  Simd a0 = Add(Mul(Div(Sub(x, p0), d0), Set(64.0f)), half),
+      a25 = Add(Mul(Div(Sub(x, p25), d25), Set(128.0f)), half),
+      a75 = Add(Mul(Div(Sub(x, p75), d75), Set(63.0f)), half);
+  a0 = Floor(Min(Max(a0, zero), Set(64.0f)));
+  a25 = Add(Floor(Min(Max(a25, zero), Set(128.0f))), Set(64.0f));
+  a75 = Add(Floor(Min(Max(a75, zero), Set(63.0f))), Set(192.0f));
+  return Select(Less(x, p25), a0, Select(Less(x, p75), a25, a75));
+}
+
+KALDI_SIMD_FUNC void CompressUint8(const float *x, MatrixIndexT n,
+                                   float p0, float p25, float p75, float p100,
+                                   unsigned char *y) {
+  Simd p0_simd = Set(p0), p25_simd = Set(p25), p75_simd = Set(p75),
+      d0 = Set(p25 - p0), d25 = Set(p75 - p25), d75 = Set(p100 - p75);
+  MatrixIndexT i = 0;
+  for (; i + kSimdWidth <= n; i += kSimdWidth)
+    StoreUint8(y + i, FloatToUint8(Load(x + i), p0_simd, d0, p25_simd, d25,
+                                   p75_simd, d75));
+  if (i < n) {
+    float temp_in[kSimdWidth];
+    unsigned char temp_out[kSimdWidth];
+    std::fill(temp_in, temp_in + kSimdWidth, p0);
+    std::copy(x + i, x + n, temp_in);
+    StoreUint8(temp_out, FloatToUint8(Load(temp_in), p0_simd, d0, p25_simd,
+                                      d25, p75_simd, d75));
+    std::copy(temp_out, temp_out + (n - i), y + i);
+  }
+}
+
+// a[i], b[i] <-- a[i] + b[i], a[i] - b[i].
+KALDI_SIMD_FUNC inline void SumDiff(float *a, float *b, MatrixIndexT n) {
+  MatrixIndexT i = 0;
+  for (; i + kSimdWidth <= n; i += kSimdWidth) {
+    Simd va = Load(a + i), vb = Load(b + i);
+    Store(a + i, Add(va, vb));
+    Store(b + i, Sub(va, vb));
+  }
+  for (; i < n; i++) {
+    float ai = a[i], bi = b[i];
+    a[i] = ai + bi;
+    b[i] = ai - bi;
+  }
+}
+
+// Multiplies by the twiddle factors: with t = c * (r + i),
+// (r, i) <-- (smc * i + t, spc * r + t).
+KALDI_SIMD_FUNC inline void Twiddle(float *xr, float *xi,
+                                    const float *c, const float *spc,
+                                    const float *smc, MatrixIndexT n) {
+  MatrixIndexT j = 0;
+  for (; j + kSimdWidth <= n; j += kSimdWidth) {
+    Simd r = Load(xr + j), i = Load(xi + j),
+        t = Mul(Load(c + j), Add(r, i));
+    Store(xr + j, Add(Mul(Load(smc + j), i), t));
+    Store(xi + j, Add(Mul(Load(spc + j), r), t));
+  }
+  for (; j < n; j++) {
+    float t = c[j] * (xr[j] + xi[j]),
+        r = spc[j] * xr[j] + t;
+    xr[j] = smc[j] * xi[j] + t;
+    xi[j] = r;
+  }
+}
+
+// Step 2 of the butterflies, on n elements of the second and last quarters
+// (r1, i1) and (r2, i2): (r1, i1, r2, i2) <-- (r1 + i2, i1 - r2, r1 - i2,
+// i1 + r2).
+KALDI_SIMD_FUNC inline void CrossSumDiff(float *xr1, float *xi1,
+                                         float *xr2, float *xi2,
+                                         MatrixIndexT n) {
+  MatrixIndexT j = 0;
+  for (; j + kSimdWidth <= n; j += kSimdWidth) {
+    Simd r1 = Load(xr1 + j), r2 = Load(xr2 + j),
+        i1 = Load(xi1 + j), i2 = Load(xi2 + j);
+    Store(xr1 + j, Add(r1, i2));
+    Store(xi2 + j, Add(i1, r2));
+    Store(xi1 + j, Sub(i1, r2));
+    Store(xr2 + j, Sub(r1, i2));
+  }
+  for (; j < n; j++) {
+    float r1 = xr1[j], r2 = xr2[j], i1 = xi1[j], i2 = xi2[j];
+    xr1[j] = r1 + i2;
+    xi2[j] = i1 + r2;
+    xi1[j] = i1 - r2;
+    xr2[j] = r1 - i2;
+  }
+}
+
+// Multiplies n elements of the second quarter by sqrt(1/2) (1 - i) and the
+// same elements of the last quarter by -sqrt(1/2) (1 + i).
+KALDI_SIMD_FUNC inline void SqrtHalfTwiddle(float *xr1, float *xi1,
+                                            float *xr2, float *xi2,
+                                            MatrixIndexT n) {
+  const float sqhalf = M_SQRT1_2;
+  MatrixIndexT j = 0;
+  Simd s = Set(sqhalf), minus_s = Set(-sqhalf);
+  for (; j + kSimdWidth <= n; j += kSimdWidth) {
+    Simd r1 = Load(xr1 + j), i1 = Load(xi1 + j),
+        r2 = Load(xr2 + j), i2 = Load(xi2 + j);
+    Store(xr1 + j, Mul(s, Add(r1, i1)));
+    Store(xi1 + j, Mul(s, Sub(i1, r1)));
+    Store(xr2 + j, Mul(s, Sub(i2, r2)));
+    Store(xi2 + j, Mul(minus_s, Add(r2, i2)));
+  }
+  for (; j < n; j++) {
+    float r1 = xr1[j], i1 = xi1[j], r2 = xr2[j], i2 = xi2[j];
+    xr1[j] = sqhalf * (r1 + i1);
+    xi1[j] = sqhalf * (i1 - r1);
+    xr2[j] = sqhalf * (i2 - r2);
+    xi2[j] = -sqhalf * (r2 + i2);
+  }
+}
+
+KALDI_SIMD_FUNC void SrfftButterflies(float *xr, float *xi, MatrixIndexT logn,
+                                      const float *tab) {
+  MatrixIndexT m = 1 << logn, m2 = m / 2, m4 = m2 / 2, m8 = m4 / 2;
+  // Step 1.
+  SumDiff(xr, xr + m2, m2);
+  SumDiff(xi, xi + m2, m2);
+
+  // Step 2.
+  float *xr1 = xr + m2, *xr2 = xr1 + m4,
+      *xi1 = xi + m2, *xi2 = xi1 + m4;
+  CrossSumDiff(xr1, xi1, xr2, xi2, m4);
+
+  // Steps 3 and 4.  Index m8 has the twiddle factor sqrt(1/2) (1 - i), which
+  // is not in the tables; the other indexes 1 <= n < m4 are in the tables.
+  if (m8 > 0)
+    SqrtHalfTwiddle(xr1 + m8, xi1 + m8, xr2 + m8, xi2 + m8, 1);
+  if (logn >= 4) {
+    MatrixIndexT nel = m4 - 2;
+    const float *cn = tab, *spcn = cn + nel, *smcn = spcn + nel,
+        *c3n = smcn + nel, *spc3n = c3n + nel, *smc3n = spc3n + nel;
+    // 1 <= n < m8.
+    Twiddle(xr1 + 1, xi1 + 1, cn, spcn, smcn, m8 - 1);
+    Twiddle(xr2 + 1, xi2 + 1, c3n, spc3n, smc3n, m8 - 1);
+    // m8 < n < m4.
+    Twiddle(xr1 + m8 + 1, xi1 + m8 + 1, cn + m8 - 1, spcn + m8 - 1,
+            smcn + m8 - 1, m4 - m8 - 1);
+    Twiddle(xr2 + m8 + 1, xi2 + m8 + 1, c3n + m8 - 1, spc3n + m8 - 1,
+            smc3n + m8 - 1, m4 - m8 - 1);
+  }
+}
+
+// As Twiddle(), for n interleaved elements of kSimdWidth floats each (see
+// SrfftInterleaved()); the floats of element j share the factors c[j],
+// spc[j] and smc[j].
+KALDI_SIMD_FUNC inline void TwiddleInterleaved(float *xr, float *xi,
+                                               const float *c,
+                                               const float *spc,
+                                               const float *smc,
+                                               MatrixIndexT n) {
+  for (MatrixIndexT j = 0; j < n; j++, xr += kSimdWidth, xi += kSimdWidth) {
+    Simd r = Load(xr), i = Load(xi), t = Mul(Set(c[j]), Add(r, i));
+    Store(xr, Add(Mul(Set(smc[j]), i), t));
+    Store(xi, Add(Mul(Set(spc[j]), r), t));
+  }
+}
+
+// The FFT without the bit-reversal permutation (i.e.
+// SplitRadixComplexFft::ComputeRecursive()) of kSimdWidth signals at once,
+// stored interleaved so that element n of all the signals is one Simd at
+// xr + n * kSimdWidth (and xi + n * kSimdWidth).  The operations are those of
+// ComputeRecursive() with each float replaced by a Simd, so every level of
+// the recursion uses whole registers, including the short transforms at the
+// bottom.
+KALDI_SIMD_FUNC void SrfftInterleaved(float *xr, float *xi, MatrixIndexT logn,
+                                      const float *const *tab) {
+  const MatrixIndexT w = kSimdWidth;
+  if (logn == 0) return;
+  if (logn == 1) {
+    SumDiff(xr, xr + w, w);
+    SumDiff(xi, xi + w, w);
+    return;
+  }
+  if (logn == 2) {
+    SumDiff(xr, xr + 2 * w, 2 * w);
+    SumDiff(xi, xi + 2 * w, 2 * w);
+    SumDiff(xr, xr + w, w);
+    SumDiff(xi, xi + w, w);
+    CrossSumDiff(xr + 2 * w, xi + 2 * w, xr + 3 * w, xi + 3 * w, w);
+    return;
+  }
+  MatrixIndexT m = 1 << logn, m2 = m / 2, m4 = m2 / 2, m8 = m4 / 2;
+  // Steps 1 to 4, as in SrfftButterflies().
+  SumDiff(xr, xr + m2 * w, m2 * w);
+  SumDiff(xi, xi + m2 * w, m2 * w);
+  float *xr1 = xr + m2 * w, *xr2 = xr1 + m4 * w,
+      *xi1 = xi + m2 * w, *xi2 = xi1 + m4 * w;
+  CrossSumDiff(xr1, xi1, xr2, xi2, m4 * w);
+  SqrtHalfTwiddle(xr1 + m8 * w, xi1 + m8 * w, xr2 + m8 * w, xi2 + m8 * w, w);
+  if (logn >= 4) {
+    MatrixIndexT nel = m4 - 2;
+    const float *cn = tab[logn - 4], *spcn = cn + nel, *smcn = spcn + nel,
+        *c3n = smcn + nel, *spc3n = c3n + nel, *smc3n = spc3n + nel;
+    TwiddleInterleaved(xr1 + w, xi1 + w, cn, spcn, smcn, m8 - 1);
+    TwiddleInterleaved(xr2 + w, xi2 + w, c3n, spc3n, smc3n, m8 - 1);
+    TwiddleInterleaved(xr1 + (m8 + 1) * w, xi1 + (m8 + 1) * w, cn + m8 - 1,
+                       spcn + m8 - 1, smcn + m8 - 1, m4 - m8 - 1);
+    TwiddleInterleaved(xr2 + (m8 + 1) * w, xi2 + (m8 + 1) * w, c3n + m8 - 1,
+                       spc3n + m8 - 1, smc3n + m8 - 1, m4 - m8 - 1);
+  }
+  SrfftInterleaved(xr, xi, logn - 1, tab);
+  SrfftInterleaved(xr + m2 * w, xi + m2 * w, logn - 2, tab);
+  SrfftInterleaved(xr + 3 * m4 * w, xi + 3 * m4 * w, logn - 2, tab);
+}
+
+// Each output is a dot product, done kSimdWidth taps at a time; the filters
+// are short (typically 10 to 50 taps), so the partial sums are added up
+// through memory rather than with shuffles.
+KALDI_SIMD_FUNC void PolyphaseFilter(const float *x, MatrixIndexT x_step,
+                                     const int32 *x_offsets,
+                                     const float *const *w,
+                                     const int32 *num_taps,
+                                     MatrixIndexT num_phases,
+                                     MatrixIndexT first_phase,
+                                     MatrixIndexT num_out, float *y) {
+  MatrixIndexT p = first_phase % num_phases,
+      x_start = (first_phase / num_phases) * x_step;
+  float partial_sums[kSimdWidth];
+  for (MatrixIndexT i = 0; i < num_out; i++) {
+    const float *this_x = x + x_start + x_offsets[p], *this_w = w[p];
+    int32 n = num_taps[p], j = 0;
+    Simd sum = Set(0.0f);
+    for (; j + kSimdWidth <= n; j += kSimdWidth)
+      sum = MulAdd(Load(this_w + j), Load(this_x + j), sum);
+    Store(partial_sums, sum);
+    float ans = 0.0f;
+    for (int32 k = 0; k < kSimdWidth; k++)
+      ans += partial_sums[k];
+    for (; j < n; j++)
+      ans += this_w[j] * this_x[j];
+    y[i] = ans;
+    if (++p == num_phases) {
+      p = 0;
+      x_start += x_step;
+    }
+  }
+}
+
+static const VectorizedMathKernels kKernels = {
+  Exp, Log, Tanh, Sigmoid, DecompressUint16, DecompressUint8,
+  CompressUint16, CompressUint8, SrfftButterflies, kSimdWidth,
+  SrfftInterleaved, PolyphaseFilter
+};
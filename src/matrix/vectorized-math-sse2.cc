@@ -0,0 +1,121 @@
+// matrix/vectorized-math-sse2.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+// The SSE2 versions of the float kernels, 4 elements at a time.
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include "matrix/vectorized-math-kernels.h"
+
+#if defined(KALDI_SIMD_X86)
+#include <emmintrin.h>
+#define KALDI_SIMD_FUNC KALDI_SIMD_TARGET("sse2") static
+#endif
+
+namespace kaldi {
+
+#if defined(KALDI_SIMD_X86)
+
+namespace sse2 {
+
+// The comparisons return masks in the same type as the data (all bits set
+// where the condition is true), and Select(mask, a, b) takes a where the mask
+// is set and b elsewhere.
+typedef __m128 Simd;
+const int32 kSimdWidth = 4;
+
+KALDI_SIMD_FUNC inline Simd Set(float f) { return _mm_set1_ps(f); }
+KALDI_SIMD_FUNC inline Simd Load(const float *p) { return _mm_loadu_ps(p); }
+KALDI_SIMD_FUNC inline void Store(float *p, Simd a) { _mm_storeu_ps(p, a); }
+KALDI_SIMD_FUNC inline Simd Add(Simd a, Simd b) { return _mm_add_ps(a, b); }
+KALDI_SIMD_FUNC inline Simd Sub(Simd a, Simd b) { return _mm_sub_ps(a, b); }
+KALDI_SIMD_FUNC inline Simd Mul(Simd a, Simd b) { return _mm_mul_ps(a, b); }
+KALDI_SIMD_FUNC inline Simd Div(Simd a, Simd b) { return _mm_div_ps(a, b); }
+KALDI_SIMD_FUNC inline Simd MulAdd(Simd a, Simd b, Simd c) {
+  return _mm_add_ps(_mm_mul_ps(a, b), c);
+}
+KALDI_SIMD_FUNC inline Simd Min(Simd a, Simd b) { return _mm_min_ps(a, b); }
+KALDI_SIMD_FUNC inline Simd Max(Simd a, Simd b) { return _mm_max_ps(a, b); }
+KALDI_SIMD_FUNC inline Simd Less(Simd a, Simd b) { return _mm_cmplt_ps(a, b); }
+KALDI_SIMD_FUNC inline Simd Equal(Simd a, Simd b) { return _mm_cmpeq_ps(a, b); }
+KALDI_SIMD_FUNC inline Simd IsNan(Simd a) { return _mm_cmpunord_ps(a, a); }
+KALDI_SIMD_FUNC inline Simd Select(Simd mask, Simd a, Simd b) {
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+// SSE2 has no floor instruction; truncate, and correct negative non-integers.
+// Requires |a| < 2^31.
+KALDI_SIMD_FUNC inline Simd Floor(Simd a) {
+  Simd t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+  return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.0f)));
+}
+KALDI_SIMD_FUNC inline Simd Pow2(Simd n) {
+  __m128i i = _mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(127));
+  return _mm_castsi128_ps(_mm_slli_epi32(i, 23));
+}
+KALDI_SIMD_FUNC inline Simd Frexp(Simd a, Simd *e) {
+  __m128i bits = _mm_castps_si128(a);
+  *e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23),
+                                     _mm_set1_epi32(126)));
+  bits = _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)),
+                      _mm_set1_epi32(0x3f000000));
+  return _mm_castsi128_ps(bits);
+}
+// Loads kSimdWidth unsigned integers and converts them to float.
+KALDI_SIMD_FUNC inline Simd LoadUint16(const uint16 *p) {
+  __m128i i = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+  return _mm_cvtepi32_ps(_mm_unpacklo_epi16(i, _mm_setzero_si128()));
+}
+KALDI_SIMD_FUNC inline Simd LoadUint8(const unsigned char *p) {
+  int32 bytes;
+  memcpy(&bytes, p, sizeof(bytes));
+  __m128i zero = _mm_setzero_si128(),
+      i = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero);
+  return _mm_cvtepi32_ps(_mm_unpacklo_epi16(i, zero));
+}
+// Stores kSimdWidth floats, which must be integers in the range of the
+// output type, as unsigned integers.  SSE2 has no unsigned 32 to 16-bit pack,
+// so we offset the values into the signed range and back.
+KALDI_SIMD_FUNC inline void StoreUint16(uint16 *p, Simd a) {
+  __m128i i = _mm_sub_epi32(_mm_cvttps_epi32(a), _mm_set1_epi32(32768));
+  i = _mm_xor_si128(_mm_packs_epi32(i, i), _mm_set1_epi16(-32768));
+  _mm_storel_epi64(reinterpret_cast<__m128i*>(p), i);
+}
+KALDI_SIMD_FUNC inline void StoreUint8(unsigned char *p, Simd a) {
+  __m128i i = _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_setzero_si128());
+  int32 bytes = _mm_cvtsi128_si32(_mm_packus_epi16(i, i));
+  memcpy(p, &bytes, sizeof(bytes));
+}
+
+#include "matrix/vectorized-math-simd.h"
+
+} // namespace sse2
+
+const VectorizedMathKernels *GetSse2Kernels() {
+  return &sse2::kKernels;
+}
+
+#else
+
+const VectorizedMathKernels *GetSse2Kernels() { return NULL; }
+
+#endif
+
+} // end namespace kaldi.
@@ -0,0 +1,325 @@
+// matrix/vectorized-math-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <limits>
+#include "matrix/cpu-features.h"
+#include "matrix/matrix-lib.h"
+#include "matrix/srfft.h"
+#include "matrix/vectorized-math.h"
+
+namespace kaldi {
+
+// Checks that the relative difference between "a" and the reference value
+// "ref" (computed in double precision) is at most "tolerance".
+static void AssertRelativelyClose(double a, double ref, double tolerance) {
+  if (KALDI_ISNAN(ref)) {
+    KALDI_ASSERT(KALDI_ISNAN(a));
+  } else if (KALDI_ISINF(ref) || ref == 0.0) {
+    KALDI_ASSERT(a == ref);
+  } else if (std::abs(a - ref) > tolerance * std::abs(ref)) {
+    KALDI_ERR << "Value " << a << " differs from " << ref;
+  }
+}
+
+template<typename Real>
+static void UnitTestVectorizedFunctions() {
+  // The documented accuracy is for float; double is exact except for the
+  // sigmoid formula.
+  double tolerance = (sizeof(Real) == 4 ? 2.0e-07 : 1.0e-14);
+  for (int32 i = 0; i < 10; i++) {
+    // Odd dimensions test the handling of the last partial group.
+    MatrixIndexT dim = RandInt(1, 100);
+    Vector<Real> x(dim), y(dim);
+    x.SetRandn();
+    x.Scale(RandInt(1, 30));
+
+    VectorizedExp(x.Data(), dim, y.Data());
+    for (MatrixIndexT j = 0; j < dim; j++)
+      AssertRelativelyClose(y(j), std::exp(double(x(j))), tolerance);
+
+    VectorizedTanh(x.Data(), dim, y.Data());
+    for (MatrixIndexT j = 0; j < dim; j++)
+      AssertRelativelyClose(y(j), std::tanh(double(x(j))), tolerance);
+
+    VectorizedSigmoid(x.Data(), dim, y.Data());
+    for (MatrixIndexT j = 0; j < dim; j++)
+      AssertRelativelyClose(y(j), 1.0 / (1.0 + std::exp(-double(x(j)))),
+                            tolerance);
+
+    x.ApplyAbs();
+    VectorizedLog(x.Data(), dim, y.Data());
+    for (MatrixIndexT j = 0; j < dim; j++)
+      AssertRelativelyClose(y(j), std::log(double(x(j))), tolerance);
+
+    // in-place.
+    y.CopyFromVec(x);
+    VectorizedExp(y.Data(), dim, y.Data());
+    for (MatrixIndexT j = 0; j < dim; j++)
+      AssertRelativelyClose(y(j), std::exp(double(x(j))), tolerance);
+
+    Real offset = x.Max(), cutoff = x(RandInt(0, dim - 1));
+    double sum = 0.0;
+    for (MatrixIndexT j = 0; j < dim; j++)
+      if (x(j) >= cutoff)
+        sum += std::exp(double(x(j)) - offset);
+    AssertRelativelyClose(VectorizedSumExp(x.Data(), dim, offset, cutoff),
+                          sum, tolerance * 10);
+  }
+}
+
+template<typename Real>
+static void UnitTestVectorizedSpecialValues() {
+  Real inf = std::numeric_limits<Real>::infinity(),
+      nan = std::numeric_limits<Real>::quiet_NaN();
+  Real x[] = { 0.0, -1.0, inf, -inf, nan, 100.0, -1000.0, 1.0e-30 };
+  const MatrixIndexT n = sizeof(x) / sizeof(x[0]);
+  Real y[n];
+  VectorizedExp(x, n, y);
+  KALDI_ASSERT(y[0] == 1.0 && y[2] == inf && y[3] == 0.0 &&
+               KALDI_ISNAN(y[4]) && y[6] == 0.0 && y[7] == 1.0);
+  if (sizeof(Real) == 4) KALDI_ASSERT(y[5] == inf);
+  VectorizedLog(x, n, y);
+  KALDI_ASSERT(y[0] == -inf && KALDI_ISNAN(y[1]) && y[2] == inf &&
+               KALDI_ISNAN(y[3]) && KALDI_ISNAN(y[4]) && KALDI_ISNAN(y[6]));
+  AssertRelativelyClose(y[7], std::log(double(x[7])), 2.0e-07);
+  VectorizedTanh(x, n, y);
+  KALDI_ASSERT(y[0] == 0.0 && y[2] == 1.0 && y[3] == -1.0 &&
+               KALDI_ISNAN(y[4]) && y[5] == 1.0 && y[6] == -1.0);
+  AssertRelativelyClose(y[7], x[7], 2.0e-07);
+  VectorizedSigmoid(x, n, y);
+  KALDI_ASSERT(y[0] == 0.5 && y[2] == 1.0 && y[3] == 0.0 &&
+               KALDI_ISNAN(y[4]) && y[5] == 1.0 && y[6] == 0.0);
+}
+
+template<typename Real>
+static void UnitTestVectorizedMembers() {
+  // Checks the member functions that use these against simple loops.
+  for (int32 i = 0; i < 10; i++) {
+    MatrixIndexT dim = RandInt(1, 1000);
+    Vector<Real> x(dim), y(dim);
+    x.SetRandn();
+    x.Scale(10.0);
+    Real max = x.Max();
+    double sum = 0.0;
+    for (MatrixIndexT j = 0; j < dim; j++)
+      sum += std::exp(double(x(j)) - max);
+    Real log_sum = max + std::log(sum);
+    AssertEqual(x.LogSumExp(), log_sum, 1.0e-05);
+
+    y.CopyFromVec(x);
+    AssertEqual(y.ApplySoftMax(), log_sum, 1.0e-05);
+    for (MatrixIndexT j = 0; j < dim; j++)
+      AssertRelativelyClose(y(j), std::exp(double(x(j)) - log_sum), 1.0e-05);
+
+    y.CopyFromVec(x);
+    AssertEqual(y.ApplyLogSoftMax(), log_sum, 1.0e-05);
+    for (MatrixIndexT j = 0; j < dim; j++)
+      KALDI_ASSERT(std::abs(y(j) - (x(j) - log_sum)) < 1.0e-04);
+
+    Matrix<Real> m(RandInt(1, 10), RandInt(1, 100));
+    m.SetRandn();
+    Matrix<Real> m2(m);
+    max = m.Max();
+    sum = 0.0;
+    for (MatrixIndexT r = 0; r < m.NumRows(); r++)
+      for (MatrixIndexT c = 0; c < m.NumCols(); c++)
+        sum += std::exp(double(m(r, c)) - max);
+    log_sum = max + std::log(sum);
+    AssertEqual(m.LogSumExp(), log_sum, 1.0e-05);
+    AssertEqual(m2.ApplySoftMax(), log_sum, 1.0e-05);
+    AssertEqual(m2.Sum(), Real(1.0), 1.0e-05);
+  }
+}
+
+template<typename Real>
+static void UnitTestVectorizedDecompress() {
+  for (int32 i = 0; i < 10; i++) {
+    MatrixIndexT dim = RandInt(1, 100);
+    std::vector<uint16> x16(dim);
+    std::vector<unsigned char> x8(dim);
+    for (MatrixIndexT j = 0; j < dim; j++) {
+      x16[j] = RandInt(0, 65535);
+      x8[j] = RandInt(0, 255);
+    }
+    Vector<Real> y(dim);
+    float min_value = RandGauss(), increment = RandUniform() * 1.0e-04;
+    VectorizedDecompressUint16(&(x16[0]), dim, min_value, increment,
+                               y.Data());
+    for (MatrixIndexT j = 0; j < dim; j++) {
+      float ref = min_value + increment * x16[j];
+      KALDI_ASSERT(std::abs(y(j) - ref) < 1.0e-06 * (1.0 + std::abs(ref)));
+    }
+
+    float p0 = RandGauss(), p25 = p0 + RandUniform(),
+        p75 = p25 + RandUniform(), p100 = p75 + RandUniform();
+    VectorizedDecompressUint8(&(x8[0]), dim, p0, p25, p75, p100, y.Data());
+    // This is required to be the same as in the scalar code, up to
+    // roundoff in case the compiler uses fused multiply-adds.
+    for (MatrixIndexT j = 0; j < dim; j++) {
+      int32 v = x8[j];
+      float ref = (v <= 64 ? p0 + (p25 - p0) * (1 / 64.0f) * v :
+                   v <= 192 ? p25 + (p75 - p25) * (1 / 128.0f) * (v - 64) :
+                   p75 + (p100 - p75) * (1 / 63.0f) * (v - 192));
+      KALDI_ASSERT(std::abs(y(j) - ref) < 1.0e-06 * (1.0 + std::abs(ref)));
+    }
+  }
+}
+
+// Checks that the compression kernels give exactly the same result as the
+// scalar code, and that they invert the decompression kernels.
+template<typename Real>
+static void UnitTestVectorizedCompress() {
+  SimdInstructionSet iset = GetSimdInstructionSet();
+  for (int32 i = 0; i < 10; i++) {
+    MatrixIndexT dim = RandInt(1, 100);
+    Vector<Real> x(dim);
+    x.SetRandn();
+    float min_value = x.Min() - RandUniform(), range = x.Max() - min_value;
+    std::vector<uint16> y16(dim), ref16(dim);
+    SetSimdInstructionSet(kSimdNone);
+    VectorizedCompressUint16(x.Data(), dim, min_value, range, &(ref16[0]));
+    SetSimdInstructionSet(iset);
+    VectorizedCompressUint16(x.Data(), dim, min_value, range, &(y16[0]));
+    KALDI_ASSERT(y16 == ref16);
+    Vector<Real> z(dim);
+    VectorizedDecompressUint16(&(y16[0]), dim, min_value, range / 65535.0f,
+                               z.Data());
+    AssertEqual(x, z, 1.0e-04 * range);
+
+    float p0 = x.Min(), p100 = x.Max(), p25 = p0 + 0.25 * (p100 - p0),
+        p75 = p0 + 0.75 * (p100 - p0);
+    std::vector<unsigned char> y8(dim), ref8(dim);
+    SetSimdInstructionSet(kSimdNone);
+    VectorizedCompressUint8(x.Data(), dim, p0, p25, p75, p100, &(ref8[0]));
+    SetSimdInstructionSet(iset);
+    VectorizedCompressUint8(x.Data(), dim, p0, p25, p75, p100, &(y8[0]));
+    KALDI_ASSERT(y8 == ref8);
+    VectorizedDecompressUint8(&(y8[0]), dim, p0, p25, p75, p100, z.Data());
+    AssertEqual(x, z, 0.01 * (p100 - p0));
+  }
+}
+
+// Checks the FFT, whose inner loop is VectorizedSrfftButterflies(), against
+// the result with the scalar code.
+template<typename Real>
+static void UnitTestVectorizedSrfft() {
+  SimdInstructionSet iset = GetSimdInstructionSet();
+  for (int32 i = 0; i < 5; i++) {
+    MatrixIndexT N = 1 << RandInt(3, 12);
+    SplitRadixComplexFft<Real> srfft(N);
+    Vector<Real> x(2 * N), ref(2 * N);
+    x.SetRandn();
+    ref.CopyFromVec(x);
+    SetSimdInstructionSet(kSimdNone);
+    srfft.Compute(ref.Data(), true);
+    SetSimdInstructionSet(iset);
+    srfft.Compute(x.Data(), true);
+    AssertEqual(x, ref, 1.0e-05);
+  }
+}
+
+// Checks the FFT of the rows of a matrix, which for float transforms several
+// rows at once with VectorizedSrfftInterleaved(), against the scalar code.
+template<typename Real>
+static void UnitTestVectorizedSrfftRows() {
+  SimdInstructionSet iset = GetSimdInstructionSet();
+  for (int32 i = 0; i < 5; i++) {
+    MatrixIndexT N = 1 << RandInt(1, 10), num_rows = RandInt(1, 20);
+    SplitRadixComplexFft<Real> srfft(N);
+    std::vector<Real> temp_buffer;
+    Matrix<Real> x(num_rows, 2 * N), ref(num_rows, 2 * N);
+    x.SetRandn();
+    ref.CopyFromMat(x);
+    bool forward = (RandInt(0, 1) == 0);
+    SetSimdInstructionSet(kSimdNone);
+    for (MatrixIndexT r = 0; r < num_rows; r++)
+      srfft.Compute(ref.RowData(r), forward, &temp_buffer);
+    SetSimdInstructionSet(iset);
+    srfft.Compute(&x, forward, &temp_buffer);
+    AssertEqual(x, ref, 1.0e-05);
+  }
+}
+
+// Checks VectorizedPolyphaseFilter() against a direct computation.
+template<typename Real>
+static void UnitTestVectorizedPolyphaseFilter() {
+  for (int32 i = 0; i < 10; i++) {
+    int32 num_phases = RandInt(1, 5), x_step = RandInt(1, 5),
+        first_phase = RandInt(0, 2 * num_phases), num_out = RandInt(0, 100);
+    std::vector<int32> x_offsets(num_phases), num_taps(num_phases);
+    std::vector<Vector<Real> > weights(num_phases);
+    std::vector<const Real*> w(num_phases);
+    for (int32 p = 0; p < num_phases; p++) {
+      // Odd numbers of taps test the handling of the last partial group.
+      x_offsets[p] = RandInt(0, 3);
+      num_taps[p] = RandInt(1, 40);
+      weights[p].Resize(num_taps[p]);
+      weights[p].SetRandn();
+      w[p] = weights[p].Data();
+    }
+    int32 num_units = (first_phase + num_out) / num_phases + 1;
+    Vector<Real> x(num_units * x_step + 50), y(num_out), ref(num_out);
+    x.SetRandn();
+    for (int32 o = 0; o < num_out; o++) {
+      int32 p = (first_phase + o) % num_phases,
+          u = (first_phase + o) / num_phases;
+      SubVector<Real> x_part(x, u * x_step + x_offsets[p], num_taps[p]);
+      ref(o) = VecVec(x_part, weights[p]);
+    }
+    VectorizedPolyphaseFilter(x.Data(), x_step, &(x_offsets[0]), &(w[0]),
+                              &(num_taps[0]), num_phases, first_phase,
+                              num_out, y.Data());
+    AssertEqual(y, ref, 1.0e-05);
+  }
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  SimdInstructionSet best = GetSimdInstructionSet();
+  // Test the kernels for each instruction set that this CPU supports.
+  for (int32 i = kSimdNone; i <= kSimdNeon; i++) {
+    SimdInstructionSet iset = static_cast<SimdInstructionSet>(i);
+    if (!CpuSupports(iset))
+      continue;
+    KALDI_LOG << "Testing instruction set " << SimdInstructionSetName(iset);
+    SetSimdInstructionSet(iset);
+    UnitTestVectorizedFunctions<float>();
+    UnitTestVectorizedFunctions<double>();
+    UnitTestVectorizedSpecialValues<float>();
+    UnitTestVectorizedSpecialValues<double>();
+    UnitTestVectorizedMembers<float>();
+    UnitTestVectorizedMembers<double>();
+    UnitTestVectorizedDecompress<float>();
+    UnitTestVectorizedDecompress<double>();
+    UnitTestVectorizedCompress<float>();
+    UnitTestVectorizedCompress<double>();
+    UnitTestVectorizedSrfft<float>();
+    UnitTestVectorizedSrfft<double>();
+    UnitTestVectorizedSrfftRows<float>();
+    UnitTestVectorizedSrfftRows<double>();
+    UnitTestVectorizedPolyphaseFilter<float>();
+    UnitTestVectorizedPolyphaseFilter<double>();
+  }
+  SetSimdInstructionSet(best);
+  KALDI_LOG << "Tests succeeded.";
+  return 0;
+}
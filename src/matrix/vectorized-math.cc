@@ -0,0 +1,392 @@
+// matrix/vectorized-math.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include "matrix/cpu-features.h"
+#include "matrix/vectorized-math.h"
+#include "matrix/vectorized-math-kernels.h"
+
+namespace kaldi {
+
+// The scalar versions of the kernels, which are used for double, and for
+// float if the CPU has none of the instruction sets that we have kernels for.
+
+template<typename Real>
+static void ExpScalar(const Real *x, MatrixIndexT n, Real *y) {
+  for (MatrixIndexT i = 0; i < n; i++)
+    y[i] = Exp(x[i]);
+}
+
+template<typename Real>
+static void LogScalar(const Real *x, MatrixIndexT n, Real *y) {
+  for (MatrixIndexT i = 0; i < n; i++)
+    y[i] = Log(x[i]);
+}
+
+template<typename Real>
+static void TanhScalar(const Real *x, MatrixIndexT n, Real *y) {
+  for (MatrixIndexT i = 0; i < n; i++)
+    y[i] = tanh(x[i]);
+}
+
+template<typename Real>
+static void SigmoidScalar(const Real *x, MatrixIndexT n, Real *y) {
+  for (MatrixIndexT i = 0; i < n; i++)
+    y[i] = 1.0 / (1.0 + Exp(-x[i]));
+}
+
+template<typename Real>
+static void DecompressUint16Scalar(const uint16 *x, MatrixIndexT n,
+                                   float min_value, float increment,
+                                   Real *y) {
+  for (MatrixIndexT i = 0; i < n; i++)
+    y[i] = min_value + increment * x[i];
+}
+
+template<typename Real>
+static void DecompressUint8Scalar(const unsigned char *x, MatrixIndexT n,
+                                  float p0, float p25, float p75, float p100,
+                                  Real *y) {
+  // This is the same as CompressedMatrix::CharToFloat().
+  float s0 = (p25 - p0) * (1 / 64.0f), s25 = (p75 - p25) * (1 / 128.0f),
+      s75 = (p100 - p75) * (1 / 63.0f);
+  for (MatrixIndexT i = 0; i < n; i++) {
+    int32 value = x[i];
+    float f;
+    if (value <= 64)
+      f = p0 + s0 * value;
+    else if (value <= 192)
+      f = p25 + s25 * (value - 64);
+    else
+      f = p75 + s75 * (value - 192);
+    y[i] = f;
+  }
+}
+
+template<typename Real>
+static void CompressUint16Scalar(const Real *x, MatrixIndexT n,
+                                 float min_value, float range, uint16 *y) {
+  // This is the same as CompressedMatrix::FloatToUint16().
+  for (MatrixIndexT i = 0; i < n; i++) {
+    float f = (static_cast<float>(x[i]) - min_value) / range;
+    f = std::min(std::max(f, 0.0f), 1.0f);
+    y[i] = static_cast<uint16>(f * 65535.0f + 0.499f);
+  }
+}
+
+template<typename Real>
+static void CompressUint8Scalar(const Real *x, MatrixIndexT n,
+                                float p0, float p25, float p75, float p100,
+                                unsigned char *y) {
+  // Each range is mapped linearly to its characters and rounded; the
+  // percentiles are strictly increasing (see
+  // CompressedMatrix::ComputeColHeader()), so d0, d25 and d75 are positive.
+  float d0 = p25 - p0, d25 = p75 - p25, d75 = p100 - p75;
+  for (MatrixIndexT i = 0; i < n; i++) {
+    float value = x[i], f;
+    int32 offset;
+    if (value < p25) {
+      f = std::min(std::max((value - p0) / d0 * 64.0f + 0.5f, 0.0f), 64.0f);
+      offset = 0;
+    } else if (value < p75) {
+      f = std::min(std::max((value - p25) / d25 * 128.0f + 0.5f, 0.0f),
+                   128.0f);
+      offset = 64;
+    } else {
+      f = std::min(std::max((value - p75) / d75 * 63.0f + 0.5f, 0.0f), 63.0f);
+      offset = 192;
+    }
+    y[i] = static_cast<unsigned char>(offset + static_cast<int32>(f));
+  }
+}
+
+// These are steps 1 to 4 of SplitRadixComplexFft::ComputeRecursive(), from
+// H. S. Malvar's code (see the note at the top of srfft.cc).
+template<typename Real>
+static void SrfftButterfliesScalar(Real *xr, Real *xi, MatrixIndexT logn,
+                                   const Real *tab) {
+  MatrixIndexT m, m2, m4, m8, nel, n;
+  Real *xr1, *xr2, *xi1, *xi2;
+  const Real *cn = NULL, *spcn = NULL, *smcn = NULL, *c3n = NULL,
+      *spc3n = NULL, *smc3n = NULL;
+  Real tmp1, tmp2;
+  Real sqhalf = M_SQRT1_2;
+
+  m = 1 << logn; m2 = m / 2; m4 = m2 / 2; m8 = m4 /2;
+
+  /* Step 1 */
+  xr1 = xr; xr2 = xr1 + m2;
+  xi1 = xi; xi2 = xi1 + m2;
+  for (n = 0; n < m2; n++) {
+    tmp1 = *xr1 + *xr2;
+    *xr2 = *xr1 - *xr2;
+    xr2++;
+    *xr1++ = tmp1;
+    tmp2 = *xi1 + *xi2;
+    *xi2 = *xi1 - *xi2;
+    xi2++;
+    *xi1++ = tmp2;
+  }
+
+  /* Step 2 */
+  xr1 = xr + m2; xr2 = xr1 + m4;
+  xi1 = xi + m2; xi2 = xi1 + m4;
+  for (n = 0; n < m4; n++) {
+    tmp1 = *xr1 + *xi2;
+    tmp2 = *xi1 + *xr2;
+    *xi1 = *xi1 - *xr2;
+    xi1++;
+    *xr2++ = *xr1 - *xi2;
+    *xr1++ = tmp1;
+    *xi2++ = tmp2;
+  }
+
+  /* Steps 3 & 4 */
+  xr1 = xr + m2; xr2 = xr1 + m4;
+  xi1 = xi + m2; xi2 = xi1 + m4;
+  if (logn >= 4) {
+    nel = m4 - 2;
+    cn  = tab; spcn  = cn + nel;  smcn  = spcn + nel;
+    c3n = smcn + nel;  spc3n = c3n + nel; smc3n = spc3n + nel;
+  }
+  xr1++; xr2++; xi1++; xi2++;
+  for (n = 1; n < m4; n++) {
+    if (n == m8) {
+      tmp1 =  sqhalf * (*xr1 + *xi1);
+      *xi1 =  sqhalf * (*xi1 - *xr1);
+      *xr1 =  tmp1;
+      tmp2 =  sqhalf * (*xi2 - *xr2);
+      *xi2 = -sqhalf * (*xr2 + *xi2);
+      *xr2 =  tmp2;
+    } else {
+      tmp2 = *cn++ * (*xr1 + *xi1);
+      tmp1 = *spcn++ * *xr1 + tmp2;
+      *xr1 = *smcn++ * *xi1 + tmp2;
+      *xi1 = tmp1;
+      tmp2 = *c3n++ * (*xr2 + *xi2);
+      tmp1 = *spc3n++ * *xr2 + tmp2;
+      *xr2 = *smc3n++ * *xi2 + tmp2;
+      *xi2 = tmp1;
+    }
+    xr1++; xr2++; xi1++; xi2++;
+  }
+}
+
+template<typename Real>
+static void PolyphaseFilterScalar(const Real *x, MatrixIndexT x_step,
+                                  const int32 *x_offsets,
+                                  const Real *const *w, const int32 *num_taps,
+                                  MatrixIndexT num_phases,
+                                  MatrixIndexT first_phase,
+                                  MatrixIndexT num_out, Real *y) {
+  MatrixIndexT p = first_phase % num_phases,
+      x_start = (first_phase / num_phases) * x_step;
+  for (MatrixIndexT i = 0; i < num_out; i++) {
+    const Real *this_x = x + x_start + x_offsets[p], *this_w = w[p];
+    Real sum = 0.0;
+    for (int32 j = 0; j < num_taps[p]; j++)
+      sum += this_w[j] * this_x[j];
+    y[i] = sum;
+    if (++p == num_phases) {
+      p = 0;
+      x_start += x_step;
+    }
+  }
+}
+
+static const VectorizedMathKernels kScalarKernels = {
+  ExpScalar<float>, LogScalar<float>, TanhScalar<float>,
+  SigmoidScalar<float>, DecompressUint16Scalar<float>,
+  DecompressUint8Scalar<float>, CompressUint16Scalar<float>,
+  CompressUint8Scalar<float>, SrfftButterfliesScalar<float>, 1, NULL,
+  PolyphaseFilterScalar<float>
+};
+
+// Returns the float kernels for the instruction set that
+// GetSimdInstructionSet() says to use.
+static inline const VectorizedMathKernels &Kernels() {
+  const VectorizedMathKernels *ans = NULL;
+  switch (GetSimdInstructionSet()) {
+    case kSimdAvx2:
+      ans = GetAvx2Kernels();
+      if (ans != NULL) break;
+      // else fall through: AVX2 CPUs also have SSE2.
+    case kSimdSse2:
+      ans = GetSse2Kernels();
+      break;
+    case kSimdNeon:
+      ans = GetNeonKernels();
+      break;
+    default:
+      break;
+  }
+  return (ans != NULL ? *ans : kScalarKernels);
+}
+
+void VectorizedExp(const float *x, MatrixIndexT n, float *y) {
+  Kernels().exp(x, n, y);
+}
+
+void VectorizedLog(const float *x, MatrixIndexT n, float *y) {
+  Kernels().log(x, n, y);
+}
+
+void VectorizedTanh(const float *x, MatrixIndexT n, float *y) {
+  Kernels().tanh(x, n, y);
+}
+
+void VectorizedSigmoid(const float *x, MatrixIndexT n, float *y) {
+  Kernels().sigmoid(x, n, y);
+}
+
+void VectorizedExp(const double *x, MatrixIndexT n, double *y) {
+  ExpScalar(x, n, y);
+}
+
+void VectorizedLog(const double *x, MatrixIndexT n, double *y) {
+  LogScalar(x, n, y);
+}
+
+void VectorizedTanh(const double *x, MatrixIndexT n, double *y) {
+  TanhScalar(x, n, y);
+}
+
+void VectorizedSigmoid(const double *x, MatrixIndexT n, double *y) {
+  SigmoidScalar(x, n, y);
+}
+
+void VectorizedDecompressUint16(const uint16 *x, MatrixIndexT n,
+                                float min_value, float increment, float *y) {
+  Kernels().decompress_uint16(x, n, min_value, increment, y);
+}
+
+void VectorizedDecompressUint16(const uint16 *x, MatrixIndexT n,
+                                float min_value, float increment, double *y) {
+  DecompressUint16Scalar(x, n, min_value, increment, y);
+}
+
+void VectorizedDecompressUint8(const unsigned char *x, MatrixIndexT n,
+                               float p0, float p25, float p75, float p100,
+                               float *y) {
+  Kernels().decompress_uint8(x, n, p0, p25, p75, p100, y);
+}
+
+void VectorizedDecompressUint8(const unsigned char *x, MatrixIndexT n,
+                               float p0, float p25, float p75, float p100,
+                               double *y) {
+  DecompressUint8Scalar(x, n, p0, p25, p75, p100, y);
+}
+
+void VectorizedCompressUint16(const float *x, MatrixIndexT n,
+                              float min_value, float range, uint16 *y) {
+  Kernels().compress_uint16(x, n, min_value, range, y);
+}
+
+void VectorizedCompressUint16(const double *x, MatrixIndexT n,
+                              float min_value, float range, uint16 *y) {
+  CompressUint16Scalar(x, n, min_value, range, y);
+}
+
+void VectorizedCompressUint8(const float *x, MatrixIndexT n,
+                             float p0, float p25, float p75, float p100,
+                             unsigned char *y) {
+  Kernels().compress_uint8(x, n, p0, p25, p75, p100, y);
+}
+
+void VectorizedCompressUint8(const double *x, MatrixIndexT n,
+                             float p0, float p25, float p75, float p100,
+                             unsigned char *y) {
+  CompressUint8Scalar(x, n, p0, p25, p75, p100, y);
+}
+
+void VectorizedSrfftButterflies(float *xr, float *xi, MatrixIndexT logn,
+                                const float *tab) {
+  KALDI_ASSERT(logn >= 3);
+  Kernels().srfft_butterflies(xr, xi, logn, tab);
+}
+
+void VectorizedSrfftButterflies(double *xr, double *xi, MatrixIndexT logn,
+                                const double *tab) {
+  KALDI_ASSERT(logn >= 3);
+  SrfftButterfliesScalar(xr, xi, logn, tab);
+}
+
+int32 VectorizedSrfftNumLanes() {
+  return Kernels().srfft_num_lanes;
+}
+
+void VectorizedSrfftInterleaved(float *xr, float *xi, MatrixIndexT logn,
+                                const float *const *tab) {
+  const VectorizedMathKernels &kernels = Kernels();
+  KALDI_ASSERT(kernels.srfft_interleaved != NULL);
+  kernels.srfft_interleaved(xr, xi, logn, tab);
+}
+
+void VectorizedPolyphaseFilter(const float *x, MatrixIndexT x_step,
+                               const int32 *x_offsets,
+                               const float *const *w, const int32 *num_taps,
+                               MatrixIndexT num_phases,
+                               MatrixIndexT first_phase, MatrixIndexT num_out,
+                               float *y) {
+  Kernels().polyphase_filter(x, x_step, x_offsets, w, num_taps, num_phases,
+                             first_phase, num_out, y);
+}
+
+void VectorizedPolyphaseFilter(const double *x, MatrixIndexT x_step,
+                               const int32 *x_offsets,
+                               const double *const *w, const int32 *num_taps,
+                               MatrixIndexT num_phases,
+                               MatrixIndexT first_phase, MatrixIndexT num_out,
+                               double *y) {
+  PolyphaseFilterScalar(x, x_step, x_offsets, w, num_taps, num_phases,
+                        first_phase, num_out, y);
+}
+
+template<typename Real>
+static double SumExpInternal(const Real *x, MatrixIndexT n,
+                             Real offset, Real cutoff) {
+  // We compute the exponentials a block at a time into a buffer on the stack.
+  const MatrixIndexT kBlockSize = 256;
+  Real buffer[kBlockSize];
+  double sum = 0.0;
+  for (MatrixIndexT i = 0; i < n; i += kBlockSize) {
+    MatrixIndexT block_size = std::min(kBlockSize, n - i);
+    const Real *x_block = x + i;
+    for (MatrixIndexT j = 0; j < block_size; j++)
+      buffer[j] = x_block[j] - offset;
+    VectorizedExp(buffer, block_size, buffer);
+    for (MatrixIndexT j = 0; j < block_size; j++)
+      if (x_block[j] >= cutoff)
+        sum += buffer[j];
+  }
+  return sum;
+}
+
+double VectorizedSumExp(const float *x, MatrixIndexT n,
+                        float offset, float cutoff) {
+  return SumExpInternal(x, n, offset, cutoff);
+}
+
+double VectorizedSumExp(const double *x, MatrixIndexT n,
+                        double offset, double cutoff) {
+  return SumExpInternal(x, n, offset, cutoff);
+}
+
+} // end namespace kaldi.
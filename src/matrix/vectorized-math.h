@@ -0,0 +1,162 @@
+// matrix/vectorized-math.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_MATRIX_VECTORIZED_MATH_H_
+#define KALDI_MATRIX_VECTORIZED_MATH_H_
+
+#include "matrix/matrix-common.h"
+
+namespace kaldi {
+
+/// \file vectorized-math.h
+/// Element-wise exp, log, tanh and sigmoid of arrays, used by the
+/// corresponding member functions of VectorBase and MatrixBase, and some
+/// other hand-written inner loops of the matrix library.
+///
+/// The single-precision versions evaluate the functions on several elements
+/// at a time with SIMD instructions, using the best instruction set that the
+/// CPU supports, as detected at run time (see cpu-features.h): AVX2 (8
+/// elements), SSE2 (4 elements) or, on 64-bit ARM, NEON (4 elements).  They
+/// use Cephes-style argument reduction and polynomial approximations.  The
+/// relative error (measured against double precision) is below 1.5e-7, i.e.
+/// about 2 ulp, for Exp, Tanh and Log (for Log, including denormal inputs),
+/// and below 2e-7 for Sigmoid, whose relative error only grows for inputs
+/// below about -87, where the result is denormal.  exp(x) is +inf for x >
+/// 88.72, and it underflows to denormals and then zero as std::exp does.  Log
+/// returns -inf for zero and NaN for negative inputs.  NaN inputs give NaN
+/// outputs.  With no SIMD instruction set, and for double precision, these
+/// functions just call the scalar functions Exp() and Log() from
+/// base/kaldi-math.h.
+///
+/// This file also has the inner loops of CompressedMatrix decompression, of
+/// SplitRadixComplexFft and of LinearResample, which are dispatched in the
+/// same way.
+///
+/// The input and output arrays may be the same, but must not otherwise
+/// overlap.
+
+/// y[i] = exp(x[i]), for 0 <= i < n.
+void VectorizedExp(const float *x, MatrixIndexT n, float *y);
+void VectorizedExp(const double *x, MatrixIndexT n, double *y);
+
+/// y[i] = log(x[i]), for 0 <= i < n.
+void VectorizedLog(const float *x, MatrixIndexT n, float *y);
+void VectorizedLog(const double *x, MatrixIndexT n, double *y);
+
+/// y[i] = tanh(x[i]), for 0 <= i < n.
+void VectorizedTanh(const float *x, MatrixIndexT n, float *y);
+void VectorizedTanh(const double *x, MatrixIndexT n, double *y);
+
+/// y[i] = 1 / (1 + exp(-x[i])), for 0 <= i < n.
+void VectorizedSigmoid(const float *x, MatrixIndexT n, float *y);
+void VectorizedSigmoid(const double *x, MatrixIndexT n, double *y);
+
+/// Returns the sum, in double precision, of exp(x[i] - offset) over those
+/// 0 <= i < n for which x[i] >= cutoff.
+double VectorizedSumExp(const float *x, MatrixIndexT n,
+                        float offset, float cutoff);
+double VectorizedSumExp(const double *x, MatrixIndexT n,
+                        double offset, double cutoff);
+
+/// y[i] = min_value + increment * x[i], for 0 <= i < n, computed in float;
+/// this is the decompression of the 16-bit format of CompressedMatrix.
+void VectorizedDecompressUint16(const uint16 *x, MatrixIndexT n,
+                                float min_value, float increment, float *y);
+void VectorizedDecompressUint16(const uint16 *x, MatrixIndexT n,
+                                float min_value, float increment, double *y);
+
+/// Decompresses the column format of CompressedMatrix: y[i] is the piecewise
+/// linear function of x[i] that maps 0, 64, 192 and 255 to p0, p25, p75 and
+/// p100 respectively; the result is the same as that of
+/// CompressedMatrix::CharToFloat().
+void VectorizedDecompressUint8(const unsigned char *x, MatrixIndexT n,
+                               float p0, float p25, float p75, float p100,
+                               float *y);
+void VectorizedDecompressUint8(const unsigned char *x, MatrixIndexT n,
+                               float p0, float p25, float p75, float p100,
+                               double *y);
+
+/// The compression of CompressedMatrix's 16-bit format: y[i] is x[i] mapped
+/// linearly from [min_value, min_value + range] to [0, 65535] and rounded,
+/// exactly as CompressedMatrix::FloatToUint16() does.
+void VectorizedCompressUint16(const float *x, MatrixIndexT n,
+                              float min_value, float range, uint16 *y);
+void VectorizedCompressUint16(const double *x, MatrixIndexT n,
+                              float min_value, float range, uint16 *y);
+
+/// The compression of CompressedMatrix's column format, the inverse of
+/// VectorizedDecompressUint8(): each of the ranges [p0, p25), [p25, p75) and
+/// [p75, p100] is mapped linearly to the characters 0..64, 64..192 and
+/// 192..255 respectively, with rounding to the nearest character.  The
+/// result is the same for all instruction sets.
+void VectorizedCompressUint8(const float *x, MatrixIndexT n,
+                             float p0, float p25, float p75, float p100,
+                             unsigned char *y);
+void VectorizedCompressUint8(const double *x, MatrixIndexT n,
+                             float p0, float p25, float p75, float p100,
+                             unsigned char *y);
+
+/// Does the butterflies of one level (of length 2^logn, logn >= 3) of
+/// the split-radix FFT, on the real parts xr and the imaginary parts xi;
+/// "tab" is the table of twiddle factors for that level (NULL if logn == 3).
+/// This is used by SplitRadixComplexFft::ComputeRecursive().
+void VectorizedSrfftButterflies(float *xr, float *xi, MatrixIndexT logn,
+                                const float *tab);
+void VectorizedSrfftButterflies(double *xr, double *xi, MatrixIndexT logn,
+                                const double *tab);
+
+/// VectorizedSrfftInterleaved() does the FFT without the bit-reversal
+/// permutation (see SplitRadixComplexFft::ComputeRecursive()) of
+/// num_lanes = VectorizedSrfftNumLanes() signals of dimension 2^logn at once.
+/// The signals are stored interleaved: element n of signal l has its real
+/// part at xr[n * num_lanes + l] and its imaginary part at
+/// xi[n * num_lanes + l], so that the butterflies use whole SIMD registers.
+/// "tab" is SplitRadixComplexFft's array of tables of twiddle factors.  This
+/// is used by SplitRadixComplexFft<float>::Compute(MatrixBase<float>*, ...).
+/// VectorizedSrfftNumLanes() returns 1 if there are no SIMD kernels for this
+/// CPU, in which case VectorizedSrfftInterleaved() must not be called.
+int32 VectorizedSrfftNumLanes();
+void VectorizedSrfftInterleaved(float *xr, float *xi, MatrixIndexT logn,
+                                const float *const *tab);
+
+/// Polyphase filtering, as done by LinearResample (see feat/resample.h): the
+/// filters for the num_phases phases have weights w[p][0 .. num_taps[p] - 1],
+/// and phase p of unit u of the output reads the input starting at
+/// x[u * x_step + x_offsets[p]].  For 0 <= i < num_out, with
+/// p = (first_phase + i) % num_phases and u = (first_phase + i) / num_phases,
+/// y[i] = sum_{j < num_taps[p]} w[p][j] * x[u * x_step + x_offsets[p] + j].
+/// x_offsets[p] may be negative as long as the elements actually read are
+/// not.
+void VectorizedPolyphaseFilter(const float *x, MatrixIndexT x_step,
+                               const int32 *x_offsets,
+                               const float *const *w, const int32 *num_taps,
+                               MatrixIndexT num_phases,
+                               MatrixIndexT first_phase, MatrixIndexT num_out,
+                               float *y);
+void VectorizedPolyphaseFilter(const double *x, MatrixIndexT x_step,
+                               const int32 *x_offsets,
+                               const double *const *w, const int32 *num_taps,
+                               MatrixIndexT num_phases,
+                               MatrixIndexT first_phase, MatrixIndexT num_out,
+                               double *y);
+
+} // end namespace kaldi.
+
+#endif
@@ -128,6 +128,13 @@ class AffineTransform : public UpdatableComponent {
     wei_copy->Range(0,linearity_num_elem).CopyRowsFromMat(Matrix<BaseFloat>(linearity_));
     wei_copy->Range(linearity_num_elem, bias_.Dim()).CopyFromVec(Vector<BaseFloat>(bias_));
   }
+
+  void SetParams(const VectorBase<BaseFloat> &wei_src) {
+    KALDI_ASSERT(wei_src.Dim() == NumParams());
+    int32 linearity_num_elem = linearity_.NumRows() * linearity_.NumCols(); 
+    linearity_.CopyRowsFromVec(wei_src.Range(0, linearity_num_elem));
+    bias_.CopyFromVec(wei_src.Range(linearity_num_elem, bias_.Dim()));
+  }
   
   std::string Info() const {
     return std::string("\n  linearity") + MomentStatistics(linearity_) +
@@ -120,80 +120,95 @@ class AveragePooling2DComponent : public Component {
   }
 
   void PropagateFnc(const CuMatrixBase<BaseFloat> &in, CuMatrixBase<BaseFloat> *out) {
-    // useful dims
-    int32 num_input_fmaps = input_dim_ / (fmap_x_len_ * fmap_y_len_);
-    int out_fmap_cnt = 0;
-    for (int32 m = 0; m < fmap_x_len_-pool_x_len_+1; m = m+pool_x_step_) {
-      for (int32 n = 0; n < fmap_y_len_-pool_y_len_+1; n = n+pool_y_step_) {
-        int32 st = 0;
-        st = (m*fmap_y_len_+n)*num_input_fmaps;
-        CuSubMatrix<BaseFloat> pool(out->ColRange(out_fmap_cnt * num_input_fmaps, num_input_fmaps));
-        pool.SetZero();  // reset
-        for (int32 i = 0; i < pool_x_len_; i++) {
-          for (int32 j = 0; j < pool_y_len_; j++) {
-            int32 c = 0;
-            c = st + i * (num_input_fmaps * fmap_y_len_)
-                   + j * num_input_fmaps;
-            pool.AddMat(1.0, in.ColRange(c, num_input_fmaps));
-          }
-        }
-        pool.Scale(1.0 / (pool_x_len_ * pool_y_len_));
-        out_fmap_cnt++;
-      }
+    // the average over the pool positions, for all the pools at once,
+    if (column_maps_.empty()) ComputeColumnMaps();
+    out->CopyCols(in, column_maps_[0]);
+    for (int32 k = 1; k < column_maps_.size(); k++) {
+      out->AddCols(in, column_maps_[k]);
     }
+    out->Scale(1.0 / (pool_x_len_ * pool_y_len_));
   }
 
   void BackpropagateFnc(const CuMatrixBase<BaseFloat> &in, const CuMatrixBase<BaseFloat> &out,
                         const CuMatrixBase<BaseFloat> &out_diff, CuMatrixBase<BaseFloat> *in_diff) {
-    // useful dims
-    int32 num_input_fmaps = input_dim_ / (fmap_x_len_ * fmap_y_len_);
-    int32 inp_fmap_size = fmap_x_len_ * fmap_y_len_;
-    //
-    // here we note how many diff matrices are summed for each input patch,
-    std::vector<int32> patch_summands(inp_fmap_size, 0);
-    // this metainfo will be used to divide diff of patches
-    // used in more than one pool.
-    //
+    if (column_maps_.empty()) ComputeColumnMaps();
+    // sum the diffs of the pools each input column was used in,
+    for (int32 m = 0; m < reverse_column_maps_.size(); m++) {
+      if (m == 0) in_diff->CopyCols(out_diff, reverse_column_maps_[m]);
+      else in_diff->AddCols(out_diff, reverse_column_maps_[m]);
+    }
+    // divide diff by average-pooling-dim (derivative of averaging),
+    // and by #summands (compensate for patches used in more pools)
+    in_diff->MulColsVec(in_diff_scales_);
+  }
 
-    in_diff->SetZero();  // reset
+ private:
+  /// Computes 'column_maps_', 'reverse_column_maps_' and 'in_diff_scales_'
+  void ComputeColumnMaps() {
+    int32 num_input_fmaps = input_dim_ / (fmap_x_len_ * fmap_y_len_);
+    // column_maps[i * pool_y_len_ + j] is the input column of each output
+    // column at position (i, j) of its pool,
+    std::vector<std::vector<int32> > column_maps(pool_x_len_ * pool_y_len_,
+                                                 std::vector<int32>(output_dim_, -1));
     int out_fmap_cnt = 0;
     for (int32 m = 0; m < fmap_x_len_-pool_x_len_+1; m = m+pool_x_step_) {
       for (int32 n = 0; n < fmap_y_len_-pool_y_len_+1; n = n+pool_y_step_) {
         int32 st = 0;
-        st = (m*fmap_y_len_+n)*num_input_fmaps;
-        CuSubMatrix<BaseFloat> src(out_diff.ColRange(out_fmap_cnt*num_input_fmaps, num_input_fmaps));
+        st = (m * fmap_y_len_ + n) * num_input_fmaps;
         for (int32 i = 0; i < pool_x_len_; i++) {
           for (int32 j = 0; j < pool_y_len_; j++) {
             int32 c = 0;
             c = st + i * (num_input_fmaps * fmap_y_len_)
                    + j * num_input_fmaps;
-            CuSubMatrix<BaseFloat> tgt(in_diff->ColRange(c, num_input_fmaps));
-            tgt.AddMat(1.0, src);
-            patch_summands[c/num_input_fmaps] += 1;
+            for (int32 f = 0; f < num_input_fmaps; f++) {
+              column_maps[i * pool_y_len_ + j][out_fmap_cnt * num_input_fmaps + f] = c + f;
+            }
           }
         }
         out_fmap_cnt++;
       }
     }
+    KALDI_ASSERT(out_fmap_cnt * num_input_fmaps == output_dim_);
+    column_maps_.resize(column_maps.size());
+    std::vector<int32> column_map;  // all of them, one after the other,
+    for (int32 k = 0; k < column_maps.size(); k++) {
+      column_maps_[k].CopyFromVec(column_maps[k]);
+      column_map.insert(column_map.end(), column_maps[k].begin(), column_maps[k].end());
+    }
 
-    // divide diff by average-pooling-dim (derivative of averaging)
-    in_diff->Scale(1.0 / (pool_x_len_ * pool_y_len_));
-
-    // divide diff by #summands (compensate for patches used in more pools)
-    for (int i = 0; i < fmap_x_len_; i++) {
-      for (int32 j = 0; j < fmap_y_len_; j++) {
-        int32 c = i * fmap_y_len_ + j;
-        CuSubMatrix<BaseFloat> tgt(in_diff->ColRange(c*num_input_fmaps, num_input_fmaps));
-        KALDI_ASSERT(patch_summands[c] > 0);  // patch at least in one pool
-        tgt.Scale(1.0 / patch_summands[c]);
+    // for the backprop, the output column of each use of an input column,
+    std::vector<std::vector<int32> > reverse_column_maps;
+    std::vector<int32> counts;
+    ReverseColumnMap(column_map, input_dim_, &reverse_column_maps, &counts);
+    reverse_column_maps_.resize(reverse_column_maps.size());
+    for (int32 m = 0; m < reverse_column_maps.size(); m++) {
+      for (int32 c = 0; c < input_dim_; c++) {
+        int32 &q = reverse_column_maps[m][c];
+        if (q >= 0) q %= output_dim_;
       }
+      reverse_column_maps_[m].CopyFromVec(reverse_column_maps[m]);
     }
+    // divide by average-pooling-dim (derivative of averaging), and by
+    // #summands (compensate for patches used in more pools),
+    Vector<BaseFloat> scales(input_dim_);
+    for (int32 c = 0; c < input_dim_; c++) {
+      KALDI_ASSERT(counts[c] > 0);  // patch at least in one pool
+      scales(c) = 1.0 / (pool_x_len_ * pool_y_len_ * counts[c]);
+    }
+    in_diff_scales_ = scales;
   }
 
- private:
   int32 fmap_x_len_, fmap_y_len_,
     pool_x_len_, pool_y_len_,
     pool_x_step_, pool_y_step_;
+
+  /// For each position in the pools, the input column of each output column
+  std::vector<CuArray<int32> > column_maps_;
+  /// For each use of the input columns in a pool (see ReverseColumnMap()),
+  /// the output column of that pool, or -1
+  std::vector<CuArray<int32> > reverse_column_maps_;
+  /// The factors for the derivatives w.r.t. the input columns
+  CuVector<BaseFloat> in_diff_scales_;
 };
 
 }  // namespace nnet1
@@ -322,6 +322,55 @@ class BLstmProjectedStreams : public UpdatableComponent {
     return;
   }
 
+  void SetParams(const VectorBase<BaseFloat> &wei_src) {
+    KALDI_ASSERT(wei_src.Dim() == NumParams());
+    int32 offset, len;
+
+    // Setting parameters corresponding to forward direction
+    offset = 0;  len = f_w_gifo_x_.NumRows() * f_w_gifo_x_.NumCols();
+    f_w_gifo_x_.CopyRowsFromVec(wei_src.Range(offset, len));
+
+    offset += len; len = f_w_gifo_r_.NumRows() * f_w_gifo_r_.NumCols();
+    f_w_gifo_r_.CopyRowsFromVec(wei_src.Range(offset, len));
+
+    offset += len; len = f_bias_.Dim();
+    f_bias_.CopyFromVec(wei_src.Range(offset, len));
+
+    offset += len; len = f_peephole_i_c_.Dim();
+    f_peephole_i_c_.CopyFromVec(wei_src.Range(offset, len));
+
+    offset += len; len = f_peephole_f_c_.Dim();
+    f_peephole_f_c_.CopyFromVec(wei_src.Range(offset, len));
+
+    offset += len; len = f_peephole_o_c_.Dim();
+    f_peephole_o_c_.CopyFromVec(wei_src.Range(offset, len));
+
+    offset += len; len = f_w_r_m_.NumRows() * f_w_r_m_.NumCols();
+    f_w_r_m_.CopyRowsFromVec(wei_src.Range(offset, len));
+
+    // Setting parameters corresponding to backward direction
+    offset += len; len = b_w_gifo_x_.NumRows() * b_w_gifo_x_.NumCols();
+    b_w_gifo_x_.CopyRowsFromVec(wei_src.Range(offset, len));
+
+    offset += len; len = b_w_gifo_r_.NumRows() * b_w_gifo_r_.NumCols();
+    b_w_gifo_r_.CopyRowsFromVec(wei_src.Range(offset, len));
+
+    offset += len; len = b_bias_.Dim();
+    b_bias_.CopyFromVec(wei_src.Range(offset, len));
+
+    offset += len; len = b_peephole_i_c_.Dim();
+    b_peephole_i_c_.CopyFromVec(wei_src.Range(offset, len));
+
+    offset += len; len = b_peephole_f_c_.Dim();
+    b_peephole_f_c_.CopyFromVec(wei_src.Range(offset, len));
+
+    offset += len; len = b_peephole_o_c_.Dim();
+    b_peephole_o_c_.CopyFromVec(wei_src.Range(offset, len));
+
+    offset += len; len = b_w_r_m_.NumRows() * b_w_r_m_.NumCols();
+    b_w_r_m_.CopyRowsFromVec(wei_src.Range(offset, len));
+  }
+
 
   std::string Info() const {
     return std::string("  ")  +
@@ -504,39 +553,11 @@ class BLstmProjectedStreams : public UpdatableComponent {
       // r(t-1) -> g, i, f, o
       y_gifo.AddMatMat(1.0, F_YR.RowRange((t-1)*S, S), kNoTrans, f_w_gifo_r_, kTrans, 1.0);
 
-      // c(t-1) -> i(t) via peephole
-      y_i.AddMatDiagVec(1.0, F_YC.RowRange((t-1)*S, S), kNoTrans, f_peephole_i_c_, 1.0);
-
-      // c(t-1) -> f(t) via peephole
-      y_f.AddMatDiagVec(1.0, F_YC.RowRange((t-1)*S, S), kNoTrans, f_peephole_f_c_, 1.0);
-
-      // i, f sigmoid squashing
-      y_i.Sigmoid(y_i);
-      y_f.Sigmoid(y_f);
-
-      // g tanh squashing
-      y_g.Tanh(y_g);
-
-      // g -> c
-      y_c.AddMatMatElements(1.0, y_g, y_i, 0.0);
-
-      // c(t-1) -> c(t) via forget-gate
-      y_c.AddMatMatElements(1.0, F_YC.RowRange((t-1)*S, S), y_f, 1.0);
-
-      y_c.ApplyFloor(-50);   // optional clipping of cell activation
-      y_c.ApplyCeiling(50);  // google paper Interspeech2014: LSTM for LVCSR
-
-      // h tanh squashing
-      y_h.Tanh(y_c);
-
-      // c(t) -> o(t) via peephole (non-recurrent) & o squashing
-      y_o.AddMatDiagVec(1.0, y_c, kNoTrans, f_peephole_o_c_, 1.0);
-
-      // o sigmoid squashing
-      y_o.Sigmoid(y_o);
-
-      // h -> m via output gate
-      y_m.AddMatMatElements(1.0, y_h, y_o, 0.0);
+      // the nonlinearities, cell and output gate, in one go:
+      // i, f, g, c (via peepholes from c(t-1) and the forget gate), h,
+      // o (via peephole from c(t)) and m
+      cu::ComputeLstmStep(CuSubMatrix<BaseFloat>(F_YC.RowRange((t-1)*S, S)),
+                          f_peephole_i_c_, f_peephole_f_c_, f_peephole_o_c_, &y_all);
 
       // m -> r
       y_r.AddMatMat(1.0, y_m, kNoTrans, f_w_r_m_, kTrans, 0.0);
@@ -593,39 +614,11 @@ class BLstmProjectedStreams : public UpdatableComponent {
       // r(t+1) -> g, i, f, o
       y_gifo.AddMatMat(1.0, B_YR.RowRange((t+1)*S, S), kNoTrans, b_w_gifo_r_, kTrans, 1.0);
 
-      // c(t+1) -> i(t) via peephole
-      y_i.AddMatDiagVec(1.0, B_YC.RowRange((t+1)*S, S), kNoTrans, b_peephole_i_c_, 1.0);
-
-      // c(t+1) -> f(t) via peephole
-      y_f.AddMatDiagVec(1.0, B_YC.RowRange((t+1)*S, S), kNoTrans, b_peephole_f_c_, 1.0);
-
-      // i, f sigmoid squashing
-      y_i.Sigmoid(y_i);
-      y_f.Sigmoid(y_f);
-
-      // g tanh squashing
-      y_g.Tanh(y_g);
-
-      // g -> c
-      y_c.AddMatMatElements(1.0, y_g, y_i, 0.0);
-
-      // c(t+1) -> c(t) via forget-gate
-      y_c.AddMatMatElements(1.0, B_YC.RowRange((t+1)*S, S), y_f, 1.0);
-
-      y_c.ApplyFloor(-50);   // optional clipping of cell activation
-      y_c.ApplyCeiling(50);  // google paper Interspeech2014: LSTM for LVCSR
-
-      // h tanh squashing
-      y_h.Tanh(y_c);
-
-      // c(t) -> o(t) via peephole (non-recurrent) & o squashing
-      y_o.AddMatDiagVec(1.0, y_c, kNoTrans, b_peephole_o_c_, 1.0);
-
-      // o sigmoid squashing
-      y_o.Sigmoid(y_o);
-
-      // h -> m via output gate
-      y_m.AddMatMatElements(1.0, y_h, y_o, 0.0);
+      // the nonlinearities, cell and output gate, in one go:
+      // i, f, g, c (via peepholes from c(t+1) and the forget gate), h,
+      // o (via peephole from c(t)) and m
+      cu::ComputeLstmStep(CuSubMatrix<BaseFloat>(B_YC.RowRange((t+1)*S, S)),
+                          b_peephole_i_c_, b_peephole_f_c_, b_peephole_o_c_, &y_all);
 
       // m -> r
       y_r.AddMatMat(1.0, y_m, kNoTrans, b_w_r_m_, kTrans, 0.0);
@@ -734,37 +727,14 @@ class BLstmProjectedStreams : public UpdatableComponent {
       // r -> m
       d_m.AddMatMat(1.0, d_r, kNoTrans, f_w_r_m_, kNoTrans, 0.0);
 
-      // m -> h via output gate
-      d_h.AddMatMatElements(1.0, d_m, y_o, 0.0);
-      d_h.DiffTanh(y_h, d_h);
-
-      // o
-      d_o.AddMatMatElements(1.0, d_m, y_h, 0.0);
-      d_o.DiffSigmoid(y_o, d_o);
-
-      // c
-      // 1. diff from h(t)
-      // 2. diff from c(t+1) (via forget-gate between CEC)
-      // 3. diff from i(t+1) (via peephole)
-      // 4. diff from f(t+1) (via peephole)
-      // 5. diff from o(t)   (via peephole, not recurrent)
-      d_c.AddMat(1.0, d_h);
-      d_c.AddMatMatElements(1.0, F_DC.RowRange((t+1)*S, S), F_YF.RowRange((t+1)*S, S), 1.0);
-      d_c.AddMatDiagVec(1.0, F_DI.RowRange((t+1)*S, S), kNoTrans, f_peephole_i_c_, 1.0);
-      d_c.AddMatDiagVec(1.0, F_DF.RowRange((t+1)*S, S), kNoTrans, f_peephole_f_c_, 1.0);
-      d_c.AddMatDiagVec(1.0, d_o           , kNoTrans, f_peephole_o_c_, 1.0);
-
-      // f
-      d_f.AddMatMatElements(1.0, d_c, F_YC.RowRange((t-1)*S, S), 0.0);
-      d_f.DiffSigmoid(y_f, d_f);
-
-      // i
-      d_i.AddMatMatElements(1.0, d_c, y_g, 0.0);
-      d_i.DiffSigmoid(y_i, d_i);
-
-      // c -> g via input gate
-      d_g.AddMatMatElements(1.0, d_c, y_i, 0.0);
-      d_g.DiffTanh(y_g, d_g);
+      // h, o, c (from h(t), c(t+1), i(t+1) and f(t+1), and o(t)
+      // via the peephole), f, i and g, in one go
+      cu::BackpropLstmStep(CuSubMatrix<BaseFloat>(f_propagate_buf_.RowRange(t*S, S)),
+                           CuSubMatrix<BaseFloat>(F_YC.RowRange((t-1)*S, S)),
+                           CuSubMatrix<BaseFloat>(f_propagate_buf_.RowRange((t+1)*S, S)),
+                           CuSubMatrix<BaseFloat>(f_backpropagate_buf_.RowRange((t+1)*S, S)),
+                           f_peephole_i_c_, f_peephole_f_c_, f_peephole_o_c_,
+                           &d_all);
 
       // debug info
       if (DEBUG) {
@@ -848,37 +818,14 @@ class BLstmProjectedStreams : public UpdatableComponent {
       // r -> m
       d_m.AddMatMat(1.0, d_r, kNoTrans, b_w_r_m_, kNoTrans, 0.0);
 
-      // m -> h via output gate
-      d_h.AddMatMatElements(1.0, d_m, y_o, 0.0);
-      d_h.DiffTanh(y_h, d_h);
-
-      // o
-      d_o.AddMatMatElements(1.0, d_m, y_h, 0.0);
-      d_o.DiffSigmoid(y_o, d_o);
-
-      // c
-      // 1. diff from h(t)
-      // 2. diff from c(t+1) (via forget-gate between CEC)
-      // 3. diff from i(t+1) (via peephole)
-      // 4. diff from f(t+1) (via peephole)
-      // 5. diff from o(t)   (via peephole, not recurrent)
-      d_c.AddMat(1.0, d_h);
-      d_c.AddMatMatElements(1.0, B_DC.RowRange((t-1)*S, S), B_YF.RowRange((t-1)*S, S), 1.0);
-      d_c.AddMatDiagVec(1.0, B_DI.RowRange((t-1)*S, S), kNoTrans, b_peephole_i_c_, 1.0);
-      d_c.AddMatDiagVec(1.0, B_DF.RowRange((t-1)*S, S), kNoTrans, b_peephole_f_c_, 1.0);
-      d_c.AddMatDiagVec(1.0, d_o                     , kNoTrans, b_peephole_o_c_, 1.0);
-
-      // f
-      d_f.AddMatMatElements(1.0, d_c, B_YC.RowRange((t-1)*S, S), 0.0);
-      d_f.DiffSigmoid(y_f, d_f);
-
-      // i
-      d_i.AddMatMatElements(1.0, d_c, y_g, 0.0);
-      d_i.DiffSigmoid(y_i, d_i);
-
-      // c -> g via input gate
-      d_g.AddMatMatElements(1.0, d_c, y_i, 0.0);
-      d_g.DiffTanh(y_g, d_g);
+      // h, o, c (from h(t), c(t-1), i(t-1) and f(t-1), and o(t)
+      // via the peephole), f, i and g, in one go
+      cu::BackpropLstmStep(CuSubMatrix<BaseFloat>(b_propagate_buf_.RowRange(t*S, S)),
+                           CuSubMatrix<BaseFloat>(B_YC.RowRange((t-1)*S, S)),
+                           CuSubMatrix<BaseFloat>(b_propagate_buf_.RowRange((t-1)*S, S)),
+                           CuSubMatrix<BaseFloat>(b_backpropagate_buf_.RowRange((t-1)*S, S)),
+                           b_peephole_i_c_, b_peephole_f_c_, b_peephole_o_c_,
+                           &d_all);
 
       // debug info
       if (DEBUG) {
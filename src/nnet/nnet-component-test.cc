@@ -168,6 +168,32 @@ namespace nnet1 {
 
 
 
+  void UnitTestUpdatableComponentSetParams() {
+    // networks with the same structure, and different parameters,
+    Nnet nnet1, nnet2;
+    for (int32 n=0; n<2; n++) {
+      Nnet *nnet = (n == 0 ? &nnet1 : &nnet2);
+      nnet->AppendComponent(Component::Init("<AffineTransform> <InputDim> 4 <OutputDim> 6 <ParamStddev> 0.1 <BiasRange> 0.5"));
+      nnet->AppendComponent(Component::Init("<LstmProjectedStreams> <InputDim> 6 <OutputDim> 3 <CellDim> 5"));
+      nnet->AppendComponent(Component::Init("<Sigmoid> <InputDim> 3 <OutputDim> 3"));
+      nnet->AppendComponent(Component::Init("<Rescale> <InputDim> 3 <OutputDim> 3 <InitParam> 2.0"));
+    }
+    // copy the parameters over,
+    Vector<BaseFloat> params1, params2;
+    nnet1.GetParams(&params1);
+    nnet2.GetParams(&params2);
+    KALDI_ASSERT(params1.Dim() == params2.Dim() && !params1.ApproxEqual(params2));
+    nnet2.SetParams(params1);
+    nnet2.GetParams(&params2);
+    AssertEqual(params1, params2);
+    // and the network computes the same function,
+    CuMatrix<BaseFloat> mat_in(3, 4), mat_out1, mat_out2;
+    mat_in.SetRandn();
+    nnet1.Propagate(mat_in, &mat_out1);
+    nnet2.Propagate(mat_in, &mat_out2);
+    AssertEqual(mat_out1, mat_out2);
+  }
+
   void UnitTestMaxPoolingComponent() {
     // make max-pooling component, assuming 4 conv. neurons, non-overlapping pool of size 3,
     Component* c = Component::Init("<MaxPoolingComponent> <InputDim> 24 <OutputDim> 8 \
@@ -359,6 +385,7 @@ int main() {
     UnitTestSimpleSentenceAveragingComponent();
     UnitTestConvolutionalComponentUnity();
     UnitTestConvolutionalComponent3x3();
+    UnitTestUpdatableComponentSetParams();
     UnitTestMaxPoolingComponent();
     UnitTestConvolutional2DComponent();
     UnitTestMaxPooling2DComponent();
@@ -194,6 +194,8 @@ class UpdatableComponent : public Component {
   /// Number of trainable parameters
   virtual int32 NumParams() const = 0;
   virtual void GetParams(Vector<BaseFloat> *params) const = 0;
+  /// Sets the trainable parameters from a vector in the layout of GetParams()
+  virtual void SetParams(const VectorBase<BaseFloat> &params) = 0;
 
   /// Compute gradient and update parameters
   virtual void Update(const CuMatrixBase<BaseFloat> &input,
@@ -26,6 +26,7 @@
 
 #include "nnet/nnet-component.h"
 #include "nnet/nnet-various.h"
+#include "nnet/nnet-utils.h"
 #include "cudamatrix/cu-math.h"
 
 namespace kaldi {
@@ -236,6 +237,13 @@ class Convolutional2DComponent : public UpdatableComponent {
     wei_copy->Range(filters_num_elem, bias_.Dim()).CopyFromVec(Vector<BaseFloat>(bias_));
   }
 
+  void SetParams(const VectorBase<BaseFloat> &wei_src) {
+    KALDI_ASSERT(wei_src.Dim() == NumParams());
+    int32 filters_num_elem = filters_.NumRows() * filters_.NumCols();
+    filters_.CopyRowsFromVec(wei_src.Range(0, filters_num_elem));
+    bias_.CopyFromVec(wei_src.Range(filters_num_elem, bias_.Dim()));
+  }
+
   std::string Info() const {
     return std::string("\n  filters") + MomentStatistics(filters_) +
            "\n  bias" + MomentStatistics(bias_);
@@ -249,8 +257,6 @@ class Convolutional2DComponent : public UpdatableComponent {
 
   void PropagateFnc(const CuMatrixBase<BaseFloat> &in, CuMatrixBase<BaseFloat> *out) {
     // useful dims
-    int32 num_input_fmaps = input_dim_ / (fmap_x_len_ * fmap_y_len_);
-    // int32 inp_fmap_size = fmap_x_len_ * fmap_y_len_;
     int32 out_fmap_x_len = (fmap_x_len_ - filt_x_len_)/filt_x_step_ + 1;
     int32 out_fmap_y_len = (fmap_y_len_ - filt_y_len_)/filt_y_step_ + 1;
     int32 out_fmap_size = out_fmap_x_len*out_fmap_y_len;
@@ -259,63 +265,32 @@ class Convolutional2DComponent : public UpdatableComponent {
     // so each input_fmap has size num_filters/num_input_fmaps
     int32 num_filters = filters_.NumRows();
     KALDI_ASSERT(num_filters == num_output_fmaps);
-    // int32 filter_size = filt_x_len_*filt_y_len_;
+    int32 filter_dim = filters_.NumCols();
     int32 num_frames = in.NumRows();
 
-    // we will need the buffers
-    if (vectorized_feature_patches_.size() == 0) {
-      vectorized_feature_patches_.resize(out_fmap_size);
-      feature_patch_diffs_.resize(out_fmap_size);
-    }
-
-    for (int32 p = 0; p < out_fmap_size; p++) {
-      vectorized_feature_patches_[p].Resize(num_frames, filters_.NumCols());
-    }
-
-    // Checked for num_input_fmaps=1, check for num_inp_fmaps>1
-    int32 out_fmap_cnt = 0;
-    for (int32 m = 0; m < fmap_x_len_-filt_x_len_+1; m = m+filt_x_step_) {
-      for (int32 n = 0; n < fmap_y_len_-filt_y_len_+1; n = n+filt_y_step_) {
-    std::vector<int32> column_mask;
-    int32 st = 0;
-    if (connect_fmap_ == 1) {
-      st = (m * fmap_y_len_ + n) * num_input_fmaps;
-    } else {
-      st = m * fmap_y_len_ * num_input_fmaps + n;
-    }
-
-    for (int32 i = 0; i < filt_x_len_; i++) {
-      for (int32 j = 0; j < filt_y_len_*num_input_fmaps; j++) {
-        int32 c = 0;
-        if (connect_fmap_ == 1) {
-          c = st + i * (num_input_fmaps*fmap_y_len_) + j;
-        } else {
-          c = st + i * (num_input_fmaps * fmap_y_len_)
-                     + (j / num_input_fmaps)
-                     + (j % num_input_fmaps) * fmap_y_len_;
-        }
-        column_mask.push_back(c);
-      }
-    }
-    CuArray<int32> cu_column_mask(column_mask);
-    vectorized_feature_patches_[out_fmap_cnt].CopyCols(in, cu_column_mask);
-    out_fmap_cnt++;
-      }
-    }
-
-    for (int32 p = 0; p < out_fmap_size; p++) {
-      CuSubMatrix<BaseFloat> tgt(out->ColRange(p*num_filters, num_filters));
-      tgt.AddVecToRows(1.0, bias_, 0.0);
-      tgt.AddMatMat(1.0, vectorized_feature_patches_[p], kNoTrans, filters_, kTrans, 1.0);
-    }
+    // all the feature patches in one matrix, by a single CopyCols(),
+    if (column_map_.Dim() == 0) ComputeColumnMaps();
+    feature_patches_.Resize(num_frames, out_fmap_size * filter_dim, kUndefined);
+    feature_patches_.CopyCols(in, column_map_);
+
+    // add the bias of all the patches (as one vector),
+    CuVector<BaseFloat> bias_patches(out_fmap_size * num_filters, kUndefined);
+    CuSubMatrix<BaseFloat>(bias_patches.Data(), out_fmap_size, num_filters,
+                           num_filters).CopyRowsFromVec(bias_);
+    out->AddVecToRows(1.0, bias_patches, 0.0);
+
+    // apply the filters to all the patches by one batched GEMM: patch p of the
+    // output is the columns p*num_filters ... (p+1)*num_filters-1, and patch p
+    // of 'feature_patches_' is the columns p*filter_dim ... (p+1)*filter_dim-1,
+    out->ColRange(0, num_filters).AddMatMatBatched(
+        1.0, feature_patches_.ColRange(0, filter_dim), kNoTrans, filter_dim,
+        filters_, kTrans, 0, 1.0, num_filters, out_fmap_size);
   }
 
 
   void BackpropagateFnc(const CuMatrixBase<BaseFloat> &in, const CuMatrixBase<BaseFloat> &out,
                         const CuMatrixBase<BaseFloat> &out_diff, CuMatrixBase<BaseFloat> *in_diff) {
     // useful dims
-    int32 num_input_fmaps = input_dim_ / (fmap_x_len_ * fmap_y_len_);
-
     int32 out_fmap_x_len = (fmap_x_len_ - filt_x_len_)/filt_x_step_ + 1;
     int32 out_fmap_y_len = (fmap_y_len_ - filt_y_len_)/filt_y_step_ + 1;
     int32 out_fmap_size = out_fmap_x_len * out_fmap_y_len;
@@ -324,73 +299,21 @@ class Convolutional2DComponent : public UpdatableComponent {
     // so each input_fmap has num_filters/num_input_fmaps
     int32 num_filters = filters_.NumRows();
     KALDI_ASSERT(num_filters == num_output_fmaps);
-    // int32 filter_size = filt_x_len_*filt_y_len_;
+    int32 filter_dim = filters_.NumCols();
     int32 num_frames = in.NumRows();
 
-    for (int32 p = 0; p < out_fmap_size; p++) {
-      feature_patch_diffs_[p].Resize(num_frames, filters_.NumCols(), kSetZero);
-      CuSubMatrix<BaseFloat> out_diff_patch(out_diff.ColRange(p*num_filters, num_filters));
-      feature_patch_diffs_[p].AddMatMat(1.0, out_diff_patch, kNoTrans, filters_, kNoTrans, 0.0);
-    }
-
-    // compute in_diff_summands_ once
-    if (in_diff_summands_.Dim() == 0) {
-      in_diff_summands_.Resize(in_diff->NumCols(), kSetZero);
-      for (int32 m = 0; m < fmap_x_len_-filt_x_len_+1; m = m+filt_x_step_) {
-        for (int32 n = 0; n < fmap_y_len_-filt_y_len_+1; n = n+filt_y_step_) {
-          int32 st = 0;
-          if (connect_fmap_ == 1) {
-            st = (m * fmap_y_len_ + n) * num_input_fmaps;
-          } else {
-            st = m * fmap_y_len_ * num_input_fmaps + n;
-          }
-          for (int32 i = 0; i < filt_x_len_; i++) {
-            for (int32 j = 0; j < filt_y_len_*num_input_fmaps; j++) {
-              int32 c = 0;
-              if (connect_fmap_ == 1) {
-                c = st + i * (num_input_fmaps * fmap_y_len_) + j;
-              } else {
-                c = st + i * (num_input_fmaps * fmap_y_len_)
-                       + (j / num_input_fmaps)
-                       + (j % num_input_fmaps) * fmap_y_len_;
-              }
-              // add 1.0
-              in_diff_summands_.Range(c, 1).Add(1.0);
-            }
-          }
-        }
-      }
-      in_diff_summands_.InvertElements();
-    }
-
-    int32 out_fmap_cnt = 0;
-
-    for (int32 m = 0; m < fmap_x_len_-filt_x_len_+1; m = m+filt_x_step_) {
-      for (int32 n = 0; n< fmap_y_len_-filt_y_len_+1; n = n+filt_y_step_) {
-        int32 st = 0;
-        if (connect_fmap_ == 1) {
-          st = (m * fmap_y_len_ + n) * num_input_fmaps;
-        } else {
-          st = m * fmap_y_len_ * num_input_fmaps + n;
-        }
-
-        for (int32 i = 0; i < filt_x_len_; i++) {
-          for (int32 j = 0; j < filt_y_len_*num_input_fmaps; j++) {
-            int32 c = 0;
-            if (connect_fmap_ == 1) {
-              c = st + i *(num_input_fmaps*fmap_y_len_)+j;
-            } else {
-              c = st + i * (num_input_fmaps * fmap_y_len_)
-                     + (j / num_input_fmaps)
-                     + (j % num_input_fmaps) * fmap_y_len_;
-            }
-            CuSubMatrix<BaseFloat> src(feature_patch_diffs_[out_fmap_cnt].ColRange(i*filt_y_len_*num_input_fmaps+j, 1));  // from which col
-            CuSubMatrix<BaseFloat> tgt(in_diff->ColRange(c, 1));  // to which col?
-            tgt.AddMat(1.0, src);
-          }
-        }
-        out_fmap_cnt++;
-      }
+    // derivatives w.r.t. all the patches, by one batched GEMM,
+    if (column_map_.Dim() == 0) ComputeColumnMaps();
+    feature_patch_diffs_.Resize(num_frames, out_fmap_size * filter_dim, kUndefined);
+    feature_patch_diffs_.ColRange(0, filter_dim).AddMatMatBatched(
+        1.0, out_diff.ColRange(0, num_filters), kNoTrans, num_filters,
+        filters_, kNoTrans, 0, 0.0, filter_dim, out_fmap_size);
+
+    // sum them back to the input columns they come from, with one
+    // CopyCols()/AddCols() per overlapping patch,
+    for (int32 m = 0; m < reverse_column_maps_.size(); m++) {
+      if (m == 0) in_diff->CopyCols(feature_patch_diffs_, reverse_column_maps_[m]);
+      else in_diff->AddCols(feature_patch_diffs_, reverse_column_maps_[m]);
     }
     // compensate for summands
     in_diff->MulColsVec(in_diff_summands_);
@@ -418,14 +341,21 @@ class Convolutional2DComponent : public UpdatableComponent {
     //
     // calculate the gradient
     //
+    // the gradients for the patches by one batched GEMM, and their sum,
+    int32 filter_dim = filters_.NumCols();
+    CuMatrix<BaseFloat> filters_grad_patches(num_filters, out_fmap_size * filter_dim, kUndefined);
+    filters_grad_patches.ColRange(0, filter_dim).AddMatMatBatched(
+        1.0, diff.ColRange(0, num_filters), kTrans, num_filters,
+        feature_patches_.ColRange(0, filter_dim), kNoTrans, filter_dim,
+        0.0, filter_dim, out_fmap_size);
     filters_grad_.Resize(filters_.NumRows(), filters_.NumCols(), kSetZero);
-    bias_grad_.Resize(filters_.NumRows());
+    filters_grad_.AddMatBlocks(1.0, filters_grad_patches);
 
-    for (int32 p = 0; p < out_fmap_size; p++) {
-      CuSubMatrix<BaseFloat> diff_patch(diff.ColRange(p*num_filters, num_filters));
-      filters_grad_.AddMatMat(1.0, diff_patch, kTrans, vectorized_feature_patches_[p], kNoTrans, 1.0);
-      bias_grad_.AddRowSumMat(1.0, diff_patch, 1.0);
-    }
+    CuVector<BaseFloat> bias_grad_patches(out_fmap_size * num_filters);
+    bias_grad_patches.AddRowSumMat(1.0, diff, 0.0);
+    bias_grad_.Resize(filters_.NumRows());
+    bias_grad_.AddRowSumMat(1.0, CuSubMatrix<BaseFloat>(bias_grad_patches.Data(), out_fmap_size,
+                                                        num_filters, num_filters), 0.0);
 
     // scale
     filters_grad_.Scale(1.0/out_fmap_size);
@@ -440,6 +370,50 @@ class Convolutional2DComponent : public UpdatableComponent {
   }
 
  private:
+  /// Computes 'column_map_', 'reverse_column_maps_' and 'in_diff_summands_'
+  void ComputeColumnMaps() {
+    int32 num_input_fmaps = input_dim_ / (fmap_x_len_ * fmap_y_len_);
+    std::vector<int32> column_map;
+    for (int32 m = 0; m < fmap_x_len_-filt_x_len_+1; m = m+filt_x_step_) {
+      for (int32 n = 0; n < fmap_y_len_-filt_y_len_+1; n = n+filt_y_step_) {
+        int32 st = 0;
+        if (connect_fmap_ == 1) {
+          st = (m * fmap_y_len_ + n) * num_input_fmaps;
+        } else {
+          st = m * fmap_y_len_ * num_input_fmaps + n;
+        }
+        for (int32 i = 0; i < filt_x_len_; i++) {
+          for (int32 j = 0; j < filt_y_len_*num_input_fmaps; j++) {
+            int32 c = 0;
+            if (connect_fmap_ == 1) {
+              c = st + i * (num_input_fmaps*fmap_y_len_) + j;
+            } else {
+              c = st + i * (num_input_fmaps * fmap_y_len_)
+                     + (j / num_input_fmaps)
+                     + (j % num_input_fmaps) * fmap_y_len_;
+            }
+            column_map.push_back(c);
+          }
+        }
+      }
+    }
+    KALDI_ASSERT(column_map.size() % filters_.NumCols() == 0);
+    column_map_.CopyFromVec(column_map);
+
+    std::vector<std::vector<int32> > reverse_column_maps;
+    std::vector<int32> counts;
+    ReverseColumnMap(column_map, input_dim_, &reverse_column_maps, &counts);
+    reverse_column_maps_.resize(reverse_column_maps.size());
+    for (int32 m = 0; m < reverse_column_maps.size(); m++) {
+      reverse_column_maps_[m].CopyFromVec(reverse_column_maps[m]);
+    }
+    // inverse of the number of summands of each input column,
+    Vector<BaseFloat> summands(input_dim_);
+    for (int32 c = 0; c < input_dim_; c++) summands(c) = counts[c];
+    summands.InvertElements();
+    in_diff_summands_ = summands;
+  }
+
   int32 fmap_x_len_, fmap_y_len_,  ///< feature maps dimensions (for input x_ is usually splice and y_ is num of fbanks) shift for 2nd dim of a patch (i.e. frame length before splicing)
     filt_x_len_, filt_y_len_,  ///< 2D filter dimensions, x_ temporal, y_ spectral
     filt_x_step_, filt_y_step_,  ///< 2D shifts along temporal and spectral
@@ -455,21 +429,23 @@ class Convolutional2DComponent : public UpdatableComponent {
   CuVector<BaseFloat> bias_grad_;  ///< gradient of biases
 
   /** Buffer of reshaped inputs:
-   *  1row = vectorized rectangular feature patch,
-   *  1col = dim over speech frames,
-   *  std::vector-dim = patch-position
+   *  1row = vectorized rectangular feature patches of a frame (one after
+   *  the other, in the order of the patch-positions),
+   *  1col = dim over speech frames
    */
-  std::vector<CuMatrix<BaseFloat> > vectorized_feature_patches_;
+  CuMatrix<BaseFloat> feature_patches_;
 
   /** Buffer for backpropagation:
-   *  derivatives in the domain of 'vectorized_feature_patches_',
-   *  1row = vectorized rectangular feature patch,
-   *  1col = dim over speech frames,
-   *  std::vector-dim = patch-position
+   *  derivatives in the domain of 'feature_patches_'
    */
-  std::vector<CuMatrix<BaseFloat> > feature_patch_diffs_;
+  CuMatrix<BaseFloat> feature_patch_diffs_;
+
+  /// For each column of 'feature_patches_', the input column it comes from
+  CuArray<int32> column_map_;
+  /// Index arrays to sum 'feature_patch_diffs_' to the input columns (see
+  /// ReverseColumnMap()), one per use of an input column in a patch
+  std::vector<CuArray<int32> > reverse_column_maps_;
 
-  /// Auxiliary vector for compensating #summands when backpropagating
   CuVector<BaseFloat> in_diff_summands_;
 };
 
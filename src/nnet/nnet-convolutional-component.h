@@ -218,6 +218,13 @@ class ConvolutionalComponent : public UpdatableComponent {
     wei_copy->Range(filters_num_elem, bias_.Dim()).CopyFromVec(Vector<BaseFloat>(bias_));
   }
 
+  void SetParams(const VectorBase<BaseFloat> &wei_src) {
+    KALDI_ASSERT(wei_src.Dim() == NumParams());
+    int32 filters_num_elem = filters_.NumRows() * filters_.NumCols();
+    filters_.CopyRowsFromVec(wei_src.Range(0, filters_num_elem));
+    bias_.CopyFromVec(wei_src.Range(filters_num_elem, bias_.Dim()));
+  }
+
   std::string Info() const {
     return std::string("\n  filters") + MomentStatistics(filters_) +
            "\n  bias" + MomentStatistics(bias_);
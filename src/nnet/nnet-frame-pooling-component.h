@@ -175,6 +175,15 @@ class FramePoolingComponent : public UpdatableComponent {
     }
     KALDI_ASSERT(offset == wei_copy->Dim());
   }
+
+  void SetParams(const VectorBase<BaseFloat> &wei_src) {
+    KALDI_ASSERT(wei_src.Dim() == NumParams());
+    int32 offset = 0;
+    for (int32 p=0; p<weight_.size(); p++) {
+      weight_[p].CopyFromVec(wei_src.Range(offset, weight_[p].Dim()));
+      offset += weight_[p].Dim(); 
+    }
+  }
   
   std::string Info() const {
     std::ostringstream oss;
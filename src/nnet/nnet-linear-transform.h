@@ -108,6 +108,11 @@ class LinearTransform : public UpdatableComponent {
     int32 linearity_num_elem = linearity_.NumRows() * linearity_.NumCols(); 
     wei_copy->Range(0,linearity_num_elem).CopyRowsFromMat(Matrix<BaseFloat>(linearity_));
   }
+
+  void SetParams(const VectorBase<BaseFloat> &wei_src) {
+    KALDI_ASSERT(wei_src.Dim() == NumParams());
+    linearity_.CopyRowsFromVec(wei_src);
+  }
   
   std::string Info() const {
     return std::string("\n  linearity") + MomentStatistics(linearity_);
@@ -215,6 +215,32 @@ class LstmProjectedStreams : public UpdatableComponent {
     return;
   }
 
+  void SetParams(const VectorBase<BaseFloat> &wei_src) {
+    KALDI_ASSERT(wei_src.Dim() == NumParams());
+    int32 offset, len;
+
+    offset = 0;  len = w_gifo_x_.NumRows() * w_gifo_x_.NumCols();
+    w_gifo_x_.CopyRowsFromVec(wei_src.Range(offset, len));
+
+    offset += len; len = w_gifo_r_.NumRows() * w_gifo_r_.NumCols();
+    w_gifo_r_.CopyRowsFromVec(wei_src.Range(offset, len));
+
+    offset += len; len = bias_.Dim();
+    bias_.CopyFromVec(wei_src.Range(offset, len));
+
+    offset += len; len = peephole_i_c_.Dim();
+    peephole_i_c_.CopyFromVec(wei_src.Range(offset, len));
+
+    offset += len; len = peephole_f_c_.Dim();
+    peephole_f_c_.CopyFromVec(wei_src.Range(offset, len));
+
+    offset += len; len = peephole_o_c_.Dim();
+    peephole_o_c_.CopyFromVec(wei_src.Range(offset, len));
+
+    offset += len; len = w_r_m_.NumRows() * w_r_m_.NumCols();
+    w_r_m_.CopyRowsFromVec(wei_src.Range(offset, len));
+  }
+
   std::string Info() const {
     return std::string("  ") +
       "\n  w_gifo_x_  "   + MomentStatistics(w_gifo_x_) +
@@ -358,39 +384,12 @@ class LstmProjectedStreams : public UpdatableComponent {
       // r(t-1) -> g, i, f, o
       y_gifo.AddMatMat(1.0, YR.RowRange((t-1)*S,S), kNoTrans, w_gifo_r_, kTrans,  1.0);
 
-      // c(t-1) -> i(t) via peephole
-      y_i.AddMatDiagVec(1.0, YC.RowRange((t-1)*S,S), kNoTrans, peephole_i_c_, 1.0);
-
-      // c(t-1) -> f(t) via peephole
-      y_f.AddMatDiagVec(1.0, YC.RowRange((t-1)*S,S), kNoTrans, peephole_f_c_, 1.0);
-
-      // i, f sigmoid squashing
-      y_i.Sigmoid(y_i);
-      y_f.Sigmoid(y_f);
-
-      // g tanh squashing
-      y_g.Tanh(y_g);
-
-      // g -> c
-      y_c.AddMatMatElements(1.0, y_g, y_i, 0.0);
-
-      // c(t-1) -> c(t) via forget-gate
-      y_c.AddMatMatElements(1.0, YC.RowRange((t-1)*S,S), y_f, 1.0);
-
-      y_c.ApplyFloor(-50);   // optional clipping of cell activation
-      y_c.ApplyCeiling(50);  // google paper Interspeech2014: LSTM for LVCSR
-
-      // h tanh squashing
-      y_h.Tanh(y_c);
-
-      // c(t) -> o(t) via peephole (non-recurrent) & o squashing
-      y_o.AddMatDiagVec(1.0, y_c, kNoTrans, peephole_o_c_, 1.0);
-
-      // o sigmoid squashing
-      y_o.Sigmoid(y_o);
-
-      // h -> m via output gate
-      y_m.AddMatMatElements(1.0, y_h, y_o, 0.0);
+      // the nonlinearities, cell and output gate, in one go:
+      // i, f, g, c (via peepholes from c(t-1) and the forget gate), h,
+      // o (via peephole from c(t)) and m
+      CuSubMatrix<BaseFloat> y_all(propagate_buf_.RowRange(t*S, S));
+      cu::ComputeLstmStep(CuSubMatrix<BaseFloat>(YC.RowRange((t-1)*S, S)),
+                          peephole_i_c_, peephole_f_c_, peephole_o_c_, &y_all);
 
       // m -> r
       y_r.AddMatMat(1.0, y_m, kNoTrans, w_r_m_, kTrans, 0.0);
@@ -491,37 +490,15 @@ class LstmProjectedStreams : public UpdatableComponent {
       // r -> m
       d_m.AddMatMat(1.0, d_r, kNoTrans, w_r_m_, kNoTrans, 0.0);
 
-      // m -> h via output gate
-      d_h.AddMatMatElements(1.0, d_m, y_o, 0.0);
-      d_h.DiffTanh(y_h, d_h);
-
-      // o
-      d_o.AddMatMatElements(1.0, d_m, y_h, 0.0);
-      d_o.DiffSigmoid(y_o, d_o);
-
-      // c
-      // 1. diff from h(t)
-      // 2. diff from c(t+1) (via forget-gate between CEC)
-      // 3. diff from i(t+1) (via peephole)
-      // 4. diff from f(t+1) (via peephole)
-      // 5. diff from o(t)   (via peephole, not recurrent)
-      d_c.AddMat(1.0, d_h);
-      d_c.AddMatMatElements(1.0, DC.RowRange((t+1)*S,S), YF.RowRange((t+1)*S,S), 1.0);
-      d_c.AddMatDiagVec(1.0, DI.RowRange((t+1)*S,S), kNoTrans, peephole_i_c_, 1.0);
-      d_c.AddMatDiagVec(1.0, DF.RowRange((t+1)*S,S), kNoTrans, peephole_f_c_, 1.0);
-      d_c.AddMatDiagVec(1.0, d_o                   , kNoTrans, peephole_o_c_, 1.0);
-
-      // f
-      d_f.AddMatMatElements(1.0, d_c, YC.RowRange((t-1)*S,S), 0.0);
-      d_f.DiffSigmoid(y_f, d_f);
-
-      // i
-      d_i.AddMatMatElements(1.0, d_c, y_g, 0.0);
-      d_i.DiffSigmoid(y_i, d_i);
-
-      // c -> g via input gate
-      d_g.AddMatMatElements(1.0, d_c, y_i, 0.0);
-      d_g.DiffTanh(y_g, d_g);
+      // h, o, c (from h(t), c(t+1), i(t+1) and f(t+1), and o(t)
+      // via the peephole), f, i and g, in one go
+      CuSubMatrix<BaseFloat> d_all(backpropagate_buf_.RowRange(t*S, S));
+      cu::BackpropLstmStep(CuSubMatrix<BaseFloat>(propagate_buf_.RowRange(t*S, S)),
+                           CuSubMatrix<BaseFloat>(YC.RowRange((t-1)*S, S)),
+                           CuSubMatrix<BaseFloat>(propagate_buf_.RowRange((t+1)*S, S)),
+                           CuSubMatrix<BaseFloat>(backpropagate_buf_.RowRange((t+1)*S, S)),
+                           peephole_i_c_, peephole_f_c_, peephole_o_c_,
+                           &d_all);
 
       // debug info
       if (DEBUG) {
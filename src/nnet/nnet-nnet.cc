@@ -228,6 +228,21 @@ void Nnet::GetParams(Vector<BaseFloat>* wei_copy) const {
 }
 
 
+void Nnet::SetParams(const VectorBase<BaseFloat>& wei_src) {
+  KALDI_ASSERT(wei_src.Dim() == NumParams());
+  int32 pos = 0;
+  for(int32 i=0; i<components_.size(); i++) {
+    if(components_[i]->IsUpdatable()) {
+      UpdatableComponent& c = dynamic_cast<UpdatableComponent&>(*components_[i]);
+      int32 num_params = c.NumParams();
+      c.SetParams(wei_src.Range(pos, num_params));
+      pos += num_params;
+    }
+  }
+  KALDI_ASSERT(pos == NumParams());
+}
+
+
 void Nnet::GetWeights(Vector<BaseFloat>* wei_copy) const {
   wei_copy->Resize(NumParams());
   int32 pos = 0;
@@ -89,6 +89,8 @@ class Nnet {
   int32 NumParams() const;
   /// Get the network weights in a supervector
   void GetParams(Vector<BaseFloat>* wei_copy) const;
+  /// Set the trainable parameters from a vector in the layout of GetParams()
+  void SetParams(const VectorBase<BaseFloat>& wei_src);
   /// Get the network weights in a supervector
   void GetWeights(Vector<BaseFloat>* wei_copy) const;
   /// Set the network weights from a supervector
@@ -155,6 +155,16 @@ class ParallelComponent : public UpdatableComponent {
     }
     KALDI_ASSERT(offset == NumParams());
   }
+
+  void SetParams(const VectorBase<BaseFloat> &wei_src) {
+    KALDI_ASSERT(wei_src.Dim() == NumParams());
+    int32 offset = 0;
+    for (int32 i=0; i<nnet_.size(); i++) {
+      int32 num_params = nnet_[i].NumParams();
+      nnet_[i].SetParams(wei_src.Range(offset, num_params));
+      offset += num_params;
+    }
+  }
     
   std::string Info() const { 
     std::ostringstream os;
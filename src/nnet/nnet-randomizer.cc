@@ -73,17 +73,20 @@ void MatrixRandomizer::Randomize(const std::vector<int32>& mask) {
   KALDI_ASSERT(data_begin_ == 0);
   KALDI_ASSERT(data_end_ > 0);
   KALDI_ASSERT(data_end_ == mask.size());
-  // Copy to auxiliary buffer for unshuffled data
-  data_aux_ = data_;
-  // Put the mask to GPU 
-  CuArray<int32> mask_in_gpu(mask.size());
-  mask_in_gpu.CopyFromVec(mask);
-  // Randomize the data, mask is used to index rows in source matrix:
-  // (Here the vector 'mask_in_gpu' is typically shorter than number of rows in 'data_aux_',
-  //  because the the buffer 'data_aux_' is larger than capacity 'randomizer_size'.
-  //  The extra rows in 'data_aux_' do not contain speech frames and are not copied
-  //  from 'data_aux_', the extra rows in 'data_' are unchanged by cu::Randomize.)
-  cu::Randomize(data_aux_, mask_in_gpu, &data_);
+  // Put the mask to GPU (reusing the buffer if the size did not change)
+  mask_in_gpu_.CopyFromVec(mask);
+  // Randomize the data into the auxiliary buffer, mask is used to index rows
+  // in the source matrix, and swap the buffers; there is no copy of the
+  // unshuffled data, and nothing but the mask goes between host and GPU.
+  // (Here the vector 'mask_in_gpu_' is typically shorter than number of rows
+  //  in 'data_', because the buffer is larger than capacity 'randomizer_size';
+  //  the extra rows do not contain speech frames and are not copied.)
+  if (data_aux_.NumRows() != data_.NumRows() ||
+      data_aux_.NumCols() != data_.NumCols()) {
+    data_aux_.Resize(data_.NumRows(), data_.NumCols(), kUndefined);
+  }
+  cu::Randomize(data_, mask_in_gpu_, &data_aux_);
+  data_.Swap(&data_aux_);
 }
 
 void MatrixRandomizer::Next() {
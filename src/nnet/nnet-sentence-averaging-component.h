@@ -157,6 +157,7 @@ class SentenceAveragingComponent : public UpdatableComponent {
 
   int32 NumParams() const { return nnet_.NumParams(); }
   void GetParams(Vector<BaseFloat>* wei_copy) const { wei_copy->Resize(NumParams()); nnet_.GetParams(wei_copy); }
+  void SetParams(const VectorBase<BaseFloat> &wei_src) { nnet_.SetParams(wei_src); }
   std::string Info() const { return std::string("nested_network {\n") + nnet_.Info() + "}\n"; }
   std::string InfoGradient() const { return std::string("nested_gradient {\n") + nnet_.InfoGradient() + "}\n"; }
 
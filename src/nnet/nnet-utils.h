@@ -202,6 +202,33 @@ void PosteriorToMatrixMapped(const Posterior &post, const TransitionModel &model
 }
 
 
+/**
+ * Given "column_map", where column q of a matrix B is column column_map[q]
+ * (or -1 for none) of a matrix A with "num_cols" columns, as in B.CopyCols(A),
+ * outputs index arrays to sum B back into the domain of A: column c of A gets
+ * B(:, (*reverse_maps)[m][c]) for each m (where -1 means nothing), i.e. one
+ * CopyCols() or AddCols() per m.  Also outputs how many columns of B each
+ * column of A went to.
+ */
+inline void ReverseColumnMap(const std::vector<int32> &column_map, int32 num_cols,
+                             std::vector<std::vector<int32> > *reverse_maps,
+                             std::vector<int32> *counts) {
+  counts->clear();
+  counts->resize(num_cols, 0);
+  reverse_maps->clear();
+  for (int32 q = 0; q < column_map.size(); q++) {
+    int32 c = column_map[q];
+    if (c < 0) continue;
+    KALDI_ASSERT(c < num_cols);
+    int32 m = (*counts)[c]++;
+    if (m == reverse_maps->size()) {
+      reverse_maps->push_back(std::vector<int32>(num_cols, -1));
+    }
+    (*reverse_maps)[m][c] = q;
+  }
+}
+
+
 } // namespace nnet1
 } // namespace kaldi
 
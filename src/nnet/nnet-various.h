@@ -388,6 +388,11 @@ class AddShift : public UpdatableComponent {
     wei_copy->Resize(InputDim());
     shift_data_.CopyToVec(wei_copy);
   }
+
+  void SetParams(const VectorBase<BaseFloat> &wei_src) {
+    KALDI_ASSERT(wei_src.Dim() == NumParams());
+    shift_data_.CopyFromVec(wei_src);
+  }
    
   std::string Info() const {
     return std::string("\n  shift_data") + MomentStatistics(shift_data_);
@@ -495,6 +500,11 @@ class Rescale : public UpdatableComponent {
     wei_copy->Resize(InputDim());
     scale_data_.CopyToVec(wei_copy);
   }
+
+  void SetParams(const VectorBase<BaseFloat> &wei_src) {
+    KALDI_ASSERT(wei_src.Dim() == NumParams());
+    scale_data_.CopyFromVec(wei_src);
+  }
  
   std::string Info() const {
     return std::string("\n  scale_data") + MomentStatistics(scale_data_);
@@ -98,6 +98,79 @@ class FisherComputationClass: public MultiThreadable {
 };
 
 
+/*
+  This class computes the objective function, and optionally the gradient,
+  of a neural net on the validation examples, starting from activations
+  cached by class FastNnetCombiner (see its member activations_).
+ */
+class CachedObjfComputationClass: public MultiThreadable {
+ public:
+  CachedObjfComputationClass(
+      const Nnet &nnet,
+      int32 num_cached_components,
+      const std::vector<std::vector<NnetExample> > &minibatches,
+      const std::vector<CuMatrix<BaseFloat> > &activations,
+      Nnet *nnet_gradient,
+      double *tot_objf,
+      double *tot_weight):
+      nnet_(nnet), num_cached_components_(num_cached_components),
+      minibatches_(minibatches), activations_(activations),
+      nnet_gradient_(nnet_gradient), nnet_gradient_orig_(nnet_gradient),
+      tot_objf_ptr_(tot_objf), tot_weight_ptr_(tot_weight),
+      tot_objf_(0.0), tot_weight_(0.0) { }  // This initializer is only
+  // used to create a temporary version of the object.
+
+  CachedObjfComputationClass(const CachedObjfComputationClass &other):
+      nnet_(other.nnet_), num_cached_components_(other.num_cached_components_),
+      minibatches_(other.minibatches_), activations_(other.activations_),
+      nnet_gradient_(NULL), nnet_gradient_orig_(other.nnet_gradient_orig_),
+      tot_objf_ptr_(other.tot_objf_ptr_), tot_weight_ptr_(other.tot_weight_ptr_),
+      tot_objf_(0.0), tot_weight_(0.0) {
+    if (nnet_gradient_orig_ != NULL) {
+      // Each thread accumulates its own copy of the gradient; we sum them
+      // in the destructor.
+      nnet_gradient_ = new Nnet(*nnet_gradient_orig_);
+      bool is_gradient = true;
+      nnet_gradient_->SetZero(is_gradient);
+    }
+  }
+
+  void operator () () {
+    int32 num_minibatches = minibatches_.size();
+    for (int32 b = 0; b < num_minibatches; b++) {
+      if (b % num_threads_ != thread_id_)
+        continue;  // We're not responsible for this minibatch.
+      tot_objf_ += DoBackpropFromActivations(nnet_, minibatches_[b],
+                                             num_cached_components_,
+                                             activations_[b], nnet_gradient_);
+      tot_weight_ += TotalNnetTrainingWeight(minibatches_[b]);
+    }
+  }
+
+  ~CachedObjfComputationClass() {
+    if (nnet_gradient_ != nnet_gradient_orig_) {
+      if (nnet_gradient_ != NULL)
+        nnet_gradient_orig_->AddNnet(1.0, *nnet_gradient_);
+      delete nnet_gradient_;
+    }
+    *tot_objf_ptr_ += tot_objf_;
+    *tot_weight_ptr_ += tot_weight_;
+  }
+
+ private:
+  const Nnet &nnet_;
+  int32 num_cached_components_;
+  const std::vector<std::vector<NnetExample> > &minibatches_;
+  const std::vector<CuMatrix<BaseFloat> > &activations_;
+  Nnet *nnet_gradient_;  // NULL if we're only computing the objf.
+  Nnet *nnet_gradient_orig_;
+  double *tot_objf_ptr_;
+  double *tot_weight_ptr_;
+  double tot_objf_;
+  double tot_weight_;
+};
+
+
 class FastNnetCombiner {
  public:
   FastNnetCombiner(const NnetCombineFastConfig &combine_config,
@@ -107,6 +180,7 @@ class FastNnetCombiner {
       config_(combine_config), egs_(validation_set),
       nnets_(nnets_in), nnet_out_(nnet_out) {
 
+    CacheActivations();
     GetInitialParams();
     ComputePreconditioner();
 
@@ -162,6 +236,16 @@ class FastNnetCombiner {
   
   void ComputePreconditioner();
 
+  // Sets up num_cached_components_, minibatches_ and activations_.
+  void CacheActivations();
+
+  // Returns the total objective function of "nnet" on the validation
+  // examples, computed from the cached activations, and outputs their total
+  // weight.  If nnet_gradient != NULL, adds the gradient to it.
+  double ComputeCachedObjf(const Nnet &nnet,
+                           Nnet *nnet_gradient,
+                           double *tot_weight) const;
+
   // Computes and returns objective function per frame, including
   // regularizer term if applicable.  Also puts just the regularizer
   // term in *regularizer_objf.
@@ -193,9 +277,79 @@ class FastNnetCombiner {
   const std::vector<NnetExample> &egs_;
   const std::vector<Nnet> &nnets_;
   Nnet *nnet_out_;
+
+  // The leading components that are not updatable and are the same in all
+  // the nnets (e.g. splicing and a fixed LDA transform) have the same output
+  // for all the nets we evaluate, so we compute it just once: for each
+  // minibatch of egs_ (of size config_.minibatch_size), minibatches_ holds
+  // the examples without their input (we only need the labels), and
+  // activations_ holds the input of component num_cached_components_.  This
+  // also saves decompressing and formatting the input on each iteration,
+  // and, with a GPU, copying it to the GPU.
+  int32 num_cached_components_;
+  std::vector<std::vector<NnetExample> > minibatches_;
+  std::vector<CuMatrix<BaseFloat> > activations_;
 };
 
 
+void FastNnetCombiner::CacheActivations() {
+  KALDI_ASSERT(!nnets_.empty() && !egs_.empty() && config_.minibatch_size > 0);
+  // Work out how many of the leading components we can cache the output of.
+  const Nnet &nnet = nnets_[0];
+  int32 num_components = nnet.FirstUpdatableComponent();
+  for (int32 c = 0; c < num_components; c++) {
+    std::ostringstream os;
+    nnet.GetComponent(c).Write(os, true);
+    bool same = true;
+    for (size_t n = 1; n < nnets_.size() && same; n++) {
+      std::ostringstream os_n;
+      nnets_[n].GetComponent(c).Write(os_n, true);
+      same = (os_n.str() == os.str());
+    }
+    if (!same) {
+      num_components = c;
+      break;
+    }
+  }
+  num_cached_components_ = num_components;
+
+  int32 num_egs = egs_.size(),
+      num_minibatches = (num_egs + config_.minibatch_size - 1) /
+      config_.minibatch_size;
+  minibatches_.resize(num_minibatches);
+  activations_.resize(num_minibatches);
+  for (int32 b = 0; b < num_minibatches; b++) {
+    int32 offset = b * config_.minibatch_size,
+        length = std::min(config_.minibatch_size, num_egs - offset);
+    std::vector<NnetExample> &minibatch = minibatches_[b];
+    minibatch.assign(egs_.begin() + offset, egs_.begin() + offset + length);
+    ComputeNnetActivations(nnet, minibatch, num_components,
+                           &(activations_[b]));
+    for (int32 i = 0; i < length; i++)
+      minibatch[i].input_frames.Clear();
+  }
+  KALDI_VLOG(1) << "Cached the input of component " << num_components
+                << " for " << num_minibatches << " minibatches.";
+}
+
+double FastNnetCombiner::ComputeCachedObjf(const Nnet &nnet,
+                                           Nnet *nnet_gradient,
+                                           double *tot_weight) const {
+  double tot_objf = 0.0;
+  *tot_weight = 0.0;
+  CachedObjfComputationClass cc(nnet, num_cached_components_, minibatches_,
+                                activations_, nnet_gradient, &tot_objf,
+                                tot_weight);
+  // As in ComputePreconditioner(), num_threads == 0 means we run in this
+  // thread, which is required when using a GPU.
+  int32 num_threads = config_.num_threads == 1 ? 0 : config_.num_threads;
+  {
+    MultiThreader<CachedObjfComputationClass> m(num_threads, cc);
+  }
+  return tot_objf;
+}
+
+
 // static
 void FastNnetCombiner::CombineNnets(const Vector<double> &scale_params,
                                     const std::vector<Nnet> &nnets,
@@ -305,8 +459,8 @@ double FastNnetCombiner::ComputeObjfAndGradient(
   bool is_gradient = true;
   nnet_gradient.SetZero(is_gradient);
   double tot_weight = 0.0;
-  double objf = DoBackpropParallel(nnet, config_.minibatch_size, config_.num_threads,
-                                   egs_, &tot_weight, &nnet_gradient) / egs_.size();
+  double objf = ComputeCachedObjf(nnet, &nnet_gradient, &tot_weight) /
+      egs_.size();
   
   // raw_gradient is gradient in non-preconditioned space.
   Vector<double> raw_gradient(params_.Dim());
@@ -387,9 +541,7 @@ int32 FastNnetCombiner::GetInitialModel(
   Vector<double> objfs(nnets.size());
   for (int32 n = 0; n < num_nnets; n++) {
     double num_frames;
-    double objf = ComputeNnetObjfParallel(nnets[n], config_.minibatch_size,
-                                          config_.num_threads, validation_set,
-                                          &num_frames);
+    double objf = ComputeCachedObjf(nnets[n], NULL, &num_frames);
     KALDI_ASSERT(num_frames != 0);
     objf /= num_frames;
     
@@ -411,9 +563,7 @@ int32 FastNnetCombiner::GetInitialModel(
     Nnet average_nnet;
     CombineNnets(scale_params, nnets, &average_nnet);
     double num_frames;
-    double objf = ComputeNnetObjfParallel(average_nnet, config_.minibatch_size,
-                                          config_.num_threads, validation_set,
-                                          &num_frames);
+    double objf = ComputeCachedObjf(average_nnet, NULL, &num_frames);
     objf /= num_frames;
     KALDI_LOG << "Objf with all neural nets averaged is " << objf;
     if (objf > best_objf) {
@@ -79,6 +79,12 @@ class DecodableAmNnet: public DecodableInterface {
                       trans_model_.TransitionIdToPdf(transition_id));
   }
 
+  virtual const BaseFloat *GetFrameScores(int32 frame,
+                                          const int32 **index_to_row) {
+    *index_to_row = &(trans_model_.TransitionIdToPdfArray()[0]);
+    return log_probs_.RowData(frame);
+  }
+
   virtual int32 NumFramesReady() const { return log_probs_.NumRows(); }
   
   // Indices are one-based!  This is for compatibility with OpenFst.
@@ -20,6 +20,7 @@
 #include "nnet2/nnet-compute-discriminative.h"
 #include "hmm/posterior.h"
 #include "lat/lattice-functions.h"
+#include "thread/kaldi-future.h"
 
 namespace kaldi {
 namespace nnet2 {
@@ -50,8 +51,31 @@ class NnetDiscriminativeUpdater {
   void Propagate();  
 
   /// Does the parts between Propagate() and Backprop(), that
-  /// involve forward-backward over the lattice.
-  void LatticeComputations();
+  /// involve forward-backward over the lattice.  It is the same as calling
+  /// PrepareLattice(), LookupLikelihoods(), ComputePosteriors() and
+  /// ComputeOutputDeriv() in that order; of those, PrepareLattice() and
+  /// ComputePosteriors() only use the CPU, so in
+  /// NnetDiscriminativeUpdatePipelined() they run on other threads.
+  void LatticeComputations() {
+    PrepareLattice();
+    LookupLikelihoods();
+    ComputePosteriors();
+    ComputeOutputDeriv();
+  }
+
+  /// Converts and sorts the lattice, and works out which elements of the nnet
+  /// output we need.  May be called before Propagate().
+  void PrepareLattice();
+
+  /// Looks up the elements of the nnet output that we need.
+  void LookupLikelihoods();
+
+  /// Puts the scaled log-likelihoods in the lattice and does the lattice
+  /// forward-backward, to get the objective function and the posteriors.
+  void ComputePosteriors();
+
+  /// Sets backward_data_ to the derivative at the nnet output.
+  void ComputeOutputDeriv();
   
   void Backprop();
 
@@ -92,6 +116,14 @@ class NnetDiscriminativeUpdater {
   // the output of the i-1'th component.
   std::vector<CuMatrix<BaseFloat> > forward_data_; 
   Lattice lat_; // we convert the CompactLattice in the eg, into Lattice form.
+  std::vector<int32> state_times_;
+  // The (frame, pdf-id) of the elements of the nnet output we need (the
+  // numerator alignment, for MMI, and then the arcs of lat_), and their
+  // values, which get replaced by the scaled pseudo-log-likelihoods.
+  std::vector<Int32Pair> requested_indexes_;
+  std::vector<BaseFloat> answers_;
+  // The discriminative posteriors, as elements of the derivative.
+  std::vector<MatrixElement<BaseFloat> > sv_labels_;
   CuMatrix<BaseFloat> backward_data_;
   std::vector<int32> silence_phones_; // derived from opts_.silence_phones_str
 };
@@ -175,7 +207,7 @@ void NnetDiscriminativeUpdater::Propagate() {
 
 
 
-void NnetDiscriminativeUpdater::LatticeComputations() {
+void NnetDiscriminativeUpdater::PrepareLattice() {
   ConvertLattice(eg_.den_lat, &lat_); // convert to Lattice.
   TopSort(&lat_); // Topologically sort (required by forward-backward algorithms)
 
@@ -186,19 +218,10 @@ void NnetDiscriminativeUpdater::LatticeComputations() {
   }
   
   int32 num_frames = static_cast<int32>(eg_.num_ali.size());
-
-  stats_->tot_t += num_frames;
-  stats_->tot_t_weighted += num_frames * eg_.weight;
+  int32 num_pdfs = am_nnet_.Priors().Dim();
   
-  const VectorBase<BaseFloat> &priors = am_nnet_.Priors();
-  const CuMatrix<BaseFloat> &posteriors = forward_data_.back();
-
-  KALDI_ASSERT(posteriors.NumRows() == num_frames);
-  int32 num_pdfs = posteriors.NumCols();
-  KALDI_ASSERT(num_pdfs == priors.Dim());
-  
-  // We need to look up the posteriors of some pdf-ids in the matrix
-  // "posteriors".  Rather than looking them all up using operator (), which is
+  // We need to look up the posteriors of some pdf-ids in the nnet output.
+  // Rather than looking them all up using operator (), which is
   // very slow because each lookup involves a separate CUDA call with
   // communication over PciExpress, we look them up all at once using
   // CuMatrix::Lookup().
@@ -206,7 +229,7 @@ void NnetDiscriminativeUpdater::LatticeComputations() {
   // the numerator alignment.  Even though they may be irrelevant to
   // the optimization, they will affect the value of the objective function.
   
-  std::vector<Int32Pair> requested_indexes;
+  std::vector<Int32Pair> &requested_indexes = requested_indexes_;
   BaseFloat wiggle_room = 1.3; // value not critical.. it's just 'reserve'
   requested_indexes.reserve(num_frames + wiggle_room * lat_.NumStates());
 
@@ -218,13 +241,12 @@ void NnetDiscriminativeUpdater::LatticeComputations() {
     }
   }
 
-  std::vector<int32> state_times;
-  int32 T = LatticeStateTimes(lat_, &state_times);
+  int32 T = LatticeStateTimes(lat_, &state_times_);
   KALDI_ASSERT(T == num_frames);
   
   StateId num_states = lat_.NumStates();
   for (StateId s = 0; s < num_states; s++) {
-    StateId t = state_times[s];
+    StateId t = state_times_[s];
     for (fst::ArcIterator<Lattice> aiter(lat_, s); !aiter.Done(); aiter.Next()) {
       const Arc &arc = aiter.Value();
       if (arc.ilabel != 0) { // input-side has transition-ids, output-side empty
@@ -233,11 +255,29 @@ void NnetDiscriminativeUpdater::LatticeComputations() {
       }
     }
   }
+}
+
 
-  std::vector<BaseFloat> answers;
-  CuArray<Int32Pair> cu_requested_indexes(requested_indexes);
-  answers.resize(requested_indexes.size());
-  posteriors.Lookup(cu_requested_indexes, &(answers[0]));
+void NnetDiscriminativeUpdater::LookupLikelihoods() {
+  const CuMatrix<BaseFloat> &posteriors = forward_data_.back();
+  KALDI_ASSERT(posteriors.NumRows() == static_cast<int32>(eg_.num_ali.size()));
+  KALDI_ASSERT(posteriors.NumCols() == am_nnet_.Priors().Dim());
+
+  CuArray<Int32Pair> cu_requested_indexes(requested_indexes_);
+  answers_.resize(requested_indexes_.size());
+  posteriors.Lookup(cu_requested_indexes, &(answers_[0]));
+}
+
+
+void NnetDiscriminativeUpdater::ComputePosteriors() {
+  int32 num_frames = static_cast<int32>(eg_.num_ali.size());
+
+  stats_->tot_t += num_frames;
+  stats_->tot_t_weighted += num_frames * eg_.weight;
+  
+  const VectorBase<BaseFloat> &priors = am_nnet_.Priors();
+  const std::vector<Int32Pair> &requested_indexes = requested_indexes_;
+  std::vector<BaseFloat> &answers = answers_;
 
   int32 num_floored = 0;
 
@@ -271,6 +311,7 @@ void NnetDiscriminativeUpdater::LatticeComputations() {
   }
 
   // Now put the (scaled) acoustic log-likelihoods in the lattice.
+  StateId num_states = lat_.NumStates();
   for (StateId s = 0; s < num_states; s++) {
     for (fst::MutableArcIterator<Lattice> aiter(&lat_, s);
          !aiter.Done(); aiter.Next()) {
@@ -296,7 +337,7 @@ void NnetDiscriminativeUpdater::LatticeComputations() {
   ScalePosterior(eg_.weight, &post);
 
   double tot_num_post = 0.0, tot_den_post = 0.0;
-  std::vector<MatrixElement<BaseFloat> > sv_labels;
+  std::vector<MatrixElement<BaseFloat> > &sv_labels = sv_labels_;
   sv_labels.reserve(answers.size());
   for (int32 t = 0; t < post.size(); t++) {
     for (int32 i = 0; i < post[t].size(); i++) {
@@ -309,6 +350,10 @@ void NnetDiscriminativeUpdater::LatticeComputations() {
     }
   }
   stats_->tot_num_count += tot_num_post;
+}
+
+
+void NnetDiscriminativeUpdater::ComputeOutputDeriv() {
   int32 num_components = am_nnet_.GetNnet().NumComponents();
   const CuMatrix<BaseFloat> &output(forward_data_[num_components]);
   backward_data_.Resize(output.NumRows(), output.NumCols()); // zeroes it.
@@ -316,7 +361,7 @@ void NnetDiscriminativeUpdater::LatticeComputations() {
   { // We don't actually need tot_objf and tot_weight; we have already
     // computed the objective function.
     BaseFloat tot_objf, tot_weight;
-    backward_data_.CompObjfAndDeriv(sv_labels, output, &tot_objf, &tot_weight);
+    backward_data_.CompObjfAndDeriv(sv_labels_, output, &tot_objf, &tot_weight);
     // Now backward_data_ will contan the derivative at the output.
     // Our work here is done..
   }
@@ -373,6 +418,112 @@ void NnetDiscriminativeUpdate(const AmNnet &am_nnet,
   updater.Update();
 }
 
+// An example in NnetDiscriminativeUpdatePipelined(), with its updater and
+// stats: the updater refers to both, and the stats are added to the total
+// once the example is done, as two lattices may be in progress at a time.
+struct PipelinedDiscriminativeExample {
+  DiscriminativeNnetExample eg;
+  NnetDiscriminativeStats stats;
+  NnetDiscriminativeUpdater *updater;
+  PipelinedDiscriminativeExample(): updater(NULL) { }
+  ~PipelinedDiscriminativeExample() { delete updater; }
+};
+
+// Reads the next example and prepares its lattice, or returns NULL if
+// there are no more examples; this runs on the ThreadPool.
+class PipelinedExampleReader {
+ public:
+  typedef PipelinedDiscriminativeExample* result_type;
+
+  PipelinedExampleReader(const AmNnet &am_nnet,
+                         const TransitionModel &tmodel,
+                         const NnetDiscriminativeUpdateOptions &opts,
+                         SequentialDiscriminativeNnetExampleReader *example_reader,
+                         Nnet *nnet_to_update):
+      am_nnet_(am_nnet), tmodel_(tmodel), opts_(opts),
+      example_reader_(example_reader), nnet_to_update_(nnet_to_update) { }
+
+  PipelinedDiscriminativeExample *operator () () const {
+    if (example_reader_->Done())
+      return NULL;
+    PipelinedDiscriminativeExample *example =
+        new PipelinedDiscriminativeExample();
+    example->eg = example_reader_->Value();
+    example_reader_->Next();
+    example->updater = new NnetDiscriminativeUpdater(
+        am_nnet_, tmodel_, opts_, example->eg, nnet_to_update_,
+        &(example->stats));
+    example->updater->PrepareLattice();
+    return example;
+  }
+
+ private:
+  const AmNnet &am_nnet_;
+  const TransitionModel &tmodel_;
+  const NnetDiscriminativeUpdateOptions &opts_;
+  SequentialDiscriminativeNnetExampleReader *example_reader_;
+  Nnet *nnet_to_update_;
+};
+
+// Does the lattice forward-backward for an example; this runs on the
+// ThreadPool.
+class PipelinedPosteriorsTask {
+ public:
+  typedef PipelinedDiscriminativeExample* result_type;
+
+  explicit PipelinedPosteriorsTask(PipelinedDiscriminativeExample *example):
+      example_(example) { }
+
+  PipelinedDiscriminativeExample *operator () () const {
+    example_->updater->ComputePosteriors();
+    return example_;
+  }
+
+ private:
+  PipelinedDiscriminativeExample *example_;
+};
+
+
+int64 NnetDiscriminativeUpdatePipelined(
+    const AmNnet &am_nnet,
+    const TransitionModel &tmodel,
+    const NnetDiscriminativeUpdateOptions &opts,
+    SequentialDiscriminativeNnetExampleReader *example_reader,
+    Nnet *nnet_to_update,
+    NnetDiscriminativeStats *stats) {
+  PipelinedExampleReader reader(am_nnet, tmodel, opts, example_reader,
+                                nnet_to_update);
+  // "next_example" is being read and "prev_example" is the example whose
+  // lattice is being processed, which we finish once the nnet has been
+  // propagated on the one after it.
+  Future<PipelinedDiscriminativeExample*> next_example = Async(reader),
+      prev_example;
+  int64 num_examples = 0;
+  while (true) {
+    PipelinedDiscriminativeExample *example = next_example.Get();
+    Future<PipelinedDiscriminativeExample*> this_example;
+    if (example != NULL) {
+      next_example = Async(reader);
+      example->updater->Propagate();
+      example->updater->LookupLikelihoods();
+      this_example = Async(PipelinedPosteriorsTask(example));
+    }
+    if (prev_example.Valid()) {
+      PipelinedDiscriminativeExample *prev = prev_example.Get();
+      prev->updater->ComputeOutputDeriv();
+      if (nnet_to_update != NULL)
+        prev->updater->Backprop();
+      stats->Add(prev->stats);
+      delete prev;
+      num_examples++;
+    }
+    if (example == NULL)
+      break;
+    prev_example = this_example;
+  }
+  return num_examples;
+}
+
 void NnetDiscriminativeStats::Add(const NnetDiscriminativeStats &other) {
   tot_t += other.tot_t;
   tot_t_weighted += other.tot_t_weighted;
@@ -108,6 +108,23 @@ void NnetDiscriminativeUpdate(const AmNnet &am_nnet,
                               Nnet *nnet_to_update,
                               NnetDiscriminativeStats *stats);
 
+/** This does the same as calling NnetDiscriminativeUpdate() for each of the
+    examples read from "example_reader", but overlaps the CPU and the GPU
+    work: the next example is read and its lattice prepared on another
+    thread, and the lattice forward-backward for each example runs on the
+    ThreadPool while the nnet is propagated on the next example and then
+    backpropagated on this one.  In the SGD case (nnet_to_update ==
+    &(am_nnet.GetNnet())) the nnet output for each example is therefore
+    computed before the update on the previous one.  The nnet outputs of two
+    examples are in memory at a time.  Returns the number of examples. */
+int64 NnetDiscriminativeUpdatePipelined(
+    const AmNnet &am_nnet,
+    const TransitionModel &tmodel,
+    const NnetDiscriminativeUpdateOptions &opts,
+    SequentialDiscriminativeNnetExampleReader *example_reader,
+    Nnet *nnet_to_update,
+    NnetDiscriminativeStats *stats);
+
 
 } // namespace nnet2
 } // namespace kaldi
@@ -61,7 +61,7 @@ void NnetOnlineComputer::Compute(const CuMatrixBase<BaseFloat> &input,
     is_first_chunk_ = false;
     // assert that all the component-wise input buffers are empty
     for (int32 i = 0; i < reusable_component_inputs_.size(); i++)
-      KALDI_ASSERT(reusable_component_inputs_[0].NumRows() == 0);
+      KALDI_ASSERT(reusable_component_inputs_[i].NumRows() == 0);
     // Pad at the start of the file if necessary.
     if ((pad_input_) && (nnet_.LeftContext() > 0))  {
         input_data.Resize(nnet_.LeftContext() + input.NumRows(), dim);
@@ -103,7 +103,8 @@ void NnetOnlineComputer::Compute(const CuMatrixBase<BaseFloat> &input,
     // store the last frame as it might be needed for padding
     last_seen_input_frame_ = input_data.Row(input_data.NumRows() - 1);
     Propagate();
-    *output = data_.back();
+    // The output is not needed for the next call, so we don't copy it.
+    output->Swap(&(data_.back()));
   } else {
     // store the input in the unprocessed_buffer_
     unprocessed_buffer_ = input_data;
@@ -113,31 +114,51 @@ void NnetOnlineComputer::Compute(const CuMatrixBase<BaseFloat> &input,
 }
 
 void NnetOnlineComputer::Flush(CuMatrix<BaseFloat> *output) {
-  KALDI_ASSERT(!finished_ && !is_first_chunk_);
+  KALDI_ASSERT(!finished_);
+  finished_ = true;
+  if (is_first_chunk_) {  // no input was ever provided.
+    output->Resize(0, 0);
+    return;
+  }
   int32 num_frames_padding = (pad_input_ ? nnet_.RightContext() : 0);
-  int32 num_stored_frames = nnet_.LeftContext() + nnet_.RightContext();
-  int32 num_effective_input_rows =  num_stored_frames + num_frames_padding;
+  // If we have done a forward pass, the component input buffers store the
+  // equivalent of (nnet_.LeftContext() + nnet_.RightContext()) input frames;
+  // otherwise, all the input so far is still in unprocessed_buffer_.
+  int32 num_stored_frames = 0;
+  for (int32 i = 0; i < reusable_component_inputs_.size(); i++) {
+    if (reusable_component_inputs_[i].NumRows() > 0) {
+      num_stored_frames = nnet_.LeftContext() + nnet_.RightContext();
+      break;
+    }
+  }
+  int32 num_unprocessed = unprocessed_buffer_.NumRows(),
+      num_effective_input_rows = num_stored_frames + num_unprocessed +
+      num_frames_padding;
   // If the amount of output would be empty return at this point.
   if (num_effective_input_rows < nnet_.LeftContext() + nnet_.RightContext() + 1) {
     output->Resize(0, 0);
-    finished_ = true;
     return;
   }
 
   int32 dim = nnet_.InputDim();
   CuMatrix<BaseFloat> &input_data(data_[0]);
   KALDI_ASSERT(num_frames_padding > 0);  // else we would have returned above.
-  input_data.Resize(num_frames_padding, dim);
-  input_data.CopyRowsFromVec(last_seen_input_frame_);
-
-  // Note, we later modify this chunk-info, it isn't quite correct right now
-  // because we add extra data at intermediate layers, and the actual number of
-  // input rows doesn't equal num_effective_input_rows.
+  if (num_unprocessed > 0)
+    last_seen_input_frame_ = unprocessed_buffer_.Row(num_unprocessed - 1);
+  input_data.Resize(num_unprocessed + num_frames_padding, dim, kUndefined);
+  if (num_unprocessed > 0)
+    input_data.RowRange(0, num_unprocessed).CopyFromMat(unprocessed_buffer_);
+  input_data.RowRange(num_unprocessed, num_frames_padding).CopyRowsFromVec(
+      last_seen_input_frame_);
+  unprocessed_buffer_.Resize(0, 0);
+
+  // Note, the chunk-info is modified in Propagate(), because we add extra data
+  // at intermediate layers, and the actual number of input rows doesn't equal
+  // num_effective_input_rows.
   nnet_.ComputeChunkInfo(num_effective_input_rows, 1,
                          &chunk_info_);
   Propagate();
-  *output = data_.back();
-  finished_ = true;
+  output->Swap(&(data_.back()));
 }
 
 void NnetOnlineComputer::Propagate() {
@@ -165,7 +186,7 @@ void NnetOnlineComputer::Propagate() {
         input_data_temp.Range(reusable_component_inputs_[c].NumRows(),
                               input_data.NumRows(), 0, dim).CopyFromMat(
                                   input_data);
-        input_data = input_data_temp;
+        input_data.Swap(&input_data_temp);
       }
       // store any frames which can be reused in the next call
       reusable_component_inputs_[c].Resize(component.Context().back() -
@@ -34,8 +34,12 @@ namespace nnet2 {
    (note: this sharing is more of an issue in multi-splice networks where there is
    splicing over time in the middle layers of the network).
    Note: this doesn't do the final taking-the-log and correcting for the prior.
-   The current implementation is just an inefficient placeholder implementation;
-   later we'll modify it to properly use previously computed activations.
+
+   At the input of each component that splices over time, we keep the last
+   (context span) rows of its input from the previous call, and prepend them
+   to the new rows; so each call only computes the new output frames at every
+   layer, and the cost per frame does not depend on the chunk size, which may
+   be as small as one frame.
 */
 
 class NnetOnlineComputer {
@@ -34,7 +34,8 @@ void UnitTestNnetCompute() {
   KALDI_LOG << "Left context = " << nnet->LeftContext() << ", right context = "
             << nnet->RightContext() << ", pad-input = " << pad_input;
   KALDI_LOG << "NNet info is " << nnet->Info();
-  int32 num_feats = 5 + rand() % 1000;
+  // Sometimes use very short inputs, which may be all flushed out at the end.
+  int32 num_feats = (rand() % 3 == 0 ? 1 + rand() % 10 : 5 + rand() % 1000);
   CuMatrix<BaseFloat> input(num_feats, input_dim);
   input.SetRandn();
 
@@ -116,6 +117,41 @@ void UnitTestNnetComputeChunked() {
   delete nnet;
 }
 
+void UnitTestNnetComputeBatched() {
+  int32 input_dim = 10 + rand() % 40, output_dim = 100 + rand() % 500;
+  bool pad_input = true;
+
+  Nnet *nnet = GenRandomNnet(input_dim, output_dim);
+  int32 num_utts = 1 + rand() % 5, chunk_size = 1 + rand() % 50;
+  std::vector<int32> num_frames(num_utts);
+  int32 tot_frames = 0;
+  for (int32 i = 0; i < num_utts; i++) {
+    // Sometimes use utterances shorter than the chunk size or the context.
+    num_frames[i] = (rand() % 3 == 0 ? 1 + rand() % 10 : 5 + rand() % 200);
+    tot_frames += num_frames[i];
+  }
+  CuMatrix<BaseFloat> input(tot_frames, input_dim);
+  input.SetRandn();
+
+  KALDI_LOG << "Left context = " << nnet->LeftContext()
+            << ", right context = " << nnet->RightContext()
+            << ", chunk size = " << chunk_size
+            << ", number of utterances = " << num_utts;
+
+  CuMatrix<BaseFloat> output1(tot_frames, output_dim),
+      output2(tot_frames, output_dim);
+  for (int32 i = 0, offset = 0; i < num_utts; i++) {
+    CuSubMatrix<BaseFloat> utt_output(output1.RowRange(offset, num_frames[i]));
+    NnetComputation(*nnet, input.RowRange(offset, num_frames[i]), pad_input,
+                    &utt_output);
+    offset += num_frames[i];
+  }
+  NnetComputationBatched(*nnet, input, num_frames, chunk_size, &output2);
+  AssertEqual(output1, output2);
+  KALDI_LOG << "OK";
+  delete nnet;
+}
+
 }  // namespace nnet2
 }  // namespace kaldi
 
@@ -129,6 +165,8 @@ int main() {
   for (int32 i = 0; i < 10; i++) 
     UnitTestNnetCompute();
     UnitTestNnetComputeChunked();
+  for (int32 i = 0; i < 10; i++)
+    UnitTestNnetComputeBatched();
   return 0;
 }
   
@@ -38,6 +38,14 @@ class NnetComputer {
                const CuMatrixBase<BaseFloat> &input_feats,
                bool pad, 
                Nnet *nnet_to_update = NULL);
+
+  /* Initializer for input consisting of "num_chunks" chunks of the same size,
+     one after the other, each of them including the frames of context
+     (there is no padding); this does no backprop.  The input is swapped into
+     this object, so "input_chunks" is left empty. */
+  NnetComputer(const Nnet &nnet,
+               CuMatrix<BaseFloat> *input_chunks,
+               int32 num_chunks);
   
   /// The forward-through-the-layers part of the computation.
   void Propagate();
@@ -90,6 +98,22 @@ NnetComputer::NnetComputer(const Nnet &nnet,
     input.Row(num_rows - i - 1).CopyFromVec(input_feats.Row(last_row));
 }
 
+NnetComputer::NnetComputer(const Nnet &nnet,
+                           CuMatrix<BaseFloat> *input_chunks,
+                           int32 num_chunks):
+    nnet_(nnet), nnet_to_update_(NULL) {
+  int32 dim = input_chunks->NumCols();
+  if (dim != nnet.InputDim()) {
+    KALDI_ERR << "Feature dimension is " << dim << " but network expects "
+              << nnet.InputDim();
+  }
+  KALDI_ASSERT(num_chunks > 0 && input_chunks->NumRows() % num_chunks == 0);
+  forward_data_.resize(nnet.NumComponents() + 1);
+  nnet.ComputeChunkInfo(input_chunks->NumRows() / num_chunks, num_chunks,
+                        &chunk_info_);
+  forward_data_[0].Swap(input_chunks);
+}
+
 
 /// This is the forward part of the computation.
 void NnetComputer::Propagate() {
@@ -205,6 +229,59 @@ void NnetComputationChunked(const Nnet &nnet,
   }
 }
 
+void NnetComputationBatched(const Nnet &nnet,
+                            const CuMatrixBase<BaseFloat> &input,
+                            const std::vector<int32> &num_frames,
+                            int32 chunk_size,
+                            CuMatrixBase<BaseFloat> *output) {
+  KALDI_ASSERT(chunk_size > 0 && output->NumRows() == input.NumRows());
+  int32 num_utts = num_frames.size(),
+      left_context = nnet.LeftContext(),
+      right_context = nnet.RightContext(),
+      input_chunk_size = left_context + chunk_size + right_context;
+  // Utterance i has chunks first_chunk[i] ... first_chunk[i+1] - 1.
+  std::vector<int32> first_chunk(num_utts + 1, 0);
+  int32 tot_frames = 0;
+  for (int32 i = 0; i < num_utts; i++) {
+    KALDI_ASSERT(num_frames[i] > 0);
+    first_chunk[i + 1] = first_chunk[i] +
+        (num_frames[i] + chunk_size - 1) / chunk_size;
+    tot_frames += num_frames[i];
+  }
+  KALDI_ASSERT(tot_frames == input.NumRows());
+  int32 num_chunks = first_chunk[num_utts];
+  if (num_chunks == 0)
+    return;
+  // We gather the input of the chunks from the rows of "input" on the GPU;
+  // frames beyond the edges of an utterance are copies of its first or last
+  // frame, as for NnetComputation() with pad_input == true.  The chunks'
+  // output is in the same order, so we then pick the rows of each utterance
+  // (discarding the padding at the end of its last chunk).
+  std::vector<MatrixIndexT> input_indexes(num_chunks * input_chunk_size),
+      output_indexes(input.NumRows());
+  for (int32 i = 0, offset = 0; i < num_utts; i++) {
+    for (int32 c = first_chunk[i]; c < first_chunk[i + 1]; c++) {
+      int32 start = (c - first_chunk[i]) * chunk_size - left_context;
+      for (int32 j = 0; j < input_chunk_size; j++) {
+        int32 t = std::max(0, std::min(num_frames[i] - 1, start + j));
+        input_indexes[c * input_chunk_size + j] = offset + t;
+      }
+    }
+    for (int32 t = 0; t < num_frames[i]; t++)
+      output_indexes[offset + t] = first_chunk[i] * chunk_size + t;
+    offset += num_frames[i];
+  }
+  CuMatrix<BaseFloat> input_chunks(num_chunks * input_chunk_size,
+                                   input.NumCols(), kUndefined);
+  input_chunks.CopyRows(input, CuArray<MatrixIndexT>(input_indexes));
+
+  NnetComputer nnet_computer(nnet, &input_chunks, num_chunks);
+  nnet_computer.Propagate();
+  KALDI_ASSERT(nnet_computer.GetOutput().NumRows() == num_chunks * chunk_size);
+  output->CopyRows(nnet_computer.GetOutput(),
+                   CuArray<MatrixIndexT>(output_indexes));
+}
+
 BaseFloat NnetGradientComputation(const Nnet &nnet,
                                   const CuMatrixBase<BaseFloat> &input,
                                   bool pad_input,
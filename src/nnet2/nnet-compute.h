@@ -60,6 +60,24 @@ void NnetComputationChunked(const Nnet &nnet,
                      int32 chunk_size,
                      Matrix<BaseFloat> *output); // posteriors.
 
+/**
+  Does the same computation as NnetComputation() with pad_input == true, but
+  for several utterances at once, which makes much better use of a GPU when
+  the utterances are short.  "input" contains the features of the utterances
+  one after the other, num_frames[i] being the number of frames of utterance
+  i, and "output" will contain their outputs in the same way (so it must have
+  as many rows as "input").  Each utterance is cut into chunks of chunk_size
+  frames, each with nnet.LeftContext() and nnet.RightContext() frames of
+  context, and the chunks of all the utterances go through the network
+  together.  See the --batch-frames option of nnet-am-compute and
+  nnet-logprob.
+*/
+void NnetComputationBatched(const Nnet &nnet,
+                            const CuMatrixBase<BaseFloat> &input,
+                            const std::vector<int32> &num_frames,
+                            int32 chunk_size,
+                            CuMatrixBase<BaseFloat> *output);
+
 /** Does the neural net computation and backprop, given input and labels.
     Note: if pad_input==true the number of rows of input should be the
     same as the number of labels, and if false, you should omit
@@ -0,0 +1,110 @@
+// nnet2/nnet-example-packed-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet2/nnet-example-packed.h"
+#include "util/common-utils.h"
+
+namespace kaldi {
+namespace nnet2 {
+
+static void GenerateExample(NnetExample *eg) {
+  int32 num_frames = Rand() % 3,
+      left_context = Rand() % 4,
+      input_frames = left_context + num_frames + 1 + Rand() % 4,
+      dim = 1 + Rand() % 10;
+  eg->labels.resize(num_frames);
+  for (int32 t = 0; t < num_frames; t++) {
+    eg->labels[t].clear();
+    int32 num_labels = Rand() % 3;
+    for (int32 i = 0; i < num_labels; i++)
+      eg->labels[t].push_back(std::make_pair(Rand() % 100,
+                                             RandUniform()));
+  }
+  eg->left_context = left_context;
+  Matrix<BaseFloat> input(input_frames, dim);
+  input.SetRandn();
+  eg->input_frames = CompressedMatrix(input);
+  eg->spk_info.Resize(Rand() % 2 == 0 ? 0 : Rand() % 5);
+  eg->spk_info.SetRandn();
+}
+
+static void AssertEqual(const NnetExample &eg1, const NnetExample &eg2) {
+  KALDI_ASSERT(eg1.labels == eg2.labels);
+  KALDI_ASSERT(eg1.left_context == eg2.left_context);
+  KALDI_ASSERT(eg1.spk_info.ApproxEqual(eg2.spk_info, 0.0));
+  Matrix<BaseFloat> input1(eg1.input_frames), input2(eg2.input_frames);
+  KALDI_ASSERT(input1.ApproxEqual(input2, 0.0));
+}
+
+void UnitTestPackedNnetExample() {
+  std::string filename = "tmpf.pegs";
+  int32 num_egs = Rand() % 10;
+  std::vector<std::string> keys(num_egs);
+  std::vector<NnetExample> egs(num_egs);
+  {
+    PackedNnetExampleWriter writer(filename);
+    for (int32 i = 0; i < num_egs; i++) {
+      // keys of various lengths, to test the padding.
+      std::ostringstream os;
+      os << std::string(Rand() % 7, 'a') << '_' << i;
+      keys[i] = os.str();
+      GenerateExample(&(egs[i]));
+      writer.Write(keys[i], egs[i]);
+    }
+  }
+  // The first time the file is memory-mapped, the second time it is read
+  // through a pipe.
+  for (int32 j = 0; j < 2; j++) {
+    std::string rxfilename = (j == 0 ? filename : "cat " + filename + " |");
+    PackedNnetExampleReader reader(rxfilename);
+    KALDI_ASSERT(reader.NumExamples() == num_egs);
+    for (int32 i = num_egs - 1; i >= 0; i--) {
+      KALDI_ASSERT(reader.Key(i) == keys[i]);
+      NnetExample eg;
+      reader.GetExample(i, &eg);
+      AssertEqual(eg, egs[i]);
+    }
+  }
+  {
+    SequentialPackedNnetExampleReader reader(filename, true);
+    std::vector<bool> seen(num_egs, false);
+    for (; !reader.Done(); reader.Next()) {
+      std::string key = reader.Key();
+      int32 i;
+      KALDI_ASSERT(ConvertStringToInteger(key.substr(key.find('_') + 1), &i));
+      KALDI_ASSERT(!seen[i] && key == keys[i]);
+      seen[i] = true;
+      AssertEqual(reader.Value(), egs[i]);
+    }
+    KALDI_ASSERT(std::find(seen.begin(), seen.end(), false) == seen.end());
+  }
+  unlink(filename.c_str());
+}
+
+
+} // namespace nnet2
+} // namespace kaldi
+
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::nnet2;
+  using kaldi::int32;
+  for (int32 i = 0; i < 20; i++)
+    UnitTestPackedNnetExample();
+  KALDI_LOG << "Success.";
+}
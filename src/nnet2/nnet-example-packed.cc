@@ -0,0 +1,284 @@
+// nnet2/nnet-example-packed.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cstring>
+#include "nnet2/nnet-example-packed.h"
+
+namespace kaldi {
+namespace nnet2 {
+
+static const char kPackedEgsMagic[8] = { 'K', 'A', 'L', 'D', 'I', 'E', 'G', 'S' };
+static const int32 kPackedEgsVersion = 1;
+
+// The header of each example in a packed file; it is followed by the key
+// (key_length bytes, padded to a multiple of 4), the number of labels of each
+// frame (int32[num_frames]), the pdf-ids of the labels (int32[num_labels]),
+// their weights (float[num_labels]), the speaker information
+// (float[spk_dim]), and, at the next multiple of 8 bytes, input_bytes bytes
+// of compressed input.
+struct PackedNnetExampleHeader {
+  int32 key_length;
+  int32 left_context;
+  int32 num_frames;
+  int32 num_labels;
+  int32 spk_dim;
+  int32 input_bytes;
+};
+
+// Rounds up to a multiple of "n", which must be a power of two.
+static inline size_t RoundUp(size_t size, size_t n) {
+  return (size + n - 1) & ~(n - 1);
+}
+
+
+void PackedNnetExampleWriter::Open(const std::string &wxfilename) {
+  if (output_.IsOpen())
+    Close();
+  if (!output_.Open(wxfilename, true, false))
+    KALDI_ERR << "Failed to open packed examples file " << wxfilename;
+  pos_ = 0;
+  offsets_.clear();
+  WriteBytes(kPackedEgsMagic, sizeof(kPackedEgsMagic));
+  int32 version = kPackedEgsVersion, reserved = 0;
+  WriteBytes(&version, sizeof(version));
+  WriteBytes(&reserved, sizeof(reserved));
+}
+
+void PackedNnetExampleWriter::WriteBytes(const void *data, size_t num_bytes) {
+  output_.Stream().write(static_cast<const char*>(data), num_bytes);
+  pos_ += num_bytes;
+}
+
+void PackedNnetExampleWriter::Pad() {
+  static const char zeros[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  WriteBytes(zeros, RoundUp(pos_, 8) - pos_);
+}
+
+void PackedNnetExampleWriter::Write(const std::string &key,
+                                    const NnetExample &eg) {
+  KALDI_ASSERT(output_.IsOpen());
+  KALDI_ASSERT(pos_ % 8 == 0);
+  offsets_.push_back(pos_);
+  PackedNnetExampleHeader h;
+  h.key_length = key.size();
+  h.left_context = eg.left_context;
+  h.num_frames = eg.labels.size();
+  h.num_labels = 0;
+  for (size_t t = 0; t < eg.labels.size(); t++)
+    h.num_labels += eg.labels[t].size();
+  h.spk_dim = eg.spk_info.Dim();
+  h.input_bytes = eg.input_frames.DataSizeInBytes();
+  WriteBytes(&h, sizeof(h));
+  WriteBytes(key.data(), key.size());
+  WriteBytes("\0\0\0", RoundUp(key.size(), 4) - key.size());
+
+  std::vector<int32> counts(h.num_frames), pdfs;
+  std::vector<BaseFloat> weights;
+  pdfs.reserve(h.num_labels);
+  weights.reserve(h.num_labels);
+  for (int32 t = 0; t < h.num_frames; t++) {
+    counts[t] = eg.labels[t].size();
+    for (size_t i = 0; i < eg.labels[t].size(); i++) {
+      pdfs.push_back(eg.labels[t][i].first);
+      weights.push_back(eg.labels[t][i].second);
+    }
+  }
+  if (h.num_frames > 0)
+    WriteBytes(&(counts[0]), h.num_frames * sizeof(int32));
+  if (h.num_labels > 0) {
+    WriteBytes(&(pdfs[0]), h.num_labels * sizeof(int32));
+    WriteBytes(&(weights[0]), h.num_labels * sizeof(BaseFloat));
+  }
+  if (h.spk_dim > 0)
+    WriteBytes(eg.spk_info.Data(), h.spk_dim * sizeof(BaseFloat));
+  Pad();
+  if (h.input_bytes > 0)
+    WriteBytes(eg.input_frames.Data(), h.input_bytes);
+  Pad();
+  if (!output_.Stream().good())
+    KALDI_ERR << "Error writing packed examples.";
+}
+
+void PackedNnetExampleWriter::Close() {
+  if (!output_.IsOpen())
+    return;
+  int64 index_offset = pos_, num_examples = offsets_.size();
+  if (!offsets_.empty())
+    WriteBytes(&(offsets_[0]), offsets_.size() * sizeof(int64));
+  WriteBytes(&index_offset, sizeof(index_offset));
+  WriteBytes(&num_examples, sizeof(num_examples));
+  WriteBytes(kPackedEgsMagic, sizeof(kPackedEgsMagic));
+  offsets_.clear();
+  if (!output_.Close())
+    KALDI_ERR << "Error closing packed examples file.";
+}
+
+PackedNnetExampleWriter::~PackedNnetExampleWriter() {
+  try {
+    Close();
+  } catch (const std::exception &e) {
+    KALDI_WARN << "Error writing packed examples: " << e.what();
+  }
+}
+
+
+void PackedNnetExampleReader::Open(const std::string &rxfilename) {
+  Close();
+  if (ClassifyRxfilename(rxfilename) == kFileInput &&
+      mapped_file_.Open(rxfilename)) {
+    data_ = mapped_file_.Data();
+    size_ = mapped_file_.Size();
+  } else {
+    Input ki(rxfilename);
+    std::istream &is = ki.Stream();
+    char buf[65536];
+    while (is.read(buf, sizeof(buf)) || is.gcount() > 0)
+      buffer_.insert(buffer_.end(), buf, buf + is.gcount());
+    if (!is.eof())
+      KALDI_ERR << "Error reading packed examples from " << rxfilename;
+    // std::vector memory is suitably aligned for the int64's.
+    data_ = (buffer_.empty() ? NULL : &(buffer_[0]));
+    size_ = buffer_.size();
+  }
+  size_t header_size = sizeof(kPackedEgsMagic) + 2 * sizeof(int32),
+      trailer_size = 2 * sizeof(int64) + sizeof(kPackedEgsMagic);
+  if (data_ == NULL || size_ < header_size + trailer_size ||
+      memcmp(data_, kPackedEgsMagic, sizeof(kPackedEgsMagic)) != 0 ||
+      memcmp(data_ + size_ - sizeof(kPackedEgsMagic), kPackedEgsMagic,
+             sizeof(kPackedEgsMagic)) != 0) {
+    Close();
+    KALDI_ERR << rxfilename << " is not a packed examples file "
+              << "(see nnet-pack-egs), or it was not completely written.";
+  }
+  int32 version;
+  memcpy(&version, data_ + sizeof(kPackedEgsMagic), sizeof(version));
+  if (version != kPackedEgsVersion) {
+    Close();
+    KALDI_ERR << "Unsupported version " << version << " of packed examples "
+              << "file " << rxfilename;
+  }
+  int64 index_offset, num_examples;
+  const char *trailer = data_ + size_ - trailer_size;
+  memcpy(&index_offset, trailer, sizeof(index_offset));
+  memcpy(&num_examples, trailer + sizeof(index_offset), sizeof(num_examples));
+  if (index_offset % 8 != 0 || index_offset < static_cast<int64>(header_size) ||
+      num_examples < 0 || num_examples > std::numeric_limits<int32>::max() ||
+      index_offset + num_examples * static_cast<int64>(sizeof(int64)) !=
+      static_cast<int64>(size_ - trailer_size)) {
+    Close();
+    KALDI_ERR << "Bad index in packed examples file " << rxfilename;
+  }
+  num_examples_ = num_examples;
+  offsets_ = reinterpret_cast<const int64*>(data_ + index_offset);
+}
+
+void PackedNnetExampleReader::Close() {
+  mapped_file_.Close();
+  std::vector<char> empty;
+  buffer_.swap(empty);
+  data_ = NULL;
+  size_ = 0;
+  num_examples_ = 0;
+  offsets_ = NULL;
+}
+
+const char *PackedNnetExampleReader::ExampleData(int32 i) const {
+  KALDI_ASSERT(i >= 0 && i < num_examples_);
+  int64 offset = offsets_[i];
+  if (offset % 8 != 0 || offset < 0 ||
+      offset + static_cast<int64>(sizeof(PackedNnetExampleHeader)) >
+      reinterpret_cast<const char*>(offsets_) - data_)
+    KALDI_ERR << "Bad offset of example " << i << " in packed examples file.";
+  return data_ + offset;
+}
+
+std::string PackedNnetExampleReader::Key(int32 i) const {
+  const char *data = ExampleData(i);
+  const PackedNnetExampleHeader &h =
+      *reinterpret_cast<const PackedNnetExampleHeader*>(data);
+  return std::string(data + sizeof(h), h.key_length);
+}
+
+void PackedNnetExampleReader::GetExample(int32 i, NnetExample *eg) const {
+  const char *data = ExampleData(i);
+  const PackedNnetExampleHeader &h =
+      *reinterpret_cast<const PackedNnetExampleHeader*>(data);
+  if (h.key_length < 0 || h.num_frames < 0 || h.num_labels < 0 ||
+      h.spk_dim < 0 || h.input_bytes < 0)
+    KALDI_ERR << "Bad header of example " << i << " in packed examples file.";
+  size_t pos = sizeof(h) + RoundUp(h.key_length, 4),
+      input_pos = RoundUp(pos + (h.num_frames + h.num_labels) * sizeof(int32) +
+                          (h.num_labels + h.spk_dim) * sizeof(BaseFloat), 8);
+  if (static_cast<int64>(data - data_ + input_pos + h.input_bytes) >
+      reinterpret_cast<const char*>(offsets_) - data_)
+    KALDI_ERR << "Example " << i << " runs past the end of the packed "
+              << "examples file.";
+  const int32 *counts = reinterpret_cast<const int32*>(data + pos),
+      *pdfs = counts + h.num_frames;
+  const BaseFloat *weights = reinterpret_cast<const BaseFloat*>(
+      pdfs + h.num_labels),
+      *spk_info = weights + h.num_labels;
+
+  eg->labels.resize(h.num_frames);
+  int32 k = 0;
+  for (int32 t = 0; t < h.num_frames; t++) {
+    int32 count = counts[t];
+    if (count < 0 || k + count > h.num_labels)
+      KALDI_ERR << "Bad labels of example " << i << " in packed examples file.";
+    std::vector<std::pair<int32, BaseFloat> > &labels = eg->labels[t];
+    labels.resize(count);
+    for (int32 j = 0; j < count; j++, k++)
+      labels[j] = std::make_pair(pdfs[k], weights[k]);
+  }
+  if (k != h.num_labels)
+    KALDI_ERR << "Bad labels of example " << i << " in packed examples file.";
+  eg->left_context = h.left_context;
+  eg->spk_info.Resize(h.spk_dim, kUndefined);
+  if (h.spk_dim > 0)
+    memcpy(eg->spk_info.Data(), spk_info, h.spk_dim * sizeof(BaseFloat));
+  eg->input_frames.CopyFromData(data + input_pos, h.input_bytes);
+}
+
+
+SequentialPackedNnetExampleReader::SequentialPackedNnetExampleReader(
+    const std::string &rxfilename, bool shuffle):
+    reader_(rxfilename), index_(0) {
+  order_.resize(reader_.NumExamples());
+  for (size_t i = 0; i < order_.size(); i++)
+    order_[i] = i;
+  if (shuffle)
+    std::random_shuffle(order_.begin(), order_.end());
+  if (!Done())
+    reader_.GetExample(order_[index_], &eg_);
+}
+
+void SequentialPackedNnetExampleReader::Next() {
+  KALDI_ASSERT(!Done());
+  index_++;
+  if (!Done())
+    reader_.GetExample(order_[index_], &eg_);
+}
+
+std::string SequentialPackedNnetExampleReader::Key() const {
+  KALDI_ASSERT(!Done());
+  return reader_.Key(order_[index_]);
+}
+
+
+} // namespace nnet2
+} // namespace kaldi
@@ -0,0 +1,160 @@
+// nnet2/nnet-example-packed.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET2_NNET_EXAMPLE_PACKED_H_
+#define KALDI_NNET2_NNET_EXAMPLE_PACKED_H_
+
+#include <string>
+#include <vector>
+#include "nnet2/nnet-example.h"
+#include "util/kaldi-io.h"
+#include "util/mapped-file.h"
+
+namespace kaldi {
+namespace nnet2 {
+
+/*
+   This file defines a "packed" file format for NnetExamples, which is an
+   alternative to archives for training.  Reading an example from an archive
+   means parsing it through the generic Holder, and shuffling archives means
+   rewriting them (nnet-shuffle-egs); a packed file has the examples in a
+   fixed binary layout with an index at the end, so it can be memory-mapped
+   and the examples read in any order, directly from the mapped pages.
+
+   The layout is: an 8-byte magic string and two int32's (the version and a
+   reserved field); then the examples, each one starting at a multiple of 8
+   bytes; then the index, which is the int64 offset of each example; and
+   finally a trailer with the int64 offset of the index, the int64 number of
+   examples and the magic string again.  The trailer is at the end so that the
+   file can be written to a pipe.  Each example consists of a header (see
+   PackedNnetExampleHeader in the .cc file), the key, the number of labels of
+   each frame, the pdf-ids and then the weights of the labels, the speaker
+   information and the data of the compressed input (see
+   CompressedMatrix::Data()).  Numbers are in the byte order of the machine,
+   as for binary Kaldi objects.
+
+   Use nnet-pack-egs to make such files, and the --packed-egs option of
+   nnet-train-simple and nnet-train-parallel to train from them.
+*/
+
+
+/// Writes examples to a packed file (see above).
+class PackedNnetExampleWriter {
+ public:
+  PackedNnetExampleWriter(): pos_(0) { }
+
+  /// Opens "wxfilename" (any extended filename, e.g. a pipe, is OK).
+  explicit PackedNnetExampleWriter(const std::string &wxfilename): pos_(0) {
+    Open(wxfilename);
+  }
+
+  void Open(const std::string &wxfilename);
+
+  void Write(const std::string &key, const NnetExample &eg);
+
+  /// Writes the index and closes the file; throws on error.  This is called
+  /// by the destructor if you don't call it, but then errors are only
+  /// printed as warnings.
+  void Close();
+
+  ~PackedNnetExampleWriter();
+ private:
+  // Writes "num_bytes" bytes at "data", and advances pos_.
+  void WriteBytes(const void *data, size_t num_bytes);
+  // Writes zeros up to the next multiple of 8 bytes.
+  void Pad();
+
+  Output output_;
+  int64 pos_;  // the number of bytes written.
+  std::vector<int64> offsets_;  // the offset of each example.
+  KALDI_DISALLOW_COPY_AND_ASSIGN(PackedNnetExampleWriter);
+};
+
+
+/// Gives random access to the examples of a packed file (see above), which
+/// is memory-mapped if it is an ordinary file, or else read into memory.
+class PackedNnetExampleReader {
+ public:
+  PackedNnetExampleReader(): data_(NULL), size_(0), num_examples_(0),
+                             offsets_(NULL) { }
+
+  /// Opens the packed file "rxfilename"; throws on error.
+  explicit PackedNnetExampleReader(const std::string &rxfilename):
+      data_(NULL), size_(0), num_examples_(0), offsets_(NULL) {
+    Open(rxfilename);
+  }
+
+  void Open(const std::string &rxfilename);
+
+  bool IsOpen() const { return data_ != NULL; }
+
+  int32 NumExamples() const { return num_examples_; }
+
+  /// Returns the key of example i, for 0 <= i < NumExamples().
+  std::string Key(int32 i) const;
+
+  /// Gets example i, for 0 <= i < NumExamples().
+  void GetExample(int32 i, NnetExample *eg) const;
+
+  void Close();
+
+ private:
+  // Returns a pointer to example i, after checking it's in the file.
+  const char *ExampleData(int32 i) const;
+
+  MappedFile mapped_file_;
+  std::vector<char> buffer_;  // if the file could not be mapped.
+  const char *data_;  // points into mapped_file_ or buffer_.
+  size_t size_;
+  int32 num_examples_;
+  const int64 *offsets_;  // the index.
+  KALDI_DISALLOW_COPY_AND_ASSIGN(PackedNnetExampleReader);
+};
+
+
+/// This gives the examples of a packed file the interface of
+/// SequentialNnetExampleReader, visiting them in the order of the file or,
+/// if "shuffle" is true, in a random order (from rand(), so see --srand), so
+/// that there is no need for shuffled copies of the examples.
+class SequentialPackedNnetExampleReader {
+ public:
+  SequentialPackedNnetExampleReader(const std::string &rxfilename,
+                                    bool shuffle);
+
+  bool Done() const { return index_ >= order_.size(); }
+
+  void Next();
+
+  std::string Key() const;
+
+  const NnetExample &Value() const {
+    KALDI_ASSERT(!Done());
+    return eg_;
+  }
+
+ private:
+  PackedNnetExampleReader reader_;
+  std::vector<int32> order_;
+  size_t index_;
+  NnetExample eg_;  // example order_[index_].
+};
+
+
+} // namespace nnet2
+} // namespace kaldi
+
+#endif // KALDI_NNET2_NNET_EXAMPLE_PACKED_H_
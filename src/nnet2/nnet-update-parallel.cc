@@ -19,8 +19,10 @@
 
 #include "nnet2/nnet-update-parallel.h"
 #include "nnet2/nnet-update.h"
+#include "nnet2/nnet-example-packed.h"
 #include "thread/kaldi-thread.h"
 #include "thread/kaldi-mutex.h"
+#include "util/stl-utils.h"
 #include <numeric>
 
 namespace kaldi {
@@ -36,11 +38,16 @@ class DoBackpropParallelClass: public MultiThreadable {
                           double *tot_weight_ptr,
                           double *log_prob_ptr,
                           Nnet *nnet_to_update,
-                          bool store_separate_gradients):
+                          bool store_separate_gradients,
+                          int32 sync_interval,
+                          std::vector<Mutex*> *component_locks):
       nnet_(nnet), repository_(repository),
       nnet_to_update_(nnet_to_update),
       nnet_to_update_orig_(nnet_to_update),
       store_separate_gradients_(store_separate_gradients),
+      sync_interval_(sync_interval),
+      component_locks_(component_locks),
+      local_nnet_(NULL), base_nnet_(NULL),
       tot_weight_ptr_(tot_weight_ptr),
       log_prob_ptr_(log_prob_ptr),
       tot_weight_(0.0),
@@ -54,6 +61,9 @@ class DoBackpropParallelClass: public MultiThreadable {
       nnet_to_update_(other.nnet_to_update_),
       nnet_to_update_orig_(other.nnet_to_update_orig_),
       store_separate_gradients_(other.store_separate_gradients_),
+      sync_interval_(other.sync_interval_),
+      component_locks_(other.component_locks_),
+      local_nnet_(NULL), base_nnet_(NULL),
       tot_weight_ptr_(other.tot_weight_ptr_),
       log_prob_ptr_(other.log_prob_ptr_),
       tot_weight_(0),
@@ -73,29 +83,56 @@ class DoBackpropParallelClass: public MultiThreadable {
       } else { // support case where we don't really need a gradient.
         nnet_to_update_ = NULL;
       }
-    }    
+    } else if (sync_interval_ > 0 && nnet_to_update_ != NULL) {
+      // Instead of Hogwild, we train our own copy of the model and add its
+      // change to nnet_to_update_ every sync_interval_ minibatches, so the
+      // threads don't keep writing to the same weights.  "base_nnet_" holds
+      // the parameters as of the last time we did that.  The stats of
+      // local_nnet_ start from zero, as we add them to nnet_to_update_ at
+      // the end.
+      local_nnet_ = new Nnet(*nnet_to_update_);
+      base_nnet_ = new Nnet(*nnet_to_update_);
+      for (int32 c = 0; c < local_nnet_->NumComponents(); c++) {
+        NonlinearComponent *nc = dynamic_cast<NonlinearComponent*>(
+            &(local_nnet_->GetComponent(c)));
+        if (nc != NULL) nc->Scale(0.0);
+      }
+    }
   }
   // This does the main function of the class.
   void operator () () {
     std::vector<NnetExample> examples;
+    int32 num_minibatches = 0;
     while (repository_->ProvideExamples(&examples)) {
       // This is a function call to a function defined in
       // nnet-update.h
       double tot_loglike;
-      if (nnet_to_update_ != NULL) 
+      if (local_nnet_ != NULL) {
+        tot_loglike = DoBackprop(*local_nnet_, examples, local_nnet_);
+        if (++num_minibatches % sync_interval_ == 0)
+          SyncModel();
+      } else if (nnet_to_update_ != NULL) {
         tot_loglike = DoBackprop(nnet_, examples, nnet_to_update_);
-      else
+      } else {
         tot_loglike = ComputeNnetObjf(nnet_, examples);
+      }
       tot_weight_ += TotalNnetTrainingWeight(examples);
       log_prob_ += tot_loglike;
       KALDI_VLOG(4) << "Thread " << thread_id_ << " saw "
                     << tot_weight_ << " frames so far (weighted); likelihood "
                     << "per frame so far is " << (log_prob_ / tot_weight_);
       examples.clear();
-    }    
+    }
+    if (local_nnet_ != NULL) {
+      if (num_minibatches % sync_interval_ != 0)
+        SyncModel();
+      AddStats();
+    }
   }
   
   ~DoBackpropParallelClass() {
+    delete local_nnet_;
+    delete base_nnet_;
     if (nnet_to_update_orig_ != nnet_to_update_) {
       // This branch is only taken if this instance of the class is
       // one of the multiple instances allocated inside the RunMultiThreaded
@@ -108,11 +145,60 @@ class DoBackpropParallelClass: public MultiThreadable {
     *tot_weight_ptr_ += tot_weight_;
   }
  private:
+  // Adds the change in the parameters of local_nnet_ since the last call to
+  // nnet_to_update_, and sets the parameters of local_nnet_ (and base_nnet_)
+  // to the result.  Each component is done under its own lock, and each
+  // thread starts at a different component, so the threads rarely wait for
+  // each other.  Only the parameters are copied, so local_nnet_ keeps its own
+  // preconditioning state.
+  void SyncModel() {
+    int32 num_components = local_nnet_->NumComponents();
+    for (int32 i = 0; i < num_components; i++) {
+      int32 c = (i + thread_id_) % num_components;
+      UpdatableComponent *local = dynamic_cast<UpdatableComponent*>(
+          &(local_nnet_->GetComponent(c)));
+      if (local == NULL) continue;
+      UpdatableComponent *base = dynamic_cast<UpdatableComponent*>(
+          &(base_nnet_->GetComponent(c))),
+          *shared = dynamic_cast<UpdatableComponent*>(
+              &(nnet_to_update_->GetComponent(c)));
+      KALDI_ASSERT(base != NULL && shared != NULL);
+      local->Add(-1.0, *base);  // "local" is now the change.
+      (*component_locks_)[c]->Lock();
+      shared->Add(1.0, *local);
+      base->Scale(0.0);
+      base->Add(1.0, *shared);
+      (*component_locks_)[c]->Unlock();
+      local->Scale(0.0);
+      local->Add(1.0, *base);
+    }
+  }
+
+  // Adds the stats of the nonlinear components of local_nnet_ (as used in
+  // mixing up) to nnet_to_update_.
+  void AddStats() {
+    for (int32 c = 0; c < local_nnet_->NumComponents(); c++) {
+      const NonlinearComponent *local = dynamic_cast<const NonlinearComponent*>(
+          &(local_nnet_->GetComponent(c)));
+      if (local == NULL) continue;
+      NonlinearComponent *shared = dynamic_cast<NonlinearComponent*>(
+          &(nnet_to_update_->GetComponent(c)));
+      KALDI_ASSERT(shared != NULL);
+      (*component_locks_)[c]->Lock();
+      shared->Add(1.0, *local);
+      (*component_locks_)[c]->Unlock();
+    }
+  }
+
   const Nnet &nnet_;
   ExamplesRepository *repository_;
   Nnet *nnet_to_update_;
   Nnet *nnet_to_update_orig_;
   bool store_separate_gradients_;
+  int32 sync_interval_;  // if > 0, use local_nnet_ instead of Hogwild.
+  std::vector<Mutex*> *component_locks_;  // one per component.
+  Nnet *local_nnet_;  // this thread's copy of the model, or NULL.
+  Nnet *base_nnet_;  // parameters of the model at the last SyncModel().
   double *tot_weight_ptr_;
   double *log_prob_ptr_;
   double tot_weight_;
@@ -121,17 +207,18 @@ class DoBackpropParallelClass: public MultiThreadable {
 
 
 #if HAVE_CUDA == 1
-double DoBackpropSingleThreaded(const Nnet &nnet,
-                                int32 minibatch_size,
-                                SequentialNnetExampleReader *examples_reader,
-                                double *tot_weight_out,
-                                Nnet *nnet_to_update) {
+template<class ReaderType>
+static double DoBackpropSingleThreaded(const Nnet &nnet,
+                                       int32 minibatch_size,
+                                       ReaderType *examples_reader,
+                                       double *tot_weight_out,
+                                       Nnet *nnet_to_update) {
   double ans = 0.0, tot_weight = 0.0;
   KALDI_ASSERT(minibatch_size > 0);
   while (!examples_reader->Done()) {
     std::vector<NnetExample> egs;
     egs.reserve(minibatch_size);
-    while (egs.size() < minibatch_size && examples_reader->Done()) {
+    while (egs.size() < minibatch_size && !examples_reader->Done()) {
       egs.push_back(examples_reader->Value());
       examples_reader->Next();
     }
@@ -144,11 +231,15 @@ double DoBackpropSingleThreaded(const Nnet &nnet,
 #endif
 
 
-double DoBackpropParallel(const Nnet &nnet,
-                          int32 minibatch_size,
-                          SequentialNnetExampleReader *examples_reader,
-                          double *tot_weight,
-                          Nnet *nnet_to_update) {
+// ReaderType is SequentialNnetExampleReader or
+// SequentialPackedNnetExampleReader.
+template<class ReaderType>
+static double DoBackpropParallelInternal(const Nnet &nnet,
+                                         int32 minibatch_size,
+                                         ReaderType *examples_reader,
+                                         double *tot_weight,
+                                         Nnet *nnet_to_update,
+                                         int32 sync_interval) {
 #if HAVE_CUDA == 1
   // Our GPU code won't work with multithreading; we do this
   // to enable it to work with this code in the single-threaded
@@ -166,10 +257,15 @@ double DoBackpropParallel(const Nnet &nnet,
   // This function assumes you want the exact gradient, if
   // nnet_to_update != &nnet.
   const bool store_separate_gradients = (nnet_to_update != &nnet);
+
+  std::vector<Mutex*> component_locks(nnet.NumComponents());
+  for (size_t c = 0; c < component_locks.size(); c++)
+    component_locks[c] = new Mutex();
   
   DoBackpropParallelClass c(nnet, &repository, tot_weight,
                             &tot_log_prob, nnet_to_update,
-                            store_separate_gradients);
+                            store_separate_gradients,
+                            sync_interval, &component_locks);
 
   {
     // The initialization of the following class spawns the threads that
@@ -191,6 +287,7 @@ double DoBackpropParallel(const Nnet &nnet,
     // DoBackpropParallelClass.
     repository.ExamplesDone();
   }
+  DeletePointers(&component_locks);
   KALDI_LOG << "Did backprop on " << *tot_weight << " examples, average log-prob "
             << "per frame is " << (tot_log_prob / *tot_weight);
   KALDI_LOG << "[this line is to be parsed by a script:] log-prob-per-frame="
@@ -198,6 +295,26 @@ double DoBackpropParallel(const Nnet &nnet,
   return tot_log_prob;
 }
 
+double DoBackpropParallel(const Nnet &nnet,
+                          int32 minibatch_size,
+                          SequentialNnetExampleReader *examples_reader,
+                          double *tot_weight,
+                          Nnet *nnet_to_update,
+                          int32 sync_interval) {
+  return DoBackpropParallelInternal(nnet, minibatch_size, examples_reader,
+                                    tot_weight, nnet_to_update, sync_interval);
+}
+
+double DoBackpropParallel(const Nnet &nnet,
+                          int32 minibatch_size,
+                          SequentialPackedNnetExampleReader *examples_reader,
+                          double *tot_weight,
+                          Nnet *nnet_to_update,
+                          int32 sync_interval) {
+  return DoBackpropParallelInternal(nnet, minibatch_size, examples_reader,
+                                    tot_weight, nnet_to_update, sync_interval);
+}
+
 
 double DoBackpropSingleThreaded(const Nnet &nnet,
                                 int32 minibatch_size,
@@ -236,7 +353,7 @@ double DoBackpropParallel(const Nnet &nnet,
   
   DoBackpropParallelClass c(nnet, &repository, tot_weight,
                             &tot_log_prob, nnet_to_update,
-                            store_separate_gradients);
+                            store_separate_gradients, 0, NULL);
 
   {
     // The initialization of the following class spawns the threads that
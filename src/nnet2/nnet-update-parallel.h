@@ -45,11 +45,29 @@ namespace nnet2 {
 /// gradient and it sums up the gradients.
 /// The return value is the total log-prob summed over the #frames. It also
 /// outputs the #frames into "num_frames".
+/// If sync_interval > 0 and we're doing SGD, instead of Hogwild each thread
+/// trains its own copy of the model, and adds the change in its parameters to
+/// "nnet_to_update" every sync_interval minibatches, one component at a time
+/// under a per-component lock; this avoids the threads fighting over the
+/// same cache lines for every minibatch, which is what makes Hogwild scale
+/// poorly to many threads.
 double DoBackpropParallel(const Nnet &nnet,
                           int32 minibatch_size,
                           SequentialNnetExampleReader *example_reader,
                           double *tot_weight,
-                          Nnet *nnet_to_update);
+                          Nnet *nnet_to_update,
+                          int32 sync_interval = 0);
+
+class SequentialPackedNnetExampleReader;
+
+/// As above, but reads the examples from a packed file (see
+/// nnet-example-packed.h).
+double DoBackpropParallel(const Nnet &nnet,
+                          int32 minibatch_size,
+                          SequentialPackedNnetExampleReader *example_reader,
+                          double *tot_weight,
+                          Nnet *nnet_to_update,
+                          int32 sync_interval = 0);
 
 
 /// This version of DoBackpropParallel takes a vector of examples, and will
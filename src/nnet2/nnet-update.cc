@@ -88,17 +88,46 @@ double NnetUpdater::ComputeForMinibatch(const std::vector<NnetExample> &data,
 }
 
 
+void NnetUpdater::ComputeActivations(const std::vector<NnetExample> &data,
+                                     int32 num_components,
+                                     CuMatrix<BaseFloat> *activations) {
+  KALDI_ASSERT(num_components >= 0 &&
+               num_components <= nnet_.NumComponents());
+  FormatInput(data);
+  Propagate(0, num_components);
+  activations->Swap(&(forward_data_[num_components]));
+}
+
+double NnetUpdater::ComputeForMinibatch(
+    const std::vector<NnetExample> &data,
+    int32 first_component,
+    const CuMatrixBase<BaseFloat> &activations,
+    double *tot_accuracy) {
+  KALDI_ASSERT(first_component >= 0 &&
+               first_component <= nnet_.FirstUpdatableComponent());
+  forward_data_.resize(nnet_.NumComponents() + 1);
+  nnet_.ComputeChunkInfo(1 + nnet_.LeftContext() + nnet_.RightContext(),
+                         data.size(), &chunk_info_out_);
+  forward_data_[first_component] = activations;
+  Propagate(first_component, nnet_.NumComponents());
+  CuMatrix<BaseFloat> tmp_deriv;
+  double ans = ComputeObjfAndDeriv(data, &tmp_deriv, tot_accuracy);
+  if (nnet_to_update_ != NULL)
+    Backprop(&tmp_deriv);
+  return ans;
+}
+
+
 void NnetUpdater::GetOutput(CuMatrix<BaseFloat> *output) {
   int32 num_components = nnet_.NumComponents(); 
   KALDI_ASSERT(forward_data_.size() == nnet_.NumComponents() + 1); 
   *output = forward_data_[num_components];
 }
 
-void NnetUpdater::Propagate() {
+void NnetUpdater::Propagate(int32 first_component, int32 end_component) {
   static int32 num_times_printed = 0;
         
-  int32 num_components = nnet_.NumComponents();
-  for (int32 c = 0; c < num_components; c++) {
+  for (int32 c = first_component; c < end_component; c++) {
     const Component &component = nnet_.GetComponent(c);
     const CuMatrix<BaseFloat> &input = forward_data_[c];
     CuMatrix<BaseFloat> &output = forward_data_[c+1];
@@ -108,7 +137,8 @@ void NnetUpdater::Propagate() {
     // If we won't need the output of the previous layer for
     // backprop, delete it to save memory.
     bool need_last_output =
-        (c>0 && nnet_.GetComponent(c-1).BackpropNeedsOutput()) ||
+        (c > first_component &&
+         nnet_.GetComponent(c-1).BackpropNeedsOutput()) ||
         component.BackpropNeedsInput();
     if (g_kaldi_verbose_level >= 3 && num_times_printed < 100) {
       KALDI_VLOG(3) << "Stddev of data for component " << c
@@ -262,6 +292,25 @@ double ComputeNnetObjf(const Nnet &nnet,
   return updater.ComputeForMinibatch(examples, tot_accuracy);
 }
 
+void ComputeNnetActivations(const Nnet &nnet,
+                            const std::vector<NnetExample> &examples,
+                            int32 num_components,
+                            CuMatrix<BaseFloat> *activations) {
+  NnetUpdater updater(nnet, NULL);
+  updater.ComputeActivations(examples, num_components, activations);
+}
+
+double DoBackpropFromActivations(const Nnet &nnet,
+                                 const std::vector<NnetExample> &examples,
+                                 int32 num_components,
+                                 const CuMatrixBase<BaseFloat> &activations,
+                                 Nnet *nnet_to_update,
+                                 double *tot_accuracy) {
+  NnetUpdater updater(nnet, nnet_to_update);
+  return updater.ComputeForMinibatch(examples, num_components, activations,
+                                     tot_accuracy);
+}
+
 double DoBackprop(const Nnet &nnet,
                   const std::vector<NnetExample> &examples,
                   Nnet *nnet_to_update,
@@ -68,10 +68,29 @@ class NnetUpdater {
                              Matrix<BaseFloat> *formatted_data,
                              double *tot_accuracy);
   
+  /// Formats the input and propagates it through components 0 ...
+  /// num_components - 1, and outputs the result (the input of component
+  /// num_components) to "activations".  See ComputeNnetActivations().
+  void ComputeActivations(const std::vector<NnetExample> &data,
+                          int32 num_components,
+                          CuMatrix<BaseFloat> *activations);
+
+  /// This version of ComputeForMinibatch starts from the input of component
+  /// "first_component", as output by ComputeActivations() for the same data;
+  /// first_component must not exceed nnet.FirstUpdatableComponent().
+  double ComputeForMinibatch(const std::vector<NnetExample> &data,
+                             int32 first_component,
+                             const CuMatrixBase<BaseFloat> &activations,
+                             double *tot_accuracy);
+  
   void GetOutput(CuMatrix<BaseFloat> *output);
  protected:
 
-  void Propagate();
+  void Propagate() { Propagate(0, nnet_.NumComponents()); }
+
+  /// Propagates through components first_component ... end_component - 1;
+  /// forward_data_[first_component] must already be set up.
+  void Propagate(int32 first_component, int32 end_component);
 
   /// Formats the input as a single matrix and sets the size of forward_data_,
   /// and sets up chunk_info_out_.
@@ -152,6 +171,32 @@ double DoBackprop(const Nnet &nnet,
 
 
 
+/// Propagates the input of these examples through the first "num_components"
+/// components of "nnet" (normally non-updatable ones, e.g. splicing and a
+/// fixed LDA transform), and outputs the input of component "num_components".
+/// With DoBackpropFromActivations(), this avoids formatting the same examples
+/// and propagating them through the same components over and over, when they
+/// are processed many times by nets that differ only in later components,
+/// as in nnet combination.
+void ComputeNnetActivations(const Nnet &nnet,
+                            const std::vector<NnetExample> &examples,
+                            int32 num_components,
+                            CuMatrix<BaseFloat> *activations);
+
+/// Like DoBackprop(), but starts from "activations", as output by
+/// ComputeNnetActivations() for these examples and "num_components"
+/// (which must not exceed nnet.FirstUpdatableComponent()).  The first
+/// num_components components of "nnet" must be the same as those of the
+/// nnet given to ComputeNnetActivations().  "nnet_to_update" may be NULL, to
+/// just compute the objective function.
+double DoBackpropFromActivations(const Nnet &nnet,
+                                 const std::vector<NnetExample> &examples,
+                                 int32 num_components,
+                                 const CuMatrixBase<BaseFloat> &activations,
+                                 Nnet *nnet_to_update,
+                                 double *tot_accuracy = NULL);
+
+
 /// Returns the total weight summed over all the examples... just a simple
 /// utility function.
 BaseFloat TotalNnetTrainingWeight(const std::vector<NnetExample> &egs);
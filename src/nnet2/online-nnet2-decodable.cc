@@ -54,6 +54,15 @@ BaseFloat DecodableNnet2Online::LogLikelihood(int32 frame, int32 index) {
   return scaled_loglikes_(frame - begin_frame_, pdf_id);
 }
 
+const BaseFloat *DecodableNnet2Online::GetFrameScores(
+    int32 frame, const int32 **index_to_row) {
+  ComputeForFrame(frame);
+  KALDI_ASSERT(frame >= begin_frame_ &&
+               frame < begin_frame_ + scaled_loglikes_.NumRows());
+  *index_to_row = &(trans_model_.TransitionIdToPdfArray()[0]);
+  return scaled_loglikes_.RowData(frame - begin_frame_);
+}
+
 
 bool DecodableNnet2Online::IsLastFrame(int32 frame) const {
   if (opts_.pad_input) { // normal case
@@ -101,17 +110,18 @@ void DecodableNnet2Online::ComputeForFrame(int32 frame) {
                                           opts_.max_nnet_batch_size);
   KALDI_ASSERT(input_frame_end > input_frame_begin);
   Matrix<BaseFloat> features(input_frame_end - input_frame_begin,
-                             feat_dim_);
+                             feat_dim_, kUndefined);
+  std::vector<int32> input_frames(input_frame_end - input_frame_begin);
   for (int32 t = input_frame_begin; t < input_frame_end; t++) {
-    SubVector<BaseFloat> row(features, t - input_frame_begin);
     int32 t_modified = t;
     // The next two if-statements take care of "pad_input"
     if (t_modified < 0)
       t_modified = 0;
     if (t_modified >= features_ready)
       t_modified = features_ready - 1;
-    features_->GetFrame(t_modified, &row);
+    input_frames[t - input_frame_begin] = t_modified;
   }
+  features_->GetFrames(input_frames, &features);
   CuMatrix<BaseFloat> cu_features; 
   cu_features.Swap(&features);  // Copy to GPU, if we're using one.
   
@@ -75,7 +75,10 @@ class DecodableNnet2Online: public DecodableInterface {
   
   /// Returns the scaled log likelihood
   virtual BaseFloat LogLikelihood(int32 frame, int32 index);
-  
+
+  virtual const BaseFloat *GetFrameScores(int32 frame,
+                                          const int32 **index_to_row);
+
   virtual bool IsLastFrame(int32 frame) const;
 
   virtual int32 NumFramesReady() const;  
@@ -18,17 +18,21 @@
 // limitations under the License.
 
 #include "nnet2/train-nnet.h"
+#include "nnet2/nnet-example-packed.h"
 #include "thread/kaldi-thread.h"
 
 namespace kaldi {
 namespace nnet2 {
 
 
+// ReaderType is SequentialNnetExampleReader or
+// SequentialPackedNnetExampleReader.
+template<class ReaderType>
 class NnetExampleBackgroundReader {
  public:
   NnetExampleBackgroundReader(int32 minibatch_size,
                               Nnet *nnet,
-                              SequentialNnetExampleReader *reader):
+                              ReaderType *reader):
       minibatch_size_(minibatch_size), nnet_(nnet), reader_(reader),
       finished_(false) {
     // When this class is created, it spawns a thread which calls ReadExamples()
@@ -138,7 +142,7 @@ class NnetExampleBackgroundReader {
  private:
   int32 minibatch_size_;
   Nnet *nnet_;
-  SequentialNnetExampleReader *reader_;
+  ReaderType *reader_;
   pthread_t thread_;
   
   std::vector<NnetExample> examples_;
@@ -154,15 +158,16 @@ class NnetExampleBackgroundReader {
 
 
 
-int64 TrainNnetSimple(const NnetSimpleTrainerConfig &config,
-                      Nnet *nnet,
-                      SequentialNnetExampleReader *reader,
-                      double *tot_weight_ptr,
-                      double *tot_logprob_ptr) {
+template<class ReaderType>
+static int64 TrainNnetSimpleInternal(const NnetSimpleTrainerConfig &config,
+                                     Nnet *nnet,
+                                     ReaderType *reader,
+                                     double *tot_weight_ptr,
+                                     double *tot_logprob_ptr) {
   int64 num_egs_processed = 0;
   double tot_weight = 0.0, tot_logprob = 0.0;
-  NnetExampleBackgroundReader background_reader(config.minibatch_size,
-                                                nnet, reader);
+  NnetExampleBackgroundReader<ReaderType> background_reader(
+      config.minibatch_size, nnet, reader);
   KALDI_ASSERT(config.minibatches_per_phase > 0);
   while (true) {
     // Iterate over phases.  A phase of training is just a certain number of
@@ -210,6 +215,21 @@ int64 TrainNnetSimple(const NnetSimpleTrainerConfig &config,
   return num_egs_processed;
 }
 
+int64 TrainNnetSimple(const NnetSimpleTrainerConfig &config,
+                      Nnet *nnet,
+                      SequentialNnetExampleReader *reader,
+                      double *tot_weight,
+                      double *tot_logprob) {
+  return TrainNnetSimpleInternal(config, nnet, reader, tot_weight, tot_logprob);
+}
+
+int64 TrainNnetSimple(const NnetSimpleTrainerConfig &config,
+                      Nnet *nnet,
+                      SequentialPackedNnetExampleReader *reader,
+                      double *tot_weight,
+                      double *tot_logprob) {
+  return TrainNnetSimpleInternal(config, nnet, reader, tot_weight, tot_logprob);
+}
 
 
 } // namespace nnet2
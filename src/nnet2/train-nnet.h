@@ -58,6 +58,16 @@ int64 TrainNnetSimple(const NnetSimpleTrainerConfig &config,
                       double *tot_weight = NULL,
                       double *tot_logprob = NULL);
 
+class SequentialPackedNnetExampleReader;
+
+/// As above, but reads the examples from a packed file (see
+/// nnet-example-packed.h).
+int64 TrainNnetSimple(const NnetSimpleTrainerConfig &config,
+                      Nnet *nnet,
+                      SequentialPackedNnetExampleReader *reader,
+                      double *tot_weight = NULL,
+                      double *tot_logprob = NULL);
+
 } // namespace nnet2
 } // namespace kaldi
 
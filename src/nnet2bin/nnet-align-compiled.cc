@@ -28,6 +28,7 @@
 #include "decoder/training-graph-compiler.h"
 #include "nnet2/decodable-am-nnet.h"
 #include "lat/kaldi-lattice.h"
+#include "thread/kaldi-task-sequence.h"
 
 int main(int argc, char *argv[]) {
   try {
@@ -45,7 +46,9 @@ int main(int argc, char *argv[]) {
         " nnet-align-compiled 1.mdl ark:graphs.fsts scp:train.scp ark:1.ali\n"
         "or:\n"
         " compile-train-graphs tree 1.mdl lex.fst ark:train.tra b, ark:- | \\\n"
-        "   nnet-align-compiled 1.mdl ark:- scp:train.scp t, ark:1.ali\n";
+        "   nnet-align-compiled 1.mdl ark:- scp:train.scp t, ark:1.ali\n"
+        "With --num-threads > 1, utterances are aligned in parallel (sharing\n"
+        "the model); the output is in the same order as the input.\n";
 
     ParseOptions po(usage);
     AlignConfig align_config;
@@ -53,8 +56,10 @@ int main(int argc, char *argv[]) {
     BaseFloat acoustic_scale = 1.0;
     BaseFloat transition_scale = 1.0;
     BaseFloat self_loop_scale = 1.0;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
 
     align_config.Register(&po);
+    sequencer_config.Register(&po);
     po.Register("transition-scale", &transition_scale,
                 "Transition-probability scale [relative to acoustics]");
     po.Register("acoustic-scale", &acoustic_scale,
@@ -81,7 +86,9 @@ int main(int argc, char *argv[]) {
         alignment_wspecifier = po.GetArg(4),
         scores_wspecifier = po.GetOptArg(5);
 
-    int num_done = 0, num_err = 0, num_retry = 0;
+    // num_fail counts utterances that we didn't get as far as aligning;
+    // num_done, num_err and num_retry are updated by the alignment tasks.
+    int num_done = 0, num_err = 0, num_retry = 0, num_fail = 0;
     double tot_like = 0.0;
     kaldi::int64 frame_count = 0;
 
@@ -100,47 +107,56 @@ int main(int argc, char *argv[]) {
       Int32VectorWriter alignment_writer(alignment_wspecifier);
       BaseFloatWriter scores_writer(scores_wspecifier);
 
-      for (; !fst_reader.Done(); fst_reader.Next()) {
-        std::string utt = fst_reader.Key();
-        if (!feature_reader.HasKey(utt)) {
-          KALDI_WARN << "No features for utterance " << utt;
-          num_err++;
-          continue;
-        }
-        const CuMatrix<BaseFloat> &features = feature_reader.Value(utt);
-        VectorFst<StdArc> decode_fst(fst_reader.Value());
-        fst_reader.FreeCurrent();  // this stops copy-on-write of the fst
-        // by deleting the fst inside the reader, since we're about to mutate
-        // the fst by adding transition probs.
-
-        if (features.NumRows() == 0) {
-          KALDI_WARN << "Zero-length utterance: " << utt;
-          num_err++;
-          continue;
-        }
-
-        {  // Add transition-probs to the FST.
-          std::vector<int32> disambig_syms;  // empty.
-          AddTransitionProbs(trans_model, disambig_syms,
-                             transition_scale, self_loop_scale,
-                             &decode_fst);
+      {
+        TaskSequencer<AlignUtteranceClass> sequencer(sequencer_config);
+        for (; !fst_reader.Done(); fst_reader.Next()) {
+          std::string utt = fst_reader.Key();
+          if (!feature_reader.HasKey(utt)) {
+            KALDI_WARN << "No features for utterance " << utt;
+            num_fail++;
+            continue;
+          }
+          const CuMatrix<BaseFloat> &features = feature_reader.Value(utt);
+          if (features.NumRows() == 0) {
+            KALDI_WARN << "Zero-length utterance: " << utt;
+            num_fail++;
+            continue;
+          }
+          VectorFst<StdArc> *decode_fst = new VectorFst<StdArc>(
+              fst_reader.Value());
+          fst_reader.FreeCurrent();  // this stops copy-on-write of the fst
+          // by deleting the fst inside the reader, since we're about to
+          // mutate the fst by adding transition probs.
+
+          {  // Add transition-probs to the FST.
+            std::vector<int32> disambig_syms;  // empty.
+            AddTransitionProbs(trans_model, disambig_syms,
+                               transition_scale, self_loop_scale,
+                               decode_fst);
+          }
+
+          // DecodableAmNnetParallel takes ownership of the features, and
+          // does the neural-net computation when it's first used, i.e. in
+          // the alignment task's thread.
+          bool pad_input = true;
+          DecodableAmNnetParallel *nnet_decodable = new DecodableAmNnetParallel(
+              trans_model, am_nnet, new CuMatrix<BaseFloat>(features),
+              pad_input, acoustic_scale);
+
+          // takes ownership of decode_fst and nnet_decodable.
+          sequencer.Run(new AlignUtteranceClass(
+              align_config, utt, acoustic_scale, decode_fst, nnet_decodable,
+              &alignment_writer, &scores_writer, &num_done, &num_err,
+              &num_retry, &tot_like, &frame_count));
         }
-
-        bool pad_input = true;
-        DecodableAmNnet nnet_decodable(trans_model, am_nnet, features,
-                                       pad_input, acoustic_scale);
-
-        AlignUtteranceWrapper(align_config, utt,
-                              acoustic_scale, &decode_fst, &nnet_decodable,
-                              &alignment_writer, &scores_writer,
-                              &num_done, &num_err, &num_retry,
-                              &tot_like, &frame_count);
+        sequencer.Wait();
       }
       KALDI_LOG << "Overall log-likelihood per frame is " << (tot_like/frame_count)
                 << " over " << frame_count<< " frames.";
       KALDI_LOG << "Retried " << num_retry << " out of "
-                << (num_done + num_err) << " utterances.";
-      KALDI_LOG << "Done " << num_done << ", errors on " << num_err;
+                << (num_done + num_err + num_fail) << " utterances.";
+      KALDI_LOG << "Done " << num_done << ", errors on "
+                << (num_err + num_fail);
     }
 #if HAVE_CUDA==1
     CuDevice::Instantiate().PrintProfile();
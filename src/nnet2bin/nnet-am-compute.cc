@@ -24,7 +24,48 @@
 #include "hmm/transition-model.h"
 #include "nnet2/train-nnet.h"
 #include "nnet2/am-nnet.h"
+#include "nnet2/nnet-compute.h"
+
+namespace kaldi {
+namespace nnet2 {
+
+// Does the computation for the utterances of a batch (see --batch-frames),
+// writes their output and empties the batch.
+static void ComputeBatch(const Nnet &nnet, int32 chunk_size, bool apply_log,
+                         std::vector<std::string> *keys,
+                         std::vector<Matrix<BaseFloat> > *feats,
+                         BaseFloatMatrixWriter *writer) {
+  int32 num_utts = keys->size();
+  std::vector<int32> num_frames(num_utts);
+  int32 tot_frames = 0;
+  for (int32 i = 0; i < num_utts; i++) {
+    num_frames[i] = (*feats)[i].NumRows();
+    tot_frames += num_frames[i];
+  }
+  Matrix<BaseFloat> input(tot_frames, nnet.InputDim(), kUndefined);
+  for (int32 i = 0, offset = 0; i < num_utts; i++) {
+    input.RowRange(offset, num_frames[i]).CopyFromMat((*feats)[i]);
+    offset += num_frames[i];
+  }
+  CuMatrix<BaseFloat> cu_input(input),
+      cu_output(tot_frames, nnet.OutputDim(), kUndefined);
+  NnetComputationBatched(nnet, cu_input, num_frames, chunk_size, &cu_output);
+  Matrix<BaseFloat> output(cu_output);
+  if (apply_log) {
+    output.ApplyFloor(1.0e-20);
+    output.ApplyLog();
+  }
+  for (int32 i = 0, offset = 0; i < num_utts; i++) {
+    writer->Write((*keys)[i], Matrix<BaseFloat>(
+        output.RowRange(offset, num_frames[i])));
+    offset += num_frames[i];
+  }
+  keys->clear();
+  feats->clear();
+}
 
+}  // namespace nnet2
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -41,12 +82,14 @@ int main(int argc, char *argv[]) {
         "\n"
         "Usage:  nnet-am-compute [options] <model-in> <feature-rspecifier> "
         "<feature-or-loglikes-wspecifier>\n"
+        "For many short utterances, use --batch-frames to do the computation for\n"
+        "several utterances at a time.\n"
         "See also: nnet-compute, nnet-logprob\n";
 
     bool apply_log = false;
     bool pad_input = true;
     std::string use_gpu = "no";
-    int32 chunk_size = 0;
+    int32 chunk_size = 0, batch_frames = 0, batch_chunk_size = 100;
     ParseOptions po(usage);
     po.Register("apply-log", &apply_log, "Apply a log to the result of the computation "
                 "before outputting.");
@@ -58,6 +101,13 @@ int main(int argc, char *argv[]) {
     po.Register("chunk-size", &chunk_size, "Process the feature matrix in chunks.  "
                 "This is useful when processing large feature files in the GPU.  "
                 "If chunk-size > 0, pad-input must be true.");
+    po.Register("batch-frames", &batch_frames, "If > 0, do the computation for "
+                "utterances together, up to about this many frames, which is "
+                "faster for short utterances (especially in the GPU).  If "
+                "batch-frames > 0, pad-input must be true.");
+    po.Register("batch-chunk-size", &batch_chunk_size, "With --batch-frames, the "
+                "utterances are cut into chunks of this many frames, which go "
+                "through the network together.");
 
     po.Read(argc, argv);
 
@@ -65,8 +115,10 @@ int main(int argc, char *argv[]) {
       po.PrintUsage();
       exit(1);
     }
-    // If chunk_size is greater than 0, pad_input needs to be true.
-    KALDI_ASSERT(chunk_size < 0 || pad_input);
+    // If chunk_size or batch_frames is greater than 0, pad_input needs to be
+    // true.
+    KALDI_ASSERT((chunk_size <= 0 && batch_frames <= 0) || pad_input);
+    KALDI_ASSERT(batch_chunk_size > 0);
 
 #if HAVE_CUDA==1
     CuDevice::Instantiate().SelectGpuId(use_gpu);
@@ -91,6 +143,11 @@ int main(int argc, char *argv[]) {
     SequentialBaseFloatMatrixReader feature_reader(features_rspecifier);
     BaseFloatMatrixWriter writer(features_or_loglikes_wspecifier);
 
+    // the utterances of the current batch, if batch_frames > 0.
+    std::vector<std::string> batch_keys;
+    std::vector<Matrix<BaseFloat> > batch_feats;
+    int32 batch_num_frames = 0;
+
     for (; !feature_reader.Done();  feature_reader.Next()) {
       std::string utt = feature_reader.Key();
       const Matrix<BaseFloat> &feats  = feature_reader.Value();
@@ -104,6 +161,21 @@ int main(int argc, char *argv[]) {
         continue;
       }
 
+      if (batch_frames > 0) {
+        batch_keys.push_back(utt);
+        batch_feats.resize(batch_feats.size() + 1);
+        batch_feats.back() = feats;
+        batch_num_frames += feats.NumRows();
+        if (batch_num_frames >= batch_frames) {
+          ComputeBatch(nnet, batch_chunk_size, apply_log, &batch_keys,
+                       &batch_feats, &writer);
+          batch_num_frames = 0;
+        }
+        num_frames += feats.NumRows();
+        num_done++;
+        continue;
+      }
+
       Matrix<BaseFloat> output(output_frames, output_dim);
       if (chunk_size > 0 && chunk_size < feats.NumRows()) {
         NnetComputationChunked(nnet, feats, chunk_size, &output);
@@ -122,6 +194,9 @@ int main(int argc, char *argv[]) {
       num_frames += feats.NumRows();
       num_done++;
     }
+    if (!batch_keys.empty())
+      ComputeBatch(nnet, batch_chunk_size, apply_log, &batch_keys,
+                   &batch_feats, &writer);
 #if HAVE_CUDA==1
     CuDevice::Instantiate().PrintProfile();
 #endif
@@ -27,7 +27,7 @@
 #include "decoder/decoder-wrappers.h"
 #include "nnet2/decodable-am-nnet.h"
 #include "base/timer.h"
-#include "thread/kaldi-task-sequence.h"
+#include "thread/kaldi-task-scheduler.h"
 
 
 int main(int argc, char *argv[]) {
@@ -48,10 +48,10 @@ int main(int argc, char *argv[]) {
     bool allow_partial = false;
     BaseFloat acoustic_scale = 0.1;
     LatticeFasterDecoderConfig config;
-    TaskSequencerConfig sequencer_config; // has --num-threads option
+    TaskSchedulerConfig scheduler_config; // has --num-threads option
     
     std::string word_syms_filename;
-    sequencer_config.Register(&po);
+    scheduler_config.Register(&po);
     config.Register(&po);
     po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for acoustic likelihoods");
     po.Register("word-symbol-table", &word_syms_filename, "Symbol table for words [for debug output]");
@@ -88,7 +88,7 @@ int main(int argc, char *argv[]) {
       KALDI_ERR << "Could not open table for writing lattices: "
                  << lattice_wspecifier;
 
-    TaskSequencer<DecodeUtteranceLatticeFasterClass> sequencer(sequencer_config);
+    TaskScheduler<DecodeUtteranceLatticeFasterClass> scheduler(scheduler_config);
     
     Int32VectorWriter words_writer(words_wspecifier);
 
@@ -139,7 +139,7 @@ int main(int argc, char *argv[]) {
                   &compact_lattice_writer, &lattice_writer,
                   &tot_like, &frame_count, &num_done, &num_err, NULL);
               
-          sequencer.Run(task); // takes ownership of "task",
+          scheduler.Run(task, features.NumRows()); // takes ownership of "task",
                                // and will delete it when done.
         }
       }
@@ -179,17 +179,17 @@ int main(int argc, char *argv[]) {
                 &compact_lattice_writer, &lattice_writer,
                 &tot_like, &frame_count, &num_done, &num_err, NULL);
 
-        sequencer.Run(task); // takes ownership of "task",
+        scheduler.Run(task, features.NumRows()); // takes ownership of "task",
                              // and will delete it when done.
       }
     }
-    sequencer.Wait(); // Waits for all tasks to be done.
+    scheduler.Wait(); // Waits for all tasks to be done.
     delete decode_fst;   
     
     double elapsed = timer.Elapsed();
     KALDI_LOG << "Time taken "<< elapsed
               << "s: real-time factor per thread assuming 100 frames/sec is "
-              << (sequencer_config.num_threads * elapsed * 100.0 / frame_count);
+              << (scheduler_config.num_threads * elapsed * 100.0 / frame_count);
     KALDI_LOG << "Done " << num_done << " utterances, failed for "
               << num_err;
     KALDI_LOG << "Overall log-likelihood per frame is " << (tot_like/frame_count) << " over "
@@ -26,6 +26,7 @@
 #include "hmm/transition-model.h"
 #include "fstext/kaldi-fst-io.h"
 #include "decoder/decoder-wrappers.h"
+#include "decoder/decoder-search-stats.h"
 #include "nnet2/decodable-am-nnet.h"
 #include "base/timer.h"
 
@@ -49,12 +50,17 @@ int main(int argc, char *argv[]) {
     BaseFloat acoustic_scale = 0.1;
     LatticeFasterDecoderConfig config;
     
-    std::string word_syms_filename;
+    std::string word_syms_filename, search_stats_wxfilename;
     config.Register(&po);
     po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for acoustic likelihoods");
     po.Register("word-symbol-table", &word_syms_filename, "Symbol table for words [for debug output]");
     po.Register("allow-partial", &allow_partial, "If true, produce output even if end state was not reached.");
     
+    po.Register("search-stats-json", &search_stats_wxfilename, "If set, "
+                "write statistics of the search (active tokens, arcs expanded, "
+                "adaptive beam, etc., per frame and per utterance) to this file "
+                "in JSON format.");
+
     po.Read(argc, argv);
     
     if (po.NumArgs() < 4 || po.NumArgs() > 6) {
@@ -99,6 +105,7 @@ int main(int argc, char *argv[]) {
 
     double tot_like = 0.0;
     kaldi::int64 frame_count = 0;
+    DecoderSearchStats search_stats;
     int num_success = 0, num_fail = 0;
 
     if (ClassifyRspecifier(fst_in_str, NULL, NULL) == kNoRspecifier) {
@@ -109,6 +116,8 @@ int main(int argc, char *argv[]) {
 
       {
         LatticeFasterDecoder decoder(*decode_fst, config);
+        if (!search_stats_wxfilename.empty())
+          decoder.SetSearchStats(&search_stats);
     
         for (; !feature_reader.Done(); feature_reader.Next()) {
           std::string utt = feature_reader.Key();
@@ -134,6 +143,8 @@ int main(int argc, char *argv[]) {
             frame_count += features.NumRows();
             num_success++;
           } else num_fail++;
+          if (!search_stats_wxfilename.empty())
+            search_stats.EndUtterance(utt);
         }
       }
       delete decode_fst; // delete this only after decoder goes out of scope.
@@ -156,6 +167,8 @@ int main(int argc, char *argv[]) {
         }
         
         LatticeFasterDecoder decoder(fst_reader.Value(), config);
+        if (!search_stats_wxfilename.empty())
+          decoder.SetSearchStats(&search_stats);
 
         bool pad_input = true;
         DecodableAmNnet nnet_decodable(trans_model,
@@ -173,6 +186,8 @@ int main(int argc, char *argv[]) {
           frame_count += features.NumRows();
           num_success++;
         } else num_fail++;
+        if (!search_stats_wxfilename.empty())
+          search_stats.EndUtterance(utt);
       }
     }
       
@@ -185,6 +200,11 @@ int main(int argc, char *argv[]) {
     KALDI_LOG << "Overall log-likelihood per frame is " << (tot_like/frame_count) << " over "
               << frame_count<<" frames.";
 
+    if (!search_stats_wxfilename.empty()) {
+      Output ko(search_stats_wxfilename, false);
+      search_stats.WriteJson(ko.Stream());
+    }
+
     delete word_syms;
     if (num_success != 0) return 0;
     else return 1;
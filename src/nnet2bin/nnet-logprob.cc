@@ -24,6 +24,77 @@
 #include "nnet2/am-nnet.h"
 #include "nnet2/nnet-compute.h"
 
+namespace kaldi {
+namespace nnet2 {
+
+// Turns the output of the network into log-probs, dividing by the priors
+// first (and re-normalizing) if divide_by_priors == true.
+static void ComputeLogProbs(const CuVectorBase<BaseFloat> &inv_priors,
+                            bool divide_by_priors,
+                            CuMatrixBase<BaseFloat> *log_probs) {
+  // at this point "log_probs" contains actual probabilities, not logs.
+  if (divide_by_priors) {
+    log_probs->MulColsVec(inv_priors); // scales each column by the corresponding element
+    // of inv_priors.
+    // re-normalize each frame to sum to one (getting the sums all at once,
+    // rather than frame by frame, which is slow in the GPU).
+    CuVector<BaseFloat> cu_sums(log_probs->NumRows(), kUndefined);
+    cu_sums.AddColSumMat(1.0, *log_probs, 0.0);
+    Vector<BaseFloat> scales(cu_sums);
+    for (int32 i = 0; i < scales.Dim(); i++) {
+      BaseFloat p = scales(i);
+      if (!(p > 0.0)) {
+        KALDI_WARN << "Bad sum of probabilities " << p;
+        scales(i) = 1.0;
+      } else {
+        scales(i) = 1.0 / p;
+      }
+    }
+    cu_sums.CopyFromVec(scales);
+    log_probs->MulRowsVec(cu_sums);
+  }
+  log_probs->ApplyFloor(1.0e-20); // To avoid log of zero which leads to NaN.
+  log_probs->ApplyLog();
+}
+
+// Does the computation for the utterances of a batch (see --batch-frames),
+// writes their log-probs and empties the batch.
+static void ComputeBatch(const AmNnet &am_nnet,
+                         const CuVectorBase<BaseFloat> &inv_priors,
+                         bool divide_by_priors, int32 chunk_size,
+                         std::vector<std::string> *keys,
+                         std::vector<Matrix<BaseFloat> > *feats,
+                         BaseFloatMatrixWriter *writer) {
+  int32 num_utts = keys->size();
+  std::vector<int32> num_frames(num_utts);
+  int32 tot_frames = 0;
+  for (int32 i = 0; i < num_utts; i++) {
+    num_frames[i] = (*feats)[i].NumRows();
+    tot_frames += num_frames[i];
+  }
+  Matrix<BaseFloat> input(tot_frames, (*feats)[0].NumCols(), kUndefined);
+  for (int32 i = 0, offset = 0; i < num_utts; i++) {
+    input.RowRange(offset, num_frames[i]).CopyFromMat((*feats)[i]);
+    offset += num_frames[i];
+  }
+  CuMatrix<BaseFloat> cu_input(input),
+      log_probs(tot_frames, am_nnet.NumPdfs(), kUndefined);
+  NnetComputationBatched(am_nnet.GetNnet(), cu_input, num_frames, chunk_size,
+                         &log_probs);
+  ComputeLogProbs(inv_priors, divide_by_priors, &log_probs);
+  Matrix<BaseFloat> output(log_probs);
+  for (int32 i = 0, offset = 0; i < num_utts; i++) {
+    writer->Write((*keys)[i], Matrix<BaseFloat>(
+        output.RowRange(offset, num_frames[i])));
+    offset += num_frames[i];
+  }
+  keys->clear();
+  feats->clear();
+}
+
+}  // namespace nnet2
+}  // namespace kaldi
+
 int main(int argc, char *argv[]) {
   try {
     using namespace kaldi;
@@ -41,15 +112,27 @@ int main(int argc, char *argv[]) {
         "Usage: nnet-logprob [options] <model-in> <features-rspecifier> <logprobs-wspecifier>\n"
         "\n"
         "e.g.: nnet-logprob 1.nnet \"$feats\" ark:- | latgen-faster-mapped ... \n"
+        "For many short utterances, use --batch-frames to do the computation for\n"
+        "several utterances at a time.\n"
         "See also: nnet-am-compute, nnet-compute\n";
 
     bool pad_input = true; // This is not currently configurable.
     bool divide_by_priors = true;
+    int32 batch_frames = 0, batch_chunk_size = 100;
+    std::string use_gpu = "no";
 
     ParseOptions po(usage);
 
     po.Register("divide-by-priors", &divide_by_priors, "If true, before getting "
                 "the log-probs, divide by the priors stored with the model");
+    po.Register("use-gpu", &use_gpu,
+                "yes|no|optional|wait, only has effect if compiled with CUDA");
+    po.Register("batch-frames", &batch_frames, "If > 0, do the computation for "
+                "utterances together, up to about this many frames, which is "
+                "faster for short utterances (especially in the GPU).");
+    po.Register("batch-chunk-size", &batch_chunk_size, "With --batch-frames, the "
+                "utterances are cut into chunks of this many frames, which go "
+                "through the network together.");
 
     po.Read(argc, argv);
 
@@ -57,6 +140,11 @@ int main(int argc, char *argv[]) {
       po.PrintUsage();
       exit(1);
     }
+    KALDI_ASSERT(batch_chunk_size > 0);
+
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().SelectGpuId(use_gpu);
+#endif
 
     std::string nnet_rxfilename = po.GetArg(1),
         feats_rspecifier = po.GetArg(2),
@@ -78,35 +166,50 @@ int main(int argc, char *argv[]) {
                  "Priors in neural network not set up.");
     inv_priors.ApplyPow(-1.0);
 
-    SequentialBaseFloatCuMatrixReader feature_reader(feats_rspecifier);
-    BaseFloatCuMatrixWriter logprob_writer(logprob_wspecifier);
+    SequentialBaseFloatMatrixReader feature_reader(feats_rspecifier);
+    BaseFloatMatrixWriter logprob_writer(logprob_wspecifier);
+
+    // the utterances of the current batch, if batch_frames > 0.
+    std::vector<std::string> batch_keys;
+    std::vector<Matrix<BaseFloat> > batch_feats;
+    int32 batch_num_frames = 0;
 
     for (; !feature_reader.Done(); feature_reader.Next()) {
       std::string key = feature_reader.Key();
-      const CuMatrix<BaseFloat> &feats = feature_reader.Value();
+      const Matrix<BaseFloat> &feats = feature_reader.Value();
+      if (feats.NumRows() == 0) {
+        KALDI_WARN << "Empty features for utterance " << key;
+        num_err++;
+        continue;
+      }
 
-      CuMatrix<BaseFloat> log_probs(feats.NumRows(), am_nnet.NumPdfs());
-      NnetComputation(am_nnet.GetNnet(), feats, pad_input, &log_probs);
-      // at this point "log_probs" contains actual probabilities, not logs.
-
-      if (divide_by_priors) {
-        log_probs.MulColsVec(inv_priors); // scales each column by the corresponding element
-        // of inv_priors.
-        for (int32 i = 0; i < log_probs.NumRows(); i++) {
-          CuSubVector<BaseFloat> frame(log_probs, i);
-          BaseFloat p = frame.Sum();
-          if (!(p > 0.0)) {
-            KALDI_WARN << "Bad sum of probabilities " << p;
-          } else {
-            frame.Scale(1.0 / p); // re-normalize to sum to one.
-          }
+      if (batch_frames > 0) {
+        batch_keys.push_back(key);
+        batch_feats.resize(batch_feats.size() + 1);
+        batch_feats.back() = feats;
+        batch_num_frames += feats.NumRows();
+        if (batch_num_frames >= batch_frames) {
+          ComputeBatch(am_nnet, inv_priors, divide_by_priors, batch_chunk_size,
+                       &batch_keys, &batch_feats, &logprob_writer);
+          batch_num_frames = 0;
         }
+        num_done++;
+        continue;
       }
-      log_probs.ApplyFloor(1.0e-20); // To avoid log of zero which leads to NaN.
-      log_probs.ApplyLog();
-      logprob_writer.Write(key, log_probs);
+
+      CuMatrix<BaseFloat> cu_feats(feats);
+      CuMatrix<BaseFloat> log_probs(feats.NumRows(), am_nnet.NumPdfs());
+      NnetComputation(am_nnet.GetNnet(), cu_feats, pad_input, &log_probs);
+      ComputeLogProbs(inv_priors, divide_by_priors, &log_probs);
+      logprob_writer.Write(key, Matrix<BaseFloat>(log_probs));
       num_done++;
     }
+    if (!batch_keys.empty())
+      ComputeBatch(am_nnet, inv_priors, divide_by_priors, batch_chunk_size,
+                   &batch_keys, &batch_feats, &logprob_writer);
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().PrintProfile();
+#endif
 
     KALDI_LOG << "Finished computing neural net log-probs, processed "
               << num_done << " utterances, " << num_err << " with errors.";
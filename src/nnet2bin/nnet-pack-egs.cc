@@ -0,0 +1,67 @@
+// nnet2bin/nnet-pack-egs.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "nnet2/nnet-example-packed.h"
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet2;
+    typedef kaldi::int32 int32;
+    typedef kaldi::int64 int64;
+
+    const char *usage =
+        "Copy examples for neural network training into a packed file, which\n"
+        "can be memory-mapped and read in a random order by nnet-train-simple\n"
+        "and nnet-train-parallel with --packed-egs (so there is no need to\n"
+        "shuffle the examples with nnet-shuffle-egs first).  The packed file\n"
+        "may be written to a pipe, but it is best as an ordinary file.\n"
+        "\n"
+        "Usage:  nnet-pack-egs [options] <egs-rspecifier> <packed-egs-wxfilename>\n"
+        "\n"
+        "e.g.\n"
+        "nnet-pack-egs ark:1.egs 1.pegs\n";
+
+    ParseOptions po(usage);
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string examples_rspecifier = po.GetArg(1),
+        packed_wxfilename = po.GetArg(2);
+
+    SequentialNnetExampleReader example_reader(examples_rspecifier);
+    PackedNnetExampleWriter writer(packed_wxfilename);
+
+    int64 num_done = 0;
+    for (; !example_reader.Done(); example_reader.Next(), num_done++)
+      writer.Write(example_reader.Key(), example_reader.Value());
+    writer.Close();
+
+    KALDI_LOG << "Packed " << num_done << " neural-network training examples "
+              << "to " << packed_wxfilename;
+    return (num_done == 0 ? 1 : 0);
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+}
@@ -22,6 +22,7 @@
 #include "hmm/transition-model.h"
 #include "nnet2/am-nnet.h"
 #include "nnet2/nnet-compute-discriminative.h"
+#include "thread/kaldi-thread.h"
 
 
 int main(int argc, char *argv[]) {
@@ -41,6 +42,7 @@ int main(int argc, char *argv[]) {
         "nnet-train-discriminative-simple 1.nnet ark:1.degs 2.nnet\n";
     
     bool binary_write = true;
+    bool pipeline = false;
     std::string use_gpu = "yes";
     NnetDiscriminativeUpdateOptions update_opts;
     
@@ -48,6 +50,13 @@ int main(int argc, char *argv[]) {
     po.Register("binary", &binary_write, "Write output in binary mode");
     po.Register("use-gpu", &use_gpu,
                 "yes|no|optional|wait, only has effect if compiled with CUDA");
+    po.Register("pipeline", &pipeline, "If true, do the lattice "
+                "computations on other threads (see --num-threads), overlapped "
+                "with the nnet computation on the next example; useful with a "
+                "GPU.  The nnet output for each example is then computed "
+                "before the update on the previous one.");
+    po.Register("num-threads", &g_num_threads, "Number of threads for "
+                "--pipeline=true.");
     update_opts.Register(&po);
     
     po.Read(argc, argv);
@@ -81,6 +90,11 @@ int main(int argc, char *argv[]) {
       NnetDiscriminativeStats stats;
       SequentialDiscriminativeNnetExampleReader example_reader(examples_rspecifier);
 
+      if (pipeline) {
+        num_examples = NnetDiscriminativeUpdatePipelined(
+            am_nnet, trans_model, update_opts, &example_reader,
+            &(am_nnet.GetNnet()), &stats);
+      }
       for (; !example_reader.Done(); example_reader.Next(), num_examples++) {
         NnetDiscriminativeUpdate(am_nnet, trans_model, update_opts,
                                  example_reader.Value(),
@@ -21,6 +21,7 @@
 #include "util/common-utils.h"
 #include "hmm/transition-model.h"
 #include "nnet2/nnet-update-parallel.h"
+#include "nnet2/nnet-example-packed.h"
 #include "nnet2/am-nnet.h"
 
 
@@ -34,17 +35,23 @@ int main(int argc, char *argv[]) {
     const char *usage =
         "Train the neural network parameters with backprop and stochastic\n"
         "gradient descent using minibatches.  As nnet-train-simple, but\n"
-        "uses multiple threads in a Hogwild type of update (for CPU, not GPU).\n"
+        "uses multiple threads in a Hogwild type of update (for CPU, not GPU),\n"
+        "or, with --sync-interval > 0, threads that train their own copies of\n"
+        "the model and periodically add their changes to it.\n"
         "\n"
         "Usage:  nnet-train-parallel [options] <model-in> <training-examples-in> <model-out>\n"
         "\n"
         "e.g.:\n"
-        "nnet-train-parallel --num-threads=8 1.nnet ark:1.1.egs 2.nnet\n";
+        "nnet-train-parallel --num-threads=8 1.nnet ark:1.1.egs 2.nnet\n"
+        "or, with examples from nnet-pack-egs:\n"
+        "nnet-train-parallel --num-threads=8 --packed-egs 1.nnet 1.1.pegs 2.nnet\n";
     
     bool binary_write = true;
+    bool packed_egs = false;
     bool zero_stats = true;
     int32 minibatch_size = 1024;
     int32 srand_seed = 0;
+    int32 sync_interval = 0;
     
     ParseOptions po(usage);
     po.Register("binary", &binary_write, "Write output in binary mode");
@@ -57,6 +64,13 @@ int main(int argc, char *argv[]) {
                 "implementation of BLAS, the actual number of threads may be larger.]");
     po.Register("minibatch-size", &minibatch_size, "Number of examples to use for "
                 "each minibatch during training.");
+    po.Register("sync-interval", &sync_interval, "If >0, instead of Hogwild, "
+                "each thread trains a copy of the model and adds its change to "
+                "the shared model after this many minibatches (scales better "
+                "to many threads).");
+    po.Register("packed-egs", &packed_egs, "If true, <training-examples-in> "
+                "is a packed examples file from nnet-pack-egs, whose examples "
+                "are visited in a random order (see --srand).");
     
     po.Read(argc, argv);
     srand(srand_seed);
@@ -84,14 +98,24 @@ int main(int argc, char *argv[]) {
     if (zero_stats) am_nnet.GetNnet().ZeroStats();
 
     double num_examples = 0;
-    SequentialNnetExampleReader example_reader(examples_rspecifier);
-    
-
-    DoBackpropParallel(am_nnet.GetNnet(),
-                       minibatch_size,
-                       &example_reader,
-                       &num_examples,
-                       &(am_nnet.GetNnet()));
+    if (packed_egs) {
+      SequentialPackedNnetExampleReader example_reader(examples_rspecifier,
+                                                       true);
+      DoBackpropParallel(am_nnet.GetNnet(),
+                         minibatch_size,
+                         &example_reader,
+                         &num_examples,
+                         &(am_nnet.GetNnet()),
+                         sync_interval);
+    } else {
+      SequentialNnetExampleReader example_reader(examples_rspecifier);
+      DoBackpropParallel(am_nnet.GetNnet(),
+                         minibatch_size,
+                         &example_reader,
+                         &num_examples,
+                         &(am_nnet.GetNnet()),
+                         sync_interval);
+    }
     
     {
       Output ko(nnet_wxfilename, binary_write);
@@ -21,6 +21,7 @@
 #include "util/common-utils.h"
 #include "hmm/transition-model.h"
 #include "nnet2/train-nnet.h"
+#include "nnet2/nnet-example-packed.h"
 #include "nnet2/am-nnet.h"
 
 
@@ -39,9 +40,12 @@ int main(int argc, char *argv[]) {
         "Usage:  nnet-train-simple [options] <model-in> <training-examples-in> <model-out>\n"
         "\n"
         "e.g.:\n"
-        "nnet-train-simple 1.nnet ark:1.egs 2.nnet\n";
+        "nnet-train-simple 1.nnet ark:1.egs 2.nnet\n"
+        "or, with examples from nnet-pack-egs:\n"
+        "nnet-train-simple --packed-egs 1.nnet 1.pegs 2.nnet\n";
     
     bool binary_write = true;
+    bool packed_egs = false;
     bool zero_stats = true;
     int32 srand_seed = 0;
     std::string use_gpu = "yes";
@@ -56,6 +60,9 @@ int main(int argc, char *argv[]) {
                 "with l2-penalty != 0.0");
     po.Register("use-gpu", &use_gpu,
                 "yes|no|optional|wait, only has effect if compiled with CUDA");
+    po.Register("packed-egs", &packed_egs, "If true, <training-examples-in> "
+                "is a packed examples file from nnet-pack-egs, whose examples "
+                "are visited in a random order (see --srand).");
     
     train_config.Register(&po);
     
@@ -89,10 +96,16 @@ int main(int argc, char *argv[]) {
 
       if (zero_stats) am_nnet.GetNnet().ZeroStats();
 
-      SequentialNnetExampleReader example_reader(examples_rspecifier);
-      
-      num_examples = TrainNnetSimple(train_config, &(am_nnet.GetNnet()),
-                                     &example_reader);
+      if (packed_egs) {
+        SequentialPackedNnetExampleReader example_reader(examples_rspecifier,
+                                                         true);
+        num_examples = TrainNnetSimple(train_config, &(am_nnet.GetNnet()),
+                                       &example_reader);
+      } else {
+        SequentialNnetExampleReader example_reader(examples_rspecifier);
+        num_examples = TrainNnetSimple(train_config, &(am_nnet.GetNnet()),
+                                       &example_reader);
+      }
     
       {
         Output ko(nnet_wxfilename, binary_write);
@@ -42,7 +42,10 @@ namespace nnet3 {
   context required to compute an output should be expressible as a left-context
   and right-context sufficient to cover all cases (for instance, the output
   can't depend on the input at 2*t).
-  
+
+  As for class Nnet, the const member functions of this class can be called
+  from several threads at once, so a single AmNnetSimple can be shared by
+  decoding threads (each with its own DecodableAmNnetSimple).
 */
 
 
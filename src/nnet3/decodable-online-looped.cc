@@ -0,0 +1,129 @@
+// nnet3/decodable-online-looped.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/decodable-online-looped.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+DecodableAmNnetLoopedOnline::DecodableAmNnetLoopedOnline(
+    const TransitionModel &trans_model,
+    const DecodableNnetSimpleLoopedInfo &info,
+    OnlineFeatureInterface *input_features,
+    OnlineFeatureInterface *ivector_features):
+    trans_model_(trans_model), info_(info),
+    input_features_(input_features), ivector_features_(ivector_features),
+    computer_(info), current_log_post_offset_(0) {
+  KALDI_ASSERT(info.IsAcousticModel());
+  if (input_features_->Dim() != info_.InputDim())
+    KALDI_ERR << "Neural net expects 'input' features with dimension "
+              << info_.InputDim() << " but you provided "
+              << input_features_->Dim();
+  int32 ivector_dim = (ivector_features_ != NULL ?
+                       ivector_features_->Dim() : 0);
+  if (ivector_dim != info_.IvectorDim())
+    KALDI_ERR << "Neural net expects 'ivector' features with dimension "
+              << info_.IvectorDim() << " but you provided " << ivector_dim;
+}
+
+int32 DecodableAmNnetLoopedOnline::NumFramesReady() const {
+  int32 features_ready = input_features_->NumFramesReady();
+  if (features_ready == 0)
+    return 0;
+  bool input_finished = input_features_->IsLastFrame(features_ready - 1);
+  if (input_finished)
+    return features_ready;
+  // Chunk k needs input up to frame (k + 1) * N + R - 1, so we can only
+  // compute whole chunks; the last chunk of the utterance waits for the end of
+  // the input.
+  int32 frames_per_chunk = info_.FramesPerChunk(),
+      num_chunks = (features_ready - info_.RightContext()) / frames_per_chunk;
+  return std::max<int32>(0, num_chunks * frames_per_chunk);
+}
+
+bool DecodableAmNnetLoopedOnline::IsLastFrame(int32 frame) const {
+  return input_features_->IsLastFrame(frame);
+}
+
+void DecodableAmNnetLoopedOnline::EnsureFrameIsComputed(int32 frame) {
+  KALDI_ASSERT(frame >= 0 && frame < NumFramesReady());
+  if (frame < current_log_post_offset_)
+    KALDI_ERR << "Frame " << frame << " requested after frame "
+              << current_log_post_offset_ << ": the looped computation "
+              << "requires the frames to be requested in order.";
+  while (frame >= current_log_post_offset_ + current_log_post_.NumRows())
+    AdvanceChunk();
+}
+
+void DecodableAmNnetLoopedOnline::AdvanceChunk() {
+  int32 chunk = computer_.NumChunksDone(), first_input_frame,
+      num_input_frames;
+  info_.GetChunkInputRange(chunk, &first_input_frame, &num_input_frames);
+  int32 features_ready = input_features_->NumFramesReady();
+  KALDI_ASSERT(features_ready > 0);
+  // We repeat the first frame as needed, and the last frame too, if the input
+  // is finished (NumFramesReady() ensures that otherwise, all the frames we
+  // need are ready).
+  Matrix<BaseFloat> input_feats(num_input_frames, input_features_->Dim(),
+                                kUndefined);
+  std::vector<int32> input_frames(num_input_frames);
+  for (int32 i = 0; i < num_input_frames; i++) {
+    int32 t = i + first_input_frame;
+    if (t < 0) t = 0;
+    if (t >= features_ready) t = features_ready - 1;
+    input_frames[i] = t;
+  }
+  input_features_->GetFrames(input_frames, &input_feats);
+  Vector<BaseFloat> ivector;
+  if (ivector_features_ != NULL) {
+    int32 last_input_frame = std::min(first_input_frame + num_input_frames,
+                                      features_ready) - 1,
+        ivector_frame = std::min(last_input_frame,
+                                 ivector_features_->NumFramesReady() - 1);
+    KALDI_ASSERT(ivector_frame >= 0);
+    ivector.Resize(ivector_features_->Dim(), kUndefined);
+    ivector_features_->GetFrame(ivector_frame, &ivector);
+  }
+  computer_.ComputeChunk(input_feats, ivector, &current_log_post_);
+  current_log_post_offset_ = chunk * info_.FramesPerChunk();
+  // The frames are requested in order, so the input frames before the next
+  // chunk's input will not be needed again.
+  int32 next_first_input_frame, next_num_input_frames;
+  info_.GetChunkInputRange(chunk + 1, &next_first_input_frame,
+                           &next_num_input_frames);
+  input_features_->ReleaseFramesBefore(next_first_input_frame);
+}
+
+BaseFloat DecodableAmNnetLoopedOnline::LogLikelihood(int32 frame,
+                                                     int32 transition_id) {
+  EnsureFrameIsComputed(frame);
+  int32 pdf_id = trans_model_.TransitionIdToPdf(transition_id);
+  return current_log_post_(frame - current_log_post_offset_, pdf_id);
+}
+
+const BaseFloat *DecodableAmNnetLoopedOnline::GetFrameScores(
+    int32 frame, const int32 **index_to_row) {
+  EnsureFrameIsComputed(frame);
+  *index_to_row = &(trans_model_.TransitionIdToPdfArray()[0]);
+  return current_log_post_.RowData(frame - current_log_post_offset_);
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
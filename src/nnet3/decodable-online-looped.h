@@ -0,0 +1,92 @@
+// nnet3/decodable-online-looped.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_DECODABLE_ONLINE_LOOPED_H_
+#define KALDI_NNET3_DECODABLE_ONLINE_LOOPED_H_
+
+#include "itf/online-feature-itf.h"
+#include "itf/decodable-itf.h"
+#include "nnet3/decodable-simple-looped.h"
+#include "hmm/transition-model.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+
+/**
+   DecodableAmNnetLoopedOnline is the online version of
+   DecodableAmNnetSimpleLooped: it takes its input from OnlineFeatureInterface
+   objects, and computes the output one chunk at a time as the features become
+   ready (see DecodableNnetSimpleLoopedInfo for how the looped computation
+   works).  Since the left context is carried over between chunks rather than
+   recomputed, the chunks can be small, which keeps the latency low.
+
+   The iVector (if the nnet has an iVector input) for each chunk is the most
+   recent one that is available when the chunk's input features are; in
+   online decoding the iVector features are computed on the same frames as
+   the input.
+*/
+class DecodableAmNnetLoopedOnline: public DecodableInterface {
+ public:
+  /// "info" should have been created from the acoustic model.
+  /// "ivector_features" should be NULL if the nnet has no iVector input.
+  /// None of the pointers or references are owned here.
+  DecodableAmNnetLoopedOnline(const TransitionModel &trans_model,
+                              const DecodableNnetSimpleLoopedInfo &info,
+                              OnlineFeatureInterface *input_features,
+                              OnlineFeatureInterface *ivector_features);
+
+  virtual BaseFloat LogLikelihood(int32 frame, int32 transition_id);
+
+  virtual const BaseFloat *GetFrameScores(int32 frame,
+                                          const int32 **index_to_row);
+
+  /// Returns the number of frames for which the output can be computed; this
+  /// is a multiple of the chunk size until the input is finished.
+  virtual int32 NumFramesReady() const;
+
+  virtual bool IsLastFrame(int32 frame) const;
+
+  /// Indices are one-based!  This is for compatibility with OpenFst.
+  virtual int32 NumIndices() const { return trans_model_.NumTransitionIds(); }
+
+ private:
+  // Computes the next chunk into current_log_post_.
+  void AdvanceChunk();
+  // Makes sure the output for this frame is in current_log_post_.
+  void EnsureFrameIsComputed(int32 frame);
+
+  const TransitionModel &trans_model_;
+  const DecodableNnetSimpleLoopedInfo &info_;
+  OnlineFeatureInterface *input_features_;
+  OnlineFeatureInterface *ivector_features_;
+  NnetLoopedComputer computer_;
+
+  // The output of the most recent chunk, and its first frame.
+  PinnedMatrix<BaseFloat> current_log_post_;
+  int32 current_log_post_offset_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableAmNnetLoopedOnline);
+};
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+#endif  // KALDI_NNET3_DECODABLE_ONLINE_LOOPED_H_
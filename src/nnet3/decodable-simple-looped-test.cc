@@ -0,0 +1,103 @@
+// nnet3/decodable-simple-looped-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/decodable-simple-looped.h"
+#include "nnet3/nnet-simple-computer.h"
+#include "nnet3/nnet-test-utils.h"
+#include "nnet3/nnet-utils.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+
+// Checks that the looped computation gives the same output as computing the
+// whole utterance in one chunk with NnetSimpleComputer.
+void UnitTestDecodableSimpleLooped() {
+  for (int32 n = 0; n < 20; n++) {
+    struct NnetGenerationOptions gen_config;
+    // With recurrence, the regular (non-looped) computation isn't exact unless
+    // it sees the whole utterance, and with clockwork nets, the looped
+    // computation may see different frames; we just test the simple cases.
+    gen_config.allow_recursion = false;
+    gen_config.allow_clockwork = false;
+    gen_config.allow_multiple_inputs = false;
+
+    std::vector<std::string> configs;
+    GenerateConfigSequence(gen_config, &configs);
+    Nnet nnet;
+    for (size_t j = 0; j < configs.size(); j++) {
+      KALDI_LOG << "Input config[" << j << "] is: " << configs[j];
+      std::istringstream is(configs[j]);
+      nnet.ReadConfig(is);
+    }
+    if (!IsSimpleNnet(nnet))
+      continue;
+
+    int32 num_frames = RandInt(1, 60);
+    Matrix<BaseFloat> feats(num_frames, nnet.InputDim("input"));
+    feats.SetRandn();
+
+    NnetSimpleComputerOptions simple_opts;
+    simple_opts.frames_per_chunk = num_frames;
+    Matrix<BaseFloat> simple_output;
+    {
+      NnetSimpleComputer computer(simple_opts, nnet, feats);
+      computer.GetOutput(&simple_output);
+    }
+
+    NnetSimpleLoopedComputationOptions looped_opts;
+    looped_opts.frames_per_chunk = RandInt(1, 10);
+    if (RandInt(0, 1) == 0)
+      looped_opts.debug_computation = true;
+    DecodableNnetSimpleLoopedInfo info(looped_opts, nnet);
+    KALDI_LOG << "Frames per chunk is " << info.FramesPerChunk()
+              << ", left-context=" << info.LeftContext()
+              << ", right-context=" << info.RightContext();
+    Matrix<BaseFloat> looped_output;
+    {
+      DecodableNnetSimpleLooped decodable(info, feats);
+      decodable.GetOutput(&looped_output);
+    }
+    KALDI_LOG << "Output sums are " << simple_output.Sum() << " (simple) and "
+              << looped_output.Sum() << " (looped)";
+    KALDI_ASSERT(looped_output.ApproxEqual(simple_output, 0.001));
+  }
+}
+
+} // namespace nnet3
+} // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::nnet3;
+
+  for (int32 loop = 0; loop < 2; loop++) {
+#if HAVE_CUDA == 1
+    if (loop == 0)
+      CuDevice::Instantiate().SelectGpuId("no");
+    else
+      CuDevice::Instantiate().SelectGpuId("yes");
+#endif
+    UnitTestDecodableSimpleLooped();
+  }
+
+  KALDI_LOG << "Looped decodable tests succeeded.";
+
+  return 0;
+}
@@ -0,0 +1,311 @@
+// nnet3/decodable-simple-looped.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/decodable-simple-looped.h"
+#include "nnet3/nnet-utils.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+
+DecodableNnetSimpleLoopedInfo::DecodableNnetSimpleLoopedInfo(
+    const NnetSimpleLoopedComputationOptions &opts,
+    const Nnet &nnet):
+    opts_(opts), is_am_(false), compiler_(NULL) {
+  Init(nnet);
+}
+
+DecodableNnetSimpleLoopedInfo::DecodableNnetSimpleLoopedInfo(
+    const NnetSimpleLoopedComputationOptions &opts,
+    const AmNnetSimple &am_nnet):
+    opts_(opts), is_am_(true), compiler_(NULL) {
+  if (am_nnet.Priors().Dim() != 0) {
+    log_priors_ = am_nnet.Priors();
+    log_priors_.ApplyLog();
+  }
+  Init(am_nnet.GetNnet());
+}
+
+void DecodableNnetSimpleLoopedInfo::Init(const Nnet &nnet) {
+  opts_.Check();
+  if (opts_.debug_computation)
+    opts_.compute_config.debug = true;
+  KALDI_ASSERT(IsSimpleNnet(nnet));
+  // The context is computed on the original nnet, which has only the one
+  // output.
+  ComputeSimpleNnetContext(nnet, &left_context_, &right_context_);
+  has_ivectors_ = (nnet.InputDim("ivector") > 0);
+
+  // The first chunk has to be able to compute all the carried-over frames
+  // from the input, so it can't be shorter than the left context; and shifting
+  // by a multiple of the modulus keeps the computation the same for each
+  // chunk.
+  int32 modulus = nnet.Modulus();
+  frames_per_chunk_ = std::max(opts_.frames_per_chunk, left_context_);
+  if (frames_per_chunk_ % modulus != 0)
+    frames_per_chunk_ += modulus - (frames_per_chunk_ % modulus);
+  if (frames_per_chunk_ != opts_.frames_per_chunk)
+    KALDI_LOG << "Increasing --frames-per-chunk from "
+              << opts_.frames_per_chunk << " to " << frames_per_chunk_
+              << " (left-context=" << left_context_ << ", modulus="
+              << modulus << ")";
+
+  nnet_ = nnet;
+  std::ostringstream config;
+  for (int32 n = 0; n < nnet.NumNodes(); n++) {
+    if (nnet.IsComponentNode(n)) {
+      const std::string &name = nnet.GetNodeName(n);
+      carried_nodes_.push_back(name);
+      config << "output-node name=" << name << "-carry input=" << name
+             << "\n";
+    }
+  }
+  if (!carried_nodes_.empty()) {
+    std::istringstream is(config.str());
+    nnet_.ReadConfig(is);
+  }
+
+  compiler_ = new CachingOptimizingCompiler(nnet_, opts_.optimize_config);
+  ComputationRequest initial_request, request;
+  GetRequest(true, &initial_request);
+  GetRequest(false, &request);
+  initial_computation_ = compiler_->Compile(initial_request);
+  computation_ = compiler_->Compile(request);
+}
+
+void DecodableNnetSimpleLoopedInfo::GetRequest(
+    bool initial, ComputationRequest *request) const {
+  request->need_model_derivative = false;
+  request->store_component_stats = false;
+  int32 num_frames = frames_per_chunk_,
+      extra_left_context = (initial ? opts_.extra_left_context_initial : 0);
+  // All time indexes are relative to the first output frame of the chunk.
+  request->inputs.push_back(
+      IoSpecification("input", -left_context_ - extra_left_context,
+                      num_frames + right_context_));
+  if (has_ivectors_) {
+    std::vector<Index> indexes;
+    indexes.push_back(Index(0, 0, 0));
+    request->inputs.push_back(IoSpecification("ivector", indexes));
+  }
+  request->outputs.push_back(IoSpecification("output", 0, num_frames));
+  for (size_t i = 0; i < carried_nodes_.size(); i++) {
+    // the values carried over from the previous chunk are supplied as inputs
+    // for the frames before this chunk.
+    if (!initial)
+      request->inputs.push_back(IoSpecification(carried_nodes_[i],
+                                                -num_frames, 0));
+    request->outputs.push_back(IoSpecification(carried_nodes_[i] + "-carry",
+                                               0, num_frames));
+  }
+}
+
+void DecodableNnetSimpleLoopedInfo::GetChunkInputRange(
+    int32 chunk, int32 *first_frame, int32 *num_frames) const {
+  KALDI_ASSERT(chunk >= 0);
+  int32 extra_left_context = (chunk == 0 ?
+                              opts_.extra_left_context_initial : 0);
+  *first_frame = chunk * frames_per_chunk_ - left_context_ -
+      extra_left_context;
+  *num_frames = extra_left_context + left_context_ + frames_per_chunk_ +
+      right_context_;
+}
+
+
+NnetLoopedComputer::NnetLoopedComputer(
+    const DecodableNnetSimpleLoopedInfo &info):
+    info_(info), num_chunks_(0) { }
+
+void NnetLoopedComputer::ComputeChunk(const MatrixBase<BaseFloat> &input,
+                                      const VectorBase<BaseFloat> &ivector,
+                                      PinnedMatrix<BaseFloat> *output) {
+  bool initial = (num_chunks_ == 0);
+  const std::vector<std::string> &carried_nodes = info_.CarriedNodes();
+  Nnet *nnet_to_update = NULL;  // we're not doing any update.
+  NnetComputer computer(info_.Options().compute_config,
+                        info_.Computation(initial),
+                        info_.GetNnet(), nnet_to_update);
+
+  CuMatrix<BaseFloat> input_cu(input);
+  computer.AcceptInput("input", &input_cu);
+  if (info_.HasIvectors()) {
+    KALDI_ASSERT(ivector.Dim() == info_.IvectorDim());
+    CuMatrix<BaseFloat> ivector_cu(1, ivector.Dim(), kUndefined);
+    ivector_cu.Row(0).CopyFromVec(ivector);
+    computer.AcceptInput("ivector", &ivector_cu);
+  }
+  if (!initial) {
+    KALDI_ASSERT(carried_.size() == carried_nodes.size());
+    for (size_t i = 0; i < carried_nodes.size(); i++)
+      computer.AcceptInput(carried_nodes[i], &(carried_[i]));
+  }
+  computer.Forward();
+
+  carried_.resize(carried_nodes.size());
+  for (size_t i = 0; i < carried_nodes.size(); i++)
+    computer.GetOutputDestructive(carried_nodes[i] + "-carry",
+                                  &(carried_[i]));
+  CuMatrix<BaseFloat> cu_output;
+  computer.GetOutputDestructive("output", &cu_output);
+  if (info_.IsAcousticModel()) {
+    BaseFloat acoustic_scale = info_.Options().acoustic_scale;
+    // subtract log-prior (divide by prior) and apply the acoustic scale, in
+    // one pass over the output.
+    if (info_.LogPriors().Dim() != 0)
+      cu_output.AddVecToRows(-acoustic_scale, info_.LogPriors(),
+                             acoustic_scale);
+    else
+      cu_output.Scale(acoustic_scale);
+  }
+  output->Resize(cu_output.NumRows(), cu_output.NumCols(), kUndefined);
+  cu_output.CopyToMat(output);
+  num_chunks_++;
+}
+
+
+DecodableNnetSimpleLooped::DecodableNnetSimpleLooped(
+    const DecodableNnetSimpleLoopedInfo &info,
+    const MatrixBase<BaseFloat> &feats,
+    const VectorBase<BaseFloat> *ivector,
+    const MatrixBase<BaseFloat> *online_ivectors,
+    int32 online_ivector_period):
+    info_(info), computer_(info), feats_(feats), ivector_(ivector),
+    online_ivector_feats_(online_ivectors),
+    online_ivector_period_(online_ivector_period),
+    current_log_post_offset_(0) {
+  KALDI_ASSERT(!(ivector != NULL && online_ivectors != NULL));
+  KALDI_ASSERT(!(online_ivectors != NULL && online_ivector_period <= 0 &&
+                 "You need to set the --online-ivector-period option!"));
+  if (feats_.NumCols() != info_.InputDim())
+    KALDI_ERR << "Neural net expects 'input' features with dimension "
+              << info_.InputDim() << " but you provided "
+              << feats_.NumCols();
+  int32 ivector_dim = (ivector != NULL ? ivector->Dim() :
+                       (online_ivectors != NULL ?
+                        online_ivectors->NumCols() : 0));
+  if (ivector_dim != info_.IvectorDim())
+    KALDI_ERR << "Neural net expects 'ivector' features with dimension "
+              << info_.IvectorDim() << " but you provided " << ivector_dim;
+}
+
+const BaseFloat *DecodableNnetSimpleLooped::GetOutputForFrame(int32 frame) {
+  KALDI_ASSERT(frame >= 0 && frame < NumFrames());
+  if (frame < current_log_post_offset_)
+    KALDI_ERR << "Frame " << frame << " requested after frame "
+              << current_log_post_offset_ << ": the looped computation "
+              << "requires the frames to be requested in order.";
+  while (frame >= current_log_post_offset_ + current_log_post_.NumRows())
+    AdvanceChunk();
+  return current_log_post_.RowData(frame - current_log_post_offset_);
+}
+
+void DecodableNnetSimpleLooped::GetOutput(Matrix<BaseFloat> *output) {
+  int32 num_frames = NumFrames();
+  output->Resize(num_frames, OutputDim(), kUndefined);
+  int32 t = 0;
+  while (t < num_frames) {
+    GetOutputForFrame(t);  // makes sure frame t is in current_log_post_.
+    int32 num_rows = std::min(num_frames, current_log_post_offset_ +
+                              current_log_post_.NumRows()) - t;
+    output->RowRange(t, num_rows).CopyFromMat(
+        current_log_post_.RowRange(t - current_log_post_offset_, num_rows));
+    t += num_rows;
+  }
+}
+
+void DecodableNnetSimpleLooped::AdvanceChunk() {
+  int32 chunk = computer_.NumChunksDone(), first_input_frame,
+      num_input_frames;
+  info_.GetChunkInputRange(chunk, &first_input_frame, &num_input_frames);
+  int32 tot_input_feats = feats_.NumRows();
+  // We repeat the first and last frames as needed.
+  Matrix<BaseFloat> input_feats(num_input_frames, feats_.NumCols(),
+                                kUndefined);
+  for (int32 i = 0; i < num_input_frames; i++) {
+    SubVector<BaseFloat> dest(input_feats, i);
+    int32 t = i + first_input_frame;
+    if (t < 0) t = 0;
+    if (t >= tot_input_feats) t = tot_input_feats - 1;
+    const SubVector<BaseFloat> src(feats_, t);
+    dest.CopyFromVec(src);
+  }
+  Vector<BaseFloat> ivector;
+  GetCurrentIvector(std::min(first_input_frame + num_input_frames,
+                             tot_input_feats) - 1, &ivector);
+  computer_.ComputeChunk(input_feats, ivector, &current_log_post_);
+  current_log_post_offset_ = chunk * info_.FramesPerChunk();
+}
+
+void DecodableNnetSimpleLooped::GetCurrentIvector(int32 last_input_frame,
+                                                  Vector<BaseFloat> *ivector) {
+  if (ivector_ != NULL) {
+    *ivector = *ivector_;
+    return;
+  } else if (online_ivector_feats_ == NULL) {
+    return;
+  }
+  KALDI_ASSERT(online_ivector_period_ > 0);
+  // Unlike NnetSimpleComputer, we use the most recent iVector that would be
+  // available at the end of the chunk's input, as an online decoder would.
+  int32 ivector_frame = last_input_frame / online_ivector_period_;
+  KALDI_ASSERT(ivector_frame >= 0);
+  if (ivector_frame >= online_ivector_feats_->NumRows()) {
+    int32 margin = ivector_frame - (online_ivector_feats_->NumRows() - 1);
+    if (margin * online_ivector_period_ > 50) {
+      // Half a second seems like too long to be explainable as edge effects.
+      KALDI_ERR << "Could not get iVector for frame " << last_input_frame
+                << ", only available till frame "
+                << online_ivector_feats_->NumRows()
+                << " * ivector-period=" << online_ivector_period_
+                << " (mismatched --ivector-period?)";
+    }
+    ivector_frame = online_ivector_feats_->NumRows() - 1;
+  }
+  *ivector = online_ivector_feats_->Row(ivector_frame);
+}
+
+
+DecodableAmNnetSimpleLooped::DecodableAmNnetSimpleLooped(
+    const DecodableNnetSimpleLoopedInfo &info,
+    const TransitionModel &trans_model,
+    const MatrixBase<BaseFloat> &feats,
+    const VectorBase<BaseFloat> *ivector,
+    const MatrixBase<BaseFloat> *online_ivectors,
+    int32 online_ivector_period):
+    decodable_nnet_(info, feats, ivector, online_ivectors,
+                    online_ivector_period),
+    trans_model_(trans_model) {
+  KALDI_ASSERT(info.IsAcousticModel());
+}
+
+BaseFloat DecodableAmNnetSimpleLooped::LogLikelihood(int32 frame,
+                                                     int32 transition_id) {
+  int32 pdf_id = trans_model_.TransitionIdToPdf(transition_id);
+  return decodable_nnet_.GetOutputForFrame(frame)[pdf_id];
+}
+
+const BaseFloat *DecodableAmNnetSimpleLooped::GetFrameScores(
+    int32 frame, const int32 **index_to_row) {
+  *index_to_row = &(trans_model_.TransitionIdToPdfArray()[0]);
+  return decodable_nnet_.GetOutputForFrame(frame);
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
@@ -0,0 +1,312 @@
+// nnet3/decodable-simple-looped.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_DECODABLE_SIMPLE_LOOPED_H_
+#define KALDI_NNET3_DECODABLE_SIMPLE_LOOPED_H_
+
+#include <vector>
+#include "base/kaldi-common.h"
+#include "hmm/transition-model.h"
+#include "itf/decodable-itf.h"
+#include "nnet3/nnet-optimize.h"
+#include "nnet3/nnet-compute.h"
+#include "nnet3/am-nnet-simple.h"
+#include "cudamatrix/cu-stream.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// See below for the documentation of the "looped" computation.
+
+struct NnetSimpleLoopedComputationOptions {
+  int32 extra_left_context_initial;
+  int32 frames_per_chunk;
+  BaseFloat acoustic_scale;
+  bool debug_computation;
+  NnetOptimizeOptions optimize_config;
+  NnetComputeOptions compute_config;
+
+  NnetSimpleLoopedComputationOptions():
+      extra_left_context_initial(0),
+      frames_per_chunk(20),
+      acoustic_scale(0.1),
+      debug_computation(false) { }
+
+  void Check() const {
+    KALDI_ASSERT(extra_left_context_initial >= 0 && frames_per_chunk > 0);
+  }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("extra-left-context-initial", &extra_left_context_initial,
+                   "Extra left context to use at the start of the utterance "
+                   "(on top of the neural net's inherent left context); may "
+                   "be useful in recurrent setups.");
+    opts->Register("frames-per-chunk", &frames_per_chunk,
+                   "Number of output frames computed in each chunk.  Unlike "
+                   "in the non-looped decoding, the left context is not "
+                   "recomputed for each chunk, so this can be small; it is "
+                   "rounded up if needed to at least the left context of the "
+                   "network, and to a multiple of its modulus.");
+    opts->Register("acoustic-scale", &acoustic_scale,
+                   "Scaling factor for acoustic log-likelihoods");
+    opts->Register("debug-computation", &debug_computation, "If true, turn on "
+                   "debug for the actual computation (very verbose!)");
+
+    // register the optimization options with the prefix "optimization".
+    ParseOptions optimization_opts("optimization", opts);
+    optimize_config.Register(&optimization_opts);
+
+    // register the compute options with the prefix "computation".
+    ParseOptions compute_opts("computation", opts);
+    compute_config.Register(&compute_opts);
+  }
+};
+
+
+/**
+   DecodableNnetSimpleLoopedInfo contains the things that the "looped"
+   computation needs, and that can be shared between utterances (and between
+   threads, since after construction it is only read): a modified copy of the
+   neural net, its context, and the two compiled computations.
+
+   The looped computation works as follows.  The output is computed in chunks
+   of frames_per_chunk (N) frames at a time, and rather than recomputing the
+   left context of each chunk from the input features as
+   DecodableAmNnetSimple does, we carry the output of every Component node
+   on the last N frames of one chunk over to the next chunk, where it is
+   supplied to the computation as an input (the computation framework allows
+   Component nodes to be supplied as inputs, and treats those Cindexes as
+   having been computed already).  To get those values out of the computation
+   we add to our copy of the nnet an output node "<name>-carry" for each
+   Component node "<name>".  So each chunk only computes the new frames (plus
+   the frames of right context of the internal nodes, which are redundant with
+   the next chunk).  This also makes recurrent setups exact, since the
+   recurrence is not broken at chunk boundaries.
+
+   Because the time indexes in the requests are relative to the start of the
+   chunk, all chunks except the first have the same ComputationRequest, so
+   only two computations are ever compiled: one for the first chunk of an
+   utterance (with no carried-over values, and with the extra left context
+   given by --extra-left-context-initial), and one for all later chunks.
+*/
+class DecodableNnetSimpleLoopedInfo {
+ public:
+  /// Constructor for use with a raw neural net (no priors are subtracted).
+  DecodableNnetSimpleLoopedInfo(const NnetSimpleLoopedComputationOptions &opts,
+                                const Nnet &nnet);
+
+  /// Constructor for use with an acoustic model; the output will have the log
+  /// of the priors subtracted (if the priors are set), and be scaled by
+  /// opts.acoustic_scale.
+  DecodableNnetSimpleLoopedInfo(const NnetSimpleLoopedComputationOptions &opts,
+                                const AmNnetSimple &am_nnet);
+
+  ~DecodableNnetSimpleLoopedInfo() { delete compiler_; }
+
+  const NnetSimpleLoopedComputationOptions &Options() const { return opts_; }
+
+  /// The modified copy of the nnet, that has the "-carry" outputs.
+  const Nnet &GetNnet() const { return nnet_; }
+
+  /// The (possibly rounded-up) number of output frames per chunk.
+  int32 FramesPerChunk() const { return frames_per_chunk_; }
+
+  int32 LeftContext() const { return left_context_; }
+  int32 RightContext() const { return right_context_; }
+
+  /// Works out the range of input frames that chunk "chunk" (numbered from
+  /// zero) needs: *first_frame may be negative, and the frames may go past the
+  /// end of the utterance, in which case the calling code should repeat the
+  /// first or last frame.  The output frames of the chunk are
+  /// chunk * FramesPerChunk() ... (chunk + 1) * FramesPerChunk() - 1.
+  void GetChunkInputRange(int32 chunk, int32 *first_frame,
+                          int32 *num_frames) const;
+
+  /// Returns true if the nnet has an input named "ivector".
+  bool HasIvectors() const { return has_ivectors_; }
+
+  int32 InputDim() const { return nnet_.InputDim("input"); }
+  int32 IvectorDim() const { return std::max<int32>(0, nnet_.InputDim("ivector")); }
+  int32 OutputDim() const { return nnet_.OutputDim("output"); }
+
+  /// True if this was created from an acoustic model, in which case the
+  /// output has the log-priors (if set) subtracted and the acoustic scale
+  /// applied.
+  bool IsAcousticModel() const { return is_am_; }
+
+  /// Log-priors to subtract from the output (empty if not an acoustic model,
+  /// or if the priors are not set).
+  const CuVector<BaseFloat> &LogPriors() const { return log_priors_; }
+
+  /// The computation for chunk 0 (if initial == true) or for later chunks.
+  const NnetComputation &Computation(bool initial) const {
+    return (initial ? *initial_computation_ : *computation_);
+  }
+
+  /// The names of the Component nodes whose values are carried between
+  /// chunks; the corresponding output nodes are named <name>-carry.
+  const std::vector<std::string> &CarriedNodes() const { return carried_nodes_; }
+
+ private:
+  void Init(const Nnet &nnet);
+  // Creates the request for the first chunk (if initial == true) or for later
+  // chunks.
+  void GetRequest(bool initial, ComputationRequest *request) const;
+
+  NnetSimpleLoopedComputationOptions opts_;
+  Nnet nnet_;
+  int32 frames_per_chunk_;
+  int32 left_context_;
+  int32 right_context_;
+  bool has_ivectors_;
+  bool is_am_;
+  CuVector<BaseFloat> log_priors_;
+  std::vector<std::string> carried_nodes_;
+  // The computations are owned by compiler_.
+  CachingOptimizingCompiler *compiler_;
+  const NnetComputation *initial_computation_;
+  const NnetComputation *computation_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableNnetSimpleLoopedInfo);
+};
+
+
+/**
+   NnetLoopedComputer does the looped computation for one utterance, one chunk
+   at a time: it holds the values carried over from the previous chunk.  It is
+   used by the decodable classes (batch and online), which are responsible for
+   getting the input features for each chunk.
+*/
+class NnetLoopedComputer {
+ public:
+  /// "info" must outlive this object.
+  explicit NnetLoopedComputer(const DecodableNnetSimpleLoopedInfo &info);
+
+  /// Computes the next chunk.  "input" must have the rows given by
+  /// info.GetChunkInputRange(NumChunksDone(), ...), and "ivector" must be the
+  /// iVector to use for this chunk (empty if the nnet has no iVector input).
+  /// The output (with the log-priors subtracted and the acoustic scale
+  /// applied, if "info" was created from an acoustic model) is written to
+  /// "output", which will have info.FramesPerChunk() rows.  "output" is in
+  /// pinned memory so that, if we are using a GPU, it can be copied from the
+  /// GPU at full speed; reuse the same one for each chunk.
+  void ComputeChunk(const MatrixBase<BaseFloat> &input,
+                    const VectorBase<BaseFloat> &ivector,
+                    PinnedMatrix<BaseFloat> *output);
+
+  int32 NumChunksDone() const { return num_chunks_; }
+
+ private:
+  const DecodableNnetSimpleLoopedInfo &info_;
+  int32 num_chunks_;
+  // carried_[i] is the output of info_.CarriedNodes()[i] on the last
+  // info_.FramesPerChunk() frames of the previous chunk.
+  std::vector<CuMatrix<BaseFloat> > carried_;
+};
+
+
+/**
+   DecodableNnetSimpleLooped does the looped neural net computation for
+   features that are all available at once (see DecodableNnetSimpleLoopedInfo
+   for the details).  It has the same iVector options as NnetSimpleComputer.
+   The frames must be requested in order (as decoders do), since the
+   computation can't go back.
+*/
+class DecodableNnetSimpleLooped {
+ public:
+  /// Note: it stores references to all arguments to the constructor, so don't
+  /// delete them till this goes out of scope.
+  DecodableNnetSimpleLooped(const DecodableNnetSimpleLoopedInfo &info,
+                            const MatrixBase<BaseFloat> &feats,
+                            const VectorBase<BaseFloat> *ivector = NULL,
+                            const MatrixBase<BaseFloat> *online_ivectors = NULL,
+                            int32 online_ivector_period = 1);
+
+  int32 NumFrames() const { return feats_.NumRows(); }
+
+  int32 OutputDim() const { return info_.OutputDim(); }
+
+  /// Returns a pointer to the output for this frame, which is valid until the
+  /// next call to this function.
+  const BaseFloat *GetOutputForFrame(int32 frame);
+
+  /// Computes the output for all the frames.
+  void GetOutput(Matrix<BaseFloat> *output);
+
+ private:
+  // Computes the next chunk into current_log_post_.
+  void AdvanceChunk();
+  // Gets the iVector for a chunk whose last input frame is "last_input_frame".
+  void GetCurrentIvector(int32 last_input_frame, Vector<BaseFloat> *ivector);
+
+  const DecodableNnetSimpleLoopedInfo &info_;
+  NnetLoopedComputer computer_;
+  const MatrixBase<BaseFloat> &feats_;
+  const VectorBase<BaseFloat> *ivector_;
+  const MatrixBase<BaseFloat> *online_ivector_feats_;
+  int32 online_ivector_period_;
+
+  // The output of the most recent chunk, and its first frame.
+  PinnedMatrix<BaseFloat> current_log_post_;
+  int32 current_log_post_offset_;
+};
+
+
+/**
+   DecodableAmNnetSimpleLooped is a decodable object that decodes with a neural
+   net acoustic model of type AmNnetSimple using the looped computation; it's
+   the looped counterpart of DecodableAmNnetSimple.  "info" should have been
+   created from the acoustic model.
+*/
+class DecodableAmNnetSimpleLooped: public DecodableInterface {
+ public:
+  /// Note: it stores references to all arguments to the constructor, so don't
+  /// delete them till this goes out of scope.
+  DecodableAmNnetSimpleLooped(const DecodableNnetSimpleLoopedInfo &info,
+                              const TransitionModel &trans_model,
+                              const MatrixBase<BaseFloat> &feats,
+                              const VectorBase<BaseFloat> *ivector = NULL,
+                              const MatrixBase<BaseFloat> *online_ivectors = NULL,
+                              int32 online_ivector_period = 1);
+
+  virtual BaseFloat LogLikelihood(int32 frame, int32 transition_id);
+
+  virtual const BaseFloat *GetFrameScores(int32 frame,
+                                          const int32 **index_to_row);
+
+  virtual int32 NumFramesReady() const { return decodable_nnet_.NumFrames(); }
+
+  // Note: these indices are one-based!  This is for compatibility with OpenFst.
+  virtual int32 NumIndices() const { return trans_model_.NumTransitionIds(); }
+
+  virtual bool IsLastFrame(int32 frame) const {
+    KALDI_ASSERT(frame < NumFramesReady());
+    return (frame == NumFramesReady() - 1);
+  }
+
+ private:
+  DecodableNnetSimpleLooped decodable_nnet_;
+  const TransitionModel &trans_model_;
+};
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+#endif  // KALDI_NNET3_DECODABLE_SIMPLE_LOOPED_H_
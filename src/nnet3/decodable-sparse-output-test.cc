@@ -0,0 +1,155 @@
+// nnet3/decodable-sparse-output-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/decodable-sparse-output.h"
+#include "nnet3/nnet-simple-computer.h"
+#include "nnet3/nnet-utils.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// Returns the config of a small TDNN-like nnet with output dimension
+// "output_dim".
+std::string SparseOutputTestConfig(bool log_softmax, int32 ivector_dim,
+                                   int32 output_dim) {
+  std::ostringstream os;
+  int32 input_dim = 10;
+  os << "component name=affine1 type=NaturalGradientAffineComponent "
+     << "input-dim=" << (3 * input_dim + ivector_dim) << " output-dim=20\n"
+     << "component name=relu1 type=RectifiedLinearComponent dim=20\n"
+     << "component name=final-affine type=NaturalGradientAffineComponent "
+     << "input-dim=20 output-dim=" << output_dim << "\n";
+  if (log_softmax)
+    os << "component name=final-log-softmax type=LogSoftmaxComponent dim="
+       << output_dim << "\n";
+  os << "input-node name=input dim=" << input_dim << "\n";
+  if (ivector_dim > 0)
+    os << "input-node name=ivector dim=" << ivector_dim << "\n";
+  os << "component-node name=affine1 component=affine1 "
+     << "input=Append(Offset(input, -1), input, Offset(input, 1)";
+  if (ivector_dim > 0)
+    os << ", ReplaceIndex(ivector, t, 0)";
+  os << ")\n"
+     << "component-node name=relu1 component=relu1 input=affine1\n"
+     << "component-node name=final-affine component=final-affine "
+     << "input=relu1\n";
+  if (log_softmax)
+    os << "component-node name=final-log-softmax "
+       << "component=final-log-softmax input=final-affine\n"
+       << "output-node name=output input=final-log-softmax\n";
+  else
+    os << "output-node name=output input=final-affine\n";
+  return os.str();
+}
+
+void UnitTestDecodableNnetSparseOutput() {
+  for (int32 n = 0; n < 12; n++) {
+    bool log_softmax = (n % 2 == 0);
+    int32 ivector_dim = (n % 3 == 0 ? 4 : 0), output_dim = 50;
+    Nnet nnet;
+    {
+      std::istringstream is(SparseOutputTestConfig(log_softmax, ivector_dim,
+                                                   output_dim));
+      nnet.ReadConfig(is);
+    }
+    KALDI_ASSERT(NnetSparseOutputInfo::IsSupported(nnet));
+    // 0 leaves out the normalizer; 20 (the input dimension of the final
+    // layer) makes it exact.
+    int32 normalizer_rank = (n % 4 < 2 ? 0 : 20);
+    NnetSparseOutputInfo info(nnet, normalizer_rank);
+    KALDI_ASSERT(info.OutputDim() == output_dim &&
+                 info.LeftContext() == 1 && info.RightContext() == 1 &&
+                 info.GetNnet().OutputDim("output") == 20);
+
+    NnetSimpleComputerOptions opts;
+    opts.frames_per_chunk = RandInt(1, 20);
+    Matrix<BaseFloat> feats(RandInt(1, 50), 10);
+    feats.SetRandn();
+    Vector<BaseFloat> ivector(ivector_dim);
+    ivector.SetRandn();
+    const Vector<BaseFloat> *ivector_ptr =
+        (ivector_dim > 0 ? &ivector : NULL);
+
+    Matrix<BaseFloat> ref_output;
+    {
+      NnetSimpleComputer computer(opts, nnet, feats, ivector_ptr);
+      computer.GetOutput(&ref_output);
+    }
+    Matrix<BaseFloat> output;
+    {
+      DecodableNnetSparseOutput decodable(opts, info, feats, ivector_ptr);
+      KALDI_ASSERT(decodable.NumFrames() == feats.NumRows());
+      // Ask for some outputs one by one first, in the order a decoder would.
+      for (int32 t = 0; t < decodable.NumFrames(); t++) {
+        for (int32 i = 0; i < 5; i++) {
+          int32 index = RandInt(0, output_dim - 1);
+          BaseFloat a = decodable.GetOutput(t, index);
+          KALDI_ASSERT(a == decodable.GetOutput(t, index));
+          KALDI_ASSERT(a == decodable.GetOutputForFrame(t)[index]);
+        }
+      }
+      decodable.GetOutput(&output);
+    }
+    if (!log_softmax || normalizer_rank > 0) {
+      KALDI_ASSERT(output.ApproxEqual(ref_output, 0.001));
+    } else {
+      // Without the normalizer, each row differs by a constant.
+      Vector<BaseFloat> diff(output_dim);
+      for (int32 t = 0; t < output.NumRows(); t++) {
+        diff.CopyFromVec(output.Row(t));
+        diff.AddVec(-1.0, ref_output.Row(t));
+        KALDI_ASSERT(diff.Max() - diff.Min() < 0.001 * output_dim);
+        // The reference output is normalized, so "diff" is the normalizer.
+        KALDI_ASSERT(ApproxEqual(diff(0), output.Row(t).LogSumExp(), 0.001));
+      }
+    }
+  }
+  // The last layer must be affine.
+  Nnet nnet;
+  std::istringstream is(
+      "component name=affine1 type=AffineComponent input-dim=10 "
+      "output-dim=20\n"
+      "component name=relu1 type=RectifiedLinearComponent dim=20\n"
+      "input-node name=input dim=10\n"
+      "component-node name=affine1 component=affine1 input=input\n"
+      "component-node name=relu1 component=relu1 input=affine1\n"
+      "output-node name=output input=relu1\n");
+  nnet.ReadConfig(is);
+  KALDI_ASSERT(!NnetSparseOutputInfo::IsSupported(nnet));
+}
+
+} // namespace nnet3
+} // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::nnet3;
+
+  for (int32 loop = 0; loop < 2; loop++) {
+#if HAVE_CUDA == 1
+    if (loop == 0)
+      CuDevice::Instantiate().SelectGpuId("no");
+    else
+      CuDevice::Instantiate().SelectGpuId("yes");
+#endif
+    UnitTestDecodableNnetSparseOutput();
+  }
+
+  KALDI_LOG << "Sparse output tests succeeded.";
+
+  return 0;
+}
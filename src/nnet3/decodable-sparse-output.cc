@@ -0,0 +1,255 @@
+// nnet3/decodable-sparse-output.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+
+#include "nnet3/decodable-sparse-output.h"
+#include "nnet3/nnet-simple-component.h"
+#include "nnet3/nnet-utils.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+namespace {
+
+// If descriptor node "node" just refers to a Component node (with no offsets,
+// appending, etc.), returns that node; else returns -1.
+int32 SimpleInputNode(const Nnet &nnet, int32 node) {
+  std::ostringstream os;
+  nnet.GetNode(node).descriptor.WriteConfig(os, nnet.GetNodeNames());
+  int32 input_node = nnet.GetNodeIndex(os.str());
+  if (input_node == -1 || !nnet.IsComponentNode(input_node))
+    return -1;
+  return input_node;
+}
+
+// Finds the Component node of the final affine layer, and sets
+// *has_log_softmax; returns -1 if the nnet's output is not of the form
+// that NnetSparseOutputInfo supports.
+int32 FindFinalAffineNode(const Nnet &nnet, bool *has_log_softmax) {
+  *has_log_softmax = false;
+  int32 output_node = nnet.GetNodeIndex("output");
+  if (output_node == -1 || !nnet.IsOutputNode(output_node))
+    return -1;
+  int32 node = SimpleInputNode(nnet, output_node);
+  if (node == -1)
+    return -1;
+  const Component *component =
+      nnet.GetComponent(nnet.GetNode(node).u.component_index);
+  if (dynamic_cast<const LogSoftmaxComponent*>(component) != NULL) {
+    *has_log_softmax = true;
+    // The component-input node precedes its component node.
+    node = SimpleInputNode(nnet, node - 1);
+    if (node == -1)
+      return -1;
+    component = nnet.GetComponent(nnet.GetNode(node).u.component_index);
+  }
+  if (dynamic_cast<const AffineComponent*>(component) == NULL)
+    return -1;
+  return node;
+}
+
+}  // namespace
+
+bool NnetSparseOutputInfo::IsSupported(const Nnet &nnet) {
+  bool has_log_softmax;
+  return FindFinalAffineNode(nnet, &has_log_softmax) != -1;
+}
+
+NnetSparseOutputInfo::NnetSparseOutputInfo(const Nnet &nnet,
+                                           int32 normalizer_rank) {
+  KALDI_ASSERT(IsSimpleNnet(nnet) && normalizer_rank >= 0);
+  int32 affine_node = FindFinalAffineNode(nnet, &has_log_softmax_);
+  if (affine_node == -1)
+    KALDI_ERR << "The sparse output computation needs the nnet's output to "
+              << "be an affine layer, possibly followed by a log-softmax.";
+  ComputeSimpleNnetContext(nnet, &left_context_, &right_context_);
+
+  const AffineComponent *affine = dynamic_cast<const AffineComponent*>(
+      nnet.GetComponent(nnet.GetNode(affine_node).u.component_index));
+  linear_params_.Resize(affine->LinearParams().NumRows(),
+                        affine->LinearParams().NumCols(), kUndefined);
+  affine->LinearParams().CopyToMat(&linear_params_);
+  bias_params_.Resize(affine->BiasParams().Dim(), kUndefined);
+  affine->BiasParams().CopyToVec(&bias_params_);
+
+  // Our copy of the nnet outputs the input of the final layer; the final
+  // layer itself is removed, as it's no longer used.
+  nnet_ = nnet;
+  std::ostringstream config;
+  config << "output-node name=output input=";
+  nnet.GetNode(affine_node - 1).descriptor.WriteConfig(config,
+                                                       nnet.GetNodeNames());
+  config << "\n";
+  std::istringstream is(config.str());
+  nnet_.ReadConfig(is);
+  nnet_.RemoveOrphanNodes();
+  nnet_.RemoveOrphanComponents();
+
+  if (has_log_softmax_ && normalizer_rank > 0) {
+    int32 input_dim = linear_params_.NumCols(),
+        rank = std::min(normalizer_rank, input_dim);
+    // The top eigenvectors of W^T W give the best rank-"rank" approximation
+    // W P P^T of W, in the Frobenius norm.
+    SpMatrix<BaseFloat> scatter(input_dim);
+    scatter.AddMat2(1.0, linear_params_, kTrans, 0.0);
+    Vector<BaseFloat> eigs(rank);
+    normalizer_proj_.Resize(input_dim, rank);
+    scatter.TopEigs(&eigs, &normalizer_proj_);
+    normalizer_params_.Resize(linear_params_.NumRows(), rank);
+    normalizer_params_.AddMatMat(1.0, linear_params_, kNoTrans,
+                                 normalizer_proj_, kNoTrans, 0.0);
+  }
+  KALDI_LOG << "Sparse output computation: final layer has "
+            << linear_params_.NumRows() << " outputs and input dimension "
+            << linear_params_.NumCols()
+            << (!has_log_softmax_ ? ", with no log-softmax." :
+                (normalizer_proj_.NumCols() > 0 ?
+                 ", with the log-softmax normalizer approximated." :
+                 ", leaving out the log-softmax normalizer."));
+}
+
+void NnetSparseOutputInfo::ComputeAllOutputs(
+    const VectorBase<BaseFloat> &hidden,
+    VectorBase<BaseFloat> *output) const {
+  output->CopyFromVec(bias_params_);
+  output->AddMatVec(1.0, linear_params_, kNoTrans, hidden, 1.0);
+}
+
+void NnetSparseOutputInfo::ComputeNormalizers(
+    const MatrixBase<BaseFloat> &hidden,
+    Vector<BaseFloat> *normalizers) const {
+  normalizers->Resize(hidden.NumRows());  // zeroes it.
+  if (normalizer_proj_.NumCols() == 0)
+    return;
+  Matrix<BaseFloat> projected(hidden.NumRows(), normalizer_proj_.NumCols(),
+                              kUndefined),
+      outputs(hidden.NumRows(), OutputDim(), kUndefined);
+  projected.AddMatMat(1.0, hidden, kNoTrans, normalizer_proj_, kNoTrans, 0.0);
+  outputs.CopyRowsFromVec(bias_params_);
+  outputs.AddMatMat(1.0, projected, kNoTrans, normalizer_params_, kTrans, 1.0);
+  for (int32 r = 0; r < hidden.NumRows(); r++)
+    (*normalizers)(r) = outputs.Row(r).LogSumExp();
+}
+
+
+DecodableNnetSparseOutput::DecodableNnetSparseOutput(
+    const NnetSimpleComputerOptions &opts,
+    const NnetSparseOutputInfo &info,
+    const MatrixBase<BaseFloat> &feats,
+    const VectorBase<BaseFloat> *ivector,
+    const MatrixBase<BaseFloat> *online_ivectors,
+    int32 online_ivector_period):
+    NnetSimpleComputer(opts, info.GetNnet(), feats, info.LeftContext(),
+                       info.RightContext(), ivector, online_ivectors,
+                       online_ivector_period),
+    info_(info), temp_output_(info.OutputDim()) { }
+
+void DecodableNnetSparseOutput::DoNnetComputation(
+    int32 input_t_start,
+    const MatrixBase<BaseFloat> &input_feats,
+    const VectorBase<BaseFloat> &ivector,
+    int32 output_t_start,
+    int32 num_output_frames) {
+  CuMatrix<BaseFloat> cu_hidden;
+  DoNnetComputationInternal(input_t_start, input_feats, ivector,
+                            output_t_start, num_output_frames, &cu_hidden);
+  hidden_.Resize(cu_hidden.NumRows(), cu_hidden.NumCols(), kUndefined);
+  cu_hidden.CopyToMat(&hidden_);
+  info_.ComputeNormalizers(hidden_, &normalizers_);
+  // The outputs are computed when they are asked for.
+  current_log_post_.Resize(num_output_frames, OutputDim(), kUndefined);
+  computed_.assign(static_cast<size_t>(num_output_frames) * OutputDim(), 0);
+  current_log_post_offset_ = output_t_start;
+}
+
+const BaseFloat *DecodableNnetSparseOutput::GetOutputForFrame(int32 frame) {
+  if (frame < current_log_post_offset_ ||
+      frame >= current_log_post_offset_ + current_log_post_.NumRows())
+    EnsureFrameIsComputed(frame);
+  int32 row = frame - current_log_post_offset_, dim = OutputDim();
+  info_.ComputeAllOutputs(hidden_.Row(row), &temp_output_);
+  BaseFloat *data = current_log_post_.RowData(row);
+  char *computed = &(computed_[static_cast<size_t>(row) * dim]);
+  BaseFloat normalizer = normalizers_(row);
+  // We keep the values we already returned, which might differ in the last
+  // bit from those of the matrix-vector product.
+  for (int32 i = 0; i < dim; i++) {
+    if (!computed[i]) {
+      data[i] = temp_output_(i) - normalizer;
+      computed[i] = 1;
+    }
+  }
+  return data;
+}
+
+void DecodableNnetSparseOutput::GetOutput(Matrix<BaseFloat> *output) {
+  output->Resize(NumFrames(), OutputDim(), kUndefined);
+  for (int32 t = 0; t < NumFrames(); t++) {
+    const BaseFloat *data = GetOutputForFrame(t);
+    std::copy(data, data + OutputDim(), output->RowData(t));
+  }
+}
+
+
+DecodableAmNnetSparseOutput::DecodableAmNnetSparseOutput(
+    const DecodableAmNnetSimpleOptions &opts,
+    const NnetSparseOutputInfo &info,
+    const TransitionModel &trans_model,
+    const AmNnetSimple &am_nnet,
+    const MatrixBase<BaseFloat> &feats,
+    const VectorBase<BaseFloat> *ivector,
+    const MatrixBase<BaseFloat> *online_ivectors,
+    int32 online_ivector_period):
+    decodable_nnet_(opts.simple_computer_opts, info, feats, ivector,
+                    online_ivectors, online_ivector_period),
+    trans_model_(trans_model),
+    acoustic_scale_(opts.acoustic_scale),
+    frame_scores_frame_(-1) {
+  if (am_nnet.Priors().Dim() != 0) {
+    log_priors_ = am_nnet.Priors();
+    log_priors_.ApplyLog();
+  }
+}
+
+BaseFloat DecodableAmNnetSparseOutput::LogLikelihood(int32 frame,
+                                                     int32 transition_id) {
+  int32 pdf_id = trans_model_.TransitionIdToPdf(transition_id);
+  BaseFloat output = decodable_nnet_.GetOutput(frame, pdf_id);
+  if (log_priors_.Dim() != 0)
+    output -= log_priors_(pdf_id);
+  return acoustic_scale_ * output;
+}
+
+const BaseFloat *DecodableAmNnetSparseOutput::GetFrameScores(
+    int32 frame, const int32 **index_to_row) {
+  *index_to_row = &(trans_model_.TransitionIdToPdfArray()[0]);
+  if (frame != frame_scores_frame_) {
+    int32 dim = decodable_nnet_.OutputDim();
+    const BaseFloat *data = decodable_nnet_.GetOutputForFrame(frame);
+    frame_scores_.Resize(dim, kUndefined);
+    std::copy(data, data + dim, frame_scores_.Data());
+    if (log_priors_.Dim() != 0)
+      frame_scores_.AddVec(-1.0, log_priors_);
+    frame_scores_.Scale(acoustic_scale_);
+    frame_scores_frame_ = frame;
+  }
+  return frame_scores_.Data();
+}
+
+} // namespace nnet3
+} // namespace kaldi
@@ -0,0 +1,233 @@
+// nnet3/decodable-sparse-output.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_DECODABLE_SPARSE_OUTPUT_H_
+#define KALDI_NNET3_DECODABLE_SPARSE_OUTPUT_H_
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "hmm/transition-model.h"
+#include "itf/decodable-itf.h"
+#include "nnet3/nnet-am-decodable-simple.h"
+#include "nnet3/nnet-simple-computer.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+/**
+   NnetSparseOutputInfo contains what the "sparse output" computation needs,
+   and can be shared between utterances (and threads, as after construction it
+   is only read).
+
+   In CPU decoding with a large output layer, most of the time goes into the
+   final affine layer (and log-softmax), although the decoder only asks for
+   the pdfs of the active tokens on each frame, typically a few hundred.  The
+   sparse output computation runs the nnet in chunks as NnetSimpleComputer
+   does, but only up to the input of the final affine layer; the output for a
+   (frame, pdf) is computed the first time it is asked for, as a dot product
+   with the final layer's row for that pdf, and cached for the chunk.
+
+   This requires the "output" node of the nnet to be an AffineComponent
+   (including NaturalGradientAffineComponent), optionally followed by a
+   LogSoftmaxComponent.  For a log-softmax, the per-frame normalizer (the
+   log-sum-exp of all the outputs) needs all the outputs, so we either leave
+   it out (normalizer_rank == 0) or approximate it from a cheap pass through a
+   rank-"normalizer_rank" approximation of the final layer.  Leaving it out
+   changes all the log-likelihoods of a frame by the same amount, which
+   doesn't change the search, or the posteriors of the lattice, as every path
+   has exactly one emitting arc per frame; but the total likelihoods (e.g. the
+   acoustic costs in lattices) are different.  Without a log-softmax (e.g.
+   chain models) the output is exact.
+*/
+class NnetSparseOutputInfo {
+ public:
+  /// Returns true if the nnet's output is as this class requires (see above).
+  static bool IsSupported(const Nnet &nnet);
+
+  /// "nnet" must satisfy IsSupported(nnet) and IsSimpleNnet(nnet).  If
+  /// normalizer_rank > 0 and the output has a log-softmax, the normalizer is
+  /// computed with a rank-"normalizer_rank" approximation of the final layer
+  /// (a rank >= its input dimension makes it exact).
+  NnetSparseOutputInfo(const Nnet &nnet, int32 normalizer_rank);
+
+  /// The modified copy of the nnet, whose "output" is the input of the final
+  /// affine layer.
+  const Nnet &GetNnet() const { return nnet_; }
+
+  /// The context of the original nnet.
+  int32 LeftContext() const { return left_context_; }
+  int32 RightContext() const { return right_context_; }
+
+  /// The dimension of the output of the original nnet.
+  int32 OutputDim() const { return linear_params_.NumRows(); }
+
+  /// Computes output "index" of the final affine layer for one frame, given
+  /// its input "hidden" (a row of GetNnet()'s output); no normalizer.
+  BaseFloat ComputeOutput(const VectorBase<BaseFloat> &hidden,
+                          int32 index) const {
+    return VecVec(linear_params_.Row(index), hidden) + bias_params_(index);
+  }
+
+  /// Computes all the outputs of the final affine layer for one frame.
+  void ComputeAllOutputs(const VectorBase<BaseFloat> &hidden,
+                         VectorBase<BaseFloat> *output) const;
+
+  /// Outputs the normalizer to subtract from the outputs of each frame (row)
+  /// of "hidden": zero if there is no log-softmax or normalizer_rank is zero,
+  /// else the approximated log-sum-exp of the outputs.
+  void ComputeNormalizers(const MatrixBase<BaseFloat> &hidden,
+                          Vector<BaseFloat> *normalizers) const;
+
+ private:
+  Nnet nnet_;
+  int32 left_context_;
+  int32 right_context_;
+  bool has_log_softmax_;
+  // The parameters of the final affine layer.
+  Matrix<BaseFloat> linear_params_;
+  Vector<BaseFloat> bias_params_;
+  // If we approximate the normalizer: the top eigenvectors of
+  // linear_params_^T linear_params_, as columns (input-dim by rank), and
+  // linear_params_ times that (output-dim by rank).
+  Matrix<BaseFloat> normalizer_proj_;
+  Matrix<BaseFloat> normalizer_params_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(NnetSparseOutputInfo);
+};
+
+
+/**
+   DecodableNnetSparseOutput does the sparse output computation (see
+   NnetSparseOutputInfo) for one utterance.  It has the same options and
+   iVector arguments as NnetSimpleComputer.
+*/
+class DecodableNnetSparseOutput: public NnetSimpleComputer {
+ public:
+  /// Note: it stores references to all arguments to the constructor, so don't
+  /// delete them till this goes out of scope.  If you use a shared compiler
+  /// (SetSharedCompiler()), it must be for info.GetNnet().
+  DecodableNnetSparseOutput(const NnetSimpleComputerOptions &opts,
+                            const NnetSparseOutputInfo &info,
+                            const MatrixBase<BaseFloat> &feats,
+                            const VectorBase<BaseFloat> *ivector = NULL,
+                            const MatrixBase<BaseFloat> *online_ivectors = NULL,
+                            int32 online_ivector_period = 1);
+
+  int32 NumFrames() const { return feats_.NumRows(); }
+
+  int32 OutputDim() const { return info_.OutputDim(); }
+
+  /// Returns output "index" for frame "frame".
+  BaseFloat GetOutput(int32 frame, int32 index) {
+    if (frame < current_log_post_offset_ ||
+        frame >= current_log_post_offset_ + current_log_post_.NumRows())
+      EnsureFrameIsComputed(frame);
+    int32 row = frame - current_log_post_offset_;
+    char &computed = computed_[static_cast<size_t>(row) * OutputDim() + index];
+    if (!computed) {
+      current_log_post_(row, index) =
+          info_.ComputeOutput(hidden_.Row(row), index) - normalizers_(row);
+      computed = 1;
+    }
+    return current_log_post_(row, index);
+  }
+
+  /// Returns a pointer to all the outputs for this frame, which is valid until
+  /// a frame from another chunk is asked for.
+  const BaseFloat *GetOutputForFrame(int32 frame);
+
+  /// Computes the output for all the frames (this is slower than the regular
+  /// computation, and is mainly for testing).
+  void GetOutput(Matrix<BaseFloat> *output);
+
+ private:
+  // Computes the input of the final layer into hidden_, and the normalizers,
+  // and clears the cache of outputs.
+  virtual void DoNnetComputation(int32 input_t_start,
+                                 const MatrixBase<BaseFloat> &input_feats,
+                                 const VectorBase<BaseFloat> &ivector,
+                                 int32 output_t_start,
+                                 int32 num_output_frames);
+
+  const NnetSparseOutputInfo &info_;
+  // The input of the final layer for the current chunk.
+  Matrix<BaseFloat> hidden_;
+  Vector<BaseFloat> normalizers_;
+  // The outputs for the current chunk are cached in current_log_post_;
+  // computed_[row * OutputDim() + index] is nonzero if that element is set.
+  std::vector<char> computed_;
+  Vector<BaseFloat> temp_output_;
+};
+
+
+/**
+   DecodableAmNnetSparseOutput is a decodable object that decodes with a
+   neural net acoustic model of type AmNnetSimple using the sparse output
+   computation (see NnetSparseOutputInfo); it is the counterpart of
+   DecodableAmNnetSimple, and is faster on CPU if the output layer is large.
+   "info" should have been created from am_nnet.GetNnet().
+*/
+class DecodableAmNnetSparseOutput: public DecodableInterface {
+ public:
+  /// Note: it stores references to all arguments to the constructor, so don't
+  /// delete them till this goes out of scope.
+  DecodableAmNnetSparseOutput(const DecodableAmNnetSimpleOptions &opts,
+                              const NnetSparseOutputInfo &info,
+                              const TransitionModel &trans_model,
+                              const AmNnetSimple &am_nnet,
+                              const MatrixBase<BaseFloat> &feats,
+                              const VectorBase<BaseFloat> *ivector = NULL,
+                              const MatrixBase<BaseFloat> *online_ivectors = NULL,
+                              int32 online_ivector_period = 1);
+
+  virtual BaseFloat LogLikelihood(int32 frame, int32 transition_id);
+
+  virtual const BaseFloat *GetFrameScores(int32 frame,
+                                          const int32 **index_to_row);
+
+  virtual int32 NumFramesReady() const { return decodable_nnet_.NumFrames(); }
+
+  // Note: these indices are one-based!  This is for compatibility with OpenFst.
+  virtual int32 NumIndices() const { return trans_model_.NumTransitionIds(); }
+
+  virtual bool IsLastFrame(int32 frame) const {
+    KALDI_ASSERT(frame < NumFramesReady());
+    return (frame == NumFramesReady() - 1);
+  }
+
+  /// See NnetSimpleComputer::SetSharedCompiler(); the compiler must be for
+  /// info.GetNnet().
+  void SetSharedCompiler(CachingOptimizingCompiler *compiler) {
+    decodable_nnet_.SetSharedCompiler(compiler);
+  }
+
+ private:
+  DecodableNnetSparseOutput decodable_nnet_;
+  const TransitionModel &trans_model_;
+  BaseFloat acoustic_scale_;
+  Vector<BaseFloat> log_priors_;  // empty if the priors are not set.
+  // The scores of frame_scores_frame_, for GetFrameScores().
+  Vector<BaseFloat> frame_scores_;
+  int32 frame_scores_frame_;
+};
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+#endif  // KALDI_NNET3_DECODABLE_SPARSE_OUTPUT_H_
@@ -271,13 +271,22 @@ void OnlineNaturalGradient::PreconditionDirectionsInternal(
     // intended.
     num_updates_skipped_++;
 
-    BaseFloat tr_Xt_XtT = TraceMatMat(*X_t, *X_t, kTrans);
+    // To avoid two separate device-to-host transfers (each of which has to
+    // wait for the GPU to finish its queued work), we get tr(X_t X_t^T) and
+    // tr(X_hat_t X_hat_t^T) by summing on the CPU the inner products of the
+    // rows, which we copy together: row 0 of "row_prods" is for X_t, and row 1
+    // is for X_hat_t.
+    CuMatrix<BaseFloat> row_prods(2, N, kUndefined);
+    row_prods.Row(0).AddDiagMat2(1.0, *X_t, kNoTrans, 0.0);
     // X_hat_t = X_t - H_t W_t
     X_t->AddMatMat(-1.0, H_t, kNoTrans, W_t, kNoTrans, 1.0);
     // each element i of row_prod will be inner product of row i of X_hat_t with
     // itself.
-    row_prod->AddDiagMat2(1.0, *X_t, kNoTrans, 0.0);
-    BaseFloat tr_Xhat_XhatT = row_prod->Sum();
+    row_prods.Row(1).AddDiagMat2(1.0, *X_t, kNoTrans, 0.0);
+    row_prod->CopyFromVec(row_prods.Row(1));
+    Matrix<BaseFloat> row_prods_cpu(row_prods);
+    BaseFloat tr_Xt_XtT = row_prods_cpu.Row(0).Sum(),
+        tr_Xhat_XhatT = row_prods_cpu.Row(1).Sum();
     KALDI_ASSERT(tr_Xhat_XhatT == tr_Xhat_XhatT);  // Check for NaN.
     BaseFloat gamma_t = (tr_Xhat_XhatT == 0.0 ? 1.0 :
                          sqrt(tr_Xt_XtT / tr_Xhat_XhatT));
@@ -301,7 +310,20 @@ void OnlineNaturalGradient::PreconditionDirectionsInternal(
     L_t.SymAddMat2(1.0, H_t, kTrans, 0.0);
   }
 
+  BaseFloat tr_Xt_XtT_check;
+  if (self_debug_)
+    tr_Xt_XtT_check = TraceMatMat(*X_t, *X_t, kTrans);
+
+  // We compute X_hat_t and its row inner-products now, rather than after the
+  // CPU part of the update below, so that the GPU work for them is queued
+  // before we copy L_t and K_t to the CPU and there is only one point at which
+  // we wait for the GPU.
+  X_t->AddMatMat(-1.0, H_t, kNoTrans, W_t, kNoTrans, 1.0);  // X_hat_t = X_t - H_t W_t
+  // set *row_prod to inner products of each row of X_hat_t with itself.
+  row_prod->AddDiagMat2(1.0, *X_t, kNoTrans, 0.0);
+
   Matrix<BaseFloat> LK_cpu(LK_t);  // contains L and K on the CPU.
+  Vector<BaseFloat> row_prod_cpu(*row_prod);
   SubMatrix<BaseFloat> L_t_cpu(LK_cpu, 0, R, 0, R),
       K_t_cpu(LK_cpu, R, R, 0, R);
   if (!compute_lk_together) {
@@ -344,15 +366,7 @@ void OnlineNaturalGradient::PreconditionDirectionsInternal(
   if (nf > 0 && self_debug_) {
     KALDI_WARN << "Floored " << nf << " elements of C_t.";
   }
-  BaseFloat tr_Xt_XtT_check;
-  if (self_debug_)
-    tr_Xt_XtT_check = TraceMatMat(*X_t, *X_t, kTrans);
-
-  X_t->AddMatMat(-1.0, H_t, kNoTrans, W_t, kNoTrans, 1.0);  // X_hat_t = X_t - H_t W_t
-  // set *row_prod to inner products of each row of X_hat_t with itself.
-  row_prod->AddDiagMat2(1.0, *X_t, kNoTrans, 0.0);
-
-  BaseFloat tr_Xhat_XhatT = row_prod->Sum();
+  BaseFloat tr_Xhat_XhatT = row_prod_cpu.Sum();
   //  tr(X_t X_t^T) = tr(X_hat_t X_hat_t^T) - tr(L_t E_t) + 2 tr(L_t)
   double tr_Xt_XtT = tr_Xhat_XhatT;
   for (int32 i = 0; i < R; i++)
@@ -437,15 +451,17 @@ void OnlineNaturalGradient::ComputeWt1(int32 N,
   Vector<BaseFloat> inv_sqrt_c_t(sqrt_c_t);
   inv_sqrt_c_t.InvertElements();
 
-  Vector<BaseFloat> w_t_coeff(R);
+  // We put A_t (below) in the first R rows of "A_w", and the coefficients
+  // w_t_coeff in its last row, so that we only need one host-to-device
+  // transfer.
+  Matrix<BaseFloat> A_w(R + 1, R, kUndefined);
+  SubMatrix<BaseFloat> A_t(A_w, 0, R, 0, R);
+  SubVector<BaseFloat> w_t_coeff(A_w, R);
   for (int32 i = 0; i < R; i++)
     w_t_coeff(i) = (1.0 - eta) / (eta/N) * (d_t(i) + rho_t);
-  CuVector<BaseFloat> w_t_coeff_gpu(w_t_coeff);
-  // B_t = J_t + (1-\eta)/(\eta/N) (D_t + \rho_t I) W_t
-  J_t->AddDiagVecMat(1.0, w_t_coeff_gpu, W_t, kNoTrans, 1.0);
 
   // A_t = (\eta/N) E_{t+1}^{0.5} C_t^{-0.5} U_t^T E_t^{-0.5} B_t
-  Matrix<BaseFloat> A_t(U_t, kTrans);
+  A_t.CopyFromMat(U_t, kTrans);
   for (int32 i = 0; i < R; i++) {
     BaseFloat i_factor = (eta / N) * sqrt_e_t1(i) * inv_sqrt_c_t(i);
     for (int32 j = 0; j < R; j++) {
@@ -453,8 +469,13 @@ void OnlineNaturalGradient::ComputeWt1(int32 N,
       A_t(i, j) *= i_factor * j_factor;
     }
   }
+  CuMatrix<BaseFloat> A_w_gpu(A_w);
+  const CuSubMatrix<BaseFloat> A_t_gpu(A_w_gpu, 0, R, 0, R);
+  const CuSubVector<BaseFloat> w_t_coeff_gpu(A_w_gpu, R);
+  // B_t = J_t + (1-\eta)/(\eta/N) (D_t + \rho_t I) W_t
+  J_t->AddDiagVecMat(1.0, w_t_coeff_gpu, W_t, kNoTrans, 1.0);
+
   // W_{t+1} = A_t B_t
-  CuMatrix<BaseFloat> A_t_gpu(A_t);
   W_t1->AddMatMat(1.0, A_t_gpu, kNoTrans, *J_t, kNoTrans, 0.0);
 
   if (self_debug_) {
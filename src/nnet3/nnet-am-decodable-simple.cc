@@ -86,6 +86,15 @@ BaseFloat DecodableAmNnetSimple::LogLikelihood(int32 frame,
                            pdf_id);
 }
 
+const BaseFloat *DecodableAmNnetSimple::GetFrameScores(
+    int32 frame, const int32 **index_to_row) {
+  if (frame < current_log_post_offset_ ||
+      frame >= current_log_post_offset_ + current_log_post_.NumRows())
+    EnsureFrameIsComputed(frame);
+  *index_to_row = &(trans_model_.TransitionIdToPdfArray()[0]);
+  return current_log_post_.RowData(frame - current_log_post_offset_);
+}
+
 void DecodableAmNnetSimple::DoNnetComputation(
     int32 input_t_start,
     const MatrixBase<BaseFloat> &input_feats,
@@ -95,13 +104,15 @@ void DecodableAmNnetSimple::DoNnetComputation(
   CuMatrix<BaseFloat> cu_output;
   DoNnetComputationInternal(input_t_start, input_feats, ivector, 
                             output_t_start, num_output_frames, &cu_output);
-  // subtract log-prior (divide by prior)
-  cu_output.AddVecToRows(-1.0, priors_);
-  // apply the acoustic scale
-  cu_output.Scale(opts_.acoustic_scale);
-  current_log_post_.Resize(0, 0);
-  // the following statement just swaps the pointers if we're not using a GPU.
-  cu_output.Swap(&current_log_post_);
+  // subtract log-prior (divide by prior) and apply the acoustic scale, in one
+  // pass over the output.
+  cu_output.AddVecToRows(-opts_.acoustic_scale, priors_,
+                         opts_.acoustic_scale);
+  // current_log_post_ is in pinned memory, so if we are using a GPU this copy
+  // goes at full speed; its memory is reused from chunk to chunk.
+  current_log_post_.Resize(cu_output.NumRows(), cu_output.NumCols(),
+                           kUndefined);
+  cu_output.CopyToMat(&current_log_post_);
   current_log_post_offset_ = output_t_start;
 }
 
@@ -88,6 +88,9 @@ class DecodableAmNnetSimple: public DecodableInterface,
   // from one (this routine is called by FSTs).
   virtual BaseFloat LogLikelihood(int32 frame, int32 transition_id);
 
+  virtual const BaseFloat *GetFrameScores(int32 frame,
+                                          const int32 **index_to_row);
+
   virtual int32 NumFramesReady() const { return feats_.NumRows(); }
 
   // Note: these indices are one-based!  This is for compatibility with OpenFst.
@@ -18,6 +18,7 @@
 // limitations under the License.
 
 #include "nnet3/nnet-analyze.h"
+#include "nnet3/nnet-simple-component.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -517,8 +518,9 @@ void ComputeMatrixAccesses(
         value_matrix_index = iter->second.first,
         deriv_matrix_index = iter->second.second;
     KALDI_ASSERT(value_matrix_index > 0 && value_matrix_index < num_matrices);
-    if (nnet.IsInputNode(node_index)) {
-      // the assert checks for repeats
+    if (!nnet.IsOutputNode(node_index)) {
+      // An input node, or a Component node whose values were supplied as an
+      // input.  The assert checks for repeats.
       KALDI_ASSERT(!(*matrix_accesses)[value_matrix_index].is_input);
       (*matrix_accesses)[value_matrix_index].is_input = true;
       if (deriv_matrix_index != 0) {
@@ -741,6 +743,13 @@ void ComputationChecker::CheckComputationIndexes() const {
         if (!(properties & kPropagateInPlace) &&
             c.arg3 == c.arg4)
           KALDI_ERR << "In-place propagation not supported for this component";
+        if (c.arg5 >= 0) {
+          const AffineComponent *affine =
+              dynamic_cast<const AffineComponent*>(component);
+          if (c.arg5 >= nnet_.NumComponents() || affine == NULL ||
+              !affine->CanFuseWith(*nnet_.GetComponent(c.arg5)))
+            KALDI_ERR << "Invalid fused component in propagate command";
+        }
         break;
       }
       case kStoreStats: {
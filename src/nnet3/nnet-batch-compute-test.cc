@@ -0,0 +1,173 @@
+// nnet3/nnet-batch-compute-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/nnet-batch-compute.h"
+#include "nnet3/nnet-simple-computer.h"
+#include "nnet3/nnet-test-utils.h"
+#include "nnet3/nnet-utils.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+
+// Checks that computing several utterances together gives the same output as
+// computing them one by one with NnetSimpleComputer.
+void UnitTestNnetBatchComputer() {
+  for (int32 n = 0; n < 20; n++) {
+    struct NnetGenerationOptions gen_config;
+    // With recurrence, or with clockwork nets, the output depends on where
+    // the chunk boundaries are.
+    gen_config.allow_recursion = false;
+    gen_config.allow_clockwork = false;
+
+    std::vector<std::string> configs;
+    GenerateConfigSequence(gen_config, &configs);
+    Nnet nnet;
+    for (size_t j = 0; j < configs.size(); j++) {
+      KALDI_LOG << "Input config[" << j << "] is: " << configs[j];
+      std::istringstream is(configs[j]);
+      nnet.ReadConfig(is);
+    }
+    if (!IsSimpleNnet(nnet))
+      continue;
+    int32 input_dim = nnet.InputDim("input"),
+        ivector_dim = std::max<int32>(0, nnet.InputDim("ivector"));
+
+    NnetBatchComputerOptions batch_opts;
+    batch_opts.frames_per_chunk = RandInt(1, 20);
+    batch_opts.minibatch_size = RandInt(1, 5);
+    Vector<BaseFloat> priors;  // empty: no priors.
+    NnetBatchComputer batch_computer(batch_opts, nnet, priors);
+
+    NnetSimpleComputerOptions simple_opts;
+    simple_opts.frames_per_chunk = batch_opts.frames_per_chunk;
+
+    int32 num_utts = RandInt(1, 10);
+    std::vector<Matrix<BaseFloat> > ref_outputs(num_utts);
+    int32 num_done = 0;
+    for (int32 u = 0; u < num_utts; u++) {
+      Matrix<BaseFloat> feats(RandInt(1, 50), input_dim);
+      feats.SetRandn();
+      Vector<BaseFloat> ivector(ivector_dim);
+      ivector.SetRandn();
+      const Vector<BaseFloat> *ivector_ptr =
+          (ivector_dim > 0 ? &ivector : NULL);
+      {
+        NnetSimpleComputer computer(simple_opts, nnet, feats, ivector_ptr);
+        computer.GetOutput(&(ref_outputs[u]));
+      }
+      std::ostringstream utt;
+      utt << "utt" << u;
+      batch_computer.AcceptInput(utt.str(), feats, ivector_ptr, NULL, 0);
+      bool flush = (u + 1 == num_utts);
+      batch_computer.Compute(flush);
+      std::string this_utt;
+      Matrix<BaseFloat> output;
+      while (batch_computer.GetOutput(&this_utt, &output)) {
+        std::ostringstream expected_utt;
+        expected_utt << "utt" << num_done;
+        KALDI_ASSERT(this_utt == expected_utt.str());
+        KALDI_LOG << "Output sums are " << ref_outputs[num_done].Sum()
+                  << " (simple) and " << output.Sum() << " (batched)";
+        KALDI_ASSERT(output.ApproxEqual(ref_outputs[num_done], 0.001));
+        num_done++;
+      }
+    }
+    KALDI_ASSERT(num_done == num_utts &&
+                 batch_computer.NumPendingUtterances() == 0);
+    batch_computer.PrintDiagnostics();
+  }
+}
+
+// Checks that after PrecompileSimpleComputations(), NnetSimpleComputer
+// doesn't need to compile anything, and gives the same output.
+void UnitTestPrecompileSimpleComputations() {
+  for (int32 n = 0; n < 10; n++) {
+    struct NnetGenerationOptions gen_config;
+    gen_config.allow_recursion = false;
+    gen_config.allow_clockwork = false;
+
+    std::vector<std::string> configs;
+    GenerateConfigSequence(gen_config, &configs);
+    Nnet nnet;
+    for (size_t j = 0; j < configs.size(); j++) {
+      std::istringstream is(configs[j]);
+      nnet.ReadConfig(is);
+    }
+    if (!IsSimpleNnet(nnet))
+      continue;
+    int32 input_dim = nnet.InputDim("input"),
+        ivector_dim = std::max<int32>(0, nnet.InputDim("ivector"));
+
+    NnetSimpleComputerOptions opts;
+    opts.frames_per_chunk = RandInt(1, 20);
+    opts.extra_left_context = RandInt(0, 3);
+    int32 left_context, right_context;
+    ComputeSimpleNnetContext(nnet, &left_context, &right_context);
+    CachingOptimizingCompiler compiler(nnet, opts.optimize_config, 0);
+    PrecompileSimpleComputations(opts, left_context, right_context,
+                                 ivector_dim > 0, &compiler);
+    int32 num_computations = compiler.NumComputations();
+    KALDI_ASSERT(num_computations == opts.frames_per_chunk);
+
+    for (int32 u = 0; u < 5; u++) {
+      Matrix<BaseFloat> feats(RandInt(1, 50), input_dim);
+      feats.SetRandn();
+      Vector<BaseFloat> ivector(ivector_dim);
+      ivector.SetRandn();
+      const Vector<BaseFloat> *ivector_ptr =
+          (ivector_dim > 0 ? &ivector : NULL);
+      Matrix<BaseFloat> output, ref_output;
+      {
+        NnetSimpleComputer computer(opts, nnet, feats, ivector_ptr);
+        computer.SetSharedCompiler(&compiler);
+        computer.GetOutput(&output);
+      }
+      {
+        NnetSimpleComputer computer(opts, nnet, feats, ivector_ptr);
+        computer.GetOutput(&ref_output);
+      }
+      KALDI_ASSERT(output.ApproxEqual(ref_output, 0.001));
+      KALDI_ASSERT(compiler.NumComputations() == num_computations);
+    }
+  }
+}
+
+} // namespace nnet3
+} // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::nnet3;
+
+  for (int32 loop = 0; loop < 2; loop++) {
+#if HAVE_CUDA == 1
+    if (loop == 0)
+      CuDevice::Instantiate().SelectGpuId("no");
+    else
+      CuDevice::Instantiate().SelectGpuId("yes");
+#endif
+    UnitTestNnetBatchComputer();
+    UnitTestPrecompileSimpleComputations();
+  }
+
+  KALDI_LOG << "Batched computation tests succeeded.";
+
+  return 0;
+}
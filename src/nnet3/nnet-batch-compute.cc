@@ -0,0 +1,270 @@
+// nnet3/nnet-batch-compute.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/nnet-batch-compute.h"
+#include "nnet3/nnet-utils.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+
+NnetBatchComputer::NnetBatchComputer(const NnetBatchComputerOptions &opts,
+                                     const Nnet &nnet,
+                                     const VectorBase<BaseFloat> &priors):
+    opts_(opts), nnet_(nnet), compiler_(nnet, opts.optimize_config) {
+  opts_.Check();
+  if (opts_.debug_computation)
+    opts_.compute_config.debug = true;
+  KALDI_ASSERT(IsSimpleNnet(nnet));
+  ComputeSimpleNnetContext(nnet, &left_context_, &right_context_);
+  input_dim_ = nnet.InputDim("input");
+  ivector_dim_ = std::max<int32>(0, nnet.InputDim("ivector"));
+  output_dim_ = nnet.OutputDim("output");
+  if (priors.Dim() != 0) {
+    KALDI_ASSERT(priors.Dim() == output_dim_);
+    log_priors_ = priors;
+    log_priors_.ApplyLog();
+  }
+}
+
+NnetBatchComputer::~NnetBatchComputer() {
+  for (size_t i = 0; i < utts_.size(); i++)
+    delete utts_[i];
+}
+
+void NnetBatchComputer::AcceptInput(
+    const std::string &utt,
+    const MatrixBase<BaseFloat> &feats,
+    const VectorBase<BaseFloat> *ivector,
+    const MatrixBase<BaseFloat> *online_ivectors,
+    int32 online_ivector_period) {
+  KALDI_ASSERT(!(ivector != NULL && online_ivectors != NULL));
+  KALDI_ASSERT(!(online_ivectors != NULL && online_ivector_period <= 0 &&
+                 "You need to set the --online-ivector-period option!"));
+  KALDI_ASSERT(feats.NumRows() > 0);
+  if (feats.NumCols() != input_dim_)
+    KALDI_ERR << "Neural net expects 'input' features with dimension "
+              << input_dim_ << " but you provided " << feats.NumCols();
+  int32 ivector_dim = (ivector != NULL ? ivector->Dim() :
+                       (online_ivectors != NULL ?
+                        online_ivectors->NumCols() : 0));
+  if (ivector_dim != ivector_dim_)
+    KALDI_ERR << "Neural net expects 'ivector' features with dimension "
+              << ivector_dim_ << " but you provided " << ivector_dim;
+
+  UtteranceInfo *info = new UtteranceInfo();
+  info->utt = utt;
+  info->feats = feats;
+  if (ivector != NULL)
+    info->ivector = *ivector;
+  if (online_ivectors != NULL)
+    info->online_ivectors = *online_ivectors;
+  info->online_ivector_period = online_ivector_period;
+  int32 num_frames = feats.NumRows();
+  info->output.Resize(num_frames, output_dim_, kUndefined);
+  info->num_chunks_pending = 0;
+  utts_.push_back(info);
+
+  // If the utterance is not a multiple of the chunk size, the last chunk is
+  // shifted back to overlap with the one before, so that it has the same size
+  // (and request) as the others; the overlapping frames are computed twice.
+  int32 chunk_size = std::min(opts_.frames_per_chunk, num_frames);
+  for (int32 t = 0; t < num_frames; t += chunk_size) {
+    ChunkInfo chunk;
+    chunk.utt_info = info;
+    chunk.first_output_frame = std::min(t, num_frames - chunk_size);
+    chunk.num_output_frames = chunk_size;
+    pending_chunks_[chunk_size].push_back(chunk);
+    info->num_chunks_pending++;
+  }
+}
+
+void NnetBatchComputer::Compute(bool flush) {
+  std::map<int32, std::deque<ChunkInfo> >::iterator
+      iter = pending_chunks_.begin(), end = pending_chunks_.end();
+  for (; iter != end; ++iter) {
+    std::deque<ChunkInfo> &queue = iter->second;
+    while (queue.size() >= static_cast<size_t>(opts_.minibatch_size) ||
+           (flush && !queue.empty())) {
+      size_t this_minibatch_size = std::min<size_t>(queue.size(),
+                                                    opts_.minibatch_size);
+      std::vector<ChunkInfo> chunks(queue.begin(),
+                                    queue.begin() + this_minibatch_size);
+      queue.erase(queue.begin(), queue.begin() + this_minibatch_size);
+      ComputeMinibatch(chunks);
+    }
+  }
+}
+
+bool NnetBatchComputer::GetOutput(std::string *utt,
+                                  Matrix<BaseFloat> *output) {
+  if (utts_.empty() || utts_.front()->num_chunks_pending != 0)
+    return false;
+  UtteranceInfo *info = utts_.front();
+  utts_.pop_front();
+  *utt = info->utt;
+  output->Swap(&(info->output));
+  delete info;
+  return true;
+}
+
+void NnetBatchComputer::GetIvectorForChunk(
+    const ChunkInfo &chunk, VectorBase<BaseFloat> *ivector) const {
+  const UtteranceInfo &info = *(chunk.utt_info);
+  if (info.ivector.Dim() != 0) {
+    ivector->CopyFromVec(info.ivector);
+    return;
+  }
+  KALDI_ASSERT(info.online_ivectors.NumRows() != 0 &&
+               info.online_ivector_period > 0);
+  // As in NnetSimpleComputer, we use the iVector for the middle of the chunk.
+  int32 frame_to_search = chunk.first_output_frame +
+      chunk.num_output_frames / 2,
+      ivector_frame = frame_to_search / info.online_ivector_period,
+      num_ivectors = info.online_ivectors.NumRows();
+  if (ivector_frame >= num_ivectors) {
+    int32 margin = ivector_frame - (num_ivectors - 1);
+    if (margin * info.online_ivector_period > 50) {
+      // Half a second seems like too long to be explainable as edge effects.
+      KALDI_ERR << "Could not get iVector for frame " << frame_to_search
+                << " of utterance " << info.utt
+                << ", only available till frame " << num_ivectors
+                << " * ivector-period=" << info.online_ivector_period
+                << " (mismatched --ivector-period?)";
+    }
+    ivector_frame = num_ivectors - 1;
+  }
+  ivector->CopyFromVec(info.online_ivectors.Row(ivector_frame));
+}
+
+void NnetBatchComputer::ComputeMinibatch(
+    const std::vector<ChunkInfo> &chunks) {
+  int32 num_chunks = chunks.size();
+  KALDI_ASSERT(num_chunks > 0);
+  minibatch_size_counts_[num_chunks]++;
+  int32 num_output_frames = chunks[0].num_output_frames,
+      left_context = left_context_ + opts_.extra_left_context,
+      num_input_frames = left_context + num_output_frames + right_context_;
+
+  // Chunk n of the minibatch has 'n' index n; the rows of the input and output
+  // matrices are ordered first by n then by t.  The times are relative to the
+  // start of each chunk, so the request only depends on the number of chunks
+  // and their size, and the compiler's cache works.
+  ComputationRequest request;
+  request.need_model_derivative = false;
+  request.store_component_stats = false;
+  request.inputs.resize(ivector_dim_ > 0 ? 2 : 1);
+  request.outputs.resize(1);
+  IoSpecification &input_spec = request.inputs[0],
+      &output_spec = request.outputs[0];
+  input_spec.name = "input";
+  output_spec.name = "output";
+  input_spec.indexes.reserve(num_chunks * num_input_frames);
+  output_spec.indexes.reserve(num_chunks * num_output_frames);
+  for (int32 n = 0; n < num_chunks; n++) {
+    for (int32 t = -left_context; t < num_output_frames + right_context_; t++)
+      input_spec.indexes.push_back(Index(n, t, 0));
+    for (int32 t = 0; t < num_output_frames; t++)
+      output_spec.indexes.push_back(Index(n, t, 0));
+  }
+  if (ivector_dim_ > 0) {
+    IoSpecification &ivector_spec = request.inputs[1];
+    ivector_spec.name = "ivector";
+    for (int32 n = 0; n < num_chunks; n++)
+      ivector_spec.indexes.push_back(Index(n, 0, 0));
+  }
+
+  Matrix<BaseFloat> input(num_chunks * num_input_frames, input_dim_,
+                          kUndefined);
+  Matrix<BaseFloat> ivectors;
+  if (ivector_dim_ > 0)
+    ivectors.Resize(num_chunks, ivector_dim_, kUndefined);
+  for (int32 n = 0; n < num_chunks; n++) {
+    const ChunkInfo &chunk = chunks[n];
+    const Matrix<BaseFloat> &feats = chunk.utt_info->feats;
+    int32 tot_input_feats = feats.NumRows(),
+        first_input_frame = chunk.first_output_frame - left_context;
+    for (int32 i = 0; i < num_input_frames; i++) {
+      SubVector<BaseFloat> dest(input, n * num_input_frames + i);
+      int32 t = i + first_input_frame;
+      // we repeat the first and last frames as needed.
+      if (t < 0) t = 0;
+      if (t >= tot_input_feats) t = tot_input_feats - 1;
+      dest.CopyFromVec(feats.Row(t));
+    }
+    if (ivector_dim_ > 0) {
+      SubVector<BaseFloat> ivector(ivectors, n);
+      GetIvectorForChunk(chunk, &ivector);
+    }
+  }
+
+  const NnetComputation *computation = compiler_.Compile(request);
+  Nnet *nnet_to_update = NULL;  // we're not doing any update.
+  NnetComputer computer(opts_.compute_config, *computation,
+                        nnet_, nnet_to_update);
+  CuMatrix<BaseFloat> input_cu;
+  input_cu.Swap(&input);
+  computer.AcceptInput("input", &input_cu);
+  CuMatrix<BaseFloat> ivectors_cu;
+  if (ivector_dim_ > 0) {
+    ivectors_cu.Swap(&ivectors);
+    computer.AcceptInput("ivector", &ivectors_cu);
+  }
+  computer.Forward();
+  CuMatrix<BaseFloat> cu_output;
+  computer.GetOutputDestructive("output", &cu_output);
+  // subtract log-prior (divide by prior)
+  if (log_priors_.Dim() != 0)
+    cu_output.AddVecToRows(-1.0, log_priors_);
+  Matrix<BaseFloat> output;
+  // the following statement just swaps the pointers if we're not using a GPU.
+  cu_output.Swap(&output);
+
+  // scatter the output back to the utterances.
+  for (int32 n = 0; n < num_chunks; n++) {
+    const ChunkInfo &chunk = chunks[n];
+    UtteranceInfo *info = chunk.utt_info;
+    info->output.RowRange(chunk.first_output_frame,
+                          num_output_frames).CopyFromMat(
+        output.RowRange(n * num_output_frames, num_output_frames));
+    info->num_chunks_pending--;
+    KALDI_ASSERT(info->num_chunks_pending >= 0);
+  }
+}
+
+void NnetBatchComputer::PrintDiagnostics() const {
+  int64 tot_minibatches = 0, tot_chunks = 0;
+  std::ostringstream os;
+  std::map<int32, int32>::const_iterator iter = minibatch_size_counts_.begin(),
+      end = minibatch_size_counts_.end();
+  for (; iter != end; ++iter) {
+    tot_minibatches += iter->second;
+    tot_chunks += static_cast<int64>(iter->first) * iter->second;
+    os << iter->first << ':' << iter->second << ' ';
+  }
+  KALDI_LOG << "Computed " << tot_chunks << " chunks in " << tot_minibatches
+            << " minibatches; average minibatch size was "
+            << (tot_chunks / std::max<double>(1.0, tot_minibatches))
+            << " (counts of minibatch sizes, as size:count, are: "
+            << os.str() << ")";
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
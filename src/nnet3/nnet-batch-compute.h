@@ -0,0 +1,201 @@
+// nnet3/nnet-batch-compute.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_BATCH_COMPUTE_H_
+#define KALDI_NNET3_NNET_BATCH_COMPUTE_H_
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include "base/kaldi-common.h"
+#include "nnet3/nnet-optimize.h"
+#include "nnet3/nnet-compute.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+
+struct NnetBatchComputerOptions {
+  int32 extra_left_context;
+  int32 frames_per_chunk;
+  int32 minibatch_size;
+  bool debug_computation;
+  NnetOptimizeOptions optimize_config;
+  NnetComputeOptions compute_config;
+
+  NnetBatchComputerOptions():
+      extra_left_context(0),
+      frames_per_chunk(50),
+      minibatch_size(64),
+      debug_computation(false) { }
+
+  void Check() const {
+    KALDI_ASSERT(extra_left_context >= 0 && frames_per_chunk > 0 &&
+                 minibatch_size > 0);
+  }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("extra-left-context", &extra_left_context,
+                   "Number of frames of additional left-context to add on top "
+                   "of the neural net's inherent left context "
+                   "(may be useful in recurrent setups");
+    opts->Register("frames-per-chunk", &frames_per_chunk,
+                   "Number of frames in each chunk that is separately "
+                   "evaluated by the neural net.");
+    opts->Register("minibatch-size", &minibatch_size,
+                   "Number of chunks (possibly from different utterances) "
+                   "that are evaluated together in one computation.");
+    opts->Register("debug-computation", &debug_computation, "If true, turn on "
+                   "debug for the actual computation (very verbose!)");
+
+    // register the optimization options with the prefix "optimization".
+    ParseOptions optimization_opts("optimization", opts);
+    optimize_config.Register(&optimization_opts);
+
+    // register the compute options with the prefix "computation".
+    ParseOptions compute_opts("computation", opts);
+    compute_config.Register(&compute_opts);
+  }
+};
+
+
+/**
+   NnetBatchComputer computes the output of a "simple" neural net (see
+   IsSimpleNnet()) for many utterances at once.  Each utterance is split into
+   chunks of frames_per_chunk output frames (with the last chunk shifted back
+   so that it's the same size as the others, if the utterance is long enough),
+   as in NnetSimpleComputer; but instead of evaluating one chunk at a time, up
+   to minibatch_size chunks of the same size, from any utterances, are put in
+   one ComputationRequest with different 'n' indexes, and evaluated in a
+   single pass.  This gives much larger matrix operations, which is important
+   for GPU utilization.
+
+   Because only the number of chunks in the batch and the chunk size vary, the
+   compiled computations are cached and reused.  The output for an utterance
+   is available once all of its chunks have been computed; the utterances are
+   returned in the order in which they were given.  Typical usage:
+\code
+   NnetBatchComputer computer(opts, nnet, priors);
+   for (each utterance) {
+     computer.AcceptInput(utt, feats, ivector, NULL, 0);
+     computer.Compute(false);
+     while (computer.GetOutput(&utt, &output))
+       ... use the output ...
+   }
+   computer.Compute(true);
+   while (computer.GetOutput(&utt, &output))
+     ... use the output ...
+\endcode
+*/
+class NnetBatchComputer {
+ public:
+  /// If "priors" is nonempty, the log of the priors is subtracted from the
+  /// output (as for an AmNnetSimple; see AmNnetSimple::Priors()); no acoustic
+  /// scale is applied.  "nnet" must outlive this object.
+  NnetBatchComputer(const NnetBatchComputerOptions &opts,
+                    const Nnet &nnet,
+                    const VectorBase<BaseFloat> &priors);
+
+  ~NnetBatchComputer();
+
+  /// Adds an utterance to be computed.  The input is copied, so it doesn't need
+  /// to outlive this call.  At most one of "ivector" and "online_ivectors"
+  /// should be non-NULL; they have the same meaning as for NnetSimpleComputer.
+  void AcceptInput(const std::string &utt,
+                   const MatrixBase<BaseFloat> &feats,
+                   const VectorBase<BaseFloat> *ivector,
+                   const MatrixBase<BaseFloat> *online_ivectors,
+                   int32 online_ivector_period);
+
+  /// Does the computation for as many full minibatches of chunks as are
+  /// available.  If "flush" is true, it also computes the remaining chunks in
+  /// smaller minibatches, so that all the utterances accepted so far are
+  /// finished.
+  void Compute(bool flush);
+
+  /// If the oldest utterance that has not yet been returned is finished,
+  /// outputs its name and output, forgets it, and returns true; otherwise
+  /// returns false.
+  bool GetOutput(std::string *utt, Matrix<BaseFloat> *output);
+
+  /// Returns the number of utterances accepted but not yet returned by
+  /// GetOutput().
+  int32 NumPendingUtterances() const { return utts_.size(); }
+
+  /// Prints some statistics on the sizes of the minibatches that we used.
+  void PrintDiagnostics() const;
+
+  /// Gives access to the compiler, e.g. to read or write its cache of
+  /// computations.
+  CachingOptimizingCompiler &GetCompiler() { return compiler_; }
+
+ private:
+  struct UtteranceInfo {
+    std::string utt;
+    Matrix<BaseFloat> feats;
+    Vector<BaseFloat> ivector;  // set if we are using batch-mode iVectors.
+    Matrix<BaseFloat> online_ivectors;  // set if using online iVectors.
+    int32 online_ivector_period;
+    Matrix<BaseFloat> output;
+    int32 num_chunks_pending;
+  };
+  // A chunk of an utterance, to be computed as part of a minibatch.
+  struct ChunkInfo {
+    UtteranceInfo *utt_info;
+    int32 first_output_frame;
+    int32 num_output_frames;
+  };
+
+  // Computes one minibatch (all chunks must have the same num_output_frames).
+  void ComputeMinibatch(const std::vector<ChunkInfo> &chunks);
+
+  // Gets the iVector for this chunk, if we are using iVectors.
+  void GetIvectorForChunk(const ChunkInfo &chunk,
+                          VectorBase<BaseFloat> *ivector) const;
+
+  NnetBatchComputerOptions opts_;
+  const Nnet &nnet_;
+  CuVector<BaseFloat> log_priors_;
+  int32 left_context_;
+  int32 right_context_;
+  int32 input_dim_;
+  int32 ivector_dim_;
+  int32 output_dim_;
+  CachingOptimizingCompiler compiler_;
+
+  // The utterances we haven't returned yet, in the order they were accepted
+  // (owned here).
+  std::deque<UtteranceInfo*> utts_;
+  // The chunks that have not been computed, indexed by num_output_frames; we
+  // only batch together chunks of the same size, so that the requests repeat.
+  std::map<int32, std::deque<ChunkInfo> > pending_chunks_;
+
+  // Statistics: the number of minibatches we computed, indexed by the number
+  // of chunks in them.
+  std::map<int32, int32> minibatch_size_counts_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(NnetBatchComputer);
+};
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+#endif  // KALDI_NNET3_NNET_BATCH_COMPUTE_H_
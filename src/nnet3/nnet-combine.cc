@@ -19,10 +19,22 @@
 
 #include "nnet3/nnet-combine.h"
 #include "nnet3/nnet-utils.h"
+#include "nnet3/nnet-computation-graph.h"
+#include "nnet3/nnet-optimize.h"
 
 namespace kaldi {
 namespace nnet3 {
 
+class NnetCombiner::ComputeProbThread: public MultiThreadable {
+ public:
+  ComputeProbThread(NnetCombiner *combiner): combiner_(combiner) { }
+  void operator() () {
+    combiner_->ComputeProb(thread_id_, num_threads_);
+  }
+ private:
+  NnetCombiner *combiner_;
+};
+
 NnetCombiner::NnetCombiner(const NnetCombineConfig &config,
                            int32 num_nnets,
                            const std::vector<NnetExample> &egs,
@@ -30,6 +42,8 @@ NnetCombiner::NnetCombiner(const NnetCombineConfig &config,
     config_(config),
     egs_(egs),
     nnet_(first_nnet),
+    compute_nnet_(&nnet_),
+    compute_egs_(&egs),
     num_real_input_nnets_(num_nnets),
     nnet_params_(std::min(num_nnets, config_.max_effective_inputs),
                  NumParameters(first_nnet)),
@@ -39,10 +53,213 @@ NnetCombiner::NnetCombiner(const NnetCombineConfig &config,
   tot_input_weighting_(0) += 1.0;
   num_nnets_provided_ = 1;
   ComputeUpdatableComponentDims();
+  if (config_.cache_frozen_activations)
+    SetUpFrozenActivationCache();
+
+  KALDI_ASSERT(config_.num_threads > 0 && !egs.empty());
+  int32 num_threads = std::min<int32>(config_.num_threads, egs.size());
   NnetComputeProbOptions compute_prob_opts;
   compute_prob_opts.compute_deriv = true;
-  prob_computer_ = new NnetComputeProb(compute_prob_opts, nnet_);
+  for (int32 t = 0; t < num_threads; t++)
+    prob_computers_.push_back(new NnetComputeProb(compute_prob_opts,
+                                                  *compute_nnet_));
+}
+
+NnetCombiner::~NnetCombiner() {
+  for (size_t t = 0; t < prob_computers_.size(); t++)
+    delete prob_computers_[t];
+  if (compute_nnet_ != &nnet_)
+    delete compute_nnet_;
+}
+
+// Outputs to "frozen" a vector indexed by node-index, saying for each node of
+// "nnet" whether its value is unaffected by the parameters of the updatable
+// components: this is true for input nodes, and for component nodes with
+// non-updatable components whose input depends only on frozen nodes.
+// Dim-range nodes are treated as not frozen, for simplicity.
+static void ComputeFrozenNodes(const Nnet &nnet, std::vector<bool> *frozen) {
+  int32 num_nodes = nnet.NumNodes();
+  frozen->clear();
+  frozen->resize(num_nodes, false);
+  for (int32 n = 0; n < num_nodes; n++)
+    if (nnet.IsInputNode(n))
+      (*frozen)[n] = true;
+  // Iterate until no more nodes change, since the nodes are not necessarily
+  // topologically sorted.
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int32 n = 0; n < num_nodes; n++) {
+      if ((*frozen)[n] || !nnet.IsComponentNode(n))
+        continue;
+      const Component *c = nnet.GetComponent(nnet.GetNode(n).u.component_index);
+      if (c->Properties() & kUpdatableComponent)
+        continue;
+      std::vector<int32> dependencies;
+      nnet.GetNode(n - 1).descriptor.GetNodeDependencies(&dependencies);
+      bool all_frozen = true;
+      for (size_t i = 0; i < dependencies.size(); i++)
+        if (!(*frozen)[dependencies[i]])
+          all_frozen = false;
+      if (all_frozen) {
+        (*frozen)[n] = true;
+        changed = true;
+      }
+    }
+  }
+}
+
+// Outputs to "is_used" a vector indexed by node-index, saying for each node of
+// "nnet" whether some node that is not frozen (according to "frozen", which is
+// indexed by node-index) takes input from it.  Output nodes count as not
+// frozen.
+static void ComputeUsedNodes(const Nnet &nnet,
+                             const std::vector<bool> &frozen,
+                             std::vector<bool> *is_used) {
+  int32 num_nodes = nnet.NumNodes();
+  is_used->clear();
+  is_used->resize(num_nodes, false);
+  for (int32 n = 0; n < num_nodes; n++) {
+    const NetworkNode &node = nnet.GetNode(n);
+    if (node.node_type == kDimRange) {
+      if (!frozen[n])
+        (*is_used)[node.u.node_index] = true;
+    } else if (node.node_type == kDescriptor) {
+      // a Descriptor node is either an output node or the input of the
+      // component node that follows it.
+      if (nnet.IsComponentInputNode(n) && frozen[n + 1])
+        continue;
+      std::vector<int32> dependencies;
+      node.descriptor.GetNodeDependencies(&dependencies);
+      for (size_t i = 0; i < dependencies.size(); i++)
+        (*is_used)[dependencies[i]] = true;
+    }
+  }
+}
+
+void NnetCombiner::SetUpFrozenActivationCache() {
+  std::vector<bool> frozen, used_by_non_frozen;
+  ComputeFrozenNodes(nnet_, &frozen);
+  ComputeUsedNodes(nnet_, frozen, &used_by_non_frozen);
+  // the "boundary" nodes are the frozen component nodes whose values are
+  // needed by the rest of the network; we'll cache their values.
+  std::vector<std::string> boundary_names;
+  std::vector<int32> node_to_boundary(nnet_.NumNodes(), -1);
+  for (int32 n = 0; n < nnet_.NumNodes(); n++) {
+    if (frozen[n] && used_by_non_frozen[n] && nnet_.IsComponentNode(n)) {
+      node_to_boundary[n] = boundary_names.size();
+      boundary_names.push_back(nnet_.GetNodeName(n));
+    }
+  }
+  if (boundary_names.empty())
+    return;  // Nothing to cache.
+  int32 num_boundary = boundary_names.size();
+
+  Nnet *suffix_nnet = new Nnet(nnet_);
+  for (int32 b = 0; b < num_boundary; b++)
+    suffix_nnet->ConvertComponentNodeToInput(
+        suffix_nnet->GetNodeIndex(boundary_names[b]));
+  suffix_nnet->RemoveOrphanNodes();
+  suffix_nnet->RemoveOrphanComponents();
+  suffix_nnet->Check();
+  if (NumParameters(*suffix_nnet) != NumParameters(nnet_)) {
+    // This could happen if some updatable component is not used in computing
+    // any output, which is not expected.
+    KALDI_WARN << "Not caching frozen activations, as some updatable "
+               << "components would be removed.";
+    delete suffix_nnet;
+    return;
+  }
+  // The inputs of the original egs that are still needed (e.g. an iVector
+  // input that feeds directly into an updatable component).
+  std::vector<bool> no_frozen(suffix_nnet->NumNodes(), false),
+      suffix_input_used;
+  ComputeUsedNodes(*suffix_nnet, no_frozen, &suffix_input_used);
+
+  // The prefix network is nnet_ with extra output nodes for the nodes whose
+  // values we cache.
+  Nnet prefix_nnet(nnet_);
+  std::vector<std::string> cached_output_names(num_boundary);
+  {
+    std::ostringstream config_os;
+    for (int32 b = 0; b < num_boundary; b++) {
+      cached_output_names[b] = "cached-" + boundary_names[b];
+      if (nnet_.GetNodeIndex(cached_output_names[b]) != -1)
+        KALDI_ERR << "Node name " << cached_output_names[b]
+                  << " already exists in the nnet.";
+      config_os << "output-node name=" << cached_output_names[b]
+                << " input=" << boundary_names[b] << "\n";
+    }
+    std::istringstream config_is(config_os.str());
+    prefix_nnet.ReadConfig(config_is);
+  }
+  CachingOptimizingCompiler compiler(prefix_nnet);
+  NnetComputeOptions compute_opts;
+
+  cached_egs_.resize(egs_.size());
+  int64 num_cached_rows = 0;
+  for (size_t i = 0; i < egs_.size(); i++) {
+    const NnetExample &eg = egs_[i];
+    // Work out the indexes at which the original computation needs the values
+    // of the boundary nodes, by building its computation graph.
+    ComputationRequest request;
+    GetComputationRequest(nnet_, eg, false, false, &request);
+    ComputationGraph graph;
+    ComputationGraphBuilder builder(nnet_, request, &graph);
+    builder.Compute();
+    if (!builder.AllOutputsAreComputable()) {
+      builder.ExplainWhyAllOutputsNotComputable();
+      KALDI_ERR << "Not all outputs were computable, cannot combine nnets.";
+    }
+    builder.Prune();
+    std::vector<std::vector<Index> > boundary_indexes(num_boundary);
+    for (size_t c = 0; c < graph.cindexes.size(); c++) {
+      int32 b = node_to_boundary[graph.cindexes[c].first];
+      if (b != -1)
+        boundary_indexes[b].push_back(graph.cindexes[c].second);
+    }
 
+    ComputationRequest prefix_request;
+    prefix_request.inputs = request.inputs;
+    for (int32 b = 0; b < num_boundary; b++) {
+      if (boundary_indexes[b].empty())
+        continue;
+      std::sort(boundary_indexes[b].begin(), boundary_indexes[b].end());
+      prefix_request.outputs.push_back(
+          IoSpecification(cached_output_names[b], boundary_indexes[b], false));
+    }
+    NnetExample *cached_eg = &(cached_egs_[i]);
+    if (!prefix_request.outputs.empty()) {
+      const NnetComputation *computation = compiler.Compile(prefix_request);
+      NnetComputer computer(compute_opts, *computation, prefix_nnet, NULL);
+      computer.AcceptInputs(prefix_nnet, eg.io);
+      computer.Forward();
+      for (int32 b = 0; b < num_boundary; b++) {
+        if (boundary_indexes[b].empty())
+          continue;
+        cached_eg->io.resize(cached_eg->io.size() + 1);
+        NnetIo &io = cached_eg->io.back();
+        io.name = boundary_names[b];
+        io.indexes = boundary_indexes[b];
+        Matrix<BaseFloat> value(computer.GetOutput(cached_output_names[b]));
+        io.features = value;
+        num_cached_rows += value.NumRows();
+      }
+    }
+    for (size_t j = 0; j < eg.io.size(); j++) {
+      int32 node_index = suffix_nnet->GetNodeIndex(eg.io[j].name);
+      KALDI_ASSERT(node_index != -1);
+      if (!suffix_nnet->IsInputNode(node_index) ||
+          suffix_input_used[node_index])
+        cached_eg->io.push_back(eg.io[j]);
+    }
+  }
+  compute_nnet_ = suffix_nnet;
+  compute_egs_ = &cached_egs_;
+  KALDI_LOG << "Cached the outputs of " << num_boundary << " frozen nodes ("
+            << num_cached_rows << " rows in total); the objective function "
+            << "will be computed with " << compute_nnet_->NumComponents()
+            << " of the " << nnet_.NumComponents() << " components.";
 }
 
 void NnetCombiner::ComputeUpdatableComponentDims(){
@@ -418,21 +635,44 @@ double NnetCombiner::ComputeObjfAndDerivFromNnet(
     return -std::numeric_limits<double>::infinity();
   // Set nnet to have these params.
   UnVectorizeNnet(nnet_params, &nnet_);
+  if (compute_nnet_ != &nnet_)
+    UnVectorizeNnet(nnet_params, compute_nnet_);
 
-  prob_computer_->Reset();
-  std::vector<NnetExample>::const_iterator iter = egs_.begin(),
-                                            end = egs_.end();
-  for (; iter != end; ++iter)
-    prob_computer_->Compute(*iter);
-  const SimpleObjectiveInfo *objf_info = prob_computer_->GetObjective("output");
-  if (objf_info == NULL)
-    KALDI_ERR << "Error getting objective info (unsuitable egs?)";
-  KALDI_ASSERT(objf_info->tot_weight > 0.0);
-  const Nnet &deriv = prob_computer_->GetDeriv();
-  VectorizeNnet(deriv, nnet_params_deriv);
+  int32 num_threads = prob_computers_.size();
+  if (num_threads == 1) {
+    ComputeProb(0, 1);
+  } else {
+    // the destructor of MultiThreader waits for the threads to finish.
+    MultiThreader<ComputeProbThread> m(num_threads, ComputeProbThread(this));
+  }
+  double tot_weight = 0.0, tot_objective = 0.0;
+  Vector<BaseFloat> thread_deriv(nnet_params_deriv->Dim(), kUndefined);
+  for (int32 t = 0; t < num_threads; t++) {
+    const SimpleObjectiveInfo *objf_info =
+        prob_computers_[t]->GetObjective("output");
+    if (objf_info == NULL)
+      KALDI_ERR << "Error getting objective info (unsuitable egs?)";
+    tot_weight += objf_info->tot_weight;
+    tot_objective += objf_info->tot_objective;
+    const Nnet &deriv = prob_computers_[t]->GetDeriv();
+    if (t == 0) {
+      VectorizeNnet(deriv, nnet_params_deriv);
+    } else {
+      VectorizeNnet(deriv, &thread_deriv);
+      nnet_params_deriv->AddVec(1.0, thread_deriv);
+    }
+  }
+  KALDI_ASSERT(tot_weight > 0.0);
   // we prefer to deal with normalized objective functions.
-  nnet_params_deriv->Scale(1.0 / objf_info->tot_weight);
-  return objf_info->tot_objective / objf_info->tot_weight;
+  nnet_params_deriv->Scale(1.0 / tot_weight);
+  return tot_objective / tot_weight;
+}
+
+void NnetCombiner::ComputeProb(int32 thread, int32 num_threads) {
+  NnetComputeProb *prob_computer = prob_computers_[thread];
+  prob_computer->Reset();
+  for (size_t i = thread; i < compute_egs_->size(); i += num_threads)
+    prob_computer->Compute((*compute_egs_)[i]);
 }
 
 
@@ -25,6 +25,7 @@
 #include "util/parse-options.h"
 #include "itf/options-itf.h"
 #include "nnet3/nnet-diagnostics.h"
+#include "thread/kaldi-thread.h"
 
 
 namespace kaldi {
@@ -49,13 +50,17 @@ struct NnetCombineConfig {
   bool enforce_positive_weights;
   bool enforce_sum_to_one;
   bool separate_weights_per_component;
+  int32 num_threads;
+  bool cache_frozen_activations;
   NnetCombineConfig(): num_iters(60),
                        initial_impr(0.01),
                        max_effective_inputs(15),
                        test_gradient(false),
                        enforce_positive_weights(false),
                        enforce_sum_to_one(false),
-                       separate_weights_per_component(true) { }
+                       separate_weights_per_component(true),
+                       num_threads(1),
+                       cache_frozen_activations(true) { }
 
   void Register(OptionsItf *po) {
     po->Register("num-iters", &num_iters, "Maximum number of function "
@@ -76,6 +81,16 @@ struct NnetCombineConfig {
     po->Register("separate-weights-per-component", &separate_weights_per_component,
                  "If true, have a separate weight for each updatable component in "
                  "the nnet.");
+    po->Register("num-threads", &num_threads, "Number of threads to use when "
+                 "computing the objective function and its derivative for each "
+                 "candidate weighting; the examples are divided between the "
+                 "threads.  Only supported when not using a GPU.");
+    po->Register("cache-frozen-activations", &cache_frozen_activations,
+                 "If true, compute just once the outputs of the part of the "
+                 "network nearest the input that contains no updatable "
+                 "components (e.g. fixed LDA-like transforms), since it is the "
+                 "same for all weightings; the objective function is then "
+                 "computed using only the part of the network above it.");
   }
 };
 
@@ -87,6 +102,14 @@ struct NnetCombineConfig {
       be stored in a matrix in CPU memory, to avoid filing up GPU memory).
     - Call Combine()
     - Get the resultant nnet with GetNnet().
+
+  Each evaluation of the objective function requires a forward and backward
+  pass over all the egs.  To speed this up, the egs may be divided between
+  several threads (--num-threads), each with its own NnetComputeProb object;
+  and the outputs of the lowest part of the network that has no updatable
+  components, which don't depend on the combination weights, are computed just
+  once in the constructor (--cache-frozen-activations); see
+  SetUpFrozenActivationCache().
  */
 class NnetCombiner {
  public:
@@ -102,15 +125,36 @@ class NnetCombiner {
   void Combine();
   const Nnet &GetNnet() const { return nnet_; }
 
-  ~NnetCombiner() { delete prob_computer_; }
+  ~NnetCombiner();
  private:
+  class ComputeProbThread;
+  friend class ComputeProbThread;
+
   const NnetCombineConfig &config_;
 
   const std::vector<NnetExample> &egs_;
 
   Nnet nnet_;  // The current neural network.
 
-  NnetComputeProb *prob_computer_;
+  // The network that we compute the objective function with.  This is either
+  // &nnet_, or, if we are caching the outputs of frozen lower layers, a network
+  // owned by this object that is the part of nnet_ above them (see
+  // SetUpFrozenActivationCache()).  Either way it has the same updatable
+  // components as nnet_, in the same order, so the same parameter vector
+  // applies to both.
+  Nnet *compute_nnet_;
+
+  // If we are caching the outputs of frozen lower layers, the egs with those
+  // outputs in place of the inputs they were computed from.
+  std::vector<NnetExample> cached_egs_;
+
+  // The egs we compute the objective function on: points to egs_ or
+  // cached_egs_.
+  const std::vector<NnetExample> *compute_egs_;
+
+  // One per thread; they all compute with *compute_nnet_, and thread t
+  // processes the egs with index i such that i % num_threads == t.
+  std::vector<NnetComputeProb*> prob_computers_;
 
   std::vector<int32> updatable_component_dims_;  // dimension of each updatable
                                                  // component.
@@ -218,6 +262,20 @@ class NnetCombiner {
   void ComputeUpdatableComponentDims();
   void FinishPreprocessingInput();
 
+  // If possible, this function sets up compute_nnet_ and cached_egs_ so that
+  // the objective function is computed without recomputing, for each set of
+  // weights, the outputs of the "frozen" nodes: those whose values don't depend
+  // on any updatable component (i.e. input nodes, and component nodes with
+  // non-updatable components all of whose inputs are frozen).  The outputs of
+  // the frozen nodes that are used by non-frozen nodes are computed once for
+  // each eg, and compute_nnet_ is a copy of nnet_ in which those nodes are
+  // input nodes (and the nodes they depended on are removed).
+  void SetUpFrozenActivationCache();
+
+  // Computes the objective function for the egs that thread "thread" is
+  // responsible for, using prob_computers_[thread].
+  void ComputeProb(int32 thread, int32 num_threads);
+
 };
 
 
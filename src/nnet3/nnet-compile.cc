@@ -185,6 +185,7 @@ void Compiler::CreateStepInfo(
     // node id's of all Cindexes are the same, so just use first one.
     this_info.node_index =
         graph_.cindexes[this_info.output_cindex_ids.front()].first;
+    this_info.is_input = graph_.is_input[this_info.output_cindex_ids.front()];
     const NetworkNode &node = nnet_.GetNode(this_info.node_index);
     int32 num_rows = num_ids, num_cols = node.Dim(nnet_);
 
@@ -192,7 +193,7 @@ void Compiler::CreateStepInfo(
       this_info.value = computation->NewMatrix(num_rows, num_cols);
       if (deriv_needed[step])
         this_info.deriv = computation->NewMatrix(num_rows, num_cols);
-      if (node.node_type == kComponent)
+      if (node.node_type == kComponent && !this_info.is_input)
         KALDI_PARANOID_ASSERT(step > 0 &&  steps_[step-1].output_indexes ==
                               this_info.output_indexes);
     } else {
@@ -283,7 +284,11 @@ void Compiler::SetInputOutputInfo(NnetComputation *computation) const {
   for (int32 step = 0; step < num_steps; step++) {
     const StepInfo &this_info = steps_[step];
     int32 node_index = this_info.node_index;
-    if (nnet_.IsInputNode(node_index) || nnet_.IsOutputNode(node_index)) {
+    // Note: a Component node may also be supplied as an input (for some of
+    // its indexes), in which case the step that holds the supplied values is
+    // the one we record here.
+    if (nnet_.IsInputNode(node_index) || nnet_.IsOutputNode(node_index) ||
+        this_info.is_input) {
       // There should be only one step for each input or output node.
       KALDI_ASSERT(computation->input_output_info.count(node_index) == 0);
       int32 value_matrix_index =
@@ -307,7 +312,9 @@ void Compiler::DoForwardComputation(int32 step,
   switch (node.node_type) {
     case kInput: case kDimRange: break;  // Nothing to do.
     case kComponent:
-      AddPropagateStep(step, computation);
+      // Nothing to do if the values were supplied as an input.
+      if (!step_info.is_input)
+        AddPropagateStep(step, computation);
       break;
     case kDescriptor:
       DoForwardComputationDescriptor(step, computation);
@@ -721,7 +728,8 @@ void Compiler::DoBackwardComputation(int32 step,
   switch (node.node_type) {
     case kInput: case kDimRange: break;  // Nothing to do.
     case kComponent:
-      AddBackpropStep(step, computation);
+      if (!step_info.is_input)
+        AddBackpropStep(step, computation);
       break;
     case kDescriptor:
       DoBackwardComputationDescriptor(step, computation);
@@ -858,8 +866,9 @@ void Compiler::SetUpPrecomputedIndexes(
     StepInfo &step_info = steps_[step];
     int32 node_index = step_info.node_index;
     const NetworkNode &node = nnet_.GetNode(node_index);
-    // There is only something to do for nodes of type Component.
-    if (node.node_type != kComponent)
+    // There is only something to do for nodes of type Component (and not if
+    // the values were supplied as an input).
+    if (node.node_type != kComponent || step_info.is_input)
       continue;
     const StepInfo &input_step_info = steps_[step - 1];
     int32 component_index = node.u.component_index;
@@ -293,6 +293,60 @@ void UnitTestNnetComponent() {
   }
 }
 
+// checks that QuantizedAffineComponent gives approximately the same output as
+// the AffineComponent it was created from.
+void UnitTestQuantizedAffineComponent() {
+  for (int32 n = 0; n < 10; n++) {
+    int32 input_dim = RandInt(1, 100), output_dim = RandInt(1, 100),
+        num_rows = RandInt(1, 20);
+    AffineComponent affine;
+    affine.Init(0.001, input_dim, output_dim, 1.0, 1.0);
+    QuantizedAffineComponent quantized(affine);
+    TestNnetComponentIo(&quantized);
+    TestNnetComponentCopy(&quantized);
+
+    CuMatrix<BaseFloat> input(num_rows, input_dim),
+        output(num_rows, output_dim),
+        output_quantized(num_rows, output_dim);
+    input.SetRandn();
+    affine.Propagate(NULL, input, &output);
+    quantized.Propagate(NULL, input, &output_quantized);
+    output_quantized.AddMat(-1.0, output);
+    BaseFloat norm = output.FrobeniusNorm(),
+        error = output_quantized.FrobeniusNorm();
+    KALDI_LOG << "Relative error of quantized affine component is "
+              << (error / norm);
+    KALDI_ASSERT(error <= 0.05 * norm);
+  }
+}
+
+// checks that HalfPrecisionAffineComponent gives approximately the same output
+// as the AffineComponent it was created from.
+void UnitTestHalfPrecisionAffineComponent() {
+  for (int32 n = 0; n < 10; n++) {
+    int32 input_dim = RandInt(1, 100), output_dim = RandInt(1, 100),
+        num_rows = RandInt(1, 20);
+    AffineComponent affine;
+    affine.Init(0.001, input_dim, output_dim, 1.0, 1.0);
+    HalfPrecisionAffineComponent half(affine);
+    TestNnetComponentIo(&half);
+    TestNnetComponentCopy(&half);
+
+    CuMatrix<BaseFloat> input(num_rows, input_dim),
+        output(num_rows, output_dim),
+        output_half(num_rows, output_dim);
+    input.SetRandn();
+    affine.Propagate(NULL, input, &output);
+    half.Propagate(NULL, input, &output_half);
+    output_half.AddMat(-1.0, output);
+    BaseFloat norm = output.FrobeniusNorm(),
+        error = output_half.FrobeniusNorm();
+    KALDI_LOG << "Relative error of half-precision affine component is "
+              << (error / norm);
+    KALDI_ASSERT(error <= 0.01 * norm);
+  }
+}
+
 } // namespace nnet3
 } // namespace kaldi
 
@@ -308,6 +362,8 @@ int main() {
       CuDevice::Instantiate().SelectGpuId("yes");
 #endif
     UnitTestNnetComponent();
+    UnitTestQuantizedAffineComponent();
+    UnitTestHalfPrecisionAffineComponent();
   }
 
   KALDI_LOG << "Nnet component ntests succeeded.";
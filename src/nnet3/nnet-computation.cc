@@ -19,6 +19,8 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <functional>
 #include <iterator>
 #include <sstream>
 #include "nnet3/nnet-computation.h"
@@ -98,6 +100,99 @@ void NnetComputation::ComputeCudaIndexes() {
   }
 }
 
+void NnetComputation::ComputeMemoryPlan() {
+  int32 num_matrices = matrices.size(),
+      num_commands = commands.size();
+  // For each matrix, the index of the command that allocates it and the
+  // command that deallocates it, or -1 if none; -2 means the matrix can't go in
+  // the workspace.
+  std::vector<int32> alloc_command(num_matrices, -1),
+      dealloc_command(num_matrices, -1);
+  // matrix zero is the empty matrix.
+  if (num_matrices > 0)
+    alloc_command[0] = -2;
+  unordered_map<int32, std::pair<int32, int32> >::const_iterator
+      io_iter = input_output_info.begin(), io_end = input_output_info.end();
+  for (; io_iter != io_end; ++io_iter) {
+    // the inputs and outputs are swapped in from, and out to, the user.
+    alloc_command[io_iter->second.first] = -2;
+    alloc_command[io_iter->second.second] = -2;
+  }
+  for (int32 c = 0; c < num_commands; c++) {
+    const Command &command = commands[c];
+    switch (command.command_type) {
+      case kAllocMatrixZeroed: case kAllocMatrixUndefined:
+        if (alloc_command[command.arg1] == -1)
+          alloc_command[command.arg1] = c;
+        else  // allocated more than once: don't try to handle this.
+          alloc_command[command.arg1] = -2;
+        break;
+      case kDeallocMatrix:
+        if (dealloc_command[command.arg1] == -1)
+          dealloc_command[command.arg1] = c;
+        else
+          alloc_command[command.arg1] = -2;
+        break;
+      case kAllocMatrixFromOther: case kAllocMatrixFromOtherZeroed:
+        // the memory of matrix arg2 becomes that of matrix arg1; for
+        // simplicity we leave both out of the workspace.
+        alloc_command[command.arg1] = -2;
+        alloc_command[command.arg2] = -2;
+        break;
+      default:
+        break;
+    }
+  }
+
+  // 'sizes' is a list of (size, matrix-index) for matrices that will go in the
+  // workspace.
+  std::vector<std::pair<int64, int32> > sizes;
+  for (int32 m = 1; m < num_matrices; m++) {
+    if (alloc_command[m] >= 0 && dealloc_command[m] > alloc_command[m]) {
+      int64 size = static_cast<int64>(matrices[m].num_rows) *
+          WorkspaceStride(matrices[m].num_cols);
+      if (size > 0)
+        sizes.push_back(std::pair<int64, int32>(size, m));
+    }
+  }
+  // We place the largest matrices first; each one goes at the lowest offset
+  // where it doesn't overlap with any already-placed matrix whose lifetime
+  // overlaps with its own ("first fit, decreasing size").
+  std::sort(sizes.begin(), sizes.end(), std::greater<std::pair<int64, int32> >());
+
+  matrix_workspace_offsets.clear();
+  matrix_workspace_offsets.resize(num_matrices, -1);
+  workspace_size = 0;
+  std::vector<int32> placed;
+  for (size_t i = 0; i < sizes.size(); i++) {
+    int64 size = sizes[i].first;
+    int32 m = sizes[i].second;
+    // 'busy' is a list of (begin, end) offsets of matrices with overlapping
+    // lifetimes.
+    std::vector<std::pair<int64, int64> > busy;
+    for (size_t j = 0; j < placed.size(); j++) {
+      int32 n = placed[j];
+      if (alloc_command[n] <= dealloc_command[m] &&
+          alloc_command[m] <= dealloc_command[n]) {
+        int64 begin = matrix_workspace_offsets[n],
+            end = begin + static_cast<int64>(matrices[n].num_rows) *
+            WorkspaceStride(matrices[n].num_cols);
+        busy.push_back(std::pair<int64, int64>(begin, end));
+      }
+    }
+    std::sort(busy.begin(), busy.end());
+    int64 offset = 0;
+    for (size_t j = 0; j < busy.size(); j++) {
+      if (busy[j].first >= offset + size)
+        break;  // it fits in the gap before this one.
+      offset = std::max(offset, busy[j].second);
+    }
+    matrix_workspace_offsets[m] = offset;
+    workspace_size = std::max(workspace_size, offset + size);
+    placed.push_back(m);
+  }
+}
+
 int32 NnetComputation::NewSubMatrix(int32 base_submatrix,
                                     int32 row_offset, int32 num_rows,
                                     int32 col_offset, int32 num_cols) {
@@ -277,7 +372,10 @@ static void PrintCommand(std::ostream &os,
       if (c.arg2 == 0) os << "NULL, ";
       else os << "precomputed_indexes[" << c.arg2 << "], ";
       os << submatrix_strings[c.arg3] << ", &" << submatrix_strings[c.arg4]
-         << ")\n";
+         << ")";
+      if (c.arg5 >= 0)
+        os << " [fused with " << nnet.GetComponentName(c.arg5) << "]";
+      os << "\n";
       break;
     case kStoreStats:
       os << nnet.GetComponentName(c.arg1) << ".StoreStats("
@@ -502,6 +600,64 @@ IoSpecification::IoSpecification(const std::string &name,
     iter->t = t;
 }
 
+void IoSpecification::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<IoSpecification>");
+  WriteToken(os, binary, name);
+  WriteIndexVector(os, binary, indexes);
+  WriteToken(os, binary, "<HasDeriv>");
+  WriteBasicType(os, binary, has_deriv);
+  WriteToken(os, binary, "</IoSpecification>");
+}
+
+void IoSpecification::Read(std::istream &is, bool binary) {
+  ExpectToken(is, binary, "<IoSpecification>");
+  ReadToken(is, binary, &name);
+  ReadIndexVector(is, binary, &indexes);
+  ExpectToken(is, binary, "<HasDeriv>");
+  ReadBasicType(is, binary, &has_deriv);
+  ExpectToken(is, binary, "</IoSpecification>");
+}
+
+void ComputationRequest::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<ComputationRequest>");
+  WriteToken(os, binary, "<NumInputs>");
+  WriteBasicType(os, binary, static_cast<int32>(inputs.size()));
+  for (size_t i = 0; i < inputs.size(); i++)
+    inputs[i].Write(os, binary);
+  WriteToken(os, binary, "<NumOutputs>");
+  WriteBasicType(os, binary, static_cast<int32>(outputs.size()));
+  for (size_t i = 0; i < outputs.size(); i++)
+    outputs[i].Write(os, binary);
+  WriteToken(os, binary, "<NeedModelDerivative>");
+  WriteBasicType(os, binary, need_model_derivative);
+  WriteToken(os, binary, "<StoreComponentStats>");
+  WriteBasicType(os, binary, store_component_stats);
+  // misc_info has no members yet, so there is nothing to write for it.
+  WriteToken(os, binary, "</ComputationRequest>");
+}
+
+void ComputationRequest::Read(std::istream &is, bool binary) {
+  ExpectToken(is, binary, "<ComputationRequest>");
+  int32 num_inputs, num_outputs;
+  ExpectToken(is, binary, "<NumInputs>");
+  ReadBasicType(is, binary, &num_inputs);
+  KALDI_ASSERT(num_inputs >= 0);
+  inputs.resize(num_inputs);
+  for (int32 i = 0; i < num_inputs; i++)
+    inputs[i].Read(is, binary);
+  ExpectToken(is, binary, "<NumOutputs>");
+  ReadBasicType(is, binary, &num_outputs);
+  KALDI_ASSERT(num_outputs >= 0);
+  outputs.resize(num_outputs);
+  for (int32 i = 0; i < num_outputs; i++)
+    outputs[i].Read(is, binary);
+  ExpectToken(is, binary, "<NeedModelDerivative>");
+  ReadBasicType(is, binary, &need_model_derivative);
+  ExpectToken(is, binary, "<StoreComponentStats>");
+  ReadBasicType(is, binary, &store_component_stats);
+  ExpectToken(is, binary, "</ComputationRequest>");
+}
+
 bool ComputationRequest::operator== (const ComputationRequest &other) const {
   // rely on the std::vector's default implementation of ==, which in turn
   // relies on the == operator of class IoSpecification.
@@ -511,6 +667,212 @@ bool ComputationRequest::operator== (const ComputationRequest &other) const {
       misc_info == other.misc_info;
 }
 
+// Writes a vector of pairs of integers, as two integer vectors.
+static void WritePairVector(std::ostream &os, bool binary,
+                            const std::vector<std::pair<int32, int32> > &vec) {
+  std::vector<int32> first(vec.size()), second(vec.size());
+  for (size_t i = 0; i < vec.size(); i++) {
+    first[i] = vec[i].first;
+    second[i] = vec[i].second;
+  }
+  WriteIntegerVector(os, binary, first);
+  WriteIntegerVector(os, binary, second);
+}
+
+static void ReadPairVector(std::istream &is, bool binary,
+                           std::vector<std::pair<int32, int32> > *vec) {
+  std::vector<int32> first, second;
+  ReadIntegerVector(is, binary, &first);
+  ReadIntegerVector(is, binary, &second);
+  KALDI_ASSERT(first.size() == second.size());
+  vec->resize(first.size());
+  for (size_t i = 0; i < first.size(); i++)
+    (*vec)[i] = std::pair<int32, int32>(first[i], second[i]);
+}
+
+bool NnetComputation::HasPrecomputedIndexes() const {
+  for (size_t i = 0; i < component_precomputed_indexes.size(); i++)
+    if (component_precomputed_indexes[i] != NULL)
+      return true;
+  return false;
+}
+
+void NnetComputation::Write(std::ostream &os, bool binary) const {
+  if (HasPrecomputedIndexes())
+    KALDI_ERR << "Writing computations with precomputed component indexes "
+              << "is not supported.";
+  WriteToken(os, binary, "<NnetComputation>");
+  WriteToken(os, binary, "<Matrices>");
+  WriteBasicType(os, binary, static_cast<int32>(matrices.size()));
+  for (size_t i = 0; i < matrices.size(); i++) {
+    WriteBasicType(os, binary, matrices[i].num_rows);
+    WriteBasicType(os, binary, matrices[i].num_cols);
+  }
+  WriteToken(os, binary, "<MatrixDebugInfo>");
+  WriteBasicType(os, binary, static_cast<int32>(matrix_debug_info.size()));
+  for (size_t i = 0; i < matrix_debug_info.size(); i++) {
+    const MatrixDebugInfo &info = matrix_debug_info[i];
+    WriteBasicType(os, binary, info.is_deriv);
+    std::vector<int32> nodes(info.cindexes.size());
+    std::vector<Index> indexes(info.cindexes.size());
+    for (size_t j = 0; j < info.cindexes.size(); j++) {
+      nodes[j] = info.cindexes[j].first;
+      indexes[j] = info.cindexes[j].second;
+    }
+    WriteIntegerVector(os, binary, nodes);
+    WriteIndexVector(os, binary, indexes);
+  }
+  WriteToken(os, binary, "<SubMatrices>");
+  WriteBasicType(os, binary, static_cast<int32>(submatrices.size()));
+  for (size_t i = 0; i < submatrices.size(); i++) {
+    const SubMatrixInfo &info = submatrices[i];
+    WriteBasicType(os, binary, info.matrix_index);
+    WriteBasicType(os, binary, info.row_offset);
+    WriteBasicType(os, binary, info.num_rows);
+    WriteBasicType(os, binary, info.col_offset);
+    WriteBasicType(os, binary, info.num_cols);
+  }
+  WriteToken(os, binary, "<NumComponentPrecomputedIndexes>");
+  WriteBasicType(os, binary,
+                 static_cast<int32>(component_precomputed_indexes.size()));
+  WriteToken(os, binary, "<Indexes>");
+  WriteBasicType(os, binary, static_cast<int32>(indexes.size()));
+  for (size_t i = 0; i < indexes.size(); i++)
+    WriteIntegerVector(os, binary, indexes[i]);
+  WriteToken(os, binary, "<IndexesMulti>");
+  WriteBasicType(os, binary, static_cast<int32>(indexes_multi.size()));
+  for (size_t i = 0; i < indexes_multi.size(); i++)
+    WritePairVector(os, binary, indexes_multi[i]);
+  WriteToken(os, binary, "<IndexesRanges>");
+  WriteBasicType(os, binary, static_cast<int32>(indexes_ranges.size()));
+  for (size_t i = 0; i < indexes_ranges.size(); i++)
+    WritePairVector(os, binary, indexes_ranges[i]);
+  WriteToken(os, binary, "<InputOutputInfo>");
+  // we sort the map so the output doesn't depend on the hash function.
+  std::map<int32, std::pair<int32, int32> > io_info(input_output_info.begin(),
+                                                    input_output_info.end());
+  WriteBasicType(os, binary, static_cast<int32>(io_info.size()));
+  std::map<int32, std::pair<int32, int32> >::const_iterator
+      iter = io_info.begin(), end = io_info.end();
+  for (; iter != end; ++iter) {
+    WriteBasicType(os, binary, iter->first);
+    WriteBasicType(os, binary, iter->second.first);
+    WriteBasicType(os, binary, iter->second.second);
+  }
+  WriteToken(os, binary, "<Commands>");
+  WriteBasicType(os, binary, static_cast<int32>(commands.size()));
+  for (size_t i = 0; i < commands.size(); i++) {
+    const Command &c = commands[i];
+    WriteBasicType(os, binary, static_cast<int32>(c.command_type));
+    WriteBasicType(os, binary, c.arg1);
+    WriteBasicType(os, binary, c.arg2);
+    WriteBasicType(os, binary, c.arg3);
+    WriteBasicType(os, binary, c.arg4);
+    WriteBasicType(os, binary, c.arg5);
+    WriteBasicType(os, binary, c.arg6);
+  }
+  WriteToken(os, binary, "<NeedModelDerivative>");
+  WriteBasicType(os, binary, need_model_derivative);
+  WriteToken(os, binary, "</NnetComputation>");
+}
+
+void NnetComputation::Read(std::istream &is, bool binary) {
+  Clear();
+  int32 size;
+  ExpectToken(is, binary, "<NnetComputation>");
+  ExpectToken(is, binary, "<Matrices>");
+  ReadBasicType(is, binary, &size);
+  KALDI_ASSERT(size >= 0);
+  matrices.resize(size);
+  for (int32 i = 0; i < size; i++) {
+    ReadBasicType(is, binary, &(matrices[i].num_rows));
+    ReadBasicType(is, binary, &(matrices[i].num_cols));
+  }
+  ExpectToken(is, binary, "<MatrixDebugInfo>");
+  ReadBasicType(is, binary, &size);
+  KALDI_ASSERT(size >= 0);
+  matrix_debug_info.resize(size);
+  for (int32 i = 0; i < size; i++) {
+    MatrixDebugInfo &info = matrix_debug_info[i];
+    ReadBasicType(is, binary, &(info.is_deriv));
+    std::vector<int32> nodes;
+    std::vector<Index> indexes;
+    ReadIntegerVector(is, binary, &nodes);
+    ReadIndexVector(is, binary, &indexes);
+    KALDI_ASSERT(nodes.size() == indexes.size());
+    info.cindexes.resize(nodes.size());
+    for (size_t j = 0; j < nodes.size(); j++)
+      info.cindexes[j] = Cindex(nodes[j], indexes[j]);
+  }
+  ExpectToken(is, binary, "<SubMatrices>");
+  ReadBasicType(is, binary, &size);
+  KALDI_ASSERT(size >= 0);
+  submatrices.resize(size);
+  for (int32 i = 0; i < size; i++) {
+    SubMatrixInfo &info = submatrices[i];
+    ReadBasicType(is, binary, &(info.matrix_index));
+    ReadBasicType(is, binary, &(info.row_offset));
+    ReadBasicType(is, binary, &(info.num_rows));
+    ReadBasicType(is, binary, &(info.col_offset));
+    ReadBasicType(is, binary, &(info.num_cols));
+  }
+  ExpectToken(is, binary, "<NumComponentPrecomputedIndexes>");
+  ReadBasicType(is, binary, &size);
+  KALDI_ASSERT(size >= 0);
+  // they are all NULL; see Write().
+  component_precomputed_indexes.resize(size, NULL);
+  ExpectToken(is, binary, "<Indexes>");
+  ReadBasicType(is, binary, &size);
+  KALDI_ASSERT(size >= 0);
+  indexes.resize(size);
+  for (int32 i = 0; i < size; i++)
+    ReadIntegerVector(is, binary, &(indexes[i]));
+  ExpectToken(is, binary, "<IndexesMulti>");
+  ReadBasicType(is, binary, &size);
+  KALDI_ASSERT(size >= 0);
+  indexes_multi.resize(size);
+  for (int32 i = 0; i < size; i++)
+    ReadPairVector(is, binary, &(indexes_multi[i]));
+  ExpectToken(is, binary, "<IndexesRanges>");
+  ReadBasicType(is, binary, &size);
+  KALDI_ASSERT(size >= 0);
+  indexes_ranges.resize(size);
+  for (int32 i = 0; i < size; i++)
+    ReadPairVector(is, binary, &(indexes_ranges[i]));
+  ExpectToken(is, binary, "<InputOutputInfo>");
+  ReadBasicType(is, binary, &size);
+  KALDI_ASSERT(size >= 0);
+  for (int32 i = 0; i < size; i++) {
+    int32 node_index, value_matrix, deriv_matrix;
+    ReadBasicType(is, binary, &node_index);
+    ReadBasicType(is, binary, &value_matrix);
+    ReadBasicType(is, binary, &deriv_matrix);
+    input_output_info[node_index] = std::pair<int32, int32>(value_matrix,
+                                                            deriv_matrix);
+  }
+  ExpectToken(is, binary, "<Commands>");
+  ReadBasicType(is, binary, &size);
+  KALDI_ASSERT(size >= 0);
+  commands.resize(size);
+  for (int32 i = 0; i < size; i++) {
+    Command &c = commands[i];
+    int32 command_type;
+    ReadBasicType(is, binary, &command_type);
+    if (command_type < 0 || command_type > kNoOperationMarker)
+      KALDI_ERR << "Invalid command type " << command_type;
+    c.command_type = static_cast<CommandType>(command_type);
+    ReadBasicType(is, binary, &(c.arg1));
+    ReadBasicType(is, binary, &(c.arg2));
+    ReadBasicType(is, binary, &(c.arg3));
+    ReadBasicType(is, binary, &(c.arg4));
+    ReadBasicType(is, binary, &(c.arg5));
+    ReadBasicType(is, binary, &(c.arg6));
+  }
+  ExpectToken(is, binary, "<NeedModelDerivative>");
+  ReadBasicType(is, binary, &need_model_derivative);
+  ExpectToken(is, binary, "</NnetComputation>");
+}
+
 NnetComputation::NnetComputation(const NnetComputation &other):
     matrices(other.matrices),
     matrix_debug_info(other.matrix_debug_info),
@@ -522,7 +884,9 @@ NnetComputation::NnetComputation(const NnetComputation &other):
     commands(other.commands),
     need_model_derivative(other.need_model_derivative),
     indexes_cuda(other.indexes_cuda),
-    indexes_ranges_cuda(other.indexes_ranges_cuda) {
+    indexes_ranges_cuda(other.indexes_ranges_cuda),
+    matrix_workspace_offsets(other.matrix_workspace_offsets),
+    workspace_size(other.workspace_size) {
   for (size_t i = 0; i < other.component_precomputed_indexes.size(); i++)
       component_precomputed_indexes.push_back(
           other.component_precomputed_indexes[i] == NULL ? NULL :
@@ -542,6 +906,8 @@ NnetComputation& NnetComputation::operator = (const NnetComputation &other) {
     need_model_derivative = other.need_model_derivative;
     indexes_cuda = other.indexes_cuda;
     indexes_ranges_cuda = other.indexes_ranges_cuda;
+    matrix_workspace_offsets = other.matrix_workspace_offsets;
+    workspace_size = other.workspace_size;
 
     for (size_t i = 0; i < component_precomputed_indexes.size(); i++)
       delete component_precomputed_indexes[i];
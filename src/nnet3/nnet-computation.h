@@ -87,6 +87,10 @@ struct IoSpecification {
   /// Output ends in a newline.
   void Print(std::ostream &os) const;
 
+  void Write(std::ostream &os, bool binary) const;
+
+  void Read(std::istream &is, bool binary);
+
   bool operator== (const IoSpecification &other) const;
 };
 
@@ -137,6 +141,10 @@ struct ComputationRequest {
   /// in a human-readable way.
   void Print(std::ostream &os) const;
 
+  void Write(std::ostream &os, bool binary) const;
+
+  void Read(std::istream &is, bool binary);
+
   bool operator== (const ComputationRequest &other) const;
 };
 
@@ -162,6 +170,10 @@ struct ComputationRequest {
        for simple Components)
      - arg3 is sub-matrix index of input
      - arg4 is sub-matrix index of output
+     - arg5 is normally -1; if it's >= 0, it is the index of a second
+       component whose Propagate() is done in place on the output, fused with
+       this one (see FusePropagateCommands() and
+       AffineComponent::PropagateFused()).
    - kStoreStats: Call Component::StoreStats() (used for computing diagnostics
       such as average activations; called after Propagate).
      - arg1 is component-index in neural net
@@ -309,6 +321,20 @@ struct NnetComputation {
   // computed from "indexes_ranges" by ComputeCudaIndexes().
   std::vector<CuArray<Int32Pair> > indexes_ranges_cuda;
 
+  // The memory plan, computed by ComputeMemoryPlan() (if it was not called,
+  // this is empty and NnetComputer allocates each matrix separately).  If
+  // nonempty it has the same dimension as "matrices", and for each matrix that
+  // lives in the workspace shared by all the matrices of the computation, it
+  // gives the offset (in elements) of the matrix's data from the start of the
+  // workspace; the row stride of such a matrix is WorkspaceStride(num_cols).
+  // It's -1 for matrices that are allocated separately: the inputs and outputs,
+  // and matrices that take part in kAllocMatrixFromOther* commands.
+  std::vector<int64> matrix_workspace_offsets;
+
+  // The size of the workspace (in elements) required by the memory plan; zero
+  // if there is no memory plan.
+  int64 workspace_size;
+
 
   /// Convenience function used when adding new matrices.  Writes to
   /// 'this->matrices' and 'this->submatrices'; and if 'this->matrix_debug_info'
@@ -335,6 +361,26 @@ struct NnetComputation {
   // the indexes.
   void ComputeCudaIndexes();
 
+  // This works out the lifetime of each matrix (from its allocation to its
+  // deallocation command) and assigns the matrices offsets in a single
+  // workspace, so that matrices whose lifetimes overlap don't share memory;
+  // it's a bit like register allocation.  It sets matrix_workspace_offsets and
+  // workspace_size.  It may be called after the computation is optimized, and
+  // it must be called again (or the plan cleared) if the commands are changed
+  // after that.  The workspace is allocated once by NnetComputer, which saves
+  // the time spent in the memory allocator, and the plan usually needs much
+  // less memory than the sum of the matrix sizes.
+  void ComputeMemoryPlan();
+
+  // Returns the row stride of a matrix with 'num_cols' columns, if it is
+  // located in the workspace; this is num_cols rounded up to a multiple of
+  // kWorkspaceAlignment, so that each row starts on an aligned address.
+  static int32 WorkspaceStride(int32 num_cols) {
+    return (num_cols + kWorkspaceAlignment - 1) / kWorkspaceAlignment *
+        kWorkspaceAlignment;
+  }
+  static const int32 kWorkspaceAlignment = 16;
+
   // This function produces pretty-print ouput intended to allow a human to
   // interpret the computation.
   void Print(std::ostream &os, const Nnet &nnet) const;
@@ -356,6 +402,19 @@ struct NnetComputation {
                          std::vector<std::string> *command_strings) const;
 
 
+  // Writes the computation (e.g. as part of a cache of compiled computations;
+  // see CachingOptimizingCompiler::WriteCache()).  The CUDA indexes are not
+  // written; call ComputeCudaIndexes() after reading.  It is an error to call
+  // this if any of the Components have precomputed indexes (see
+  // HasPrecomputedIndexes()), since those can't currently be written.
+  void Write(std::ostream &os, bool binary) const;
+
+  void Read(std::istream &is, bool binary);
+
+  // Returns true if any of the elements of component_precomputed_indexes is
+  // non-NULL.
+  bool HasPrecomputedIndexes() const;
+
   // destructor deletes pointers in component_precomputed_indexes.
   ~NnetComputation();
   // removes all information from this struct, makes it as a newly constructed one.
@@ -366,7 +425,7 @@ struct NnetComputation {
   // Assignment operator.
   NnetComputation &operator = (const NnetComputation &other);
   // Default constructor
-  NnetComputation(): need_model_derivative(false) { }
+  NnetComputation(): need_model_derivative(false), workspace_size(0) { }
 };
 
 
@@ -374,8 +433,6 @@ struct NnetComputation {
 
 // This operator is to print out the NnetComputation in a human-readable way, for
 // debugging purposes.
-// We don't give Read and Write functions to struct NnetComputation, because we
-// don't anticipate needing to write it to disk.
 std::ostream &operator << (std::ostream &os,
                            NnetComputation &computation);
 
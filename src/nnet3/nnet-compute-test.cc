@@ -23,6 +23,7 @@
 #include "nnet3/nnet-test-utils.h"
 #include "nnet3/nnet-optimize.h"
 #include "nnet3/nnet-compute.h"
+#include "thread/kaldi-thread.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -76,6 +77,8 @@ void UnitTestNnetCompute() {
     NnetComputeOptions compute_opts;
     if (RandInt(0, 1) == 0)
       compute_opts.debug = true;
+    if (RandInt(0, 1) == 0)
+      compute_opts.profile = true;
     
     computation.ComputeCudaIndexes();
     NnetComputer computer(compute_opts,
@@ -108,6 +111,104 @@ void UnitTestNnetCompute() {
   }
 }
 
+
+// This class is used in UnitTestNnetComputeMultiThreaded().  Each thread
+// repeatedly does one of the computations in "requests", using its own
+// NnetComputer but sharing the Nnet and the CachingOptimizingCompiler with the
+// other threads, and checks that the output is the same as when it was
+// computed in a single thread.
+class ConcurrentComputeTester: public MultiThreadable {
+ public:
+  ConcurrentComputeTester(
+      const Nnet *nnet,
+      CachingOptimizingCompiler *compiler,
+      const std::vector<ComputationRequest> *requests,
+      const std::vector<std::vector<Matrix<BaseFloat> > > *inputs,
+      const std::vector<Matrix<BaseFloat> > *ref_outputs):
+      nnet_(nnet), compiler_(compiler), requests_(requests), inputs_(inputs),
+      ref_outputs_(ref_outputs) { }
+
+  void operator () () {
+    int32 num_requests = requests_->size();
+    for (int32 iter = 0; iter < 20; iter++) {
+      int32 r = (thread_id_ + iter) % num_requests;
+      const ComputationRequest &request = (*requests_)[r];
+      const NnetComputation *computation = compiler_->Compile(request);
+      NnetComputeOptions compute_opts;
+      NnetComputer computer(compute_opts, *computation, *nnet_, NULL);
+      for (size_t i = 0; i < request.inputs.size(); i++) {
+        CuMatrix<BaseFloat> temp((*inputs_)[r][i]);
+        computer.AcceptInput(request.inputs[i].name, &temp);
+      }
+      computer.Forward();
+      Matrix<BaseFloat> output(computer.GetOutput("output"));
+      KALDI_ASSERT(output.ApproxEqual((*ref_outputs_)[r]));
+    }
+  }
+ private:
+  const Nnet *nnet_;
+  CachingOptimizingCompiler *compiler_;
+  const std::vector<ComputationRequest> *requests_;
+  const std::vector<std::vector<Matrix<BaseFloat> > > *inputs_;
+  const std::vector<Matrix<BaseFloat> > *ref_outputs_;
+};
+
+// Tests that one const Nnet and one CachingOptimizingCompiler can be shared by
+// several threads doing inference at the same time.
+void UnitTestNnetComputeMultiThreaded() {
+  for (int32 n = 0; n < 5; n++) {
+    struct NnetGenerationOptions gen_config;
+    std::vector<std::string> configs;
+    GenerateConfigSequence(gen_config, &configs);
+    Nnet nnet;
+    for (size_t j = 0; j < configs.size(); j++) {
+      std::istringstream is(configs[j]);
+      nnet.ReadConfig(is);
+    }
+
+    int32 num_requests = 4;
+    std::vector<ComputationRequest> requests(num_requests);
+    std::vector<std::vector<Matrix<BaseFloat> > > inputs(num_requests);
+    std::vector<Matrix<BaseFloat> > ref_outputs(num_requests);
+    {
+      CachingOptimizingCompiler compiler(nnet);
+      for (int32 r = 0; r < num_requests; r++) {
+        ComputationRequest &request = requests[r];
+        ComputeExampleComputationRequestSimple(nnet, &request, &(inputs[r]));
+        // we're testing inference, so no derivatives.
+        request.need_model_derivative = false;
+        request.store_component_stats = false;
+        for (size_t i = 0; i < request.inputs.size(); i++)
+          request.inputs[i].has_deriv = false;
+        for (size_t i = 0; i < request.outputs.size(); i++)
+          request.outputs[i].has_deriv = false;
+        const NnetComputation *computation = compiler.Compile(request);
+        NnetComputeOptions compute_opts;
+        NnetComputer computer(compute_opts, *computation, nnet, NULL);
+        for (size_t i = 0; i < request.inputs.size(); i++) {
+          CuMatrix<BaseFloat> temp(inputs[r][i]);
+          computer.AcceptInput(request.inputs[i].name, &temp);
+        }
+        computer.Forward();
+        const CuMatrixBase<BaseFloat> &output = computer.GetOutput("output");
+        ref_outputs[r].Resize(output.NumRows(), output.NumCols());
+        output.CopyToMat(&(ref_outputs[r]));
+      }
+    }
+    // capacity 0 means the computations are never evicted, which is what
+    // makes it safe to share the compiler.
+    CachingOptimizingCompiler shared_compiler(nnet, 0);
+    int32 num_threads = RandInt(2, 8);
+    {
+      // the destructor of MultiThreader waits for the threads to finish.
+      MultiThreader<ConcurrentComputeTester> m(
+          num_threads, ConcurrentComputeTester(&nnet, &shared_compiler,
+                                               &requests, &inputs,
+                                               &ref_outputs));
+    }
+  }
+}
+
 } // namespace nnet3
 } // namespace kaldi
 
@@ -125,7 +226,11 @@ int main() {
       CuDevice::Instantiate().SelectGpuId("yes");
 #endif
     UnitTestNnetCompute();
+    // Only one thread may use the GPU.
+    if (loop == 0)
+      UnitTestNnetComputeMultiThreaded();
   }
+  NnetComputeProfiler::Print();
 
   KALDI_LOG << "Nnet tests succeeded.";
 
@@ -18,8 +18,13 @@
 // limitations under the License.
 
 #include <iterator>
+#include <limits>
 #include <sstream>
 #include "nnet3/nnet-compute.h"
+#include "nnet3/nnet-simple-component.h"
+#include "base/timer.h"
+#include "base/kaldi-memory-stats.h"
+#include "base/kaldi-trace.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -31,11 +36,20 @@ NnetComputer::NnetComputer(const NnetComputeOptions &options,
                            Nnet *nnet_to_update):
     options_(options), computation_(computation), nnet_(nnet),
     nnet_to_update_(nnet_to_update) {
+  MemoryTagScope memory_tag(kMemoryNnet);
   KALDI_ASSERT(computation.indexes_cuda.size() == computation.indexes.size() &&
  computation.indexes_ranges_cuda.size() == computation.indexes_ranges.size() &&
                "You must call NnetComputation::ComputeCudaIndexes() before "
                "executing the computation.");
   matrices_.resize(computation.matrices.size());
+  if (!computation.matrix_workspace_offsets.empty()) {
+    KALDI_ASSERT(computation.matrix_workspace_offsets.size() ==
+                 computation.matrices.size());
+    KALDI_ASSERT(computation.workspace_size <
+                 std::numeric_limits<MatrixIndexT>::max() &&
+                 "Workspace is too large; don't use a memory plan.");
+    workspace_.Resize(computation.workspace_size, kUndefined);
+  }
   debug_ = (options_.debug || GetVerboseLevel() >= 5);
   if (debug_) {
     ComputationVariables variables;
@@ -47,6 +61,8 @@ NnetComputer::NnetComputer(const NnetComputeOptions &options,
     KALDI_LOG << preamble;
     computation.GetSubmatrixStrings(nnet, &submatrix_strings_);
   }
+  if (options_.profile)
+    ComputeProfileKeys();
 }
 
 //static
@@ -73,7 +89,7 @@ void NnetComputer::DebugBeforeExecute(int32 command,
     info->matrices_written_stddevs.resize(size);
     for (size_t i = 0; i < size; i++) {
       int32 m = matrices_written[i];
-      info->matrices_written_stddevs[i] = MatrixStddev(matrices_[m]);
+      info->matrices_written_stddevs[i] = MatrixStddev(GetMatrix(m));
     }
   }
   {
@@ -110,7 +126,7 @@ void NnetComputer::DebugAfterExecute(int32 command,
     for (size_t i = 0; i < size; i++) {
       int32 m = matrices_written[i];
       BaseFloat old_stddev = info.matrices_written_stddevs[i],
-          stddev = MatrixStddev(matrices_[m]);
+          stddev = MatrixStddev(GetMatrix(m));
       os << 'm' << m << ": " << old_stddev << "->" << stddev << " ";
     }
   }
@@ -143,22 +159,98 @@ void NnetComputer::DebugAfterExecute(int32 command,
 }
 
 
+// Returns the name of the enum value, e.g. "kPropagate"; used in profiling.
+static const char *CommandTypeName(CommandType command_type) {
+  switch (command_type) {
+    case kAllocMatrixUndefined: return "kAllocMatrixUndefined";
+    case kAllocMatrixZeroed: return "kAllocMatrixZeroed";
+    case kDeallocMatrix: return "kDeallocMatrix";
+    case kAllocMatrixFromOther: return "kAllocMatrixFromOther";
+    case kAllocMatrixFromOtherZeroed: return "kAllocMatrixFromOtherZeroed";
+    case kPropagate: return "kPropagate";
+    case kStoreStats: return "kStoreStats";
+    case kBackprop: return "kBackprop";
+    case kBackpropNoModelUpdate: return "kBackpropNoModelUpdate";
+    case kMatrixCopy: return "kMatrixCopy";
+    case kMatrixAdd: return "kMatrixAdd";
+    case kCopyRows: return "kCopyRows";
+    case kAddRows: return "kAddRows";
+    case kCopyRowsMulti: return "kCopyRowsMulti";
+    case kCopyToRowsMulti: return "kCopyToRowsMulti";
+    case kAddRowsMulti: return "kAddRowsMulti";
+    case kAddToRowsMulti: return "kAddToRowsMulti";
+    case kAddRowRanges: return "kAddRowRanges";
+    case kNoOperation: return "kNoOperation";
+    case kNoOperationMarker: return "kNoOperationMarker";
+    default: KALDI_ERR << "Unknown command type " << command_type;
+  }
+  return "";  // Suppress compiler warning.
+}
+
+void NnetComputer::ComputeProfileKeys() {
+  int32 num_commands = computation_.commands.size();
+  profile_keys_.resize(num_commands);
+  for (int32 i = 0; i < num_commands; i++) {
+    const NnetComputation::Command &c = computation_.commands[i];
+    std::ostringstream os;
+    os << CommandTypeName(c.command_type);
+    switch (c.command_type) {
+      case kPropagate: case kStoreStats:
+      case kBackprop: case kBackpropNoModelUpdate:
+        os << ' ' << nnet_.GetComponentName(c.arg1) << " ("
+           << nnet_.GetComponent(c.arg1)->Type() << ')';
+        if (c.command_type == kPropagate && c.arg5 >= 0)
+          os << " fused with " << nnet_.GetComponentName(c.arg5);
+        break;
+      default:
+        break;
+    }
+    profile_keys_[i] = os.str();
+  }
+}
+
+void NnetComputer::ExecuteCommandProfiled(int32 command) {
+  // When using a GPU, commands are executed asynchronously, so we have to
+  // wait for the previous commands to finish before starting the timer, and
+  // for this one to finish before stopping it.
+#if HAVE_CUDA == 1
+  bool use_gpu = CuDevice::Instantiate().Enabled();
+  if (use_gpu)
+    CU_SAFE_CALL(cudaDeviceSynchronize());
+#endif
+  Timer timer;
+  ExecuteCommand(command);
+#if HAVE_CUDA == 1
+  if (use_gpu)
+    CU_SAFE_CALL(cudaDeviceSynchronize());
+#endif
+  NnetComputeProfiler::Accumulate(profile_keys_[command], timer.Elapsed());
+}
+
 void NnetComputer::ExecuteCommand(int32 command) {
   const NnetComputation::Command &c = computation_.commands[command];
+  // The component names in profile_keys_ would not outlive this object, so
+  // the trace only has the command type.
+  KALDI_TRACE_SCOPE(CommandTypeName(c.command_type));
   try {
     switch (c.command_type) {
       case kAllocMatrixZeroed:
-        matrices_[c.arg1].Resize(computation_.matrices[c.arg1].num_rows,
-                                 computation_.matrices[c.arg1].num_cols,
-                                 kSetZero);
+        if (InWorkspace(c.arg1))
+          GetMatrix(c.arg1).SetZero();
+        else
+          matrices_[c.arg1].Resize(computation_.matrices[c.arg1].num_rows,
+                                   computation_.matrices[c.arg1].num_cols,
+                                   kSetZero);
         break;
       case kAllocMatrixUndefined:
-        matrices_[c.arg1].Resize(computation_.matrices[c.arg1].num_rows,
-                                 computation_.matrices[c.arg1].num_cols,
-                                 kUndefined);
+        if (!InWorkspace(c.arg1))
+          matrices_[c.arg1].Resize(computation_.matrices[c.arg1].num_rows,
+                                   computation_.matrices[c.arg1].num_cols,
+                                   kUndefined);
         break;
       case kDeallocMatrix:
-        matrices_[c.arg1].Resize(0, 0);
+        if (!InWorkspace(c.arg1))
+          matrices_[c.arg1].Resize(0, 0);
         break;
       case kAllocMatrixFromOther:
         matrices_[c.arg1].Swap(&(matrices_[c.arg2]));
@@ -173,7 +265,15 @@ void NnetComputer::ExecuteCommand(int32 command) {
             computation_.component_precomputed_indexes[c.arg2];
         const CuSubMatrix<BaseFloat> input(GetSubMatrix(c.arg3));
         CuSubMatrix<BaseFloat> output(GetSubMatrix(c.arg4));
-        component->Propagate(indexes, input, &output);
+        if (c.arg5 >= 0) {
+          // fused with the following component; see FusePropagateCommands().
+          const AffineComponent *affine =
+              dynamic_cast<const AffineComponent*>(component);
+          KALDI_ASSERT(affine != NULL);
+          affine->PropagateFused(input, *nnet_.GetComponent(c.arg5), &output);
+        } else {
+          component->Propagate(indexes, input, &output);
+        }
         break;
       }
       case kStoreStats: {
@@ -292,11 +392,32 @@ CuSubMatrix<BaseFloat> NnetComputer::GetSubMatrix(int32 submatrix_index) {
                         computation_.submatrices.size());
   const NnetComputation::SubMatrixInfo &info =
       computation_.submatrices[submatrix_index];
+  if (InWorkspace(info.matrix_index)) {
+    int32 stride = NnetComputation::WorkspaceStride(
+        computation_.matrices[info.matrix_index].num_cols);
+    const BaseFloat *data = workspace_.Data() +
+        computation_.matrix_workspace_offsets[info.matrix_index] +
+        static_cast<int64>(info.row_offset) * stride + info.col_offset;
+    return CuSubMatrix<BaseFloat>(data, info.num_rows, info.num_cols, stride);
+  }
   const CuMatrix<BaseFloat> &mat = matrices_[info.matrix_index];
   return CuSubMatrix<BaseFloat>(
       mat, info.row_offset, info.num_rows, info.col_offset, info.num_cols);
 }
 
+CuSubMatrix<BaseFloat> NnetComputer::GetMatrix(int32 matrix_index) {
+  if (InWorkspace(matrix_index)) {
+    const NnetComputation::MatrixInfo &info =
+        computation_.matrices[matrix_index];
+    return CuSubMatrix<BaseFloat>(
+        workspace_.Data() + computation_.matrix_workspace_offsets[matrix_index],
+        info.num_rows, info.num_cols,
+        NnetComputation::WorkspaceStride(info.num_cols));
+  }
+  const CuMatrix<BaseFloat> &mat = matrices_[matrix_index];
+  return CuSubMatrix<BaseFloat>(mat, 0, mat.NumRows(), 0, mat.NumCols());
+}
+
 void NnetComputer::GetPointers(int32 indexes_multi_index,
                                int32 num_cols,
                                CuArray<BaseFloat*> *pointers) {
@@ -349,6 +470,7 @@ void NnetComputer::GetPointers(int32 indexes_multi_index,
 }
 
 void NnetComputer::Forward() {
+  MemoryTagScope memory_tag(kMemoryNnet);
   CheckInputs(false);
   int32 size = computation_.commands.size(), i = 0;
   const std::vector<NnetComputation::Command> &c = computation_.commands;
@@ -358,7 +480,10 @@ void NnetComputer::Forward() {
        i++) {
     if (debug_)
       DebugBeforeExecute(i, &info);
-    ExecuteCommand(i);
+    if (options_.profile)
+      ExecuteCommandProfiled(i);
+    else
+      ExecuteCommand(i);
     if (debug_)
       DebugAfterExecute(i, info);
   }
@@ -367,6 +492,7 @@ void NnetComputer::Forward() {
 
 
 void NnetComputer::Backward() {
+  MemoryTagScope memory_tag(kMemoryNnet);
   CheckInputs(true);
   int32 size = computation_.commands.size(), i = 0;
   const std::vector<NnetComputation::Command> &c = computation_.commands;
@@ -376,7 +502,10 @@ void NnetComputer::Backward() {
   for (; i < size; i++) {
     if (debug_)
       DebugBeforeExecute(i, &info);
-    ExecuteCommand(i);
+    if (options_.profile)
+      ExecuteCommandProfiled(i);
+    else
+      ExecuteCommand(i);
     if (debug_)
       DebugAfterExecute(i, info);
   }
@@ -529,5 +658,45 @@ void NnetComputer::AcceptInputs(const Nnet &nnet,
   }
 }
 
+Mutex NnetComputeProfiler::mutex_;
+std::map<std::string, NnetComputeProfiler::Stats> NnetComputeProfiler::stats_;
+
+void NnetComputeProfiler::Accumulate(const std::string &key, double seconds) {
+  mutex_.Lock();
+  Stats &stats = stats_[key];
+  stats.seconds += seconds;
+  stats.count++;
+  mutex_.Unlock();
+}
+
+void NnetComputeProfiler::Print() {
+  mutex_.Lock();
+  if (!stats_.empty()) {
+    std::vector<std::pair<double, std::string> > pairs;
+    double total_seconds = 0.0;
+    std::map<std::string, Stats>::const_iterator iter = stats_.begin(),
+        end = stats_.end();
+    for (; iter != end; ++iter) {
+      pairs.push_back(std::make_pair(iter->second.seconds, iter->first));
+      total_seconds += iter->second.seconds;
+    }
+    std::sort(pairs.begin(), pairs.end(),
+              std::greater<std::pair<double, std::string> >());
+    std::ostringstream os;
+    os << "-----\n[nnet computation profile]\n"
+       << "seconds\tpercent\tcount\tcommand\n";
+    for (size_t i = 0; i < pairs.size(); i++) {
+      const Stats &stats = stats_[pairs[i].second];
+      os << stats.seconds << "\t"
+         << (100.0 * stats.seconds / std::max(total_seconds, 1.0e-20)) << "\t"
+         << stats.count << "\t" << pairs[i].second << "\n";
+    }
+    os << "Total time in commands:\t" << total_seconds << "s\n-----";
+    KALDI_LOG << os.str();
+  }
+  mutex_.Unlock();
+}
+
+
 } // namespace nnet3
 } // namespace kaldi
@@ -25,6 +25,7 @@
 #include "nnet3/nnet-computation.h"
 #include "nnet3/nnet-analyze.h"
 #include "nnet3/nnet-example.h"
+#include "thread/kaldi-mutex.h"
 
 #include <iostream>
 #include <sstream>
@@ -38,16 +39,52 @@ namespace nnet3 {
 
 struct NnetComputeOptions {
   bool debug;
-  NnetComputeOptions(): debug(false) { }
+  bool profile;
+  NnetComputeOptions(): debug(false), profile(false) { }
   void Register(OptionsItf *opts) {
     opts->Register("debug", &debug, "If true, turn on "
                    "debug for the neural net computation (very verbose!) "
                    "Will be turned on regardless if --verbose >= 5");
+    opts->Register("profile", &profile, "If true, time each command of the "
+                   "neural net computation and print a summary of the times "
+                   "per command type and component at the end of the "
+                   "program.  Slows down GPU computation, because it waits "
+                   "for each command to finish.");
   }
   
 };
 
 
+/**
+   NnetComputeProfiler accumulates the time taken by the commands that
+   NnetComputer executes when its options have profile == true.  The
+   statistics are for the whole process (a program normally creates a new
+   NnetComputer for each minibatch or chunk), grouped by a key that contains
+   the command type and, for commands that run a component, the component's
+   name and type, e.g. "kPropagate affine3 (AffineComponent)".  It's safe to
+   accumulate from several threads.  Programs call Print() at the end.
+ */
+class NnetComputeProfiler {
+ public:
+  /// Adds "seconds" to the total time of "key", and one to its count.
+  static void Accumulate(const std::string &key, double seconds);
+
+  /// Prints the accumulated times with KALDI_LOG, longest first; it does
+  /// nothing if there are no statistics (e.g. if profiling was not turned
+  /// on).
+  static void Print();
+
+ private:
+  struct Stats {
+    double seconds;
+    int64 count;
+    Stats(): seconds(0.0), count(0) { }
+  };
+  static Mutex mutex_;
+  static std::map<std::string, Stats> stats_;
+};
+
+
 /**
   class NnetComputer is responsible for executing the computation described in the
   "computation" object.
@@ -55,6 +92,12 @@ struct NnetComputeOptions {
   You call in sequence, the constructor, then AcceptInput() [or AcceptInputs()],
   then Forward(), then GetOutput(), then if applicable (Backward(), then if
   applicable GetInputDeriv()).
+
+  An NnetComputer object should be used by one thread only, but several
+  NnetComputer objects may run at once in different threads with the same
+  const NnetComputation and Nnet (e.g. a computation obtained from a shared
+  CachingOptimizingCompiler), as long as "nnet_to_update" is NULL; see the
+  documentation for class Nnet.
  */
 class NnetComputer {
  public:
@@ -123,13 +166,39 @@ class NnetComputer {
   std::vector<std::string> submatrix_strings_;
   // command_strings_ is only used if debug_=true, or in case of error.
   std::vector<std::string> command_strings_;
+  // profile_keys_ is only used if options_.profile is true; it contains, for
+  // each command, the key for NnetComputeProfiler::Accumulate().
+  std::vector<std::string> profile_keys_;
   
-  // The matrices used in the computation.
+  // The matrices used in the computation.  If the computation has a memory
+  // plan (see NnetComputation::ComputeMemoryPlan()), the matrices that the plan
+  // places in workspace_ stay empty here.
   std::vector<CuMatrix<BaseFloat> > matrices_;
 
+  // The workspace for the matrices in the memory plan of the computation, if
+  // any; it's allocated once, in the constructor.
+  CuVector<BaseFloat> workspace_;
+
+  // Returns true if matrix 'matrix_index' is located in workspace_.
+  bool InWorkspace(int32 matrix_index) const {
+    return !computation_.matrix_workspace_offsets.empty() &&
+        computation_.matrix_workspace_offsets[matrix_index] >= 0;
+  }
+
+  // Returns the whole of the matrix 'matrix_index', which may be located
+  // either in matrices_ or in workspace_.
+  CuSubMatrix<BaseFloat> GetMatrix(int32 matrix_index);
+
   // executes the command in computation_.commands[command].
   void ExecuteCommand(int32 command);
 
+  // Does the same as ExecuteCommand(), but waits for the command to finish
+  // (if we're using a GPU) and gives the time taken to NnetComputeProfiler.
+  void ExecuteCommandProfiled(int32 command);
+
+  // Sets up profile_keys_.
+  void ComputeProfileKeys();
+
   // Returns the matrix index where the input or output matrix index for
   // "node_name" is stored (or its corresponding derivative, if is_deriv==true).
   // "is_output" tells the code that this is an output node, as opposed to an
@@ -0,0 +1,188 @@
+// nnet3/nnet-example-reader.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <cstring>
+#include "nnet3/nnet-example-reader.h"
+#include "nnet3/nnet-example-utils.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// returns the number of indexes/frames in the NnetIo named "output" in the eg,
+// or crashes if it is not there.
+static int32 NumOutputIndexes(const NnetExample &eg) {
+  for (size_t i = 0; i < eg.io.size(); i++)
+    if (eg.io[i].name == "output")
+      return eg.io[i].indexes.size();
+  KALDI_ERR << "No output named 'output' in the eg.";
+  return 0;  // Suppress compiler warning.
+}
+
+NnetExampleReader::NnetExampleReader(
+    const NnetExampleReaderOptions &config,
+    const std::string &examples_rspecifier):
+    config_(config), current_(NULL),
+    use_thread_(config.prefetch_queue_size > 0),
+    queue_elements_(0),
+    queue_slots_(std::max<int32>(config.prefetch_queue_size, 0)),
+    stop_(false), num_read_(0) {
+  if (!example_reader_.Open(examples_rspecifier))
+    KALDI_ERR << "Error opening examples from " << examples_rspecifier;
+  if (use_thread_) {
+    int32 ret;
+    if ((ret = pthread_create(&thread_, NULL, NnetExampleReader::RunThread,
+                              static_cast<void*>(this)))) {
+      const char *c = strerror(ret);
+      KALDI_ERR << "Error creating thread, errno was: " << (c ? c : "[NULL]");
+    }
+  }
+  current_ = NextFromQueue();
+}
+
+NnetExample &NnetExampleReader::Value() {
+  KALDI_ASSERT(current_ != NULL);
+  return *current_;
+}
+
+void NnetExampleReader::Next() {
+  KALDI_ASSERT(current_ != NULL);
+  delete current_;
+  current_ = NULL;  // in case NextFromQueue() throws.
+  current_ = NextFromQueue();
+}
+
+NnetExample *NnetExampleReader::NextFromQueue() {
+  if (!use_thread_)
+    return ReadExample();
+  queue_elements_.Wait();
+  mutex_.Lock();
+  KALDI_ASSERT(!queue_.empty());
+  NnetExample *ans = queue_.front();
+  queue_.pop_front();
+  std::string error_message = error_message_;
+  mutex_.Unlock();
+  queue_slots_.Signal();
+  if (ans == NULL && !error_message.empty())
+    KALDI_ERR << "Error reading examples in background thread: "
+              << error_message;
+  return ans;
+}
+
+NnetExample *NnetExampleReader::ReadExample() {
+  std::vector<NnetExample> egs;
+  bool minibatch_ready = false;
+  int32 num_output_frames = 0;
+  while (!minibatch_ready && !example_reader_.Done()) {
+    egs.resize(egs.size() + 1);
+    egs.back() = example_reader_.Value();
+    example_reader_.Next();
+    num_read_++;
+    if (config_.minibatch_size <= 0) {
+      minibatch_ready = true;
+    } else {
+      if (config_.measure_output_frames)
+        num_output_frames += NumOutputIndexes(egs.back());
+      minibatch_ready =
+          (config_.measure_output_frames ?
+           num_output_frames >= config_.minibatch_size :
+           static_cast<int32>(egs.size()) >= config_.minibatch_size);
+    }
+  }
+  if (egs.empty() || (!minibatch_ready && config_.discard_partial_minibatches))
+    return NULL;
+  NnetExample *ans = new NnetExample();
+  if (config_.minibatch_size <= 0)
+    ans->Swap(&(egs[0]));
+  else
+    MergeExamples(egs, false, ans);
+  if (config_.uncompress)
+    for (size_t i = 0; i < ans->io.size(); i++)
+      ans->io[i].features.Uncompress();
+  return ans;
+}
+
+void *NnetExampleReader::RunThread(void *arg) {
+  static_cast<NnetExampleReader*>(arg)->ReadAll();
+  return NULL;
+}
+
+void NnetExampleReader::ReadAll() {
+  while (true) {
+    NnetExample *eg = NULL;
+    std::string error_message;
+    try {
+      mutex_.Lock();
+      bool stop = stop_;
+      mutex_.Unlock();
+      if (!stop)
+        eg = ReadExample();
+    } catch (const std::exception &e) {
+      error_message = e.what();
+      if (error_message.empty())
+        error_message = "[unknown error]";
+    }
+    queue_slots_.Wait();
+    mutex_.Lock();
+    queue_.push_back(eg);
+    if (!error_message.empty())
+      error_message_ = error_message;
+    mutex_.Unlock();
+    queue_elements_.Signal();
+    if (eg == NULL)
+      return;
+  }
+}
+
+NnetExampleReader::~NnetExampleReader() {
+  if (use_thread_) {
+    if (current_ != NULL) {
+      // The background thread may still be running.  Make it stop, and
+      // discard whatever it has read ahead, up to the NULL that it puts at
+      // the end.  (If current_ == NULL we have already taken that NULL.)
+      delete current_;
+      current_ = NULL;
+      mutex_.Lock();
+      stop_ = true;
+      mutex_.Unlock();
+      while (true) {
+        queue_elements_.Wait();
+        mutex_.Lock();
+        NnetExample *eg = queue_.front();
+        queue_.pop_front();
+        mutex_.Unlock();
+        queue_slots_.Signal();
+        if (eg == NULL)
+          break;
+        delete eg;
+      }
+    }
+    int ret = pthread_join(thread_, NULL);
+    if (ret != 0) {
+      const char *c = strerror(ret);
+      KALDI_WARN << "Error joining thread, errno was: " << (c ? c : "[NULL]");
+    }
+  } else {
+    delete current_;
+  }
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
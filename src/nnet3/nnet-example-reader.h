@@ -0,0 +1,165 @@
+// nnet3/nnet-example-reader.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_NNET3_NNET_EXAMPLE_READER_H_
+#define KALDI_NNET3_NNET_EXAMPLE_READER_H_
+
+#include <pthread.h>
+#include <deque>
+#include "nnet3/nnet-example.h"
+#include "thread/kaldi-mutex.h"
+#include "thread/kaldi-semaphore.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+
+struct NnetExampleReaderOptions {
+  int32 prefetch_queue_size;
+  int32 minibatch_size;
+  bool measure_output_frames;
+  bool discard_partial_minibatches;
+  bool uncompress;
+
+  NnetExampleReaderOptions(): prefetch_queue_size(4),
+                              minibatch_size(0),
+                              measure_output_frames(true),
+                              discard_partial_minibatches(false),
+                              uncompress(true) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("prefetch-queue-size", &prefetch_queue_size, "Number of "
+                   "(merged) examples that a background thread reads ahead "
+                   "of the training.  If <= 0, examples are read in the "
+                   "training thread.");
+    opts->Register("minibatch-size", &minibatch_size, "If > 0, the reader "
+                   "merges the examples it reads into minibatches of this "
+                   "size (as nnet3-merge-egs would; see also "
+                   "--measure-output-frames).  If <= 0, the examples are "
+                   "assumed to be already merged.");
+    opts->Register("measure-output-frames", &measure_output_frames, "If "
+                   "true, --minibatch-size is a target number of total "
+                   "output frames; if false, it is the number of input "
+                   "examples to merge.");
+    opts->Register("discard-partial-minibatches",
+                   &discard_partial_minibatches, "If true, discard any "
+                   "partial minibatch encountered at the end (only relevant "
+                   "if --minibatch-size > 0).");
+    opts->Register("uncompress", &uncompress, "If true, uncompress any "
+                   "compressed features in the reader, so that this is done "
+                   "in the background thread rather than in the training.");
+  }
+};
+
+
+/**
+   NnetExampleReader reads nnet3 examples from an rspecifier, optionally
+   merging them into minibatches and uncompressing their features, and does all
+   this in a background thread that keeps up to
+   config.prefetch_queue_size finished examples ready in a queue.  The
+   point is that reading, merging, and especially uncompressing (the examples
+   on disk are normally stored as CompressedMatrix) are done while the
+   training thread is busy with the previous minibatch, instead of in series
+   with it.
+
+   The interface is like that of SequentialNnetExampleReader, except that
+   there is no Key() (the keys of merged examples are not meaningful), and
+   Value() may be swapped out of the reader (see Value()).  The order of the
+   examples is the same as if they had been read in the calling thread.
+
+   Errors in the background thread (e.g. reading a corrupted archive) are
+   reported in the calling thread, as an exception thrown from Next().
+ */
+class NnetExampleReader {
+ public:
+  /// Opens the rspecifier and (if config.prefetch_queue_size > 0) starts the
+  /// background thread.  Dies with KALDI_ERR if the rspecifier can't be
+  /// opened.
+  NnetExampleReader(const NnetExampleReaderOptions &config,
+                    const std::string &examples_rspecifier);
+
+  /// True when there are no more examples.
+  bool Done() const { return current_ == NULL; }
+
+  /// Returns the current example.  It is not const, so that the calling code
+  /// can Swap() it out instead of copying, if it wants to keep it.
+  NnetExample &Value();
+
+  /// Moves on to the next example.
+  void Next();
+
+  /// Returns the number of examples read from the rspecifier so far (before
+  /// merging).  This is only exact when Done() is true.
+  int64 NumRead() const { return num_read_; }
+
+  /// The destructor stops the background thread, discarding any examples
+  /// that it has read ahead.
+  ~NnetExampleReader();
+
+ private:
+  // Reads (and merges, and uncompresses) the next example, and returns it,
+  // or NULL if there are no more.  Called in the background thread if there
+  // is one.
+  NnetExample *ReadExample();
+
+  // Gets the next example from the queue (or reads it directly if there is
+  // no background thread).  Returns NULL at the end.
+  NnetExample *NextFromQueue();
+
+  // The function that the background thread runs; "arg" is "this".
+  static void *RunThread(void *arg);
+  // Called by RunThread().
+  void ReadAll();
+
+  NnetExampleReaderOptions config_;
+  SequentialNnetExampleReader example_reader_;
+
+  // The current example; NULL if Done().
+  NnetExample *current_;
+
+  bool use_thread_;
+  pthread_t thread_;
+
+  // Examples that the background thread has finished with, and not yet
+  // taken by Next(); a NULL at the back means there are no more.
+  std::deque<NnetExample*> queue_;
+  // Guards queue_, stop_ and error_message_.
+  Mutex mutex_;
+  // Counts the elements of queue_.
+  Semaphore queue_elements_;
+  // Counts the free slots in the queue; Initialized to
+  // config_.prefetch_queue_size.
+  Semaphore queue_slots_;
+  // Set by the destructor to make the background thread stop early.
+  bool stop_;
+  // Set by the background thread if it caught an exception.
+  std::string error_message_;
+
+  // Only accessed by whichever thread is reading.
+  int64 num_read_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(NnetExampleReader);
+};
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+#endif // KALDI_NNET3_NNET_EXAMPLE_READER_H_
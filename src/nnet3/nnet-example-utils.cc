@@ -80,6 +80,20 @@ static void GetIoSizes(const std::vector<NnetExample> &src,
 
 
 
+// Returns true if all the (nonempty) matrices in "mats" are compressed, and
+// there is at least one.
+static bool AllCompressed(const std::vector<GeneralMatrix const*> &mats) {
+  bool ans = false;
+  for (size_t i = 0; i < mats.size(); i++) {
+    if (mats[i]->NumRows() == 0)
+      continue;
+    if (mats[i]->Type() != kCompressedMatrix)
+      return false;
+    ans = true;
+  }
+  return ans;
+}
+
 // Do the final merging of NnetIo, once we have obtained the names, dims and
 // sizes for each feature/supervision type.
 static void MergeIo(const std::vector<NnetExample> &src,
@@ -133,6 +147,19 @@ static void MergeIo(const std::vector<NnetExample> &src,
   }
   KALDI_ASSERT(cur_size == sizes);
   for (int32 f = 0; f < num_feats; f++) {
+    if (compress && AllCompressed(output_lists[f])) {
+      // Keep the compressed data of each eg as it is, instead of
+      // decompressing and compressing again, which is slow and loses more
+      // precision.
+      std::vector<const CompressedMatrix*> cmats;
+      for (size_t i = 0; i < output_lists[f].size(); i++)
+        cmats.push_back(&(output_lists[f][i]->GetCompressedMatrix()));
+      CompressedMatrix merged_cmat;
+      merged_cmat.ConcatenateRows(cmats);
+      merged_eg->io[f].features.Clear();
+      merged_eg->io[f].features.SwapCompressedMatrix(&merged_cmat);
+      continue;
+    }
     AppendGeneralMatrixRows(output_lists[f],
                             &(merged_eg->io[f].features));
     if (compress) {
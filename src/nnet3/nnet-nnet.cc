@@ -138,6 +138,23 @@ Component *Nnet::GetComponent(int32 c) {
   return components_[c];
 }
 
+void Nnet::SetComponent(int32 c, Component *component) {
+  KALDI_ASSERT(static_cast<size_t>(c) < components_.size());
+  KALDI_ASSERT(component->InputDim() == components_[c]->InputDim() &&
+               component->OutputDim() == components_[c]->OutputDim());
+  delete components_[c];
+  components_[c] = component;
+}
+
+int32 Nnet::AddComponent(const std::string &name, Component *component) {
+  KALDI_ASSERT(component != NULL);
+  if (!IsValidName(name) || GetComponentIndex(name) != -1)
+    KALDI_ERR << "Invalid or duplicate component name '" << name << "'";
+  components_.push_back(component);
+  component_names_.push_back(name);
+  return static_cast<int32>(components_.size()) - 1;
+}
+
 /// Returns true if this is component-input node, i.e. a node of type kDescriptor
 /// that immediately precedes a node of type kComponent.
 bool Nnet::IsComponentInputNode(int32 node) const {
@@ -560,6 +577,125 @@ void Nnet::GetSomeNodeNames(
   }
 }
 
+void Nnet::RemoveSomeNodes(const std::vector<int32> &nodes_to_remove) {
+  int32 num_nodes = NumNodes();
+  std::vector<bool> remove(num_nodes, false);
+  for (size_t i = 0; i < nodes_to_remove.size(); i++) {
+    int32 n = nodes_to_remove[i];
+    KALDI_ASSERT(n >= 0 && n < num_nodes && !remove[n]);
+    remove[n] = true;
+  }
+  // Write out the Descriptors using the old node names.
+  std::vector<std::string> old_node_names;
+  GetSomeNodeNames(&old_node_names);
+  std::vector<int32> old_to_new(num_nodes, -1);
+  std::vector<NetworkNode> new_nodes;
+  std::vector<std::string> new_node_names, descriptor_configs;
+  for (int32 n = 0; n < num_nodes; n++) {
+    if (remove[n])
+      continue;
+    old_to_new[n] = new_nodes.size();
+    new_nodes.push_back(nodes_[n]);
+    new_node_names.push_back(node_names_[n]);
+    std::ostringstream os;
+    if (nodes_[n].node_type == kDescriptor)
+      nodes_[n].descriptor.WriteConfig(os, old_node_names);
+    descriptor_configs.push_back(os.str());
+  }
+  nodes_.swap(new_nodes);
+  node_names_.swap(new_node_names);
+
+  std::vector<std::string> node_names_temp;
+  GetSomeNodeNames(&node_names_temp);
+  for (int32 n = 0; n < NumNodes(); n++) {
+    NetworkNode &node = nodes_[n];
+    if (node.node_type == kDimRange) {
+      int32 new_node_index = old_to_new[node.u.node_index];
+      KALDI_ASSERT(new_node_index != -1 &&
+                   "Removing a node that a dim-range node refers to");
+      node.u.node_index = new_node_index;
+    } else if (node.node_type == kDescriptor) {
+      std::vector<std::string> tokens;
+      if (!DescriptorTokenize(descriptor_configs[n], &tokens))
+        KALDI_ERR << "Error tokenizing descriptor " << descriptor_configs[n];
+      tokens.push_back("end of input");
+      const std::string *next_token = &(tokens[0]);
+      if (!node.descriptor.Parse(node_names_temp, &next_token))
+        KALDI_ERR << "Error re-parsing descriptor " << descriptor_configs[n]
+                  << " of node " << node_names_[n]
+                  << " (was a node that it refers to removed?)";
+    }
+  }
+}
+
+void Nnet::RemoveOrphanNodes() {
+  while (true) {
+    int32 num_nodes = NumNodes();
+    // num_users[n] is the number of nodes that take input from node n.
+    std::vector<int32> num_users(num_nodes, 0);
+    for (int32 n = 0; n < num_nodes; n++) {
+      if (nodes_[n].node_type == kDescriptor) {
+        std::vector<int32> dependencies;
+        nodes_[n].descriptor.GetNodeDependencies(&dependencies);
+        SortAndUniq(&dependencies);
+        for (size_t i = 0; i < dependencies.size(); i++)
+          num_users[dependencies[i]]++;
+      } else if (nodes_[n].node_type == kDimRange) {
+        num_users[nodes_[n].u.node_index]++;
+      }
+    }
+    std::vector<int32> orphan_nodes;
+    for (int32 n = 0; n < num_nodes; n++) {
+      if (num_users[n] != 0)
+        continue;
+      if (nodes_[n].node_type == kComponent) {
+        orphan_nodes.push_back(n - 1);  // its component-input node.
+        orphan_nodes.push_back(n);
+      } else if (nodes_[n].node_type == kDimRange) {
+        orphan_nodes.push_back(n);
+      }
+    }
+    if (orphan_nodes.empty())
+      break;
+    KALDI_VLOG(2) << "Removing " << orphan_nodes.size() << " orphan nodes.";
+    RemoveSomeNodes(orphan_nodes);
+  }
+}
+
+void Nnet::RemoveOrphanComponents() {
+  int32 num_components = NumComponents();
+  std::vector<bool> used(num_components, false);
+  for (int32 n = 0; n < NumNodes(); n++)
+    if (nodes_[n].node_type == kComponent)
+      used[nodes_[n].u.component_index] = true;
+  std::vector<int32> old_to_new(num_components, -1);
+  std::vector<Component*> new_components;
+  std::vector<std::string> new_component_names;
+  for (int32 c = 0; c < num_components; c++) {
+    if (used[c]) {
+      old_to_new[c] = new_components.size();
+      new_components.push_back(components_[c]);
+      new_component_names.push_back(component_names_[c]);
+    } else {
+      KALDI_VLOG(2) << "Removing orphan component " << component_names_[c];
+      delete components_[c];
+    }
+  }
+  for (int32 n = 0; n < NumNodes(); n++)
+    if (nodes_[n].node_type == kComponent)
+      nodes_[n].u.component_index = old_to_new[nodes_[n].u.component_index];
+  components_.swap(new_components);
+  component_names_.swap(new_component_names);
+}
+
+void Nnet::ConvertComponentNodeToInput(int32 node) {
+  KALDI_ASSERT(IsComponentNode(node));
+  int32 dim = nodes_[node].Dim(*this);
+  nodes_[node] = NetworkNode(kInput);
+  nodes_[node].dim = dim;
+  RemoveSomeNodes(std::vector<int32>(1, node - 1));
+}
+
 void Nnet::Read(std::istream &is, bool binary) {
   Destroy();
   ExpectToken(is, binary, "<Nnet3>");
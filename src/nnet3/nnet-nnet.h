@@ -112,6 +112,18 @@ struct NetworkNode {
 
 
 
+/**
+   Thread safety: none of the const member functions of this class, or of the
+   Components, modify the object (Component::Propagate() is const; only
+   Backprop() with a non-NULL "to_update", and StoreStats(), modify
+   Components).  So one Nnet may be used at the same time from any number of
+   threads, each with its own NnetComputer, provided those computers are
+   constructed with nnet_to_update == NULL and nobody modifies the Nnet
+   meanwhile; there is no need for a
+   separate copy of the model per thread.  (In this version of the code,
+   though, only one thread may use the GPU.)  The test
+   UnitTestNnetComputeMultiThreaded() in nnet-compute-test.cc checks this.
+*/
 class Nnet {
  public:
   // This function can be used either to initialize a new Nnet from a config
@@ -130,6 +142,16 @@ class Nnet {
   /// caller.
   const Component *GetComponent(int32 c) const;
 
+  /// Replaces the component indexed c with a new component (of the same
+  /// input and output dimension).  Takes ownership of the pointer and deletes
+  /// the previous component.
+  void SetComponent(int32 c, Component *component);
+
+  /// Adds a new component with the given name, which must be a valid name and
+  /// must not be the name of an existing component, and returns its index.
+  /// Takes ownership of the pointer.  This does not add any node that uses the
+  /// component.
+  int32 AddComponent(const std::string &name, Component *component);
 
   /// returns const reference to a particular numbered network node.
   const NetworkNode &GetNode(int32 node) const {
@@ -137,6 +159,15 @@ class Nnet {
     return nodes_[node];
   }
 
+  /// returns non-const reference to a particular numbered network node.  This
+  /// is for code that modifies the network topology (e.g. CollapseModel());
+  /// it's the caller's responsibility to keep the network consistent, so call
+  /// Check() when you're done.
+  NetworkNode &GetNode(int32 node) {
+    KALDI_ASSERT(node >= 0 && node < nodes_.size());
+    return nodes_[node];
+  }
+
   /// Returns true if this is a component node, meaning that it is of type
   /// kComponent.
   bool IsComponentNode(int32 node) const;
@@ -211,6 +242,25 @@ class Nnet {
   /// by computing the lcm of all the moduli of the Descriptors in the network.
   int32 Modulus() const;
 
+  /// Removes the nodes whose output is not used by any other node: that is,
+  /// component nodes (together with their component-input nodes) and dim-range
+  /// nodes that are not referred to by any Descriptor or dim-range node.  This
+  /// is repeated until there are no such nodes left.  Input and output nodes
+  /// are never removed.  Note: this renumbers the nodes.
+  void RemoveOrphanNodes();
+
+  /// Removes the components that are not used by any node.  Note: this
+  /// renumbers the components.
+  void RemoveOrphanComponents();
+
+  /// Converts the component node "node" into an input node of the same name
+  /// and dimension, removing its component-input node.  This is useful when
+  /// the values of that node are to be supplied from outside (e.g. they have
+  /// been computed already), after which RemoveOrphanNodes() will remove the
+  /// part of the network that was only used to compute them.  Note: this
+  /// renumbers the nodes.
+  void ConvertComponentNodeToInput(int32 node);
+
   ~Nnet() { Destroy(); }
 
   // Default constructor
@@ -277,6 +327,13 @@ class Nnet {
   // they are not allowed.
   void GetSomeNodeNames(std::vector<std::string> *modified_node_names) const;
 
+  // This function removes the nodes listed in "nodes_to_remove" (which need not
+  // be sorted, but must not contain duplicates), renumbering the remaining
+  // nodes.  No remaining node may refer to a node that is removed.  It works by
+  // writing out each Descriptor with the old node names and parsing it again
+  // with the new ones.
+  void RemoveSomeNodes(const std::vector<int32> &nodes_to_remove);
+
 
   // the names of the components of the network.  Note, these may be distinct
   // from the network node names below (and live in a different namespace); the
@@ -83,6 +83,11 @@ static bool UnitTestNnetOptimizeWithOptions(NnetOptimizeOptions opt_config) {
 
     computation.ComputeCudaIndexes();
     computation_opt.ComputeCudaIndexes();
+    if (opt_config.plan_memory) {
+      computation_opt.ComputeMemoryPlan();
+      KALDI_LOG << "Workspace size of memory plan is "
+                << computation_opt.workspace_size;
+    }
     Nnet nnet_to_update(nnet);  // copy of the nnet that we update...  needed to
                                 // test the consolidation of backprop commands,
                                 // otherwise the optimized and non-optimized
@@ -211,6 +216,10 @@ static void UnitTestNnetOptimize() {
   optimize.move_sizing_commands = false;
   bool succ_no_move_sizing_commands = UnitTestNnetOptimizeWithOptions(optimize);
 
+  optimize = optimize_all;
+  optimize.fuse_propagate = false;
+  bool succ_no_fuse_propagate = UnitTestNnetOptimizeWithOptions(optimize);
+
 #define KALDI_SUCCFAIL(b) ((b) ? "SUCCESS" : "FAILURE")
   KALDI_ERR
     << "Test failed with all optimizations enabled. Retried test with the "
@@ -219,10 +228,58 @@ static void UnitTestNnetOptimize() {
     << "\n  backprop_in_place    ... " << KALDI_SUCCFAIL(succ_no_backprop_in_place)
     << "\n  remove_assignments   ... " << KALDI_SUCCFAIL(succ_no_remove_assignments)
     << "\n  initialize_undefined ... " << KALDI_SUCCFAIL(succ_no_initialize_undefined)
-    << "\n  move_sizing_commands ... " << KALDI_SUCCFAIL(succ_no_move_sizing_commands);
+    << "\n  move_sizing_commands ... " << KALDI_SUCCFAIL(succ_no_move_sizing_commands)
+    << "\n  fuse_propagate       ... " << KALDI_SUCCFAIL(succ_no_fuse_propagate);
 #undef KALDI_SUCCFAIL
 }
 
+// This test checks that computations read back from the cache written by
+// CachingOptimizingCompiler::WriteCache() are the same as the originals.
+static void UnitTestCachingOptimizingCompilerIo() {
+  for (int32 n = 0; n < 10; n++) {
+    struct NnetGenerationOptions gen_config;
+    std::vector<std::string> configs;
+    GenerateConfigSequence(gen_config, &configs);
+    Nnet nnet;
+    for (size_t j = 0; j < configs.size(); j++) {
+      std::istringstream is(configs[j]);
+      nnet.ReadConfig(is);
+    }
+
+    ComputationRequest request;
+    std::vector<Matrix<BaseFloat> > inputs;
+    ComputeExampleComputationRequestSimple(nnet, &request, &inputs);
+
+    NnetOptimizeOptions opt_config;
+    CachingOptimizingCompiler compiler(nnet, opt_config);
+    const NnetComputation *computation = compiler.Compile(request);
+    if (computation->HasPrecomputedIndexes())
+      continue;
+
+    bool binary = (RandInt(0, 1) == 0);
+    std::ostringstream os;
+    compiler.WriteCache(os, binary);
+
+    CachingOptimizingCompiler compiler2(nnet, opt_config);
+    std::istringstream is(os.str());
+    compiler2.ReadCache(is, binary);
+    const NnetComputation *computation2 = compiler2.Compile(request);
+
+    std::ostringstream os1, os2;
+    computation->Print(os1, nnet);
+    computation2->Print(os2, nnet);
+    KALDI_ASSERT(os1.str() == os2.str());
+
+    // With different optimization options the cache should not be used (this
+    // just prints a warning).
+    NnetOptimizeOptions opt_config3;
+    opt_config3.optimize = false;
+    CachingOptimizingCompiler compiler3(nnet, opt_config3);
+    std::istringstream is3(os.str());
+    compiler3.ReadCache(is3, binary);
+  }
+}
+
 } // namespace nnet3
 } // namespace kaldi
 
@@ -237,6 +294,7 @@ int main() {
   CuDevice::Instantiate().SelectGpuId("yes");
 #endif
   UnitTestNnetOptimize();
+  UnitTestCachingOptimizingCompilerIo();
 
   KALDI_LOG << "Nnet tests succeeded.";
 
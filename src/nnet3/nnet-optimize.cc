@@ -19,6 +19,7 @@
 
 #include "nnet3/nnet-optimize.h"
 #include "nnet3/nnet-optimize-utils.h"
+#include "nnet3/nnet-simple-component.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -143,6 +144,84 @@ void RemoveUnnecessaryZeroing(const Nnet &nnet,
   }
 }
 
+// Returns true if the matrix whose accesses are given is written to, or
+// deallocated, by any command c with begin < c < end.
+static bool MatrixChangedBetween(const MatrixAccesses &accesses,
+                                 int32 begin, int32 end) {
+  if (accesses.deallocate_command > begin && accesses.deallocate_command < end)
+    return true;
+  std::vector<Access>::const_iterator iter = accesses.accesses.begin(),
+      iter_end = accesses.accesses.end();
+  for (; iter != iter_end; ++iter)
+    if (iter->command_index > begin && iter->command_index < end &&
+        iter->access_type != kReadAccess)
+      return true;
+  return false;
+}
+
+void FusePropagateCommands(const Nnet &nnet,
+                           NnetComputation *computation) {
+  Analyzer a;
+  a.Init(nnet, *computation);
+  std::vector<NnetComputation::Command> &commands = computation->commands;
+  int32 num_commands = commands.size(), num_fused = 0;
+  for (int32 c1 = 0; c1 < num_commands; c1++) {
+    const NnetComputation::Command &command1 = commands[c1];
+    if (command1.command_type != kPropagate || command1.arg5 >= 0)
+      continue;
+    const AffineComponent *affine = dynamic_cast<const AffineComponent*>(
+        nnet.GetComponent(command1.arg1));
+    int32 s1 = command1.arg4;
+    if (affine == NULL || !computation->IsWholeMatrix(s1))
+      continue;
+    int32 m1 = computation->submatrices[s1].matrix_index;
+    const MatrixAccesses &accesses1 = a.matrix_accesses[m1];
+    if (accesses1.is_input || accesses1.is_output)
+      continue;
+    // Work out the commands, apart from allocation and deallocation, that
+    // access the intermediate matrix m1; they must be command c1 and the
+    // propagate command of the next component.
+    std::vector<int32> users;
+    for (size_t i = 0; i < accesses1.accesses.size(); i++) {
+      int32 c = accesses1.accesses[i].command_index;
+      if (c != accesses1.allocate_command && c != accesses1.deallocate_command)
+        users.push_back(c);
+    }
+    if (users.size() != 2 || users[0] != c1)
+      continue;
+    int32 c2 = users[1];
+    NnetComputation::Command &command2 = commands[c2];
+    if (command2.command_type != kPropagate || command2.arg5 >= 0 ||
+        !computation->IsWholeMatrix(command2.arg3) ||
+        computation->submatrices[command2.arg3].matrix_index != m1 ||
+        !affine->CanFuseWith(*nnet.GetComponent(command2.arg1)))
+      continue;
+    // The input of the affine component must be unchanged by the time the
+    // fused command is executed, at position c2.
+    int32 input_matrix = computation->submatrices[command1.arg3].matrix_index;
+    if (MatrixChangedBetween(a.matrix_accesses[input_matrix], c1, c2))
+      continue;
+    bool in_place = (computation->IsWholeMatrix(command2.arg4) &&
+                     computation->submatrices[command2.arg4].matrix_index == m1);
+    command2 = NnetComputation::Command(kPropagate, command1.arg1,
+                                        command1.arg2, command1.arg3,
+                                        command2.arg4, command2.arg1);
+    commands[c1].command_type = kNoOperation;
+    if (!in_place) {
+      // the intermediate matrix is no longer used.
+      if (accesses1.allocate_command != -1)
+        commands[accesses1.allocate_command].command_type = kNoOperation;
+      if (accesses1.deallocate_command != -1)
+        commands[accesses1.deallocate_command].command_type = kNoOperation;
+    }
+    num_fused++;
+  }
+  if (num_fused > 0) {
+    RemoveNoOps(computation);
+    RenumberComputation(computation);
+  }
+}
+
 /*
   This function is called from RemoveUnnecessaryAllocation.  The input is two
   sorted, unique lists, of (deallocation-commands, allocation-commands)
@@ -366,6 +445,12 @@ void Optimize(const NnetOptimizeOptions &config,
   if (GetVerboseLevel() >= 4)
     CheckComputation(nnet, request, *computation, false);
 
+  if (config.fuse_propagate)
+    FusePropagateCommands(nnet, computation);
+
+  if (GetVerboseLevel() >= 4)
+    CheckComputation(nnet, request, *computation, false);
+
   if (config.move_sizing_commands)
     MoveSizingCommands(nnet, computation);
 
@@ -412,7 +497,7 @@ size_t ComputationRequestHasher::IoSpecificationToInt(const IoSpecification& spe
 
 void CachingOptimizingCompiler::UpdateCache(const ComputationRequest *request,
                                             NnetComputation *computation) {
-  if (computation_cache_.size() == cache_capacity_) {
+  if (cache_capacity_ > 0 && computation_cache_.size() >= cache_capacity_) {
     // full, locate the least-recently-accessed request
     const CacheType::iterator it =
         computation_cache_.find(access_queue_.front());
@@ -445,59 +530,171 @@ CachingOptimizingCompiler::~CachingOptimizingCompiler() {
   }
 }
 
+NnetComputation *CachingOptimizingCompiler::CompileNoCache(
+    const ComputationRequest &request) const {
+  Compiler compiler(request, nnet_);
+  CompilerOptions opts;
+  NnetComputation *computation = new NnetComputation;
+  compiler.CreateComputation(opts, computation);
+
+  int32 verbose_cutoff = 4;
+  if (GetVerboseLevel() >= verbose_cutoff) {
+    std::ostringstream os1;
+    request.Print(os1);
+    KALDI_LOG << "Computation request is " << os1.str();
+    std::ostringstream os2;
+    computation->Print(os2, nnet_);
+    KALDI_LOG << "Generated computation is: " << os2.str();
+  }
+  { // some checking.
+    CheckComputationOptions check_config;
+    // we can do the rewrite check since it's before optimization.
+    check_config.check_rewrite = true;
+    ComputationChecker checker(check_config, nnet_, request,
+                               *computation);
+    checker.Check();
+  }
+  Optimize(opt_config_, nnet_, request, computation);
+  if (GetVerboseLevel() >= verbose_cutoff) {
+    std::ostringstream os;
+    computation->Print(os, nnet_);
+    KALDI_LOG << "Optimized computation is: " << os.str();
+  }
+  {  // check the computation again.
+    CheckComputationOptions check_config;
+    ComputationChecker checker(check_config, nnet_, request, *computation);
+    checker.Check();
+  }
+  computation->ComputeCudaIndexes();
+  if (opt_config_.plan_memory)
+    computation->ComputeMemoryPlan();
+  return computation;
+}
+
 const NnetComputation* CachingOptimizingCompiler::Compile(
     const ComputationRequest  &in_request) {
-  NnetComputation *computation;
-  ComputationRequest *request;
+  mutex_.Lock();
   // find computation in the cache
   CacheType::iterator cit = computation_cache_.find(&in_request);
-  if (cit == computation_cache_.end()) {
-    // if not found, compile and update cache
-    request = new ComputationRequest;
-    *request = in_request;
-    Compiler compiler(*request, nnet_);
-    CompilerOptions opts;
-    computation = new NnetComputation;
-    compiler.CreateComputation(opts, computation);
-
-    int32 verbose_cutoff = 4;
-    if (GetVerboseLevel() >= verbose_cutoff) {
-      std::ostringstream os1;
-      request->Print(os1);
-      KALDI_LOG << "Computation request is " << os1.str();
-      std::ostringstream os2;
-      computation->Print(os2, nnet_);
-      KALDI_LOG << "Generated computation is: " << os2.str();
-    }
-    { // some checking.
-      CheckComputationOptions check_config;
-      // we can do the rewrite check since it's before optimization.
-      check_config.check_rewrite = true;
-      ComputationChecker checker(check_config, nnet_, *request,
-                                 *computation);
-      checker.Check();
-    }
-    Optimize(opt_config_, nnet_, *request, computation);
-    if (GetVerboseLevel() >= verbose_cutoff) {
-      std::ostringstream os;
-      computation->Print(os, nnet_);
-      KALDI_LOG << "Optimized computation is: " << os.str();
-    }
-    {  // check the computation again.
-      CheckComputationOptions check_config;
-      ComputationChecker checker(check_config, nnet_, *request, *computation);
-      checker.Check();
-    }
-    computation->ComputeCudaIndexes();
-    UpdateCache(request, computation);
-  } else {
+  if (cit != computation_cache_.end()) {
     // if found, update access queue
+    NnetComputation *computation = cit->second.first;
+    UpdateAccessQueue(cit);
+    mutex_.Unlock();
+    return computation;
+  }
+  // We don't hold the lock while compiling, which may take a while; so
+  // other threads can use the cache in the meantime.
+  mutex_.Unlock();
+  ComputationRequest *request = new ComputationRequest(in_request);
+  NnetComputation *computation = CompileNoCache(*request);
+
+  mutex_.Lock();
+  cit = computation_cache_.find(request);
+  if (cit != computation_cache_.end()) {
+    // another thread compiled the same request while we were compiling; use
+    // its version.
+    delete request;
+    delete computation;
     computation = cit->second.first;
     UpdateAccessQueue(cit);
+  } else {
+    UpdateCache(request, computation);
   }
+  mutex_.Unlock();
   return computation;
 }
 
+int32 CachingOptimizingCompiler::NumComputations() const {
+  mutex_.Lock();
+  int32 ans = computation_cache_.size();
+  mutex_.Unlock();
+  return ans;
+}
+
+uint64 CachingOptimizingCompiler::ComputeHash() const {
+  std::ostringstream os;
+  nnet_.Write(os, true);
+  const NnetOptimizeOptions &c = opt_config_;
+  os << c.optimize << c.consolidate_model_update << c.propagate_in_place
+     << c.backprop_in_place << c.convert_addition << c.remove_assignments
+     << c.allow_left_merge << c.allow_right_merge << c.initialize_undefined
+     << c.move_sizing_commands << c.allocate_from_other << c.fuse_propagate
+     << ' '
+     << c.min_deriv_time << ' ' << c.max_deriv_time;
+  StringHasher hasher;
+  return static_cast<uint64>(hasher(os.str()));
+}
+
+void CachingOptimizingCompiler::WriteCache(std::ostream &os,
+                                           bool binary) const {
+  uint64 hash = ComputeHash();
+  mutex_.Lock();
+  std::vector<std::pair<const ComputationRequest*,
+                        const NnetComputation*> > to_write;
+  AqType::const_iterator iter = access_queue_.begin(),
+      end = access_queue_.end();
+  for (; iter != end; ++iter) {
+    CacheType::const_iterator cit = computation_cache_.find(*iter);
+    KALDI_ASSERT(cit != computation_cache_.end());
+    if (cit->second.first->HasPrecomputedIndexes()) {
+      KALDI_WARN << "Not writing computation with precomputed component "
+                 << "indexes to the cache.";
+      continue;
+    }
+    to_write.push_back(std::make_pair(cit->first, cit->second.first));
+  }
+  WriteToken(os, binary, "<CachingOptimizingCompiler>");
+  WriteToken(os, binary, "<Hash>");
+  WriteBasicType(os, binary, hash);
+  WriteToken(os, binary, "<NumComputations>");
+  WriteBasicType(os, binary, static_cast<int32>(to_write.size()));
+  for (size_t i = 0; i < to_write.size(); i++) {
+    to_write[i].first->Write(os, binary);
+    to_write[i].second->Write(os, binary);
+  }
+  WriteToken(os, binary, "</CachingOptimizingCompiler>");
+  mutex_.Unlock();
+}
+
+void CachingOptimizingCompiler::ReadCache(std::istream &is, bool binary) {
+  uint64 hash, expected_hash = ComputeHash();
+  ExpectToken(is, binary, "<CachingOptimizingCompiler>");
+  ExpectToken(is, binary, "<Hash>");
+  ReadBasicType(is, binary, &hash);
+  if (hash != expected_hash) {
+    KALDI_WARN << "Not using the cache of computations, since it was written "
+               << "for a different nnet or different optimization options.";
+    return;
+  }
+  int32 num_computations;
+  ExpectToken(is, binary, "<NumComputations>");
+  ReadBasicType(is, binary, &num_computations);
+  KALDI_ASSERT(num_computations >= 0);
+  int32 num_added = 0;
+  for (int32 i = 0; i < num_computations; i++) {
+    ComputationRequest *request = new ComputationRequest;
+    request->Read(is, binary);
+    NnetComputation *computation = new NnetComputation;
+    computation->Read(is, binary);
+    computation->ComputeCudaIndexes();
+    if (opt_config_.plan_memory)
+      computation->ComputeMemoryPlan();
+    mutex_.Lock();
+    if (computation_cache_.find(request) == computation_cache_.end()) {
+      UpdateCache(request, computation);
+      num_added++;
+    } else {
+      delete request;
+      delete computation;
+    }
+    mutex_.Unlock();
+  }
+  ExpectToken(is, binary, "</CachingOptimizingCompiler>");
+  KALDI_LOG << "Read " << num_computations << " computations from the cache, "
+            << "of which " << num_added << " were new.";
+}
+
 
 } // namespace nnet3
 } // namespace kaldi
@@ -22,6 +22,7 @@
 
 #include "nnet3/nnet-compile.h"
 #include "nnet3/nnet-analyze.h"
+#include "thread/kaldi-mutex.h"
 
 #include <list>
 
@@ -43,6 +44,8 @@ struct NnetOptimizeOptions {
   bool initialize_undefined;
   bool move_sizing_commands;
   bool allocate_from_other;
+  bool plan_memory;
+  bool fuse_propagate;
   int32 min_deriv_time;
   int32 max_deriv_time;
 
@@ -57,6 +60,8 @@ struct NnetOptimizeOptions {
                          initialize_undefined(true),
                          move_sizing_commands(true),
                          allocate_from_other(true),
+                         plan_memory(true),
+                         fuse_propagate(true),
                          min_deriv_time(std::numeric_limits<int32>::min()),
                          max_deriv_time(std::numeric_limits<int32>::max()) { }
 
@@ -90,6 +95,14 @@ struct NnetOptimizeOptions {
     opts->Register("allocate-from-other", &allocate_from_other, "Instead of "
                    "deleting a matrix of a given size and then allocating "
                    "a matrix of the same size, allow re-use of that memory");
+    opts->Register("plan-memory", &plan_memory, "If true, the compiler works "
+                   "out the lifetimes of the matrices and places them in a "
+                   "single workspace that is allocated once per computation, "
+                   "instead of allocating and freeing each matrix separately.");
+    opts->Register("fuse-propagate", &fuse_propagate, "Set to false to "
+                   "disable the optimization that fuses the propagation of "
+                   "an affine component with a following rectified-linear, "
+                   "normalize or log-softmax component.");
     opts->Register("min-deriv-time", &min_deriv_time, "You can set this to "
                    "the minimum t value that you want derivatives to be computed "
                    "at when updating the model.  This is an optimization that "
@@ -129,6 +142,24 @@ struct ComputationRequestPtrEqual {
 /// This class enables you to do the compilation and optimization in one call,
 /// and also ensures that if the ComputationRequest is identical to the previous
 /// one, the compilation process is not repeated.
+///
+/// It is safe to call Compile() from more than one thread at a time: the cache
+/// is protected by a mutex that is only held while looking up and updating the
+/// cache, not while compiling.  Note that the pointer returned by Compile() is
+/// only valid until the computation is evicted from the cache, which happens
+/// after "capacity" other distinct requests are compiled.  If capacity <= 0,
+/// the cache is unbounded and nothing is ever evicted, so the pointers remain
+/// valid for the lifetime of this object; this is what you should use if you
+/// share this object between threads, e.g. so that many NnetComputer objects
+/// working in different threads on the same (const) Nnet use the same compiled
+/// computations.  This is reasonable when the set of distinct requests is
+/// limited, as it is for chunk-by-chunk computation (see NnetSimpleComputer).
+///
+/// The cache can be written to disk with WriteCache() and read back with
+/// ReadCache(), e.g. so that decoding jobs don't each have to spend time
+/// compiling the same computations at startup.  The cache on disk is keyed by
+/// a hash of the neural net and of the optimization options, and is ignored if
+/// they don't match.
 class CachingOptimizingCompiler {
  public:
   CachingOptimizingCompiler(const Nnet &nnet,
@@ -147,7 +178,29 @@ class CachingOptimizingCompiler {
   /// It calls ComputeCudaIndexes() for you, because you wouldn't
   /// be able to do this on a const object.
   const NnetComputation* Compile(const ComputationRequest &request);
+
+  /// Writes the requests and computations in the cache (least recently used
+  /// first), preceded by a hash of the nnet and the optimization options.
+  /// Computations that use precomputed component indexes can't be written,
+  /// and are skipped.
+  void WriteCache(std::ostream &os, bool binary) const;
+
+  /// Reads a cache written by WriteCache() and adds its computations to the
+  /// cache (without replacing any that are already there).  If the cache was
+  /// written for a different nnet or with different optimization options, it
+  /// prints a warning and does nothing.
+  void ReadCache(std::istream &is, bool binary);
+
+  /// Returns the number of computations in the cache.
+  int32 NumComputations() const;
  private:
+  // Compiles and optimizes a computation, without looking at the cache.
+  NnetComputation *CompileNoCache(const ComputationRequest &request) const;
+
+  // Returns a hash of the nnet and the optimization options, used to check that
+  // a cache read from disk is applicable.
+  uint64 ComputeHash() const;
+
   const Nnet &nnet_;
   NnetOptimizeOptions opt_config_;
 
@@ -179,6 +232,9 @@ class CachingOptimizingCompiler {
   // This configuration value determines how many unique Computations
   // to cache in our most-recently-used cache.
   int32 cache_capacity_;
+
+  // Protects access_queue_ and computation_cache_.
+  mutable Mutex mutex_;
 };
 
 
@@ -248,6 +304,19 @@ void RemoveUnnecessaryZeroing(const Nnet &nnet, NnetComputation *computation);
 /// possible, and commands that empty matrices to as early as possible.
 void MoveSizingCommands(const Nnet &nnet, NnetComputation *computation);
 
+
+/// This optimization fuses pairs of kPropagate commands where an
+/// AffineComponent (or a child class) writes a matrix that is read only by the
+/// Propagate of a RectifiedLinearComponent, NormalizeComponent or
+/// LogSoftmaxComponent (see AffineComponent::CanFuseWith()).  The pair is
+/// replaced by a single kPropagate command for the affine component, with the
+/// second component as arg5 (see AffineComponent::PropagateFused()), located
+/// where the second command was, and the intermediate matrix is removed.  The
+/// intermediate matrix must not be needed in the backward pass (e.g. by the
+/// backprop of NormalizeComponent), so in training this mostly applies to
+/// RectifiedLinearComponent and LogSoftmaxComponent.
+void FusePropagateCommands(const Nnet &nnet, NnetComputation *computation);
+
 /// This optimization detects cases where we deallocate a matrix, and then
 /// later allocate another matrix of the same size; and replaces them
 /// with commands of type kAllocFromOther or kAllocFromOtherZeroed.
@@ -0,0 +1,193 @@
+// nnet3/nnet-rnnlm-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/nnet-rnnlm.h"
+#include "cudamatrix/cu-device.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+static void InitRandomRnnlm(NnetRnnlm *rnnlm) {
+  const char *cell_types[] = { "rnn", "lstm" };
+  int32 hidden_dim = RandInt(1, 20);
+  rnnlm->Init(cell_types[RandInt(0, 1)], RandInt(3, 50), RandInt(1, 20),
+              hidden_dim, (RandInt(0, 1) == 0 ? 0 : RandInt(1, 20)));
+  KALDI_LOG << "RNNLM info: " << rnnlm->Info();
+}
+
+// Computes the states of random word sequences one word at a time, either
+// all rows together or one row at a time.
+static void ComputeRandomStates(const NnetRnnlm &rnnlm,
+                                const std::vector<std::vector<int32> > &words,
+                                bool batched,
+                                CuMatrix<BaseFloat> *states) {
+  int32 num_rows = words.size();
+  states->Resize(num_rows, rnnlm.StateDim());
+  for (size_t t = 0; t < words[0].size(); t++) {
+    if (batched) {
+      std::vector<int32> prev_words(num_rows);
+      for (int32 i = 0; i < num_rows; i++)
+        prev_words[i] = words[i][t];
+      CuMatrix<BaseFloat> new_states;
+      rnnlm.ComputeStates(*states, prev_words, &new_states);
+      states->Swap(&new_states);
+    } else {
+      for (int32 i = 0; i < num_rows; i++) {
+        std::vector<int32> prev_words(1, words[i][t]);
+        CuMatrix<BaseFloat> new_state;
+        rnnlm.ComputeStates(states->RowRange(i, 1), prev_words, &new_state);
+        states->RowRange(i, 1).CopyFromMat(new_state);
+      }
+    }
+  }
+}
+
+void UnitTestNnetRnnlmIo() {
+  NnetRnnlm rnnlm;
+  InitRandomRnnlm(&rnnlm);
+  bool binary = (RandInt(0, 1) == 0);
+  std::ostringstream os;
+  rnnlm.Write(os, binary);
+  NnetRnnlm rnnlm2;
+  std::istringstream is(os.str());
+  rnnlm2.Read(is, binary);
+  std::ostringstream os2;
+  rnnlm2.Write(os2, binary);
+  if (binary)
+    KALDI_ASSERT(os.str() == os2.str());
+  KALDI_ASSERT(rnnlm2.StateDim() == rnnlm.StateDim() &&
+               rnnlm2.NumWords() == rnnlm.NumWords());
+
+  std::vector<std::vector<int32> > words(5, std::vector<int32>(3));
+  for (size_t i = 0; i < words.size(); i++)
+    for (size_t t = 0; t < words[i].size(); t++)
+      words[i][t] = RandInt(0, rnnlm.NumWords() - 1);
+  CuMatrix<BaseFloat> states, states2, scores, scores2;
+  ComputeRandomStates(rnnlm, words, true, &states);
+  ComputeRandomStates(rnnlm2, words, true, &states2);
+  rnnlm.ComputeScores(states, &scores);
+  rnnlm2.ComputeScores(states2, &scores2);
+  AssertEqual(scores, scores2, 0.001);
+}
+
+// Checks that evaluating many histories at once gives the same states as
+// evaluating them one by one.
+void UnitTestNnetRnnlmStates() {
+  NnetRnnlm rnnlm;
+  InitRandomRnnlm(&rnnlm);
+  int32 num_rows = RandInt(1, 20), length = RandInt(1, 4);
+  std::vector<std::vector<int32> > words(num_rows, std::vector<int32>(length));
+  for (int32 i = 0; i < num_rows; i++)
+    for (int32 t = 0; t < length; t++)
+      words[i][t] = RandInt(-1, rnnlm.NumWords() - 1);
+  CuMatrix<BaseFloat> batched_states, states;
+  ComputeRandomStates(rnnlm, words, true, &batched_states);
+  ComputeRandomStates(rnnlm, words, false, &states);
+  AssertEqual(batched_states, states, 0.001);
+  // The states are bounded, because of the nonlinearities.
+  KALDI_ASSERT(states.Max() < 1.0e+03 && states.Min() > -1.0e+03);
+}
+
+void UnitTestNnetRnnlmComputer() {
+  NnetRnnlm rnnlm;
+  InitRandomRnnlm(&rnnlm);
+  int32 num_words = rnnlm.NumWords(), num_rows = RandInt(1, 10);
+  std::vector<std::vector<int32> > words(num_rows, std::vector<int32>(2));
+  for (int32 i = 0; i < num_rows; i++)
+    for (int32 t = 0; t < 2; t++)
+      words[i][t] = RandInt(0, num_words - 1);
+  CuMatrix<BaseFloat> states;
+  ComputeRandomStates(rnnlm, words, true, &states);
+
+  NnetRnnlmComputeOptions opts;
+  opts.bos_symbol = 0;
+  opts.eos_symbol = num_words - 1;
+  opts.unk_symbol = RandInt(-1, num_words - 1);
+  opts.max_normalizer_elements = RandInt(1, 3) * num_words;
+  NnetRnnlmComputer computer(opts, rnnlm);
+  opts.normalize_probs = false;
+  NnetRnnlmComputer unnormalized_computer(opts, rnnlm);
+  KALDI_ASSERT(computer.HiddenDim() == rnnlm.StateDim() &&
+               computer.WordIndex(num_words - 1) == num_words - 1 &&
+               computer.WordIndex(num_words) == opts.unk_symbol);
+
+  // We query all the words for each row, in a random order.
+  std::vector<std::pair<int32, int32> > queries;
+  for (int32 i = 0; i < num_rows; i++)
+    for (int32 w = 0; w < num_words; w++)
+      queries.push_back(std::make_pair(i, w));
+  std::random_shuffle(queries.begin(), queries.end());
+  std::vector<int32> rows, labels;
+  for (size_t q = 0; q < queries.size(); q++) {
+    rows.push_back(queries[q].first);
+    labels.push_back(queries[q].second);
+  }
+  std::vector<const std::vector<int32>* > histories(num_rows, &(words[0]));
+  std::vector<BaseFloat> logprobs, scores;
+  computer.ComputeLogProbs(states, histories, rows, labels, &logprobs);
+  unnormalized_computer.ComputeLogProbs(states, histories, rows, labels,
+                                        &scores);
+
+  CuMatrix<BaseFloat> ref_scores;
+  rnnlm.ComputeScores(states, &ref_scores);
+  Matrix<BaseFloat> ref_scores_cpu(ref_scores);
+  Vector<BaseFloat> log_sums(num_rows, kUndefined);
+  for (int32 i = 0; i < num_rows; i++)
+    log_sums(i) = ref_scores_cpu.Row(i).LogSumExp();
+  Vector<BaseFloat> prob_sums(num_rows);
+  for (size_t q = 0; q < queries.size(); q++) {
+    int32 i = rows[q], w = labels[q];
+    AssertEqual(scores[q], ref_scores_cpu(i, w), 0.001);
+    AssertEqual(logprobs[q], ref_scores_cpu(i, w) - log_sums(i), 0.001);
+    prob_sums(i) += Exp(logprobs[q]);
+  }
+  for (int32 i = 0; i < num_rows; i++)
+    AssertEqual(prob_sums(i), 1.0, 0.001);
+
+  Vector<BaseFloat> context(computer.HiddenDim());
+  context.Set(1.0);
+  KALDI_ASSERT(computer.GetInitialContext(&context) == opts.bos_symbol &&
+               context.Sum() == 0.0);
+}
+
+}  // namespace nnet3
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::nnet3;
+
+  for (int32 loop = 0; loop < 2; loop++) {
+#if HAVE_CUDA == 1
+    if (loop == 0)
+      CuDevice::Instantiate().SelectGpuId("no");
+    else
+      CuDevice::Instantiate().SelectGpuId("yes");
+#endif
+    for (int32 i = 0; i < 10; i++) {
+      UnitTestNnetRnnlmIo();
+      UnitTestNnetRnnlmStates();
+      UnitTestNnetRnnlmComputer();
+    }
+  }
+
+  KALDI_LOG << "RNNLM tests succeeded.";
+
+  return 0;
+}
@@ -0,0 +1,361 @@
+// nnet3/nnet-rnnlm.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <sstream>
+
+#include "nnet3/nnet-rnnlm.h"
+#include "cudamatrix/cu-array.h"
+#include "cudamatrix/cu-vector.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// Reads a component and checks that it is an AffineComponent (or a child
+// class of it, such as NaturalGradientAffineComponent).
+static AffineComponent *ReadAffineComponent(std::istream &is, bool binary) {
+  Component *c = Component::ReadNew(is, binary);
+  AffineComponent *ans = dynamic_cast<AffineComponent*>(c);
+  if (ans == NULL) {
+    std::string type = c->Type();
+    delete c;
+    KALDI_ERR << "Expected an AffineComponent in RNNLM, got " << type;
+  }
+  return ans;
+}
+
+void NnetRnnlm::Destroy() {
+  delete input_affine_;
+  delete nonlinearity_;
+  delete projection_;
+  delete output_affine_;
+  input_affine_ = NULL;
+  nonlinearity_ = NULL;
+  projection_ = NULL;
+  output_affine_ = NULL;
+  word_embedding_.Resize(0, 0);
+}
+
+void NnetRnnlm::Init(const std::string &cell_type, int32 num_words,
+                     int32 embedding_dim, int32 hidden_dim,
+                     int32 projection_dim) {
+  Destroy();
+  if (cell_type == "rnn") cell_type_ = kRnn;
+  else if (cell_type == "lstm") cell_type_ = kLstm;
+  else KALDI_ERR << "Unknown RNNLM cell type " << cell_type;
+  KALDI_ASSERT(num_words > 0 && embedding_dim > 0 && hidden_dim > 0 &&
+               projection_dim >= 0);
+  int32 recurrent_dim = (projection_dim > 0 ? projection_dim : hidden_dim),
+      input_dim = embedding_dim + recurrent_dim;
+  BaseFloat learning_rate = 0.001;
+
+  word_embedding_.Resize(num_words, embedding_dim);
+  word_embedding_.SetRandn();
+  input_affine_ = new AffineComponent();
+  input_affine_->Init(learning_rate, input_dim,
+                      (cell_type_ == kLstm ? 4 * hidden_dim : hidden_dim),
+                      1.0 / std::sqrt(input_dim), 0.0);
+  if (cell_type_ == kRnn)
+    nonlinearity_ = new TanhComponent(hidden_dim);
+  if (projection_dim > 0) {
+    projection_ = new AffineComponent();
+    projection_->Init(learning_rate, hidden_dim, projection_dim,
+                      1.0 / std::sqrt(hidden_dim), 0.0);
+  }
+  output_affine_ = new AffineComponent();
+  output_affine_->Init(learning_rate, recurrent_dim, num_words,
+                       1.0 / std::sqrt(recurrent_dim), 0.0);
+  Check();
+}
+
+int32 NnetRnnlm::CellDim() const {
+  int32 dim = input_affine_->OutputDim();
+  return (cell_type_ == kLstm ? dim / 4 : dim);
+}
+
+void NnetRnnlm::Check() const {
+  KALDI_ASSERT(input_affine_ != NULL && output_affine_ != NULL &&
+               NumWords() > 0);
+  int32 cell_dim = CellDim(), recurrent_dim = RecurrentDim();
+  if (input_affine_->InputDim() != EmbeddingDim() + recurrent_dim)
+    KALDI_ERR << "Input dimension of RNNLM cell is "
+              << input_affine_->InputDim() << ", expected "
+              << EmbeddingDim() << " + " << recurrent_dim;
+  if (cell_type_ == kLstm) {
+    if (input_affine_->OutputDim() % 4 != 0 || nonlinearity_ != NULL)
+      KALDI_ERR << "Invalid LSTM cell in RNNLM.";
+  } else {
+    if (nonlinearity_ == NULL ||
+        !(nonlinearity_->Properties() & kSimpleComponent) ||
+        nonlinearity_->InputDim() != cell_dim ||
+        nonlinearity_->OutputDim() != cell_dim)
+      KALDI_ERR << "Invalid nonlinearity in RNNLM.";
+  }
+  if (projection_ != NULL) {
+    if (projection_->InputDim() != cell_dim ||
+        projection_->OutputDim() != recurrent_dim)
+      KALDI_ERR << "Invalid projection in RNNLM.";
+  } else if (recurrent_dim != cell_dim) {
+    KALDI_ERR << "Output-layer input dimension " << recurrent_dim
+              << " of RNNLM does not match cell dimension " << cell_dim;
+  }
+  if (output_affine_->OutputDim() != NumWords())
+    KALDI_ERR << "Output dimension of RNNLM is " << output_affine_->OutputDim()
+              << ", expected vocabulary size " << NumWords();
+}
+
+void NnetRnnlm::Read(std::istream &is, bool binary) {
+  Destroy();
+  ExpectToken(is, binary, "<NnetRnnlm>");
+  ExpectToken(is, binary, "<CellType>");
+  std::string cell_type;
+  ReadToken(is, binary, &cell_type);
+  if (cell_type == "rnn") cell_type_ = kRnn;
+  else if (cell_type == "lstm") cell_type_ = kLstm;
+  else KALDI_ERR << "Unknown RNNLM cell type " << cell_type;
+  ExpectToken(is, binary, "<WordEmbedding>");
+  word_embedding_.Read(is, binary);
+  ExpectToken(is, binary, "<InputAffine>");
+  input_affine_ = ReadAffineComponent(is, binary);
+  if (cell_type_ == kRnn) {
+    ExpectToken(is, binary, "<Nonlinearity>");
+    nonlinearity_ = Component::ReadNew(is, binary);
+  }
+  ExpectToken(is, binary, "<Projection>");
+  bool has_projection;
+  ReadBasicType(is, binary, &has_projection);
+  if (has_projection)
+    projection_ = ReadAffineComponent(is, binary);
+  ExpectToken(is, binary, "<OutputAffine>");
+  output_affine_ = ReadAffineComponent(is, binary);
+  ExpectToken(is, binary, "</NnetRnnlm>");
+  Check();
+}
+
+void NnetRnnlm::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<NnetRnnlm>");
+  WriteToken(os, binary, "<CellType>");
+  WriteToken(os, binary, (cell_type_ == kLstm ? "lstm" : "rnn"));
+  WriteToken(os, binary, "<WordEmbedding>");
+  word_embedding_.Write(os, binary);
+  WriteToken(os, binary, "<InputAffine>");
+  input_affine_->Write(os, binary);
+  if (cell_type_ == kRnn) {
+    WriteToken(os, binary, "<Nonlinearity>");
+    nonlinearity_->Write(os, binary);
+  }
+  WriteToken(os, binary, "<Projection>");
+  WriteBasicType(os, binary, projection_ != NULL);
+  if (projection_ != NULL)
+    projection_->Write(os, binary);
+  WriteToken(os, binary, "<OutputAffine>");
+  output_affine_->Write(os, binary);
+  WriteToken(os, binary, "</NnetRnnlm>");
+}
+
+std::string NnetRnnlm::Info() const {
+  std::ostringstream os;
+  os << "cell-type: " << (cell_type_ == kLstm ? "lstm" : "rnn") << "\n"
+     << "num-words: " << NumWords() << "\n"
+     << "embedding-dim: " << EmbeddingDim() << "\n"
+     << "cell-dim: " << CellDim() << "\n"
+     << "recurrent-dim: " << RecurrentDim() << "\n"
+     << "state-dim: " << StateDim() << "\n";
+  if (nonlinearity_ != NULL)
+    os << "nonlinearity: " << nonlinearity_->Type() << "\n";
+  return os.str();
+}
+
+void NnetRnnlm::ComputeStates(const CuMatrixBase<BaseFloat> &prev_states,
+                              const std::vector<int32> &prev_words,
+                              CuMatrix<BaseFloat> *states) const {
+  int32 num_rows = prev_states.NumRows(), embedding_dim = EmbeddingDim(),
+      cell_dim = CellDim(), recurrent_dim = RecurrentDim();
+  KALDI_ASSERT(prev_states.NumCols() == StateDim() &&
+               static_cast<size_t>(num_rows) == prev_words.size());
+  states->Resize(num_rows, StateDim());
+  if (num_rows == 0) return;
+  for (int32 i = 0; i < num_rows; i++)
+    KALDI_ASSERT(prev_words[i] >= -1 && prev_words[i] < NumWords());
+
+  // The input of the cell is [x_t, r_{t-1}]; CopyRows() gives zero
+  // embeddings for the words -1.
+  CuMatrix<BaseFloat> input(num_rows, embedding_dim + recurrent_dim,
+                            kUndefined);
+  CuArray<MatrixIndexT> indexes(prev_words);
+  input.ColRange(0, embedding_dim).CopyRows(word_embedding_, indexes);
+  input.ColRange(embedding_dim, recurrent_dim).CopyFromMat(
+      prev_states.ColRange(0, recurrent_dim));
+  CuMatrix<BaseFloat> pre(num_rows, input_affine_->OutputDim());
+  input_affine_->Propagate(NULL, input, &pre);
+
+  CuMatrix<BaseFloat> h(num_rows, cell_dim);
+  if (cell_type_ == kRnn) {
+    nonlinearity_->Propagate(NULL, pre, &h);
+  } else {
+    CuSubMatrix<BaseFloat> i_part(pre.ColRange(0, cell_dim)),
+        f_part(pre.ColRange(cell_dim, cell_dim)),
+        o_part(pre.ColRange(2 * cell_dim, cell_dim)),
+        g_part(pre.ColRange(3 * cell_dim, cell_dim));
+    i_part.Sigmoid(i_part);
+    f_part.Sigmoid(f_part);
+    o_part.Sigmoid(o_part);
+    g_part.Tanh(g_part);
+    CuSubMatrix<BaseFloat> c(states->ColRange(recurrent_dim, cell_dim));
+    c.CopyFromMat(prev_states.ColRange(recurrent_dim, cell_dim));
+    c.MulElements(f_part);
+    c.AddMatMatElements(1.0, i_part, g_part, 1.0);
+    h.Tanh(c);
+    h.MulElements(o_part);
+  }
+
+  CuSubMatrix<BaseFloat> r(states->ColRange(0, recurrent_dim));
+  if (projection_ != NULL)
+    projection_->Propagate(NULL, h, &r);
+  else
+    r.CopyFromMat(h);
+}
+
+void NnetRnnlm::ComputeScores(const CuMatrixBase<BaseFloat> &states,
+                              CuMatrix<BaseFloat> *scores) const {
+  KALDI_ASSERT(states.NumCols() == StateDim());
+  scores->Resize(states.NumRows(), NumWords(), kUndefined);
+  output_affine_->Propagate(NULL, states.ColRange(0, RecurrentDim()), scores);
+}
+
+
+NnetRnnlmComputer::NnetRnnlmComputer(const NnetRnnlmComputeOptions &opts,
+                                     const NnetRnnlm &rnnlm):
+    opts_(opts), rnnlm_(rnnlm) {
+  int32 num_words = rnnlm.NumWords();
+  if (opts.bos_symbol < 0 || opts.bos_symbol >= num_words ||
+      opts.eos_symbol < 0 || opts.eos_symbol >= num_words ||
+      opts.unk_symbol < -1 || opts.unk_symbol >= num_words)
+    KALDI_ERR << "Invalid --bos-symbol, --eos-symbol or --unk-symbol for "
+              << "RNNLM with " << num_words << " words.";
+  KALDI_ASSERT(opts.max_normalizer_elements > 0);
+  output_bias_.Resize(num_words, kUndefined);
+  rnnlm.OutputLayer().BiasParams().CopyToVec(&output_bias_);
+}
+
+int32 NnetRnnlmComputer::WordIndex(int32 label) const {
+  if (label >= 0 && label < rnnlm_.NumWords()) return label;
+  else return opts_.unk_symbol;
+}
+
+int32 NnetRnnlmComputer::OutputIndex(int32 label) const {
+  int32 index = WordIndex(label);
+  if (index == -1)
+    KALDI_ERR << "Word label " << label << " is outside the RNNLM vocabulary "
+              << "(of size " << rnnlm_.NumWords() << "); use --unk-symbol.";
+  return index;
+}
+
+int32 NnetRnnlmComputer::GetInitialContext(
+    VectorBase<BaseFloat> *context) const {
+  KALDI_ASSERT(context->Dim() == HiddenDim());
+  context->SetZero();
+  return opts_.bos_symbol;
+}
+
+void NnetRnnlmComputer::ComputeHidden(const CuMatrixBase<BaseFloat> &context,
+                                      const std::vector<int32> &prev_words,
+                                      CuMatrix<BaseFloat> *hidden) const {
+  rnnlm_.ComputeStates(context, prev_words, hidden);
+}
+
+void NnetRnnlmComputer::ComputeLogProbs(
+    const CuMatrixBase<BaseFloat> &hidden,
+    const std::vector<const std::vector<int32>* > &histories,
+    const std::vector<int32> &rows,
+    const std::vector<int32> &labels,
+    std::vector<BaseFloat> *logprobs) const {
+  KALDI_ASSERT(hidden.NumCols() == HiddenDim() &&
+               labels.size() == rows.size());
+  int32 num_queries = rows.size();
+  logprobs->resize(num_queries);
+  if (num_queries == 0) return;
+  std::vector<int32> indexes(num_queries);
+  for (int32 q = 0; q < num_queries; q++) {
+    KALDI_ASSERT(rows[q] >= 0 && rows[q] < hidden.NumRows());
+    indexes[q] = OutputIndex(labels[q]);
+  }
+  if (opts_.normalize_probs)
+    ComputeNormalizedLogProbs(hidden, rows, indexes, logprobs);
+  else
+    ComputeUnnormalizedLogProbs(hidden, rows, indexes, logprobs);
+}
+
+void NnetRnnlmComputer::ComputeUnnormalizedLogProbs(
+    const CuMatrixBase<BaseFloat> &hidden,
+    const std::vector<int32> &rows,
+    const std::vector<int32> &indexes,
+    std::vector<BaseFloat> *logprobs) const {
+  // Each score is the dot product of the recurrent output of the history with
+  // the output embedding of the word, plus the word's bias.
+  int32 num_queries = rows.size(), dim = rnnlm_.RecurrentDim();
+  CuArray<MatrixIndexT> cu_rows(rows), cu_indexes(indexes);
+  CuMatrix<BaseFloat> input(num_queries, dim, kUndefined),
+      weights(num_queries, dim, kUndefined);
+  input.CopyRows(hidden.ColRange(0, dim), cu_rows);
+  weights.CopyRows(rnnlm_.OutputLayer().LinearParams(), cu_indexes);
+  CuVector<BaseFloat> scores(num_queries);
+  scores.AddDiagMatMat(1.0, input, kNoTrans, weights, kTrans, 0.0);
+  Vector<BaseFloat> scores_cpu(scores);
+  for (int32 q = 0; q < num_queries; q++)
+    (*logprobs)[q] = scores_cpu(q) + output_bias_(indexes[q]);
+}
+
+void NnetRnnlmComputer::ComputeNormalizedLogProbs(
+    const CuMatrixBase<BaseFloat> &hidden,
+    const std::vector<int32> &rows,
+    const std::vector<int32> &indexes,
+    std::vector<BaseFloat> *logprobs) const {
+  // We compute the log-softmax for chunks of rows of "hidden", so that the
+  // matrix of scores has at most about opts_.max_normalizer_elements elements.
+  int32 num_rows = hidden.NumRows(), num_words = rnnlm_.NumWords(),
+      rows_per_chunk = std::max<int32>(
+          1, opts_.max_normalizer_elements / num_words),
+      num_chunks = (num_rows + rows_per_chunk - 1) / rows_per_chunk;
+  std::vector<std::vector<int32> > chunk_queries(num_chunks);
+  for (size_t q = 0; q < rows.size(); q++)
+    chunk_queries[rows[q] / rows_per_chunk].push_back(q);
+
+  CuMatrix<BaseFloat> scores;
+  for (int32 c = 0; c < num_chunks; c++) {
+    const std::vector<int32> &queries = chunk_queries[c];
+    if (queries.empty()) continue;
+    int32 row_begin = c * rows_per_chunk,
+        this_num_rows = std::min(rows_per_chunk, num_rows - row_begin);
+    rnnlm_.ComputeScores(hidden.RowRange(row_begin, this_num_rows), &scores);
+    scores.ApplyLogSoftMaxPerRow(scores);
+    std::vector<Int32Pair> elements(queries.size());
+    for (size_t i = 0; i < queries.size(); i++) {
+      elements[i].first = rows[queries[i]] - row_begin;
+      elements[i].second = indexes[queries[i]];
+    }
+    std::vector<BaseFloat> values(queries.size());
+    scores.Lookup(elements, &(values[0]));
+    for (size_t i = 0; i < queries.size(); i++)
+      (*logprobs)[queries[i]] = values[i];
+  }
+}
+
+}  // namespace nnet3
+}  // namespace kaldi
@@ -0,0 +1,235 @@
+// nnet3/nnet-rnnlm.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_RNNLM_H_
+#define KALDI_NNET3_NNET_RNNLM_H_
+
+#include <string>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "cudamatrix/cu-matrix.h"
+#include "itf/batched-rnnlm-itf.h"
+#include "nnet3/nnet-simple-component.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+/// NnetRnnlm is a word-level recurrent language model whose layers are nnet3
+/// components, so that it can be evaluated for many histories at once with
+/// CuMatrix operations (on the GPU if one was selected), as opposed to the
+/// scalar, one-word-at-a-time evaluation of Mikolov's RNNLM
+/// (../lm/mikolov-rnnlm-lib.h).  The words are the integer labels of the word
+/// symbol table, and the vocabulary is the labels 0 ... NumWords() - 1.
+///
+/// At each word position t, with x_t the embedding of the previous word and
+/// r_{t-1} the previous recurrent output, the cell computes
+///   "rnn":   h_t = nonlinearity(A [x_t, r_{t-1}])
+///   "lstm":  [i, f, o, g] = A [x_t, r_{t-1}],
+///            c_t = sigmoid(f) .* c_{t-1} + sigmoid(i) .* tanh(g),
+///            h_t = sigmoid(o) .* tanh(c_t)
+/// where A is an AffineComponent and the nonlinearity is any simple nnet3
+/// component (e.g. TanhComponent).  The recurrent output r_t is h_t, or a
+/// projection of it by a second AffineComponent, and the output layer is an
+/// AffineComponent from r_t to the vocabulary.  The hidden state of a history
+/// is the vector [r_t, c_t] (c_t only for "lstm").
+///
+/// The output layer is "sampling-friendly": each row of its linear parameters
+/// is the output embedding of one word, so the unnormalized score of a word
+/// costs one dot product, and models trained with sampling (which are close to
+/// self-normalized) can be evaluated without computing the normalizer over
+/// the whole vocabulary; see NnetRnnlmComputeOptions::normalize_probs.
+class NnetRnnlm {
+ public:
+  enum CellType { kRnn, kLstm };
+
+  NnetRnnlm(): cell_type_(kRnn), input_affine_(NULL), nonlinearity_(NULL),
+               projection_(NULL), output_affine_(NULL) { }
+
+  ~NnetRnnlm() { Destroy(); }
+
+  /// Initializes the model with random parameters.  "cell_type" is "rnn"
+  /// (with a TanhComponent as the nonlinearity) or "lstm"; "hidden_dim" is the
+  /// dimension of h_t, and "projection_dim" the dimension of r_t if there is
+  /// to be a projection (else 0).  Mostly useful for testing.
+  void Init(const std::string &cell_type, int32 num_words,
+            int32 embedding_dim, int32 hidden_dim, int32 projection_dim);
+
+  void Read(std::istream &is, bool binary);
+
+  void Write(std::ostream &os, bool binary) const;
+
+  CellType GetCellType() const { return cell_type_; }
+
+  int32 NumWords() const { return word_embedding_.NumRows(); }
+
+  int32 EmbeddingDim() const { return word_embedding_.NumCols(); }
+
+  /// The dimension of h_t (and of c_t, for "lstm").
+  int32 CellDim() const;
+
+  /// The dimension of r_t, which is the input of the output layer.
+  int32 RecurrentDim() const { return output_affine_->InputDim(); }
+
+  /// The dimension of the hidden state of a history, [r_t, c_t].
+  int32 StateDim() const {
+    return RecurrentDim() + (cell_type_ == kLstm ? CellDim() : 0);
+  }
+
+  /// Row w is the input embedding of word w.
+  const CuMatrix<BaseFloat> &WordEmbedding() const { return word_embedding_; }
+
+  /// The output layer; row w of its linear parameters (and element w of its
+  /// bias) is the output embedding of word w.
+  const AffineComponent &OutputLayer() const { return *output_affine_; }
+
+  /// For each i, computes in row i of "states" the state obtained from the
+  /// state in row i of "prev_states" and the word "prev_words[i]" (-1 for no
+  /// word, which gives it a zero embedding).  "states" is resized.
+  void ComputeStates(const CuMatrixBase<BaseFloat> &prev_states,
+                     const std::vector<int32> &prev_words,
+                     CuMatrix<BaseFloat> *states) const;
+
+  /// Sets "scores" to the unnormalized log-probabilities (the output layer's
+  /// activations) of all the words given the states in the rows of "states";
+  /// "scores" is resized to states.NumRows() by NumWords().
+  void ComputeScores(const CuMatrixBase<BaseFloat> &states,
+                     CuMatrix<BaseFloat> *scores) const;
+
+  /// Returns a string with information about the dimensions of the model.
+  std::string Info() const;
+
+ private:
+  // Checks that the dimensions of the components agree.
+  void Check() const;
+
+  void Destroy();
+
+  CellType cell_type_;
+  CuMatrix<BaseFloat> word_embedding_;
+  // Maps [x_t, r_{t-1}] to the input of the nonlinearity (kRnn) or the gates
+  // (kLstm).
+  AffineComponent *input_affine_;
+  // The nonlinearity; only for kRnn.
+  Component *nonlinearity_;
+  // The projection from h_t to r_t; NULL if r_t equals h_t.
+  AffineComponent *projection_;
+  AffineComponent *output_affine_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(NnetRnnlm);
+};
+
+
+struct NnetRnnlmComputeOptions {
+  int32 bos_symbol;
+  int32 eos_symbol;
+  int32 unk_symbol;
+  bool normalize_probs;
+  int32 max_normalizer_elements;
+
+  NnetRnnlmComputeOptions(): bos_symbol(1), eos_symbol(2), unk_symbol(-1),
+                             normalize_probs(true),
+                             max_normalizer_elements(1 << 24) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("bos-symbol", &bos_symbol, "Integer label of the "
+                   "beginning-of-sentence symbol, which is the input word at "
+                   "the start of each sentence.");
+    opts->Register("eos-symbol", &eos_symbol, "Integer label of the "
+                   "end-of-sentence symbol, whose probability gives the "
+                   "final-probs.");
+    opts->Register("unk-symbol", &unk_symbol, "Integer label of the "
+                   "unknown-word symbol, to which labels outside the RNNLM "
+                   "vocabulary are mapped.  If -1, such labels are an error.");
+    opts->Register("normalize-probs", &normalize_probs, "If true, normalize "
+                   "the word probabilities over the vocabulary.  Models "
+                   "trained with sampling are close to self-normalized, and "
+                   "with false only the scores of the requested words are "
+                   "computed, which is much faster for large vocabularies.");
+    opts->Register("max-normalizer-elements", &max_normalizer_elements,
+                   "Maximum size of the matrix of scores that is computed at "
+                   "one time when normalizing (histories times vocabulary "
+                   "size); limits the memory used.");
+  }
+};
+
+
+/// NnetRnnlmComputer evaluates an NnetRnnlm through the interface that
+/// RnnlmBatchDeterministicFst (../lm/kaldi-rnnlm-batch.h) uses, i.e. it gives
+/// the hidden states and word log-probs of many histories at once, so that
+/// the model can be used to rescore lattices.
+class NnetRnnlmComputer: public BatchedRnnlmInterface {
+ public:
+  /// Does not take ownership of "rnnlm", which must outlive this object.
+  NnetRnnlmComputer(const NnetRnnlmComputeOptions &opts,
+                    const NnetRnnlm &rnnlm);
+
+  virtual int32 HiddenDim() const { return rnnlm_.StateDim(); }
+
+  virtual int32 Eos() const { return opts_.eos_symbol; }
+
+  /// Returns the label itself if it is in the vocabulary, else the
+  /// unknown-word symbol (-1 if there is none).
+  virtual int32 WordIndex(int32 label) const;
+
+  /// The initial state is zero and the preceding word is the
+  /// beginning-of-sentence symbol.
+  virtual int32 GetInitialContext(VectorBase<BaseFloat> *context) const;
+
+  virtual void ComputeHidden(const CuMatrixBase<BaseFloat> &context,
+                             const std::vector<int32> &prev_words,
+                             CuMatrix<BaseFloat> *hidden) const;
+
+  /// The histories are not used.  With normalize_probs == false this costs
+  /// one dot product per query; otherwise the scores of the whole vocabulary
+  /// are computed for each distinct row.
+  virtual void ComputeLogProbs(
+      const CuMatrixBase<BaseFloat> &hidden,
+      const std::vector<const std::vector<int32>* > &histories,
+      const std::vector<int32> &rows,
+      const std::vector<int32> &labels,
+      std::vector<BaseFloat> *logprobs) const;
+
+ private:
+  // Returns WordIndex(label), and dies if it is -1.
+  int32 OutputIndex(int32 label) const;
+
+  void ComputeUnnormalizedLogProbs(const CuMatrixBase<BaseFloat> &hidden,
+                                   const std::vector<int32> &rows,
+                                   const std::vector<int32> &indexes,
+                                   std::vector<BaseFloat> *logprobs) const;
+
+  void ComputeNormalizedLogProbs(const CuMatrixBase<BaseFloat> &hidden,
+                                 const std::vector<int32> &rows,
+                                 const std::vector<int32> &indexes,
+                                 std::vector<BaseFloat> *logprobs) const;
+
+  NnetRnnlmComputeOptions opts_;
+  const NnetRnnlm &rnnlm_;
+  // A copy of the bias of the output layer.
+  Vector<BaseFloat> output_bias_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(NnetRnnlmComputer);
+};
+
+
+}  // namespace nnet3
+}  // namespace kaldi
+
+#endif  // KALDI_NNET3_NNET_RNNLM_H_
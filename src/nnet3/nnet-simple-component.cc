@@ -21,6 +21,9 @@
 #include <iterator>
 #include <sstream>
 #include <algorithm>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 #include "nnet3/nnet-simple-component.h"
 #include "nnet3/nnet-parse.h"
 
@@ -672,6 +675,66 @@ void AffineComponent::Propagate(const ComponentPrecomputedIndexes *indexes,
   out->AddMatMat(1.0, in, kNoTrans, linear_params_, kTrans, 1.0);
 }
 
+bool AffineComponent::CanFuseWith(const Component &next) const {
+  return (dynamic_cast<const RectifiedLinearComponent*>(&next) != NULL ||
+          dynamic_cast<const NormalizeComponent*>(&next) != NULL ||
+          dynamic_cast<const LogSoftmaxComponent*>(&next) != NULL) &&
+      next.InputDim() == OutputDim() && next.OutputDim() == OutputDim();
+}
+
+void AffineComponent::PropagateFused(const CuMatrixBase<BaseFloat> &in,
+                                     const Component &next,
+                                     CuMatrixBase<BaseFloat> *out) const {
+  KALDI_ASSERT(CanFuseWith(next));
+  out->AddMatMat(1.0, in, kNoTrans, linear_params_, kTrans, 0.0);
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    // There are no fused kernels; we just avoid the intermediate matrix.
+    out->AddVecToRows(1.0, bias_params_);
+    if (next.Properties() & kPropagateInPlace) {
+      next.Propagate(NULL, *out, out);
+    } else {
+      CuMatrix<BaseFloat> temp(*out);
+      next.Propagate(NULL, temp, out);
+    }
+    return;
+  }
+#endif
+  MatrixBase<BaseFloat> &out_mat = out->Mat();
+  const BaseFloat *bias = bias_params_.Data();
+  int32 num_rows = out_mat.NumRows(), dim = out_mat.NumCols();
+  if (dynamic_cast<const RectifiedLinearComponent*>(&next) != NULL) {
+    for (int32 r = 0; r < num_rows; r++) {
+      BaseFloat *row = out_mat.RowData(r);
+      for (int32 i = 0; i < dim; i++) {
+        BaseFloat x = row[i] + bias[i];
+        row[i] = (x > 0.0 ? x : 0.0);
+      }
+    }
+  } else if (dynamic_cast<const NormalizeComponent*>(&next) != NULL) {
+    for (int32 r = 0; r < num_rows; r++) {
+      BaseFloat *row = out_mat.RowData(r), sumsq = 0.0;
+      for (int32 i = 0; i < dim; i++) {
+        BaseFloat x = row[i] + bias[i];
+        row[i] = x;
+        sumsq += x * x;
+      }
+      BaseFloat scale = 1.0 / std::sqrt(
+          std::max(sumsq / dim, NormalizeComponent::kNormFloor));
+      for (int32 i = 0; i < dim; i++)
+        row[i] *= scale;
+    }
+  } else {  // LogSoftmaxComponent
+    for (int32 r = 0; r < num_rows; r++) {
+      SubVector<BaseFloat> row(out_mat, r);
+      BaseFloat *row_data = row.Data();
+      for (int32 i = 0; i < dim; i++)
+        row_data[i] += bias[i];
+      row.ApplyLogSoftMax();
+    }
+  }
+}
+
 void AffineComponent::UpdateSimple(const CuMatrixBase<BaseFloat> &in_value,
                                    const CuMatrixBase<BaseFloat> &out_deriv) {
   bias_params_.AddRowSumMat(learning_rate_, out_deriv, 1.0);
@@ -824,6 +887,36 @@ Component *AffineComponent::CollapseWithPrevious(
   return ans;
 }
 
+Component *AffineComponent::CollapseWithNext(
+    const FixedBiasComponent &next_component) const {
+  KALDI_ASSERT(this->OutputDim() == next_component.InputDim());
+  AffineComponent *ans =
+      dynamic_cast<AffineComponent*>(this->Copy());
+  KALDI_ASSERT(ans != NULL);
+  ans->bias_params_.AddVec(1.0, next_component.bias_);
+  return ans;
+}
+
+Component *AffineComponent::CollapseWithPrevious(
+    const FixedScaleComponent &prev_component) const {
+  KALDI_ASSERT(this->InputDim() == prev_component.OutputDim());
+  AffineComponent *ans =
+      dynamic_cast<AffineComponent*>(this->Copy());
+  KALDI_ASSERT(ans != NULL);
+  ans->linear_params_.MulColsVec(prev_component.scales_);
+  return ans;
+}
+
+Component *AffineComponent::CollapseWithPrevious(
+    const PerElementScaleComponent &prev_component) const {
+  KALDI_ASSERT(this->InputDim() == prev_component.OutputDim());
+  AffineComponent *ans =
+      dynamic_cast<AffineComponent*>(this->Copy());
+  KALDI_ASSERT(ans != NULL);
+  ans->linear_params_.MulColsVec(prev_component.scales_);
+  return ans;
+}
+
 
 void PerElementScaleComponent::Scale(BaseFloat scale) {
   scales_.Scale(scale);
@@ -1449,6 +1542,309 @@ void FixedAffineComponent::Read(std::istream &is, bool binary) {
   ExpectToken(is, binary, "</FixedAffineComponent>");
 }
 
+// Does the quantization for a single row of a matrix: sets "scale" to
+// max(abs(row)) / 127 (or 1 if the row is zero) and sets out[i] to the nearest
+// integer to row(i) / scale.
+static void QuantizeRow(const SubVector<BaseFloat> &row, int8 *out,
+                        BaseFloat *scale) {
+  int32 dim = row.Dim();
+  const BaseFloat *data = row.Data();
+  BaseFloat max_abs = 0.0;
+  for (int32 i = 0; i < dim; i++)
+    max_abs = std::max(max_abs, std::abs(data[i]));
+  *scale = (max_abs == 0.0 ? 1.0 : max_abs / 127.0);
+  BaseFloat inv_scale = 1.0 / *scale;
+  for (int32 i = 0; i < dim; i++)
+    out[i] = static_cast<int8>(std::floor(data[i] * inv_scale + 0.5));
+}
+
+// Returns the dot product of two int8 vectors, as an int32.  This can't
+// overflow unless dim is more than about 130,000.
+static inline int32 Int8DotProduct(const int8 *a, const int8 *b, int32 dim) {
+  int32 i = 0, ans = 0;
+#ifdef __AVX2__
+  // Sign-extend 16 elements at a time to 16 bits and use madd, which
+  // multiplies pairs of 16-bit integers and adds adjacent products to give
+  // 32-bit sums.
+  __m256i sum = _mm256_setzero_si256();
+  for (; i + 16 <= dim; i += 16) {
+    __m256i a16 = _mm256_cvtepi8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i))),
+        b16 = _mm256_cvtepi8_epi16(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+    sum = _mm256_add_epi32(sum, _mm256_madd_epi16(a16, b16));
+  }
+  __m128i sum4 = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                               _mm256_extracti128_si256(sum, 1));
+  sum4 = _mm_add_epi32(sum4, _mm_shuffle_epi32(sum4, _MM_SHUFFLE(1, 0, 3, 2)));
+  sum4 = _mm_add_epi32(sum4, _mm_shuffle_epi32(sum4, _MM_SHUFFLE(2, 3, 0, 1)));
+  ans = _mm_cvtsi128_si32(sum4);
+#endif
+  for (; i < dim; i++)
+    ans += static_cast<int32>(a[i]) * static_cast<int32>(b[i]);
+  return ans;
+}
+
+std::string QuantizedAffineComponent::Info() const {
+  std::stringstream stream;
+  Matrix<BaseFloat> linear_params(num_rows_, num_cols_);
+  GetLinearParams(&linear_params);
+  BaseFloat linear_params_size =
+      static_cast<BaseFloat>(num_rows_) * static_cast<BaseFloat>(num_cols_);
+  BaseFloat linear_params_stddev =
+      std::sqrt(TraceMatMat(linear_params, linear_params, kTrans) /
+                linear_params_size);
+  BaseFloat bias_params_stddev =
+      std::sqrt(VecVec(bias_params_, bias_params_) / bias_params_.Dim());
+  stream << Component::Info() << ", linear-params-stddev="
+         << linear_params_stddev << ", bias-params-stddev="
+         << bias_params_stddev;
+  return stream.str();
+}
+
+void QuantizedAffineComponent::Init(
+    const CuMatrixBase<BaseFloat> &linear_params,
+    const CuVectorBase<BaseFloat> &bias_params) {
+  KALDI_ASSERT(linear_params.NumRows() == bias_params.Dim() &&
+               linear_params.NumRows() != 0 && linear_params.NumCols() != 0);
+  num_rows_ = linear_params.NumRows();
+  num_cols_ = linear_params.NumCols();
+  Matrix<BaseFloat> linear(linear_params);
+  bias_params_.Resize(num_rows_);
+  bias_params.CopyToVec(&bias_params_);
+  row_scales_.Resize(num_rows_);
+  linear_params_.resize(static_cast<size_t>(num_rows_) * num_cols_);
+  for (int32 i = 0; i < num_rows_; i++)
+    QuantizeRow(linear.Row(i), &(linear_params_[i * num_cols_]),
+                &(row_scales_(i)));
+}
+
+void QuantizedAffineComponent::InitFromConfig(ConfigLine *cfl) {
+  std::string filename;
+  CuMatrix<BaseFloat> mat;
+  if (cfl->GetValue("matrix", &filename)) {
+    if (cfl->HasUnusedValues())
+      KALDI_ERR << "Invalid initializer for layer of type "
+                << Type() << ": \"" << cfl->WholeLine() << "\"";
+    bool binary;
+    Input ki(filename, &binary);
+    mat.Read(ki.Stream(), binary);
+  } else {
+    int32 input_dim, output_dim;
+    if (!cfl->GetValue("input-dim", &input_dim) ||
+        !cfl->GetValue("output-dim", &output_dim) || cfl->HasUnusedValues()) {
+      KALDI_ERR << "Invalid initializer for layer of type "
+                << Type() << ": \"" << cfl->WholeLine() << "\"";
+    }
+    mat.Resize(output_dim, input_dim + 1);
+    mat.SetRandn();
+  }
+  KALDI_ASSERT(mat.NumRows() != 0 && mat.NumCols() > 1);
+  CuVector<BaseFloat> bias(mat.NumRows());
+  bias.CopyColFromMat(mat, mat.NumCols() - 1);
+  Init(mat.ColRange(0, mat.NumCols() - 1), bias);
+}
+
+void QuantizedAffineComponent::GetLinearParams(
+    MatrixBase<BaseFloat> *linear_params) const {
+  KALDI_ASSERT(linear_params->NumRows() == num_rows_ &&
+               linear_params->NumCols() == num_cols_);
+  for (int32 i = 0; i < num_rows_; i++) {
+    const int8 *quantized_row = &(linear_params_[i * num_cols_]);
+    BaseFloat *row = linear_params->RowData(i), scale = row_scales_(i);
+    for (int32 j = 0; j < num_cols_; j++)
+      row[j] = quantized_row[j] * scale;
+  }
+}
+
+void QuantizedAffineComponent::PropagateCpu(const MatrixBase<BaseFloat> &in,
+                                            MatrixBase<BaseFloat> *out) const {
+  int32 num_frames = in.NumRows();
+  std::vector<int8> quantized_in(num_cols_);
+  const int8 *weights = &(linear_params_[0]);
+  const BaseFloat *row_scales = row_scales_.Data(),
+      *bias = bias_params_.Data();
+  for (int32 f = 0; f < num_frames; f++) {
+    BaseFloat in_scale;
+    QuantizeRow(in.Row(f), &(quantized_in[0]), &in_scale);
+    BaseFloat *out_row = out->RowData(f);
+    for (int32 i = 0; i < num_rows_; i++) {
+      int32 prod = Int8DotProduct(&(quantized_in[0]), weights + i * num_cols_,
+                                  num_cols_);
+      out_row[i] = prod * in_scale * row_scales[i] + bias[i];
+    }
+  }
+}
+
+void QuantizedAffineComponent::Propagate(
+    const ComponentPrecomputedIndexes *indexes,
+    const CuMatrixBase<BaseFloat> &in,
+    CuMatrixBase<BaseFloat> *out) const {
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    Matrix<BaseFloat> in_cpu(in), out_cpu(out->NumRows(), out->NumCols(),
+                                          kUndefined);
+    PropagateCpu(in_cpu, &out_cpu);
+    out->CopyFromMat(out_cpu);
+    return;
+  }
+#endif
+  PropagateCpu(in.Mat(), &(out->Mat()));
+}
+
+void QuantizedAffineComponent::Backprop(
+    const std::string &debug_info,
+    const ComponentPrecomputedIndexes *indexes,
+    const CuMatrixBase<BaseFloat> &, //in_value
+    const CuMatrixBase<BaseFloat> &, //out_value
+    const CuMatrixBase<BaseFloat> &, //out_deriv
+    Component *, //to_update
+    CuMatrixBase<BaseFloat> *) const {
+  KALDI_ERR << "Backprop is not supported for QuantizedAffineComponent "
+            << debug_info << " (it is for inference only).";
+}
+
+Component* QuantizedAffineComponent::Copy() const {
+  QuantizedAffineComponent *ans = new QuantizedAffineComponent();
+  ans->num_rows_ = num_rows_;
+  ans->num_cols_ = num_cols_;
+  ans->linear_params_ = linear_params_;
+  ans->row_scales_ = row_scales_;
+  ans->bias_params_ = bias_params_;
+  return ans;
+}
+
+void QuantizedAffineComponent::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<QuantizedAffineComponent>");
+  WriteToken(os, binary, "<NumRows>");
+  WriteBasicType(os, binary, num_rows_);
+  WriteToken(os, binary, "<NumCols>");
+  WriteBasicType(os, binary, num_cols_);
+  WriteToken(os, binary, "<LinearParams>");
+  WriteIntegerVector(os, binary, linear_params_);
+  WriteToken(os, binary, "<RowScales>");
+  row_scales_.Write(os, binary);
+  WriteToken(os, binary, "<BiasParams>");
+  bias_params_.Write(os, binary);
+  WriteToken(os, binary, "</QuantizedAffineComponent>");
+}
+
+void QuantizedAffineComponent::Read(std::istream &is, bool binary) {
+  ExpectOneOrTwoTokens(is, binary, "<QuantizedAffineComponent>", "<NumRows>");
+  ReadBasicType(is, binary, &num_rows_);
+  ExpectToken(is, binary, "<NumCols>");
+  ReadBasicType(is, binary, &num_cols_);
+  ExpectToken(is, binary, "<LinearParams>");
+  ReadIntegerVector(is, binary, &linear_params_);
+  ExpectToken(is, binary, "<RowScales>");
+  row_scales_.Read(is, binary);
+  ExpectToken(is, binary, "<BiasParams>");
+  bias_params_.Read(is, binary);
+  ExpectToken(is, binary, "</QuantizedAffineComponent>");
+  KALDI_ASSERT(linear_params_.size() ==
+               static_cast<size_t>(num_rows_) * num_cols_ &&
+               row_scales_.Dim() == num_rows_ &&
+               bias_params_.Dim() == num_rows_);
+}
+
+std::string HalfPrecisionAffineComponent::Info() const {
+  std::stringstream stream;
+  CuMatrix<BaseFloat> linear_params(OutputDim(), InputDim(), kUndefined);
+  linear_params_.CopyToMat(&linear_params);
+  BaseFloat linear_params_size =
+      static_cast<BaseFloat>(OutputDim()) * static_cast<BaseFloat>(InputDim());
+  BaseFloat linear_params_stddev =
+      std::sqrt(TraceMatMat(linear_params, linear_params, kTrans) /
+                linear_params_size);
+  BaseFloat bias_params_stddev =
+      std::sqrt(VecVec(bias_params_, bias_params_) / bias_params_.Dim());
+  stream << Component::Info() << ", linear-params-stddev="
+         << linear_params_stddev << ", bias-params-stddev="
+         << bias_params_stddev;
+  return stream.str();
+}
+
+void HalfPrecisionAffineComponent::Init(
+    const CuMatrixBase<BaseFloat> &linear_params,
+    const CuVectorBase<BaseFloat> &bias_params) {
+  KALDI_ASSERT(linear_params.NumRows() == bias_params.Dim() &&
+               linear_params.NumRows() != 0 && linear_params.NumCols() != 0);
+  linear_params_.CopyFromMat(linear_params);
+  bias_params_ = bias_params;
+}
+
+void HalfPrecisionAffineComponent::InitFromConfig(ConfigLine *cfl) {
+  std::string filename;
+  CuMatrix<BaseFloat> mat;
+  if (cfl->GetValue("matrix", &filename)) {
+    if (cfl->HasUnusedValues())
+      KALDI_ERR << "Invalid initializer for layer of type "
+                << Type() << ": \"" << cfl->WholeLine() << "\"";
+    bool binary;
+    Input ki(filename, &binary);
+    mat.Read(ki.Stream(), binary);
+  } else {
+    int32 input_dim, output_dim;
+    if (!cfl->GetValue("input-dim", &input_dim) ||
+        !cfl->GetValue("output-dim", &output_dim) || cfl->HasUnusedValues()) {
+      KALDI_ERR << "Invalid initializer for layer of type "
+                << Type() << ": \"" << cfl->WholeLine() << "\"";
+    }
+    mat.Resize(output_dim, input_dim + 1);
+    mat.SetRandn();
+  }
+  KALDI_ASSERT(mat.NumRows() != 0 && mat.NumCols() > 1);
+  CuVector<BaseFloat> bias(mat.NumRows());
+  bias.CopyColFromMat(mat, mat.NumCols() - 1);
+  Init(mat.ColRange(0, mat.NumCols() - 1), bias);
+}
+
+void HalfPrecisionAffineComponent::Propagate(
+    const ComponentPrecomputedIndexes *indexes,
+    const CuMatrixBase<BaseFloat> &in,
+    CuMatrixBase<BaseFloat> *out) const {
+  out->CopyRowsFromVec(bias_params_);
+  AddMatHalfMat(1.0, in, linear_params_, kTrans, 1.0, out);
+}
+
+void HalfPrecisionAffineComponent::Backprop(
+    const std::string &debug_info,
+    const ComponentPrecomputedIndexes *indexes,
+    const CuMatrixBase<BaseFloat> &, //in_value
+    const CuMatrixBase<BaseFloat> &, //out_value
+    const CuMatrixBase<BaseFloat> &, //out_deriv
+    Component *, //to_update
+    CuMatrixBase<BaseFloat> *) const {
+  KALDI_ERR << "Backprop is not supported for HalfPrecisionAffineComponent "
+            << debug_info << " (it is for inference only).";
+}
+
+Component* HalfPrecisionAffineComponent::Copy() const {
+  HalfPrecisionAffineComponent *ans = new HalfPrecisionAffineComponent();
+  ans->linear_params_.CopyFromHalfMat(linear_params_);
+  ans->bias_params_ = bias_params_;
+  return ans;
+}
+
+void HalfPrecisionAffineComponent::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<HalfPrecisionAffineComponent>");
+  WriteToken(os, binary, "<LinearParams>");
+  linear_params_.Write(os, binary);
+  WriteToken(os, binary, "<BiasParams>");
+  bias_params_.Write(os, binary);
+  WriteToken(os, binary, "</HalfPrecisionAffineComponent>");
+}
+
+void HalfPrecisionAffineComponent::Read(std::istream &is, bool binary) {
+  ExpectOneOrTwoTokens(is, binary, "<HalfPrecisionAffineComponent>",
+                       "<LinearParams>");
+  linear_params_.Read(is, binary);
+  ExpectToken(is, binary, "<BiasParams>");
+  bias_params_.Read(is, binary);
+  ExpectToken(is, binary, "</HalfPrecisionAffineComponent>");
+  KALDI_ASSERT(bias_params_.Dim() == linear_params_.NumRows());
+}
+
 void SumGroupComponent::Init(const std::vector<int32> &sizes) {
   KALDI_ASSERT(!sizes.empty());
   std::vector<Int32Pair> cpu_vec(sizes.size());
@@ -2230,6 +2626,170 @@ void ConvolutionComponent::InputToInputPatches(
 }
 
 
+// The functions ConvolveBlocks(), ConvolveBlocksBackprop() and
+// ConvolveBlocksUpdate() do the convolution without first copying the input
+// patches into a separate matrix, as InputToInputPatches() does.  This works
+// when each input patch, taken in the column order of the filter parameters,
+// consists of contiguous ranges of 'block_dim' columns of the input ("blocks"),
+// where block b of a patch is multiplied by columns
+// b * block_dim ... (b+1) * block_dim - 1 of the filters.
+// block_offsets[b][p] is the input column where block b of patch p starts; for
+// each b it must be nondecreasing in p.  As in the rest of the convolution
+// code, the output for patch p is columns
+// p * num_filters ... (p+1) * num_filters - 1 of the output.
+// There is one AddMatMatBatched() call per block (or a few, in the backprop),
+// with one matrix product per patch, reading the input in place.
+
+// Does out += in * filters^T, one patch at a time.
+static void ConvolveBlocks(
+    const std::vector<std::vector<int32> > &block_offsets,
+    int32 block_dim,
+    const CuMatrixBase<BaseFloat> &filters,
+    const CuMatrixBase<BaseFloat> &in,
+    CuMatrixBase<BaseFloat> *out) {
+  int32 num_blocks = block_offsets.size(),
+      num_filters = filters.NumRows();
+  KALDI_ASSERT(num_blocks * block_dim == filters.NumCols());
+  for (int32 b = 0; b < num_blocks; b++) {
+    CuSubMatrix<BaseFloat> filter_block(filters.ColRange(b * block_dim,
+                                                         block_dim));
+    int32 num_patches = block_offsets[b].size();
+    std::vector<CuSubMatrix<BaseFloat>* > out_batch(num_patches),
+        in_batch(num_patches), filter_batch(num_patches, &filter_block);
+    for (int32 p = 0; p < num_patches; p++) {
+      out_batch[p] = new CuSubMatrix<BaseFloat>(
+          out->ColRange(p * num_filters, num_filters));
+      in_batch[p] = new CuSubMatrix<BaseFloat>(
+          in.ColRange(block_offsets[b][p], block_dim));
+    }
+    AddMatMatBatched<BaseFloat>(1.0, out_batch, in_batch, kNoTrans,
+                                filter_batch, kTrans, 1.0);
+    for (int32 p = 0; p < num_patches; p++) {
+      delete out_batch[p];
+      delete in_batch[p];
+    }
+  }
+}
+
+// Does in_deriv += out_deriv * filters, one patch at a time.
+static void ConvolveBlocksBackprop(
+    const std::vector<std::vector<int32> > &block_offsets,
+    int32 block_dim,
+    const CuMatrixBase<BaseFloat> &filters,
+    const CuMatrixBase<BaseFloat> &out_deriv,
+    CuMatrixBase<BaseFloat> *in_deriv) {
+  int32 num_blocks = block_offsets.size(),
+      num_filters = filters.NumRows();
+  KALDI_ASSERT(num_blocks * block_dim == filters.NumCols());
+  for (int32 b = 0; b < num_blocks; b++) {
+    CuSubMatrix<BaseFloat> filter_block(filters.ColRange(b * block_dim,
+                                                         block_dim));
+    const std::vector<int32> &offsets = block_offsets[b];
+    int32 num_patches = offsets.size();
+    // The matrix products of one AddMatMatBatched() call may be done in
+    // parallel (on a GPU), so their outputs must not overlap.  Blocks of
+    // neighboring patches overlap if the step is less than the block size,
+    // so we divide the patches into groups in which they don't.
+    std::vector<std::vector<int32> > groups;
+    std::vector<int32> group_end;  // end of the last block in each group.
+    for (int32 p = 0; p < num_patches; p++) {
+      KALDI_ASSERT(p == 0 || offsets[p] >= offsets[p - 1]);
+      size_t g = 0;
+      while (g < groups.size() && group_end[g] > offsets[p])
+        g++;
+      if (g == groups.size()) {
+        groups.resize(g + 1);
+        group_end.resize(g + 1);
+      }
+      groups[g].push_back(p);
+      group_end[g] = offsets[p] + block_dim;
+    }
+    for (size_t g = 0; g < groups.size(); g++) {
+      int32 size = groups[g].size();
+      std::vector<CuSubMatrix<BaseFloat>* > in_deriv_batch(size),
+          out_deriv_batch(size), filter_batch(size, &filter_block);
+      for (int32 i = 0; i < size; i++) {
+        int32 p = groups[g][i];
+        in_deriv_batch[i] = new CuSubMatrix<BaseFloat>(
+            in_deriv->ColRange(offsets[p], block_dim));
+        out_deriv_batch[i] = new CuSubMatrix<BaseFloat>(
+            out_deriv.ColRange(p * num_filters, num_filters));
+      }
+      AddMatMatBatched<BaseFloat>(1.0, in_deriv_batch, out_deriv_batch,
+                                  kNoTrans, filter_batch, kNoTrans, 1.0);
+      for (int32 i = 0; i < size; i++) {
+        delete in_deriv_batch[i];
+        delete out_deriv_batch[i];
+      }
+    }
+  }
+}
+
+// Adds learning_rate times the gradient to the filters and to the bias.
+static void ConvolveBlocksUpdate(
+    const std::vector<std::vector<int32> > &block_offsets,
+    int32 block_dim,
+    BaseFloat learning_rate,
+    const CuMatrixBase<BaseFloat> &in_value,
+    const CuMatrixBase<BaseFloat> &out_deriv,
+    CuMatrixBase<BaseFloat> *filters,
+    CuVectorBase<BaseFloat> *bias) {
+  int32 num_blocks = block_offsets.size(),
+      num_filters = filters->NumRows(),
+      num_patches = block_offsets[0].size(),
+      filter_dim = filters->NumCols();
+  KALDI_ASSERT(num_blocks * block_dim == filter_dim);
+  // As in the other Update() functions, the gradient for each patch goes in
+  // a separate row block of this matrix, and they are summed at the end.
+  CuMatrix<BaseFloat> filters_grad_blocks(num_patches * num_filters,
+                                          filter_dim);
+  for (int32 b = 0; b < num_blocks; b++) {
+    std::vector<CuSubMatrix<BaseFloat>* > grad_batch(num_patches),
+        out_deriv_batch(num_patches), in_batch(num_patches);
+    for (int32 p = 0; p < num_patches; p++) {
+      grad_batch[p] = new CuSubMatrix<BaseFloat>(
+          filters_grad_blocks.Range(p * num_filters, num_filters,
+                                    b * block_dim, block_dim));
+      out_deriv_batch[p] = new CuSubMatrix<BaseFloat>(
+          out_deriv.ColRange(p * num_filters, num_filters));
+      in_batch[p] = new CuSubMatrix<BaseFloat>(
+          in_value.ColRange(block_offsets[b][p], block_dim));
+    }
+    AddMatMatBatched<BaseFloat>(1.0, grad_batch, out_deriv_batch, kTrans,
+                                in_batch, kNoTrans, 1.0);
+    for (int32 p = 0; p < num_patches; p++) {
+      delete grad_batch[p];
+      delete out_deriv_batch[p];
+      delete in_batch[p];
+    }
+  }
+  filters->AddMatBlocks(learning_rate, filters_grad_blocks);
+
+  CuMatrix<BaseFloat> out_deriv_col_blocks_sum(out_deriv.NumRows(),
+                                               num_filters);
+  out_deriv_col_blocks_sum.AddMatBlocks(1.0, out_deriv);
+  bias->AddRowSumMat(learning_rate, out_deriv_col_blocks_sum, 1.0);
+}
+
+void ConvolutionComponent::GetBlockOffsets(
+    std::vector<std::vector<int32> > *block_offsets) const {
+  KALDI_ASSERT(input_vectorization_ == kZyx);
+  // With zyx vectorization, the part of a patch with a particular x is
+  // contiguous in the input: filt_y_dim_ * input_z_dim_ columns.
+  const int32 num_x_steps = (1 + (input_x_dim_ - filt_x_dim_) / filt_x_step_),
+              num_y_steps = (1 + (input_y_dim_ - filt_y_dim_) / filt_y_step_);
+  block_offsets->resize(filt_x_dim_);
+  for (int32 x = 0; x < filt_x_dim_; x++) {
+    std::vector<int32> &offsets = (*block_offsets)[x];
+    offsets.resize(num_x_steps * num_y_steps);
+    for (int32 x_step = 0; x_step < num_x_steps; x_step++)
+      for (int32 y_step = 0; y_step < num_y_steps; y_step++)
+        offsets[x_step * num_y_steps + y_step] =
+            ZyxVectorIndex(x_step * filt_x_step_ + x, y_step * filt_y_step_, 0,
+                           input_x_dim_, input_y_dim_, input_z_dim_);
+  }
+}
+
 // propagation function
 // see function declaration in nnet-simple-component.h for details
 void ConvolutionComponent::Propagate(const ComponentPrecomputedIndexes *indexes,
@@ -2243,36 +2803,33 @@ void ConvolutionComponent::Propagate(const ComponentPrecomputedIndexes *indexes,
   KALDI_ASSERT((*out).NumRows() == num_frames &&
                (*out).NumCols() == (num_filters * num_x_steps * num_y_steps));
 
+  if (input_vectorization_ == kZyx) {
+    // we don't need the patches; see ConvolveBlocks().
+    for (int32 p = 0; p < num_x_steps * num_y_steps; p++)
+      out->ColRange(p * num_filters, num_filters).AddVecToRows(
+          1.0, bias_params_, 1.0);
+    std::vector<std::vector<int32> > block_offsets;
+    GetBlockOffsets(&block_offsets);
+    ConvolveBlocks(block_offsets, filt_y_dim_ * input_z_dim_, filter_params_,
+                   in, out);
+    return;
+  }
+
   CuMatrix<BaseFloat> patches(num_frames,
                               num_x_steps * num_y_steps * filter_dim,
                               kUndefined);
   InputToInputPatches(in, &patches);
-  CuSubMatrix<BaseFloat>* filter_params_elem = new CuSubMatrix<BaseFloat>(
-		  filter_params_, 0, filter_params_.NumRows(), 0,
-		  filter_params_.NumCols());
-  std::vector<CuSubMatrix<BaseFloat>* > tgt_batch, patch_batch,
-      filter_params_batch;
-
-  for (int32 x_step = 0; x_step < num_x_steps; x_step++)  {
-    for (int32 y_step = 0; y_step < num_y_steps; y_step++)  {
-      int32 patch_number = x_step * num_y_steps + y_step;
-      tgt_batch.push_back(new CuSubMatrix<BaseFloat>(
-              out->ColRange(patch_number * num_filters, num_filters)));
-      patch_batch.push_back(new CuSubMatrix<BaseFloat>(
-              patches.ColRange(patch_number * filter_dim, filter_dim)));
-      filter_params_batch.push_back(filter_params_elem);
-      tgt_batch[patch_number]->AddVecToRows(1.0, bias_params_, 1.0); // add bias
-    }
-  }
-  // apply all filters
-  AddMatMatBatched(1.0f, tgt_batch, patch_batch, kNoTrans, filter_params_batch,
-		  kTrans, 1.0f);
-  // release memory
-  delete filter_params_elem;
-  for (int32 p = 0; p < tgt_batch.size(); p++) {
-    delete tgt_batch[p];
-    delete patch_batch[p];
-  }
+  int32 num_patches = num_x_steps * num_y_steps;
+  for (int32 p = 0; p < num_patches; p++)
+    out->ColRange(p * num_filters, num_filters).AddVecToRows(
+        1.0, bias_params_, 1.0);  // add bias
+  // apply all filters: patch p of the output is columns
+  // p * num_filters ... (p+1) * num_filters - 1, and patch p of 'patches' is
+  // columns p * filter_dim ... (p+1) * filter_dim - 1.  The filters are the
+  // same for all patches.
+  out->ColRange(0, num_filters).AddMatMatBatched(
+      1.0, patches.ColRange(0, filter_dim), kNoTrans, filter_dim,
+      filter_params_, kTrans, 0, 1.0, num_filters, num_patches);
 }
 
 // scale the parameters
@@ -2395,6 +2952,21 @@ void ConvolutionComponent::Backprop(const std::string &debug_info,
                out_deriv.NumCols() ==
                (num_filters * num_x_steps * num_y_steps));
 
+  if (input_vectorization_ == kZyx) {
+    // we don't need the patches; see ConvolveBlocks().
+    std::vector<std::vector<int32> > block_offsets;
+    GetBlockOffsets(&block_offsets);
+    int32 block_dim = filt_y_dim_ * input_z_dim_;
+    if (in_deriv)
+      ConvolveBlocksBackprop(block_offsets, block_dim, filter_params_,
+                             out_deriv, in_deriv);
+    if (to_update != NULL)
+      ConvolveBlocksUpdate(block_offsets, block_dim, to_update->learning_rate_,
+                           in_value, out_deriv, &(to_update->filter_params_),
+                           &(to_update->bias_params_));
+    return;
+  }
+
   // Compute inderiv patches
   CuMatrix<BaseFloat> in_deriv_patches(num_frames,
                                        num_x_steps * num_y_steps * filter_dim,
@@ -2824,66 +3396,20 @@ void Convolutional1dComponent::InitFromConfig(ConfigLine *cfl) {
 void Convolutional1dComponent::Propagate(const ComponentPrecomputedIndexes *indexes,
                                          const CuMatrixBase<BaseFloat> &in,
                                          CuMatrixBase<BaseFloat> *out) const {
-  // dims
-  int32 num_splice = InputDim() / patch_stride_;
   int32 num_patches = 1 + (patch_stride_ - patch_dim_) / patch_step_;
   int32 num_filters = filter_params_.NumRows();
-  int32 num_frames = in.NumRows();
-  int32 filter_dim = filter_params_.NumCols();
+  KALDI_ASSERT(out->NumRows() == in.NumRows() &&
+               out->NumCols() == num_filters * num_patches);
 
-  /** Buffer of reshaped inputs:
-   *  1row = vectorized rectangular feature patches
-   *  1col = dim over speech frames,
-   */
-  CuMatrix<BaseFloat> patches(num_frames, filter_dim * num_patches, kUndefined);
-  // column_map is indexed by the column-index of "patches",
-  // and the value is the corresponding column-index of "in".
-  std::vector<int32> column_map(filter_dim * num_patches);
-
-  // build-up a column selection map
-  for (int32 p = 0, index = 0; p < num_patches; p++) {
-    for (int32 s = 0; s < num_splice; s++) {
-        for (int32 d = 0; d < patch_dim_; d++, index++) {
-        column_map[index] = p * patch_step_ + s * patch_stride_ + d;
-      }
-    }
-  }
-  CuArray<int32> cu_cols(column_map);
-  patches.CopyCols(in, cu_cols);
-
-  //
-  // compute filter activations
-  //
-
-  std::vector<CuSubMatrix<BaseFloat>* > tgt_batch, patch_batch, filter_params_batch;
+  for (int32 p = 0; p < num_patches; p++)
+    out->ColRange(p * num_filters, num_filters).AddVecToRows(
+        1.0, bias_params_, 1.0);  // add bias
 
-  CuSubMatrix<BaseFloat>* filter_params_elem = new CuSubMatrix<BaseFloat>(
-		  filter_params_, 0, filter_params_.NumRows(), 0,
-		  filter_params_.NumCols());
-
-  // form batch in vector container
-  for (int32 p = 0; p < num_patches; p++) {
-    // form batch in vector container. for filter_params_batch, all elements
-    // point to the same copy filter_params_elem
-    tgt_batch.push_back(new CuSubMatrix<BaseFloat>(out->ColRange(p * num_filters,
-				    num_filters)));
-    patch_batch.push_back(new CuSubMatrix<BaseFloat>(patches.ColRange(p * filter_dim,
-				    filter_dim)));
-    filter_params_batch.push_back(filter_params_elem);
-
-    tgt_batch[p]->AddVecToRows(1.0, bias_params_, 1.0); // add bias
-  }
-
-  // apply all filters
-  AddMatMatBatched(1.0f, tgt_batch, patch_batch, kNoTrans, filter_params_batch,
-		  kTrans, 1.0f);
-
-  // release memory
-  delete filter_params_elem;
-  for (int32 p = 0; p < num_patches; p++) {
-    delete tgt_batch[p];
-    delete patch_batch[p];
-  }
+  // apply all filters, reading the patches directly from the input; see
+  // ConvolveBlocks().
+  std::vector<std::vector<int32> > block_offsets;
+  GetBlockOffsets(&block_offsets);
+  ConvolveBlocks(block_offsets, patch_dim_, filter_params_, in, out);
 }
 
 // scale the parameters
@@ -2968,69 +3494,16 @@ void Convolutional1dComponent::Backprop(const std::string &debug_info,
                                         Component *to_update_in,
                                         CuMatrixBase<BaseFloat> *in_deriv) const {
   Convolutional1dComponent *to_update = dynamic_cast<Convolutional1dComponent*>(to_update_in);
-  int32 num_splice = InputDim() / patch_stride_;
   int32 num_patches = 1 + (patch_stride_ - patch_dim_) / patch_step_;
   int32 num_filters = filter_params_.NumRows();
-  int32 num_frames = out_deriv.NumRows();
-  int32 filter_dim = filter_params_.NumCols();
-
-  /** Buffer for backpropagation:
-   *  derivatives in the domain of 'patches_',
-   *  1row = vectorized rectangular feature patches,
-   *  1col = dim over speech frames,
-   */
-  CuMatrix<BaseFloat> patches_deriv(num_frames, filter_dim * num_patches, kSetZero);
-
-  //
-  // backpropagate to vector of matrices
-  // (corresponding to position of a filter)
-  //
-  std::vector<CuSubMatrix<BaseFloat>* > patch_deriv_batch, out_deriv_batch,
-	  filter_params_batch;
-
-  CuSubMatrix<BaseFloat>* filter_params_elem = new CuSubMatrix<BaseFloat>(
-		  filter_params_, 0, filter_params_.NumRows(), 0,
-		  filter_params_.NumCols());
-
-  // form batch in vector container
-  for (int32 p = 0; p < num_patches; p++) {
-    // form batch in vector container. for filter_params_batch, all elements
-    // point to the same copy filter_params_elem
-    patch_deriv_batch.push_back(new CuSubMatrix<BaseFloat>(patches_deriv.ColRange(
-				    p * filter_dim, filter_dim)));
-    out_deriv_batch.push_back(new CuSubMatrix<BaseFloat>(out_deriv.ColRange(
-				    p * num_filters, num_filters)));
-    filter_params_batch.push_back(filter_params_elem);
-  }
-  AddMatMatBatched(1.0f, patch_deriv_batch, out_deriv_batch, kNoTrans,
-		  filter_params_batch, kNoTrans, 0.0f);
-
-  // release memory
-  delete filter_params_elem;
-  for (int32 p = 0; p < num_patches; p++) {
-    delete patch_deriv_batch[p];
-    delete out_deriv_batch[p];
-  }
-
-  // sum the derivatives into in_deriv
-  std::vector<int32> column_map(filter_dim * num_patches);
-  for (int32 p = 0, index = 0; p < num_patches; p++) {
-    for (int32 s = 0; s < num_splice; s++) {
-      for (int32 d = 0; d < patch_dim_; d++, index++) {
-        column_map[index] = p * patch_step_ + s * patch_stride_ + d;
-      }
-    }
-  }
+  KALDI_ASSERT(out_deriv.NumCols() == num_filters * num_patches);
 
   if (in_deriv) {
-    std::vector<std::vector<int32> > reversed_column_map;
-    ReverseIndexes(column_map, InputDim(), &reversed_column_map);
-    std::vector<std::vector<int32> > rearranged_column_map;
-    RearrangeIndexes(reversed_column_map, &rearranged_column_map);
-    for (int32 p = 0; p < rearranged_column_map.size(); p++) {
-      CuArray<int32> cu_cols(rearranged_column_map[p]);
-      in_deriv->AddCols(patches_deriv, cu_cols);
-    }
+    // backpropagate directly into in_deriv; see ConvolveBlocksBackprop().
+    std::vector<std::vector<int32> > block_offsets;
+    GetBlockOffsets(&block_offsets);
+    ConvolveBlocksBackprop(block_offsets, patch_dim_, filter_params_,
+                           out_deriv, in_deriv);
   }
 
   if (to_update != NULL) {
@@ -3146,86 +3619,25 @@ int32 Convolutional1dComponent::NumParameters() const {
 void Convolutional1dComponent::Update(const std::string &debug_info,
 		                      const CuMatrixBase<BaseFloat> &in_value,
                                       const CuMatrixBase<BaseFloat> &out_deriv) {
-  // useful dims
-  int32 num_patches = 1 + (patch_stride_ - patch_dim_) / patch_step_;
-  int32 num_filters = filter_params_.NumRows();
-  int32 filter_dim = filter_params_.NumCols();
-  int32 num_frames = in_value.NumRows();
-  int32 num_splice = InputDim() / patch_stride_;
-  CuMatrix<BaseFloat> filters_grad;
-  CuVector<BaseFloat> bias_grad;
-
-  /** Buffer of reshaped inputs:
-   *  1row = vectorized rectangular feature patches
-   *  1col = dim over speech frames,
-   */
-  CuMatrix<BaseFloat> patches(num_frames, filter_dim * num_patches, kUndefined);
-  std::vector<int32> column_map(filter_dim * num_patches);
-  for (int32 p = 0, index = 0; p < num_patches; p++) {
-    for (int32 s = 0; s < num_splice; s++) {
-      for (int32 d = 0; d < patch_dim_; d++, index++) {
-        column_map[index] = p * patch_step_ + s * patch_stride_ + d;
-      }
-    }
-  }
-  CuArray<int32> cu_cols(column_map);
-  patches.CopyCols(in_value, cu_cols);
-
-  //
-  // calculate the gradient
-  //
-  filters_grad.Resize(num_filters, filter_dim, kSetZero); // reset
-  bias_grad.Resize(num_filters, kSetZero); // reset
-
-  //
-  // use all the patches
-  //
-
-  // create a single large matrix holding the smaller matrices
-  // from the vector container filters_grad_batch along the rows
-  CuMatrix<BaseFloat> filters_grad_blocks_batch(
-		  num_patches * filters_grad.NumRows(), filters_grad.NumCols());
-
-  std::vector<CuSubMatrix<BaseFloat>* > filters_grad_batch, diff_patch_batch,
-	  patch_batch;
-  for (int32 p = 0; p < num_patches; p++) {
-    // form batch in vector container
-    filters_grad_batch.push_back(new CuSubMatrix<BaseFloat>(
-			    filters_grad_blocks_batch.RowRange(
-				    p * filters_grad.NumRows(),
-				    filters_grad.NumRows())));
-    diff_patch_batch.push_back(new CuSubMatrix<BaseFloat>(out_deriv.ColRange(
-				    p * num_filters, num_filters)));
-    patch_batch.push_back(new CuSubMatrix<BaseFloat>(patches.ColRange(
-				    p * filter_dim, filter_dim)));
-  }
-
-  AddMatMatBatched(1.0f, filters_grad_batch, diff_patch_batch, kTrans, patch_batch,
-		  kNoTrans, 1.0f);
-
-  // add the row blocks together to filters_grad
-  filters_grad.AddMatBlocks(1.0, filters_grad_blocks_batch);
-
-  // create a matrix holding the col blocks sum of out_deriv
-  CuMatrix<BaseFloat> out_deriv_col_blocks_sum(out_deriv.NumRows(), num_filters);
-
-  // add the col blocks together to out_deriv_col_blocks_sum
-  out_deriv_col_blocks_sum.AddMatBlocks(1.0, out_deriv);
-
-  bias_grad.AddRowSumMat(1.0, out_deriv_col_blocks_sum, 1.0);
+  std::vector<std::vector<int32> > block_offsets;
+  GetBlockOffsets(&block_offsets);
+  ConvolveBlocksUpdate(block_offsets, patch_dim_, learning_rate_,
+                       in_value, out_deriv, &filter_params_, &bias_params_);
+}
 
-  // release memory
-  for (int32 p = 0; p < num_patches; p++) {
-    delete filters_grad_batch[p];
-    delete diff_patch_batch[p];
-    delete patch_batch[p];
+void Convolutional1dComponent::GetBlockOffsets(
+    std::vector<std::vector<int32> > *block_offsets) const {
+  // The part of patch p that belongs to the s'th spliced frame is contiguous
+  // in the input: patch_dim_ columns starting at p * patch_step_ +
+  // s * patch_stride_.
+  int32 num_splice = InputDim() / patch_stride_;
+  int32 num_patches = 1 + (patch_stride_ - patch_dim_) / patch_step_;
+  block_offsets->resize(num_splice);
+  for (int32 s = 0; s < num_splice; s++) {
+    (*block_offsets)[s].resize(num_patches);
+    for (int32 p = 0; p < num_patches; p++)
+      (*block_offsets)[s][p] = p * patch_step_ + s * patch_stride_;
   }
-
-  //
-  // update
-  //
-  filter_params_.AddMat(learning_rate_, filters_grad);
-  bias_params_.AddVec(learning_rate_, bias_grad);
 }
 
 void MaxpoolingComponent::Init(int32 input_dim, int32 output_dim,
@@ -27,6 +27,7 @@
 #include "nnet3/nnet-common.h"
 #include "nnet3/nnet-component-itf.h"
 #include "nnet3/natural-gradient-online.h"
+#include "cudamatrix/cu-half-matrix.h"
 #include <iostream>
 
 namespace kaldi {
@@ -141,6 +142,7 @@ class NormalizeComponent: public NonlinearComponent {
                         Component *to_update,
                         CuMatrixBase<BaseFloat> *in_deriv) const;
  private:
+  friend class AffineComponent;  // for kNormFloor, in PropagateFused().
   NormalizeComponent &operator = (const NormalizeComponent &other); // Disallow.
   static const BaseFloat kNormFloor;
   // about 0.7e-20.  We need a value that's exactly representable in
@@ -228,6 +230,7 @@ class RectifiedLinearComponent: public NonlinearComponent {
 
 class FixedAffineComponent;
 class FixedScaleComponent;
+class FixedBiasComponent;
 class PerElementScaleComponent;
 
 // Affine means a linear function plus an offset.
@@ -284,8 +287,8 @@ class AffineComponent: public UpdatableComponent {
   // This new function is used when mixing up:
   virtual void SetParams(const VectorBase<BaseFloat> &bias,
                          const MatrixBase<BaseFloat> &linear);
-  const CuVector<BaseFloat> &BiasParams() { return bias_params_; }
-  const CuMatrix<BaseFloat> &LinearParams() { return linear_params_; }
+  const CuVector<BaseFloat> &BiasParams() const { return bias_params_; }
+  const CuMatrix<BaseFloat> &LinearParams() const { return linear_params_; }
   explicit AffineComponent(const AffineComponent &other);
   // The next constructor is used in converting from nnet1.
   AffineComponent(const CuMatrixBase<BaseFloat> &linear_params,
@@ -309,7 +312,24 @@ class AffineComponent: public UpdatableComponent {
   Component *CollapseWithNext(const FixedAffineComponent &next) const;
   Component *CollapseWithNext(const FixedScaleComponent &next) const;
   Component *CollapseWithNext(const PerElementScaleComponent &next) const;
+  Component *CollapseWithNext(const FixedBiasComponent &next) const;
   Component *CollapseWithPrevious(const FixedAffineComponent &prev) const;
+  Component *CollapseWithPrevious(const FixedScaleComponent &prev) const;
+  Component *CollapseWithPrevious(const PerElementScaleComponent &prev) const;
+
+  /// Returns true if PropagateFused() can be used with this "next" component,
+  /// i.e. if it is a RectifiedLinearComponent, NormalizeComponent or
+  /// LogSoftmaxComponent whose dimension equals our output dimension.
+  bool CanFuseWith(const Component &next) const;
+
+  /// Does the same as Propagate() followed by next.Propagate() on the output,
+  /// but without an intermediate matrix; on the CPU, adding the bias and
+  /// applying the nonlinearity are done in a single pass over each row of the
+  /// output.  Requires CanFuseWith(next).  This is used for kPropagate commands
+  /// that were fused by FusePropagateCommands() (see nnet-optimize.h).
+  void PropagateFused(const CuMatrixBase<BaseFloat> &in,
+                      const Component &next,
+                      CuMatrixBase<BaseFloat> *out) const;
 
  protected:
   friend class NaturalGradientAffineComponent;
@@ -515,6 +535,141 @@ class FixedAffineComponent: public Component {
   KALDI_DISALLOW_COPY_AND_ASSIGN(FixedAffineComponent);
 };
 
+
+/// QuantizedAffineComponent is an inference-only version of AffineComponent
+/// (or NaturalGradientAffineComponent) in which the linear parameters are
+/// stored as 8-bit integers with one scale per row (i.e. per output
+/// dimension), which makes the model about 4 times smaller in memory.  In
+/// Propagate(), each row of the input is quantized to 8 bits with its own
+/// scale, the product is computed with integer arithmetic (using AVX2
+/// instructions if the code was compiled with them), and the result is scaled
+/// back and the bias added.  The integer product is done on the CPU; if we are
+/// using a GPU, the data is copied to and from the CPU, so this component is
+/// really only for CPU decoding.  You create one from a trained model with
+/// "nnet3-copy --quantize=true"; it does not support backprop.
+class QuantizedAffineComponent: public Component {
+ public:
+  QuantizedAffineComponent(): num_rows_(0), num_cols_(0) { }
+  virtual std::string Type() const { return "QuantizedAffineComponent"; }
+  virtual std::string Info() const;
+
+  /// Initializes by quantizing the parameters of an AffineComponent (this also
+  /// works for NaturalGradientAffineComponent, which is a child class).
+  explicit QuantizedAffineComponent(const AffineComponent &affine) {
+    Init(affine.LinearParams(), affine.BiasParams());
+  }
+  void Init(const CuMatrixBase<BaseFloat> &linear_params,
+            const CuVectorBase<BaseFloat> &bias_params);
+
+  // The config line takes the same options as for FixedAffineComponent:
+  // "matrix=<rxfilename>" (the last column is the bias), or for testing
+  // purposes, "input-dim=x output-dim=y".
+  virtual void InitFromConfig(ConfigLine *cfl);
+
+  virtual int32 Properties() const { return kSimpleComponent; }
+  virtual int32 InputDim() const { return num_cols_; }
+  virtual int32 OutputDim() const { return num_rows_; }
+
+  virtual void Propagate(const ComponentPrecomputedIndexes *indexes,
+                         const CuMatrixBase<BaseFloat> &in,
+                         CuMatrixBase<BaseFloat> *out) const;
+  // Backprop() dies with an error, since this component is for inference only.
+  virtual void Backprop(const std::string &debug_info,
+                        const ComponentPrecomputedIndexes *indexes,
+                        const CuMatrixBase<BaseFloat> &in_value,
+                        const CuMatrixBase<BaseFloat> &, // out_value
+                        const CuMatrixBase<BaseFloat> &out_deriv,
+                        Component *to_update,
+                        CuMatrixBase<BaseFloat> *in_deriv) const;
+
+  virtual Component* Copy() const;
+  virtual void Read(std::istream &is, bool binary);
+  virtual void Write(std::ostream &os, bool binary) const;
+
+  /// Outputs the linear parameters as they are represented after
+  /// quantization, i.e. the integer weights times the row scales; this is
+  /// useful for measuring the quantization error.
+  void GetLinearParams(MatrixBase<BaseFloat> *linear_params) const;
+
+  const Vector<BaseFloat> &BiasParams() const { return bias_params_; }
+
+ private:
+  // Does the work of Propagate() on the CPU.
+  void PropagateCpu(const MatrixBase<BaseFloat> &in,
+                    MatrixBase<BaseFloat> *out) const;
+
+  int32 num_rows_;  // output dimension
+  int32 num_cols_;  // input dimension
+  // The quantized linear parameters, of dimension num_rows_ * num_cols_,
+  // stored row by row; element (i, j) of the parameter matrix is approximately
+  // linear_params_[i * num_cols_ + j] * row_scales_(i).
+  std::vector<int8> linear_params_;
+  Vector<BaseFloat> row_scales_;  // dimension num_rows_.
+  Vector<BaseFloat> bias_params_;  // dimension num_rows_.
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(QuantizedAffineComponent);
+};
+
+/// HalfPrecisionAffineComponent is an inference-only version of
+/// AffineComponent (or NaturalGradientAffineComponent) in which the linear
+/// parameters are stored in 16-bit floating point (see CuHalfMatrix).  In
+/// Propagate(), the input is converted to half precision and multiplied by the
+/// parameters with single-precision accumulation, which on GPUs with tensor
+/// cores is a lot faster than a single-precision matrix multiply, and the bias
+/// is added in single precision; the output, and everything downstream of it
+/// such as the final log-softmax, stays in single precision.  It's only faster
+/// on a GPU.  Decoding programs create it from AffineComponents when you give
+/// them the option --use-fp16=true (see ConvertAffineComponentsToHalf()); it
+/// does not support backprop.
+class HalfPrecisionAffineComponent: public Component {
+ public:
+  HalfPrecisionAffineComponent() { }
+  virtual std::string Type() const { return "HalfPrecisionAffineComponent"; }
+  virtual std::string Info() const;
+
+  /// Initializes by rounding the parameters of an AffineComponent (this also
+  /// works for NaturalGradientAffineComponent, which is a child class).
+  explicit HalfPrecisionAffineComponent(const AffineComponent &affine) {
+    Init(affine.LinearParams(), affine.BiasParams());
+  }
+  void Init(const CuMatrixBase<BaseFloat> &linear_params,
+            const CuVectorBase<BaseFloat> &bias_params);
+
+  // The config line takes the same options as for FixedAffineComponent:
+  // "matrix=<rxfilename>" (the last column is the bias), or for testing
+  // purposes, "input-dim=x output-dim=y".
+  virtual void InitFromConfig(ConfigLine *cfl);
+
+  virtual int32 Properties() const { return kSimpleComponent; }
+  virtual int32 InputDim() const { return linear_params_.NumCols(); }
+  virtual int32 OutputDim() const { return linear_params_.NumRows(); }
+
+  virtual void Propagate(const ComponentPrecomputedIndexes *indexes,
+                         const CuMatrixBase<BaseFloat> &in,
+                         CuMatrixBase<BaseFloat> *out) const;
+  // Backprop() dies with an error, since this component is for inference only.
+  virtual void Backprop(const std::string &debug_info,
+                        const ComponentPrecomputedIndexes *indexes,
+                        const CuMatrixBase<BaseFloat> &in_value,
+                        const CuMatrixBase<BaseFloat> &, // out_value
+                        const CuMatrixBase<BaseFloat> &out_deriv,
+                        Component *to_update,
+                        CuMatrixBase<BaseFloat> *in_deriv) const;
+
+  virtual Component* Copy() const;
+  virtual void Read(std::istream &is, bool binary);
+  virtual void Write(std::ostream &os, bool binary) const;
+
+  const CuHalfMatrix &LinearParams() const { return linear_params_; }
+  const CuVector<BaseFloat> &BiasParams() const { return bias_params_; }
+
+ private:
+  CuHalfMatrix linear_params_;
+  CuVector<BaseFloat> bias_params_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(HalfPrecisionAffineComponent);
+};
+
 // SumGroupComponent is used to sum up groups of posteriors.
 // It's used to introduce a kind of Gaussian-mixture-model-like
 // idea into neural nets.  This is basically a degenerate case of
@@ -638,6 +793,7 @@ class FixedBiasComponent: public Component {
   virtual void Write(std::ostream &os, bool binary) const;
 
  protected:
+  friend class AffineComponent;  // necessary for collapse
   CuVector<BaseFloat> bias_;
   KALDI_DISALLOW_COPY_AND_ASSIGN(FixedBiasComponent);
 };
@@ -1137,6 +1293,14 @@ class ConvolutionComponent: public UpdatableComponent {
                            CuMatrix<BaseFloat> *patches) const;
   void InderivPatchesToInderiv(const CuMatrix<BaseFloat>& in_deriv_patches,
                                CuMatrixBase<BaseFloat> *in_deriv) const;
+  // Only applicable for zyx input vectorization.  Outputs, for each x
+  // position within the filter (the "block"), and each patch, the column of
+  // the input where that part of the patch starts.  With zyx vectorization
+  // this lets us do the convolution without making a copy of the input
+  // patches (see ConvolveBlocks() in nnet-simple-component.cc), which is what
+  // we do in that case; for yzx vectorization we still use
+  // InputToInputPatches().
+  void GetBlockOffsets(std::vector<std::vector<int32> > *block_offsets) const;
   const ConvolutionComponent &operator = (const ConvolutionComponent &other); // Disallow.
 };
 
@@ -1261,6 +1425,11 @@ class Convolutional1dComponent: public UpdatableComponent {
                              std::vector<std::vector<int32> > *backward_indexes);
   static void RearrangeIndexes(const std::vector<std::vector<int32> > &in,
                                std::vector<std::vector<int32> > *out);
+  // Outputs, for each spliced frame s (the "block") and each patch p, the
+  // column of the input where the part of patch p in frame s starts; we use
+  // this to do the convolution without making a copy of the input patches
+  // (see ConvolveBlocks() in nnet-simple-component.cc).
+  void GetBlockOffsets(std::vector<std::vector<int32> > *block_offsets) const;
 
   const Convolutional1dComponent &operator = (const Convolutional1dComponent &other); // Disallow.
   CuMatrix<BaseFloat> filter_params_;
@@ -38,6 +38,7 @@ namespace nnet3 {
  ivector_(ivector), online_ivector_feats_(online_ivectors),
  online_ivector_period_(online_ivector_period),
  compiler_(nnet_, opts_.optimize_config),
+ shared_compiler_(NULL),
  current_log_post_offset_(0), 
  left_context_(left_context), right_context_(right_context) {
  KALDI_ASSERT(!(ivector != NULL && online_ivectors != NULL));
@@ -59,6 +60,7 @@ NnetSimpleComputer::NnetSimpleComputer(
  ivector_(ivector), online_ivector_feats_(online_ivectors),
  online_ivector_period_(online_ivector_period),
  compiler_(nnet_, opts_.optimize_config),
+ shared_compiler_(NULL),
  current_log_post_offset_(0) {
  KALDI_ASSERT(!(ivector != NULL && online_ivectors != NULL));
  KALDI_ASSERT(!(online_ivectors != NULL && online_ivector_period <= 0 &&
@@ -80,6 +82,7 @@ NnetSimpleComputer::NnetSimpleComputer(
  online_ivector_feats_(&ivectors),
  online_ivector_period_(online_ivector_period),
  compiler_(nnet, opts_.optimize_config),
+ shared_compiler_(NULL),
  current_log_post_offset_(0) {
  PossiblyWarnForFramesPerChunk();
  ComputeSimpleNnetContext(nnet_, &left_context_, &right_context_);
@@ -97,6 +100,7 @@ NnetSimpleComputer::NnetSimpleComputer(
  online_ivector_feats_(NULL),
  online_ivector_period_(0),
  compiler_(nnet, opts_.optimize_config),
+ shared_compiler_(NULL),
  current_log_post_offset_(0) {
  PossiblyWarnForFramesPerChunk();
  ComputeSimpleNnetContext(nnet_, &left_context_, &right_context_);
@@ -209,9 +213,11 @@ void NnetSimpleComputer::DoNnetComputation(
   CuMatrix<BaseFloat> cu_output;
   DoNnetComputationInternal(input_t_start, input_feats, ivector, 
                             output_t_start, num_output_frames, &cu_output);
-  current_log_post_.Resize(0, 0);
-  // the following statement just swaps the pointers if we're not using a GPU.
-  cu_output.Swap(&current_log_post_);
+  // current_log_post_ is in pinned memory, so if we are using a GPU this copy
+  // goes at full speed; its memory is reused from chunk to chunk.
+  current_log_post_.Resize(cu_output.NumRows(), cu_output.NumCols(),
+                           kUndefined);
+  cu_output.CopyToMat(&current_log_post_);
   current_log_post_offset_ = output_t_start;
 }
 
@@ -224,29 +230,16 @@ void NnetSimpleComputer::DoNnetComputationInternal(
     CuMatrix<BaseFloat> *cu_output) {
   KALDI_ASSERT(cu_output != NULL);
 
+  // We shift the 'input' and 'output' to a consistent time (the output
+  // starting at zero), to take advantage of caching in the compiler.
   ComputationRequest request;
-  request.need_model_derivative = false;
-  request.store_component_stats = false;
-
-  bool shift_time = true; // shift the 'input' and 'output' to a consistent
-                          // time, to take advantage of caching in the compiler.
-                          // An optimization.
-  int32 time_offset = (shift_time ? -output_t_start : 0);
-  
-  // First add the regular features-- named "input".
-  request.inputs.reserve(2);
-  request.inputs.push_back(
-      IoSpecification("input", time_offset + input_t_start,
-                      time_offset + input_t_start + input_feats.NumRows()));
-  if (ivector.Dim() != 0) {
-    std::vector<Index> indexes;
-    indexes.push_back(Index(0, 0, 0));
-    request.inputs.push_back(IoSpecification("ivector", indexes));
-  }
-  request.outputs.push_back(
-      IoSpecification("output", time_offset + output_t_start,
-                      time_offset + output_t_start + num_output_frames));
-  const NnetComputation *computation = compiler_.Compile(request);
+  CreateComputationRequest(output_t_start - input_t_start,
+                           input_t_start + input_feats.NumRows() -
+                           (output_t_start + num_output_frames),
+                           num_output_frames, ivector.Dim() != 0, &request);
+  CachingOptimizingCompiler *compiler =
+      (shared_compiler_ != NULL ? shared_compiler_ : &compiler_);
+  const NnetComputation *computation = compiler->Compile(request);
   Nnet *nnet_to_update = NULL;  // we're not doing any update.
   NnetComputer computer(opts_.compute_config, *computation,
                         nnet_, nnet_to_update);
@@ -263,6 +256,51 @@ void NnetSimpleComputer::DoNnetComputationInternal(
   computer.GetOutputDestructive("output", cu_output);
 }
 
+void NnetSimpleComputer::CreateComputationRequest(
+    int32 left_context,
+    int32 right_context,
+    int32 num_output_frames,
+    bool use_ivector,
+    ComputationRequest *request) {
+  KALDI_ASSERT(num_output_frames > 0);
+  request->inputs.clear();
+  request->outputs.clear();
+  request->need_model_derivative = false;
+  request->store_component_stats = false;
+
+  // First add the regular features-- named "input".
+  request->inputs.reserve(2);
+  request->inputs.push_back(
+      IoSpecification("input", -left_context,
+                      num_output_frames + right_context));
+  if (use_ivector) {
+    std::vector<Index> indexes;
+    indexes.push_back(Index(0, 0, 0));
+    request->inputs.push_back(IoSpecification("ivector", indexes));
+  }
+  request->outputs.push_back(
+      IoSpecification("output", 0, num_output_frames));
+}
+
+void PrecompileSimpleComputations(const NnetSimpleComputerOptions &opts,
+                                  int32 left_context,
+                                  int32 right_context,
+                                  bool use_ivector,
+                                  CachingOptimizingCompiler *compiler) {
+  KALDI_ASSERT(opts.frames_per_chunk > 0 && opts.extra_left_context >= 0);
+  // This is the context that EnsureFrameIsComputed() uses.
+  left_context += opts.extra_left_context;
+  for (int32 n = 1; n <= opts.frames_per_chunk; n++) {
+    ComputationRequest request;
+    NnetSimpleComputer::CreateComputationRequest(
+        left_context, right_context, n, use_ivector, &request);
+    compiler->Compile(request);
+  }
+  KALDI_VLOG(1) << "Compiled the computations for chunks of 1 to "
+                << opts.frames_per_chunk << " frames; the compiler has "
+                << compiler->NumComputations() << " computations.";
+}
+
 void NnetSimpleComputer::PossiblyWarnForFramesPerChunk() const {
   static bool warned = false;
   int32 nnet_modulus = nnet_.Modulus();  
@@ -25,6 +25,7 @@
 #include "nnet3/nnet-optimize.h"
 #include "nnet3/nnet-compute.h"
 #include "nnet3/am-nnet-simple.h"
+#include "cudamatrix/cu-stream.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -111,6 +112,29 @@ class NnetSimpleComputer {
   /// and returns the result to the output matrix
   void GetOutput(Matrix<BaseFloat> *output);
 
+  /// Makes this object get its computations from "compiler" instead of from
+  /// its own CachingOptimizingCompiler.  "compiler" must have been constructed
+  /// with the same nnet and optimization options as this object, and must
+  /// outlive it.  This is useful when there is one of these objects per
+  /// utterance, possibly in several threads, so that the computations are
+  /// compiled only once; the compiler should then have been constructed with
+  /// capacity <= 0 (no eviction), see CachingOptimizingCompiler.
+  void SetSharedCompiler(CachingOptimizingCompiler *compiler) {
+    shared_compiler_ = compiler;
+  }
+
+  /// Creates the ComputationRequest that this class uses for a chunk with
+  /// "num_output_frames" frames of output, and "left_context" and
+  /// "right_context" frames of input context on either side of it (including
+  /// extra_left_context).  The times are relative to the start of the chunk,
+  /// so the request only depends on these numbers and on whether there is an
+  /// iVector.
+  static void CreateComputationRequest(int32 left_context,
+                                       int32 right_context,
+                                       int32 num_output_frames,
+                                       bool use_ivector,
+                                       ComputationRequest *request);
+
  protected:
   // This call is made to ensure that we have the log-probs for this frame
   // cached in current_log_post_.
@@ -170,12 +194,14 @@ class NnetSimpleComputer {
   int32 online_ivector_period_;
 
   CachingOptimizingCompiler compiler_;
+  // If non-NULL, we use this instead of compiler_ (see SetSharedCompiler()).
+  CachingOptimizingCompiler *shared_compiler_;
 
   // The current log-posteriors that we got from the last time we
   // ran the computation. 
   // NOTE: This is just the output of the neural network, not necessarily the 
-  // log-posteriors
-  Matrix<BaseFloat> current_log_post_;
+  // log-posteriors.  It's in pinned memory, for faster copying from the GPU.
+  PinnedMatrix<BaseFloat> current_log_post_;
   // The time-offset of the current log-posteriors. 
   int32 current_log_post_offset_;
  
@@ -184,6 +210,24 @@ class NnetSimpleComputer {
   int32 right_context_;
 };
 
+/// Compiles, in "compiler", all the computations that NnetSimpleComputer
+/// objects with options "opts" can request: one for each chunk size from 1 to
+/// opts.frames_per_chunk (the last chunk of an utterance is usually shorter),
+/// with or without an iVector as "use_ivector" says.  "left_context" and
+/// "right_context" are the nnet's context, as given to (or computed by) the
+/// constructor.  Call this at startup and give the compiler to the
+/// NnetSimpleComputer objects with SetSharedCompiler(), so that no compilation
+/// happens, at unpredictable times, while decoding.  The compiler must have
+/// been constructed with capacity <= 0, or the computations would be evicted
+/// again; and it may have read a cache written by
+/// CachingOptimizingCompiler::WriteCache(), in which case only the missing
+/// computations are compiled.
+void PrecompileSimpleComputations(const NnetSimpleComputerOptions &opts,
+                                  int32 left_context,
+                                  int32 right_context,
+                                  bool use_ivector,
+                                  CachingOptimizingCompiler *compiler);
+
 } // namespace nnet3
 } // namespace kaldi
 
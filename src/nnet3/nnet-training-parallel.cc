@@ -0,0 +1,176 @@
+// nnet3/nnet-training-parallel.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "nnet3/nnet-training-parallel.h"
+#include "nnet3/nnet-utils.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+class NnetParallelTrainer::TrainerThread: public MultiThreadable {
+ public:
+  TrainerThread(NnetParallelTrainer *trainer,
+                const std::vector<const NnetExample*> *egs):
+      trainer_(trainer), egs_(egs) { }
+  void operator() () {
+    trainer_->TrainOne(thread_id_, *((*egs_)[thread_id_]));
+    // wait until all the threads have computed their parameter change.
+    trainer_->barrier_.Wait();
+    trainer_->ReduceComponents(thread_id_, num_threads_);
+  }
+ private:
+  NnetParallelTrainer *trainer_;
+  const std::vector<const NnetExample*> *egs_;
+};
+
+NnetParallelTrainer::NnetParallelTrainer(const NnetTrainerOptions &config,
+                                         int32 num_threads,
+                                         Nnet *nnet):
+    config_(config),
+    nnet_(nnet),
+    compiler_(*nnet, config_.optimize_config),
+    minibatch_objf_(num_threads),
+    num_minibatches_processed_(0) {
+  KALDI_ASSERT(num_threads > 0 && config.momentum >= 0.0 &&
+               config.max_param_change >= 0.0);
+  if (config.zero_component_stats)
+    ZeroComponentStats(nnet);
+  delta_nnets_.resize(num_threads);
+  for (int32 t = 0; t < num_threads; t++) {
+    delta_nnets_[t] = nnet_->Copy();
+    bool is_gradient = false;  // setting this to true would disable the
+                               // natural-gradient updates.
+    SetZero(is_gradient, delta_nnets_[t]);
+  }
+}
+
+NnetParallelTrainer::~NnetParallelTrainer() {
+  for (size_t t = 0; t < delta_nnets_.size(); t++)
+    delete delta_nnets_[t];
+}
+
+void NnetParallelTrainer::Train(const std::vector<const NnetExample*> &egs) {
+  int32 num_threads = egs.size();
+  KALDI_ASSERT(num_threads > 0 && num_threads <= NumThreads());
+  barrier_.SetThreshold(num_threads);
+  {
+    // the destructor of MultiThreader waits for the threads to finish.
+    MultiThreader<TrainerThread> m(num_threads, TrainerThread(this, &egs));
+  }
+  ApplyChange(num_threads);
+
+  for (int32 t = 0; t < num_threads; t++) {
+    for (size_t i = 0; i < minibatch_objf_[t].size(); i++) {
+      const std::string &name = minibatch_objf_[t][i].first;
+      objf_info_[name].UpdateStats(name, config_.print_interval,
+                                   num_minibatches_processed_++,
+                                   minibatch_objf_[t][i].second.first,
+                                   minibatch_objf_[t][i].second.second);
+    }
+  }
+}
+
+void NnetParallelTrainer::TrainOne(int32 thread, const NnetExample &eg) {
+  bool need_model_derivative = true;
+  ComputationRequest request;
+  GetComputationRequest(*nnet_, eg, need_model_derivative,
+                        config_.store_component_stats,
+                        &request);
+  const NnetComputation *computation = compiler_.Compile(request);
+
+  NnetComputer computer(config_.compute_config, *computation,
+                        *nnet_, delta_nnets_[thread]);
+  // give the inputs to the computer object.
+  computer.AcceptInputs(*nnet_, eg.io);
+  computer.Forward();
+
+  minibatch_objf_[thread].clear();
+  std::vector<NnetIo>::const_iterator iter = eg.io.begin(),
+      end = eg.io.end();
+  for (; iter != end; ++iter) {
+    const NnetIo &io = *iter;
+    int32 node_index = nnet_->GetNodeIndex(io.name);
+    KALDI_ASSERT(node_index >= 0);
+    if (nnet_->IsOutputNode(node_index)) {
+      ObjectiveType obj_type = nnet_->GetNode(node_index).u.objective_type;
+      BaseFloat tot_weight, tot_objf;
+      bool supply_deriv = true;
+      ComputeObjectiveFunction(io.features, obj_type, io.name,
+                               supply_deriv, &computer,
+                               &tot_weight, &tot_objf);
+      minibatch_objf_[thread].push_back(
+          std::make_pair(io.name, std::make_pair(tot_weight, tot_objf)));
+    }
+  }
+  computer.Backward();
+}
+
+void NnetParallelTrainer::ReduceComponents(int32 thread, int32 num_threads) {
+  Nnet *dest = delta_nnets_[0];
+  for (int32 c = thread; c < dest->NumComponents(); c += num_threads) {
+    Component *dest_comp = dest->GetComponent(c);
+    for (int32 t = 1; t < num_threads; t++)
+      dest_comp->Add(1.0, *(delta_nnets_[t]->GetComponent(c)));
+  }
+}
+
+void NnetParallelTrainer::ApplyChange(int32 num_threads) {
+  Nnet *delta_nnet = delta_nnets_[0];
+  BaseFloat scale = (1.0 - config_.momentum);
+  if (config_.max_param_change != 0.0) {
+    BaseFloat param_delta =
+        std::sqrt(DotProduct(*delta_nnet, *delta_nnet)) * scale;
+    if (param_delta > config_.max_param_change) {
+      if (param_delta - param_delta != 0.0) {
+        KALDI_WARN << "Infinite parameter change, will not apply.";
+        SetZero(false, delta_nnet);
+      } else {
+        scale *= config_.max_param_change / param_delta;
+        KALDI_LOG << "Parameter change too big: " << param_delta << " > "
+                  << "--max-param-change=" << config_.max_param_change
+                  << ", scaling by " << config_.max_param_change / param_delta;
+      }
+    }
+  }
+  AddNnet(*delta_nnet, scale, nnet_);
+  ScaleNnet(config_.momentum, delta_nnet);
+  // ScaleNnet() also zeroes the stats and, for natural-gradient components,
+  // the update counts, but it leaves the preconditioning state alone.
+  for (int32 t = 1; t < num_threads; t++)
+    ScaleNnet(0.0, delta_nnets_[t]);
+}
+
+bool NnetParallelTrainer::PrintTotalStats() const {
+  unordered_map<std::string, ObjectiveFunctionInfo,
+                StringHasher>::const_iterator
+      iter = objf_info_.begin(),
+      end = objf_info_.end();
+  bool ans = false;
+  for (; iter != end; ++iter) {
+    const std::string &name = iter->first;
+    const ObjectiveFunctionInfo &info = iter->second;
+    ans = ans || info.PrintTotalStats(name);
+  }
+  return ans;
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
@@ -0,0 +1,112 @@
+// nnet3/nnet-training-parallel.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_NNET3_NNET_TRAINING_PARALLEL_H_
+#define KALDI_NNET3_NNET_TRAINING_PARALLEL_H_
+
+#include "nnet3/nnet-training.h"
+#include "thread/kaldi-barrier.h"
+#include "thread/kaldi-thread.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+/**
+   This class is for synchronous data-parallel training of neural nets with
+   several threads in one process.  Each call to Train() gives it up to
+   NumThreads() minibatches; each thread computes the parameter change for one
+   of them, starting from the same model, into its own copy of the nnet
+   ("delta nnet"); then the threads sum the changes ("all-reduce", with each
+   thread doing a subset of the components), and the summed change is applied
+   to the model, subject to --max-param-change and --momentum as in class
+   NnetTrainer.  The result is the same as training with one thread on
+   minibatches NumThreads() times larger (but with the learning rate applied
+   per original minibatch), and unlike averaging models from separate jobs, it
+   doesn't get worse as the number of threads increases.
+
+   Each thread's delta nnet keeps its own natural-gradient preconditioning state
+   (see NaturalGradientAffineComponent) from one minibatch to the next, so the
+   natural-gradient update is done just as in single-threaded training, with
+   each thread estimating the Fisher matrix from the data it sees.
+
+   The computation is done on the CPU, since in this version of the code the
+   GPU (CuDevice) is a single per-process object that can't be shared between
+   threads.  --max-param-change applies to the summed change, so you may want
+   to increase it.
+ */
+class NnetParallelTrainer {
+ public:
+  NnetParallelTrainer(const NnetTrainerOptions &config,
+                      int32 num_threads,
+                      Nnet *nnet);
+
+  int32 NumThreads() const { return delta_nnets_.size(); }
+
+  /// Trains on a group of minibatches, one per thread; "egs" must be nonempty
+  /// and its size may not exceed NumThreads() (it can be smaller, e.g. at the
+  /// end of the data).
+  void Train(const std::vector<const NnetExample*> &egs);
+
+  /// Prints out the final stats, and return true if there was a nonzero count.
+  bool PrintTotalStats() const;
+
+  ~NnetParallelTrainer();
+ private:
+  class TrainerThread;
+  friend class TrainerThread;
+
+  // Does the forward and backward computation for thread "thread", adding the
+  // parameter change to delta_nnets_[thread] and recording the objective
+  // function in minibatch_objf_[thread].
+  void TrainOne(int32 thread, const NnetExample &eg);
+
+  // Adds delta_nnets_[t] for 0 < t < num_threads to delta_nnets_[0], for the
+  // components c with c % num_threads == thread.
+  void ReduceComponents(int32 thread, int32 num_threads);
+
+  // Applies the summed change in delta_nnets_[0] to the model, and sets up
+  // the delta nnets for the next call to Train().
+  void ApplyChange(int32 num_threads);
+
+  const NnetTrainerOptions config_;
+  Nnet *nnet_;
+  // The parameter changes, one per thread.  delta_nnets_[0] also holds the
+  // momentum term, if --momentum is nonzero.
+  std::vector<Nnet*> delta_nnets_;
+  CachingOptimizingCompiler compiler_;  // this is thread-safe.
+  Barrier barrier_;
+
+  // For each thread, the (output-name, (weight, objective)) for each output of
+  // the minibatch it most recently processed.
+  std::vector<std::vector<std::pair<std::string,
+                                    std::pair<BaseFloat, BaseFloat> > > >
+  minibatch_objf_;
+
+  int32 num_minibatches_processed_;
+  unordered_map<std::string, ObjectiveFunctionInfo, StringHasher> objf_info_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(NnetParallelTrainer);
+};
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+#endif // KALDI_NNET3_NNET_TRAINING_PARALLEL_H_
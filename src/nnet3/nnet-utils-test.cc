@@ -19,6 +19,10 @@
 
 #include "nnet3/nnet-nnet.h"
 #include "nnet3/nnet-test-utils.h"
+#include "nnet3/nnet-utils.h"
+#include "nnet3/nnet-compile.h"
+#include "nnet3/nnet-compute.h"
+#include "nnet3/nnet-simple-component.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -43,6 +47,114 @@ void UnitTestNnetContext() {
   }
 }
 
+// Computes the output of the nnet for this request and these inputs.
+static void ComputeOutput(const Nnet &nnet,
+                          const ComputationRequest &request,
+                          const std::vector<Matrix<BaseFloat> > &inputs,
+                          Matrix<BaseFloat> *output) {
+  NnetComputation computation;
+  Compiler compiler(request, nnet);
+  CompilerOptions opts;
+  compiler.CreateComputation(opts, &computation);
+  computation.ComputeCudaIndexes();
+  NnetComputeOptions compute_opts;
+  NnetComputer computer(compute_opts, computation, nnet, NULL);
+  for (size_t i = 0; i < request.inputs.size(); i++) {
+    CuMatrix<BaseFloat> temp(inputs[i]);
+    computer.AcceptInput(request.inputs[i].name, &temp);
+  }
+  computer.Forward();
+  output->Resize(0, 0);
+  output->Resize(computer.GetOutput("output").NumRows(),
+                 computer.GetOutput("output").NumCols());
+  computer.GetOutput("output").CopyToMat(output);
+}
+
+// Checks that CollapseModel() doesn't change the output of the nnet.
+static void TestCollapseModelOutput(const Nnet &nnet) {
+  Nnet collapsed_nnet(nnet);
+  int32 num_collapsed = CollapseModel(&collapsed_nnet);
+  KALDI_LOG << "Collapsed " << num_collapsed << " pairs of components; "
+            << "collapsed nnet is: " << collapsed_nnet.Info();
+  KALDI_ASSERT(collapsed_nnet.NumComponents() <=
+               nnet.NumComponents() - num_collapsed);
+
+  ComputationRequest request;
+  std::vector<Matrix<BaseFloat> > inputs;
+  ComputeExampleComputationRequestSimple(nnet, &request, &inputs);
+  // We only do the forward computation.
+  request.need_model_derivative = false;
+  for (size_t i = 0; i < request.inputs.size(); i++)
+    request.inputs[i].has_deriv = false;
+  for (size_t i = 0; i < request.outputs.size(); i++)
+    request.outputs[i].has_deriv = false;
+
+  Matrix<BaseFloat> output, collapsed_output;
+  ComputeOutput(nnet, request, inputs, &output);
+  ComputeOutput(collapsed_nnet, request, inputs, &collapsed_output);
+  KALDI_ASSERT(output.ApproxEqual(collapsed_output, 0.001));
+}
+
+void UnitTestCollapseModel() {
+  {
+    // A network in which everything apart from the nonlinearity can be
+    // collapsed into a neighbouring affine component.
+    std::ostringstream os;
+    os << "component name=lda type=AffineComponent input-dim=20 "
+       << "output-dim=20 param-stddev=0.2 bias-stddev=0.1\n"
+       << "component name=scale1 type=PerElementScaleComponent dim=20 "
+       << "param-mean=1.0 param-stddev=0.5\n"
+       << "component name=affine1 type=NaturalGradientAffineComponent "
+       << "input-dim=20 output-dim=15\n"
+       << "component name=clip1 type=ClipGradientComponent dim=15\n"
+       << "component name=relu1 type=RectifiedLinearComponent dim=15\n"
+       << "component name=affine2 type=AffineComponent input-dim=15 "
+       << "output-dim=10\n"
+       << "component name=noop2 type=NoOpComponent dim=10\n"
+       << "input-node name=input dim=20\n"
+       << "component-node name=lda component=lda input=input\n"
+       << "component-node name=scale1 component=scale1 input=lda\n"
+       << "component-node name=affine1 component=affine1 input=scale1\n"
+       << "component-node name=clip1 component=clip1 input=affine1\n"
+       << "component-node name=relu1 component=relu1 input=clip1\n"
+       << "component-node name=affine2 component=affine2 input=relu1\n"
+       << "component-node name=noop2 component=noop2 input=affine2\n"
+       << "output-node name=output input=noop2\n";
+    Nnet nnet;
+    std::istringstream is(os.str());
+    nnet.ReadConfig(is);
+    // Replace "lda" with an equivalent FixedAffineComponent.
+    int32 c = nnet.GetComponentIndex("lda");
+    const AffineComponent *lda =
+        dynamic_cast<const AffineComponent*>(nnet.GetComponent(c));
+    KALDI_ASSERT(lda != NULL);
+    CuMatrix<BaseFloat> lda_mat(20, 21);
+    lda_mat.Range(0, 20, 0, 20).CopyFromMat(lda->LinearParams());
+    lda_mat.CopyColFromVec(lda->BiasParams(), 20);
+    FixedAffineComponent *fixed_lda = new FixedAffineComponent();
+    fixed_lda->Init(lda_mat);
+    nnet.SetComponent(c, fixed_lda);
+
+    TestCollapseModelOutput(nnet);
+    Nnet collapsed_nnet(nnet);
+    CollapseModel(&collapsed_nnet);
+    // What should be left is a FixedAffineComponent, the
+    // RectifiedLinearComponent and an AffineComponent.
+    KALDI_ASSERT(collapsed_nnet.NumComponents() == 3);
+  }
+  for (int32 n = 0; n < 10; n++) {
+    struct NnetGenerationOptions gen_config;
+    std::vector<std::string> configs;
+    GenerateConfigSequence(gen_config, &configs);
+    Nnet nnet;
+    for (size_t j = 0; j < configs.size(); j++) {
+      std::istringstream is(configs[j]);
+      nnet.ReadConfig(is);
+    }
+    TestCollapseModelOutput(nnet);
+  }
+}
+
 } // namespace nnet3
 } // namespace kaldi
 
@@ -52,6 +164,7 @@ int main() {
   SetVerboseLevel(2);
 
   UnitTestNnetContext();
+  UnitTestCollapseModel();
 
   KALDI_LOG << "Nnet tests succeeded.";
 
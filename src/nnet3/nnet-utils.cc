@@ -20,6 +20,7 @@
 // limitations under the License.
 
 #include "nnet3/nnet-utils.h"
+#include "nnet3/nnet-simple-component.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -356,5 +357,175 @@ int32 NumUpdatableComponents(const Nnet &dest) {
   return ans;
 }
 
+int32 QuantizeAffineComponents(Nnet *nnet) {
+  int32 num_quantized = 0;
+  for (int32 c = 0; c < nnet->NumComponents(); c++) {
+    const AffineComponent *ac =
+        dynamic_cast<const AffineComponent*>(nnet->GetComponent(c));
+    if (ac == NULL)
+      continue;
+    QuantizedAffineComponent *qc = new QuantizedAffineComponent(*ac);
+    Matrix<BaseFloat> linear_params(ac->LinearParams()),
+        quantized_params(linear_params.NumRows(), linear_params.NumCols());
+    qc->GetLinearParams(&quantized_params);
+    BaseFloat orig_norm = linear_params.FrobeniusNorm();
+    quantized_params.AddMat(-1.0, linear_params);
+    KALDI_LOG << "Quantized component " << nnet->GetComponentName(c)
+              << ", relative error in linear parameters is "
+              << (orig_norm == 0.0 ? 0.0 :
+                  quantized_params.FrobeniusNorm() / orig_norm);
+    nnet->SetComponent(c, qc);
+    num_quantized++;
+  }
+  return num_quantized;
+}
+
+int32 ConvertAffineComponentsToHalf(Nnet *nnet) {
+  int32 num_converted = 0;
+  for (int32 c = 0; c < nnet->NumComponents(); c++) {
+    const AffineComponent *ac =
+        dynamic_cast<const AffineComponent*>(nnet->GetComponent(c));
+    if (ac == NULL)
+      continue;
+    nnet->SetComponent(c, new HalfPrecisionAffineComponent(*ac));
+    num_converted++;
+  }
+  return num_converted;
+}
+
+// Returns true if this component is the identity in the forward direction.
+static bool IsIdentityComponent(const Component &c) {
+  std::string type = c.Type();
+  return (type == "NoOpComponent" || type == "ClipGradientComponent");
+}
+
+// Returns a newly allocated component that is equivalent, in the forward
+// direction, to c1 followed by c2, or NULL if we don't know how to combine
+// them.
+static Component *CollapseComponents(const Component &c1,
+                                     const Component &c2) {
+  if (!(c1.Properties() & kSimpleComponent) ||
+      !(c2.Properties() & kSimpleComponent))
+    return NULL;
+  if (IsIdentityComponent(c2))
+    return c1.Copy();
+  if (IsIdentityComponent(c1))
+    return c2.Copy();
+  const AffineComponent *a1 = dynamic_cast<const AffineComponent*>(&c1),
+      *a2 = dynamic_cast<const AffineComponent*>(&c2);
+  if (a1 != NULL) {
+    if (a2 != NULL) {
+      // Don't undo a factorization of a large matrix into two smaller ones.
+      int32 mid_dim = a1->OutputDim();
+      if (static_cast<int64>(a1->InputDim()) * a2->OutputDim() >
+          static_cast<int64>(mid_dim) * (a1->InputDim() + a2->OutputDim()))
+        return NULL;
+      return a1->CollapseWithNext(*a2);
+    }
+    if (const FixedAffineComponent *f2 =
+        dynamic_cast<const FixedAffineComponent*>(&c2))
+      return a1->CollapseWithNext(*f2);
+    if (const FixedScaleComponent *s2 =
+        dynamic_cast<const FixedScaleComponent*>(&c2))
+      return a1->CollapseWithNext(*s2);
+    if (const PerElementScaleComponent *p2 =
+        dynamic_cast<const PerElementScaleComponent*>(&c2))
+      return a1->CollapseWithNext(*p2);
+    if (const FixedBiasComponent *b2 =
+        dynamic_cast<const FixedBiasComponent*>(&c2))
+      return a1->CollapseWithNext(*b2);
+  } else if (a2 != NULL) {
+    if (const FixedAffineComponent *f1 =
+        dynamic_cast<const FixedAffineComponent*>(&c1))
+      return a2->CollapseWithPrevious(*f1);
+    if (const FixedScaleComponent *s1 =
+        dynamic_cast<const FixedScaleComponent*>(&c1))
+      return a2->CollapseWithPrevious(*s1);
+    if (const PerElementScaleComponent *p1 =
+        dynamic_cast<const PerElementScaleComponent*>(&c1))
+      return a2->CollapseWithPrevious(*p1);
+  }
+  return NULL;
+}
+
+// Tries to find a pair of component nodes that CollapseModel() can combine,
+// and combines them.  Returns true if it did.
+static bool CollapseOnePair(Nnet *nnet) {
+  int32 num_nodes = nnet->NumNodes();
+  // num_node_users[n] is the number of nodes that take input from node n;
+  // num_component_users[c] is the number of nodes that use component c.
+  std::vector<int32> num_node_users(num_nodes, 0),
+      num_component_users(nnet->NumComponents(), 0);
+  for (int32 n = 0; n < num_nodes; n++) {
+    const NetworkNode &node = nnet->GetNode(n);
+    if (node.node_type == kDescriptor) {
+      std::vector<int32> dependencies;
+      node.descriptor.GetNodeDependencies(&dependencies);
+      SortAndUniq(&dependencies);
+      for (size_t i = 0; i < dependencies.size(); i++)
+        num_node_users[dependencies[i]]++;
+    } else if (node.node_type == kDimRange) {
+      num_node_users[node.u.node_index]++;
+    } else if (node.node_type == kComponent) {
+      num_component_users[node.u.component_index]++;
+    }
+  }
+  for (int32 n2 = 0; n2 < num_nodes; n2++) {
+    if (!nnet->IsComponentNode(n2))
+      continue;
+    const Descriptor &descriptor = nnet->GetNode(n2 - 1).descriptor;
+    std::vector<int32> dependencies;
+    descriptor.GetNodeDependencies(&dependencies);
+    SortAndUniq(&dependencies);
+    if (dependencies.size() != 1)
+      continue;
+    int32 n1 = dependencies[0];
+    if (!nnet->IsComponentNode(n1) || num_node_users[n1] != 1)
+      continue;
+    // Check that the input of n2 is exactly the output of n1.
+    std::ostringstream os;
+    descriptor.WriteConfig(os, nnet->GetNodeNames());
+    if (os.str() != nnet->GetNodeName(n1))
+      continue;
+    int32 c1 = nnet->GetNode(n1).u.component_index,
+        c2 = nnet->GetNode(n2).u.component_index;
+    if (num_component_users[c1] != 1 || num_component_users[c2] != 1)
+      continue;
+    Component *new_component = CollapseComponents(*(nnet->GetComponent(c1)),
+                                                  *(nnet->GetComponent(c2)));
+    if (new_component == NULL)
+      continue;
+    std::string new_name = nnet->GetComponentName(c1) + "-" +
+        nnet->GetComponentName(c2), name = new_name;
+    for (int32 i = 2; nnet->GetComponentIndex(name) != -1; i++) {
+      std::ostringstream name_os;
+      name_os << new_name << "-" << i;
+      name = name_os.str();
+    }
+    KALDI_LOG << "Collapsing component " << nnet->GetComponentName(c1)
+              << " of type " << nnet->GetComponent(c1)->Type()
+              << " and component " << nnet->GetComponentName(c2)
+              << " of type " << nnet->GetComponent(c2)->Type()
+              << " into component " << name << " of type "
+              << new_component->Type();
+    int32 new_c = nnet->AddComponent(name, new_component);
+    nnet->GetNode(n2).u.component_index = new_c;
+    nnet->GetNode(n2 - 1).descriptor = nnet->GetNode(n1 - 1).descriptor;
+    // n1 is now unused; this removes it and the components c1 and c2.
+    nnet->RemoveOrphanNodes();
+    nnet->RemoveOrphanComponents();
+    return true;
+  }
+  return false;
+}
+
+int32 CollapseModel(Nnet *nnet) {
+  int32 num_collapsed = 0;
+  while (CollapseOnePair(nnet))
+    num_collapsed++;
+  nnet->Check();
+  return num_collapsed;
+}
+
 } // namespace nnet3
 } // namespace kaldi
@@ -138,6 +138,37 @@ void UnVectorizeNnet(const VectorBase<BaseFloat> &params,
 /// Returns the number of updatable components in the nnet.
 int32 NumUpdatableComponents(const Nnet &dest);
 
+/// Replaces each AffineComponent (including child classes such as
+/// NaturalGradientAffineComponent) in the nnet with an equivalent
+/// QuantizedAffineComponent, which stores the linear parameters as 8-bit
+/// integers; the result can only be used for inference.  Prints the relative
+/// error in the linear parameters of each component, and returns the number of
+/// components that were converted.
+int32 QuantizeAffineComponents(Nnet *nnet);
+
+/// Replaces each AffineComponent (including child classes such as
+/// NaturalGradientAffineComponent) in the nnet with an equivalent
+/// HalfPrecisionAffineComponent, which stores the linear parameters in 16-bit
+/// floating point; the result can only be used for inference, and is only
+/// faster if we are using a GPU.  Returns the number of components that were
+/// converted.
+int32 ConvertAffineComponentsToHalf(Nnet *nnet);
+
+/// This function simplifies a neural net for inference, by combining pairs of
+/// adjacent component nodes into a single node where we know how to do this:
+/// it folds FixedAffineComponent (e.g. the LDA transform), FixedScaleComponent,
+/// PerElementScaleComponent and FixedBiasComponent into a neighbouring
+/// AffineComponent (or child class such as NaturalGradientAffineComponent),
+/// combines two consecutive AffineComponents if that doesn't increase the
+/// number of parameters, and removes NoOpComponent and ClipGradientComponent,
+/// which are the identity in the forward direction.  A pair of nodes is only
+/// combined if the second one's input is exactly the first one's output (no
+/// Append(), Offset() and so on), the first one's output isn't used anywhere
+/// else, and neither component is shared with another node.  The resulting
+/// nnet computes the same output but is not suitable for further training.
+/// Returns the number of pairs of components that were combined.
+int32 CollapseModel(Nnet *nnet);
+
 
 
 } // namespace nnet3
@@ -0,0 +1,276 @@
+// nnet3bin/nnet2-to-nnet3.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "nnet2/am-nnet.h"
+#include "nnet2/nnet-component.h"
+#include "nnet3/am-nnet-simple.h"
+#include "nnet3/nnet-simple-component.h"
+#include "nnet3/nnet-parse.h"
+
+namespace kaldi {
+
+// Returns a NaturalGradientAffineComponent with the parameters of any of the
+// nnet2 affine components, and the default natural-gradient options of nnet3
+// (the parameters are all that matter for decoding).
+nnet3::Component *ConvertAffineComponent(
+    const nnet2::AffineComponent &affine) {
+  std::ostringstream config;
+  config << "input-dim=" << affine.InputDim()
+         << " output-dim=" << affine.OutputDim()
+         << " learning-rate=" << affine.LearningRate();
+  nnet3::ConfigLine cfl;
+  if (!cfl.ParseLine(config.str()))
+    KALDI_ERR << "Error parsing " << config.str();
+  nnet3::NaturalGradientAffineComponent *ans =
+      new nnet3::NaturalGradientAffineComponent();
+  ans->InitFromConfig(&cfl);
+  ans->SetParams(Vector<BaseFloat>(affine.BiasParams()),
+                 Matrix<BaseFloat>(affine.LinearParams()));
+  return ans;
+}
+
+nnet3::Component *ConvertFixedAffineComponent(
+    const nnet2::FixedAffineComponent &fixed_affine) {
+  const CuMatrix<BaseFloat> &linear = fixed_affine.LinearParams();
+  CuMatrix<BaseFloat> mat(linear.NumRows(), linear.NumCols() + 1);
+  mat.Range(0, linear.NumRows(), 0, linear.NumCols()).CopyFromMat(linear);
+  mat.CopyColFromVec(fixed_affine.BiasParams(), linear.NumCols());
+  nnet3::FixedAffineComponent *ans = new nnet3::FixedAffineComponent();
+  ans->Init(mat);
+  return ans;
+}
+
+nnet3::Component *ConvertPnormComponent(const nnet2::PnormComponent &pnorm) {
+  if (pnorm.P() != 2.0)
+    KALDI_ERR << "Cannot convert PnormComponent with p = " << pnorm.P()
+              << ": nnet3 only supports p = 2.";
+  return new nnet3::PnormComponent(pnorm.InputDim(), pnorm.OutputDim());
+}
+
+nnet3::Component *ConvertSumGroupComponent(
+    const nnet2::SumGroupComponent &sum_group) {
+  std::vector<int32> sizes;
+  sum_group.GetSizes(&sizes);
+  nnet3::SumGroupComponent *ans = new nnet3::SumGroupComponent();
+  ans->Init(sizes);
+  return ans;
+}
+
+nnet3::Component *ConvertScales(const CuVectorBase<BaseFloat> &scales) {
+  nnet3::FixedScaleComponent *ans = new nnet3::FixedScaleComponent();
+  ans->Init(scales);
+  return ans;
+}
+
+// Converts one nnet2 component which is not a SpliceComponent.  If
+// "is_last" is true and this is the final softmax, it becomes a
+// LogSoftmaxComponent, because nnet3 acoustic models output log-probs.
+nnet3::Component *ConvertComponent(const nnet2::Component &c, bool is_last) {
+  using namespace nnet2;
+  if (const AffineComponent *affine =
+      dynamic_cast<const AffineComponent*>(&c))
+    return ConvertAffineComponent(*affine);  // includes the preconditioned types.
+  if (const FixedAffineComponent *fixed_affine =
+      dynamic_cast<const FixedAffineComponent*>(&c))
+    return ConvertFixedAffineComponent(*fixed_affine);
+  if (const PnormComponent *pnorm = dynamic_cast<const PnormComponent*>(&c))
+    return ConvertPnormComponent(*pnorm);
+  if (const SumGroupComponent *sum_group =
+      dynamic_cast<const SumGroupComponent*>(&c))
+    return ConvertSumGroupComponent(*sum_group);
+  if (const FixedScaleComponent *fixed_scale =
+      dynamic_cast<const FixedScaleComponent*>(&c))
+    return ConvertScales(fixed_scale->Scales());
+  if (const ScaleComponent *scale = dynamic_cast<const ScaleComponent*>(&c)) {
+    CuVector<BaseFloat> scales(scale->InputDim());
+    scales.Set(scale->GetScale());
+    return ConvertScales(scales);
+  }
+  if (const FixedBiasComponent *fixed_bias =
+      dynamic_cast<const FixedBiasComponent*>(&c)) {
+    nnet3::FixedBiasComponent *ans = new nnet3::FixedBiasComponent();
+    ans->Init(fixed_bias->Bias());
+    return ans;
+  }
+  if (dynamic_cast<const LogSoftmaxComponent*>(&c) != NULL)
+    return new nnet3::LogSoftmaxComponent(c.InputDim());
+  if (dynamic_cast<const SoftmaxComponent*>(&c) != NULL) {
+    if (is_last)
+      return new nnet3::LogSoftmaxComponent(c.InputDim());
+    else
+      return new nnet3::SoftmaxComponent(c.InputDim());
+  }
+  if (dynamic_cast<const NormalizeComponent*>(&c) != NULL)
+    return new nnet3::NormalizeComponent(c.InputDim());
+  if (dynamic_cast<const SigmoidComponent*>(&c) != NULL)
+    return new nnet3::SigmoidComponent(c.InputDim());
+  if (dynamic_cast<const TanhComponent*>(&c) != NULL)
+    return new nnet3::TanhComponent(c.InputDim());
+  if (dynamic_cast<const RectifiedLinearComponent*>(&c) != NULL)
+    return new nnet3::RectifiedLinearComponent(c.InputDim());
+  KALDI_ERR << "Cannot convert component of type " << c.Type()
+            << " to nnet3.";
+  return NULL;
+}
+
+// Returns the descriptor for the output of SpliceComponent "splice", whose
+// input is the node "input_node".  If the splice component has a constant
+// part (normally an iVector), we take it from the node "ivector" at t = 0.
+std::string SpliceDescriptor(const nnet2::SpliceComponent &splice,
+                             const std::string &input_node) {
+  std::vector<int32> context = splice.Context();
+  std::ostringstream os;
+  os << "Append(";
+  for (size_t i = 0; i < context.size(); i++) {
+    if (i > 0) os << ", ";
+    if (context[i] == 0) os << input_node;
+    else os << "Offset(" << input_node << ", " << context[i] << ")";
+  }
+  if (splice.ConstComponentDim() != 0)
+    os << ", ReplaceIndex(ivector, t, 0)";
+  os << ")";
+  return os.str();
+}
+
+// Converts the nnet2 neural net into an nnet3 one with nodes "input",
+// possibly "ivector", and "output".  The SpliceComponents become Descriptors
+// on the inputs of the following components.
+void ConvertNnet2ToNnet3(const nnet2::Nnet &nnet2, nnet3::Nnet *nnet3) {
+  KALDI_ASSERT(nnet3->NumComponents() == 0 && nnet3->NumNodes() == 0);
+  int32 num_components = nnet2.NumComponents();
+  std::ostringstream config;
+  int32 feat_dim = nnet2.InputDim(), ivector_dim = 0;
+  if (num_components > 0) {
+    const nnet2::SpliceComponent *splice =
+        dynamic_cast<const nnet2::SpliceComponent*>(&(nnet2.GetComponent(0)));
+    if (splice != NULL)
+      ivector_dim = splice->ConstComponentDim();
+  }
+  feat_dim -= ivector_dim;
+  config << "input-node name=input dim=" << feat_dim << "\n";
+  if (ivector_dim != 0)
+    config << "input-node name=ivector dim=" << ivector_dim << "\n";
+
+  // "cur_node" is the last node we added, and "cur_input" the descriptor for
+  // the input of the next component (which is cur_node unless there was a
+  // SpliceComponent since then).
+  std::string cur_node = "input", cur_input = "input";
+  for (int32 c = 0; c < num_components; c++) {
+    const nnet2::Component &component = nnet2.GetComponent(c);
+    const nnet2::SpliceComponent *splice =
+        dynamic_cast<const nnet2::SpliceComponent*>(&component);
+    if (splice != NULL) {
+      if (cur_input != cur_node)
+        KALDI_ERR << "Cannot convert consecutive SpliceComponents.";
+      if (c != 0 && splice->ConstComponentDim() != 0)
+        KALDI_ERR << "Cannot convert a SpliceComponent with a constant part "
+                  << "that is not the first component.";
+      cur_input = SpliceDescriptor(*splice, cur_node);
+      continue;
+    }
+    if (dynamic_cast<const nnet2::SoftmaxComponent*>(&component) != NULL &&
+        c + 1 < num_components &&
+        dynamic_cast<const nnet2::SumGroupComponent*>(
+            &(nnet2.GetComponent(c + 1))) != NULL &&
+        c + 2 == num_components)
+      KALDI_ERR << "Cannot convert a model that was mixed up (a softmax "
+                << "followed by a SumGroupComponent at the output), since "
+                << "nnet3 needs log-probs at the output.";
+    std::ostringstream name;
+    name << "component" << c;
+    nnet3->AddComponent(name.str(),
+                        ConvertComponent(component, c + 1 == num_components));
+    config << "component-node name=" << name.str() << " component="
+           << name.str() << " input=" << cur_input << "\n";
+    cur_node = cur_input = name.str();
+  }
+  config << "output-node name=output input=" << cur_input << "\n";
+  KALDI_VLOG(1) << "Config is:\n" << config.str();
+  std::istringstream is(config.str());
+  nnet3->ReadConfig(is);
+}
+
+}  // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Convert an nnet2 acoustic model (with its transition model) into an\n"
+        "nnet3 one, so that it can be used with the nnet3 decoding programs\n"
+        "(e.g. nnet3-latgen-faster, nnet3-latgen-faster-looped).  The\n"
+        "SpliceComponents become Descriptors; if the first one has a constant\n"
+        "part (the iVector in online models), the nnet3 model has an input\n"
+        "\"ivector\" which is used at t = 0.  Dropout components are removed,\n"
+        "and the final softmax becomes a log-softmax.  Models with mixture\n"
+        "components (after --mix-up) are not supported.\n"
+        "\n"
+        "Usage:  nnet2-to-nnet3 [options] <nnet2-am-in> <nnet3-am-out>\n"
+        "e.g.:\n"
+        " nnet2-to-nnet3 final.mdl nnet3/final.mdl\n";
+
+    bool binary_write = true;
+
+    ParseOptions po(usage);
+    po.Register("binary", &binary_write, "Write output in binary mode");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string nnet2_rxfilename = po.GetArg(1),
+        nnet3_wxfilename = po.GetArg(2);
+
+    TransitionModel trans_model;
+    nnet2::AmNnet am_nnet2;
+    {
+      bool binary_read;
+      Input ki(nnet2_rxfilename, &binary_read);
+      trans_model.Read(ki.Stream(), binary_read);
+      am_nnet2.Read(ki.Stream(), binary_read);
+    }
+    am_nnet2.GetNnet().RemoveDropout();
+
+    nnet3::Nnet nnet3;
+    ConvertNnet2ToNnet3(am_nnet2.GetNnet(), &nnet3);
+    nnet3::AmNnetSimple am_nnet3(nnet3);
+    if (am_nnet2.Priors().Dim() != 0)
+      am_nnet3.SetPriors(am_nnet2.Priors());
+
+    {
+      Output ko(nnet3_wxfilename, binary_write);
+      trans_model.Write(ko.Stream(), binary_write);
+      am_nnet3.Write(ko.Stream(), binary_write);
+    }
+    KALDI_LOG << "Converted nnet2 model " << nnet2_rxfilename
+              << " to nnet3 model " << nnet3_wxfilename << " with "
+              << am_nnet3.GetNnet().NumComponents() << " components.";
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+}
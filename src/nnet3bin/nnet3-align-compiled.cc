@@ -27,8 +27,110 @@
 #include "fstext/fstext-lib.h"
 #include "decoder/decoder-wrappers.h"
 #include "decoder/training-graph-compiler.h"
+#include "decoder/decodable-matrix.h"
 #include "nnet3/nnet-am-decodable-simple.h"
 #include "lat/kaldi-lattice.h"
+#include "thread/kaldi-task-sequence.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// The arguments to the constructor of AlignUtteranceClass that are the same
+// for all utterances.
+struct AlignOutputArgs {
+  const AlignConfig *config;
+  BaseFloat acoustic_scale;
+  Int32VectorWriter *alignment_writer;
+  BaseFloatWriter *scores_writer;
+  int32 *num_done;
+  int32 *num_err;
+  int32 *num_retry;
+  double *tot_like;
+  int64 *frame_count;
+};
+
+/**
+   This class computes the scaled acoustic log-likelihoods for one utterance
+   and aligns it, in operator (), which runs in one of the TaskSequencer's
+   threads; the output happens in the destructor, in the order of the input.
+   All tasks share the model and the compiler.
+ */
+class NnetAlignUtteranceClass {
+ public:
+  // Takes ownership of "fst", "features", "ivector" and "online_ivectors"
+  // ("ivector" and "online_ivectors" may be NULL).  "compiler" is shared by
+  // all the tasks, so each computation is compiled only once.
+  NnetAlignUtteranceClass(const DecodableAmNnetSimpleOptions &opts,
+                          const TransitionModel &trans_model,
+                          const AmNnetSimple &am_nnet,
+                          CachingOptimizingCompiler *compiler,
+                          const std::string &utt,
+                          fst::VectorFst<fst::StdArc> *fst,
+                          Matrix<BaseFloat> *features,
+                          Vector<BaseFloat> *ivector,
+                          Matrix<BaseFloat> *online_ivectors,
+                          int32 online_ivector_period,
+                          const AlignOutputArgs &align_args):
+      opts_(opts), trans_model_(trans_model), am_nnet_(am_nnet),
+      compiler_(compiler), utt_(utt), fst_(fst), features_(features),
+      ivector_(ivector), online_ivectors_(online_ivectors),
+      online_ivector_period_(online_ivector_period), align_args_(align_args),
+      align_task_(NULL) { }
+
+  void operator () () {
+    Matrix<BaseFloat> *loglikes = new Matrix<BaseFloat>();
+    {
+      DecodableAmNnetSimple nnet_decodable(
+          opts_, trans_model_, am_nnet_, *features_, ivector_,
+          online_ivectors_, online_ivector_period_);
+      nnet_decodable.SetSharedCompiler(compiler_);
+      // The output already has the priors and the acoustic scale applied.
+      nnet_decodable.GetOutput(loglikes);
+    }
+    delete features_;
+    delete ivector_;
+    delete online_ivectors_;
+    features_ = NULL;
+    ivector_ = NULL;
+    online_ivectors_ = NULL;
+    // The decodable object takes ownership of loglikes, and the alignment
+    // task takes ownership of the decodable object and of fst_.
+    DecodableMatrixScaledMapped *decodable =
+        new DecodableMatrixScaledMapped(trans_model_, 1.0, loglikes);
+    const AlignOutputArgs &a = align_args_;
+    align_task_ = new AlignUtteranceClass(
+        *a.config, utt_, a.acoustic_scale, fst_, decodable,
+        a.alignment_writer, a.scores_writer, a.num_done, a.num_err,
+        a.num_retry, a.tot_like, a.frame_count);
+    fst_ = NULL;
+    (*align_task_)();
+  }
+
+  ~NnetAlignUtteranceClass() {
+    delete fst_;
+    delete features_;
+    delete ivector_;
+    delete online_ivectors_;
+    delete align_task_;  // the output happens here.
+  }
+
+ private:
+  const DecodableAmNnetSimpleOptions &opts_;
+  const TransitionModel &trans_model_;
+  const AmNnetSimple &am_nnet_;
+  CachingOptimizingCompiler *compiler_;
+  std::string utt_;
+  fst::VectorFst<fst::StdArc> *fst_;
+  Matrix<BaseFloat> *features_;
+  Vector<BaseFloat> *ivector_;
+  Matrix<BaseFloat> *online_ivectors_;
+  int32 online_ivector_period_;
+  const AlignOutputArgs &align_args_;
+  AlignUtteranceClass *align_task_;
+};
+
+}  // namespace nnet3
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -46,7 +148,9 @@ int main(int argc, char *argv[]) {
         " nnet3-align-compiled 1.mdl ark:graphs.fsts scp:train.scp ark:1.ali\n"
         "or:\n"
         " compile-train-graphs tree 1.mdl lex.fst ark:train.tra b, ark:- | \\\n"
-        "   nnet3-align-compiled 1.mdl ark:- scp:train.scp t, ark:1.ali\n";
+        "   nnet3-align-compiled 1.mdl ark:- scp:train.scp t, ark:1.ali\n"
+        "With --num-threads > 1, utterances are aligned in parallel (sharing\n"
+        "the model); the output is in the same order as the input.\n";
 
     ParseOptions po(usage);
     AlignConfig align_config;
@@ -60,7 +164,9 @@ int main(int argc, char *argv[]) {
         online_ivector_rspecifier,
         utt2spk_rspecifier;
     int32 online_ivector_period = 0;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
     align_config.Register(&po);
+    sequencer_config.Register(&po);
     decodable_opts.Register(&po);
     po.Register("transition-scale", &transition_scale,
                 "Transition-probability scale [relative to acoustics]");
@@ -91,7 +197,9 @@ int main(int argc, char *argv[]) {
         alignment_wspecifier = po.GetArg(4),
         scores_wspecifier = po.GetOptArg(5);
 
-    int num_done = 0, num_err = 0, num_retry = 0;
+    // num_fail counts utterances that we didn't get as far as aligning;
+    // num_done, num_err and num_retry are updated by the alignment tasks.
+    int num_done = 0, num_err = 0, num_retry = 0, num_fail = 0;
     double tot_like = 0.0;
     kaldi::int64 frame_count = 0;
 
@@ -117,71 +225,88 @@ int main(int argc, char *argv[]) {
       BaseFloatWriter scores_writer(scores_wspecifier);
 
 
-      for (; !fst_reader.Done(); fst_reader.Next()) {
-        std::string utt = fst_reader.Key();
-        if (!feature_reader.HasKey(utt)) {
-          KALDI_WARN << "No features for utterance " << utt;
-          num_err++;
-          continue;
-        }
-        const Matrix<BaseFloat> &features = feature_reader.Value(utt);
-        VectorFst<StdArc> decode_fst(fst_reader.Value());
-        fst_reader.FreeCurrent();  // this stops copy-on-write of the fst
-        // by deleting the fst inside the reader, since we're about to mutate
-        // the fst by adding transition probs.
-
-        if (features.NumRows() == 0) {
-          KALDI_WARN << "Zero-length utterance: " << utt;
-          num_err++;
-          continue;
-        }
+      AlignOutputArgs align_args;
+      align_args.config = &align_config;
+      align_args.acoustic_scale = decodable_opts.acoustic_scale;
+      align_args.alignment_writer = &alignment_writer;
+      align_args.scores_writer = &scores_writer;
+      align_args.num_done = &num_done;
+      align_args.num_err = &num_err;
+      align_args.num_retry = &num_retry;
+      align_args.tot_like = &tot_like;
+      align_args.frame_count = &frame_count;
 
-        const Matrix<BaseFloat> *online_ivectors = NULL;
-        const Vector<BaseFloat> *ivector = NULL;
-        if (!ivector_rspecifier.empty()) {
-          if (!ivector_reader.HasKey(utt)) {
-            KALDI_WARN << "No iVector available for utterance " << utt;
-            num_err++;
+      // capacity 0 means that computations are never evicted from the cache,
+      // which is necessary as it is shared between threads.
+      CachingOptimizingCompiler compiler(am_nnet.GetNnet(),
+                                         decodable_opts.optimize_config, 0);
+      {
+        TaskSequencer<NnetAlignUtteranceClass> sequencer(sequencer_config);
+        for (; !fst_reader.Done(); fst_reader.Next()) {
+          std::string utt = fst_reader.Key();
+          if (!feature_reader.HasKey(utt)) {
+            KALDI_WARN << "No features for utterance " << utt;
+            num_fail++;
             continue;
-          } else {
-            ivector = &ivector_reader.Value(utt);
           }
-        }
-        if (!online_ivector_rspecifier.empty()) {
-          if (!online_ivector_reader.HasKey(utt)) {
-            KALDI_WARN << "No online iVector available for utterance " << utt;
-            num_err++;
+          const Matrix<BaseFloat> &features = feature_reader.Value(utt);
+          if (features.NumRows() == 0) {
+            KALDI_WARN << "Zero-length utterance: " << utt;
+            num_fail++;
             continue;
-          } else {
-            online_ivectors = &online_ivector_reader.Value(utt);
           }
-        }
 
-        {  // Add transition-probs to the FST.
-          std::vector<int32> disambig_syms;  // empty.
-          AddTransitionProbs(trans_model, disambig_syms,
-                             transition_scale, self_loop_scale,
-                             &decode_fst);
-        }
+          Vector<BaseFloat> *ivector = NULL;
+          Matrix<BaseFloat> *online_ivectors = NULL;
+          if (!ivector_rspecifier.empty()) {
+            if (!ivector_reader.HasKey(utt)) {
+              KALDI_WARN << "No iVector available for utterance " << utt;
+              num_fail++;
+              continue;
+            } else {
+              ivector = new Vector<BaseFloat>(ivector_reader.Value(utt));
+            }
+          }
+          if (!online_ivector_rspecifier.empty()) {
+            if (!online_ivector_reader.HasKey(utt)) {
+              KALDI_WARN << "No online iVector available for utterance " << utt;
+              num_fail++;
+              delete ivector;
+              continue;
+            } else {
+              online_ivectors = new Matrix<BaseFloat>(
+                  online_ivector_reader.Value(utt));
+            }
+          }
+
+          VectorFst<StdArc> *decode_fst = new VectorFst<StdArc>(
+              fst_reader.Value());
+          fst_reader.FreeCurrent();  // this stops copy-on-write of the fst
+          // by deleting the fst inside the reader, since we're about to
+          // mutate the fst by adding transition probs.
 
-        DecodableAmNnetSimple nnet_decodable(
-            decodable_opts, trans_model, am_nnet,
-            features, ivector, online_ivectors,
-            online_ivector_period);
-
-        AlignUtteranceWrapper(align_config, utt,
-                              decodable_opts.acoustic_scale,
-                              &decode_fst, &nnet_decodable,
-                              &alignment_writer, &scores_writer,
-                              &num_done, &num_err, &num_retry,
-                              &tot_like, &frame_count);
+          {  // Add transition-probs to the FST.
+            std::vector<int32> disambig_syms;  // empty.
+            AddTransitionProbs(trans_model, disambig_syms,
+                               transition_scale, self_loop_scale,
+                               decode_fst);
+          }
+
+          // takes ownership of decode_fst, the features and the iVectors.
+          sequencer.Run(new NnetAlignUtteranceClass(
+              decodable_opts, trans_model, am_nnet, &compiler, utt,
+              decode_fst, new Matrix<BaseFloat>(features), ivector,
+              online_ivectors, online_ivector_period, align_args));
+        }
+        sequencer.Wait();
       }
       KALDI_LOG << "Overall log-likelihood per frame is "
                 << (tot_like/frame_count)
                 << " over " << frame_count<< " frames.";
       KALDI_LOG << "Retried " << num_retry << " out of "
-                << (num_done + num_err) << " utterances.";
-      KALDI_LOG << "Done " << num_done << ", errors on " << num_err;
+                << (num_done + num_err + num_fail) << " utterances.";
+      KALDI_LOG << "Done " << num_done << ", errors on "
+                << (num_err + num_fail);
     }
     return (num_done != 0 ? 0 : 1);
   } catch(const std::exception &e) {
@@ -37,7 +37,9 @@ int main(int argc, char *argv[]) {
         "(the --learning-rate-factor option) and setting them all to supplied\n"
         "values (the --learning-rate and --learning-rates options),\n"
         "and supports replacing the raw nnet in the model (the Nnet)\n"
-        "with a provided raw nnet (the --set-raw-nnet option)\n"
+        "with a provided raw nnet (the --set-raw-nnet option), and converting\n"
+        "the affine components to 8-bit quantized form for inference\n"
+        "(the --quantize option)\n"
         "\n"
         "Usage:  nnet3-am-copy [options] <nnet-in> <nnet-out>\n"
         "e.g.:\n"
@@ -49,6 +51,7 @@ int main(int argc, char *argv[]) {
     BaseFloat learning_rate = -1;
     std::string set_raw_nnet = "";
     BaseFloat scale = 1.0;
+    bool quantize = false;
 
     ParseOptions po(usage);
     po.Register("binary", &binary_write, "Write output in binary mode");
@@ -63,6 +66,9 @@ int main(int argc, char *argv[]) {
                 " are set to this value.");
     po.Register("scale", &scale, "The parameter matrices are scaled"
                 " by the specified value.");
+    po.Register("quantize", &quantize, "If true, replace the affine "
+                "components with quantized versions (QuantizedAffineComponent) "
+                "that are only usable for inference.");
 
 
     po.Read(argc, argv);
@@ -96,6 +102,10 @@ int main(int argc, char *argv[]) {
     if (scale != 1.0)
       ScaleNnet(scale, &(am_nnet.GetNnet()));
 
+    if (quantize)
+      KALDI_LOG << "Quantized " << QuantizeAffineComponents(&(am_nnet.GetNnet()))
+                << " affine components.";
+
     if (raw) {
       WriteKaldiObject(am_nnet.GetNnet(), nnet_wxfilename, binary_write);
       KALDI_LOG << "Copied neural net from " << nnet_rxfilename
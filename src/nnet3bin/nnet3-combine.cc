@@ -33,6 +33,8 @@ int main(int argc, char *argv[]) {
         "Using a subset of training or held-out examples, compute an optimal combination of a\n"
         "number of nnet3 neural nets by maximizing the objective function.  See documentation of\n"
         "options for more details.  Inputs and outputs are 'raw' nnets.\n"
+        "With --num-threads > 1 (only without a GPU), the examples are divided\n"
+        "between threads when evaluating each candidate combination.\n"
         "\n"
         "Usage:  nnet3-combine [options] <nnet-in1> <nnet-in2> ... <nnet-inN> <valid-examples-in> <nnet-out>\n"
         "\n"
@@ -59,6 +61,9 @@ int main(int argc, char *argv[]) {
 
 #if HAVE_CUDA==1
     CuDevice::Instantiate().SelectGpuId(use_gpu);
+    if (CuDevice::Instantiate().Enabled() && combine_config.num_threads > 1)
+      KALDI_ERR << "--num-threads > 1 is not supported when using a GPU; "
+                << "use --use-gpu=no.";
 #endif
     
     std::string
@@ -20,6 +20,7 @@
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "nnet3/nnet-diagnostics.h"
+#include "nnet3/nnet-utils.h"
 
 
 int main(int argc, char *argv[]) {
@@ -34,6 +35,10 @@ int main(int argc, char *argv[]) {
         "the given data with an nnet3 neural net.  The input of this is the output of\n"
         "e.g. nnet3-get-egs | nnet3-merge-egs.\n"
         "\n"
+        "With --compare-quantized=true, it also computes it with a copy of the model\n"
+        "whose affine components are quantized (as by nnet3-copy --quantize=true), and\n"
+        "prints the difference in the objective function.\n"
+        "\n"
         "Usage:  nnet3-compute-prob [options] <raw-model-in> <training-examples-in>\n"
         "e.g.: nnet3-compute-prob 0.raw ark:valid.egs\n";
 
@@ -43,10 +48,14 @@ int main(int argc, char *argv[]) {
     // amount of data that a CPU can do it within reasonable time.
 
     NnetComputeProbOptions opts;
+    bool compare_quantized = false;
     
     ParseOptions po(usage);
 
     opts.Register(&po);
+    po.Register("compare-quantized", &compare_quantized, "If true, also "
+                "compute the objective with the affine components quantized "
+                "to 8 bits, and print the difference.");
     
     po.Read(argc, argv);
     
@@ -62,13 +71,41 @@ int main(int argc, char *argv[]) {
     ReadKaldiObject(raw_nnet_rxfilename, &nnet);
 
     NnetComputeProb prob_computer(opts, nnet);
+
+    Nnet quantized_nnet;
+    NnetComputeProb *quantized_prob_computer = NULL;
+    if (compare_quantized) {
+      quantized_nnet = nnet;
+      QuantizeAffineComponents(&quantized_nnet);
+      quantized_prob_computer = new NnetComputeProb(opts, quantized_nnet);
+    }
     
     SequentialNnetExampleReader example_reader(examples_rspecifier);
 
-    for (; !example_reader.Done(); example_reader.Next())
+    for (; !example_reader.Done(); example_reader.Next()) {
       prob_computer.Compute(example_reader.Value());
+      if (quantized_prob_computer != NULL)
+        quantized_prob_computer->Compute(example_reader.Value());
+    }
 
     bool ok = prob_computer.PrintTotalStats();
+
+    if (quantized_prob_computer != NULL) {
+      const SimpleObjectiveInfo *info = prob_computer.GetObjective("output"),
+          *quantized_info = quantized_prob_computer->GetObjective("output");
+      if (info != NULL && quantized_info != NULL && info->tot_weight > 0) {
+        double objf = info->tot_objective / info->tot_weight,
+            quantized_objf = quantized_info->tot_objective /
+            quantized_info->tot_weight;
+        KALDI_LOG << "Objective function for 'output' is " << objf
+                  << " per frame, and with quantized affine components is "
+                  << quantized_objf << ", a change of "
+                  << (quantized_objf - objf);
+      } else {
+        KALDI_WARN << "No objective function for 'output' to compare.";
+      }
+      delete quantized_prob_computer;
+    }
     
     return (ok ? 0 : 1);
   } catch(const std::exception &e) {
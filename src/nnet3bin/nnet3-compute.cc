@@ -24,6 +24,72 @@
 #include "nnet3/nnet-simple-computer.h"
 #include "base/timer.h"
 #include "nnet3/nnet-utils.h"
+#include "thread/kaldi-task-sequence.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// This class computes the output for one utterance, in operator (), and writes
+// it in its destructor.  With --num-threads > 1, the operator () of several of
+// these runs in parallel, while TaskSequencer calls the destructors in the
+// order of the input.
+class NnetComputeUtteranceClass {
+ public:
+  // Takes ownership of "features", "ivector" and "online_ivectors" (the last
+  // two may be NULL).  "compiler" is shared by all the tasks, so each
+  // computation is compiled only once.
+  NnetComputeUtteranceClass(const NnetSimpleComputerOptions &opts,
+                            const Nnet &nnet,
+                            CachingOptimizingCompiler *compiler,
+                            int32 left_context, int32 right_context,
+                            const std::string &utt,
+                            Matrix<BaseFloat> *features,
+                            Vector<BaseFloat> *ivector,
+                            Matrix<BaseFloat> *online_ivectors,
+                            int32 online_ivector_period,
+                            bool apply_exp,
+                            BaseFloatMatrixWriter *matrix_writer):
+      opts_(opts), nnet_(nnet), compiler_(compiler),
+      left_context_(left_context),
+      right_context_(right_context), utt_(utt), features_(features),
+      ivector_(ivector), online_ivectors_(online_ivectors),
+      online_ivector_period_(online_ivector_period), apply_exp_(apply_exp),
+      matrix_writer_(matrix_writer) { }
+
+  void operator () () {
+    NnetSimpleComputer nnet_computer(
+        opts_, nnet_, *features_, left_context_, right_context_,
+        ivector_, online_ivectors_, online_ivector_period_);
+    nnet_computer.SetSharedCompiler(compiler_);
+    nnet_computer.GetOutput(&output_);
+    if (apply_exp_)
+      output_.ApplyExp();
+  }
+
+  ~NnetComputeUtteranceClass() {
+    matrix_writer_->Write(utt_, output_);
+    delete features_;
+    delete ivector_;
+    delete online_ivectors_;
+  }
+ private:
+  const NnetSimpleComputerOptions &opts_;
+  const Nnet &nnet_;
+  CachingOptimizingCompiler *compiler_;
+  int32 left_context_;
+  int32 right_context_;
+  std::string utt_;
+  Matrix<BaseFloat> *features_;
+  Vector<BaseFloat> *ivector_;
+  Matrix<BaseFloat> *online_ivectors_;
+  int32 online_ivector_period_;
+  bool apply_exp_;
+  BaseFloatMatrixWriter *matrix_writer_;
+  Matrix<BaseFloat> output_;
+};
+
+} // namespace nnet3
+} // namespace kaldi
 
 
 int main(int argc, char *argv[]) {
@@ -38,6 +104,8 @@ int main(int argc, char *argv[]) {
         "and write the output.\n"
         "If --apply-exp=true, apply the Exp() function to the output "
         "before writing it out.\n"
+        "With --num-threads > 1 (only without a GPU), several utterances are\n"
+        "computed at the same time, sharing one copy of the model.\n"
         "\n"
         "Usage: nnet3-compute [options] <raw-nnet-in> <features-rspecifier> <matrix-wspecifier>\n"
         " e.g.: nnet3-compute final.raw scp:feats.scp ark:nnet_prediction.ark\n"
@@ -47,8 +115,9 @@ int main(int argc, char *argv[]) {
     Timer timer;
 
     NnetSimpleComputerOptions opts;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
 
-    bool apply_exp = false;
+    bool apply_exp = false, use_fp16 = false;
     std::string use_gpu = "yes";
 
     std::string word_syms_filename;
@@ -57,6 +126,7 @@ int main(int argc, char *argv[]) {
                 utt2spk_rspecifier;
     int32 online_ivector_period = 0;
     opts.Register(&po);
+    sequencer_config.Register(&po);
 
     po.Register("ivectors", &ivector_rspecifier, "Rspecifier for "
                 "iVectors as vectors (i.e. not estimated online); per utterance "
@@ -73,6 +143,10 @@ int main(int argc, char *argv[]) {
                 "output");
     po.Register("use-gpu", &use_gpu,
                 "yes|no|optional|wait, only has effect if compiled with CUDA");
+    po.Register("use-fp16", &use_fp16, "If true, store the parameters of "
+                "the affine components in half precision and do their matrix "
+                "multiplications with half-precision inputs (see "
+                "HalfPrecisionAffineComponent); only faster on a GPU.");
 
     po.Read(argc, argv);
 
@@ -83,6 +157,9 @@ int main(int argc, char *argv[]) {
 
 #if HAVE_CUDA==1
     CuDevice::Instantiate().SelectGpuId(use_gpu);
+    if (CuDevice::Instantiate().Enabled() && sequencer_config.num_threads > 1)
+      KALDI_ERR << "--num-threads > 1 is not supported when using a GPU; "
+                << "use --use-gpu=no.";
 #endif
 
     std::string nnet_rxfilename = po.GetArg(1),
@@ -91,6 +168,9 @@ int main(int argc, char *argv[]) {
 
     Nnet nnet;
     ReadKaldiObject(nnet_rxfilename, &nnet);
+    if (use_fp16)
+      KALDI_LOG << "Converted " << ConvertAffineComponentsToHalf(&nnet)
+                << " affine components to half precision.";
 
     RandomAccessBaseFloatMatrixReader online_ivector_reader(
         online_ivector_rspecifier);
@@ -107,6 +187,11 @@ int main(int argc, char *argv[]) {
     int32 left_context = 0, right_context = 0;
     ComputeSimpleNnetContext(nnet, &left_context, &right_context);
 
+    // capacity 0 means that computations are never evicted from the cache,
+    // which is necessary as it is shared between threads.
+    CachingOptimizingCompiler compiler(nnet, opts.optimize_config, 0);
+    TaskSequencer<NnetComputeUtteranceClass> sequencer(sequencer_config);
+
     for (; !feature_reader.Done(); feature_reader.Next()) {
       std::string utt = feature_reader.Key();
       const Matrix<BaseFloat> &features (feature_reader.Value());
@@ -136,24 +221,23 @@ int main(int argc, char *argv[]) {
         }
       }
 
-      NnetSimpleComputer nnet_computer(
-          opts, nnet,
-          features,
-          left_context, right_context,
-          ivector, online_ivectors,
-          online_ivector_period);
-
-      Matrix<BaseFloat> matrix;
-      nnet_computer.GetOutput(&matrix);
-
-      if (apply_exp)
-        matrix.ApplyExp();
-
-      matrix_writer.Write(utt, matrix);
-
       frame_count += features.NumRows();
       num_success++;
+
+      NnetComputeUtteranceClass *task = new NnetComputeUtteranceClass(
+          opts, nnet, &compiler, left_context, right_context, utt,
+          new Matrix<BaseFloat>(features),
+          (ivector ? new Vector<BaseFloat>(*ivector) : NULL),
+          (online_ivectors ? new Matrix<BaseFloat>(*online_ivectors) : NULL),
+          online_ivector_period, apply_exp, &matrix_writer);
+      if (sequencer_config.num_threads > 1) {
+        sequencer.Run(task);  // takes ownership of "task".
+      } else {
+        (*task)();
+        delete task;  // writes the output.
+      }
     }
+    sequencer.Wait();
 
     double elapsed = timer.Elapsed();
     KALDI_LOG << "Time taken "<< elapsed
@@ -161,6 +245,7 @@ int main(int argc, char *argv[]) {
               << (elapsed*100.0/frame_count);
     KALDI_LOG << "Done " << num_success << " utterances, failed for "
               << num_fail;
+    NnetComputeProfiler::Print();
 
     if (num_success != 0) return 0;
     else return 1;
@@ -34,20 +34,28 @@ int main(int argc, char *argv[]) {
     const char *usage =
         "Copy 'raw' nnet3 neural network to standard output\n"
         "Also supports setting all the learning rates to a value\n"
-        "(the --learning-rate option)\n"
+        "(the --learning-rate option), and converting the affine components\n"
+        "to 8-bit quantized form for faster CPU inference (the --quantize\n"
+        "option; see nnet3-compute-prob --compare-quantized for a way to\n"
+        "check the effect on the objective function)\n"
         "\n"
         "Usage:  nnet3-copy [options] <nnet-in> <nnet-out>\n"
         "e.g.:\n"
-        " nnet3-copy --binary=false 0.raw text.raw\n";
+        " nnet3-copy --binary=false 0.raw text.raw\n"
+        " nnet3-copy --quantize=true final.raw final_quantized.raw\n";
 
     bool binary_write = true;
     BaseFloat learning_rate = -1;
+    bool quantize = false;
     
     ParseOptions po(usage);
     po.Register("binary", &binary_write, "Write output in binary mode");
     po.Register("learning-rate", &learning_rate,
                 "If supplied, all the learning rates of updatable components"
                 "are set to this value.");
+    po.Register("quantize", &quantize, "If true, replace the affine "
+                "components with quantized versions (QuantizedAffineComponent) "
+                "that are only usable for inference.");
 
     po.Read(argc, argv);
     
@@ -65,6 +73,10 @@ int main(int argc, char *argv[]) {
     if (learning_rate >= 0)
       SetLearningRate(learning_rate, &nnet);
 
+    if (quantize)
+      KALDI_LOG << "Quantized " << QuantizeAffineComponents(&nnet)
+                << " affine components.";
+
     WriteKaldiObject(nnet, raw_nnet_wxfilename, binary_write);
     KALDI_LOG << "Copied raw neural net from " << raw_nnet_rxfilename
               << " to " << raw_nnet_wxfilename;
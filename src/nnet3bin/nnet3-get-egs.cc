@@ -25,6 +25,7 @@
 #include "hmm/transition-model.h"
 #include "hmm/posterior.h"
 #include "nnet3/nnet-example.h"
+#include "thread/kaldi-task-sequence.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -39,9 +40,8 @@ static void ProcessFile(const MatrixBase<BaseFloat> &feats,
                         int32 left_context,
                         int32 right_context,
                         int32 frames_per_eg,
-                        int64 *num_frames_written,
-                        int64 *num_egs_written,
-                        NnetExampleWriter *example_writer) {
+                        int64 *num_frames,
+                        std::vector<std::pair<std::string, NnetExample> > *egs) {
   KALDI_ASSERT(feats.NumRows() == static_cast<int32>(pdf_post.size()));
   
   for (int32 t = 0; t < feats.NumRows(); t += frames_per_eg) {
@@ -68,8 +68,12 @@ static void ProcessFile(const MatrixBase<BaseFloat> &feats,
       dest.CopyFromVec(src);
     }
 
-    NnetExample eg;
-    
+    std::ostringstream os;
+    os << utt_id << "-" << t;
+    egs->resize(egs->size() + 1);
+    egs->back().first = os.str(); // key is <utt_id>-<frame_id>
+    NnetExample &eg = egs->back().second;
+
     // call the regular input "input".
     eg.io.push_back(NnetIo("input", - left_context,
                            input_frames));
@@ -96,18 +100,78 @@ static void ProcessFile(const MatrixBase<BaseFloat> &feats,
     
     if (compress)
       eg.Compress();
-      
-    std::ostringstream os;
-    os << utt_id << "-" << t;
 
-    std::string key = os.str(); // key is <utt_id>-<frame_id>
+    *num_frames += actual_frames_per_eg;
+  }
+}
 
-    *num_frames_written += actual_frames_per_eg;
-    *num_egs_written += 1;
+// This class creates the examples for one utterance, in operator (), and
+// writes them in its destructor.  With --num-threads > 1, the operator () of
+// several of these runs in parallel (the splicing and compression are the
+// expensive part), while TaskSequencer calls the destructors in the order of
+// the input.  The examples are assigned to the output archives in rotation.
+class NnetGetEgsUtteranceClass {
+ public:
+  // Takes ownership of "feats", "ivector_feats" (which may be NULL) and
+  // "pdf_post".
+  NnetGetEgsUtteranceClass(const std::string &utt_id,
+                           Matrix<BaseFloat> *feats,
+                           Matrix<BaseFloat> *ivector_feats,
+                           Posterior *pdf_post,
+                           bool compress, int32 num_pdfs,
+                           int32 left_context, int32 right_context,
+                           int32 frames_per_eg,
+                           int64 *num_frames_written,
+                           int64 *num_egs_written,
+                           std::vector<NnetExampleWriter*> *example_writers):
+      utt_id_(utt_id), feats_(feats), ivector_feats_(ivector_feats),
+      pdf_post_(pdf_post), compress_(compress), num_pdfs_(num_pdfs),
+      left_context_(left_context), right_context_(right_context),
+      frames_per_eg_(frames_per_eg), num_frames_(0),
+      num_frames_written_(num_frames_written),
+      num_egs_written_(num_egs_written), example_writers_(example_writers) { }
 
-    example_writer->Write(key, eg);
+  void operator () () {
+    ProcessFile(*feats_, ivector_feats_, *pdf_post_, utt_id_, compress_,
+                num_pdfs_, left_context_, right_context_, frames_per_eg_,
+                &num_frames_, &egs_);
+    // free the inputs now, as the destructor may not be called for a while.
+    delete feats_;
+    feats_ = NULL;
+    delete ivector_feats_;
+    ivector_feats_ = NULL;
+    delete pdf_post_;
+    pdf_post_ = NULL;
   }
-}
+
+  ~NnetGetEgsUtteranceClass() {
+    int32 num_writers = example_writers_->size();
+    for (size_t i = 0; i < egs_.size(); i++) {
+      int32 w = *num_egs_written_ % num_writers;
+      (*example_writers_)[w]->Write(egs_[i].first, egs_[i].second);
+      (*num_egs_written_)++;
+    }
+    *num_frames_written_ += num_frames_;
+    delete feats_;
+    delete ivector_feats_;
+    delete pdf_post_;
+  }
+ private:
+  std::string utt_id_;
+  Matrix<BaseFloat> *feats_;
+  Matrix<BaseFloat> *ivector_feats_;
+  Posterior *pdf_post_;
+  bool compress_;
+  int32 num_pdfs_;
+  int32 left_context_;
+  int32 right_context_;
+  int32 frames_per_eg_;
+  int64 num_frames_;
+  int64 *num_frames_written_;
+  int64 *num_egs_written_;
+  std::vector<NnetExampleWriter*> *example_writers_;
+  std::vector<std::pair<std::string, NnetExample> > egs_;
+};
 
 
 } // namespace nnet2
@@ -129,9 +193,13 @@ int main(int argc, char *argv[]) {
         "do different things they may have to extend this program or create\n"
         "different versions of it for different tasks (the egs format is quite\n"
         "general)\n"
+        "If more than one <egs-out> is given, the examples are written to them\n"
+        "in rotation, which saves reading the features more than once when\n"
+        "several archives are wanted; and with --num-threads > 1, several\n"
+        "utterances are processed in parallel.\n"
         "\n"
         "Usage:  nnet3-get-egs [options] <features-rspecifier> "
-        "<pdf-post-rspecifier> <egs-out>\n"
+        "<pdf-post-rspecifier> <egs-out1> [<egs-out2> ...]\n"
         "\n"
         "An example [where $feats expands to the actual features]:\n"
         "nnet-get-egs --num-pdfs=2658 --left-context=12 --right-context=9 --num-frames=8 \"$feats\"\\\n"
@@ -144,7 +212,8 @@ int main(int argc, char *argv[]) {
         num_frames = 1, length_tolerance = 100;
         
     std::string ivector_rspecifier;
-    
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+
     ParseOptions po(usage);
     po.Register("compress", &compress, "If true, write egs in "
                 "compressed format.");
@@ -160,10 +229,11 @@ int main(int argc, char *argv[]) {
                 "features, as matrix.");
     po.Register("length-tolerance", &length_tolerance, "Tolerance for "
                 "difference in num-frames between feat and ivector matrices");
-    
+    sequencer_config.Register(&po);
+
     po.Read(argc, argv);
 
-    if (po.NumArgs() != 3) {
+    if (po.NumArgs() < 3) {
       po.PrintUsage();
       exit(1);
     }
@@ -173,18 +243,21 @@ int main(int argc, char *argv[]) {
     
 
     std::string feature_rspecifier = po.GetArg(1),
-        pdf_post_rspecifier = po.GetArg(2),
-        examples_wspecifier = po.GetArg(3);
+        pdf_post_rspecifier = po.GetArg(2);
 
     // Read in all the training files.
     SequentialBaseFloatMatrixReader feat_reader(feature_rspecifier);
     RandomAccessPosteriorReader pdf_post_reader(pdf_post_rspecifier);
-    NnetExampleWriter example_writer(examples_wspecifier);
+    std::vector<NnetExampleWriter*> example_writers;
+    for (int32 i = 3; i <= po.NumArgs(); i++)
+      example_writers.push_back(new NnetExampleWriter(po.GetArg(i)));
     RandomAccessBaseFloatMatrixReader ivector_reader(ivector_rspecifier);
     
     int32 num_done = 0, num_err = 0;
     int64 num_frames_written = 0, num_egs_written = 0;
-    
+
+    TaskSequencer<NnetGetEgsUtteranceClass> sequencer(sequencer_config);
+
     for (; !feat_reader.Done(); feat_reader.Next()) {
       std::string key = feat_reader.Key();
       const Matrix<BaseFloat> &feats = feat_reader.Value();
@@ -222,13 +295,25 @@ int main(int argc, char *argv[]) {
           continue;
         }
           
-        ProcessFile(feats, ivector_feats, pdf_post, key, compress,
-                    num_pdfs, left_context, right_context, num_frames,
-                    &num_frames_written, &num_egs_written,
-                    &example_writer);
+        NnetGetEgsUtteranceClass *task = new NnetGetEgsUtteranceClass(
+            key, new Matrix<BaseFloat>(feats),
+            (ivector_feats ? new Matrix<BaseFloat>(*ivector_feats) : NULL),
+            new Posterior(pdf_post), compress, num_pdfs, left_context,
+            right_context, num_frames, &num_frames_written, &num_egs_written,
+            &example_writers);
+        if (sequencer_config.num_threads > 1) {
+          sequencer.Run(task);  // takes ownership of "task".
+        } else {
+          (*task)();
+          delete task;  // writes the examples.
+        }
         num_done++;
       }
     }
+    sequencer.Wait();  // the examples must all be written before we close
+                       // the writers.
+    for (size_t i = 0; i < example_writers.size(); i++)
+      delete example_writers[i];
 
     KALDI_LOG << "Finished generating examples, "
               << "successfully processed " << num_done
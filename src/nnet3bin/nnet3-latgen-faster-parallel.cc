@@ -0,0 +1,381 @@
+// nnet3bin/nnet3-latgen-faster-parallel.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "fstext/fstext-lib.h"
+#include "decoder/decoder-wrappers.h"
+#include "decoder/decodable-matrix.h"
+#include "nnet3/nnet-am-decodable-simple.h"
+#include "thread/kaldi-task-sequence.h"
+#include "thread/kaldi-numa.h"
+#include "base/timer.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// The arguments to the constructor of DecodeUtteranceLatticeFasterClass that
+// are the same for all utterances.
+struct DecodeOutputArgs {
+  const TransitionModel *trans_model;
+  const fst::SymbolTable *word_syms;
+  BaseFloat acoustic_scale;
+  bool determinize;
+  bool allow_partial;
+  Int32VectorWriter *alignments_writer;
+  Int32VectorWriter *words_writer;
+  CompactLatticeWriter *compact_lattice_writer;
+  LatticeWriter *lattice_writer;
+  double *like_sum;
+  int64 *frame_sum;
+  int32 *num_done;
+  int32 *num_err;
+  int32 *num_partial;
+};
+
+/**
+   This class computes the scaled acoustic log-likelihoods for one utterance
+   (in operator (), which runs in one of the neural-net threads), and then, in
+   its destructor (which the TaskSequencer calls in the order of the input),
+   gives them to a decoding task that runs in one of the decoder threads.
+   This way the neural-net computation of some utterances overlaps with the
+   decoding of others, and each part has its own pool of threads.  All tasks
+   share the model and (if there is only one) the decoding graph.
+   If the decoder threads are all busy, the destructor waits, which stops the
+   neural-net threads from getting too far ahead.
+ */
+class NnetComputeForDecodingClass {
+ public:
+  // Takes ownership of "features", "ivector", "online_ivectors" and
+  // "decoder" ("ivector" and "online_ivectors" may be NULL).  "compiler" is
+  // shared by all the tasks, so each computation is compiled only once.
+  NnetComputeForDecodingClass(
+      const DecodableAmNnetSimpleOptions &opts,
+      const AmNnetSimple &am_nnet,
+      CachingOptimizingCompiler *compiler,
+      const std::string &utt,
+      Matrix<BaseFloat> *features,
+      Vector<BaseFloat> *ivector,
+      Matrix<BaseFloat> *online_ivectors,
+      int32 online_ivector_period,
+      LatticeFasterDecoder *decoder,
+      const DecodeOutputArgs &decode_args,
+      TaskSequencer<DecodeUtteranceLatticeFasterClass> *decode_sequencer):
+      opts_(opts), am_nnet_(am_nnet), compiler_(compiler), utt_(utt),
+      features_(features), ivector_(ivector),
+      online_ivectors_(online_ivectors),
+      online_ivector_period_(online_ivector_period), decoder_(decoder),
+      decode_args_(decode_args), decode_sequencer_(decode_sequencer),
+      loglikes_(new Matrix<BaseFloat>()) { }
+
+  void operator () () {
+    DecodableAmNnetSimple nnet_decodable(
+        opts_, *decode_args_.trans_model, am_nnet_, *features_, ivector_,
+        online_ivectors_, online_ivector_period_);
+    nnet_decodable.SetSharedCompiler(compiler_);
+    // The output already has the priors and the acoustic scale applied.
+    nnet_decodable.GetOutput(loglikes_);
+  }
+
+  ~NnetComputeForDecodingClass() {
+    delete features_;
+    delete ivector_;
+    delete online_ivectors_;
+    // The decodable object takes ownership of loglikes_, and the decoding
+    // task takes ownership of the decodable object and of decoder_.
+    DecodableMatrixScaledMapped *decodable =
+        new DecodableMatrixScaledMapped(*decode_args_.trans_model, 1.0,
+                                        loglikes_);
+    const DecodeOutputArgs &a = decode_args_;
+    decode_sequencer_->Run(new DecodeUtteranceLatticeFasterClass(
+        decoder_, decodable, *a.trans_model, a.word_syms, utt_,
+        a.acoustic_scale, a.determinize, a.allow_partial,
+        a.alignments_writer, a.words_writer, a.compact_lattice_writer,
+        a.lattice_writer, a.like_sum, a.frame_sum, a.num_done, a.num_err,
+        a.num_partial));
+  }
+
+ private:
+  const DecodableAmNnetSimpleOptions &opts_;
+  const AmNnetSimple &am_nnet_;
+  CachingOptimizingCompiler *compiler_;
+  std::string utt_;
+  Matrix<BaseFloat> *features_;
+  Vector<BaseFloat> *ivector_;
+  Matrix<BaseFloat> *online_ivectors_;
+  int32 online_ivector_period_;
+  LatticeFasterDecoder *decoder_;
+  const DecodeOutputArgs &decode_args_;
+  TaskSequencer<DecodeUtteranceLatticeFasterClass> *decode_sequencer_;
+  Matrix<BaseFloat> *loglikes_;
+};
+
+} // namespace nnet3
+} // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+    using fst::SymbolTable;
+    using fst::VectorFst;
+    using fst::StdArc;
+
+    const char *usage =
+        "Generate lattices using nnet3 neural net model, using multiple\n"
+        "threads on the CPU: --num-threads threads do the neural-net\n"
+        "computation and pass the log-likelihoods to --num-decoder-threads\n"
+        "decoding threads, one utterance at a time.  The model and the\n"
+        "decoding graph are shared by all threads.  The interface and output\n"
+        "are otherwise the same as nnet3-latgen-faster.\n"
+        "Usage: nnet3-latgen-faster-parallel [options] <nnet-in> <fst-in|fsts-rspecifier> <features-rspecifier>"
+        " <lattice-wspecifier> [ <words-wspecifier> [<alignments-wspecifier>] ]\n";
+    ParseOptions po(usage);
+    Timer timer;
+    bool allow_partial = false;
+    LatticeFasterDecoderConfig config;
+    DecodableAmNnetSimpleOptions decodable_opts;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+    int32 num_decoder_threads = 0;
+    std::string numa_policy = "none";
+
+    std::string word_syms_filename;
+    std::string ivector_rspecifier,
+        online_ivector_rspecifier,
+        utt2spk_rspecifier;
+    int32 online_ivector_period = 0;
+    config.Register(&po);
+    decodable_opts.Register(&po);
+    sequencer_config.Register(&po);
+    po.Register("num-decoder-threads", &num_decoder_threads, "Number of "
+                "decoding threads; if <= 0, the same as --num-threads.");
+    po.Register("word-symbol-table", &word_syms_filename,
+                "Symbol table for words [for debug output]");
+    po.Register("allow-partial", &allow_partial,
+                "If true, produce output even if end state was not reached.");
+    po.Register("ivectors", &ivector_rspecifier, "Rspecifier for "
+                "iVectors as vectors (i.e. not estimated online); per utterance "
+                "by default, or per speaker if you provide the --utt2spk option.");
+    po.Register("utt2spk", &utt2spk_rspecifier, "Rspecifier for "
+                "utt2spk option used to get ivectors per speaker");
+    po.Register("online-ivectors", &online_ivector_rspecifier, "Rspecifier for "
+                "iVectors estimated online, as matrices.  If you supply this,"
+                " you must set the --online-ivector-period option.");
+    po.Register("online-ivector-period", &online_ivector_period, "Number of frames "
+                "between iVectors in matrices supplied to the --online-ivectors "
+                "option");
+    po.Register("numa-policy", &numa_policy,
+                "Placement of threads on NUMA machines: \"none\" or \"pin\" "
+                "(pin the threads to the nodes).");
+
+    po.Read(argc, argv);
+    if (numa_policy == "replicate") {
+      // TaskSequencer can't send a task to a particular node, so a copy of
+      // the model per node would be no use.
+      KALDI_WARN << "--numa-policy=replicate is not supported by this program; "
+                 << "using --numa-policy=pin.";
+      numa_policy = "pin";
+    }
+    SetNumaPolicy(numa_policy);
+
+    if (po.NumArgs() < 4 || po.NumArgs() > 6) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string model_in_filename = po.GetArg(1),
+        fst_in_str = po.GetArg(2),
+        feature_rspecifier = po.GetArg(3),
+        lattice_wspecifier = po.GetArg(4),
+        words_wspecifier = po.GetOptArg(5),
+        alignment_wspecifier = po.GetOptArg(6);
+
+    TransitionModel trans_model;
+    AmNnetSimple am_nnet;
+    {
+      bool binary;
+      Input ki(model_in_filename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+    }
+
+    bool determinize = config.determinize_lattice;
+    CompactLatticeWriter compact_lattice_writer;
+    LatticeWriter lattice_writer;
+    if (! (determinize ? compact_lattice_writer.Open(lattice_wspecifier)
+           : lattice_writer.Open(lattice_wspecifier)))
+      KALDI_ERR << "Could not open table for writing lattices: "
+                 << lattice_wspecifier;
+
+    RandomAccessBaseFloatMatrixReader online_ivector_reader(
+        online_ivector_rspecifier);
+    RandomAccessBaseFloatVectorReaderMapped ivector_reader(
+        ivector_rspecifier, utt2spk_rspecifier);
+
+    Int32VectorWriter words_writer(words_wspecifier);
+    Int32VectorWriter alignment_writer(alignment_wspecifier);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (word_syms_filename != "")
+      if (!(word_syms = fst::SymbolTable::ReadText(word_syms_filename)))
+        KALDI_ERR << "Could not read symbol table from file "
+                   << word_syms_filename;
+
+    double tot_like = 0.0;
+    kaldi::int64 frame_count = 0;
+    // num_fail counts utterances that we didn't get as far as decoding;
+    // num_done and num_err are updated by the decoding tasks.
+    int32 num_done = 0, num_err = 0, num_fail = 0;
+
+    DecodeOutputArgs decode_args;
+    decode_args.trans_model = &trans_model;
+    decode_args.word_syms = word_syms;
+    decode_args.acoustic_scale = decodable_opts.acoustic_scale;
+    decode_args.determinize = determinize;
+    decode_args.allow_partial = allow_partial;
+    decode_args.alignments_writer = &alignment_writer;
+    decode_args.words_writer = &words_writer;
+    decode_args.compact_lattice_writer = &compact_lattice_writer;
+    decode_args.lattice_writer = &lattice_writer;
+    decode_args.like_sum = &tot_like;
+    decode_args.frame_sum = &frame_count;
+    decode_args.num_done = &num_done;
+    decode_args.num_err = &num_err;
+    decode_args.num_partial = NULL;
+
+    TaskSequencerConfig decode_sequencer_config;
+    decode_sequencer_config.num_threads = (num_decoder_threads > 0 ?
+                                           num_decoder_threads :
+                                           sequencer_config.num_threads);
+
+    VectorFst<StdArc> *decode_fst = NULL;  // only used if there is a single
+                                           // decoding graph.
+    // capacity 0 means that computations are never evicted from the cache,
+    // which is necessary as it is shared between threads.
+    CachingOptimizingCompiler compiler(am_nnet.GetNnet(),
+                                       decodable_opts.optimize_config, 0);
+    {
+      // decode_sequencer must be destroyed after sequencer, because the
+      // tasks of "sequencer" give it tasks when they are deleted.
+      TaskSequencer<DecodeUtteranceLatticeFasterClass> decode_sequencer(
+          decode_sequencer_config);
+      TaskSequencer<NnetComputeForDecodingClass> sequencer(sequencer_config);
+
+      bool single_fst =
+          (ClassifyRspecifier(fst_in_str, NULL, NULL) == kNoRspecifier);
+      SequentialBaseFloatMatrixReader feature_reader;
+      RandomAccessBaseFloatMatrixReader random_feature_reader;
+      SequentialTableReader<fst::VectorFstHolder> fst_reader;
+      if (single_fst) {
+        if (!feature_reader.Open(feature_rspecifier))
+          KALDI_ERR << "Error opening features " << feature_rspecifier;
+        decode_fst = fst::ReadFstKaldi(fst_in_str);
+      } else {
+        // We have different FSTs for different utterances.
+        if (!fst_reader.Open(fst_in_str))
+          KALDI_ERR << "Error opening FSTs " << fst_in_str;
+        if (!random_feature_reader.Open(feature_rspecifier))
+          KALDI_ERR << "Error opening features " << feature_rspecifier;
+      }
+
+      while (single_fst ? !feature_reader.Done() : !fst_reader.Done()) {
+        std::string utt = (single_fst ? feature_reader.Key() :
+                           fst_reader.Key());
+        Matrix<BaseFloat> *features = NULL;
+        if (single_fst) {
+          features = new Matrix<BaseFloat>(feature_reader.Value());
+          feature_reader.FreeCurrent();
+        } else if (random_feature_reader.HasKey(utt)) {
+          features = new Matrix<BaseFloat>(random_feature_reader.Value(utt));
+        } else {
+          KALDI_WARN << "Not decoding utterance " << utt
+                     << " because no features available.";
+        }
+        Vector<BaseFloat> *ivector = NULL;
+        Matrix<BaseFloat> *online_ivectors = NULL;
+        bool ok = (features != NULL);
+        if (ok && features->NumRows() == 0) {
+          KALDI_WARN << "Zero-length utterance: " << utt;
+          ok = false;
+        }
+        if (ok && !ivector_rspecifier.empty()) {
+          if (!ivector_reader.HasKey(utt)) {
+            KALDI_WARN << "No iVector available for utterance " << utt;
+            ok = false;
+          } else {
+            ivector = new Vector<BaseFloat>(ivector_reader.Value(utt));
+          }
+        }
+        if (ok && !online_ivector_rspecifier.empty()) {
+          if (!online_ivector_reader.HasKey(utt)) {
+            KALDI_WARN << "No online iVector available for utterance " << utt;
+            ok = false;
+          } else {
+            online_ivectors = new Matrix<BaseFloat>(
+                online_ivector_reader.Value(utt));
+          }
+        }
+        if (ok) {
+          LatticeFasterDecoder *decoder =
+              (single_fst ? new LatticeFasterDecoder(*decode_fst, config) :
+               // the decoder takes ownership of the new FST object.
+               new LatticeFasterDecoder(
+                   config, new VectorFst<StdArc>(fst_reader.Value())));
+          // takes ownership of the features, iVectors and decoder.
+          sequencer.Run(new NnetComputeForDecodingClass(
+              decodable_opts, am_nnet, &compiler, utt, features, ivector,
+              online_ivectors, online_ivector_period, decoder, decode_args,
+              &decode_sequencer));
+        } else {
+          delete features;
+          delete ivector;
+          delete online_ivectors;
+          num_fail++;
+        }
+        if (single_fst) feature_reader.Next();
+        else fst_reader.Next();
+      }
+      sequencer.Wait();
+      decode_sequencer.Wait();
+    }
+    delete decode_fst; // delete this only after the decoders are deleted.
+
+    double elapsed = timer.Elapsed();
+    KALDI_LOG << "Time taken "<< elapsed
+              << "s: real-time factor assuming 100 frames/sec is "
+              << (elapsed*100.0/frame_count);
+    KALDI_LOG << "Done " << num_done << " utterances, failed for "
+              << (num_err + num_fail);
+    NnetComputeProfiler::Print();
+    KALDI_LOG << "Overall log-likelihood per frame is " << (tot_like/frame_count) << " over "
+              << frame_count<<" frames.";
+
+    delete word_syms;
+    if (num_done != 0) return 0;
+    else return 1;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -25,8 +25,80 @@
 #include "hmm/transition-model.h"
 #include "fstext/fstext-lib.h"
 #include "decoder/decoder-wrappers.h"
+#include "decoder/decoder-search-stats.h"
 #include "nnet3/nnet-am-decodable-simple.h"
+#include "nnet3/decodable-sparse-output.h"
+#include "nnet3/nnet-utils.h"
 #include "base/timer.h"
+#include "thread/kaldi-task-pipeline.h"
+
+
+namespace kaldi {
+namespace nnet3 {
+
+// The decoding of one utterance, for TaskPipeline.  Stage 0 runs the neural
+// net and the decoder, and stage 1 (if there is one) determinizes the
+// lattice; the output is done by the destructor.  It keeps its own copies of
+// the features and iVectors, as the table readers' copies may have changed
+// by the time it runs.
+class DecodeUtteranceTask {
+ public:
+  DecodeUtteranceTask(const std::string &utt,
+                      const Matrix<BaseFloat> &features,
+                      const Vector<BaseFloat> *ivector,
+                      const Matrix<BaseFloat> *online_ivectors,
+                      int32 num_stages,
+                      DecoderSearchStats *search_stats,
+                      int64 *frame_count,
+                      int32 *num_success):
+      utt_(utt), features_(features),
+      ivector_(ivector != NULL ? new Vector<BaseFloat>(*ivector) : NULL),
+      online_ivectors_(online_ivectors != NULL ?
+                       new Matrix<BaseFloat>(*online_ivectors) : NULL),
+      num_stages_(num_stages), search_stats_(search_stats),
+      frame_count_(frame_count), num_success_(num_success), task_(NULL) { }
+
+  const Matrix<BaseFloat> &Features() const { return features_; }
+  const Vector<BaseFloat> *Ivector() const { return ivector_; }
+  const Matrix<BaseFloat> *OnlineIvectors() const { return online_ivectors_; }
+
+  // Takes ownership of "task", which should use Features() etc.
+  void SetTask(DecodeUtteranceLatticeFasterClass *task) { task_ = task; }
+
+  void RunStage(int32 stage) {
+    task_->RunStage(stage);
+    if (stage == 0) {
+      // Stage 0 has one thread, so this sees the utterances in order.
+      if (search_stats_ != NULL)
+        search_stats_->EndUtterance(utt_);
+      if (num_stages_ == 1)
+        task_->RunStage(1);
+    }
+  }
+
+  ~DecodeUtteranceTask() {
+    int32 num_success = *num_success_;
+    delete task_;  // does the output.
+    if (*num_success_ != num_success)
+      *frame_count_ += features_.NumRows();
+    delete ivector_;
+    delete online_ivectors_;
+  }
+
+ private:
+  std::string utt_;
+  Matrix<BaseFloat> features_;
+  Vector<BaseFloat> *ivector_;
+  Matrix<BaseFloat> *online_ivectors_;
+  int32 num_stages_;
+  DecoderSearchStats *search_stats_;
+  int64 *frame_count_;
+  int32 *num_success_;
+  DecodeUtteranceLatticeFasterClass *task_;
+};
+
+}  // namespace nnet3
+}  // namespace kaldi
 
 
 int main(int argc, char *argv[]) {
@@ -51,11 +123,14 @@ int main(int argc, char *argv[]) {
     LatticeFasterDecoderConfig config;
     DecodableAmNnetSimpleOptions decodable_opts;
 
-    std::string word_syms_filename;
+    std::string word_syms_filename, search_stats_wxfilename, computation_cache;
     std::string ivector_rspecifier,
         online_ivector_rspecifier,
         utt2spk_rspecifier;
     int32 online_ivector_period = 0;
+    int32 determinize_threads = 0, sparse_output_normalizer_rank = 0;
+    bool use_fp16 = false, precompile = false, sparse_output = false;
+    std::string use_gpu = "no";
     config.Register(&po);
     decodable_opts.Register(&po);
     po.Register("word-symbol-table", &word_syms_filename,
@@ -72,6 +147,39 @@ int main(int argc, char *argv[]) {
                 "between iVectors in matrices supplied to the --online-ivectors "
                 "option");
 
+    po.Register("search-stats-json", &search_stats_wxfilename, "If set, "
+                "write statistics of the search (active tokens, arcs expanded, "
+                "adaptive beam, etc., per frame and per utterance) to this file "
+                "in JSON format.");
+    po.Register("use-gpu", &use_gpu,
+                "yes|no|optional|wait, only has effect if compiled with CUDA");
+    po.Register("use-fp16", &use_fp16, "If true, store the parameters of "
+                "the affine components in half precision and do their matrix "
+                "multiplications with half-precision inputs (see "
+                "HalfPrecisionAffineComponent); only faster on a GPU.");
+    po.Register("determinize-threads", &determinize_threads, "If > 0, "
+                "lattice determinization is done by this many separate "
+                "threads, overlapping with the decoding of the following "
+                "utterances.  (In any case, the decoding is done in a thread "
+                "of its own, overlapping with the reading of the input).");
+    po.Register("precompile", &precompile, "If true, compile the "
+                "computations for all the chunk sizes (1 to --frames-per-chunk) "
+                "at startup, instead of when they are first needed, so that "
+                "the latency of the first utterances is predictable.");
+    po.Register("computation-cache", &computation_cache, "If set, the "
+                "compiled computations are read from this file at startup (if "
+                "it exists and matches the model), and written to it at the "
+                "end, to save compilation time in later runs.");
+    po.Register("sparse-output", &sparse_output, "If true, only compute the "
+                "outputs of the final affine layer that the decoder asks for "
+                "(see NnetSparseOutputInfo); faster on CPU for large output "
+                "layers.  With a log-softmax, the normalizer is left out "
+                "unless --sparse-output-normalizer-rank > 0, which changes the "
+                "acoustic costs in the lattices but not the best paths.");
+    po.Register("sparse-output-normalizer-rank", &sparse_output_normalizer_rank,
+                "With --sparse-output=true, if > 0, approximate the "
+                "log-softmax normalizer with a final layer of this rank.");
+
     po.Read(argc, argv);
 
     if (po.NumArgs() < 4 || po.NumArgs() > 6) {
@@ -86,6 +194,10 @@ int main(int argc, char *argv[]) {
         words_wspecifier = po.GetOptArg(5),
         alignment_wspecifier = po.GetOptArg(6);
 
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().SelectGpuId(use_gpu);
+#endif
+
     TransitionModel trans_model;
     AmNnetSimple am_nnet;
     {
@@ -94,6 +206,10 @@ int main(int argc, char *argv[]) {
       trans_model.Read(ki.Stream(), binary);
       am_nnet.Read(ki.Stream(), binary);
     }
+    if (use_fp16)
+      KALDI_LOG << "Converted "
+                << ConvertAffineComponentsToHalf(&(am_nnet.GetNnet()))
+                << " affine components to half precision.";
 
     bool determinize = config.determinize_lattice;
     CompactLatticeWriter compact_lattice_writer;
@@ -117,125 +233,151 @@ int main(int argc, char *argv[]) {
         KALDI_ERR << "Could not read symbol table from file "
                    << word_syms_filename;
 
+    NnetSparseOutputInfo *sparse_info = NULL;
+    if (sparse_output)
+      sparse_info = new NnetSparseOutputInfo(am_nnet.GetNnet(),
+                                             sparse_output_normalizer_rank);
+
+    // All the utterances get their computations from this compiler, so each
+    // chunk size is compiled only once.  capacity 0 means that computations
+    // are never evicted, which is necessary as it is shared.
+    CachingOptimizingCompiler compiler(sparse_info != NULL ?
+                                       sparse_info->GetNnet() :
+                                       am_nnet.GetNnet(),
+                                       decodable_opts.simple_computer_opts.
+                                       optimize_config, 0);
+    if (!computation_cache.empty()) {
+      bool binary;
+      Input ki;
+      if (ki.Open(computation_cache, &binary))
+        compiler.ReadCache(ki.Stream(), binary);
+    }
+    if (precompile) {
+      Timer precompile_timer;
+      bool use_ivector = (!ivector_rspecifier.empty() ||
+                          !online_ivector_rspecifier.empty());
+      PrecompileSimpleComputations(decodable_opts.simple_computer_opts,
+                                   am_nnet.LeftContext(),
+                                   am_nnet.RightContext(), use_ivector,
+                                   &compiler);
+      KALDI_LOG << "Precompiled the computations for chunks of up to "
+                << decodable_opts.simple_computer_opts.frames_per_chunk
+                << " frames, in " << precompile_timer.Elapsed() << " seconds.";
+    }
+
     double tot_like = 0.0;
     kaldi::int64 frame_count = 0;
+    DecoderSearchStats search_stats;
     int num_success = 0, num_fail = 0;
 
-    if (ClassifyRspecifier(fst_in_str, NULL, NULL) == kNoRspecifier) {
-      SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
-
-      // Input FST is just one FST, not a table of FSTs.
-      VectorFst<StdArc> *decode_fst = fst::ReadFstKaldi(fst_in_str);
-
-      {
-        LatticeFasterDecoder decoder(*decode_fst, config);
-
-        for (; !feature_reader.Done(); feature_reader.Next()) {
-          std::string utt = feature_reader.Key();
-          const Matrix<BaseFloat> &features (feature_reader.Value());
-          if (features.NumRows() == 0) {
-            KALDI_WARN << "Zero-length utterance: " << utt;
-            num_fail++;
-            continue;
-          }
-          const Matrix<BaseFloat> *online_ivectors = NULL;
-          const Vector<BaseFloat> *ivector = NULL;
-          if (!ivector_rspecifier.empty()) {
-            if (!ivector_reader.HasKey(utt)) {
-              KALDI_WARN << "No iVector available for utterance " << utt;
-              num_fail++;
-              continue;
-            } else {
-              ivector = &ivector_reader.Value(utt);
-            }
-          }
-          if (!online_ivector_rspecifier.empty()) {
-            if (!online_ivector_reader.HasKey(utt)) {
-              KALDI_WARN << "No online iVector available for utterance " << utt;
-              num_fail++;
-              continue;
-            } else {
-              online_ivectors = &online_ivector_reader.Value(utt);
-            }
-          }
-
-          DecodableAmNnetSimple nnet_decodable(
-              decodable_opts, trans_model, am_nnet,
-              features, ivector, online_ivectors,
-              online_ivector_period);
-
-          double like;
-          if (DecodeUtteranceLatticeFaster(
-                  decoder, nnet_decodable, trans_model, word_syms, utt,
-                  decodable_opts.acoustic_scale, determinize, allow_partial,
-                  &alignment_writer, &words_writer, &compact_lattice_writer,
-                  &lattice_writer,
-                  &like)) {
-            tot_like += like;
-            frame_count += features.NumRows();
-            num_success++;
-          } else num_fail++;
-        }
+    // Stage 0 of the pipeline decodes, in one thread; stage 1, if there is
+    // one, determinizes.  We limit the number of utterances in the pipeline,
+    // as each has its own decoder.
+    std::vector<int32> stage_threads(1, 1);
+    if (determinize_threads > 0)
+      stage_threads.push_back(determinize_threads);
+    VectorFst<StdArc> *decode_fst = NULL;  // only used if there is a single
+                                           // decoding graph.
+    // Failures are counted in num_decode_fail by the pipeline's threads, and
+    // in num_fail by this one.
+    int32 num_decode_fail = 0;
+    {
+      TaskPipeline<DecodeUtteranceTask> pipeline(stage_threads,
+                                                 2 + 2 * determinize_threads);
+      SequentialTableReader<fst::VectorFstHolder> fst_reader;
+      SequentialBaseFloatMatrixReader feature_reader;
+      RandomAccessBaseFloatMatrixReader random_feature_reader;
+      if (ClassifyRspecifier(fst_in_str, NULL, NULL) == kNoRspecifier) {
+        // Input FST is just one FST, not a table of FSTs.
+        decode_fst = fst::ReadFstKaldi(fst_in_str);
+        feature_reader.Open(feature_rspecifier);
+      } else {  // We have different FSTs for different utterances.
+        fst_reader.Open(fst_in_str);
+        random_feature_reader.Open(feature_rspecifier);
       }
-      delete decode_fst; // delete this only after decoder goes out of scope.
-    } else { // We have different FSTs for different utterances.
-      SequentialTableReader<fst::VectorFstHolder> fst_reader(fst_in_str);
-      RandomAccessBaseFloatMatrixReader feature_reader(feature_rspecifier);
-      for (; !fst_reader.Done(); fst_reader.Next()) {
-        std::string utt = fst_reader.Key();
-        if (!feature_reader.HasKey(utt)) {
+      while (decode_fst != NULL ? !feature_reader.Done() : !fst_reader.Done()) {
+        std::string utt = (decode_fst != NULL ? feature_reader.Key() :
+                           fst_reader.Key());
+        const Matrix<BaseFloat> *features = NULL;
+        if (decode_fst != NULL) {
+          features = &(feature_reader.Value());
+        } else if (random_feature_reader.HasKey(utt)) {
+          features = &(random_feature_reader.Value(utt));
+        } else {
           KALDI_WARN << "Not decoding utterance " << utt
                      << " because no features available.";
           num_fail++;
-          continue;
         }
-        const Matrix<BaseFloat> &features = feature_reader.Value(utt);
-        if (features.NumRows() == 0) {
+        const Matrix<BaseFloat> *online_ivectors = NULL;
+        const Vector<BaseFloat> *ivector = NULL;
+        if (features != NULL && features->NumRows() == 0) {
           KALDI_WARN << "Zero-length utterance: " << utt;
           num_fail++;
-          continue;
+          features = NULL;
         }
-
-        LatticeFasterDecoder decoder(fst_reader.Value(), config);
-
-        const Matrix<BaseFloat> *online_ivectors = NULL;
-        const Vector<BaseFloat> *ivector = NULL;
-        if (!ivector_rspecifier.empty()) {
+        if (features != NULL && !ivector_rspecifier.empty()) {
           if (!ivector_reader.HasKey(utt)) {
             KALDI_WARN << "No iVector available for utterance " << utt;
             num_fail++;
-            continue;
+            features = NULL;
           } else {
             ivector = &ivector_reader.Value(utt);
           }
         }
-        if (!online_ivector_rspecifier.empty()) {
+        if (features != NULL && !online_ivector_rspecifier.empty()) {
           if (!online_ivector_reader.HasKey(utt)) {
             KALDI_WARN << "No online iVector available for utterance " << utt;
             num_fail++;
-            continue;
+            features = NULL;
           } else {
             online_ivectors = &online_ivector_reader.Value(utt);
           }
         }
-
-        DecodableAmNnetSimple nnet_decodable(
-            decodable_opts, trans_model, am_nnet,
-            features, ivector, online_ivectors,
-            online_ivector_period);
-
-        double like;
-        if (DecodeUtteranceLatticeFaster(
-                decoder, nnet_decodable, trans_model, word_syms, utt,
-                decodable_opts.acoustic_scale, determinize, allow_partial,
-                &alignment_writer, &words_writer, &compact_lattice_writer,
-                &lattice_writer, &like)) {
-          tot_like += like;
-          frame_count += features.NumRows();
-          num_success++;
-        } else num_fail++;
+        if (features != NULL) {
+          DecodeUtteranceTask *task = new DecodeUtteranceTask(
+              utt, *features, ivector, online_ivectors, stage_threads.size(),
+              search_stats_wxfilename.empty() ? NULL : &search_stats,
+              &frame_count, &num_success);
+          // The decoder owns the FST if it is given a pointer.
+          LatticeFasterDecoder *decoder = (decode_fst != NULL ?
+              new LatticeFasterDecoder(*decode_fst, config) :
+              new LatticeFasterDecoder(
+                  config, new VectorFst<StdArc>(fst_reader.Value())));
+          if (!search_stats_wxfilename.empty())
+            decoder->SetSearchStats(&search_stats);
+          DecodableInterface *nnet_decodable;
+          if (sparse_info != NULL) {
+            DecodableAmNnetSparseOutput *sparse_decodable =
+                new DecodableAmNnetSparseOutput(
+                    decodable_opts, *sparse_info, trans_model, am_nnet,
+                    task->Features(), task->Ivector(), task->OnlineIvectors(),
+                    online_ivector_period);
+            sparse_decodable->SetSharedCompiler(&compiler);
+            nnet_decodable = sparse_decodable;
+          } else {
+            DecodableAmNnetSimple *simple_decodable = new DecodableAmNnetSimple(
+                decodable_opts, trans_model, am_nnet,
+                task->Features(), task->Ivector(), task->OnlineIvectors(),
+                online_ivector_period);
+            simple_decodable->SetSharedCompiler(&compiler);
+            nnet_decodable = simple_decodable;
+          }
+          task->SetTask(new DecodeUtteranceLatticeFasterClass(
+              decoder, nnet_decodable,  // takes ownership of these two.
+              trans_model, word_syms, utt, decodable_opts.acoustic_scale,
+              determinize, allow_partial, &alignment_writer, &words_writer,
+              &compact_lattice_writer, &lattice_writer,
+              &tot_like, NULL, &num_success, &num_decode_fail, NULL));
+          pipeline.Run(task);  // takes ownership of "task".
+        }
+        if (decode_fst != NULL)
+          feature_reader.Next();
+        else
+          fst_reader.Next();
       }
-    }
+    }  // the pipeline's destructor waits for the utterances to be output.
+    delete decode_fst; // delete this only after the decoders are deleted.
+    num_fail += num_decode_fail;
 
     double elapsed = timer.Elapsed();
     KALDI_LOG << "Time taken "<< elapsed
@@ -243,10 +385,22 @@ int main(int argc, char *argv[]) {
               << (elapsed*100.0/frame_count);
     KALDI_LOG << "Done " << num_success << " utterances, failed for "
               << num_fail;
+    NnetComputeProfiler::Print();
     KALDI_LOG << "Overall log-likelihood per frame is " << (tot_like/frame_count) << " over "
               << frame_count<<" frames.";
 
+    if (!computation_cache.empty()) {
+      Output ko(computation_cache, true);
+      compiler.WriteCache(ko.Stream(), true);
+    }
+
+    if (!search_stats_wxfilename.empty()) {
+      Output ko(search_stats_wxfilename, false);
+      search_stats.WriteJson(ko.Stream());
+    }
+
     delete word_syms;
+    delete sparse_info;
     if (num_success != 0) return 0;
     else return 1;
   } catch(const std::exception &e) {
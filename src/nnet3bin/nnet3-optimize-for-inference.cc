@@ -0,0 +1,99 @@
+// nnet3bin/nnet3-optimize-for-inference.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "nnet3/am-nnet-simple.h"
+#include "nnet3/nnet-utils.h"
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Simplify an nnet3 model for inference, by folding fixed transforms\n"
+        "(FixedAffineComponent, e.g. LDA; FixedScaleComponent,\n"
+        "PerElementScaleComponent and FixedBiasComponent) into neighbouring\n"
+        "affine components, combining consecutive affine components where this\n"
+        "doesn't increase the number of parameters, and removing components that\n"
+        "are the identity in the forward direction (NoOpComponent and\n"
+        "ClipGradientComponent).  The output computes the same function as the\n"
+        "input but should not be trained further.  See also nnet3-am-copy\n"
+        "--quantize=true.\n"
+        "\n"
+        "Usage:  nnet3-optimize-for-inference [options] <model-in> <model-out>\n"
+        "e.g.:\n"
+        " nnet3-optimize-for-inference final.mdl final_inference.mdl\n"
+        " nnet3-optimize-for-inference --raw=true final.raw final_inference.raw\n";
+
+    bool binary_write = true,
+        raw = false;
+
+    ParseOptions po(usage);
+    po.Register("binary", &binary_write, "Write output in binary mode");
+    po.Register("raw", &raw, "If true, read and write a 'raw' neural net "
+                "(as used by nnet3-copy) instead of a model with a transition "
+                "model and priors.");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string nnet_rxfilename = po.GetArg(1),
+        nnet_wxfilename = po.GetArg(2);
+
+    TransitionModel trans_model;
+    AmNnetSimple am_nnet;
+    if (raw) {
+      ReadKaldiObject(nnet_rxfilename, &(am_nnet.GetNnet()));
+    } else {
+      bool binary;
+      Input ki(nnet_rxfilename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+    }
+    Nnet &nnet = am_nnet.GetNnet();
+
+    int32 num_components = nnet.NumComponents();
+    int32 num_collapsed = CollapseModel(&nnet);
+    KALDI_LOG << "Collapsed " << num_collapsed << " pairs of components; "
+              << "number of components changed from " << num_components
+              << " to " << nnet.NumComponents();
+
+    if (raw) {
+      WriteKaldiObject(nnet, nnet_wxfilename, binary_write);
+    } else {
+      Output ko(nnet_wxfilename, binary_write);
+      trans_model.Write(ko.Stream(), binary_write);
+      am_nnet.Write(ko.Stream(), binary_write);
+    }
+    KALDI_LOG << "Wrote optimized neural net from " << nnet_rxfilename
+              << " to " << nnet_wxfilename;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+}
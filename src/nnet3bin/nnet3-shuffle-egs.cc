@@ -22,6 +22,69 @@
 #include "util/common-utils.h"
 #include "hmm/transition-model.h"
 #include "nnet3/nnet-example.h"
+#include <unistd.h>
+#include <cstdio>
+
+namespace kaldi {
+namespace nnet3 {
+
+// Shuffles the examples from "example_reader" in two passes, using temporary
+// files so that the memory needed is only about that needed for
+// 1/num_buckets of the data.  In the first pass, each example is written
+// to a randomly chosen one of "num_buckets" temporary archives in "temp_dir";
+// in the second pass, each archive in turn is read into memory, shuffled,
+// written to "example_writer" and deleted.  Since the example's bucket is
+// chosen uniformly at random, and the order within each bucket is a random
+// permutation, the output order is a uniformly random permutation (the order
+// of the buckets themselves doesn't matter).  Returns the number of examples
+// written.
+int64 ShuffleExamplesExternal(const std::string &temp_dir,
+                              int32 num_buckets,
+                              SequentialNnetExampleReader *example_reader,
+                              NnetExampleWriter *example_writer) {
+  KALDI_ASSERT(num_buckets > 0);
+  std::vector<std::string> bucket_filenames(num_buckets);
+  std::vector<NnetExampleWriter*> bucket_writers(num_buckets);
+  for (int32 b = 0; b < num_buckets; b++) {
+    std::ostringstream os;
+    os << temp_dir << "/nnet3-shuffle-egs." << getpid() << "." << b << ".egs";
+    bucket_filenames[b] = os.str();
+    bucket_writers[b] = new NnetExampleWriter("ark:" + bucket_filenames[b]);
+  }
+  for (; !example_reader->Done(); example_reader->Next()) {
+    int32 b = RandInt(0, num_buckets - 1);
+    bucket_writers[b]->Write(example_reader->Key(), example_reader->Value());
+  }
+  for (int32 b = 0; b < num_buckets; b++) {
+    if (!bucket_writers[b]->Close())
+      KALDI_ERR << "Error writing temporary file " << bucket_filenames[b];
+    delete bucket_writers[b];
+  }
+
+  int64 num_done = 0;
+  for (int32 b = 0; b < num_buckets; b++) {
+    std::vector<std::pair<std::string, NnetExample*> > egs;
+    {
+      SequentialNnetExampleReader bucket_reader("ark:" + bucket_filenames[b]);
+      for (; !bucket_reader.Done(); bucket_reader.Next())
+        egs.push_back(std::make_pair(bucket_reader.Key(),
+                                     new NnetExample(bucket_reader.Value())));
+    }
+    if (std::remove(bucket_filenames[b].c_str()) != 0)
+      KALDI_WARN << "Could not delete temporary file " << bucket_filenames[b];
+    std::random_shuffle(egs.begin(), egs.end());
+    for (size_t i = 0; i < egs.size(); i++) {
+      example_writer->Write(egs[i].first, *(egs[i].second));
+      delete egs[i].second;
+    }
+    KALDI_VLOG(1) << "Wrote " << egs.size() << " examples from bucket " << b;
+    num_done += egs.size();
+  }
+  return num_done;
+}
+
+}  // namespace nnet3
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -34,19 +97,33 @@ int main(int argc, char *argv[]) {
         "Copy examples (typically single frames or small groups of frames) for\n"
         "neural network training, from the input to output, but randomly shuffle the order.\n"
         "This program will keep all of the examples in memory at once, unless you\n"
-        "use the --buffer-size option\n"
+        "use the --buffer-size option, or the --num-buckets option, which does\n"
+        "a full randomization using temporary files in --temp-dir, holding in\n"
+        "memory only about 1/num-buckets of the examples at a time.\n"
         "\n"
         "Usage:  nnet3-shuffle-egs [options] <egs-rspecifier> <egs-wspecifier>\n"
         "\n"
-        "nnet3-shuffle-egs --srand=1 ark:train.egs ark:shuffled.egs\n";
+        "nnet3-shuffle-egs --srand=1 ark:train.egs ark:shuffled.egs\n"
+        "nnet3-shuffle-egs --srand=1 --num-buckets=100 --temp-dir=exp/egs/tmp \\\n"
+        "   ark:train.egs ark:shuffled.egs\n";
 
     int32 srand_seed = 0;
     int32 buffer_size = 0;
+    int32 num_buckets = 0;
+    std::string temp_dir = "/tmp";
     ParseOptions po(usage);
     po.Register("srand", &srand_seed, "Seed for random number generator ");
     po.Register("buffer-size", &buffer_size, "If >0, size of a buffer we use "
                 "to do limited-memory partial randomization.  Otherwise, do "
                 "full randomization.");
+    po.Register("num-buckets", &num_buckets, "If >0, do full randomization "
+                "in two passes, via this many temporary archives (each of which "
+                "is held in memory in turn); the memory used is about the "
+                "total size of the examples divided by this number.  "
+                "Incompatible with --buffer-size.");
+    po.Register("temp-dir", &temp_dir, "Directory for the temporary archives "
+                "used if --num-buckets > 0; needs enough space for all the "
+                "examples.");
 
     po.Read(argc, argv);
 
@@ -66,7 +143,12 @@ int main(int argc, char *argv[]) {
 
     SequentialNnetExampleReader example_reader(examples_rspecifier);
     NnetExampleWriter example_writer(examples_wspecifier);
-    if (buffer_size == 0) { // Do full randomization
+    if (num_buckets > 0) {
+      if (buffer_size != 0)
+        KALDI_ERR << "--buffer-size and --num-buckets may not both be set.";
+      num_done = ShuffleExamplesExternal(temp_dir, num_buckets,
+                                         &example_reader, &example_writer);
+    } else if (buffer_size == 0) { // Do full randomization
       // Putting in an extra level of indirection here to avoid excessive
       // computation and memory demands when we have to resize the vector.
 
@@ -102,7 +184,8 @@ int main(int argc, char *argv[]) {
 
     KALDI_LOG << "Shuffled order of " << num_done
               << " neural-network training examples "
-              << (buffer_size ? "using a buffer (partial randomization)" : "");
+              << (buffer_size ? "using a buffer (partial randomization)" :
+                  (num_buckets ? "using temporary files" : ""));
 
     return (num_done == 0 ? 1 : 0);
   } catch(const std::exception &e) {
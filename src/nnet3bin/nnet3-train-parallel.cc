@@ -0,0 +1,108 @@
+// nnet3bin/nnet3-train-parallel.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "nnet3/nnet-training-parallel.h"
+#include "nnet3/nnet-example-reader.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+    typedef kaldi::int64 int64;
+
+    const char *usage =
+        "Train nnet3 neural network parameters with backprop and stochastic\n"
+        "gradient descent, using several threads on the CPU with synchronous\n"
+        "updates: each thread computes the parameter change for one\n"
+        "minibatch, and the changes are summed and applied to the model\n"
+        "before the next group of minibatches.  Minibatches are to be created\n"
+        "by nnet3-merge-egs in the input pipeline, or by this program if\n"
+        "--minibatch-size is set.  See also nnet3-train.\n"
+        "\n"
+        "Usage:  nnet3-train-parallel [options] <raw-model-in> <training-examples-in> <raw-model-out>\n"
+        "\n"
+        "e.g.:\n"
+        "nnet3-train-parallel --num-threads=8 1.raw 'ark:nnet3-merge-egs 1.egs ark:-|' 2.raw\n";
+
+    bool binary_write = true;
+    int32 num_threads = 4;
+    NnetTrainerOptions train_config;
+    NnetExampleReaderOptions reader_config;
+
+    ParseOptions po(usage);
+    po.Register("binary", &binary_write, "Write output in binary mode");
+    po.Register("num-threads", &num_threads, "Number of training threads; "
+                "each processes one minibatch at a time.");
+
+    train_config.Register(&po);
+    reader_config.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 3 || num_threads <= 0) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string nnet_rxfilename = po.GetArg(1),
+        examples_rspecifier = po.GetArg(2),
+        nnet_wxfilename = po.GetArg(3);
+
+    Nnet nnet;
+    ReadKaldiObject(nnet_rxfilename, &nnet);
+
+    bool ok;
+    {
+      NnetParallelTrainer trainer(train_config, num_threads, &nnet);
+
+      NnetExampleReader example_reader(reader_config, examples_rspecifier);
+
+      while (!example_reader.Done()) {
+        std::vector<NnetExample> egs;
+        egs.reserve(num_threads);
+        for (; !example_reader.Done() && egs.size() < num_threads;
+             example_reader.Next()) {
+          egs.resize(egs.size() + 1);
+          egs.back().Swap(&(example_reader.Value()));
+        }
+        std::vector<const NnetExample*> eg_pointers(egs.size());
+        for (size_t i = 0; i < egs.size(); i++)
+          eg_pointers[i] = &(egs[i]);
+        trainer.Train(eg_pointers);
+      }
+
+      ok = trainer.PrintTotalStats();
+
+      // need trainer's destructor to be called before we write model.
+    }
+
+    NnetComputeProfiler::Print();
+    WriteKaldiObject(nnet, nnet_wxfilename, binary_write);
+    KALDI_LOG << "Wrote model to " << nnet_wxfilename;
+    return (ok ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+}
@@ -20,6 +20,7 @@
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "nnet3/nnet-training.h"
+#include "nnet3/nnet-example-reader.h"
 
 
 int main(int argc, char *argv[]) {
@@ -32,7 +33,9 @@ int main(int argc, char *argv[]) {
     const char *usage =
         "Train nnet3 neural network parameters with backprop and stochastic\n"
         "gradient descent.  Minibatches are to be created by nnet3-merge-egs in\n"
-        "the input pipeline.  This training program is single-threaded (best to\n"
+        "the input pipeline, or by this program if --minibatch-size is set.\n"
+        "The examples are read (and uncompressed) in a background thread; see\n"
+        "--prefetch-queue-size.  The training itself training program is single-threaded (best to\n"
         "use it with a GPU); see nnet3-train-parallel for multi-threaded training\n"
         "that is better suited to CPUs.\n"
         "\n"
@@ -43,14 +46,22 @@ int main(int argc, char *argv[]) {
 
     bool binary_write = true;
     std::string use_gpu = "yes";
+    std::string cuda_profile_wxfilename;
     NnetTrainerOptions train_config;
+    NnetExampleReaderOptions reader_config;
 
     ParseOptions po(usage);
     po.Register("binary", &binary_write, "Write output in binary mode");
     po.Register("use-gpu", &use_gpu,
                 "yes|no|optional|wait, only has effect if compiled with CUDA");
+    po.Register("cuda-profile-json", &cuda_profile_wxfilename,
+                "If set, time the GPU operations on the device using CUDA "
+                "events, and write the profile (totals per operation, and a "
+                "trace that chrome://tracing can display) to this file in "
+                "JSON format.  Only has effect if compiled with CUDA.");
 
     train_config.Register(&po);
+    reader_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -61,6 +72,8 @@ int main(int argc, char *argv[]) {
 
 #if HAVE_CUDA==1
     CuDevice::Instantiate().SelectGpuId(use_gpu);
+    if (!cuda_profile_wxfilename.empty())
+      CuDevice::Instantiate().SetEventProfiling(true);
 #endif
 
     std::string nnet_rxfilename = po.GetArg(1),
@@ -74,7 +87,7 @@ int main(int argc, char *argv[]) {
     {
       NnetTrainer trainer(train_config, &nnet);
 
-      SequentialNnetExampleReader example_reader(examples_rspecifier);
+      NnetExampleReader example_reader(reader_config, examples_rspecifier);
 
       for (; !example_reader.Done(); example_reader.Next())
         trainer.Train(example_reader.Value());
@@ -86,7 +99,12 @@ int main(int argc, char *argv[]) {
 
 #if HAVE_CUDA==1
     CuDevice::Instantiate().PrintProfile();
+    if (!cuda_profile_wxfilename.empty()) {
+      Output ko(cuda_profile_wxfilename, false, false);
+      CuDevice::Instantiate().WriteProfileJson(ko.Stream());
+    }
 #endif
+    NnetComputeProfiler::Print();
     WriteKaldiObject(nnet, nnet_wxfilename, binary_write);
     KALDI_LOG << "Wrote model to " << nnet_wxfilename;
     return (ok ? 0 : 1);
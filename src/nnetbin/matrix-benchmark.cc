@@ -0,0 +1,358 @@
+// nnetbin/matrix-benchmark.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#if HAVE_CUDA == 1
+#include <cuda_runtime_api.h>
+#endif
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "util/common-utils.h"
+#include "matrix/compressed-matrix.h"
+#include "matrix/sparse-matrix.h"
+#include "cudamatrix/cu-common.h"
+#include "cudamatrix/cu-device.h"
+#include "cudamatrix/cu-matrix.h"
+#include "cudamatrix/cu-array.h"
+
+namespace kaldi {
+
+static bool UsingGpu() {
+#if HAVE_CUDA == 1
+  return CuDevice::Instantiate().Enabled();
+#else
+  return false;
+#endif
+}
+
+// Waits for the GPU (if we are using one) to finish its work, so that the
+// timings include it.
+static void SynchronizeDevice() {
+#if HAVE_CUDA == 1
+  if (UsingGpu())
+    CU_SAFE_CALL(cudaDeviceSynchronize());
+#endif
+}
+
+// One benchmarked operation on matrices of a given size.  The constructor
+// sets up the inputs; Run() does the operation once.
+class Benchmark {
+ public:
+  virtual void Run() = 0;
+  // The number of floating point operations in one Run(), or 0 if it is not
+  // meaningful (e.g. for copies).
+  virtual double NumFlops() const = 0;
+  // The (minimum) number of bytes of memory read or written by one Run().
+  virtual double NumBytes() const = 0;
+  virtual ~Benchmark() { }
+};
+
+template<typename Real>
+class GemmBenchmark: public Benchmark {
+ public:
+  explicit GemmBenchmark(int32 dim): a_(dim, dim), b_(dim, dim), c_(dim, dim) {
+    a_.SetRandn();
+    b_.SetRandn();
+  }
+  virtual void Run() { c_.AddMatMat(1.0, a_, kNoTrans, b_, kNoTrans, 0.0); }
+  virtual double NumFlops() const {
+    return 2.0 * a_.NumRows() * a_.NumCols() * b_.NumCols();
+  }
+  virtual double NumBytes() const {
+    return 3.0 * a_.NumRows() * a_.NumCols() * sizeof(Real);
+  }
+ private:
+  CuMatrix<Real> a_, b_, c_;
+};
+
+// Sets up a random selection of source rows, for AddRows() and CopyRows().
+static void GetRandomIndexes(int32 num_rows, CuArray<MatrixIndexT> *indexes) {
+  std::vector<MatrixIndexT> temp(num_rows);
+  for (int32 i = 0; i < num_rows; i++)
+    temp[i] = RandInt(0, num_rows - 1);
+  indexes->CopyFromVec(temp);
+}
+
+template<typename Real>
+class CopyRowsBenchmark: public Benchmark {
+ public:
+  CopyRowsBenchmark(int32 dim, bool add):
+      add_(add), src_(dim, dim), dest_(dim, dim) {
+    src_.SetRandn();
+    GetRandomIndexes(dim, &indexes_);
+  }
+  virtual void Run() {
+    if (add_) dest_.AddRows(1.0, src_, indexes_);
+    else dest_.CopyRows(src_, indexes_);
+  }
+  virtual double NumFlops() const {
+    return add_ ? 2.0 * dest_.NumRows() * dest_.NumCols() : 0.0;
+  }
+  virtual double NumBytes() const {
+    return (add_ ? 3.0 : 2.0) * dest_.NumRows() * dest_.NumCols() *
+        sizeof(Real);
+  }
+ private:
+  bool add_;
+  CuMatrix<Real> src_, dest_;
+  CuArray<MatrixIndexT> indexes_;
+};
+
+template<typename Real>
+class SoftmaxBenchmark: public Benchmark {
+ public:
+  SoftmaxBenchmark(int32 dim, bool log):
+      log_(log), src_(dim, dim), dest_(dim, dim) {
+    src_.SetRandn();
+  }
+  virtual void Run() {
+    if (log_) dest_.ApplyLogSoftMaxPerRow(src_);
+    else dest_.ApplySoftMaxPerRow(src_);
+  }
+  virtual double NumFlops() const { return 0.0; }
+  virtual double NumBytes() const {
+    return 2.0 * dest_.NumRows() * dest_.NumCols() * sizeof(Real);
+  }
+ private:
+  bool log_;
+  CuMatrix<Real> src_, dest_;
+};
+
+// Sums ranges of "range_size" consecutive columns (SumColumnRanges()) or rows
+// (AddRowRanges()).
+template<typename Real>
+class RangesBenchmark: public Benchmark {
+ public:
+  RangesBenchmark(int32 dim, bool rows, int32 range_size):
+      rows_(rows), src_(dim, dim) {
+    src_.SetRandn();
+    int32 num_ranges = (dim + range_size - 1) / range_size;
+    std::vector<Int32Pair> ranges(num_ranges);
+    for (int32 i = 0; i < num_ranges; i++) {
+      ranges[i].first = i * range_size;
+      ranges[i].second = std::min(dim, (i + 1) * range_size);
+    }
+    indexes_.CopyFromVec(ranges);
+    if (rows_) dest_.Resize(num_ranges, dim);
+    else dest_.Resize(dim, num_ranges);
+  }
+  virtual void Run() {
+    if (rows_) dest_.AddRowRanges(src_, indexes_);
+    else dest_.SumColumnRanges(src_, indexes_);
+  }
+  virtual double NumFlops() const {
+    return 1.0 * src_.NumRows() * src_.NumCols();
+  }
+  virtual double NumBytes() const {
+    return (1.0 * src_.NumRows() * src_.NumCols() +
+            (rows_ ? 2.0 : 1.0) * dest_.NumRows() * dest_.NumCols()) *
+        sizeof(Real);
+  }
+ private:
+  bool rows_;
+  CuMatrix<Real> src_, dest_;
+  CuArray<Int32Pair> indexes_;
+};
+
+// Compression (always on the CPU) and decompression (on the GPU if we are
+// using one) of a CompressedMatrix; the byte count is that of the
+// uncompressed matrix.
+template<typename Real>
+class CompressionBenchmark: public Benchmark {
+ public:
+  CompressionBenchmark(int32 dim, bool compress):
+      compress_(compress), mat_(dim, dim), dest_(dim, dim) {
+    mat_.SetRandn();
+    cmat_.CopyFromMat(mat_);
+    gmat_ = cmat_;
+  }
+  virtual void Run() {
+    if (compress_) cmat_.CopyFromMat(mat_);
+    else dest_.CopyFromGeneralMat(gmat_);
+  }
+  virtual double NumFlops() const { return 0.0; }
+  virtual double NumBytes() const {
+    return 1.0 * mat_.NumRows() * mat_.NumCols() * sizeof(Real);
+  }
+ private:
+  bool compress_;
+  Matrix<Real> mat_;
+  CompressedMatrix cmat_;
+  GeneralMatrix gmat_;
+  CuMatrix<Real> dest_;
+};
+
+// Returns a newly allocated benchmark, or NULL if "name" is not known.
+template<typename Real>
+static Benchmark *NewBenchmark(const std::string &name, int32 dim) {
+  if (name == "gemm") return new GemmBenchmark<Real>(dim);
+  if (name == "copy-rows") return new CopyRowsBenchmark<Real>(dim, false);
+  if (name == "add-rows") return new CopyRowsBenchmark<Real>(dim, true);
+  if (name == "softmax") return new SoftmaxBenchmark<Real>(dim, false);
+  if (name == "log-softmax") return new SoftmaxBenchmark<Real>(dim, true);
+  if (name == "sum-column-ranges")
+    return new RangesBenchmark<Real>(dim, false, 8);
+  if (name == "add-row-ranges") return new RangesBenchmark<Real>(dim, true, 8);
+  if (name == "compress") return new CompressionBenchmark<Real>(dim, true);
+  if (name == "uncompress") return new CompressionBenchmark<Real>(dim, false);
+  return NULL;
+}
+
+// Runs the benchmark repeatedly, in batches of doubling size, until at least
+// "min_time" seconds have passed, and returns the number of runs and the time
+// they took.
+static void TimeBenchmark(Benchmark *benchmark, BaseFloat min_time,
+                          int64 *num_runs, double *elapsed) {
+  benchmark->Run();  // warm-up (e.g. for memory allocation, and caches).
+  SynchronizeDevice();
+  Timer timer;
+  *num_runs = 0;
+  for (int64 batch_size = 1; ; batch_size *= 2) {
+    for (int64 i = 0; i < batch_size; i++)
+      benchmark->Run();
+    SynchronizeDevice();
+    *num_runs += batch_size;
+    *elapsed = timer.Elapsed();
+    if (*elapsed >= min_time) break;
+  }
+}
+
+template<typename Real>
+static void RunBenchmarks(const std::vector<std::string> &names,
+                          const std::vector<int32> &sizes,
+                          BaseFloat min_time, std::ostream &os) {
+  os << "{\n  \"device\": \""
+     << (UsingGpu() ? "gpu" : "cpu")
+     << "\",\n  \"precision\": \""
+     << (sizeof(Real) == 4 ? "float" : "double") << "\",\n"
+     << "  \"results\": [";
+  bool first = true;
+  for (size_t i = 0; i < names.size(); i++) {
+    for (size_t j = 0; j < sizes.size(); j++) {
+      Benchmark *benchmark = NewBenchmark<Real>(names[i], sizes[j]);
+      KALDI_ASSERT(benchmark != NULL);
+      int64 num_runs;
+      double elapsed;
+      TimeBenchmark(benchmark, min_time, &num_runs, &elapsed);
+      double flops = benchmark->NumFlops() * num_runs / elapsed,
+          bytes = benchmark->NumBytes() * num_runs / elapsed;
+      delete benchmark;
+      os << (first ? "\n" : ",\n") << "    { \"name\": \"" << names[i]
+         << "\", \"dim\": " << sizes[j] << ", \"runs\": " << num_runs
+         << ", \"seconds\": " << elapsed
+         << ", \"seconds_per_run\": " << (elapsed / num_runs);
+      if (flops > 0.0)
+        os << ", \"gflops\": " << (flops * 1.0e-09);
+      os << ", \"gbytes_per_second\": " << (bytes * 1.0e-09) << " }";
+      first = false;
+      std::ostringstream speed;
+      speed << (bytes * 1.0e-09) << " GB/s";
+      if (flops > 0.0)
+        speed << ", " << (flops * 1.0e-09) << " GFlop/s";
+      KALDI_LOG << names[i] << ", dim = " << sizes[j] << ": "
+                << (elapsed / num_runs) << " seconds per run, "
+                << speed.str();
+    }
+  }
+  os << "\n  ]\n}\n";
+}
+
+} // end namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Times common matrix operations (GEMM, CopyRows/AddRows, softmax,\n"
+        "SumColumnRanges/AddRowRanges, and compression) on the GPU or, with\n"
+        "--use-gpu=no, on the CPU with whatever BLAS Kaldi was built with, and\n"
+        "writes the speeds (in GFlop/s and GB/s) as JSON, so that results\n"
+        "from different machines and versions can be compared.  The\n"
+        "matrices are square with dimension given by --sizes.\n"
+        "\n"
+        "Usage:  matrix-benchmark [options] [<json-wxfilename>]\n"
+        "e.g.: matrix-benchmark --use-gpu=yes --sizes=1024,4096 gpu.json\n";
+
+    ParseOptions po(usage);
+    std::string use_gpu = "optional",
+        sizes_str = "256,1024,2048",
+        benchmarks_str = "gemm,copy-rows,add-rows,softmax,log-softmax,"
+        "sum-column-ranges,add-row-ranges,compress,uncompress";
+    BaseFloat min_time = 0.25;
+    bool use_double = false;
+
+    po.Register("use-gpu", &use_gpu,
+                "yes|no|optional|wait, only has effect if compiled with CUDA");
+    po.Register("sizes", &sizes_str, "Comma-separated list of matrix "
+                "dimensions to run each benchmark with");
+    po.Register("benchmarks", &benchmarks_str, "Comma-separated list of "
+                "benchmarks to run, from: gemm, copy-rows, add-rows, "
+                "softmax, log-softmax, sum-column-ranges, add-row-ranges, "
+                "compress, uncompress");
+    po.Register("min-time", &min_time, "Minimum time in seconds to spend on "
+                "each benchmark and size");
+    po.Register("double", &use_double, "If true, use double precision");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() > 1) {
+      po.PrintUsage();
+      exit(1);
+    }
+    std::string json_wxfilename = po.GetOptArg(1);
+    if (json_wxfilename == "") json_wxfilename = "-";
+
+#if HAVE_CUDA == 1
+    CuDevice::Instantiate().SelectGpuId(use_gpu);
+#endif
+
+    std::vector<int32> sizes;
+    if (!SplitStringToIntegers(sizes_str, ",", true, &sizes) ||
+        sizes.empty())
+      KALDI_ERR << "Invalid --sizes option: " << sizes_str;
+    for (size_t i = 0; i < sizes.size(); i++)
+      if (sizes[i] <= 0)
+        KALDI_ERR << "Invalid --sizes option: " << sizes_str;
+    std::vector<std::string> names;
+    SplitStringToVector(benchmarks_str, ",", true, &names);
+    for (size_t i = 0; i < names.size(); i++) {
+      Benchmark *benchmark = NewBenchmark<BaseFloat>(names[i], 1);
+      if (benchmark == NULL)
+        KALDI_ERR << "Unknown benchmark '" << names[i] << "'";
+      delete benchmark;
+    }
+
+    Output ko(json_wxfilename, false);
+    if (use_double)
+      RunBenchmarks<double>(names, sizes, min_time, ko.Stream());
+    else
+      RunBenchmarks<float>(names, sizes, min_time, ko.Stream());
+#if HAVE_CUDA == 1
+    CuDevice::Instantiate().PrintProfile();
+#endif
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
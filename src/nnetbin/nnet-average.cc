@@ -0,0 +1,96 @@
+// nnetbin/nnet-average.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "nnet/nnet-nnet.h"
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet1;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Average the trainable parameters of several Neural Networks with the same\n"
+        "structure, e.g. trained in parallel on different parts of the data, on\n"
+        "different GPUs (model averaging, see steps/nnet/train_scheduler.sh\n"
+        "--num-jobs).  The non-trainable components are taken from the first one.\n"
+        "Usage:  nnet-average [options] <model-in1> <model-in2> ... <model-inN> <model-out>\n"
+        "e.g.:\n"
+        " nnet-average nnet.1 nnet.2 nnet.3 nnet.avg\n";
+
+    bool binary_write = true;
+    
+    ParseOptions po(usage);
+    po.Register("binary", &binary_write, "Write output in binary mode");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    int32 num_in = po.NumArgs() - 1;
+    std::string model_out_filename = po.GetArg(po.NumArgs());
+
+    // load the first network
+    Nnet nnet; 
+    {
+      bool binary_read;
+      Input ki(po.GetArg(1), &binary_read);
+      nnet.Read(ki.Stream(), binary_read);
+    }
+    Vector<BaseFloat> params_sum;
+    nnet.GetParams(&params_sum);
+
+    // accumulate the parameters of the others
+    for (int32 i = 2; i <= num_in; i++) {
+      Nnet nnet_i;
+      {
+        bool binary_read;
+        Input ki(po.GetArg(i), &binary_read);
+        nnet_i.Read(ki.Stream(), binary_read);
+      }
+      if (nnet_i.NumComponents() != nnet.NumComponents() ||
+          nnet_i.NumParams() != nnet.NumParams()) {
+        KALDI_ERR << "Network " << po.GetArg(i) << " does not have the "
+                  << "structure of " << po.GetArg(1);
+      }
+      Vector<BaseFloat> params;
+      nnet_i.GetParams(&params);
+      params_sum.AddVec(1.0, params);
+    }
+
+    params_sum.Scale(1.0 / num_in);
+    nnet.SetParams(params_sum);
+
+    // store the network
+    {
+      Output ko(model_out_filename, binary_write);
+      nnet.Write(ko.Stream(), binary_write);
+    }
+
+    KALDI_LOG << "Averaged " << num_in << " models, written model to "
+              << model_out_filename;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+}
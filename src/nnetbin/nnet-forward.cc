@@ -22,11 +22,106 @@
 #include "nnet/nnet-nnet.h"
 #include "nnet/nnet-loss.h"
 #include "nnet/nnet-pdf-prior.h"
+#include "nnet/nnet-utils.h"
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "base/timer.h"
 
 
+namespace kaldi {
+namespace nnet1 {
+
+// Returns true if the output for a frame of "nnet" can depend on the other
+// frames in other ways than through the recurrence of the LSTMs, so that
+// utterances cannot be concatenated (or put into streams) for a single
+// forward pass.  We are conservative about ParallelComponent, as the nested
+// networks can contain anything.
+static bool HasFrameContext(const Nnet &nnet) {
+  for (int32 c = 0; c < nnet.NumComponents(); c++) {
+    switch (nnet.GetComponent(c).GetType()) {
+      case Component::kSplice:
+      case Component::kFramePoolingComponent:
+      case Component::kSentenceAveragingComponent:
+      case Component::kSimpleSentenceAveragingComponent:
+      case Component::kParallelComponent:
+        return true;
+      default:
+        break;
+    }
+  }
+  return false;
+}
+
+static bool IsRecurrent(const Nnet &nnet) {
+  for (int32 c = 0; c < nnet.NumComponents(); c++) {
+    Component::ComponentType type = nnet.GetComponent(c).GetType();
+    if (type == Component::kLstmProjectedStreams ||
+        type == Component::kBLstmProjectedStreams)
+      return true;
+  }
+  return false;
+}
+
+// Does the forward pass of "nnet" for a batch of utterances (the transformed
+// features), and puts the outputs, concatenated in the same order, in
+// "nnet_out".  If num_stream == 0, the utterances are concatenated, which is
+// only correct for nets without context (see HasFrameContext()) or with a
+// single utterance (nnet-forward's original per-utterance mode).  Otherwise
+// the net is recurrent, and the utterances (at most num_stream of them) go
+// in parallel streams, with frame t of stream s at row t*num_stream+s, padded
+// with zeros to the longest one.
+static void ForwardBatch(const std::vector<CuMatrix<BaseFloat> > &feats,
+                         int32 num_stream,
+                         Nnet *nnet,
+                         CuMatrix<BaseFloat> *nnet_out) {
+  int32 num_utts = feats.size();
+  KALDI_ASSERT(num_utts > 0);
+  if (num_utts == 1 && num_stream == 0) {
+    nnet->Feedforward(feats[0], nnet_out);
+    return;
+  }
+  // concatenate,
+  int32 num_rows = 0, num_cols = feats[0].NumCols(), max_len = 0;
+  for (int32 i = 0; i < num_utts; i++) {
+    num_rows += feats[i].NumRows();
+    max_len = std::max(max_len, feats[i].NumRows());
+  }
+  CuMatrix<BaseFloat> feats_concat(num_rows, num_cols, kUndefined);
+  for (int32 i = 0, offset = 0; i < num_utts; i++) {
+    feats_concat.RowRange(offset, feats[i].NumRows()).CopyFromMat(feats[i]);
+    offset += feats[i].NumRows();
+  }
+  if (num_stream == 0) {
+    nnet->Feedforward(feats_concat, nnet_out);
+    return;
+  }
+  // interleave the streams, and back,
+  KALDI_ASSERT(num_utts <= num_stream);
+  int32 S = num_stream, T = max_len;
+  std::vector<MatrixIndexT> to_streams(T * S, -1), from_streams(num_rows);
+  std::vector<int32> seq_lengths(S, 0);
+  for (int32 s = 0, offset = 0; s < num_utts; s++) {
+    seq_lengths[s] = feats[s].NumRows();
+    for (int32 t = 0; t < seq_lengths[s]; t++) {
+      to_streams[t * S + s] = offset + t;
+      from_streams[offset + t] = t * S + s;
+    }
+    offset += seq_lengths[s];
+  }
+  CuMatrix<BaseFloat> feats_streams(T * S, num_cols, kUndefined), out_streams;
+  feats_streams.CopyRows(feats_concat, CuArray<MatrixIndexT>(to_streams));
+  // all the streams start a new utterance,
+  nnet->ResetLstmStreams(std::vector<int32>(S, 1));
+  nnet->SetSeqLengths(seq_lengths);
+  nnet->Feedforward(feats_streams, &out_streams);
+  nnet_out->Resize(num_rows, out_streams.NumCols(), kUndefined);
+  nnet_out->CopyRows(out_streams, CuArray<MatrixIndexT>(from_streams));
+}
+
+}  // namespace nnet1
+}  // namespace kaldi
+
+
 int main(int argc, char *argv[]) {
   using namespace kaldi;
   using namespace kaldi::nnet1;
@@ -36,7 +131,9 @@ int main(int argc, char *argv[]) {
         "\n"
         "Usage:  nnet-forward [options] <model-in> <feature-rspecifier> <feature-wspecifier>\n"
         "e.g.: \n"
-        " nnet-forward nnet ark:features.ark ark:mlpoutput.ark\n";
+        " nnet-forward nnet ark:features.ark ark:mlpoutput.ark\n"
+        "For many short utterances, use --batch-frames (feedforward nets) or\n"
+        "--num-stream (recurrent nets) to forward several utterances at a time.\n";
 
     ParseOptions po(usage);
 
@@ -61,6 +158,13 @@ int main(int argc, char *argv[]) {
     int32 time_shift = 0;
     po.Register("time-shift", &time_shift, "LSTM : repeat last input frame N-times, discrad N initial output frames."); 
 
+    int32 batch_frames = 0;
+    po.Register("batch-frames", &batch_frames, "Feedforward nets : concatenate utterances up to this number of frames "
+                "for a single forward pass [ 0 == per-utterance ]"); 
+    int32 num_stream = 0;
+    po.Register("num-stream", &num_stream, "LSTM : forward this many utterances at a time, in parallel streams "
+                "[ 0 == per-utterance ]"); 
+
     po.Read(argc, argv);
 
     if (po.NumArgs() != 3) {
@@ -100,6 +204,23 @@ int main(int argc, char *argv[]) {
       KALDI_ERR << "Cannot use both --apply-log=true --no-softmax=true, use only one of the two!";
     }
 
+    // check the batching is possible,
+    if (batch_frames > 0 || num_stream > 0) {
+      if (batch_frames > 0 && num_stream > 0) {
+        KALDI_ERR << "Cannot use both --batch-frames and --num-stream, use only one of the two!";
+      }
+      if (HasFrameContext(nnet)) {
+        KALDI_ERR << "Cannot forward several utterances at a time, the nnet " << model_filename
+                  << " has components with frame context (move the splicing to the --feature-transform)";
+      }
+      if (batch_frames > 0 && IsRecurrent(nnet)) {
+        KALDI_ERR << "The nnet " << model_filename << " is recurrent, use --num-stream instead of --batch-frames";
+      }
+      if (num_stream > 0 && !IsRecurrent(nnet)) {
+        KALDI_ERR << "The nnet " << model_filename << " is not recurrent, use --batch-frames instead of --num-stream";
+      }
+    }
+
     // we will subtract log-priors later,
     PdfPrior pdf_prior(prior_opts); 
 
@@ -115,52 +236,76 @@ int main(int argc, char *argv[]) {
     CuMatrix<BaseFloat> feats, feats_transf, nnet_out;
     Matrix<BaseFloat> nnet_out_host;
 
+    // the utterances of the current batch (the transformed features),
+    std::vector<std::string> batch_keys;
+    std::vector<CuMatrix<BaseFloat> > batch_feats;
+    int32 batch_num_frames = 0;
 
     Timer time;
     double time_now = 0;
     int32 num_done = 0;
     // iterate over all feature files
-    for (; !feature_reader.Done(); feature_reader.Next()) {
-      // read
-      Matrix<BaseFloat> mat = feature_reader.Value();
-      std::string utt = feature_reader.Key();
-      KALDI_VLOG(2) << "Processing utterance " << num_done+1 
-                    << ", " << utt
-                    << ", " << mat.NumRows() << "frm";
+    for (; !feature_reader.Done() || !batch_keys.empty(); ) {
+      if (!feature_reader.Done()) {
+        // read
+        Matrix<BaseFloat> mat = feature_reader.Value();
+        std::string utt = feature_reader.Key();
+        KALDI_VLOG(2) << "Processing utterance " << num_done+1 
+                      << ", " << utt
+                      << ", " << mat.NumRows() << "frm";
 
-      
-      if (!KALDI_ISFINITE(mat.Sum())) { // check there's no nan/inf,
-        KALDI_ERR << "NaN or inf found in features for " << utt;
-      }
+        
+        if (!KALDI_ISFINITE(mat.Sum())) { // check there's no nan/inf,
+          KALDI_ERR << "NaN or inf found in features for " << utt;
+        }
 
-      // time-shift, copy the last frame of LSTM input N-times,
-      if (time_shift > 0) {
-        int32 last_row = mat.NumRows() - 1; // last row,
-        mat.Resize(mat.NumRows() + time_shift, mat.NumCols(), kCopyData);
-        for (int32 r = last_row+1; r<mat.NumRows(); r++) {
-          mat.CopyRowFromVec(mat.Row(last_row), r); // copy last row,
+        // time-shift, copy the last frame of LSTM input N-times,
+        if (time_shift > 0) {
+          int32 last_row = mat.NumRows() - 1; // last row,
+          mat.Resize(mat.NumRows() + time_shift, mat.NumCols(), kCopyData);
+          for (int32 r = last_row+1; r<mat.NumRows(); r++) {
+            mat.CopyRowFromVec(mat.Row(last_row), r); // copy last row,
+          }
+        }
+        
+        // push it to gpu,
+        feats = mat;
+
+        // fwd-pass, feature transform (per utterance, as it may splice frames),
+        nnet_transf.Feedforward(feats, &feats_transf);
+        if (!KALDI_ISFINITE(feats_transf.Sum())) { // check there's no nan/inf,
+          KALDI_ERR << "NaN or inf found in transformed-features for " << utt;
         }
-      }
-      
-      // push it to gpu,
-      feats = mat;
 
-      // fwd-pass, feature transform,
-      nnet_transf.Feedforward(feats, &feats_transf);
-      if (!KALDI_ISFINITE(feats_transf.Sum())) { // check there's no nan/inf,
-        KALDI_ERR << "NaN or inf found in transformed-features for " << utt;
+        // add to the batch,
+        batch_keys.push_back(utt);
+        batch_feats.resize(batch_feats.size() + 1);
+        batch_feats.back().Swap(&feats_transf);
+        batch_num_frames += batch_feats.back().NumRows();
+        tot_t += mat.NumRows();
+        feature_reader.Next();
+
+        // wait for more utterances, if the batch is not full,
+        bool batch_full = (batch_frames > 0 ? batch_num_frames >= batch_frames :
+                           num_stream > 0 ? batch_keys.size() >= num_stream : true);
+        if (!batch_full && !feature_reader.Done()) continue;
+      }
+      // a description of the batch, for the messages,
+      std::string utts = batch_keys[0];
+      if (batch_keys.size() > 1) {
+        utts += " (and " + ToString(batch_keys.size() - 1) + " more utterances)";
       }
 
       // fwd-pass, nnet,
-      nnet.Feedforward(feats_transf, &nnet_out);
+      ForwardBatch(batch_feats, num_stream, &nnet, &nnet_out);
       if (!KALDI_ISFINITE(nnet_out.Sum())) { // check there's no nan/inf,
-        KALDI_ERR << "NaN or inf found in nn-output for " << utt;
+        KALDI_ERR << "NaN or inf found in nn-output for " << utts;
       }
       
       // convert posteriors to log-posteriors,
       if (apply_log) {
         if (!(nnet_out.Min() >= 0.0 && nnet_out.Max() <= 1.0)) {
-          KALDI_WARN << utt << " "
+          KALDI_WARN << utts << " "
                      << "Applying 'log' to data which don't seem to be probabilities "
                      << "(is there a softmax somwhere?)";
         }
@@ -171,7 +316,7 @@ int main(int argc, char *argv[]) {
       // subtract log-priors from log-posteriors or pre-softmax,
       if (prior_opts.class_frame_counts != "") {
         if (nnet_out.Min() >= 0.0 && nnet_out.Max() <= 1.0) {
-          KALDI_WARN << utt << " " 
+          KALDI_WARN << utts << " " 
                      << "Subtracting log-prior on 'probability-like' data in range [0..1] " 
                      << "(Did you forget --no-softmax=true or --apply-log=true ?)";
         }
@@ -182,27 +327,36 @@ int main(int argc, char *argv[]) {
       nnet_out_host.Resize(nnet_out.NumRows(), nnet_out.NumCols());
       nnet_out.CopyToMat(&nnet_out_host);
 
-      // time-shift, remove N first frames of LSTM output,
-      if (time_shift > 0) {
-        Matrix<BaseFloat> tmp(nnet_out_host);
-        nnet_out_host = tmp.RowRange(time_shift, tmp.NumRows() - time_shift);
-      }
+      // split by utterance,
+      for (int32 i = 0, offset = 0; i < batch_keys.size(); i++) {
+        int32 num_rows = batch_feats[i].NumRows();
+        Matrix<BaseFloat> utt_out(nnet_out_host.RowRange(offset, num_rows));
+        offset += num_rows;
 
-      // write,
-      if (!KALDI_ISFINITE(nnet_out_host.Sum())) { // check there's no nan/inf,
-        KALDI_ERR << "NaN or inf found in final output nn-output for " << utt;
-      }
-      feature_writer.Write(feature_reader.Key(), nnet_out_host);
-
-      // progress log
-      if (num_done % 100 == 0) {
-        time_now = time.Elapsed();
-        KALDI_VLOG(1) << "After " << num_done << " utterances: time elapsed = "
-                      << time_now/60 << " min; processed " << tot_t/time_now
-                      << " frames per second.";
+        // time-shift, remove N first frames of LSTM output,
+        if (time_shift > 0) {
+          Matrix<BaseFloat> tmp(utt_out);
+          utt_out = tmp.RowRange(time_shift, tmp.NumRows() - time_shift);
+        }
+
+        // write,
+        if (!KALDI_ISFINITE(utt_out.Sum())) { // check there's no nan/inf,
+          KALDI_ERR << "NaN or inf found in final output nn-output for " << batch_keys[i];
+        }
+        feature_writer.Write(batch_keys[i], utt_out);
+
+        // progress log
+        if (num_done % 100 == 0) {
+          time_now = time.Elapsed();
+          KALDI_VLOG(1) << "After " << num_done << " utterances: time elapsed = "
+                        << time_now/60 << " min; processed " << tot_t/time_now
+                        << " frames per second.";
+        }
+        num_done++;
       }
-      num_done++;
-      tot_t += mat.NumRows();
+      batch_keys.clear();
+      batch_feats.clear();
+      batch_num_frames = 0;
     }
     
     // final message
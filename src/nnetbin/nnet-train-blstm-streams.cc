@@ -17,6 +17,8 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <numeric>
 #include "nnet/nnet-trnopts.h"
 #include "nnet/nnet-nnet.h"
 #include "nnet/nnet-loss.h"
@@ -68,6 +70,12 @@ int main(int argc, char *argv[]) {
     double frame_limit = 100000;
     po.Register("frame-limit", &frame_limit, "Max number of frames to be processed");
 
+    int32 sort_pool_size = 0;
+    po.Register("sort-pool-size", &sort_pool_size, "If > 0, read this many "
+                "sequences at a time and sort them on length before grouping "
+                "them into sets of num_streams, to reduce the padding "
+                "(e.g. 1000)");
+
     int32 report_step = 100;
     po.Register("report-step", &report_step, "Step (number of sequences) for status reporting");
 
@@ -125,21 +133,24 @@ int main(int argc, char *argv[]) {
 
     Timer time;
     KALDI_LOG << (crossvalidate?"CROSS-VALIDATION":"TRAINING") << " STARTED";
-    // Feature matrix of every utterance
-    std::vector< Matrix<BaseFloat> > feats_utt(num_streams);
-    // Label vector of every utterance
-    std::vector< Posterior > labels_utt(num_streams);
-    std::vector< Vector<BaseFloat> > weights_utt(num_streams);
-
     int32 feat_dim = nnet.InputDim();
 
+    // The utterances that have been read but not trained on yet; they are
+    // grouped into sets of up to num_streams utterances, which are padded to
+    // the length of the longest one.  With --sort-pool-size, we read that
+    // many utterances at a time and sort them on length before grouping them,
+    // so that there is less padding.
+    std::vector<std::pair<int32, int32> > pool;  // (length, index in *_utt).
+    std::vector<Matrix<BaseFloat> > feats_utt;
+    std::vector<Posterior> labels_utt;
+    std::vector<Vector<BaseFloat> > weights_utt;
+    int32 pool_size = std::max(sort_pool_size, num_streams);
+
     int32 num_done = 0, num_no_tgt_mat = 0, num_other_error = 0;
+    kaldi::int64 total_padded_frames = 0;
     while (1) {
-
-      std::vector<int32> frame_num_utt;
-      int32 sequence_index = 0, max_frame_num = 0;
-
-      for ( ; !feature_reader.Done(); feature_reader.Next()) {
+      for ( ; !feature_reader.Done() && pool.size() < pool_size;
+           feature_reader.Next()) {
         std::string utt = feature_reader.Key();
         // Check that we have targets
         if (!targets_reader.HasKey(utt)) {
@@ -179,86 +190,124 @@ int main(int argc, char *argv[]) {
             continue;
           }
         }
-
-        if (max_frame_num < mat.NumRows()) max_frame_num = mat.NumRows();
-        feats_utt[sequence_index] = mat;
-        labels_utt[sequence_index] = targets;
-        weights_utt[sequence_index] = weights;
-
-        frame_num_utt.push_back(mat.NumRows());
-        sequence_index++;
-        // If the total number of frames reaches frame_limit, then stop adding more sequences, regardless of whether
-        // the number of utterances reaches num_sequence or not.
-        if (frame_num_utt.size() == num_streams || frame_num_utt.size() * max_frame_num > frame_limit) {
-            feature_reader.Next(); break;
+        // find a free slot in the buffers.
+        int32 index = 0;
+        std::vector<bool> used(feats_utt.size(), false);
+        for (size_t i = 0; i < pool.size(); i++) used[pool[i].second] = true;
+        while (index < used.size() && used[index]) index++;
+        if (index == feats_utt.size()) {
+          feats_utt.resize(index + 1);
+          labels_utt.resize(index + 1);
+          weights_utt.resize(index + 1);
         }
+        feats_utt[index].Swap(&mat);
+        labels_utt[index].swap(targets);
+        weights_utt[index] = weights;
+        pool.push_back(std::make_pair(feats_utt[index].NumRows(), index));
       }
-      int32 cur_sequence_num = frame_num_utt.size();
-
-      // Create the final feature matrix. Every utterance is padded to the max length within this group of utterances
-      Matrix<BaseFloat> feat_mat_host(cur_sequence_num * max_frame_num, feat_dim, kSetZero);
-      Posterior target_host;
-      Vector<BaseFloat> weight_host;
-
-      target_host.resize(cur_sequence_num * max_frame_num);
-      weight_host.Resize(cur_sequence_num * max_frame_num, kSetZero);
-
-      for (int s = 0; s < cur_sequence_num; s++) {
-        Matrix<BaseFloat> mat_tmp = feats_utt[s];
-        for (int r = 0; r < frame_num_utt[s]; r++) {
-          feat_mat_host.Row(r*cur_sequence_num + s).CopyFromVec(mat_tmp.Row(r));
+      if (pool.empty()) break;
+
+      if (sort_pool_size > 0)
+        std::sort(pool.begin(), pool.end());
+
+      // Split the pool into groups.  If the total number of frames reaches
+      // frame_limit, then stop adding more sequences, regardless of whether
+      // the number of utterances reaches num_streams or not.  A group that
+      // isn't full is kept for next time, unless we have read everything.
+      std::vector<std::pair<size_t, size_t> > groups;  // ranges of "pool".
+      size_t begin = 0;
+      int32 group_max_frames = 0;
+      for (size_t i = 0; i < pool.size(); i++) {
+        group_max_frames = std::max(group_max_frames, pool[i].first);
+        size_t group_size = i + 1 - begin;
+        if (group_size == num_streams ||
+            group_size * group_max_frames > frame_limit) {
+          groups.push_back(std::make_pair(begin, i + 1));
+          begin = i + 1;
+          group_max_frames = 0;
         }
       }
-
-      for (int s = 0; s < cur_sequence_num; s++) {
-        Posterior target_tmp = labels_utt[s];
-        for (int r = 0; r < frame_num_utt[s]; r++) {
-          target_host[r*cur_sequence_num+s] = target_tmp[r];
+      if (begin < pool.size() && feature_reader.Done())
+        groups.push_back(std::make_pair(begin, pool.size()));
+      if (sort_pool_size > 0)  // don't always go from short to long ones.
+        std::random_shuffle(groups.begin(), groups.end());
+
+      for (size_t g = 0; g < groups.size(); g++) {
+        std::vector<int32> frame_num_utt;
+        int32 max_frame_num = 0;
+        for (size_t i = groups[g].first; i < groups[g].second; i++) {
+          frame_num_utt.push_back(pool[i].first);
+          max_frame_num = std::max(max_frame_num, pool[i].first);
         }
-        Vector<BaseFloat> weight_tmp = weights_utt[s];
-        for (int r = 0; r < frame_num_utt[s]; r++) {
-          weight_host(r*cur_sequence_num+s) = weight_tmp(r);
+        int32 cur_sequence_num = frame_num_utt.size();
+
+        // Create the final feature matrix. Every utterance is padded to the max length within this group of utterances
+        Matrix<BaseFloat> feat_mat_host(cur_sequence_num * max_frame_num, feat_dim, kSetZero);
+        Posterior target_host;
+        Vector<BaseFloat> weight_host;
+
+        target_host.resize(cur_sequence_num * max_frame_num);
+        weight_host.Resize(cur_sequence_num * max_frame_num, kSetZero);
+
+        for (int s = 0; s < cur_sequence_num; s++) {
+          int32 index = pool[groups[g].first + s].second;
+          const Matrix<BaseFloat> &mat_tmp = feats_utt[index];
+          const Posterior &target_tmp = labels_utt[index];
+          const Vector<BaseFloat> &weight_tmp = weights_utt[index];
+          for (int r = 0; r < frame_num_utt[s]; r++) {
+            feat_mat_host.Row(r*cur_sequence_num + s).CopyFromVec(mat_tmp.Row(r));
+            target_host[r*cur_sequence_num+s] = target_tmp[r];
+            weight_host(r*cur_sequence_num+s) = weight_tmp(r);
+          }
         }
-      }
-
-      // transform feature
-      nnet_transf.Feedforward(CuMatrix<BaseFloat>(feat_mat_host), &feats_transf);
 
-      // Set the original lengths of utterances before padding
-      nnet.SetSeqLengths(frame_num_utt);
+        // transform feature
+        nnet_transf.Feedforward(CuMatrix<BaseFloat>(feat_mat_host), &feats_transf);
 
-      // Propagation and xent training
-      nnet.Propagate(feats_transf, &nnet_out);
+        // Set the original lengths of utterances before padding
+        nnet.SetSeqLengths(frame_num_utt);
 
-      if (objective_function == "xent") {
-          // gradients re-scaled by weights in Eval,
-          xent.Eval(weight_host, nnet_out, target_host, &obj_diff);
-      } else if (objective_function == "mse") {
-          // gradients re-scaled by weights in Eval,
-          mse.Eval(weight_host, nnet_out, target_host, &obj_diff);
-      } else {
-          KALDI_ERR << "Unknown objective function code : " << objective_function;
-      }
+        // Propagation and xent training
+        nnet.Propagate(feats_transf, &nnet_out);
 
-      // Backward pass
-      if (!crossvalidate) {
-        nnet.Backpropagate(obj_diff, NULL);
-      }
+        if (objective_function == "xent") {
+            // gradients re-scaled by weights in Eval,
+            xent.Eval(weight_host, nnet_out, target_host, &obj_diff);
+        } else if (objective_function == "mse") {
+            // gradients re-scaled by weights in Eval,
+            mse.Eval(weight_host, nnet_out, target_host, &obj_diff);
+        } else {
+            KALDI_ERR << "Unknown objective function code : " << objective_function;
+        }
 
-      // 1st minibatch : show what happens in network
-      if (kaldi::g_kaldi_verbose_level >= 2 && total_frames == 0) {  // vlog-1
-        KALDI_VLOG(1) << "### After " << total_frames << " frames,";
-        KALDI_VLOG(1) << nnet.InfoPropagate();
+        // Backward pass
         if (!crossvalidate) {
-          KALDI_VLOG(1) << nnet.InfoBackPropagate();
-          KALDI_VLOG(1) << nnet.InfoGradient();
+          nnet.Backpropagate(obj_diff, NULL);
         }
-      }
 
-      num_done += cur_sequence_num;
-      total_frames += feats_transf.NumRows();
+        // 1st minibatch : show what happens in network
+        if (kaldi::g_kaldi_verbose_level >= 2 && total_frames == 0) {  // vlog-1
+          KALDI_VLOG(1) << "### After " << total_frames << " frames,";
+          KALDI_VLOG(1) << nnet.InfoPropagate();
+          if (!crossvalidate) {
+            KALDI_VLOG(1) << nnet.InfoBackPropagate();
+            KALDI_VLOG(1) << nnet.InfoGradient();
+          }
+        }
+
+        num_done += cur_sequence_num;
+        total_frames += feats_transf.NumRows();
+        total_padded_frames += feats_transf.NumRows() -
+            std::accumulate(frame_num_utt.begin(), frame_num_utt.end(), 0);
+      }
 
-      if (feature_reader.Done()) break;  // end loop of while(1)
+      // remove the groups we have trained on from the pool.
+      std::vector<std::pair<int32, int32> > remaining;
+      size_t num_used = 0;
+      for (size_t g = 0; g < groups.size(); g++)
+        num_used = std::max(num_used, groups[g].second);
+      remaining.insert(remaining.end(), pool.begin() + num_used, pool.end());
+      pool.swap(remaining);
     }
 
     // Check network parameters and gradients when training finishes
@@ -281,6 +330,8 @@ int main(int argc, char *argv[]) {
               << "[" << (crossvalidate?"CROSS-VALIDATION":"TRAINING")
               << ", " << time.Elapsed()/60 << " min, fps" << total_frames/time.Elapsed()
               << "]";
+    KALDI_LOG << "Of " << total_frames << " frames, " << total_padded_frames
+              << " were padding.";
     KALDI_LOG << xent.Report();
 
 #if HAVE_CUDA == 1
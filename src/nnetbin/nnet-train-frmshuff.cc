@@ -23,8 +23,141 @@
 #include "nnet/nnet-randomizer.h"
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
+#include "util/stl-utils.h"
 #include "base/timer.h"
 #include "cudamatrix/cu-device.h"
+#include "thread/kaldi-future.h"
+
+namespace kaldi {
+namespace nnet1 {
+
+// The utterances for one fill of the randomizers, read and checked on the CPU.
+struct FrameBuffer {
+  std::vector<Matrix<BaseFloat> > feats;
+  std::vector<Posterior> targets;
+  std::vector<Vector<BaseFloat> > weights;
+  int32 num_no_tgt_mat, num_other_error;
+  bool done;  // true if the feature reader is done after this buffer.
+  FrameBuffer(): num_no_tgt_mat(0), num_other_error(0), done(false) { }
+};
+
+// Reads utterances with their targets and weights, correcting small length
+// mismatches and dropping the bad ones, until it has more than "num_frames"
+// frames or the features are done, and returns them in a newly allocated
+// FrameBuffer.  If the data is split between parallel jobs, only the
+// utterances of this job are used.  It only uses the readers and host memory,
+// so with --read-ahead=true it runs on the ThreadPool, while the previous
+// buffer is being trained on; the feature transform is done by the caller, as
+// it runs on the GPU.
+class FrameBufferReader {
+ public:
+  typedef FrameBuffer* result_type;
+
+  // "weights_reader" and "utt_weights_reader" may be NULL.
+  FrameBufferReader(SequentialBaseFloatMatrixReader *feature_reader,
+                    RandomAccessPosteriorReader *targets_reader,
+                    RandomAccessBaseFloatVectorReader *weights_reader,
+                    RandomAccessBaseFloatReader *utt_weights_reader,
+                    int32 length_tolerance, int32 num_frames,
+                    int32 num_jobs, int32 job_index):
+      feature_reader_(feature_reader), targets_reader_(targets_reader),
+      weights_reader_(weights_reader), utt_weights_reader_(utt_weights_reader),
+      length_tolerance_(length_tolerance), num_frames_(num_frames),
+      num_jobs_(num_jobs), job_index_(job_index) { }
+
+  FrameBuffer *operator () () const {
+    FrameBuffer *buffer = new FrameBuffer();
+    int32 num_frames = 0;
+    for ( ; !feature_reader_->Done(); feature_reader_->Next()) {
+      if (num_frames > num_frames_) break; // keep utt for next buffer
+      std::string utt = feature_reader_->Key();
+      // skip the utterances of the other jobs
+      if (num_jobs_ > 1 && StringHasher()(utt) % num_jobs_ != job_index_) continue;
+      KALDI_VLOG(3) << "Reading " << utt;
+      // check that we have targets
+      if (!targets_reader_->HasKey(utt)) {
+        KALDI_WARN << utt << ", missing targets";
+        buffer->num_no_tgt_mat++;
+        continue;
+      }
+      // check we have per-frame weights
+      if (weights_reader_ != NULL && !weights_reader_->HasKey(utt)) {
+        KALDI_WARN << utt << ", missing per-frame weights";
+        buffer->num_other_error++;
+        continue;
+      }
+      // check we have per-utterance weights
+      if (utt_weights_reader_ != NULL && !utt_weights_reader_->HasKey(utt)) {
+        KALDI_WARN << utt << ", missing per-utterance weight";
+        buffer->num_other_error++;
+        continue;
+      }
+      // get feature / target pair
+      Matrix<BaseFloat> mat = feature_reader_->Value();
+      Posterior targets = targets_reader_->Value(utt);
+      // get per-frame weights
+      Vector<BaseFloat> weights;
+      if (weights_reader_ != NULL) {
+        weights = weights_reader_->Value(utt);
+      } else { // all per-frame weights are 1.0
+        weights.Resize(mat.NumRows());
+        weights.Set(1.0);
+      }
+      // multiply with per-utterance weight,
+      if (utt_weights_reader_ != NULL) {
+        BaseFloat w = utt_weights_reader_->Value(utt);
+        KALDI_ASSERT(w >= 0.0);
+        if (w == 0.0) continue; // remove sentence from training,
+        weights.Scale(w);
+      }
+
+      // correct small length mismatch ... or drop sentence
+      {
+        // add lengths to vector
+        std::vector<int32> lenght;
+        lenght.push_back(mat.NumRows());
+        lenght.push_back(targets.size());
+        lenght.push_back(weights.Dim());
+        // find min, max
+        int32 min = *std::min_element(lenght.begin(),lenght.end());
+        int32 max = *std::max_element(lenght.begin(),lenght.end());
+        // fix or drop ?
+        if (max - min < length_tolerance_) {
+          if(mat.NumRows() != min) mat.Resize(min, mat.NumCols(), kCopyData);
+          if(targets.size() != min) targets.resize(min);
+          if(weights.Dim() != min) weights.Resize(min, kCopyData);
+        } else {
+          KALDI_WARN << utt << ", length mismatch of targets " << targets.size()
+                     << " and features " << mat.NumRows();
+          buffer->num_other_error++;
+          continue;
+        }
+      }
+      // store, without copying the data again
+      buffer->feats.resize(buffer->feats.size() + 1);
+      buffer->feats.back().Swap(&mat);
+      buffer->targets.resize(buffer->targets.size() + 1);
+      buffer->targets.back().swap(targets);
+      buffer->weights.resize(buffer->weights.size() + 1);
+      buffer->weights.back().Swap(&weights);
+      num_frames += buffer->feats.back().NumRows();
+    }
+    buffer->done = feature_reader_->Done();
+    return buffer;
+  }
+
+ private:
+  SequentialBaseFloatMatrixReader *feature_reader_;
+  RandomAccessPosteriorReader *targets_reader_;
+  RandomAccessBaseFloatVectorReader *weights_reader_;
+  RandomAccessBaseFloatReader *utt_weights_reader_;
+  int32 length_tolerance_;
+  int32 num_frames_;
+  int32 num_jobs_, job_index_;
+};
+
+}  // namespace nnet1
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   using namespace kaldi;
@@ -70,6 +203,17 @@ int main(int argc, char *argv[]) {
     std::string use_gpu="yes";
     po.Register("use-gpu", &use_gpu, "yes|no|optional, only has effect if compiled with CUDA");
     
+    bool read_ahead = false;
+    po.Register("read-ahead", &read_ahead, "Read and check the utterances for the next fill of the randomizer "
+                "in a background thread, while training on the current one (see also the 'bg' option of "
+                "the feature rspecifier)");
+
+    int32 num_jobs = 1, job_index = 0;
+    po.Register("num-jobs", &num_jobs, "Number of parallel training jobs (on different GPUs), "
+                "whose models get averaged by nnet-average; see --job-index");
+    po.Register("job-index", &job_index, "Index of this job, 0..num-jobs-1: we only use the "
+                "utterances whose key hashes to it");
+
     double dropout_retention = 0.0;
     po.Register("dropout-retention", &dropout_retention, "number between 0..1, saying how many neurons to preserve (0.0 will keep original value");
      
@@ -80,6 +224,7 @@ int main(int argc, char *argv[]) {
       po.PrintUsage();
       exit(1);
     }
+    KALDI_ASSERT(num_jobs >= 1 && job_index >= 0 && job_index < num_jobs);
 
     std::string feature_rspecifier = po.GetArg(1),
       targets_rspecifier = po.GetArg(2),
@@ -153,84 +298,43 @@ int main(int argc, char *argv[]) {
     Timer time;
     KALDI_LOG << (crossvalidate?"CROSS-VALIDATION":"TRAINING") << " STARTED";
 
+    FrameBufferReader buffer_reader(&feature_reader, &targets_reader,
+                                    (frame_weights != "" ? &weights_reader : NULL),
+                                    (utt_weights != "" ? &utt_weights_reader : NULL),
+                                    length_tolerance, rnd_opts.randomizer_size,
+                                    num_jobs, job_index);
+    Future<FrameBuffer*> next_buffer;
+    if (read_ahead && !feature_reader.Done()) {
+      next_buffer = Async(buffer_reader);
+    }
+
     int32 num_done = 0, num_no_tgt_mat = 0, num_other_error = 0;
-    while (!feature_reader.Done()) {
+    bool done = feature_reader.Done();
+    while (!done) {
 #if HAVE_CUDA==1
       // check the GPU is not overheated
       CuDevice::Instantiate().CheckGpuHealth();
 #endif
-      // fill the randomizer
-      for ( ; !feature_reader.Done(); feature_reader.Next()) {
-        if (feature_randomizer.IsFull()) break; // suspend, keep utt for next loop
-        std::string utt = feature_reader.Key();
-        KALDI_VLOG(3) << "Reading " << utt;
-        // check that we have targets
-        if (!targets_reader.HasKey(utt)) {
-          KALDI_WARN << utt << ", missing targets";
-          num_no_tgt_mat++;
-          continue;
-        }
-        // check we have per-frame weights
-        if (frame_weights != "" && !weights_reader.HasKey(utt)) {
-          KALDI_WARN << utt << ", missing per-frame weights";
-          num_other_error++;
-          continue;
-        }
-        // check we have per-utterance weights
-        if (utt_weights != "" && !utt_weights_reader.HasKey(utt)) {
-          KALDI_WARN << utt << ", missing per-utterance weight";
-          num_other_error++;
-          continue;
-        }
-        // get feature / target pair
-        Matrix<BaseFloat> mat = feature_reader.Value();
-        Posterior targets = targets_reader.Value(utt);
-        // get per-frame weights
-        Vector<BaseFloat> weights;
-        if (frame_weights != "") {
-          weights = weights_reader.Value(utt);
-        } else { // all per-frame weights are 1.0
-          weights.Resize(mat.NumRows());
-          weights.Set(1.0);
-        }
-        // multiply with per-utterance weight,
-        if (utt_weights != "") {
-          BaseFloat w = utt_weights_reader.Value(utt);
-          KALDI_ASSERT(w >= 0.0);
-          if (w == 0.0) continue; // remove sentence from training,
-          weights.Scale(w);
-        }
+      // get the utterances, and start reading the next ones
+      FrameBuffer *buffer = (read_ahead ? next_buffer.Get() : buffer_reader());
+      done = buffer->done;
+      if (read_ahead && !done) {
+        next_buffer = Async(buffer_reader);
+      }
+      num_no_tgt_mat += buffer->num_no_tgt_mat;
+      num_other_error += buffer->num_other_error;
+      int32 num_utts = buffer->feats.size();
 
-        // correct small length mismatch ... or drop sentence
-        {
-          // add lengths to vector
-          std::vector<int32> lenght;
-          lenght.push_back(mat.NumRows());
-          lenght.push_back(targets.size());
-          lenght.push_back(weights.Dim());
-          // find min, max
-          int32 min = *std::min_element(lenght.begin(),lenght.end());
-          int32 max = *std::max_element(lenght.begin(),lenght.end());
-          // fix or drop ?
-          if (max - min < length_tolerance) {
-            if(mat.NumRows() != min) mat.Resize(min, mat.NumCols(), kCopyData);
-            if(targets.size() != min) targets.resize(min);
-            if(weights.Dim() != min) weights.Resize(min, kCopyData);
-          } else {
-            KALDI_WARN << utt << ", length mismatch of targets " << targets.size()
-                       << " and features " << mat.NumRows();
-            num_other_error++;
-            continue;
-          }
-        }
+      // fill the randomizer
+      for (int32 i = 0; i < num_utts; i++) {
         // apply optional feature transform
-        nnet_transf.Feedforward(CuMatrix<BaseFloat>(mat), &feats_transf);
+        nnet_transf.Feedforward(CuMatrix<BaseFloat>(buffer->feats[i]), &feats_transf);
 
         // pass data to randomizers
-        KALDI_ASSERT(feats_transf.NumRows() == targets.size());
+        KALDI_ASSERT(feats_transf.NumRows() == buffer->targets[i].size());
         feature_randomizer.AddData(feats_transf);
-        targets_randomizer.AddData(targets);
-        weights_randomizer.AddData(weights);
+        targets_randomizer.AddData(buffer->targets[i]);
+        weights_randomizer.AddData(buffer->weights[i]);
         num_done++;
       
         // report the speed
@@ -241,6 +345,8 @@ int main(int argc, char *argv[]) {
                         << " frames per second.";
         }
       }
+      delete buffer;
+      if (num_utts == 0) continue; // nothing was added
 
       // randomize
       if (!crossvalidate && randomize) {
@@ -36,6 +36,7 @@
 #include "nnet/nnet-utils.h"
 #include "base/timer.h"
 #include "cudamatrix/cu-device.h"
+#include "thread/kaldi-future.h"
 
 #include <iomanip>
 
@@ -79,6 +80,246 @@ void LatticeAcousticRescore(const Matrix<BaseFloat> &log_like,
   }
 }
 
+// One utterance for sequence training.  SequenceExampleReader fills in the
+// data, read, checked and pre-processed on the CPU; Forward() then fills in
+// the log-likelihoods, and MmiLatticeTask the rest.
+struct SequenceExample {
+  std::string utt;
+  Matrix<BaseFloat> feats;
+  std::vector<int32> num_ali;
+  Lattice den_lat;  // scaled by --old-acoustic-scale, topologically sorted.
+  std::vector<int32> state_times;
+  Matrix<BaseFloat> log_like;  // nnet output minus the log-priors.
+  Matrix<BaseFloat> nnet_diff;  // derivative w.r.t. the nnet output.
+  double mmi_obj, post_on_ali;
+  std::vector<int32> frm_drop_vec;  // frames with num/den mismatch.
+  // utterances skipped by the reader before this one,
+  int32 num_no_num_ali, num_no_den_lat, num_other_error;
+  bool done;  // true if there was no utterance left; there is no data then.
+  SequenceExample(): mmi_obj(0.0), post_on_ali(0.0), num_no_num_ali(0),
+                     num_no_den_lat(0), num_other_error(0), done(false) { }
+};
+
+// Reads the next utterance which has a numerator alignment and a
+// denominator lattice of the right length, and returns it in a newly
+// allocated SequenceExample, with the lattice scaled and topologically
+// sorted.  It only uses the readers and host memory, so with --pipeline=true
+// it runs on the ThreadPool, reading ahead of the training.
+class SequenceExampleReader {
+ public:
+  typedef SequenceExample* result_type;
+
+  SequenceExampleReader(SequentialBaseFloatMatrixReader *feature_reader,
+                        RandomAccessLatticeReader *den_lat_reader,
+                        RandomAccessInt32VectorReader *num_ali_reader,
+                        BaseFloat old_acoustic_scale, int32 max_frames):
+      feature_reader_(feature_reader), den_lat_reader_(den_lat_reader),
+      num_ali_reader_(num_ali_reader), old_acoustic_scale_(old_acoustic_scale),
+      max_frames_(max_frames) { }
+
+  SequenceExample *operator () () const {
+    SequenceExample *example = new SequenceExample();
+    for ( ; !feature_reader_->Done(); feature_reader_->Next()) {
+      std::string utt = feature_reader_->Key();
+      if (!den_lat_reader_->HasKey(utt)) {
+        KALDI_WARN << "Utterance " << utt << ": found no lattice.";
+        example->num_no_den_lat++;
+        continue;
+      }
+      if (!num_ali_reader_->HasKey(utt)) {
+        KALDI_WARN << "Utterance " << utt << ": found no reference alignment.";
+        example->num_no_num_ali++;
+        continue;
+      }
+
+      // 1) get the features, numerator alignment
+      const Matrix<BaseFloat> &mat = feature_reader_->Value();
+      const std::vector<int32> &num_ali = num_ali_reader_->Value(utt);
+      // check for temporal length of numerator alignments
+      if ((int32)num_ali.size() != mat.NumRows()) {
+        KALDI_WARN << "Numerator alignment has wrong length "
+                   << num_ali.size() << " vs. "<< mat.NumRows();
+        example->num_other_error++;
+        continue;
+      }
+      if (mat.NumRows() > max_frames_) {
+        KALDI_WARN << "Utterance " << utt << ": Skipped because it has "
+                   << mat.NumRows() << " frames, which is more than "
+                   << max_frames_ << ".";
+        example->num_other_error++;
+        continue;
+      }
+
+      // 2) get the denominator lattice, preprocess
+      Lattice &den_lat = example->den_lat;
+      den_lat = den_lat_reader_->Value(utt);
+      if (den_lat.Start() == -1) {
+        KALDI_WARN << "Empty lattice for utt " << utt;
+        example->num_other_error++;
+        continue;
+      }
+      if (old_acoustic_scale_ != 1.0) {
+        fst::ScaleLattice(fst::AcousticLatticeScale(old_acoustic_scale_), &den_lat);
+      }
+      // optional sort it topologically
+      kaldi::uint64 props = den_lat.Properties(fst::kFstProperties, false);
+      if (!(props & fst::kTopSorted)) {
+        if (fst::TopSort(&den_lat) == false)
+          KALDI_ERR << "Cycles detected in lattice.";
+      }
+      // get the lattice length and times of states
+      int32 max_time = kaldi::LatticeStateTimes(den_lat, &example->state_times);
+      // check for temporal length of denominator lattices
+      if (max_time != mat.NumRows()) {
+        KALDI_WARN << "Denominator lattice has wrong length "
+                   << max_time << " vs. " << mat.NumRows();
+        example->num_other_error++;
+        continue;
+      }
+
+      example->utt = utt;
+      example->feats = mat;
+      example->num_ali = num_ali;
+      feature_reader_->Next();
+      return example;
+    }
+    example->done = true;
+    return example;
+  }
+
+ private:
+  SequentialBaseFloatMatrixReader *feature_reader_;
+  RandomAccessLatticeReader *den_lat_reader_;
+  RandomAccessInt32VectorReader *num_ali_reader_;
+  BaseFloat old_acoustic_scale_;
+  int32 max_frames_;
+};
+
+// Does the lattice part of MMI training for an example whose log-likelihoods
+// have been computed: rescores the denominator lattice, does the
+// forward-backward, and computes the objective function and the derivative
+// w.r.t. the nnet output.  It only uses host memory, so with --pipeline=true
+// it runs on the ThreadPool while the GPU trains on the previous example.
+class MmiLatticeTask {
+ public:
+  typedef SequenceExample* result_type;
+
+  MmiLatticeTask(const TransitionModel &trans_model, BaseFloat acoustic_scale,
+                 BaseFloat lm_scale, bool drop_frames,
+                 SequenceExample *example):
+      trans_model_(trans_model), acoustic_scale_(acoustic_scale),
+      lm_scale_(lm_scale), drop_frames_(drop_frames), example_(example) { }
+
+  SequenceExample *operator () () const {
+    const Matrix<BaseFloat> &nnet_out_h = example_->log_like;
+    const std::vector<int32> &num_ali = example_->num_ali;
+    Lattice &den_lat = example_->den_lat;
+    Matrix<BaseFloat> &nnet_diff_h = example_->nnet_diff;
+    int32 num_frames = nnet_out_h.NumRows(),
+        num_pdfs = nnet_out_h.NumCols();
+
+    // 4) rescore the latice
+    LatticeAcousticRescore(nnet_out_h, trans_model_, example_->state_times,
+                           &den_lat);
+    if (acoustic_scale_ != 1.0 || lm_scale_ != 1.0)
+      fst::ScaleLattice(fst::LatticeScale(lm_scale_, acoustic_scale_), &den_lat);
+
+    // 5) get the posteriors
+    kaldi::Posterior post;
+    double lat_ac_like;  // acoustic likelihood weighted by posterior.
+    double lat_like =  // total likelihood of the lattice
+        kaldi::LatticeForwardBackward(den_lat, &post, &lat_ac_like);
+
+    // 6) convert the Posterior to a matrix
+    nnet_diff_h.Resize(num_frames, num_pdfs, kSetZero);
+    for (int32 t = 0; t < post.size(); t++) {
+      for (int32 arc = 0; arc < post[t].size(); arc++) {
+        int32 pdf = trans_model_.TransitionIdToPdf(post[t][arc].first);
+        nnet_diff_h(t, pdf) += post[t][arc].second;
+      }
+    }
+
+    // 7) Calculate the MMI-objective function
+    // Calculate the likelihood of correct path from acoustic score, 
+    // the denominator likelihood is the total likelihood of the lattice.
+    double path_ac_like = 0.0;
+    for(int32 t=0; t<num_frames; t++) {
+      int32 pdf = trans_model_.TransitionIdToPdf(num_ali[t]);
+      path_ac_like += nnet_out_h(t,pdf);
+    }
+    path_ac_like *= acoustic_scale_;
+    example_->mmi_obj = path_ac_like - lat_like; 
+    //
+    // Note: numerator likelihood does not include graph score,
+    // while denominator likelihood contains graph scores.
+    // The result is offset at the MMI-objective.
+    // However the offset is constant for given alignment,
+    // so it is not harmful.
+    
+    // Sum the den-posteriors under the correct path:
+    example_->post_on_ali = 0.0;
+    for(int32 t=0; t<num_frames; t++) {
+      int32 pdf = trans_model_.TransitionIdToPdf(num_ali[t]);
+      double posterior = nnet_diff_h(t, pdf);
+      example_->post_on_ali += posterior;
+    }
+
+    // 7a) Search for the frames with num/den mismatch
+    std::vector<int32> &frm_drop_vec = example_->frm_drop_vec;
+    for(int32 t=0; t<num_frames; t++) {
+      int32 pdf = trans_model_.TransitionIdToPdf(num_ali[t]);
+      double posterior = nnet_diff_h(t, pdf);
+      if(posterior < 1e-20) {
+        frm_drop_vec.push_back(t);
+      }
+    }
+
+    // 8) subtract the pdf-Viterbi-path
+    for(int32 t=0; t<nnet_diff_h.NumRows(); t++) {
+      int32 pdf = trans_model_.TransitionIdToPdf(num_ali[t]);
+      nnet_diff_h(t, pdf) -= 1.0;
+    }
+
+    // 9) Drop mismatched frames from the training by zeroing the derivative
+    if(drop_frames_) {
+      for(int32 i=0; i<frm_drop_vec.size(); i++) {
+        nnet_diff_h.Row(frm_drop_vec[i]).Set(0.0);
+      }
+    }
+    return example_;
+  }
+
+ private:
+  const TransitionModel &trans_model_;
+  BaseFloat acoustic_scale_, lm_scale_;
+  bool drop_frames_;
+  SequenceExample *example_;
+};
+
+// 3) propagates the features of "example" to get the log-posteriors (nnet
+// w/o softmax), and stores them minus the log-priors in example->log_like.
+// With buffered == false we use Nnet::Feedforward(), so this does not
+// prepare "nnet" for Backpropagate().
+void Forward(bool buffered, Nnet *nnet_transf, PdfPrior *log_prior,
+             Nnet *nnet, SequenceExample *example) {
+  CuMatrix<BaseFloat> feats(example->feats), feats_transf, nnet_out;
+  // possibly apply transform
+  nnet_transf->Feedforward(feats, &feats_transf);
+  // propagate through the nnet (assuming w/o softmax)
+  if (buffered) {
+    nnet->Propagate(feats_transf, &nnet_out);
+  } else {
+    nnet->Feedforward(feats_transf, &nnet_out);
+  }
+  // subtract the log_prior
+  if (log_prior != NULL) {
+    log_prior->SubtractOnLogpost(&nnet_out);
+  }
+  // transfer it back to the host
+  example->log_like.Resize(nnet_out.NumRows(), nnet_out.NumCols(), kUndefined);
+  nnet_out.CopyToMat(&example->log_like);
+}
+
 }  // namespace nnet1
 }  // namespace kaldi
 
@@ -130,6 +371,15 @@ int main(int argc, char *argv[]) {
                 "Drop frames, where is zero den-posterior under numerator path "
                 "(ie. path not in lattice)");
 
+    bool pipeline = false;
+    po.Register("pipeline", &pipeline,
+                "Overlap the lattice processing with the nnet training: read "
+                "and sort the lattices ahead, and do the forward-backward for "
+                "each utterance on the CPU while the GPU trains on the previous "
+                "one.  The lattices are then rescored by the nnet before the "
+                "update on the previous utterance, and each utterance is "
+                "propagated twice.");
+
     std::string use_gpu="yes";
     po.Register("use-gpu", &use_gpu, "yes|no|optional, only has effect if compiled with CUDA"); 
 
@@ -188,7 +438,6 @@ int main(int argc, char *argv[]) {
     RandomAccessInt32VectorReader num_ali_reader(num_ali_rspecifier);
 
     CuMatrix<BaseFloat> feats, feats_transf, nnet_out, nnet_diff;
-    Matrix<BaseFloat> nnet_out_h, nnet_diff_h;
 
     if (drop_frames) {
       KALDI_LOG << "--drop-frames=true :"
@@ -206,171 +455,89 @@ int main(int argc, char *argv[]) {
           num_other_error = 0, num_frm_drop = 0;
 
     kaldi::int64 total_frames = 0;
-    double lat_like; // total likelihood of the lattice
-    double lat_ac_like; // acoustic likelihood weighted by posterior.
-    double total_mmi_obj = 0.0, mmi_obj = 0.0;
-    double total_post_on_ali = 0.0, post_on_ali = 0.0;
+    double total_mmi_obj = 0.0;
+    double total_post_on_ali = 0.0;
+
+    SequenceExampleReader example_reader(&feature_reader, &den_lat_reader,
+                                         &num_ali_reader, old_acoustic_scale,
+                                         max_frames);
+    PdfPrior *prior = (prior_opts.class_frame_counts != "" ? &log_prior : NULL);
+
+    // With --pipeline=true, the next example is read on the ThreadPool, and
+    // "prev_example" is the one whose lattice is being processed there, which
+    // we train on once we have started on the lattice of the next one.
+    Future<SequenceExample*> next_example, prev_example;
+    if (pipeline) {
+      next_example = Async(example_reader);
+    }
 
     // do per-utterance processing
-    for( ; !feature_reader.Done(); feature_reader.Next()) {
-      std::string utt = feature_reader.Key();
-      if (!den_lat_reader.HasKey(utt)) { 
-        KALDI_WARN << "Utterance " << utt << ": found no lattice.";
-        num_no_den_lat++;
-        continue;
-      }
-      if (!num_ali_reader.HasKey(utt)) { 
-        KALDI_WARN << "Utterance " << utt << ": found no reference alignment.";
-        num_no_num_ali++;
-        continue;
-      }
-
-      // 1) get the features, numerator alignment
-      const Matrix<BaseFloat> &mat = feature_reader.Value();
-      const std::vector<int32> &num_ali = num_ali_reader.Value(utt);
-      // check for temporal length of numerator alignments
-      if ((int32)num_ali.size() != mat.NumRows()) {
-        KALDI_WARN << "Numerator alignment has wrong length "
-                   << num_ali.size() << " vs. "<< mat.NumRows();
-        num_other_error++;
-        continue;
-      }
-      if (mat.NumRows() > max_frames) {
-    KALDI_WARN << "Utterance " << utt << ": Skipped because it has " << mat.NumRows() << 
-      " frames, which is more than " << max_frames << ".";
-    num_other_error++;
-    continue;
-      }
-      
-      // 2) get the denominator lattice, preprocess
-      Lattice den_lat = den_lat_reader.Value(utt);
-      if (den_lat.Start() == -1) {
-        KALDI_WARN << "Empty lattice for utt " << utt;
-        num_other_error++;
-        continue;
-      }
-      if (old_acoustic_scale != 1.0) {
-        fst::ScaleLattice(fst::AcousticLatticeScale(old_acoustic_scale), &den_lat);
-      }
-      // optional sort it topologically
-      kaldi::uint64 props = den_lat.Properties(fst::kFstProperties, false);
-      if (!(props & fst::kTopSorted)) {
-        if (fst::TopSort(&den_lat) == false)
-          KALDI_ERR << "Cycles detected in lattice.";
-      }
-      // get the lattice length and times of states
-      vector<int32> state_times;
-      int32 max_time = kaldi::LatticeStateTimes(den_lat, &state_times);
-      // check for temporal length of denominator lattices
-      if (max_time != mat.NumRows()) {
-        KALDI_WARN << "Denominator lattice has wrong length "
-                   << max_time << " vs. " << mat.NumRows();
-        num_other_error++;
-        continue;
-      }
-     
-      // get actual dims for this utt and nnet
-      int32 num_frames = mat.NumRows(),
-          num_fea = mat.NumCols(),
-          num_pdfs = nnet.OutputDim();
-      
-      // 3) propagate the feature to get the log-posteriors (nnet w/o sofrmax)
-      // push features to GPU
-      feats.Resize(num_frames, num_fea, kUndefined);
-      feats.CopyFromMat(mat);
-      // possibly apply transform
-      nnet_transf.Feedforward(feats, &feats_transf);
-      // propagate through the nnet (assuming w/o softmax)
-      nnet.Propagate(feats_transf, &nnet_out);
-      // subtract the log_prior
-      if(prior_opts.class_frame_counts != "") {
-        log_prior.SubtractOnLogpost(&nnet_out);
+    bool reader_done = false;
+    while (true) {
+      SequenceExample *example = NULL;
+      if (!reader_done) {
+        example = (pipeline ? next_example.Get() : example_reader());
+        num_no_num_ali += example->num_no_num_ali;
+        num_no_den_lat += example->num_no_den_lat;
+        num_other_error += example->num_other_error;
+        reader_done = example->done;
+        if (reader_done) {
+          delete example;
+          example = NULL;
+        }
       }
-      // transfer it back to the host
-      nnet_out_h.Resize(num_frames,num_pdfs, kUndefined);
-      nnet_out.CopyToMat(&nnet_out_h);
-      // release the buffers we don't need anymore
-      feats.Resize(0,0);
-      feats_transf.Resize(0,0);
-      nnet_out.Resize(0,0);
-
-      // 4) rescore the latice
-      LatticeAcousticRescore(nnet_out_h, trans_model, state_times, &den_lat);
-      if (acoustic_scale != 1.0 || lm_scale != 1.0)
-        fst::ScaleLattice(fst::LatticeScale(lm_scale, acoustic_scale), &den_lat);
-
-      // 5) get the posteriors
-      kaldi::Posterior post;
-      lat_like = kaldi::LatticeForwardBackward(den_lat, &post, &lat_ac_like);
-
-      // 6) convert the Posterior to a matrix
-      nnet_diff_h.Resize(num_frames, num_pdfs, kSetZero);
-      for (int32 t = 0; t < post.size(); t++) {
-        for (int32 arc = 0; arc < post[t].size(); arc++) {
-          int32 pdf = trans_model.TransitionIdToPdf(post[t][arc].first);
-          nnet_diff_h(t, pdf) += post[t][arc].second;
+      if (!pipeline) {
+        if (example == NULL) break;
+        Forward(true, &nnet_transf, prior, &nnet, example);
+        MmiLatticeTask(trans_model, acoustic_scale, lm_scale, drop_frames,
+                       example)();
+      } else {
+        // start reading the next example, get the log-likelihoods for this
+        // one and start on its lattice,
+        Future<SequenceExample*> this_example;
+        if (example != NULL) {
+          next_example = Async(example_reader);
+          Forward(false, &nnet_transf, prior, &nnet, example);
+          this_example = Async(MmiLatticeTask(trans_model, acoustic_scale,
+                                              lm_scale, drop_frames, example));
+        }
+        // and train on the previous one,
+        if (!prev_example.Valid()) {
+          if (example == NULL) break;
+          prev_example = this_example;
+          continue;
         }
+        example = prev_example.Get();
+        prev_example = this_example;
+        // propagate it again, to prepare the nnet for the backpropagation,
+        feats.Resize(example->feats.NumRows(), example->feats.NumCols(), kUndefined);
+        feats.CopyFromMat(example->feats);
+        nnet_transf.Feedforward(feats, &feats_transf);
+        nnet.Propagate(feats_transf, &nnet_out);
+        // release the buffers we don't need anymore
+        feats.Resize(0,0);
+        feats_transf.Resize(0,0);
+        nnet_out.Resize(0,0);
       }
 
-      // 7) Calculate the MMI-objective function
-      // Calculate the likelihood of correct path from acoustic score, 
-      // the denominator likelihood is the total likelihood of the lattice.
-      double path_ac_like = 0.0;
-      for(int32 t=0; t<num_frames; t++) {
-        int32 pdf = trans_model.TransitionIdToPdf(num_ali[t]);
-        path_ac_like += nnet_out_h(t,pdf);
-      }
-      path_ac_like *= acoustic_scale;
-      mmi_obj = path_ac_like - lat_like; 
-      //
-      // Note: numerator likelihood does not include graph score,
-      // while denominator likelihood contains graph scores.
-      // The result is offset at the MMI-objective.
-      // However the offset is constant for given alignment,
-      // so it is not harmful.
-      
-      // Sum the den-posteriors under the correct path:
-      post_on_ali = 0.0;
-      for(int32 t=0; t<num_frames; t++) {
-        int32 pdf = trans_model.TransitionIdToPdf(num_ali[t]);
-        double posterior = nnet_diff_h(t, pdf);
-        post_on_ali += posterior;
-      }
+      const std::string &utt = example->utt;
+      int32 num_frames = example->nnet_diff.NumRows();
+      double mmi_obj = example->mmi_obj,
+          post_on_ali = example->post_on_ali;
+      const std::vector<int32> &frm_drop_vec = example->frm_drop_vec;
+      int32 frm_drop = frm_drop_vec.size();
 
       // Report
       KALDI_VLOG(1) << "Lattice #" << num_done + 1 << " processed"
-                    << " (" << utt << "): found " << den_lat.NumStates()
-                    << " states and " << fst::NumArcs(den_lat) << " arcs.";
+                    << " (" << utt << "): found " << example->den_lat.NumStates()
+                    << " states and " << fst::NumArcs(example->den_lat) << " arcs.";
 
       KALDI_VLOG(1) << "Utterance " << utt << ": Average MMI obj. value = "
                     << (mmi_obj/num_frames) << " over " << num_frames
                     << " frames."
                     << " (Avg. den-posterior on ali " << post_on_ali/num_frames << ")";
 
-
-      // 7a) Search for the frames with num/den mismatch
-      int32 frm_drop = 0;
-      std::vector<int32> frm_drop_vec; 
-      for(int32 t=0; t<num_frames; t++) {
-        int32 pdf = trans_model.TransitionIdToPdf(num_ali[t]);
-        double posterior = nnet_diff_h(t, pdf);
-        if(posterior < 1e-20) {
-          frm_drop++;
-          frm_drop_vec.push_back(t);
-        }
-      }
-
-      // 8) subtract the pdf-Viterbi-path
-      for(int32 t=0; t<nnet_diff_h.NumRows(); t++) {
-        int32 pdf = trans_model.TransitionIdToPdf(num_ali[t]);
-        nnet_diff_h(t, pdf) -= 1.0;
-      }
-
-      // 9) Drop mismatched frames from the training by zeroing the derivative
-      if(drop_frames) {
-        for(int32 i=0; i<frm_drop_vec.size(); i++) {
-          nnet_diff_h.Row(frm_drop_vec[i]).Set(0.0);
-        }
+      if (drop_frames) {
         num_frm_drop += frm_drop;
       }
       // Report the frame dropping
@@ -397,11 +564,12 @@ int main(int argc, char *argv[]) {
       }
 
       // 10) backpropagate through the nnet
-      nnet_diff.Resize(num_frames, num_pdfs, kUndefined);
-      nnet_diff.CopyFromMat(nnet_diff_h);
+      nnet_diff.Resize(num_frames, example->nnet_diff.NumCols(), kUndefined);
+      nnet_diff.CopyFromMat(example->nnet_diff);
       nnet.Backpropagate(nnet_diff, NULL);
       // relase the buffer, we don't need anymore
       nnet_diff.Resize(0,0);
+      delete example;
 
       // increase time counter
       total_mmi_obj += mmi_obj;
@@ -36,6 +36,7 @@
 #include "nnet/nnet-utils.h"
 #include "base/timer.h"
 #include "cudamatrix/cu-device.h"
+#include "thread/kaldi-future.h"
 
 
 namespace kaldi {
@@ -77,6 +78,192 @@ void LatticeAcousticRescore(const Matrix<BaseFloat> &log_like,
   }
 }
 
+// One utterance for sequence training.  SequenceExampleReader fills in the
+// data, read, checked and pre-processed on the CPU; Forward() then fills in
+// the log-likelihoods, and MpeLatticeTask the rest.
+struct SequenceExample {
+  std::string utt;
+  Matrix<BaseFloat> feats;
+  std::vector<int32> ref_ali;
+  Lattice den_lat;  // scaled by --old-acoustic-scale, topologically sorted.
+  std::vector<int32> state_times;
+  Matrix<BaseFloat> log_like;  // nnet output minus the log-priors.
+  Posterior post;  // derivative w.r.t. the nnet output, with flipped sign.
+  double utt_frame_acc;
+  // utterances skipped by the reader before this one,
+  int32 num_no_ref_ali, num_no_den_lat, num_other_error;
+  bool done;  // true if there was no utterance left; there is no data then.
+  SequenceExample(): utt_frame_acc(0.0), num_no_ref_ali(0), num_no_den_lat(0),
+                     num_other_error(0), done(false) { }
+};
+
+// Reads the next utterance which has a numerator alignment and a
+// denominator lattice of the right length, and returns it in a newly
+// allocated SequenceExample, with the lattice scaled and topologically
+// sorted.  It only uses the readers and host memory, so with --pipeline=true
+// it runs on the ThreadPool, reading ahead of the training.
+class SequenceExampleReader {
+ public:
+  typedef SequenceExample* result_type;
+
+  SequenceExampleReader(SequentialBaseFloatMatrixReader *feature_reader,
+                        RandomAccessLatticeReader *den_lat_reader,
+                        RandomAccessInt32VectorReader *ref_ali_reader,
+                        BaseFloat old_acoustic_scale, int32 max_frames):
+      feature_reader_(feature_reader), den_lat_reader_(den_lat_reader),
+      ref_ali_reader_(ref_ali_reader), old_acoustic_scale_(old_acoustic_scale),
+      max_frames_(max_frames) { }
+
+  SequenceExample *operator () () const {
+    SequenceExample *example = new SequenceExample();
+    for ( ; !feature_reader_->Done(); feature_reader_->Next()) {
+      std::string utt = feature_reader_->Key();
+      if (!den_lat_reader_->HasKey(utt)) {
+        KALDI_WARN << "Utterance " << utt << ": found no lattice.";
+        example->num_no_den_lat++;
+        continue;
+      }
+      if (!ref_ali_reader_->HasKey(utt)) {
+        KALDI_WARN << "Utterance " << utt << ": found no reference alignment.";
+        example->num_no_ref_ali++;
+        continue;
+      }
+
+      // 1) get the features, numerator alignment
+      const Matrix<BaseFloat> &mat = feature_reader_->Value();
+      const std::vector<int32> &ref_ali = ref_ali_reader_->Value(utt);
+      // check for temporal length of numerator alignments
+      if (static_cast<MatrixIndexT>(ref_ali.size()) != mat.NumRows()) {
+        KALDI_WARN << "Numerator alignment has wrong length "
+                   << ref_ali.size() << " vs. "<< mat.NumRows();
+        example->num_other_error++;
+        continue;
+      }
+      if (mat.NumRows() > max_frames_) {
+        KALDI_WARN << "Utterance " << utt << ": Skipped because it has "
+                   << mat.NumRows() << " frames, which is more than "
+                   << max_frames_ << ".";
+        example->num_other_error++;
+        continue;
+      }
+
+      // 2) get the denominator lattice, preprocess
+      Lattice &den_lat = example->den_lat;
+      den_lat = den_lat_reader_->Value(utt);
+      if (den_lat.Start() == -1) {
+        KALDI_WARN << "Empty lattice for utt " << utt;
+        example->num_other_error++;
+        continue;
+      }
+      if (old_acoustic_scale_ != 1.0) {
+        fst::ScaleLattice(fst::AcousticLatticeScale(old_acoustic_scale_),
+                          &den_lat);
+      }
+      // optional sort it topologically
+      kaldi::uint64 props = den_lat.Properties(fst::kFstProperties, false);
+      if (!(props & fst::kTopSorted)) {
+        if (fst::TopSort(&den_lat) == false)
+          KALDI_ERR << "Cycles detected in lattice.";
+      }
+      // get the lattice length and times of states
+      int32 max_time = kaldi::LatticeStateTimes(den_lat, &example->state_times);
+      // check for temporal length of denominator lattices
+      if (max_time != mat.NumRows()) {
+        KALDI_WARN << "Denominator lattice has wrong length "
+                   << max_time << " vs. " << mat.NumRows();
+        example->num_other_error++;
+        continue;
+      }
+
+      example->utt = utt;
+      example->feats = mat;
+      example->ref_ali = ref_ali;
+      feature_reader_->Next();
+      return example;
+    }
+    example->done = true;
+    return example;
+  }
+
+ private:
+  SequentialBaseFloatMatrixReader *feature_reader_;
+  RandomAccessLatticeReader *den_lat_reader_;
+  RandomAccessInt32VectorReader *ref_ali_reader_;
+  BaseFloat old_acoustic_scale_;
+  int32 max_frames_;
+};
+
+// Does the lattice part of MPE/sMBR training for an example whose
+// log-likelihoods have been computed: rescores the denominator lattice and
+// does the forward-backward, to get the frame accuracy and the posteriors
+// from which we get the derivative.  It only uses host memory, so with
+// --pipeline=true it runs on the ThreadPool while the GPU trains on the
+// previous example.
+class MpeLatticeTask {
+ public:
+  typedef SequenceExample* result_type;
+
+  MpeLatticeTask(const TransitionModel &trans_model,
+                 const std::vector<int32> &silence_phones,
+                 BaseFloat acoustic_scale, BaseFloat lm_scale, bool do_smbr,
+                 bool one_silence_class, SequenceExample *example):
+      trans_model_(trans_model), silence_phones_(silence_phones),
+      acoustic_scale_(acoustic_scale), lm_scale_(lm_scale),
+      do_smbr_(do_smbr), one_silence_class_(one_silence_class),
+      example_(example) { }
+
+  SequenceExample *operator () () const {
+    Lattice &den_lat = example_->den_lat;
+    // 4) rescore the latice
+    LatticeAcousticRescore(example_->log_like, trans_model_,
+                           example_->state_times, &den_lat);
+    if (acoustic_scale_ != 1.0 || lm_scale_ != 1.0)
+      fst::ScaleLattice(fst::LatticeScale(lm_scale_, acoustic_scale_), &den_lat);
+
+    if (do_smbr_) {  // use state-level accuracies, i.e. sMBR estimation
+      example_->utt_frame_acc = LatticeForwardBackwardMpeVariants(
+          trans_model_, silence_phones_, den_lat, example_->ref_ali, "smbr",
+          one_silence_class_, &example_->post);
+    } else {  // use phone-level accuracies, i.e. MPFE (minimum phone frame error)
+      example_->utt_frame_acc = LatticeForwardBackwardMpeVariants(
+          trans_model_, silence_phones_, den_lat, example_->ref_ali, "mpfe",
+          one_silence_class_, &example_->post);
+    }
+    return example_;
+  }
+
+ private:
+  const TransitionModel &trans_model_;
+  const std::vector<int32> &silence_phones_;
+  BaseFloat acoustic_scale_, lm_scale_;
+  bool do_smbr_, one_silence_class_;
+  SequenceExample *example_;
+};
+
+// 3) propagates the features of "example" to get the log-posteriors (nnet
+// w/o softmax), and stores them minus the log-priors in example->log_like.
+// With buffered == false we use Nnet::Feedforward(), so this does not
+// prepare "nnet" for Backpropagate().
+void Forward(bool buffered, Nnet *nnet_transf, PdfPrior *log_prior,
+             Nnet *nnet, SequenceExample *example) {
+  CuMatrix<BaseFloat> feats(example->feats), feats_transf, nnet_out;
+  // possibly apply transform
+  nnet_transf->Feedforward(feats, &feats_transf);
+  // propagate through the nnet (assuming w/o softmax)
+  if (buffered) {
+    nnet->Propagate(feats_transf, &nnet_out);
+  } else {
+    nnet->Feedforward(feats_transf, &nnet_out);
+  }
+  // subtract the log_prior
+  if (log_prior != NULL) {
+    log_prior->SubtractOnLogpost(&nnet_out);
+  }
+  // transfer it back to the host
+  example->log_like.Resize(nnet_out.NumRows(), nnet_out.NumCols(), kUndefined);
+  nnet_out.CopyToMat(&example->log_like);
+}
+
 }  // namespace nnet1
 }  // namespace kaldi
 
@@ -133,6 +320,15 @@ int main(int argc, char *argv[]) {
     po.Register("do-smbr", &do_smbr, "Use state-level accuracies instead of "
                 "phone accuracies.");
 
+    bool pipeline = false;
+    po.Register("pipeline", &pipeline,
+                "Overlap the lattice processing with the nnet training: read "
+                "and sort the lattices ahead, and do the forward-backward for "
+                "each utterance on the CPU while the GPU trains on the previous "
+                "one.  The lattices are then rescored by the nnet before the "
+                "update on the previous utterance, and each utterance is "
+                "propagated twice.");
+
     std::string use_gpu="yes";
     po.Register("use-gpu", &use_gpu, "yes|no|optional, only has effect if compiled with CUDA");
      
@@ -194,7 +390,6 @@ int main(int argc, char *argv[]) {
     RandomAccessInt32VectorReader ref_ali_reader(ref_ali_rspecifier);
 
     CuMatrix<BaseFloat> feats, feats_transf, nnet_out, nnet_diff;
-    Matrix<BaseFloat> nnet_out_h;
 
     Timer time;
     double time_now = 0;
@@ -204,115 +399,82 @@ int main(int argc, char *argv[]) {
       num_other_error = 0;
 
     kaldi::int64 total_frames = 0;
-    double total_frame_acc = 0.0, utt_frame_acc;
+    double total_frame_acc = 0.0;
+
+    SequenceExampleReader example_reader(&feature_reader, &den_lat_reader,
+                                         &ref_ali_reader, old_acoustic_scale,
+                                         max_frames);
+    PdfPrior *prior = (prior_opts.class_frame_counts != "" ? &log_prior : NULL);
+
+    // With --pipeline=true, the next example is read on the ThreadPool, and
+    // "prev_example" is the one whose lattice is being processed there, which
+    // we train on once we have started on the lattice of the next one.
+    Future<SequenceExample*> next_example, prev_example;
+    if (pipeline) {
+      next_example = Async(example_reader);
+    }
 
     // do per-utterance processing
-    for (; !feature_reader.Done(); feature_reader.Next()) {
-      std::string utt = feature_reader.Key();
-      if (!den_lat_reader.HasKey(utt)) {
-        KALDI_WARN << "Utterance " << utt << ": found no lattice.";
-        num_no_den_lat++;
-        continue;
-      }
-      if (!ref_ali_reader.HasKey(utt)) {
-        KALDI_WARN << "Utterance " << utt << ": found no reference alignment.";
-        num_no_ref_ali++;
-        continue;
-      }
-
-      // 1) get the features, numerator alignment
-      const Matrix<BaseFloat> &mat = feature_reader.Value();
-      const std::vector<int32> &ref_ali = ref_ali_reader.Value(utt);
-      // check for temporal length of numerator alignments
-      if (static_cast<MatrixIndexT>(ref_ali.size()) != mat.NumRows()) {
-        KALDI_WARN << "Numerator alignment has wrong length "
-                   << ref_ali.size() << " vs. "<< mat.NumRows();
-        num_other_error++;
-        continue;
-      }
-      if (mat.NumRows() > max_frames) {
-    KALDI_WARN << "Utterance " << utt << ": Skipped because it has " << mat.NumRows() << 
-      " frames, which is more than " << max_frames << ".";
-    num_other_error++;
-    continue;
-      }
-      // 2) get the denominator lattice, preprocess
-      Lattice den_lat = den_lat_reader.Value(utt);
-      if (den_lat.Start() == -1) {
-        KALDI_WARN << "Empty lattice for utt " << utt;
-        num_other_error++;
-        continue;
-      }
-      if (old_acoustic_scale != 1.0) {
-        fst::ScaleLattice(fst::AcousticLatticeScale(old_acoustic_scale),
-                          &den_lat);
-      }
-      // optional sort it topologically
-      kaldi::uint64 props = den_lat.Properties(fst::kFstProperties, false);
-      if (!(props & fst::kTopSorted)) {
-        if (fst::TopSort(&den_lat) == false)
-          KALDI_ERR << "Cycles detected in lattice.";
+    bool reader_done = false;
+    while (true) {
+      SequenceExample *example = NULL;
+      if (!reader_done) {
+        example = (pipeline ? next_example.Get() : example_reader());
+        num_no_ref_ali += example->num_no_ref_ali;
+        num_no_den_lat += example->num_no_den_lat;
+        num_other_error += example->num_other_error;
+        reader_done = example->done;
+        if (reader_done) {
+          delete example;
+          example = NULL;
+        }
       }
-      // get the lattice length and times of states
-      vector<int32> state_times;
-      int32 max_time = kaldi::LatticeStateTimes(den_lat, &state_times);
-      // check for temporal length of denominator lattices
-      if (max_time != mat.NumRows()) {
-        KALDI_WARN << "Denominator lattice has wrong length "
-                   << max_time << " vs. " << mat.NumRows();
-        num_other_error++;
-        continue;
+      if (!pipeline) {
+        if (example == NULL) break;
+        Forward(true, &nnet_transf, prior, &nnet, example);
+        MpeLatticeTask(trans_model, silence_phones, acoustic_scale, lm_scale,
+                       do_smbr, one_silence_class, example)();
+      } else {
+        // start reading the next example, get the log-likelihoods for this
+        // one and start on its lattice,
+        Future<SequenceExample*> this_example;
+        if (example != NULL) {
+          next_example = Async(example_reader);
+          Forward(false, &nnet_transf, prior, &nnet, example);
+          this_example = Async(MpeLatticeTask(trans_model, silence_phones,
+                                              acoustic_scale, lm_scale, do_smbr,
+                                              one_silence_class, example));
+        }
+        // and train on the previous one,
+        if (!prev_example.Valid()) {
+          if (example == NULL) break;
+          prev_example = this_example;
+          continue;
+        }
+        example = prev_example.Get();
+        prev_example = this_example;
+        // propagate it again, to prepare the nnet for the backpropagation,
+        feats.Resize(example->feats.NumRows(), example->feats.NumCols(), kUndefined);
+        feats.CopyFromMat(example->feats);
+        nnet_transf.Feedforward(feats, &feats_transf);
+        nnet.Propagate(feats_transf, &nnet_out);
+        // release the buffers we don't need anymore
+        feats.Resize(0,0);
+        feats_transf.Resize(0,0);
+        nnet_out.Resize(0,0);
       }
 
-      // get actual dims for this utt and nnet
-      int32 num_frames = mat.NumRows(),
-          num_fea = mat.NumCols(),
-          num_pdfs = nnet.OutputDim();
-
-      // 3) propagate the feature to get the log-posteriors (nnet w/o sofrmax)
-      // push features to GPU
-      feats.Resize(num_frames, num_fea, kUndefined);
-      feats.CopyFromMat(mat);
-      // possibly apply transform
-      nnet_transf.Feedforward(feats, &feats_transf);
-      // propagate through the nnet (assuming w/o softmax)
-      nnet.Propagate(feats_transf, &nnet_out);
-      // subtract the log_prior
-      if (prior_opts.class_frame_counts != "") {
-        log_prior.SubtractOnLogpost(&nnet_out);
-      }
-      // transfer it back to the host
-      nnet_out_h.Resize(num_frames, num_pdfs, kUndefined);
-      nnet_out.CopyToMat(&nnet_out_h);
-      // release the buffers we don't need anymore
-      feats.Resize(0,0);
-      feats_transf.Resize(0,0);
-      nnet_out.Resize(0,0);
-
-      // 4) rescore the latice
-      LatticeAcousticRescore(nnet_out_h, trans_model, state_times, &den_lat);
-      if (acoustic_scale != 1.0 || lm_scale != 1.0)
-        fst::ScaleLattice(fst::LatticeScale(lm_scale, acoustic_scale), &den_lat);
-
-      kaldi::Posterior post;
-
-      if (do_smbr) {  // use state-level accuracies, i.e. sMBR estimation
-        utt_frame_acc = LatticeForwardBackwardMpeVariants(
-            trans_model, silence_phones, den_lat, ref_ali, "smbr",
-            one_silence_class, &post);
-      } else {  // use phone-level accuracies, i.e. MPFE (minimum phone frame error)
-        utt_frame_acc = LatticeForwardBackwardMpeVariants(
-            trans_model, silence_phones, den_lat, ref_ali, "mpfe",
-            one_silence_class, &post);
-      }
+      const std::string &utt = example->utt;
+      int32 num_frames = example->feats.NumRows();
+      double utt_frame_acc = example->utt_frame_acc;
 
       // 6) convert the Posterior to a matrix,
-      PosteriorToMatrixMapped(post, trans_model, &nnet_diff);
+      PosteriorToMatrixMapped(example->post, trans_model, &nnet_diff);
       nnet_diff.Scale(-1.0); // need to flip the sign of derivative,
 
       KALDI_VLOG(1) << "Lattice #" << num_done + 1 << " processed"
-                    << " (" << utt << "): found " << den_lat.NumStates()
-                    << " states and " << fst::NumArcs(den_lat) << " arcs.";
+                    << " (" << utt << "): found " << example->den_lat.NumStates()
+                    << " states and " << fst::NumArcs(example->den_lat) << " arcs.";
 
       KALDI_VLOG(1) << "Utterance " << utt << ": Average frame accuracy = "
                     << (utt_frame_acc/num_frames) << " over " << num_frames
@@ -322,6 +484,7 @@ int main(int argc, char *argv[]) {
       // 7) backpropagate through the nnet,
       nnet.Backpropagate(nnet_diff, NULL);
       nnet_diff.Resize(0,0); // release GPU memory,
+      delete example;
 
       // increase time counter
       total_frame_acc += utt_frame_acc;
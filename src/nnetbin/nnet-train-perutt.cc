@@ -23,6 +23,7 @@
 #include "nnet/nnet-randomizer.h"
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
+#include "util/stl-utils.h"
 #include "base/timer.h"
 #include "cudamatrix/cu-device.h"
 
@@ -65,6 +66,12 @@ int main(int argc, char *argv[]) {
     std::string use_gpu="yes";
     po.Register("use-gpu", &use_gpu, "yes|no|optional, only has effect if compiled with CUDA"); 
 
+    int32 num_jobs = 1, job_index = 0;
+    po.Register("num-jobs", &num_jobs, "Number of parallel training jobs (on different GPUs), "
+                "whose models get averaged by nnet-average; see --job-index");
+    po.Register("job-index", &job_index, "Index of this job, 0..num-jobs-1: we only use the "
+                "utterances whose key hashes to it");
+
     // Add dummy randomizer options, to make the tool compatible with standard scripts
     NnetDataRandomizerOptions rnd_opts;
     rnd_opts.Register(&po);
@@ -77,6 +84,7 @@ int main(int argc, char *argv[]) {
       po.PrintUsage();
       exit(1);
     }
+    KALDI_ASSERT(num_jobs >= 1 && job_index >= 0 && job_index < num_jobs);
 
     std::string feature_rspecifier = po.GetArg(1),
       targets_rspecifier = po.GetArg(2),
@@ -130,6 +138,8 @@ int main(int argc, char *argv[]) {
     int32 num_done = 0, num_no_tgt_mat = 0, num_other_error = 0;
     for ( ; !feature_reader.Done(); feature_reader.Next()) {
       std::string utt = feature_reader.Key();
+      // skip the utterances of the other jobs
+      if (num_jobs > 1 && StringHasher()(utt) % num_jobs != job_index) continue;
       KALDI_VLOG(3) << "Reading " << utt;
       // check that we have targets
       if (!targets_reader.HasKey(utt)) {
@@ -0,0 +1,212 @@
+// online2/online-adaptation-store.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "online2/online-adaptation-store.h"
+
+namespace kaldi {
+
+DirectoryAdaptationStoreBackend::DirectoryAdaptationStoreBackend(
+    const std::string &dir): dir_(dir) {
+  KALDI_ASSERT(!dir_.empty());
+}
+
+std::string DirectoryAdaptationStoreBackend::Filename(
+    const std::string &key) const {
+  // Escape anything other than alphanumerics, '-' and '_' as %XX, so the key
+  // can't name a path outside dir_, and distinct keys give distinct names.
+  std::ostringstream os;
+  os << dir_ << '/';
+  for (size_t i = 0; i < key.size(); i++) {
+    unsigned char c = key[i];
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+        (c >= '0' && c <= '9') || c == '-' || c == '_') {
+      os << c;
+    } else {
+      char buf[4];
+      snprintf(buf, sizeof(buf), "%%%02X", static_cast<unsigned int>(c));
+      os << buf;
+    }
+  }
+  os << ".ada";
+  return os.str();
+}
+
+bool DirectoryAdaptationStoreBackend::Get(const std::string &key,
+                                          std::string *value) {
+  std::ifstream is(Filename(key).c_str(), std::ios::in | std::ios::binary);
+  if (!is.is_open())
+    return false;
+  std::ostringstream os;
+  os << is.rdbuf();
+  if (is.bad()) {
+    KALDI_WARN << "Error reading adaptation state from " << Filename(key);
+    return false;
+  }
+  *value = os.str();
+  return true;
+}
+
+void DirectoryAdaptationStoreBackend::Put(const std::string &key,
+                                          const std::string &value) {
+  std::string filename = Filename(key);
+  std::ostringstream tmp_name;
+  tmp_name << filename << ".tmp." << getpid();
+  {
+    std::ofstream os(tmp_name.str().c_str(),
+                     std::ios::out | std::ios::binary | std::ios::trunc);
+    os.write(value.data(), value.size());
+    os.close();
+    if (os.fail()) {
+      KALDI_WARN << "Error writing adaptation state to " << tmp_name.str();
+      unlink(tmp_name.str().c_str());
+      return;
+    }
+  }
+  if (rename(tmp_name.str().c_str(), filename.c_str()) != 0) {
+    KALDI_WARN << "Error renaming " << tmp_name.str() << " to " << filename
+               << ": " << strerror(errno);
+    unlink(tmp_name.str().c_str());
+  }
+}
+
+
+LruAdaptationStoreBackend::LruAdaptationStoreBackend(
+    int32 capacity, AdaptationStoreBackend *next):
+    capacity_(capacity), next_(next) {
+  KALDI_ASSERT(capacity_ > 0);
+}
+
+void LruAdaptationStoreBackend::CacheValue(const std::string &key,
+                                           const std::string &value) {
+  unordered_map<std::string, EntryList::iterator, StringHasher>::iterator
+      iter = index_.find(key);
+  if (iter != index_.end()) {
+    iter->second->second = value;
+    entries_.splice(entries_.begin(), entries_, iter->second);
+  } else {
+    entries_.push_front(std::make_pair(key, value));
+    index_[key] = entries_.begin();
+  }
+  while (static_cast<int32>(index_.size()) > capacity_) {
+    index_.erase(entries_.back().first);
+    entries_.pop_back();
+  }
+}
+
+bool LruAdaptationStoreBackend::Get(const std::string &key,
+                                    std::string *value) {
+  mutex_.Lock();
+  unordered_map<std::string, EntryList::iterator, StringHasher>::iterator
+      iter = index_.find(key);
+  if (iter != index_.end()) {
+    entries_.splice(entries_.begin(), entries_, iter->second);
+    *value = iter->second->second;
+    mutex_.Unlock();
+    return true;
+  }
+  mutex_.Unlock();
+  // We don't hold the lock while consulting next_, which may be slow.
+  if (next_ == NULL || !next_->Get(key, value))
+    return false;
+  mutex_.Lock();
+  CacheValue(key, *value);
+  mutex_.Unlock();
+  return true;
+}
+
+void LruAdaptationStoreBackend::Put(const std::string &key,
+                                    const std::string &value) {
+  mutex_.Lock();
+  CacheValue(key, value);
+  mutex_.Unlock();
+  if (next_ != NULL)
+    next_->Put(key, value);
+}
+
+
+OnlineAdaptationStateStore::OnlineAdaptationStateStore(
+    const OnlineAdaptationStoreConfig &config,
+    const OnlineIvectorExtractionInfo &info,
+    AdaptationStoreBackend *backend):
+    info_(info), owned_backend_(NULL), cache_(NULL), backend_(backend) {
+  KALDI_ASSERT(config.cache_size >= 0);
+  if (backend_ == NULL && !config.store_dir.empty())
+    backend_ = owned_backend_ =
+        new DirectoryAdaptationStoreBackend(config.store_dir);
+  if (backend_ != NULL && config.cache_size > 0)
+    backend_ = cache_ = new LruAdaptationStoreBackend(config.cache_size,
+                                                      backend_);
+}
+
+OnlineAdaptationStateStore::~OnlineAdaptationStateStore() {
+  delete cache_;
+  delete owned_backend_;
+}
+
+bool OnlineAdaptationStateStore::Load(
+    const std::string &key,
+    OnlineIvectorExtractorAdaptationState *state) {
+  std::string value;
+  if (backend_ == NULL || !backend_->Get(key, &value))
+    return false;
+  OnlineIvectorExtractorAdaptationState stored(info_);
+  try {
+    std::istringstream is(value);
+    stored.Read(is, true);
+  } catch (const std::exception &e) {
+    KALDI_WARN << "Could not read stored adaptation state for " << key
+               << ", ignoring it: " << e.what();
+    return false;
+  }
+  const Matrix<double> &speaker_stats = stored.cmvn_state.speaker_cmvn_stats;
+  if (stored.ivector_stats.IvectorDim() != info_.extractor.IvectorDim() ||
+      (speaker_stats.NumRows() != 0 &&
+       speaker_stats.NumCols() != info_.global_cmvn_stats.NumCols())) {
+    KALDI_WARN << "Stored adaptation state for " << key << " does not match "
+               << "the model (was it stored with a different model?), "
+               << "ignoring it.";
+    return false;
+  }
+  stored.cmvn_state.global_cmvn_stats = info_.global_cmvn_stats;
+  *state = stored;
+  return true;
+}
+
+void OnlineAdaptationStateStore::Store(
+    const std::string &key,
+    const OnlineIvectorExtractorAdaptationState &state) {
+  if (backend_ == NULL)
+    return;
+  OnlineIvectorExtractorAdaptationState compact(state);
+  compact.LimitFrames(info_.max_remembered_frames, info_.posterior_scale);
+  compact.cmvn_state.global_cmvn_stats.Resize(0, 0);
+  std::ostringstream os;
+  compact.Write(os, true);
+  backend_->Put(key, os.str());
+}
+
+}  // namespace kaldi
@@ -0,0 +1,179 @@
+// online2/online-adaptation-store.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+#ifndef KALDI_ONLINE2_ONLINE_ADAPTATION_STORE_H_
+#define KALDI_ONLINE2_ONLINE_ADAPTATION_STORE_H_
+
+#include <list>
+#include <string>
+#include <utility>
+
+#include "base/kaldi-error.h"
+#include "itf/options-itf.h"
+#include "util/stl-utils.h"
+#include "thread/kaldi-mutex.h"
+#include "online2/online-ivector-feature.h"
+
+namespace kaldi {
+/// @addtogroup  onlinedecoding OnlineDecoding
+/// @{
+
+/// This file contains code for remembering the speaker adaptation state
+/// (class OnlineIvectorExtractorAdaptationState, which includes the online-CMVN
+/// state) across sessions, keyed by a speaker or session id, so that a caller
+/// who comes back (possibly to a different process or machine) does not have
+/// to re-converge from scratch.
+
+
+/// AdaptationStoreBackend is the interface for the thing that actually stores
+/// the serialized adaptation states; it maps keys to opaque strings.  You
+/// can implement it for whatever key-value store your servers share; we
+/// provide an in-memory LRU cache and a backend that stores one file per key
+/// in a directory (which may be on a shared filesystem).  Implementations must
+/// be safe to call from multiple threads.
+class AdaptationStoreBackend {
+ public:
+  /// If "key" is present, outputs its value to "value" and returns true;
+  /// otherwise returns false.
+  virtual bool Get(const std::string &key, std::string *value) = 0;
+
+  /// Sets the value for "key", replacing any previous value.
+  virtual void Put(const std::string &key, const std::string &value) = 0;
+
+  virtual ~AdaptationStoreBackend() { }
+};
+
+
+/// This backend stores the value for each key in its own file in a directory
+/// (the key is escaped so it is a valid filename).  Files are written to a
+/// temporary name and then renamed, so a reader on another machine never sees
+/// a partly written value.
+class DirectoryAdaptationStoreBackend: public AdaptationStoreBackend {
+ public:
+  /// "dir" must already exist.
+  explicit DirectoryAdaptationStoreBackend(const std::string &dir);
+
+  virtual bool Get(const std::string &key, std::string *value);
+
+  virtual void Put(const std::string &key, const std::string &value);
+
+ private:
+  std::string Filename(const std::string &key) const;
+
+  std::string dir_;
+};
+
+
+/// This backend keeps up to "capacity" values in memory, discarding the least
+/// recently used ones.  If "next" is non-NULL it is consulted on a miss (and
+/// the value found is cached), and Put() writes through to it; so it can act
+/// as a local cache in front of a slower, shared backend.
+class LruAdaptationStoreBackend: public AdaptationStoreBackend {
+ public:
+  /// "next" may be NULL; it is not owned here.
+  LruAdaptationStoreBackend(int32 capacity,
+                            AdaptationStoreBackend *next = NULL);
+
+  virtual bool Get(const std::string &key, std::string *value);
+
+  virtual void Put(const std::string &key, const std::string &value);
+
+  int32 NumCached() const { return index_.size(); }
+
+ private:
+  // Inserts or updates the entry for "key" at the front of the list, then
+  // discards entries from the back while there are more than capacity_.
+  // Requires mutex_ to be locked.
+  void CacheValue(const std::string &key, const std::string &value);
+
+  typedef std::list<std::pair<std::string, std::string> > EntryList;
+
+  int32 capacity_;
+  AdaptationStoreBackend *next_;
+  EntryList entries_;  // most recently used first.
+  unordered_map<std::string, EntryList::iterator, StringHasher> index_;
+  Mutex mutex_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(LruAdaptationStoreBackend);
+};
+
+
+struct OnlineAdaptationStoreConfig {
+  std::string store_dir;  // directory for DirectoryAdaptationStoreBackend.
+  int32 cache_size;  // number of states kept by the in-memory LRU cache.
+
+  OnlineAdaptationStoreConfig(): cache_size(1000) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("adaptation-store-dir", &store_dir, "If set, directory "
+                   "(which must exist, and may be shared between servers) in "
+                   "which to store the speaker adaptation state, keyed by "
+                   "speaker id, so it is carried over between sessions.");
+    opts->Register("adaptation-cache-size", &cache_size, "Number of speaker "
+                   "adaptation states cached in memory in front of "
+                   "--adaptation-store-dir (or 0 for no cache).");
+  }
+};
+
+
+/// OnlineAdaptationStateStore saves and restores speaker adaptation states
+/// through an AdaptationStoreBackend.  The states are stored compactly: in
+/// binary form, limited to info.max_remembered_frames as in
+/// OnlineIvectorFeature::GetAdaptationState(), and without the global CMVN
+/// stats (which come from the model, and are restored from "info" on Load()).
+/// It is safe to call from multiple threads.
+class OnlineAdaptationStateStore {
+ public:
+  /// If "backend" is non-NULL (it is not owned here) it is used as the shared
+  /// store, e.g. a client for a remote key-value store; otherwise, if
+  /// config.store_dir is set, a DirectoryAdaptationStoreBackend is used.  If
+  /// config.cache_size > 0 an LRU cache of that size sits in front of it.
+  OnlineAdaptationStateStore(const OnlineAdaptationStoreConfig &config,
+                             const OnlineIvectorExtractionInfo &info,
+                             AdaptationStoreBackend *backend = NULL);
+
+  /// Returns true if there is somewhere to store states.
+  bool Active() const { return backend_ != NULL; }
+
+  /// If a usable state is stored for "key", sets *state to it and returns
+  /// true.  Otherwise (including if the stored value was corrupted or does not
+  /// match this model; these cases produce a warning) returns false and leaves
+  /// *state unchanged.
+  bool Load(const std::string &key,
+            OnlineIvectorExtractorAdaptationState *state);
+
+  /// Stores "state" as the adaptation state for "key".
+  void Store(const std::string &key,
+             const OnlineIvectorExtractorAdaptationState &state);
+
+  ~OnlineAdaptationStateStore();
+
+ private:
+  const OnlineIvectorExtractionInfo &info_;
+  AdaptationStoreBackend *owned_backend_;  // directory backend, if we own it.
+  LruAdaptationStoreBackend *cache_;  // may be NULL.
+  AdaptationStoreBackend *backend_;  // the one we use; may be NULL.
+  KALDI_DISALLOW_COPY_AND_ASSIGN(OnlineAdaptationStateStore);
+};
+
+/// @} End of "addtogroup onlinedecoding"
+}  // namespace kaldi
+
+#endif  // KALDI_ONLINE2_ONLINE_ADAPTATION_STORE_H_
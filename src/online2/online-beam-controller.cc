@@ -0,0 +1,141 @@
+// online2/online-beam-controller.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include "online2/online-beam-controller.h"
+
+namespace kaldi {
+
+OnlineBeamController::OnlineBeamController(
+    const OnlineBeamControllerConfig &config,
+    const LatticeFasterDecoderConfig &decoder_config):
+    config_(config), base_config_(decoder_config),
+    cur_config_(decoder_config), interval_frames_(0), interval_time_(0.0),
+    num_reductions_(0) {
+  config.Check();
+  decoder_config.Check();
+}
+
+void OnlineBeamController::InitUtterance(LatticeFasterOnlineDecoder *decoder) {
+  if (Active())
+    decoder->SetOptions(cur_config_);
+  interval_frames_ = 0;
+  interval_time_ = 0.0;
+  frame_beams_.clear();
+  frame_max_active_.clear();
+  frame_num_tokens_.clear();
+  num_reductions_ = 0;
+}
+
+void OnlineBeamController::AdvanceDecoding(
+    OnlineTimer *timer, DecodableInterface *decodable,
+    LatticeFasterOnlineDecoder *decoder) {
+  if (!Active()) {
+    decoder->AdvanceDecoding(decodable);
+    return;
+  }
+  while (decoder->NumFramesDecoded() < decodable->NumFramesReady()) {
+    double start_time = timer->Elapsed();
+    decoder->AdvanceDecoding(decodable, 1);
+    interval_time_ += timer->Elapsed() - start_time;
+    interval_frames_++;
+    frame_beams_.push_back(cur_config_.beam);
+    frame_max_active_.push_back(cur_config_.max_active);
+    frame_num_tokens_.push_back(decoder->NumActiveTokens());
+    if (interval_frames_ >= config_.control_interval) {
+      BaseFloat rtf = interval_time_ / (interval_frames_ * config_.frame_shift),
+          latency = timer->Elapsed() -
+          decoder->NumFramesDecoded() * config_.frame_shift;
+      Update(rtf, latency, decoder);
+      interval_frames_ = 0;
+      interval_time_ = 0.0;
+    }
+  }
+}
+
+void OnlineBeamController::Update(BaseFloat rtf, BaseFloat latency,
+                                  LatticeFasterOnlineDecoder *decoder) {
+  bool lagging = (config_.max_latency > 0.0 && latency > config_.max_latency);
+  if (lagging || rtf > config_.target_rtf * (1.0 + config_.hysteresis)) {
+    if (cur_config_.beam <= config_.min_beam &&
+        cur_config_.max_active <= config_.min_max_active)
+      return;  // We can't do any more.
+    cur_config_.beam = std::max(config_.min_beam,
+                                cur_config_.beam - config_.beam_step);
+    // If max-active is bigger than the number of active tokens, reducing it
+    // would have no effect, so we start from the number of active tokens.
+    int32 max_active = std::min(cur_config_.max_active,
+                                std::max(decoder->NumActiveTokens(),
+                                         config_.min_max_active));
+    cur_config_.max_active = std::max(
+        config_.min_max_active,
+        static_cast<int32>(max_active * config_.max_active_factor));
+    num_reductions_++;
+  } else if (rtf < config_.target_rtf * (1.0 - config_.hysteresis)) {
+    if (cur_config_.beam < base_config_.beam) {
+      cur_config_.beam = std::min(base_config_.beam,
+                                  cur_config_.beam + config_.beam_step);
+    } else if (cur_config_.max_active < base_config_.max_active) {
+      double max_active = cur_config_.max_active / config_.max_active_factor;
+      cur_config_.max_active = (max_active >= base_config_.max_active ?
+                                base_config_.max_active :
+                                static_cast<int32>(max_active));
+    } else {
+      return;  // Already at the original settings.
+    }
+  } else {
+    return;
+  }
+  KALDI_VLOG(2) << "Real-time factor is " << rtf << ", latency " << latency
+                << "s: setting beam to " << cur_config_.beam
+                << " and max-active to " << cur_config_.max_active;
+  decoder->SetOptions(cur_config_);
+}
+
+void OnlineBeamController::GetStats(Matrix<BaseFloat> *stats) const {
+  int32 num_frames = frame_beams_.size();
+  stats->Resize(num_frames, 3);
+  for (int32 t = 0; t < num_frames; t++) {
+    (*stats)(t, 0) = frame_beams_[t];
+    (*stats)(t, 1) = frame_max_active_[t];
+    (*stats)(t, 2) = frame_num_tokens_[t];
+  }
+}
+
+void OnlineBeamController::PrintStats(const std::string &utterance_id) const {
+  int32 num_frames = frame_beams_.size();
+  if (num_frames == 0) return;
+  double tot_beam = 0.0, tot_tokens = 0.0;
+  BaseFloat min_beam = frame_beams_[0];
+  int32 max_tokens = 0;
+  for (int32 t = 0; t < num_frames; t++) {
+    tot_beam += frame_beams_[t];
+    min_beam = std::min(min_beam, frame_beams_[t]);
+    tot_tokens += frame_num_tokens_[t];
+    max_tokens = std::max(max_tokens, frame_num_tokens_[t]);
+  }
+  KALDI_LOG << "For utterance " << utterance_id << ", average beam was "
+            << (tot_beam / num_frames) << " (minimum " << min_beam
+            << ", reduced " << num_reductions_ << " times), average active "
+            << "tokens per frame " << (tot_tokens / num_frames)
+            << " (maximum " << max_tokens << ").";
+}
+
+
+}  // namespace kaldi
@@ -0,0 +1,173 @@
+// online2/online-beam-controller.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_ONLINE2_ONLINE_BEAM_CONTROLLER_H_
+#define KALDI_ONLINE2_ONLINE_BEAM_CONTROLLER_H_
+
+#include <string>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "matrix/kaldi-matrix.h"
+#include "itf/options-itf.h"
+#include "itf/decodable-itf.h"
+#include "decoder/lattice-faster-online-decoder.h"
+#include "online2/online-timing.h"
+
+namespace kaldi {
+/// @addtogroup  onlinedecoding OnlineDecoding
+/// @{
+
+
+struct OnlineBeamControllerConfig {
+  BaseFloat target_rtf;
+  BaseFloat hysteresis;
+  BaseFloat max_latency;
+  BaseFloat min_beam;
+  BaseFloat beam_step;
+  int32 min_max_active;
+  BaseFloat max_active_factor;
+  int32 control_interval;
+  BaseFloat frame_shift;
+
+  OnlineBeamControllerConfig(): target_rtf(-1.0), hysteresis(0.2),
+                                max_latency(-1.0), min_beam(6.0),
+                                beam_step(1.0), min_max_active(500),
+                                max_active_factor(0.7), control_interval(20),
+                                frame_shift(0.01) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("rtf-target", &target_rtf, "If >0, the real-time factor "
+                   "that the beam controller aims for: if decoding is slower "
+                   "than this, the beam and max-active are reduced, and they "
+                   "are restored (up to the values of --beam and --max-active) "
+                   "when it is faster.  If <= 0, the beam is not controlled.");
+    opts->Register("rtf-hysteresis", &hysteresis, "The beam is reduced if the "
+                   "real-time factor exceeds rtf-target * (1 + rtf-hysteresis) "
+                   "and increased if it is below rtf-target * (1 - "
+                   "rtf-hysteresis).");
+    opts->Register("rtf-max-latency", &max_latency, "If >0, the beam is also "
+                   "reduced whenever decoding lags behind the audio by more "
+                   "than this many seconds.");
+    opts->Register("rtf-min-beam", &min_beam, "The beam controller never "
+                   "reduces the beam below this.");
+    opts->Register("rtf-beam-step", &beam_step, "Amount by which the beam "
+                   "controller changes the beam at each step.");
+    opts->Register("rtf-min-max-active", &min_max_active, "The beam controller "
+                   "never reduces max-active below this.");
+    opts->Register("rtf-max-active-factor", &max_active_factor, "Factor by "
+                   "which the beam controller scales max-active when reducing "
+                   "it (the inverse is used when increasing it).");
+    opts->Register("rtf-control-interval", &control_interval, "Number of frames "
+                   "between adjustments by the beam controller; the real-time "
+                   "factor is measured over this many frames.");
+    opts->Register("rtf-frame-shift", &frame_shift, "Frame shift in seconds of "
+                   "the frames being decoded, used by the beam controller to "
+                   "work out the audio time.");
+  }
+  void Check() const {
+    KALDI_ASSERT(hysteresis >= 0.0 && hysteresis < 1.0 && min_beam > 0.0 &&
+                 beam_step > 0.0 && min_max_active > 1 &&
+                 max_active_factor > 0.0 && max_active_factor < 1.0 &&
+                 control_interval > 0 && frame_shift > 0.0);
+  }
+};
+
+
+/**
+   OnlineBeamController adjusts the beam and max-active of a
+   LatticeFasterOnlineDecoder as decoding proceeds, so as to keep the
+   real-time factor near a target value: when the decoder is overloaded it
+   loses some accuracy rather than falling further and further behind the
+   audio.  The clock is an OnlineTimer; only the time spent inside
+   AdvanceDecoding() counts as processing time, so simulated waits
+   (OnlineTimer::WaitUntil()) don't affect the measured real-time factor.
+
+   Every "control_interval" frames, the real-time factor over the interval is
+   compared with the target.  If it is too high (or, with max_latency > 0, if
+   decoding lags behind the audio by more than max_latency seconds), the beam
+   is reduced by beam_step and max-active is scaled by max_active_factor
+   (starting from the current number of active tokens, if max-active was
+   effectively unlimited); if it is too low, the beam is increased again and
+   then max-active, up to the values in the original decoder config.  The
+   settings carry over from one utterance to the next, since load usually
+   does too.
+
+   The controller also records, for each frame of the current utterance, the
+   beam, max-active and number of active tokens; see GetStats().
+*/
+class OnlineBeamController {
+ public:
+  /// "decoder_config" gives the beam and max-active that the controller
+  /// starts with and never exceeds.
+  OnlineBeamController(const OnlineBeamControllerConfig &config,
+                       const LatticeFasterDecoderConfig &decoder_config);
+
+  /// Returns true if the controller is turned on (target_rtf > 0).
+  bool Active() const { return config_.target_rtf > 0.0; }
+
+  /// Call this at the start of each utterance, after InitDecoding(); it
+  /// applies the current settings to the decoder and clears the per-frame
+  /// statistics.
+  void InitUtterance(LatticeFasterOnlineDecoder *decoder);
+
+  /// Decodes all frames that are ready in "decodable", like
+  /// decoder->AdvanceDecoding(decodable), but adjusting the beam as it goes.
+  /// "timer" is the timer of the current utterance.
+  void AdvanceDecoding(OnlineTimer *timer, DecodableInterface *decodable,
+                       LatticeFasterOnlineDecoder *decoder);
+
+  /// Outputs the per-frame statistics of the current utterance, as a matrix
+  /// with one row per frame decoded and columns (beam, max-active,
+  /// number of active tokens).
+  void GetStats(Matrix<BaseFloat> *stats) const;
+
+  /// Prints a summary of the statistics of the current utterance.
+  void PrintStats(const std::string &utterance_id) const;
+
+  BaseFloat CurrentBeam() const { return cur_config_.beam; }
+  int32 CurrentMaxActive() const { return cur_config_.max_active; }
+
+ private:
+  // Works out the new beam and max-active at the end of an interval and
+  // applies them to the decoder.
+  void Update(BaseFloat rtf, BaseFloat latency,
+              LatticeFasterOnlineDecoder *decoder);
+
+  OnlineBeamControllerConfig config_;
+  LatticeFasterDecoderConfig base_config_;
+  LatticeFasterDecoderConfig cur_config_;
+
+  // For the current interval: the number of frames decoded and the
+  // processing time in seconds.
+  int32 interval_frames_;
+  double interval_time_;
+
+  // Per-frame statistics for the current utterance.
+  std::vector<BaseFloat> frame_beams_;
+  std::vector<int32> frame_max_active_;
+  std::vector<int32> frame_num_tokens_;
+  int32 num_reductions_;
+};
+
+
+/// @} End of "addtogroup onlinedecoding"
+}  // namespace kaldi
+
+#endif  // KALDI_ONLINE2_ONLINE_BEAM_CONTROLLER_H_
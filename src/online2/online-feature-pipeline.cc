@@ -253,6 +253,15 @@ void OnlineFeaturePipeline::GetFrame(int32 frame,
   AdaptedFeature()->GetFrame(frame, feat);
 }
 
+void OnlineFeaturePipeline::GetFrames(const std::vector<int32> &frames,
+                                      MatrixBase<BaseFloat> *feats) {
+  AdaptedFeature()->GetFrames(frames, feats);
+}
+
+void OnlineFeaturePipeline::ReleaseFramesBefore(int32 frame) {
+  AdaptedFeature()->ReleaseFramesBefore(frame);
+}
+
 OnlineFeaturePipeline::~OnlineFeaturePipeline() {
   // Note: the delete command only deletes pointers that are non-NULL.  Not all
   // of the pointers below will be non-NULL.
@@ -296,11 +305,12 @@ BaseFloat OnlineFeaturePipelineConfig::FrameShiftInSeconds() const {
 
 void OnlineFeaturePipeline::GetAsMatrix(Matrix<BaseFloat> *feats) {
   if (pitch_) {
-    feats->Resize(NumFramesReady(), pitch_feature_->Dim());
-    for (int32 i = 0; i < NumFramesReady(); i++) {
-      SubVector<BaseFloat> row(*feats, i);
-      pitch_feature_->GetFrame(i, &row);
-    }
+    int32 num_frames = NumFramesReady();
+    feats->Resize(num_frames, pitch_feature_->Dim());
+    std::vector<int32> frames(num_frames);
+    for (int32 i = 0; i < num_frames; i++)
+      frames[i] = i;
+    pitch_feature_->GetFrames(frames, feats);
   }
 }
 
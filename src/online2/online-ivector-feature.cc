@@ -18,6 +18,7 @@
 // limitations under the License.
 
 #include "online2/online-ivector-feature.h"
+#include "base/kaldi-memory-stats.h"
 
 namespace kaldi {
 
@@ -171,48 +172,34 @@ void OnlineIvectorFeature::UpdateFrameWeights(
   delta_weights_provided_ = true;
 }
 
-void OnlineIvectorFeature::UpdateStatsForFrame(int32 t,
-                                               BaseFloat weight) {
-  int32 feat_dim = lda_normalized_->Dim();      
-  Vector<BaseFloat> feat(feat_dim),  // features given to iVector extractor
-      log_likes(info_.diag_ubm.NumGauss());
-  lda_normalized_->GetFrame(t, &feat);
-  info_.diag_ubm.LogLikelihoods(feat, &log_likes);
-  // "posterior" stores the pruned posteriors for Gaussians in the UBM.
-  std::vector<std::pair<int32, BaseFloat> > posterior;
-  tot_ubm_loglike_ += weight *
-      VectorToPosteriorEntry(log_likes, info_.num_gselect,
-                             info_.min_post, &posterior);
-  for (size_t i = 0; i < posterior.size(); i++)
-    posterior[i].second *= info_.posterior_scale * weight;
-  lda_->GetFrame(t, &feat); // get feature without CMN.
-  ivector_stats_.AccStats(info_.extractor, feat, posterior);
+void OnlineIvectorFeature::PlanStatsUntilFrame(int32 frame,
+                                               PendingStats *pending) {
+  if (!delta_weights_provided_)  // No silence weighting.
+    PlanStatsUntilFrameUnweighted(frame, pending);
+  else
+    PlanStatsUntilFrameWeighted(frame, pending);
 }
 
-void OnlineIvectorFeature::UpdateStatsUntilFrame(int32 frame) {
+void OnlineIvectorFeature::PlanStatsUntilFrameUnweighted(
+    int32 frame, PendingStats *pending) {
   KALDI_ASSERT(frame >= 0 && frame < this->NumFramesReady() &&
                !delta_weights_provided_);
   updated_with_no_delta_weights_ = true;
   
   int32 ivector_period = info_.ivector_period;
-  int32 num_cg_iters = info_.num_cg_iters;
   
   for (; num_frames_stats_ <= frame; num_frames_stats_++) {
     int32 t = num_frames_stats_;
-    UpdateStatsForFrame(t, 1.0);
+    pending->frames.push_back(std::pair<int32, BaseFloat>(t, 1.0));
     if ((!info_.use_most_recent_ivector && t % ivector_period == 0) ||
-        (info_.use_most_recent_ivector && t == frame)) {
-      ivector_stats_.GetIvector(num_cg_iters, &current_ivector_);
-      if (!info_.use_most_recent_ivector) {  // need to cache iVectors.
-        int32 ivec_index = t / ivector_period;
-        KALDI_ASSERT(ivec_index == static_cast<int32>(ivectors_history_.size()));
-        ivectors_history_.push_back(new Vector<BaseFloat>(current_ivector_));
-      }
-    }
+        (info_.use_most_recent_ivector && t == frame))
+      pending->ivector_times.push_back(
+          std::pair<size_t, int32>(pending->frames.size(), t));
   }
 }
 
-void OnlineIvectorFeature::UpdateStatsUntilFrameWeighted(int32 frame) {
+void OnlineIvectorFeature::PlanStatsUntilFrameWeighted(
+    int32 frame, PendingStats *pending) {
   KALDI_ASSERT(frame >= 0 && frame < this->NumFramesReady() &&
                delta_weights_provided_ &&
                ! updated_with_no_delta_weights_ &&
@@ -220,7 +207,6 @@ void OnlineIvectorFeature::UpdateStatsUntilFrameWeighted(int32 frame) {
   bool debug_weights = true;
 
   int32 ivector_period = info_.ivector_period;
-  int32 num_cg_iters = info_.num_cg_iters;
 
   for (; num_frames_stats_ <= frame; num_frames_stats_++) {
     int32 t = num_frames_stats_;
@@ -232,7 +218,7 @@ void OnlineIvectorFeature::UpdateStatsUntilFrameWeighted(int32 frame) {
       delta_weights_.pop();
       int32 frame = p.first;
       BaseFloat weight = p.second;
-      UpdateStatsForFrame(frame, weight);
+      pending->frames.push_back(p);
       if (debug_weights) {
         if (current_frame_weight_debug_.size() <= frame)
           current_frame_weight_debug_.resize(frame + 1, 0.0);
@@ -242,14 +228,111 @@ void OnlineIvectorFeature::UpdateStatsUntilFrameWeighted(int32 frame) {
       }
     }
     if ((!info_.use_most_recent_ivector && t % ivector_period == 0) ||
-        (info_.use_most_recent_ivector && t == frame)) {
-      ivector_stats_.GetIvector(num_cg_iters, &current_ivector_);
-      if (!info_.use_most_recent_ivector) {  // need to cache iVectors.
-        int32 ivec_index = t / ivector_period;
-        KALDI_ASSERT(ivec_index == static_cast<int32>(ivectors_history_.size()));
-        ivectors_history_.push_back(new Vector<BaseFloat>(current_ivector_));
-      }
+        (info_.use_most_recent_ivector && t == frame))
+      pending->ivector_times.push_back(
+          std::pair<size_t, int32>(pending->frames.size(), t));
+  }
+}
+
+void OnlineIvectorFeature::GetUbmFeatures(const PendingStats &pending,
+                                          MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(feats->NumRows() == pending.frames.size());
+  for (size_t i = 0; i < pending.frames.size(); i++) {
+    SubVector<BaseFloat> feat(*feats, i);
+    lda_normalized_->GetFrame(pending.frames[i].first, &feat);
+  }
+}
+
+void OnlineIvectorFeature::ApplyStats(
+    const PendingStats &pending, const MatrixBase<BaseFloat> &ubm_loglikes) {
+  KALDI_ASSERT(ubm_loglikes.NumRows() == pending.frames.size());
+  Vector<BaseFloat> feat(lda_->Dim());  // features given to iVector extractor
+  // "posterior" stores the pruned posteriors for Gaussians in the UBM.
+  std::vector<std::pair<int32, BaseFloat> > posterior;
+  size_t next_ivector = 0;
+  for (size_t i = 0; i <= pending.frames.size(); i++) {
+    for (; next_ivector < pending.ivector_times.size() &&
+             pending.ivector_times[next_ivector].first == i; next_ivector++)
+      EstimateIvector(pending.ivector_times[next_ivector].second);
+    if (i == pending.frames.size()) break;
+    int32 t = pending.frames[i].first;
+    BaseFloat weight = pending.frames[i].second;
+    tot_ubm_loglike_ += weight *
+        VectorToPosteriorEntry(ubm_loglikes.Row(i), info_.num_gselect,
+                               info_.min_post, &posterior);
+    for (size_t j = 0; j < posterior.size(); j++)
+      posterior[j].second *= info_.posterior_scale * weight;
+    lda_->GetFrame(t, &feat); // get feature without CMN.
+    ivector_stats_.AccStats(info_.extractor, feat, posterior);
+  }
+}
+
+void OnlineIvectorFeature::EstimateIvector(int32 t) {
+  ivector_stats_.GetIvector(info_.num_cg_iters, &current_ivector_);
+  if (!info_.use_most_recent_ivector) {  // need to cache iVectors.
+    int32 ivec_index = t / info_.ivector_period;
+    KALDI_ASSERT(ivec_index == static_cast<int32>(ivectors_history_.size()));
+    ivectors_history_.push_back(new Vector<BaseFloat>(current_ivector_));
+  }
+}
+
+void OnlineIvectorFeature::UpdateStatsUntilFrame(int32 frame) {
+  MemoryTagScope memory_tag(kMemoryFeature);
+  PendingStats pending;
+  PlanStatsUntilFrame(frame, &pending);
+  Matrix<BaseFloat> ubm_loglikes;
+  if (!pending.frames.empty()) {
+    Matrix<BaseFloat> feats(pending.frames.size(), lda_normalized_->Dim(),
+                            kUndefined);
+    GetUbmFeatures(pending, &feats);
+    info_.diag_ubm.LogLikelihoods(feats, &ubm_loglikes);
+  }
+  ApplyStats(pending, ubm_loglikes);
+}
+
+// static
+void OnlineIvectorFeature::UpdateStatsBatch(
+    const std::vector<OnlineIvectorFeature*> &features) {
+  if (features.empty()) return;
+  MemoryTagScope memory_tag(kMemoryFeature);
+  const OnlineIvectorExtractionInfo &info = features[0]->info_;
+  std::vector<PendingStats> pending(features.size());
+  int32 tot_frames = 0;
+  for (size_t i = 0; i < features.size(); i++) {
+    OnlineIvectorFeature *f = features[i];
+    KALDI_ASSERT(&(f->info_) == &info &&
+                 "UpdateStatsBatch() requires features with the same info.");
+    int32 frame = f->NumFramesReady() - 1;
+    if (f->delta_weights_provided_)
+      frame = std::min(frame, f->most_recent_frame_with_weight_);
+    if (frame >= f->num_frames_stats_)
+      f->PlanStatsUntilFrame(frame, &(pending[i]));
+    tot_frames += pending[i].frames.size();
+  }
+  // Compute the UBM log-likelihoods for the frames of all the streams at once.
+  Matrix<BaseFloat> ubm_loglikes;
+  if (tot_frames != 0) {
+    Matrix<BaseFloat> feats(tot_frames, info.diag_ubm.Dim(), kUndefined);
+    for (size_t i = 0, offset = 0; i < features.size(); i++) {
+      int32 num_frames = pending[i].frames.size();
+      if (num_frames == 0) continue;
+      SubMatrix<BaseFloat> this_feats(feats, offset, num_frames,
+                                      0, feats.NumCols());
+      features[i]->GetUbmFeatures(pending[i], &this_feats);
+      offset += num_frames;
     }
+    info.diag_ubm.LogLikelihoods(feats, &ubm_loglikes);
+  }
+  for (size_t i = 0, offset = 0; i < features.size(); i++) {
+    int32 num_frames = pending[i].frames.size();
+    if (num_frames == 0) {
+      features[i]->ApplyStats(pending[i], Matrix<BaseFloat>());
+      continue;
+    }
+    SubMatrix<BaseFloat> this_loglikes(ubm_loglikes, offset, num_frames,
+                                       0, ubm_loglikes.NumCols());
+    features[i]->ApplyStats(pending[i], this_loglikes);
+    offset += num_frames;
   }
 }
 
@@ -258,10 +341,7 @@ void OnlineIvectorFeature::GetFrame(int32 frame,
                                     VectorBase<BaseFloat> *feat) {
   int32 frame_to_update_until = (info_.greedy_ivector_extractor ?
                                  lda_->NumFramesReady() - 1 : frame);
-  if (!delta_weights_provided_)  // No silence weighting.
-    UpdateStatsUntilFrame(frame_to_update_until);
-  else
-    UpdateStatsUntilFrameWeighted(frame_to_update_until);
+  UpdateStatsUntilFrame(frame_to_update_until);
 
   KALDI_ASSERT(feat->Dim() == this->Dim());
   
@@ -340,6 +420,7 @@ OnlineIvectorFeature::OnlineIvectorFeature(
     num_frames_stats_(0), delta_weights_provided_(false),
     updated_with_no_delta_weights_(false),
     most_recent_frame_with_weight_(-1), tot_ubm_loglike_(0.0) {
+  MemoryTagScope memory_tag(kMemoryFeature);
   info.Check();
   KALDI_ASSERT(base_feature != NULL);
   splice_ = new OnlineSpliceFrames(info_.splice_opts, base_);
@@ -382,12 +463,18 @@ OnlineSilenceWeighting::OnlineSilenceWeighting(
     const TransitionModel &trans_model,
     const OnlineSilenceWeightingConfig &config):
     trans_model_(trans_model), config_(config),
-    num_frames_output_and_correct_(0) {
+    stable_frame_(0), num_frames_output_and_correct_(0) {
   vector<int32> silence_phones;
   SplitStringToIntegers(config.silence_phones_str, ":,", false,
                         &silence_phones);
+  unordered_set<int32> silence_phone_set;
   for (size_t i = 0; i < silence_phones.size(); i++)
-    silence_phones_.insert(silence_phones[i]);
+    silence_phone_set.insert(silence_phones[i]);
+  int32 num_tids = trans_model.NumTransitionIds();
+  is_silence_transition_.resize(num_tids + 1, false);
+  for (int32 tid = 1; tid <= num_tids; tid++)
+    is_silence_transition_[tid] =
+        (silence_phone_set.count(trans_model.TransitionIdToPhone(tid)) != 0);
 }
 
 
@@ -406,11 +493,16 @@ void OnlineSilenceWeighting::ComputeCurrentTraceback(
 
   if (num_frames_decoded == 0)
     return;  
+  // Frames before the point where the decoder's paths last converged to a
+  // single token can't change; we don't trace back into them, and we look
+  // for a new convergence point only among the frames after it, so the cost
+  // of this function doesn't grow with the length of the utterance.
+  int32 convergence_frame = decoder.GetConvergenceFrame(stable_frame_);
   int32 frame = num_frames_decoded - 1;
   bool use_final_probs = false;
   LatticeFasterOnlineDecoder::BestPathIterator iter =
       decoder.BestPathEnd(use_final_probs, NULL);
-  while (frame >= 0) {
+  while (frame >= stable_frame_) {
     LatticeArc arc;
     arc.ilabel = 0;
     while (arc.ilabel == 0)  // the while loop skips over input-epsilons
@@ -438,6 +530,11 @@ void OnlineSilenceWeighting::ComputeCurrentTraceback(
     // constructor), reflecting that we haven't already output a weight for that
     // frame.
   }
+  // The arcs for frames before convergence_frame lead into the single token
+  // on that frame, which all future paths will go through, so the traceback
+  // for them is now final.
+  if (convergence_frame > stable_frame_)
+    stable_frame_ = convergence_frame;
 }
 
 int32 OnlineSilenceWeighting::GetBeginFrame() {
@@ -539,9 +636,7 @@ void OnlineSilenceWeighting::GetDeltaWeights(
         // frame we have a traceback for (probably a reasonable guess).
         frame_weight[offset] = frame_weight[offset - 1];
       } else {
-        int32 phone = trans_model_.TransitionIdToPhone(transition_id);
-        bool is_silence = (silence_phones_.count(phone) != 0);
-        if (is_silence)
+        if (is_silence_transition_[transition_id])
           frame_weight[offset] = silence_weight;
         // now deal with max-duration issues.
         if (max_state_duration > 0 &&
@@ -308,20 +308,62 @@ class OnlineIvectorFeature: public OnlineFeatureInterface {
   // lifetime of this object.
   void UpdateFrameWeights(
       const std::vector<std::pair<int32, BaseFloat> > &delta_weights);
+
+  /// This is for servers that decode many streams at once.  It brings the
+  /// iVector stats of each of "features" up to date with all the frames that
+  /// are ready (or, with silence weighting, that have weights), as GetFrame()
+  /// does when --greedy-ivector-extractor=true, so that the following
+  /// GetFrame() calls are cheap.  The UBM log-likelihoods for the new frames of
+  /// all the streams are computed together, in one matrix multiplication; the
+  /// iVectors themselves are still estimated separately for each stream.  All
+  /// the features must have been constructed with the same "info".  Note: if
+  /// --use-most-recent-ivector=true, GetFrame() will then return an iVector
+  /// that reflects all these frames, even if --greedy-ivector-extractor=false.
+  static void UpdateStatsBatch(
+      const std::vector<OnlineIvectorFeature*> &features);
   
  private:
-  // this function adds "weight" to the stats for frame "frame".
-  void UpdateStatsForFrame(int32 frame,
-                           BaseFloat weight);
+  // The stats updates that have been planned but not yet done; see
+  // PlanStatsUntilFrame().
+  struct PendingStats {
+    // The frames whose stats are to be added, with their weights, in order.
+    std::vector<std::pair<int32, BaseFloat> > frames;
+    // Pairs (i, t) meaning that after the first i elements of "frames" have
+    // been added, the iVector for time t is to be estimated.
+    std::vector<std::pair<size_t, int32> > ivector_times;
+  };
 
-  // This is the original UpdateStatsUntilFrame that is called when there is
-  // no data-weighting involved.
-  void UpdateStatsUntilFrame(int32 frame);
+  // Works out the stats updates needed before GetFrame() can return the
+  // iVector for frame "frame", and advances num_frames_stats_ accordingly.  It
+  // calls PlanStatsUntilFrameUnweighted() or PlanStatsUntilFrameWeighted().
+  void PlanStatsUntilFrame(int32 frame, PendingStats *pending);
 
-  // This is the new UpdateStatsUntilFrame that is called when there is
+  // This is the original planning function that is called when there is no
+  // data-weighting involved.
+  void PlanStatsUntilFrameUnweighted(int32 frame, PendingStats *pending);
+
+  // This is the planning function that is called when there is
   // data-weighting (i.e. when the user has been calling UpdateFrameWeights()).
-  void UpdateStatsUntilFrameWeighted(int32 frame);
-  
+  void PlanStatsUntilFrameWeighted(int32 frame, PendingStats *pending);
+
+  // Copies the features that the UBM is evaluated on (the ones with CMN), for
+  // the frames in pending.frames, to the rows of "feats".
+  void GetUbmFeatures(const PendingStats &pending,
+                      MatrixBase<BaseFloat> *feats);
+
+  // Does the stats updates in "pending", given the UBM log-likelihoods of its
+  // frames (one row per element of pending.frames), and estimates the
+  // iVectors.
+  void ApplyStats(const PendingStats &pending,
+                  const MatrixBase<BaseFloat> &ubm_loglikes);
+
+  // Plans and does the stats updates needed for frame "frame".
+  void UpdateStatsUntilFrame(int32 frame);
+
+  // Estimates the iVector after the stats of frame t have been added, and
+  // caches it if !info_.use_most_recent_ivector.
+  void EstimateIvector(int32 t);
+
   void PrintDiagnostics() const;
   
   const OnlineIvectorExtractionInfo &info_;
@@ -348,7 +390,7 @@ class OnlineIvectorFeature: public OnlineFeatureInterface {
 
   /// delta_weights_ is written to by UpdateFrameWeights,
   /// in the case where the iVector estimation is silence-weighted using the decoder
-  /// traceback.  Its elements are consumed by UpdateStatsUntilFrameWeighted().
+  /// traceback.  Its elements are consumed by PlanStatsUntilFrameWeighted().
   /// We provide std::greater<std::pair<int32, BaseFloat> > > as the comparison type
   /// (default is std::less) so that the lowest-numbered frame, not the highest-numbered
   /// one, will be returned by top().
@@ -363,7 +405,7 @@ class OnlineIvectorFeature: public OnlineFeatureInterface {
   /// used to detect wrong usage of this class.
   bool delta_weights_provided_;
   /// The following is also used to detect wrong usage of this class; it's set
-  /// to true if UpdateStatsUntilFrame() was ever called.
+  /// to true if PlanStatsUntilFrameUnweighted() was ever called.
   bool updated_with_no_delta_weights_;
   
   /// if delta_weights_ was ever called, this keeps track of the most recent
@@ -472,7 +514,9 @@ class OnlineSilenceWeighting {
   const TransitionModel &trans_model_;
   const OnlineSilenceWeightingConfig &config_;
   
-  unordered_set<int32> silence_phones_;
+  // is_silence_transition_[tid] is true if transition-id tid is for one of the
+  // silence phones (index zero is unused).
+  std::vector<bool> is_silence_transition_;
   
   struct FrameInfo {
     //The only reason we need the token pointer is to know far back we have to
@@ -495,6 +539,12 @@ class OnlineSilenceWeighting {
 
   std::vector<FrameInfo> frame_info_;
 
+  // The traceback in frame_info_ is final for frames before stable_frame_,
+  // because the decoder's paths have since converged to a single token (see
+  // LatticeFasterOnlineDecoder::GetConvergenceFrame()); ComputeCurrentTraceback()
+  // never traces back further than this.
+  int32 stable_frame_;
+
   // This records how many frames have been output and that currently reflect
   // the traceback accurately.  It is used to avoid GetDeltaWeights() having to
   // visit each frame as far back as t = 0, each time it is called.
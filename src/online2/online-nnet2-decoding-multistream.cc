@@ -0,0 +1,731 @@
+// online2/online-nnet2-decoding-multistream.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <sys/time.h>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+
+#include "online2/online-nnet2-decoding-multistream.h"
+#include "nnet2/nnet-compute.h"
+#include "lat/lattice-functions.h"
+#include "lat/determinize-lattice-pruned.h"
+
+namespace kaldi {
+
+// Returns the time of day in seconds.
+static double TimeOfDay() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1.0e-06;
+}
+
+void OnlineNnet2MultiStreamConfig::Check() const {
+  KALDI_ASSERT(num_nnet_threads > 0 && num_decoder_threads > 0);
+  KALDI_ASSERT(nnet_batch_size > 0 && max_batch_streams > 0);
+  KALDI_ASSERT(max_batch_delay >= 0.0);
+  KALDI_ASSERT(decode_batch_size > 0);
+}
+
+struct OnlineNnet2MultiStreamDecoder::Stream {
+  Stream(const OnlineNnet2MultiStreamConfig &config,
+         const TransitionModel &tmodel,
+         const fst::Fst<fst::StdArc> &fst,
+         const OnlineNnet2FeaturePipelineInfo &feature_info,
+         const OnlineIvectorExtractorAdaptationState &adaptation_state):
+      sampling_rate(0.0), num_samples_pending(0), input_finished(false),
+      abort(false), error(false), nnet_queued(false), nnet_queue_time(0.0),
+      nnet_busy(false),
+      nnet_done(false), decoder_queued(false), decoder_busy(false),
+      frames_to_decode(false), decodable_finished(false), done(false),
+      feature_pipeline(feature_info), num_frames_consumed(0),
+      silence_weighting(tmodel, feature_info.silence_weighting_config),
+      decodable(tmodel), decoder(fst, config.decoder_opts) {
+    feature_pipeline.SetAdaptationState(adaptation_state);
+    decoder.InitDecoding();
+  }
+
+  ~Stream() {
+    for (size_t i = 0; i < input_waveform.size(); i++)
+      delete input_waveform[i];
+    for (size_t i = 0; i < loglikes.size(); i++)
+      delete loglikes[i];
+  }
+
+  // The following are protected by the mutex_ of the decoder.
+  BaseFloat sampling_rate;  // set the first time AcceptWaveform() is called.
+  // Waveform pieces waiting to be given to the feature pipeline.
+  std::deque<Vector<BaseFloat>*> input_waveform;
+  int64 num_samples_pending;  // total size of input_waveform.
+  bool input_finished;  // true once InputFinished() has been called.
+  bool abort;  // true if TerminateDecoding() was called or there was an error.
+  bool error;
+  bool nnet_queued;  // true if in nnet_queue_.
+  double nnet_queue_time;  // time of day at which it was put in nnet_queue_.
+  bool nnet_busy;  // true while an nnet thread is working on the stream.
+  bool nnet_done;  // true once all the log-likelihoods have been computed.
+  // Blocks of scaled log-likelihoods waiting to be given to the decodable.
+  std::deque<Matrix<BaseFloat>*> loglikes;
+  bool decoder_queued;  // true if in decoder_queue_.
+  bool decoder_busy;  // true while a decoder thread is working on the stream.
+  bool frames_to_decode;  // true if the decodable has frames not yet decoded.
+  bool decodable_finished;  // true once decodable.InputIsFinished() was called.
+  bool done;  // true once no more work will be done for this stream.
+
+  // The following are only accessed by the nnet thread that has set
+  // nnet_busy (and by GetAdaptationState() once the stream is done).
+  OnlineNnet2FeaturePipeline feature_pipeline;
+  int32 num_frames_consumed;  // number of frames taken from feature_pipeline.
+  // The features that are still needed as input to the nnet: the frames not
+  // yet evaluated, preceded by the left and right context of the first one
+  // (at the start and end of the utterance, the first and last frames are
+  // repeated to provide this context).
+  Matrix<BaseFloat> nnet_input;
+
+  // This controls the (optional) downweighting of silence in iVector
+  // estimation; it's used by both kinds of thread.
+  OnlineSilenceWeighting silence_weighting;
+  Mutex silence_weighting_mutex;
+
+  // The following are only modified by the decoder thread that has set
+  // decoder_busy; decoder_mutex guards the decoder against being read (e.g.
+  // by GetLattice()) while it is being advanced.
+  DecodableMatrixMappedOffset decodable;
+  LatticeFasterOnlineDecoder decoder;
+  Mutex decoder_mutex;
+};
+
+
+OnlineNnet2MultiStreamDecoder::OnlineNnet2MultiStreamDecoder(
+    const OnlineNnet2MultiStreamConfig &config,
+    const TransitionModel &tmodel,
+    const nnet2::AmNnet &am_nnet,
+    const fst::Fst<fst::StdArc> &fst,
+    const OnlineNnet2FeaturePipelineInfo &feature_info):
+    config_(config), tmodel_(tmodel), am_nnet_(am_nnet), fst_(fst),
+    feature_info_(feature_info), log_inv_prior_(am_nnet.Priors()),
+    nnet_context_(am_nnet.GetNnet().LeftContext() +
+                  am_nnet.GetNnet().RightContext()),
+    shutdown_(false), next_stream_id_(0) {
+  config.Check();
+  log_inv_prior_.ApplyFloor(1.0e-20);  // should have no effect.
+  log_inv_prior_.ApplyLog();
+  log_inv_prior_.Scale(-1.0);
+
+  pthread_mutex_init(&mutex_, NULL);
+  pthread_cond_init(&nnet_cond_, NULL);
+  pthread_cond_init(&decoder_cond_, NULL);
+  pthread_cond_init(&done_cond_, NULL);
+  int32 num_threads = config.num_nnet_threads + config.num_decoder_threads;
+  threads_.resize(num_threads);
+  for (int32 i = 0; i < num_threads; i++) {
+    int32 ret;
+    if ((ret = pthread_create(&(threads_[i]), NULL,
+                              (i < config.num_nnet_threads ? RunNnetWorker :
+                               RunDecoderWorker),
+                              static_cast<void*>(this)))) {
+      const char *c = strerror(ret);
+      KALDI_ERR << "Error creating thread, errno was: " << (c ? c : "[NULL]");
+    }
+  }
+}
+
+OnlineNnet2MultiStreamDecoder::~OnlineNnet2MultiStreamDecoder() {
+  std::vector<int32> stream_ids;
+  pthread_mutex_lock(&mutex_);
+  for (std::map<int32, Stream*>::iterator iter = streams_.begin();
+       iter != streams_.end(); ++iter)
+    stream_ids.push_back(iter->first);
+  pthread_mutex_unlock(&mutex_);
+  for (size_t i = 0; i < stream_ids.size(); i++)
+    CloseStream(stream_ids[i]);
+
+  pthread_mutex_lock(&mutex_);
+  shutdown_ = true;
+  pthread_cond_broadcast(&nnet_cond_);
+  pthread_cond_broadcast(&decoder_cond_);
+  pthread_mutex_unlock(&mutex_);
+  for (size_t i = 0; i < threads_.size(); i++) {
+    if (pthread_join(threads_[i], NULL))
+      KALDI_WARN << "Error rejoining thread.";  // this should not happen.
+  }
+  pthread_mutex_destroy(&mutex_);
+  pthread_cond_destroy(&nnet_cond_);
+  pthread_cond_destroy(&decoder_cond_);
+  pthread_cond_destroy(&done_cond_);
+}
+
+int32 OnlineNnet2MultiStreamDecoder::OpenStream(
+    const OnlineIvectorExtractorAdaptationState &adaptation_state) {
+  Stream *stream = new Stream(config_, tmodel_, fst_, feature_info_,
+                              adaptation_state);
+  pthread_mutex_lock(&mutex_);
+  int32 stream_id = next_stream_id_++;
+  streams_[stream_id] = stream;
+  pthread_mutex_unlock(&mutex_);
+  return stream_id;
+}
+
+OnlineNnet2MultiStreamDecoder::Stream* OnlineNnet2MultiStreamDecoder::GetStream(
+    int32 stream_id) const {
+  pthread_mutex_lock(&mutex_);
+  std::map<int32, Stream*>::const_iterator iter = streams_.find(stream_id);
+  Stream *ans = (iter == streams_.end() ? NULL : iter->second);
+  pthread_mutex_unlock(&mutex_);
+  if (ans == NULL)
+    KALDI_ERR << "No such stream " << stream_id << " (already closed?)";
+  return ans;
+}
+
+int32 OnlineNnet2MultiStreamDecoder::NumStreams() const {
+  pthread_mutex_lock(&mutex_);
+  int32 ans = streams_.size();
+  pthread_mutex_unlock(&mutex_);
+  return ans;
+}
+
+void OnlineNnet2MultiStreamDecoder::AcceptWaveform(
+    int32 stream_id, BaseFloat sampling_rate,
+    const VectorBase<BaseFloat> &wave_part) {
+  Stream *stream = GetStream(stream_id);
+  if (wave_part.Dim() == 0) return;
+  Vector<BaseFloat> *new_part = new Vector<BaseFloat>(wave_part);
+  pthread_mutex_lock(&mutex_);
+  bool bad_rate = (stream->sampling_rate > 0.0 &&
+                   stream->sampling_rate != sampling_rate),
+      finished = stream->input_finished;
+  if (bad_rate || finished || stream->abort) {
+    pthread_mutex_unlock(&mutex_);
+    delete new_part;
+    if (bad_rate)
+      KALDI_ERR << "Sampling rate changed from " << stream->sampling_rate
+                << " to " << sampling_rate;
+    if (finished)
+      KALDI_ERR << "AcceptWaveform() called after InputFinished()";
+    return;  // the stream was terminated; the waveform is not needed.
+  }
+  stream->sampling_rate = sampling_rate;
+  stream->input_waveform.push_back(new_part);
+  stream->num_samples_pending += new_part->Dim();
+  ScheduleNnet(stream);
+  pthread_mutex_unlock(&mutex_);
+}
+
+void OnlineNnet2MultiStreamDecoder::InputFinished(int32 stream_id) {
+  Stream *stream = GetStream(stream_id);
+  pthread_mutex_lock(&mutex_);
+  bool already_finished = stream->input_finished;
+  stream->input_finished = true;
+  ScheduleNnet(stream);
+  pthread_mutex_unlock(&mutex_);
+  if (already_finished)
+    KALDI_ERR << "InputFinished called twice";
+}
+
+void OnlineNnet2MultiStreamDecoder::TerminateDecoding(int32 stream_id) {
+  Stream *stream = GetStream(stream_id);
+  pthread_mutex_lock(&mutex_);
+  stream->abort = true;
+  ScheduleDecoder(stream);
+  pthread_mutex_unlock(&mutex_);
+}
+
+void OnlineNnet2MultiStreamDecoder::Wait(int32 stream_id) {
+  Stream *stream = GetStream(stream_id);
+  pthread_mutex_lock(&mutex_);
+  if (!stream->input_finished && !stream->abort) {
+    pthread_mutex_unlock(&mutex_);
+    KALDI_ERR << "You cannot call Wait() before calling either InputFinished() "
+              << "or TerminateDecoding().";
+  }
+  while (!stream->done)
+    pthread_cond_wait(&done_cond_, &mutex_);
+  bool error = stream->error;
+  pthread_mutex_unlock(&mutex_);
+  if (error)
+    KALDI_ERR << "Error encountered during decoding.  See above.";
+}
+
+void OnlineNnet2MultiStreamDecoder::FinalizeDecoding(int32 stream_id) {
+  Wait(stream_id);
+  Stream *stream = GetStream(stream_id);
+  stream->decoder_mutex.Lock();
+  stream->decoder.FinalizeDecoding();
+  stream->decoder_mutex.Unlock();
+}
+
+void OnlineNnet2MultiStreamDecoder::CloseStream(int32 stream_id) {
+  Stream *stream = GetStream(stream_id);
+  pthread_mutex_lock(&mutex_);
+  if (!stream->done) {
+    stream->abort = true;
+    ScheduleDecoder(stream);
+  }
+  while (!stream->done)
+    pthread_cond_wait(&done_cond_, &mutex_);
+  streams_.erase(stream_id);
+  pthread_mutex_unlock(&mutex_);
+  delete stream;
+}
+
+int32 OnlineNnet2MultiStreamDecoder::NumFramesDecoded(int32 stream_id) const {
+  Stream *stream = GetStream(stream_id);
+  stream->decoder_mutex.Lock();
+  int32 ans = stream->decoder.NumFramesDecoded();
+  stream->decoder_mutex.Unlock();
+  return ans;
+}
+
+void OnlineNnet2MultiStreamDecoder::GetLattice(
+    int32 stream_id, bool end_of_utterance, CompactLattice *clat,
+    BaseFloat *final_relative_cost) const {
+  Stream *stream = GetStream(stream_id);
+  clat->DeleteStates();
+  stream->decoder_mutex.Lock();
+  if (final_relative_cost != NULL)
+    *final_relative_cost = stream->decoder.FinalRelativeCost();
+  if (stream->decoder.NumFramesDecoded() == 0) {
+    stream->decoder_mutex.Unlock();
+    clat->SetFinal(clat->AddState(),
+                   CompactLatticeWeight::One());
+    return;
+  }
+  Lattice raw_lat;
+  stream->decoder.GetRawLattice(&raw_lat, end_of_utterance);
+  stream->decoder_mutex.Unlock();
+
+  if (!config_.decoder_opts.determinize_lattice)
+    KALDI_ERR << "--determinize-lattice=false option is not supported at the moment";
+
+  BaseFloat lat_beam = config_.decoder_opts.lattice_beam;
+  DeterminizeLatticePhonePrunedWrapper(
+      tmodel_, &raw_lat, lat_beam, clat, config_.decoder_opts.det_opts);
+}
+
+void OnlineNnet2MultiStreamDecoder::GetBestPath(
+    int32 stream_id, bool end_of_utterance, Lattice *best_path,
+    BaseFloat *final_relative_cost) const {
+  Stream *stream = GetStream(stream_id);
+  stream->decoder_mutex.Lock();
+  if (stream->decoder.NumFramesDecoded() == 0) {
+    best_path->DeleteStates();
+    best_path->SetFinal(best_path->AddState(),
+                        LatticeWeight::One());
+    if (final_relative_cost != NULL)
+      *final_relative_cost = std::numeric_limits<BaseFloat>::infinity();
+  } else {
+    stream->decoder.GetBestPath(best_path,
+                                end_of_utterance);
+    if (final_relative_cost != NULL)
+      *final_relative_cost = stream->decoder.FinalRelativeCost();
+  }
+  stream->decoder_mutex.Unlock();
+}
+
+bool OnlineNnet2MultiStreamDecoder::EndpointDetected(
+    int32 stream_id, const OnlineEndpointConfig &config) {
+  Stream *stream = GetStream(stream_id);
+  stream->decoder_mutex.Lock();
+  bool ans = kaldi::EndpointDetected(config, tmodel_,
+                                     feature_info_.FrameShiftInSeconds(),
+                                     stream->decoder);
+  stream->decoder_mutex.Unlock();
+  return ans;
+}
+
+void OnlineNnet2MultiStreamDecoder::GetAdaptationState(
+    int32 stream_id,
+    OnlineIvectorExtractorAdaptationState *adaptation_state) const {
+  Stream *stream = GetStream(stream_id);
+  pthread_mutex_lock(&mutex_);
+  bool done = stream->done;
+  pthread_mutex_unlock(&mutex_);
+  if (!done)
+    KALDI_ERR << "You cannot call GetAdaptationState() before Wait().";
+  stream->feature_pipeline.GetAdaptationState(adaptation_state);
+}
+
+void OnlineNnet2MultiStreamDecoder::ScheduleNnet(Stream *stream) {
+  if (stream->abort) {
+    ScheduleDecoder(stream);  // this takes care of terminating it.
+    return;
+  }
+  if (stream->nnet_queued || stream->nnet_busy || stream->nnet_done)
+    return;
+  int64 min_samples_pending = config_.nnet_batch_size *
+      feature_info_.FrameShiftInSeconds() * stream->sampling_rate;
+  if (stream->input_finished || (stream->num_samples_pending > 0 &&
+      stream->num_samples_pending >= min_samples_pending)) {
+    stream->nnet_queued = true;
+    stream->nnet_queue_time = TimeOfDay();
+    nnet_queue_.push_back(stream);
+    pthread_cond_signal(&nnet_cond_);
+  }
+}
+
+void OnlineNnet2MultiStreamDecoder::ScheduleDecoder(Stream *stream) {
+  if (stream->done || stream->decoder_queued || stream->decoder_busy)
+    return;
+  if (stream->abort) {
+    // Once the threads that have the stream queued or busy have seen the
+    // abort flag (they call this function again), it is done.
+    if (!stream->nnet_queued && !stream->nnet_busy)
+      SetDone(stream);
+    return;
+  }
+  if (!stream->loglikes.empty() || stream->frames_to_decode ||
+      (stream->nnet_done && !stream->decodable_finished)) {
+    stream->decoder_queued = true;
+    decoder_queue_.push_back(stream);
+    pthread_cond_signal(&decoder_cond_);
+  } else if (stream->nnet_done) {
+    SetDone(stream);
+  }
+}
+
+void OnlineNnet2MultiStreamDecoder::SetDone(Stream *stream) {
+  stream->done = true;
+  for (size_t i = 0; i < stream->loglikes.size(); i++)
+    delete stream->loglikes[i];
+  stream->loglikes.clear();
+  pthread_cond_broadcast(&done_cond_);
+}
+
+void OnlineNnet2MultiStreamDecoder::WaitForBatch() {
+  if (config_.max_batch_delay <= 0.0)
+    return;
+  while (!shutdown_ && !nnet_queue_.empty() &&
+         nnet_queue_.size() < static_cast<size_t>(config_.max_batch_streams) &&
+         nnet_queue_.size() < streams_.size()) {
+    double deadline = nnet_queue_.front()->nnet_queue_time +
+        config_.max_batch_delay;
+    if (TimeOfDay() >= deadline)
+      break;
+    struct timespec ts;
+    ts.tv_sec = static_cast<time_t>(deadline);
+    ts.tv_nsec = static_cast<long>((deadline - ts.tv_sec) * 1.0e+09);
+    if (ts.tv_nsec >= 1000000000L)
+      ts.tv_nsec = 999999999L;
+    // ScheduleNnet() signals nnet_cond_ each time a stream is queued, so we
+    // wake up to re-check the batch size.
+    if (pthread_cond_timedwait(&nnet_cond_, &mutex_, &ts) == ETIMEDOUT)
+      break;
+  }
+}
+
+// static
+void *OnlineNnet2MultiStreamDecoder::RunNnetWorker(void *me) {
+  static_cast<OnlineNnet2MultiStreamDecoder*>(me)->NnetWorker();
+  return NULL;
+}
+
+// static
+void *OnlineNnet2MultiStreamDecoder::RunDecoderWorker(void *me) {
+  static_cast<OnlineNnet2MultiStreamDecoder*>(me)->DecoderWorker();
+  return NULL;
+}
+
+void OnlineNnet2MultiStreamDecoder::NnetWorker() {
+  pthread_mutex_lock(&mutex_);
+  while (true) {
+    while (!shutdown_ && nnet_queue_.empty())
+      pthread_cond_wait(&nnet_cond_, &mutex_);
+    if (nnet_queue_.empty()) break;  // shutdown_ must be true.
+    WaitForBatch();
+    if (nnet_queue_.empty()) continue;  // another thread took the streams.
+    // Take up to max_batch_streams streams, with their pending waveform.
+    std::vector<Stream*> streams;
+    std::vector<std::vector<Vector<BaseFloat>*> > waveforms;
+    std::vector<bool> input_finished;
+    while (!nnet_queue_.empty() &&
+           streams.size() < static_cast<size_t>(config_.max_batch_streams)) {
+      Stream *stream = nnet_queue_.front();
+      nnet_queue_.pop_front();
+      stream->nnet_queued = false;
+      if (stream->abort) {
+        ScheduleDecoder(stream);
+        continue;
+      }
+      stream->nnet_busy = true;
+      streams.push_back(stream);
+      waveforms.push_back(std::vector<Vector<BaseFloat>*>(
+          stream->input_waveform.begin(), stream->input_waveform.end()));
+      stream->input_waveform.clear();
+      stream->num_samples_pending = 0;
+      input_finished.push_back(stream->input_finished);
+    }
+    if (streams.empty()) continue;
+    pthread_mutex_unlock(&mutex_);
+
+    size_t num_streams = streams.size();
+    std::vector<bool> error(num_streams, false), complete(num_streams, false);
+    std::vector<OnlineIvectorFeature*> ivector_features;
+    for (size_t i = 0; i < num_streams; i++) {
+      try {
+        AcceptInput(streams[i], &(waveforms[i]), input_finished[i]);
+        OnlineIvectorFeature *ivector_feature =
+            streams[i]->feature_pipeline.IvectorFeature();
+        if (ivector_feature != NULL)
+          ivector_features.push_back(ivector_feature);
+      } catch (const std::exception &e) {
+        KALDI_WARN << "Caught exception: " << e.what();
+        error[i] = true;
+        DeletePointers(&(waveforms[i]));
+      }
+    }
+    try {
+      // The UBM computation for the iVector stats of all the streams is done
+      // together.
+      OnlineIvectorFeature::UpdateStatsBatch(ivector_features);
+    } catch (const std::exception &e) {
+      KALDI_WARN << "Caught exception: " << e.what();
+      error.assign(num_streams, true);
+    }
+    for (size_t i = 0; i < num_streams; i++) {
+      try {
+        if (!error[i])
+          complete[i] = ExtractFeatures(streams[i], input_finished[i]);
+      } catch (const std::exception &e) {
+        KALDI_WARN << "Caught exception: " << e.what();
+        error[i] = true;
+      }
+      if (error[i])
+        streams[i]->nnet_input.Resize(0, 0);  // so it's not evaluated.
+    }
+    std::vector<Matrix<BaseFloat>*> loglikes;
+    try {
+      ComputeLoglikes(streams, &loglikes);
+    } catch (const std::exception &e) {
+      KALDI_WARN << "Caught exception: " << e.what();
+      DeletePointers(&loglikes);
+      loglikes.clear();
+      error.assign(num_streams, true);
+    }
+
+    pthread_mutex_lock(&mutex_);
+    for (size_t i = 0; i < num_streams; i++) {
+      Stream *stream = streams[i];
+      stream->nnet_busy = false;
+      if (error[i]) {
+        stream->error = true;
+        stream->abort = true;
+      } else {
+        if (loglikes[i]->NumRows() != 0)
+          stream->loglikes.push_back(loglikes[i]);
+        else
+          delete loglikes[i];
+        stream->nnet_done = complete[i];
+      }
+      ScheduleNnet(stream);
+      ScheduleDecoder(stream);
+    }
+  }
+  pthread_mutex_unlock(&mutex_);
+}
+
+void OnlineNnet2MultiStreamDecoder::AcceptInput(
+    Stream *stream, std::vector<Vector<BaseFloat>*> *waveform,
+    bool input_finished) {
+  OnlineNnet2FeaturePipeline &pipeline = stream->feature_pipeline;
+  for (size_t i = 0; i < waveform->size(); i++) {
+    pipeline.AcceptWaveform(stream->sampling_rate, *((*waveform)[i]));
+    delete (*waveform)[i];
+    (*waveform)[i] = NULL;
+  }
+  if (input_finished)
+    pipeline.InputFinished();  // flushes out the last frames.
+
+  if (stream->silence_weighting.Active()) {
+    stream->silence_weighting_mutex.Lock();
+    std::vector<std::pair<int32, BaseFloat> > delta_weights;
+    stream->silence_weighting.GetDeltaWeights(pipeline.NumFramesReady(),
+                                              &delta_weights);
+    stream->silence_weighting_mutex.Unlock();
+    pipeline.UpdateFrameWeights(delta_weights);
+  }
+}
+
+bool OnlineNnet2MultiStreamDecoder::ExtractFeatures(Stream *stream,
+                                                    bool input_finished) {
+  OnlineNnet2FeaturePipeline &pipeline = stream->feature_pipeline;
+  const nnet2::Nnet &nnet = am_nnet_.GetNnet();
+  int32 num_frames_ready = pipeline.NumFramesReady(),
+      num_new_frames = num_frames_ready - stream->num_frames_consumed,
+      dim = pipeline.Dim();
+  Matrix<BaseFloat> &nnet_input = stream->nnet_input;
+  if (num_new_frames > 0) {
+    std::vector<int32> frames(num_new_frames);
+    for (int32 i = 0; i < num_new_frames; i++)
+      frames[i] = stream->num_frames_consumed + i;
+    Matrix<BaseFloat> feats(num_new_frames, dim, kUndefined);
+    pipeline.GetFrames(frames, &feats);
+    // At the start of the utterance, the first frame is repeated to provide
+    // the left context.
+    int32 num_pad = (stream->num_frames_consumed == 0 ? nnet.LeftContext() : 0),
+        old_num_rows = nnet_input.NumRows();
+    nnet_input.Resize(old_num_rows + num_pad + num_new_frames, dim, kCopyData);
+    for (int32 i = 0; i < num_pad; i++)
+      nnet_input.Row(old_num_rows + i).CopyFromVec(feats.Row(0));
+    nnet_input.RowRange(old_num_rows + num_pad,
+                        num_new_frames).CopyFromMat(feats);
+    stream->num_frames_consumed = num_frames_ready;
+  }
+  if (input_finished && stream->num_frames_consumed > 0) {
+    // At the end of the utterance, the last frame is repeated to provide
+    // the right context.
+    int32 num_pad = nnet.RightContext(), old_num_rows = nnet_input.NumRows();
+    nnet_input.Resize(old_num_rows + num_pad, dim, kCopyData);
+    for (int32 i = 0; i < num_pad; i++)
+      nnet_input.Row(old_num_rows + i).CopyFromVec(
+          nnet_input.Row(old_num_rows - 1));
+  }
+  return input_finished;
+}
+
+void OnlineNnet2MultiStreamDecoder::ComputeLoglikes(
+    const std::vector<Stream*> &streams,
+    std::vector<Matrix<BaseFloat>*> *loglikes) {
+  const nnet2::Nnet &nnet = am_nnet_.GetNnet();
+  int32 num_streams = streams.size(), num_input_rows = 0;
+  // The streams' inputs are stacked; offsets[i] is the row where stream i's
+  // input starts, or -1 if it has too few frames to produce any output.
+  std::vector<int32> offsets(num_streams, -1);
+  for (int32 i = 0; i < num_streams; i++) {
+    if (streams[i]->nnet_input.NumRows() > nnet_context_) {
+      offsets[i] = num_input_rows;
+      num_input_rows += streams[i]->nnet_input.NumRows();
+    }
+  }
+  CuMatrix<BaseFloat> cu_loglikes;
+  if (num_input_rows > 0) {
+    CuMatrix<BaseFloat> cu_input(num_input_rows, nnet.InputDim(), kUndefined);
+    for (int32 i = 0; i < num_streams; i++) {
+      if (offsets[i] >= 0)
+        cu_input.RowRange(offsets[i], streams[i]->nnet_input.NumRows()).
+            CopyFromMat(streams[i]->nnet_input);
+    }
+    // Output row r depends on input rows r through r + nnet_context_, so the
+    // output for stream i is in rows offsets[i] onward, and the rows in
+    // between are the ones whose context straddles two streams.
+    cu_loglikes.Resize(num_input_rows - nnet_context_, nnet.OutputDim(),
+                       kUndefined);
+    bool pad_input = false;
+    nnet2::NnetComputation(nnet, cu_input, pad_input, &cu_loglikes);
+    // Take the log and turn the log-posteriors into pseudo-log-likelihoods by
+    // dividing by the pdf priors; then scale by the acoustic scale.
+    cu_loglikes.ApplyFloor(1.0e-20);
+    cu_loglikes.ApplyLog();
+    cu_loglikes.AddVecToRows(1.0, log_inv_prior_);
+    cu_loglikes.Scale(config_.acoustic_scale);
+  }
+  loglikes->resize(num_streams, NULL);
+  for (int32 i = 0; i < num_streams; i++) {
+    Matrix<BaseFloat> *this_loglikes = new Matrix<BaseFloat>();
+    (*loglikes)[i] = this_loglikes;
+    if (offsets[i] < 0) continue;
+    Matrix<BaseFloat> &nnet_input = streams[i]->nnet_input;
+    int32 num_rows = nnet_input.NumRows(),
+        num_output_rows = num_rows - nnet_context_;
+    this_loglikes->Resize(num_output_rows, cu_loglikes.NumCols(), kUndefined);
+    this_loglikes->CopyFromMat(cu_loglikes.RowRange(offsets[i],
+                                                    num_output_rows));
+    // Keep the last nnet_context_ rows, which are the context of the next
+    // frame to be evaluated.
+    if (nnet_context_ == 0) {
+      nnet_input.Resize(0, 0);
+    } else {
+      Matrix<BaseFloat> context(nnet_input.RowRange(num_output_rows,
+                                                    nnet_context_));
+      nnet_input.Swap(&context);
+    }
+  }
+}
+
+void OnlineNnet2MultiStreamDecoder::DecoderWorker() {
+  pthread_mutex_lock(&mutex_);
+  while (true) {
+    while (!shutdown_ && decoder_queue_.empty())
+      pthread_cond_wait(&decoder_cond_, &mutex_);
+    if (decoder_queue_.empty()) break;  // shutdown_ must be true.
+    Stream *stream = decoder_queue_.front();
+    decoder_queue_.pop_front();
+    stream->decoder_queued = false;
+    if (stream->abort) {
+      ScheduleDecoder(stream);
+      continue;
+    }
+    stream->decoder_busy = true;
+    std::vector<Matrix<BaseFloat>*> loglikes(stream->loglikes.begin(),
+                                             stream->loglikes.end());
+    stream->loglikes.clear();
+    // If nnet_done, all the log-likelihoods have been taken.
+    bool nnet_done = stream->nnet_done, error = false, frames_to_decode = false;
+    pthread_mutex_unlock(&mutex_);
+
+    try {
+      DecodableMatrixMappedOffset &decodable = stream->decodable;
+      LatticeFasterOnlineDecoder &decoder = stream->decoder;
+      for (size_t i = 0; i < loglikes.size(); i++) {
+        // We can discard the frames that have already been decoded.
+        int32 frames_to_discard = decoder.NumFramesDecoded() -
+            decodable.FirstAvailableFrame();
+        decodable.AcceptLoglikes(loglikes[i], frames_to_discard);
+        delete loglikes[i];
+        loglikes[i] = NULL;
+      }
+      if (nnet_done)
+        decodable.InputIsFinished();
+      stream->decoder_mutex.Lock();
+      try {
+        decoder.AdvanceDecoding(&decodable, config_.decode_batch_size);
+      } catch (...) {
+        stream->decoder_mutex.Unlock();
+        throw;
+      }
+      stream->decoder_mutex.Unlock();
+      if (stream->silence_weighting.Active()) {
+        stream->silence_weighting_mutex.Lock();
+        // the next function does not trace back all the way; it's very fast.
+        stream->silence_weighting.ComputeCurrentTraceback(decoder);
+        stream->silence_weighting_mutex.Unlock();
+      }
+      frames_to_decode = (decodable.NumFramesReady() >
+                          decoder.NumFramesDecoded());
+    } catch (const std::exception &e) {
+      KALDI_WARN << "Caught exception: " << e.what();
+      DeletePointers(&loglikes);
+      error = true;
+    }
+
+    pthread_mutex_lock(&mutex_);
+    stream->decoder_busy = false;
+    stream->frames_to_decode = frames_to_decode;
+    if (nnet_done)
+      stream->decodable_finished = true;
+    if (error) {
+      stream->error = true;
+      stream->abort = true;
+    }
+    ScheduleDecoder(stream);
+  }
+  pthread_mutex_unlock(&mutex_);
+}
+
+
+}  // namespace kaldi
@@ -0,0 +1,282 @@
+// online2/online-nnet2-decoding-multistream.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_ONLINE2_ONLINE_NNET2_DECODING_MULTISTREAM_H_
+#define KALDI_ONLINE2_ONLINE_NNET2_DECODING_MULTISTREAM_H_
+
+#include <pthread.h>
+#include <deque>
+#include <map>
+#include <vector>
+
+#include "matrix/matrix-lib.h"
+#include "util/common-utils.h"
+#include "base/kaldi-error.h"
+#include "decoder/decodable-matrix.h"
+#include "nnet2/am-nnet.h"
+#include "online2/online-nnet2-feature-pipeline.h"
+#include "online2/online-endpoint.h"
+#include "decoder/lattice-faster-online-decoder.h"
+#include "hmm/transition-model.h"
+#include "thread/kaldi-mutex.h"
+
+namespace kaldi {
+/// @addtogroup  onlinedecoding OnlineDecoding
+/// @{
+
+
+// This is the configuration class for OnlineNnet2MultiStreamDecoder.  As for
+// OnlineNnet2DecodingThreadedConfig, the OnlineNnet2FeaturePipelineConfig and
+// OnlineEndpointConfig are created separately by the command line program.
+struct OnlineNnet2MultiStreamConfig {
+
+  LatticeFasterDecoderConfig decoder_opts;
+
+  BaseFloat acoustic_scale;
+
+  int32 num_nnet_threads;  // number of threads that do the feature extraction
+                           // and the neural net evaluation, for all streams.
+  int32 num_decoder_threads;  // number of threads that do the decoder search,
+                              // for all streams.
+  int32 nnet_batch_size;  // number of frames of waveform a stream should have
+                          // pending before it is given to an nnet thread
+                          // (unless its input has finished).
+  int32 max_batch_streams;  // maximum number of streams whose frames are
+                            // evaluated in one neural net computation.
+  BaseFloat max_batch_delay;  // maximum time, in seconds, that a stream
+                              // waiting for the nnet may be held back so that
+                              // more streams can join its batch.
+  int32 decode_batch_size;  // maximum number of frames a decoder thread
+                            // decodes for a stream before moving on to the
+                            // next stream that is waiting.
+
+  OnlineNnet2MultiStreamConfig(): acoustic_scale(0.1), num_nnet_threads(1),
+                                  num_decoder_threads(1), nnet_batch_size(32),
+                                  max_batch_streams(16),
+                                  max_batch_delay(0.0),
+                                  decode_batch_size(16) { }
+
+  void Check() const;
+
+  void Register(OptionsItf *opts) {
+    decoder_opts.Register(opts);
+    opts->Register("acoustic-scale", &acoustic_scale, "Scale used on acoustics "
+                   "when decoding");
+    opts->Register("num-nnet-threads", &num_nnet_threads, "Number of threads "
+                   "that do feature extraction and neural net evaluation, "
+                   "shared by all streams.");
+    opts->Register("num-decoder-threads", &num_decoder_threads, "Number of "
+                   "threads that do the decoder search, shared by all "
+                   "streams.");
+    opts->Register("nnet-batch-size", &nnet_batch_size, "Number of frames of "
+                   "input a stream accumulates before its neural net "
+                   "evaluation is scheduled.");
+    opts->Register("max-batch-streams", &max_batch_streams, "Maximum number of "
+                   "streams whose frames are evaluated together in one neural "
+                   "net computation.");
+    opts->Register("max-batch-delay", &max_batch_delay, "If >0, an nnet thread "
+                   "that finds fewer than --max-batch-streams streams waiting "
+                   "waits for more to arrive, but for no longer than this many "
+                   "seconds after the first of them was queued.  Larger "
+                   "batches are more efficient (especially on GPU), at the "
+                   "cost of latency.");
+    opts->Register("decode-batch-size", &decode_batch_size, "Maximum number of "
+                   "frames decoded for one stream before the decoder thread "
+                   "moves on to another stream.");
+  }
+};
+
+/**
+   OnlineNnet2MultiStreamDecoder decodes many utterances ("streams") at once
+   with the online nnet2 setup, using a fixed pool of threads for all of them
+   instead of the two threads per utterance that
+   SingleUtteranceNnet2DecoderThreaded creates.  This is intended for servers
+   that handle many concurrent connections: with 500 streams open, there are
+   still only num_nnet_threads + num_decoder_threads worker threads.
+
+   Each stream has its own queues, like those of
+   SingleUtteranceNnet2DecoderThreaded: waveform pieces waiting for feature
+   extraction, and blocks of log-likelihoods waiting to be decoded.  A stream is
+   put on the nnet work queue once it has nnet_batch_size frames of waveform
+   pending (or its input has finished), and on the decoder work queue once it
+   has log-likelihoods to decode.  An nnet thread takes up to max_batch_streams
+   of the waiting streams, does their feature extraction, and evaluates the
+   neural net on all their new frames in a single computation, which is much
+   more efficient than a small computation for each stream (especially when
+   a GPU is used, via CuDevice, since the stacked input is one CuMatrix).  If
+   max_batch_delay > 0, an nnet thread that finds fewer than
+   max_batch_streams streams waiting holds them back until more arrive or
+   the oldest of them has waited max_batch_delay seconds, so the batch size
+   adapts to the load while the added latency stays bounded.  To make this
+   possible, each stream keeps the last (left + right context) frames of its
+   input, and the chunks of the different streams are stacked with their
+   contexts; the few output rows whose context straddles two streams are
+   discarded.  A decoder thread decodes up to decode_batch_size frames of one
+   stream at a time, so that the streams are decoded in turn.
+
+   All the public functions may be called from any thread (e.g., one thread
+   per connection); the ones taking a stream id should not be called after
+   CloseStream() for that stream.
+*/
+class OnlineNnet2MultiStreamDecoder {
+ public:
+  /// The models and the feature info must outlive this object.
+  OnlineNnet2MultiStreamDecoder(
+      const OnlineNnet2MultiStreamConfig &config,
+      const TransitionModel &tmodel,
+      const nnet2::AmNnet &am_nnet,
+      const fst::Fst<fst::StdArc> &fst,
+      const OnlineNnet2FeaturePipelineInfo &feature_info);
+
+  /// Starts a new stream (utterance) and returns its id.  adaptation_state is
+  /// used to initialize its feature pipeline, as in the constructor of
+  /// SingleUtteranceNnet2DecoderThreaded.
+  int32 OpenStream(
+      const OnlineIvectorExtractorAdaptationState &adaptation_state);
+
+  /// Provides more waveform for the stream; this never blocks for long.
+  void AcceptWaveform(int32 stream_id, BaseFloat samp_freq,
+                      const VectorBase<BaseFloat> &wave_part);
+
+  /// Informs the stream that no more waveform will be provided, so the last
+  /// frames can be flushed out.  You can't call AcceptWaveform() after this.
+  void InputFinished(int32 stream_id);
+
+  /// Stops any further processing of the stream; what has been decoded so far
+  /// can still be obtained.
+  void TerminateDecoding(int32 stream_id);
+
+  /// Blocks until all the stream's data has been decoded (or it has been
+  /// terminated).  Must only be called after InputFinished() or
+  /// TerminateDecoding().  Throws if there was an error processing the stream.
+  void Wait(int32 stream_id);
+
+  /// As SingleUtteranceNnet2DecoderThreaded::FinalizeDecoding(); calls Wait().
+  void FinalizeDecoding(int32 stream_id);
+
+  /// Returns the number of frames of the stream decoded so far.
+  int32 NumFramesDecoded(int32 stream_id) const;
+
+  /// As SingleUtteranceNnet2DecoderThreaded::GetLattice().
+  void GetLattice(int32 stream_id, bool end_of_utterance,
+                  CompactLattice *clat,
+                  BaseFloat *final_relative_cost) const;
+
+  /// As SingleUtteranceNnet2DecoderThreaded::GetBestPath().
+  void GetBestPath(int32 stream_id, bool end_of_utterance,
+                   Lattice *best_path,
+                   BaseFloat *final_relative_cost) const;
+
+  /// Calls EndpointDetected() from online-endpoint.h for the stream.
+  bool EndpointDetected(int32 stream_id, const OnlineEndpointConfig &config);
+
+  /// Outputs the adaptation state of the stream's feature pipeline; may only
+  /// be called after Wait().
+  void GetAdaptationState(
+      int32 stream_id,
+      OnlineIvectorExtractorAdaptationState *adaptation_state) const;
+
+  /// Terminates the stream if it has not finished, waits for the worker
+  /// threads to finish with it, and frees it.
+  void CloseStream(int32 stream_id);
+
+  /// Returns the number of streams that are open.
+  int32 NumStreams() const;
+
+  /// Closes any streams that are still open and joins the worker threads.
+  ~OnlineNnet2MultiStreamDecoder();
+
+ private:
+  struct Stream;
+
+  // Returns the stream with this id; it's an error if it does not exist.
+  Stream *GetStream(int32 stream_id) const;
+
+  // The following functions must be called with mutex_ held.
+  // Puts the stream on the nnet work queue if it has enough waveform pending
+  // (or its input has finished) and is not already queued or being processed.
+  void ScheduleNnet(Stream *stream);
+  // Puts the stream on the decoder work queue if it has log-likelihoods or
+  // frames to decode (or must be finished off) and is not already queued or
+  // being decoded.
+  void ScheduleDecoder(Stream *stream);
+  // Marks the stream as finished and wakes up anyone in Wait().
+  void SetDone(Stream *stream);
+  // Called by an nnet thread when nnet_queue_ is not empty: if
+  // config_.max_batch_delay > 0, waits until max_batch_streams streams are
+  // queued, every open stream is queued, the first queued stream has waited
+  // max_batch_delay seconds, or shutdown_ is set.
+  void WaitForBatch();
+
+  // These static functions get run in the worker threads.
+  static void *RunNnetWorker(void *me);
+  static void *RunDecoderWorker(void *me);
+  void NnetWorker();
+  void DecoderWorker();
+
+  // Called by an nnet thread, without mutex_ held: gives the stream's feature
+  // pipeline the waveform pieces "waveform" (deleting them), and the silence
+  // weights.
+  void AcceptInput(Stream *stream,
+                   std::vector<Vector<BaseFloat>*> *waveform,
+                   bool input_finished);
+
+  // Called by an nnet thread, without mutex_ held, after AcceptInput() (and
+  // after the iVector stats of the batch have been updated): appends the
+  // features that are now ready to stream->nnet_input.  Returns true if the
+  // input of the stream is now complete.
+  bool ExtractFeatures(Stream *stream, bool input_finished);
+
+  // Called by an nnet thread, without mutex_ held: evaluates the neural net on
+  // the pending input of all the streams in one computation, and puts each
+  // stream's scaled log-likelihoods in (*loglikes)[i] (which may be empty).
+  void ComputeLoglikes(const std::vector<Stream*> &streams,
+                       std::vector<Matrix<BaseFloat>*> *loglikes);
+
+  OnlineNnet2MultiStreamConfig config_;
+  const TransitionModel &tmodel_;
+  const nnet2::AmNnet &am_nnet_;
+  const fst::Fst<fst::StdArc> &fst_;
+  const OnlineNnet2FeaturePipelineInfo &feature_info_;
+  CuVector<BaseFloat> log_inv_prior_;  // -log(prior) of each pdf.
+  int32 nnet_context_;  // left + right context of the nnet.
+
+  std::vector<pthread_t> threads_;
+
+  // The following are protected by mutex_.
+  mutable pthread_mutex_t mutex_;
+  pthread_cond_t nnet_cond_;  // signaled when nnet_queue_ gets a stream.
+  pthread_cond_t decoder_cond_;  // signaled when decoder_queue_ gets a stream.
+  pthread_cond_t done_cond_;  // broadcast when a stream finishes or is idle.
+  bool shutdown_;
+  int32 next_stream_id_;
+  std::map<int32, Stream*> streams_;
+  std::deque<Stream*> nnet_queue_;
+  std::deque<Stream*> decoder_queue_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(OnlineNnet2MultiStreamDecoder);
+};
+
+
+/// @} End of "addtogroup onlinedecoding"
+
+}  // namespace kaldi
+
+#endif  // KALDI_ONLINE2_ONLINE_NNET2_DECODING_MULTISTREAM_H_
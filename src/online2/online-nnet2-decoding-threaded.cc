@@ -106,6 +106,10 @@ void OnlineNnet2DecodingThreadedConfig::Check() {
   KALDI_ASSERT(max_loglikes_copy >= 0);
   KALDI_ASSERT(nnet_batch_size > 0);
   KALDI_ASSERT(decode_batch_size >= 1);
+  KALDI_ASSERT(max_pending_waveform >= 0.0);
+  if (overload_policy != "block" && overload_policy != "drop-oldest" &&
+      overload_policy != "report")
+    KALDI_ERR << "Invalid --overload-policy: '" << overload_policy << "'";
 }
 
 
@@ -118,49 +122,38 @@ SingleUtteranceNnet2DecoderThreaded::SingleUtteranceNnet2DecoderThreaded(
     const OnlineIvectorExtractorAdaptationState &adaptation_state):
   config_(config), am_nnet_(am_nnet), tmodel_(tmodel), sampling_rate_(0.0),
   num_samples_received_(0), input_finished_(false),
+  num_samples_pending_(0), num_samples_dropped_(0),
   feature_pipeline_(feature_info),
   num_samples_discarded_(0),
   silence_weighting_(tmodel, feature_info.silence_weighting_config),
   decodable_(tmodel),
   num_frames_decoded_(0), decoder_(fst, config_.decoder_opts),
-  abort_(false), error_(false) {
+  threads_running_(false), abort_(false), error_(false) {
   // if the user supplies an adaptation state that was not freshly initialized,
   // it means that we take the adaptation state from the previous
   // utterance(s)... this only makes sense if theose previous utterance(s) are
   // believed to be from the same speaker.
   feature_pipeline_.SetAdaptationState(adaptation_state);
-  // spawn threads.
-
-  pthread_attr_t pthread_attr;
-  pthread_attr_init(&pthread_attr);
-  int32 ret;
+  // spawn threads.  They come from the ThreadPool's cache (see
+  // thread/kaldi-thread-pool.h), so we don't create two new threads for each
+  // utterance.
 
   // Note: if the constructor throws an exception, the corresponding destructor
-  // will not be called.  So we don't have to be careful about setting the
-  // thread pointers to NULL after we've joined them.
-  if ((ret=pthread_create(&(threads_[0]),
-                          &pthread_attr, RunNnetEvaluation,
-                          (void*)this)) != 0) {
-    const char *c = strerror(ret);
-    if (c == NULL) { c = "[NULL]"; }
-    KALDI_ERR << "Error creating thread, errno was: " << c;
-  }
+  // will not be called, but the destructor of threads_ waits for any thread we
+  // did start.
+  threads_.Start(RunNnetEvaluation, static_cast<void*>(this));
   decoder_.InitDecoding();
-  if ((ret=pthread_create(&(threads_[1]),
-                          &pthread_attr, RunDecoderSearch,
-                          (void*)this)) != 0) {
-    const char *c = strerror(ret);
-    if (c == NULL) { c = "[NULL]"; }
+  try {
+    threads_.Start(RunDecoderSearch, static_cast<void*>(this));
+  } catch (...) {
     bool error = true;
     AbortAllThreads(error);
-    KALDI_WARN << "Error creating thread, errno was: " << c
-               << " (will rejoin already-created threads).";
-    if (pthread_join(threads_[0], NULL)) {
-      KALDI_ERR << "Error rejoining thread.";
-    } else {
-      KALDI_ERR << "Error creating thread, errno was: " << c;
-    }
+    KALDI_WARN << "Error starting decoder thread (will rejoin "
+               << "already-created threads).";
+    threads_.Join();
+    throw;
   }
+  threads_running_ = true;
 }
 
 
@@ -186,22 +179,56 @@ SingleUtteranceNnet2DecoderThreaded::~SingleUtteranceNnet2DecoderThreaded() {
 void SingleUtteranceNnet2DecoderThreaded::AcceptWaveform(
     BaseFloat sampling_rate,
     const VectorBase<BaseFloat> &wave_part) {
+  Vector<BaseFloat> wave_part_copy(wave_part);
+  AcceptWaveform(sampling_rate, &wave_part_copy);
+}
+
+void SingleUtteranceNnet2DecoderThreaded::AcceptWaveform(
+    BaseFloat sampling_rate,
+    Vector<BaseFloat> *wave_part) {
   if (sampling_rate_ <= 0.0)
     sampling_rate_ = sampling_rate;
   else {
     KALDI_ASSERT(sampling_rate == sampling_rate_);
   }
-  num_samples_received_ += wave_part.Dim();
+  num_samples_received_ += wave_part->Dim();
   
-  if (wave_part.Dim() == 0) return;
+  if (wave_part->Dim() == 0) return;
   if (!waveform_synchronizer_.Lock(ThreadSynchronizer::kProducer)) {
     KALDI_ERR << "Failure locking mutex: decoding aborted.";
   }
 
-  Vector<BaseFloat> *new_part = new Vector<BaseFloat>(wave_part);
+  int64 max_pending = config_.max_pending_waveform * sampling_rate_,
+      dim = wave_part->Dim();
+  if (max_pending > 0 && num_samples_pending_ + dim > max_pending) {
+    if (config_.overload_policy == "block") {
+      // Unlocking with failure makes the next Lock() wait until the
+      // feature-processing thread has taken some waveform.  We always accept
+      // the waveform once nothing is pending, so a piece larger than the limit
+      // can't block forever.
+      while (num_samples_pending_ > 0 &&
+             num_samples_pending_ + dim > max_pending) {
+        waveform_synchronizer_.UnlockFailure(ThreadSynchronizer::kProducer);
+        if (!waveform_synchronizer_.Lock(ThreadSynchronizer::kProducer)) {
+          KALDI_ERR << "Failure locking mutex: decoding aborted.";
+        }
+      }
+    } else if (config_.overload_policy == "drop-oldest") {
+      while (!input_waveform_.empty() &&
+             num_samples_pending_ + dim > max_pending) {
+        num_samples_pending_ -= input_waveform_.front()->Dim();
+        num_samples_dropped_ += input_waveform_.front()->Dim();
+        delete input_waveform_.front();
+        input_waveform_.pop_front();
+      }
+    }
+    // with "report", we accept the waveform anyway; see FallingBehind().
+  }
+
+  Vector<BaseFloat> *new_part = new Vector<BaseFloat>();
+  new_part->Swap(wave_part);
   input_waveform_.push_back(new_part);
-  // we always unlock with success because there is no buffer size limitation
-  // for the waveform so no reason why we might wait.
+  num_samples_pending_ += dim;
   waveform_synchronizer_.UnlockSuccess(ThreadSynchronizer::kProducer);
 }
 
@@ -220,9 +247,27 @@ int32 SingleUtteranceNnet2DecoderThreaded::NumWaveformPiecesPending() {
   return ans;
 }
 
+BaseFloat SingleUtteranceNnet2DecoderThreaded::NumSecondsPending() {
+  if (sampling_rate_ <= 0.0)
+    return 0.0;  // AcceptWaveform() has not been called.
+  // See NumWaveformPiecesPending() RE the locking.
+  if (!waveform_synchronizer_.Lock(ThreadSynchronizer::kProducer)) {
+    KALDI_ERR << "Failure locking mutex: decoding aborted.";
+  }
+  BaseFloat ans = num_samples_pending_ / sampling_rate_;
+  waveform_synchronizer_.UnlockSuccess(ThreadSynchronizer::kProducer);
+  return ans;
+}
+
+bool SingleUtteranceNnet2DecoderThreaded::FallingBehind() {
+  return config_.max_pending_waveform > 0.0 &&
+      NumSecondsPending() > config_.max_pending_waveform;
+}
+
 
 int32 SingleUtteranceNnet2DecoderThreaded::NumFramesReceivedApprox() const {
-  return num_samples_received_ /
+  // Dropped samples never reach the feature pipeline, so they don't count.
+  return (num_samples_received_ - num_samples_dropped_) /
       (sampling_rate_ * feature_pipeline_.FrameShiftInSeconds());
 }
 
@@ -252,7 +297,7 @@ void SingleUtteranceNnet2DecoderThreaded::Wait() {
 }
 
 void SingleUtteranceNnet2DecoderThreaded::FinalizeDecoding() {
-  if (KALDI_PTHREAD_PTR(threads_[0]) != 0) {
+  if (threads_running_) {
     KALDI_ERR << "It is an error to call FinalizeDecoding before Wait().";
   }
   decoder_.FinalizeDecoding();
@@ -260,7 +305,7 @@ void SingleUtteranceNnet2DecoderThreaded::FinalizeDecoding() {
 
 BaseFloat SingleUtteranceNnet2DecoderThreaded::GetRemainingWaveform(
     Vector<BaseFloat> *waveform) const {
-  if (KALDI_PTHREAD_PTR(threads_[0]) != 0) {
+  if (threads_running_) {
     KALDI_ERR << "It is an error to call GetRemainingWaveform before Wait().";
   }
   int64 num_samples_stored = 0;  // number of samples we still have.
@@ -413,15 +458,8 @@ void* SingleUtteranceNnet2DecoderThreaded::RunDecoderSearch(void *ptr_in) {
 
 
 void SingleUtteranceNnet2DecoderThreaded::WaitForAllThreads() {
-  for (int32 i = 0; i < 2; i++) {  // there are 2 spawned threads.
-    pthread_t &thread = threads_[i];
-    if (KALDI_PTHREAD_PTR(thread) != 0) {
-      if (pthread_join(thread, NULL)) {
-        KALDI_ERR << "Error rejoining thread";  // this should not happen.
-      }
-      KALDI_PTHREAD_PTR(thread) = 0;
-    }
-  }
+  threads_.Join();  // the 2 spawned threads.
+  threads_running_ = false;
   if (error_) {
     KALDI_ERR << "Error encountered during decoding.  See above.";
   }
@@ -481,6 +519,7 @@ bool SingleUtteranceNnet2DecoderThreaded::FeatureComputation(
       while (num_frames_usable < config_.nnet_batch_size &&
              !input_waveform_.empty()) {
         feature_pipeline_.AcceptWaveform(sampling_rate_, *input_waveform_.front());
+        num_samples_pending_ -= input_waveform_.front()->Dim();
         processed_waveform_.push_back(input_waveform_.front());
         input_waveform_.pop_front();
         num_frames_ready = feature_pipeline_.NumFramesReady();
@@ -36,6 +36,7 @@
 #include "hmm/transition-model.h"
 #include "thread/kaldi-mutex.h"
 #include "thread/kaldi-semaphore.h"
+#include "thread/kaldi-thread-pool.h"
 
 namespace kaldi {
 /// @addtogroup  onlinedecoding OnlineDecoding
@@ -148,6 +149,15 @@ struct OnlineNnet2DecodingThreadedConfig {
                             // before unlocking the mutex.  The only real cost
                             // here is a mutex lock/unlock, so it's OK to make
                             // this fairly small.
+  BaseFloat max_pending_waveform;  // maximum seconds of waveform we allow to be
+                                   // waiting for the feature-processing
+                                   // thread, or zero for no limit.
+  std::string overload_policy;  // what AcceptWaveform() does when
+                                // max_pending_waveform would be exceeded:
+                                // "block" (wait for the feature-processing
+                                // thread to catch up), "drop-oldest" (discard
+                                // the oldest pending waveform), or "report"
+                                // (accept it anyway; see FallingBehind()).
   
   OnlineNnet2DecodingThreadedConfig() {
     acoustic_scale = 0.1;
@@ -156,6 +166,8 @@ struct OnlineNnet2DecodingThreadedConfig {
     nnet_batch_size = 32;
     max_loglikes_copy = 20;
     decode_batch_size = 2;
+    max_pending_waveform = 0.0;
+    overload_policy = "block";
   }
 
   void Check();
@@ -174,6 +186,15 @@ struct OnlineNnet2DecodingThreadedConfig {
                    "setting, affects multi-threaded decoding.");
     opts->Register("decode-batch-sie", &decode_batch_size, "Obscure "
                    "setting, affects multi-threaded decoding.");
+    opts->Register("max-pending-waveform", &max_pending_waveform, "Maximum "
+                   "seconds of waveform that may be waiting to be processed "
+                   "(if the decoding threads fall behind); zero means no "
+                   "limit.  See --overload-policy.");
+    opts->Register("overload-policy", &overload_policy, "What to do with new "
+                   "waveform when --max-pending-waveform would be exceeded: "
+                   "\"block\" (wait), \"drop-oldest\" (discard the oldest "
+                   "pending waveform) or \"report\" (accept it, and report "
+                   "that the decoder is falling behind).");
   }
 };
 
@@ -208,11 +229,31 @@ class SingleUtteranceNnet2DecoderThreaded {
   void AcceptWaveform(BaseFloat samp_freq,
                       const VectorBase<BaseFloat> &wave_part);
 
+  /// This version of AcceptWaveform() takes the contents of *wave_part, which
+  /// is left empty, instead of copying it; this saves a copy when the caller
+  /// has had to convert the waveform into a new vector anyway.
+  void AcceptWaveform(BaseFloat samp_freq,
+                      Vector<BaseFloat> *wave_part);
+
   /// Returns the number of pieces of waveform that are still waiting to be
   /// processed.  This may be useful for calling code to judge whether to supply
   /// more waveform or to wait.
   int32 NumWaveformPiecesPending();
 
+  /// Returns the number of seconds of waveform that are waiting to be
+  /// processed; this is the queue depth that --max-pending-waveform limits.
+  BaseFloat NumSecondsPending();
+
+  /// Returns true if the waveform waiting to be processed exceeds
+  /// --max-pending-waveform (only possible with --overload-policy=report,
+  /// or if a single piece of waveform exceeds the limit).  A server could
+  /// use this to stop accepting new streams.
+  bool FallingBehind();
+
+  /// Returns the number of samples discarded because of
+  /// --overload-policy=drop-oldest.
+  int64 NumSamplesDropped() const { return num_samples_dropped_; }
+
   /// You call this to inform the class that no more waveform will be provided;
   /// this allows it to flush out the last few frames of features, and is
   /// necessary if you want to call Wait() to wait until all decoding is done.
@@ -307,7 +348,7 @@ class SingleUtteranceNnet2DecoderThreaded {
   void AbortAllThreads(bool error);
 
   // This function waits for all the threads that have been spawned, and then
-  // sets the pointers in threads_ to NULL; it is called in the destructor and
+  // sets threads_running_ to false; it is called in the destructor and
   // from Wait().  If called twice it is not an error.
   void WaitForAllThreads();
   
@@ -362,6 +403,8 @@ class SingleUtteranceNnet2DecoderThreaded {
   // sampling_rate_ is only needed for checking that it matches the config.
   bool input_finished_;
   std::deque< Vector<BaseFloat>* > input_waveform_;
+  int64 num_samples_pending_;  // total number of samples in input_waveform_.
+  int64 num_samples_dropped_;  // samples discarded because of overload.
 
   
   ThreadSynchronizer waveform_synchronizer_;
@@ -409,10 +452,10 @@ class SingleUtteranceNnet2DecoderThreaded {
   // GetLattice() and GetBestPath().
   Mutex decoder_mutex_;
   
-  // This contains the thread pointers for the nnet-evaluation and
-  // decoder-search threads respectively (or NULL if they have been joined in
-  // Wait()).
-  pthread_t threads_[2];
+  // This runs the nnet-evaluation and decoder-search threads;
+  // threads_running_ is true until they have been joined in Wait().
+  ThreadGroup threads_;
+  bool threads_running_;
 
   // This is set to true if AbortAllThreads was called for any reason, including
   // if someone called TerminateDecoding().
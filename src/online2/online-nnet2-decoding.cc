@@ -17,6 +17,8 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <limits>
+
 #include "online2/online-nnet2-decoding.h"
 #include "lat/lattice-functions.h"
 #include "lat/determinize-lattice-pruned.h"
@@ -32,13 +34,31 @@ SingleUtteranceNnet2Decoder::SingleUtteranceNnet2Decoder(
     config_(config),
     feature_pipeline_(feature_pipeline),
     tmodel_(tmodel),
-    decodable_(model, tmodel, config.decodable_opts, feature_pipeline),
-    decoder_(fst, config.decoder_opts) {
+    vad_feature_(config.vad_opts, feature_pipeline->FrameShiftInSeconds(),
+                 feature_pipeline->InputFeature(), feature_pipeline),
+    decodable_(model, tmodel, config.decodable_opts,
+               (config.vad_opts.gate ?
+                static_cast<OnlineFeatureInterface*>(&vad_feature_) :
+                static_cast<OnlineFeatureInterface*>(feature_pipeline))),
+    decoder_(fst, config.decoder_opts),
+    partial_lattice_(tmodel, config_.decoder_opts),
+    beam_controller_(NULL), timer_(NULL) {
   decoder_.InitDecoding();
 }
 
 void SingleUtteranceNnet2Decoder::AdvanceDecoding() {
-  decoder_.AdvanceDecoding(&decodable_);
+  if (beam_controller_ != NULL)
+    beam_controller_->AdvanceDecoding(timer_, &decodable_, &decoder_);
+  else
+    decoder_.AdvanceDecoding(&decodable_);
+}
+
+void SingleUtteranceNnet2Decoder::SetBeamController(
+    OnlineBeamController *controller, OnlineTimer *timer) {
+  KALDI_ASSERT(controller != NULL && timer != NULL);
+  beam_controller_ = controller;
+  timer_ = timer;
+  beam_controller_->InitUtterance(&decoder_);
 }
 
 void SingleUtteranceNnet2Decoder::FinalizeDecoding() {
@@ -64,6 +84,13 @@ void SingleUtteranceNnet2Decoder::GetLattice(bool end_of_utterance,
       tmodel_, &raw_lat, lat_beam, clat, config_.decoder_opts.det_opts);
 }
 
+void SingleUtteranceNnet2Decoder::GetPartialLattice(CompactLattice *clat) {
+  if (NumFramesDecoded() == 0)
+    KALDI_ERR << "You cannot get a lattice if you decoded no frames.";
+  bool use_final_probs = false;
+  partial_lattice_.GetLattice(decoder_, use_final_probs, clat);
+}
+
 void SingleUtteranceNnet2Decoder::GetBestPath(bool end_of_utterance,
                                               Lattice *best_path) const {
   decoder_.GetBestPath(best_path, end_of_utterance);
@@ -71,9 +98,34 @@ void SingleUtteranceNnet2Decoder::GetBestPath(bool end_of_utterance,
 
 bool SingleUtteranceNnet2Decoder::EndpointDetected(
     const OnlineEndpointConfig &config) {
-  return kaldi::EndpointDetected(config, tmodel_,
+  if (!config_.vad_opts.gate)
+    return kaldi::EndpointDetected(config, tmodel_,
+                                   feature_pipeline_->FrameShiftInSeconds(),
+                                   decoder_);
+  // The skipped frames are treated as decoded silence: those before the last
+  // decoded frame count towards the utterance length, and those after it as
+  // trailing silence.
+  int32 num_frames_decoded = decoder_.NumFramesDecoded(),
+      num_frames = 0, trailing_silence_frames = 0;
+  BaseFloat final_relative_cost = std::numeric_limits<BaseFloat>::infinity();
+  if (num_frames_decoded > 0) {
+    num_frames = vad_feature_.SourceFrame(num_frames_decoded - 1) + 1;
+    trailing_silence_frames = TrailingSilenceLength(
+        tmodel_, config.silence_phones, decoder_);
+    final_relative_cost = decoder_.FinalRelativeCost();
+  }
+  int32 num_gated = vad_feature_.NumTrailingGatedFrames();
+  if (num_gated > 0 && num_frames_decoded == decodable_.NumFramesReady()) {
+    // The kept frames that can't be decoded yet, for lack of right context,
+    // are non-speech frames of the hangover before the skipped ones.
+    int32 num_undecoded = vad_feature_.NumFramesReady() - num_frames_decoded;
+    num_frames += num_undecoded + num_gated;
+    trailing_silence_frames += num_undecoded + num_gated;
+  }
+  if (num_frames == 0) return false;
+  return kaldi::EndpointDetected(config, num_frames, trailing_silence_frames,
                                  feature_pipeline_->FrameShiftInSeconds(),
-                                 decoder_);  
+                                 final_relative_cost);
 }
 
 
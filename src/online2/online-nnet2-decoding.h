@@ -31,7 +31,10 @@
 #include "nnet2/online-nnet2-decodable.h"
 #include "online2/online-nnet2-feature-pipeline.h"
 #include "online2/online-endpoint.h"
+#include "online2/online-beam-controller.h"
+#include "online2/online-vad.h"
 #include "decoder/lattice-faster-online-decoder.h"
+#include "decoder/lattice-incremental-determinizer.h"
 #include "hmm/transition-model.h"
 #include "hmm/posterior.h"
 
@@ -51,12 +54,14 @@ struct OnlineNnet2DecodingConfig {
   
   LatticeFasterDecoderConfig decoder_opts;
   nnet2::DecodableNnet2OnlineOptions decodable_opts;
+  OnlineVadConfig vad_opts;
   
   OnlineNnet2DecodingConfig() {  decodable_opts.acoustic_scale = 0.1; }
   
   void Register(OptionsItf *opts) {
     decoder_opts.Register(opts);
     decodable_opts.Register(opts);
+    vad_opts.Register(opts);
   }
 };
 
@@ -77,6 +82,11 @@ class SingleUtteranceNnet2Decoder {
   /// advance the decoding as far as we can.
   void AdvanceDecoding();
 
+  /// Makes AdvanceDecoding() go through "controller", which adjusts the beam
+  /// to keep to a target real-time factor, as measured with "timer" (see
+  /// online-beam-controller.h).  Neither pointer is owned by this class.
+  void SetBeamController(OnlineBeamController *controller, OnlineTimer *timer);
+
   /// Finalizes the decoding. Cleans up and prunes remaining tokens, so the
   /// GetLattice() call will return faster.  You must not call this before
   /// calling (TerminateDecoding() or InputIsFinished()) and then Wait().
@@ -91,6 +101,13 @@ class SingleUtteranceNnet2Decoder {
   /// final-probs to be included.
   void GetLattice(bool end_of_utterance,
                   CompactLattice *clat) const;
+
+  /// Gets the lattice of a partial result (without final-probs), like
+  /// GetLattice(false, clat), but with the frozen part of the lattice only
+  /// determinized once, so that calling this repeatedly during the utterance
+  /// does not get slower as the utterance gets longer (see
+  /// IncrementalLatticeDeterminizer).
+  void GetPartialLattice(CompactLattice *clat);
   
   /// Outputs an FST corresponding to the single best path through the current
   /// lattice. If "use_final_probs" is true AND we reached the final-state of
@@ -101,10 +118,19 @@ class SingleUtteranceNnet2Decoder {
 
 
   /// This function calls EndpointDetected from online-endpoint.h,
-  /// with the required arguments.
+  /// with the required arguments.  With --vad-gating, the frames skipped as
+  /// non-speech count as decoded frames of silence.
   bool EndpointDetected(const OnlineEndpointConfig &config);
 
   const LatticeFasterOnlineDecoder &Decoder() const { return decoder_; }
+
+  /// Returns the voice-activity gate that the decoder reads its features
+  /// through if --vad-gating is true, or NULL.  The decoder's frame indexes
+  /// are those of this object, not of the feature pipeline (see
+  /// OnlineVadFeature::SourceFrame()).
+  const OnlineVadFeature *VadFeature() const {
+    return (config_.vad_opts.gate ? &vad_feature_ : NULL);
+  }
   
   ~SingleUtteranceNnet2Decoder() { }
  private:
@@ -114,11 +140,17 @@ class SingleUtteranceNnet2Decoder {
   OnlineNnet2FeaturePipeline *feature_pipeline_;
 
   const TransitionModel &tmodel_;
+
+  OnlineVadFeature vad_feature_;  // only used if config_.vad_opts.gate.
   
   nnet2::DecodableNnet2Online decodable_;
   
   LatticeFasterOnlineDecoder decoder_;
-  
+
+  IncrementalLatticeDeterminizer partial_lattice_;  // for GetPartialLattice().
+
+  OnlineBeamController *beam_controller_;  // not owned; may be NULL.
+  OnlineTimer *timer_;  // not owned; used with beam_controller_.
 };
 
   
@@ -19,6 +19,7 @@
 
 #include "online2/online-nnet2-feature-pipeline.h"
 #include "transform/cmvn.h"
+#include "base/kaldi-memory-stats.h"
 
 namespace kaldi {
 
@@ -79,6 +80,7 @@ OnlineNnet2FeaturePipelineInfo::OnlineNnet2FeaturePipelineInfo(
 OnlineNnet2FeaturePipeline::OnlineNnet2FeaturePipeline(
     const OnlineNnet2FeaturePipelineInfo &info):
     info_(info) {
+  MemoryTagScope memory_tag(kMemoryFeature);
   if (info_.feature_type == "mfcc") {
     base_feature_ = new OnlineMfcc(info_.mfcc_opts);
   } else if (info_.feature_type == "plp") {
@@ -128,6 +130,15 @@ void OnlineNnet2FeaturePipeline::GetFrame(int32 frame,
   return final_feature_->GetFrame(frame, feat);
 }
 
+void OnlineNnet2FeaturePipeline::GetFrames(const std::vector<int32> &frames,
+                                           MatrixBase<BaseFloat> *feats) {
+  final_feature_->GetFrames(frames, feats);
+}
+
+void OnlineNnet2FeaturePipeline::ReleaseFramesBefore(int32 frame) {
+  final_feature_->ReleaseFramesBefore(frame);
+}
+
 void OnlineNnet2FeaturePipeline::SetAdaptationState(
     const OnlineIvectorExtractorAdaptationState &adaptation_state) {
   if (info_.use_ivectors) {
@@ -163,6 +174,7 @@ OnlineNnet2FeaturePipeline::~OnlineNnet2FeaturePipeline() {
 void OnlineNnet2FeaturePipeline::AcceptWaveform(
     BaseFloat sampling_rate,
     const VectorBase<BaseFloat> &waveform) {
+  MemoryTagScope memory_tag(kMemoryFeature);
   base_feature_->AcceptWaveform(sampling_rate, waveform);
   if (pitch_)
     pitch_->AcceptWaveform(sampling_rate, waveform);
@@ -192,6 +192,9 @@ class OnlineNnet2FeaturePipeline: public OnlineFeatureInterface {
   virtual bool IsLastFrame(int32 frame) const;
   virtual int32 NumFramesReady() const;
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
+  virtual void ReleaseFramesBefore(int32 frame);
 
   /// Set the adaptation state to a particular value, e.g. reflecting previous
   /// utterances of the same speaker; this will generally be called after
@@ -224,6 +227,14 @@ class OnlineNnet2FeaturePipeline: public OnlineFeatureInterface {
 
   BaseFloat FrameShiftInSeconds() const { return info_.FrameShiftInSeconds(); }
 
+  /// Returns the base features (plus pitch, if used), without the iVector;
+  /// this is for decodable objects, such as nnet3's, that take the iVector as
+  /// a separate input.
+  OnlineFeatureInterface *InputFeature() { return feature_plus_optional_pitch_; }
+
+  /// Returns the iVector feature, or NULL if iVectors are not used.
+  OnlineIvectorFeature *IvectorFeature() { return ivector_feature_; }
+
   /// If you call InputFinished(), it tells the class you won't be providing any
   /// more waveform.  This will help flush out the last few frames of delta or
   /// LDA features, and finalize the pitch features (making them more
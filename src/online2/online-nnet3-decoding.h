@@ -0,0 +1,129 @@
+// online2/online-nnet3-decoding.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_ONLINE2_ONLINE_NNET3_DECODING_H_
+#define KALDI_ONLINE2_ONLINE_NNET3_DECODING_H_
+
+#include <string>
+#include <vector>
+
+#include "matrix/matrix-lib.h"
+#include "util/common-utils.h"
+#include "base/kaldi-error.h"
+#include "nnet3/decodable-online-looped.h"
+#include "online2/online-nnet2-feature-pipeline.h"
+#include "online2/online-endpoint.h"
+#include "online2/online-beam-controller.h"
+#include "decoder/lattice-faster-online-decoder.h"
+#include "decoder/lattice-incremental-determinizer.h"
+#include "hmm/transition-model.h"
+
+namespace kaldi {
+/// @addtogroup  onlinedecoding OnlineDecoding
+/// @{
+
+
+/**
+   You will instantiate this class when you want to decode a single utterance
+   using the online-decoding setup for nnet3 neural nets, with the looped
+   computation (see nnet3/decodable-simple-looped.h).  It uses the same
+   feature pipeline as the nnet2 setup (OnlineNnet2FeaturePipeline), but gives
+   the iVectors to the nnet as a separate input.
+*/
+class SingleUtteranceNnet3Decoder {
+ public:
+  // Constructor.  The "info" and "feature_pipeline" are not owned in this
+  // class, they're owned externally; "info" should have been created from the
+  // AmNnetSimple, and will normally be shared between utterances.
+  SingleUtteranceNnet3Decoder(
+      const LatticeFasterDecoderConfig &decoder_opts,
+      const TransitionModel &tmodel,
+      const nnet3::DecodableNnetSimpleLoopedInfo &info,
+      const fst::Fst<fst::StdArc> &fst,
+      OnlineNnet2FeaturePipeline *feature_pipeline);
+
+  /// advance the decoding as far as we can.
+  void AdvanceDecoding();
+
+  /// Makes AdvanceDecoding() go through "controller", which adjusts the beam
+  /// to keep to a target real-time factor, as measured with "timer" (see
+  /// online-beam-controller.h).  Neither pointer is owned by this class.
+  void SetBeamController(OnlineBeamController *controller, OnlineTimer *timer);
+
+  /// Finalizes the decoding. Cleans up and prunes remaining tokens, so the
+  /// GetLattice() call will return faster.
+  void FinalizeDecoding();
+
+  int32 NumFramesDecoded() const;
+
+  /// Gets the lattice.  The output lattice has any acoustic scaling in it
+  /// (which will typically be desirable in an online-decoding context); if you
+  /// want an un-scaled lattice, scale it using ScaleLattice() with the inverse
+  /// of the acoustic weight.  "end_of_utterance" will be true if you want the
+  /// final-probs to be included.
+  void GetLattice(bool end_of_utterance,
+                  CompactLattice *clat) const;
+
+  /// Gets the lattice of a partial result (without final-probs), like
+  /// GetLattice(false, clat), but with the frozen part of the lattice only
+  /// determinized once, so that calling this repeatedly during the utterance
+  /// does not get slower as the utterance gets longer (see
+  /// IncrementalLatticeDeterminizer).
+  void GetPartialLattice(CompactLattice *clat);
+
+  /// Outputs an FST corresponding to the single best path through the current
+  /// lattice. If "use_final_probs" is true AND we reached the final-state of
+  /// the graph then it will include those as final-probs, else it will treat
+  /// all final-probs as one.
+  void GetBestPath(bool end_of_utterance,
+                   Lattice *best_path) const;
+
+  /// This function calls EndpointDetected from online-endpoint.h,
+  /// with the required arguments.
+  bool EndpointDetected(const OnlineEndpointConfig &config);
+
+  const LatticeFasterOnlineDecoder &Decoder() const { return decoder_; }
+
+  ~SingleUtteranceNnet3Decoder() { }
+ private:
+
+  LatticeFasterDecoderConfig decoder_opts_;
+
+  OnlineNnet2FeaturePipeline *feature_pipeline_;
+
+  const TransitionModel &tmodel_;
+
+  nnet3::DecodableAmNnetLoopedOnline decodable_;
+
+  LatticeFasterOnlineDecoder decoder_;
+
+  IncrementalLatticeDeterminizer partial_lattice_;  // for GetPartialLattice().
+
+  OnlineBeamController *beam_controller_;  // not owned; may be NULL.
+  OnlineTimer *timer_;  // not owned; used with beam_controller_.
+};
+
+
+/// @} End of "addtogroup onlinedecoding"
+
+}  // namespace kaldi
+
+
+
+#endif  // KALDI_ONLINE2_ONLINE_NNET3_DECODING_H_
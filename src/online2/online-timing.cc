@@ -21,11 +21,158 @@
 
 namespace kaldi {
 
+const double LatencyHistogram::kMinTime = 1.0e-04;
+const int32 LatencyHistogram::kBucketsPerOctave;
+
+void LatencyHistogram::Add(double seconds) {
+  if (seconds < 0.0) seconds = 0.0;
+  int32 bucket = 0;
+  if (seconds >= kMinTime) {
+    // the maximum means times of more than about a day share the last bucket.
+    bucket = std::min<double>(
+        kBucketsPerOctave * Log(seconds / kMinTime) / M_LN2,
+        30 * kBucketsPerOctave);
+  }
+  if (bucket >= static_cast<int32>(counts_.size()))
+    counts_.resize(bucket + 1, 0);
+  counts_[bucket]++;
+  count_++;
+  total_ += seconds;
+  max_ = std::max(max_, seconds);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram &other) {
+  if (other.counts_.size() > counts_.size())
+    counts_.resize(other.counts_.size(), 0);
+  for (size_t i = 0; i < other.counts_.size(); i++)
+    counts_[i] += other.counts_[i];
+  count_ += other.count_;
+  total_ += other.total_;
+  max_ = std::max(max_, other.max_);
+}
+
+double LatencyHistogram::Percentile(BaseFloat p) const {
+  KALDI_ASSERT(p >= 0.0 && p <= 100.0);
+  if (count_ == 0) return 0.0;
+  // "target" is the 1-based rank of the time we want.
+  int64 target = std::max<int64>(1, static_cast<int64>(ceil(count_ * p / 100.0))),
+      cumulative = 0;
+  for (size_t i = 0; i < counts_.size(); i++) {
+    cumulative += counts_[i];
+    if (cumulative >= target) {
+      double center = kMinTime * pow(2.0, (i + 0.5) / kBucketsPerOctave);
+      return std::min(center, max_);
+    }
+  }
+  return max_;  // not reached.
+}
+
+void LatencyHistogram::Print(const std::string &name) const {
+  if (count_ == 0) return;
+  KALDI_LOG << name << ": count " << count_ << ", mean " << Mean()
+            << ", p50 " << Percentile(50.0) << ", p90 " << Percentile(90.0)
+            << ", p99 " << Percentile(99.0) << ", max " << max_
+            << " seconds.";
+}
+
+void LatencyHistogram::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<LatencyHistogram>");
+  WriteToken(os, binary, "<Counts>");
+  WriteIntegerVector(os, binary, counts_);
+  WriteToken(os, binary, "<Total>");
+  WriteBasicType(os, binary, total_);
+  WriteToken(os, binary, "<Max>");
+  WriteBasicType(os, binary, max_);
+  WriteToken(os, binary, "</LatencyHistogram>");
+}
+
+void LatencyHistogram::Read(std::istream &is, bool binary) {
+  ExpectToken(is, binary, "<LatencyHistogram>");
+  ExpectToken(is, binary, "<Counts>");
+  ReadIntegerVector(is, binary, &counts_);
+  ExpectToken(is, binary, "<Total>");
+  ReadBasicType(is, binary, &total_);
+  ExpectToken(is, binary, "<Max>");
+  ReadBasicType(is, binary, &max_);
+  ExpectToken(is, binary, "</LatencyHistogram>");
+  count_ = 0;
+  for (size_t i = 0; i < counts_.size(); i++)
+    count_ += counts_[i];
+}
+
 OnlineTimingStats::OnlineTimingStats():
     num_utts_(0), total_audio_(0.0), total_time_taken_(0.0),
     total_time_waited_(0.0), max_delay_(0.0) {
 }
 
+void OnlineTimingStats::Merge(const OnlineTimingStats &other) {
+  num_utts_ += other.num_utts_;
+  total_audio_ += other.total_audio_;
+  total_time_taken_ += other.total_time_taken_;
+  total_time_waited_ += other.total_time_waited_;
+  if (other.max_delay_ > max_delay_) {
+    max_delay_ = other.max_delay_;
+    max_delay_utt_ = other.max_delay_utt_;
+  }
+  first_partial_latency_.Merge(other.first_partial_latency_);
+  final_latency_.Merge(other.final_latency_);
+  chunk_time_.Merge(other.chunk_time_);
+}
+
+void OnlineTimingStats::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<OnlineTimingStats>");
+  WriteToken(os, binary, "<NumUtts>");
+  WriteBasicType(os, binary, num_utts_);
+  WriteToken(os, binary, "<TotalAudio>");
+  WriteBasicType(os, binary, total_audio_);
+  WriteToken(os, binary, "<TotalTimeTaken>");
+  WriteBasicType(os, binary, total_time_taken_);
+  WriteToken(os, binary, "<TotalTimeWaited>");
+  WriteBasicType(os, binary, total_time_waited_);
+  WriteToken(os, binary, "<MaxDelay>");
+  WriteBasicType(os, binary, max_delay_);
+  if (!max_delay_utt_.empty()) {
+    WriteToken(os, binary, "<MaxDelayUtt>");
+    WriteToken(os, binary, max_delay_utt_);
+  }
+  WriteToken(os, binary, "<FirstPartialLatency>");
+  first_partial_latency_.Write(os, binary);
+  WriteToken(os, binary, "<FinalLatency>");
+  final_latency_.Write(os, binary);
+  WriteToken(os, binary, "<ChunkTime>");
+  chunk_time_.Write(os, binary);
+  WriteToken(os, binary, "</OnlineTimingStats>");
+}
+
+void OnlineTimingStats::Read(std::istream &is, bool binary) {
+  ExpectToken(is, binary, "<OnlineTimingStats>");
+  ExpectToken(is, binary, "<NumUtts>");
+  ReadBasicType(is, binary, &num_utts_);
+  ExpectToken(is, binary, "<TotalAudio>");
+  ReadBasicType(is, binary, &total_audio_);
+  ExpectToken(is, binary, "<TotalTimeTaken>");
+  ReadBasicType(is, binary, &total_time_taken_);
+  ExpectToken(is, binary, "<TotalTimeWaited>");
+  ReadBasicType(is, binary, &total_time_waited_);
+  ExpectToken(is, binary, "<MaxDelay>");
+  ReadBasicType(is, binary, &max_delay_);
+  std::string token;
+  ReadToken(is, binary, &token);
+  max_delay_utt_ = "";
+  if (token == "<MaxDelayUtt>") {
+    ReadToken(is, binary, &max_delay_utt_);
+    ReadToken(is, binary, &token);
+  }
+  if (token != "<FirstPartialLatency>")
+    KALDI_ERR << "Expected <FirstPartialLatency>, got " << token;
+  first_partial_latency_.Read(is, binary);
+  ExpectToken(is, binary, "<FinalLatency>");
+  final_latency_.Read(is, binary);
+  ExpectToken(is, binary, "<ChunkTime>");
+  chunk_time_.Read(is, binary);
+  ExpectToken(is, binary, "</OnlineTimingStats>");
+}
+
 void OnlineTimingStats::Print(bool online){
   if (online) {
     double real_time_factor = total_time_taken_ / total_audio_,
@@ -43,6 +190,10 @@ void OnlineTimingStats::Print(bool online){
     }
     KALDI_LOG << "Longest delay was " << max_delay_ << " seconds for utterance "
               << '\'' << max_delay_utt_ << '\'';
+    first_partial_latency_.Print("Time from utterance start to first partial "
+                                 "result");
+    final_latency_.Print("Time from utterance end to final result");
+    chunk_time_.Print("Processing time per chunk");
   } else {
     // we have processed each utterance in one chunk.
     // the decoding code will have "pretended to wait" (using WaitUntil())
@@ -60,10 +211,14 @@ void OnlineTimingStats::Print(bool online){
 }
 
 OnlineTimer::OnlineTimer(const std::string &utterance_id):
-    utterance_id_(utterance_id), waited_(0.0), utterance_length_(0.0) { }
+    utterance_id_(utterance_id), waited_(0.0), utterance_length_(0.0),
+    first_partial_time_(-1.0), chunk_start_(-1.0) { }
 
 void OnlineTimer::WaitUntil(double cur_utterance_length) {
   double elapsed = timer_.Elapsed();
+  if (chunk_start_ >= 0.0)
+    chunk_times_.push_back(elapsed - chunk_start_);
+  chunk_start_ = elapsed;
   // it's been cur_utterance_length seconds since we would have
   // started processing this utterance, in a real-time decoding
   // scenario.  We've been actually processing it for "elapsed"
@@ -81,11 +236,14 @@ void OnlineTimer::WaitUntil(double cur_utterance_length) {
 void OnlineTimer::SleepUntil(double cur_utterance_length) {
   KALDI_ASSERT(waited_ == 0 && "Do not mix SleepUntil with WaitUntil.");
   double elapsed = timer_.Elapsed();
+  if (chunk_start_ >= 0.0)
+    chunk_times_.push_back(elapsed - chunk_start_);
 
   double to_wait = cur_utterance_length - elapsed;
   if (to_wait > 0.0) {
     Sleep(to_wait);
   }
+  chunk_start_ = timer_.Elapsed();
   utterance_length_ = cur_utterance_length;
 }
 
@@ -93,8 +251,14 @@ double OnlineTimer::Elapsed() {
   return timer_.Elapsed() + waited_;
 }
 
+void OnlineTimer::FirstPartialReady() {
+  if (first_partial_time_ < 0.0)
+    first_partial_time_ = Elapsed();
+}
+
 void OnlineTimer::OutputStats(OnlineTimingStats *stats) {
-  double processing_time = timer_.Elapsed() + waited_,
+  double real_time = timer_.Elapsed(),
+      processing_time = real_time + waited_,
       wait_time = processing_time - utterance_length_;
   if (wait_time < 0.0) {
     // My first though was to make this a KALDI_ERR, but perhaps
@@ -111,6 +275,16 @@ void OnlineTimer::OutputStats(OnlineTimingStats *stats) {
   stats->total_audio_ += utterance_length_;
   stats->total_time_taken_ += processing_time;
   stats->total_time_waited_ += waited_;
+  if (first_partial_time_ >= 0.0) {
+    KALDI_VLOG(2) << "First partial result after " << first_partial_time_
+                  << " seconds, for utterance " << utterance_id_;
+    stats->first_partial_latency_.Add(first_partial_time_);
+  }
+  stats->final_latency_.Add(wait_time);
+  for (size_t i = 0; i < chunk_times_.size(); i++)
+    stats->chunk_time_.Add(chunk_times_[i]);
+  if (chunk_start_ >= 0.0)  // the last chunk, which includes finalization.
+    stats->chunk_time_.Add(real_time - chunk_start_);
   if (wait_time > stats->max_delay_) {
     stats->max_delay_ = wait_time;
     stats->max_delay_utt_ = utterance_id_;
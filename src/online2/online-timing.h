@@ -27,17 +27,67 @@
 
 #include "base/timer.h"
 #include "base/kaldi-error.h"
+#include "base/io-funcs.h"
 
 namespace kaldi {
 /// @addtogroup  onlinedecoding OnlineDecoding
 /// @{
 
 
+/// class LatencyHistogram stores the distribution of a time (e.g. a latency),
+/// in buckets whose widths increase geometrically (kBucketsPerOctave buckets
+/// per factor of two, starting at kMinTime seconds), so the percentiles it
+/// prints are accurate to a few percent over a very wide range of values.
+/// Histograms can be merged, e.g. across threads, and written and read, e.g.
+/// to combine the stats from several processes.
+class LatencyHistogram {
+ public:
+  LatencyHistogram(): count_(0), total_(0.0), max_(0.0) { }
+
+  /// Adds a time in seconds (negative times are treated as zero).
+  void Add(double seconds);
+
+  /// Adds the counts of "other" to this.
+  void Merge(const LatencyHistogram &other);
+
+  int64 Count() const { return count_; }
+
+  double Mean() const { return (count_ == 0 ? 0.0 : total_ / count_); }
+
+  double Max() const { return max_; }
+
+  /// Returns an approximation to the p'th percentile (0 <= p <= 100): the
+  /// geometric center of the bucket it falls in, or max_ if that is smaller.
+  double Percentile(BaseFloat p) const;
+
+  /// Prints the count, mean, p50, p90, p99 and max on one line, to the log.
+  void Print(const std::string &name) const;
+
+  void Write(std::ostream &os, bool binary) const;
+  void Read(std::istream &is, bool binary);
+
+  static const double kMinTime;  // times less than this go in the first bucket.
+  static const int32 kBucketsPerOctave = 8;
+ private:
+  // counts_[i] is the number of times in the range
+  // [kMinTime * 2^(i / kBucketsPerOctave),
+  //  kMinTime * 2^((i+1) / kBucketsPerOctave)); it's resized as needed.
+  std::vector<int64> counts_;
+  int64 count_;
+  double total_;
+  double max_;
+};
+
+
 class OnlineTimer;
 
 /// class OnlineTimingStats stores statistics from timing of online decoding,
 /// which will enable the Print() function to print out the averate real-time
 /// factor and average delay per utterance.  See class OnlineTimer.
+/// It also keeps histograms of the time to the first partial result, of the
+/// delay at utterance end (from the endpoint or end of input to the final
+/// result), and of the processing time of each chunk, whose percentiles are
+/// printed.
 class OnlineTimingStats {
  public:
   OnlineTimingStats();
@@ -45,6 +95,15 @@ class OnlineTimingStats {
   /// not-really-online mode where the chunk length was the whole file.  We need
   /// to change the way we interpret the stats and print results, in this case.
   void Print(bool online = true);
+
+  /// Adds the stats in "other" to this, e.g. to combine the stats of several
+  /// decoding threads.
+  void Merge(const OnlineTimingStats &other);
+
+  /// Write and Read allow the stats of several processes to be combined (with
+  /// Merge()).
+  void Write(std::ostream &os, bool binary) const;
+  void Read(std::istream &is, bool binary);
  protected:
   friend class OnlineTimer;
   int32 num_utts_;
@@ -56,6 +115,13 @@ class OnlineTimingStats {
                              // called SleepUntil instead of WaitUntil().
   double max_delay_; // maximum delay at utterance end.
   std::string max_delay_utt_;
+  // time from the utterance start to the first partial result.
+  LatencyHistogram first_partial_latency_;
+  // time from the end of the utterance (the endpoint, or end of input) to the
+  // final result.
+  LatencyHistogram final_latency_;
+  // real time taken to process each chunk.
+  LatencyHistogram chunk_time_;
 };
 
 
@@ -106,6 +172,13 @@ class OnlineTimer {
   /// Returns the simulated time elapsed in seconds since the timer was started;
   /// this equals waited_ plus the real time elapsed.
   double Elapsed();
+
+  /// Call this when the decoder has produced its first partial output (e.g.
+  /// when NumFramesDecoded() first becomes nonzero); only the first call has
+  /// any effect.  The simulated time elapsed since the start of the utterance
+  /// is the "first-partial latency", whose distribution over utterances is
+  /// printed by OnlineTimingStats::Print().
+  void FirstPartialReady();
   
  private:
   std::string utterance_id_;
@@ -113,6 +186,13 @@ class OnlineTimer {
   // all times are in seconds.
   double waited_;
   double utterance_length_;
+  double first_partial_time_;  // negative if FirstPartialReady() not called.
+  // real time at which the current chunk started being processed (when the
+  // last WaitUntil() or SleepUntil() call returned), or negative before the
+  // first chunk.
+  double chunk_start_;
+  // real time taken to process each chunk, so far.
+  std::vector<double> chunk_times_;
 };
 
 
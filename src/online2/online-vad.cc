@@ -0,0 +1,153 @@
+// online2/online-vad.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "online2/online-vad.h"
+
+namespace kaldi {
+
+OnlineVadFeature::OnlineVadFeature(const OnlineVadConfig &config,
+                                   BaseFloat frame_shift_in_seconds,
+                                   OnlineFeatureInterface *energy_src,
+                                   OnlineFeatureInterface *src):
+    config_(config),
+    hangover_frames_(static_cast<int32>(config.hangover /
+                                        frame_shift_in_seconds + 0.5)),
+    preroll_frames_(static_cast<int32>(config.preroll /
+                                       frame_shift_in_seconds + 0.5)),
+    energy_src_(energy_src), src_(src), log_energy_sum_(0.0),
+    energy_finished_(false), num_frames_decided_(0) {
+  const VadEnergyOptions &opts = config.energy_opts;
+  KALDI_ASSERT(frame_shift_in_seconds > 0.0 && energy_src->Dim() > 0);
+  KALDI_ASSERT(config.hangover >= 0.0 && config.preroll >= 0.0);
+  KALDI_ASSERT(opts.vad_frames_context >= 0 &&
+               opts.vad_energy_mean_scale >= 0.0);
+  KALDI_ASSERT(opts.vad_proportion_threshold > 0.0 &&
+               opts.vad_proportion_threshold < 1.0);
+}
+
+void OnlineVadFeature::Update() const {
+  const VadEnergyOptions &opts = config_.energy_opts;
+  if (!energy_finished_) {
+    int32 num_ready = energy_src_->NumFramesReady();
+    if (num_ready > static_cast<int32>(log_energy_.size())) {
+      Vector<BaseFloat> feat(energy_src_->Dim(), kUndefined);
+      for (int32 t = log_energy_.size(); t < num_ready; t++) {
+        energy_src_->GetFrame(t, &feat);
+        log_energy_.push_back(feat(0));  // column zero is log-energy.
+        log_energy_sum_ += feat(0);
+      }
+    }
+    energy_finished_ = energy_src_->IsLastFrame(num_ready - 1);
+  }
+
+  // The decision for frame t needs the log-energies of frames up to
+  // t + vad_frames_context (or the end of the input).
+  int32 num_frames = log_energy_.size(), context = opts.vad_frames_context;
+  if (num_frames == 0) return;
+  BaseFloat energy_threshold = opts.vad_energy_threshold +
+      opts.vad_energy_mean_scale * log_energy_sum_ / num_frames;
+  while (static_cast<int32>(speech_.size()) < num_frames) {
+    int32 t = speech_.size();
+    if (!energy_finished_ && t + context >= num_frames)
+      break;
+    int32 num_count = 0, den_count = 0;
+    for (int32 t2 = std::max(0, t - context);
+         t2 <= std::min(num_frames - 1, t + context); t2++) {
+      den_count++;
+      if (log_energy_[t2] > energy_threshold)
+        num_count++;
+    }
+    speech_.push_back(num_count >= den_count * opts.vad_proportion_threshold);
+  }
+
+  // The keep/skip decision for frame t needs the speech decisions of frames up
+  // to t + preroll_frames_ (or the end of the input).
+  int32 num_speech_decided = speech_.size(),
+      num_src_ready = src_->NumFramesReady();
+  bool all_decided = (energy_finished_ && num_speech_decided == num_frames);
+  while (num_frames_decided_ < std::min(num_src_ready, num_speech_decided)) {
+    int32 t = num_frames_decided_;
+    if (!all_decided && t + preroll_frames_ >= num_speech_decided)
+      break;
+    int32 end = std::min(num_speech_decided - 1, t + preroll_frames_);
+    bool keep = false;
+    for (int32 t2 = std::max(0, t - hangover_frames_); t2 <= end; t2++) {
+      if (speech_[t2]) {
+        keep = true;
+        break;
+      }
+    }
+    if (keep)
+      kept_frames_.push_back(t);
+    num_frames_decided_++;
+  }
+}
+
+int32 OnlineVadFeature::NumFramesReady() const {
+  Update();
+  return kept_frames_.size();
+}
+
+bool OnlineVadFeature::IsLastFrame(int32 frame) const {
+  Update();
+  if (frame != static_cast<int32>(kept_frames_.size()) - 1)
+    return false;
+  // It is the last frame if all the frames of the source have been decided,
+  // and the rest were skipped.
+  return src_->NumFramesReady() == num_frames_decided_ &&
+      src_->IsLastFrame(num_frames_decided_ - 1);
+}
+
+void OnlineVadFeature::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
+  src_->GetFrame(SourceFrame(frame), feat);
+}
+
+void OnlineVadFeature::GetFrames(const std::vector<int32> &frames,
+                                 MatrixBase<BaseFloat> *feats) {
+  std::vector<int32> src_frames(frames.size());
+  for (size_t i = 0; i < frames.size(); i++)
+    src_frames[i] = SourceFrame(frames[i]);
+  src_->GetFrames(src_frames, feats);
+}
+
+void OnlineVadFeature::ReleaseFramesBefore(int32 frame) {
+  if (frame <= 0) return;
+  if (frame < static_cast<int32>(kept_frames_.size()))
+    src_->ReleaseFramesBefore(kept_frames_[frame]);
+  else
+    src_->ReleaseFramesBefore(num_frames_decided_);
+}
+
+int32 OnlineVadFeature::SourceFrame(int32 frame) const {
+  KALDI_ASSERT(frame >= 0 &&
+               frame < static_cast<int32>(kept_frames_.size()));
+  return kept_frames_[frame];
+}
+
+int32 OnlineVadFeature::NumTrailingGatedFrames() const {
+  return num_frames_decided_ -
+      (kept_frames_.empty() ? 0 : kept_frames_.back() + 1);
+}
+
+int32 OnlineVadFeature::NumFramesGated() const {
+  return num_frames_decided_ - kept_frames_.size();
+}
+
+}  // namespace kaldi
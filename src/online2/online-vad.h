@@ -0,0 +1,143 @@
+// online2/online-vad.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_ONLINE2_ONLINE_VAD_H_
+#define KALDI_ONLINE2_ONLINE_VAD_H_
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "itf/online-feature-itf.h"
+#include "itf/options-itf.h"
+#include "ivector/voice-activity-detection.h"
+
+namespace kaldi {
+/// @addtogroup  onlinedecoding OnlineDecoding
+/// @{
+
+
+/// Configuration for OnlineVadFeature.  The energy-based decision for each
+/// frame is that of ComputeVadEnergy() (see compute-vad), except that the
+/// mean log-energy in the threshold is the mean over the frames seen so far.
+struct OnlineVadConfig {
+  bool gate;  // if true, the online decoder skips non-speech frames.
+  VadEnergyOptions energy_opts;
+  BaseFloat hangover;  // seconds of non-speech kept after speech.
+  BaseFloat preroll;  // seconds of non-speech kept before speech.
+
+  OnlineVadConfig(): gate(false), hangover(0.5), preroll(0.1) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("vad-gating", &gate, "If true, skip the neural net "
+                   "evaluation and the decoding of frames that an energy-based "
+                   "voice activity detector classifies as non-speech (needs "
+                   "MFCC or PLP features, whose first coefficient is the "
+                   "energy or C0).  The skipped frames count as silence for "
+                   "endpointing, but are not in the output lattice.  See also "
+                   "--vad-energy-threshold etc.");
+    energy_opts.Register(opts);
+    opts->Register("vad-hangover", &hangover, "With --vad-gating, number of "
+                   "seconds of non-speech after speech that are still "
+                   "decoded.");
+    opts->Register("vad-preroll", &preroll, "With --vad-gating, number of "
+                   "seconds of non-speech before speech that are still "
+                   "decoded; this adds to the latency.");
+  }
+};
+
+
+/**
+   OnlineVadFeature presents the frames of another OnlineFeatureInterface
+   ("src") with the non-speech frames removed, so that a decoder reading from
+   it spends no time on them.  The speech/non-speech decision is made from the
+   first coefficient of "energy_src", which must have the same frame rate as
+   "src" (normally it is the MFCC or PLP features that "src" is computed from).
+   Frame t of the source is kept if there is a speech frame in the range
+   [t - hangover, t + preroll] (in frames), so short pauses, and the silence
+   at the edges of speech, are still seen by the decoder.
+
+   The output frame index is therefore not the source frame index;
+   SourceFrame() maps between them, e.g. for silence weighting or for times in
+   the output, and NumTrailingGatedFrames() says how many non-speech frames
+   have been skipped since the last output frame, which the endpointing code
+   counts as trailing silence.
+*/
+class OnlineVadFeature: public OnlineFeatureInterface {
+ public:
+  /// Neither pointer is owned here.
+  OnlineVadFeature(const OnlineVadConfig &config,
+                   BaseFloat frame_shift_in_seconds,
+                   OnlineFeatureInterface *energy_src,
+                   OnlineFeatureInterface *src);
+
+  virtual int32 Dim() const { return src_->Dim(); }
+
+  virtual int32 NumFramesReady() const;
+
+  virtual bool IsLastFrame(int32 frame) const;
+
+  virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
+
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
+
+  virtual void ReleaseFramesBefore(int32 frame);
+
+  /// Returns the index in "src" of output frame "frame", which must be less
+  /// than NumFramesReady().
+  int32 SourceFrame(int32 frame) const;
+
+  /// Returns the number of source frames, after the last output frame that is
+  /// ready, that have been classified as non-speech and skipped.
+  int32 NumTrailingGatedFrames() const;
+
+  /// Returns the total number of source frames skipped so far.
+  int32 NumFramesGated() const;
+
+  virtual ~OnlineVadFeature() { }
+
+ private:
+  // Makes the speech/non-speech and keep/skip decisions for as many frames as
+  // possible.  It's called from NumFramesReady(), which is const in the
+  // interface, so the state it updates is mutable.
+  void Update() const;
+
+  OnlineVadConfig config_;
+  int32 hangover_frames_;
+  int32 preroll_frames_;
+  OnlineFeatureInterface *energy_src_;
+  OnlineFeatureInterface *src_;
+
+  mutable std::vector<BaseFloat> log_energy_;  // log-energy of each frame read.
+  mutable double log_energy_sum_;
+  mutable bool energy_finished_;  // true once log_energy_ has all the frames.
+  // speech_[t] is true if frame t is classified as speech; it has an entry for
+  // each frame whose decision is known.
+  mutable std::vector<bool> speech_;
+  mutable int32 num_frames_decided_;  // number of frames kept or skipped.
+  mutable std::vector<int32> kept_frames_;  // source indexes of output frames.
+};
+
+
+/// @} End of "addtogroup onlinedecoding"
+
+}  // namespace kaldi
+
+#endif  // KALDI_ONLINE2_ONLINE_VAD_H_
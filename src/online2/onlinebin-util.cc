@@ -21,10 +21,12 @@
 // limitations under the License.
 
 #include "onlinebin-util.h"
+#include "util/kaldi-io.h"
 
 namespace kaldi {
 
-fst::Fst<fst::StdArc> *ReadDecodeGraph(std::string filename) {
+fst::Fst<fst::StdArc> *ReadDecodeGraph(std::string filename,
+                                       bool use_mmap) {
   // read decoding network FST
   Input ki(filename); // use ki.Stream() instead of is.
   if (!ki.Stream().good()) KALDI_ERR << "Could not open decoding-graph FST "
@@ -38,6 +40,23 @@ fst::Fst<fst::StdArc> *ReadDecodeGraph(std::string filename) {
     KALDI_ERR << "FST with arc type " << hdr.ArcType() << " not supported.\n";
   }
   fst::FstReadOptions ropts("<unspecified>", &hdr);
+  if (use_mmap) {
+    // OpenFst maps the file named by ropts.source, at the current position of
+    // the stream, if the data there is aligned; otherwise it reads it.
+    if (ClassifyRxfilename(filename) != kFileInput)
+      KALDI_WARN << "Cannot memory-map decoding graph " << filename
+                 << " as it is not an ordinary file; reading it.";
+    else if (hdr.FstType() != "const")
+      KALDI_WARN << "Cannot memory-map decoding graph " << filename
+                 << " as it is not a ConstFst; reading it.";
+    else if (!(hdr.GetFlags() & fst::FstHeader::IS_ALIGNED))
+      KALDI_WARN << "Cannot memory-map decoding graph " << filename
+                 << " as it was not written with --fst_align; reading it.";
+    else {
+      ropts.source = filename;
+      ropts.mode = fst::FstReadOptions::MAP;
+    }
+  }
 
   fst::Fst<fst::StdArc> *decode_fst = NULL;
 
@@ -33,8 +33,13 @@
 
 namespace kaldi {
 
-// Reads a decoding graph from a file
-fst::Fst<fst::StdArc> *ReadDecodeGraph(std::string filename);
+// Reads a decoding graph from a file.  If "use_mmap" is true, "filename" is
+// an ordinary file and the graph is a ConstFst written with alignment (e.g.
+// by "fstconvert --fst_type=const --fst_align=true"), the arrays of the graph
+// are memory-mapped instead of read, so loading takes almost no time and
+// processes decoding with the same graph share one copy of it.
+fst::Fst<fst::StdArc> *ReadDecodeGraph(std::string filename,
+                                       bool use_mmap = false);
 
 // Prints a string corresponding to (a possibly partial) decode result as
 // and adds a "new line" character if "line_break" argument is true
@@ -0,0 +1,65 @@
+// online2bin/online2-sum-timing-stats.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "util/common-utils.h"
+#include "online2/online-timing.h"
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Sum the timing stats written by the online decoding programs with\n"
+        "--timing-stats-wxfilename (e.g. from several jobs), and print them,\n"
+        "including the percentiles of the latencies.\n"
+        "Usage: online2-sum-timing-stats [options] <stats-in1> <stats-in2> ...\n"
+        "e.g.: online2-sum-timing-stats exp/decode/timing.*.stats\n";
+
+    std::string stats_wxfilename;
+    bool online = true;
+    ParseOptions po(usage);
+    po.Register("write-stats", &stats_wxfilename,
+                "If supplied, write the summed stats to this file.");
+    po.Register("online", &online,
+                "Set this to false if the stats came from decoding with "
+                "--online=false (this affects how they are printed).");
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 1) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    OnlineTimingStats stats;
+    for (int32 i = 1; i <= po.NumArgs(); i++) {
+      OnlineTimingStats this_stats;
+      ReadKaldiObject(po.GetArg(i), &this_stats);
+      stats.Merge(this_stats);
+    }
+    stats.Print(online);
+    if (stats_wxfilename != "")
+      WriteKaldiObject(stats, stats_wxfilename, false);
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
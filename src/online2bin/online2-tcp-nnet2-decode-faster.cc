@@ -0,0 +1,505 @@
+// online2bin/online2-tcp-nnet2-decode-faster.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <set>
+
+#include "online2/online-nnet2-decoding.h"
+#include "online2/onlinebin-util.h"
+#include "online2/online-endpoint.h"
+#include "fstext/fstext-lib.h"
+#include "lat/lattice-functions.h"
+#include "thread/kaldi-task-scheduler.h"
+
+namespace kaldi {
+
+// A very simple TCP server that listens on a port and accepts clients.
+class TcpServer {
+ public:
+  TcpServer(): server_desc_(-1) { }
+  ~TcpServer() { if (server_desc_ != -1) close(server_desc_); }
+
+  // Starts listening on the given port; "backlog" is the number of
+  // connections the system will queue before refusing new ones.
+  void Listen(int32 port, int32 backlog) {
+    struct sockaddr_in h_addr;
+    memset(&h_addr, 0, sizeof(h_addr));
+    h_addr.sin_addr.s_addr = INADDR_ANY;
+    h_addr.sin_port = htons(port);
+    h_addr.sin_family = AF_INET;
+    if ((server_desc_ = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+      KALDI_ERR << "Cannot create TCP socket: " << strerror(errno);
+    int32 flag = 1;
+    if (setsockopt(server_desc_, SOL_SOCKET, SO_REUSEADDR, &flag,
+                   sizeof(flag)) == -1)
+      KALDI_ERR << "Cannot set socket options: " << strerror(errno);
+    if (bind(server_desc_, (struct sockaddr*) &h_addr, sizeof(h_addr)) == -1)
+      KALDI_ERR << "Cannot bind to port " << port << " (is it taken?): "
+                << strerror(errno);
+    if (listen(server_desc_, backlog) == -1)
+      KALDI_ERR << "Cannot listen on port " << port << ": " << strerror(errno);
+    KALDI_LOG << "Listening on port " << port;
+  }
+
+  // Waits for a client and returns its socket descriptor, or -1 on failure;
+  // "client" is set to a printable form of its address.
+  int32 Accept(std::string *client) {
+    struct sockaddr_in c_addr;
+    socklen_t len = sizeof(c_addr);
+    int32 client_desc = accept(server_desc_, (struct sockaddr*) &c_addr, &len);
+    if (client_desc == -1) {
+      KALDI_WARN << "Error accepting connection: " << strerror(errno);
+      return -1;
+    }
+    char ipstr[INET_ADDRSTRLEN];
+    if (inet_ntop(AF_INET, &c_addr.sin_addr, ipstr, sizeof(ipstr)) == NULL)
+      *client = "[unknown]";
+    else
+      *client = ipstr;
+    std::ostringstream os;
+    os << ':' << ntohs(c_addr.sin_port);
+    *client += os.str();
+    return client_desc;
+  }
+
+ private:
+  int32 server_desc_;
+};
+
+// Writes a line of text to the socket; returns false on failure.
+bool WriteLine(int32 socket, const std::string &text) {
+  std::string line = text + "\n";
+  const char *p = line.c_str();
+  size_t to_write = line.size();
+  while (to_write > 0) {
+    ssize_t ret = write(socket, p, to_write);
+    if (ret <= 0) {
+      if (ret < 0 && errno == EINTR) continue;
+      return false;
+    }
+    to_write -= ret;
+    p += ret;
+  }
+  return true;
+}
+
+// Reads up to "num_samples" 16-bit little-endian samples from the socket into
+// "wave_part" (which is resized to the number actually read), blocking until
+// they are all there.  Returns false if the client closed the connection (or
+// there was an error) before all of them arrived.
+bool ReadSamples(int32 socket, int32 num_samples,
+                 Vector<BaseFloat> *wave_part) {
+  std::vector<unsigned char> buffer(num_samples * 2);
+  size_t num_bytes = 0;
+  bool ans = true;
+  while (num_bytes < buffer.size()) {
+    ssize_t ret = read(socket, &(buffer[num_bytes]), buffer.size() - num_bytes);
+    if (ret <= 0) {
+      if (ret < 0 && errno == EINTR) continue;
+      if (ret < 0)
+        KALDI_WARN << "Error reading from socket: " << strerror(errno);
+      ans = false;
+      break;
+    }
+    num_bytes += ret;
+  }
+  int32 num_read = num_bytes / 2;  // an odd trailing byte is ignored.
+  wave_part->Resize(num_read, kUndefined);
+  for (int32 i = 0; i < num_read; i++) {
+    int16 sample = static_cast<int16>(buffer[2 * i] |
+                                      (buffer[2 * i + 1] << 8));
+    (*wave_part)(i) = sample;
+  }
+  return ans;
+}
+
+// Things that are shared (read-only) by all the connections: the model and
+// graph are loaded once, at startup.
+struct DecodingResources {
+  DecodingResources(const OnlineNnet2FeaturePipelineInfo &feature_info,
+                    const OnlineNnet2DecodingConfig &decoding_config,
+                    const OnlineEndpointConfig &endpoint_config,
+                    const TransitionModel &trans_model,
+                    const nnet2::AmNnet &nnet,
+                    const fst::Fst<fst::StdArc> &decode_fst,
+                    const fst::SymbolTable &word_syms):
+      feature_info(feature_info), decoding_config(decoding_config),
+      endpoint_config(endpoint_config), trans_model(trans_model), nnet(nnet),
+      decode_fst(decode_fst), word_syms(word_syms), samp_freq(16000.0),
+      chunk_length_secs(0.1), do_endpointing(true) { }
+
+  const OnlineNnet2FeaturePipelineInfo &feature_info;
+  const OnlineNnet2DecodingConfig &decoding_config;
+  const OnlineEndpointConfig &endpoint_config;
+  const TransitionModel &trans_model;
+  const nnet2::AmNnet &nnet;
+  const fst::Fst<fst::StdArc> &decode_fst;
+  const fst::SymbolTable &word_syms;
+  BaseFloat samp_freq;
+  BaseFloat chunk_length_secs;
+  bool do_endpointing;
+};
+
+// Returns the words on the best path of the decoder as a string.
+std::string GetBestPathWords(const DecodingResources &resources,
+                             const SingleUtteranceNnet2Decoder &decoder,
+                             bool end_of_utterance) {
+  if (decoder.NumFramesDecoded() == 0)
+    return "";
+  Lattice best_path;
+  decoder.GetBestPath(end_of_utterance, &best_path);
+  std::vector<int32> alignment, words;
+  LatticeWeight weight;
+  GetLinearSymbolSequence(best_path, &alignment, &words, &weight);
+  std::string ans;
+  for (size_t i = 0; i < words.size(); i++) {
+    std::string s = resources.word_syms.Find(words[i]);
+    if (s == "")
+      KALDI_ERR << "Word-id " << words[i] << " not in symbol table.";
+    if (i != 0) ans += ' ';
+    ans += s;
+  }
+  return ans;
+}
+
+// This class decodes the audio from one client connection, as a sequence of
+// utterances separated by endpoints, carrying the iVector adaptation state
+// from one utterance to the next.  It is run by a TaskScheduler, whose fixed
+// pool of threads limits the number of connections decoded at once.
+class DecodeConnectionClass {
+ public:
+  DecodeConnectionClass(const DecodingResources &resources,
+                        int32 client_desc, const std::string &client):
+      resources_(resources), client_desc_(client_desc), client_(client),
+      num_utts_(0), num_frames_(0), error_(false) { }
+
+  void operator () () {
+    try {
+      Decode();
+    } catch (const std::exception &e) {
+      KALDI_WARN << "Error decoding connection from " << client_ << ": "
+                 << e.what();
+      error_ = true;
+    }
+  }
+
+  ~DecodeConnectionClass() {
+    close(client_desc_);
+    KALDI_LOG << "Closed connection from " << client_ << ": decoded "
+              << num_utts_ << " utterances, " << num_frames_ << " frames"
+              << (error_ ? " (with error)." : ".");
+  }
+
+ private:
+  void Decode() {
+    const DecodingResources &r = resources_;
+    int32 chunk_length = std::max<int32>(1, r.samp_freq * r.chunk_length_secs);
+    OnlineIvectorExtractorAdaptationState adaptation_state(
+        r.feature_info.ivector_extractor_info);
+    bool input_finished = false;
+    while (!input_finished) {
+      OnlineNnet2FeaturePipeline feature_pipeline(r.feature_info);
+      feature_pipeline.SetAdaptationState(adaptation_state);
+      OnlineSilenceWeighting silence_weighting(
+          r.trans_model, r.feature_info.silence_weighting_config);
+      SingleUtteranceNnet2Decoder decoder(r.decoding_config, r.trans_model,
+                                          r.nnet, r.decode_fst,
+                                          &feature_pipeline);
+      std::vector<std::pair<int32, BaseFloat> > delta_weights;
+      std::string partial;
+      while (true) {
+        Vector<BaseFloat> wave_part;
+        input_finished = !ReadSamples(client_desc_, chunk_length, &wave_part);
+        if (wave_part.Dim() != 0)
+          feature_pipeline.AcceptWaveform(r.samp_freq, wave_part);
+        if (input_finished)
+          feature_pipeline.InputFinished();  // flush out the last frames.
+        if (silence_weighting.Active()) {
+          silence_weighting.ComputeCurrentTraceback(decoder.Decoder());
+          silence_weighting.GetDeltaWeights(feature_pipeline.NumFramesReady(),
+                                            &delta_weights);
+          feature_pipeline.UpdateFrameWeights(delta_weights);
+        }
+        decoder.AdvanceDecoding();
+        if (input_finished ||
+            (r.do_endpointing && decoder.EndpointDetected(r.endpoint_config)))
+          break;
+        std::string words = GetBestPathWords(r, decoder, false);
+        if (words != partial) {
+          partial = words;
+          if (!WriteLine(client_desc_, "PARTIAL: " + partial))
+            KALDI_ERR << "Error writing to client.";
+        }
+      }
+      if (decoder.NumFramesDecoded() == 0)
+        continue;  // no audio since the last endpoint.
+      decoder.FinalizeDecoding();
+      std::string words = GetBestPathWords(r, decoder, true);
+      // If the client has closed its end of the connection (after sending the
+      // audio), we can still send the final result.
+      if (!WriteLine(client_desc_, "RESULT: " + words) && !input_finished)
+        KALDI_ERR << "Error writing to client.";
+      num_utts_++;
+      num_frames_ += decoder.NumFramesDecoded();
+      // In an application you might avoid updating the adaptation state if
+      // you felt the utterance had low confidence.  See lat/confidence.h
+      feature_pipeline.GetAdaptationState(&adaptation_state);
+    }
+  }
+
+  const DecodingResources &resources_;
+  int32 client_desc_;
+  std::string client_;
+  int32 num_utts_;
+  int64 num_frames_;
+  bool error_;
+};
+
+// Accepts clients and decodes up to "max_connections" of them at once, each in
+// its own thread.  Never returns; the server is stopped by killing it.
+void ServeConnections(const DecodingResources &resources, TcpServer *server,
+                      int32 max_connections) {
+  TaskSchedulerConfig scheduler_config;
+  scheduler_config.num_threads = max_connections;
+  scheduler_config.reorder_buffer = 0;  // no need to keep the order.
+  TaskScheduler<DecodeConnectionClass> scheduler(scheduler_config);
+
+  while (true) {
+    std::string client;
+    int32 client_desc = server->Accept(&client);
+    if (client_desc == -1) continue;
+    KALDI_LOG << "Accepted connection from " << client;
+    // This blocks while all of the decoding threads are busy.
+    scheduler.Run(new DecodeConnectionClass(resources, client_desc, client));
+  }
+}
+
+// Set by the SIGINT/SIGTERM handler of the parent process when there are
+// worker processes.
+static volatile sig_atomic_t g_stop_workers = 0;
+
+static void StopWorkers(int signum) { g_stop_workers = 1; }
+
+// Forks a worker process that serves clients on the same listening socket, and
+// returns its process id.  The models were loaded before forking, so all the
+// workers share the parent's copy of them (nothing writes to them, so the
+// pages are never copied).
+pid_t StartWorker(const DecodingResources &resources, TcpServer *server,
+                  int32 max_connections) {
+  pid_t pid = fork();
+  if (pid == -1)
+    KALDI_ERR << "Error forking worker process: " << strerror(errno);
+  if (pid == 0) {
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    try {
+      ServeConnections(resources, server, max_connections);
+    } catch(const std::exception& e) {
+      std::cerr << e.what();
+    }
+    _exit(1);
+  }
+  return pid;
+}
+
+// Runs "num_workers" worker processes, restarting any that exit (which is
+// fast, as the models don't have to be loaded again), until this process gets
+// SIGINT or SIGTERM; then it stops the workers.
+void RunWorkers(const DecodingResources &resources, TcpServer *server,
+                int32 max_connections, int32 num_workers) {
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = StopWorkers;
+  sigemptyset(&action.sa_mask);
+  // No SA_RESTART, so that waitpid() returns when we get a signal.
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  std::set<pid_t> workers;
+  for (int32 i = 0; i < num_workers; i++)
+    workers.insert(StartWorker(resources, server, max_connections));
+  KALDI_LOG << "Started " << num_workers << " worker processes.";
+
+  while (!g_stop_workers) {
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid == -1) {
+      if (errno == EINTR) continue;
+      KALDI_ERR << "Error waiting for worker processes: " << strerror(errno);
+    }
+    if (workers.erase(pid) == 0) continue;
+    KALDI_WARN << "Worker process " << pid << " exited with status " << status
+               << "; restarting it.";
+    // Avoid a busy loop if workers keep failing straight away.
+    Sleep(1.0);
+    workers.insert(StartWorker(resources, server, max_connections));
+  }
+  KALDI_LOG << "Stopping worker processes.";
+  for (std::set<pid_t>::iterator iter = workers.begin();
+       iter != workers.end(); ++iter)
+    kill(*iter, SIGTERM);
+  for (std::set<pid_t>::iterator iter = workers.begin();
+       iter != workers.end(); ++iter)
+    waitpid(*iter, NULL, 0);
+}
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace fst;
+
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Streaming speech recognition server using neural nets (nnet2 setup),\n"
+        "with optional iVector-based speaker adaptation.  The model and graph\n"
+        "are loaded once, and up to --max-connections clients are decoded at\n"
+        "once (further clients wait until a connection finishes).  A client\n"
+        "sends raw 16-bit little-endian mono audio at --samp-freq over a TCP\n"
+        "connection; the server sends back lines of text: \"PARTIAL: <words>\"\n"
+        "whenever the partial hypothesis changes, and \"RESULT: <words>\" at\n"
+        "each endpoint (if --do-endpointing=true) and when the client shuts\n"
+        "down its side of the connection.  The adaptation state is carried\n"
+        "over from one utterance to the next within a connection.\n"
+        "With --num-workers > 1, the models are loaded once and then that many\n"
+        "worker processes are forked, which share the memory of the models and\n"
+        "each decode up to --max-connections clients; workers that die are\n"
+        "restarted without reloading anything.  With --mmap-graph=true and a\n"
+        "ConstFst graph written with \"fstconvert --fst_type=const\n"
+        "--fst_align=true\", the graph is memory-mapped, so separately started\n"
+        "servers also share it and start quickly.\n"
+        "Note: some configuration values and inputs are set via config files\n"
+        "whose filenames are passed as options\n"
+        "\n"
+        "Usage: online2-tcp-nnet2-decode-faster [options] <nnet2-in> <fst-in> "
+        "<word-symbol-table>\n"
+        "See also online2-wav-nnet2-latgen-faster\n";
+
+    ParseOptions po(usage);
+
+    OnlineEndpointConfig endpoint_config;
+    // feature_config includes configuration for the iVector adaptation,
+    // as well as the basic features.
+    OnlineNnet2FeaturePipelineConfig feature_config;
+    OnlineNnet2DecodingConfig nnet2_decoding_config;
+
+    BaseFloat samp_freq = 16000.0, chunk_length_secs = 0.1;
+    bool do_endpointing = true;
+    bool mmap_graph = false;
+    int32 port_num = 5050, max_connections = 4, num_workers = 1;
+
+    po.Register("samp-freq", &samp_freq,
+                "Sampling frequency of the audio sent by the clients (must match "
+                "the model)");
+    po.Register("chunk-length", &chunk_length_secs,
+                "Length of the chunks of audio, in seconds, that are read from "
+                "the client and decoded at a time (this is also how often "
+                "partial results are sent).");
+    po.Register("do-endpointing", &do_endpointing,
+                "If true, apply endpoint detection, and send a result and "
+                "start a new utterance at each endpoint.");
+    po.Register("port-num", &port_num, "Port number the server listens on.");
+    po.Register("max-connections", &max_connections,
+                "Maximum number of client connections decoded in parallel "
+                "(this is the number of decoding threads).");
+    po.Register("num-workers", &num_workers,
+                "Number of worker processes (each decodes up to "
+                "--max-connections clients); if >1, they are forked after "
+                "loading the models, and share them.  Not for use with a GPU.");
+    po.Register("mmap-graph", &mmap_graph,
+                "If true, memory-map the decoding graph if possible (see "
+                "usage message).");
+    po.Register("num-threads-startup", &g_num_threads,
+                "Number of threads used when initializing iVector extractor.");
+
+    feature_config.Register(&po);
+    nnet2_decoding_config.Register(&po);
+    endpoint_config.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 3) {
+      po.PrintUsage();
+      return 1;
+    }
+    if (max_connections <= 0 || num_workers <= 0 || samp_freq <= 0.0 ||
+        chunk_length_secs <= 0.0)
+      KALDI_ERR << "Invalid --max-connections, --num-workers, --samp-freq or "
+                << "--chunk-length.";
+
+    std::string nnet2_rxfilename = po.GetArg(1),
+        fst_rxfilename = po.GetArg(2),
+        word_syms_rxfilename = po.GetArg(3);
+
+    OnlineNnet2FeaturePipelineInfo feature_info(feature_config);
+
+    TransitionModel trans_model;
+    nnet2::AmNnet nnet;
+    {
+      bool binary;
+      Input ki(nnet2_rxfilename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      nnet.Read(ki.Stream(), binary);
+    }
+
+    fst::Fst<fst::StdArc> *decode_fst = ReadDecodeGraph(fst_rxfilename,
+                                                        mmap_graph);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (!(word_syms = fst::SymbolTable::ReadText(word_syms_rxfilename)))
+      KALDI_ERR << "Could not read symbol table from file "
+                << word_syms_rxfilename;
+
+    DecodingResources resources(feature_info, nnet2_decoding_config,
+                                endpoint_config, trans_model, nnet,
+                                *decode_fst, *word_syms);
+    resources.samp_freq = samp_freq;
+    resources.chunk_length_secs = chunk_length_secs;
+    resources.do_endpointing = do_endpointing;
+
+    // Writing to a socket whose client has gone away must not kill the server.
+    signal(SIGPIPE, SIG_IGN);
+
+    TcpServer server;
+    server.Listen(port_num, max_connections * num_workers);
+
+    if (num_workers == 1) {
+      ServeConnections(resources, &server, max_connections);  // never returns.
+    } else {
+      RunWorkers(resources, &server, max_connections, num_workers);
+    }
+    delete decode_fst;
+    delete word_syms;
+    return 0;
+  } catch(const std::exception& e) {
+    std::cerr << e.what();
+    return -1;
+  }
+} // main()
@@ -90,7 +90,7 @@ int main(int argc, char *argv[]) {
     
     ParseOptions po(usage);
     
-    std::string word_syms_rxfilename;
+    std::string word_syms_rxfilename, timing_stats_wxfilename;
     
     OnlineEndpointConfig endpoint_config;
     OnlineFeaturePipelineCommandLineConfig feature_cmdline_config;
@@ -102,6 +102,10 @@ int main(int argc, char *argv[]) {
     
     po.Register("chunk-length", &chunk_length_secs,
                 "Length of chunk size in seconds, that we process.");
+    po.Register("timing-stats-wxfilename", &timing_stats_wxfilename,
+                "If supplied, write the timing stats (including the latency "
+                "histograms) to this file, so that the stats of several jobs "
+                "can be combined.");
     po.Register("word-symbol-table", &word_syms_rxfilename,
                 "Symbol table for words [for debug output]");
     po.Register("do-endpointing", &do_endpointing,
@@ -222,7 +226,9 @@ int main(int argc, char *argv[]) {
         num_done++;
       }
     }
-    timing_stats.Print();    
+    timing_stats.Print();
+    if (timing_stats_wxfilename != "")
+      WriteKaldiObject(timing_stats, timing_stats_wxfilename, false);
     KALDI_LOG << "Decoded " << num_done << " utterances, "
               << num_err << " with errors.";
     KALDI_LOG << "Overall likelihood per frame was " << (tot_like / num_frames)
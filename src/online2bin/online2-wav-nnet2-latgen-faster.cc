@@ -22,6 +22,8 @@
 #include "online2/onlinebin-util.h"
 #include "online2/online-timing.h"
 #include "online2/online-endpoint.h"
+#include "online2/online-beam-controller.h"
+#include "online2/online-adaptation-store.h"
 #include "fstext/fstext-lib.h"
 #include "lat/lattice-functions.h"
 #include "thread/kaldi-thread.h"
@@ -94,7 +96,7 @@ int main(int argc, char *argv[]) {
     
     ParseOptions po(usage);
     
-    std::string word_syms_rxfilename;
+    std::string word_syms_rxfilename, timing_stats_wxfilename;
     
     OnlineEndpointConfig endpoint_config;
 
@@ -102,14 +104,21 @@ int main(int argc, char *argv[]) {
     // as well as the basic features.
     OnlineNnet2FeaturePipelineConfig feature_config;  
     OnlineNnet2DecodingConfig nnet2_decoding_config;
+    OnlineBeamControllerConfig beam_controller_config;
+    OnlineAdaptationStoreConfig adaptation_store_config;
 
     BaseFloat chunk_length_secs = 0.05;
+    std::string beam_stats_wspecifier;
     bool do_endpointing = false;
     bool online = true;
     
     po.Register("chunk-length", &chunk_length_secs,
                 "Length of chunk size in seconds, that we process.  Set to <= 0 "
                 "to use all input in one chunk.");
+    po.Register("timing-stats-wxfilename", &timing_stats_wxfilename,
+                "If supplied, write the timing stats (including the latency "
+                "histograms) to this file, so that the stats of several jobs "
+                "can be combined.");
     po.Register("word-symbol-table", &word_syms_rxfilename,
                 "Symbol table for words [for debug output]");
     po.Register("do-endpointing", &do_endpointing,
@@ -125,10 +134,16 @@ int main(int argc, char *argv[]) {
                 "--chunk-length=-1.");
     po.Register("num-threads-startup", &g_num_threads,
                 "Number of threads used when initializing iVector extractor.");
+    po.Register("beam-stats-wspecifier", &beam_stats_wspecifier,
+                "If supplied (with --rtf-target > 0), write for each utterance "
+                "a matrix with one row per frame giving the beam, max-active "
+                "and number of active tokens.");
     
     feature_config.Register(&po);
     nnet2_decoding_config.Register(&po);
     endpoint_config.Register(&po);
+    beam_controller_config.Register(&po);
+    adaptation_store_config.Register(&po);
     
     po.Read(argc, argv);
     
@@ -175,14 +190,26 @@ int main(int argc, char *argv[]) {
     SequentialTokenVectorReader spk2utt_reader(spk2utt_rspecifier);
     RandomAccessTableReader<WaveHolder> wav_reader(wav_rspecifier);
     CompactLatticeWriter clat_writer(clat_wspecifier);
+    BaseFloatMatrixWriter beam_stats_writer(beam_stats_wspecifier);
     
     OnlineTimingStats timing_stats;
+    // If --adaptation-store-dir is set, each speaker's adaptation state is
+    // loaded before its first utterance and stored after its last one, so it
+    // carries over to later runs.
+    if (!feature_info.use_ivectors)
+      adaptation_store_config.store_dir = "";  // nothing to store.
+    OnlineAdaptationStateStore adaptation_store(
+        adaptation_store_config, feature_info.ivector_extractor_info);
+    OnlineBeamController beam_controller(beam_controller_config,
+                                         nnet2_decoding_config.decoder_opts);
     
     for (; !spk2utt_reader.Done(); spk2utt_reader.Next()) {
       std::string spk = spk2utt_reader.Key();
       const std::vector<std::string> &uttlist = spk2utt_reader.Value();
       OnlineIvectorExtractorAdaptationState adaptation_state(
           feature_info.ivector_extractor_info);
+      if (adaptation_store.Load(spk, &adaptation_state))
+        KALDI_VLOG(1) << "Loaded stored adaptation state for speaker " << spk;
       for (size_t i = 0; i < uttlist.size(); i++) {
         std::string utt = uttlist[i];
         if (!wav_reader.HasKey(utt)) {
@@ -208,6 +235,8 @@ int main(int argc, char *argv[]) {
                                             *decode_fst,
                                             &feature_pipeline);
         OnlineTimer decoding_timer(utt);
+        if (beam_controller.Active())
+          decoder.SetBeamController(&beam_controller, &decoding_timer);
         
         BaseFloat samp_freq = wave_data.SampFreq();
         int32 chunk_length;
@@ -238,17 +267,28 @@ int main(int argc, char *argv[]) {
     
           if (silence_weighting.Active()) {
             silence_weighting.ComputeCurrentTraceback(decoder.Decoder());
-            silence_weighting.GetDeltaWeights(feature_pipeline.NumFramesReady(),
-                                              &delta_weights);
+            // With --vad-gating, the decoder's frames are a subset of the
+            // feature pipeline's.
+            const OnlineVadFeature *vad = decoder.VadFeature();
+            silence_weighting.GetDeltaWeights(
+                (vad != NULL ? vad->NumFramesReady() :
+                 feature_pipeline.NumFramesReady()), &delta_weights);
+            for (size_t j = 0; vad != NULL && j < delta_weights.size(); j++)
+              delta_weights[j].first = vad->SourceFrame(delta_weights[j].first);
             feature_pipeline.UpdateFrameWeights(delta_weights);
           }
           
           decoder.AdvanceDecoding();
+          if (decoder.NumFramesDecoded() > 0)
+            decoding_timer.FirstPartialReady();
           
           if (do_endpointing && decoder.EndpointDetected(endpoint_config))
             break;
         }
         decoder.FinalizeDecoding();
+        if (decoder.VadFeature() != NULL)
+          KALDI_VLOG(1) << "Skipped " << decoder.VadFeature()->NumFramesGated()
+                        << " frames of non-speech in utterance " << utt;
 
         CompactLattice clat;
         bool end_of_utterance = true;
@@ -258,6 +298,15 @@ int main(int argc, char *argv[]) {
                                      &num_frames, &tot_like);
         
         decoding_timer.OutputStats(&timing_stats);
+
+        if (beam_controller.Active()) {
+          beam_controller.PrintStats(utt);
+          if (beam_stats_wspecifier != "") {
+            Matrix<BaseFloat> beam_stats;
+            beam_controller.GetStats(&beam_stats);
+            beam_stats_writer.Write(utt, beam_stats);
+          }
+        }
         
         // In an application you might avoid updating the adaptation state if
         // you felt the utterance had low confidence.  See lat/confidence.h
@@ -272,8 +321,11 @@ int main(int argc, char *argv[]) {
         KALDI_LOG << "Decoded utterance " << utt;
         num_done++;
       }
+      adaptation_store.Store(spk, adaptation_state);
     }
     timing_stats.Print(online);
+    if (timing_stats_wxfilename != "")
+      WriteKaldiObject(timing_stats, timing_stats_wxfilename, false);
     
     KALDI_LOG << "Decoded " << num_done << " utterances, "
               << num_err << " with errors.";
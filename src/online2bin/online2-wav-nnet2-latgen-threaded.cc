@@ -95,7 +95,7 @@ int main(int argc, char *argv[]) {
     
     ParseOptions po(usage);
     
-    std::string word_syms_rxfilename;
+    std::string word_syms_rxfilename, timing_stats_wxfilename;
     
     OnlineEndpointConfig endpoint_config;
 
@@ -113,6 +113,10 @@ int main(int argc, char *argv[]) {
                 "Length of chunk size in seconds, that we provide each time to the "
                 "decoder.  The actual chunk sizes it processes for various stages "
                 "of decoding are dynamically determinated, and unrelated to this");
+    po.Register("timing-stats-wxfilename", &timing_stats_wxfilename,
+                "If supplied, write the timing stats (including the latency "
+                "histograms) to this file, so that the stats of several jobs "
+                "can be combined.");
     po.Register("word-symbol-table", &word_syms_rxfilename,
                 "Symbol table for words [for debug output]");
     po.Register("do-endpointing", &do_endpointing,
@@ -235,6 +239,8 @@ int main(int argc, char *argv[]) {
           if (simulate_realtime_decoding) {
             // Note: the next call may actually call sleep().
             decoding_timer.SleepUntil(samp_offset / samp_freq);
+            if (decoder.NumFramesDecoded() > 0)
+              decoding_timer.FirstPartialReady();
           }
           if (samp_offset == data.Dim()) {
             // no more input. flush out last frames
@@ -253,6 +259,10 @@ int main(int argc, char *argv[]) {
                         << "finish after giving it last chunk.";
         }
         decoder.FinalizeDecoding();
+        if (decoder.NumSamplesDropped() > 0)
+          KALDI_WARN << "Decoder fell behind on utterance " << utt << ": "
+                     << (decoder.NumSamplesDropped() / samp_freq)
+                     << " seconds of audio were dropped.";
 
         CompactLattice clat;
         bool end_of_utterance = true;
@@ -288,6 +298,8 @@ int main(int argc, char *argv[]) {
             
     if (simulate_realtime_decoding) {
       timing_stats.Print(online);
+      if (timing_stats_wxfilename != "")
+        WriteKaldiObject(timing_stats, timing_stats_wxfilename, false);
     } else {
       BaseFloat frame_shift = 0.01;
       BaseFloat real_time_factor =
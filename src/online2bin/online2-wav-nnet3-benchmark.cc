@@ -0,0 +1,434 @@
+// online2bin/online2-wav-nnet3-benchmark.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <sys/resource.h>
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "util/common-utils.h"
+#include "cudamatrix/cu-device.h"
+#include "feat/wave-reader.h"
+#include "online2/online-nnet2-feature-pipeline.h"
+#include "nnet3/am-nnet-simple.h"
+#include "nnet3/nnet-simple-computer.h"
+#include "decoder/lattice-faster-decoder.h"
+#include "decoder/decodable-matrix.h"
+#include "fstext/fstext-lib.h"
+#include "fstext/deterministic-fst.h"
+#include "lat/lattice-functions.h"
+#include "lat/determinize-lattice-pruned.h"
+#include "lm/const-arpa-lm.h"
+
+namespace kaldi {
+
+// Returns the peak resident set size of this process so far, in bytes.
+static double PeakRssBytes() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0.0;
+#ifdef __APPLE__
+  return usage.ru_maxrss;  // in bytes on OS X...
+#else
+  return usage.ru_maxrss * 1024.0;  // ... and in kilobytes on Linux.
+#endif
+}
+
+// Returns the most GPU memory held by Kaldi's allocator so far, in bytes, or
+// -1 if we are not using a GPU.
+static double PeakGpuMemoryBytes() {
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled())
+    return CuDevice::Instantiate().MaxMemoryAllocated();
+#endif
+  return -1.0;
+}
+
+static const char *BlasName() {
+#if defined(HAVE_MKL)
+  return "mkl";
+#elif defined(HAVE_OPENBLAS)
+  return "openblas";
+#elif defined(HAVE_ATLAS)
+  return "atlas";
+#elif defined(HAVE_CLAPACK)
+  return "clapack";
+#else
+  return "unknown";
+#endif
+}
+
+// The measurements for one stage of the decoding, for all the utterances.
+struct BenchmarkStage {
+  std::string name;
+  double seconds;
+  // Process-wide high-water marks at the end of the stage.  As the stages are
+  // run one after the other over all the utterances, the increase from one
+  // stage to the next is the memory that stage needed.
+  double peak_rss_bytes;
+  double peak_gpu_memory_bytes;  // -1 if not using a GPU.
+  int64 num_tokens;  // only for the search.
+  BenchmarkStage(const std::string &name, double seconds):
+      name(name), seconds(seconds), peak_rss_bytes(PeakRssBytes()),
+      peak_gpu_memory_bytes(PeakGpuMemoryBytes()), num_tokens(-1) { }
+};
+
+// The data of an utterance as it goes through the stages.
+struct BenchmarkUtterance {
+  std::string key;
+  Matrix<BaseFloat> feats;
+  Matrix<BaseFloat> ivectors;  // online iVectors, if we use iVectors.
+  Matrix<BaseFloat> loglikes;  // scaled by the acoustic scale.
+  Lattice lat;  // the raw lattice.
+  CompactLattice clat;
+};
+
+static void WriteStageJson(const BenchmarkStage &stage, double audio_seconds,
+                           int64 num_frames, std::ostream &os) {
+  os << "    { \"name\": \"" << stage.name << "\", \"seconds\": "
+     << stage.seconds << ", \"rtf\": " << (stage.seconds / audio_seconds)
+     << ", \"frames_per_second\": " << (num_frames / stage.seconds);
+  if (stage.num_tokens >= 0)
+    os << ", \"tokens\": " << stage.num_tokens << ", \"tokens_per_second\": "
+       << (stage.num_tokens / stage.seconds);
+  os << ", \"peak_rss_mb\": " << (stage.peak_rss_bytes / 1048576.0);
+  if (stage.peak_gpu_memory_bytes >= 0.0)
+    os << ", \"peak_gpu_memory_mb\": "
+       << (stage.peak_gpu_memory_bytes / 1048576.0);
+  os << " }";
+}
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace fst;
+
+    typedef kaldi::int32 int32;
+    typedef kaldi::int64 int64;
+
+    const char *usage =
+        "Measures the speed of decoding with neural nets (nnet3 setup), stage by\n"
+        "stage, on a (small) fixed set of wav files, and writes the results as\n"
+        "JSON, so that builds, BLAS libraries and machines can be compared.\n"
+        "Each stage is run for all the utterances before the next one starts:\n"
+        "feature extraction (as in online2-wav-nnet3-latgen-faster, with\n"
+        "iVectors if configured, but with the whole utterance at once), the\n"
+        "nnet computation, the search (including getting the raw lattice), the\n"
+        "lattice determinization and, with --rescore-const-arpa, the LM\n"
+        "rescoring.  For each stage it reports the time, the real-time factor,\n"
+        "frames per second (and tokens per second for the search), and the\n"
+        "peak memory use of the process (and of the GPU, if used) so far.\n"
+        "\n"
+        "Usage: online2-wav-nnet3-benchmark [options] <nnet3-in> <fst-in> "
+        "<wav-rspecifier> [<json-wxfilename>]\n"
+        "e.g.: online2-wav-nnet3-benchmark --config=conf/online.conf \\\n"
+        "   --rescore-old-lm=data/lang/G.fst --rescore-const-arpa=data/lang_big/G.carpa \\\n"
+        "   final.mdl graph/HCLG.fst scp:data/bench/wav.scp bench.json\n"
+        "See also: steps/benchmark_decode.sh, utils/compare_benchmarks.py\n";
+
+    ParseOptions po(usage);
+
+    OnlineNnet2FeaturePipelineConfig feature_config;
+    nnet3::NnetSimpleComputerOptions computer_opts;
+    LatticeFasterDecoderConfig decoder_opts;
+    BaseFloat acoustic_scale = 0.1;
+    std::string use_gpu = "no", old_lm_rxfilename, const_arpa_rxfilename,
+        clat_wspecifier;
+    bool warm_up = true;
+
+    po.Register("acoustic-scale", &acoustic_scale,
+                "Scaling factor for acoustic log-likelihoods");
+    po.Register("use-gpu", &use_gpu,
+                "yes|no|optional|wait, only has effect if compiled with CUDA");
+    po.Register("warm-up", &warm_up, "If true, do the nnet computation for the "
+                "first utterance once before timing it, so that the compilation "
+                "of the computation is not included in the timing.");
+    po.Register("rescore-const-arpa", &const_arpa_rxfilename, "If set, rescore "
+                "the lattices with this language model (in the format of "
+                "arpa-to-const-arpa).");
+    po.Register("rescore-old-lm", &old_lm_rxfilename, "With "
+                "--rescore-const-arpa, the language model (G.fst) that the "
+                "graph was built with, whose costs are removed when rescoring.");
+    po.Register("write-lattices", &clat_wspecifier, "If set, write the "
+                "(rescored) lattices to this wspecifier.");
+
+    feature_config.Register(&po);
+    computer_opts.Register(&po);
+    decoder_opts.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 3 || po.NumArgs() > 4) {
+      po.PrintUsage();
+      return 1;
+    }
+    if (old_lm_rxfilename != "" && const_arpa_rxfilename == "")
+      KALDI_ERR << "--rescore-old-lm only makes sense with --rescore-const-arpa";
+
+    std::string nnet3_rxfilename = po.GetArg(1),
+        fst_rxfilename = po.GetArg(2),
+        wav_rspecifier = po.GetArg(3),
+        json_wxfilename = po.GetOptArg(4);
+    if (json_wxfilename == "") json_wxfilename = "-";
+
+#if HAVE_CUDA == 1
+    CuDevice::Instantiate().SelectGpuId(use_gpu);
+#endif
+
+    std::vector<BenchmarkStage> stages;
+    Timer timer;
+
+    OnlineNnet2FeaturePipelineInfo feature_info(feature_config);
+    TransitionModel trans_model;
+    nnet3::AmNnetSimple am_nnet;
+    {
+      bool binary;
+      Input ki(nnet3_rxfilename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+    }
+    Vector<BaseFloat> log_priors(am_nnet.Priors());
+    log_priors.ApplyLog();
+    fst::Fst<fst::StdArc> *decode_fst = ReadFstKaldi(fst_rxfilename);
+    VectorFst<StdArc> *old_lm_fst = NULL;
+    if (old_lm_rxfilename != "") {
+      old_lm_fst = ReadFstKaldi(old_lm_rxfilename);
+      // The backoff arcs of G.fst have #0 on the input side, so we project on
+      // the output, as steps/lmrescore_const_arpa.sh does.
+      Project(old_lm_fst, PROJECT_OUTPUT);
+      ArcSort(old_lm_fst, ILabelCompare<StdArc>());
+    }
+    ConstArpaLm const_arpa;
+    if (const_arpa_rxfilename != "")
+      ReadConstArpaLm(const_arpa_rxfilename, true, &const_arpa);
+    stages.push_back(BenchmarkStage("load", timer.Elapsed()));
+
+    std::vector<BenchmarkUtterance> utts;
+    double audio_seconds = 0.0;
+    {
+      // We read all the audio first, so that reading it is not timed.
+      std::vector<WaveData> waves;
+      SequentialTableReader<WaveHolder> wav_reader(wav_rspecifier);
+      for (; !wav_reader.Done(); wav_reader.Next()) {
+        utts.resize(utts.size() + 1);
+        utts.back().key = wav_reader.Key();
+        waves.push_back(wav_reader.Value());
+        audio_seconds += waves.back().Duration();
+      }
+      if (utts.empty())
+        KALDI_ERR << "No audio was read from " << wav_rspecifier;
+
+      timer.Reset();
+      for (size_t i = 0; i < utts.size(); i++) {
+        // We take the first channel, as online2-wav-nnet3-latgen-faster does.
+        SubVector<BaseFloat> data(waves[i].Data(), 0);
+        OnlineNnet2FeaturePipeline feature_pipeline(feature_info);
+        feature_pipeline.AcceptWaveform(waves[i].SampFreq(), data);
+        feature_pipeline.InputFinished();
+        OnlineFeatureInterface *input_feature =
+            feature_pipeline.InputFeature();
+        int32 num_frames = input_feature->NumFramesReady();
+        std::vector<int32> frames(num_frames);
+        for (int32 t = 0; t < num_frames; t++)
+          frames[t] = t;
+        utts[i].feats.Resize(num_frames, input_feature->Dim(), kUndefined);
+        input_feature->GetFrames(frames, &(utts[i].feats));
+        OnlineIvectorFeature *ivector_feature =
+            feature_pipeline.IvectorFeature();
+        if (ivector_feature != NULL) {
+          int32 period = feature_info.ivector_extractor_info.ivector_period,
+              num_ivectors = (num_frames + period - 1) / period;
+          utts[i].ivectors.Resize(num_ivectors, ivector_feature->Dim(),
+                                  kUndefined);
+          for (int32 j = 0; j < num_ivectors; j++) {
+            SubVector<BaseFloat> ivector(utts[i].ivectors, j);
+            ivector_feature->GetFrame(j * period, &ivector);
+          }
+        }
+      }
+      stages.push_back(BenchmarkStage("features", timer.Elapsed()));
+    }
+    int64 num_frames = 0;
+    for (size_t i = 0; i < utts.size(); i++)
+      num_frames += utts[i].feats.NumRows();
+
+    {
+      // The computations are compiled once for all the utterances.
+      nnet3::CachingOptimizingCompiler compiler(am_nnet.GetNnet(),
+                                                computer_opts.optimize_config,
+                                                0);
+      int32 ivector_period = feature_info.ivector_extractor_info.ivector_period;
+      if (warm_up && utts[0].feats.NumRows() > 0) {
+        nnet3::NnetSimpleComputer computer(
+            computer_opts, am_nnet.GetNnet(), utts[0].feats, NULL,
+            (utts[0].ivectors.NumRows() > 0 ? &(utts[0].ivectors) : NULL),
+            ivector_period);
+        computer.SetSharedCompiler(&compiler);
+        Matrix<BaseFloat> output;
+        computer.GetOutput(&output);
+      }
+      timer.Reset();
+      for (size_t i = 0; i < utts.size(); i++) {
+        if (utts[i].feats.NumRows() == 0) continue;
+        nnet3::NnetSimpleComputer computer(
+            computer_opts, am_nnet.GetNnet(), utts[i].feats, NULL,
+            (utts[i].ivectors.NumRows() > 0 ? &(utts[i].ivectors) : NULL),
+            ivector_period);
+        computer.SetSharedCompiler(&compiler);
+        Matrix<BaseFloat> &loglikes = utts[i].loglikes;
+        computer.GetOutput(&loglikes);
+        // subtract the log-prior (divide by the prior), as
+        // DecodableAmNnetSimple does.
+        if (log_priors.Dim() != 0)
+          loglikes.AddVecToRows(-1.0, log_priors);
+        loglikes.Scale(acoustic_scale);
+      }
+      stages.push_back(BenchmarkStage("nnet", timer.Elapsed()));
+    }
+
+    {
+      LatticeFasterDecoder decoder(*decode_fst, decoder_opts);
+      int64 num_tokens = 0;
+      timer.Reset();
+      for (size_t i = 0; i < utts.size(); i++) {
+        DecodableMatrixScaledMapped decodable(trans_model, utts[i].loglikes,
+                                              1.0);
+        decoder.InitDecoding();
+        // We decode frame by frame to count the active tokens.
+        while (decoder.NumFramesDecoded() < decodable.NumFramesReady()) {
+          decoder.AdvanceDecoding(&decodable, 1);
+          num_tokens += decoder.NumActiveTokens();
+        }
+        decoder.FinalizeDecoding();
+        if (!decoder.GetRawLattice(&(utts[i].lat), true))
+          KALDI_WARN << "Failed to get the lattice for utterance "
+                     << utts[i].key;
+      }
+      stages.push_back(BenchmarkStage("search", timer.Elapsed()));
+      stages.back().num_tokens = num_tokens;
+    }
+
+    timer.Reset();
+    for (size_t i = 0; i < utts.size(); i++) {
+      if (decoder_opts.determinize_lattice) {
+        DeterminizeLatticePhonePrunedWrapper(
+            trans_model, &(utts[i].lat), decoder_opts.lattice_beam,
+            &(utts[i].clat), decoder_opts.det_opts);
+      } else {
+        ConvertLattice(utts[i].lat, &(utts[i].clat));
+      }
+      utts[i].lat.DeleteStates();
+    }
+    stages.push_back(BenchmarkStage("determinization", timer.Elapsed()));
+
+    if (const_arpa_rxfilename != "") {
+      ConstArpaLmHistoryCache cache;
+      timer.Reset();
+      for (size_t i = 0; i < utts.size(); i++) {
+        CompactLattice &clat = utts[i].clat;
+        if (clat.Start() == fst::kNoStateId) continue;
+        ArcSort(&clat, fst::OLabelCompare<CompactLatticeArc>());
+        // This does what lattice-lmrescore --lm-scale=-1 with the old LM and
+        // then lattice-lmrescore-const-arpa do, as in
+        // steps/lmrescore_const_arpa.sh, but in one composition.
+        ConstArpaLmDeterministicFst new_lm_fst(const_arpa, &cache);
+        CompactLattice composed_clat;
+        if (old_lm_fst != NULL) {
+          BackoffDeterministicOnDemandFst<StdArc> old_lm(*old_lm_fst);
+          ScaleDeterministicOnDemandFst<StdArc> old_lm_removed(-1.0, &old_lm);
+          ComposeDeterministicOnDemandFst<StdArc> lm_fst(&old_lm_removed,
+                                                         &new_lm_fst);
+          ComposeCompactLatticeDeterministic(clat, &lm_fst, &composed_clat);
+        } else {
+          ComposeCompactLatticeDeterministic(clat, &new_lm_fst, &composed_clat);
+        }
+        Lattice composed_lat;
+        ConvertLattice(composed_clat, &composed_lat);
+        Invert(&composed_lat);
+        DeterminizeLattice(composed_lat, &clat);
+      }
+      stages.push_back(BenchmarkStage("rescoring", timer.Elapsed()));
+    }
+
+    // The likelihood of the best paths is a check that different builds
+    // decode the same way; this is not timed.
+    double tot_like = 0.0;
+    int32 num_failed = 0;
+    CompactLatticeWriter clat_writer(clat_wspecifier);
+    for (size_t i = 0; i < utts.size(); i++) {
+      const CompactLattice &clat = utts[i].clat;
+      if (clat.Start() == fst::kNoStateId) {
+        KALDI_WARN << "Empty lattice for utterance " << utts[i].key;
+        num_failed++;
+        continue;
+      }
+      CompactLattice best_path;
+      CompactLatticeShortestPath(clat, &best_path);
+      Lattice best_path_lat;
+      ConvertLattice(best_path, &best_path_lat);
+      std::vector<int32> alignment, words;
+      LatticeWeight weight;
+      GetLinearSymbolSequence(best_path_lat, &alignment, &words, &weight);
+      tot_like += -(weight.Value1() + weight.Value2());
+      if (clat_wspecifier != "")
+        clat_writer.Write(utts[i].key, clat);
+    }
+
+    double decode_seconds = 0.0;
+    for (size_t i = 1; i < stages.size(); i++)  // stage 0 is the loading.
+      decode_seconds += stages[i].seconds;
+
+    Output ko(json_wxfilename, false);
+    std::ostream &os = ko.Stream();
+    os << "{\n  \"device\": \""
+       << (PeakGpuMemoryBytes() >= 0.0 ? "gpu" : "cpu")
+       << "\",\n  \"blas\": \"" << BlasName()
+       << "\",\n  \"num_utterances\": " << utts.size()
+       << ",\n  \"num_failed\": " << num_failed
+       << ",\n  \"audio_seconds\": " << audio_seconds
+       << ",\n  \"num_frames\": " << num_frames
+       << ",\n  \"likelihood_per_frame\": "
+       << (tot_like / std::max<int64>(1, num_frames))
+       << ",\n  \"load_seconds\": " << stages[0].seconds
+       << ",\n  \"decode_seconds\": " << decode_seconds
+       << ",\n  \"rtf\": " << (decode_seconds / audio_seconds)
+       << ",\n  \"peak_rss_mb\": " << (PeakRssBytes() / 1048576.0)
+       << ",\n  \"stages\": [";
+    for (size_t i = 1; i < stages.size(); i++) {
+      os << (i == 1 ? "\n" : ",\n");
+      WriteStageJson(stages[i], audio_seconds, num_frames, os);
+      KALDI_LOG << "Stage " << stages[i].name << ": " << stages[i].seconds
+                << " seconds, real-time factor "
+                << (stages[i].seconds / audio_seconds);
+    }
+    os << "\n  ]\n}\n";
+    KALDI_LOG << "Decoded " << utts.size() << " utterances ("
+              << audio_seconds << " seconds of audio) with real-time factor "
+              << (decode_seconds / audio_seconds) << ", " << num_failed
+              << " failed.";
+#if HAVE_CUDA == 1
+    CuDevice::Instantiate().PrintProfile();
+#endif
+    delete decode_fst;
+    delete old_lm_fst;
+    return (num_failed < static_cast<int32>(utts.size()) ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
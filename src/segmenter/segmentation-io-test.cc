@@ -17,6 +17,8 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <set>
+
 #include "segmenter/segmenter.h"
 
 namespace kaldi {
@@ -43,6 +45,33 @@ void UnitTestSegmentationIo() {
   KALDI_ASSERT(os2.str() == os.str());
 }
 
+void UnitTestSegmentationIndex() {
+  // The segments may overlap, and are appended in random order.
+  Segmentation seg;
+  int32 num_segments = rand() % 200;
+  for (int32 i = 0; i < num_segments; i++) {
+    int32 start_frame = rand() % 1000;
+    seg.Emplace(start_frame, start_frame + rand() % 50, rand() % 3);
+  }
+  SegmentationIndex index(seg);
+  KALDI_ASSERT(index.NumSegments() == num_segments);
+  std::vector<const Segment*> overlapping;
+  for (int32 n = 0; n < 100; n++) {
+    int32 start_frame = rand() % 1100 - 50,
+        end_frame = start_frame + rand() % 100;
+    index.GetOverlapping(start_frame, end_frame, &overlapping);
+    std::multiset<const Segment*> found(overlapping.begin(),
+                                        overlapping.end()), expected;
+    for (SegmentList::const_iterator it = seg.Begin(); it != seg.End(); ++it)
+      if (it->start_frame <= end_frame && it->end_frame >= start_frame)
+        expected.insert(&(*it));
+    KALDI_ASSERT(found == expected);
+    for (size_t i = 1; i < overlapping.size(); i++)
+      KALDI_ASSERT(overlapping[i - 1]->start_frame <=
+                   overlapping[i]->start_frame);
+  }
+}
+
 } // namespace segmenter
 } // namespace kaldi
 
@@ -51,6 +80,7 @@ int main() {
   using namespace kaldi::segmenter;
 
   UnitTestSegmentationIo();
+  UnitTestSegmentationIndex();
   return 0;
 }
   
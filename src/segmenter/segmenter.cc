@@ -421,21 +421,22 @@ void Segmentation::CreateSubSegments(
     int32 secondary_label, int32 subsegment_label,
     Segmentation *out_segmentation) const {
   out_segmentation->Clear();
-  SegmentList::const_iterator s_it = secondary_segmentation.Begin();
+  SegmentationIndex secondary_index(secondary_segmentation);
+  std::vector<const Segment*> overlapping;
   for (SegmentList::const_iterator p_it = Begin(); p_it != End(); ++p_it) {
-    if (s_it == secondary_segmentation.End()) --s_it;
-    while (s_it->start_frame > p_it->start_frame) --s_it;
-    while (s_it->end_frame < p_it->start_frame && s_it != secondary_segmentation.End()) ++s_it;
-    for (; s_it->start_frame <= p_it->end_frame && s_it != secondary_segmentation.End(); ++s_it) {
+    secondary_index.GetOverlapping(p_it->start_frame, p_it->end_frame,
+                                   &overlapping);
+    for (size_t i = 0; i < overlapping.size(); i++) {
+      const Segment &s = *(overlapping[i]);
       int32 new_label = -1;
-      if (s_it->Label() != secondary_label) {
-        new_label = s_it->Label();
+      if (s.Label() != secondary_label) {
+        new_label = s.Label();
       } else 
         new_label = subsegment_label;
 
-      out_segmentation->Emplace(std::max(s_it->start_frame, p_it->start_frame),
-          std::min(s_it->end_frame, p_it->end_frame), new_label,
-          s_it->VectorValue(), p_it->StringValue());
+      out_segmentation->Emplace(std::max(s.start_frame, p_it->start_frame),
+          std::min(s.end_frame, p_it->end_frame), new_label,
+          s.VectorValue(), p_it->StringValue());
     }
   }
 }
@@ -785,5 +786,61 @@ void Segmentation::Sort() {
   segments_.sort(SegmentComparator());
 }
 
+// Compares segments by start frame, like SegmentComparator.
+struct SegmentPointerComparator {
+  bool operator() (const Segment *lhs, const Segment *rhs) const {
+    return lhs->start_frame < rhs->start_frame;
+  }
+};
+
+void SegmentationIndex::Init(const Segmentation &seg) {
+  Clear();
+  std::vector<const Segment*> sorted;
+  sorted.reserve(seg.Dim());
+  for (SegmentList::const_iterator it = seg.Begin(); it != seg.End(); ++it)
+    sorted.push_back(&(*it));
+  // A stable sort keeps segments with the same start frame in their order
+  // in the list.
+  std::stable_sort(sorted.begin(), sorted.end(), SegmentPointerComparator());
+  segments_.reserve(sorted.size());
+  start_frames_.reserve(sorted.size());
+  max_end_frames_.reserve(sorted.size());
+  for (size_t i = 0; i < sorted.size(); i++)
+    Append(sorted[i]);
+}
+
+void SegmentationIndex::Clear() {
+  segments_.clear();
+  start_frames_.clear();
+  max_end_frames_.clear();
+}
+
+void SegmentationIndex::Append(const Segment *seg) {
+  if (!segments_.empty() && seg->start_frame < start_frames_.back())
+    KALDI_ERR << "Segments must be appended in order of start frame: "
+              << seg->start_frame << " < " << start_frames_.back();
+  segments_.push_back(seg);
+  start_frames_.push_back(seg->start_frame);
+  max_end_frames_.push_back(max_end_frames_.empty() ? seg->end_frame :
+                            std::max(max_end_frames_.back(), seg->end_frame));
+}
+
+void SegmentationIndex::GetOverlapping(
+    int32 start_frame, int32 end_frame,
+    std::vector<const Segment*> *segments) const {
+  segments->clear();
+  // The segments that start after end_frame can't overlap, and nor can those
+  // before the first position whose maximum end frame reaches start_frame;
+  // max_end_frames_ is sorted, so both positions are binary searches.
+  size_t begin = std::lower_bound(max_end_frames_.begin(),
+                                  max_end_frames_.end(), start_frame) -
+      max_end_frames_.begin(),
+      end = std::upper_bound(start_frames_.begin(), start_frames_.end(),
+                             end_frame) - start_frames_.begin();
+  for (size_t i = begin; i < end; i++)
+    if (segments_[i]->end_frame >= start_frame)
+      segments->push_back(segments_[i]);
+}
+
 }
 }
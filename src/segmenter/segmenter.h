@@ -224,7 +224,8 @@ class Segmentation {
     // the filtered subsegments, all the subsegments are kept, while only 
     // changing the labels of the filtered subsegment to "subsegment_label".
     // Additionally this program adds the secondary segmentation's 
-    // vector_value along with this segmentation's string_value
+    // vector_value along with this segmentation's string_value.
+    // secondary_segmentation is expected to be sorted.
     void CreateSubSegments(const Segmentation &secondary_segmentation,
                            int32 secondary_label, int32 subsegment_label,
                            Segmentation *new_segmentation) const;
@@ -288,6 +289,45 @@ class Segmentation {
     SegmentList::iterator current_;
 };
 
+/// SegmentationIndex answers queries for the segments of a Segmentation that
+/// overlap a range of frames in O(log n) time plus the number of segments
+/// returned, whereas walking the SegmentList is linear in the number of
+/// segments.  It keeps pointers to the segments, sorted by start frame, and
+/// for each position the maximum end frame up to there, so it also works if
+/// the segments overlap each other.  Segments may also be added one at a time
+/// in order of start frame, e.g. while a segmentation is being created.
+/// The Segmentation must not be modified while the index is in use.
+class SegmentationIndex {
+  public:
+    SegmentationIndex() { }
+
+    /// Indexes all the segments of "seg", which need not be sorted.
+    explicit SegmentationIndex(const Segmentation &seg) { Init(seg); }
+
+    void Init(const Segmentation &seg);
+
+    void Clear();
+
+    /// Adds "seg" to the index.  Its start frame must not be less than that of
+    /// the last segment added.  We don't take a copy; the pointer must stay
+    /// valid (segments in a SegmentList don't move).
+    void Append(const Segment *seg);
+
+    /// Outputs to "segments" the segments that overlap the frames
+    /// start_frame ... end_frame (inclusive, as for Segment), in order of
+    /// start frame.
+    void GetOverlapping(int32 start_frame, int32 end_frame,
+                        std::vector<const Segment*> *segments) const;
+
+    inline int32 NumSegments() const { return segments_.size(); }
+
+  private:
+    std::vector<const Segment*> segments_;  // sorted by start_frame.
+    std::vector<int32> start_frames_;  // start_frame of each of segments_.
+    // max_end_frames_[i] is the maximum end_frame of segments_[0 ... i].
+    std::vector<int32> max_end_frames_;
+};
+
 typedef TableWriter<KaldiObjectHolder<Segmentation> > SegmentationWriter;
 typedef SequentialTableReader<KaldiObjectHolder<Segmentation> > SequentialSegmentationReader;
 typedef RandomAccessTableReader<KaldiObjectHolder<Segmentation> > RandomAccessSegmentationReader;
@@ -96,7 +96,11 @@ int main(int argc, char *argv[]) {
 
     std::string line, recording, prev_recording;
     segmenter::Segmentation seg;
-    segmenter::SegmentList::const_iterator seg_it;
+    // For finding the segments that overlap each word.
+    segmenter::SegmentationIndex seg_index;
+    std::vector<const segmenter::Segment*> overlapping;
+    // The confidences for the current recording.
+    std::map<int32, std::pair<BaseFloat, BaseFloat> > *conf_acc = NULL;
     
     std::unordered_map<std::string, std::map<int32, std::pair<BaseFloat, BaseFloat> >*, StringHasher> confidences;
     std::set<std::string> reco_list;
@@ -155,13 +159,13 @@ int main(int argc, char *argv[]) {
       }
 
       if (prev_recording == "" || prev_recording != reco_id) {
+        // The words of a recording are usually together in the CTM, so we
+        // only read the segmentation and index it when the recording changes.
         if (!seg_reader.HasKey(reco_id)) {
           KALDI_ERR << "Could not find segmentation for recording " << reco_id;
         } 
         seg = seg_reader.Value(reco_id);
-        seg_it = seg.Begin();
-
-        std::map<int32, std::pair<BaseFloat, BaseFloat> > *conf_acc;
+        seg_index.Init(seg);
 
         if (confidences.count(reco_id) > 0) {
           conf_acc = confidences[reco_id];
@@ -171,34 +175,39 @@ int main(int argc, char *argv[]) {
           reco_list.insert(reco_id);
           num_recos++;
         }
+        prev_recording = reco_id;
+      }
 
-        while (seg_it != seg.End() && seg_it->end_frame * frame_shift < start) ++seg_it;
-        while (seg_it != seg.Begin() && seg_it->start_frame * frame_shift > start) --seg_it;
-
-        BaseFloat this_word_occ = 0;
-        std::vector<BaseFloat> occs;
-        while (seg_it != seg.End() && seg_it->start_frame * frame_shift <= end) {
-          double fraction = (std::min(static_cast<double>(seg_it->end_frame * frame_shift), end) - std::max(static_cast<double>(seg_it->start_frame * frame_shift), start) + frame_shift) / (end-start+frame_shift);
-          std::map<int32, std::pair<BaseFloat, BaseFloat> >::iterator it = conf_acc->find(seg_it->Label());
-          if (it == conf_acc->end()) {
-            (*conf_acc)[seg_it->Label()] = std::make_pair(conf * fraction, fraction);
-          } else {
-            (it->second).first += conf * fraction;
-            (it->second).second += fraction;
-          }
-          this_word_occ += fraction;
-          occs.push_back(seg_it->start_frame * frame_shift);
-          occs.push_back(seg_it->end_frame * frame_shift);
-          occs.push_back(fraction);
-          ++seg_it;
-        }
-        if (!kaldi::ApproxEqual(this_word_occ, 1.0)) {
-          KALDI_WARN << "This word from " << start << " - " << end 
-                    << "; computed occupancy is " << this_word_occ << "; (seg_start,seg_end,frac) = " << SubVector<BaseFloat>(&occs[0], occs.size());; 
+      // The frames that may overlap the word; we check the times below.
+      seg_index.GetOverlapping(static_cast<int32>(start / frame_shift) - 1,
+                               static_cast<int32>(end / frame_shift) + 1,
+                               &overlapping);
+      BaseFloat this_word_occ = 0;
+      std::vector<BaseFloat> occs;
+      for (size_t i = 0; i < overlapping.size(); i++) {
+        const segmenter::Segment &segment = *(overlapping[i]);
+        double fraction = (std::min(static_cast<double>(segment.end_frame * frame_shift), end) - std::max(static_cast<double>(segment.start_frame * frame_shift), start) + frame_shift) / (end-start+frame_shift);
+        if (fraction <= 0)
+          continue;
+        std::map<int32, std::pair<BaseFloat, BaseFloat> >::iterator it = conf_acc->find(segment.Label());
+        if (it == conf_acc->end()) {
+          (*conf_acc)[segment.Label()] = std::make_pair(conf * fraction, fraction);
+        } else {
+          (it->second).first += conf * fraction;
+          (it->second).second += fraction;
         }
-      } 
+        this_word_occ += fraction;
+        occs.push_back(segment.start_frame * frame_shift);
+        occs.push_back(segment.end_frame * frame_shift);
+        occs.push_back(fraction);
+      }
+      if (!kaldi::ApproxEqual(this_word_occ, 1.0)) {
+        KALDI_WARN << "This word from " << start << " - " << end 
+                  << "; computed occupancy is " << this_word_occ << "; (seg_start,seg_end,frac) = "
+                  << (occs.empty() ? SubVector<BaseFloat>(&this_word_occ, 0) :
+                      SubVector<BaseFloat>(&occs[0], occs.size()));
+      }
       
-      prev_recording = recording;
       num_success++;
     }
     
@@ -100,7 +100,9 @@ int main(int argc, char *argv[]) {
 
     std::string line, recording, prev_recording;
     segmenter::Segmentation seg;
-    segmenter::SegmentList::const_iterator seg_it;
+    // For finding the segments that overlap each word.
+    segmenter::SegmentationIndex seg_index;
+    std::vector<const segmenter::Segment*> overlapping;
     
     std::unordered_map<std::string, std::map<int32, std::pair<BaseFloat, BaseFloat> >*, StringHasher> confidences;
     std::set<std::string> reco_list;
@@ -162,39 +164,39 @@ int main(int argc, char *argv[]) {
       }
 
       if (prev_recording == "" || prev_recording != reco_id) {
+        // The words of a recording are usually together in the CTM, so we
+        // only read the segmentation and index it when the recording changes.
         if (!seg_reader.HasKey(reco_id)) {
           KALDI_ERR << "Could not find segmentation for recording " << reco_id;
         } 
         seg = seg_reader.Value(reco_id);
-        seg_it = seg.Begin();
+        seg_index.Init(seg);
 
-        std::map<int32, std::pair<BaseFloat, BaseFloat> > *conf_acc;
-
-        if (confidences.count(reco_id) > 0) {
-          conf_acc = confidences[reco_id];
-        } else {
-          conf_acc = new std::map<int32, std::pair<BaseFloat, BaseFloat> >;
-          confidences.insert(std::make_pair(reco_id, conf_acc));
+        if (confidences.count(reco_id) == 0) {
+          confidences.insert(std::make_pair(reco_id,
+              new std::map<int32, std::pair<BaseFloat, BaseFloat> >));
           reco_list.insert(reco_id);
           num_recos++;
         }
+        prev_recording = reco_id;
+      }
 
-        while (seg_it != seg.End() && seg_it->end_frame * frame_shift < start) ++seg_it;
-        while (seg_it != seg.Begin() && seg_it->start_frame * frame_shift > start) --seg_it;
-
-        BaseFloat this_word_occ = 0;
-        while (seg_it != seg.End() && seg_it->start_frame * frame_shift <= end) {
-          double fraction = (std::min(static_cast<double>(seg_it->end_frame * frame_shift), end) - std::max(static_cast<double>(seg_it->start_frame * frame_shift), start) + frame_shift) / (end-start+frame_shift);
+      // The frames that may overlap the word; we check the times below.
+      seg_index.GetOverlapping(static_cast<int32>(start / frame_shift) - 1,
+                               static_cast<int32>(end / frame_shift) + 1,
+                               &overlapping);
+      BaseFloat this_word_occ = 0;
+      for (size_t i = 0; i < overlapping.size(); i++) {
+        const segmenter::Segment &segment = *(overlapping[i]);
+        double fraction = (std::min(static_cast<double>(segment.end_frame * frame_shift), end) - std::max(static_cast<double>(segment.start_frame * frame_shift), start) + frame_shift) / (end-start+frame_shift);
+        if (fraction > 0)
           this_word_occ += fraction;
-          ++seg_it;
-        } 
-
-        if (this_word_occ > keep_word_threshold) {
-          ko.Stream() << line << "\n";
-        }
       } 
+
+      if (this_word_occ > keep_word_threshold) {
+        ko.Stream() << line << "\n";
+      }
       
-      prev_recording = recording;
       num_success++;
     }
 
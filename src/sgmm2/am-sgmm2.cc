@@ -492,14 +492,12 @@ void AmSgmm2::ComponentLogLikes(const Sgmm2PerFrameDerivedVars &per_frame_vars,
     KALDI_ASSERT(static_cast<int32>(w_jmi_.size()) == NumGroups() ||
                  "You need to call ComputeWeights().");
   }
-  for (int32 ki = 0;  ki < num_gselect; ki++) {
-    SubVector<BaseFloat> logp_xi(*loglikes, ki);
-    int32 i = gselect[ki];
-    // for all substates, compute z_{i}^T v_{jm}
-    logp_xi.AddMatVec(1.0, v_[j1], kNoTrans, per_frame_vars.zti.Row(ki), 0.0);
-    logp_xi.AddVec(1.0, n_[j1].Row(i));  // for all substates, add n_{jim}
-    logp_xi.Add(per_frame_vars.nti(ki));  // for all substates, add n_{i}(t)
-  }    
+  // for all selected Gaussians and substates, compute z_{i}^T v_{jm}; this is
+  // one matrix multiplication rather than one matrix-vector product per
+  // Gaussian.
+  loglikes->AddMatMat(1.0, per_frame_vars.zti, kNoTrans, v_[j1], kTrans, 0.0);
+  loglikes->AddRows(1.0, n_[j1], &(gselect[0]));  // add n_{jim}
+  loglikes->AddVecToCols(1.0, per_frame_vars.nti);  // add n_{i}(t)
   if (speaker_dep_weights) { // [SSGMM]
     Vector<BaseFloat> &log_d = spk_vars->log_d_jms[j1];
     if (log_d.Dim() == 0) { // have not yet cached this quantity.
@@ -183,6 +183,7 @@ class Sgmm2PerSpkDerivedVars {
   }    
  protected:
   friend class AmSgmm2;
+  friend class CuAmSgmm2;
   friend class MleAmSgmm2Accs;
   Vector<BaseFloat> v_s;  ///< Speaker adaptation vector v_^{(s)}. Dim is [T]
   Matrix<BaseFloat> o_s;  ///< Per-speaker offsets o_{i}. Dimension is [I][D]
@@ -505,6 +506,7 @@ class AmSgmm2 {
   friend class MleSgmm2SpeakerAccs;
   friend class AmSgmm2Functions;  // misc functions that need access.
   friend class Sgmm2Feature;
+  friend class CuAmSgmm2;
 };
 
 template<typename Real>
@@ -0,0 +1,107 @@
+// sgmm2/cu-am-sgmm2-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gmm/model-test-common.h"
+#include "sgmm2/cu-am-sgmm2.h"
+#include "cudamatrix/cu-device.h"
+
+namespace kaldi {
+
+// Checks CuAmSgmm2 against AmSgmm2::LogLikelihood() (without pruning).
+void UnitTestCuAmSgmm2() {
+  int32 dim = 1 + RandInt(0, 9), num_comp = 2 + RandInt(0, 9),
+      spk_dim = RandInt(0, 2);
+  FullGmm full_gmm;
+  unittest::InitRandFullGmm(dim, num_comp, &full_gmm);
+
+  // Several groups of pdfs (as in SCTM systems).
+  std::vector<int32> pdf2group;
+  int32 num_groups = 1 + RandInt(0, 3);
+  for (int32 j1 = 0; j1 < num_groups; j1++)
+    for (int32 k = RandInt(0, 2); k >= 0; k--)
+      pdf2group.push_back(j1);
+  AmSgmm2 sgmm;
+  sgmm.InitializeFromFullGmm(full_gmm, pdf2group, dim + 1, spk_dim,
+                             (spk_dim > 0), 0.9);
+  sgmm.ComputeNormalizers();
+  Vector<BaseFloat> occs(sgmm.NumPdfs());
+  occs.Set(100.0);
+  Sgmm2SplitSubstatesConfig split_config;
+  split_config.split_substates = 3 * sgmm.NumPdfs();
+  sgmm.SplitSubstates(occs, split_config);
+  sgmm.ComputeNormalizers();
+  sgmm.ComputeWeights();
+
+  Sgmm2PerSpkDerivedVars spk_vars;
+  if (spk_dim > 0) {
+    Vector<BaseFloat> v_s(spk_dim);
+    v_s.SetRandn();
+    spk_vars.SetSpeakerVector(v_s);
+    sgmm.ComputePerSpkDerivedVars(&spk_vars);
+  }
+
+  int32 num_frames = 1 + RandInt(0, 20);
+  Sgmm2GselectConfig gselect_config;
+  gselect_config.full_gmm_nbest = std::min(gselect_config.full_gmm_nbest,
+                                           sgmm.NumGauss());
+  std::vector<Sgmm2PerFrameDerivedVars> per_frame_vars(num_frames);
+  for (int32 t = 0; t < num_frames; t++) {
+    Vector<BaseFloat> feat(dim);
+    feat.SetRandn();
+    std::vector<int32> gselect;
+    sgmm.GaussianSelection(gselect_config, feat, &gselect);
+    if (RandInt(0, 1) == 0 && gselect.size() > 1)
+      gselect.resize(gselect.size() - 1);  // vary the number of Gaussians.
+    sgmm.ComputePerFrameVars(feat, gselect, spk_vars, &(per_frame_vars[t]));
+  }
+
+  CuAmSgmm2 cu_sgmm(sgmm);
+  Matrix<BaseFloat> loglikes;
+  cu_sgmm.LogLikelihoods(per_frame_vars, &spk_vars, &loglikes);
+  KALDI_ASSERT(loglikes.NumRows() == num_frames &&
+               loglikes.NumCols() == sgmm.NumPdfs());
+
+  Sgmm2LikelihoodCache cache(sgmm.NumGroups(), sgmm.NumPdfs());
+  for (int32 t = 0; t < num_frames; t++) {
+    cache.NextFrame();
+    for (int32 j2 = 0; j2 < sgmm.NumPdfs(); j2++) {
+      BaseFloat loglike = sgmm.LogLikelihood(per_frame_vars[t], j2, &cache,
+                                             &spk_vars, 0.0);
+      AssertEqual(loglike, loglikes(t, j2), 1.0e-03);
+    }
+  }
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 loop = 0; loop < 2; loop++) {
+#if HAVE_CUDA == 1
+    if (loop == 0)
+      CuDevice::Instantiate().SelectGpuId("no");
+    else
+      CuDevice::Instantiate().SelectGpuId("yes");
+#endif
+    for (int32 i = 0; i < 10; i++)
+      UnitTestCuAmSgmm2();
+  }
+  std::cout << "Test OK.\n";
+  return 0;
+}
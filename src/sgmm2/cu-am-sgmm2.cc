@@ -0,0 +1,191 @@
+// sgmm2/cu-am-sgmm2.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <vector>
+
+#include "sgmm2/cu-am-sgmm2.h"
+
+namespace kaldi {
+
+CuAmSgmm2::CuAmSgmm2(const AmSgmm2 &am): am_(am), num_substates_(0) {
+  int32 num_groups = am.NumGroups(), num_gauss = am.NumGauss();
+  KALDI_ASSERT(num_groups > 0);
+  if (am.n_.empty())
+    KALDI_ERR << "You must call ComputeNormalizers() before computing "
+              << "likelihoods.";
+  group_offsets_.resize(num_groups + 1);
+  for (int32 j1 = 0; j1 < num_groups; j1++) {
+    group_offsets_[j1] = num_substates_;
+    num_substates_ += am.NumSubstatesForGroup(j1);
+  }
+  group_offsets_[num_groups] = num_substates_;
+
+  Matrix<BaseFloat> v(num_substates_, am.PhoneSpaceDim(), kUndefined),
+      n(num_substates_, num_gauss, kUndefined);
+  for (int32 j1 = 0; j1 < num_groups; j1++) {
+    int32 offset = group_offsets_[j1],
+        num_substates = group_offsets_[j1 + 1] - offset;
+    v.RowRange(offset, num_substates).CopyFromMat(am.v_[j1]);
+    // am.n_[j1] is indexed [i][m].
+    n.RowRange(offset, num_substates).CopyFromMat(am.n_[j1], kTrans);
+  }
+  v_.Swap(&v);
+  n_.Swap(&n);
+}
+
+void CuAmSgmm2::GetSpeakerNormalizers(Sgmm2PerSpkDerivedVars *spk_vars,
+                                      Vector<BaseFloat> *log_d) const {
+  if (spk_vars->v_s.Dim() == 0 || !am_.HasSpeakerDependentWeights()) {
+    log_d->Resize(0);
+    return;
+  }
+  int32 num_groups = am_.NumGroups();
+  KALDI_ASSERT(static_cast<int32>(spk_vars->log_d_jms.size()) == num_groups);
+  KALDI_ASSERT(static_cast<int32>(am_.w_jmi_.size()) == num_groups ||
+               "You need to call ComputeWeights().");
+  log_d->Resize(num_substates_, kUndefined);
+  for (int32 j1 = 0; j1 < num_groups; j1++) {
+    // This caches the quantity in spk_vars the same way as
+    // AmSgmm2::ComponentLogLikes() does.
+    Vector<BaseFloat> &this_log_d = spk_vars->log_d_jms[j1];
+    if (this_log_d.Dim() == 0) {
+      this_log_d.Resize(am_.NumSubstatesForGroup(j1));
+      this_log_d.AddMatVec(1.0, am_.w_jmi_[j1], kNoTrans, spk_vars->b_is, 0.0);
+      this_log_d.ApplyLog();
+    }
+    log_d->Range(group_offsets_[j1], this_log_d.Dim()).CopyFromVec(this_log_d);
+  }
+}
+
+void CuAmSgmm2::SubstateLogLikelihoods(
+    const std::vector<Sgmm2PerFrameDerivedVars> &per_frame_vars,
+    Sgmm2PerSpkDerivedVars *spk_vars,
+    Matrix<BaseFloat> *substate_loglikes) const {
+  int32 num_frames = per_frame_vars.size(), phn_dim = v_.NumCols();
+  substate_loglikes->Resize(num_frames, num_substates_, kUndefined);
+  if (num_frames == 0) return;
+  int32 max_gselect = 0;
+  for (int32 t = 0; t < num_frames; t++) {
+    const Sgmm2PerFrameDerivedVars &vars = per_frame_vars[t];
+    if (vars.gselect.empty() || vars.zti.NumCols() != phn_dim)
+      KALDI_ERR << "Per-frame vars not set up (or wrong dimension).";
+    max_gselect = std::max<int32>(max_gselect, vars.gselect.size());
+  }
+  Vector<BaseFloat> log_d;
+  GetSpeakerNormalizers(spk_vars, &log_d);
+  CuVector<BaseFloat> cu_log_d(log_d);
+
+  // We do blocks of frames so that the likelihoods of the individual
+  // (sub-state, Gaussian) pairs take at most about 64MB.  We pad each frame to
+  // max_gselect Gaussians.
+  int32 frame_cols = num_substates_ * max_gselect,
+      max_block_size = std::max<int32>(1, (1 << 24) / frame_cols),
+      block_size = std::min(num_frames, max_block_size);
+  CuVector<BaseFloat> work(block_size * frame_cols, kUndefined),
+      log_sums(block_size * num_substates_, kUndefined),
+      first_col(block_size * num_substates_, kUndefined);
+  CuMatrix<BaseFloat> block_loglikes(block_size, num_substates_, kUndefined);
+  for (int32 start = 0; start < num_frames; start += block_size) {
+    int32 n = std::min(block_size, num_frames - start),
+        num_cols = n * max_gselect;
+    // Column (t * max_gselect + k) corresponds to the k'th selected Gaussian
+    // on frame t; the padding has a zero z, no normalizer n_{jmi} and a very
+    // negative n_{i}(t), so it doesn't contribute to the sum.
+    Matrix<BaseFloat> z(num_cols, phn_dim);
+    Vector<BaseFloat> nti(num_cols);
+    nti.Set(-1.0e+30);
+    std::vector<MatrixIndexT> gauss(num_cols, -1);
+    for (int32 t = 0; t < n; t++) {
+      const Sgmm2PerFrameDerivedVars &vars = per_frame_vars[start + t];
+      int32 num_gselect = vars.gselect.size(), offset = t * max_gselect;
+      z.RowRange(offset, num_gselect).CopyFromMat(vars.zti);
+      nti.Range(offset, num_gselect).CopyFromVec(vars.nti);
+      std::copy(vars.gselect.begin(), vars.gselect.end(),
+                gauss.begin() + offset);
+    }
+    CuMatrix<BaseFloat> cu_z(z);
+    CuVector<BaseFloat> cu_nti(nti);
+    CuArray<MatrixIndexT> cu_gauss(gauss);
+
+    // The same memory, seen as (sub-state, frame * gaussian) and as
+    // (sub-state * frame, gaussian).
+    CuSubMatrix<BaseFloat> by_substate(work.Data(), num_substates_, num_cols,
+                                       num_cols),
+        by_substate_frame(work.Data(), num_substates_ * n, max_gselect,
+                          max_gselect);
+    // Eq.(37): z_{i}(t)^T v_{jm} + n_{jmi} + n_{i}(t) [ - log d_{jm}^{(s)} ].
+    by_substate.AddMatMat(1.0, v_, kNoTrans, cu_z, kTrans, 0.0);
+    by_substate.AddCols(n_, cu_gauss);
+    by_substate.AddVecToRows(1.0, cu_nti);
+    if (cu_log_d.Dim() != 0)
+      by_substate.AddVecToCols(-1.0, cu_log_d);
+
+    // log-sum-exp(x) = x_0 - log-softmax(x)_0; there is always at least one
+    // selected Gaussian, so x_0 is never padding.
+    CuSubVector<BaseFloat> this_log_sums(log_sums, 0, num_substates_ * n),
+        this_first_col(first_col, 0, num_substates_ * n);
+    this_log_sums.CopyColFromMat(by_substate_frame, 0);
+    by_substate_frame.ApplyLogSoftMaxPerRow(by_substate_frame);
+    this_first_col.CopyColFromMat(by_substate_frame, 0);
+    this_log_sums.AddVec(-1.0, this_first_col);
+
+    CuSubMatrix<BaseFloat> sums_by_substate(this_log_sums.Data(),
+                                            num_substates_, n, n),
+        this_loglikes(block_loglikes, 0, n, 0, num_substates_);
+    this_loglikes.CopyFromMat(sums_by_substate, kTrans);
+    BaseFloat sum = this_loglikes.Sum();
+    if (KALDI_ISNAN(sum) || KALDI_ISINF(sum))
+      KALDI_ERR << "Invalid answer (overflow or invalid parameters?)";
+    SubMatrix<BaseFloat> out(*substate_loglikes, start, n, 0, num_substates_);
+    this_loglikes.CopyToMat(&out);
+  }
+}
+
+void CuAmSgmm2::LogLikelihoods(
+    const std::vector<Sgmm2PerFrameDerivedVars> &per_frame_vars,
+    Sgmm2PerSpkDerivedVars *spk_vars,
+    Matrix<BaseFloat> *loglikes) const {
+  Matrix<BaseFloat> substate_loglikes;
+  SubstateLogLikelihoods(per_frame_vars, spk_vars, &substate_loglikes);
+  int32 num_frames = substate_loglikes.NumRows(),
+      num_groups = am_.NumGroups();
+  loglikes->Resize(num_frames, am_.NumPdfs(), kUndefined);
+  Vector<BaseFloat> likes;
+  for (int32 t = 0; t < num_frames; t++) {
+    for (int32 j1 = 0; j1 < num_groups; j1++) {
+      // As in AmSgmm2::LogLikelihood(): "likes" are the sub-state likelihoods
+      // scaled by exp(-max), and the weights are applied per pdf.
+      int32 offset = group_offsets_[j1],
+          num_substates = group_offsets_[j1 + 1] - offset;
+      likes.Resize(num_substates, kUndefined);
+      likes.CopyFromVec(substate_loglikes.Row(t).Range(offset, num_substates));
+      BaseFloat max = likes.Max();
+      likes.Add(-max);
+      likes.ApplyExp();
+      const std::vector<int32> &pdfs = am_.group2pdf_[j1];
+      for (size_t i = 0; i < pdfs.size(); i++) {
+        int32 j2 = pdfs[i];
+        (*loglikes)(t, j2) = max + Log(VecVec(likes, am_.c_[j2]));
+      }
+    }
+  }
+}
+
+}  // namespace kaldi
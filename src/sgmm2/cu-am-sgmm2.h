@@ -0,0 +1,95 @@
+// sgmm2/cu-am-sgmm2.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_SGMM2_CU_AM_SGMM2_H_
+#define KALDI_SGMM2_CU_AM_SGMM2_H_
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "sgmm2/am-sgmm2.h"
+#include "cudamatrix/cu-matrix.h"
+#include "cudamatrix/cu-vector.h"
+
+namespace kaldi {
+
+/// CuAmSgmm2 holds the sub-state vectors v_{jm} and normalizers n_{jmi} of an
+/// AmSgmm2, for all the groups of pdfs (j1) stacked together as CuMatrix
+/// objects, i.e. on the GPU if one was selected.  It computes the likelihoods
+/// for blocks of frames at a time: for each block, the projections of the
+/// selected Gaussians' z_{i}(t) on all the sub-state vectors are one matrix
+/// multiplication, followed by a log-sum-exp over the selected Gaussians.
+///
+/// Unlike AmSgmm2::LogLikelihood(), this computes the likelihoods of all the
+/// sub-states on every frame, so it's most useful when a large fraction of the
+/// pdfs are active (e.g. with wide decoding beams) or with a GPU.  The answers
+/// are exact, i.e. there is no log-sum-exp pruning.  The parameters are copied
+/// at construction, but the AmSgmm2 is also referenced (for the sub-state
+/// weights), so it must not be changed or destroyed while this object exists.
+class CuAmSgmm2 {
+ public:
+  /// The model must have its normalizers computed (see
+  /// AmSgmm2::ComputeNormalizers()).
+  explicit CuAmSgmm2(const AmSgmm2 &am);
+
+  int32 NumPdfs() const { return am_.NumPdfs(); }
+  /// Returns the total number of sub-states over all groups of pdfs.
+  int32 NumSubstates() const { return num_substates_; }
+
+  /// Computes the log-likelihoods of each sub-state of each group of pdfs, for
+  /// each frame, not including the sub-state weights: element (t, offset +
+  /// m), with offset the number of sub-states in groups before j1, corresponds
+  /// to sub-state m of group j1.  per_frame_vars[t] must have been computed by
+  /// AmSgmm2::ComputePerFrameVars() with the same speaker vars "spk_vars".
+  /// (spk_vars is not const because we cache per-speaker quantities in it).
+  void SubstateLogLikelihoods(
+      const std::vector<Sgmm2PerFrameDerivedVars> &per_frame_vars,
+      Sgmm2PerSpkDerivedVars *spk_vars,
+      Matrix<BaseFloat> *substate_loglikes) const;
+
+  /// Sets "loglikes" to the log-likelihoods of all the pdfs (j2), of dimension
+  /// (num-frames, num-pdfs).  Arguments are as for SubstateLogLikelihoods().
+  void LogLikelihoods(
+      const std::vector<Sgmm2PerFrameDerivedVars> &per_frame_vars,
+      Sgmm2PerSpkDerivedVars *spk_vars,
+      Matrix<BaseFloat> *loglikes) const;
+
+ private:
+  /// Sets log_d to the [SSGMM] normalizers log d_{jm}^{(s)} of all sub-states
+  /// in the same order as in SubstateLogLikelihoods(), or to the empty vector
+  /// if the model or speaker doesn't have speaker-dependent weights.
+  void GetSpeakerNormalizers(Sgmm2PerSpkDerivedVars *spk_vars,
+                             Vector<BaseFloat> *log_d) const;
+
+  const AmSgmm2 &am_;
+  int32 num_substates_;
+  /// group_offsets_[j1] is the index of the first sub-state of group j1 in the
+  /// stacked quantities; dimension is NumGroups() + 1.
+  std::vector<int32> group_offsets_;
+  /// The sub-state vectors v_{jm}, dimension is [total-substates][S].
+  CuMatrix<BaseFloat> v_;
+  /// The normalizers, n_(offset + m, i) = n_{jmi}; dimension is
+  /// [total-substates][I].
+  CuMatrix<BaseFloat> n_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(CuAmSgmm2);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_SGMM2_CU_AM_SGMM2_H_
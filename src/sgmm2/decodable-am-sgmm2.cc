@@ -18,6 +18,7 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <vector>
 using std::vector;
 
@@ -35,6 +36,12 @@ DecodableAmSgmm2::~DecodableAmSgmm2() {
 }
 
 BaseFloat DecodableAmSgmm2::LogLikelihoodForPdf(int32 frame, int32 pdf_id) {
+  if (batch_computer_ != NULL) {
+    if (batch_start_ < 0 || frame < batch_start_ ||
+        frame >= batch_start_ + batch_log_likes_.NumRows())
+      ComputeBatch(frame);
+    return batch_log_likes_(frame - batch_start_, pdf_id);
+  }
   if (frame != cur_frame_) {
     cur_frame_ = frame;
     sgmm_cache_.NextFrame(); // it has a frame-index internally but it doesn't
@@ -50,5 +57,29 @@ BaseFloat DecodableAmSgmm2::LogLikelihoodForPdf(int32 frame, int32 pdf_id) {
                              log_prune_);  
 }
 
+void DecodableAmSgmm2::ComputeBatch(int32 frame) {
+  int32 num_frames = std::min(frame_batch_size_, NumFramesReady() - frame);
+  KALDI_ASSERT(num_frames > 0);
+  batch_frame_vars_.resize(num_frames);
+  for (int32 t = 0; t < num_frames; t++) {
+    SubVector<BaseFloat> data(*feature_matrix_, frame + t);
+    sgmm_.ComputePerFrameVars(data, (*gselect_)[frame + t], *spk_,
+                              &(batch_frame_vars_[t]));
+  }
+  batch_computer_->LogLikelihoods(batch_frame_vars_, spk_, &batch_log_likes_);
+  batch_start_ = frame;
+}
+
+void DecodableAmSgmm2::SetBatchComputer(const CuAmSgmm2 *computer,
+                                        int32 frame_batch_size) {
+  KALDI_ASSERT(frame_batch_size > 0);
+  KALDI_ASSERT(computer == NULL || computer->NumPdfs() == sgmm_.NumPdfs());
+  batch_computer_ = computer;
+  frame_batch_size_ = frame_batch_size;
+  batch_start_ = -1;
+  batch_frame_vars_.clear();
+  batch_log_likes_.Resize(0, 0);
+}
+
 
 }  // namespace kaldi
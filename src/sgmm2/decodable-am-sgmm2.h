@@ -25,6 +25,7 @@
 
 #include "base/kaldi-common.h"
 #include "sgmm2/am-sgmm2.h"
+#include "sgmm2/cu-am-sgmm2.h"
 #include "hmm/transition-model.h"
 #include "itf/decodable-itf.h"
 
@@ -41,7 +42,8 @@ class DecodableAmSgmm2 : public DecodableInterface {
       sgmm_(sgmm), spk_(spk),
       trans_model_(tm), feature_matrix_(&feats),
       gselect_(&gselect), log_prune_(log_prune), cur_frame_(-1),
-      sgmm_cache_(sgmm.NumGroups(), sgmm.NumPdfs()), delete_vars_(false) {
+      sgmm_cache_(sgmm.NumGroups(), sgmm.NumPdfs()), delete_vars_(false),
+      batch_computer_(NULL), frame_batch_size_(1), batch_start_(-1) {
     KALDI_ASSERT(gselect.size() == static_cast<size_t>(feats.NumRows()));
   }
 
@@ -56,10 +58,21 @@ class DecodableAmSgmm2 : public DecodableInterface {
       sgmm_(sgmm), spk_(spk),
       trans_model_(tm), feature_matrix_(feats),
       gselect_(gselect), log_prune_(log_prune), cur_frame_(-1),
-      sgmm_cache_(sgmm.NumGroups(), sgmm.NumPdfs()), delete_vars_(true) {
+      sgmm_cache_(sgmm.NumGroups(), sgmm.NumPdfs()), delete_vars_(true),
+      batch_computer_(NULL), frame_batch_size_(1), batch_start_(-1) {
     KALDI_ASSERT(gselect->size() == static_cast<size_t>(feats->NumRows()));
   }
   
+  /// If "computer" is non-NULL, the likelihoods of all the pdfs are computed
+  /// by "computer" (which may use the GPU) for frame_batch_size frames at a
+  /// time, the first time any pdf is needed on a frame, instead of only for the
+  /// pdfs requested.  This is faster when many pdfs are active on each frame.
+  /// The log-sum-exp is not pruned in this case (log_prune is ignored).
+  /// "computer" must have been created from the same model, and must outlive
+  /// this object.
+  void SetBatchComputer(const CuAmSgmm2 *computer,
+                        int32 frame_batch_size = 32);
+
   // Note, frames are numbered from zero, but transition indices are 1-based!
   // This is for compatibility with OpenFST.
   virtual BaseFloat LogLikelihood(int32 frame, int32 tid) {
@@ -91,7 +104,19 @@ class DecodableAmSgmm2 : public DecodableInterface {
 
   bool delete_vars_; // If true, we will delete feature_matrix_, gselect_, and
   // spk_ in the destructor.
-  
+
+  /// Called from LogLikelihoodForPdf() if batch_computer_ != NULL; computes
+  /// batch_log_likes_ for the frames starting from "frame".
+  void ComputeBatch(int32 frame);
+
+  const CuAmSgmm2 *batch_computer_;  ///< See SetBatchComputer().
+  int32 frame_batch_size_;
+  /// The first frame whose log-likelihoods are in row 0 of batch_log_likes_,
+  /// which is indexed [frame - batch_start_][pdf], or -1 if none.
+  int32 batch_start_;
+  std::vector<Sgmm2PerFrameDerivedVars> batch_frame_vars_;
+  Matrix<BaseFloat> batch_log_likes_;
+
  private:
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableAmSgmm2);
 };
@@ -29,6 +29,8 @@ using std::string;
 #include "fstext/fstext-lib.h"
 #include "decoder/decoder-wrappers.h"
 #include "sgmm2/decodable-am-sgmm2.h"
+#include "sgmm2/cu-am-sgmm2.h"
+#include "cudamatrix/cu-device.h"
 #include "base/timer.h"
 
 namespace kaldi {
@@ -37,6 +39,8 @@ namespace kaldi {
 // requires, but are best viewed as inputs.
 bool ProcessUtterance(LatticeFasterDecoder &decoder,
                       const AmSgmm2 &am_sgmm,
+                      const CuAmSgmm2 *cu_am_sgmm,  // if non-NULL, batch.
+                      int32 frame_batch_size,
                       const TransitionModel &trans_model,
                       double log_prune,
                       double acoustic_scale,
@@ -76,6 +80,8 @@ bool ProcessUtterance(LatticeFasterDecoder &decoder,
   
   DecodableAmSgmm2Scaled sgmm_decodable(am_sgmm, trans_model, features, gselect,
                                         log_prune, acoustic_scale, &spk_vars);
+  if (cu_am_sgmm != NULL)
+    sgmm_decodable.SetBatchComputer(cu_am_sgmm, frame_batch_size);
 
   return DecodeUtteranceLatticeFaster(
       decoder, sgmm_decodable, trans_model, word_syms, utt, acoustic_scale,
@@ -101,6 +107,8 @@ int main(int argc, char *argv[]) {
     BaseFloat acoustic_scale = 0.1;
     bool allow_partial = false;
     BaseFloat log_prune = 5.0;
+    int32 frame_batch_size = 1;
+    std::string use_gpu = "no";
     string word_syms_filename, gselect_rspecifier, spkvecs_rspecifier,
         utt2spk_rspecifier;
 
@@ -121,6 +129,15 @@ int main(int argc, char *argv[]) {
                 "rspecifier for speaker vectors");
     po.Register("utt2spk", &utt2spk_rspecifier,
                 "rspecifier for utterance to speaker map");
+    po.Register("frame-batch-size", &frame_batch_size, "If > 1, compute the "
+                "likelihoods of all pdfs for this many frames at a time, the "
+                "first time any pdf is needed on a frame (uses matrix-matrix "
+                "products, and is faster with wide beams; --log-prune is then "
+                "ignored).");
+    po.Register("use-gpu", &use_gpu,
+                "yes|no|optional|wait, only has effect if compiled with CUDA. "
+                "If not \"no\", the batched likelihood computation "
+                "(--frame-batch-size) is done on the GPU.");
     po.Read(argc, argv);
 
     if (po.NumArgs() < 4 || po.NumArgs() > 6) {
@@ -130,6 +147,10 @@ int main(int argc, char *argv[]) {
 
     if (gselect_rspecifier == "")
       KALDI_ERR << "--gselect option is required.";
+    if (frame_batch_size < 1)
+      KALDI_ERR << "Invalid --frame-batch-size " << frame_batch_size;
+    if (use_gpu != "no" && frame_batch_size == 1)
+      KALDI_ERR << "--use-gpu requires --frame-batch-size > 1.";
 
     std::string model_in_filename = po.GetArg(1),
         fst_in_str = po.GetArg(2),
@@ -146,6 +167,11 @@ int main(int argc, char *argv[]) {
       trans_model.Read(ki.Stream(), binary);
       am_sgmm.Read(ki.Stream(), binary);
     }
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().SelectGpuId(use_gpu);
+#endif
+    CuAmSgmm2 *cu_am_sgmm = (frame_batch_size > 1 ? new CuAmSgmm2(am_sgmm) :
+                             NULL);
 
     CompactLatticeWriter compact_lattice_writer;
     LatticeWriter lattice_writer;
@@ -199,7 +225,8 @@ int main(int argc, char *argv[]) {
             continue;
           }
           double like;
-          if (ProcessUtterance(decoder, am_sgmm, trans_model, log_prune, acoustic_scale,
+          if (ProcessUtterance(decoder, am_sgmm, cu_am_sgmm, frame_batch_size,
+                               trans_model, log_prune, acoustic_scale,
                                features, gselect_reader, spkvecs_reader, word_syms,
                                utt, determinize, allow_partial,
                                &alignment_writer, &words_writer, &compact_lattice_writer,
@@ -234,7 +261,8 @@ int main(int argc, char *argv[]) {
         LatticeFasterDecoder decoder(fst_reader.Value(), decoder_opts);
         double like;
 
-        if (ProcessUtterance(decoder, am_sgmm, trans_model, log_prune, acoustic_scale,
+        if (ProcessUtterance(decoder, am_sgmm, cu_am_sgmm, frame_batch_size,
+                             trans_model, log_prune, acoustic_scale,
                              features, gselect_reader, spkvecs_reader, word_syms,
                              utt, determinize, allow_partial,
                              &alignment_writer, &words_writer, &compact_lattice_writer,
@@ -258,6 +286,10 @@ int main(int argc, char *argv[]) {
               << " over " << frame_count << " frames.";
 
     delete word_syms;
+    delete cu_am_sgmm;
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().PrintProfile();
+#endif
     return (num_success != 0 ? 0 : 1);
   } catch(const std::exception &e) {
     std::cerr << e.what();
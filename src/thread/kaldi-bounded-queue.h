@@ -0,0 +1,137 @@
+// thread/kaldi-bounded-queue.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_THREAD_KALDI_BOUNDED_QUEUE_H_
+#define KALDI_THREAD_KALDI_BOUNDED_QUEUE_H_ 1
+
+#include <vector>
+#include "base/kaldi-common.h"
+
+namespace kaldi {
+
+/**
+   BoundedQueue is a fixed-size, lock-free queue that any number of threads
+   may push to and pop from at the same time (the "bounded MPMC queue" of
+   Dmitry Vyukov).  It is a ring buffer in which each cell has a sequence
+   number that says whether it is ready to be written or read on the current
+   pass around the ring, so that pushing or popping is just a compare-and-swap
+   on the corresponding position, with no locks.
+
+   TryPush() and TryPop() never block: they return false if the queue is full
+   or empty.  To wait for something to become available, pair the queue with
+   a LightweightSemaphore (kaldi-semaphore.h) that counts the elements, as
+   TaskSequencer does.  Note: TryPop() may fail transiently if another thread
+   is in the middle of pushing into the next cell, even though a push that
+   was started later has completed, so after waiting on such a semaphore you
+   should retry TryPop() until it succeeds.
+
+   T must be copyable; it is copied in and out of the queue.
+*/
+template<class T>
+class BoundedQueue {
+ public:
+  /// The capacity is rounded up to a power of two, and is at least 2 (with
+  /// one cell, a full queue would look the same as an empty one).
+  explicit BoundedQueue(size_t capacity): enqueue_pos_(0), dequeue_pos_(0) {
+    KALDI_ASSERT(capacity > 0);
+    size_t size = 2;
+    while (size < capacity)
+      size *= 2;
+    cells_.resize(size);
+    mask_ = size - 1;
+    for (size_t i = 0; i < size; i++)
+      cells_[i].sequence = i;
+  }
+
+  size_t Capacity() const { return mask_ + 1; }
+
+  /// Adds a copy of t to the queue; returns false if the queue was full.
+  bool TryPush(const T &t) {
+    Cell *cell;
+    size_t pos = __atomic_load_n(&enqueue_pos_, __ATOMIC_RELAXED);
+    while (true) {
+      cell = &(cells_[pos & mask_]);
+      size_t sequence = __atomic_load_n(&(cell->sequence), __ATOMIC_ACQUIRE);
+      intptr_t diff = static_cast<intptr_t>(sequence) -
+          static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        // The cell is free on this pass; try to claim it.
+        // On failure this sets pos to the current value.
+        if (__atomic_compare_exchange_n(&enqueue_pos_, &pos, pos + 1, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+          break;
+      } else if (diff < 0) {
+        return false;  // The cell hasn't been read on the last pass: full.
+      } else {
+        // Another thread got there first.
+        pos = __atomic_load_n(&enqueue_pos_, __ATOMIC_RELAXED);
+      }
+    }
+    cell->data = t;
+    // Mark it ready to be read.
+    __atomic_store_n(&(cell->sequence), pos + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  /// Removes the element at the front of the queue and puts it in *t;
+  /// returns false if the queue was empty.
+  bool TryPop(T *t) {
+    Cell *cell;
+    size_t pos = __atomic_load_n(&dequeue_pos_, __ATOMIC_RELAXED);
+    while (true) {
+      cell = &(cells_[pos & mask_]);
+      size_t sequence = __atomic_load_n(&(cell->sequence), __ATOMIC_ACQUIRE);
+      intptr_t diff = static_cast<intptr_t>(sequence) -
+          static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (__atomic_compare_exchange_n(&dequeue_pos_, &pos, pos + 1, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+          break;
+      } else if (diff < 0) {
+        return false;  // Nothing has been written to the cell: empty.
+      } else {
+        pos = __atomic_load_n(&dequeue_pos_, __ATOMIC_RELAXED);
+      }
+    }
+    *t = cell->data;
+    // Mark it free for the next pass.
+    __atomic_store_n(&(cell->sequence), pos + mask_ + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+ private:
+  struct Cell {
+    size_t sequence;  // Accessed atomically.
+    T data;
+  };
+  std::vector<Cell> cells_;
+  size_t mask_;
+  // The positions are on separate cache lines, as they are written by
+  // different threads.
+  char pad1_[64];
+  size_t enqueue_pos_;
+  char pad2_[64];
+  size_t dequeue_pos_;
+  char pad3_[64];
+  KALDI_DISALLOW_COPY_AND_ASSIGN(BoundedQueue);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_THREAD_KALDI_BOUNDED_QUEUE_H_
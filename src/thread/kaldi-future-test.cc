@@ -0,0 +1,131 @@
+// thread/kaldi-future-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "thread/kaldi-future.h"
+#include "thread/kaldi-thread.h"
+
+namespace kaldi {
+
+// Returns the sum of 0 ... n-1.
+struct SumFunctor {
+  typedef int64 result_type;
+  int64 n;
+  explicit SumFunctor(int64 n): n(n) { }
+  int64 operator () () const {
+    int64 sum = 0;
+    for (int64 i = 0; i < n; i++)
+      sum += i;
+    return sum;
+  }
+};
+
+// Computes the same sum recursively with Async(), waiting for the futures
+// inside the tasks.
+struct RecursiveSumFunctor {
+  typedef int64 result_type;
+  int64 begin, end;
+  RecursiveSumFunctor(int64 begin, int64 end): begin(begin), end(end) { }
+  int64 operator () () const {
+    if (end - begin <= 10) {
+      int64 sum = 0;
+      for (int64 i = begin; i < end; i++)
+        sum += i;
+      return sum;
+    }
+    int64 middle = (begin + end) / 2;
+    Future<int64> left = Async(RecursiveSumFunctor(begin, middle)),
+        right = Async(RecursiveSumFunctor(middle, end));
+    return left.Get() + right.Get();
+  }
+};
+
+struct ThrowingFunctor {
+  typedef bool result_type;
+  bool operator () () const {
+    KALDI_ERR << "Expected error";
+    return true;
+  }
+};
+
+void TestAsync() {
+  std::vector<Future<int64> > futures;
+  for (int32 i = 0; i < 100; i++)
+    futures.push_back(Async(SumFunctor(i * 10)));
+  for (int32 i = 0; i < 100; i++) {
+    int64 n = i * 10;
+    KALDI_ASSERT(futures[i].Get() == n * (n - 1) / 2);
+    KALDI_ASSERT(futures[i].Ready());
+  }
+  Future<int64> copy = futures[5];
+  futures.clear();
+  KALDI_ASSERT(copy.Get() == 50 * 49 / 2);
+}
+
+void TestRecursiveAsync() {
+  int64 n = 5000;
+  KALDI_ASSERT(Async(RecursiveSumFunctor(0, n)).Get() == n * (n - 1) / 2);
+}
+
+void TestAsyncError() {
+  Future<bool> future = Async(ThrowingFunctor());
+  bool threw = false;
+  try {
+    future.Get();
+  } catch (const std::exception &e) {
+    threw = true;
+  }
+  KALDI_ASSERT(threw);
+}
+
+void TestPromise() {
+  Future<std::string> future;
+  KALDI_ASSERT(!future.Valid());
+  {
+    Promise<std::string> promise;
+    future = promise.GetFuture();
+    KALDI_ASSERT(future.Valid() && !future.Ready());
+    promise.Set("foo");
+  }
+  KALDI_ASSERT(future.Ready() && future.Get() == "foo");
+  {
+    Promise<std::string> promise;
+    future = promise.GetFuture();
+  }  // A Promise that is destroyed without a value sets an error.
+  bool threw = false;
+  try {
+    future.Get();
+  } catch (const std::exception &e) {
+    threw = true;
+  }
+  KALDI_ASSERT(threw);
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  g_num_threads = 4;
+  TestAsync();
+  TestRecursiveAsync();
+  TestAsyncError();
+  TestPromise();
+  std::cout << "Test OK.\n";
+  return 0;
+}
@@ -0,0 +1,234 @@
+// thread/kaldi-future.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_THREAD_KALDI_FUTURE_H_
+#define KALDI_THREAD_KALDI_FUTURE_H_ 1
+
+#include <pthread.h>
+#include <string>
+#include "base/kaldi-common.h"
+#include "thread/kaldi-thread-pool.h"
+
+namespace kaldi {
+
+/**
+   Future<T> and Promise<T> are a way to pass the result of a computation that
+   runs in another thread (or later) to whoever needs it, like std::future
+   and std::promise in C++11.  A Promise is where the value is set, and the
+   Futures obtained from it (with GetFuture()) are where it is read; Get()
+   waits until the value (or an error) has been set.  Futures may be copied,
+   and the copies refer to the same value.
+
+   Async() runs a function object on the ThreadPool (kaldi-thread-pool.h)
+   and returns a Future for its result; exceptions are passed on, so that
+   Get() throws if the function did.  While Wait() or Get() is waiting, it
+   runs other tasks that are queued on the ThreadPool, so it is safe to wait
+   for a Future inside a task that is itself running on the pool.
+
+   For processing a stream of items in several overlapping stages (e.g.
+   decoding, then lattice determinization), see TaskPipeline in
+   kaldi-task-pipeline.h.
+*/
+
+namespace internal {
+
+template<class T>
+struct FutureState {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int32 ref_count;  // The number of Promises and Futures that refer to this.
+  bool ready;
+  T value;
+  std::string error;  // Set if the computation failed.
+
+  FutureState(): ref_count(1), ready(false) {
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond, NULL);
+  }
+  ~FutureState() {
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+  }
+  void Ref() {
+    pthread_mutex_lock(&mutex);
+    ref_count++;
+    pthread_mutex_unlock(&mutex);
+  }
+  // Deletes this when the last reference is gone.
+  void Unref() {
+    pthread_mutex_lock(&mutex);
+    bool last = (--ref_count == 0);
+    pthread_mutex_unlock(&mutex);
+    if (last)
+      delete this;
+  }
+  // Set "value" before calling this if error is empty.
+  void SetReady(const std::string &error_in) {
+    pthread_mutex_lock(&mutex);
+    KALDI_ASSERT(!ready && "Promise value set twice");
+    error = error_in;
+    ready = true;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+  }
+};
+
+}  // namespace internal
+
+template<class T> class Promise;
+
+template<class T>
+class Future {
+ public:
+  /// Creates an invalid Future, which you may assign to.
+  Future(): state_(NULL) { }
+
+  Future(const Future &other): state_(other.state_) {
+    if (state_ != NULL) state_->Ref();
+  }
+
+  Future &operator = (const Future &other) {
+    if (other.state_ != NULL) other.state_->Ref();
+    if (state_ != NULL) state_->Unref();
+    state_ = other.state_;
+    return *this;
+  }
+
+  ~Future() {
+    if (state_ != NULL) state_->Unref();
+  }
+
+  /// Returns true if this refers to a Promise.
+  bool Valid() const { return state_ != NULL; }
+
+  /// Returns true if the value (or an error) has been set.
+  bool Ready() const {
+    KALDI_ASSERT(Valid());
+    pthread_mutex_lock(&(state_->mutex));
+    bool ready = state_->ready;
+    pthread_mutex_unlock(&(state_->mutex));
+    return ready;
+  }
+
+  /// Waits until the value (or an error) has been set, running tasks queued
+  /// on the ThreadPool in the meantime.
+  void Wait() const {
+    KALDI_ASSERT(Valid());
+    ThreadPool *pool = ThreadPool::Instance();
+    while (!Ready()) {
+      if (pool->RunOneTask())
+        continue;
+      // There is nothing to help with, so the value is being computed
+      // elsewhere.
+      pthread_mutex_lock(&(state_->mutex));
+      while (!state_->ready)
+        pthread_cond_wait(&(state_->cond), &(state_->mutex));
+      pthread_mutex_unlock(&(state_->mutex));
+    }
+  }
+
+  /// Waits for the value and returns it; throws (via KALDI_ERR) if an error
+  /// was set instead.
+  const T &Get() const {
+    Wait();
+    if (!state_->error.empty())
+      KALDI_ERR << state_->error;
+    return state_->value;
+  }
+
+ private:
+  friend class Promise<T>;
+  explicit Future(internal::FutureState<T> *state): state_(state) {
+    state_->Ref();
+  }
+  internal::FutureState<T> *state_;
+};
+
+template<class T>
+class Promise {
+ public:
+  Promise(): state_(new internal::FutureState<T>()), set_(false) { }
+
+  /// Returns a Future for the value.  You may call this more than once.
+  Future<T> GetFuture() { return Future<T>(state_); }
+
+  /// Sets the value, and wakes up anyone waiting for it.  You may only call
+  /// one of Set() and SetError(), once.
+  void Set(const T &value) {
+    KALDI_ASSERT(!set_);
+    state_->value = value;
+    state_->SetReady("");
+    set_ = true;
+  }
+
+  /// Sets an error, which Future::Get() will throw.
+  void SetError(const std::string &error) {
+    KALDI_ASSERT(!set_);
+    state_->SetReady(error.empty() ? "Unknown error" : error);
+    set_ = true;
+  }
+
+  /// If neither Set() nor SetError() was called, sets an error, so that
+  /// nobody waits forever.
+  ~Promise() {
+    if (!set_)
+      state_->SetReady("Promise destroyed without setting a value");
+    state_->Unref();
+  }
+
+ private:
+  internal::FutureState<T> *state_;
+  bool set_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(Promise);
+};
+
+
+template<class F>
+class AsyncTask: public ThreadPoolTask {
+ public:
+  typedef typename F::result_type T;
+  explicit AsyncTask(const F &f): f_(f) { }
+  Future<T> GetFuture() { return promise_.GetFuture(); }
+  virtual void Run() {
+    try {
+      promise_.Set(f_());
+    } catch (const std::exception &e) {
+      promise_.SetError(e.what());
+    }
+  }
+ private:
+  F f_;
+  Promise<T> promise_;
+};
+
+/// Runs a copy of f on the ThreadPool, and returns a Future for the result.
+/// F must be copyable, have a typedef "result_type", and have an
+/// operator () () const, or non-const, that returns result_type (which must
+/// not be void; use e.g. bool if there is no result).
+template<class F>
+Future<typename F::result_type> Async(const F &f) {
+  AsyncTask<F> *task = new AsyncTask<F>(f);
+  Future<typename F::result_type> ans = task->GetFuture();
+  ThreadPool::Instance()->Submit(task);  // takes ownership of "task".
+  return ans;
+}
+
+}  // namespace kaldi
+
+#endif  // KALDI_THREAD_KALDI_FUTURE_H_
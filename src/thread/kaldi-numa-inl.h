@@ -0,0 +1,70 @@
+// thread/kaldi-numa-inl.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_THREAD_KALDI_NUMA_INL_H_
+#define KALDI_THREAD_KALDI_NUMA_INL_H_ 1
+
+#include "thread/kaldi-thread-pool.h"
+
+namespace kaldi {
+
+template<class T>
+void *NumaReplicated<T>::MakeCopy(void *arg) {
+  CopyInfo *info = static_cast<CopyInfo*>(arg);
+  // The thread belongs to the ThreadPool's cache, which re-pins it for its
+  // next job.
+  NumaPinThread(info->node);
+  info->replica = (info->copy != NULL ? (*(info->copy))(*(info->original)) :
+                   new T(*(info->original)));
+  return NULL;
+}
+
+template<class T>
+NumaReplicated<T>::NumaReplicated(const T &original, T *(*copy)(const T&)):
+    original_(&original) {
+  int32 num_nodes = NumaNumNodes();
+  if (GetNumaPolicy() != kNumaReplicate || num_nodes <= 1)
+    return;
+  std::vector<CopyInfo> info(num_nodes);
+  {
+    ThreadGroup threads;
+    for (int32 n = 1; n < num_nodes; n++) {
+      info[n].original = &original;
+      info[n].copy = copy;
+      info[n].node = n;
+      info[n].replica = NULL;
+      threads.Start(MakeCopy, &(info[n]));
+    }
+  }  // waits for the copies.
+  replicas_.resize(num_nodes, NULL);
+  for (int32 n = 1; n < num_nodes; n++)
+    replicas_[n] = info[n].replica;
+  KALDI_VLOG(1) << "Made copies of object on " << (num_nodes - 1)
+                << " other NUMA nodes.";
+}
+
+template<class T>
+NumaReplicated<T>::~NumaReplicated() {
+  for (size_t n = 0; n < replicas_.size(); n++)
+    delete replicas_[n];
+}
+
+}  // namespace kaldi
+
+#endif  // KALDI_THREAD_KALDI_NUMA_INL_H_
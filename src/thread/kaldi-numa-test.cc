@@ -0,0 +1,129 @@
+// thread/kaldi-numa-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "thread/kaldi-numa.h"
+#include "thread/kaldi-thread.h"
+#include "thread/kaldi-task-scheduler.h"
+
+namespace kaldi {
+
+struct CopiedVector {
+  std::vector<int32> v;
+};
+
+CopiedVector *CopyCopiedVector(const CopiedVector &other) {
+  return new CopiedVector(other);
+}
+
+// Records the NUMA node it ran on.
+class NodeTask {
+ public:
+  NodeTask(int32 *node): node_(node) { }
+  void operator() () { *node_ = NumaThreadNode(); }
+ private:
+  int32 *node_;
+};
+
+void TestNumaPolicy() {
+  SetNumaPolicy("none");
+  KALDI_ASSERT(GetNumaPolicy() == kNumaNone);
+  KALDI_ASSERT(NumaNumNodes() >= 1);
+  KALDI_ASSERT(NumaNodeForThread(0) == -1 && NumaNodeForThread(5) == -1);
+
+  SetNumaPolicy("pin");
+  KALDI_ASSERT(GetNumaPolicy() == kNumaPin);
+  for (int32 i = 0; i < 10; i++) {
+    int32 node = NumaNodeForThread(i);
+    if (NumaNumNodes() == 1)
+      KALDI_ASSERT(node == -1);
+    else
+      KALDI_ASSERT(node == i % NumaNumNodes());
+  }
+  bool threw = false;
+  try {
+    SetNumaPolicy("interleave");
+  } catch (...) {
+    threw = true;
+  }
+  KALDI_ASSERT(threw);
+  SetNumaPolicy("none");
+}
+
+void TestNumaPinThread() {
+  for (int32 node = 0; node < NumaNumNodes(); node++) {
+    KALDI_ASSERT(NumaPinThread(node));
+    if (NumaNumNodes() > 1)
+      KALDI_ASSERT(NumaThreadNode() == node);
+  }
+  KALDI_ASSERT(NumaPinThread(-1));
+  KALDI_ASSERT(NumaThreadNode() == -1);
+}
+
+void TestNumaReplicated() {
+  SetNumaPolicy("replicate");
+  CopiedVector original;
+  for (int32 i = 0; i < 100; i++)
+    original.v.push_back(i);
+  {
+    NumaReplicated<CopiedVector> r(original, &CopyCopiedVector);
+    KALDI_ASSERT(&(r.Get(-1)) == &original && &(r.Get(0)) == &original);
+    for (int32 node = 0; node < NumaNumNodes(); node++)
+      KALDI_ASSERT(r.Get(node).v == original.v);
+    KALDI_ASSERT(r.Get().v == original.v);
+  }
+  {
+    NumaReplicated<CopiedVector> r(original);  // uses the copy constructor.
+    KALDI_ASSERT(r.Get(NumaNumNodes() - 1).v == original.v);
+  }
+  SetNumaPolicy("none");
+}
+
+void TestNumaTaskScheduler() {
+  SetNumaPolicy("pin");
+  TaskSchedulerConfig opts;
+  opts.num_threads = 3;
+  int32 num_tasks = 20;
+  std::vector<int32> nodes(num_tasks, -2);
+  {
+    TaskScheduler<NodeTask> scheduler(opts);
+    for (int32 i = 0; i < num_tasks; i++)
+      scheduler.Run(new NodeTask(&(nodes[i])), 0.0, i % NumaNumNodes());
+  }
+  // We can't check which node each task ran on, as workers take other nodes'
+  // tasks when they have none of their own, but it must be a valid one.
+  for (int32 i = 0; i < num_tasks; i++) {
+    if (NumaNumNodes() == 1)
+      KALDI_ASSERT(nodes[i] == -1);
+    else
+      KALDI_ASSERT(nodes[i] >= 0 && nodes[i] < NumaNumNodes());
+  }
+  SetNumaPolicy("none");
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  TestNumaPolicy();
+  TestNumaPinThread();
+  TestNumaReplicated();
+  TestNumaTaskScheduler();
+  KALDI_LOG << "Tests succeeded.";
+  return 0;
+}
@@ -0,0 +1,175 @@
+// thread/kaldi-numa.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <pthread.h>
+#include <sched.h>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include "thread/kaldi-numa.h"
+
+namespace kaldi {
+
+namespace {
+
+NumaPolicy g_numa_policy = kNumaNone;
+
+// The CPUs of each node that has any, and the CPUs the process may use.
+std::vector<std::vector<int32> > g_node_cpus;
+#ifdef __linux__
+cpu_set_t g_process_cpus;
+#endif
+pthread_once_t g_topology_once = PTHREAD_ONCE_INIT;
+
+// The key for the node the calling thread is pinned to, plus one (so that
+// the default of NULL means "not pinned").
+pthread_key_t g_node_key;
+
+// Parses a list of CPUs in the format of /sys, e.g. "0-3,8,10-11".
+bool ParseCpuList(const std::string &str, std::vector<int32> *cpus) {
+  cpus->clear();
+  std::istringstream is(str);
+  std::string range;
+  while (std::getline(is, range, ',')) {
+    if (range.empty() || range == "\n")
+      continue;
+    int32 begin, end;
+    char dash;
+    std::istringstream rs(range);
+    if (!(rs >> begin))
+      return false;
+    if (rs >> dash) {
+      if (dash != '-' || !(rs >> end) || end < begin)
+        return false;
+    } else {
+      end = begin;
+    }
+    for (int32 cpu = begin; cpu <= end; cpu++)
+      cpus->push_back(cpu);
+  }
+  return true;
+}
+
+void ReadTopology() {
+  if (pthread_key_create(&g_node_key, NULL) != 0)
+    KALDI_ERR << "pthread_key_create failed";
+#ifdef __linux__
+  if (sched_getaffinity(0, sizeof(g_process_cpus), &g_process_cpus) != 0)
+    return;
+  // We stop at the first missing node; nodes are numbered contiguously on all
+  // but very unusual machines.
+  for (int32 node = 0; ; node++) {
+    std::ostringstream filename;
+    filename << "/sys/devices/system/node/node" << node << "/cpulist";
+    std::ifstream is(filename.str().c_str());
+    if (!is.good())
+      break;
+    std::string line;
+    std::getline(is, line);
+    std::vector<int32> cpus, usable_cpus;
+    if (!ParseCpuList(line, &cpus)) {
+      KALDI_WARN << "Could not parse " << filename.str() << ": " << line
+                 << "; disabling NUMA support.";
+      g_node_cpus.clear();
+      return;
+    }
+    // Only use CPUs the process was allowed (e.g. by taskset).
+    for (size_t i = 0; i < cpus.size(); i++)
+      if (cpus[i] < CPU_SETSIZE && CPU_ISSET(cpus[i], &g_process_cpus))
+        usable_cpus.push_back(cpus[i]);
+    if (!usable_cpus.empty())
+      g_node_cpus.push_back(usable_cpus);
+  }
+#endif
+}
+
+}  // namespace
+
+void SetNumaPolicy(const std::string &policy) {
+  if (policy == "none") {
+    g_numa_policy = kNumaNone;
+  } else if (policy == "pin") {
+    g_numa_policy = kNumaPin;
+  } else if (policy == "replicate") {
+    g_numa_policy = kNumaReplicate;
+  } else {
+    KALDI_ERR << "Invalid NUMA policy '" << policy
+              << "': expected none, pin or replicate.";
+  }
+  if (g_numa_policy != kNumaNone) {
+    int32 num_nodes = NumaNumNodes();
+    if (num_nodes <= 1)
+      KALDI_LOG << "Only one NUMA node, so --numa-policy=" << policy
+                << " has no effect.";
+    else
+      KALDI_LOG << "Using NUMA policy '" << policy << "' with " << num_nodes
+                << " nodes.";
+  }
+}
+
+NumaPolicy GetNumaPolicy() { return g_numa_policy; }
+
+int32 NumaNumNodes() {
+  pthread_once(&g_topology_once, ReadTopology);
+  return std::max<int32>(1, g_node_cpus.size());
+}
+
+int32 NumaNodeForThread(int32 index) {
+  int32 num_nodes = NumaNumNodes();
+  if (g_numa_policy == kNumaNone || num_nodes <= 1)
+    return -1;
+  return index % num_nodes;
+}
+
+bool NumaPinThread(int32 node) {
+  int32 num_nodes = NumaNumNodes();
+  KALDI_ASSERT(node >= -1 && node < num_nodes);
+  if (node == NumaThreadNode() || g_node_cpus.size() <= 1)
+    return true;
+#ifdef __linux__
+  cpu_set_t cpus;
+  if (node == -1) {
+    cpus = g_process_cpus;
+  } else {
+    CPU_ZERO(&cpus);
+    const std::vector<int32> &node_cpus = g_node_cpus[node];
+    for (size_t i = 0; i < node_cpus.size(); i++)
+      CPU_SET(node_cpus[i], &cpus);
+  }
+  int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+  if (ret != 0) {
+    KALDI_WARN << "Could not pin thread to NUMA node " << node
+               << ", error code " << ret;
+    return false;
+  }
+#endif
+  if (pthread_setspecific(g_node_key, reinterpret_cast<void*>(
+          static_cast<intptr_t>(node + 1))) != 0)
+    KALDI_ERR << "pthread_setspecific failed";
+  return true;
+}
+
+int32 NumaThreadNode() {
+  pthread_once(&g_topology_once, ReadTopology);
+  return static_cast<int32>(
+      reinterpret_cast<intptr_t>(pthread_getspecific(g_node_key))) - 1;
+}
+
+}  // namespace kaldi
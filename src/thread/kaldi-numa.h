@@ -0,0 +1,129 @@
+// thread/kaldi-numa.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_THREAD_KALDI_NUMA_H_
+#define KALDI_THREAD_KALDI_NUMA_H_ 1
+
+#include <string>
+#include <vector>
+#include "base/kaldi-common.h"
+
+namespace kaldi {
+
+/**
+   Optional NUMA awareness, for machines with several sockets, where memory
+   that is attached to another socket is slower to access.  It is controlled by
+   a process-wide policy (see SetNumaPolicy(), and the --numa-policy option of
+   the parallel decoding programs):
+
+    - "none" (the default): threads run where the OS puts them.
+    - "pin": the threads of the ThreadPool and its thread cache (and so of
+      MultiThreader, TaskSequencer and TaskPipeline), and of TaskScheduler,
+      are each pinned to the CPUs of one NUMA node, round-robin.  As Linux
+      allocates memory on the node of the thread that first touches it, the
+      memory that a thread allocates for itself (e.g. the decoder's tokens) is
+      then local to it.
+    - "replicate": as "pin", and in addition the programs make a copy of large
+      read-only objects (e.g. the decoding graph and the model) on each node,
+      using NumaReplicated, and give each task the copy on the node it runs on.
+
+   We don't use libnuma: the topology is read from /sys, and the placement of
+   memory relies on the "first touch" rule.  On systems other than Linux, or
+   with only one node, all of this does nothing.
+*/
+
+enum NumaPolicy {
+  kNumaNone,
+  kNumaPin,
+  kNumaReplicate
+};
+
+/// Sets the policy from a string, "none", "pin" or "replicate"; dies if it
+/// is something else.  Call this before any threads are started (the
+/// ThreadPool's threads are pinned when the pool is created).
+void SetNumaPolicy(const std::string &policy);
+
+NumaPolicy GetNumaPolicy();
+
+/// Returns the number of NUMA nodes that have CPUs (1 if the machine is not
+/// NUMA, or we can't tell).
+int32 NumaNumNodes();
+
+/// Returns the node that threads should be pinned to for thread number
+/// "index" (index % NumaNumNodes()), or -1 if the policy is kNumaNone or
+/// there is only one node.
+int32 NumaNodeForThread(int32 index);
+
+/// Restricts the calling thread to the CPUs of "node" (0 <= node <
+/// NumaNumNodes()); if node is -1, lets it run on all the CPUs the process
+/// started with.  Returns false (after a warning) if this fails.
+bool NumaPinThread(int32 node);
+
+/// Returns the node the calling thread was pinned to by NumaPinThread(), or
+/// -1 if it is not pinned.
+int32 NumaThreadNode();
+
+
+/// Holds one copy of a read-only object per NUMA node if the policy is
+/// kNumaReplicate (and there is more than one node), or else just refers to
+/// the original.  Each copy is made by a thread pinned to its node, so its
+/// memory is on that node (as long as copying the object allocates new memory
+/// for its data).  The original, which must outlive this object, serves as
+/// the copy on node 0.
+template<class T>
+class NumaReplicated {
+ public:
+  /// "copy" makes a copy of the object; if NULL, the copy constructor is
+  /// used.  Be careful with classes whose copies share data (e.g. OpenFst's
+  /// VectorFst); for those, supply a function that makes a deep copy.
+  explicit NumaReplicated(const T &original, T *(*copy)(const T&) = NULL);
+
+  /// Returns the copy on "node", or the original if node is -1 or we don't
+  /// replicate.
+  const T &Get(int32 node) const {
+    if (node <= 0 || node >= static_cast<int32>(replicas_.size()))
+      return *original_;
+    return *(replicas_[node]);
+  }
+
+  /// Returns the copy on the node of the calling thread.
+  const T &Get() const { return Get(NumaThreadNode()); }
+
+  ~NumaReplicated();
+
+ private:
+  struct CopyInfo {
+    const T *original;
+    T *(*copy)(const T&);
+    int32 node;
+    T *replica;
+  };
+  static void *MakeCopy(void *arg);
+
+  const T *original_;
+  // replicas_[n] is the copy on node n, for n > 0.
+  std::vector<T*> replicas_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(NumaReplicated);
+};
+
+}  // namespace kaldi
+
+#include "thread/kaldi-numa-inl.h"
+
+#endif  // KALDI_THREAD_KALDI_NUMA_H_
@@ -92,4 +92,27 @@ void Semaphore::Signal() {
 }
 
 
+
+void LightweightSemaphore::Wait() {
+  // Spin for a while first, as a Signal() will often come soon.
+  for (int32 i = 0; i < 1000; i++) {
+    int32 counter = __atomic_load_n(&counter_, __ATOMIC_RELAXED);
+    if (counter > 0 &&
+        __atomic_compare_exchange_n(&counter_, &counter, counter - 1, true,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      return;
+  }
+  if (__atomic_fetch_sub(&counter_, 1, __ATOMIC_ACQUIRE) <= 0)
+    sema_.Wait();  // There was nothing available, so wait for a Signal().
+}
+
+
+
+void LightweightSemaphore::Signal() {
+  if (__atomic_fetch_add(&counter_, 1, __ATOMIC_RELEASE) < 0)
+    sema_.Signal();  // Someone is waiting in sema_.Wait().
+}
+
+
+
 } // namespace kaldi
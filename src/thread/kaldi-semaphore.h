@@ -51,6 +51,29 @@ class Semaphore {
 };
 
 
+/**
+ * A semaphore that only uses a mutex when Wait() has to block.  The counter is
+ * an atomic integer; Wait() spins for a short time while it is zero, and only
+ * then goes to sleep on a Semaphore, which Signal() wakes up only if someone
+ * is sleeping.  This is much faster than Semaphore when there is usually
+ * something available, e.g. for handing out many small tasks.
+ */
+class LightweightSemaphore {
+ public:
+  LightweightSemaphore(int32 initValue = 0): counter_(initValue) { }
+
+  void Wait(); ///< decrease the counter
+  void Signal(); ///< increase the counter
+
+ private:
+  // If negative, minus the number of threads sleeping (or about to sleep) in
+  // sema_.Wait().  Accessed atomically.
+  int32 counter_;
+  Semaphore sema_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(LightweightSemaphore);
+};
+
+
 
 } //namespace
 
@@ -0,0 +1,88 @@
+// thread/kaldi-task-pipeline-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "thread/kaldi-task-pipeline.h"
+
+namespace kaldi {
+
+// Each stage adds (stage + 1) to the value, after spinning for a while; we
+// check that the stages run in order, and that the output is in order.
+class MyPipelineTask {
+ public:
+  MyPipelineTask(int32 i, int32 num_stages, std::vector<int32> *output,
+                 std::vector<int32> *stage0_order):
+      i_(i), num_stages_(num_stages), next_stage_(0), value_(0),
+      output_(output), stage0_order_(stage0_order) { }
+
+  void RunStage(int32 stage) {
+    KALDI_ASSERT(stage == next_stage_);
+    next_stage_++;
+    if (stage == 0)  // stage 0 has one thread.
+      stage0_order_->push_back(i_);
+    int32 spin = Rand() % 10000;
+    for (int32 j = 0; j < spin; j++)
+      value_ += (j % 2 == 0 ? 1 : -1);
+    value_ += stage + 1 - (spin % 2);
+  }
+
+  ~MyPipelineTask() {
+    KALDI_ASSERT(next_stage_ == num_stages_ &&
+                 value_ == num_stages_ * (num_stages_ + 1) / 2);
+    output_->push_back(i_);
+  }
+
+ private:
+  int32 i_;
+  int32 num_stages_;
+  int32 next_stage_;
+  int32 value_;
+  std::vector<int32> *output_;
+  std::vector<int32> *stage0_order_;
+};
+
+
+void TestTaskPipeline() {
+  int32 num_stages = 1 + Rand() % 4;
+  std::vector<int32> num_threads(num_stages);
+  num_threads[0] = 1;
+  for (int32 s = 1; s < num_stages; s++)
+    num_threads[s] = 1 + Rand() % 4;
+  int32 max_tasks = 1 + Rand() % 10, num_tasks = Rand() % 100;
+
+  std::vector<int32> output, stage0_order;
+  {
+    TaskPipeline<MyPipelineTask> pipeline(num_threads, max_tasks);
+    for (int32 i = 0; i < num_tasks; i++)
+      pipeline.Run(new MyPipelineTask(i, num_stages, &output, &stage0_order));
+  }  // the destructor waits for the tasks.
+  KALDI_ASSERT(output.size() == static_cast<size_t>(num_tasks) &&
+               stage0_order.size() == static_cast<size_t>(num_tasks));
+  for (int32 i = 0; i < num_tasks; i++)
+    KALDI_ASSERT(output[i] == i && stage0_order[i] == i);
+}
+
+}  // end namespace kaldi.
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 200; i++)
+    TestTaskPipeline();
+  std::cout << "Test OK.\n";
+}
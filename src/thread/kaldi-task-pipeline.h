@@ -0,0 +1,206 @@
+// thread/kaldi-task-pipeline.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_THREAD_KALDI_TASK_PIPELINE_H_
+#define KALDI_THREAD_KALDI_TASK_PIPELINE_H_ 1
+
+#include <pthread.h>
+#include <deque>
+#include <vector>
+#include "base/kaldi-common.h"
+#include "matrix/kaldi-blas.h"
+#include "thread/kaldi-thread-pool.h"
+
+namespace kaldi {
+
+/**
+   TaskPipeline is for the same kind of job as TaskSequencer
+   (kaldi-task-sequence.h), i.e. a sequence of items such as utterances that
+   are each processed and then output in order, but where the processing is
+   split into stages, e.g. "decode" and "determinize the lattice", that have
+   their own threads.  While one item is in a later stage, the next can be in
+   an earlier one, so the stages overlap even if each has only one thread.
+
+   The tasks are objects of a class C with a function RunStage(int32 stage),
+   which is called for stage = 0, 1, ... num_stages - 1 in turn, each time in a
+   thread of that stage; and a destructor that does the output.  The
+   destructors are called one at a time, in the same order as the tasks were
+   given to Run(), in whichever thread finishes the task that is next in
+   order.  Within a stage, the tasks are started in order, so a stage with one
+   thread sees them in order (which may be useful if it updates shared
+   statistics).
+
+   The threads come from the ThreadPool's cache (see ThreadGroup).  As with
+   TaskSequencer, exceptions thrown by RunStage() or by the destructor are not
+   caught, so they terminate the program.
+*/
+template<class C>
+class TaskPipeline {
+ public:
+  /// num_threads[s] is the number of threads for stage s (each must be > 0);
+  /// the number of stages is num_threads.size().  Run() blocks while
+  /// max_tasks tasks are in the pipeline (in any stage, or waiting to be
+  /// output), which limits the memory used.
+  TaskPipeline(const std::vector<int32> &num_threads, int32 max_tasks):
+      blas_threads_(1), max_tasks_(max_tasks), num_tasks_(0),
+      input_finished_(false), outputting_(false),
+      queues_(num_threads.size()), num_before_(num_threads.size(), 0),
+      stage_info_(num_threads.size()) {
+    KALDI_ASSERT(!num_threads.empty() && max_tasks > 0);
+    pthread_mutex_init(&mutex_, NULL);
+    pthread_cond_init(&work_cond_, NULL);
+    pthread_cond_init(&space_cond_, NULL);
+    for (size_t s = 0; s < num_threads.size(); s++) {
+      KALDI_ASSERT(num_threads[s] > 0);
+      stage_info_[s].me = this;
+      stage_info_[s].stage = s;
+      for (int32 t = 0; t < num_threads[s]; t++)
+        threads_.Start(TaskPipeline<C>::RunStageThread, &(stage_info_[s]));
+    }
+  }
+
+  /// Takes ownership of "c", and deletes it (in order) after the last stage.
+  void Run(C *c) {
+    pthread_mutex_lock(&mutex_);
+    KALDI_ASSERT(!input_finished_);
+    while (num_tasks_ >= max_tasks_)
+      pthread_cond_wait(&space_cond_, &mutex_);
+    Task *task = new Task(c);
+    num_tasks_++;
+    unfinished_.push_back(task);
+    queues_[0].push_back(task);
+    for (size_t s = 1; s < queues_.size(); s++)
+      num_before_[s]++;
+    pthread_cond_broadcast(&work_cond_);
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  /// Waits for all tasks to finish and be output.  You can't call Run() after
+  /// this.
+  void Wait() {
+    pthread_mutex_lock(&mutex_);
+    input_finished_ = true;
+    pthread_cond_broadcast(&work_cond_);
+    pthread_mutex_unlock(&mutex_);
+    threads_.Join();
+    KALDI_ASSERT(unfinished_.empty());
+  }
+
+  ~TaskPipeline() {
+    Wait();
+    pthread_cond_destroy(&space_cond_);
+    pthread_cond_destroy(&work_cond_);
+    pthread_mutex_destroy(&mutex_);
+  }
+
+ private:
+  struct Task {
+    C *c;
+    bool done;  // true after the last stage.
+    explicit Task(C *c): c(c), done(false) { }
+  };
+  struct StageInfo {
+    TaskPipeline *me;
+    int32 stage;
+  };
+
+  static void *RunStageThread(void *input) {
+    StageInfo *info = static_cast<StageInfo*>(input);
+    SetBlasNumThreads(1);  // See MultiThreadable::run().
+    info->me->StageLoop(info->stage);
+    return NULL;
+  }
+
+  void StageLoop(int32 stage) {
+    std::deque<Task*> &queue = queues_[stage];
+    bool last_stage = (stage + 1 == static_cast<int32>(queues_.size()));
+    pthread_mutex_lock(&mutex_);
+    while (true) {
+      // We exit when no more tasks can reach this stage.
+      while (queue.empty() && !(input_finished_ && num_before_[stage] == 0))
+        pthread_cond_wait(&work_cond_, &mutex_);
+      if (queue.empty())
+        break;
+      Task *task = queue.front();
+      queue.pop_front();
+      pthread_mutex_unlock(&mutex_);
+
+      task->c->RunStage(stage);
+
+      pthread_mutex_lock(&mutex_);
+      if (last_stage) {
+        task->done = true;
+        OutputFinishedTasks();
+      } else {
+        queues_[stage + 1].push_back(task);
+        num_before_[stage + 1]--;
+      }
+      pthread_cond_broadcast(&work_cond_);
+    }
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  // Deletes the finished tasks at the head of unfinished_, unless another
+  // thread is already doing so.  Called with mutex_ held, but releases it
+  // while deleting, so the other stages can carry on.
+  void OutputFinishedTasks() {
+    if (outputting_)
+      return;  // That thread will output our task too.
+    outputting_ = true;
+    while (!unfinished_.empty() && unfinished_.front()->done) {
+      Task *task = unfinished_.front();
+      unfinished_.pop_front();
+      pthread_mutex_unlock(&mutex_);
+      delete task->c;  // This is where the output happens.
+      delete task;
+      pthread_mutex_lock(&mutex_);
+      num_tasks_--;
+      pthread_cond_signal(&space_cond_);
+    }
+    outputting_ = false;
+  }
+
+  // limits BLAS to one thread while the pipeline's threads exist (see
+  // SetBlasNumThreads()); it's destroyed after they have been joined.
+  BlasThreadScope blas_threads_;
+  int32 max_tasks_;
+
+  // The following are protected by mutex_.
+  pthread_mutex_t mutex_;
+  pthread_cond_t work_cond_;  // signaled when a queue or num_before_ changes.
+  pthread_cond_t space_cond_;  // signaled when a task has been output.
+  int32 num_tasks_;  // The number of tasks not yet output.
+  bool input_finished_;
+  bool outputting_;  // true while a thread is in OutputFinishedTasks().
+  // All tasks that have not been output, in the order Run() was called.
+  std::deque<Task*> unfinished_;
+  // queues_[s] contains the tasks waiting for stage s.
+  std::vector<std::deque<Task*> > queues_;
+  // num_before_[s] is the number of tasks that have not finished stage s - 1
+  // (for s > 0; num_before_[0] is always 0).
+  std::vector<int32> num_before_;
+
+  std::vector<StageInfo> stage_info_;
+  ThreadGroup threads_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(TaskPipeline);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_THREAD_KALDI_TASK_PIPELINE_H_
@@ -0,0 +1,117 @@
+// thread/kaldi-task-scheduler-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "thread/kaldi-mutex.h"
+#include "thread/kaldi-task-scheduler.h"
+
+namespace kaldi {
+
+class MyTaskClass { // spins for a while, then outputs a pre-given integer.
+ public:
+  MyTaskClass(int32 i, std::vector<int32> *run_order, Mutex *mutex,
+              std::vector<int32> *output):
+      done_(false), i_(i), run_order_(run_order), mutex_(mutex),
+      output_(output) { }
+
+  void operator() () {
+    mutex_->Lock();
+    run_order_->push_back(i_);
+    mutex_->Unlock();
+    int32 spin = 1000000 * Rand() % 100;
+    for (int32 i = 0; i < spin; i++);
+    done_ = true;
+  }
+  ~MyTaskClass() {
+    KALDI_ASSERT(done_);
+    output_->push_back(i_);
+  }
+
+ private:
+  bool done_;
+  int32 i_;
+  std::vector<int32> *run_order_;
+  Mutex *mutex_;
+  std::vector<int32> *output_;
+};
+
+
+void TestTaskScheduler() {
+  TaskSchedulerConfig config;
+  config.num_threads = 1 + Rand() % 20;
+  config.sort_window = 1 + Rand() % 10;
+  config.reorder_buffer = Rand() % 20 - 1;
+
+  int32 num_tasks = Rand() % 100;
+
+  std::vector<int32> run_order, output;
+  Mutex mutex;
+  {
+    TaskScheduler<MyTaskClass> scheduler(config);
+    for (int32 i = 0; i < num_tasks; i++)
+      scheduler.Run(new MyTaskClass(i, &run_order, &mutex, &output),
+                    Rand() % 10);
+  } // and let "scheduler" be destroyed, which waits for the tasks.
+  KALDI_ASSERT(output.size() == static_cast<size_t>(num_tasks) &&
+               run_order.size() == static_cast<size_t>(num_tasks));
+  // Every task is output exactly once.
+  std::sort(output.begin(), output.end());
+  for (int32 i = 0; i < num_tasks; i++)
+    KALDI_ASSERT(output[i] == i);
+}
+
+void TestTaskSchedulerOrder() {
+  // With one thread and a sort window that holds all the tasks, the tasks are
+  // run in order of decreasing cost; with reorder_buffer < 0 they are still
+  // output in the input order.
+  TaskSchedulerConfig config;
+  config.num_threads = 1;
+  int32 num_tasks = 1 + Rand() % 50;
+  config.sort_window = num_tasks + Rand() % 5;
+  config.reorder_buffer = -1;
+
+  std::vector<int32> cost(num_tasks);
+  std::vector<int32> run_order, output;
+  Mutex mutex;
+  {
+    TaskScheduler<MyTaskClass> scheduler(config);
+    for (int32 i = 0; i < num_tasks; i++) {
+      cost[i] = Rand() % 10;
+      scheduler.Run(new MyTaskClass(i, &run_order, &mutex, &output), cost[i]);
+    }
+  }
+  KALDI_ASSERT(run_order.size() == static_cast<size_t>(num_tasks));
+  for (int32 i = 0; i + 1 < num_tasks; i++) {
+    int32 a = run_order[i], b = run_order[i + 1];
+    KALDI_ASSERT(cost[a] > cost[b] || (cost[a] == cost[b] && a < b));
+  }
+  for (int32 i = 0; i < num_tasks; i++)
+    KALDI_ASSERT(output[i] == i);
+}
+
+}  // end namespace kaldi.
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 100; i++) {
+    TestTaskScheduler();
+    TestTaskSchedulerOrder();
+  }
+  KALDI_LOG << "Tests succeeded.";
+}
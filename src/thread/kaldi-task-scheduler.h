@@ -0,0 +1,311 @@
+// thread/kaldi-task-scheduler.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_THREAD_KALDI_TASK_SCHEDULER_H_
+#define KALDI_THREAD_KALDI_TASK_SCHEDULER_H_ 1
+
+#include <pthread.h>
+#include <algorithm>
+#include <list>
+#include <vector>
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "itf/options-itf.h"
+#include "matrix/kaldi-blas.h"
+#include "thread/kaldi-numa.h"
+
+namespace kaldi {
+
+/**
+   TaskScheduler is an alternative to TaskSequencer (see
+   kaldi-task-sequence.h), for the same kind of job: objects of a class C with
+   an operator () that does the computation and a destructor that does the
+   output.  As with TaskSequencer, the destructors are called one at a time,
+   never in parallel.  The differences are:
+
+    - A fixed pool of "num_threads" worker threads takes tasks as they become
+      free, and a worker never waits for another task to be output, so a very
+      long task does not hold up the tasks behind it.  Finished tasks are held
+      in a reorder buffer so that they can be output in the order in which they
+      were given to Run(); but if more than "reorder_buffer" finished tasks are
+      waiting (behind a task that is still running), the oldest of them are
+      output out of order.  If reorder_buffer < 0, the output is always in
+      order, and the buffer is not bounded.
+
+    - Run() takes a cost (e.g. the number of frames of an utterance), and up
+      to "sort_window" tasks are read ahead and run in order of decreasing
+      cost.  Starting the longest tasks first means the last tasks to finish
+      are short ones, which reduces the time at the end when some threads are
+      idle.
+
+   Wait() (or the destructor) waits for all tasks to finish, and prints the
+   fraction of the time that each thread spent running tasks.
+
+   If a NUMA policy is set (see kaldi-numa.h), the workers are pinned to the
+   nodes round-robin, and Run() may say which node a task should run on (e.g.
+   because it uses that node's copy of the model); workers take tasks for
+   their own node first, and only then the others'.
+*/
+struct TaskSchedulerConfig {
+  int32 num_threads;
+  int32 sort_window;
+  int32 reorder_buffer;
+
+  TaskSchedulerConfig(): num_threads(1), sort_window(1),
+                         reorder_buffer(100) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("num-threads", &num_threads, "Number of actively processing "
+                   "threads to run in parallel");
+    opts->Register("sort-window", &sort_window, "Number of tasks (e.g. "
+                   "utterances) to read ahead; the tasks read ahead are "
+                   "processed longest first.  If 1, tasks are processed in "
+                   "the order they are read.");
+    opts->Register("reorder-buffer", &reorder_buffer, "Maximum number of "
+                   "finished tasks that are held back so that the output can "
+                   "be in the input order; beyond this, finished tasks are "
+                   "output out of order.  If < 0, the output is always in "
+                   "order.");
+  }
+  void Check() const {
+    KALDI_ASSERT(num_threads > 0 && sort_window > 0);
+  }
+};
+
+template<class C>
+class TaskScheduler {
+ public:
+  explicit TaskScheduler(const TaskSchedulerConfig &config):
+      config_(config), blas_threads_(1), input_finished_(false), next_index_(0),
+      pending_(GetNumaPolicy() != kNumaNone ? NumaNumNodes() : 1),
+      num_pending_(0), num_waiting_(0), num_out_of_order_(0) {
+    config.Check();
+    pthread_mutex_init(&mutex_, NULL);
+    pthread_cond_init(&work_cond_, NULL);
+    pthread_cond_init(&space_cond_, NULL);
+    workers_.resize(config.num_threads);
+    for (size_t i = 0; i < workers_.size(); i++) {
+      workers_[i].me = this;
+      workers_[i].numa_node = NumaNodeForThread(i);
+      workers_[i].busy_time = 0.0;
+      workers_[i].num_tasks = 0;
+      int32 ret;
+      if ((ret = pthread_create(&(workers_[i].thread), NULL,
+                                TaskScheduler<C>::RunWorker,
+                                static_cast<void*>(&(workers_[i]))))) {
+        const char *c = strerror(ret);
+        KALDI_ERR << "Error creating thread, errno was: " << (c ? c : "[NULL]");
+      }
+    }
+  }
+
+  /// This function takes ownership of the pointer "c", and will delete it
+  /// when the task has run (see the comment above the class for the order).
+  /// Tasks with larger "cost" are run first, among those read ahead.  It
+  /// blocks if sort_window tasks are already waiting to be run.  If numa_node
+  /// is >= 0, workers on that node get the task first.
+  void Run(C *c, double cost = 0.0, int32 numa_node = -1) {
+    KALDI_ASSERT(!input_finished_);
+    pthread_mutex_lock(&mutex_);
+    while (num_pending_ >= static_cast<size_t>(config_.sort_window))
+      pthread_cond_wait(&space_cond_, &mutex_);
+    Task *task = new Task(c, cost, next_index_++);
+    std::vector<Task*> &pending = pending_[numa_node >= 0 &&
+        numa_node < static_cast<int32>(pending_.size()) ? numa_node : 0];
+    pending.push_back(task);
+    std::push_heap(pending.begin(), pending.end(), TaskCompare());
+    num_pending_++;
+    unfinished_.push_back(task);
+    if (num_pending_ >= static_cast<size_t>(config_.sort_window))
+      pthread_cond_signal(&work_cond_);
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  /// Waits for all tasks to finish and be output.  You can't call Run()
+  /// after this.
+  void Wait() {
+    if (workers_.empty()) return;
+    pthread_mutex_lock(&mutex_);
+    input_finished_ = true;
+    pthread_cond_broadcast(&work_cond_);
+    pthread_mutex_unlock(&mutex_);
+    for (size_t i = 0; i < workers_.size(); i++) {
+      int ret = pthread_join(workers_[i].thread, NULL);
+      if (ret != 0) {
+        const char *c = strerror(ret);
+        KALDI_ERR << "Error joining thread, errno was: " << (c ? c : "[NULL]");
+      }
+    }
+    KALDI_ASSERT(unfinished_.empty() && num_pending_ == 0);
+    double elapsed = timer_.Elapsed();
+    for (size_t i = 0; i < workers_.size(); i++)
+      KALDI_LOG << "Thread " << i << " ran " << workers_[i].num_tasks
+                << " tasks and was busy for "
+                << (elapsed > 0.0 ? 100.0 * workers_[i].busy_time / elapsed
+                    : 0.0) << "% of the time.";
+    if (num_out_of_order_ != 0)
+      KALDI_LOG << num_out_of_order_ << " of " << next_index_
+                << " tasks were output out of order.";
+    workers_.clear();
+  }
+
+  ~TaskScheduler() {
+    Wait();
+    pthread_mutex_destroy(&mutex_);
+    pthread_cond_destroy(&work_cond_);
+    pthread_cond_destroy(&space_cond_);
+  }
+
+ private:
+  struct Task {
+    C *c;
+    double cost;
+    int64 index;  // the order in which Run() was called.
+    bool done;
+    Task(C *c, double cost, int64 index):
+        c(c), cost(cost), index(index), done(false) { }
+  };
+  // Orders the heap so that the task with the largest cost (and, among
+  // equal costs, the earliest) is at the top.
+  struct TaskCompare {
+    bool operator() (const Task *a, const Task *b) const {
+      if (a->cost != b->cost) return a->cost < b->cost;
+      return a->index > b->index;
+    }
+  };
+  struct WorkerInfo {
+    TaskScheduler *me;
+    pthread_t thread;
+    int32 numa_node;  // -1 if not pinned.
+    double busy_time;
+    int32 num_tasks;
+  };
+
+  // This static function gets run in the worker threads.
+  static void* RunWorker(void *input) {
+    WorkerInfo *info = static_cast<WorkerInfo*>(input);
+    TaskScheduler *me = info->me;
+    SetBlasNumThreads(1);  // See MultiThreadable::run().
+    if (info->numa_node >= 0)
+      NumaPinThread(info->numa_node);
+    pthread_mutex_lock(&(me->mutex_));
+    while (true) {
+      // We take a task if the sort window is full, or if there will be no
+      // more tasks.
+      while (!(me->input_finished_ || me->num_pending_ >=
+               static_cast<size_t>(me->config_.sort_window)))
+        pthread_cond_wait(&(me->work_cond_), &(me->mutex_));
+      if (me->num_pending_ == 0) break;  // input_finished_ must be true.
+      Task *task = me->TakeTask(info->numa_node);
+      pthread_cond_signal(&(me->space_cond_));
+      pthread_mutex_unlock(&(me->mutex_));
+
+      Timer timer;
+      (*(task->c))();  // call operator () on the task, which does the work.
+      info->busy_time += timer.Elapsed();
+      info->num_tasks++;
+
+      pthread_mutex_lock(&(me->mutex_));
+      task->done = true;
+      me->num_waiting_++;
+      me->OutputFinishedTasks();
+    }
+    pthread_mutex_unlock(&(me->mutex_));
+    return NULL;
+  }
+
+  // Removes and returns the first task from the heap of our node, if it is not
+  // empty, or else the first task of all the others.  Must be called with
+  // mutex_ held, and num_pending_ > 0.
+  Task *TakeTask(int32 numa_node) {
+    int32 h = (numa_node >= 0 && numa_node < static_cast<int32>(pending_.size())
+               ? numa_node : 0);
+    if (pending_[h].empty()) {
+      for (size_t i = 0; i < pending_.size(); i++)
+        if (!pending_[i].empty() &&
+            (pending_[h].empty() ||
+             TaskCompare()(pending_[h].front(), pending_[i].front())))
+          h = i;
+    }
+    std::vector<Task*> &pending = pending_[h];
+    std::pop_heap(pending.begin(), pending.end(), TaskCompare());
+    Task *task = pending.back();
+    pending.pop_back();
+    num_pending_--;
+    return task;
+  }
+
+  // Outputs (deletes) the finished tasks at the head of unfinished_, and then,
+  // if too many finished tasks are waiting, the oldest of the others.  Must be
+  // called with mutex_ held; the destructors of the tasks are therefore never
+  // run at the same time.
+  void OutputFinishedTasks() {
+    while (!unfinished_.empty() && unfinished_.front()->done) {
+      OutputTask(unfinished_.front());
+      unfinished_.pop_front();
+    }
+    if (config_.reorder_buffer < 0) return;
+    typename std::list<Task*>::iterator iter = unfinished_.begin();
+    while (num_waiting_ > config_.reorder_buffer && iter != unfinished_.end()) {
+      if ((*iter)->done) {
+        OutputTask(*iter);
+        iter = unfinished_.erase(iter);
+        num_out_of_order_++;
+      } else {
+        ++iter;
+      }
+    }
+  }
+
+  void OutputTask(Task *task) {
+    delete task->c;  // This is where the output happens.
+    delete task;
+    num_waiting_--;
+  }
+
+  TaskSchedulerConfig config_;
+  // limits BLAS to one thread while the workers exist (see
+  // SetBlasNumThreads()); it's destroyed after they have been joined.
+  BlasThreadScope blas_threads_;
+  std::vector<WorkerInfo> workers_;
+  Timer timer_;
+
+  // The following are protected by mutex_.
+  pthread_mutex_t mutex_;
+  pthread_cond_t work_cond_;  // signaled when tasks may be taken.
+  pthread_cond_t space_cond_;  // signaled when a task is taken from pending_.
+  bool input_finished_;
+  int64 next_index_;
+  // The tasks waiting to be run, as a heap (see TaskCompare) for each NUMA
+  // node (or just one, if we don't use NUMA).
+  std::vector<std::vector<Task*> > pending_;
+  size_t num_pending_;  // The total size of the heaps.
+  // All tasks that have not been output (pending, running, or finished), in
+  // the order in which Run() was called.
+  std::list<Task*> unfinished_;
+  // The number of finished tasks in unfinished_.
+  int32 num_waiting_;
+  int64 num_out_of_order_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(TaskScheduler);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_THREAD_KALDI_TASK_SCHEDULER_H_
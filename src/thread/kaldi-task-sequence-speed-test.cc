@@ -0,0 +1,139 @@
+// thread/kaldi-task-sequence-speed-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "thread/kaldi-task-sequence.h"
+
+namespace kaldi {
+
+// A task that does a given amount of arithmetic, then adds its index to a
+// checksum (which only works if the destructors are called in order).
+class SpeedTestTask {
+ public:
+  SpeedTestTask(int32 i, int32 work, int64 *checksum):
+      i_(i), work_(work), checksum_(checksum), result_(0) { }
+  void operator() () {
+    double x = i_;
+    for (int32 j = 0; j < work_; j++)
+      x = x * 0.999 + 1.0;
+    result_ = (x > 0.0 ? 1 : 0);
+  }
+  ~SpeedTestTask() {
+    *checksum_ = *checksum_ * 3 + i_ + result_;
+  }
+ private:
+  int32 i_;
+  int32 work_;
+  int64 *checksum_;
+  int32 result_;
+};
+
+// This is the way TaskSequencer used to be implemented, for comparison: a new
+// thread for each task, which joins the thread of the previous task before
+// deleting its own task, with Semaphores limiting the number of threads.
+template<class C>
+class ThreadPerTaskSequencer {
+ public:
+  ThreadPerTaskSequencer(const TaskSequencerConfig &config):
+      threads_avail_(config.num_threads),
+      tot_threads_avail_(config.num_threads_total > 0 ?
+                         config.num_threads_total : config.num_threads + 20),
+      thread_list_(NULL) { }
+  void Run(C *c) {
+    threads_avail_.Wait();
+    tot_threads_avail_.Wait();
+    thread_list_ = new RunTaskArgsList(this, c, thread_list_);
+    if (pthread_create(&(thread_list_->thread), NULL, RunTask,
+                       static_cast<void*>(thread_list_)) != 0)
+      KALDI_ERR << "Error creating thread";
+  }
+  ~ThreadPerTaskSequencer() {
+    if (thread_list_ != NULL) {
+      pthread_join(thread_list_->thread, NULL);
+      delete thread_list_;
+    }
+  }
+ private:
+  struct RunTaskArgsList {
+    ThreadPerTaskSequencer *me;
+    C *c;
+    pthread_t thread;
+    RunTaskArgsList *tail;
+    RunTaskArgsList(ThreadPerTaskSequencer *me, C *c, RunTaskArgsList *tail):
+        me(me), c(c), tail(tail) {}
+  };
+  static void* RunTask(void *input) {
+    RunTaskArgsList *args = static_cast<RunTaskArgsList*>(input);
+    (*(args->c))();
+    args->me->threads_avail_.Signal();
+    if (args->tail != NULL)
+      pthread_join(args->tail->thread, NULL);
+    delete args->c;
+    if (args->tail != NULL) {
+      delete args->tail;
+      args->tail = NULL;
+    }
+    args->me->tot_threads_avail_.Signal();
+    return NULL;
+  }
+  Semaphore threads_avail_;
+  Semaphore tot_threads_avail_;
+  RunTaskArgsList *thread_list_;
+};
+
+template<class Sequencer>
+double TimeSequencer(const TaskSequencerConfig &config, int32 num_tasks,
+                     int32 work, int64 *checksum) {
+  Timer timer;
+  *checksum = 0;
+  {
+    Sequencer sequencer(config);
+    for (int32 i = 0; i < num_tasks; i++)
+      sequencer.Run(new SpeedTestTask(i, work, checksum));
+  }
+  return timer.Elapsed();
+}
+
+void TestTaskSequencerSpeed(int32 num_threads, int32 work) {
+  TaskSequencerConfig config;
+  config.num_threads = num_threads;
+  int32 num_tasks = 20000;
+  int64 checksum_old, checksum_new;
+  double time_old = TimeSequencer<ThreadPerTaskSequencer<SpeedTestTask> >(
+      config, num_tasks, work, &checksum_old),
+      time_new = TimeSequencer<TaskSequencer<SpeedTestTask> >(
+          config, num_tasks, work, &checksum_new);
+  KALDI_ASSERT(checksum_old == checksum_new);
+  KALDI_LOG << "For " << num_tasks << " tasks of size " << work << " with "
+            << num_threads << " threads, thread-per-task took " << time_old
+            << "s and TaskSequencer took " << time_new << "s (speedup "
+            << (time_old / time_new) << ")";
+}
+
+}  // end namespace kaldi.
+
+int main() {
+  using namespace kaldi;
+  int32 num_threads[] = { 1, 2, 4, 8 }, work[] = { 10, 1000, 10000 };
+  for (int32 i = 0; i < 4; i++)
+    for (int32 j = 0; j < 3; j++)
+      TestTaskSequencerSpeed(num_threads[i], work[j]);
+  std::cout << "Test OK.\n";
+}
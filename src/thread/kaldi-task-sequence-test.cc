@@ -20,6 +20,7 @@
 
 
 #include "base/kaldi-common.h"
+#include "thread/kaldi-bounded-queue.h"
 #include "thread/kaldi-task-sequence.h"
 
 namespace kaldi {
@@ -66,10 +67,81 @@ void TestTaskSequencer() {
     KALDI_ASSERT(task_output[i] == i);
 }
 
+// Several producers push the numbers 0 ... num_items-1, offset by their
+// index times num_items, and several consumers pop them and add them up.
+struct BoundedQueueTestInfo {
+  BoundedQueue<int32> *queue;
+  LightweightSemaphore *items_avail;
+  LightweightSemaphore *space_avail;
+  int32 num_items;
+  int32 index;
+  int64 sum;
+};
+
+void *BoundedQueueProducer(void *arg) {
+  BoundedQueueTestInfo *info = static_cast<BoundedQueueTestInfo*>(arg);
+  for (int32 i = 0; i < info->num_items; i++) {
+    info->space_avail->Wait();
+    while (!info->queue->TryPush(info->index * info->num_items + i));
+    info->items_avail->Signal();
+  }
+  return NULL;
+}
+
+void *BoundedQueueConsumer(void *arg) {
+  BoundedQueueTestInfo *info = static_cast<BoundedQueueTestInfo*>(arg);
+  info->sum = 0;
+  for (int32 i = 0; i < info->num_items; i++) {
+    info->items_avail->Wait();
+    int32 item;
+    while (!info->queue->TryPop(&item));
+    info->space_avail->Signal();
+    info->sum += item;
+  }
+  return NULL;
+}
+
+void TestBoundedQueue() {
+  BoundedQueue<int32> queue(1 + Rand() % 10);
+  int32 capacity = queue.Capacity();
+  for (int32 i = 0; i < capacity; i++)
+    KALDI_ASSERT(queue.TryPush(i));
+  KALDI_ASSERT(!queue.TryPush(0));
+  int32 item;
+  for (int32 i = 0; i < capacity; i++)
+    KALDI_ASSERT(queue.TryPop(&item) && item == i);
+  KALDI_ASSERT(!queue.TryPop(&item));
+
+  int32 num_threads = 1 + Rand() % 4, num_items = 1000;
+  LightweightSemaphore items_avail(0), space_avail(capacity);
+  std::vector<BoundedQueueTestInfo> producers(num_threads),
+      consumers(num_threads);
+  std::vector<pthread_t> threads(2 * num_threads);
+  for (int32 t = 0; t < num_threads; t++) {
+    BoundedQueueTestInfo info = { &queue, &items_avail, &space_avail,
+                                  num_items, t, 0 };
+    producers[t] = info;
+    consumers[t] = info;
+    pthread_create(&(threads[2 * t]), NULL, BoundedQueueProducer,
+                   &(producers[t]));
+    pthread_create(&(threads[2 * t + 1]), NULL, BoundedQueueConsumer,
+                   &(consumers[t]));
+  }
+  int64 sum = 0, n = static_cast<int64>(num_threads) * num_items;
+  for (int32 t = 0; t < num_threads; t++) {
+    pthread_join(threads[2 * t], NULL);
+    pthread_join(threads[2 * t + 1], NULL);
+    sum += consumers[t].sum;
+  }
+  KALDI_ASSERT(sum == n * (n - 1) / 2);
+}
+
 }  // end namespace kaldi.
 
 int main() {
   using namespace kaldi;
+  for (int32 i = 0; i < 20; i++)
+    TestBoundedQueue();
   for (int32 i = 0; i < 1000; i++)
     TestTaskSequencer();
 }
@@ -21,8 +21,11 @@
 #define KALDI_THREAD_KALDI_TASK_SEQUENCE_H_ 1
 
 #include <pthread.h>
+#include <sched.h>
+#include <vector>
 #include "thread/kaldi-thread.h"
 #include "itf/options-itf.h"
+#include "thread/kaldi-bounded-queue.h"
 #include "thread/kaldi-semaphore.h"
 
 
@@ -54,7 +57,17 @@ namespace kaldi {
    effects such as outputting data.
 
    Note: the destructor of TaskSequencer will wait for any remaining jobs that
-   are still running and will call the destructors.   
+   are still running and will call the destructors.
+
+   Implementation: there are num_threads worker threads (from the ThreadPool's
+   cache, see kaldi-thread-pool.h) for the life of the TaskSequencer.  Run()
+   puts the task in one of num_threads_total slots and pushes its sequence
+   number onto a lock-free BoundedQueue, from which the workers take tasks.
+   A worker that finishes a task marks its slot done, and then, if no other
+   worker is doing so, deletes all the finished tasks that are next in
+   sequence.  All the handoffs use atomic operations and LightweightSemaphore,
+   so a mutex or condition variable is only touched when a thread actually
+   has to sleep.  Run() should be called from only one thread.
  */
 
 struct TaskSequencerConfig {
@@ -79,117 +92,135 @@ template<class C>
 class TaskSequencer {
  public:
   TaskSequencer(const TaskSequencerConfig &config):
-      threads_avail_(config.num_threads),
-      tot_threads_avail_(config.num_threads_total > 0 ? config.num_threads_total :
-                         config.num_threads + 20),
-      thread_list_(NULL) {
+      blas_threads_(1),
+      num_threads_(config.num_threads),
+      slots_(config.num_threads_total > 0 ? config.num_threads_total :
+             config.num_threads + 20),
+      slots_avail_(slots_.size()),
+      queue_(std::max<size_t>(slots_.size(), config.num_threads)),
+      next_seq_(0), next_output_(0), outputting_(0) {
+    KALDI_ASSERT(config.num_threads > 0 &&
+                 "num-threads must be > 0");
     KALDI_ASSERT((config.num_threads_total <= 0 ||
                   config.num_threads_total >= config.num_threads) &&
                  "num-threads-total, if specified, must be >= num-threads");
+    for (size_t i = 0; i < slots_.size(); i++) {
+      slots_[i].c = NULL;
+      slots_[i].done_seq = -1;
+    }
+    for (int32 thread = 0; thread < num_threads_; thread++)
+      threads_.Start(TaskSequencer<C>::RunWorker, this);
   }
 
   /// This function takes ownership of the pointer "c", and will delete it
   /// in the same sequence as Run was called on the jobs.
   void Run(C *c) {
-    threads_avail_.Wait(); // wait till we have a thread for computation free.
-    tot_threads_avail_.Wait(); // this ensures we don't have too many threads
-    // waiting on I/O, and consume too much memory.
-    
-    // put the new RunTaskArgsList object at head of the singly
-    // linked list thread_list_.
-    thread_list_ = new RunTaskArgsList(this, c, thread_list_);
-    int32 ret;
-    if ((ret=pthread_create(&(thread_list_->thread),
-                            NULL, // default attributes
-                            TaskSequencer<C>::RunTask,
-                            static_cast<void*>(thread_list_)))) {
-      const char *c = strerror(ret);
-      KALDI_ERR << "Error creating thread, errno was: " << (c ? c : "[NULL]");
-    }
+    slots_avail_.Wait(); // this ensures we don't have too many tasks
+    // waiting to run or to be output, and consume too much memory.
+    int64 seq = next_seq_++;
+    Slot &slot = slots_[seq % slots_.size()];
+    KALDI_ASSERT(slot.c == NULL);
+    slot.c = c;
+    // The queue can't be full, as it's at least as big as the number of slots.
+    if (!queue_.TryPush(seq))
+      KALDI_ERR << "TaskSequencer queue is full (code error)";
+    tasks_avail_.Signal();
   }
 
   void Wait() { // You call this at the end if it's more convenient
     // than waiting for the destructor.  It waits for all tasks to finish.
-    if (thread_list_ != NULL) {
-      int ret = pthread_join(thread_list_->thread, NULL);
-      if (ret != 0) {
-        const char *c = strerror(ret);
-        KALDI_ERR << "Error joining thread, errno was: " << (c ? c : "[NULL]");
-      }
-      KALDI_ASSERT(thread_list_->tail == NULL); // thread would not
-      // have exited without setting tail to NULL.
-      delete thread_list_;
-      thread_list_ = NULL;
-    }
+    // When all the slots are free, all the tasks have been deleted.
+    for (size_t i = 0; i < slots_.size(); i++)
+      slots_avail_.Wait();
+    for (size_t i = 0; i < slots_.size(); i++)
+      slots_avail_.Signal();
   }
   
-  /// The destructor waits for the last thread to exit.
+  /// The destructor waits for the last task to finish.
   ~TaskSequencer() {
-    Wait();      
+    Wait();
+    // Tell the workers to exit.
+    for (int32 thread = 0; thread < num_threads_; thread++) {
+      if (!queue_.TryPush(-1))
+        KALDI_ERR << "TaskSequencer queue is full (code error)";
+      tasks_avail_.Signal();
+    }
+    threads_.Join();
   }
  private:
-  struct RunTaskArgsList {
-    TaskSequencer *me; // Think of this as a "this" pointer.
-    C *c; // Clist element of the task we're expected
-    pthread_t thread;
-    RunTaskArgsList *tail;
-    RunTaskArgsList(TaskSequencer *me, C *c, RunTaskArgsList *tail):
-        me(me), c(c), tail(tail) {}
+  struct Slot {
+    C *c;  // The task, or NULL if the slot is free.
+    int64 done_seq;  // The sequence number of the last task in this slot
+                     // whose operator () has finished.  Accessed atomically.
   };
-  // This static function gets run in the threads that we create.
-  static void* RunTask(void *input) {
-    RunTaskArgsList *args = static_cast<RunTaskArgsList*>(input);
-    
-    // (1) run the job.
-    (*(args->c))(); // call operator () on args->c, which does the computation.
-    args->me->threads_avail_.Signal(); // Signal that the compute-intensive
-    // part of the thread is done (we want to run no more than
-    // config_.num_threads of these.)
-    
-    // (2) we want to destroy the object "c" now, by deleting it.  But for
-    //     correct sequencing (this is the whole point of this class, it
-    //     is intended to ensure the output of the program is in correct order),
-    //     we first wait till the previous thread, whose details will be in "tail",
-    //     is finished.
-    if (args->tail != NULL) {
-      int ret = pthread_join(args->tail->thread, NULL);
-      if (ret != 0) {
-        const char *c = strerror(ret);
-        KALDI_ERR << "Error joining thread, errno was: " << (c ? c : "[NULL]");
-      }
-    }
 
-    delete args->c; // delete the object "c".  This may cause some output,
-    // e.g. to a stream.  We don't need to worry about concurrent access to
-    // the output stream, because each thread waits for the previous thread
-    // to be done, before doing this.  So there is no risk of concurrent
-    // access.
-    args->c = NULL;
-    
-    if (args->tail != NULL) {
-      KALDI_ASSERT(args->tail->tail == NULL); // Because we already
-      // did pthread_join on args->tail->thread, which means that
-      // thread was done, and before it exited, it would have
-      // deleted and set to NULL its tail (which is the next line of code).
-      delete args->tail;
-      args->tail = NULL;
+  // This static function gets run in the worker threads.
+  static void* RunWorker(void *input) {
+    TaskSequencer *me = static_cast<TaskSequencer*>(input);
+    SetBlasNumThreads(1);  // See MultiThreadable::run().
+    while (true) {
+      me->tasks_avail_.Wait();
+      int64 seq;
+      while (!me->queue_.TryPop(&seq))
+        sched_yield();  // Another thread is part way through pushing.
+      if (seq < 0)
+        return NULL;  // We're being told to exit.
+      Slot &slot = me->slots_[seq % me->slots_.size()];
+      (*(slot.c))(); // call operator () on slot.c, which does the computation.
+      __atomic_store_n(&(slot.done_seq), seq, __ATOMIC_SEQ_CST);
+      me->OutputTasks();
     }
-    // At this point we are exiting from the thread.  Signal the
-    // "tot_threads_avail_" semaphore which is used to limit the total number of threads that are alive, including
-    // not onlhy those that are in active computation in c->operator (), but those
-    // that are waiting on I/O or other threads.
-    args->me->tot_threads_avail_.Signal();
-    // .. and exit the thread, by returning. 
-    return NULL;
   }
 
-  Semaphore threads_avail_; // Initialized to the number of threads we are
-  // supposed to run with; the function Run() waits on this.
+  // Returns true if the next task to be deleted has finished running.
+  bool HaveNextOutput() {
+    int64 next = __atomic_load_n(&next_output_, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&(slots_[next % slots_.size()].done_seq),
+                           __ATOMIC_SEQ_CST) == next;
+  }
 
-  Semaphore tot_threads_avail_; // We use this semaphore to ensure we don't
-  // consume too much memory...
-  RunTaskArgsList *thread_list_; 
-  
+  // Deletes the tasks that have finished, in sequence, unless another thread
+  // is already doing it.  Deleting them may cause some output, e.g. to a
+  // stream; only one thread at a time does this, so there is no risk of
+  // concurrent access.
+  void OutputTasks() {
+    while (true) {
+      int32 expected = 0;
+      if (!__atomic_compare_exchange_n(&outputting_, &expected, 1, false,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+        return;  // The thread that is outputting will see our task.
+      while (HaveNextOutput()) {
+        Slot &slot = slots_[next_output_ % slots_.size()];
+        delete slot.c;
+        slot.c = NULL;
+        __atomic_store_n(&next_output_, next_output_ + 1, __ATOMIC_SEQ_CST);
+        slots_avail_.Signal();
+      }
+      __atomic_store_n(&outputting_, 0, __ATOMIC_SEQ_CST);
+      // A task may have finished after we looked at its slot but before we
+      // released outputting_, in which case its thread will have given up,
+      // so check again.
+      if (!HaveNextOutput())
+        return;
+    }
+  }
+
+  BlasThreadScope blas_threads_;  // limits BLAS to one thread, as the tasks
+  // run in their own threads; see SetBlasNumThreads().
+
+  int32 num_threads_;
+  std::vector<Slot> slots_;  // The task with sequence number s is in slot
+                             // s % slots_.size().
+  LightweightSemaphore slots_avail_;  // The number of free slots; Run()
+                                      // waits on this.
+  BoundedQueue<int64> queue_;  // Sequence numbers of tasks waiting to be run
+                               // (or -1 to tell a worker to exit).
+  LightweightSemaphore tasks_avail_;  // The number of elements in queue_.
+  int64 next_seq_;  // The sequence number of the next task given to Run().
+  int64 next_output_;  // The sequence number of the next task to delete.
+  int32 outputting_;  // 1 while a thread is deleting tasks in OutputTasks().
+  // (next_output_ and outputting_ are accessed atomically).
+  ThreadGroup threads_;
 };
 
 } // namespace kaldi
@@ -0,0 +1,140 @@
+// thread/kaldi-thread-pool-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "thread/kaldi-barrier.h"
+#include "thread/kaldi-mutex.h"
+#include "thread/kaldi-thread.h"
+#include "thread/kaldi-thread-pool.h"
+
+namespace kaldi {
+
+class SquareFunctor {
+ public:
+  explicit SquareFunctor(std::vector<int64> *out): out_(out) { }
+  void operator () (int32 i) { (*out_)[i] = static_cast<int64>(i) * i; }
+ private:
+  std::vector<int64> *out_;
+};
+
+void TestParallelFor() {
+  for (int32 n = 0; n < 10; n++) {
+    int32 size = RandInt(0, 2000), grain = RandInt(1, 50);
+    std::vector<int64> out(size, -1);
+    SquareFunctor f(&out);
+    ParallelFor(0, size, &f, grain);
+    for (int32 i = 0; i < size; i++)
+      KALDI_ASSERT(out[i] == static_cast<int64>(i) * i);
+  }
+}
+
+// Each call runs a ParallelFor of its own, to check that Run() can be called
+// from inside a task.
+class NestedFunctor {
+ public:
+  NestedFunctor(int32 inner_size, std::vector<int64> *sums):
+      inner_size_(inner_size), sums_(sums) { }
+  void operator () (int32 i) {
+    std::vector<int64> out(inner_size_);
+    SquareFunctor f(&out);
+    ParallelFor(0, inner_size_, &f);
+    int64 sum = 0;
+    for (int32 j = 0; j < inner_size_; j++)
+      sum += out[j];
+    (*sums_)[i] = sum;
+  }
+ private:
+  int32 inner_size_;
+  std::vector<int64> *sums_;
+};
+
+void TestNestedParallelFor() {
+  int32 outer_size = 50, inner_size = 100;
+  std::vector<int64> sums(outer_size);
+  NestedFunctor f(inner_size, &sums);
+  ParallelFor(0, outer_size, &f);
+  int64 n = inner_size;
+  for (int32 i = 0; i < outer_size; i++)
+    KALDI_ASSERT(sums[i] == (n - 1) * n * (2 * n - 1) / 6);
+}
+
+class ThrowingFunctor {
+ public:
+  void operator () (int32 i) {
+    if (i == 37)
+      KALDI_ERR << "Expected error for index " << i;
+  }
+};
+
+void TestParallelForError() {
+  ThrowingFunctor f;
+  bool threw = false;
+  try {
+    ParallelFor(0, 100, &f);
+  } catch (const std::exception &e) {
+    threw = true;
+  }
+  KALDI_ASSERT(threw);
+  // The pool should still work afterwards.
+  TestParallelFor();
+}
+
+// All the copies wait on a barrier, so this only finishes if they are all
+// running at the same time.
+class BarrierClass: public MultiThreadable {
+ public:
+  BarrierClass(Barrier *barrier, Mutex *mutex, int32 *count):
+      barrier_(barrier), mutex_(mutex), count_(count) { }
+  void operator() () {
+    barrier_->Wait();
+    mutex_->Lock();
+    (*count_)++;
+    mutex_->Unlock();
+  }
+ private:
+  Barrier *barrier_;
+  Mutex *mutex_;
+  int32 *count_;
+};
+
+void TestMultiThreaderReuse() {
+  Mutex mutex;
+  for (int32 n = 0; n < 20; n++) {
+    int32 num_threads = RandInt(1, 12), count = 0;
+    Barrier barrier(num_threads);
+    {
+      MultiThreader<BarrierClass> m(num_threads,
+                                    BarrierClass(&barrier, &mutex, &count));
+    }
+    KALDI_ASSERT(count == num_threads);
+  }
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  g_num_threads = 4;
+  TestParallelFor();
+  TestNestedParallelFor();
+  TestParallelForError();
+  TestMultiThreaderReuse();
+  std::cout << "Test OK.\n";
+  return 0;
+}
@@ -0,0 +1,337 @@
+// thread/kaldi-thread-pool.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstring>
+
+#include "thread/kaldi-numa.h"
+#include "thread/kaldi-thread-pool.h"
+#include "thread/kaldi-thread.h"
+
+namespace kaldi {
+
+struct ThreadPool::Group {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  size_t num_remaining;
+  std::string error;  // The message of the first exception, if any.
+};
+
+namespace {
+pthread_once_t g_thread_pool_once = PTHREAD_ONCE_INIT;
+ThreadPool *g_thread_pool = NULL;
+
+struct WorkerArg {
+  ThreadPool *pool;
+  int32 index;
+};
+}  // namespace
+
+void ThreadPool::CreateInstance() {
+  g_thread_pool = new ThreadPool(std::max<int32>(g_num_threads - 1, 0));
+}
+
+ThreadPool *ThreadPool::Instance() {
+  pthread_once(&g_thread_pool_once, CreateInstance);
+  return g_thread_pool;
+}
+
+ThreadPool::ThreadPool(int32 num_workers): num_queued_(0), next_worker_(0),
+                                           num_jobs_started_(0),
+                                           num_available_threads_(0) {
+  pthread_mutex_init(&sleep_mutex_, NULL);
+  pthread_cond_init(&sleep_cond_, NULL);
+  pthread_mutex_init(&thread_mutex_, NULL);
+  pthread_cond_init(&thread_cond_, NULL);
+  for (int32 i = 0; i < num_workers; i++) {
+    Worker *worker = new Worker();
+    pthread_mutex_init(&(worker->mutex), NULL);
+    workers_.push_back(worker);
+  }
+  // We start the workers after creating them all, as they look at each
+  // other's queues.
+  for (int32 i = 0; i < num_workers; i++) {
+    WorkerArg *arg = new WorkerArg();
+    arg->pool = this;
+    arg->index = i;
+    int32 ret = pthread_create(&(workers_[i]->thread), NULL, RunWorker, arg);
+    if (ret != 0) {
+      const char *c = strerror(ret);
+      KALDI_ERR << "Error creating thread, errno was: " << (c ? c : "[NULL]");
+    }
+    pthread_detach(workers_[i]->thread);
+  }
+}
+
+void *ThreadPool::RunWorker(void *arg) {
+  WorkerArg *worker_arg = static_cast<WorkerArg*>(arg);
+  ThreadPool *pool = worker_arg->pool;
+  int32 index = worker_arg->index;
+  delete worker_arg;
+  // The workers would oversubscribe the CPU if BLAS used threads too; see
+  // SetBlasNumThreads().  (With MKL this setting is per thread).
+  SetBlasNumThreads(1);
+  int32 node = NumaNodeForThread(index);
+  if (node >= 0)
+    NumaPinThread(node);
+  pool->WorkerLoop(index);
+  return NULL;
+}
+
+void ThreadPool::WorkerLoop(int32 index) {
+  while (true) {
+    QueuedTask task;
+    if (GetTask(index, &task)) {
+      RunTask(task);
+    } else {
+      pthread_mutex_lock(&sleep_mutex_);
+      while (num_queued_ <= 0)
+        pthread_cond_wait(&sleep_cond_, &sleep_mutex_);
+      pthread_mutex_unlock(&sleep_mutex_);
+    }
+  }
+}
+
+bool ThreadPool::GetTask(int32 index, QueuedTask *task) {
+  int32 num_workers = workers_.size();
+  bool found = false;
+  if (index >= 0) {
+    Worker *worker = workers_[index];
+    pthread_mutex_lock(&(worker->mutex));
+    if (!worker->tasks.empty()) {
+      *task = worker->tasks.front();
+      worker->tasks.pop_front();
+      found = true;
+    }
+    pthread_mutex_unlock(&(worker->mutex));
+  }
+  // Steal from the other workers, starting with the next one so that the
+  // thieves don't all go for the same queue.
+  int32 start = (index >= 0 ? index + 1 : 0);
+  for (int32 i = 0; i < num_workers && !found; i++) {
+    int32 victim = (start + i) % num_workers;
+    if (victim == index)
+      continue;
+    Worker *worker = workers_[victim];
+    pthread_mutex_lock(&(worker->mutex));
+    if (!worker->tasks.empty()) {
+      *task = worker->tasks.back();
+      worker->tasks.pop_back();
+      found = true;
+    }
+    pthread_mutex_unlock(&(worker->mutex));
+  }
+  if (found) {
+    pthread_mutex_lock(&sleep_mutex_);
+    num_queued_--;
+    pthread_mutex_unlock(&sleep_mutex_);
+  }
+  return found;
+}
+
+void ThreadPool::RunTask(const QueuedTask &task) {
+  Group *group = task.group;
+  if (group == NULL) {  // From Submit().
+    task.task->Run();
+    delete task.task;
+    return;
+  }
+  std::string error;
+  try {
+    task.task->Run();
+  } catch (const std::exception &e) {
+    error = e.what();
+    if (error.empty())
+      error = "[unknown error]";
+  }
+  pthread_mutex_lock(&(group->mutex));
+  if (!error.empty() && group->error.empty())
+    group->error = error;
+  if (--(group->num_remaining) == 0)
+    pthread_cond_broadcast(&(group->cond));
+  pthread_mutex_unlock(&(group->mutex));
+}
+
+void ThreadPool::Run(const std::vector<ThreadPoolTask*> &tasks) {
+  if (tasks.empty())
+    return;
+  int32 num_workers = workers_.size();
+  if (num_workers == 0) {
+    for (size_t i = 0; i < tasks.size(); i++)
+      tasks[i]->Run();
+    return;
+  }
+  Group group;
+  pthread_mutex_init(&(group.mutex), NULL);
+  pthread_cond_init(&(group.cond), NULL);
+  group.num_remaining = tasks.size();
+  // Deal the tasks out to the workers' queues, in contiguous blocks so that
+  // neighbouring tasks (which may share data) tend to run on the same thread.
+  for (int32 w = 0; w < num_workers; w++) {
+    size_t begin = tasks.size() * w / num_workers,
+        end = tasks.size() * (w + 1) / num_workers;
+    if (begin == end)
+      continue;
+    Worker *worker = workers_[w];
+    pthread_mutex_lock(&(worker->mutex));
+    for (size_t i = begin; i < end; i++) {
+      QueuedTask task;
+      task.task = tasks[i];
+      task.group = &group;
+      worker->tasks.push_back(task);
+    }
+    pthread_mutex_unlock(&(worker->mutex));
+  }
+  pthread_mutex_lock(&sleep_mutex_);
+  num_queued_ += tasks.size();
+  pthread_cond_broadcast(&sleep_cond_);
+  pthread_mutex_unlock(&sleep_mutex_);
+
+  // Help with the work while we wait.  Once the queues are empty, the rest of
+  // our tasks are running on other threads.
+  QueuedTask task;
+  while (GetTask(-1, &task))
+    RunTask(task);
+  pthread_mutex_lock(&(group.mutex));
+  while (group.num_remaining > 0)
+    pthread_cond_wait(&(group.cond), &(group.mutex));
+  std::string error = group.error;
+  pthread_mutex_unlock(&(group.mutex));
+  pthread_cond_destroy(&(group.cond));
+  pthread_mutex_destroy(&(group.mutex));
+  if (!error.empty())
+    KALDI_ERR << "Error in thread-pool task: " << error;
+}
+
+void ThreadPool::Submit(ThreadPoolTask *task) {
+  if (workers_.empty()) {
+    task->Run();
+    delete task;
+    return;
+  }
+  pthread_mutex_lock(&sleep_mutex_);
+  Worker *worker = workers_[next_worker_];
+  next_worker_ = (next_worker_ + 1) % workers_.size();
+  pthread_mutex_unlock(&sleep_mutex_);
+  QueuedTask queued_task;
+  queued_task.task = task;
+  queued_task.group = NULL;
+  pthread_mutex_lock(&(worker->mutex));
+  worker->tasks.push_back(queued_task);
+  pthread_mutex_unlock(&(worker->mutex));
+  pthread_mutex_lock(&sleep_mutex_);
+  num_queued_++;
+  pthread_cond_signal(&sleep_cond_);
+  pthread_mutex_unlock(&sleep_mutex_);
+}
+
+bool ThreadPool::RunOneTask() {
+  QueuedTask task;
+  if (!GetTask(-1, &task))
+    return false;
+  RunTask(task);
+  return true;
+}
+
+void ThreadPool::StartThread(void *(*func)(void*), void *arg,
+                             ThreadGroup *group) {
+  ThreadJob job;
+  job.func = func;
+  job.arg = arg;
+  job.group = group;
+  pthread_mutex_lock(&thread_mutex_);
+  // Successive threads are spread over the NUMA nodes, if requested.
+  job.numa_node = NumaNodeForThread(num_jobs_started_);
+  num_jobs_started_ = (num_jobs_started_ + 1) % NumaNumNodes();
+  thread_jobs_.push_back(job);
+  if (num_available_threads_ < thread_jobs_.size()) {
+    // All the cached threads are busy, so we need a new one.
+    pthread_t thread;
+    int32 ret = pthread_create(&thread, NULL, RunCachedThread, this);
+    if (ret != 0) {
+      thread_jobs_.pop_back();
+      pthread_mutex_unlock(&thread_mutex_);
+      const char *c = strerror(ret);
+      KALDI_ERR << "Error creating thread, errno was: " << (c ? c : "[NULL]");
+    }
+    pthread_detach(thread);
+    num_available_threads_++;
+  }
+  pthread_cond_signal(&thread_cond_);
+  pthread_mutex_unlock(&thread_mutex_);
+}
+
+void *ThreadPool::RunCachedThread(void *arg) {
+  static_cast<ThreadPool*>(arg)->CachedThreadLoop();
+  return NULL;
+}
+
+void ThreadPool::CachedThreadLoop() {
+  while (true) {
+    pthread_mutex_lock(&thread_mutex_);
+    while (thread_jobs_.empty())
+      pthread_cond_wait(&thread_cond_, &thread_mutex_);
+    ThreadJob job = thread_jobs_.front();
+    thread_jobs_.pop_front();
+    num_available_threads_--;
+    pthread_mutex_unlock(&thread_mutex_);
+    NumaPinThread(job.numa_node);
+    job.func(job.arg);
+    // Make ourselves available before saying we're done, so a caller that
+    // immediately starts more threads will reuse this one.
+    pthread_mutex_lock(&thread_mutex_);
+    num_available_threads_++;
+    pthread_mutex_unlock(&thread_mutex_);
+    job.group->Done();
+  }
+}
+
+
+ThreadGroup::ThreadGroup(): num_running_(0) {
+  pthread_mutex_init(&mutex_, NULL);
+  pthread_cond_init(&cond_, NULL);
+}
+
+void ThreadGroup::Start(void *(*func)(void*), void *arg) {
+  pthread_mutex_lock(&mutex_);
+  num_running_++;
+  pthread_mutex_unlock(&mutex_);
+  ThreadPool::Instance()->StartThread(func, arg, this);
+}
+
+void ThreadGroup::Done() {
+  pthread_mutex_lock(&mutex_);
+  if (--num_running_ == 0)
+    pthread_cond_broadcast(&cond_);
+  pthread_mutex_unlock(&mutex_);
+}
+
+void ThreadGroup::Join() {
+  pthread_mutex_lock(&mutex_);
+  while (num_running_ > 0)
+    pthread_cond_wait(&cond_, &mutex_);
+  pthread_mutex_unlock(&mutex_);
+}
+
+ThreadGroup::~ThreadGroup() {
+  Join();
+  pthread_cond_destroy(&cond_);
+  pthread_mutex_destroy(&mutex_);
+}
+
+}  // namespace kaldi
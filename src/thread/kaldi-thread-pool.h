@@ -0,0 +1,234 @@
+// thread/kaldi-thread-pool.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_THREAD_KALDI_THREAD_POOL_H_
+#define KALDI_THREAD_KALDI_THREAD_POOL_H_ 1
+
+#include <pthread.h>
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "matrix/kaldi-blas.h"
+
+namespace kaldi {
+
+/**
+   ThreadPool is a process-wide pool of persistent threads, so that code that
+   is parallelized many times (e.g. once per iteration, or once per utterance)
+   doesn't pay for creating and joining threads each time.  It provides two
+   things:
+
+    - A work-stealing scheduler for short tasks: Run() runs a set of
+      ThreadPoolTasks in parallel and returns when they are all done, and
+      ParallelFor() (below) is a convenient interface to it.  Each worker
+      thread has its own queue; workers take tasks from the front of their own
+      queue and, when that is empty, steal from the back of the others, so the
+      load is balanced even if the tasks take different amounts of time.  The
+      thread that calls Run() runs tasks too while it waits, so it is safe to
+      call Run() from inside a task.  The number of workers is
+      g_num_threads - 1 (plus the calling thread) as it was when the pool was
+      first used.
+
+    - A cache of threads for code that needs a given number of threads
+      running at the same time, e.g. because they wait for each other; this
+      is what MultiThreader (kaldi-thread.h) uses.  ThreadGroup::Start() runs
+      each function on its own thread, reusing a thread that has finished an
+      earlier function if there is one, and ThreadGroup::Join() waits for
+      them.
+*/
+
+/// A task for ThreadPool::Run().
+class ThreadPoolTask {
+ public:
+  virtual void Run() = 0;
+  virtual ~ThreadPoolTask() { }
+};
+
+class ThreadGroup;
+
+class ThreadPool {
+ public:
+  /// Returns the process-wide pool, creating it if necessary.
+  static ThreadPool *Instance();
+
+  /// The number of worker threads of the work-stealing scheduler (not
+  /// counting the thread that calls Run()).
+  int32 NumWorkers() const { return workers_.size(); }
+
+  /// Runs the tasks in parallel, and returns when they have all finished.
+  /// Does not take ownership of the tasks.  If any task throws, this throws
+  /// (via KALDI_ERR) after all the tasks have finished.
+  void Run(const std::vector<ThreadPoolTask*> &tasks);
+
+  /// Queues a task to be run by a worker, and returns without waiting for it.
+  /// Takes ownership of the task, and deletes it after it has run.  The task
+  /// must not throw (see Async() in kaldi-future.h, which catches exceptions
+  /// and passes them on).  If there are no workers, it runs the task now.
+  void Submit(ThreadPoolTask *task);
+
+  /// Runs one queued task in the calling thread, if there is one, and returns
+  /// true; returns false if there were none.  Threads waiting for the result
+  /// of a submitted task use this to help (see Future::Wait()), which is also
+  /// what makes it safe to wait inside a task.
+  bool RunOneTask();
+
+ private:
+  friend class ThreadGroup;
+
+  struct Group;  // The state of one call to Run().
+
+  struct QueuedTask {
+    ThreadPoolTask *task;
+    Group *group;  // NULL for a task given to Submit().
+  };
+
+  struct Worker {
+    pthread_t thread;
+    pthread_mutex_t mutex;  // Protects "tasks".
+    std::deque<QueuedTask> tasks;
+  };
+
+  struct ThreadJob {
+    void *(*func)(void*);
+    void *arg;
+    ThreadGroup *group;
+    int32 numa_node;  // The node to run on, or -1; see kaldi-numa.h.
+  };
+
+  explicit ThreadPool(int32 num_workers);
+  static void CreateInstance();  // Called once, by Instance().
+
+  // Called by ThreadGroup::Start(): runs func(arg) on a cached thread.
+  void StartThread(void *(*func)(void*), void *arg, ThreadGroup *group);
+
+  // Gets a task: from the front of the queue of worker "index" if index >= 0,
+  // else (or if that is empty) from the back of the other queues.  Returns
+  // false if there are none.
+  bool GetTask(int32 index, QueuedTask *task);
+  void RunTask(const QueuedTask &task);
+
+  static void *RunWorker(void *arg);
+  static void *RunCachedThread(void *arg);
+  void WorkerLoop(int32 index);
+  void CachedThreadLoop();
+
+  std::vector<Worker*> workers_;
+  // sleep_mutex_ protects num_queued_ (the total number of tasks in the
+  // workers' queues) and next_worker_ (the queue that Submit() uses next),
+  // and idle workers wait on sleep_cond_.
+  pthread_mutex_t sleep_mutex_;
+  pthread_cond_t sleep_cond_;
+  int64 num_queued_;
+  size_t next_worker_;
+
+  // thread_mutex_ protects the following, which are for StartThread().
+  pthread_mutex_t thread_mutex_;
+  pthread_cond_t thread_cond_;
+  std::deque<ThreadJob> thread_jobs_;
+  int32 num_jobs_started_;  // For assigning jobs to NUMA nodes.
+  // The number of cached threads that are waiting for a job, or will soon
+  // be; there is always one for each job in thread_jobs_.
+  size_t num_available_threads_;
+
+  // The pool is never destroyed.
+  KALDI_DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+};
+
+
+/// Runs functions on threads from the ThreadPool's cache, each on its own
+/// thread, so they all run at the same time; see ThreadPool.
+class ThreadGroup {
+ public:
+  ThreadGroup();
+
+  /// Runs func(arg) on its own thread.
+  void Start(void *(*func)(void*), void *arg);
+
+  /// Waits until all the functions started so far have returned.
+  void Join();
+
+  /// Calls Join().
+  ~ThreadGroup();
+
+ private:
+  friend class ThreadPool;
+  void Done();  // Called by the thread when func(arg) returns.
+
+  pthread_mutex_t mutex_;
+  pthread_cond_t cond_;
+  int32 num_running_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(ThreadGroup);
+};
+
+
+template<class F> class ParallelForTask: public ThreadPoolTask {
+ public:
+  ParallelForTask(F *f, int32 begin, int32 end): f_(f), begin_(begin),
+                                                 end_(end) { }
+  virtual void Run() {
+    for (int32 i = begin_; i < end_; i++)
+      (*f_)(i);
+  }
+ private:
+  F *f_;
+  int32 begin_;
+  int32 end_;
+};
+
+/// Calls (*f)(i) for begin <= i < end, in parallel using the ThreadPool, and
+/// returns when all the calls have finished.  F is any class with an
+/// operator () (int32), which must be safe to call from several threads at
+/// once.  The range is split into chunks of at least "grain" indexes,
+/// several per thread so that the work-stealing can balance the load; use a
+/// larger grain if each call does very little work.  The BLAS library is
+/// limited to one thread while this runs, as the threads would otherwise
+/// oversubscribe the CPU.
+template<class F> void ParallelFor(int32 begin, int32 end, F *f,
+                                   int32 grain = 1) {
+  if (end <= begin)
+    return;
+  KALDI_ASSERT(grain > 0);
+  ThreadPool *pool = ThreadPool::Instance();
+  int32 num_chunks = std::min<int64>((static_cast<int64>(end) - begin +
+                                      grain - 1) / grain,
+                                     4 * (pool->NumWorkers() + 1));
+  if (num_chunks <= 1 || pool->NumWorkers() == 0) {
+    for (int32 i = begin; i < end; i++)
+      (*f)(i);
+    return;
+  }
+  std::vector<ParallelForTask<F> > chunks;
+  chunks.reserve(num_chunks);
+  int64 size = static_cast<int64>(end) - begin;
+  for (int32 c = 0; c < num_chunks; c++)
+    chunks.push_back(ParallelForTask<F>(f, begin + size * c / num_chunks,
+                                        begin + size * (c + 1) / num_chunks));
+  std::vector<ThreadPoolTask*> tasks(num_chunks);
+  for (int32 c = 0; c < num_chunks; c++)
+    tasks[c] = &(chunks[c]);
+  BlasThreadScope blas_threads(1);
+  pool->Run(tasks);
+}
+
+}  // namespace kaldi
+
+#endif  // KALDI_THREAD_KALDI_THREAD_POOL_H_
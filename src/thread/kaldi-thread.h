@@ -29,6 +29,8 @@
 
 #include <pthread.h>
 #include "thread/kaldi-barrier.h"
+#include "thread/kaldi-thread-pool.h"
+#include "matrix/kaldi-blas.h"
 // This header provides a convenient mechanism for parallelization.  The idea is
 // that you have some range of integers, e.g. A ... B-1 (with B > A), and some
 // function call that takes a range of integers, and you partition these up into
@@ -41,21 +43,11 @@
 // multi-threading.
 
 
-// Description of MultiThreadPool and its usage:
-//
-// Usage of the RunMultiThreadedPersistent is the same as the usage of
-// RunMultiThreaded, except that the object provided ust inherit MultiThreadable
-// and it's run method isn't called, but operator() is called directly instead.
-// Member variables num_threads_ and thread_id_ must NOT be redefined in the
-// classes used, as they are called when using MultiThreadable*
-//
-// MultiThreadPool is a singleton class, it's instance is obtained using
-// MultiThreadPool::Instantiate(). First instantiation initializes the thread
-// pool using g_num_threads threads, each of those threads runs infinite loop in
-// ThreadWorker::run(). When RunMultiThreadedPersistent(c) is called, each
-// ThreadWorker is given a pointer to a copy of c and calls c() in it's thread.
-// After doing this, it Waits on barrier to sync with all the threads and the
-// main one, then Waits again until it receives another job.
+// The threads used by MultiThreader come from the process-wide cache in
+// ThreadPool (see kaldi-thread-pool.h), so a MultiThreader that is created
+// many times (e.g. once per minibatch) doesn't create a new set of threads each
+// time.  Each copy of the object still gets its own thread, so they all run
+// at the same time and may wait for each other (e.g. using a Barrier).
 
 namespace kaldi {
 
@@ -82,6 +74,9 @@ class MultiThreadable {
 
   static void *run(void *m_in) {
     MultiThreadable *m = static_cast<MultiThreadable*>(m_in);
+    // The threads would oversubscribe the CPU if BLAS used threads too; see
+    // SetBlasNumThreads().  (With MKL this setting is per thread).
+    SetBlasNumThreads(1);
     (*m)();  // call operator () on it.  This is a virtual
     // function so the one in the child class will be called.
     return NULL;
@@ -126,42 +121,32 @@ class MultiThreader {
  public:
   MultiThreader(int32 num_threads,
                 const C &c_in):
-    threads_(new pthread_t[std::max<int32>(1, num_threads)]),
+    blas_threads_(num_threads != 0 ? 1 : GetBlasNumThreads()),
     cvec_(std::max<int32>(1, num_threads), c_in) {
     if (num_threads == 0) {
       // This is a special case with num_threads == 0, which behaves like with
       // num_threads == 1 but without creating extra threads.  This can be
       // useful in GPU computations where threads cannot be used.
-      KALDI_PTHREAD_PTR(threads_[0]) = 0;
       cvec_[0].thread_id_ = 0;
       cvec_[0].num_threads_ = 1;
       (cvec_[0])();
     } else {
-      pthread_attr_t pthread_attr;
-      pthread_attr_init(&pthread_attr);
       for (int32 thread = 0; thread < num_threads; thread++) {
         cvec_[thread].thread_id_ = thread;
         cvec_[thread].num_threads_ = num_threads;
-        int32 ret;
-        if ((ret=pthread_create(&(threads_[thread]),
-                                &pthread_attr, C::run, &(cvec_[thread])))) {
-          const char *c = strerror(ret);
-          if (c == NULL) { c = "[NULL]"; }
-          KALDI_ERR << "Error creating thread, errno was: " << c;
-        }
+        threads_.Start(C::run, &(cvec_[thread]));
       }
     }
   }
   ~MultiThreader() {
-    for (size_t thread = 0; thread < cvec_.size(); thread++)
-      if (KALDI_PTHREAD_PTR(threads_[thread]) != 0)
-        if (pthread_join(threads_[thread], NULL))
-          KALDI_ERR << "Error rejoining thread.";
-    delete [] threads_;
+    threads_.Join();
   }
  private:
-  pthread_t *threads_;
+  // limits BLAS to one thread while the threads are running; it's declared
+  // first so that it's destroyed after they have been joined.
+  BlasThreadScope blas_threads_;
   std::vector<C> cvec_;
+  ThreadGroup threads_;
 };
 
 /// Here, class C should inherit from MultiThreadable.  Note: if you want to
@@ -19,6 +19,7 @@
 
 #include "util/common-utils.h"
 #include "gmm/diag-gmm.h"
+#include "gmm/am-diag-gmm.h"
 #include "transform/fmllr-diag-gmm.h"
 
 namespace kaldi {
@@ -222,6 +223,89 @@ void UnitTestFmllrDiagGmmOffset() {
   // mean that something is wrong.
 }
 
+// Checks that the frame-batched accumulation (AccumulateForGmms and the
+// matrix version of AccumulateFromPosteriors) gives the same stats as the
+// frame-by-frame code.
+void UnitTestFmllrDiagGmmBatched() {
+  using namespace kaldi;
+  DiagGmm gmm;
+  InitRandomGmm(&gmm);
+  int32 dim = gmm.Dim(), num_pdfs = 2 + Rand() % 3;
+  AmDiagGmm am_gmm;
+  for (int32 p = 0; p < num_pdfs; p++) {
+    DiagGmm this_gmm;
+    this_gmm.CopyFromDiagGmm(gmm);
+    Matrix<BaseFloat> means;
+    this_gmm.GetMeans(&means);
+    means.Add(0.5 * p);
+    this_gmm.SetMeans(means);
+    this_gmm.ComputeGconsts();
+    am_gmm.AddPdf(this_gmm);
+  }
+  int32 num_frames = 10 * dim + Rand() % 30;
+  Matrix<BaseFloat> feats(num_frames, dim);
+  std::vector<std::vector<std::pair<int32, BaseFloat> > > pdf_post(num_frames);
+  for (int32 t = 0; t < num_frames; t++) {
+    SubVector<BaseFloat> row(feats, t);
+    gmm.Generate(&row);
+    int32 num_post = Rand() % 3;  // some frames have no posteriors.
+    for (int32 i = 0; i < num_post; i++)
+      pdf_post[t].push_back(std::make_pair(Rand() % num_pdfs,
+                                           0.1f + RandUniform()));
+  }
+
+  for (int32 j = 0; j < 2; j++) {
+    FmllrOptions opts;
+    opts.min_count = 0.0;
+    if (j == 1) opts.update_type = "diag";
+    FmllrDiagGmmAccs stats(dim, opts), stats_batched(dim, opts),
+        stats_post(dim, opts), stats_post_batched(dim, opts);
+    BaseFloat tot_like = 0.0;
+    for (int32 t = 0; t < num_frames; t++)
+      for (size_t i = 0; i < pdf_post[t].size(); i++)
+        tot_like += pdf_post[t][i].second *
+            stats.AccumulateForGmm(am_gmm.GetPdf(pdf_post[t][i].first),
+                                   feats.Row(t), pdf_post[t][i].second);
+    BaseFloat tot_like_batched =
+        stats_batched.AccumulateForGmms(am_gmm, feats, pdf_post);
+    KALDI_ASSERT(ApproxEqual(tot_like, tot_like_batched));
+
+    Matrix<BaseFloat> post(num_frames, gmm.NumGauss());
+    for (int32 t = 0; t < num_frames; t++) {
+      Vector<BaseFloat> this_post(gmm.NumGauss());
+      gmm.ComponentPosteriors(feats.Row(t), &this_post);
+      this_post.Scale(RandUniform());
+      post.Row(t).CopyFromVec(this_post);
+      stats_post.AccumulateFromPosteriors(gmm, feats.Row(t), this_post);
+    }
+    stats_post_batched.AccumulateFromPosteriors(gmm, feats, post);
+
+    // Update() commits any pending per-frame stats.
+    Matrix<BaseFloat> xform(dim, dim + 1), xform_batched(dim, dim + 1);
+    BaseFloat objf_impr, count;
+    xform.SetUnit();
+    stats.Update(opts, &xform, &objf_impr, &count);
+    xform_batched.SetUnit();
+    stats_batched.Update(opts, &xform_batched, &objf_impr, &count);
+    Matrix<BaseFloat> xform2(dim, dim + 1);
+    xform2.SetUnit();
+    stats_post.Update(opts, &xform2, &objf_impr, &count);
+    xform2.SetUnit();
+    stats_post_batched.Update(opts, &xform2, &objf_impr, &count);
+
+    KALDI_ASSERT(ApproxEqual(stats.beta_, stats_batched.beta_));
+    KALDI_ASSERT(stats.K_.ApproxEqual(stats_batched.K_, 1.0e-04));
+    KALDI_ASSERT(ApproxEqual(stats_post.beta_, stats_post_batched.beta_));
+    KALDI_ASSERT(stats_post.K_.ApproxEqual(stats_post_batched.K_, 1.0e-04));
+    for (int32 d = 0; d < dim; d++) {
+      KALDI_ASSERT(stats.G_[d].ApproxEqual(stats_batched.G_[d], 1.0e-04));
+      KALDI_ASSERT(stats_post.G_[d].ApproxEqual(stats_post_batched.G_[d],
+                                                1.0e-04));
+    }
+    KALDI_ASSERT(xform.ApproxEqual(xform_batched, 1.0e-03));
+  }
+}
+
 }  // namespace kaldi ends here
 
 int main() {
@@ -229,6 +313,7 @@ int main() {
     kaldi::UnitTestFmllrDiagGmmOffset();
     kaldi::UnitTestFmllrDiagGmmDiagonal();
     kaldi::UnitTestFmllrDiagGmm();
+    kaldi::UnitTestFmllrDiagGmmBatched();
   }
   std::cout << "Test OK.\n";
 }
@@ -19,6 +19,7 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <utility>
 #include <vector>
 using std::vector;
@@ -64,6 +65,89 @@ void FmllrDiagGmmAccs:: AccumulateFromPosteriorsPreselect(
   }
 }
 
+void FmllrDiagGmmAccs::AccumulateFromPosteriors(
+    const DiagGmm &pdf,
+    const MatrixBase<BaseFloat> &data,
+    const MatrixBase<BaseFloat> &posteriors) {
+  KALDI_ASSERT(data.NumRows() == posteriors.NumRows() &&
+               data.NumCols() == Dim() &&
+               posteriors.NumCols() == pdf.NumGauss());
+  if (data.NumRows() == 0) return;
+  int32 num_frames = data.NumRows(), dim = Dim();
+  Matrix<BaseFloat> a(num_frames, dim), b(num_frames, dim);
+  a.AddMatMat(1.0, posteriors, kNoTrans, pdf.means_invvars(), kNoTrans, 0.0);
+  b.AddMatMat(1.0, posteriors, kNoTrans, pdf.inv_vars(), kNoTrans, 0.0);
+  CommitFrameStats(data, a, b, posteriors.Sum());
+}
+
+BaseFloat FmllrDiagGmmAccs::AccumulateForGmms(
+    const AmDiagGmm &am_gmm,
+    const MatrixBase<BaseFloat> &data,
+    const std::vector<std::vector<std::pair<int32, BaseFloat> > > &pdf_post) {
+  KALDI_ASSERT(static_cast<size_t>(data.NumRows()) == pdf_post.size() &&
+               data.NumCols() == Dim());
+  // (pdf-id, frame) pairs, with their weights.
+  std::vector<std::pair<std::pair<int32, int32>, BaseFloat> > frames;
+  for (size_t t = 0; t < pdf_post.size(); t++) {
+    for (size_t i = 0; i < pdf_post[t].size(); i++) {
+      int32 pdf_id = pdf_post[t][i].first;
+      KALDI_ASSERT(pdf_id >= 0 && pdf_id < am_gmm.NumPdfs());
+      frames.push_back(std::make_pair(std::make_pair(pdf_id,
+                                                     static_cast<int32>(t)),
+                                      pdf_post[t][i].second));
+    }
+  }
+  if (frames.empty()) return 0.0;
+  std::sort(frames.begin(), frames.end());
+
+  int32 num_frames = data.NumRows(), dim = Dim();
+  // Per-frame linear and quadratic terms, summed over pdfs; these are the
+  // same quantities as in SingleFrameStats, but for all frames at once.
+  Matrix<BaseFloat> a(num_frames, dim), b(num_frames, dim);
+  double tot_like = 0.0, count = 0.0;
+  std::vector<MatrixIndexT> rows;
+  for (size_t begin = 0; begin < frames.size(); ) {
+    int32 pdf_id = frames[begin].first.first;
+    size_t end = begin;
+    for (; end < frames.size() && frames[end].first.first == pdf_id; end++);
+    int32 this_num_frames = end - begin;
+    rows.resize(this_num_frames);
+    Vector<BaseFloat> weights(this_num_frames);
+    for (int32 i = 0; i < this_num_frames; i++) {
+      rows[i] = frames[begin + i].first.second;
+      weights(i) = frames[begin + i].second;
+    }
+    const DiagGmm &pdf = am_gmm.GetPdf(pdf_id);
+    Matrix<BaseFloat> this_data(this_num_frames, dim, kUndefined);
+    this_data.CopyRows(data, &(rows[0]));
+    Matrix<BaseFloat> posteriors;
+    pdf.LogLikelihoods(this_data, &posteriors);
+    for (int32 i = 0; i < this_num_frames; i++) {
+      SubVector<BaseFloat> post(posteriors, i);
+      BaseFloat log_like = post.ApplySoftMax();
+      if (KALDI_ISNAN(log_like) || KALDI_ISINF(log_like))
+        KALDI_ERR << "Invalid answer (overflow or invalid variances/features?)";
+      tot_like += log_like * weights(i);
+    }
+    posteriors.MulRowsVec(weights);
+    count += weights.Sum();
+
+    Matrix<BaseFloat> this_a(this_num_frames, dim, kUndefined),
+        this_b(this_num_frames, dim, kUndefined);
+    this_a.AddMatMat(1.0, posteriors, kNoTrans, pdf.means_invvars(), kNoTrans,
+                     0.0);
+    this_b.AddMatMat(1.0, posteriors, kNoTrans, pdf.inv_vars(), kNoTrans, 0.0);
+    // A frame may appear more than once for a pdf, so we can't use AddToRows.
+    for (int32 i = 0; i < this_num_frames; i++) {
+      a.Row(rows[i]).AddVec(1.0, this_a.Row(i));
+      b.Row(rows[i]).AddVec(1.0, this_b.Row(i));
+    }
+    begin = end;
+  }
+  CommitFrameStats(data, a, b, count);
+  return tot_like;
+}
+
 FmllrDiagGmmAccs::FmllrDiagGmmAccs(const DiagGmm &gmm,
                                    const AccumFullGmm &fgmm_accs):
     single_frame_stats_(gmm.Dim()), opts_(FmllrOptions()) {
@@ -594,7 +678,55 @@ void FmllrDiagGmmAccs::CommitSingleFrameStats() {
   stats.a.SetZero();
   stats.b.SetZero();
 }
-    
+
+void FmllrDiagGmmAccs::CommitFrameStats(const MatrixBase<BaseFloat> &data,
+                                        const MatrixBase<BaseFloat> &a,
+                                        const MatrixBase<BaseFloat> &b,
+                                        double count) {
+  int32 dim = Dim(), num_frames = data.NumRows();
+  KALDI_ASSERT(data.NumCols() == dim && a.NumRows() == num_frames &&
+               a.NumCols() == dim && b.NumRows() == num_frames &&
+               b.NumCols() == dim);
+  if (num_frames == 0) return;
+
+  // Row t of xplus is the extended feature vector [ x_t; 1 ].
+  Matrix<double> xplus(num_frames, dim + 1, kUndefined);
+  xplus.Range(0, num_frames, 0, dim).CopyFromMat(data);
+  xplus.Range(0, num_frames, dim, 1).Set(1.0);
+  this->beta_ += count;
+  this->K_.AddMatMat(1.0, Matrix<double>(a), kTrans, xplus, kNoTrans, 1.0);
+
+  Matrix<double> b_dbl(b);
+  KALDI_ASSERT(static_cast<size_t>(dim) == this->G_.size());
+  if (opts_.update_type == "full") {
+    // G_i += \sum_t b_t(i) xplus_t xplus_t^T, computed as
+    // xplus^T diag(b(:, i)) xplus.
+    Matrix<double> weighted_xplus(num_frames, dim + 1, kUndefined),
+        scatter(dim + 1, dim + 1, kUndefined);
+    Vector<double> b_col(num_frames);
+    for (int32 i = 0; i < dim; i++) {
+      b_col.CopyColFromMat(b_dbl, i);
+      weighted_xplus.CopyFromMat(xplus);
+      weighted_xplus.MulRowsVec(b_col);
+      scatter.AddMatMat(1.0, xplus, kTrans, weighted_xplus, kNoTrans, 0.0);
+      this->G_[i].AddSp(1.0, SpMatrix<double>(scatter, kTakeLower));
+    }
+  } else {
+    // We only need the elements (i, i), (dim, i) and (dim, dim) of G_i.
+    Vector<double> b_sum(dim), bx_sum(dim), bx2_sum(dim);
+    b_sum.AddRowSumMat(1.0, b_dbl, 0.0);
+    b_dbl.MulElements(xplus.Range(0, num_frames, 0, dim));
+    bx_sum.AddRowSumMat(1.0, b_dbl, 0.0);
+    b_dbl.MulElements(xplus.Range(0, num_frames, 0, dim));
+    bx2_sum.AddRowSumMat(1.0, b_dbl, 0.0);
+    for (int32 i = 0; i < dim; i++) {
+      this->G_[i](i, i) += bx2_sum(i);
+      this->G_[i](dim, i) += bx_sum(i);
+      this->G_[i](dim, dim) += b_sum(i);
+    }
+  }
+}
+
 
 
 
@@ -22,6 +22,7 @@
 #ifndef KALDI_TRANSFORM_FMLLR_DIAG_GMM_H_
 #define KALDI_TRANSFORM_FMLLR_DIAG_GMM_H_
 
+#include <utility>
 #include <vector>
 
 #include "base/kaldi-common.h"
@@ -110,7 +111,25 @@ class FmllrDiagGmmAccs: public AffineXformStats {
       const VectorBase<BaseFloat> &data,
       const VectorBase<BaseFloat> &posteriors);
 
-  
+  /// This version of AccumulateFromPosteriors operates on a block of frames;
+  /// row t of "posteriors" (num-frames by num-gauss) contains the posteriors
+  /// for frame "data.Row(t)".  The stats are accumulated with matrix
+  /// multiplications rather than per-frame outer products.
+  void AccumulateFromPosteriors(const DiagGmm &gmm,
+                                const MatrixBase<BaseFloat> &data,
+                                const MatrixBase<BaseFloat> &posteriors);
+
+  /// Accumulates stats for a whole utterance given pdf-level posteriors
+  /// (e.g. from ConvertPosteriorToPdfs); pdf_post.size() must equal
+  /// data.NumRows().  Frames are grouped by pdf so that the likelihoods can be
+  /// computed a block at a time, and the stats are committed once for the
+  /// whole utterance.  Equivalent to calling AccumulateForGmm for each
+  /// (frame, pdf) pair; returns the total weighted log-likelihood.
+  BaseFloat AccumulateForGmms(
+      const AmDiagGmm &am_gmm,
+      const MatrixBase<BaseFloat> &data,
+      const std::vector<std::vector<std::pair<int32, BaseFloat> > > &pdf_post);
+
   /// Update
   void Update(const FmllrOptions &opts,
               MatrixBase<BaseFloat> *fmllr_mat,
@@ -143,6 +162,14 @@ class FmllrDiagGmmAccs: public AffineXformStats {
 
   void CommitSingleFrameStats();
 
+  // Commits the stats for a block of frames: row t of "a" and "b" are the
+  // linear and quadratic terms (as in SingleFrameStats) for frame
+  // data.Row(t), and "count" is the total posterior of the block.
+  void CommitFrameStats(const MatrixBase<BaseFloat> &data,
+                        const MatrixBase<BaseFloat> &a,
+                        const MatrixBase<BaseFloat> &b,
+                        double count);
+
   void InitSingleFrameStats(const VectorBase<BaseFloat> &data);
   
   bool DataHasChanged(const VectorBase<BaseFloat> &data) const; // compares it to the
@@ -203,10 +203,55 @@ UnitTestEstimateLda() {
   test_io(lda_est, true);
 }
 
+// Checks that accumulating blocks of frames (and adding accumulators) gives
+// the same stats as accumulating frame by frame.
+void
+UnitTestLdaAccumulateBlock() {
+  int32 dim = RandInt(10, 30), num_class = dim + RandInt(1, 10),
+      num_frames = RandInt(200, 400);
+  Matrix<BaseFloat> feats(num_frames, dim);
+  feats.SetRandn();
+  std::vector<std::vector<std::pair<int32, BaseFloat> > > posts(num_frames);
+  LdaEstimate lda1, lda2, lda3;
+  lda1.Init(num_class, dim);
+  lda2.Init(num_class, dim);
+  lda3.Init(num_class, dim);
+  for (int32 t = 0; t < num_frames; t++) {
+    // make sure every class is seen.
+    posts[t].push_back(std::make_pair(t % num_class, RandUniform()));
+    if (RandInt(0, 1) == 0)
+      posts[t].push_back(std::make_pair(RandInt(0, num_class - 1),
+                                        RandUniform()));
+    for (size_t j = 0; j < posts[t].size(); j++)
+      lda1.Accumulate(feats.Row(t), posts[t][j].first, posts[t][j].second);
+  }
+  int32 half = num_frames / 2;
+  std::vector<std::vector<std::pair<int32, BaseFloat> > >
+      posts_a(posts.begin(), posts.begin() + half),
+      posts_b(posts.begin() + half, posts.end());
+  lda2.Accumulate(feats.RowRange(0, half), posts_a);
+  lda3.Accumulate(feats.RowRange(half, num_frames - half), posts_b);
+  lda2.Add(lda3);
+  KALDI_ASSERT(ApproxEqual(lda1.TotCount(), lda2.TotCount()));
+
+  LdaEstimateOptions opts;
+  opts.dim = dim;
+  Matrix<BaseFloat> m1, m2;
+  lda1.Estimate(opts, &m1);
+  lda2.Estimate(opts, &m2);
+  // The sign of each row is arbitrary.
+  for (int32 i = 0; i < dim; i++)
+    if (VecVec(m1.Row(i), m2.Row(i)) < 0.0)
+      m2.Row(i).Scale(-1.0);
+  KALDI_ASSERT(m1.ApproxEqual(m2, 0.01));
+}
+
 int
 main() {
   // repeat the test X times
-  for (int i = 0; i < 2; i++)
+  for (int i = 0; i < 2; i++) {
     UnitTestEstimateLda();
+    UnitTestLdaAccumulateBlock();
+  }
   std::cout << "Test OK.\n";
 }
@@ -54,6 +54,35 @@ void LdaEstimate::Accumulate(const VectorBase<BaseFloat> &data,
   total_second_acc_.AddVec2(weight, data_d);
 }
 
+void LdaEstimate::Accumulate(
+    const MatrixBase<BaseFloat> &data,
+    const std::vector<std::vector<std::pair<int32, BaseFloat> > > &class_weights) {
+  KALDI_ASSERT(data.NumRows() == static_cast<int32>(class_weights.size()) &&
+               data.NumCols() == Dim());
+  int32 num_frames = data.NumRows(), num_classes = NumClasses();
+  Matrix<double> data_d(data);
+  Vector<double> frame_weights(num_frames);
+  for (int32 t = 0; t < num_frames; t++) {
+    SubVector<double> frame(data_d, t);
+    for (size_t j = 0; j < class_weights[t].size(); j++) {
+      int32 class_id = class_weights[t][j].first;
+      BaseFloat weight = class_weights[t][j].second;
+      KALDI_ASSERT(class_id >= 0 && class_id < num_classes);
+      zero_acc_(class_id) += weight;
+      first_acc_.Row(class_id).AddVec(weight, frame);
+      frame_weights(t) += weight;
+    }
+  }
+  total_second_acc_.AddMat2Vec(1.0, data_d, kTrans, frame_weights, 1.0);
+}
+
+void LdaEstimate::Add(const LdaEstimate &other) {
+  KALDI_ASSERT(NumClasses() == other.NumClasses() && Dim() == other.Dim());
+  zero_acc_.AddVec(1.0, other.zero_acc_);
+  first_acc_.AddMat(1.0, other.first_acc_);
+  total_second_acc_.AddSp(1.0, other.total_second_acc_);
+}
+
 void LdaEstimate::GetStats(SpMatrix<double> *total_covar,
                            SpMatrix<double> *between_covar,
                            Vector<double> *total_mean,
@@ -74,6 +74,17 @@ class LdaEstimate {
   /// Accumulates data
   void Accumulate(const VectorBase<BaseFloat> &data, int32 class_id, BaseFloat weight = 1.0);
 
+  /// Accumulates a block of frames: row t of "data" is accumulated for each
+  /// (class-id, weight) pair in class_weights[t] (e.g. a pdf-level
+  /// Posterior).  This is much faster than calling the version above for
+  /// each frame, as the scatter is accumulated with a matrix multiplication.
+  void Accumulate(
+      const MatrixBase<BaseFloat> &data,
+      const std::vector<std::vector<std::pair<int32, BaseFloat> > > &class_weights);
+
+  /// Adds the stats in "other", which must have the same dimensions.
+  void Add(const LdaEstimate &other);
+
   /// Estimates the LDA transform matrix m.  If Mfull != NULL, it also outputs
   /// the full matrix (without dimensionality reduction), which is useful for
   /// some purposes.  If opts.remove_offset == true, it will output both matrices
@@ -159,6 +159,70 @@ void MlltAccs::AccumulateFromPosteriors(const DiagGmm &gmm,
   Vector<double> data_dbl(data);
 }
 
+void MlltAccs::AccumulateFromPosteriors(
+    const DiagGmm &gmm,
+    const MatrixBase<BaseFloat> &data,
+    const MatrixBase<BaseFloat> &posteriors) {
+  int32 dim = data.NumCols(), num_frames = data.NumRows(),
+      num_gauss = gmm.NumGauss();
+  KALDI_ASSERT(dim == gmm.Dim() && dim == Dim());
+  KALDI_ASSERT(posteriors.NumRows() == num_frames &&
+               posteriors.NumCols() == num_gauss);
+  KALDI_ASSERT(rand_prune_ >= 0.0);
+  const Matrix<BaseFloat> &means_invvars = gmm.means_invvars();
+  const Matrix<BaseFloat> &inv_vars = gmm.inv_vars();
+  Vector<BaseFloat> mean(dim);
+  // offsets are the (mean - data) for the frames with nonzero posterior.
+  Matrix<double> offsets(num_frames, dim, kUndefined);
+  Vector<double> weights(num_frames, kUndefined);
+  SpMatrix<double> scatter(dim);
+  for (int32 i = 0; i < num_gauss; i++) {  // for each mixcomp..
+    SubVector<BaseFloat> mean_invvar(means_invvars, i);
+    SubVector<BaseFloat> inv_var(inv_vars, i);
+    mean.AddVecDivVec(1.0, mean_invvar, inv_var, 0.0);  // get mean.
+    int32 n = 0;
+    for (int32 t = 0; t < num_frames; t++) {
+      BaseFloat posterior = RandPrune(posteriors(t, i), rand_prune_);
+      if (posterior == 0.0) continue;
+      SubVector<double> offset(offsets, n);
+      offset.CopyFromVec(mean);
+      offset.AddVec(-1.0, data.Row(t));
+      weights(n++) = posterior;
+    }
+    if (n == 0) continue;
+    // scatter = \sum_t posterior(t) offset(t) offset(t)^T.
+    SubMatrix<double> these_offsets(offsets, 0, n, 0, dim);
+    SubVector<double> these_weights(weights, 0, n);
+    scatter.AddMat2Vec(1.0, these_offsets, kTrans, these_weights, 0.0);
+    for (int32 j = 0; j < dim; j++)
+      G_[j].AddSp(inv_var(j), scatter);
+    beta_ += these_weights.Sum();
+  }
+}
+
+BaseFloat MlltAccs::AccumulateFromGmm(const DiagGmm &gmm,
+                                      const MatrixBase<BaseFloat> &data,
+                                      const VectorBase<BaseFloat> &weights) {
+  KALDI_ASSERT(weights.Dim() == data.NumRows());
+  Matrix<BaseFloat> posteriors;
+  gmm.LogLikelihoods(data, &posteriors);
+  double ans = 0.0;
+  for (int32 t = 0; t < data.NumRows(); t++) {
+    SubVector<BaseFloat> post(posteriors, t);
+    ans += post.ApplySoftMax() * weights(t);
+    post.Scale(weights(t));
+  }
+  AccumulateFromPosteriors(gmm, data, posteriors);
+  return ans;
+}
+
+void MlltAccs::Add(const MlltAccs &other) {
+  KALDI_ASSERT(G_.size() == other.G_.size());
+  beta_ += other.beta_;
+  for (size_t i = 0; i < G_.size(); i++)
+    G_[i].AddSp(1.0, other.G_[i]);
+}
+
 BaseFloat MlltAccs::AccumulateFromGmm(const DiagGmm &gmm,
                                       const VectorBase<BaseFloat> &data,
                                       BaseFloat weight) {  // e.g. weight = 1.0
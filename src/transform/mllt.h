@@ -85,11 +85,28 @@ class MlltAccs {
                                 const VectorBase<BaseFloat> &data,
                                 const VectorBase<BaseFloat> &posteriors);
 
+  /// This version of AccumulateFromPosteriors operates on a block of frames:
+  /// row t of "posteriors" is the Gaussian posteriors for row t of "data".
+  /// It accumulates the weighted scatter around each mean with a matrix
+  /// multiplication, which is much faster than doing it frame by frame.
+  void AccumulateFromPosteriors(const DiagGmm &gmm,
+                                const MatrixBase<BaseFloat> &data,
+                                const MatrixBase<BaseFloat> &posteriors);
+
   // Returns GMM likelihood.
   BaseFloat AccumulateFromGmm(const DiagGmm &gmm,
                               const VectorBase<BaseFloat> &data,
                               BaseFloat weight);  // e.g. weight = 1.0
 
+  /// Block version of AccumulateFromGmm: row t of "data" has weight
+  /// weights(t).  Returns the sum over frames of weight times GMM likelihood.
+  BaseFloat AccumulateFromGmm(const DiagGmm &gmm,
+                              const MatrixBase<BaseFloat> &data,
+                              const VectorBase<BaseFloat> &weights);
+
+  /// Adds the stats in "other", which must have the same dimension.
+  void Add(const MlltAccs &other);
+
   BaseFloat AccumulateFromGmmPreselect(const DiagGmm &gmm,
                                        const std::vector<int32> &gselect,
                                        const VectorBase<BaseFloat> &data,
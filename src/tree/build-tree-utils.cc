@@ -20,6 +20,7 @@
 #include <set>
 #include <queue>
 #include "util/stl-utils.h"
+#include "thread/kaldi-thread-pool.h"
 #include "tree/build-tree-utils.h"
 
 
@@ -292,6 +293,45 @@ BaseFloat ObjfGivenMap(const BuildTreeStatsType &stats_in, const EventMap &e) {
   return ans;
 }
 
+// This class is used in ComputeInitialSplit() to work out, in parallel, the
+// objf change from splitting the stats with each of the questions.
+class InitialSplitObjfComputer {
+ public:
+  InitialSplitObjfComputer(
+      const std::vector<Clusterable*> &summed_stats,
+      const std::vector<std::vector<EventValueType> > &questions,
+      const Clusterable &total, BaseFloat unsplit_objf,
+      std::vector<BaseFloat> *objf_changes):
+      summed_stats_(summed_stats), questions_(questions), total_(total),
+      unsplit_objf_(unsplit_objf), objf_changes_(objf_changes) { }
+
+  void operator () (int32 i) {
+    const std::vector<EventValueType> &yes_set = questions_[i];
+    std::vector<int32> assignments(summed_stats_.size(), 0);  // 0 is index of "no".
+    std::vector<Clusterable*> clusters(2);  // no and yes clusters.
+    for (std::vector<EventValueType>::const_iterator iter = yes_set.begin(); iter != yes_set.end(); iter++) {
+      KALDI_ASSERT(*iter>=0);
+      if (*iter < (EventValueType)assignments.size()) assignments[*iter] = 1;
+    }
+    kaldi::AddToClustersOptimized(summed_stats_, assignments, total_, &clusters);
+    BaseFloat this_objf = SumClusterableObjf(clusters);
+
+    if (this_objf < unsplit_objf_- 0.001*std::abs(unsplit_objf_)) {  // got worse; should never happen.
+      // of course small differences can be caused by roundoff.
+      KALDI_WARN << "Objective function got worse when building tree: "<< this_objf << " < " << unsplit_objf_;
+      KALDI_ASSERT(!(this_objf < unsplit_objf_ - 0.01*(200 + std::abs(unsplit_objf_))));  // do assert on more stringent check.
+    }
+    (*objf_changes_)[i] = this_objf - unsplit_objf_;
+    DeletePointers(&clusters);
+  }
+ private:
+  const std::vector<Clusterable*> &summed_stats_;
+  const std::vector<std::vector<EventValueType> > &questions_;
+  const Clusterable &total_;
+  BaseFloat unsplit_objf_;
+  std::vector<BaseFloat> *objf_changes_;
+};
+
 // This function computes the best initial split of these stats [with this key].
 // Returns best objf change (>=0).
 BaseFloat ComputeInitialSplit(const std::vector<Clusterable*> &summed_stats,
@@ -309,32 +349,20 @@ BaseFloat ComputeInitialSplit(const std::vector<Clusterable*> &summed_stats,
 
   const std::vector<std::vector<EventValueType> > &questions_of_this_key = key_opts.initial_questions;
 
+  // Evaluate the questions in parallel, then pick the best one in order (so
+  // the result doesn't depend on the number of threads).
+  std::vector<BaseFloat> objf_changes(questions_of_this_key.size());
+  InitialSplitObjfComputer computer(summed_stats, questions_of_this_key,
+                                    *total, unsplit_objf, &objf_changes);
+  ParallelFor(0, questions_of_this_key.size(), &computer, 16);
+
   int32 best_idx = -1;
   BaseFloat best_objf_change = 0;
-
   for (size_t i = 0; i < questions_of_this_key.size(); i++) {
-    const std::vector<EventValueType> &yes_set = questions_of_this_key[i];
-    std::vector<int32> assignments(summed_stats.size(), 0);  // 0 is index of "no".
-    std::vector<Clusterable*> clusters(2);  // no and yes clusters.
-    for (std::vector<EventValueType>::const_iterator iter = yes_set.begin(); iter != yes_set.end(); iter++) {
-      KALDI_ASSERT(*iter>=0);
-      if (*iter < (EventValueType)assignments.size()) assignments[*iter] = 1;
-    }
-    kaldi::AddToClustersOptimized(summed_stats, assignments, *total, &clusters);
-    BaseFloat this_objf = SumClusterableObjf(clusters);
-
-    if (this_objf < unsplit_objf- 0.001*std::abs(unsplit_objf)) {  // got worse; should never happen.
-      // of course small differences can be caused by roundoff.
-      KALDI_WARN << "Objective function got worse when building tree: "<< this_objf << " < " << unsplit_objf;
-      KALDI_ASSERT(!(this_objf < unsplit_objf - 0.01*(200 + std::abs(unsplit_objf))));  // do assert on more stringent check.
-    }
-
-    BaseFloat this_objf_change = this_objf - unsplit_objf;
-    if (this_objf_change > best_objf_change) {
-      best_objf_change = this_objf_change;
+    if (objf_changes[i] > best_objf_change) {
+      best_objf_change = objf_changes[i];
       best_idx = i;
     }
-    DeletePointers(&clusters);
   }
   delete total;
   if (best_idx != -1)
@@ -453,6 +481,28 @@ class DecisionTreeSplitter {
     delete yes_;
     delete no_;
   }
+
+  // Creates DecisionTreeSplitter objects in parallel (their constructors call
+  // FindBestSplit()).
+  class SplitterCreator {
+   public:
+    SplitterCreator(const std::vector<EventAnswerType> &leaves,
+                    const std::vector<const BuildTreeStatsType*> &stats,
+                    const Questions &q_opts,
+                    std::vector<DecisionTreeSplitter*> *splitters):
+        leaves_(leaves), stats_(stats), q_opts_(q_opts),
+        splitters_(splitters) { }
+    void operator () (int32 i) {
+      (*splitters_)[i] = new DecisionTreeSplitter(leaves_[i], *(stats_[i]),
+                                                  q_opts_);
+    }
+   private:
+    const std::vector<EventAnswerType> &leaves_;
+    const std::vector<const BuildTreeStatsType*> &stats_;
+    const Questions &q_opts_;
+    std::vector<DecisionTreeSplitter*> *splitters_;
+  };
+
  private:
   void DoSplitInternal(int32 *next_leaf) {
     // Does the split; applicable only to leaf nodes.
@@ -481,8 +531,19 @@ class DecisionTreeSplitter {
       delete yes_clust; delete no_clust;
     }
 #endif
-    yes_ = new DecisionTreeSplitter(yes_leaf, yes_stats, q_opts_);
-    no_ = new DecisionTreeSplitter(no_leaf, no_stats, q_opts_);
+    // The constructors find the best splits of the children, which is where
+    // the time goes, so we do the two in parallel.
+    std::vector<DecisionTreeSplitter*> children(2);
+    std::vector<EventAnswerType> leaves(2);
+    std::vector<const BuildTreeStatsType*> stats(2);
+    leaves[0] = yes_leaf;
+    stats[0] = &yes_stats;
+    leaves[1] = no_leaf;
+    stats[1] = &no_stats;
+    SplitterCreator creator(leaves, stats, q_opts_, &children);
+    ParallelFor(0, 2, &creator);
+    yes_ = children[0];
+    no_ = children[1];
     best_split_impr_ = std::max(yes_->BestSplit(), no_->BestSplit());
     stats_.clear();  // note: pointers in stats_ were not owned here.
   }
@@ -496,19 +557,45 @@ class DecisionTreeSplitter {
       KALDI_WARN << "DecisionTreeSplitter::FindBestSplit(), no keys available to split on (maybe no key covered all of your events, or there was a problem with your questions configuration?)";
     }
     best_split_impr_ = 0;
+    // The keys are tried in parallel; we then pick the best in order, as the
+    // result must not depend on the number of threads.
+    std::vector<BaseFloat> split_improvements(all_keys.size(), 0.0);
+    std::vector<std::vector<EventValueType> > yes_sets(all_keys.size());
+    KeySplitFinder finder(stats_, q_opts_, all_keys, &split_improvements,
+                          &yes_sets);
+    ParallelFor(0, all_keys.size(), &finder);
     for (size_t i = 0; i < all_keys.size(); i++) {
-      if (q_opts_.HasQuestionsForKey(all_keys[i])) {
-        std::vector<EventValueType> temp_yes_set;
-        BaseFloat split_improvement = FindBestSplitForKey(stats_, q_opts_, all_keys[i], &temp_yes_set);
-        if (split_improvement > best_split_impr_) {
-          best_split_impr_ = split_improvement;
-          yes_set_ = temp_yes_set;
-          key_ = all_keys[i];
-        }
+      if (split_improvements[i] > best_split_impr_) {
+        best_split_impr_ = split_improvements[i];
+        yes_set_.swap(yes_sets[i]);
+        key_ = all_keys[i];
       }
     }
   }
 
+  // Used in FindBestSplit() to call FindBestSplitForKey() in parallel.
+  class KeySplitFinder {
+   public:
+    KeySplitFinder(const BuildTreeStatsType &stats, const Questions &q_opts,
+                   const std::vector<EventKeyType> &keys,
+                   std::vector<BaseFloat> *split_improvements,
+                   std::vector<std::vector<EventValueType> > *yes_sets):
+        stats_(stats), q_opts_(q_opts), keys_(keys),
+        split_improvements_(split_improvements), yes_sets_(yes_sets) { }
+    void operator () (int32 i) {
+      if (q_opts_.HasQuestionsForKey(keys_[i]))
+        (*split_improvements_)[i] = FindBestSplitForKey(stats_, q_opts_,
+                                                        keys_[i],
+                                                        &((*yes_sets_)[i]));
+    }
+   private:
+    const BuildTreeStatsType &stats_;
+    const Questions &q_opts_;
+    const std::vector<EventKeyType> &keys_;
+    std::vector<BaseFloat> *split_improvements_;
+    std::vector<std::vector<EventValueType> > *yes_sets_;
+  };
+
 
 
   // Data members... Always used:
@@ -548,11 +635,18 @@ EventMap *SplitDecisionTree(const EventMap &input_map,
     SplitStatsByMap(stats, input_map, &split_stats);
     KALDI_ASSERT(split_stats.size() != 0);
     builders.resize(split_stats.size());  // size == #leaves.
+    std::vector<EventAnswerType> leaves(split_stats.size());
+    std::vector<const BuildTreeStatsType*> stats_ptrs(split_stats.size());
     for (size_t i = 0;i < split_stats.size();i++) {
-      EventAnswerType leaf = static_cast<EventAnswerType>(i);
+      leaves[i] = static_cast<EventAnswerType>(i);
+      stats_ptrs[i] = &(split_stats[i]);
       if (split_stats[i].size() == 0) num_empty_leaves++;
-      builders[i] = new DecisionTreeSplitter(leaf, split_stats[i], q_opts);
     }
+    // Finding the best split of each of the initial leaves is independent, so
+    // we do it in parallel.
+    DecisionTreeSplitter::SplitterCreator creator(leaves, stats_ptrs, q_opts,
+                                                  &builders);
+    ParallelFor(0, split_stats.size(), &creator);
   }
 
   {  // Do the splitting.
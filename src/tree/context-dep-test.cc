@@ -127,6 +127,38 @@ void TestGenRandContextDependency() {
   std::cout << "Note: any \"serious error\" warnings preceding this line are OK.\n";
 }
 
+// Checks that ContextDependency::Compute(), which uses the compiled form of
+// the tree, agrees with EventMap::Map() on the tree itself.
+void TestCompiledEventMap() {
+  size_t num_phones = 1 + Rand() % 10;
+  std::set<int32> phones_set;
+  while (phones_set.size() < num_phones) phones_set.insert(1 + Rand() % (num_phones + 5));
+  std::vector<int32> phones;
+  CopySetToVector(phones_set, &phones);
+  std::vector<int32> phone2num_pdf_classes;
+  ContextDependency *dep = GenRandContextDependency(phones,
+                                                    (Rand() % 2 == 0),
+                                                    &phone2num_pdf_classes);
+  int32 N = dep->ContextWidth(), max_phone = phones.back();
+  for (int32 i = 0; i < 200; i++) {
+    std::vector<int32> phoneseq(N);
+    EventType event;
+    // pdf-classes and phones go slightly out of range, to test failure.
+    int32 pdf_class = Rand() % 5;
+    event.push_back(std::make_pair(kPdfClass, pdf_class));
+    for (int32 j = 0; j < N; j++) {
+      phoneseq[j] = Rand() % (max_phone + 3);
+      event.push_back(std::make_pair(j, phoneseq[j]));
+    }
+    int32 pdf_id1 = -1, pdf_id2 = -1;
+    bool ans1 = dep->ToPdfMap().Map(event, &pdf_id1),
+        ans2 = dep->Compute(phoneseq, pdf_class, &pdf_id2);
+    KALDI_ASSERT(ans1 == ans2);
+    if (ans1) KALDI_ASSERT(pdf_id1 == pdf_id2);
+  }
+  delete dep;
+}
+
 } // end namespace kaldi
 
 int main() {
@@ -134,5 +166,6 @@ int main() {
     kaldi::TestContextDep();
     kaldi::TestGenRandContextDependency();  // Also tests I/O of ContextDependency
     kaldi::TestMonophoneContextDependency();
+    kaldi::TestCompiledEventMap();
   }
 }
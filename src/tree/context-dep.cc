@@ -27,6 +27,24 @@ bool ContextDependency::Compute(const std::vector<int32> &phoneseq,
                                  int32 pdf_class,
                                  int32 *pdf_id) const {
   KALDI_ASSERT(static_cast<int32>(phoneseq.size()) == N_);
+  KALDI_ASSERT(pdf_id != NULL);
+  if (compiled_.IsCompiled()) {
+    // values[k + 1] is the value for key k, with kPdfClass == -1.
+    const int32 kMaxStackValues = 8;
+    EventValueType stack_values[kMaxStackValues];
+    std::vector<EventValueType> heap_values;
+    EventValueType *values = stack_values;
+    if (N_ + 1 > kMaxStackValues) {
+      heap_values.resize(N_ + 1);
+      values = &(heap_values[0]);
+    }
+    values[0] = pdf_class;
+    for (int32 i = 0; i < N_; i++) {
+      KALDI_ASSERT(phoneseq[i] >= 0);
+      values[i + 1] = phoneseq[i];
+    }
+    return compiled_.Map(values, pdf_id);
+  }
   EventType  event_vec;
   event_vec.reserve(N_+1);
   event_vec.push_back(std::make_pair
@@ -39,10 +57,16 @@ bool ContextDependency::Compute(const std::vector<int32> &phoneseq,
                          static_cast<EventValueType>(phoneseq[i])));
     KALDI_ASSERT(static_cast<EventAnswerType>(phoneseq[i]) >= 0);
   }
-  KALDI_ASSERT(pdf_id != NULL);
   return to_pdf_->Map(event_vec, pdf_id);
 }
 
+void ContextDependency::Compile() {
+  KALDI_COMPILE_TIME_ASSERT(kPdfClass == -1);
+  compiled_.Clear();
+  if (to_pdf_ != NULL && !compiled_.Compile(*to_pdf_, kPdfClass, N_ - 1))
+    KALDI_VLOG(2) << "Could not compile the tree; using the EventMap directly.";
+}
+
 ContextDependency *GenRandContextDependency(const std::vector<int32> &phone_ids,
                                             bool ensure_all_covered,
                                             std::vector<int32> *hmm_lengths) {
@@ -150,6 +174,7 @@ void ContextDependency::Write (std::ostream &os, bool binary) const {
 
 
 void ContextDependency::Read (std::istream &is, bool binary) {
+  compiled_.Clear();
   if (to_pdf_) {
     delete to_pdf_;
     to_pdf_ = NULL;
@@ -173,6 +198,7 @@ void ContextDependency::Read (std::istream &is, bool binary) {
   }
   ExpectToken(is, binary, "EndContextDependency");
   to_pdf_ = to_pdf;
+  Compile();
 }
 
 void ContextDependency::GetPdfInfo(const std::vector<int32> &phones,
@@ -89,7 +89,7 @@ class ContextDependency: public ContextDependencyInterface {
   // Constructor takes ownership of pointers.
   ContextDependency(int32 N, int32 P,
                     EventMap *to_pdf):
-      N_(N), P_(P), to_pdf_(to_pdf) { }
+      N_(N), P_(P), to_pdf_(to_pdf) { Compile(); }
   void Write (std::ostream &os, bool binary) const;
 
   ~ContextDependency() { delete to_pdf_; }
@@ -106,9 +106,15 @@ class ContextDependency: public ContextDependencyInterface {
       const;
 
  private:
+  // Sets up compiled_ from to_pdf_, if possible.
+  void Compile();
+
   int32 N_;  //
   int32 P_;
   EventMap *to_pdf_;  // owned here.
+  // Flattened copy of to_pdf_ with keys kPdfClass ... N_-1, used by Compute();
+  // empty if to_pdf_ could not be compiled.
+  CompiledEventMap compiled_;
 
   KALDI_DISALLOW_COPY_AND_ASSIGN(ContextDependency);
 };
@@ -426,6 +426,87 @@ static bool GetTreeStructureInternal(
 }
 
 // See the header for a description of what this function does.
+void CompiledEventMap::Clear() {
+  min_key_ = 0;
+  num_keys_ = 0;
+  nodes_.clear();
+  children_.clear();
+  bits_.clear();
+}
+
+bool CompiledEventMap::Compile(const EventMap &map, EventKeyType min_key,
+                               EventKeyType max_key) {
+  KALDI_ASSERT(max_key >= min_key);
+  Clear();
+  min_key_ = min_key;
+  num_keys_ = max_key - min_key + 1;
+  if (CompileNode(map) != 0) {
+    Clear();
+    return false;
+  }
+  return true;
+}
+
+int32 CompiledEventMap::CompileNode(const EventMap &map) {
+  // Bitmaps for yes-sets are limited to this many values; in practice the
+  // values are phones or pdf-classes so this is never reached.
+  const EventValueType kMaxSplitRange = 1 << 20;
+  int32 index = nodes_.size();
+  nodes_.resize(index + 1);
+  Node node;
+  node.type = kLeaf;
+  node.key = 0;
+  node.min_value = 0;
+  node.size = 0;
+  node.offset = 0;
+  node.child = -1;
+  node.no_child = -1;
+  if (const ConstantEventMap *c = dynamic_cast<const ConstantEventMap*>(&map)) {
+    node.child = c->answer_;
+  } else if (const TableEventMap *t =
+             dynamic_cast<const TableEventMap*>(&map)) {
+    node.type = kTable;
+    node.key = t->key_ - min_key_;
+    if (node.key < 0 || node.key >= num_keys_) return -1;
+    node.size = t->table_.size();
+    node.offset = children_.size();
+    children_.resize(children_.size() + t->table_.size(), -1);
+    for (size_t i = 0; i < t->table_.size(); i++) {
+      if (t->table_[i] != NULL) {
+        int32 child = CompileNode(*(t->table_[i]));
+        if (child < 0) return -1;
+        children_[node.offset + i] = child;
+      }
+    }
+  } else if (const SplitEventMap *s =
+             dynamic_cast<const SplitEventMap*>(&map)) {
+    node.type = kSplit;
+    node.key = s->key_ - min_key_;
+    if (node.key < 0 || node.key >= num_keys_) return -1;
+    const ConstIntegerSet<EventValueType> &yes_set = s->yes_set_;
+    node.offset = bits_.size();
+    if (!yes_set.empty()) {
+      // the set is sorted.
+      EventValueType lo = *yes_set.begin(), hi = *(yes_set.end() - 1);
+      if (static_cast<int64>(hi) - lo >= kMaxSplitRange) return -1;
+      node.min_value = lo;
+      node.size = hi - lo + 1;
+      bits_.resize(bits_.size() + (node.size + 31) / 32, 0);
+      for (ConstIntegerSet<EventValueType>::iterator iter = yes_set.begin();
+           iter != yes_set.end(); ++iter) {
+        uint32 i = *iter - lo;
+        bits_[node.offset + (i >> 5)] |= (static_cast<uint32>(1) << (i & 31));
+      }
+    }
+    if ((node.child = CompileNode(*(s->yes_))) < 0 ||
+        (node.no_child = CompileNode(*(s->no_))) < 0) return -1;
+  } else {
+    return -1;  // some other type of EventMap.
+  }
+  nodes_[index] = node;
+  return index;
+}
+
 bool GetTreeStructure(const EventMap &map,
                       int32 *num_leaves,
                       std::vector<int32> *parents) {
@@ -163,6 +163,8 @@ class EventMap {
 };
 
 
+class CompiledEventMap;
+
 class ConstantEventMap: public EventMap {
  public:
   virtual bool Map(const EventType &event, EventAnswerType *ans) const {
@@ -199,6 +201,7 @@ class ConstantEventMap: public EventMap {
   virtual void Write(std::ostream &os, bool binary);
   static ConstantEventMap *Read(std::istream &is, bool binary);
  private:
+  friend class CompiledEventMap;
   EventAnswerType answer_;
   KALDI_DISALLOW_COPY_AND_ASSIGN(ConstantEventMap);
 };
@@ -258,6 +261,7 @@ class TableEventMap: public EventMap {
     DeletePointers(&table_);
   }
  private:
+  friend class CompiledEventMap;
   EventKeyType key_;
   std::vector<EventMap*> table_;
   KALDI_DISALLOW_COPY_AND_ASSIGN(TableEventMap);
@@ -332,6 +336,7 @@ class SplitEventMap: public EventMap {  // A decision tree [non-leaf] node.
   void Destroy() {
     delete yes_; delete no_;
   }
+  friend class CompiledEventMap;
   EventKeyType key_;
   //  std::vector<EventValueType> yes_set_;
   ConstIntegerSet<EventValueType> yes_set_;  // more efficient Map function.
@@ -340,6 +345,87 @@ class SplitEventMap: public EventMap {  // A decision tree [non-leaf] node.
   SplitEventMap &operator = (const SplitEventMap &other);  // Disallow.
 };
 
+
+/**
+   CompiledEventMap is a read-only, flattened copy of an EventMap made up of
+   ConstantEventMap, TableEventMap and SplitEventMap nodes (i.e. any EventMap
+   that we create in the tree-building code).  The nodes are stored in a
+   single contiguous array; the tables of TableEventMap nodes and the yes-sets
+   of SplitEventMap nodes become directly indexed arrays (a bitmap, for the
+   yes-sets), so a lookup is a short loop with no virtual calls and no
+   searching.
+
+   The keys must all lie in a small known range [min_key, max_key], and the
+   event is supplied as an array indexed by key - min_key with a value for
+   every key in that range.  This suits ContextDependency, where the keys are
+   kPdfClass and the phone positions 0 ... N-1.
+*/
+class CompiledEventMap {
+ public:
+  CompiledEventMap(): min_key_(0), num_keys_(0) { }
+
+  /// Compiles "map".  Returns false (and leaves *this empty) if the map
+  /// contains a type of EventMap we don't know about, a key outside
+  /// [min_key, max_key], or a yes-set spanning too large a range of values;
+  /// the caller should then use the EventMap itself.
+  bool Compile(const EventMap &map, EventKeyType min_key,
+               EventKeyType max_key);
+
+  /// True if Compile() has been called successfully.
+  bool IsCompiled() const { return !nodes_.empty(); }
+
+  /// Empties the object.
+  void Clear();
+
+  /// Equivalent to EventMap::Map() on the event whose value for key k is
+  /// values[k - min_key], for all k in [min_key, max_key].
+  inline bool Map(const EventValueType *values, EventAnswerType *ans) const {
+    int32 n = 0;
+    while (true) {
+      const Node &node = nodes_[n];
+      if (node.type == kLeaf) {
+        *ans = node.child;
+        return true;
+      }
+      // Values below min_value wrap around to large unsigned numbers, so one
+      // comparison checks both ends of the range.
+      uint32 i = static_cast<uint32>(values[node.key] - node.min_value);
+      if (node.type == kTable) {
+        if (i >= node.size || (n = children_[node.offset + i]) < 0) {
+          *ans = -1;
+          return false;
+        }
+      } else {  // kSplit
+        bool yes = (i < node.size &&
+                    ((bits_[node.offset + (i >> 5)] >> (i & 31)) & 1) != 0);
+        n = (yes ? node.child : node.no_child);
+      }
+    }
+  }
+
+ private:
+  enum NodeType { kLeaf, kTable, kSplit };
+  struct Node {
+    int32 type;  // a NodeType
+    int32 key;  // key - min_key_, for table and split nodes.
+    EventValueType min_value;  // value that corresponds to index zero.
+    uint32 size;  // number of values covered by the table or bitmap.
+    int32 offset;  // offset into children_ (table) or bits_ (split).
+    int32 child;  // answer (leaf) or "yes" child (split).
+    int32 no_child;  // "no" child (split).
+  };
+
+  // Appends the node for "map" (and, recursively, its children) and returns
+  // its index, or -1 on failure.
+  int32 CompileNode(const EventMap &map);
+
+  EventKeyType min_key_;
+  int32 num_keys_;
+  std::vector<Node> nodes_;  // nodes_[0] is the root.
+  std::vector<int32> children_;  // node indexes for table entries; -1 if NULL.
+  std::vector<uint32> bits_;  // yes-set bitmaps for split nodes.
+};
+
 /**
    This function gets the tree structure of the EventMap "map" in a convenient form.
    If "map" corresponds to a tree structure (not necessarily binary) with leaves
@@ -0,0 +1,163 @@
+// util/active-token-map-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "util/active-token-map.h"
+#include "util/hash-list.h"
+#include "base/timer.h"
+#include <map>  // for baseline.
+
+namespace kaldi {
+
+template<class Int, class T> void TestActiveTokenMap() {
+  typedef typename ActiveTokenMap<Int, T>::Elem Elem;
+
+  ActiveTokenMap<Int, T> map;
+  if (Rand() % 2 == 0)
+    map.SetSize(Rand() % 200);
+  std::map<Int, T> m1;
+  for (size_t j = 0; j < 50; j++) {
+    Int key = Rand() % 200;
+    T val = Rand() % 50;
+    m1[key] = val;
+    T *v = map.Find(key);
+    if (v) *v = val;
+    else map.Insert(key, val);
+  }
+
+  std::map<Int, T> m2;
+  std::vector<Elem> prev;
+
+  for (int i = 0; i < 100; i++) {
+    m2.clear();
+    for (typename std::map<Int, T>::const_iterator iter = m1.begin();
+         iter != m1.end(); ++iter)
+      m2[iter->first + 1] = iter->second;
+    std::swap(m1, m2);
+
+    map.Clear(&prev);
+    KALDI_ASSERT(map.NumElements() == 0);
+    for (size_t j = 0; j < prev.size(); j++)
+      map.Insert(prev[j].key + 1, prev[j].val);
+
+    // Now make sure map and m1 are the same.
+    const std::vector<Elem> &list = map.GetList();
+    KALDI_ASSERT(list.size() == m1.size());
+    for (size_t j = 0; j < list.size(); j++)
+      KALDI_ASSERT(m1[list[j].key] == list[j].val);
+
+    for (size_t j = 0; j < 10; j++) {
+      Int key = Rand() % 200;
+      bool found_m1 = (m1.find(key) != m1.end());
+      T *v = map.Find(key);
+      KALDI_ASSERT((v != NULL) == found_m1);
+      if (found_m1)
+        KALDI_ASSERT(m1[key] == *v);
+    }
+  }
+  map.Clear();
+  KALDI_ASSERT(map.NumElements() == 0 && map.Find(m1.begin()->first) == NULL);
+}
+
+
+// Compares the speed of ActiveTokenMap and HashList on the access pattern of
+// a decoder with a realistic number of active tokens: on each frame, the
+// tokens of the previous frame are iterated over and each is expanded to a
+// few successor states, many of which are already present.  The "graph" is
+// random, with num_states states; the number of active tokens quickly
+// saturates at most of the states.
+void SpeedTestActiveTokenMap() {
+  typedef int32 StateId;
+  int32 num_states = 100000, num_frames = 20, arcs_per_state = 4;
+  std::vector<StateId> successors(num_states * arcs_per_state);
+  for (size_t i = 0; i < successors.size(); i++)
+    successors[i] = Rand() % num_states;
+  double hash_list_time, map_time;
+  uint32 hash_list_sum = 0, map_sum = 0;
+  size_t hash_list_count = 0;
+  {
+    Timer timer;
+    typedef HashList<StateId, uint32>::Elem Elem;
+    HashList<StateId, uint32> toks;
+    toks.SetSize(2 * num_states);
+    toks.Insert(0, 1);
+    for (int32 f = 0; f < num_frames; f++) {
+      Elem *list = toks.Clear(), *tail;
+      for (Elem *e = list; e != NULL; e = tail) {
+        for (int32 a = 0; a < arcs_per_state; a++) {
+          StateId s = successors[e->key * arcs_per_state + a];
+          Elem *e_found = toks.Find(s);
+          if (e_found == NULL) toks.Insert(s, e->val);
+          else e_found->val += e->val;
+        }
+        tail = e->tail;
+        toks.Delete(e);
+      }
+    }
+    Elem *list = toks.Clear(), *tail;
+    for (Elem *e = list; e != NULL; e = tail, hash_list_count++) {
+      hash_list_sum += e->val;
+      tail = e->tail;
+      toks.Delete(e);
+    }
+    hash_list_time = timer.Elapsed();
+  }
+  {
+    Timer timer;
+    typedef ActiveTokenMap<StateId, uint32>::Elem Elem;
+    ActiveTokenMap<StateId, uint32> toks;
+    std::vector<Elem> prev;
+    toks.Insert(0, 1);
+    for (int32 f = 0; f < num_frames; f++) {
+      toks.Clear(&prev);
+      for (size_t n = 0; n < prev.size(); n++) {
+        for (int32 a = 0; a < arcs_per_state; a++) {
+          StateId s = successors[prev[n].key * arcs_per_state + a];
+          uint32 *v = toks.Find(s);
+          if (v == NULL) toks.Insert(s, prev[n].val);
+          else *v += prev[n].val;
+        }
+      }
+    }
+    const std::vector<Elem> &list = toks.GetList();
+    for (size_t i = 0; i < list.size(); i++)
+      map_sum += list[i].val;
+    map_time = timer.Elapsed();
+    // Both structures should have done exactly the same thing.
+    KALDI_ASSERT(list.size() == hash_list_count && map_sum == hash_list_sum);
+  }
+  KALDI_LOG << "For " << hash_list_count << " active tokens and "
+            << num_frames << " frames, HashList took " << hash_list_time
+            << "s, ActiveTokenMap took " << map_time << "s.";
+}
+
+} // end namespace kaldi
+
+
+int main() {
+  using namespace kaldi;
+  for (size_t i = 0; i < 3; i++) {
+    TestActiveTokenMap<int, unsigned int>();
+    TestActiveTokenMap<unsigned int, int>();
+    TestActiveTokenMap<short int, long int>();
+    TestActiveTokenMap<short unsigned int, long int>();
+  }
+  SpeedTestActiveTokenMap();
+  std::cout << "Test OK.\n";
+}
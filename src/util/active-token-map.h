@@ -0,0 +1,186 @@
+// util/active-token-map.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_UTIL_ACTIVE_TOKEN_MAP_H_
+#define KALDI_UTIL_ACTIVE_TOKEN_MAP_H_
+#include <vector>
+#include "base/kaldi-common.h"
+
+
+/* This header provides a flat, open-addressing alternative to HashList (see
+   hash-list.h) for the decoders' map from graph state to token on the current
+   frame.  HashList keeps its elements in a singly linked list and its hash
+   buckets point into that list, so both lookups and iteration over the active
+   tokens chase pointers around memory; once there are tens of thousands of
+   active tokens, this causes a lot of cache misses.
+
+   Here the elements of the current frame are stored contiguously in a
+   std::vector, in insertion order, and the hash is an array of slots (linear
+   probing) holding the key and the index of the element.  The hash is cleared
+   in constant time by incrementing a "generation" counter, so the slots do not
+   have to be rewritten on each frame.
+
+   The decoders' "iterate-and-clear" pattern looks like this:
+      std::vector<Elem> prev;   // typically a class member, to reuse memory.
+      map.Clear(&prev);         // prev now has the old frame's elements.
+      for (size_t i = 0; i < prev.size(); i++)
+        ... map.Insert(new_key, new_val) ...
+   Clear(&prev) swaps the element vectors, so no memory is allocated once the
+   vectors have grown to the size needed.
+
+   See active-token-map-test.cc for an example of how to use this object, and a
+   speed comparison with HashList.
+*/
+
+
+namespace kaldi {
+
+template<class I, class T> class ActiveTokenMap {
+ public:
+  struct Elem {
+    I key;
+    T val;
+  };
+
+  /// Constructor takes no arguments.  You may call SetSize to inform it of the
+  /// likely number of elements, but this is not required: the hash grows as
+  /// needed.
+  ActiveTokenMap(): generation_(1), mask_(0) { SetSize(16); }
+
+  /// Empties the map, putting the elements it held into "*prev" (whose
+  /// previous contents are discarded).  Takes constant time.
+  void Clear(std::vector<Elem> *prev) {
+    prev->swap(elems_);
+    ClearInternal();
+  }
+
+  /// Empties the map, discarding the elements.
+  void Clear() { ClearInternal(); }
+
+  /// Returns the elements currently in the map, in the order in which they
+  /// were inserted.  The reference is invalidated by Insert().
+  const std::vector<Elem> &GetList() const { return elems_; }
+
+  /// Returns the number of elements currently in the map.
+  size_t NumElements() const { return elems_.size(); }
+
+  /// Returns a pointer to the value stored for "key", or NULL if it is not
+  /// present.  The user may modify the value through the pointer.  The pointer
+  /// is invalidated by the next call to Insert().
+  inline T *Find(I key) {
+    size_t i = Hash(key) & mask_;
+    while (true) {
+      const Slot &slot = slots_[i];
+      if (slot.generation != generation_) return NULL;
+      if (slot.key == key) return &(elems_[slot.index].val);
+      i = (i + 1) & mask_;
+    }
+  }
+
+  /// Inserts a new element.  By calling this, the user asserts that "key" is
+  /// not already present (e.g. Find() was called and returned NULL).
+  inline void Insert(I key, T val) {
+    if (2 * (elems_.size() + 1) > slots_.size())
+      Rehash(2 * slots_.size());
+    size_t i = Hash(key) & mask_;
+    while (slots_[i].generation == generation_) {
+      KALDI_PARANOID_ASSERT(slots_[i].key != key);
+      i = (i + 1) & mask_;
+    }
+    Slot &slot = slots_[i];
+    slot.key = key;
+    slot.index = elems_.size();
+    slot.generation = generation_;
+    Elem e;
+    e.key = key;
+    e.val = val;
+    elems_.push_back(e);
+  }
+
+  /// SetSize tells the object the likely number of elements it will have to
+  /// hold, so it can allocate the hash in advance.  It must be called while
+  /// the map is empty.  It never shrinks the hash.
+  void SetSize(size_t num_elements) {
+    KALDI_ASSERT(elems_.empty());
+    size_t num_slots = 2 * num_elements;
+    if (num_slots > slots_.size())
+      Rehash(num_slots);
+  }
+
+  /// Returns the current number of hash slots.
+  size_t Size() const { return slots_.size(); }
+
+ private:
+  struct Slot {
+    I key;
+    int32 index;  // index into elems_.
+    uint32 generation;  // the slot is occupied iff generation == generation_.
+  };
+
+  static inline size_t Hash(I key) {
+    // Multiplicative (Fibonacci) hashing; the shift mixes the high-order
+    // bits of the product into the low-order bits that we use.
+    size_t h = static_cast<size_t>(key) * static_cast<size_t>(2654435769u);
+    return h ^ (h >> 16);
+  }
+
+  void ClearInternal() {
+    elems_.clear();
+    if (++generation_ == 0) {
+      // The generation counter wrapped around (this is very rare); the slots
+      // have to be cleared for real.
+      for (size_t i = 0; i < slots_.size(); i++)
+        slots_[i].generation = 0;
+      generation_ = 1;
+    }
+  }
+
+  // Resizes the hash to the smallest power of two >= num_slots, and
+  // re-inserts the current elements.
+  void Rehash(size_t num_slots) {
+    size_t size = 1;
+    while (size < num_slots) size *= 2;
+    Slot empty;
+    empty.key = I();
+    empty.index = -1;
+    empty.generation = 0;
+    slots_.assign(size, empty);
+    mask_ = size - 1;
+    generation_ = 1;
+    for (size_t e = 0; e < elems_.size(); e++) {
+      size_t i = Hash(elems_[e].key) & mask_;
+      while (slots_[i].generation == generation_)
+        i = (i + 1) & mask_;
+      slots_[i].key = elems_[e].key;
+      slots_[i].index = e;
+      slots_[i].generation = generation_;
+    }
+  }
+
+  std::vector<Elem> elems_;  // the current elements, in insertion order.
+  std::vector<Slot> slots_;  // the hash; its size is a power of two.
+  uint32 generation_;
+  size_t mask_;  // slots_.size() - 1.
+};
+
+
+} // end namespace kaldi
+
+#endif  // KALDI_UTIL_ACTIVE_TOKEN_MAP_H_
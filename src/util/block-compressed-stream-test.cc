@@ -0,0 +1,199 @@
+// util/block-compressed-stream-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <unistd.h>
+#include <sstream>
+
+#include "util/block-compressed-stream.h"
+#include "util/kaldi-io.h"
+#include "util/table-types.h"
+
+namespace kaldi {
+
+// Makes data that is partly compressible: runs of repeated bytes and
+// repeated phrases, mixed with random bytes.
+void GenerateData(size_t size, std::string *data) {
+  data->clear();
+  while (data->size() < size) {
+    switch (RandInt(0, 3)) {
+      case 0:
+        data->append(RandInt(1, 600), static_cast<char>(RandInt(0, 255)));
+        break;
+      case 1:
+        if (data->size() > 100) {
+          size_t start = RandInt(0, data->size() - 100);
+          data->append(data->substr(start, RandInt(4, 100)));
+        }
+        break;
+      default: {
+        int32 n = RandInt(1, 50);
+        for (int32 i = 0; i < n; i++)
+          data->push_back(static_cast<char>(RandInt(0, 255)));
+      }
+    }
+  }
+  data->resize(size);
+}
+
+void UnitTestLz4() {
+  for (int32 i = 0; i < 100; i++) {
+    size_t size = (i < 20 ? i : RandInt(0, 100000));
+    std::string data, compressed;
+    GenerateData(size, &data);
+    Lz4CompressBlock(data.data(), data.size(), &compressed);
+    std::vector<char> output(size + 1);
+    KALDI_ASSERT(Lz4DecompressBlock(compressed.data(), compressed.size(),
+                                    &(output[0]), size));
+    KALDI_ASSERT(std::string(&(output[0]), size) == data);
+    // The wrong output size, or truncated input, must be detected.
+    KALDI_ASSERT(!Lz4DecompressBlock(compressed.data(), compressed.size(),
+                                     &(output[0]), size + 1));
+    if (size > 0)
+      KALDI_ASSERT(!Lz4DecompressBlock(compressed.data(),
+                                       compressed.size() - 1,
+                                       &(output[0]), size));
+  }
+  // Highly compressible data should compress well.
+  std::string zeros(100000, '\0'), compressed;
+  Lz4CompressBlock(zeros.data(), zeros.size(), &compressed);
+  KALDI_ASSERT(compressed.size() < 1000);
+}
+
+void UnitTestBlockCompressedStream() {
+  // Enough data for several batches of blocks.
+  size_t size = (kBlockCompressedNumThreads + 2) * kBlockCompressedBlockSize +
+      RandInt(0, 1000);
+  std::string data;
+  GenerateData(size, &data);
+  std::stringstream ss;
+  {
+    BlockCompressedOutputBuffer buf(&ss);
+    std::ostream os(&buf);
+    for (size_t pos = 0; pos < size; ) {
+      size_t n = std::min<size_t>(RandInt(1, 100000), size - pos);
+      KALDI_ASSERT(static_cast<size_t>(os.tellp()) == pos);
+      os.write(data.data() + pos, n);
+      pos += n;
+    }
+    KALDI_ASSERT(buf.Finish());
+  }
+  KALDI_ASSERT(HasBlockCompressedMagic(ss.str().data(), ss.str().size()));
+  KALDI_ASSERT(ss.str().size() < size);
+  {  // Sequential reading.
+    BlockCompressedInputBuffer buf(&ss);
+    KALDI_ASSERT(buf.Init());
+    std::istream is(&buf);
+    std::string read((std::istreambuf_iterator<char>(is)),
+                     std::istreambuf_iterator<char>());
+    KALDI_ASSERT(read == data);
+  }
+  ss.clear();
+  ss.seekg(0);
+  {  // Random access.
+    BlockCompressedInputBuffer buf(&ss);
+    KALDI_ASSERT(buf.Init());
+    std::istream is(&buf);
+    for (int32 i = 0; i < 20; i++) {
+      size_t pos = RandInt(0, size - 1), n = std::min<size_t>(100, size - pos);
+      is.clear();
+      is.seekg(pos);
+      KALDI_ASSERT(static_cast<size_t>(is.tellg()) == pos);
+      std::string read(n, ' ');
+      is.read(&(read[0]), n);
+      KALDI_ASSERT(is.good() && read == data.substr(pos, n));
+    }
+    is.seekg(0, std::ios::end);
+    KALDI_ASSERT(static_cast<size_t>(is.tellg()) == size);
+    KALDI_ASSERT(is.get() == EOF);
+  }
+  {  // Empty stream.
+    std::stringstream empty;
+    BlockCompressedOutputBuffer out_buf(&empty);
+    KALDI_ASSERT(out_buf.Finish());
+    BlockCompressedInputBuffer in_buf(&empty);
+    KALDI_ASSERT(in_buf.Init());
+    std::istream is(&in_buf);
+    KALDI_ASSERT(is.get() == EOF);
+  }
+}
+
+void UnitTestBlockCompressedTable() {
+  std::vector<std::string> keys;
+  std::vector<Matrix<BaseFloat> > mats;
+  int32 num_mats = RandInt(1, 20);
+  for (int32 i = 0; i < num_mats; i++) {
+    std::ostringstream os;
+    os << "key" << i;
+    keys.push_back(os.str());
+    // Make it compressible: one random row and copies of it.
+    Matrix<BaseFloat> mat(RandInt(1, 300), RandInt(1, 300));
+    mat.Row(0).SetRandn();
+    for (int32 r = 1; r < mat.NumRows(); r++)
+      mat.Row(r).CopyFromVec(mat.Row(0));
+    mats.push_back(mat);
+  }
+  bool binary = (RandInt(0, 1) == 0);
+  {
+    BaseFloatMatrixWriter writer(std::string(binary ? "ark" : "ark,t") +
+                                 ",scp,bc,idx:tmpf.ark,tmpf.scp");
+    for (int32 i = 0; i < num_mats; i++)
+      writer.Write(keys[i], mats[i]);
+    KALDI_ASSERT(writer.Close());
+  }
+  {
+    bool is_binary;
+    Input ki("tmpf.ark", &is_binary);  // The compression is transparent.
+    std::string key;
+    ki.Stream() >> key;
+    KALDI_ASSERT(key == keys[0]);
+  }
+  {
+    SequentialBaseFloatMatrixReader reader("ark:tmpf.ark");
+    int32 i = 0;
+    for (; !reader.Done(); reader.Next(), i++) {
+      KALDI_ASSERT(reader.Key() == keys[i]);
+      KALDI_ASSERT(reader.Value().ApproxEqual(mats[i], 1.0e-04));
+    }
+    KALDI_ASSERT(i == num_mats && reader.Close());
+  }
+  std::string rspecifiers[2] = { "scp:tmpf.scp", "ark,idx:tmpf.ark" };
+  for (int32 r = 0; r < 2; r++) {
+    RandomAccessBaseFloatMatrixReader reader(rspecifiers[r]);
+    for (int32 j = 0; j < 2 * num_mats; j++) {
+      int32 i = RandInt(0, num_mats - 1);
+      KALDI_ASSERT(reader.HasKey(keys[i]));
+      KALDI_ASSERT(reader.Value(keys[i]).ApproxEqual(mats[i], 1.0e-04));
+    }
+    KALDI_ASSERT(!reader.HasKey("foo"));
+  }
+  unlink("tmpf.ark");
+  unlink("tmpf.ark.idx");
+  unlink("tmpf.scp");
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  UnitTestLz4();
+  UnitTestBlockCompressedStream();
+  for (int32 i = 0; i < 5; i++)
+    UnitTestBlockCompressedTable();
+  std::cout << "Test OK.\n";
+}
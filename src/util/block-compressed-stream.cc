@@ -0,0 +1,530 @@
+// util/block-compressed-stream.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <pthread.h>
+#include <algorithm>
+#include <cstring>
+
+#include "util/block-compressed-stream.h"
+
+namespace kaldi {
+
+static const char kBlockCompressedMagic[8] = {
+  '\x89', 'K', 'B', 'C', '\r', '\n', '\x1a', '\n' };
+static const char kBlockCompressedFooterMagic[8] = {
+  'K', 'B', 'C', 'I', 'N', 'D', 'E', 'X' };
+static const size_t kBlockCompressedFooterSize = 24;
+// A sanity limit on the block size, for detecting corrupted files.
+static const uint32 kBlockCompressedMaxBlockSize = 1 << 28;
+
+bool HasBlockCompressedMagic(const char *data, size_t size) {
+  return size >= sizeof(kBlockCompressedMagic) &&
+      std::memcmp(data, kBlockCompressedMagic,
+                  sizeof(kBlockCompressedMagic)) == 0;
+}
+
+static inline void PutUint32(uint32 value, char *p) {
+  for (int32 i = 0; i < 4; i++, value >>= 8)
+    p[i] = static_cast<char>(value & 0xFF);
+}
+
+static inline uint32 GetUint32(const char *p) {
+  uint32 value = 0;
+  for (int32 i = 3; i >= 0; i--)
+    value = (value << 8) | static_cast<unsigned char>(p[i]);
+  return value;
+}
+
+static inline void PutUint64(uint64 value, char *p) {
+  for (int32 i = 0; i < 8; i++, value >>= 8)
+    p[i] = static_cast<char>(value & 0xFF);
+}
+
+static inline uint64 GetUint64(const char *p) {
+  uint64 value = 0;
+  for (int32 i = 7; i >= 0; i--)
+    value = (value << 8) | static_cast<unsigned char>(p[i]);
+  return value;
+}
+
+
+// The constants below are those of the LZ4 block format: matches are at
+// least 4 bytes long, the last 5 bytes of a block are always literals and the
+// last match starts at least 12 bytes before the end of the block.
+static const int32 kLz4HashLog = 16;
+static const size_t kLz4MinMatch = 4;
+static const size_t kLz4LastLiterals = 5;
+static const size_t kLz4MatchFindLimit = 12;
+static const size_t kLz4MaxOffset = 65535;
+
+static inline uint32 Lz4Hash(const char *p) {
+  uint32 value;
+  std::memcpy(&value, p, 4);  // the hash does not need to be portable.
+  return (value * 2654435761U) >> (32 - kLz4HashLog);
+}
+
+// Writes the part of a literal or match length that does not fit in the
+// token.
+static inline void Lz4WriteLength(size_t length, std::string *dest) {
+  for (; length >= 255; length -= 255)
+    dest->push_back(static_cast<char>(255));
+  dest->push_back(static_cast<char>(length));
+}
+
+static inline void Lz4WriteLiterals(const char *src, size_t num_literals,
+                                    size_t match_length, std::string *dest) {
+  size_t token = (std::min<size_t>(num_literals, 15) << 4);
+  if (match_length != 0)
+    token |= std::min<size_t>(match_length - kLz4MinMatch, 15);
+  dest->push_back(static_cast<char>(token));
+  if (num_literals >= 15)
+    Lz4WriteLength(num_literals - 15, dest);
+  dest->append(src, num_literals);
+}
+
+void Lz4CompressBlock(const char *src, size_t size, std::string *dest) {
+  dest->clear();
+  dest->reserve(size + size / 255 + 16);
+  size_t anchor = 0;  // start of the literals not yet written.
+  if (size > kLz4MatchFindLimit) {
+    // Positions of the most recent occurrence of each hashed 4-byte sequence.
+    std::vector<uint32> table(1 << kLz4HashLog, 0);
+    size_t match_limit = size - kLz4MatchFindLimit,
+        match_end_limit = size - kLz4LastLiterals;
+    size_t pos = 1;
+    while (pos < match_limit) {
+      uint32 hash = Lz4Hash(src + pos);
+      size_t candidate = table[hash];
+      table[hash] = pos;
+      if (pos - candidate > kLz4MaxOffset ||
+          std::memcmp(src + candidate, src + pos, kLz4MinMatch) != 0) {
+        pos++;
+        continue;
+      }
+      size_t length = kLz4MinMatch;
+      while (pos + length < match_end_limit &&
+             src[candidate + length] == src[pos + length])
+        length++;
+      while (pos > anchor && candidate > 0 &&
+             src[pos - 1] == src[candidate - 1]) {
+        pos--;
+        candidate--;
+        length++;
+      }
+      Lz4WriteLiterals(src + anchor, pos - anchor, length, dest);
+      size_t offset = pos - candidate;
+      dest->push_back(static_cast<char>(offset & 0xFF));
+      dest->push_back(static_cast<char>(offset >> 8));
+      if (length - kLz4MinMatch >= 15)
+        Lz4WriteLength(length - kLz4MinMatch - 15, dest);
+      pos += length;
+      anchor = pos;
+      if (pos - 2 < match_limit)
+        table[Lz4Hash(src + pos - 2)] = pos - 2;
+    }
+  }
+  Lz4WriteLiterals(src + anchor, size - anchor, 0, dest);
+}
+
+// Reads the part of a length that did not fit in the token; returns false if
+// we reach the end of the input.
+static inline bool Lz4ReadLength(const unsigned char **ip,
+                                 const unsigned char *end, size_t *length) {
+  unsigned char byte;
+  do {
+    if (*ip == end) return false;
+    byte = *((*ip)++);
+    *length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+bool Lz4DecompressBlock(const char *src, size_t src_size,
+                        char *dest, size_t dest_size) {
+  const unsigned char *ip = reinterpret_cast<const unsigned char*>(src),
+      *ip_end = ip + src_size;
+  char *op = dest, *op_end = dest + dest_size;
+  while (ip < ip_end) {
+    size_t token = *(ip++), num_literals = token >> 4;
+    if (num_literals == 15 && !Lz4ReadLength(&ip, ip_end, &num_literals))
+      return false;
+    if (num_literals > static_cast<size_t>(ip_end - ip) ||
+        num_literals > static_cast<size_t>(op_end - op))
+      return false;
+    std::memcpy(op, ip, num_literals);
+    op += num_literals;
+    ip += num_literals;
+    if (ip == ip_end) break;  // The last sequence has no match.
+    if (ip_end - ip < 2) return false;
+    size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+    ip += 2;
+    if (offset == 0 || offset > static_cast<size_t>(op - dest))
+      return false;
+    size_t length = token & 15;
+    if (length == 15 && !Lz4ReadLength(&ip, ip_end, &length))
+      return false;
+    length += kLz4MinMatch;
+    if (length > static_cast<size_t>(op_end - op))
+      return false;
+    const char *match = op - offset;
+    if (offset >= length) {
+      std::memcpy(op, match, length);
+    } else {  // Overlapping match: must copy byte by byte.
+      for (size_t i = 0; i < length; i++)
+        op[i] = match[i];
+    }
+    op += length;
+  }
+  return op == op_end;
+}
+
+
+namespace {
+
+// One block to be compressed or decompressed; see RunBlockJobs().
+struct BlockJob {
+  const char *src;
+  size_t src_size;
+  char *dest;  // for decompression: where to put the output.
+  size_t dest_size;
+  std::string compressed;  // for compression: the output.
+  bool compress;
+  bool ok;
+};
+
+void *RunBlockJob(void *arg) {
+  BlockJob *job = static_cast<BlockJob*>(arg);
+  if (job->compress) {
+    Lz4CompressBlock(job->src, job->src_size, &(job->compressed));
+    job->ok = true;
+  } else if (job->src_size == job->dest_size) {  // stored uncompressed.
+    std::memcpy(job->dest, job->src, job->src_size);
+    job->ok = true;
+  } else {
+    job->ok = Lz4DecompressBlock(job->src, job->src_size,
+                                 job->dest, job->dest_size);
+  }
+  return NULL;
+}
+
+// Runs the jobs in parallel, one thread per job (the first one runs in this
+// thread).  There are at most kBlockCompressedNumThreads jobs, each of which
+// processes about a megabyte, so the cost of creating the threads is small.
+void RunBlockJobs(std::vector<BlockJob> *jobs) {
+  size_t num_jobs = jobs->size();
+  std::vector<pthread_t> threads(num_jobs);
+  std::vector<bool> started(num_jobs, false);
+  for (size_t i = 1; i < num_jobs; i++)
+    started[i] = (pthread_create(&(threads[i]), NULL, RunBlockJob,
+                                 &((*jobs)[i])) == 0);
+  for (size_t i = 0; i < num_jobs; i++)
+    if (!started[i])  // Run it in this thread.
+      RunBlockJob(&((*jobs)[i]));
+  for (size_t i = 1; i < num_jobs; i++)
+    if (started[i])
+      pthread_join(threads[i], NULL);
+}
+
+}  // namespace
+
+
+BlockCompressedOutputBuffer::BlockCompressedOutputBuffer(std::ostream *os):
+    os_(os),
+    buffer_(static_cast<size_t>(kBlockCompressedBlockSize) *
+            kBlockCompressedNumThreads),
+    raw_offset_(0), file_offset_(sizeof(kBlockCompressedMagic)),
+    finished_(false) {
+  os_->write(kBlockCompressedMagic, sizeof(kBlockCompressedMagic));
+  setp(&(buffer_[0]), &(buffer_[0]) + buffer_.size());
+}
+
+void BlockCompressedOutputBuffer::WriteBlocks() {
+  size_t size = pptr() - pbase();
+  std::vector<BlockJob> jobs;
+  for (size_t start = 0; start < size; start += kBlockCompressedBlockSize) {
+    BlockJob job;
+    job.src = pbase() + start;
+    job.src_size = std::min<size_t>(kBlockCompressedBlockSize, size - start);
+    job.dest = NULL;
+    job.dest_size = 0;
+    job.compress = true;
+    job.ok = false;
+    jobs.push_back(job);
+  }
+  RunBlockJobs(&jobs);
+  for (size_t i = 0; i < jobs.size(); i++) {
+    const BlockJob &job = jobs[i];
+    // If compression did not help, store the block uncompressed.
+    bool stored = (job.compressed.size() >= job.src_size);
+    uint32 stored_size = (stored ? job.src_size : job.compressed.size());
+    char header[8];
+    PutUint32(stored_size, header);
+    PutUint32(job.src_size, header + 4);
+    os_->write(header, sizeof(header));
+    os_->write(stored ? job.src : job.compressed.data(), stored_size);
+    index_.push_back(std::pair<uint64, uint64>(raw_offset_, file_offset_));
+    raw_offset_ += job.src_size;
+    file_offset_ += sizeof(header) + stored_size;
+  }
+  setp(&(buffer_[0]), &(buffer_[0]) + buffer_.size());
+}
+
+BlockCompressedOutputBuffer::int_type
+BlockCompressedOutputBuffer::overflow(int_type c) {
+  if (finished_) return traits_type::eof();
+  WriteBlocks();
+  if (!os_->good()) return traits_type::eof();
+  if (traits_type::eq_int_type(c, traits_type::eof()))
+    return traits_type::not_eof(c);
+  *pptr() = traits_type::to_char_type(c);
+  pbump(1);
+  return c;
+}
+
+int BlockCompressedOutputBuffer::sync() {
+  // We don't write out the partial block here, as flushing after every object
+  // (or every line, with std::endl) would then produce tiny blocks; the data
+  // is written when the block is full, or by Finish().
+  os_->flush();
+  return os_->good() ? 0 : -1;
+}
+
+BlockCompressedOutputBuffer::pos_type
+BlockCompressedOutputBuffer::seekoff(off_type off, std::ios_base::seekdir dir,
+                                     std::ios_base::openmode which) {
+  // Only "tell" is supported.
+  if (off != 0 || dir != std::ios_base::cur || !(which & std::ios_base::out))
+    return pos_type(off_type(-1));
+  return pos_type(off_type(raw_offset_ + (pptr() - pbase())));
+}
+
+bool BlockCompressedOutputBuffer::Finish() {
+  if (finished_) return os_->good();
+  WriteBlocks();
+  finished_ = true;
+  std::vector<char> trailer(8 + 16 * index_.size() +
+                            kBlockCompressedFooterSize);
+  char *p = &(trailer[0]);
+  PutUint32(0, p);  // The terminator.
+  PutUint32(0, p + 4);
+  p += 8;
+  for (size_t i = 0; i < index_.size(); i++, p += 16) {
+    PutUint64(index_[i].first, p);
+    PutUint64(index_[i].second, p + 8);
+  }
+  PutUint64(index_.size(), p);
+  PutUint64(raw_offset_, p + 8);
+  std::memcpy(p + 16, kBlockCompressedFooterMagic,
+              sizeof(kBlockCompressedFooterMagic));
+  os_->write(&(trailer[0]), trailer.size());
+  os_->flush();
+  return os_->good();
+}
+
+
+BlockCompressedInputBuffer::BlockCompressedInputBuffer(std::istream *is):
+    is_(is), buffer_start_(0), at_end_(false), raw_size_(0) {
+  setg(NULL, NULL, NULL);
+}
+
+bool BlockCompressedInputBuffer::Init() {
+  char magic[sizeof(kBlockCompressedMagic)];
+  is_->read(magic, sizeof(magic));
+  if (!is_->good() || !HasBlockCompressedMagic(magic, sizeof(magic))) {
+    KALDI_WARN << "Stream is not in the block-compressed format.";
+    return false;
+  }
+  // Try to read the index from the footer.  If the stream cannot seek we can
+  // still read it sequentially.
+  std::streampos data_start = is_->tellg();
+  if (data_start == std::streampos(-1) ||
+      !is_->seekg(-static_cast<off_type>(kBlockCompressedFooterSize),
+                  std::ios_base::end)) {
+    is_->clear();
+    return true;
+  }
+  char footer[kBlockCompressedFooterSize];
+  is_->read(footer, sizeof(footer));
+  uint64 num_blocks = GetUint64(footer);
+  raw_size_ = GetUint64(footer + 8);
+  if (!is_->good() ||
+      std::memcmp(footer + 16, kBlockCompressedFooterMagic,
+                  sizeof(kBlockCompressedFooterMagic)) != 0 ||
+      num_blocks > (uint64(1) << 40)) {
+    KALDI_WARN << "Block-compressed file has no valid index (truncated file?)";
+    return false;
+  }
+  std::vector<char> index_data(16 * num_blocks);
+  off_type index_start = kBlockCompressedFooterSize + index_data.size();
+  if (num_blocks > 0) {
+    if (!is_->seekg(-index_start, std::ios_base::end) ||
+        !is_->read(&(index_data[0]), index_data.size())) {
+      KALDI_WARN << "Error reading index of block-compressed file.";
+      return false;
+    }
+  }
+  index_.resize(num_blocks);
+  for (size_t i = 0; i < num_blocks; i++) {
+    index_[i].first = GetUint64(&(index_data[16 * i]));
+    index_[i].second = GetUint64(&(index_data[16 * i + 8]));
+    if (i > 0 && !(index_[i].first > index_[i-1].first &&
+                   index_[i].second > index_[i-1].second)) {
+      KALDI_WARN << "Index of block-compressed file is corrupted.";
+      return false;
+    }
+  }
+  is_->clear();
+  return static_cast<bool>(is_->seekg(data_start));
+}
+
+bool BlockCompressedInputBuffer::ReadBlocks(int32 max_blocks) {
+  std::vector<std::string> stored(max_blocks);
+  std::vector<BlockJob> jobs;
+  size_t raw_size = 0;
+  for (int32 i = 0; i < max_blocks; i++) {
+    char header[8];
+    if (!is_->read(header, sizeof(header))) {
+      KALDI_WARN << "Block-compressed stream ended without a terminator "
+                 << "(truncated file?)";
+      at_end_ = true;
+      break;
+    }
+    uint32 stored_size = GetUint32(header), block_size = GetUint32(header + 4);
+    if (block_size == 0) {
+      at_end_ = true;
+      break;
+    }
+    if (stored_size > block_size || block_size > kBlockCompressedMaxBlockSize) {
+      KALDI_WARN << "Corrupted block in block-compressed stream.";
+      at_end_ = true;
+      break;
+    }
+    stored[i].resize(stored_size);
+    if (!is_->read(&(stored[i][0]), stored_size)) {
+      KALDI_WARN << "Error reading block-compressed stream (truncated file?)";
+      at_end_ = true;
+      break;
+    }
+    BlockJob job;
+    job.src = stored[i].data();
+    job.src_size = stored_size;
+    job.dest = NULL;
+    job.dest_size = block_size;
+    job.compress = false;
+    job.ok = false;
+    jobs.push_back(job);
+    raw_size += block_size;
+  }
+  buffer_.resize(raw_size);
+  for (size_t i = 0, offset = 0; i < jobs.size(); i++) {
+    jobs[i].dest = &(buffer_[0]) + offset;
+    offset += jobs[i].dest_size;
+  }
+  RunBlockJobs(&jobs);
+  for (size_t i = 0; i < jobs.size(); i++) {
+    if (!jobs[i].ok) {
+      KALDI_WARN << "Error decompressing block of block-compressed stream.";
+      at_end_ = true;
+      raw_size = 0;
+    }
+  }
+  if (raw_size == 0) {
+    setg(NULL, NULL, NULL);
+    return false;
+  }
+  setg(&(buffer_[0]), &(buffer_[0]), &(buffer_[0]) + raw_size);
+  return true;
+}
+
+BlockCompressedInputBuffer::int_type BlockCompressedInputBuffer::underflow() {
+  if (gptr() < egptr())
+    return traits_type::to_int_type(*gptr());
+  buffer_start_ += egptr() - eback();
+  setg(NULL, NULL, NULL);
+  if (at_end_ || !ReadBlocks(kBlockCompressedNumThreads))
+    return traits_type::eof();
+  return traits_type::to_int_type(*gptr());
+}
+
+bool BlockCompressedInputBuffer::Seek(uint64 pos) {
+  uint64 buffer_end = buffer_start_ + (egptr() - eback());
+  if (pos >= buffer_start_ && pos < buffer_end) {
+    setg(eback(), eback() + (pos - buffer_start_), egptr());
+    return true;
+  }
+  if (index_.empty() && raw_size_ == 0) {
+    if (pos == buffer_end) {  // We may be at the end of an empty file.
+      setg(eback(), egptr(), egptr());
+      return true;
+    }
+    KALDI_WARN << "Cannot seek in block-compressed stream without an index.";
+    return false;
+  }
+  if (pos >= raw_size_) {
+    if (pos > raw_size_) return false;
+    buffer_start_ = raw_size_;  // Seek to the end.
+    at_end_ = true;
+    setg(NULL, NULL, NULL);
+    return true;
+  }
+  // Find the last block starting at or before pos.
+  std::vector<std::pair<uint64, uint64> >::const_iterator iter =
+      std::upper_bound(index_.begin(), index_.end(),
+                       std::pair<uint64, uint64>(pos, ~static_cast<uint64>(0)));
+  KALDI_ASSERT(iter != index_.begin());
+  --iter;
+  is_->clear();
+  if (!is_->seekg(iter->second, std::ios_base::beg))
+    return false;
+  buffer_start_ = iter->first;
+  at_end_ = false;
+  if (!ReadBlocks(1) || pos >= buffer_start_ + (egptr() - eback()))
+    return false;
+  setg(eback(), eback() + (pos - buffer_start_), egptr());
+  return true;
+}
+
+BlockCompressedInputBuffer::pos_type
+BlockCompressedInputBuffer::seekoff(off_type off, std::ios_base::seekdir dir,
+                                    std::ios_base::openmode which) {
+  if (!(which & std::ios_base::in))
+    return pos_type(off_type(-1));
+  off_type target;
+  if (dir == std::ios_base::beg) {
+    target = off;
+  } else if (dir == std::ios_base::cur) {
+    if (off == 0) return pos_type(off_type(Tell()));
+    target = Tell() + off;
+  } else {
+    if (index_.empty() && raw_size_ == 0)
+      return pos_type(off_type(-1));
+    target = raw_size_ + off;
+  }
+  if (target < 0 || !Seek(target))
+    return pos_type(off_type(-1));
+  return pos_type(target);
+}
+
+BlockCompressedInputBuffer::pos_type
+BlockCompressedInputBuffer::seekpos(pos_type pos,
+                                    std::ios_base::openmode which) {
+  return seekoff(off_type(pos), std::ios_base::beg, which);
+}
+
+}  // end namespace kaldi
@@ -0,0 +1,169 @@
+// util/block-compressed-stream.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_UTIL_BLOCK_COMPRESSED_STREAM_H_
+#define KALDI_UTIL_BLOCK_COMPRESSED_STREAM_H_
+
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/kaldi-common.h"
+
+namespace kaldi {
+
+/// \addtogroup io_group
+/// @{
+
+/*
+  This header implements the "block-compressed" file format, which is what
+  the "bc" wspecifier option (e.g. "ark,bc:foo.ark") writes.  Reading it is
+  transparent: the Input class recognizes the format from its first byte, so
+  "ark:foo.ark" and "foo.ark:1234" work exactly as if the file were not
+  compressed.  Offsets into block-compressed files (as in scp files, and the
+  index files written by the "idx" option) always refer to positions in the
+  uncompressed data.
+
+  The data is split into blocks of kBlockCompressedBlockSize bytes, which are
+  each compressed independently with the LZ4 block format, which is very fast
+  to decompress.  Up to kBlockCompressedNumThreads blocks are compressed or
+  decompressed in parallel.  The file format is:
+
+    magic             8 bytes, "\x89KBC\r\n\x1a\n"
+    per block:        uint32 stored_size, uint32 raw_size, then stored_size
+                      bytes: if stored_size == raw_size the block is stored
+                      uncompressed, else it is LZ4-compressed.
+    terminator:       uint32 0, uint32 0
+    index:            for each block, uint64 raw_offset, uint64 file_offset
+    footer:           uint64 num_blocks, uint64 raw_size, 8 bytes "KBCINDEX"
+
+  All integers are little-endian.  The index lets us seek without
+  decompressing the whole file; the terminator lets us read the file
+  sequentially from a stream that cannot seek.
+*/
+
+/// The uncompressed size of the blocks of a block-compressed file
+/// (the last block may be smaller).
+static const int32 kBlockCompressedBlockSize = 1 << 20;
+
+/// The number of blocks we compress or decompress in parallel.
+static const int32 kBlockCompressedNumThreads = 4;
+
+/// Returns true if "data", which is the first "size" bytes of a file, starts
+/// with the magic string of the block-compressed format.
+bool HasBlockCompressedMagic(const char *data, size_t size);
+
+/// Compresses "size" bytes at "src" into "dest" using the LZ4 block format.
+void Lz4CompressBlock(const char *src, size_t size, std::string *dest);
+
+/// Decompresses LZ4 block-format data at "src" into exactly "dest_size"
+/// bytes at "dest".  Returns false if the data was corrupt or did not
+/// decompress to exactly dest_size bytes.
+bool Lz4DecompressBlock(const char *src, size_t src_size,
+                        char *dest, size_t dest_size);
+
+
+/// A streambuf that block-compresses the data written to it and writes the
+/// result to another stream.  You must call Finish() once all the data has
+/// been written, otherwise the file will not be readable.  The stream
+/// position (e.g. as returned by tellp()) is the position in the
+/// uncompressed data.
+class BlockCompressedOutputBuffer: public std::streambuf {
+ public:
+  /// Writes the magic string to "os", which must stay alive until
+  /// Finish() is called.
+  explicit BlockCompressedOutputBuffer(std::ostream *os);
+
+  /// Writes out any data not yet written, then the terminator and the
+  /// index.  Returns true if everything was written successfully.
+  bool Finish();
+
+  virtual ~BlockCompressedOutputBuffer() { }
+
+ protected:
+  virtual int_type overflow(int_type c);
+  virtual int sync();
+  virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                           std::ios_base::openmode which);
+ private:
+  // Compresses the data in the put area and writes it to os_ as one or more
+  // blocks.
+  void WriteBlocks();
+
+  std::ostream *os_;
+  std::vector<char> buffer_;  // the put area.
+  uint64 raw_offset_;  // uncompressed size of the blocks written so far.
+  uint64 file_offset_;  // number of bytes written to os_ so far.
+  // (raw_offset, file_offset) for each block written so far.
+  std::vector<std::pair<uint64, uint64> > index_;
+  bool finished_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(BlockCompressedOutputBuffer);
+};
+
+
+/// A streambuf that reads a block-compressed file from another stream and
+/// presents the uncompressed data.  If the underlying stream is seekable,
+/// seeking (to positions in the uncompressed data) is supported.
+class BlockCompressedInputBuffer: public std::streambuf {
+ public:
+  /// "is" must stay alive as long as this object; it must be positioned at
+  /// the start of the file.
+  explicit BlockCompressedInputBuffer(std::istream *is);
+
+  /// Reads and checks the magic string, and the index if the stream is
+  /// seekable.  Returns false (with a warning) on error.
+  bool Init();
+
+  /// Seeks to position "pos" in the uncompressed data; returns false on
+  /// failure, e.g. if the underlying stream is not seekable.
+  bool Seek(uint64 pos);
+
+  /// Returns the current position in the uncompressed data.
+  uint64 Tell() const { return buffer_start_ + (gptr() - eback()); }
+
+  virtual ~BlockCompressedInputBuffer() { }
+
+ protected:
+  virtual int_type underflow();
+  virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                           std::ios_base::openmode which);
+  virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which);
+ private:
+  // Reads up to "max_blocks" blocks from the current position of is_ and
+  // decompresses them into buffer_, which becomes the get area.  Returns
+  // false if there were no more blocks, or on error.
+  bool ReadBlocks(int32 max_blocks);
+
+  std::istream *is_;
+  std::vector<char> buffer_;  // the get area (decompressed data).
+  uint64 buffer_start_;  // position of buffer_[0] in the uncompressed data.
+  bool at_end_;  // true if we have reached the terminator.
+  // (raw_offset, file_offset) for each block; empty if is_ is not seekable.
+  std::vector<std::pair<uint64, uint64> > index_;
+  uint64 raw_size_;  // total uncompressed size, if index_ was read.
+  KALDI_DISALLOW_COPY_AND_ASSIGN(BlockCompressedInputBuffer);
+};
+
+/// @} end "addtogroup io_group"
+
+}  // end namespace kaldi
+
+#endif  // KALDI_UTIL_BLOCK_COMPRESSED_STREAM_H_
@@ -39,6 +39,8 @@ template<class I, class T> void HashList<I, T>::SetSize(size_t size) {
   KALDI_ASSERT(list_head_ == NULL && bucket_list_tail_ == static_cast<size_t>(-1));  // make sure empty.
   if (size > buckets_.size())
     buckets_.resize(size, HashBucket(0, NULL));
+  memory_stats_.Set(buckets_.capacity() * sizeof(HashBucket) +
+                    allocated_.size() * allocate_block_size_ * sizeof(Elem));
 }
 
 template<class I, class T>
@@ -97,6 +99,8 @@ inline typename HashList<I, T>::Elem* HashList<I, T>::New() {
     tmp[allocate_block_size_-1].tail = NULL;
     freed_head_ = tmp;
     allocated_.push_back(tmp);
+    memory_stats_.Set(buckets_.capacity() * sizeof(HashBucket) +
+                      allocated_.size() * allocate_block_size_ * sizeof(Elem));
     return this->New();
   }
 }
@@ -26,6 +26,7 @@
 #include <algorithm>
 #include <limits>
 #include <cassert>
+#include "base/kaldi-memory-stats.h"
 #include "util/stl-utils.h"
 
 
@@ -128,6 +129,10 @@ template<class I, class T> class HashList {
 
   std::vector<Elem*> allocated_;  // list of allocated blocks.
 
+  // The size of the buckets and of the blocks of Elems, for the memory
+  // statistics (see base/kaldi-memory-stats.h).
+  MemoryStatsEstimate memory_stats_;
+
   static const size_t allocate_block_size_ = 1024;  // Number of Elements to allocate in one block.  Must be
   // largish so storing allocated_ doesn't become a problem.
 };
@@ -55,6 +55,8 @@ template<class KaldiType> class KaldiObjectHolder {
     }
   }
 
+  void Swap(KaldiObjectHolder<KaldiType> *other) { std::swap(t_, other->t_); }
+
   void Clear() {
     if (t_) {
       delete t_;
@@ -126,6 +128,8 @@ template<class BasicType> class BasicHolder {
     }
   }
 
+  void Swap(BasicHolder<BasicType> *other) { std::swap(t_, other->t_); }
+
   void Clear() { }
 
   // Reads into the holder.
@@ -203,11 +207,12 @@ template<class BasicType> class BasicVectorHolder {
         // Or this Write routine cannot handle such a large vector.
         // use int32 because it's fixed size regardless of compilation.
         // change to int64 (plus in Read function) if this becomes a problem.
+        // The "BV" token marks the bulk format, in which the elements are
+        // written as a single block; see ReadBasicTypeArray().  Read() also
+        // accepts the older format, with a type-size byte for each element.
+        WriteToken(os, binary, "BV");
         WriteBasicType(os, binary, static_cast<int32>(t.size()));
-        for (typename std::vector<BasicType>::const_iterator iter = t.begin();
-            iter != t.end(); ++iter)
-          WriteBasicType(os, binary, *iter);
-
+        WriteBasicTypeArray(os, (t.empty() ? NULL : &(t[0])), t.size());
       } else {
         for (typename std::vector<BasicType>::const_iterator iter = t.begin();
             iter != t.end(); ++iter)
@@ -224,6 +229,8 @@ template<class BasicType> class BasicVectorHolder {
     }
   }
 
+  void Swap(BasicVectorHolder<BasicType> *other) { t_.swap(other->t_); }
+
   void Clear() { t_.clear(); }
 
   // Reads into the holder.
@@ -260,13 +267,24 @@ template<class BasicType> class BasicVectorHolder {
     } else {  // binary mode.
       size_t filepos = is.tellg();
       try {
+        // The older format starts with the type-size byte of the int32
+        // size, so can't start with 'B'.
+        bool bulk = (is.peek() == 'B');
+        if (bulk)
+          ExpectToken(is, true, "BV");
         int32 size;
         ReadBasicType(is, true, &size);
+        if (size < 0)
+          KALDI_ERR << "Negative size " << size;
         t_.resize(size);
-        for (typename std::vector<BasicType>::iterator iter = t_.begin();
-            iter != t_.end();
-            ++iter) {
-          ReadBasicType(is, true, &(*iter));
+        if (bulk) {
+          ReadBasicTypeArray(is, t_.size(), (t_.empty() ? NULL : &(t_[0])));
+        } else {
+          for (typename std::vector<BasicType>::iterator iter = t_.begin();
+              iter != t_.end();
+              ++iter) {
+            ReadBasicType(is, true, &(*iter));
+          }
         }
         return true;
       } catch (...) {
@@ -308,16 +326,27 @@ template<class BasicType> class BasicVectorVectorHolder {
         // Or this Write routine cannot handle such a large vector.
         // use int32 because it's fixed size regardless of compilation.
         // change to int64 (plus in Read function) if this becomes a problem.
+        // The "BVV" token marks the bulk format: the number of vectors, then
+        // all their sizes as one block, then all their elements concatenated
+        // as one block.  Read() also accepts the older format, with a
+        // type-size byte for each size and element.
+        WriteToken(os, binary, "BVV");
         WriteBasicType(os, binary, static_cast<int32>(t.size()));
-        for (typename std::vector<std::vector<BasicType> >::const_iterator iter = t.begin();
-            iter != t.end(); ++iter) {
-          KALDI_ASSERT(static_cast<size_t>(static_cast<int32>(iter->size())) == iter->size());
-          WriteBasicType(os, binary, static_cast<int32>(iter->size()));
-          for (typename std::vector<BasicType>::const_iterator iter2=iter->begin();
-              iter2 != iter->end(); ++iter2) {
-            WriteBasicType(os, binary, *iter2);
-          }
+        std::vector<int32> sizes(t.size());
+        size_t total_size = 0;
+        for (size_t i = 0; i < t.size(); i++) {
+          KALDI_ASSERT(static_cast<size_t>(static_cast<int32>(t[i].size())) == t[i].size());
+          sizes[i] = t[i].size();
+          total_size += t[i].size();
         }
+        WriteBasicTypeArray(os, (sizes.empty() ? NULL : &(sizes[0])),
+                            sizes.size());
+        std::vector<BasicType> data;
+        data.reserve(total_size);
+        for (size_t i = 0; i < t.size(); i++)
+          data.insert(data.end(), t[i].begin(), t[i].end());
+        WriteBasicTypeArray(os, (data.empty() ? NULL : &(data[0])),
+                            data.size());
       } else {  // text mode...
         // In text mode, we write out something like (for integers):
         // "1 2 3 ; 4 5 ; 6 ; ; 7 8 9 ;\n"
@@ -342,6 +371,8 @@ template<class BasicType> class BasicVectorVectorHolder {
     }
   }
 
+  void Swap(BasicVectorVectorHolder<BasicType> *other) { t_.swap(other->t_); }
+
   void Clear() { t_.clear(); }
 
   // Reads into the holder.
@@ -386,6 +417,33 @@ template<class BasicType> class BasicVectorVectorHolder {
     } else {  // binary mode.
       size_t filepos = is.tellg();
       try {
+        if (is.peek() == 'B') {  // The bulk format; see Write().
+          ExpectToken(is, true, "BVV");
+          int32 size;
+          ReadBasicType(is, true, &size);
+          if (size < 0)
+            KALDI_ERR << "Negative size " << size;
+          std::vector<int32> sizes(size);
+          ReadBasicTypeArray(is, sizes.size(),
+                             (sizes.empty() ? NULL : &(sizes[0])));
+          size_t total_size = 0;
+          for (size_t i = 0; i < sizes.size(); i++) {
+            if (sizes[i] < 0)
+              KALDI_ERR << "Negative size " << sizes[i];
+            total_size += sizes[i];
+          }
+          std::vector<BasicType> data(total_size);
+          ReadBasicTypeArray(is, data.size(),
+                             (data.empty() ? NULL : &(data[0])));
+          t_.resize(size);
+          typename std::vector<BasicType>::const_iterator data_iter =
+              data.begin();
+          for (size_t i = 0; i < sizes.size(); i++) {
+            t_[i].assign(data_iter, data_iter + sizes[i]);
+            data_iter += sizes[i];
+          }
+          return true;
+        }
         int32 size;
         ReadBasicType(is, true, &size);
         t_.resize(size);
@@ -468,6 +526,8 @@ template<class BasicType> class BasicPairVectorHolder {
     }
   }
   
+  void Swap(BasicPairVectorHolder<BasicType> *other) { t_.swap(other->t_); }
+
   void Clear() { t_.clear(); }
 
   // Reads into the holder.
@@ -572,6 +632,8 @@ class TokenHolder {
     return os.good();
   }
 
+  void Swap(TokenHolder *other) { t_.swap(other->t_); }
+
   void Clear() { t_.clear(); }
 
   // Reads into the holder.
@@ -621,6 +683,8 @@ class TokenVectorHolder {
     return os.good();
   }
 
+  void Swap(TokenVectorHolder *other) { t_.swap(other->t_); }
+
   void Clear() { t_.clear(); }
 
 
@@ -669,6 +733,8 @@ class SegmentHolder {
       return os.good();
     }
 
+    void Swap(SegmentHolder *other) { std::swap(t_, other->t_); }
+
     void Clear() { 
       t_.reco_id.clear();
       t_.channel_id.clear();
@@ -736,6 +802,11 @@ class HtkMatrixHolder {
     return ans;
   }
 
+  void Swap(HtkMatrixHolder *other) {
+    t_.first.Swap(&other->t_.first);
+    std::swap(t_.second, other->t_.second);
+  }
+
   void Clear() { t_.first.Resize(0, 0); }
 
   // Reads into the holder.
@@ -777,6 +848,8 @@ template<int kFeatDim> class SphinxMatrixHolder {
 
   SphinxMatrixHolder() {}
 
+  void Swap(SphinxMatrixHolder<kFeatDim> *other) { feats_.Swap(&other->feats_); }
+
   void Clear() { feats_.Resize(0, 0); }
 
   // Writes Sphinx-format features
@@ -126,6 +126,12 @@ template<class SomeType> class GenericHolder {
   /// true (so OK to throw exception if no object was read).
   const T &Value() const { return t_; } // if t is a pointer, would return *t_;
 
+  /// Swap() exchanges the contents of this Holder with those of "other"; it
+  /// should be cheap (e.g. swapping pointers or calling std::vector::swap()),
+  /// as it is used by the background-reading code to hand the objects read
+  /// by a separate thread to the user without copying them.
+  void Swap(GenericHolder<T> *other) { std::swap(t_, other->t_); }
+
   /// The Clear() function doesn't have to do anything.  Its purpose is to
   /// allow the object to free resources if they're no longer needed.
   void Clear() { }
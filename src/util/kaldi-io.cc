@@ -20,6 +20,9 @@
 #include "base/kaldi-math.h"
 #include "util/text-utils.h"
 #include "util/parse-options.h"
+#include "util/block-compressed-stream.h"
+#include "util/remote-file.h"
+#include "util/table-io-stats.h"
 #include <cstdlib>
 #include <errno.h>
 
@@ -93,7 +96,13 @@ OutputType ClassifyWxfilename(const std::string &filename) {
     while (d[1] != '\0') d++;  // go to last char.
     if (*d == '|' || isspace(*d)) return kNoOutput;  // An input pipe (not allowed in
     // this context) or trailing space which is just wrong.
-    else if (isdigit(*d)) {
+    else if (GetRemoteFileBackend(filename) != NULL) {
+      // e.g. s3://bucket/foo.ark: we can read these (see remote-file.h) but
+      // not write them, and we don't want to create a local file "s3:".
+      KALDI_WARN << "Writing remote files is not supported (use a pipe): "
+                 << filename;
+      return kNoOutput;
+    } else if (isdigit(*d)) {
       // OK, it could be a file, but we have to see if it's an offset into a file,
       // which is not allowed.
       while (isdigit(*d) && d > c) d--;
@@ -133,7 +142,9 @@ InputType ClassifyRxfilename(const std::string &filename) {
     while (d[1] != '\0') d++;  // go to last char.
     if (*d == '|') return kPipeInput;  // an input pipe.
     if (isspace(*d)) return kNoInput;  // trailing space which is never valid.
-    else if (isdigit(*d)) {
+    else if (GetRemoteFileBackend(filename) != NULL) {
+      return kRemoteInput;  // e.g. s3://bucket/foo.ark, or with an offset.
+    } else if (isdigit(*d)) {
       // OK, it could be an offset into a file
       // which is not allowed.
       while (isdigit(*d) && d > c) d--;
@@ -200,6 +211,53 @@ class FileOutputImpl: public OutputImplBase {
   std::ofstream os_;
 };
 
+// Writes a file in the block-compressed format (see
+// block-compressed-stream.h).  The file is always opened in binary mode, as
+// the compressed data is binary even if what we write to it is text.
+class BlockCompressedFileOutputImpl: public OutputImplBase {
+ public:
+  BlockCompressedFileOutputImpl(): buf_(NULL), stream_(NULL) { }
+
+  virtual bool Open(const std::string &filename, bool binary) {
+    if (os_.is_open()) KALDI_ERR << "BlockCompressedFileOutputImpl::Open(), "
+                                << "open called on already open file.";
+    filename_ = filename;
+    os_.open(MapOsPath(filename_).c_str(),
+             std::ios_base::out | std::ios_base::binary);
+    if (!os_.is_open()) return false;
+    buf_ = new BlockCompressedOutputBuffer(&os_);
+    stream_ = new std::ostream(buf_);
+    return os_.good();
+  }
+
+  virtual std::ostream &Stream() {
+    if (stream_ == NULL)
+      KALDI_ERR << "BlockCompressedFileOutputImpl::Stream(), file is not open.";
+    return *stream_;
+  }
+
+  virtual bool Close() {
+    if (stream_ == NULL)
+      KALDI_ERR << "BlockCompressedFileOutputImpl::Close(), file is not open.";
+    bool ok = stream_->good() && buf_->Finish();
+    delete stream_;
+    stream_ = NULL;
+    delete buf_;
+    buf_ = NULL;
+    os_.close();
+    return ok && !os_.fail();
+  }
+  virtual ~BlockCompressedFileOutputImpl() {
+    if (stream_ != NULL && !Close())
+      KALDI_ERR << "Error closing output file " << filename_;
+  }
+ private:
+  std::string filename_;
+  std::ofstream os_;
+  BlockCompressedOutputBuffer *buf_;
+  std::ostream *stream_;
+};
+
 class StandardOutputImpl: public OutputImplBase {
  public:
   StandardOutputImpl(): is_open_(false) { }
@@ -336,6 +394,56 @@ class InputImplBase {
   virtual ~InputImplBase() { }
 };
 
+// This is used by FileInputImpl and OffsetFileInputImpl to read files in the
+// block-compressed format (see block-compressed-stream.h) transparently.  We
+// recognize them from their first byte, which can't be the first byte of an
+// archive, of a Kaldi binary object or of normal text.
+class BlockCompressedFileReader {
+ public:
+  BlockCompressedFileReader(): buf_(NULL), stream_(NULL) { }
+
+  // To be called after opening the file "is".  Returns false if the file
+  // looks block-compressed but is corrupted.
+  bool Init(std::ifstream *is) {
+    Reset();
+    if (is->peek() != static_cast<unsigned char>('\x89')) {
+      is->clear();  // peek() sets eofbit if the file is empty.
+      return true;
+    }
+    buf_ = new BlockCompressedInputBuffer(is);
+    if (!buf_->Init()) {
+      Reset();
+      return false;
+    }
+    stream_ = new std::istream(buf_);
+    return true;
+  }
+
+  // Returns the stream for the uncompressed data, or NULL if the file is not
+  // block-compressed.
+  std::istream *Stream() { return stream_; }
+
+  // Seeks to position "offset" in the uncompressed data.
+  bool Seek(size_t offset) {
+    KALDI_ASSERT(stream_ != NULL);
+    stream_->clear();
+    return buf_->Seek(offset);
+  }
+
+  void Reset() {
+    delete stream_;
+    stream_ = NULL;
+    delete buf_;
+    buf_ = NULL;
+  }
+
+  ~BlockCompressedFileReader() { Reset(); }
+ private:
+  BlockCompressedInputBuffer *buf_;
+  std::istream *stream_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(BlockCompressedFileReader);
+};
+
 class FileInputImpl: public InputImplBase {
  public:
   virtual bool Open(const std::string &filename, bool binary) {
@@ -344,18 +452,21 @@ class FileInputImpl: public InputImplBase {
     is_.open(MapOsPath(filename).c_str(),
              binary ? std::ios_base::in | std::ios_base::binary
                     : std::ios_base::in);
-    return is_.is_open();
+    return is_.is_open() && compressed_.Init(&is_);
   }
 
   virtual std::istream &Stream() {
     if (!is_.is_open()) KALDI_ERR << "FileInputImpl::Stream(), file is not open.";
     // I believe this error can only arise from coding error.
+    if (compressed_.Stream() != NULL)
+      return *compressed_.Stream();
     return is_;
   }
 
   virtual void Close() {
     if (!is_.is_open()) KALDI_ERR << "FileInputImpl::Close(), file is not open.";
     // I believe this error can only arise from coding error.
+    compressed_.Reset();
     is_.close();
     // Don't check status.
   }
@@ -368,6 +479,7 @@ class FileInputImpl: public InputImplBase {
   }
  private:
   std::ifstream is_;
+  BlockCompressedFileReader compressed_;
 };
 
 
@@ -524,6 +636,8 @@ class OffsetFileInputImpl: public InputImplBase {
   }
 
   bool Seek(size_t offset) {
+    if (compressed_.Stream() != NULL)  // Offsets are in the uncompressed data.
+      return compressed_.Seek(offset);
     size_t cur_pos = is_.tellg();
     if (cur_pos == offset) return true;
     else if (cur_pos<offset && cur_pos+100 > offset) {
@@ -559,12 +673,13 @@ class OffsetFileInputImpl: public InputImplBase {
         is_.clear();  // clear fail bit, etc.
         return Seek(offset);
       } else {
+        compressed_.Reset();
         is_.close();  // don't bother checking error status of is_.
         filename_ = tmp_filename;
         is_.open(MapOsPath(filename_).c_str(),
                  binary ? std::ios_base::in | std::ios_base::binary
                         : std::ios_base::in);
-        if (!is_.is_open()) return false;
+        if (!is_.is_open() || !compressed_.Init(&is_)) return false;
         else return Seek(offset);
       }
     } else {
@@ -574,7 +689,7 @@ class OffsetFileInputImpl: public InputImplBase {
       is_.open(MapOsPath(filename_).c_str(),
                 binary ? std::ios_base::in | std::ios_base::binary
                       : std::ios_base::in);
-      if (!is_.is_open()) return false;
+      if (!is_.is_open() || !compressed_.Init(&is_)) return false;
       else return Seek(offset);
     }
   }
@@ -582,12 +697,15 @@ class OffsetFileInputImpl: public InputImplBase {
   virtual std::istream &Stream() {
     if (!is_.is_open()) KALDI_ERR << "FileInputImpl::Stream(), file is not open.";
     // I believe this error can only arise from coding error.
+    if (compressed_.Stream() != NULL)
+      return *compressed_.Stream();
     return is_;
   }
 
   virtual void Close() {
     if (!is_.is_open()) KALDI_ERR << "FileInputImpl::Close(), file is not open.";
     // I believe this error can only arise from coding error.
+    compressed_.Reset();
     is_.close();
     // Don't check status.
   }
@@ -602,11 +720,68 @@ class OffsetFileInputImpl: public InputImplBase {
   std::string filename_;  // the actual filename
   bool binary_;  // true if was opened in binary mode.
   std::ifstream is_;
+  BlockCompressedFileReader compressed_;
+};
+
+
+// Reads remote files, e.g. "s3://bucket/foo.ark" or, with an offset,
+// "s3://bucket/foo.ark:12970"; see remote-file.h.  Like OffsetFileInputImpl,
+// it can be opened again while open, and if the file is the same we just seek
+// (keeping any data we have already fetched).
+class RemoteInputImpl: public InputImplBase {
+ public:
+  RemoteInputImpl(): buf_(NULL), is_(NULL) { }
+
+  virtual bool Open(const std::string &rxfilename, bool binary) {
+    std::string url;
+    int64 offset;
+    if (!SplitRemoteFilename(rxfilename, &url, &offset))
+      return false;
+    if (buf_ == NULL || buf_->Url() != url) {
+      Reset();
+      RemoteFileBackend *backend = GetRemoteFileBackend(url);
+      KALDI_ASSERT(backend != NULL);  // ClassifyRxfilename() checked this.
+      buf_ = new RemoteInputBuffer(backend, url);
+      is_ = new std::istream(buf_);
+    }
+    is_->clear();
+    buf_->Seek(offset);
+    // Fetch the first data now, so errors such as a missing file are reported
+    // here.
+    is_->peek();
+    is_->clear();  // in case of eof, e.g. empty file; errors are in buf_.
+    return !buf_->HasError();
+  }
+
+  virtual std::istream &Stream() {
+    if (is_ == NULL) KALDI_ERR << "RemoteInputImpl::Stream(), file is not open.";
+    // I believe this error can only arise from coding error.
+    return *is_;
+  }
+
+  virtual void Close() {
+    if (is_ == NULL) KALDI_ERR << "RemoteInputImpl::Close(), file is not open.";
+    // I believe this error can only arise from coding error.
+    Reset();
+  }
+
+  virtual InputType MyType() { return kRemoteInput; }
+
+  virtual ~RemoteInputImpl() { Reset(); }
+ private:
+  void Reset() {
+    delete is_;
+    is_ = NULL;
+    delete buf_;
+    buf_ = NULL;
+  }
+  RemoteInputBuffer *buf_;
+  std::istream *is_;
 };
 
 
 Output::Output(const std::string &wxfilename, bool binary, bool write_header):
-    impl_(NULL) {
+    impl_(NULL), stats_buf_(NULL), stats_stream_(NULL) {
   if (!Open(wxfilename, binary, write_header)) {
     if (impl_) {
       delete impl_;
@@ -617,10 +792,24 @@ Output::Output(const std::string &wxfilename, bool binary, bool write_header):
   }
 }
 
+bool Output::CloseStatsStream() {
+  if (stats_stream_ == NULL)
+    return true;
+  stats_stream_->flush();
+  bool ans = stats_stream_->good();
+  delete stats_stream_;
+  delete stats_buf_;
+  stats_stream_ = NULL;
+  stats_buf_ = NULL;
+  return ans;
+}
+
 bool Output::Close() {
   if (!impl_) return false;  // error to call Close if not open.
   else {
-    bool ans = impl_->Close();
+    bool ok = CloseStatsStream();
+    TableIoBlockedTimer timer;  // e.g. waiting for a pipe to finish.
+    bool ans = impl_->Close() && ok;
     delete impl_;
     impl_ = NULL;
     return ans;
@@ -629,7 +818,8 @@ bool Output::Close() {
 
 Output::~Output() {
   if (impl_) {
-    bool ok = impl_->Close();
+    bool ok = CloseStatsStream();
+    ok = impl_->Close() && ok;
     delete impl_;
     impl_ = NULL;
     if (!ok)
@@ -640,10 +830,13 @@ Output::~Output() {
 
 std::ostream &Output::Stream() {  // will throw if not open; else returns stream.
   if (!impl_) KALDI_ERR << "Output::Stream() called but not open.";
+  if (stats_stream_ != NULL)
+    return *stats_stream_;
   return impl_->Stream();
 }
 
-bool Output::Open(const std::string &wxfn, bool binary, bool header) {
+bool Output::Open(const std::string &wxfn, bool binary, bool header,
+                  bool block_compressed) {
   if (IsOpen()) {
     if (!Close()) {  // Throw here rather than return status, as it's an error about
       // something else: if the user wanted to avoid the exception he/she could have
@@ -658,8 +851,14 @@ bool Output::Open(const std::string &wxfn, bool binary, bool header) {
   OutputType type = ClassifyWxfilename(wxfn);
   KALDI_ASSERT(impl_ == NULL);
 
+  if (block_compressed && type != kFileOutput)
+    KALDI_WARN << "Block compression is only supported when writing to files; "
+               << "writing " << PrintableWxfilename(wxfn) << " uncompressed.";
   if (type ==  kFileOutput) {
-    impl_ = new FileOutputImpl();
+    if (block_compressed)
+      impl_ = new BlockCompressedFileOutputImpl();
+    else
+      impl_ = new FileOutputImpl();
   } else if (type == kStandardOutput) {
     impl_ = new StandardOutputImpl();
   } else if (type == kPipeOutput) {
@@ -669,7 +868,12 @@ bool Output::Open(const std::string &wxfn, bool binary, bool header) {
         PrintableWxfilename(wxfn);
     return false;
   }
-  if (!impl_->Open(wxfn, binary)) {
+  bool opened;
+  {
+    TableIoBlockedTimer timer;
+    opened = impl_->Open(wxfn, binary);
+  }
+  if (!opened) {
     delete impl_;
     impl_ = NULL;
     return false;  // failed to open.
@@ -682,13 +886,19 @@ bool Output::Open(const std::string &wxfn, bool binary, bool header) {
         impl_ = NULL;
         return false;
       }
-      return true;
-    } else return true;
+    }
+    if (TableIoStats::Current() != NULL) {
+      stats_buf_ = new TableIoOutputBuffer(impl_->Stream().rdbuf());
+      stats_stream_ = new std::ostream(stats_buf_);
+      stats_stream_->copyfmt(impl_->Stream());
+    }
+    return true;
   }
 }
 
 
-Input::Input(const std::string &rxfilename, bool *binary): impl_(NULL) {
+Input::Input(const std::string &rxfilename, bool *binary):
+    impl_(NULL), stats_buf_(NULL), stats_stream_(NULL) {
   if (!Open(rxfilename, binary)) {
     KALDI_ERR << "Error opening input stream "
               << PrintableRxfilename(rxfilename);
@@ -696,6 +906,10 @@ Input::Input(const std::string &rxfilename, bool *binary): impl_(NULL) {
 }
 
 void Input::Close() {
+  delete stats_stream_;
+  delete stats_buf_;
+  stats_stream_ = NULL;
+  stats_buf_ = NULL;
   if (impl_) {
     delete impl_;
     impl_ = NULL;
@@ -708,17 +922,23 @@ bool Input::OpenInternal(const std::string &rxfilename,
   InputType type = ClassifyRxfilename(rxfilename);
   if (IsOpen()) {
     // May have to close the stream first.
-    if (type == kOffsetFileInput && impl_->MyType() == kOffsetFileInput) {
+    if ((type == kOffsetFileInput || type == kRemoteInput) &&
+        impl_->MyType() == type) {
       // We want to use the same object to Open... this is in case
       // the files are the same, so we can just seek.
-      if (!impl_->Open(rxfilename, file_binary)) {  // true is binary mode-- always open in binary.
-        delete impl_;
-        impl_ = NULL;
+      bool opened;
+      {
+        TableIoBlockedTimer timer;
+        opened = impl_->Open(rxfilename, file_binary);
+      }
+      if (!opened) {  // true is binary mode-- always open in binary.
+        Close();
         return false;
       }
+      InitStatsStream();
       // read the binary header, if requested.
       if (contents_binary != NULL)
-        return InitKaldiInputStream(impl_->Stream(), contents_binary);
+        return InitKaldiInputStream(Stream(), contents_binary);
       else return true;
     } else {
       Close();
@@ -733,27 +953,51 @@ bool Input::OpenInternal(const std::string &rxfilename,
     impl_ = new PipeInputImpl();
   } else if (type == kOffsetFileInput) {
     impl_ = new OffsetFileInputImpl();
+  } else if (type == kRemoteInput) {
+    impl_ = new RemoteInputImpl();
   } else {  // type == kNoInput
     KALDI_WARN << "Invalid input filename format "<<
         PrintableRxfilename(rxfilename);
     return false;
   }
-  if (!impl_->Open(rxfilename, file_binary)) {  // true is binary mode-- always read in binary.
+  bool opened;
+  {
+    TableIoBlockedTimer timer;
+    opened = impl_->Open(rxfilename, file_binary);
+  }
+  if (!opened) {  // true is binary mode-- always read in binary.
     delete impl_;
     impl_ = NULL;
     return false;
   }
+  InitStatsStream();
   if (contents_binary != NULL)
-    return InitKaldiInputStream(impl_->Stream(), contents_binary);
+    return InitKaldiInputStream(Stream(), contents_binary);
   else return true;
 }
 
+void Input::InitStatsStream() {
+  TableIoStats *stats = TableIoStats::Current();
+  if (stats != NULL && impl_->MyType() == kOffsetFileInput)
+    stats->num_seeks++;
+  if (stats_stream_ != NULL) {  // Reopened; impl_ may have a new stream.
+    stats_buf_->SetSource(impl_->Stream().rdbuf());
+    stats_stream_->clear();
+  } else if (stats != NULL) {
+    stats_buf_ = new TableIoInputBuffer(impl_->Stream().rdbuf());
+    stats_stream_ = new std::istream(stats_buf_);
+    stats_stream_->copyfmt(impl_->Stream());
+  }
+}
+
 
 Input::~Input() { if (impl_) Close(); }
 
 
 std::istream &Input::Stream() {
   if (!IsOpen()) KALDI_ERR << "Input::Stream(), not open.";
+  if (stats_stream_ != NULL)
+    return *stats_stream_;
   return impl_->Stream();
 }
 
@@ -34,6 +34,8 @@ namespace kaldi {
 
 class OutputImplBase;  // Forward decl; defined in a .cc file
 class InputImplBase;  // Forward decl; defined in a .cc file
+class TableIoOutputBuffer;  // Forward decl; see table-io-stats.h
+class TableIoInputBuffer;  // Forward decl; see table-io-stats.h
 
 /// \addtogroup io_group
 /// @{
@@ -104,7 +106,8 @@ enum InputType {
   kFileInput,
   kStandardInput,
   kOffsetFileInput,
-  kPipeInput
+  kPipeInput,
+  kRemoteInput
 };
 
 /// ClassifyRxfilenames interprets filenames for reading as follows:
@@ -115,6 +118,9 @@ enum InputType {
 ///  - kStandardInput: the empty string or "-"
 ///  - kPipeInput: e.g. "| gzip -c > blah.gz"
 ///  - kOffsetFileInput: offsets into files, e.g.  /some/filename:12970
+///  - kRemoteInput: remote files, for URL schemes that have a backend (see
+///       remote-file.h), optionally with an offset, e.g.
+///       s3://bucket/foo.ark or s3://bucket/foo.ark:12970
 InputType ClassifyRxfilename(const std::string &rxfilename);
 
 
@@ -125,7 +131,7 @@ class Output {
   // with these arguments.
   Output(const std::string &filename, bool binary, bool write_header = true);
 
-  Output(): impl_(NULL) {};
+  Output(): impl_(NULL), stats_buf_(NULL), stats_stream_(NULL) {};
 
   /// This opens the stream, with the given mode (binary or text).  It returns
   /// true on success and false on failure.  However, it will throw if something
@@ -133,8 +139,12 @@ class Output {
   /// first.  if write_header == true and binary == true, it writes the Kaldi
   /// binary-mode header ('\0' then 'B').  You may call Open even if it is
   /// already open; it will close the existing stream and reopen (however if
-  /// closing the old stream failed it will throw).
-  bool Open(const std::string &wxfilename, bool binary, bool write_header);
+  /// closing the old stream failed it will throw).  If block_compressed ==
+  /// true and wxfilename is an ordinary file, the file is written in the
+  /// block-compressed format (see block-compressed-stream.h), which Input
+  /// reads transparently; this is used for the "bc" wspecifier option.
+  bool Open(const std::string &wxfilename, bool binary, bool write_header,
+            bool block_compressed = false);
 
   inline bool IsOpen();  // return true if we have an open stream.  Does not imply
   // stream is good for writing.
@@ -154,8 +164,17 @@ class Output {
   ~Output();
 
  private:
+  // Deletes stats_stream_ and stats_buf_ after flushing them; returns false
+  // if there was an error.
+  bool CloseStatsStream();
+
   OutputImplBase *impl_;  // non-NULL if open.
   std::string filename_;
+  // If the stream was opened while table I/O stats were being collected (see
+  // table-io-stats.h), Stream() returns stats_stream_, which writes through
+  // stats_buf_ to the stream of impl_.
+  TableIoOutputBuffer *stats_buf_;
+  std::ostream *stats_stream_;
   KALDI_DISALLOW_COPY_AND_ASSIGN(Output);
 };
 
@@ -192,7 +211,7 @@ class Input {
   /// throws on error.
   Input(const std::string &rxfilename, bool *contents_binary = NULL);
 
-  Input(): impl_(NULL) {}
+  Input(): impl_(NULL), stats_buf_(NULL), stats_stream_(NULL) {}
 
   // Open opens the stream for reading (the mode, where relevant, is binary; use
   // OpenTextMode for text-mode, we made this a separate function rather than a
@@ -227,7 +246,15 @@ class Input {
   ~Input();
  private:
   bool OpenInternal(const std::string &rxfilename, bool file_binary, bool *contents_binary);
+  // Called after impl_ is (re)opened: sets up or resets stats_stream_ if
+  // needed.
+  void InitStatsStream();
   InputImplBase *impl_;
+  // If the stream was opened while table I/O stats were being collected (see
+  // table-io-stats.h), Stream() returns stats_stream_, which reads through
+  // stats_buf_ from the stream of impl_.
+  TableIoInputBuffer *stats_buf_;
+  std::istream *stats_stream_;
   KALDI_DISALLOW_COPY_AND_ASSIGN(Input);
 };
 
@@ -22,10 +22,15 @@
 #ifndef KALDI_UTIL_KALDI_TABLE_INL_H_
 #define KALDI_UTIL_KALDI_TABLE_INL_H_
 
+#include <pthread.h>
 #include <algorithm>
+#include <deque>
+#include "base/kaldi-memory-stats.h"
+#include "base/kaldi-trace.h"
 #include "util/kaldi-io.h"
 #include "util/text-utils.h"
 #include "util/stl-utils.h" // for StringHasher.
+#include "util/table-cache.h"
 
 
 namespace kaldi {
@@ -45,6 +50,12 @@ template<class Holder> class SequentialTableReaderImplBase {
   virtual void FreeCurrent() = 0;
   virtual void Next() = 0;
   virtual bool Close() = 0;
+  // SwapHolder() is valid to call only if Done() would return false.  It
+  // exchanges the contents of the current Holder with "other_holder" (which
+  // will normally be empty), after which the current object counts as freed
+  // (as if FreeCurrent() had been called).  It throws in the same situations
+  // where Value() would throw.  It is used by the background-reading code.
+  virtual void SwapHolder(Holder *other_holder) = 0;
   SequentialTableReaderImplBase() { }
   virtual ~SequentialTableReaderImplBase() { }
  private:
@@ -162,6 +173,12 @@ template<class Holder>  class SequentialTableReaderScriptImpl:
       KALDI_WARN << "TableReader: FreeCurrent called at the wrong time.";
     }
   }
+  virtual void SwapHolder(Holder *other_holder) {
+    // Value() makes sure the object is loaded, and throws if it cannot be.
+    Value();
+    holder_.Swap(other_holder);
+    state_ = kLoadFailed;  // the same state we'd be in after FreeCurrent().
+  }
   void Next() {
     while (1) {
       NextScpLine();
@@ -453,6 +470,13 @@ template<class Holder>  class SequentialTableReaderArchiveImpl:
       KALDI_WARN << "TableReader: FreeCurernt called at the wrong time.";
   }
 
+  virtual void SwapHolder(Holder *other_holder) {
+    if (state_ != kHaveObject)
+      KALDI_ERR << "SwapHolder() called on TableReader object at the wrong time.";
+    holder_.Swap(other_holder);
+    state_ = kFreedObject;
+  }
+
   virtual bool Close() {
     if (! this->IsOpen())
       KALDI_ERR << "Close() called on TableReader twice or otherwise wrongly.";
@@ -507,8 +531,269 @@ template<class Holder>  class SequentialTableReaderArchiveImpl:
 };
 
 
+// This is the implementation for SequentialTableReader when the "bg"
+// (background) option was given in the rspecifier.  It wraps another
+// implementation (archive or script) that has already been opened, and runs
+// it in a separate thread which reads and parses objects up to
+// kMaxQueueSize objects ahead of the user.  The objects are handed over via
+// Holder::Swap(), so nothing is copied.  Errors in loading individual objects
+// are reported when the user calls Value(), as they would be without "bg".
+template<class Holder>  class SequentialTableReaderBackgroundImpl:
+      public SequentialTableReaderImplBase<Holder> {
+ public:
+  typedef typename Holder::T T;
+
+  // Takes ownership of "base_reader", which must already be open.
+  explicit SequentialTableReaderBackgroundImpl(
+      SequentialTableReaderImplBase<Holder> *base_reader):
+      base_reader_(base_reader), parent_stats_(TableIoStats::Current()),
+      thread_stats_(parent_stats_ != NULL ? new TableIoStats() : NULL),
+      stop_(false), producer_done_(false), state_(kEof), current_ok_(false) {
+    pthread_mutex_init(&mutex_, NULL);
+    pthread_cond_init(&cond_, NULL);
+    int ret = pthread_create(&thread_, NULL, RunThread, this);
+    if (ret != 0) {
+      pthread_cond_destroy(&cond_);
+      pthread_mutex_destroy(&mutex_);
+      delete thread_stats_;
+      KALDI_ERR << "Error creating background reading thread (errno = "
+                << ret << ")";
+    }
+    try {
+      // Like Open() for the other implementations, this waits for the first
+      // object.
+      GetNextItem();
+    } catch (...) {
+      StopThread();  // base_reader_ still belongs to the caller.
+      throw;
+    }
+  }
+
+  virtual bool Open(const std::string &rspecifier) {
+    KALDI_ERR << "Open() should not be called on the background reader.";
+    return false;
+  }
+
+  virtual bool IsOpen() const { return (base_reader_ != NULL); }
+
+  virtual bool Done() const {
+    if (base_reader_ == NULL)
+      KALDI_ERR << "Done() called on TableReader object at the wrong time.";
+    return (state_ == kEof);
+  }
+
+  virtual std::string Key() {
+    if (state_ == kEof)
+      KALDI_ERR << "Key() called on TableReader object at the wrong time.";
+    return key_;
+  }
+
+  virtual const T &Value() {
+    if (state_ != kHaveObject)
+      KALDI_ERR << "TableReader: Value() called at the wrong time (or after "
+                << "FreeCurrent()).";
+    if (!current_ok_)
+      KALDI_ERR << "TableReader: failed to load object for key " << key_
+                << " (to suppress this error, add the permissive "
+                << "(p, ) option to the rspecifier.";
+    return holder_.Value();
+  }
+
+  virtual void FreeCurrent() {
+    if (state_ == kHaveObject) {
+      holder_.Clear();
+      state_ = kFreedObject;
+    } else {
+      KALDI_WARN << "TableReader: FreeCurrent called at the wrong time.";
+    }
+  }
+
+  virtual void SwapHolder(Holder *other_holder) {
+    Value();  // checks the state.
+    holder_.Swap(other_holder);
+    state_ = kFreedObject;
+  }
+
+  virtual void Next() {
+    if (state_ == kEof)
+      KALDI_ERR << "TableReader: Next() called wrongly.";
+    GetNextItem();
+  }
+
+  virtual bool Close() {
+    if (base_reader_ == NULL)
+      KALDI_ERR << "Close() called on TableReader twice or otherwise wrongly.";
+    StopThread();
+    bool ans = base_reader_->Close();
+    delete base_reader_;
+    base_reader_ = NULL;
+    if (!error_message_.empty()) {
+      KALDI_WARN << "Error in background reading thread: " << error_message_;
+      ans = false;
+    }
+    return ans;
+  }
+
+  virtual ~SequentialTableReaderBackgroundImpl() {
+    if (base_reader_ != NULL) {
+      StopThread();
+      SequentialTableReaderImplBase<Holder> *base_reader = base_reader_;
+      base_reader_ = NULL;
+      delete base_reader;  // This may throw, as for the non-background case.
+    }
+  }
+
+ private:
+  // The maximum number of objects we read ahead of the user.
+  static const size_t kMaxQueueSize = 2;
+
+  struct QueueItem {
+    std::string key;
+    Holder *holder;
+    bool ok;  // false if the object couldn't be loaded.
+  };
+
+  static void *RunThread(void *arg) {
+    static_cast<SequentialTableReaderBackgroundImpl<Holder>*>(arg)->Produce();
+    return NULL;
+  }
+
+  // This is what the background thread runs.
+  void Produce() {
+    TableIoStats::SetCurrent(thread_stats_);
+    MemoryTagScope memory_tag(kMemoryTableIo);
+    try {
+      while (true) {
+        pthread_mutex_lock(&mutex_);
+        while (queue_.size() >= kMaxQueueSize && !stop_)
+          pthread_cond_wait(&cond_, &mutex_);
+        bool stop = stop_;
+        pthread_mutex_unlock(&mutex_);
+        if (stop || base_reader_->Done())
+          break;
+        KALDI_TRACE_SCOPE("SequentialTableReader background read");
+        QueueItem item;
+        item.key = base_reader_->Key();
+        item.holder = new Holder;
+        try {
+          base_reader_->SwapHolder(item.holder);
+          item.ok = true;
+        } catch (const std::exception &e) {
+          item.ok = false;  // The error will be reported by Value().
+        }
+        try {
+          base_reader_->Next();
+        } catch (...) {
+          delete item.holder;
+          throw;
+        }
+        pthread_mutex_lock(&mutex_);
+        queue_.push_back(item);
+        pthread_cond_broadcast(&cond_);
+        pthread_mutex_unlock(&mutex_);
+      }
+    } catch (const std::exception &e) {
+      pthread_mutex_lock(&mutex_);
+      error_message_ = e.what();
+      pthread_mutex_unlock(&mutex_);
+    }
+    pthread_mutex_lock(&mutex_);
+    producer_done_ = true;
+    pthread_cond_broadcast(&cond_);
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  // Called from the user's thread: moves the next object from the queue
+  // into holder_, waiting for it if necessary.
+  void GetNextItem() {
+    if (state_ == kHaveObject)
+      holder_.Clear();
+    bool have_item;
+    QueueItem item;
+    std::string error_message;
+    {
+      KALDI_TRACE_SCOPE("SequentialTableReader wait");
+      TableIoBlockedTimer timer;
+      pthread_mutex_lock(&mutex_);
+      while (queue_.empty() && !producer_done_)
+        pthread_cond_wait(&cond_, &mutex_);
+      have_item = !queue_.empty();
+      if (have_item) {
+        item = queue_.front();
+        queue_.pop_front();
+        pthread_cond_broadcast(&cond_);
+      }
+      error_message = error_message_;
+      pthread_mutex_unlock(&mutex_);
+    }
+    if (have_item) {
+      key_ = item.key;
+      holder_.Swap(item.holder);
+      delete item.holder;
+      current_ok_ = item.ok;  // if false, Value() will report the error.
+      state_ = kHaveObject;
+    } else {
+      state_ = kEof;
+      if (!error_message.empty())
+        KALDI_ERR << "Error in background reading thread: " << error_message;
+    }
+  }
+
+  void StopThread() {
+    pthread_mutex_lock(&mutex_);
+    stop_ = true;
+    pthread_cond_broadcast(&cond_);
+    pthread_mutex_unlock(&mutex_);
+    pthread_join(thread_, NULL);
+    pthread_cond_destroy(&cond_);
+    pthread_mutex_destroy(&mutex_);
+    if (thread_stats_ != NULL) {
+      // The background thread's time didn't block the user; see
+      // table-io-stats.h.
+      parent_stats_->num_bytes += thread_stats_->num_bytes;
+      parent_stats_->num_seeks += thread_stats_->num_seeks;
+      delete thread_stats_;
+      thread_stats_ = NULL;
+    }
+    for (size_t i = 0; i < queue_.size(); i++)
+      delete queue_[i].holder;
+    queue_.clear();
+    if (state_ == kHaveObject)
+      holder_.Clear();
+    state_ = kEof;
+  }
+
+  SequentialTableReaderImplBase<Holder> *base_reader_;
+  // If collecting table I/O stats, the background thread counts its I/O in
+  // thread_stats_, which is added to parent_stats_ when it exits.
+  TableIoStats *parent_stats_;
+  TableIoStats *thread_stats_;
+  pthread_t thread_;
+  pthread_mutex_t mutex_;
+  pthread_cond_t cond_;
+  // The following variables are shared between the threads and are protected
+  // by mutex_.
+  std::deque<QueueItem> queue_;
+  bool stop_;
+  bool producer_done_;
+  std::string error_message_;
+
+  // The following variables are only accessed by the user's thread.
+  Holder holder_;
+  std::string key_;
+  enum {
+    kHaveObject,   // holder_ has the current object [or it failed to load,
+                   // if !current_ok_].
+    kFreedObject,  // The user called FreeCurrent() or SwapHolder().
+    kEof           // No more objects, or closed.
+  } state_;
+  bool current_ok_;
+};
+
+
 template<class Holder>
-SequentialTableReader<Holder>::SequentialTableReader(const std::string &rspecifier): impl_(NULL) {
+SequentialTableReader<Holder>::SequentialTableReader(const std::string &rspecifier):
+    impl_(NULL), stats_(NULL) {
   if (rspecifier != "" && !Open(rspecifier))
     KALDI_ERR << "Error constructing TableReader: rspecifier is " << rspecifier;
 }
@@ -519,8 +804,15 @@ bool SequentialTableReader<Holder>::Open(const std::string &rspecifier) {
     if (!Close())
       KALDI_ERR << "Could not close previously open object.";
   // now impl_ will be NULL.
+  TableIoStats::Report(stats_);  // In case a previous Open() failed.
+  stats_ = TableIoStats::New("SequentialTableReader", rspecifier);
+  TableIoStatsScope scope(stats_);
+  MemoryTagScope memory_tag(kMemoryTableIo);
 
-  RspecifierType wt = ClassifyRspecifier(rspecifier, NULL, NULL);
+  // With the "cache" option, this may be a script file in the table cache.
+  std::string table_rspecifier = ResolveCachedRspecifier(rspecifier);
+  RspecifierOptions opts;
+  RspecifierType wt = ClassifyRspecifier(table_rspecifier, NULL, &opts);
   switch (wt) {
     case kArchiveRspecifier:
       impl_ = new SequentialTableReaderArchiveImpl<Holder>();
@@ -532,20 +824,28 @@ bool SequentialTableReader<Holder>::Open(const std::string &rspecifier) {
       KALDI_WARN << "Invalid rspecifier " << rspecifier;
       return false;
   }
-  if (!impl_->Open(rspecifier)) {
+  if (!impl_->Open(table_rspecifier)) {
     delete impl_;
     impl_ = NULL;
     return false;  // sub-object will have printed warnings.
   }
-  else return true;
+  if (opts.background)
+    impl_ = new SequentialTableReaderBackgroundImpl<Holder>(impl_);
+  return true;
 }
 
 template<class Holder>
 bool SequentialTableReader<Holder>::Close() {
-  CheckImpl();  
-  bool ans = impl_->Close();
-  delete impl_;  // We don't keep around empty impl_ objects.
-  impl_ = NULL;
+  CheckImpl();
+  bool ans;
+  {
+    TableIoStatsScope scope(stats_);
+    ans = impl_->Close();
+    delete impl_;  // We don't keep around empty impl_ objects.
+    impl_ = NULL;
+  }
+  TableIoStats::Report(stats_);
+  stats_ = NULL;
   return ans;
 }
 
@@ -576,6 +876,9 @@ template<class Holder>
 const typename SequentialTableReader<Holder>::T &
 SequentialTableReader<Holder>::Value() {
   CheckImpl();
+  TableIoStatsScope scope(stats_);  // Script files are read in Value().
+  KALDI_TRACE_SCOPE("SequentialTableReader::Value");
+  MemoryTagScope memory_tag(kMemoryTableIo);
   return impl_->Value();  // This may throw (if LoadCurrent() returned false you are safe.).
 }
 
@@ -583,6 +886,11 @@ SequentialTableReader<Holder>::Value() {
 template<class Holder>
 void SequentialTableReader<Holder>::Next() {
   CheckImpl();
+  TableIoStatsScope scope(stats_);
+  KALDI_TRACE_SCOPE("SequentialTableReader::Next");
+  MemoryTagScope memory_tag(kMemoryTableIo);
+  if (stats_ != NULL)
+    stats_->num_objects++;
   impl_->Next();
 }
 
@@ -595,8 +903,12 @@ bool SequentialTableReader<Holder>::Done() {
 
 template<class Holder>
 SequentialTableReader<Holder>::~SequentialTableReader() {
-  delete impl_;
-  // Destructor of impl_ may throw.
+  {
+    TableIoStatsScope scope(stats_);
+    delete impl_;
+    // Destructor of impl_ may throw.
+  }
+  TableIoStats::Report(stats_);
 }
 
 
@@ -656,8 +968,16 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
                                            NULL,
                                            &opts_);
     KALDI_ASSERT(ws == kArchiveWspecifier);  // or wrongly called.
+    index_.clear();
+    if (opts_.write_index && ClassifyWxfilename(archive_wxfilename_) != kFileOutput) {
+      KALDI_WARN << "Not writing an index for archive "
+                 << PrintableWxfilename(archive_wxfilename_)
+                 << " as it is not an ordinary file.";
+      opts_.write_index = false;
+    }
 
-    if (output_.Open(archive_wxfilename_, opts_.binary, false)) {  // false means no binary header.
+    if (output_.Open(archive_wxfilename_, opts_.binary, false,  // no header.
+                     opts_.block_compressed)) {
       state_ = kOpen;
       return true;
     } else {
@@ -695,6 +1015,9 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
     if (!IsToken(key)) // e.g. empty string or has spaces...
       KALDI_ERR << "TableWriter: using invalid key " << key;
     output_.Stream() << key << ' ';
+    if (opts_.write_index)
+      index_.push_back(std::make_pair(
+          key, static_cast<int64>(output_.Stream().tellp())));
     if (!Holder::Write(output_.Stream(), opts_.binary, value)) {
       KALDI_WARN << "TableWriter: write failure to "
                  << PrintableWxfilename(archive_wxfilename_);
@@ -739,6 +1062,11 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
       return false;
     }
     state_ = kUninitialized;
+    if (opts_.write_index) {
+      bool ans = WriteArchiveIndex(archive_wxfilename_, &index_);
+      index_.clear();
+      return ans;
+    }
     return true;
   }
 
@@ -757,6 +1085,8 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
   WspecifierOptions opts_;
   std::string wspecifier_;
   std::string archive_wxfilename_;
+  // (key, offset of object) for each object written, if opts_.write_index.
+  std::vector<std::pair<std::string, int64> > index_;
   enum {               // is stream open?
     kUninitialized,    // no
     kOpen,             // yes
@@ -949,8 +1279,17 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
       KALDI_WARN << "When writing to both archive and script, the script file "
           "will generally not be interpreted correctly unless the archive is "
           "an actual file: wspecifier = " << wspecifier;
+    index_.clear();
+    if (opts_.write_index && ClassifyWxfilename(archive_wxfilename_) != kFileOutput) {
+      KALDI_WARN << "Not writing an index for archive "
+                 << PrintableWxfilename(archive_wxfilename_)
+                 << " as it is not an ordinary file.";
+      opts_.write_index = false;
+    }
 
-    if (!archive_output_.Open(archive_wxfilename_, opts_.binary, false)) {  // false means no binary header.
+    if (!archive_output_.Open(archive_wxfilename_, opts_.binary,
+                              false,  // false means no binary header.
+                              opts_.block_compressed)) {
       state_ = kUninitialized;
       return false;
     }
@@ -1009,6 +1348,8 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
     std::string offset_rxfilename;  // rxfilename with offset into the archive,
     // e.g. some_archive_name.ark:431541423
     MakeFilename(archive_os_pos, &offset_rxfilename);
+    if (opts_.write_index)
+      index_.push_back(std::make_pair(key, static_cast<int64>(archive_os_pos)));
 
     // Write to the script file first.
     // The idea is that we want to get all the information possible into the
@@ -1069,6 +1410,9 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
       if (!script_output_.Close()) close_success = false;
     bool ans = close_success && (state_ != kWriteError);
     state_ = kUninitialized;
+    if (ans && opts_.write_index)
+      ans = WriteArchiveIndex(archive_wxfilename_, &index_);
+    index_.clear();
     return ans;
   }
 
@@ -1090,6 +1434,8 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
   std::string archive_wxfilename_;
   std::string script_wxfilename_;
   std::string wspecifier_;
+  // (key, offset of object) for each object written, if opts_.write_index.
+  std::vector<std::pair<std::string, int64> > index_;
   enum {               // is stream open?
     kUninitialized,    // no
     kOpen,             // yes
@@ -1097,9 +1443,340 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
   } state_;
 };
 
+// This is the implementation for TableWriter when the "bg" (background)
+// option was given in the wspecifier.  It wraps another implementation that
+// has already been opened, and does the serialization and writing in a
+// separate thread, so that e.g. a decoder does not wait for writes to slow
+// disks.  Write() copies the object (which is much cheaper than writing it)
+// and puts it on a queue of at most kMaxQueueSize objects, waiting if the
+// queue is full.  Errors in the background thread are reported by the next
+// call to Write() or Close().
+template<class Holder>  class TableWriterBackgroundImpl:
+      public TableWriterImplBase<Holder> {
+ public:
+  typedef typename Holder::T T;
+
+  // Takes ownership of "base_writer", which must already be open.
+  explicit TableWriterBackgroundImpl(TableWriterImplBase<Holder> *base_writer):
+      base_writer_(base_writer), parent_stats_(TableIoStats::Current()),
+      thread_stats_(parent_stats_ != NULL ? new TableIoStats() : NULL),
+      stop_(false), write_error_(false) {
+    pthread_mutex_init(&mutex_, NULL);
+    pthread_cond_init(&cond_, NULL);
+    int ret = pthread_create(&thread_, NULL, RunThread, this);
+    if (ret != 0) {
+      pthread_cond_destroy(&cond_);
+      pthread_mutex_destroy(&mutex_);
+      delete thread_stats_;
+      KALDI_ERR << "Error creating background writing thread (errno = "
+                << ret << ")";
+    }
+  }
+
+  virtual bool Open(const std::string &wspecifier) {
+    KALDI_ERR << "Open() should not be called on the background writer.";
+    return false;
+  }
+
+  virtual bool IsOpen() const { return (base_writer_ != NULL); }
+
+  virtual bool Write(const std::string &key, const T &value) {
+    if (base_writer_ == NULL)
+      KALDI_ERR << "Write called on invalid stream";
+    if (!IsToken(key))  // Check this here, so the error is thrown from here.
+      KALDI_ERR << "TableWriter: using invalid key " << key;
+    // Copy the object before taking the lock.
+    QueueItem item;
+    item.key = key;
+    item.value = new T(value);
+    bool ok;
+    {
+      KALDI_TRACE_SCOPE("TableWriter wait");
+      TableIoBlockedTimer timer;
+      pthread_mutex_lock(&mutex_);
+      while (queue_.size() >= kMaxQueueSize && !write_error_)
+        pthread_cond_wait(&cond_, &mutex_);
+      ok = !write_error_;
+      if (ok) {
+        queue_.push_back(item);
+        pthread_cond_broadcast(&cond_);
+      }
+      pthread_mutex_unlock(&mutex_);
+    }
+    if (!ok) {
+      delete item.value;
+      KALDI_WARN << "TableWriter: error in background writing thread"
+                 << (error_message_.empty() ? std::string() :
+                     ": " + error_message_);
+    }
+    return ok;
+  }
+
+  // We queue the flush, so it happens after the objects already queued are
+  // written.
+  virtual void Flush() {
+    if (base_writer_ == NULL) {
+      KALDI_WARN << "TableWriter: Flush called on not-open writer.";
+      return;
+    }
+    QueueItem item;
+    item.value = NULL;  // This means "flush".
+    pthread_mutex_lock(&mutex_);
+    if (!write_error_) {
+      queue_.push_back(item);
+      pthread_cond_broadcast(&cond_);
+    }
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  virtual bool Close() {
+    if (base_writer_ == NULL)
+      KALDI_ERR << "TableWriter: Close called on a stream that was not open.";
+    StopThread();  // This waits for the queued objects to be written.
+    TableWriterImplBase<Holder> *base_writer = base_writer_;
+    base_writer_ = NULL;
+    bool ans = base_writer->Close() && !write_error_;
+    delete base_writer;
+    if (write_error_)
+      KALDI_WARN << "TableWriter: error in background writing thread"
+                 << (error_message_.empty() ? std::string() :
+                     ": " + error_message_);
+    return ans;
+  }
+
+  // May throw on write error if Close was not called.
+  virtual ~TableWriterBackgroundImpl() {
+    if (base_writer_ != NULL && !Close())
+      KALDI_ERR << "TableWriter: error closing background writer.";
+  }
+
+ private:
+  // The maximum number of objects waiting to be written.
+  static const size_t kMaxQueueSize = 4;
+
+  struct QueueItem {
+    std::string key;
+    T *value;  // NULL means "flush".
+  };
+
+  static void *RunThread(void *arg) {
+    static_cast<TableWriterBackgroundImpl<Holder>*>(arg)->Consume();
+    return NULL;
+  }
+
+  // This is what the background thread runs: it writes the queued objects
+  // until StopThread() is called and the queue is empty, or there is an
+  // error.
+  void Consume() {
+    TableIoStats::SetCurrent(thread_stats_);
+    while (true) {
+      pthread_mutex_lock(&mutex_);
+      while (queue_.empty() && !stop_)
+        pthread_cond_wait(&cond_, &mutex_);
+      if (queue_.empty()) {  // stop_ is true.
+        pthread_mutex_unlock(&mutex_);
+        break;
+      }
+      QueueItem item = queue_.front();
+      pthread_mutex_unlock(&mutex_);
+      KALDI_TRACE_SCOPE("TableWriter background write");
+      bool ok = true;
+      std::string error_message;
+      try {
+        if (item.value == NULL)
+          base_writer_->Flush();
+        else
+          ok = base_writer_->Write(item.key, *(item.value));
+      } catch (const std::exception &e) {
+        ok = false;
+        error_message = e.what();
+      }
+      delete item.value;
+      pthread_mutex_lock(&mutex_);
+      // We only pop the item now, so the queue size includes the object being
+      // written.
+      queue_.pop_front();
+      if (!ok) {
+        write_error_ = true;
+        error_message_ = error_message;
+        for (size_t i = 0; i < queue_.size(); i++)
+          delete queue_[i].value;
+        queue_.clear();
+      }
+      pthread_cond_broadcast(&cond_);
+      pthread_mutex_unlock(&mutex_);
+      if (!ok) break;
+    }
+  }
+
+  void StopThread() {
+    TableIoBlockedTimer timer;  // We wait for the queued objects.
+    pthread_mutex_lock(&mutex_);
+    stop_ = true;
+    pthread_cond_broadcast(&cond_);
+    pthread_mutex_unlock(&mutex_);
+    pthread_join(thread_, NULL);
+    pthread_cond_destroy(&cond_);
+    pthread_mutex_destroy(&mutex_);
+    if (thread_stats_ != NULL) {
+      // The background thread's time didn't block the user; see
+      // table-io-stats.h.
+      parent_stats_->num_bytes += thread_stats_->num_bytes;
+      parent_stats_->num_seeks += thread_stats_->num_seeks;
+      delete thread_stats_;
+      thread_stats_ = NULL;
+    }
+    for (size_t i = 0; i < queue_.size(); i++)  // Only nonempty after errors.
+      delete queue_[i].value;
+    queue_.clear();
+  }
+
+  TableWriterImplBase<Holder> *base_writer_;
+  // If collecting table I/O stats, the background thread counts its I/O in
+  // thread_stats_, which is added to parent_stats_ when it exits.
+  TableIoStats *parent_stats_;
+  TableIoStats *thread_stats_;
+  pthread_t thread_;
+  pthread_mutex_t mutex_;
+  pthread_cond_t cond_;
+  // The following variables are shared between the threads and are protected
+  // by mutex_ (after the thread has exited, the user's thread may read them
+  // without the lock).
+  std::deque<QueueItem> queue_;
+  bool stop_;
+  bool write_error_;
+  std::string error_message_;
+};
+
+// This is the implementation for TableWriter when the "shards=N" option was
+// given in the wspecifier, e.g. "ark,scp,shards=4:egs.SHARD.ark,egs.SHARD.scp".
+// It writes N archives (with scp files, if requested), replacing "SHARD" in the
+// filenames with 1, 2, ... N.  Each shard is written by an archive or
+// archive+scp writer in its own background thread (see
+// TableWriterBackgroundImpl), so the writes proceed in parallel.
+template<class Holder>  class TableWriterShardedImpl:
+      public TableWriterImplBase<Holder> {
+ public:
+  typedef typename Holder::T T;
+
+  TableWriterShardedImpl(): next_shard_(0) { }
+
+  virtual bool Open(const std::string &wspecifier) {
+    if (!writers_.empty())
+      KALDI_ERR << "Opening already open TableWriter: call Close first.";
+    std::string archive_wxfilename, script_wxfilename;
+    WspecifierType ws = ClassifyWspecifier(wspecifier, &archive_wxfilename,
+                                           &script_wxfilename, &opts_);
+    KALDI_ASSERT(opts_.num_shards > 0);
+    if (ws != kArchiveWspecifier && ws != kBothWspecifier) {
+      KALDI_WARN << "The shards option requires an archive: wspecifier is "
+                 << wspecifier;
+      return false;
+    }
+    const std::string shard_str = "SHARD";
+    if (archive_wxfilename.find(shard_str) == std::string::npos ||
+        (ws == kBothWspecifier &&
+         script_wxfilename.find(shard_str) == std::string::npos)) {
+      KALDI_WARN << "With the shards option, the filenames must contain "
+                 << shard_str << ": wspecifier is " << wspecifier;
+      return false;
+    }
+    // The options for the shards: all except the ones about sharding, or
+    // "bg", as the shards are always written in the background.
+    std::vector<std::string> split_options;
+    SplitStringToVector(wspecifier.substr(0, wspecifier.find(':')), ", ",
+                        false, &split_options);
+    std::string shard_options;
+    for (size_t i = 0; i < split_options.size(); i++) {
+      const std::string &opt = split_options[i];
+      if (opt.compare(0, 7, "shards=") == 0 || opt == "hash" ||
+          opt == "nhash" || opt == "bg" || opt == "nbg")
+        continue;
+      shard_options += (shard_options.empty() ? "" : ",") + opt;
+    }
+    for (int32 shard = 1; shard <= opts_.num_shards; shard++) {
+      std::ostringstream shard_wspecifier;
+      shard_wspecifier << shard_options << ':'
+                       << ReplaceShard(archive_wxfilename, shard);
+      TableWriterImplBase<Holder> *writer;
+      if (ws == kBothWspecifier) {
+        shard_wspecifier << ',' << ReplaceShard(script_wxfilename, shard);
+        writer = new TableWriterBothImpl<Holder>();
+      } else {
+        writer = new TableWriterArchiveImpl<Holder>();
+      }
+      if (!writer->Open(shard_wspecifier.str())) {
+        delete writer;
+        for (size_t i = 0; i < writers_.size(); i++)
+          writers_[i]->Close();
+        DeletePointers(&writers_);
+        writers_.clear();
+        return false;  // The writer will have printed a warning.
+      }
+      writers_.push_back(new TableWriterBackgroundImpl<Holder>(writer));
+    }
+    next_shard_ = 0;
+    return true;
+  }
+
+  virtual bool IsOpen() const { return !writers_.empty(); }
+
+  virtual bool Write(const std::string &key, const T &value) {
+    if (writers_.empty())
+      KALDI_ERR << "Write called on invalid stream";
+    size_t shard;
+    if (opts_.shard_by_key) {
+      shard = StringHasher()(key) % writers_.size();
+    } else {
+      shard = next_shard_;
+      next_shard_ = (next_shard_ + 1) % writers_.size();
+    }
+    return writers_[shard]->Write(key, value);
+  }
+
+  virtual void Flush() {
+    for (size_t i = 0; i < writers_.size(); i++)
+      writers_[i]->Flush();
+  }
+
+  virtual bool Close() {
+    if (writers_.empty())
+      KALDI_ERR << "TableWriter: Close called on a stream that was not open.";
+    bool ans = true;
+    for (size_t i = 0; i < writers_.size(); i++)
+      if (!writers_[i]->Close()) ans = false;
+    DeletePointers(&writers_);
+    writers_.clear();
+    return ans;
+  }
+
+  // May throw on write error if Close was not called.
+  virtual ~TableWriterShardedImpl() {
+    if (!writers_.empty() && !Close())
+      KALDI_ERR << "TableWriter: error closing sharded writer.";
+  }
+
+ private:
+  static std::string ReplaceShard(const std::string &filename, int32 shard) {
+    std::ostringstream shard_str;
+    shard_str << shard;
+    std::string ans = filename;
+    for (size_t pos = ans.find("SHARD"); pos != std::string::npos;
+         pos = ans.find("SHARD", pos + shard_str.str().size()))
+      ans.replace(pos, 5, shard_str.str());
+    return ans;
+  }
+
+  std::vector<TableWriterImplBase<Holder>*> writers_;
+  WspecifierOptions opts_;
+  size_t next_shard_;  // for round-robin.
+};
+
+
 
 template<class Holder>
-TableWriter<Holder>::TableWriter(const std::string &wspecifier): impl_(NULL) {
+TableWriter<Holder>::TableWriter(const std::string &wspecifier):
+    impl_(NULL), stats_(NULL) {
   if (wspecifier != "" && !Open(wspecifier)) {
     KALDI_ERR << "TableWriter: failed to write to "
               << wspecifier;
@@ -1120,23 +1797,35 @@ bool TableWriter<Holder>::Open(const std::string &wspecifier) {
       KALDI_ERR << "TableWriter::Open, failed to close previously open writer.";
   }
   KALDI_ASSERT(impl_ == NULL);
-  WspecifierType wtype = ClassifyWspecifier(wspecifier, NULL, NULL, NULL);
-  switch (wtype) {
-    case kBothWspecifier:
-      impl_ = new TableWriterBothImpl<Holder>();
-      break;
-    case kArchiveWspecifier:
-      impl_ = new TableWriterArchiveImpl<Holder>();
-      break;
-    case kScriptWspecifier:
-      impl_ = new TableWriterScriptImpl<Holder>();
-      break;
-    case kNoWspecifier: default:
-      KALDI_WARN << "ClassifyWspecifier: invalid wspecifier " << wspecifier;
-      return false;
+  TableIoStats::Report(stats_);  // In case a previous Open() failed.
+  stats_ = TableIoStats::New("TableWriter", wspecifier);
+  TableIoStatsScope scope(stats_);
+  WspecifierOptions opts;
+  WspecifierType wtype = ClassifyWspecifier(wspecifier, NULL, NULL, &opts);
+  if (wtype != kNoWspecifier && opts.num_shards > 0) {
+    // This creates the writers for the individual shards.
+    impl_ = new TableWriterShardedImpl<Holder>();
+  } else {
+    switch (wtype) {
+      case kBothWspecifier:
+        impl_ = new TableWriterBothImpl<Holder>();
+        break;
+      case kArchiveWspecifier:
+        impl_ = new TableWriterArchiveImpl<Holder>();
+        break;
+      case kScriptWspecifier:
+        impl_ = new TableWriterScriptImpl<Holder>();
+        break;
+      case kNoWspecifier: default:
+        KALDI_WARN << "ClassifyWspecifier: invalid wspecifier " << wspecifier;
+        return false;
+    }
   }
-  if (impl_->Open(wspecifier)) return true;
-  else {  // The class will have printed a more specific warning.
+  if (impl_->Open(wspecifier)) {
+    if (opts.background && opts.num_shards == 0)  // Shards are always "bg".
+      impl_ = new TableWriterBackgroundImpl<Holder>(impl_);
+    return true;
+  } else {  // The class will have printed a more specific warning.
     delete impl_;
     impl_ = NULL;
     return false;
@@ -1147,6 +1836,11 @@ template<class Holder>
 void TableWriter<Holder>::Write(const std::string &key,
                                 const T &value) const {
   CheckImpl();
+  TableIoStatsScope scope(stats_);
+  KALDI_TRACE_SCOPE("TableWriter::Write");
+  MemoryTagScope memory_tag(kMemoryTableIo);
+  if (stats_ != NULL)
+    stats_->num_objects++;
   if (!impl_->Write(key, value))
     KALDI_ERR << "Error in TableWriter::Write";
   // More specific warning will have
@@ -1156,15 +1850,22 @@ void TableWriter<Holder>::Write(const std::string &key,
 template<class Holder>
 void TableWriter<Holder>::Flush() {
   CheckImpl();
+  TableIoStatsScope scope(stats_);
   impl_->Flush();
 }
 
 template<class Holder>
 bool TableWriter<Holder>::Close() {
   CheckImpl();
-  bool ans = impl_->Close();
-  delete impl_;  // We don't keep around non-open impl_ objects [c.f. definition of IsOpen()]
-  impl_ = NULL;
+  bool ans;
+  {
+    TableIoStatsScope scope(stats_);
+    ans = impl_->Close();
+    delete impl_;  // We don't keep around non-open impl_ objects [c.f. definition of IsOpen()]
+    impl_ = NULL;
+  }
+  TableIoStats::Report(stats_);
+  stats_ = NULL;
   return ans;
 }
 
@@ -1173,6 +1874,7 @@ TableWriter<Holder>::~TableWriter() {
   if (IsOpen() && !Close()) {
     KALDI_ERR << "Error closing TableWriter [in destructor].";
   }
+  TableIoStats::Report(stats_);  // Only non-NULL if Open() failed.
 }
 
 
@@ -2075,12 +2777,131 @@ template<class Holder>  class RandomAccessTableReaderUnsortedArchiveImpl:
 };
 
 
+// Implementation of RandomAccessTableReader for an archive that has an index
+// file "<archive>.idx" (see ArchiveIndex, and the "idx" option in rspecifiers
+// and wspecifiers).  Each lookup is a binary search in the (memory-mapped)
+// index followed by a seek in the archive, so it doesn't matter whether the
+// archive or the requests are sorted, and we never hold more than the most
+// recently requested object in memory.
+template<class Holder>  class RandomAccessTableReaderIndexedArchiveImpl:
+      public RandomAccessTableReaderImplBase<Holder> {
+ public:
+  typedef typename Holder::T T;
+
+  RandomAccessTableReaderIndexedArchiveImpl(): state_(kUninitialized) { }
+
+  virtual bool Open(const std::string &rspecifier) {
+    if (state_ != kUninitialized)
+      KALDI_ERR << "Opening already open RandomAccessTableReader: "
+                << "call Close first.";
+    rspecifier_ = rspecifier;
+    RspecifierType rs = ClassifyRspecifier(rspecifier, &archive_rxfilename_,
+                                           &opts_);
+    KALDI_ASSERT(rs == kArchiveRspecifier && opts_.use_index);
+    if (ClassifyRxfilename(archive_rxfilename_) != kFileInput) {
+      KALDI_WARN << "The idx option requires the archive to be an ordinary "
+                 << "file: rspecifier is " << rspecifier;
+      return false;
+    }
+    if (!index_.Open(archive_rxfilename_))
+      return false;  // it will have printed a warning.
+    state_ = kNotHaveObject;
+    return true;
+  }
+
+  virtual bool HasKey(const std::string &key) {
+    if (state_ == kUninitialized)
+      KALDI_ERR << "HasKey called on RandomAccessTableReader object that is "
+                << "not open.";
+    if (state_ == kHaveObject && key == current_key_)
+      return true;
+    int64 offset;
+    if (!index_.Lookup(key, &offset))
+      return false;
+    if (!opts_.permissive)
+      return true;
+    // In permissive mode we have to check that we can read the object.
+    return LoadObject(key, offset);
+  }
+
+  virtual const T &Value(const std::string &key) {
+    if (state_ == kUninitialized)
+      KALDI_ERR << "Value() called on non-open object.";
+    if (!(state_ == kHaveObject && key == current_key_)) {
+      int64 offset;
+      if (!index_.Lookup(key, &offset))
+        KALDI_ERR << "Value() called but no such key " << key
+                  << " in archive " << PrintableRxfilename(archive_rxfilename_);
+      if (!LoadObject(key, offset))
+        KALDI_ERR << "Could not read object for key " << key
+                  << ", rspecifier is " << rspecifier_;
+    }
+    return holder_.Value();
+  }
+
+  virtual bool Close() {
+    if (state_ == kUninitialized)
+      KALDI_ERR << "Close() called on RandomAccessTableReader that was not "
+                << "open.";
+    holder_.Clear();
+    if (input_.IsOpen())
+      input_.Close();
+    index_.Close();
+    current_key_ = "";
+    state_ = kUninitialized;
+    return true;  // Errors in individual objects are reported by Value().
+  }
+
+  virtual ~RandomAccessTableReaderIndexedArchiveImpl() { }
+
+ private:
+  bool LoadObject(const std::string &key, int64 offset) {
+    std::ostringstream rxfilename;
+    rxfilename << archive_rxfilename_ << ':' << offset;
+    if (state_ == kHaveObject)
+      holder_.Clear();
+    state_ = kNotHaveObject;
+    // Input keeps the archive open between calls, as the filename part of the
+    // rxfilename doesn't change, so this is just a seek.
+    bool ans;
+    if (Holder::IsReadInBinary())
+      ans = input_.Open(rxfilename.str(), NULL);
+    else
+      ans = input_.OpenTextMode(rxfilename.str());
+    if (!ans) {
+      KALDI_WARN << "Error opening stream " << rxfilename.str();
+      return false;
+    }
+    if (!holder_.Read(input_.Stream())) {
+      KALDI_WARN << "Error reading object from " << rxfilename.str();
+      return false;
+    }
+    current_key_ = key;
+    state_ = kHaveObject;
+    return true;
+  }
+
+  ArchiveIndex index_;
+  Input input_;
+  Holder holder_;
+  std::string current_key_;  // Key of object in holder_, if kHaveObject.
+  RspecifierOptions opts_;
+  std::string rspecifier_;
+  std::string archive_rxfilename_;
+  enum {
+    kUninitialized,
+    kNotHaveObject,
+    kHaveObject
+  } state_;
+};
+
+
 
 
 
 template<class Holder>
 RandomAccessTableReader<Holder>::RandomAccessTableReader(const std::string &rspecifier):
-    impl_(NULL) {
+    impl_(NULL), stats_(NULL) {
   if (rspecifier != "" && !Open(rspecifier))
     KALDI_ERR << "Error opening RandomAccessTableReader object "
         " (rspecifier is: " << rspecifier << ")";
@@ -2090,14 +2911,22 @@ template<class Holder>
 bool RandomAccessTableReader<Holder>::Open(const std::string &rspecifier) {
   if (IsOpen())
     KALDI_ERR << "Already open.";
+  TableIoStats::Report(stats_);  // In case a previous Open() failed.
+  stats_ = TableIoStats::New("RandomAccessTableReader", rspecifier);
+  TableIoStatsScope scope(stats_);
+  MemoryTagScope memory_tag(kMemoryTableIo);
+  // With the "cache" option, this may be a script file in the table cache.
+  std::string table_rspecifier = ResolveCachedRspecifier(rspecifier);
   RspecifierOptions opts;
-  RspecifierType rs = ClassifyRspecifier(rspecifier, NULL, &opts);
+  RspecifierType rs = ClassifyRspecifier(table_rspecifier, NULL, &opts);
   switch (rs) {
     case kScriptRspecifier:
       impl_ = new RandomAccessTableReaderScriptImpl<Holder>();
       break;
     case kArchiveRspecifier:
-      if (opts.sorted) {
+      if (opts.use_index) {
+        impl_ = new RandomAccessTableReaderIndexedArchiveImpl<Holder>();
+      } else if (opts.sorted) {
         if (opts.called_sorted) // "doubly" sorted case.
           impl_ = new RandomAccessTableReaderDSortedArchiveImpl<Holder>();
         else
@@ -2109,7 +2938,7 @@ bool RandomAccessTableReader<Holder>::Open(const std::string &rspecifier) {
                  << rspecifier;
       return false;
   }
-  if (impl_->Open(rspecifier))
+  if (impl_->Open(table_rspecifier))
     return true;
   else {
     // Warning will already have been printed.
@@ -2124,6 +2953,9 @@ bool RandomAccessTableReader<Holder>::HasKey(const std::string &key) {
   CheckImpl();
   if (!IsToken(key))
     KALDI_ERR << "Invalid key \"" << key << '"';
+  TableIoStatsScope scope(stats_);
+  KALDI_TRACE_SCOPE("RandomAccessTableReader::HasKey");
+  MemoryTagScope memory_tag(kMemoryTableIo);
   return impl_->HasKey(key);
 }
 
@@ -2131,16 +2963,27 @@ bool RandomAccessTableReader<Holder>::HasKey(const std::string &key) {
 template<class Holder>
 const typename RandomAccessTableReader<Holder>::T&
 RandomAccessTableReader<Holder>::Value(const std::string &key) {
-  CheckImpl();  
+  CheckImpl();
+  TableIoStatsScope scope(stats_);
+  KALDI_TRACE_SCOPE("RandomAccessTableReader::Value");
+  MemoryTagScope memory_tag(kMemoryTableIo);
+  if (stats_ != NULL)
+    stats_->num_objects++;
   return impl_->Value(key);
 }
 
 template<class Holder>
 bool RandomAccessTableReader<Holder>::Close() {
   CheckImpl();
-  bool ans =impl_->Close();
-  delete impl_;
-  impl_ = NULL;
+  bool ans;
+  {
+    TableIoStatsScope scope(stats_);
+    ans = impl_->Close();
+    delete impl_;
+    impl_ = NULL;
+  }
+  TableIoStats::Report(stats_);
+  stats_ = NULL;
   return ans;
 }
 
@@ -2148,6 +2991,7 @@ template<class Holder>
 RandomAccessTableReader<Holder>::~RandomAccessTableReader() {
   if (IsOpen() && !Close()) // call Close() yourself to stop this being thrown.
     KALDI_ERR << "failure detected in destructor.";
+  TableIoStats::Report(stats_);  // Only non-NULL if Open() failed.
 }
 
 template<class Holder>
@@ -118,6 +118,13 @@ void UnitTestClassifyWspecifier() {
     KALDI_ASSERT(ans == kBothWspecifier && ark == "a b" && scp == "c,d" && opts.binary == false);
   }
 
+  {
+    std::string a = "ark,idx:foo";
+    std::string ark = "x", scp = "y"; WspecifierOptions opts;
+    WspecifierType ans = ClassifyWspecifier(a, &ark, &scp, &opts);
+    KALDI_ASSERT(ans == kArchiveWspecifier && ark == "foo" && opts.write_index);
+  }
+
   {
     std::string a = "";
     std::string ark = "x", scp = "y"; WspecifierOptions opts;
@@ -248,6 +255,33 @@ void UnitTestClassifyRspecifier() {
   }
 
 
+  {
+    std::string a = "bg,o,ark:foo|";
+    std::string fname = "x";
+    RspecifierOptions opts;
+    RspecifierType ans = ClassifyRspecifier(a, &fname, &opts);
+    KALDI_ASSERT(ans == kArchiveRspecifier && fname == "foo|");
+    KALDI_ASSERT(opts.once && opts.background);
+  }
+
+  {
+    std::string a = "idx,p,ark:foo";
+    std::string fname = "x";
+    RspecifierOptions opts;
+    RspecifierType ans = ClassifyRspecifier(a, &fname, &opts);
+    KALDI_ASSERT(ans == kArchiveRspecifier && fname == "foo");
+    KALDI_ASSERT(opts.use_index && opts.permissive && !opts.background);
+  }
+
+  {
+    std::string a = "bg,nbg,scp:foo|";
+    std::string fname = "x";
+    RspecifierOptions opts;
+    RspecifierType ans = ClassifyRspecifier(a, &fname, &opts);
+    KALDI_ASSERT(ans == kScriptRspecifier && fname == "foo|");
+    KALDI_ASSERT(!opts.background);
+  }
+
   {
     std::string a = "scp:foo|";
     std::string fname = "x";
@@ -576,6 +610,50 @@ void UnitTestTableSequentialInt32VectorVectorBoth(bool binary, bool read_scp) {
   KALDI_ASSERT(v2 == v);
 }
 
+// Tests that BasicVectorHolder and BasicVectorVectorHolder can still read
+// the older binary format, which wrote each element with WriteBasicType().
+void UnitTestHolderReadOldVectorFormat() {
+  std::vector<std::vector<int32> > vv(3);
+  vv[0].push_back(3);
+  vv[0].push_back(-4);
+  vv[2].push_back(100);
+  {
+    Output ko("tmpf", false, false);
+    std::ostream &os = ko.Stream();
+    os << "a ";
+    InitKaldiOutputStream(os, true);
+    WriteBasicType(os, true, static_cast<int32>(vv[0].size()));
+    for (size_t i = 0; i < vv[0].size(); i++)
+      WriteBasicType(os, true, vv[0][i]);
+    os << "b ";
+    InitKaldiOutputStream(os, true);
+    WriteBasicType(os, true, static_cast<int32>(0));
+  }
+  SequentialInt32VectorReader vr("ark:tmpf");
+  KALDI_ASSERT(!vr.Done() && vr.Key() == "a" && vr.Value() == vv[0]);
+  vr.Next();
+  KALDI_ASSERT(!vr.Done() && vr.Key() == "b" && vr.Value().empty());
+  vr.Next();
+  KALDI_ASSERT(vr.Done() && vr.Close());
+
+  {
+    Output ko("tmpf", false, false);
+    std::ostream &os = ko.Stream();
+    os << "a ";
+    InitKaldiOutputStream(os, true);
+    WriteBasicType(os, true, static_cast<int32>(vv.size()));
+    for (size_t i = 0; i < vv.size(); i++) {
+      WriteBasicType(os, true, static_cast<int32>(vv[i].size()));
+      for (size_t j = 0; j < vv[i].size(); j++)
+        WriteBasicType(os, true, vv[i][j]);
+    }
+  }
+  SequentialInt32VectorVectorReader vvr("ark:tmpf");
+  KALDI_ASSERT(!vvr.Done() && vvr.Key() == "a" && vvr.Value() == vv);
+  vvr.Next();
+  KALDI_ASSERT(vvr.Done() && vvr.Close());
+}
+
 
 void UnitTestTableSequentialInt32Script(bool binary) {
   int32 sz = Rand() % 10;
@@ -675,6 +753,94 @@ void UnitTestTableSequentialDoubleMatrixBoth(bool binary, bool read_scp) {
 }
 
 
+// Reading with the "bg" (background) option, freeing some objects, stopping
+// early and reading an scp with an entry that can't be loaded.
+void UnitTestTableSequentialBackground(bool binary, bool read_scp) {
+  int32 sz = Rand() % 10;
+  std::vector<std::string> k;
+  std::vector<Matrix<double>*> v;
+
+  for (int32 i = 0; i < sz; i++) {
+    k.push_back("key" + CharToString('a' + static_cast<char>(i)));
+    v.push_back(new Matrix<double>(1 + Rand() % 4, 1 + Rand() % 4));
+    v.back()->SetRandn();
+  }
+
+  DoubleMatrixWriter bw(binary ? "b,ark,scp:tmpf,tmpf.scp" :
+                        "t,ark,scp:tmpf,tmpf.scp");
+  for (int32 i = 0; i < sz; i++)
+    bw.Write(k[i], *(v[i]));
+  KALDI_ASSERT(bw.Close());
+
+  std::string rspecifier = (read_scp ? "bg,scp:tmpf.scp" : "bg,ark:tmpf");
+  {
+    SequentialDoubleMatrixReader sbr(rspecifier);
+    int32 i = 0;
+    for (; !sbr.Done(); sbr.Next(), i++) {
+      KALDI_ASSERT(i < sz && sbr.Key() == k[i]);
+      if (i % 3 == 1) {
+        sbr.FreeCurrent();
+      } else {
+        KALDI_ASSERT(sbr.Value().ApproxEqual(*(v[i]),
+                                             binary ? 1.0e-10 : 1.0e-04));
+      }
+    }
+    KALDI_ASSERT(i == sz);
+    KALDI_ASSERT(sbr.Close());
+  }
+  {
+    // Stop early; the destructor has to stop the background thread.
+    SequentialDoubleMatrixReader sbr(rspecifier);
+    if (!sbr.Done())
+      KALDI_ASSERT(sbr.Key() == k[0]);
+  }
+  {
+    Output ko("tmpf.scp", false, false);
+    ko.Stream() << "a tmpf_nonexistent\n";
+    for (int32 i = 0; i < sz; i++)
+      ko.Stream() << k[i] << " tmpf_" << k[i] << "\n";
+    ko.Stream() << "b tmpf_nonexistent\n";
+  }
+  for (int32 i = 0; i < sz; i++) {
+    Output ko("tmpf_" + k[i], binary);
+    v[i]->Write(ko.Stream(), binary);
+  }
+  {
+    SequentialDoubleMatrixReader sbr("bg,scp:tmpf.scp");
+    KALDI_ASSERT(!sbr.Done() && sbr.Key() == "a");
+    bool threw = false;
+    try {
+      sbr.Value();
+    } catch (...) {
+      threw = true;
+    }
+    KALDI_ASSERT(threw);
+    sbr.Next();
+    for (int32 i = 0; i < sz; i++, sbr.Next()) {
+      KALDI_ASSERT(sbr.Key() == k[i] && sbr.Value().NumRows() ==
+                   v[i]->NumRows());
+    }
+    KALDI_ASSERT(!sbr.Done() && sbr.Key() == "b");
+    sbr.Next();
+    KALDI_ASSERT(sbr.Done() && sbr.Close());
+  }
+  {
+    // In permissive mode the entries that can't be read are skipped.
+    SequentialDoubleMatrixReader sbr("bg,p,scp:tmpf.scp");
+    int32 i = 0;
+    for (; !sbr.Done(); sbr.Next(), i++)
+      KALDI_ASSERT(sbr.Key() == k[i]);
+    KALDI_ASSERT(i == sz && sbr.Close());
+  }
+  for (int32 i = 0; i < sz; i++) {
+    delete v[i];
+    unlink(("tmpf_" + k[i]).c_str());
+  }
+  unlink("tmpf");
+  unlink("tmpf.scp");
+}
+
+
 // Writing as both and reading as archive.
 void UnitTestTableSequentialBaseFloatVectorBoth(bool binary, bool read_scp) {
   int32 sz = Rand() % 10;
@@ -804,6 +970,177 @@ void UnitTestTableRandomBothDouble(bool binary, bool read_scp,
 }
 
 
+// Writing with the "bg" option.
+void UnitTestTableWriterBackground(bool binary, bool write_scp) {
+  int32 sz = Rand() % 20;
+  std::vector<std::string> k;
+  std::vector<Matrix<double> > v;
+  for (int32 i = 0; i < sz; i++) {
+    k.push_back("key" + CharToString('a' + static_cast<char>(i)));
+    v.push_back(Matrix<double>(1 + Rand() % 4, 1 + Rand() % 4));
+    v.back().SetRandn();
+  }
+  std::string wspecifier = std::string(binary ? "b" : "t") + ",bg," +
+      (write_scp ? "ark,scp:tmpf,tmpf.scp" : "ark:tmpf");
+  {
+    DoubleMatrixWriter bw(wspecifier);
+    for (int32 i = 0; i < sz; i++) {
+      Matrix<double> m(v[i]);
+      bw.Write(k[i], m);
+      m.SetZero();  // The writer must have taken a copy.
+      if (i % 5 == 2)
+        bw.Flush();
+    }
+    KALDI_ASSERT(bw.Close());
+  }
+  {
+    SequentialDoubleMatrixReader sbr(write_scp ? "scp:tmpf.scp" : "ark:tmpf");
+    int32 i = 0;
+    for (; !sbr.Done(); sbr.Next(), i++) {
+      KALDI_ASSERT(i < sz && sbr.Key() == k[i]);
+      KALDI_ASSERT(sbr.Value().ApproxEqual(v[i], binary ? 1.0e-10 : 1.0e-04));
+    }
+    KALDI_ASSERT(i == sz);
+  }
+  {
+    // The destructor has to wait for the objects to be written.
+    DoubleMatrixWriter bw("bg,ark:tmpf2");
+    for (int32 i = 0; i < sz; i++)
+      bw.Write(k[i], v[i]);
+  }
+  {
+    RandomAccessDoubleMatrixReader rbr("ark:tmpf2");
+    for (int32 i = 0; i < sz; i++)
+      KALDI_ASSERT(rbr.Value(k[i]).ApproxEqual(v[i]));
+  }
+  {
+    // Write errors are reported by a later Write() or by Close(): here the
+    // script file that tells us where to write has no entry for the key.
+    {
+      Output ko("tmpf.scp", false);
+      ko.Stream() << "a tmpf_a\n";
+    }
+    DoubleMatrixWriter bw("bg,scp:tmpf.scp");
+    Matrix<double> m(2, 2);
+    bw.Write("a", m);
+    bw.Write("b", m);
+    bool threw = false;
+    try {
+      for (int32 i = 0; i < 100; i++)
+        bw.Write("a", m);
+    } catch (const std::exception &e) {
+      threw = true;
+    }
+    KALDI_ASSERT(threw && !bw.Close());
+  }
+  unlink("tmpf");
+  unlink("tmpf2");
+  unlink("tmpf.scp");
+  unlink("tmpf_a");
+}
+
+// Writing with the "shards=N" option.
+void UnitTestTableWriterSharded(bool binary, bool write_scp, bool by_key) {
+  int32 sz = Rand() % 20, num_shards = RandInt(1, 4);
+  std::vector<std::string> k;
+  std::vector<Matrix<double> > v;
+  for (int32 i = 0; i < sz; i++) {
+    k.push_back("key" + CharToString('a' + static_cast<char>(i)));
+    v.push_back(Matrix<double>(1 + Rand() % 4, 1 + Rand() % 4));
+    v.back().SetRandn();
+  }
+  std::ostringstream wspecifier;
+  wspecifier << (binary ? "b" : "t") << ",shards=" << num_shards
+             << (by_key ? ",hash" : "")
+             << (write_scp ? ",ark,scp:tmpf.SHARD.ark,tmpf.SHARD.scp" :
+                 ",ark:tmpf.SHARD.ark");
+  {
+    DoubleMatrixWriter bw(wspecifier.str());
+    for (int32 i = 0; i < sz; i++)
+      bw.Write(k[i], v[i]);
+    KALDI_ASSERT(bw.Close());
+  }
+  int32 num_read = 0;
+  for (int32 shard = 1; shard <= num_shards; shard++) {
+    std::ostringstream rspecifier;
+    if (write_scp) rspecifier << "scp:tmpf." << shard << ".scp";
+    else rspecifier << "ark:tmpf." << shard << ".ark";
+    SequentialDoubleMatrixReader sbr(rspecifier.str());
+    int32 prev = -1;
+    for (; !sbr.Done(); sbr.Next(), num_read++) {
+      int32 i = std::find(k.begin(), k.end(), sbr.Key()) - k.begin();
+      KALDI_ASSERT(i > prev && i < sz);
+      prev = i;
+      if (by_key)
+        KALDI_ASSERT(StringHasher()(k[i]) % num_shards == shard - 1);
+      else
+        KALDI_ASSERT(i % num_shards == shard - 1);
+      KALDI_ASSERT(sbr.Value().ApproxEqual(v[i], binary ? 1.0e-10 : 1.0e-04));
+    }
+    std::ostringstream filename;
+    filename << "tmpf." << shard << ".";
+    unlink((filename.str() + "ark").c_str());
+    unlink((filename.str() + "scp").c_str());
+  }
+  KALDI_ASSERT(num_read == sz);
+  {
+    DoubleMatrixWriter bw;
+    KALDI_ASSERT(!bw.Open("ark,shards=2:tmpf.ark"));  // No "SHARD".
+  }
+  KALDI_ASSERT(ClassifyWspecifier("ark,shards=0:tmpf.SHARD.ark", NULL, NULL,
+                                  NULL) == kNoWspecifier);
+}
+
+// Writing an archive with an index ("idx" option), and reading it with
+// random access using the index.
+void UnitTestTableRandomIndexed(bool binary, bool write_scp) {
+  int32 sz = Rand() % 10;
+  std::vector<std::string> k;
+  std::vector<Matrix<BaseFloat>*> v;
+  for (int32 i = 0; i < sz; i++) {
+    // Keys in reverse order, so the archive is not sorted.
+    k.push_back("key" + CharToString('z' - static_cast<char>(i)));
+    v.push_back(new Matrix<BaseFloat>(1 + Rand() % 4, 1 + Rand() % 4));
+    v.back()->SetRandn();
+  }
+  std::string wspecifier = std::string(binary ? "b," : "t,") +
+      (write_scp ? "ark,scp,idx:tmpf,tmpf.scp" : "ark,idx:tmpf");
+  {
+    BaseFloatMatrixWriter writer(wspecifier);
+    for (int32 i = 0; i < sz; i++)
+      writer.Write(k[i], *(v[i]));
+    if (sz > 0)  // A repeated key; for lookup, the first one should win.
+      writer.Write(k[0], Matrix<BaseFloat>(5, 5));
+    KALDI_ASSERT(writer.Close());
+  }
+  {
+    RandomAccessBaseFloatMatrixReader reader("idx,ark:tmpf");
+    for (int32 n = 0; n < 3 * sz; n++) {
+      int32 i = Rand() % sz;
+      KALDI_ASSERT(reader.HasKey(k[i]));
+      KALDI_ASSERT(reader.Value(k[i]).ApproxEqual(*(v[i]), 1.0e-04));
+    }
+    KALDI_ASSERT(!reader.HasKey("key") && !reader.HasKey("keyzz"));
+    KALDI_ASSERT(reader.Close());
+  }
+  {
+    // Modify the archive; the index is now out of date and we should fail to
+    // open it.
+    std::ofstream os("tmpf", std::ios::app);
+    os << "extra ";
+  }
+  {
+    RandomAccessBaseFloatMatrixReader reader;
+    KALDI_ASSERT(!reader.Open("idx,ark:tmpf"));
+  }
+  for (int32 i = 0; i < sz; i++)
+    delete v[i];
+  unlink("tmpf");
+  unlink("tmpf.idx");
+  unlink("tmpf.scp");
+}
+
+
 void UnitTestTableRandomBothDoubleMatrix(bool binary, bool read_scp,
                                          bool sorted, bool called_sorted,
                                          bool once) {
@@ -887,6 +1224,7 @@ int main() {
   UnitTestReadScriptFile();
   UnitTestClassifyWspecifier();
   UnitTestClassifyRspecifier();
+  UnitTestHolderReadOldVectorFormat();
   for (int i = 0; i < 10; i++) {
     bool b = (i == 0);
     UnitTestTableSequentialBool(b);
@@ -901,6 +1239,10 @@ int main() {
       UnitTestTableSequentialInt32PairVectorBoth(b, c);
       UnitTestTableSequentialInt32VectorVectorBoth(b, c);
       UnitTestTableSequentialBaseFloatVectorBoth(b, c);
+      UnitTestTableSequentialBackground(b, c);
+      UnitTestTableRandomIndexed(b, c);
+      UnitTestTableWriterBackground(b, c);
+      UnitTestTableWriterSharded(b, c, Rand() % 2 == 0);
       for (int k = 0; k < 2; k++) {
         bool d = (k == 0);
         for (int l = 0; l < 2; l++) {
@@ -17,6 +17,10 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
 #include "util/kaldi-table.h"
 #include "util/text-utils.h"
 
@@ -105,6 +109,154 @@ bool WriteScriptFile(std::ostream &os,
   return true;
 }
 
+
+static const char kArchiveIndexMagic[] = "KALDIIDX";  // 8 chars + '\0'.
+static const size_t kArchiveIndexHeaderSize = 8 + 2 * sizeof(int64);
+
+// Compares the keys of (key, offset) pairs only.
+static bool ArchiveIndexEntryLess(const std::pair<std::string, int64> &a,
+                                  const std::pair<std::string, int64> &b) {
+  return a.first < b.first;
+}
+
+// Returns the size of the file in bytes, or -1 if it cannot be opened.
+static int64 GetArchiveFileSize(const std::string &filename) {
+  std::ifstream is(filename.c_str(), std::ios::binary);
+  is.seekg(0, std::ios::end);
+  if (!is.good()) return -1;
+  return static_cast<int64>(is.tellg());
+}
+
+bool WriteArchiveIndex(const std::string &archive_filename,
+                       std::vector<std::pair<std::string, int64> > *entries) {
+  std::string wxfilename = archive_filename + ".idx";
+  int64 archive_size = GetArchiveFileSize(archive_filename);
+  if (archive_size < 0) {
+    KALDI_WARN << "Cannot write index: error opening archive "
+               << archive_filename;
+    return false;
+  }
+  std::stable_sort(entries->begin(), entries->end(), ArchiveIndexEntryLess);
+  Output ko;
+  if (!ko.Open(wxfilename, true, false)) {
+    KALDI_WARN << "Error opening archive index "
+               << PrintableWxfilename(wxfilename) << " for writing";
+    return false;
+  }
+  std::ostream &os = ko.Stream();
+  int64 num_keys = entries->size();
+  os.write(kArchiveIndexMagic, 8);
+  os.write(reinterpret_cast<const char*>(&num_keys), sizeof(num_keys));
+  os.write(reinterpret_cast<const char*>(&archive_size), sizeof(archive_size));
+  int64 key_offset = 0;
+  for (size_t i = 0; i < entries->size(); i++) {
+    int64 pair[2] = { key_offset, (*entries)[i].second };
+    os.write(reinterpret_cast<const char*>(pair), sizeof(pair));
+    key_offset += (*entries)[i].first.size() + 1;
+  }
+  for (size_t i = 0; i < entries->size(); i++)
+    os.write((*entries)[i].first.c_str(), (*entries)[i].first.size() + 1);
+  if (!os.good() || !ko.Close()) {
+    KALDI_WARN << "Error writing archive index "
+               << PrintableWxfilename(wxfilename);
+    return false;
+  }
+  return true;
+}
+
+bool ArchiveIndex::Open(const std::string &archive_filename) {
+  Close();
+  std::string filename = archive_filename + ".idx";
+  bool ans;
+  if (mapped_.Open(filename)) {
+    ans = Init(mapped_.Data(), mapped_.Size(), filename);
+  } else {
+    // We couldn't memory-map it (e.g. on Windows); read it instead.
+    std::ifstream is(filename.c_str(), std::ios::binary);
+    if (!is.is_open()) {
+      KALDI_WARN << "Error opening archive index " << filename;
+      return false;
+    }
+    std::vector<char> buffer((std::istreambuf_iterator<char>(is)),
+                             std::istreambuf_iterator<char>());
+    buffer_.swap(buffer);
+    if (buffer_.empty()) buffer_.push_back('\0');  // so &(buffer_[0]) is
+                                                    // valid; Init() rejects it.
+    ans = Init(&(buffer_[0]), buffer_.size(), filename);
+  }
+  if (!ans) return false;
+  if (GetArchiveFileSize(archive_filename) != archive_size_) {
+    KALDI_WARN << "Archive " << archive_filename << " does not exist or "
+               << "has changed since its index " << filename << " was "
+               << "written; re-create the index (e.g. write the archive "
+               << "with the idx option).";
+    Close();
+    return false;
+  }
+  return true;
+}
+
+bool ArchiveIndex::Init(const char *data, size_t size,
+                        const std::string &filename) {
+  if (size < kArchiveIndexHeaderSize ||
+      std::memcmp(data, kArchiveIndexMagic, 8) != 0) {
+    KALDI_WARN << "File " << filename << " is not an archive index.";
+    Close();
+    return false;
+  }
+  std::memcpy(&num_keys_, data + 8, sizeof(int64));
+  std::memcpy(&archive_size_, data + 8 + sizeof(int64), sizeof(int64));
+  size_t entries_size = 2 * sizeof(int64) * num_keys_;
+  if (num_keys_ < 0 || size - kArchiveIndexHeaderSize < entries_size) {
+    KALDI_WARN << "Archive index " << filename << " is truncated or corrupt.";
+    Close();
+    return false;
+  }
+  // The header is 24 bytes and the data is page-aligned (or came from
+  // std::vector), so entries_ is suitably aligned for int64.
+  entries_ = reinterpret_cast<const int64*>(data + kArchiveIndexHeaderSize);
+  keys_ = data + kArchiveIndexHeaderSize + entries_size;
+  keys_size_ = size - kArchiveIndexHeaderSize - entries_size;
+  if (num_keys_ > 0 && (keys_size_ == 0 || keys_[keys_size_ - 1] != '\0' ||
+                        entries_[2 * (num_keys_ - 1)] >=
+                        static_cast<int64>(keys_size_))) {
+    KALDI_WARN << "Archive index " << filename << " is truncated or corrupt.";
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void ArchiveIndex::Close() {
+  mapped_.Close();
+  std::vector<char> empty;
+  buffer_.swap(empty);
+  num_keys_ = 0;
+  archive_size_ = 0;
+  entries_ = NULL;
+  keys_ = NULL;
+  keys_size_ = 0;
+}
+
+bool ArchiveIndex::Lookup(const std::string &key, int64 *offset) const {
+  KALDI_ASSERT(IsOpen());
+  const char *key_str = key.c_str();
+  // Binary search for the first entry whose key is >= "key".
+  int64 lo = 0, hi = num_keys_;
+  while (lo < hi) {
+    int64 mid = lo + (hi - lo) / 2;
+    if (std::strcmp(keys_ + entries_[2 * mid], key_str) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo < num_keys_ && std::strcmp(keys_ + entries_[2 * lo], key_str) == 0) {
+    *offset = entries_[2 * lo + 1];
+    return true;
+  }
+  return false;
+}
+
 bool WriteScriptFile(const std::string &wxfilename,
                      const std::vector<std::pair<std::string, std::string> > &script) {
   Output output;
@@ -173,6 +325,25 @@ WspecifierType ClassifyWspecifier(const std::string &wspecifier,
       if (opts) opts->binary = false;
     } else if (!strcmp(c, "p")) {
       if (opts) opts->permissive = true;
+    } else if (!strcmp(c, "idx")) {
+      if (opts) opts->write_index = true;
+    } else if (!strcmp(c, "bc")) {
+      if (opts) opts->block_compressed = true;
+    } else if (!strcmp(c, "nbc")) {
+      if (opts) opts->block_compressed = false;
+    } else if (!strcmp(c, "bg")) {
+      if (opts) opts->background = true;
+    } else if (!strcmp(c, "nbg")) {
+      if (opts) opts->background = false;
+    } else if (!strncmp(c, "shards=", 7)) {
+      int32 num_shards;
+      if (!ConvertStringToInteger(c + 7, &num_shards) || num_shards <= 0)
+        return kNoWspecifier;
+      if (opts) opts->num_shards = num_shards;
+    } else if (!strcmp(c, "hash")) {
+      if (opts) opts->shard_by_key = true;
+    } else if (!strcmp(c, "nhash")) {
+      if (opts) opts->shard_by_key = false;
     } else if (!strcmp(c, "ark")) {
       if (ws == kNoWspecifier) ws = kArchiveWspecifier;
       else return kNoWspecifier;  // We do not allow "scp, ark", only "ark, scp".
@@ -219,7 +390,8 @@ RspecifierType ClassifyRspecifier(const std::string &rspecifier,
   // We also allow the meaningless prefixes b, and t,
   // plus the options o (once), no (not-once),
   // s (sorted) and ns (not-sorted), p (permissive)
-  // and np (not-permissive).
+  // and np (not-permissive), bg (background) and nbg (not-background),
+  // idx (index) and nidx, and cache and ncache.
   // so the following would be valid:
   //
   // f, o, b, np, ark:rxfilename  ->  kArchiveRspecifier
@@ -276,6 +448,18 @@ RspecifierType ClassifyRspecifier(const std::string &rspecifier,
       if (opts) opts->called_sorted = true;
     } else if (!strcmp(c, "ncs")) {
       if (opts) opts->called_sorted = false;
+    } else if (!strcmp(c, "bg")) {
+      if (opts) opts->background = true;
+    } else if (!strcmp(c, "nbg")) {
+      if (opts) opts->background = false;
+    } else if (!strcmp(c, "idx")) {
+      if (opts) opts->use_index = true;
+    } else if (!strcmp(c, "nidx")) {
+      if (opts) opts->use_index = false;
+    } else if (!strcmp(c, "cache")) {
+      if (opts) opts->cache = true;
+    } else if (!strcmp(c, "ncache")) {
+      if (opts) opts->cache = false;
     } else if (!strcmp(c, "ark")) {
       if (rs == kNoRspecifier) rs = kArchiveRspecifier;
       else return kNoRspecifier;  // Repeated or combined ark and scp options invalid.
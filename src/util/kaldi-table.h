@@ -27,6 +27,8 @@
 
 #include "base/kaldi-common.h"
 #include "util/kaldi-holder.h"
+#include "util/mapped-file.h"
+#include "util/table-io-stats.h"
 
 namespace kaldi {
 
@@ -70,9 +72,34 @@ typedef std::vector<std::string> KeyList;
 //  p means permissive mode, when writing to an "scp" file only: will ignore
 //     missing scp entries, i.e. won't write anything for those files but will
 //     return success status).
+//  idx means write an index file "<archive>.idx" next to the archive when it
+//     is closed (archives only, and the archive must be an ordinary file); see
+//     the "idx" rspecifier option and the ArchiveIndex class below.
+//  bc means write the archive in the block-compressed format (see
+//     util/block-compressed-stream.h), which is compressed in parallel, in
+//     blocks, with LZ4 (nbc means don't, which is the default).  The archive
+//     must be an ordinary file.  It is read like any other archive: offsets in
+//     scp and index files refer to the uncompressed data, so random access
+//     still works.
+//  bg means "background": the objects are serialized and written in a
+//     separate thread, so the program does not wait for the writes.  Write()
+//     copies the object and returns at once, unless several objects are
+//     already waiting to be written.  Errors are reported by the next Write()
+//     or by Close() (nbg means don't, which is the default).
+//  shards=N means write N archives (and scp files, if "scp" is given), each
+//     in its own background thread, instead of one, so that downstream jobs
+//     can read them in parallel.  The filenames must contain the string
+//     "SHARD", which is replaced by the shard index 1, 2, ... N.  The objects
+//     go to the shards in turn, or, with the "hash" option, to a shard chosen
+//     from a hash of the key, so that a given key always goes to the same
+//     shard.  Any other options apply to each shard.
 //
 //  So the following are valid wspecifiers:
 //  ark,b,f:foo
+//  ark,idx:foo.ark
+//  ark,scp,bc:foo.ark,foo.scp
+//  ark,bg:foo.ark
+//  ark,scp,shards=4:egs.SHARD.ark,egs.SHARD.scp
 //  "ark,b,b:| gzip -c > foo"
 //  "ark,scp,t,nf:foo.ark,|gzip -c > foo.scp.gz"
 //  ark,b:-
@@ -113,7 +140,15 @@ struct WspecifierOptions {
   bool binary;
   bool flush;
   bool permissive; // will ignore absent scp entries.
-  WspecifierOptions(): binary(true), flush(false), permissive(false) { }
+  bool write_index;  // write "<archive>.idx" when the archive is closed.
+  bool block_compressed;  // write the archive in the block-compressed format.
+  bool background;  // serialize and write in a background thread.
+  int32 num_shards;  // if > 0, write this many archives ("shards=N" option).
+  bool shard_by_key;  // choose the shard from a hash of the key.
+  WspecifierOptions(): binary(true), flush(false), permissive(false),
+                       write_index(false), block_compressed(false),
+                       background(false), num_shards(0),
+                       shard_by_key(false) { }
 };
 
 // ClassifyWspecifier returns the type of the wspecifier string,
@@ -156,6 +191,65 @@ bool WriteScriptFile(const std::string &wxfilename,
 bool WriteScriptFile(std::ostream &os,
                      const std::vector<std::pair<std::string, std::string> > &script);
 
+
+// WriteArchiveIndex writes the index file "<archive>.idx" for the archive
+// "archive_filename", which must be an ordinary file that has already been
+// closed, given the byte offsets in the archive of the objects (i.e. the
+// positions just after "key "; for block-compressed archives these are
+// positions in the uncompressed data).  It sorts "entries" (stably, so that
+// for repeated keys the first one is found, as when reading the archive
+// sequentially).  Returns true on success.  The format is binary, in native
+// byte order: the token "KALDIIDX", then int64 num-keys and archive-size (the
+// size of the archive file on disk), then num-keys pairs of int64
+// (offset-of-key-in-string-pool, offset-in-archive), sorted by key, and then
+// the keys themselves, each followed by '\0'.
+bool WriteArchiveIndex(const std::string &archive_filename,
+                       std::vector<std::pair<std::string, int64> > *entries);
+
+/// ArchiveIndex gives read access to an index file written by
+/// WriteArchiveIndex(), which maps each key in an archive to the byte offset
+/// of its object.  The file is memory-mapped where possible (see class
+/// MappedFile), so opening it is cheap and it uses no memory of its own even
+/// for huge archives; lookup is a binary search.
+class ArchiveIndex {
+ public:
+  ArchiveIndex(): num_keys_(0), archive_size_(0), entries_(NULL),
+                  keys_(NULL), keys_size_(0) { }
+
+  /// Opens the index "<archive_filename>.idx" of the archive
+  /// "archive_filename" (which must be an ordinary file), and checks that the
+  /// archive is the size it was when the index was written, as a guard
+  /// against out-of-date indexes.  Returns true on success; on error, prints a
+  /// warning and returns false.
+  bool Open(const std::string &archive_filename);
+
+  bool IsOpen() const { return keys_ != NULL; }
+
+  void Close();
+
+  /// Looks up "key"; if it's present, outputs the byte offset of its object in
+  /// the archive and returns true.
+  bool Lookup(const std::string &key, int64 *offset) const;
+
+  int64 NumKeys() const { return num_keys_; }
+
+  /// The size in bytes of the archive file when the index was written; this
+  /// is used to detect an index that doesn't match its archive.
+  int64 ArchiveSize() const { return archive_size_; }
+
+ private:
+  bool Init(const char *data, size_t size, const std::string &filename);
+
+  MappedFile mapped_;  // Used if we could memory-map the file...
+  std::vector<char> buffer_;  // .. otherwise we read it into here.
+  int64 num_keys_;
+  int64 archive_size_;
+  const int64 *entries_;  // pairs of (key offset, archive offset).
+  const char *keys_;
+  size_t keys_size_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(ArchiveIndex);
+};
+
 // Documentation for "rspecifier"
 // "rspecifier" describes how we read a set of objects indexed by keys.
 // The possibilities are:
@@ -173,12 +267,27 @@ bool WriteScriptFile(std::ostream &os,
 //   p   means "permissive", and causes it to skip over keys whose corresponding
 //       scp-file entries cannot be read. [and to ignore errors in archives and
 //       script files, and just consider the "good" entries].
+//   bg  means "background": for SequentialTableReader only, the objects are
+//       read and parsed in a separate thread, a couple of objects ahead of
+//       the program, so that I/O and decompression overlap with computation.
+//       It has no effect for RandomAccessTableReader.
 //       We allow the negation of the options above, as in no, ns, np,
 //       but these aren't currently very useful (just equivalent to omitting the
 //       corresponding option).
 //      [any of the above options can be prefixed by n to negate them, e.g. no, ns,
 //       ncs, np; but these aren't currently useful as you could just omit the option].
 //
+//   idx means that the archive has an index file "<archive>.idx" written by
+//       the "idx" wspecifier option; RandomAccessTableReader will then seek
+//       directly to each object it is asked for, instead of reading through
+//       the archive and storing objects.  The archive must be an ordinary
+//       file; "idx" is ignored for script files and by SequentialTableReader.
+//
+//   cache means that if the environment variable KALDI_TABLE_CACHE is set and
+//       the node-local table cache in that directory has an entry for this
+//       table (created by cache-feats), we read the entry instead; see
+//       ../util/table-cache.h.
+//
 //   b   is ignored [for scripting convenience]
 //   t   is ignored [for scripting convenience]
 //
@@ -186,6 +295,8 @@ bool WriteScriptFile(std::ostream &os,
 //  So for instance the following would be a valid rspecifier:
 //
 //   "o, s, p, ark:gunzip -c foo.gz|"
+//   "bg, ark:gunzip -c foo.gz|"
+//   "s, cs, cache, ark:apply-cmvn ... scp:feats.scp ark:- |"
 
 struct  RspecifierOptions {
   // These options only make a difference for the RandomAccessTableReader class.
@@ -198,9 +309,16 @@ struct  RspecifierOptions {
   // For archive files it will suppress errors getting thrown if the archive
   
   // is corrupted and can't be read to the end.
+  bool background;  // For SequentialTableReader only: if true, read ahead
+  // in a background thread.
+  bool use_index;  // For RandomAccessTableReader on archives: look up keys in
+  // the index file "<archive>.idx".
+  bool cache;  // Read the table from the table cache, if it has an entry for
+  // it; see ../util/table-cache.h.
 
   RspecifierOptions(): once(false), sorted(false),
-                       called_sorted(false), permissive(false) { }
+                       called_sorted(false), permissive(false),
+                       background(false), use_index(false), cache(false) { }
 };
 
 enum RspecifierType  {
@@ -225,7 +343,7 @@ class RandomAccessTableReader {
  public:
   typedef typename Holder::T T;
 
-  RandomAccessTableReader(): impl_(NULL) { }
+  RandomAccessTableReader(): impl_(NULL), stats_(NULL) { }
 
   // This constructor equivalent to default constructor + "open", but
   // throws on error.
@@ -260,13 +378,14 @@ class RandomAccessTableReader {
   // Allow copy-constructor only for non-opened readers (needed for inclusion in
   // stl vector)
   RandomAccessTableReader(const RandomAccessTableReader<Holder> &other):
-      impl_(NULL) { KALDI_ASSERT(other.impl_ == NULL); }
+      impl_(NULL), stats_(NULL) { KALDI_ASSERT(other.impl_ == NULL); }
  private:
   // Disallow assignment.
   RandomAccessTableReader &operator=(const RandomAccessTableReader<Holder>&);
   void CheckImpl() const; // Checks that impl_ is non-NULL; prints an error
                           // message and dies (with KALDI_ERR) if NULL.
   RandomAccessTableReaderImplBase<Holder> *impl_;
+  TableIoStats *stats_;  // Non-NULL if collecting stats; see table-io-stats.h
 };
 
 
@@ -278,7 +397,7 @@ class SequentialTableReader {
  public:
   typedef typename Holder::T T;
 
-  SequentialTableReader(): impl_(NULL) { }
+  SequentialTableReader(): impl_(NULL), stats_(NULL) { }
 
   // This constructor equivalent to default constructor + "open", but
   // throws on error.
@@ -342,13 +461,14 @@ class SequentialTableReader {
   // Allow copy-constructor only for non-opened readers (needed for inclusion in
   // stl vector)
   SequentialTableReader(const SequentialTableReader<Holder> &other):
-      impl_(NULL) { KALDI_ASSERT(other.impl_ == NULL); }
+      impl_(NULL), stats_(NULL) { KALDI_ASSERT(other.impl_ == NULL); }
  private:
   // Disallow assignment.
   SequentialTableReader &operator = (const SequentialTableReader<Holder>&); 
   void CheckImpl() const; // Checks that impl_ is non-NULL; prints an error
                           // message and dies (with KALDI_ERR) if NULL.
   SequentialTableReaderImplBase<Holder> *impl_;
+  TableIoStats *stats_;  // Non-NULL if collecting stats; see table-io-stats.h
 };
 
 
@@ -359,7 +479,7 @@ class TableWriter {
  public:
   typedef typename Holder::T T;
 
-  TableWriter(): impl_(NULL) { }
+  TableWriter(): impl_(NULL), stats_(NULL) { }
 
   // This constructor equivalent to default constructor
   // + "open", but throws on error.  See docs for
@@ -374,7 +494,9 @@ class TableWriter {
   bool IsOpen() const;
 
   // Write the object.  Throws  std::runtime_error on error (via the
-  // KALDI_ERR macro)
+  // KALDI_ERR macro).  With the "bg" wspecifier option, the object is copied
+  // and written later, and write errors are thrown by the next Write() or
+  // reported by Close().
   inline void Write(const std::string &key, const T &value) const;
 
 
@@ -394,7 +516,7 @@ class TableWriter {
   
   // Allow copy-constructor only for non-opened writers (needed for inclusion in
   // stl vector)
-  TableWriter(const TableWriter &other): impl_(NULL) {
+  TableWriter(const TableWriter &other): impl_(NULL), stats_(NULL) {
     KALDI_ASSERT(other.impl_ == NULL);
   }
  private:
@@ -402,6 +524,7 @@ class TableWriter {
   void CheckImpl() const; // Checks that impl_ is non-NULL; prints an error
                           // message and dies (with KALDI_ERR) if NULL.
   TableWriterImplBase<Holder> *impl_;
+  TableIoStats *stats_;  // Non-NULL if collecting stats; see table-io-stats.h
 };
 
 
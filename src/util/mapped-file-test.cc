@@ -0,0 +1,58 @@
+// util/mapped-file-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "util/mapped-file.h"
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+
+namespace kaldi {
+
+void UnitTestMappedFile() {
+  std::string filename = "tmpf";
+  std::string contents;
+  int32 size = 1 + Rand() % 20000;
+  for (int32 i = 0; i < size; i++)
+    contents.push_back(static_cast<char>(Rand() % 256));
+  {
+    std::ofstream os(filename.c_str(), std::ios::binary);
+    os.write(contents.data(), contents.size());
+    KALDI_ASSERT(os.good());
+  }
+  MappedFile mf;
+  KALDI_ASSERT(!mf.IsOpen());
+  KALDI_ASSERT(mf.Open(filename));
+  KALDI_ASSERT(mf.IsOpen() && mf.Size() == contents.size());
+  KALDI_ASSERT(std::string(mf.Data(), mf.Size()) == contents);
+  mf.Close();
+  KALDI_ASSERT(!mf.IsOpen() && mf.Size() == 0);
+  unlink(filename.c_str());
+  // Opening a nonexistent file should fail without crashing.
+  KALDI_ASSERT(!mf.Open(filename));
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 10; i++)
+    UnitTestMappedFile();
+  std::cout << "Test OK.\n";
+}
@@ -0,0 +1,82 @@
+// util/mapped-file.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "util/mapped-file.h"
+
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <cerrno>
+#include <cstring>
+
+namespace kaldi {
+
+bool MappedFile::Open(const std::string &filename) {
+  Close();
+#ifdef _MSC_VER
+  KALDI_WARN << "Memory-mapping files is not supported on Windows: "
+             << filename;
+  return false;
+#else
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    KALDI_WARN << "Could not open file " << filename << " for mapping: "
+               << strerror(errno);
+    return false;
+  }
+  struct stat buf;
+  if (fstat(fd, &buf) != 0 || !S_ISREG(buf.st_mode)) {
+    KALDI_WARN << "Cannot map " << filename << ": not an ordinary file.";
+    close(fd);
+    return false;
+  }
+  if (buf.st_size == 0) {
+    KALDI_WARN << "Cannot map " << filename << ": file is empty.";
+    close(fd);
+    return false;
+  }
+  void *addr = mmap(NULL, buf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  // The mapping stays valid after the file descriptor is closed.
+  close(fd);
+  if (addr == MAP_FAILED) {
+    KALDI_WARN << "Failed to map file " << filename << ": "
+               << strerror(errno);
+    return false;
+  }
+  data_ = static_cast<const char*>(addr);
+  size_ = buf.st_size;
+  return true;
+#endif
+}
+
+void MappedFile::Close() {
+  if (data_ == NULL) return;
+#ifndef _MSC_VER
+  if (munmap(const_cast<char*>(data_), size_) != 0)
+    KALDI_WARN << "Failed to unmap file: " << strerror(errno);
+#endif
+  data_ = NULL;
+  size_ = 0;
+}
+
+}  // namespace kaldi
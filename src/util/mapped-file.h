@@ -0,0 +1,73 @@
+// util/mapped-file.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_UTIL_MAPPED_FILE_H_
+#define KALDI_UTIL_MAPPED_FILE_H_
+
+#include <string>
+#include "base/kaldi-common.h"
+
+namespace kaldi {
+
+/**
+   MappedFile maps the whole of an ordinary file read-only into memory (using
+   mmap() with MAP_SHARED).  The point is that when several processes map the
+   same large file (e.g. a decoding graph or a language model), the operating
+   system keeps only one copy of it in the page cache, and "loading" it takes
+   no time; pages are read from disk the first time they are touched.
+
+   Only ordinary files are supported, not the "extended filenames" (pipes,
+   offsets into archives, standard input) that Input() supports; the calling
+   code will normally fall back to reading the object in the normal way if
+   Open() fails.  On Windows, Open() always fails.
+*/
+class MappedFile {
+ public:
+  MappedFile(): data_(NULL), size_(0) { }
+
+  /// Maps the file "filename" into memory.  Returns true on success; on
+  /// failure, prints a warning and returns false.  If a file was already
+  /// open, it is closed first.
+  bool Open(const std::string &filename);
+
+  /// Unmaps the file, if one was open.  Pointers previously returned by Data()
+  /// become invalid.
+  void Close();
+
+  bool IsOpen() const { return data_ != NULL; }
+
+  /// Returns the start of the mapped data, which will be aligned to the
+  /// system page size.  Must not be called if !IsOpen().
+  const char *Data() const { KALDI_ASSERT(data_ != NULL); return data_; }
+
+  /// Returns the size of the file in bytes.
+  size_t Size() const { return size_; }
+
+  ~MappedFile() { Close(); }
+
+ private:
+  const char *data_;
+  size_t size_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MappedFile);
+};
+
+
+}  // namespace kaldi
+
+#endif  // KALDI_UTIL_MAPPED_FILE_H_
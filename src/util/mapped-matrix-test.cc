@@ -0,0 +1,153 @@
+// util/mapped-matrix-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+#include "util/mapped-matrix.h"
+#include "util/kaldi-io.h"
+#include "util/table-types.h"
+#include "matrix/compressed-matrix.h"
+#include <unistd.h>
+
+namespace kaldi {
+
+template<typename Real>
+void UnitTestMappedMatrix() {
+  std::string filename = "tmpf";
+  // Try various offsets of the matrix from the start of the stream, to test
+  // the padding.
+  for (int32 offset = 0; offset < 3; offset++) {
+    Matrix<Real> mat(RandInt(1, 20), RandInt(1, 20));
+    mat.SetRandn();
+    {
+      Output ko(filename, true);
+      for (int32 i = 0; i < offset; i++)
+        WriteToken(ko.Stream(), true, "X");
+      mat.WriteAligned(ko.Stream());
+    }
+    {  // Read() should accept the aligned format.
+      bool binary;
+      Input ki(filename, &binary);
+      for (int32 i = 0; i < offset; i++)
+        ExpectToken(ki.Stream(), binary, "X");
+      Matrix<Real> mat2;
+      mat2.Read(ki.Stream(), binary);
+      KALDI_ASSERT(mat2.ApproxEqual(mat, 0.0));
+      // ... including reading the other floating-point type.
+      Matrix<typename OtherReal<Real>::Real> mat3;
+      ki.Stream().seekg(0);
+      InitKaldiInputStream(ki.Stream(), &binary);
+      for (int32 i = 0; i < offset; i++)
+        ExpectToken(ki.Stream(), binary, "X");
+      mat3.Read(ki.Stream(), binary);
+      KALDI_ASSERT(mat3.ApproxEqual(
+          Matrix<typename OtherReal<Real>::Real>(mat), 0.0));
+    }
+  }
+  Matrix<Real> mat(RandInt(1, 100), RandInt(1, 100));
+  mat.SetRandn();
+  WriteAlignedMatrix(mat, filename);
+  MappedMatrix<Real> mapped;
+  KALDI_ASSERT(mapped.NumRows() == 0 && !mapped.IsMapped());
+  mapped.Read(filename);
+  KALDI_ASSERT(mapped.IsMapped());
+  KALDI_ASSERT(reinterpret_cast<size_t>(mapped.Mat().Data()) %
+               MatrixBase<Real>::kAlignedMatrixAlignment == 0);
+  KALDI_ASSERT(mapped.NumRows() == mat.NumRows() &&
+               mapped.Mat().ApproxEqual(mat, 0.0));
+  // Files in the normal format are read, not mapped.
+  WriteKaldiObject(mat, filename, true);
+  mapped.Read(filename);
+  KALDI_ASSERT(!mapped.IsMapped() && mapped.Mat().ApproxEqual(mat, 0.0));
+  KALDI_ASSERT(!mapped.Open(filename) && !mapped.IsMapped());
+  unlink(filename.c_str());
+}
+
+template<typename Real>
+void UnitTestSequentialMappedMatrixReader() {
+  std::vector<std::string> keys;
+  std::vector<Matrix<Real> > mats;
+  for (int32 i = 0; i < 10; i++) {
+    // keys of varying length, so the data is at arbitrary offsets.
+    keys.push_back(std::string(RandInt(1, 7), 'a' + i));
+    int32 rows = RandInt(0, 10), cols = (rows == 0 ? 0 : RandInt(1, 10));
+    mats.push_back(Matrix<Real>(rows, cols));
+    mats.back().SetRandn();
+  }
+  for (int32 format = 0; format < 4; format++) {
+    // 0 = aligned, 1 = normal binary, 2 = text, 3 = compressed.
+    if (format == 0) {
+      TableWriter<AlignedMatrixHolder<Real> > writer("ark:tmpf");
+      for (size_t i = 0; i < keys.size(); i++)
+        writer.Write(keys[i], mats[i]);
+    } else if (format == 3) {
+      CompressedMatrixWriter writer("ark:tmpf");
+      for (size_t i = 0; i < keys.size(); i++)
+        writer.Write(keys[i], CompressedMatrix(mats[i]));
+    } else {
+      TableWriter<KaldiObjectHolder<Matrix<Real> > > writer(
+          format == 1 ? "ark:tmpf" : "ark,t:tmpf");
+      for (size_t i = 0; i < keys.size(); i++)
+        writer.Write(keys[i], mats[i]);
+    }
+    SequentialTableReader<KaldiObjectHolder<Matrix<Real> > > reader(
+        "ark:tmpf");
+    SequentialMappedMatrixReader<Real> mapped_reader;
+    KALDI_ASSERT(mapped_reader.Open("ark:tmpf"));
+    int32 num_mapped = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+      KALDI_ASSERT(!mapped_reader.Done() && mapped_reader.Key() == keys[i]);
+      // The table reader gives the reference value (this takes care of the
+      // text and compressed formats being lossy).
+      KALDI_ASSERT(reader.Key() == keys[i]);
+      KALDI_ASSERT(mapped_reader.Value().ApproxEqual(reader.Value(), 0.0));
+      if (mapped_reader.ValueIsMapped())
+        num_mapped++;
+      mapped_reader.Next();
+      reader.Next();
+    }
+    KALDI_ASSERT(mapped_reader.Done());
+    if (format == 0) {
+      for (size_t i = 0; i < keys.size(); i++)
+        if (mats[i].NumRows() == 0) num_mapped++;
+      KALDI_ASSERT(num_mapped == static_cast<int32>(keys.size()));
+    }
+    if (format >= 2)
+      KALDI_ASSERT(num_mapped == 0);
+  }
+  {
+    // Can't map pipes.
+    SequentialMappedMatrixReader<Real> mapped_reader;
+    KALDI_ASSERT(!mapped_reader.Open("ark:cat tmpf|"));
+  }
+  unlink("tmpf");
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 5; i++) {
+    UnitTestMappedMatrix<float>();
+    UnitTestMappedMatrix<double>();
+    UnitTestSequentialMappedMatrixReader<float>();
+    UnitTestSequentialMappedMatrixReader<double>();
+  }
+  std::cout << "Test OK.\n";
+}
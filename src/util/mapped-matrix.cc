@@ -0,0 +1,313 @@
+// util/mapped-matrix.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <cctype>
+#include <cstring>
+#include <sstream>
+#include "util/mapped-matrix.h"
+#include "util/block-compressed-stream.h"
+#include "util/kaldi-io.h"
+#include "util/kaldi-table.h"
+
+namespace kaldi {
+
+template<typename Real>
+void MappedMatrix<Real>::Clear() {
+  mapped_file_.Close();
+  storage_.Resize(0, 0);
+  data_ = NULL;
+  num_rows_ = 0;
+  num_cols_ = 0;
+  stride_ = 0;
+}
+
+template<typename Real>
+bool MappedMatrix<Real>::Open(const std::string &filename) {
+  Clear();
+  if (!mapped_file_.Open(filename))
+    return false;
+  const char *data = mapped_file_.Data();
+  size_t file_size = mapped_file_.Size();
+  // The Kaldi binary header, then the token written by WriteAligned().
+  std::string header = std::string("\0B", 2) +
+      (sizeof(Real) == 4 ? "FMA " : "DMA ");
+  if (file_size < header.size() || std::string(data, header.size()) != header) {
+    KALDI_WARN << "Could not memory-map " << filename << ": it does not "
+               << "contain a matrix written by WriteAligned() of the expected "
+               << "type.";
+    mapped_file_.Close();
+    return false;
+  }
+  // The rest of the header is much smaller than this.
+  std::istringstream is(std::string(data + header.size(),
+                                    std::min<size_t>(file_size - header.size(),
+                                                     256)));
+  bool binary = true;
+  int32 rows = 0, cols = 0, padding = 0;
+  ReadBasicType(is, binary, &rows);
+  ReadBasicType(is, binary, &cols);
+  ReadBasicType(is, binary, &padding);
+  size_t offset = header.size() + static_cast<size_t>(is.tellg()) + padding,
+      expected_size = offset + sizeof(Real) * static_cast<size_t>(rows) * cols;
+  if (rows < 0 || cols < 0 || padding < 0 || file_size < expected_size)
+    KALDI_ERR << "Mapped matrix " << filename << " has size " << file_size
+              << ", expected " << expected_size << " (truncated?)";
+  if (offset % sizeof(Real) != 0) {
+    // This would happen if WriteAligned() could not tell the stream position,
+    // e.g. when the output was a pipe.
+    KALDI_WARN << "Could not memory-map " << filename << ": data is not "
+               << "aligned.";
+    mapped_file_.Close();
+    return false;
+  }
+  if (rows * cols != 0) {  // else leave it empty, as set up by Clear().
+    data_ = reinterpret_cast<const Real*>(data + offset);
+    num_rows_ = rows;
+    num_cols_ = cols;
+    stride_ = cols;
+  }
+  KALDI_VLOG(2) << "Mapped " << rows << " by " << cols << " matrix from "
+                << filename;
+  return true;
+}
+
+template<typename Real>
+void MappedMatrix<Real>::Read(const std::string &rxfilename, bool use_mmap) {
+  if (use_mmap && ClassifyRxfilename(rxfilename) == kFileInput) {
+    if (Open(rxfilename))
+      return;
+    KALDI_WARN << "Reading " << rxfilename << " instead.";
+  }
+  Clear();
+  ReadKaldiObject(rxfilename, &storage_);
+  data_ = storage_.Data();
+  num_rows_ = storage_.NumRows();
+  num_cols_ = storage_.NumCols();
+  stride_ = storage_.Stride();
+}
+
+template<typename Real>
+void WriteAlignedMatrix(const MatrixBase<Real> &mat,
+                        const std::string &wxfilename) {
+  bool binary = true;
+  Output ko(wxfilename, binary);
+  mat.WriteAligned(ko.Stream());
+  ko.Close();
+}
+
+namespace {
+// An std::streambuf that reads from a region of memory, so that objects we
+// can't get directly from the mapped data can be parsed by their Read()
+// functions without copying the archive.
+class MemoryInputBuffer: public std::streambuf {
+ public:
+  MemoryInputBuffer(const char *begin, const char *end) {
+    char *b = const_cast<char*>(begin), *e = const_cast<char*>(end);
+    setg(b, b, e);
+  }
+  size_t Consumed() const { return gptr() - eback(); }
+ protected:
+  virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                           std::ios_base::openmode which) {
+    char *target = (dir == std::ios_base::beg ? eback() :
+                    (dir == std::ios_base::cur ? gptr() : egptr())) + off;
+    if (target < eback() || target > egptr())
+      return pos_type(off_type(-1));
+    setg(eback(), target, egptr());
+    return pos_type(target - eback());
+  }
+  virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which) {
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+  }
+};
+}  // namespace
+
+template<typename Real>
+bool SequentialMappedMatrixReader<Real>::Open(const std::string &rspecifier) {
+  Close();
+  RspecifierType rs = ClassifyRspecifier(rspecifier, &archive_filename_, NULL);
+  if (rs != kArchiveRspecifier ||
+      ClassifyRxfilename(archive_filename_) != kFileInput) {
+    KALDI_WARN << "Cannot memory-map " << rspecifier << ": expected "
+               << "ark:<filename> where <filename> is an ordinary file.";
+    return false;
+  }
+  if (!file_.Open(archive_filename_))
+    return false;
+  if (HasBlockCompressedMagic(file_.Data(), file_.Size())) {
+    KALDI_WARN << "Cannot memory-map " << rspecifier << ": the archive is "
+               << "block-compressed; read it with SequentialTableReader.";
+    file_.Close();
+    return false;
+  }
+  pos_ = 0;
+  done_ = false;
+  ReadObject();
+  return true;
+}
+
+template<typename Real>
+void SequentialMappedMatrixReader<Real>::Close() {
+  file_.Close();
+  buffer_.Resize(0, 0);
+  key_.clear();
+  pos_ = 0;
+  data_ = NULL;
+  num_rows_ = num_cols_ = stride_ = 0;
+  value_is_mapped_ = false;
+  done_ = true;
+}
+
+template<typename Real>
+const std::string &SequentialMappedMatrixReader<Real>::Key() const {
+  if (done_)
+    KALDI_ERR << "Key() called on SequentialMappedMatrixReader at the wrong "
+              << "time.";
+  return key_;
+}
+
+template<typename Real>
+const SubMatrix<Real> SequentialMappedMatrixReader<Real>::Value() const {
+  if (done_)
+    KALDI_ERR << "Value() called on SequentialMappedMatrixReader at the wrong "
+              << "time.";
+  return SubMatrix<Real>(const_cast<Real*>(data_), num_rows_, num_cols_,
+                         stride_);
+}
+
+template<typename Real>
+void SequentialMappedMatrixReader<Real>::Next() {
+  if (done_)
+    KALDI_ERR << "Next() called on SequentialMappedMatrixReader at the wrong "
+              << "time.";
+  ReadObject();
+}
+
+template<typename Real>
+size_t SequentialMappedMatrixReader<Real>::ReadBinaryMatrix(size_t pos) {
+  const char *data = file_.Data();
+  size_t size = file_.Size();
+  std::string token = (sizeof(Real) == 4 ? "FM" : "DM");
+  bool aligned;
+  if (pos + 3 <= size && std::string(data + pos, 3) == token + " ")
+    aligned = false;
+  else if (pos + 4 <= size && std::string(data + pos, 4) == token + "A ")
+    aligned = true;
+  else
+    return 0;
+  pos += (aligned ? 4 : 3);
+  // The integers are written by WriteBasicType(): a size byte, then the
+  // int32 in native byte order.
+  int32 num_ints = (aligned ? 3 : 2), ints[3] = { 0, 0, 0 };
+  for (int32 i = 0; i < num_ints; i++, pos += 1 + sizeof(int32)) {
+    if (pos + 1 + sizeof(int32) > size || data[pos] != sizeof(int32))
+      KALDI_ERR << "Error reading matrix header in archive "
+                << archive_filename_ << " (key " << key_ << ')';
+    std::memcpy(&(ints[i]), data + pos + 1, sizeof(int32));
+  }
+  int32 rows = ints[0], cols = ints[1], padding = ints[2];
+  size_t data_size = sizeof(Real) * static_cast<size_t>(rows) * cols;
+  if (rows < 0 || cols < 0 || padding < 0 ||
+      pos + padding + data_size > size)
+    KALDI_ERR << "Error reading matrix in archive " << archive_filename_
+              << " (key " << key_ << "): truncated or corrupted.";
+  pos += padding;
+  if (rows == 0 || cols == 0) {
+    buffer_.Resize(0, 0);
+    data_ = NULL;
+    num_rows_ = num_cols_ = stride_ = 0;
+    value_is_mapped_ = false;
+  } else if (reinterpret_cast<size_t>(data + pos) % sizeof(Real) == 0) {
+    data_ = reinterpret_cast<const Real*>(data + pos);
+    num_rows_ = rows;
+    num_cols_ = cols;
+    stride_ = cols;
+    value_is_mapped_ = true;
+  } else {
+    // Not aligned: we have to copy it.
+    buffer_.Resize(rows, cols, kUndefined);
+    for (int32 r = 0; r < rows; r++)
+      std::memcpy(buffer_.RowData(r), data + pos + sizeof(Real) * r * cols,
+                  sizeof(Real) * cols);
+    data_ = buffer_.Data();
+    num_rows_ = rows;
+    num_cols_ = cols;
+    stride_ = buffer_.Stride();
+    value_is_mapped_ = false;
+  }
+  return pos + data_size;
+}
+
+template<typename Real>
+void SequentialMappedMatrixReader<Real>::ReadObject() {
+  const char *data = file_.Data();
+  size_t size = file_.Size();
+  while (pos_ < size && isspace(static_cast<unsigned char>(data[pos_])))
+    pos_++;
+  if (pos_ == size) {
+    done_ = true;
+    return;
+  }
+  size_t key_end = pos_;
+  while (key_end < size && !isspace(static_cast<unsigned char>(data[key_end])))
+    key_end++;
+  key_.assign(data + pos_, key_end - pos_);
+  // As in SequentialTableReader, we expect a space after the key, but also
+  // allow tab [which is consumed] and newline [which is not].
+  if (key_end == size || (data[key_end] != ' ' && data[key_end] != '\t' &&
+                          data[key_end] != '\n'))
+    KALDI_ERR << "Invalid archive file format: expected space after key "
+              << key_ << ", reading " << archive_filename_;
+  pos_ = (data[key_end] == '\n' ? key_end : key_end + 1);
+  bool binary = (pos_ + 2 <= size && data[pos_] == '\0' &&
+                 data[pos_ + 1] == 'B');
+  if (binary) {
+    size_t end = ReadBinaryMatrix(pos_ + 2);
+    if (end != 0) {
+      pos_ = end;
+      return;
+    }
+  }
+  // Some other format: parse it with Matrix::Read() from the mapped data.
+  size_t begin = pos_ + (binary ? 2 : 0);
+  MemoryInputBuffer buf(data + begin, data + size);
+  std::istream is(&buf);
+  buffer_.Read(is, binary);
+  if (is.fail())
+    KALDI_ERR << "Error reading matrix in archive " << archive_filename_
+              << " (key " << key_ << ')';
+  pos_ = begin + buf.Consumed();
+  data_ = buffer_.Data();
+  num_rows_ = buffer_.NumRows();
+  num_cols_ = buffer_.NumCols();
+  stride_ = buffer_.Stride();
+  value_is_mapped_ = false;
+}
+
+template class MappedMatrix<float>;
+template class MappedMatrix<double>;
+template void WriteAlignedMatrix(const MatrixBase<float> &mat,
+                                 const std::string &wxfilename);
+template void WriteAlignedMatrix(const MatrixBase<double> &mat,
+                                 const std::string &wxfilename);
+template class SequentialMappedMatrixReader<float>;
+template class SequentialMappedMatrixReader<double>;
+
+} // end namespace kaldi.
@@ -0,0 +1,198 @@
+// util/mapped-matrix.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_UTIL_MAPPED_MATRIX_H_
+#define KALDI_UTIL_MAPPED_MATRIX_H_
+
+#include <string>
+#include "base/kaldi-common.h"
+#include "matrix/kaldi-matrix.h"
+#include "util/kaldi-holder.h"
+#include "util/mapped-file.h"
+
+namespace kaldi {
+
+/**
+   MappedMatrix is a read-only matrix that, if possible, is memory-mapped from
+   a file rather than read into memory.  For this to work the file must
+   contain just the matrix, in the format written by MatrixBase::WriteAligned()
+   (e.g. by WriteAlignedMatrix(), or "copy-matrix --aligned=true"), in which
+   the data starts at an aligned position in the file.  Loading such a matrix
+   takes no time regardless of its size, and processes on the same machine
+   that map the same file share one copy of it (see class MappedFile).
+
+   Files in that format can also be read in the normal way (e.g. by
+   ReadKaldiObject()), so nothing else needs to change if a matrix is stored
+   like this.
+*/
+template<typename Real>
+class MappedMatrix {
+ public:
+  MappedMatrix(): data_(NULL), num_rows_(0), num_cols_(0), stride_(0) { }
+
+  /// Reads the matrix from "rxfilename".  If "use_mmap" is true and
+  /// "rxfilename" is an ordinary file containing a matrix written by
+  /// WriteAligned() with the same floating-point type, the matrix is mapped
+  /// (see Open()); otherwise it is read into memory, with the same formats
+  /// accepted as by ReadKaldiObject().
+  void Read(const std::string &rxfilename, bool use_mmap = true);
+
+  /// Maps the ordinary file "filename", which must have been written as
+  /// described above.  Returns false (with a warning) if it could not be
+  /// mapped, in which case the calling code may want to fall back to Read().
+  bool Open(const std::string &filename);
+
+  /// Returns true if the data is memory-mapped from a file.
+  bool IsMapped() const { return mapped_file_.IsOpen(); }
+
+  MatrixIndexT NumRows() const { return num_rows_; }
+  MatrixIndexT NumCols() const { return num_cols_; }
+
+  /// Returns the matrix, which is valid until *this is changed or destroyed.
+  /// Note: if the matrix is mapped, the memory is read-only, so although
+  /// SubMatrix permits it, you must not modify it.
+  const SubMatrix<Real> Mat() const {
+    return SubMatrix<Real>(const_cast<Real*>(data_), num_rows_, num_cols_,
+                           stride_);
+  }
+
+ private:
+  // Frees any storage and sets up an empty matrix.
+  void Clear();
+
+  // data_ points either into storage_ or into mapped_file_.
+  const Real *data_;
+  MatrixIndexT num_rows_;
+  MatrixIndexT num_cols_;
+  MatrixIndexT stride_;
+
+  Matrix<Real> storage_;
+  MappedFile mapped_file_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MappedMatrix);
+};
+
+
+/// Writes "mat" to "wxfilename" (in binary mode, with the Kaldi binary
+/// header) in the format that MappedMatrix::Open() requires.
+template<typename Real>
+void WriteAlignedMatrix(const MatrixBase<Real> &mat,
+                        const std::string &wxfilename);
+
+
+/// AlignedMatrixHolder is a Holder (see kaldi-holder.h) that writes matrices
+/// with WriteAligned() rather than Write(), so an archive written with it to
+/// an ordinary file can be read with no copying by
+/// SequentialMappedMatrixReader.  Reading is as for KaldiObjectHolder, so the
+/// archives can also be read in the normal way.
+template<typename Real>
+class AlignedMatrixHolder: public KaldiObjectHolder<Matrix<Real> > {
+ public:
+  typedef Matrix<Real> T;
+
+  static bool Write(std::ostream &os, bool binary, const T &t) {
+    if (!binary)
+      KALDI_ERR << "AlignedMatrixHolder only supports binary mode.";
+    InitKaldiOutputStream(os, binary);
+    try {
+      t.WriteAligned(os);
+      return os.good();
+    } catch (const std::exception &e) {
+      KALDI_WARN << "Exception caught writing Table object: " << e.what();
+      return false;  // Write failure.
+    }
+  }
+};
+
+
+/**
+   SequentialMappedMatrixReader reads an archive of matrices (e.g. features)
+   that is an ordinary file, by memory-mapping it and parsing the objects
+   directly from the mapped pages, rather than through an std::istream as
+   SequentialTableReader does.  Where the archive contains binary matrices of
+   type Real whose data is suitably aligned, Value() returns a view of the
+   mapped data and nothing is copied; this is always the case for archives
+   written with AlignedMatrixHolder (e.g. "copy-matrix --aligned=true"), and
+   by chance for some other objects.  Anything else (text-mode, the other
+   floating-point type, compressed matrices) is read or decompressed from the
+   mapped data into a buffer that is reused between objects.
+
+   The interface is like that of SequentialTableReader, except that Value()
+   returns a SubMatrix, which you must not modify.  Views of mapped data stay
+   valid until the reader is closed or destroyed; other values only until
+   Next() is called.
+*/
+template<typename Real>
+class SequentialMappedMatrixReader {
+ public:
+  SequentialMappedMatrixReader(): pos_(0), data_(NULL), num_rows_(0),
+                                  num_cols_(0), stride_(0),
+                                  value_is_mapped_(false), done_(true) { }
+
+  /// "rspecifier" must be of the form "ark:filename" (other options, e.g.
+  /// "s,", are ignored) where "filename" is an ordinary file.  Returns false,
+  /// with a warning, if it can't be mapped, in which case the calling code
+  /// may want to fall back to SequentialTableReader.
+  bool Open(const std::string &rspecifier);
+
+  bool IsOpen() const { return file_.IsOpen(); }
+
+  bool Done() const { return done_; }
+
+  /// Moves to the next object.  Throws on format errors.
+  void Next();
+
+  const std::string &Key() const;
+
+  const SubMatrix<Real> Value() const;
+
+  /// Returns true if Value() points directly into the mapped file.
+  bool ValueIsMapped() const { return value_is_mapped_; }
+
+  void Close();
+
+ private:
+  // Parses the object starting at pos_ (if any), setting up key_ and the
+  // value, and advancing pos_ past it.
+  void ReadObject();
+  // Parses the binary matrix starting at "pos" (just after the binary-mode
+  // header) if it is of type Real, in the format of Write() or
+  // WriteAligned(), and returns its end position; returns 0 if it is in some
+  // other format.
+  size_t ReadBinaryMatrix(size_t pos);
+
+  MappedFile file_;
+  std::string archive_filename_;
+  size_t pos_;  // position in file_ of the next object.
+  std::string key_;
+  const Real *data_;  // points into file_ or buffer_.
+  MatrixIndexT num_rows_;
+  MatrixIndexT num_cols_;
+  MatrixIndexT stride_;
+  Matrix<Real> buffer_;
+  bool value_is_mapped_;
+  bool done_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(SequentialMappedMatrixReader);
+};
+
+
+} // end namespace kaldi.
+
+#endif  // KALDI_UTIL_MAPPED_MATRIX_H_
@@ -0,0 +1,98 @@
+// util/object-pool-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "util/object-pool.h"
+#include <set>
+#include <iostream>
+
+namespace kaldi {
+
+// A struct resembling the decoders' Token.
+struct TestToken {
+  float tot_cost;
+  float extra_cost;
+  void *links;
+  TestToken *next;
+  TestToken(float tot_cost, float extra_cost, TestToken *next):
+      tot_cost(tot_cost), extra_cost(extra_cost), links(NULL), next(next) { }
+};
+
+void TestObjectPool() {
+  ObjectPool<TestToken> pool;
+  KALDI_ASSERT(pool.NumInUse() == 0 && pool.NumAllocated() == 0);
+
+  for (int32 iter = 0; iter < 5; iter++) {
+    // 'utterance' loop: allocate a variable number of tokens, freeing a
+    // random subset as we go (as pruning would), and free the rest at the end.
+    std::set<TestToken*> live;
+    int32 num_toks = 1000 + Rand() % 3000;
+    TestToken *head = NULL;
+    for (int32 i = 0; i < num_toks; i++) {
+      TestToken *tok = new (pool.Allocate()) TestToken(i, 0.0, head);
+      KALDI_ASSERT(live.count(tok) == 0);  // no slot is handed out twice.
+      KALDI_ASSERT(reinterpret_cast<size_t>(tok) % sizeof(void*) == 0);
+      live.insert(tok);
+      head = tok;
+    }
+    KALDI_ASSERT(pool.NumInUse() == live.size());
+    // check the objects were not corrupted by later allocations.
+    int32 count = num_toks;
+    for (TestToken *tok = head; tok != NULL; tok = tok->next) {
+      count--;
+      KALDI_ASSERT(tok->tot_cost == static_cast<float>(count));
+    }
+    KALDI_ASSERT(count == 0);
+
+    std::set<TestToken*>::iterator it = live.begin();
+    while (it != live.end()) {
+      if (Rand() % 2 == 0) {
+        pool.Free(*it);
+        live.erase(it++);
+      } else {
+        ++it;
+      }
+    }
+    KALDI_ASSERT(pool.NumInUse() == live.size());
+    for (it = live.begin(); it != live.end(); ++it)
+      pool.Free(*it);
+    KALDI_ASSERT(pool.NumInUse() == 0);
+  }
+
+  // After freeing everything, allocating up to the previous capacity must not
+  // grow the pool.
+  size_t num_allocated = pool.NumAllocated();
+  std::vector<void*> ptrs;
+  for (size_t i = 0; i < num_allocated; i++)
+    ptrs.push_back(pool.Allocate());
+  KALDI_ASSERT(pool.NumAllocated() == num_allocated);
+  for (size_t i = 0; i < ptrs.size(); i++)
+    pool.Free(ptrs[i]);
+}
+
+
+}  // end namespace kaldi
+
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 3; i++)
+    TestObjectPool();
+  std::cout << "Test OK.\n";
+}
@@ -0,0 +1,133 @@
+// util/object-pool.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_UTIL_OBJECT_POOL_H_
+#define KALDI_UTIL_OBJECT_POOL_H_
+#include <new>
+#include <vector>
+#include "base/kaldi-common.h"
+#include "base/kaldi-memory-stats.h"
+
+
+/* This header provides a simple fixed-size object allocator, intended for the
+   small structures (tokens and links) that the decoders create and destroy in
+   very large numbers.  Memory is obtained from the heap in blocks of many
+   objects and is never returned to the heap until the pool is destroyed;
+   objects that are freed go on a singly-linked free list and are handed out
+   again by subsequent calls to Allocate().  This is the same scheme that
+   HashList uses internally for its Elems (see hash-list.h).
+
+   Because the pool is normally a member of a decoder object that is reused
+   from utterance to utterance, once the pool has grown to the size needed for
+   the largest utterance seen so far, decoding does no further heap allocation
+   for these objects.
+
+   The pool deals in raw memory: the user is expected to construct objects
+   using placement new, e.g.
+      Token *tok = new (pool.Allocate()) Token(cost, 0.0, NULL, NULL);
+   and to return them with pool.Free(tok).  Free() does not call the
+   destructor, so this is only suitable for types with trivial destructors
+   (or for which the user calls the destructor explicitly).
+
+   The blocks are counted in the memory statistics (see
+   base/kaldi-memory-stats.h) under the MemoryTag that was current when the
+   first block was allocated.
+
+   See object-pool-test.cc for an example of how to use this object.
+*/
+
+
+namespace kaldi {
+
+template<class T> class ObjectPool {
+ public:
+  /// Constructor takes no arguments; no memory is allocated until the first
+  /// call to Allocate().
+  ObjectPool(): free_head_(NULL), num_in_use_(0) { }
+
+  /// Returns uninitialized memory with enough space (and suitable alignment)
+  /// for an object of type T.  Use placement new to construct the object.
+  inline void *Allocate() {
+    if (free_head_ == NULL) AllocateBlock();
+    Slot *ans = free_head_;
+    free_head_ = free_head_->next;
+    num_in_use_++;
+    return static_cast<void*>(ans);
+  }
+
+  /// Returns to the pool memory that was obtained from Allocate().  Does not
+  /// call the destructor of T.
+  inline void Free(void *p) {
+    Slot *slot = static_cast<Slot*>(p);
+    slot->next = free_head_;
+    free_head_ = slot;
+    num_in_use_--;
+  }
+
+  /// Returns the number of objects that have been allocated and not yet freed.
+  size_t NumInUse() const { return num_in_use_; }
+
+  /// Returns the total number of object slots that the pool has obtained from
+  /// the heap (in use or free).
+  size_t NumAllocated() const {
+    return allocated_.size() * static_cast<size_t>(kAllocateBlockSize);
+  }
+
+  ~ObjectPool() {
+    if (num_in_use_ != 0) {
+      KALDI_WARN << "Possible memory leak: " << num_in_use_
+                 << " objects were not freed before destroying the pool.";
+    }
+    for (size_t i = 0; i < allocated_.size(); i++)
+      delete [] allocated_[i];
+  }
+ private:
+  union Slot {
+    Slot *next;  // used while the slot is on the free list.
+    char data[sizeof(T)];
+    double align_double;  // the next two members just ensure the alignment
+    void *align_pointer;  // is suitable for ordinary structs.
+  };
+
+  void AllocateBlock() {
+    Slot *block = new Slot[kAllocateBlockSize];
+    for (int32 i = 0; i + 1 < kAllocateBlockSize; i++)
+      block[i].next = block + i + 1;
+    block[kAllocateBlockSize - 1].next = free_head_;
+    free_head_ = block;
+    allocated_.push_back(block);
+    memory_stats_.Set(NumAllocated() * sizeof(Slot));
+  }
+
+  // Number of objects to allocate in one block.  Must be largish so storing
+  // allocated_ doesn't become a problem.
+  static const int32 kAllocateBlockSize = 1024;
+
+  Slot *free_head_;  // head of list of free slots, ready for allocation.
+  size_t num_in_use_;  // number of slots currently handed out to the user.
+  std::vector<Slot*> allocated_;  // list of allocated blocks.
+  MemoryStatsEstimate memory_stats_;  // the size of the blocks.
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(ObjectPool);
+};
+
+
+}  // end namespace kaldi
+
+#endif  // KALDI_UTIL_OBJECT_POOL_H_
@@ -0,0 +1,285 @@
+// util/remote-file-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "util/remote-file.h"
+#include "util/kaldi-io.h"
+#include "util/table-types.h"
+
+namespace kaldi {
+
+// A backend that serves files from memory, and counts the requests.
+class MemoryFileBackend: public RemoteFileBackend {
+ public:
+  MemoryFileBackend(): num_reads(0) { }
+  virtual int64 Read(const std::string &url, int64 offset, int64 size,
+                     char *data) {
+    num_reads++;
+    if (files.count(url) == 0) {
+      KALDI_WARN << "No such file " << url;
+      return -1;
+    }
+    const std::string &file = files[url];
+    if (offset >= static_cast<int64>(file.size())) return 0;
+    int64 n = std::min<int64>(size, file.size() - offset);
+    std::memcpy(data, file.data() + offset, n);
+    return n;
+  }
+  std::map<std::string, std::string> files;
+  int32 num_reads;
+};
+
+std::string ReadWholeFile(const std::string &filename) {
+  std::ifstream is(filename.c_str(), std::ios::binary);
+  return std::string((std::istreambuf_iterator<char>(is)),
+                     std::istreambuf_iterator<char>());
+}
+
+void UnitTestClassifyRemote() {
+  KALDI_ASSERT(ClassifyRxfilename("http://host/foo.ark") == kRemoteInput);
+  KALDI_ASSERT(ClassifyRxfilename("s3://bucket/foo.ark:123") == kRemoteInput);
+  KALDI_ASSERT(ClassifyRxfilename("gs://bucket/foo") == kRemoteInput);
+  KALDI_ASSERT(ClassifyRxfilename("unknown://bucket/foo") == kFileInput);
+  KALDI_ASSERT(ClassifyRxfilename("aws s3 cp s3://bucket/foo - |") ==
+               kPipeInput);
+  KALDI_ASSERT(ClassifyWxfilename("s3://bucket/foo") == kNoOutput);
+  std::string url;
+  int64 offset;
+  KALDI_ASSERT(SplitRemoteFilename("s3://b/foo.ark:123", &url, &offset) &&
+               url == "s3://b/foo.ark" && offset == 123);
+  KALDI_ASSERT(SplitRemoteFilename("http://host:80/foo", &url, &offset) &&
+               url == "http://host:80/foo" && offset == 0);
+  KALDI_ASSERT(SplitRemoteFilename("http://host:80", &url, &offset) &&
+               url == "http://host:80" && offset == 0);
+}
+
+// Writes an archive and scp with some matrices, and returns the archive
+// contents; the scp file refers to "archive_url".
+std::string WriteTestArchive(const std::string &archive_url,
+                             std::vector<std::string> *keys,
+                             std::vector<Matrix<BaseFloat> > *mats) {
+  int32 num_mats = RandInt(1, 30);
+  for (int32 i = 0; i < num_mats; i++) {
+    std::ostringstream os;
+    os << "key" << i;
+    keys->push_back(os.str());
+    // Some of them are large, to test the read-ahead.
+    Matrix<BaseFloat> mat(RandInt(1, 300), RandInt(1, 500));
+    mat.SetRandn();
+    mats->push_back(mat);
+  }
+  {
+    BaseFloatMatrixWriter writer("ark,scp:tmpf.ark,tmpf.scp");
+    for (int32 i = 0; i < num_mats; i++)
+      writer.Write((*keys)[i], (*mats)[i]);
+  }
+  // Make the scp file point to the remote archive.
+  std::istringstream scp(ReadWholeFile("tmpf.scp"));
+  std::string key, location, scp_out;
+  while (scp >> key >> location) {
+    std::string file;
+    int64 offset;
+    KALDI_ASSERT(SplitRemoteFilename("http://x/" + location, &file, &offset));
+    std::ostringstream line;
+    line << key << ' ' << archive_url << ':' << offset << '\n';
+    scp_out += line.str();
+  }
+  Output ko("tmpf.scp", false);
+  ko.Stream() << scp_out;
+  return ReadWholeFile("tmpf.ark");
+}
+
+void TestReadArchive(const std::string &archive_url,
+                     const std::vector<std::string> &keys,
+                     const std::vector<Matrix<BaseFloat> > &mats) {
+  {
+    SequentialBaseFloatMatrixReader reader("ark:" + archive_url);
+    size_t i = 0;
+    for (; !reader.Done(); reader.Next(), i++) {
+      KALDI_ASSERT(reader.Key() == keys[i]);
+      KALDI_ASSERT(reader.Value().ApproxEqual(mats[i], 1.0e-05));
+    }
+    KALDI_ASSERT(i == keys.size() && reader.Close());
+  }
+  {
+    RandomAccessBaseFloatMatrixReader reader("scp:tmpf.scp");
+    for (size_t j = 0; j < 2 * keys.size(); j++) {
+      int32 i = RandInt(0, keys.size() - 1);
+      KALDI_ASSERT(reader.Value(keys[i]).ApproxEqual(mats[i], 1.0e-05));
+    }
+  }
+}
+
+void UnitTestMemoryBackend() {
+  MemoryFileBackend *backend = new MemoryFileBackend();
+  RegisterRemoteFileBackend("mem", backend);
+  std::vector<std::string> keys;
+  std::vector<Matrix<BaseFloat> > mats;
+  std::string archive = WriteTestArchive("mem://store/foo.ark", &keys, &mats);
+  backend->files["mem://store/foo.ark"] = archive;
+  TestReadArchive("mem://store/foo.ark", keys, mats);
+  // Read-ahead means that we need far fewer requests than objects.
+  KALDI_LOG << "Read " << archive.size() << " bytes in " << backend->num_reads
+            << " requests";
+  KALDI_ASSERT(backend->num_reads <
+               4 * keys.size() + archive.size() /
+               RemoteInputBuffer::kMinReadSize + 5);
+  {
+    Input ki;
+    KALDI_ASSERT(!ki.Open("mem://store/nonexistent"));
+    backend->files["mem://store/empty"] = "";
+    KALDI_ASSERT(ki.Open("mem://store/empty"));
+    std::string str;
+    KALDI_ASSERT(!(ki.Stream() >> str));
+  }
+  unlink("tmpf.ark");
+  unlink("tmpf.scp");
+}
+
+
+// A very simple HTTP server that serves one file with range requests, on
+// persistent connections.
+struct TestHttpServer {
+  int listen_fd;
+  int32 port;
+  std::string file;
+  int32 num_connections;
+  int32 num_requests;
+
+  bool Start() {
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t len = sizeof(addr);
+    if (listen_fd < 0 ||
+        bind(listen_fd, reinterpret_cast<sockaddr*>(&addr),
+             sizeof(addr)) != 0 ||
+        listen(listen_fd, 5) != 0 ||
+        getsockname(listen_fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0)
+      return false;
+    port = ntohs(addr.sin_port);
+    num_connections = 0;
+    num_requests = 0;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, Run, this) != 0) return false;
+    pthread_detach(thread);
+    return true;
+  }
+
+  static void *Run(void *arg) {
+    TestHttpServer *server = static_cast<TestHttpServer*>(arg);
+    while (true) {
+      int fd = accept(server->listen_fd, NULL, NULL);
+      if (fd < 0) break;
+      server->num_connections++;
+      server->Serve(fd);
+      close(fd);
+    }
+    return NULL;
+  }
+
+  void Serve(int fd) {
+    std::string received;
+    char buf[4096];
+    while (true) {
+      size_t end;
+      while ((end = received.find("\r\n\r\n")) == std::string::npos) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) return;
+        received.append(buf, n);
+      }
+      std::string request = received.substr(0, end);
+      received.erase(0, end + 4);
+      num_requests++;
+      std::istringstream is(request);
+      std::string method, path;
+      is >> method >> path;
+      std::ostringstream reply;
+      size_t range = request.find("Range: bytes=");
+      if (path != "/foo.ark" || range == std::string::npos) {
+        reply << "HTTP/1.1 404 Not Found\r\nContent-Length: 9\r\n\r\n"
+              << "not found";
+      } else {
+        int64 first = 0, last = 0;
+        char dash;
+        std::istringstream range_is(request.substr(range + 13));
+        range_is >> first >> dash >> last;
+        if (first >= static_cast<int64>(file.size())) {
+          reply << "HTTP/1.1 416 Range Not Satisfiable\r\n"
+                << "Content-Length: 0\r\n\r\n";
+        } else {
+          last = std::min<int64>(last, file.size() - 1);
+          reply << "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes "
+                << first << '-' << last << '/' << file.size()
+                << "\r\nContent-Length: " << (last - first + 1) << "\r\n\r\n"
+                << file.substr(first, last - first + 1);
+        }
+      }
+      std::string str = reply.str();
+      if (send(fd, str.data(), str.size(), 0) !=
+          static_cast<ssize_t>(str.size()))
+        return;
+    }
+  }
+};
+
+void UnitTestHttpBackend() {
+  TestHttpServer server;
+  if (!server.Start()) {
+    KALDI_WARN << "Could not start the test HTTP server; skipping test.";
+    return;
+  }
+  std::ostringstream url;
+  url << "http://127.0.0.1:" << server.port << "/foo.ark";
+  std::vector<std::string> keys;
+  std::vector<Matrix<BaseFloat> > mats;
+  server.file = WriteTestArchive(url.str(), &keys, &mats);
+  TestReadArchive(url.str(), keys, mats);
+  {
+    Input ki;
+    KALDI_ASSERT(!ki.Open(url.str() + "-nonexistent"));
+  }
+  KALDI_LOG << "Served " << server.num_requests << " requests on "
+            << server.num_connections << " connection(s)";
+  // We read from one thread, so the connection is reused all the time.
+  KALDI_ASSERT(server.num_connections == 1);
+  unlink("tmpf.ark");
+  unlink("tmpf.scp");
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  UnitTestClassifyRemote();
+  for (int32 i = 0; i < 3; i++) {
+    UnitTestMemoryBackend();
+    UnitTestHttpBackend();
+  }
+  std::cout << "Test OK.\n";
+}
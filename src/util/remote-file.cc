@@ -0,0 +1,499 @@
+// util/remote-file.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <map>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#ifndef _MSC_VER
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#include "util/remote-file.h"
+#include "util/text-utils.h"
+
+namespace kaldi {
+
+namespace {
+
+pthread_once_t registry_once = PTHREAD_ONCE_INIT;
+pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Maps scheme to backend.  The backends are never deleted.
+std::map<std::string, RemoteFileBackend*> *registry = NULL;
+
+std::string GetEnvOrDefault(const char *name, const char *default_value) {
+  const char *value = getenv(name);
+  return (value != NULL && *value != '\0' ? value : default_value);
+}
+
+void InitRegistry() {
+  registry = new std::map<std::string, RemoteFileBackend*>();
+  (*registry)["http"] = new HttpFileBackend();
+  (*registry)["s3"] = new HttpFileBackend(
+      "s3://", "http://" + GetEnvOrDefault("KALDI_S3_ENDPOINT",
+                                           "s3.amazonaws.com") + "/");
+  (*registry)["gs"] = new HttpFileBackend(
+      "gs://", "http://" + GetEnvOrDefault("KALDI_GCS_ENDPOINT",
+                                           "storage.googleapis.com") + "/");
+}
+
+// Returns the scheme of "filename" ("s3" for "s3://bucket/foo"), or the empty
+// string if it does not look like a URL.
+std::string GetScheme(const std::string &filename) {
+  size_t pos = filename.find("://");
+  if (pos == std::string::npos || pos == 0) return "";
+  for (size_t i = 0; i < pos; i++) {
+    char c = filename[i];
+    if (!(isalnum(c) || c == '+' || c == '-' || c == '.'))
+      return "";
+  }
+  return filename.substr(0, pos);
+}
+
+}  // namespace
+
+void RegisterRemoteFileBackend(const std::string &scheme,
+                               RemoteFileBackend *backend) {
+  pthread_once(&registry_once, InitRegistry);
+  pthread_mutex_lock(&registry_mutex);
+  // We don't delete any old backend, as it may still be in use.
+  (*registry)[scheme] = backend;
+  pthread_mutex_unlock(&registry_mutex);
+}
+
+RemoteFileBackend *GetRemoteFileBackend(const std::string &filename) {
+  std::string scheme = GetScheme(filename);
+  if (scheme.empty()) return NULL;
+  pthread_once(&registry_once, InitRegistry);
+  pthread_mutex_lock(&registry_mutex);
+  std::map<std::string, RemoteFileBackend*>::const_iterator iter =
+      registry->find(scheme);
+  RemoteFileBackend *ans = (iter == registry->end() ? NULL : iter->second);
+  pthread_mutex_unlock(&registry_mutex);
+  return ans;
+}
+
+bool SplitRemoteFilename(const std::string &rxfilename, std::string *url,
+                         int64 *offset) {
+  *url = rxfilename;
+  *offset = 0;
+  size_t scheme_end = rxfilename.find("://"),
+      path_start = (scheme_end == std::string::npos ? std::string::npos :
+                    rxfilename.find('/', scheme_end + 3)),
+      colon = rxfilename.find_last_of(':');
+  // An offset is a ':' followed by digits, after the start of the path (so
+  // that "http://host:8080/foo" is not taken as having an offset).
+  if (path_start == std::string::npos || colon == std::string::npos ||
+      colon < path_start || colon + 1 == rxfilename.size())
+    return true;
+  for (size_t i = colon + 1; i < rxfilename.size(); i++)
+    if (!isdigit(rxfilename[i]))
+      return true;
+  *url = rxfilename.substr(0, colon);
+  if (!ConvertStringToInteger(rxfilename.substr(colon + 1), offset)) {
+    KALDI_WARN << "Cannot get offset from filename " << rxfilename;
+    return false;
+  }
+  return true;
+}
+
+
+// Socket timeout for the HTTP backend, and the maximum number of idle
+// connections we keep.
+static const int32 kHttpTimeoutSeconds = 60;
+static const size_t kHttpMaxIdleConnections = 16;
+
+struct HttpFileBackend::Connection {
+  int fd;
+  std::string host;
+  std::string port;
+  std::string buffer;  // data received but not consumed yet...
+  size_t buffer_pos;   // ... starting here.
+  bool received_any;   // true if anything was received for this request.
+
+  Connection(): fd(-1), buffer_pos(0), received_any(false) { }
+  ~Connection() {
+#ifndef _MSC_VER
+    if (fd >= 0) close(fd);
+#endif
+  }
+
+  // Makes sure there is at least one unconsumed byte; returns false on error
+  // or if the connection was closed.
+  bool Fill() {
+#ifndef _MSC_VER
+    if (buffer_pos < buffer.size()) return true;
+    buffer.resize(65536);
+    buffer_pos = 0;
+    ssize_t n;
+    do {
+      n = recv(fd, &(buffer[0]), buffer.size(), 0);
+    } while (n < 0 && errno == EINTR);
+    buffer.resize(n > 0 ? n : 0);
+    if (n > 0) received_any = true;
+    return (n > 0);
+#else
+    return false;
+#endif
+  }
+
+  // Reads a line ending in "\r\n", which is not included in *line.
+  bool ReadLine(std::string *line) {
+    line->clear();
+    while (true) {
+      if (!Fill()) return false;
+      size_t end = buffer.find('\n', buffer_pos);
+      if (end == std::string::npos) {
+        line->append(buffer, buffer_pos, std::string::npos);
+        buffer_pos = buffer.size();
+      } else {
+        line->append(buffer, buffer_pos, end - buffer_pos);
+        buffer_pos = end + 1;
+        if (!line->empty() && (*line)[line->size() - 1] == '\r')
+          line->resize(line->size() - 1);
+        return true;
+      }
+    }
+  }
+
+  // Reads "size" bytes into "data", or discards them if data == NULL.
+  // Returns the number of bytes read, which is less than "size" only if the
+  // connection was closed or there was an error.
+  int64 ReadBytes(char *data, int64 size) {
+    int64 done = 0;
+    while (done < size && Fill()) {
+      int64 n = std::min<int64>(size - done, buffer.size() - buffer_pos);
+      if (data != NULL)
+        std::memcpy(data + done, buffer.data() + buffer_pos, n);
+      buffer_pos += n;
+      done += n;
+    }
+    return done;
+  }
+
+  bool Send(const std::string &data) {
+#ifndef _MSC_VER
+    size_t done = 0;
+    while (done < data.size()) {
+      int flags = 0;
+#ifdef MSG_NOSIGNAL
+      flags = MSG_NOSIGNAL;  // Don't get SIGPIPE if the server closed it.
+#endif
+      ssize_t n = send(fd, data.data() + done, data.size() - done, flags);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) return false;
+      done += n;
+    }
+    return true;
+#else
+    return false;
+#endif
+  }
+};
+
+HttpFileBackend::HttpFileBackend(const std::string &scheme_prefix,
+                                 const std::string &http_prefix):
+    scheme_prefix_(scheme_prefix), http_prefix_(http_prefix) {
+  pthread_mutex_init(&mutex_, NULL);
+}
+
+HttpFileBackend::~HttpFileBackend() {
+  for (size_t i = 0; i < pool_.size(); i++)
+    delete pool_[i];
+  pthread_mutex_destroy(&mutex_);
+}
+
+HttpFileBackend::Connection *HttpFileBackend::GetConnection(
+    const std::string &host, const std::string &port, bool from_pool) {
+  if (from_pool) {
+    pthread_mutex_lock(&mutex_);
+    for (size_t i = 0; i < pool_.size(); i++) {
+      if (pool_[i]->host == host && pool_[i]->port == port) {
+        Connection *conn = pool_[i];
+        pool_.erase(pool_.begin() + i);
+        pthread_mutex_unlock(&mutex_);
+        return conn;
+      }
+    }
+    pthread_mutex_unlock(&mutex_);
+  }
+#ifndef _MSC_VER
+  struct addrinfo hints, *addresses = NULL;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  int ret = getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses);
+  if (ret != 0) {
+    KALDI_WARN << "Cannot resolve host " << host << ": " << gai_strerror(ret);
+    return NULL;
+  }
+  int fd = -1;
+  for (struct addrinfo *a = addresses; a != NULL && fd < 0; a = a->ai_next) {
+    fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (fd < 0) continue;
+    struct timeval timeout;
+    timeout.tv_sec = kHttpTimeoutSeconds;
+    timeout.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    if (connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(addresses);
+  if (fd < 0) {
+    KALDI_WARN << "Cannot connect to " << host << ":" << port << ": "
+               << strerror(errno);
+    return NULL;
+  }
+  Connection *conn = new Connection();
+  conn->fd = fd;
+  conn->host = host;
+  conn->port = port;
+  return conn;
+#else
+  KALDI_WARN << "The HTTP backend is not supported on Windows.";
+  return NULL;
+#endif
+}
+
+void HttpFileBackend::ReleaseConnection(Connection *conn) {
+  pthread_mutex_lock(&mutex_);
+  if (pool_.size() < kHttpMaxIdleConnections) {
+    pool_.push_back(conn);
+    conn = NULL;
+  }
+  pthread_mutex_unlock(&mutex_);
+  delete conn;
+}
+
+int64 HttpFileBackend::TryRead(Connection *conn, const std::string &host,
+                               const std::string &path, int64 offset,
+                               int64 size, char *data, bool *reusable,
+                               bool *retry) {
+  *reusable = false;
+  *retry = false;
+  // The URL, for messages.
+  std::string url = "http://" + host + ":" + conn->port + path;
+  std::ostringstream request;
+  request << "GET " << path << " HTTP/1.1\r\n"
+          << "Host: " << host
+          << (conn->port == "80" ? std::string() : ":" + conn->port) << "\r\n"
+          << "Range: bytes=" << offset << '-' << (offset + size - 1) << "\r\n"
+          << "User-Agent: kaldi\r\n\r\n";
+  conn->received_any = false;
+  std::string status_line;
+  if (!conn->Send(request.str()) || !conn->ReadLine(&status_line)) {
+    // If we got nothing at all, it's probably an idle connection that the
+    // server closed, so it's worth trying again.
+    *retry = !conn->received_any;
+    return -1;
+  }
+  std::istringstream status_stream(status_line);
+  std::string version;
+  int32 status = 0;
+  status_stream >> version >> status;
+  int64 content_length = -1, range_start = -1;
+  bool keep_alive = (version == "HTTP/1.1"), chunked = false;
+  std::string line;
+  while (true) {
+    if (!conn->ReadLine(&line)) return -1;
+    if (line.empty()) break;  // End of the headers.
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) continue;
+    std::string name = line.substr(0, colon), value = line.substr(colon + 1);
+    for (size_t i = 0; i < name.size(); i++)
+      name[i] = tolower(name[i]);
+    Trim(&value);
+    if (name == "content-length") {
+      ConvertStringToInteger(value, &content_length);
+    } else if (name == "connection") {
+      for (size_t i = 0; i < value.size(); i++)
+        value[i] = tolower(value[i]);
+      keep_alive = (value == "keep-alive" ||
+                    (keep_alive && value != "close"));
+    } else if (name == "transfer-encoding") {
+      chunked = (value != "identity");
+    } else if (name == "content-range") {
+      // e.g. "bytes 100-199/1234".
+      std::istringstream range(value.substr(std::min<size_t>(6, value.size())));
+      if (!(range >> range_start)) range_start = -1;
+    }
+  }
+  if (chunked) {
+    KALDI_WARN << "Chunked transfer encoding is not supported, reading "
+               << url;
+    return -1;
+  }
+  if (status == 416) {  // Range not satisfiable: we are at the end.
+    if (content_length >= 0 &&
+        conn->ReadBytes(NULL, content_length) == content_length)
+      *reusable = keep_alive;
+    return 0;
+  }
+  int64 skip = 0;
+  if (status == 206) {
+    if (range_start != offset) {
+      KALDI_WARN << "Unexpected Content-Range in reply from " << url;
+      return -1;
+    }
+  } else if (status == 200) {
+    // The server ignored the Range header and is sending the whole object;
+    // we skip to the part we want and then have to drop the connection.
+    skip = offset;
+    keep_alive = false;
+  } else {
+    KALDI_WARN << "Error reading " << url << ": " << status_line;
+    if (content_length >= 0 && content_length < (1 << 20) &&
+        conn->ReadBytes(NULL, content_length) == content_length)
+      *reusable = keep_alive;
+    return -1;
+  }
+  if (content_length < 0) keep_alive = false;  // The body ends at close.
+  int64 available = (content_length < 0 ? size :
+                     std::max<int64>(0, std::min(size, content_length - skip)));
+  if (conn->ReadBytes(NULL, skip) != skip)
+    return (content_length < 0 ? 0 : -1);
+  int64 n = conn->ReadBytes(data, available);
+  if (content_length >= 0 && n != available) {
+    KALDI_WARN << "Connection closed while reading " << url;
+    return -1;
+  }
+  *reusable = keep_alive && skip + n == content_length;
+  return n;
+}
+
+int64 HttpFileBackend::Read(const std::string &url_in, int64 offset,
+                            int64 size, char *data) {
+  if (size <= 0) return 0;
+  std::string url = url_in;
+  if (!scheme_prefix_.empty() &&
+      url.compare(0, scheme_prefix_.size(), scheme_prefix_) == 0)
+    url = http_prefix_ + url.substr(scheme_prefix_.size());
+  const std::string http = "http://";
+  if (url.compare(0, http.size(), http) != 0) {
+    KALDI_WARN << "Cannot read " << url_in << ": only http:// is supported";
+    return -1;
+  }
+  size_t path_start = url.find('/', http.size());
+  std::string host_port = url.substr(http.size(), path_start - http.size()),
+      path = (path_start == std::string::npos ? "/" : url.substr(path_start)),
+      host = host_port, port = "80";
+  size_t colon = host_port.find(':');
+  if (colon != std::string::npos) {
+    host = host_port.substr(0, colon);
+    port = host_port.substr(colon + 1);
+  }
+  if (host.empty()) {
+    KALDI_WARN << "Invalid URL " << url_in;
+    return -1;
+  }
+  // We retry only if a connection from the pool turned out to be closed.
+  for (int32 attempt = 0; attempt < 3; attempt++) {
+    Connection *conn = GetConnection(host, port, attempt == 0);
+    if (conn == NULL) return -1;
+    bool reusable, retry;
+    int64 n = TryRead(conn, host, path, offset, size, data, &reusable, &retry);
+    if (reusable) ReleaseConnection(conn);
+    else delete conn;
+    if (n >= 0 || !retry) {
+      if (n < 0)
+        KALDI_WARN << "Error reading " << url_in << " at offset " << offset;
+      return n;
+    }
+  }
+  KALDI_WARN << "Error reading " << url_in << " at offset " << offset;
+  return -1;
+}
+
+
+const int64 RemoteInputBuffer::kMinReadSize;
+const int64 RemoteInputBuffer::kMaxReadSize;
+
+RemoteInputBuffer::RemoteInputBuffer(RemoteFileBackend *backend,
+                                     const std::string &url):
+    backend_(backend), url_(url), buffer_start_(0),
+    read_size_(kMinReadSize), at_end_(false), error_(false) {
+  setg(NULL, NULL, NULL);
+}
+
+void RemoteInputBuffer::Seek(int64 offset) {
+  int64 buffer_end = buffer_start_ + (egptr() - eback());
+  if (offset >= buffer_start_ && offset <= buffer_end) {
+    // Within what we have (or just after it, which is still sequential).
+    setg(eback(), eback() + (offset - buffer_start_), egptr());
+    return;
+  }
+  buffer_start_ = offset;
+  read_size_ = kMinReadSize;
+  at_end_ = false;
+  error_ = false;
+  setg(NULL, NULL, NULL);
+}
+
+RemoteInputBuffer::int_type RemoteInputBuffer::underflow() {
+  if (gptr() < egptr())
+    return traits_type::to_int_type(*gptr());
+  if (at_end_ || error_)
+    return traits_type::eof();
+  int64 start = buffer_start_ + (egptr() - eback());
+  buffer_.resize(read_size_);
+  int64 n = backend_->Read(url_, start, read_size_, &(buffer_[0]));
+  buffer_start_ = start;
+  if (n < 0) {
+    error_ = true;
+    n = 0;
+  }
+  at_end_ = (n < read_size_);
+  read_size_ = std::min(2 * read_size_, kMaxReadSize);
+  setg(&(buffer_[0]), &(buffer_[0]), &(buffer_[0]) + n);
+  if (n == 0) return traits_type::eof();
+  return traits_type::to_int_type(*gptr());
+}
+
+RemoteInputBuffer::pos_type
+RemoteInputBuffer::seekoff(off_type off, std::ios_base::seekdir dir,
+                           std::ios_base::openmode which) {
+  int64 pos = buffer_start_ + (gptr() - eback());
+  if (!(which & std::ios_base::in) || dir == std::ios_base::end)
+    return pos_type(off_type(-1));  // We don't know the size.
+  if (dir == std::ios_base::beg) pos = off;
+  else pos += off;
+  if (pos < 0) return pos_type(off_type(-1));
+  Seek(pos);
+  return pos_type(pos);
+}
+
+RemoteInputBuffer::pos_type
+RemoteInputBuffer::seekpos(pos_type pos, std::ios_base::openmode which) {
+  return seekoff(off_type(pos), std::ios_base::beg, which);
+}
+
+}  // end namespace kaldi
@@ -0,0 +1,164 @@
+// util/remote-file.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_UTIL_REMOTE_FILE_H_
+#define KALDI_UTIL_REMOTE_FILE_H_
+
+#include <pthread.h>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "base/kaldi-common.h"
+
+namespace kaldi {
+
+/// \addtogroup io_group
+/// @{
+
+/*
+  Remote files are read through "backends", one per URL scheme, so an
+  rxfilename like "s3://bucket/foo.ark", or "s3://bucket/foo.ark:12345" for an
+  offset (e.g. in an scp file), is read directly by Input without a pipe.
+  Objects are read with range requests, read-ahead buffering, and (for HTTP)
+  connections that are kept open and reused.  The built-in backends are:
+
+    http://host[:port]/path   plain HTTP/1.1.
+    s3://bucket/key           read as http://<endpoint>/bucket/key, where
+                              <endpoint> is $KALDI_S3_ENDPOINT or
+                              s3.amazonaws.com.
+    gs://bucket/key           read as http://<endpoint>/bucket/key, where
+                              <endpoint> is $KALDI_GCS_ENDPOINT or
+                              storage.googleapis.com.
+
+  The built-in backends send unauthenticated requests, so they work for public
+  objects and for endpoints (e.g. a local proxy or gateway) that take care of
+  authentication; for anything else, register your own backend with
+  RegisterRemoteFileBackend(), e.g. one that signs the requests or speaks
+  HTTPS.  Writing remote files is not supported: use a pipe.
+*/
+
+/// The interface of remote-file backends.  Backends must be thread-safe, as
+/// different threads may read different files at the same time.
+class RemoteFileBackend {
+ public:
+  /// Reads up to "size" bytes of the object "url", starting at byte "offset",
+  /// into "data".  Returns the number of bytes read, which is less than
+  /// "size" only if we reached the end of the object, or -1 on error (after
+  /// printing a warning).
+  virtual int64 Read(const std::string &url, int64 offset, int64 size,
+                     char *data) = 0;
+
+  virtual ~RemoteFileBackend() { }
+};
+
+/// Makes "backend" handle URLs that start with "<scheme>://", replacing any
+/// existing backend for that scheme.  Takes ownership of "backend".  Backends
+/// should be registered at the start of the program, before any remote
+/// files are opened.
+void RegisterRemoteFileBackend(const std::string &scheme,
+                               RemoteFileBackend *backend);
+
+/// Returns the backend for "filename" if it starts with "<scheme>://" for a
+/// registered scheme, else NULL.
+RemoteFileBackend *GetRemoteFileBackend(const std::string &filename);
+
+/// Splits a remote rxfilename like "s3://bucket/foo.ark:12345" into the URL
+/// and the offset; if there is no offset, sets *offset to 0.  Returns false
+/// if the offset could not be parsed.
+bool SplitRemoteFilename(const std::string &rxfilename, std::string *url,
+                         int64 *offset);
+
+
+/// The HTTP backend.  If "scheme_prefix" is nonempty, URLs starting with it
+/// are rewritten to start with "http_prefix" instead, which is how the s3://
+/// and gs:// backends work.
+class HttpFileBackend: public RemoteFileBackend {
+ public:
+  HttpFileBackend(const std::string &scheme_prefix = "",
+                  const std::string &http_prefix = "");
+
+  virtual int64 Read(const std::string &url, int64 offset, int64 size,
+                     char *data);
+
+  virtual ~HttpFileBackend();
+
+ private:
+  struct Connection;
+  // Makes one attempt at the request, on "conn", which must be connected.
+  // Returns the number of bytes read, -1 on error; sets *reusable to true if
+  // the connection can be reused.
+  int64 TryRead(Connection *conn, const std::string &host,
+                const std::string &path, int64 offset, int64 size,
+                char *data, bool *reusable, bool *retry);
+  // Returns a connection to host:port, from the pool if possible; NULL on
+  // error.
+  Connection *GetConnection(const std::string &host, const std::string &port,
+                            bool from_pool);
+  void ReleaseConnection(Connection *conn);
+
+  std::string scheme_prefix_;
+  std::string http_prefix_;
+  pthread_mutex_t mutex_;  // protects pool_.
+  std::vector<Connection*> pool_;  // idle connections.
+  KALDI_DISALLOW_COPY_AND_ASSIGN(HttpFileBackend);
+};
+
+
+/// A seekable streambuf that reads a remote file through its backend, with
+/// read-ahead: after each seek we fetch kMinReadSize bytes, and the size of
+/// the requests doubles up to kMaxReadSize while reading sequentially.
+class RemoteInputBuffer: public std::streambuf {
+ public:
+  /// Does not take ownership of "backend".
+  RemoteInputBuffer(RemoteFileBackend *backend, const std::string &url);
+
+  /// Seeks to "offset"; this doesn't contact the server.
+  void Seek(int64 offset);
+
+  const std::string &Url() const { return url_; }
+
+  /// True if the backend returned an error; the stream will just have seen
+  /// end of file.
+  bool HasError() const { return error_; }
+
+  static const int64 kMinReadSize = 1 << 18;
+  static const int64 kMaxReadSize = 1 << 23;
+
+ protected:
+  virtual int_type underflow();
+  virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                           std::ios_base::openmode which);
+  virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which);
+ private:
+  RemoteFileBackend *backend_;
+  std::string url_;
+  std::vector<char> buffer_;
+  int64 buffer_start_;  // offset in the file of the start of the get area.
+  int64 read_size_;  // how much we will fetch next time.
+  bool at_end_;  // true if the last fetch reached the end of the file.
+  bool error_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(RemoteInputBuffer);
+};
+
+/// @} end "addtogroup io_group"
+
+}  // end namespace kaldi
+
+#endif  // KALDI_UTIL_REMOTE_FILE_H_
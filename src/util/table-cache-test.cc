@@ -0,0 +1,119 @@
+// util/table-cache-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdlib>
+
+#include "util/table-cache.h"
+#include "util/table-types.h"
+
+namespace kaldi {
+
+void UnitTestTableCacheKey() {
+  std::string key = TableCache::Key("ark:foo.ark");
+  KALDI_ASSERT(key.size() == 16);
+  KALDI_ASSERT(TableCache::Key("ark,s,cs,cache:foo.ark") == key);
+  KALDI_ASSERT(TableCache::Key("scp:foo.ark") != key);
+  KALDI_ASSERT(TableCache::Key("ark:bar.ark") != key);
+  KALDI_ASSERT(TableCache::Key("foo.ark") == "");
+
+  RspecifierOptions opts;
+  KALDI_ASSERT(ClassifyRspecifier("ark,cache:foo.ark", NULL, &opts) ==
+               kArchiveRspecifier && opts.cache);
+  KALDI_ASSERT(ClassifyRspecifier("ark,cache,ncache:foo.ark", NULL, &opts) ==
+               kArchiveRspecifier && !opts.cache);
+}
+
+void UnitTestTableCache() {
+  const char *dir = "tmp.table-cache";
+  setenv("KALDI_TABLE_CACHE", dir, 1);
+
+  std::vector<std::string> keys;
+  std::vector<Matrix<BaseFloat> > mats;
+  {
+    BaseFloatMatrixWriter writer("ark:tmpf");
+    for (int32 i = 0; i < 5; i++) {
+      keys.push_back(std::string(1, 'a' + i));
+      mats.push_back(Matrix<BaseFloat>(1 + Rand() % 10, 1 + Rand() % 10));
+      mats.back().SetRandn();
+      writer.Write(keys.back(), mats.back());
+    }
+  }
+  std::string rspecifier = "ark,s,cs,cache:tmpf";
+  TableCache cache;
+  KALDI_ASSERT(cache.IsEnabled() && !cache.HasEntry(rspecifier));
+  // Without an entry, we read the original table.
+  KALDI_ASSERT(ResolveCachedRspecifier(rspecifier) == rspecifier);
+
+  std::string wspecifier;
+  KALDI_ASSERT(cache.BeginEntry(rspecifier, &wspecifier));
+  std::string wspecifier2;
+  KALDI_ASSERT(!cache.BeginEntry(rspecifier, &wspecifier2));  // It's locked.
+  {
+    SequentialBaseFloatMatrixReader reader(rspecifier);
+    CompressedMatrixWriter writer(wspecifier);
+    for (; !reader.Done(); reader.Next())
+      writer.Write(reader.Key(), CompressedMatrix(reader.Value()));
+  }
+  KALDI_ASSERT(!cache.HasEntry(rspecifier));  // Not committed yet.
+  cache.CommitEntry(rspecifier);
+  KALDI_ASSERT(cache.HasEntry(rspecifier));
+  KALDI_ASSERT(!cache.BeginEntry(rspecifier, &wspecifier2));  // It exists.
+
+  std::string cached = ResolveCachedRspecifier(rspecifier);
+  KALDI_ASSERT(cached != rspecifier && cached.substr(0, 9) == "s,cs,scp:");
+  // Without "cache", the cache is not used.
+  KALDI_ASSERT(ResolveCachedRspecifier("ark,s,cs:tmpf") == "ark,s,cs:tmpf");
+
+  // The original table is no longer needed.
+  unlink("tmpf");
+  {
+    SequentialBaseFloatMatrixReader reader(rspecifier);
+    size_t i = 0;
+    for (; !reader.Done(); reader.Next(), i++) {
+      KALDI_ASSERT(reader.Key() == keys[i]);
+      Matrix<BaseFloat> mat(CompressedMatrix(mats[i]));
+      KALDI_ASSERT(reader.Value().ApproxEqual(mat, 1.0e-05));
+    }
+    KALDI_ASSERT(i == keys.size());
+  }
+  {
+    RandomAccessBaseFloatMatrixReader reader(rspecifier);
+    KALDI_ASSERT(reader.HasKey("c") && !reader.HasKey("z"));
+    KALDI_ASSERT(reader.Value("c").NumRows() == mats[2].NumRows());
+  }
+
+  KALDI_ASSERT(cache.RemoveEntry(rspecifier) && !cache.HasEntry(rspecifier));
+  KALDI_ASSERT(!cache.RemoveEntry(rspecifier));
+  // An aborted entry leaves nothing behind.
+  KALDI_ASSERT(cache.BeginEntry(rspecifier, &wspecifier));
+  cache.AbortEntry(rspecifier);
+  KALDI_ASSERT(!cache.HasEntry(rspecifier));
+  KALDI_ASSERT(rmdir(dir) == 0);
+  unsetenv("KALDI_TABLE_CACHE");
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  UnitTestTableCacheKey();
+  for (int32 i = 0; i < 3; i++)
+    UnitTestTableCache();
+  std::cout << "Test OK.\n";
+}
@@ -0,0 +1,208 @@
+// util/table-cache.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+#include "util/kaldi-table.h"
+#include "util/table-cache.h"
+#include "util/text-utils.h"
+
+namespace kaldi {
+
+namespace {
+
+std::string CurrentDirectory() {
+  std::vector<char> buffer(4096);
+  while (getcwd(&(buffer[0]), buffer.size()) == NULL) {
+    if (errno != ERANGE)
+      KALDI_ERR << "Could not get the current directory: " << strerror(errno);
+    buffer.resize(buffer.size() * 2);
+  }
+  return std::string(&(buffer[0]));
+}
+
+bool FileExists(const std::string &filename) {
+  struct stat buf;
+  return stat(filename.c_str(), &buf) == 0;
+}
+
+// Splits "rspecifier" into its options (other than the table type and
+// "cache") and its ark/scp part, e.g. "ark,s,cache:foo.ark" -> "s" and
+// "ark:foo.ark".  Returns false if it is not a valid rspecifier.
+bool SplitRspecifier(const std::string &rspecifier, std::string *options,
+                     std::string *table) {
+  std::string rxfilename;
+  RspecifierType rs = ClassifyRspecifier(rspecifier, &rxfilename, NULL);
+  if (rs == kNoRspecifier)
+    return false;
+  size_t pos = rspecifier.find(':');
+  std::vector<std::string> split_options;
+  SplitStringToVector(rspecifier.substr(0, pos), ", ", true, &split_options);
+  options->clear();
+  for (size_t i = 0; i < split_options.size(); i++) {
+    const std::string &str = split_options[i];
+    if (str == "ark" || str == "scp" || str == "cache" || str == "ncache")
+      continue;
+    if (!options->empty()) *options += ",";
+    *options += str;
+  }
+  *table = (rs == kArchiveRspecifier ? "ark:" : "scp:") + rxfilename;
+  return true;
+}
+
+}  // namespace
+
+TableCache::TableCache(const std::string &dir): dir_(dir) {
+  if (dir_.empty()) {
+    const char *value = getenv("KALDI_TABLE_CACHE");
+    if (value != NULL)
+      dir_ = value;
+  }
+  // The script files point into the archives by filename, so a relative
+  // directory would only work from the current directory.
+  if (!dir_.empty() && dir_[0] != '/')
+    dir_ = CurrentDirectory() + "/" + dir_;
+}
+
+std::string TableCache::Key(const std::string &rspecifier) {
+  std::string options, table;
+  if (!SplitRspecifier(rspecifier, &options, &table))
+    return "";
+  // 64-bit FNV-1a.
+  std::string str = CurrentDirectory() + "\n" + table;
+  uint64 hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < str.size(); i++) {
+    hash ^= static_cast<unsigned char>(str[i]);
+    hash *= 1099511628211ULL;
+  }
+  char buf[17];
+  snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(hash));
+  return buf;
+}
+
+std::string TableCache::EntryFilename(const std::string &rspecifier,
+                                      const char *suffix) const {
+  KALDI_ASSERT(IsEnabled());
+  std::string key = Key(rspecifier);
+  if (key.empty())
+    KALDI_ERR << "Invalid rspecifier " << rspecifier;
+  return dir_ + "/" + key + suffix;
+}
+
+bool TableCache::HasEntry(const std::string &rspecifier) const {
+  return IsEnabled() && !Key(rspecifier).empty() &&
+      FileExists(EntryFilename(rspecifier, ".scp"));
+}
+
+std::string TableCache::CachedRspecifier(
+    const std::string &rspecifier) const {
+  std::string options, table;
+  if (!IsEnabled() || !SplitRspecifier(rspecifier, &options, &table))
+    return "";
+  std::string scp = EntryFilename(rspecifier, ".scp");
+  if (!FileExists(scp))
+    return "";
+  return (options.empty() ? "" : options + ",") + "scp:" + scp;
+}
+
+bool TableCache::BeginEntry(const std::string &rspecifier,
+                            std::string *wspecifier) {
+  if (!IsEnabled())
+    KALDI_ERR << "The table cache is not enabled (set KALDI_TABLE_CACHE).";
+  if (HasEntry(rspecifier)) {
+    KALDI_WARN << "The table cache already has an entry for " << rspecifier;
+    return false;
+  }
+  mkdir(dir_.c_str(), 0777);  // In case it doesn't exist; errors show below.
+  std::string lock = EntryFilename(rspecifier, ".lock");
+  int fd = open(lock.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+  if (fd == -1) {
+    if (errno == EEXIST)
+      KALDI_WARN << "The table cache entry for " << rspecifier
+                 << " is being written by another process (if not, remove "
+                 << lock << ")";
+    else
+      KALDI_WARN << "Could not create " << lock << ": " << strerror(errno);
+    return false;
+  }
+  std::ostringstream pid;
+  pid << getpid() << "\n";
+  ssize_t ret = write(fd, pid.str().c_str(), pid.str().size());
+  (void) ret;  // The pid is only informational.
+  close(fd);
+  if (HasEntry(rspecifier)) {  // Another process committed it meanwhile.
+    unlink(lock.c_str());
+    KALDI_WARN << "The table cache already has an entry for " << rspecifier;
+    return false;
+  }
+  *wspecifier = "ark,scp:" + EntryFilename(rspecifier, ".ark") + "," +
+      EntryFilename(rspecifier, ".scp.tmp");
+  return true;
+}
+
+void TableCache::CommitEntry(const std::string &rspecifier) {
+  std::string tmp = EntryFilename(rspecifier, ".scp.tmp"),
+      scp = EntryFilename(rspecifier, ".scp");
+  // rename() is atomic, so readers never see a partial script file.
+  if (rename(tmp.c_str(), scp.c_str()) != 0)
+    KALDI_ERR << "Could not rename " << tmp << " to " << scp << ": "
+              << strerror(errno);
+  unlink(EntryFilename(rspecifier, ".lock").c_str());
+}
+
+void TableCache::AbortEntry(const std::string &rspecifier) {
+  unlink(EntryFilename(rspecifier, ".scp.tmp").c_str());
+  unlink(EntryFilename(rspecifier, ".ark").c_str());
+  unlink(EntryFilename(rspecifier, ".lock").c_str());
+}
+
+bool TableCache::RemoveEntry(const std::string &rspecifier) {
+  if (!IsEnabled())
+    KALDI_ERR << "The table cache is not enabled (set KALDI_TABLE_CACHE).";
+  // Remove the script file first, so that no new reader uses the archive.
+  bool existed = (unlink(EntryFilename(rspecifier, ".scp").c_str()) == 0);
+  unlink(EntryFilename(rspecifier, ".ark").c_str());
+  return existed;
+}
+
+std::string ResolveCachedRspecifier(const std::string &rspecifier) {
+  RspecifierOptions opts;
+  if (ClassifyRspecifier(rspecifier, NULL, &opts) == kNoRspecifier ||
+      !opts.cache)
+    return rspecifier;
+  TableCache cache;
+  if (!cache.IsEnabled())
+    return rspecifier;
+  std::string cached = cache.CachedRspecifier(rspecifier);
+  if (cached.empty()) {
+    KALDI_VLOG(1) << "No table cache entry for " << rspecifier;
+    return rspecifier;
+  }
+  KALDI_VLOG(1) << "Reading " << rspecifier << " from the table cache, as "
+                << cached;
+  return cached;
+}
+
+}  // namespace kaldi
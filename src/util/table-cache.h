@@ -0,0 +1,111 @@
+// util/table-cache.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_UTIL_TABLE_CACHE_H_
+#define KALDI_UTIL_TABLE_CACHE_H_
+
+#include <string>
+
+#include "base/kaldi-common.h"
+
+namespace kaldi {
+
+/// \addtogroup table_group
+/// @{
+
+/*
+  A table cache is a directory on a node-local disk (e.g. /dev/shm, which is
+  in memory, or a local SSD) holding copies of tables, typically features
+  after an expensive pipeline like
+    "ark,s,cs:apply-cmvn ... scp:feats.scp ark:- | splice-feats ark:- ark:- |"
+  so that the jobs on a node that read the same table don't each run the
+  pipeline (and read feats.scp over NFS) again.  Each entry is an archive with
+  a script file pointing into it; the program cache-feats creates entries
+  (storing the features as CompressedMatrix), and readers use an entry when
+  the rspecifier has the "cache" option, e.g.
+    "ark,s,cs,cache:apply-cmvn ... |"
+  and the environment variable KALDI_TABLE_CACHE is set to the directory.
+  If the entry does not exist (or is still being written), the reader reads
+  the original table as if "cache" were not there.  As the files are shared
+  through the page cache, all the jobs on the node share one copy in memory.
+
+  The entries are keyed by the current directory and the rspecifier without
+  its options, not by the contents of the files it refers to: if you change
+  those, remove the entry (cache-feats --remove) or the directory.
+*/
+class TableCache {
+ public:
+  /// If "dir" is empty, the directory is the value of KALDI_TABLE_CACHE,
+  /// and if that is not set the cache is disabled.
+  explicit TableCache(const std::string &dir = "");
+
+  bool IsEnabled() const { return !dir_.empty(); }
+
+  const std::string &Dir() const { return dir_; }
+
+  /// Returns the key of the entry for "rspecifier", a 16-digit hex string
+  /// that depends on the current directory and on the rspecifier without its
+  /// options; "ark,s,cs:foo.ark" and "ark:foo.ark" have the same key.
+  /// Returns "" if "rspecifier" is not a valid rspecifier.
+  static std::string Key(const std::string &rspecifier);
+
+  /// Returns true if a complete entry for "rspecifier" exists.
+  bool HasEntry(const std::string &rspecifier) const;
+
+  /// If a complete entry for "rspecifier" exists, returns an rspecifier that
+  /// reads it: "scp:" and the entry's script file, with the options of
+  /// "rspecifier" (other than "cache").  Otherwise returns "".
+  std::string CachedRspecifier(const std::string &rspecifier) const;
+
+  /// Starts writing the entry for "rspecifier": this takes the entry's lock
+  /// and outputs to "wspecifier" a wspecifier ("ark,scp:...") to which the
+  /// table should be written.  It returns false (with a warning) if the
+  /// entry already exists or is locked by another process.  The entry only
+  /// becomes visible to readers when CommitEntry() is called; call
+  /// AbortEntry() instead on failure.  The writer must be closed first.
+  bool BeginEntry(const std::string &rspecifier, std::string *wspecifier);
+
+  /// See BeginEntry().  Throws on error.
+  void CommitEntry(const std::string &rspecifier);
+
+  /// Removes what BeginEntry() and the writer created, including the lock.
+  void AbortEntry(const std::string &rspecifier);
+
+  /// Removes the entry for "rspecifier", if it exists; returns true if it
+  /// did.  If a reader has the entry open, it will still be able to finish
+  /// reading it.
+  bool RemoveEntry(const std::string &rspecifier);
+
+ private:
+  // Returns dir_ + "/" + Key(rspecifier) + suffix, e.g. suffix = ".scp".
+  std::string EntryFilename(const std::string &rspecifier,
+                            const char *suffix) const;
+
+  std::string dir_;
+};
+
+/// Used by SequentialTableReader and RandomAccessTableReader: if
+/// "rspecifier" has the "cache" option and the table cache (see TableCache)
+/// has an entry for it, returns the rspecifier that reads the entry;
+/// otherwise returns "rspecifier".
+std::string ResolveCachedRspecifier(const std::string &rspecifier);
+
+/// @} end "addtogroup table_group"
+
+}  // namespace kaldi
+
+#endif  // KALDI_UTIL_TABLE_CACHE_H_
@@ -0,0 +1,142 @@
+// util/table-io-stats-test.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <unistd.h>
+#include <cstdlib>
+#include <sstream>
+
+#include "util/table-io-stats.h"
+#include "util/kaldi-io.h"
+#include "util/table-types.h"
+
+namespace kaldi {
+
+// Tests that Input and Output count bytes and seeks, without changing what is
+// read or written.
+void UnitTestTableIoStreams() {
+  std::string data;
+  for (int32 i = 0; i < 100000; i++)
+    data.push_back(static_cast<char>(Rand() % 256));
+  TableIoStats stats;
+  {
+    TableIoStatsScope scope(&stats);
+    Output ko("tmpf", true, false);
+    ko.Stream().put(data[0]);
+    ko.Stream().write(data.data() + 1, 10);
+    KALDI_ASSERT(ko.Stream().tellp() == 11);
+    ko.Stream() << data.substr(11);
+    KALDI_ASSERT(ko.Close());
+  }
+  KALDI_ASSERT(stats.num_bytes == static_cast<int64>(data.size()) &&
+               stats.num_seeks == 0);
+  {
+    TableIoStatsScope scope(&stats);
+    Input ki("tmpf");
+    std::istream &is = ki.Stream();
+    KALDI_ASSERT(is.peek() == static_cast<unsigned char>(data[0]));
+    KALDI_ASSERT(is.get() == static_cast<unsigned char>(data[0]));
+    is.unget();
+    KALDI_ASSERT(is.tellg() == 0);
+    std::string str(data.size(), ' ');
+    is.read(&(str[0]), str.size());
+    KALDI_ASSERT(str == data && is.peek() == -1);
+    is.clear();
+    is.seekg(10);
+    KALDI_ASSERT(is.get() == static_cast<unsigned char>(data[10]));
+  }
+  KALDI_ASSERT(stats.num_bytes == 2 * static_cast<int64>(data.size()) + 1 &&
+               stats.num_seeks == 1);
+  {
+    TableIoStatsScope scope(&stats);
+    Input ki("tmpf:20");
+    KALDI_ASSERT(ki.Stream().get() == static_cast<unsigned char>(data[20]));
+  }
+  KALDI_ASSERT(stats.num_seeks == 2);
+  // Without a current TableIoStats, nothing is counted.
+  {
+    Input ki("tmpf");
+    ki.Stream().get();
+  }
+  KALDI_ASSERT(stats.num_bytes == 2 * static_cast<int64>(data.size()) + 2);
+  KALDI_ASSERT(stats.total_time >= stats.io_time && stats.io_time >= 0.0);
+  unlink("tmpf");
+}
+
+// Tests the per-table counters, which main() has switched on.
+void UnitTestTableIoStatsSummary() {
+  int32 num_objects = 20;
+  {
+    Int32VectorWriter writer("ark:tmpf.ark");
+    std::vector<int32> v(1000, 5);
+    for (int32 i = 0; i < num_objects; i++) {
+      std::ostringstream key;
+      key << "key" << i;
+      writer.Write(key.str(), v);
+    }
+  }
+  for (int32 bg = 0; bg < 2; bg++) {
+    SequentialInt32VectorReader reader(bg ? "ark,bg:tmpf.ark" : "ark:tmpf.ark");
+    for (; !reader.Done(); reader.Next())
+      KALDI_ASSERT(reader.Value().size() == 1000);
+  }
+  RandomAccessInt32VectorReader random_reader("scp:echo key3 tmpf.ark:5 |");
+  KALDI_ASSERT(random_reader.Value("key3").size() == 1000);
+  KALDI_ASSERT(random_reader.Close());
+
+  int64 size;
+  {
+    Input ki("tmpf.ark");
+    ki.Stream().seekg(0, std::ios::end);
+    size = ki.Stream().tellg();
+  }
+  std::ostringstream os;
+  WriteTableIoStatsSummary(os, true);
+  KALDI_LOG << "Summary is:\n" << os.str();
+  std::ostringstream bytes;
+  bytes << "\"objects\": " << num_objects << ", \"bytes\": " << size << ",";
+  std::istringstream is(os.str());
+  std::string line;
+  int32 num_lines = 0;
+  while (std::getline(is, line)) {
+    num_lines++;
+    if (line.find("\"table\": \"RandomAccessTableReader\"") !=
+        std::string::npos)
+      KALDI_ASSERT(line.find("\"objects\": 1,") != std::string::npos);
+    else
+      KALDI_ASSERT(line.find(bytes.str()) != std::string::npos);
+  }
+  // The writer, the two sequential readers and the random-access reader.
+  KALDI_ASSERT(num_lines == 4);
+  os.str("");
+  WriteTableIoStatsSummary(os, false);
+  KALDI_LOG << "Summary is:\n" << os.str();
+  unlink("tmpf.ark");
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  // This has to be done before anything else looks at the stats.
+  setenv("KALDI_TABLE_STATS", "json", 1);
+  for (int32 i = 0; i < 3; i++)
+    UnitTestTableIoStreams();
+  UnitTestTableIoStatsSummary();
+  std::cout << "Test OK.\n";
+}
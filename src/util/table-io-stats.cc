@@ -0,0 +1,384 @@
+// util/table-io-stats.cc
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <pthread.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <utility>
+
+#include "util/table-io-stats.h"
+
+namespace kaldi {
+
+namespace {
+
+enum TableIoStatsMode {
+  kTableIoStatsOff,
+  kTableIoStatsLog,
+  kTableIoStatsJsonLog,
+  kTableIoStatsJsonFile
+};
+
+pthread_once_t g_table_io_stats_once = PTHREAD_ONCE_INIT;
+pthread_key_t g_table_io_stats_key;
+TableIoStatsMode g_table_io_stats_mode = kTableIoStatsOff;
+std::string *g_table_io_stats_json_file = NULL;
+
+// The summary, indexed by (table type, specifier), and protected by
+// g_table_io_stats_mutex.  It is never deleted, as it's used at exit.
+typedef std::map<std::pair<std::string, std::string>, TableIoStats>
+    TableIoStatsSummary;
+TableIoStatsSummary *g_table_io_stats_summary = NULL;
+pthread_mutex_t g_table_io_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void PrintTableIoStatsAtExit() {
+  if (g_table_io_stats_mode == kTableIoStatsJsonFile) {
+    std::ofstream os(g_table_io_stats_json_file->c_str(), std::ios::app);
+    WriteTableIoStatsSummary(os, true);
+    if (!os.good())
+      KALDI_WARN << "Error writing table I/O stats to "
+                 << *g_table_io_stats_json_file;
+    return;
+  }
+  std::ostringstream os;
+  WriteTableIoStatsSummary(os, g_table_io_stats_mode == kTableIoStatsJsonLog);
+  std::istringstream is(os.str());
+  std::string line;
+  while (std::getline(is, line))
+    KALDI_LOG << line;
+}
+
+void InitTableIoStats() {
+  int ret = pthread_key_create(&g_table_io_stats_key, NULL);
+  if (ret != 0)
+    KALDI_ERR << "Error creating thread-local key (errno = " << ret << ")";
+  const char *value = getenv("KALDI_TABLE_STATS");
+  if (value == NULL || *value == '\0' || !strcmp(value, "0"))
+    return;
+  if (!strcmp(value, "json")) {
+    g_table_io_stats_mode = kTableIoStatsJsonLog;
+  } else if (!strncmp(value, "json:", 5) && value[5] != '\0') {
+    g_table_io_stats_mode = kTableIoStatsJsonFile;
+    g_table_io_stats_json_file = new std::string(value + 5);
+  } else {
+    if (strcmp(value, "1"))
+      KALDI_WARN << "Unknown value of KALDI_TABLE_STATS: '" << value
+                 << "', treating it as 1.";
+    g_table_io_stats_mode = kTableIoStatsLog;
+  }
+  g_table_io_stats_summary = new TableIoStatsSummary();
+  atexit(PrintTableIoStatsAtExit);
+}
+
+void WriteJsonString(std::ostream &os, const std::string &str) {
+  os << '"';
+  for (size_t i = 0; i < str.size(); i++) {
+    unsigned char c = str[i];
+    if (c == '"' || c == '\\') {
+      os << '\\' << c;
+    } else if (c < 0x20) {
+      const char *hex = "0123456789abcdef";
+      os << "\\u00" << hex[c >> 4] << hex[c & 15];
+    } else {
+      os << c;
+    }
+  }
+  os << '"';
+}
+
+}  // namespace
+
+void TableIoStats::Add(const TableIoStats &other) {
+  num_objects += other.num_objects;
+  num_bytes += other.num_bytes;
+  num_seeks += other.num_seeks;
+  io_time += other.io_time;
+  total_time += other.total_time;
+}
+
+TableIoStats *TableIoStats::New(const std::string &table_type,
+                               const std::string &specifier) {
+  pthread_once(&g_table_io_stats_once, InitTableIoStats);
+  if (g_table_io_stats_mode == kTableIoStatsOff)
+    return NULL;
+  TableIoStats *ans = new TableIoStats();
+  ans->table_type = table_type;
+  ans->specifier = specifier;
+  return ans;
+}
+
+void TableIoStats::Report(TableIoStats *stats) {
+  if (stats == NULL)
+    return;
+  KALDI_ASSERT(g_table_io_stats_summary != NULL);
+  pthread_mutex_lock(&g_table_io_stats_mutex);
+  (*g_table_io_stats_summary)[std::make_pair(stats->table_type,
+                                             stats->specifier)].Add(*stats);
+  pthread_mutex_unlock(&g_table_io_stats_mutex);
+  delete stats;
+}
+
+TableIoStats *TableIoStats::Current() {
+  pthread_once(&g_table_io_stats_once, InitTableIoStats);
+  return static_cast<TableIoStats*>(
+      pthread_getspecific(g_table_io_stats_key));
+}
+
+void TableIoStats::SetCurrent(TableIoStats *stats) {
+  pthread_once(&g_table_io_stats_once, InitTableIoStats);
+  pthread_setspecific(g_table_io_stats_key, stats);
+}
+
+void WriteTableIoStatsSummary(std::ostream &os, bool json) {
+  if (g_table_io_stats_summary == NULL)
+    return;
+  std::string program(g_program_name == NULL ? "" : g_program_name);
+  if (!program.empty() && program[program.size() - 1] == ':')
+    program.resize(program.size() - 1);
+  pthread_mutex_lock(&g_table_io_stats_mutex);
+  for (TableIoStatsSummary::const_iterator iter =
+           g_table_io_stats_summary->begin();
+       iter != g_table_io_stats_summary->end(); ++iter) {
+    const std::string &table_type = iter->first.first,
+        &specifier = iter->first.second;
+    const TableIoStats &stats = iter->second;
+    double parse_time = std::max(stats.total_time - stats.io_time, 0.0);
+    if (json) {
+      os << "{\"program\": ";
+      WriteJsonString(os, program);
+      os << ", \"table\": ";
+      WriteJsonString(os, table_type);
+      os << ", \"specifier\": ";
+      WriteJsonString(os, specifier);
+      os << ", \"objects\": " << stats.num_objects
+         << ", \"bytes\": " << stats.num_bytes
+         << ", \"seeks\": " << stats.num_seeks
+         << ", \"io_time\": " << stats.io_time
+         << ", \"parse_time\": " << parse_time << "}\n";
+    } else {
+      os << table_type << ' ' << specifier << ": " << stats.num_objects
+         << " objects, " << stats.num_bytes << " bytes, " << stats.num_seeks
+         << " seeks, " << stats.io_time << "s blocked on I/O, " << parse_time
+         << "s parsing";
+      if (stats.io_time > 0.0)
+        os << " (" << (stats.num_bytes / stats.io_time / 1.0e+06)
+           << " MB/s while blocked)";
+      os << '\n';
+    }
+  }
+  pthread_mutex_unlock(&g_table_io_stats_mutex);
+}
+
+TableIoStatsScope::TableIoStatsScope(TableIoStats *stats):
+    stats_(stats), prev_stats_(NULL), timer_(NULL) {
+  if (stats_ != NULL) {
+    prev_stats_ = TableIoStats::Current();
+    TableIoStats::SetCurrent(stats_);
+    timer_ = new Timer();
+  }
+}
+
+TableIoStatsScope::~TableIoStatsScope() {
+  if (stats_ != NULL) {
+    stats_->total_time += timer_->Elapsed();
+    delete timer_;
+    TableIoStats::SetCurrent(prev_stats_);
+  }
+}
+
+TableIoBlockedTimer::TableIoBlockedTimer():
+    stats_(TableIoStats::Current()), timer_(NULL) {
+  if (stats_ != NULL)
+    timer_ = new Timer();
+}
+
+TableIoBlockedTimer::~TableIoBlockedTimer() {
+  if (stats_ != NULL) {
+    stats_->io_time += timer_->Elapsed();
+    delete timer_;
+  }
+}
+
+
+// In TableIoInputBuffer we only time calls that may have to refill the
+// buffer of src_, i.e. when in_avail() is not positive; in_avail() is cheap
+// when src_ has data buffered.
+
+TableIoInputBuffer::int_type TableIoInputBuffer::underflow() {
+  if (src_->in_avail() > 0)
+    return src_->sgetc();
+  TableIoBlockedTimer timer;
+  return src_->sgetc();
+}
+
+TableIoInputBuffer::int_type TableIoInputBuffer::uflow() {
+  int_type c;
+  if (src_->in_avail() > 0) {
+    c = src_->sbumpc();
+  } else {
+    TableIoBlockedTimer timer;
+    c = src_->sbumpc();
+  }
+  TableIoStats *stats = TableIoStats::Current();
+  if (stats != NULL && !traits_type::eq_int_type(c, traits_type::eof()))
+    stats->num_bytes++;
+  return c;
+}
+
+std::streamsize TableIoInputBuffer::xsgetn(char *s, std::streamsize n) {
+  std::streamsize ans;
+  if (src_->in_avail() >= n) {
+    ans = src_->sgetn(s, n);
+  } else {
+    TableIoBlockedTimer timer;
+    ans = src_->sgetn(s, n);
+  }
+  TableIoStats *stats = TableIoStats::Current();
+  if (stats != NULL)
+    stats->num_bytes += ans;
+  return ans;
+}
+
+TableIoInputBuffer::int_type TableIoInputBuffer::pbackfail(int_type c) {
+  int_type ans = (traits_type::eq_int_type(c, traits_type::eof()) ?
+                  src_->sungetc() :
+                  src_->sputbackc(traits_type::to_char_type(c)));
+  TableIoStats *stats = TableIoStats::Current();
+  if (stats != NULL && !traits_type::eq_int_type(ans, traits_type::eof()))
+    stats->num_bytes--;
+  return ans;
+}
+
+std::streamsize TableIoInputBuffer::showmanyc() {
+  return src_->in_avail();
+}
+
+TableIoInputBuffer::pos_type TableIoInputBuffer::seekoff(
+    off_type off, std::ios_base::seekdir way, std::ios_base::openmode which) {
+  if (off == 0 && way == std::ios_base::cur)  // This is a tell(), not a seek.
+    return src_->pubseekoff(off, way, which);
+  TableIoStats *stats = TableIoStats::Current();
+  if (stats != NULL)
+    stats->num_seeks++;
+  TableIoBlockedTimer timer;
+  return src_->pubseekoff(off, way, which);
+}
+
+TableIoInputBuffer::pos_type TableIoInputBuffer::seekpos(
+    pos_type pos, std::ios_base::openmode which) {
+  TableIoStats *stats = TableIoStats::Current();
+  if (stats != NULL)
+    stats->num_seeks++;
+  TableIoBlockedTimer timer;
+  return src_->pubseekpos(pos, which);
+}
+
+
+TableIoOutputBuffer::TableIoOutputBuffer(std::streambuf *src):
+    src_(src), buffer_(kBufferSize) {
+  setp(&(buffer_[0]), &(buffer_[0]) + buffer_.size());
+}
+
+bool TableIoOutputBuffer::FlushBuffer() {
+  std::streamsize n = pptr() - pbase();
+  if (n == 0)
+    return true;
+  std::streamsize written;
+  {
+    TableIoBlockedTimer timer;
+    written = src_->sputn(pbase(), n);
+  }
+  TableIoStats *stats = TableIoStats::Current();
+  if (stats != NULL)
+    stats->num_bytes += written;
+  setp(&(buffer_[0]), &(buffer_[0]) + buffer_.size());
+  return (written == n);
+}
+
+TableIoOutputBuffer::int_type TableIoOutputBuffer::overflow(int_type c) {
+  if (!FlushBuffer())
+    return traits_type::eof();
+  if (traits_type::eq_int_type(c, traits_type::eof()))
+    return traits_type::not_eof(c);
+  *pptr() = traits_type::to_char_type(c);
+  pbump(1);
+  return c;
+}
+
+std::streamsize TableIoOutputBuffer::xsputn(const char *s,
+                                            std::streamsize n) {
+  if (n <= epptr() - pptr()) {
+    memcpy(pptr(), s, n);
+    pbump(static_cast<int>(n));
+    return n;
+  }
+  // Large writes go straight to src_.
+  if (!FlushBuffer())
+    return 0;
+  std::streamsize written;
+  {
+    TableIoBlockedTimer timer;
+    written = src_->sputn(s, n);
+  }
+  TableIoStats *stats = TableIoStats::Current();
+  if (stats != NULL)
+    stats->num_bytes += written;
+  return written;
+}
+
+int TableIoOutputBuffer::sync() {
+  if (!FlushBuffer())
+    return -1;
+  TableIoBlockedTimer timer;
+  return src_->pubsync();
+}
+
+TableIoOutputBuffer::pos_type TableIoOutputBuffer::seekoff(
+    off_type off, std::ios_base::seekdir way, std::ios_base::openmode which) {
+  if (off == 0 && way == std::ios_base::cur) {  // This is a tell().
+    pos_type pos = src_->pubseekoff(off, way, which);
+    if (pos == pos_type(off_type(-1)))
+      return pos;
+    return pos + off_type(pptr() - pbase());
+  }
+  if (!FlushBuffer())
+    return pos_type(off_type(-1));
+  TableIoStats *stats = TableIoStats::Current();
+  if (stats != NULL)
+    stats->num_seeks++;
+  TableIoBlockedTimer timer;
+  return src_->pubseekoff(off, way, which);
+}
+
+TableIoOutputBuffer::pos_type TableIoOutputBuffer::seekpos(
+    pos_type pos, std::ios_base::openmode which) {
+  if (!FlushBuffer())
+    return pos_type(off_type(-1));
+  TableIoStats *stats = TableIoStats::Current();
+  if (stats != NULL)
+    stats->num_seeks++;
+  TableIoBlockedTimer timer;
+  return src_->pubseekpos(pos, which);
+}
+
+}  // namespace kaldi
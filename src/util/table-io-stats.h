@@ -0,0 +1,178 @@
+// util/table-io-stats.h
+
+// Copyright 2016  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_UTIL_TABLE_IO_STATS_H_
+#define KALDI_UTIL_TABLE_IO_STATS_H_
+
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+
+namespace kaldi {
+
+/// \addtogroup table_group
+/// @{
+
+/*
+  Table I/O statistics are opt-in counters kept for each SequentialTableReader,
+  RandomAccessTableReader and TableWriter, which tell you whether a program is
+  I/O-bound.  They are switched on by the environment variable
+  KALDI_TABLE_STATS, and are summarized when the program exits:
+
+    KALDI_TABLE_STATS=1           one KALDI_LOG line per table.
+    KALDI_TABLE_STATS=json        one KALDI_LOG line of JSON per table.
+    KALDI_TABLE_STATS=json:FILE   append one line of JSON per table to FILE.
+
+  As environment variables are inherited, you can set it for a whole pipeline
+  (or a whole recipe) and compare the stages.  Tables with the same type and
+  specifier (e.g. a reader opened once per iteration) are summed together.
+
+  The counters are: the number of objects read or written; the number of bytes
+  on the underlying streams (for block-compressed archives this is the
+  uncompressed size); the number of seeks, including opening an rxfilename with
+  an offset; "io_time", the time the program was blocked opening, seeking,
+  reading or writing streams, or waiting for the background thread of the "bg"
+  option; and "parse_time", the rest of the time spent in the table's
+  functions, which is mostly parsing or serializing objects.  With "bg", the
+  bytes and seeks of the background thread are counted but its time is not, as
+  it doesn't block the program.
+*/
+
+/// The counters for one table; see above.
+struct TableIoStats {
+  std::string table_type;  // e.g. "TableWriter".
+  std::string specifier;
+  int64 num_objects;
+  int64 num_bytes;
+  int64 num_seeks;
+  double io_time;  // Seconds blocked on I/O.
+  // Total seconds in the table's functions, including io_time; the parse time
+  // is total_time - io_time.
+  double total_time;
+
+  TableIoStats(): num_objects(0), num_bytes(0), num_seeks(0), io_time(0.0),
+                  total_time(0.0) { }
+
+  /// Adds the counters (not the names) of "other" to this.
+  void Add(const TableIoStats &other);
+
+  /// Returns a new, zeroed object if KALDI_TABLE_STATS is set, else NULL.
+  /// The table classes call this when they are opened.
+  static TableIoStats *New(const std::string &table_type,
+                           const std::string &specifier);
+
+  /// Adds *stats to the summary that is printed at exit, under its table type
+  /// and specifier, and deletes it.  Does nothing if stats == NULL.
+  static void Report(TableIoStats *stats);
+
+  /// Returns the counters that I/O done in this thread should be added to,
+  /// or NULL; see TableIoStatsScope.  Input and Output only count I/O for
+  /// streams that were opened while this was non-NULL.
+  static TableIoStats *Current();
+
+  /// Sets the value returned by Current() in this thread.  Normally you would
+  /// use TableIoStatsScope instead.
+  static void SetCurrent(TableIoStats *stats);
+};
+
+/// Writes the summary of the tables reported so far, one table per line, as
+/// text or as JSON.  This is what is printed at exit.
+void WriteTableIoStatsSummary(std::ostream &os, bool json);
+
+/// The table classes create one of these in each of their functions: while it
+/// exists, "stats" is TableIoStats::Current() for this thread, and its
+/// lifetime is added to stats->total_time.  Does nothing if stats == NULL.
+class TableIoStatsScope {
+ public:
+  explicit TableIoStatsScope(TableIoStats *stats);
+  ~TableIoStatsScope();
+ private:
+  TableIoStats *stats_;
+  TableIoStats *prev_stats_;
+  Timer *timer_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(TableIoStatsScope);
+};
+
+/// The lifetime of this object is added to the io_time of
+/// TableIoStats::Current(), if it is non-NULL; it is used around operations
+/// that may block, such as opening files or waiting for other threads.
+class TableIoBlockedTimer {
+ public:
+  TableIoBlockedTimer();
+  ~TableIoBlockedTimer();
+ private:
+  TableIoStats *stats_;
+  Timer *timer_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(TableIoBlockedTimer);
+};
+
+/// A streambuf that reads from another streambuf, counting bytes, seeks and
+/// blocked time into TableIoStats::Current().  It does no buffering of its
+/// own, so the underlying stream is left exactly where the reader stopped;
+/// only reads that have to refill the underlying buffer are timed.  Input
+/// reads through one of these when it was opened with stats enabled.
+class TableIoInputBuffer: public std::streambuf {
+ public:
+  explicit TableIoInputBuffer(std::streambuf *src): src_(src) { }
+  void SetSource(std::streambuf *src) { src_ = src; }
+ protected:
+  virtual int_type underflow();
+  virtual int_type uflow();
+  virtual std::streamsize xsgetn(char *s, std::streamsize n);
+  virtual int_type pbackfail(int_type c);
+  virtual std::streamsize showmanyc();
+  virtual pos_type seekoff(off_type off, std::ios_base::seekdir way,
+                           std::ios_base::openmode which);
+  virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which);
+ private:
+  std::streambuf *src_;
+};
+
+/// A streambuf that writes to another streambuf, counting bytes, seeks and
+/// blocked time into TableIoStats::Current().  It buffers the output (so the
+/// writes can be timed without timing every character) and passes it on when
+/// the buffer is full, on flush, and when the stream position is needed.
+/// Output writes through one of these when it was opened with stats enabled.
+class TableIoOutputBuffer: public std::streambuf {
+ public:
+  explicit TableIoOutputBuffer(std::streambuf *src);
+ protected:
+  virtual int_type overflow(int_type c);
+  virtual std::streamsize xsputn(const char *s, std::streamsize n);
+  virtual int sync();
+  virtual pos_type seekoff(off_type off, std::ios_base::seekdir way,
+                           std::ios_base::openmode which);
+  virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which);
+ private:
+  // Writes the buffered data to src_; returns false on error.
+  bool FlushBuffer();
+  static const size_t kBufferSize = 65536;
+  std::streambuf *src_;
+  std::vector<char> buffer_;
+};
+
+/// @} end "addtogroup table_group"
+
+}  // namespace kaldi
+
+#endif  // KALDI_UTIL_TABLE_IO_STATS_H_